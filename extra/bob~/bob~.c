@@ -4,6 +4,7 @@
 
 #include "m_pd.h"
 #include <math.h>
+#include <string.h>
 #define DIM 4
 #define FLOAT double
 
@@ -13,6 +14,17 @@ doubles the computation time, so it's only compiled in for testing. */
 
 /* #define CALCERROR */
 
+/* With a multichannel input, bob~ runs a filter for each channel.  With
+SSE2 these are solved two at a time, one in each lane of the registers;
+this does the same arithmetic as the scalar code below, in the same order,
+so the output is the same either way. */
+
+#if !defined(CALCERROR) && (defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define BOB_SSE2
+#include <emmintrin.h>
+#endif
+
 typedef struct _params
 {
     FLOAT p_input;
@@ -124,6 +136,100 @@ static void solver_rungekutte(FLOAT *state, FLOAT *errorestimate,
 #endif
 }
 
+    /* cheaper 2nd-order (midpoint) method: half the derivative evaluations
+    of Runge-Kutte, and less accurate, especially near Nyquist */
+static void solver_midpoint(FLOAT *state, FLOAT *errorestimate,
+    FLOAT stepsize, t_params *params)
+{
+    int i;
+    FLOAT deriv1[DIM], deriv2[DIM], tempstate[DIM];
+    *errorestimate = 0;
+    calc_derivatives(deriv1, state, params);
+    for (i = 0; i < DIM; i++)
+        tempstate[i] = state[i] + 0.5 * stepsize * deriv1[i];
+    calc_derivatives(deriv2, tempstate, params);
+    for (i = 0; i < DIM; i++)
+        state[i] += stepsize * deriv2[i];
+}
+
+typedef void (*t_solver)(FLOAT *state, FLOAT *errorestimate,
+    FLOAT stepsize, t_params *params);
+
+#ifdef BOB_SSE2
+    /* the same, for two filters at once */
+typedef struct _params2
+{
+    __m128d p_input;
+    __m128d p_k;            /* 2 pi cutoff */
+    __m128d p_resonance;
+    __m128d p_saturation;
+    __m128d p_satinv;
+} t_params2;
+
+static inline __m128d clip2(__m128d value, __m128d saturation,
+    __m128d saturationinverse)
+{
+    __m128d v2 = _mm_min_pd(_mm_max_pd(_mm_mul_pd(value, saturationinverse),
+        _mm_set1_pd(-1)), _mm_set1_pd(1));
+    v2 = _mm_cvtps_pd(_mm_cvtpd_ps(v2));    /* as "float v2" above */
+    return (_mm_mul_pd(saturation, _mm_sub_pd(v2, _mm_mul_pd(_mm_mul_pd(
+        _mm_mul_pd(_mm_set1_pd(1./3.), v2), v2), v2))));
+}
+
+static inline void calc_derivatives2(__m128d *dstate, const __m128d *state,
+    const t_params2 *p)
+{
+    __m128d sat = p->p_saturation, satinv = p->p_satinv, k = p->p_k;
+    __m128d satstate0 = clip2(state[0], sat, satinv);
+    __m128d satstate1 = clip2(state[1], sat, satinv);
+    __m128d satstate2 = clip2(state[2], sat, satinv);
+    dstate[0] = _mm_mul_pd(k, _mm_sub_pd(clip2(_mm_sub_pd(p->p_input,
+        _mm_mul_pd(p->p_resonance, state[3])), sat, satinv), satstate0));
+    dstate[1] = _mm_mul_pd(k, _mm_sub_pd(satstate0, satstate1));
+    dstate[2] = _mm_mul_pd(k, _mm_sub_pd(satstate1, satstate2));
+    dstate[3] = _mm_mul_pd(k, _mm_sub_pd(satstate2,
+        clip2(state[3], sat, satinv)));
+}
+
+static inline void solver_rungekutte2(__m128d *state, FLOAT stepsize,
+    const t_params2 *p)
+{
+    __m128d deriv1[DIM], deriv2[DIM], deriv3[DIM], deriv4[DIM],
+        tempstate[DIM], two = _mm_set1_pd(2);
+    __m128d half = _mm_set1_pd(0.5 * stepsize), whole = _mm_set1_pd(stepsize),
+        sixth = _mm_set1_pd((1./6.) * stepsize);
+    int i;
+    calc_derivatives2(deriv1, state, p);
+    for (i = 0; i < DIM; i++)
+        tempstate[i] = _mm_add_pd(state[i], _mm_mul_pd(half, deriv1[i]));
+    calc_derivatives2(deriv2, tempstate, p);
+    for (i = 0; i < DIM; i++)
+        tempstate[i] = _mm_add_pd(state[i], _mm_mul_pd(half, deriv2[i]));
+    calc_derivatives2(deriv3, tempstate, p);
+    for (i = 0; i < DIM; i++)
+        tempstate[i] = _mm_add_pd(state[i], _mm_mul_pd(whole, deriv3[i]));
+    calc_derivatives2(deriv4, tempstate, p);
+    for (i = 0; i < DIM; i++)
+        state[i] = _mm_add_pd(state[i], _mm_mul_pd(sixth, _mm_add_pd(
+            _mm_add_pd(_mm_add_pd(deriv1[i], _mm_mul_pd(two, deriv2[i])),
+                _mm_mul_pd(two, deriv3[i])), deriv4[i])));
+}
+
+static inline void solver_midpoint2(__m128d *state, FLOAT stepsize,
+    const t_params2 *p)
+{
+    __m128d deriv1[DIM], deriv2[DIM], tempstate[DIM];
+    __m128d half = _mm_set1_pd(0.5 * stepsize), whole = _mm_set1_pd(stepsize);
+    int i;
+    calc_derivatives2(deriv1, state, p);
+    for (i = 0; i < DIM; i++)
+        tempstate[i] = _mm_add_pd(state[i], _mm_mul_pd(half, deriv1[i]));
+    calc_derivatives2(deriv2, tempstate, p);
+    for (i = 0; i < DIM; i++)
+        state[i] = _mm_add_pd(state[i], _mm_mul_pd(whole, deriv2[i]));
+}
+#endif /* BOB_SSE2 */
+
 typedef struct _bob
 {
     t_object x_obj;
@@ -134,10 +240,12 @@ typedef struct _bob
     FLOAT x_cumerror;
 #endif
     t_params x_params;
-    FLOAT x_state[DIM];
+    FLOAT *x_state;         /* DIM state variables for each filter */
+    int x_nfilters;         /* number of filters (input channels) */
     FLOAT x_sr;
     int x_oversample;
     int x_errorcount;
+    int x_midpoint;         /* use the cheaper solver */
 } t_bob;
 
 static t_class *bob_class;
@@ -159,8 +267,10 @@ static void bob_oversample(t_bob *x, t_float oversample)
 static void bob_clear(t_bob *x)
 {
     int i;
+    for (i = 0; i < DIM * x->x_nfilters; i++)
+        x->x_state[i] = 0;
     for (i = 0; i < DIM; i++)
-        x->x_state[i] = x->x_params.p_derivativeswere[i] = 0;
+        x->x_params.p_derivativeswere[i] = 0;
 }
 
 static void bob_error(t_bob *x)
@@ -177,16 +287,35 @@ static void bob_error(t_bob *x)
 
 static void bob_print(t_bob *x)
 {
-    int i;
-    for (i = 0; i < DIM; i++)
-        post("state %d: %f", i, x->x_state[i]);
+    int i, j;
+    for (j = 0; j < x->x_nfilters; j++)
+        for (i = 0; i < DIM; i++)
+    {
+        if (x->x_nfilters > 1)
+            post("filter %d state %d: %f", j, i, x->x_state[j * DIM + i]);
+        else post("state %d: %f", i, x->x_state[i]);
+    }
     post("saturation %f", x->x_params.p_saturation);
     post("oversample %d", x->x_oversample);
+    post("solver %s", (x->x_midpoint ? "midpoint" : "Runge-Kutte"));
 }
 
-static void *bob_new( void)
+static void *bob_new(t_symbol *s, int argc, t_atom *argv)
 {
     t_bob *x = (t_bob *)pd_new(bob_class);
+    x->x_midpoint = 0;
+    while (argc > 0 && argv->a_type == A_SYMBOL)
+    {
+        const char *flag = argv->a_w.w_symbol->s_name;
+        if (!strcmp(flag, "-midpoint"))
+            x->x_midpoint = 1;
+        else if (!strcmp(flag, "-rk4"))
+            x->x_midpoint = 0;
+        else pd_error(x, "bob~: %s: unknown flag", flag);
+        argc--, argv++;
+    }
+    x->x_nfilters = 1;
+    x->x_state = (FLOAT *)getbytes(DIM * sizeof(*x->x_state));
     x->x_out1 = outlet_new(&x->x_obj, gensym("signal"));
     inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
     inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
@@ -202,16 +331,14 @@ static void *bob_new( void)
     return (x);
 }
 
-static t_int *bob_perform(t_int *w)
+    /* run one filter over a block */
+static void bob_run1(t_bob *x, FLOAT *state, t_float *in1,
+    t_float *cutoffin, t_float *resonancein, t_float *out, int n)
 {
-    t_bob *x = (t_bob *)(w[1]);
-    t_float *in1 = (t_float *)(w[2]);
-    t_float *cutoffin = (t_float *)(w[3]);
-    t_float *resonancein = (t_float *)(w[4]);
-    t_float *out = (t_float *)(w[5]);
-    int n = (int)(w[6]), i, j;
+    int i, j;
     FLOAT stepsize = 1./(x->x_oversample * x->x_sr);
     FLOAT errorestimate;
+    t_solver solver = (x->x_midpoint ? solver_midpoint : solver_rungekutte);
     for (i = 0; i < n; i++)
     {
         x->x_params.p_input = *in1++;
@@ -219,29 +346,114 @@ static t_int *bob_perform(t_int *w)
         if ((x->x_params.p_resonance = *resonancein++) < 0)
             x->x_params.p_resonance = 0;
         for (j = 0; j < x->x_oversample; j++)
-            solver_rungekutte(x->x_state, &errorestimate,
-                stepsize, &x->x_params);
-        *out++ = x->x_state[0];
+            (*solver)(state, &errorestimate, stepsize, &x->x_params);
+        *out++ = state[0];
 #if CALCERROR
         x->x_cumerror += errorestimate;
         x->x_errorcount++;
 #endif
     }
-    return (w+7);
+}
+
+#ifdef BOB_SSE2
+    /* run two filters over a block, each with its own input, cutoff,
+    resonance and output vectors, one per lane */
+static void bob_run2(t_bob *x, FLOAT *state0, FLOAT *state1,
+    t_float *in0, t_float *in1, t_float *cutoff0, t_float *cutoff1,
+    t_float *res0, t_float *res1, t_float *out0, t_float *out1, int n)
+{
+    int i, j, oversample = x->x_oversample;
+    FLOAT stepsize = 1./(oversample * x->x_sr);
+    t_params2 p;
+    __m128d state[DIM], zero = _mm_setzero_pd(),
+        twopi = _mm_set1_pd((float)(2*3.14159));
+    double out[2];
+    p.p_saturation = _mm_set1_pd(x->x_params.p_saturation);
+    p.p_satinv = _mm_set1_pd(1./x->x_params.p_saturation);
+    for (i = 0; i < DIM; i++)
+        state[i] = _mm_set_pd(state1[i], state0[i]);
+    for (i = 0; i < n; i++)
+    {
+        p.p_input = _mm_set_pd(in1[i], in0[i]);
+        p.p_k = _mm_mul_pd(twopi, _mm_set_pd(cutoff1[i], cutoff0[i]));
+        p.p_resonance = _mm_max_pd(_mm_set_pd(res1[i], res0[i]), zero);
+        if (x->x_midpoint)
+            for (j = 0; j < oversample; j++)
+                solver_midpoint2(state, stepsize, &p);
+        else for (j = 0; j < oversample; j++)
+            solver_rungekutte2(state, stepsize, &p);
+        _mm_storeu_pd(out, state[0]);
+        out0[i] = out[0];
+        out1[i] = out[1];
+    }
+    for (i = 0; i < DIM; i++)
+    {
+        _mm_storeu_pd(out, state[i]);
+        state0[i] = out[0];
+        state1[i] = out[1];
+    }
+}
+#endif /* BOB_SSE2 */
+
+    /* the cutoff and resonance inputs may have a channel for each filter
+    or else one channel for all of them, in which case "cutoffstride" or
+    "resstride" is zero */
+static t_int *bob_perform(t_int *w)
+{
+    t_bob *x = (t_bob *)(w[1]);
+    t_float *in1 = (t_float *)(w[2]);
+    t_float *cutoffin = (t_float *)(w[3]);
+    t_float *resonancein = (t_float *)(w[4]);
+    t_float *out = (t_float *)(w[5]);
+    int n = (int)(w[6]), nfilters = (int)(w[7]);
+    int cutoffstride = (int)(w[8]), resstride = (int)(w[9]), ch = 0;
+#ifdef BOB_SSE2
+    for (; ch + 1 < nfilters; ch += 2)
+        bob_run2(x, x->x_state + ch * DIM, x->x_state + (ch+1) * DIM,
+            in1 + ch * n, in1 + (ch+1) * n,
+            cutoffin + ch * cutoffstride, cutoffin + (ch+1) * cutoffstride,
+            resonancein + ch * resstride, resonancein + (ch+1) * resstride,
+            out + ch * n, out + (ch+1) * n, n);
+#endif
+    for (; ch < nfilters; ch++)
+        bob_run1(x, x->x_state + ch * DIM, in1 + ch * n,
+            cutoffin + ch * cutoffstride, resonancein + ch * resstride,
+                out + ch * n, n);
+    return (w+10);
 }
 
 static void bob_dsp(t_bob *x, t_signal **sp)
 {
+    int n = sp[0]->s_n, nchans = sp[0]->s_nchans;
     x->x_sr = sp[0]->s_sr;
-    dsp_add(bob_perform, 6, x, sp[0]->s_vec, sp[1]->s_vec,
-        sp[2]->s_vec, sp[3]->s_vec, sp[0]->s_n);
+    if (nchans != x->x_nfilters)
+    {
+        x->x_state = (FLOAT *)resizebytes(x->x_state,
+            DIM * x->x_nfilters * sizeof(*x->x_state),
+                DIM * nchans * sizeof(*x->x_state));
+        if (nchans > x->x_nfilters)
+            memset(x->x_state + DIM * x->x_nfilters, 0,
+                DIM * (nchans - x->x_nfilters) * sizeof(*x->x_state));
+        x->x_nfilters = nchans;
+    }
+    signal_setmultiout(&sp[3], nchans);
+    dsp_add(bob_perform, 9, x, sp[0]->s_vec, sp[1]->s_vec,
+        sp[2]->s_vec, sp[3]->s_vec, n, nchans,
+            (sp[1]->s_nchans >= nchans ? n : 0),
+                (sp[2]->s_nchans >= nchans ? n : 0));
+}
+
+static void bob_free(t_bob *x)
+{
+    freebytes(x->x_state, DIM * x->x_nfilters * sizeof(*x->x_state));
 }
 
 void bob_tilde_setup(void)
 {
     int i;
     bob_class = class_new(gensym("bob~"),
-        (t_newmethod)bob_new, 0, sizeof(t_bob), 0, 0);
+        (t_newmethod)bob_new, (t_method)bob_free, sizeof(t_bob), 0,
+            A_GIMME, 0);
     class_addmethod(bob_class, (t_method)bob_saturation, gensym("saturation"),
         A_FLOAT, 0);
     class_addmethod(bob_class, (t_method)bob_oversample, gensym("oversample"),
@@ -83,6 +83,12 @@ void *bonk_class;
 static t_class *bonk_class;
 #endif
 
+#if defined(PD) && PD_FLOATSIZE == 32 && (defined(__SSE__) || \
+    defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#define BONK_SSE
+#include <xmmintrin.h>
+#endif
+
 #ifdef _WIN32
 # include <malloc.h> /* MSVC or mingw on windows */
 #elif defined(__linux__) || defined(__APPLE__)
@@ -632,12 +638,44 @@ static void bonk_tick(t_bonk *x)
     }
 }
 
+    /* correlate "n" points of "in" with a kernel of interleaved complex
+    points, giving the real and imaginary parts of the sum.  With SSE we
+    take four input points at a time, each duplicated to meet a real and
+    an imaginary kernel point, and fold the partial sums at the end. */
+static void bonk_correlate(const t_float *in, const t_float *kern, int n,
+    t_float *rp, t_float *ip)
+{
+    t_float rsum = 0, isum = 0;
+#ifdef BONK_SSE
+    __m128 acc1 = _mm_setzero_ps(), acc2 = _mm_setzero_ps();
+    float sums[4];
+    for (; n >= 4; n -= 4, in += 4, kern += 8)
+    {
+        __m128 g = _mm_loadu_ps(in);
+        acc1 = _mm_add_ps(acc1,
+            _mm_mul_ps(_mm_unpacklo_ps(g, g), _mm_loadu_ps(kern)));
+        acc2 = _mm_add_ps(acc2,
+            _mm_mul_ps(_mm_unpackhi_ps(g, g), _mm_loadu_ps(kern + 4)));
+    }
+    _mm_storeu_ps(sums, _mm_add_ps(acc1, acc2));
+    rsum = sums[0] + sums[2];
+    isum = sums[1] + sums[3];
+#endif
+    for (; n--; in++, kern += 2)
+    {
+        rsum += *in * kern[0];
+        isum += *in * kern[1];
+    }
+    *rp = rsum;
+    *ip = isum;
+}
+
 static void bonk_doit(t_bonk *x)
 {
-    int i, j, ch, n;
+    int i, ch, n;
     t_filterkernel *k;
     t_hist *h;
-    t_float growth = 0, *fp1, *fp3, *fp4, hithresh, lothresh;
+    t_float growth = 0, *fp1, hithresh, lothresh;
     int ninsig = x->x_ninsig, nfilters = x->x_nfilters,
         maskphase = x->x_maskphase, nextphase, oldmaskphase;
     t_insig *gp;
@@ -676,13 +714,8 @@ static void bonk_doit(t_bonk *x)
             for (fp1 = inbuf, n = 0;
                  n < k->k_nhops; fp1 += k->k_hoppoints, n++)
             {
-                t_float rsum = 0, isum = 0;
-                for (fp3 = fp1, fp4 = k->k_stuff, j = filterpoints; j--;)
-                {
-                    t_float g = *fp3++;
-                    rsum += g * *fp4++;
-                    isum += g * *fp4++;
-                }
+                t_float rsum, isum;
+                bonk_correlate(fp1, k->k_stuff, filterpoints, &rsum, &isum);
                 power += rsum * rsum + isum * isum;
             }
             if (!x->x_willattack) 
@@ -1353,6 +1386,7 @@ void bonk_tilde_setup(void)
 {
     bonk_class = class_new(gensym("bonk~"), (t_newmethod)bonk_new,
         (t_method)bonk_free, sizeof(t_bonk), 0, A_GIMME, 0);
+    class_setdspflags(bonk_class, CLASS_NOPARALLEL);
     class_addmethod(bonk_class, nullfn, gensym("signal"), 0);
     class_addmethod(bonk_class, (t_method)bonk_dsp, gensym("dsp"), A_CANT, 0);
     class_addbang(bonk_class, bonk_bang);
@@ -267,6 +267,9 @@ typedef struct sigfiddle                    /* instance struct */
     t_float *x_inbuf;               /* buffer to analyze, npoints/2 elems */
     t_float *x_lastanalysis;        /* FT of last buffer (see main comment) */
     t_float *x_spiral;              /* 1/4-wave complex exponential */
+#ifdef PD
+    t_fftplan *x_fftplan;           /* complex FFT plan for x_hop points */
+#endif
     t_peakout *x_peakbuf;           /* spectral peaks for output */
     int x_npeakout;                 /* number of spectral peaks to output */
     int x_npeakanal;                /* number of spectral peaks to analyze */
@@ -393,6 +396,22 @@ void sigfiddle_doit(t_sigfiddle *x)
          * multiply the H points by a 1/4-wave complex exponential,
          * and take FFT of the result.
          */
+#ifdef PD
+        /* the planned FFT takes real and imaginary parts apart; use the
+        unused upper half of spect1 for them and interleave the result */
+    if (x->x_fftplan)
+    {
+        t_float *re = spect1 + 2*hop, *im = spect1 + 3*hop;
+        for (i = 0, fp1 = x->x_inbuf, fp2 = x->x_spiral;
+            i < hop; i++, fp1++, fp2 += 2)
+                re[i] = fp1[0] * fp2[0], im[i] = fp1[0] * fp2[1];
+        fftplan_complex(x->x_fftplan, re, im, 0);
+        for (i = 0, fp3 = spect1; i < hop; i++, fp3 += 2)
+            fp3[0] = re[i], fp3[1] = im[i];
+    }
+    else
+    {
+#endif
     for (i = 0, fp1 = x->x_inbuf, fp2 = x->x_spiral, fp3 = spect1;
         i < hop; i++, fp1++, fp2 += 2, fp3 += 2)
             fp3[0] = fp1[0] * fp2[0], fp3[1] = fp1[0] * fp2[1];
@@ -402,6 +421,7 @@ void sigfiddle_doit(t_sigfiddle *x)
 #endif
 #ifdef PD
     pd_fft(spect1, hop, 0);
+    }
 #endif
 #ifdef JMAX
     fts_cfft_inplc((complex *)spect1, hop);
@@ -1071,6 +1091,13 @@ static void sigfiddle_freebird(t_sigfiddle *x)
         freebytes(x->x_spiral, sizeof(t_float) * 2 * x->x_hop);
         x->x_spiral = 0;
     }
+#ifdef PD
+    if (x->x_fftplan)
+    {
+        fftplan_free(x->x_fftplan);
+        x->x_fftplan = 0;
+    }
+#endif
     x->x_hop = 0;
 }
 
@@ -1103,6 +1130,10 @@ int sigfiddle_setnpoints(t_sigfiddle *x, t_floatarg fnpoints)
     for (i = 0; i < x->x_hop; i++)
         x->x_spiral[2*i] =    cos((3.14159*i)/(npoints)),
         x->x_spiral[2*i+1] = -sin((3.14159*i)/(npoints));
+#ifdef PD
+        /* if we can't get a plan we fall back on pd_fft() */
+    x->x_fftplan = fftplan_new(x->x_hop, 0);
+#endif
     x->x_phase = 0;
     return (1);
 fail:
@@ -1500,6 +1531,7 @@ void fiddle_tilde_setup(void)
     sigfiddle_class = class_new(gensym("fiddle~"), (t_newmethod)sigfiddle_new,
         (t_method)sigfiddle_ff, sizeof(t_sigfiddle), 0,
             A_DEFFLOAT, A_DEFFLOAT, A_DEFFLOAT, A_DEFFLOAT, 0);
+    class_setdspflags(sigfiddle_class, CLASS_NOPARALLEL);
     class_addmethod(sigfiddle_class, (t_method)sigfiddle_dsp,
         gensym("dsp"), 0);
     class_addmethod(sigfiddle_class, (t_method)sigfiddle_debug,
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 #include "m_pd.h"
 
 static void pd_tilde_putfloat(float f, FILE *fd)
@@ -54,3 +55,42 @@ static int pd_tilde_getatom(t_atom *ap, FILE *fd)
         }
     }
 }
+
+    /* the same from a buffer, for when we don't want to block waiting for
+    the rest of an atom: return the number of bytes taken, or 0 if "buf"
+    ends before the atom does.  Bytes that aren't atoms come back as A_NULL */
+static int pd_tilde_getbufatom(t_atom *ap, const char *buf, int n)
+{
+    int i;
+    float f;
+    if (n < 1)
+        return (0);
+    switch (buf[0])
+    {
+    case A_SEMI:
+        SETSEMI(ap);
+        return (1);
+    case A_FLOAT:
+        if (n < 1 + (int)sizeof(f))
+            return (0);
+        memcpy(&f, buf + 1, sizeof(f));
+        SETFLOAT(ap, f);
+        return (1 + sizeof(f));
+    case A_SYMBOL:
+        for (i = 1; i < n && i <= MAXPDSTRING; i++)
+            if (!buf[i])
+        {
+            SETSYMBOL(ap, gensym(buf + 1));
+            return (i + 1);
+        }
+        if (i > MAXPDSTRING)    /* too long; drop it */
+        {
+            ap->a_type = A_NULL;
+            return (i);
+        }
+        return (0);
+    default:
+        ap->a_type = A_NULL;
+        return (1);
+    }
+}
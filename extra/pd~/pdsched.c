@@ -17,9 +17,18 @@ outputs audio and messages. */
 #ifdef _WIN32
 #include <io.h>
 #include <fcntl.h>
+#else
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
 #endif
 
 #include "binarymsg.c"
+#include "shmaudio.c"
 
 #if defined(__linux__) || defined(__FreeBSD__) || defined(__FreeBSD_kernel__)\
      || defined(__GNU__)
@@ -81,43 +90,92 @@ static int readbinmessage(t_binbuf *b)
     }
 }
 
-int pd_extern_sched(char *flags)
+static void dispatchmessage(t_binbuf *b)
 {
-    int naudioindev, audioindev[MAXAUDIOINDEV], chindev[MAXAUDIOINDEV];
-    int naudiooutdev, audiooutdev[MAXAUDIOOUTDEV], choutdev[MAXAUDIOOUTDEV];
-    int i, j, rate, advance, callback, chin, chout, fill = 0, c, blocksize,
-        useascii = 0;
-    t_binbuf *b = binbuf_new();
+    t_atom *ap = binbuf_getvec(b);
+    int n = binbuf_getnatom(b);
+    if (n > 1 && ap[0].a_type == A_SYMBOL)
+    {
+        t_pd *whom = ap[0].a_w.w_symbol->s_thing;
+        if (!whom)
+            error("%s: no such object", ap[0].a_w.w_symbol->s_name);
+        else if (ap[1].a_type == A_SYMBOL)
+            typedmess(whom, ap[1].a_w.w_symbol, n-2, ap+2);
+        else pd_list(whom, 0, n-1, ap+1);
+    }
+}
 
-    sys_get_audio_params(&naudioindev, audioindev, chindev,
-        &naudiooutdev, audiooutdev, choutdev, &rate, &advance, &callback,
-            &blocksize);
+static void dotick(void)
+{
+    sched_tick();
+    sys_pollgui();
+#if defined(__linux__) || defined(__FreeBSD__) || defined(__FreeBSD_kernel__)\
+     || defined(__GNU__)
+    pollwatchdog();
+#endif
+}
 
-    chin = (naudioindev < 1 ? 0 : chindev[0]);
-    chout = (naudiooutdev < 1 ? 0 : choutdev[0]);
-    if (!flags || flags[0] != 'a')
+#ifdef SHMAUDIO
+    /* audio comes and goes through shared memory (see shmaudio.c); the
+    pipes only carry messages, which for each block we're told how many
+    of to read before running it. */
+static int shmsched(int fd, int chin, int chout, t_binbuf *b)
+{
+    t_shmaudio *m = shmaudio_map(fd, 0);
+    unsigned int slot = 0;
+    pid_t parent = getppid();
+    int i, j;
+    if (!m)
     {
-            /* signal to stdout object to do binary by attaching an object
-            to an obscure symbol name */
-        pd_ambinary_class = class_new(gensym("pd~"), 0, 0, sizeof(t_pd),
-            CLASS_PD, 0);
-        pd_bind(&pd_ambinary_class, gensym("#pd_binary_stdio"));
-            /* On Windows, set stdin and out to "binary" mode */
-#ifdef _WIN32
-        setmode(fileno(stdout),O_BINARY);
-        setmode(fileno(stdin),O_BINARY);
-#endif
+        fprintf(stderr, "pd-extern: can't map shared memory\n");
+        return (1);
     }
-    else
+    close(fd);
+    if (m->m_ninsig != chin || m->m_noutsig != chout)
     {
-        if (!(ascii_inbuf = getbytes(BUFSIZE)))
-            return (1);
-        useascii = 1;
+        fprintf(stderr, "pd-extern: channel count mismatch\n");
+        return (1);
     }
-    /* fprintf(stderr, "Pd plug-in scheduler called, chans %d %d, sr %d\n",
-        chin, chout, (int)rate); */
-    sys_setchsr(chin, chout, rate);
-    sys_audioapi = API_NONE;
+    while (1)
+    {
+        float *fp;
+        t_sample *sp;
+        int nmess;
+        while (!shmaudio_wait(&m->m_tochild))
+            if (getppid() != parent)    /* orphaned */
+                goto done;
+        if (m->m_quit)
+            break;
+        for (nmess = shmaudio_nmess(m)[slot % m->m_nslots]; nmess--; )
+        {
+            if (!readbinmessage(b))
+                goto done;
+            dispatchmessage(b);
+        }
+        for (i = chin * DEFDACBLKSIZE, fp = shmaudio_in(m, slot),
+            sp = STUFF->st_soundin; i--; )
+                *sp++ = *fp++;
+        dotick();
+        for (i = chout * DEFDACBLKSIZE, fp = shmaudio_out(m, slot),
+            sp = STUFF->st_soundout; i--; sp++)
+        {
+            *fp++ = *sp;
+            *sp = 0;
+        }
+        fflush(stdout);     /* messages from "stdout" objects */
+        slot++;
+        sem_post(&m->m_toparent);
+    }
+done:
+    munmap(m, m->m_size);
+    return (0);
+}
+#endif /* SHMAUDIO */
+
+    /* exchange blocks and messages with pd~ until it hangs up */
+static void serve(t_binbuf *b, int useascii, int chin, int chout)
+{
+    int i, j;
     while (useascii ? readasciimessage(b) : readbinmessage(b) )
     {
         t_atom *ap = binbuf_getvec(b);
@@ -133,12 +191,7 @@ int pd_extern_sched(char *flags)
             for (; chan < chin; chan++)
                 for (j = 0; j < DEFDACBLKSIZE; j++)
                     *fp++ = 0;
-            sched_tick();
-            sys_pollgui();
-#if defined(__linux__) || defined(__FreeBSD__) || defined(__FreeBSD_kernel__)\
-     || defined(__GNU__)
-            pollwatchdog();
-#endif
+            dotick();
             if (useascii)
                 printf(";\n");
             else putchar(A_SEMI);
@@ -155,16 +208,128 @@ int pd_extern_sched(char *flags)
             else putchar(A_SEMI);
             fflush(stdout);
         }
-        else if (n > 1 && ap[0].a_type == A_SYMBOL)
+        else dispatchmessage(b);
+    }
+}
+
+#ifndef _WIN32
+    /* "-extraflags bt<port>": instead of talking to a parent through pipes,
+    wait on a TCP port for a pd~ on some other machine to "pd~ connect" to
+    us, and then talk to it the same way over the connection, which we make
+    our standard input and output so that "stdout" objects write to it too.
+    When it hangs up we wait for the next one; the patches we've opened and
+    their state stay as they were. */
+static int tcpsched(int portno, t_binbuf *b, int chin, int chout)
+{
+    struct addrinfo hints, *ailist = 0, *ai;
+    char portstr[20];
+    int listenfd = -1, one = 1;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    sprintf(portstr, "%d", portno);
+    if (getaddrinfo(0, portstr, &hints, &ailist))
+    {
+        fprintf(stderr, "pd-extern: bad port %d\n", portno);
+        return (1);
+    }
+    for (ai = ailist; ai; ai = ai->ai_next)
+    {
+        if ((listenfd = socket(ai->ai_family, ai->ai_socktype,
+            ai->ai_protocol)) < 0)
+                continue;
+        setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(listenfd, ai->ai_addr, ai->ai_addrlen) >= 0 &&
+            listen(listenfd, 1) >= 0)
+                break;
+        close(listenfd);
+        listenfd = -1;
+    }
+    freeaddrinfo(ailist);
+    if (listenfd < 0)
+    {
+        perror("pd-extern: listen");
+        return (1);
+    }
+    fprintf(stderr, "pd-extern: waiting for pd~ on port %d\n", portno);
+    while (1)
+    {
+        int fd = accept(listenfd, 0, 0);
+        if (fd < 0)
         {
-            t_pd *whom = ap[0].a_w.w_symbol->s_thing;
-            if (!whom)
-                error("%s: no such object", ap[0].a_w.w_symbol->s_name);
-            else if (ap[1].a_type == A_SYMBOL)
-                typedmess(whom, ap[1].a_w.w_symbol, n-2, ap+2);
-            else pd_list(whom, 0, n-1, ap+1);
+            perror("pd-extern: accept");
+            break;
         }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fflush(stdout);
+        dup2(fd, 0);
+        dup2(fd, 1);
+        close(fd);
+        clearerr(stdin);
+        clearerr(stdout);
+        fprintf(stderr, "pd-extern: pd~ connected\n");
+        serve(b, 0, chin, chout);
+        fprintf(stderr, "pd-extern: pd~ hung up\n");
     }
+    close(listenfd);
+    return (0);
+}
+#endif /* _WIN32 */
+
+int pd_extern_sched(char *flags)
+{
+    int naudioindev, audioindev[MAXAUDIOINDEV], chindev[MAXAUDIOINDEV];
+    int naudiooutdev, audiooutdev[MAXAUDIOOUTDEV], choutdev[MAXAUDIOOUTDEV];
+    int rate, advance, callback, chin, chout, blocksize, useascii = 0;
+    t_binbuf *b = binbuf_new();
+
+    sys_get_audio_params(&naudioindev, audioindev, chindev,
+        &naudiooutdev, audiooutdev, choutdev, &rate, &advance, &callback,
+            &blocksize);
+
+    chin = (naudioindev < 1 ? 0 : chindev[0]);
+    chout = (naudiooutdev < 1 ? 0 : choutdev[0]);
+    if (!flags || flags[0] != 'a')
+    {
+            /* signal to stdout object to do binary by attaching an object
+            to an obscure symbol name */
+        pd_ambinary_class = class_new(gensym("pd~"), 0, 0, sizeof(t_pd),
+            CLASS_PD, 0);
+        pd_bind(&pd_ambinary_class, gensym("#pd_binary_stdio"));
+            /* On Windows, set stdin and out to "binary" mode */
+#ifdef _WIN32
+        setmode(fileno(stdout),O_BINARY);
+        setmode(fileno(stdin),O_BINARY);
+#endif
+    }
+    else
+    {
+        if (!(ascii_inbuf = getbytes(BUFSIZE)))
+            return (1);
+        useascii = 1;
+    }
+    /* fprintf(stderr, "Pd plug-in scheduler called, chans %d %d, sr %d\n",
+        chin, chout, (int)rate); */
+    sys_setchsr(chin, chout, rate);
+    sys_audioapi = API_NONE;
+#ifdef SHMAUDIO
+    if (flags && flags[0] == 'b' && flags[1] == 's')
+    {
+        int ret = shmsched(atoi(flags + 2), chin, chout, b);
+        binbuf_free(b);
+        return (ret);
+    }
+#endif
+#ifndef _WIN32
+    if (flags && flags[0] == 'b' && flags[1] == 't')
+    {
+        int ret = tcpsched(atoi(flags + 2), b, chin, chout);
+        binbuf_free(b);
+        return (ret);
+    }
+#endif
+    serve(b, useascii, chin, chout);
     binbuf_free(b);
     return (0);
 }
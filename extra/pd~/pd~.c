@@ -22,6 +22,11 @@ typedef int socklen_t;
 #include <sys/wait.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <poll.h>
 #endif
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -103,6 +108,7 @@ static const char*pd_tilde_dllextent[] = {
 
 #define FOOFOO
 #include "binarymsg.c"
+#include "shmaudio.c"
 
 /* ------------------------ pd_tilde~ ----------------------------- */
 
@@ -115,6 +121,9 @@ typedef struct _pd_tilde
     t_clock *x_clock;
     t_outlet *x_outlet1;        /* for messages back from subproc */
     t_canvas *x_canvas;
+    struct _pd_tilde *x_poolnext;   /* next idle subprocess in the pool */
+    int x_poolsize;             /* how many to keep there for us ... */
+    t_binbuf *x_poolflags;      /* ... and what to start them with */
 #endif /* PD */
 #ifdef MSP
     t_pxobject x_obj;
@@ -129,6 +138,17 @@ typedef struct _pd_tilde
     int x_noutsig;
     int x_fifo;
     int x_binary;
+    int x_pipe;                 /* audio through the pipes even if we could
+                                use shared memory */
+    t_symbol *x_host;           /* if nonzero, start it there via ssh */
+#ifdef SHMAUDIO
+    t_shmaudio *x_shm;          /* audio goes here if not through the pipes */
+    unsigned int x_inslot;      /* number of blocks sent ... */
+    unsigned int x_outslot;     /* ... and received */
+    int x_nmess;                /* messages sent since the last block */
+    char *x_msgbuf;             /* bytes read from the subprocess */
+    int x_msgfill;
+#endif
     t_float x_sr;
     t_symbol *x_pddir;
     t_symbol *x_schedlibdir;
@@ -154,6 +174,16 @@ static void pd_tilde_close(t_pd_tilde *x)
 {
 #ifdef _WIN32
     int termstat;
+#endif
+#ifdef SHMAUDIO
+    if (x->x_shm)
+    {
+            /* wake the subprocess up to tell it to quit */
+        x->x_shm->m_quit = 1;
+        sem_post(&x->x_shm->m_tochild);
+        if (x->x_infd)
+            sys_rmpollfn(fileno(x->x_infd));
+    }
 #endif
     if (x->x_outfd)
         fclose(x->x_outfd);
@@ -164,12 +194,63 @@ static void pd_tilde_close(t_pd_tilde *x)
         _cwait(&termstat, x->x_childpid, WAIT_CHILD);
 #else
         waitpid(x->x_childpid, 0, 0);
+#endif
+#ifdef SHMAUDIO
+    if (x->x_shm)
+        shmaudio_free(x->x_shm);
+    x->x_shm = 0;
+    x->x_msgfill = 0;
 #endif
     binbuf_clear(x->x_binbuf);
     x->x_infd = x->x_outfd = 0;
     x->x_childpid = -1;
 }
 
+#ifdef SHMAUDIO
+    /* called from the scheduler when the subprocess has sent us something.
+    With shared memory the pipe carries only messages, so we don't need to
+    read it every block; we take whatever complete messages have come in. */
+static void pd_tilde_pollmessages(t_pd_tilde *x, int fd)
+{
+    int n, i, k, end;
+    t_atom at;
+    if (!x->x_msgbuf && !(x->x_msgbuf = (char *)getbytes(MSGBUFSIZE)))
+        return;
+    if ((n = (int)read(fd, x->x_msgbuf + x->x_msgfill,
+        MSGBUFSIZE - x->x_msgfill)) <= 0)
+    {
+        if (n < 0 && errno == EINTR)
+            return;
+        if (n < 0)
+            PDERROR "pd~: %s", strerror(errno));
+        else PDERROR "pd~: subprocess exited");
+        pd_tilde_close(x);
+        return;
+    }
+    x->x_msgfill += n;
+        /* find the end of the last complete message */
+    for (i = end = 0; (k = pd_tilde_getbufatom(&at,
+        x->x_msgbuf + i, x->x_msgfill - i)); i += k)
+            if (at.a_type == A_SEMI)
+                end = i + k;
+    if (!end && x->x_msgfill == MSGBUFSIZE)
+    {
+        PDERROR "pd~: message from subprocess too long; dropped");
+        end = MSGBUFSIZE;
+    }
+    for (i = 0; i < end; i += k)
+    {
+        k = pd_tilde_getbufatom(&at, x->x_msgbuf + i, end - i);
+        if (at.a_type != A_NULL)
+            binbuf_add(x->x_binbuf, 1, &at);
+    }
+    memmove(x->x_msgbuf, x->x_msgbuf + end, x->x_msgfill - end);
+    x->x_msgfill -= end;
+    if (end)
+        clock_delay(x->x_clock, 0);
+}
+#endif /* SHMAUDIO */
+
 static int pd_tilde_readmessages(t_pd_tilde *x)
 {
     t_atom at;
@@ -223,6 +304,7 @@ static int pd_tilde_readmessages(t_pd_tilde *x)
 }
 
 #define FIXEDARG 13
+#define HOSTARG 3   /* "ssh -T <host>" ahead of the rest */
 #define MAXARG 100
 #ifdef _WIN32
 #define EXTENT ".com"
@@ -230,15 +312,38 @@ static int pd_tilde_readmessages(t_pd_tilde *x)
 #define EXTENT ""
 #endif
 
+    /* send "fifo" blocks of silence ahead, so that the other side runs that
+    many blocks behind us, and then start reading what comes back */
+static void pd_tilde_prime(t_pd_tilde *x, int fifo, int deferred)
+{
+    int i;
+    for (i = 0; i < fifo; i++)
+        if (x->x_binary)
+    {
+        putc(A_SEMI, x->x_outfd);
+        pd_tilde_putfloat(0, x->x_outfd);
+        putc(A_SEMI, x->x_outfd);
+    }
+    else fprintf(x->x_outfd, "%s", ";\n0;\n");
+
+    fflush(x->x_outfd);
+    binbuf_clear(x->x_binbuf);
+    if (!deferred)
+        pd_tilde_readmessages(x);
+}
+
+    /* start a subprocess.  If "deferred" is set, don't wait for it or take
+    messages from it until pd_tilde_activate() (this is for the pool). */
 static void pd_tilde_donew(t_pd_tilde *x, const char *pddir, const char *schedlibdir,
     const char *patchdir_c, int argc, t_atom *argv, int ninsig, int noutsig,
-    int fifo, t_float samplerate)
+    int fifo, t_float samplerate, int deferred)
 {
-    int i, pid, pipe1[2], pipe2[2];
+    int i, pid, pipe1[2], pipe2[2], argoffset = 0;
     char cmdbuf[MAXPDSTRING], pdexecbuf[MAXPDSTRING], schedbuf[MAXPDSTRING],
         tmpbuf[MAXPDSTRING], patchdir[MAXPDSTRING];
-    char *execargv[FIXEDARG+MAXARG+1], ninsigstr[20], noutsigstr[20],
-        sampleratestr[40];
+    char *execargv[HOSTARG+FIXEDARG+MAXARG+1], ninsigstr[20], noutsigstr[20],
+        sampleratestr[40], flagsstr[40];
+    int shmfd = -1;
     const char**dllextent;
     struct stat statbuf;
     x->x_infd = x->x_outfd = 0;
@@ -251,6 +356,17 @@ static void pd_tilde_donew(t_pd_tilde *x, const char *pddir, const char *schedli
     sprintf(ninsigstr, "%d", ninsig);
     sprintf(noutsigstr, "%d", noutsig);
     sprintf(sampleratestr, "%f", (float)samplerate);
+    if (x->x_host)
+    {
+#ifdef _WIN32
+        PDERROR "pd~: -host not supported on Windows");
+        goto fail1;
+#else
+            /* the paths are on the other machine, so take them on faith */
+        snprintf(pdexecbuf, MAXPDSTRING, "%s/bin/pd", pddir);
+        goto gotone;
+#endif
+    }
     snprintf(tmpbuf, MAXPDSTRING, "%s/bin/pd" EXTENT, pddir);
     sys_bashfilename(tmpbuf, pdexecbuf);
     if (stat(pdexecbuf, &statbuf) < 0)
@@ -310,7 +426,26 @@ gotone:
     execargv[1] = "-schedlib";
     execargv[2] = schedbuf;
     execargv[3] = "-extraflags";
-    execargv[4] = (x->x_binary ? "b" : "a");
+    strcpy(flagsstr, (x->x_binary ? "b" : "a"));
+#ifdef SHMAUDIO
+    if (x->x_binary && !x->x_pipe && !x->x_host)
+    {
+        int nslots = (fifo > 0 ? fifo : 0) + 1;
+        if ((shmfd = shmaudio_makefile(
+            shmaudio_size(ninsig, noutsig, nslots))) < 3 ||
+                !(x->x_shm = shmaudio_new(shmfd, ninsig, noutsig, nslots)))
+        {
+            post("pd~: can't share memory with subprocess (%s); using pipes",
+                strerror(errno));
+            if (shmfd >= 0)
+                close(shmfd);
+            shmfd = -1;
+        }
+            /* the subprocess finds it by its file number */
+        else sprintf(flagsstr, "bs%d", shmfd);
+    }
+#endif
+    execargv[4] = flagsstr;
     execargv[5] = "-path";
     execargv[6] = patchdir;
     execargv[7] = "-inchannels";
@@ -342,6 +477,16 @@ gotone:
         strcpy(execargv[FIXEDARG+i], tmpbuf);
     }
     execargv[argc+FIXEDARG] = 0;
+    if (x->x_host)
+    {
+            /* run it as "ssh -T <host> pd ..." talking through the pipes */
+        memmove(execargv + HOSTARG, execargv,
+            (argc + FIXEDARG + 1) * sizeof(*execargv));
+        execargv[0] = "ssh";
+        execargv[1] = "-T";
+        execargv[2] = (char *)x->x_host->s_name;
+        argoffset = HOSTARG;
+    }
 #if 0
     for (i = 0; i < argc+FIXEDARG; i++)
         fprintf(stderr, "%s ", execargv[i]);
@@ -413,10 +558,14 @@ gotone:
             close(pipe1[1]);
         if (pipe2[0] >= 2)
             close(pipe2[0]);
-        execv(cmdbuf, execargv);
+        if (shmfd >= 0)
+            fcntl(shmfd, F_SETFD, 0);   /* shm_open() sets close-on-exec */
+        if (x->x_host)
+            execvp("ssh", execargv);
+        else execv(cmdbuf, execargv);
         _exit(1);
     }
-    for (i=FIXEDARG; execargv[i]; i++)
+    for (i = argoffset + FIXEDARG; execargv[i]; i++)
         free(execargv[i]);
 
 #endif /* _WIN32 */
@@ -430,18 +579,26 @@ gotone:
     x->x_outfd = fdopen(pipe1[1], "w");
     x->x_infd = fdopen(pipe2[0], "r");
     x->x_childpid = pid;
-    for (i = 0; i < fifo; i++)
-        if (x->x_binary)
+#ifdef SHMAUDIO
+    if (x->x_shm)
     {
-        putc(A_SEMI, x->x_outfd);
-        pd_tilde_putfloat(0, x->x_outfd);
-        putc(A_SEMI, x->x_outfd);
+            /* prime the fifo with blocks of silence (the region starts out
+            zeroed) and get messages whenever they come in */
+        close(shmfd);
+        x->x_inslot = x->x_outslot = 0;
+        x->x_nmess = 0;
+        for (i = 0; i < fifo; i++)
+        {
+            x->x_inslot++;
+            sem_post(&x->x_shm->m_tochild);
+        }
+        binbuf_clear(x->x_binbuf);
+        if (!deferred)
+            sys_addpollfn(pipe2[0], (t_fdpollfn)pd_tilde_pollmessages, x);
+        return;
     }
-    else fprintf(x->x_outfd, "%s", ";\n0;\n");
-
-    fflush(x->x_outfd);
-    binbuf_clear(x->x_binbuf);
-    pd_tilde_readmessages(x);
+#endif
+    pd_tilde_prime(x, fifo, deferred);
     return;
 #ifndef _WIN32
 fail3:
@@ -454,11 +611,71 @@ fail2:
     close(pipe1[0]);
     close(pipe1[1]);
 fail1:
+#ifdef SHMAUDIO
+    if (x->x_shm)
+    {
+        shmaudio_free(x->x_shm);
+        close(shmfd);
+        x->x_shm = 0;
+    }
+#endif
     x->x_infd = x->x_outfd = 0;
     x->x_childpid = -1;
     return;
 }
 
+#ifdef SHMAUDIO
+    /* exchange a block with the subprocess through shared memory; return
+    0 if it's gone away. */
+static int pd_tilde_shmexchange(t_pd_tilde *x, int n)
+{
+    t_shmaudio *m = x->x_shm;
+    int i, j;
+    float *fp;
+    if (n > DEFDACBLKSIZE)
+        n = DEFDACBLKSIZE;
+    if (x->x_nmess)
+        fflush(x->x_outfd);
+    shmaudio_nmess(m)[x->x_inslot % m->m_nslots] = x->x_nmess;
+    x->x_nmess = 0;
+    fp = shmaudio_in(m, x->x_inslot);
+    for (i = 0; i < x->x_ninsig; i++)
+    {
+        t_sample *sp = x->x_insig[i];
+        for (j = 0; j < n; j++)
+            *fp++ = *sp++;
+        for (; j < DEFDACBLKSIZE; j++)
+            *fp++ = 0;
+    }
+    x->x_inslot++;
+    sem_post(&m->m_tochild);
+    while (!shmaudio_wait(&m->m_toparent))
+        if (waitpid(x->x_childpid, 0, WNOHANG) != 0)
+    {
+        PDERROR "pd~: subprocess exited");
+        x->x_childpid = -1;     /* already waited for */
+        pd_tilde_close(x);
+        return (0);
+    }
+    fp = shmaudio_out(m, x->x_outslot++);
+    for (i = 0; i < x->x_noutsig; i++, fp += DEFDACBLKSIZE)
+        for (j = 0; j < n; j++)
+            x->x_outsig[i][j] = fp[j];
+        /* with -batch Pd never polls file descriptors, so look for messages
+        from the subprocess here; this may close us, which is fine now. */
+    if (sys_batch)
+    {
+        struct pollfd pfd;
+        pfd.fd = fileno(x->x_infd);
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, 0) > 0)
+            pd_tilde_pollmessages(x, pfd.fd);
+    }
+    return (1);
+}
+#endif /* SHMAUDIO */
+
 static t_int *pd_tilde_perform(t_int *w)
 {
     t_pd_tilde *x = (t_pd_tilde *)(w[1]);
@@ -467,6 +684,14 @@ static t_int *pd_tilde_perform(t_int *w)
     FILE *infd = x->x_infd;
     if (!infd)
         goto zeroit;
+#ifdef SHMAUDIO
+    if (x->x_shm)
+    {
+        if (!pd_tilde_shmexchange(x, n))
+            goto zeroit;
+        return (w+3);
+    }
+#endif
     if (x->x_binary)
     {
         putc(A_SEMI, x->x_outfd);
@@ -611,40 +836,290 @@ static void pd_tilde_dsp(t_pd_tilde *x, t_signal **sp)
     dsp_add(pd_tilde_perform, 2, x, n);
 }
 
-static void pd_tilde_pdtilde(t_pd_tilde *x, t_symbol *s,
-    int argc, t_atom *argv)
+#ifndef _WIN32
+    /* instead of starting a subprocess, attach to a Pd that's waiting for
+    us on another machine (see tcpsched() in pdsched.c).  The protocol is
+    the same as through the pipes, and "-fifo" is how many blocks it can
+    fall behind before we have to wait for it, so set it to cover the round
+    trip over the network. */
+static void pd_tilde_connect(t_pd_tilde *x, t_symbol *host, int portno)
 {
-    t_symbol *sel = ((argc > 0 && argv->a_type == A_SYMBOL) ?
-        argv->a_w.w_symbol : gensym("?")), *schedlibdir;
-    const char *patchdir;
-    if (sel == gensym("start"))
+    struct addrinfo hints, *ailist = 0, *ai;
+    char portstr[20];
+    int fd = -1, fd2, one = 1, status;
+    if (x->x_infd)
+        pd_tilde_close(x);
+    if (!x->x_binary)
     {
-        char pdargstring[MAXPDSTRING];
-        if (x->x_infd)
-            pd_tilde_close(x);
-        pdargstring[0] = 0;
-        argc--; argv++;
+        PDERROR "pd~ connect: can't use -ascii");
+        return;
+    }
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    sprintf(portstr, "%d", portno);
+    if ((status = getaddrinfo(host->s_name, portstr, &hints, &ailist)))
+    {
+        PDERROR "pd~ connect: %s: %s", host->s_name, gai_strerror(status));
+        return;
+    }
+    for (ai = ailist; ai; ai = ai->ai_next)
+    {
+        if ((fd = socket(ai->ai_family, ai->ai_socktype,
+            ai->ai_protocol)) < 0)
+                continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) >= 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(ailist);
+    if (fd < 0 || (fd2 = dup(fd)) < 0)
+    {
+        PDERROR "pd~ connect: %s %d: %s", host->s_name, portno,
+            strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char *)&one, sizeof(one));
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    fcntl(fd2, F_SETFD, FD_CLOEXEC);
+    x->x_outfd = fdopen(fd, "w");
+    x->x_infd = fdopen(fd2, "r");
+    x->x_childpid = -1;
+    pd_tilde_prime(x, x->x_fifo, 0);
+}
+#endif /* _WIN32 */
+
+static void pd_tilde_start(t_pd_tilde *x, int argc, t_atom *argv,
+    int deferred)
+{
+    t_symbol *schedlibdir;
+    const char *patchdir;
+    if (x->x_infd)
+        pd_tilde_close(x);
 #ifdef PD
-        patchdir = canvas_getdir(x->x_canvas)->s_name;
+    patchdir = canvas_getdir(x->x_canvas)->s_name;
 #endif
 #ifdef MSP
-        patchdir = ".";
+    patchdir = ".";
+#endif
+    schedlibdir = x->x_schedlibdir;
+    if (schedlibdir == gensym(".") && x->x_pddir != gensym("."))
+    {
+        const char *pds = x->x_pddir->s_name;
+        char scheddirstring[MAXPDSTRING];
+        int l = strlen(pds);
+        if (l >= 4 && (!strcmp(pds+l-3, "bin") || !strcmp(pds+l-4, "bin/")))
+            snprintf(scheddirstring, MAXPDSTRING, "%s/../extra/pd~", pds);
+        else snprintf(scheddirstring, MAXPDSTRING, "%s/extra/pd~", pds);
+        schedlibdir = gensym(scheddirstring);
+    }
+    pd_tilde_donew(x, x->x_pddir->s_name, schedlibdir->s_name,
+        patchdir, argc, argv, x->x_ninsig, x->x_noutsig, x->x_fifo,
+            x->x_sr, deferred);
+}
+
+#ifdef PD
+/* The pool: subprocesses started ahead of time by "pd~ pool <n> [flags]" so
+that "pd~ open <patch>" needn't wait for Pd to start up and load libraries.
+Each is a pd~ object of its own, not in any canvas, whose subprocess is
+running but isn't heard from yet (see pd_tilde_donew()); any pd~ object with
+the same settings can take it over.  We keep the number the object asked for
+by starting another one whenever one is taken. */
+
+static t_pd_tilde *pd_tilde_pool;
+static void *pd_tilde_new(t_symbol *s, int argc, t_atom *argv);
+
+static int pd_tilde_poolmatch(t_pd_tilde *x, t_pd_tilde *y)
+{
+    return (x->x_ninsig == y->x_ninsig && x->x_noutsig == y->x_noutsig &&
+        x->x_fifo == y->x_fifo && x->x_sr == y->x_sr &&
+        x->x_binary == y->x_binary && x->x_pipe == y->x_pipe &&
+        x->x_host == y->x_host &&
+        x->x_pddir == y->x_pddir && x->x_schedlibdir == y->x_schedlibdir);
+}
+
+static int pd_tilde_poolcount(t_pd_tilde *x)
+{
+    t_pd_tilde *y;
+    int n = 0;
+    for (y = pd_tilde_pool; y; y = y->x_poolnext)
+        if (pd_tilde_poolmatch(x, y))
+            n++;
+    return (n);
+}
+
+    /* start one more subprocess like x's and put it in the pool */
+static void pd_tilde_poolspawn(t_pd_tilde *x)
+{
+    t_atom at[16];
+    int n = 12;
+    t_pd_tilde *y;
+    SETSYMBOL(at, gensym("-sr")); SETFLOAT(at+1, x->x_sr);
+    SETSYMBOL(at+2, gensym("-ninsig")); SETFLOAT(at+3, x->x_ninsig);
+    SETSYMBOL(at+4, gensym("-noutsig")); SETFLOAT(at+5, x->x_noutsig);
+    SETSYMBOL(at+6, gensym("-fifo")); SETFLOAT(at+7, x->x_fifo);
+    SETSYMBOL(at+8, gensym("-pddir")); SETSYMBOL(at+9, x->x_pddir);
+    SETSYMBOL(at+10, gensym("-scheddir")); SETSYMBOL(at+11, x->x_schedlibdir);
+    if (!x->x_binary)
+        SETSYMBOL(at+n, gensym("-ascii")), n++;
+    if (x->x_pipe)
+        SETSYMBOL(at+n, gensym("-pipe")), n++;
+    if (x->x_host)
+    {
+        SETSYMBOL(at+n, gensym("-host")); SETSYMBOL(at+n+1, x->x_host);
+        n += 2;
+    }
+    if (!(y = (t_pd_tilde *)pd_tilde_new(gensym("pd~"), n, at)))
+        return;
+    y->x_canvas = x->x_canvas;
+    pd_tilde_start(y, binbuf_getnatom(x->x_poolflags),
+        binbuf_getvec(x->x_poolflags), 1);
+    if (!y->x_infd)
+    {
+        pd_free(&y->x_obj.ob_pd);
+        return;
+    }
+    y->x_poolnext = pd_tilde_pool;
+    pd_tilde_pool = y;
+}
+
+    /* take a subprocess out of the pool, skipping any that have died */
+static t_pd_tilde *pd_tilde_pooltake(t_pd_tilde *x)
+{
+    t_pd_tilde **yp = &pd_tilde_pool, *y;
+    while ((y = *yp))
+    {
+        if (!pd_tilde_poolmatch(x, y))
+        {
+            yp = &y->x_poolnext;
+            continue;
+        }
+        *yp = y->x_poolnext;
+        if (waitpid(y->x_childpid, 0, WNOHANG) == 0)
+            return (y);
+        y->x_childpid = -1;
+        pd_free(&y->x_obj.ob_pd);
+    }
+    return (0);
+}
+
+    /* give x the subprocess of pooled object y and get rid of y */
+static void pd_tilde_takeover(t_pd_tilde *x, t_pd_tilde *y)
+{
+    if (x->x_infd)
+        pd_tilde_close(x);
+    x->x_infd = y->x_infd;
+    x->x_outfd = y->x_outfd;
+    x->x_childpid = y->x_childpid;
+    y->x_infd = y->x_outfd = 0;
+    y->x_childpid = -1;
+#ifdef SHMAUDIO
+    x->x_shm = y->x_shm;
+    x->x_inslot = y->x_inslot;
+    x->x_outslot = y->x_outslot;
+    x->x_nmess = y->x_nmess;
+    y->x_shm = 0;
 #endif
-        schedlibdir = x->x_schedlibdir;
-        if (schedlibdir == gensym(".") && x->x_pddir != gensym("."))
+    pd_free(&y->x_obj.ob_pd);
+        /* and start listening to it as pd_tilde_donew() would have */
+    binbuf_clear(x->x_binbuf);
+#ifdef SHMAUDIO
+    if (x->x_shm)
+    {
+        sys_addpollfn(fileno(x->x_infd),
+            (t_fdpollfn)pd_tilde_pollmessages, x);
+        return;
+    }
+#endif
+    pd_tilde_readmessages(x);
+}
+
+static void pd_tilde_anything(t_pd_tilde *x, t_symbol *s,
+    int argc, t_atom *argv);
+
+    /* get a subprocess, from the pool if there's one, and open a patch */
+static void pd_tilde_open(t_pd_tilde *x, t_symbol *name)
+{
+    char pathbuf[MAXPDSTRING], *slash;
+    t_pd_tilde *y;
+    t_atom at[3];
+    if ((y = pd_tilde_pooltake(x)))
+        pd_tilde_takeover(x, y);
+    else pd_tilde_start(x, binbuf_getnatom(x->x_poolflags),
+        binbuf_getvec(x->x_poolflags), 0);
+    if (!x->x_infd)
+        return;
+    if (sys_isabsolutepath(name->s_name))
+        snprintf(pathbuf, MAXPDSTRING, "%s", name->s_name);
+    else snprintf(pathbuf, MAXPDSTRING, "%s/%s",
+        canvas_getdir(x->x_canvas)->s_name, name->s_name);
+    slash = strrchr(pathbuf, '/');
+    *slash = 0;
+    SETSYMBOL(at, gensym("open"));
+    SETSYMBOL(at+1, gensym(slash + 1));
+    SETSYMBOL(at+2, gensym(pathbuf));
+    pd_tilde_anything(x, gensym("pd"), 3, at);
+    if (x->x_poolsize > pd_tilde_poolcount(x))
+        pd_tilde_poolspawn(x);
+}
+
+static void pd_tilde_setpool(t_pd_tilde *x, int n, int argc, t_atom *argv)
+{
+    t_pd_tilde **yp, *y;
+    int have = pd_tilde_poolcount(x);
+    x->x_poolsize = (n > 0 ? n : 0);
+    binbuf_clear(x->x_poolflags);
+    binbuf_add(x->x_poolflags, argc, argv);
+    for (; have < x->x_poolsize; have++)
+        pd_tilde_poolspawn(x);
+        /* if we have too many, let the oldest ones go */
+    for (yp = &pd_tilde_pool; have > x->x_poolsize && (y = *yp); )
+    {
+        if (pd_tilde_poolmatch(x, y))
         {
-            const char *pds = x->x_pddir->s_name;
-            char scheddirstring[MAXPDSTRING];
-            int l = strlen(pds);
-            if (l >= 4 && (!strcmp(pds+l-3, "bin") || !strcmp(pds+l-4, "bin/")))
-                snprintf(scheddirstring, MAXPDSTRING, "%s/../extra/pd~", pds);
-            else snprintf(scheddirstring, MAXPDSTRING, "%s/extra/pd~", pds);
-            schedlibdir = gensym(scheddirstring);
+            *yp = y->x_poolnext;
+            pd_free(&y->x_obj.ob_pd);
+            have--;
         }
-        pd_tilde_donew(x, x->x_pddir->s_name, schedlibdir->s_name,
-            patchdir, argc, argv, x->x_ninsig, x->x_noutsig, x->x_fifo,
-                x->x_sr);
+        else yp = &y->x_poolnext;
+    }
+}
+#endif /* PD */
+
+static void pd_tilde_pdtilde(t_pd_tilde *x, t_symbol *s,
+    int argc, t_atom *argv)
+{
+    t_symbol *sel = ((argc > 0 && argv->a_type == A_SYMBOL) ?
+        argv->a_w.w_symbol : gensym("?"));
+    if (sel == gensym("start"))
+        pd_tilde_start(x, argc-1, argv+1, 0);
+#ifndef _WIN32
+    else if (sel == gensym("connect"))
+    {
+        if (argc > 2 && argv[1].a_type == A_SYMBOL &&
+            argv[2].a_type == A_FLOAT)
+                pd_tilde_connect(x, argv[1].a_w.w_symbol,
+                    (int)argv[2].a_w.w_float);
+        else PDERROR "pd~ connect: needs host and port");
+    }
+#endif
+#ifdef PD
+    else if (sel == gensym("pool"))
+    {
+        if (argc > 1 && argv[1].a_type == A_FLOAT)
+            pd_tilde_setpool(x, (int)argv[1].a_w.w_float, argc-2, argv+2);
+        else PDERROR "pd~ pool: needs number of subprocesses");
+    }
+    else if (sel == gensym("open"))
+    {
+        if (argc > 1 && argv[1].a_type == A_SYMBOL)
+            pd_tilde_open(x, argv[1].a_w.w_symbol);
+        else PDERROR "pd~ open: needs patch name");
     }
+#endif
     else if (sel == gensym("stop"))
     {
         if (x->x_infd)
@@ -673,6 +1148,13 @@ static void pd_tilde_free(t_pd_tilde *x)
 #endif
     pd_tilde_close(x);
     clock_free(x->x_clock);
+#ifdef PD
+    binbuf_free(x->x_poolflags);
+#endif
+#ifdef SHMAUDIO
+    if (x->x_msgbuf)
+        freebytes(x->x_msgbuf, MSGBUFSIZE);
+#endif
 }
 
 /* -------------------------- Pd glue ------------------------- */
@@ -717,6 +1199,9 @@ static void pd_tilde_anything(t_pd_tilde *x, t_symbol *s,
                 pd_tilde_putsymbol(argv->a_w.w_symbol, x->x_outfd);
         }
         putc(A_SEMI, x->x_outfd);
+#ifdef SHMAUDIO
+        x->x_nmess++;
+#endif
     }
     else
     {
@@ -733,8 +1218,9 @@ static void pd_tilde_anything(t_pd_tilde *x, t_symbol *s,
 static void *pd_tilde_new(t_symbol *s, int argc, t_atom *argv)
 {
     t_pd_tilde *x = (t_pd_tilde *)pd_new(pd_tilde_class);
-    int ninsig = 2, noutsig = 2, j, fifo = 5, binary = 1;
+    int ninsig = 2, noutsig = 2, j, fifo = 5, binary = 1, usepipe = 0;
     t_float sr = sys_getsr();
+    t_symbol *host = 0;
     t_sample **g;
     t_symbol *pddir = sys_libdir,
         *scheddir = gensym(class_gethelpdir(pd_tilde_class));
@@ -776,6 +1262,25 @@ static void *pd_tilde_new(t_symbol *s, int argc, t_atom *argv)
         {
             binary = 0;
             argc--; argv++;
+        }
+            /* the subprocess computes each block while we go on with
+            ours, and we get it back one block later */
+        else if (!strcmp(firstarg->s_name, "-pipeline"))
+        {
+            fifo = 1;
+            argc--; argv++;
+        }
+        else if (!strcmp(firstarg->s_name, "-pipe"))
+        {
+            usepipe = 1;
+            argc--; argv++;
+        }
+            /* start the subprocess on another machine through ssh, in
+            which case -pddir and -scheddir are paths over there */
+        else if (!strcmp(firstarg->s_name, "-host") && argc > 1)
+        {
+            host = atom_getsymbolarg(1, argc, argv);
+            argc -= 2; argv += 2;
         }
         else break;
     }
@@ -785,7 +1290,7 @@ static void *pd_tilde_new(t_symbol *s, int argc, t_atom *argv)
         pd_error(x,
 "usage: pd~ [-sr #] [-ninsig #] [-noutsig #] [-fifo #] [-pddir <>]");
         post(
-"... [-scheddir <>]");
+"... [-scheddir <>] [-ascii] [-pipe] [-pipeline] [-host <>]");
     }
 
     x->x_clock = clock_new(x, (t_method)pd_tilde_tick);
@@ -804,6 +1309,16 @@ static void *pd_tilde_new(t_symbol *s, int argc, t_atom *argv)
     x->x_canvas = canvas_getcurrent();
     x->x_binbuf = binbuf_new();
     x->x_binary = binary;
+    x->x_pipe = usepipe;
+    x->x_host = (host && *host->s_name ? host : 0);
+    x->x_poolnext = 0;
+    x->x_poolsize = 0;
+    x->x_poolflags = binbuf_new();
+#ifdef SHMAUDIO
+    x->x_shm = 0;
+    x->x_msgbuf = 0;
+    x->x_msgfill = 0;
+#endif
     for (j = 1, g = x->x_insig; j < ninsig; j++, g++)
         inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
     x->x_outlet1 = outlet_new(&x->x_obj, 0);
@@ -819,6 +1334,7 @@ void pd_tilde_setup(void)
 {
     pd_tilde_class = class_new(gensym("pd~"), (t_newmethod)pd_tilde_new,
         (t_method)pd_tilde_free, sizeof(t_pd_tilde), 0, A_GIMME, 0);
+    class_setdspflags(pd_tilde_class, CLASS_NOPARALLEL);
     class_addmethod(pd_tilde_class, nullfn, gensym("signal"), 0);
     class_addmethod(pd_tilde_class, (t_method)pd_tilde_dsp, gensym("dsp"), A_CANT, 0);
     class_addmethod(pd_tilde_class, (t_method)pd_tilde_pdtilde, gensym("pd~"), A_GIMME, 0);
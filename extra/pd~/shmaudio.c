@@ -0,0 +1,155 @@
+/* Shared-memory audio transport between pd~ and its subprocess.
+
+Rather than sending every block of audio through the pipes as float atoms, pd~
+can put it in a region of memory it shares with the subprocess:  a ring of
+blocks for each direction, and a semaphore for each direction (in the same
+region) by which one side tells the other that a block is ready.  Messages
+still go through the pipes; for each input block pd~ records how many
+messages it sent before it, so that the subprocess still gets them in the
+same order relative to the audio.
+
+pd~ creates the region and the subprocess inherits it as an open file whose
+descriptor number is passed as "-extraflags bs<fd>".  This needs
+process-shared POSIX semaphores, so it's only compiled in where we know
+those work; otherwise, and with "-ascii" or "-pipe", the pipes carry
+everything as before. */
+
+#if defined(PD) && (defined(__linux__) || defined(__FreeBSD__) || \
+    defined(__FreeBSD_kernel__))
+#define SHMAUDIO
+
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <fcntl.h>
+
+#define SHMAUDIO_WAITMS 100     /* how long to wait before checking on peer */
+
+typedef struct _shmaudio
+{
+    sem_t m_tochild;        /* posted for each block of input */
+    sem_t m_toparent;       /* posted for each block of output */
+    volatile int m_quit;    /* set by pd~ to make the subprocess exit */
+    int m_ninsig;
+    int m_noutsig;
+    int m_nslots;           /* number of blocks in each ring */
+    size_t m_size;          /* size of the whole region */
+} t_shmaudio;
+
+    /* the header is followed by a count of messages for each input block,
+    then the input blocks, then the output blocks */
+#define SHMAUDIO_HEADSIZE(nslots) (((sizeof(t_shmaudio) + \
+    (nslots) * sizeof(int)) + 15) & ~(size_t)15)
+
+static size_t shmaudio_size(int ninsig, int noutsig, int nslots)
+{
+    return (SHMAUDIO_HEADSIZE(nslots) +
+        (size_t)nslots * (ninsig + noutsig) * DEFDACBLKSIZE * sizeof(float));
+}
+
+static int *shmaudio_nmess(t_shmaudio *m)
+{
+    return ((int *)(m + 1));
+}
+
+static float *shmaudio_in(t_shmaudio *m, unsigned int slot)
+{
+    return ((float *)((char *)m + SHMAUDIO_HEADSIZE(m->m_nslots)) +
+        (size_t)(slot % m->m_nslots) * m->m_ninsig * DEFDACBLKSIZE);
+}
+
+static float *shmaudio_out(t_shmaudio *m, unsigned int slot)
+{
+    return ((float *)((char *)m + SHMAUDIO_HEADSIZE(m->m_nslots)) +
+        (size_t)m->m_nslots * m->m_ninsig * DEFDACBLKSIZE +
+            (size_t)(slot % m->m_nslots) * m->m_noutsig * DEFDACBLKSIZE);
+}
+
+    /* make an anonymous file to share, without the close-on-exec flag so
+    that the subprocess inherits it.  Return -1 on failure. */
+static int shmaudio_makefile(size_t size)
+{
+    int fd;
+#if defined(__linux__)
+    char name[] = "/dev/shm/pd~XXXXXX";
+    if ((fd = mkstemp(name)) < 0)
+        return (-1);
+    unlink(name);
+#else
+    if ((fd = shm_open(SHM_ANON, O_RDWR, 0600)) < 0)
+        return (-1);
+#endif
+    if (ftruncate(fd, size) < 0)
+    {
+        close(fd);
+        return (-1);
+    }
+    return (fd);
+}
+
+    /* map the region in the file; if "size" is zero it's read from the
+    header, as the subprocess does. */
+static t_shmaudio *shmaudio_map(int fd, size_t size)
+{
+    void *v;
+    if (!size)
+    {
+        t_shmaudio head;
+        if (pread(fd, &head, sizeof(head), 0) != sizeof(head))
+            return (0);
+        size = head.m_size;
+    }
+    v = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    return (v == MAP_FAILED ? 0 : (t_shmaudio *)v);
+}
+
+static t_shmaudio *shmaudio_new(int fd, int ninsig, int noutsig, int nslots)
+{
+    size_t size = shmaudio_size(ninsig, noutsig, nslots);
+    t_shmaudio *m = shmaudio_map(fd, size);
+    if (!m)
+        return (0);
+    if (sem_init(&m->m_tochild, 1, 0) < 0)
+        goto fail;
+    if (sem_init(&m->m_toparent, 1, 0) < 0)
+    {
+        sem_destroy(&m->m_tochild);
+        goto fail;
+    }
+    m->m_quit = 0;
+    m->m_ninsig = ninsig;
+    m->m_noutsig = noutsig;
+    m->m_nslots = nslots;
+    m->m_size = size;
+    return (m);
+fail:
+    munmap(m, size);
+    return (0);
+}
+
+static void shmaudio_free(t_shmaudio *m)
+{
+    sem_destroy(&m->m_tochild);
+    sem_destroy(&m->m_toparent);
+    munmap(m, m->m_size);
+}
+
+    /* wait for a block, giving up after a while so that the caller can
+    check whether the other process is still there.  Return 1 if we got it. */
+static int shmaudio_wait(sem_t *s)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += SHMAUDIO_WAITMS * 1000000L;
+    if (ts.tv_nsec >= 1000000000L)
+        ts.tv_sec++, ts.tv_nsec -= 1000000000L;
+    while (sem_timedwait(s, &ts) < 0)
+        if (errno != EINTR)
+            return (0);
+    return (1);
+}
+
+#endif /* SHMAUDIO */
@@ -41,6 +41,11 @@ for example, defines this in the file d_fft_mayer.c or d_fft_fftsg.c. */
 # include <alloca.h> /* linux, mac, mingw, cygwin */
 #endif
 #include <stdlib.h>
+#if defined(PD) && !defined(_WIN32)
+#define SIGMUND_THREADS     /* do the analysis in other threads; see below */
+#include <pthread.h>
+#include <unistd.h>
+#endif
 #ifdef _MSC_VER
 #pragma warning( disable : 4244 )
 #pragma warning( disable : 4305 )
@@ -260,9 +265,11 @@ static void sigmund_remask(int maxbin, int bestindex, t_float powmask,
 #define PEAKMASKFACTOR 1.
 #define PEAKTHRESHFACTOR 0.6
 
+    /* "fftplan", if not null, is a Pd FFT plan for 2*npts points, which
+    unlike mayer_realfft() is safe to use outside Pd's own thread. */
 static void sigmund_getrawpeaks(int npts, t_float *insamps,
     int npeak, t_peak *peakv, int *nfound, t_float *power, t_float srate,
-    int loud, t_float hifreq)
+    int loud, t_float hifreq, void *fftplan)
 {
     t_float oneovern = 1.0/ (t_float)npts;
     t_float fperbin = 0.5 * srate * oneovern, totalpower = 0;
@@ -287,6 +294,11 @@ static void sigmund_getrawpeaks(int npts, t_float *insamps,
         bigbuf[i] = insamps[i];
     for (i = npts; i < 2*npts; i++)
         bigbuf[i] = 0;
+#ifdef PD
+    if (fftplan)
+        fftplan_real((t_fftplan *)fftplan, bigbuf, 0);
+    else
+#endif
     mayer_realfft(npts2, bigbuf);
     for (i = 0; i < npts; i++)
         rawreal[i] = bigbuf[i];
@@ -879,8 +891,31 @@ typedef struct _sigmund
     unsigned int x_dopitch:1;   /* which things to calculate */
     unsigned int x_donote:1;
     unsigned int x_dotracks:1;
+#ifdef SIGMUND_THREADS
+    struct _sigmund *x_jobnext; /* next in queue waiting for a thread */
+    int x_jobpending;           /* analysis started, not yet output */
+    int x_jobdone;              /* set by the thread when finished */
+    t_sample *x_jobbuf;         /* copy of the input for the thread */
+    int x_jobnpts;              /* size of x_jobbuf */
+    t_fftplan *x_jobplan;       /* FFT plan for 2*x_jobnpts points */
+    t_peak *x_jobpeakv;         /* results of the analysis */
+    int x_jobnpeak;             /* size of x_jobpeakv */
+    int x_jobnfound;
+    t_float x_jobfreq;
+    t_float x_jobpower;
+    t_float x_jobnote;
+#endif
 } t_sigmund;
 
+    /* with analysis threads, anything that changes what the analysis reads
+    or writes first waits for any analysis in progress to finish */
+#ifdef SIGMUND_THREADS
+static void sigmund_wait(t_sigmund *x);
+#define SIGMUND_SYNC(x) sigmund_wait(x)
+#else
+#define SIGMUND_SYNC(x)
+#endif
+
 static void sigmund_preinit(t_sigmund *x)
 {
     x->x_npts = NPOINTS_DEF;
@@ -906,11 +941,21 @@ static void sigmund_preinit(t_sigmund *x)
 #ifdef MSP
     x->x_inbuf2 = 0;
 #endif
+#ifdef SIGMUND_THREADS
+    x->x_jobnext = 0;
+    x->x_jobpending = x->x_jobdone = 0;
+    x->x_jobbuf = 0;
+    x->x_jobnpts = 0;
+    x->x_jobplan = 0;
+    x->x_jobpeakv = 0;
+    x->x_jobnpeak = 0;
+#endif
 }
 
 static void sigmund_npts(t_sigmund *x, t_floatarg f)
 {
     int nwas = x->x_npts, npts = f;
+    SIGMUND_SYNC(x);
         /* check parameter ranges */
     if (npts < NPOINTS_MIN)
         post("sigmund~: minimum points %d", NPOINTS_MIN),
@@ -952,6 +997,7 @@ static void sigmund_npts(t_sigmund *x, t_floatarg f)
 static void sigmund_hop(t_sigmund *x, t_floatarg f)
 {
     int hop = f;
+    SIGMUND_SYNC(x);
     if (hop < 0)
     {
         error("sigmund~: ignoring negative hopsize %d", hop);
@@ -967,6 +1013,7 @@ static void sigmund_hop(t_sigmund *x, t_floatarg f)
 
 static void sigmund_npeak(t_sigmund *x, t_floatarg f)
 {
+    SIGMUND_SYNC(x);
     if (f < 1)
         f = 1;
     x->x_npeak = f;
@@ -974,11 +1021,13 @@ static void sigmund_npeak(t_sigmund *x, t_floatarg f)
 
 static void sigmund_maxfreq(t_sigmund *x, t_floatarg f)
 {
+    SIGMUND_SYNC(x);
     x->x_maxfreq = f;
 }
 
 static void sigmund_vibrato(t_sigmund *x, t_floatarg f)
 {
+    SIGMUND_SYNC(x);
     if (f < 0)
         f = 0;
     x->x_vibrato = f;
@@ -986,6 +1035,7 @@ static void sigmund_vibrato(t_sigmund *x, t_floatarg f)
 
 static void sigmund_stabletime(t_sigmund *x, t_floatarg f)
 {
+    SIGMUND_SYNC(x);
     if (f < 0)
         f = 0;
     x->x_stabletime = f;
@@ -993,6 +1043,7 @@ static void sigmund_stabletime(t_sigmund *x, t_floatarg f)
 
 static void sigmund_growth(t_sigmund *x, t_floatarg f)
 {
+    SIGMUND_SYNC(x);
     if (f < 0)
         f = 0;
     x->x_growth = f;
@@ -1000,19 +1051,24 @@ static void sigmund_growth(t_sigmund *x, t_floatarg f)
 
 static void sigmund_minpower(t_sigmund *x, t_floatarg f)
 {
+    SIGMUND_SYNC(x);
     if (f < 0)
         f = 0;
     x->x_minpower = f;
 }
 
-static void sigmund_doit(t_sigmund *x, int npts, t_float *arraypoints,
-    int loud, t_float srate)
+    /* the analysis proper, leaving x_npeak or fewer peaks in "peakv" and
+    the rest of the results in the last four arguments.  Apart from
+    printing when "loud" is set, this touches nothing but "x" and its own
+    arguments, so that it can run in another thread. */
+static void sigmund_analyze(t_sigmund *x, int npts, t_float *arraypoints,
+    int loud, t_float srate, void *fftplan, t_peak *peakv, int *nfoundp,
+    t_float *freqp, t_float *powerp, t_float *notep)
 {
-    t_peak *peakv = (t_peak *)alloca(sizeof(t_peak) * x->x_npeak);
-    int nfound, i, cnt;
+    int nfound;
     t_float freq = 0, power, note = 0;
     sigmund_getrawpeaks(npts, arraypoints, x->x_npeak, peakv,
-        &nfound, &power, srate, loud, x->x_maxfreq);
+        &nfound, &power, srate, loud, x->x_maxfreq, fftplan);
     if (x->x_dopitch)
         sigmund_getpitch(nfound, peakv, &freq, npts, srate, 
         x->x_param1, x->x_param2, loud);
@@ -1023,6 +1079,16 @@ static void sigmund_doit(t_sigmund *x, int npts, t_float *arraypoints,
     if (x->x_dotracks)
         sigmund_peaktrack(nfound, peakv, x->x_ntrack, x->x_trackv, 
             2* srate / npts, loud);
+    *nfoundp = nfound;
+    *freqp = freq;
+    *powerp = power;
+    *notep = note;
+}
+
+static void sigmund_output(t_sigmund *x, int nfound, t_peak *peakv,
+    t_float freq, t_float power, t_float note)
+{
+    int i, cnt;
     for (cnt = x->x_nvarout; cnt--;)
     {
         t_varout *v = &x->x_varoutv[cnt];
@@ -1065,9 +1131,21 @@ static void sigmund_doit(t_sigmund *x, int npts, t_float *arraypoints,
     }
 }
 
+static void sigmund_doit(t_sigmund *x, int npts, t_float *arraypoints,
+    int loud, t_float srate)
+{
+    t_peak *peakv = (t_peak *)alloca(sizeof(t_peak) * x->x_npeak);
+    int nfound;
+    t_float freq, power, note;
+    sigmund_analyze(x, npts, arraypoints, loud, srate, 0, peakv, &nfound,
+        &freq, &power, &note);
+    sigmund_output(x, nfound, peakv, freq, power, note);
+}
+
 static t_int *sigmund_perform(t_int *w);
 static void sigmund_dsp(t_sigmund *x, t_signal **sp)
 {
+    SIGMUND_SYNC(x);
     if (x->x_mode == MODE_STREAM)
     {
         if (x->x_hop % sp[0]->s_n)
@@ -1089,11 +1167,21 @@ static void sigmund_print(t_sigmund *x)
     post("stabletime %g", x->x_stabletime);
     post("growth %g", x->x_growth);
     post("minpower %g", x->x_minpower);
+    SIGMUND_SYNC(x);
     x->x_loud = 1;
 }
 
 static void sigmund_free(t_sigmund *x)
 {
+    SIGMUND_SYNC(x);
+#ifdef SIGMUND_THREADS
+    if (x->x_jobbuf)
+        freebytes(x->x_jobbuf, x->x_jobnpts * sizeof(*x->x_jobbuf));
+    if (x->x_jobplan)
+        fftplan_free(x->x_jobplan);
+    if (x->x_jobpeakv)
+        freebytes(x->x_jobpeakv, x->x_jobnpeak * sizeof(*x->x_jobpeakv));
+#endif
     if (x->x_inbuf)
     {
         freebytes(x->x_inbuf, x->x_npts * sizeof(*x->x_inbuf));
@@ -1124,10 +1212,148 @@ static void sigmund_stabletime(t_sigmund *x, t_floatarg f);
 static void sigmund_growth(t_sigmund *x, t_floatarg f);
 static void sigmund_minpower(t_sigmund *x, t_floatarg f);
 
+#ifdef SIGMUND_THREADS
+/* With many sigmund~ objects analyzing large windows, doing the analyses in
+the clock callback makes an occasional tick take far longer than the rest.
+Instead, when a window is full we copy it and queue it for one of a few
+threads shared by all sigmund~ objects, and output the results in the
+following tick, waiting for the thread then if it hasn't finished.  So the
+output comes one DSP tick later than it otherwise would, and every time.
+Debugging printout ("print" and "printnext") is still done synchronously,
+as is table analysis ("list"). */
+
+#define SIGMUND_MAXTHREADS 8
+#define SIGMUND_STACKSIZE 0x400000  /* room for alloca() in the analysis */
+
+static pthread_mutex_t sigmund_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sigmund_jobcond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t sigmund_donecond = PTHREAD_COND_INITIALIZER;
+static t_sigmund *sigmund_queue, **sigmund_queuetail = &sigmund_queue;
+static int sigmund_nthreads;    /* -1 if we couldn't start any */
+static int sigmund_stagger;     /* count of objects made, for staggering */
+
+static void *sigmund_thread(void *dummy)
+{
+    pthread_mutex_lock(&sigmund_mutex);
+    while (1)
+    {
+        t_sigmund *x;
+        while (!(x = sigmund_queue))
+            pthread_cond_wait(&sigmund_jobcond, &sigmund_mutex);
+        if (!(sigmund_queue = x->x_jobnext))
+            sigmund_queuetail = &sigmund_queue;
+        pthread_mutex_unlock(&sigmund_mutex);
+        sigmund_analyze(x, x->x_jobnpts, x->x_jobbuf, 0, x->x_sr,
+            x->x_jobplan, x->x_jobpeakv, &x->x_jobnfound, &x->x_jobfreq,
+                &x->x_jobpower, &x->x_jobnote);
+        pthread_mutex_lock(&sigmund_mutex);
+        x->x_jobdone = 1;
+        pthread_cond_broadcast(&sigmund_donecond);
+    }
+    return (0);
+}
+
+    /* call with sigmund_mutex locked */
+static void sigmund_startthreads(void)
+{
+    pthread_attr_t attr;
+    pthread_t id;
+    int n = 2;
+#ifdef _SC_NPROCESSORS_ONLN
+    n = sysconf(_SC_NPROCESSORS_ONLN) - 1;  /* leave one for Pd itself */
+#endif
+    if (n < 1)
+        n = 1;
+    if (n > SIGMUND_MAXTHREADS)
+        n = SIGMUND_MAXTHREADS;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, SIGMUND_STACKSIZE);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    while (sigmund_nthreads < n &&
+        !pthread_create(&id, &attr, sigmund_thread, 0))
+            sigmund_nthreads++;
+    pthread_attr_destroy(&attr);
+    if (!sigmund_nthreads)
+    {
+        post("sigmund~: couldn't start analysis threads");
+        sigmund_nthreads = -1;
+    }
+}
+
+    /* queue the full input buffer for analysis by a thread.  Return 0 if
+    we can't, in which case the caller should do it right away. */
+static int sigmund_start(t_sigmund *x)
+{
+    int npts = x->x_npts;
+    if (x->x_jobnpts != npts)
+    {
+        if (x->x_jobbuf)
+            freebytes(x->x_jobbuf, x->x_jobnpts * sizeof(*x->x_jobbuf));
+        if (x->x_jobplan)
+            fftplan_free(x->x_jobplan);
+        x->x_jobbuf = (t_sample *)getbytes(npts * sizeof(*x->x_jobbuf));
+        x->x_jobplan = fftplan_new(2 * npts, 1);
+        x->x_jobnpts = npts;
+    }
+    if (!x->x_jobplan)
+        return (0);
+    if (x->x_jobnpeak != x->x_npeak)
+    {
+        x->x_jobpeakv = (t_peak *)resizebytes(x->x_jobpeakv,
+            x->x_jobnpeak * sizeof(*x->x_jobpeakv),
+                x->x_npeak * sizeof(*x->x_jobpeakv));
+        x->x_jobnpeak = x->x_npeak;
+    }
+    pthread_mutex_lock(&sigmund_mutex);
+    if (!sigmund_nthreads)
+        sigmund_startthreads();
+    if (sigmund_nthreads < 0)
+    {
+        pthread_mutex_unlock(&sigmund_mutex);
+        return (0);
+    }
+    memcpy(x->x_jobbuf, x->x_inbuf, npts * sizeof(*x->x_jobbuf));
+    x->x_jobdone = 0;
+    x->x_jobnext = 0;
+    *sigmund_queuetail = x;
+    sigmund_queuetail = &x->x_jobnext;
+    pthread_cond_signal(&sigmund_jobcond);
+    pthread_mutex_unlock(&sigmund_mutex);
+    x->x_jobpending = 1;
+    return (1);
+}
+
+static void sigmund_wait(t_sigmund *x)
+{
+    if (!x->x_jobpending)
+        return;
+    pthread_mutex_lock(&sigmund_mutex);
+    while (!x->x_jobdone)
+        pthread_cond_wait(&sigmund_donecond, &sigmund_mutex);
+    pthread_mutex_unlock(&sigmund_mutex);
+}
+
+    /* output the results of the analysis started in the last tick */
+static void sigmund_finish(t_sigmund *x)
+{
+    sigmund_wait(x);
+    x->x_jobpending = 0;
+    sigmund_output(x, x->x_jobnfound, x->x_jobpeakv, x->x_jobfreq,
+        x->x_jobpower, x->x_jobnote);
+}
+#endif /* SIGMUND_THREADS */
+
 static void sigmund_tick(t_sigmund *x)
 {
+#ifdef SIGMUND_THREADS
+    if (x->x_jobpending)
+        sigmund_finish(x);
+#endif
     if (x->x_infill == x->x_npts)
     {
+#ifdef SIGMUND_THREADS
+        if (x->x_loud || !sigmund_start(x))
+#endif
         sigmund_doit(x, x->x_npts, x->x_inbuf, x->x_loud, x->x_sr);
         if (x->x_hop >= x->x_npts)
         {
@@ -1151,6 +1377,10 @@ static t_int *sigmund_perform(t_int *w)
     t_sample *in = (t_sample *)(w[2]);
     int n = (int)(w[3]);
 
+#ifdef SIGMUND_THREADS
+    if (x->x_jobpending)
+        clock_delay(x->x_clock, 0);
+#endif
     if (x->x_hop % n)
         return (w+4);
     if (x->x_countdown > 0)
@@ -1322,6 +1552,15 @@ static void *sigmund_new(t_symbol *s, int argc, t_atom *argv)
     sigmund_npts(x, x->x_npts);
     notefinder_init(&x->x_notefinder);
     sigmund_clear(x);
+#ifdef SIGMUND_THREADS
+        /* stagger the analyses of objects with the same hop size (such as
+        many made at once) so that they don't all fall in the same tick */
+    pthread_mutex_lock(&sigmund_mutex);
+    if (x->x_hop > sys_getblksize())
+        x->x_countdown = (sigmund_stagger * sys_getblksize()) % x->x_hop;
+    sigmund_stagger++;
+    pthread_mutex_unlock(&sigmund_mutex);
+#endif
     return (x);
 }
 
@@ -1373,6 +1612,7 @@ static void sigmund_list(t_sigmund *x, t_symbol *s, int argc, t_atom *argv)
     }
     for (i = 0; i < npts; i++)
         arraypoints[i] = wordarray[i+onset].w_float;
+    SIGMUND_SYNC(x);
     sigmund_doit(x, npts, arraypoints, loud, srate);
 cleanup:
     freebytes(arraypoints, bufsize);
@@ -1380,6 +1620,7 @@ cleanup:
 
 static void sigmund_clear(t_sigmund *x)
 {
+    SIGMUND_SYNC(x);
     if (x->x_trackv)
         memset(x->x_trackv, 0, x->x_ntrack * sizeof(*x->x_trackv));
     x->x_infill = x->x_countdown = 0;
@@ -1388,21 +1629,25 @@ static void sigmund_clear(t_sigmund *x)
     /* these are for testing; their meanings vary... */
 static void sigmund_param1(t_sigmund *x, t_floatarg f)
 {
+    SIGMUND_SYNC(x);
     x->x_param1 = f;
 }
 
 static void sigmund_param2(t_sigmund *x, t_floatarg f)
 {
+    SIGMUND_SYNC(x);
     x->x_param2 = f;
 }
 
 static void sigmund_param3(t_sigmund *x, t_floatarg f)
 {
+    SIGMUND_SYNC(x);
     x->x_param3 = f;
 }
 
 static void sigmund_printnext(t_sigmund *x, t_float f)
 {
+    SIGMUND_SYNC(x);
     x->x_loud = f;
 }
 
@@ -1410,6 +1655,7 @@ void sigmund_tilde_setup(void)
 {
     sigmund_class = class_new(gensym("sigmund~"), (t_newmethod)sigmund_new,
         (t_method)sigmund_free, sizeof(t_sigmund), 0, A_GIMME, 0);
+    class_setdspflags(sigmund_class, CLASS_NOPARALLEL);
     class_addlist(sigmund_class, sigmund_list);
     class_addmethod(sigmund_class, (t_method)sigmund_dsp, gensym("dsp"),
         A_CANT, 0);
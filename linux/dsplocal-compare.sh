@@ -0,0 +1,25 @@
+#! /bin/sh
+# compare cache misses with and without "-dsplocal" on a set of patches:
+#    linux/dsplocal-compare.sh [seconds] patch.pd ...
+# Each patch is rendered (to a scratch file, in batch mode) both ways under
+# "perf stat".  The patches should turn DSP on themselves; if they also send
+# "pd dspstatus" the peak number of signal buffers in use is shown too.
+
+PD=${PD:-`dirname $0`/../bin/pd}
+SECONDS_TO_RUN=10
+case "$1" in
+    *.pd) ;;
+    *) SECONDS_TO_RUN=$1; shift ;;
+esac
+OUT=${TMPDIR:-/tmp}/dsplocal-compare.$$.wav
+trap 'rm -f $OUT' 0
+
+for patch in "$@"; do
+    for flag in "" -dsplocal; do
+        echo "== $patch ${flag:-(default order)}"
+        perf stat -e cache-references,cache-misses,L1-dcache-load-misses \
+            $PD -nogui -nosound $flag -render $OUT \
+                -duration $SECONDS_TO_RUN -open $patch 2>&1 | \
+            grep -E "peak signals|cache|elapsed"
+    done
+done
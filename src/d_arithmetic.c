@@ -9,6 +9,81 @@ to reset the value.
 */
 
 #include "m_pd.h"
+#include "s_stuff.h"
+
+    /* the routines used when the vector size is a multiple of 8: either the
+    unrolled "perf8" ones below or SIMD versions, depending on the CPU.
+    They're set in d_arithmetic_setup(). */
+static t_perfroutine plus_perfvec, scalarplus_perfvec;
+static t_perfroutine minus_perfvec, scalarminus_perfvec;
+static t_perfroutine times_perfvec, scalartimes_perfvec;
+static t_perfroutine over_perfvec, scalarover_perfvec;
+static t_perfroutine max_perfvec, scalarmax_perfvec;
+static t_perfroutine min_perfvec, scalarmin_perfvec;
+
+    /* vector/scalar: "in" to "*out" */
+static void scalarbinop_dodsp(t_signal *in, t_signal **out, t_float *g,
+    int op, t_perfroutine perf, t_perfroutine perfvec)
+{
+    int n = in->s_n * in->s_nchans;
+    signal_setmultiout(out, in->s_nchans);
+    if (dsp_addpointwise(op, in->s_vec, g, 0, (*out)->s_vec, n))
+        return;
+    dsp_add((n&7 ? perf : perfvec), 4, in->s_vec, g, (*out)->s_vec, n);
+}
+
+    /* the "dsp" methods for vector/vector binops.  A multichannel signal
+    is done all at once.  If the inputs have different numbers of channels,
+    one of them has to have just one, which is used against each channel
+    of the other.  These classes are CLASS_SCALARIN: an unconnected right
+    inlet is done as vector/scalar with the "s" routines, and an unconnected
+    left one is filled in as usual. */
+static void binop_dsp(t_object *x, t_signal **sp, int op,
+    t_perfroutine perf, t_perfroutine perfvec,
+    int sop, t_perfroutine sperf, t_perfroutine sperfvec)
+{
+    int n = sp[0]->s_n, nch1 = sp[0]->s_nchans, nch2 = sp[1]->s_nchans, i;
+    int nchans = (nch1 > nch2 ? nch1 : nch2);
+    if (sp[0]->s_scalar)
+        dsp_add_scalarcopy(sp[0]->s_scalar, sp[0]->s_vec, sp[0]->s_n);
+    if (sp[1]->s_scalar)
+    {
+        scalarbinop_dodsp(sp[0], &sp[2], sp[1]->s_scalar, sop,
+            sperf, sperfvec);
+        return;
+    }
+    signal_setmultiout(&sp[2], nchans);
+    if (nch1 == nch2)
+    {
+        n *= nchans;
+        if (dsp_addpointwise(op, sp[0]->s_vec, sp[1]->s_vec, 0,
+            sp[2]->s_vec, n))
+                return;
+        dsp_add((n&7 ? perf : perfvec), 4,
+            sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, n);
+    }
+    else if (nch1 == 1 || nch2 == 1)
+    {
+        for (i = 0; i < nchans; i++)
+            dsp_add((n&7 ? perf : perfvec), 4,
+                sp[0]->s_vec + (nch1 > 1) * i * n,
+                    sp[1]->s_vec + (nch2 > 1) * i * n,
+                        sp[2]->s_vec + i * n, n);
+    }
+    else
+    {
+        pd_error(x, "%s: inputs have %d and %d channels",
+            class_getname(pd_class(&x->ob_pd)), nch1, nch2);
+        dsp_add_zero(sp[2]->s_vec, n * nchans);
+    }
+}
+
+    /* and for vector/scalar ones */
+static void scalarbinop_dsp(t_signal **sp, t_float *g, int op,
+    t_perfroutine perf, t_perfroutine perfvec)
+{
+    scalarbinop_dodsp(sp[0], &sp[1], g, op, perf, perfvec);
+}
 
 /* ----------------------------- plus ----------------------------- */
 static t_class *plus_class, *scalarplus_class;
@@ -110,22 +185,19 @@ void dsp_add_plus(t_sample *in1, t_sample *in2, t_sample *out, int n)
     if (n&7)
         dsp_add(plus_perform, 4, in1, in2, out, n);
     else
-        dsp_add(plus_perf8, 4, in1, in2, out, n);
+        dsp_add(plus_perfvec, 4, in1, in2, out, n);
 }
 
 static void plus_dsp(t_plus *x, t_signal **sp)
 {
-    dsp_add_plus(sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[0]->s_n);
+    binop_dsp(&x->x_obj, sp, PW_PLUS, plus_perform, plus_perfvec,
+        PW_SCALARPLUS, scalarplus_perform, scalarplus_perfvec);
 }
 
 static void scalarplus_dsp(t_scalarplus *x, t_signal **sp)
 {
-    if (sp[0]->s_n&7)
-        dsp_add(scalarplus_perform, 4, sp[0]->s_vec, &x->x_g,
-            sp[1]->s_vec, sp[0]->s_n);
-    else
-        dsp_add(scalarplus_perf8, 4, sp[0]->s_vec, &x->x_g,
-            sp[1]->s_vec, sp[0]->s_n);
+    scalarbinop_dsp(sp, &x->x_g, PW_SCALARPLUS,
+        scalarplus_perform, scalarplus_perfvec);
 }
 
 static void plus_setup(void)
@@ -134,6 +206,7 @@ static void plus_setup(void)
         sizeof(t_plus), 0, A_GIMME, 0);
     class_addmethod(plus_class, (t_method)plus_dsp, gensym("dsp"), A_CANT, 0);
     CLASS_MAINSIGNALIN(plus_class, t_plus, x_f);
+    class_setdspflags(plus_class, CLASS_SCALARIN);
     class_sethelpsymbol(plus_class, gensym("sigbinops"));
     scalarplus_class = class_new(gensym("+~"), 0, 0,
         sizeof(t_scalarplus), 0, 0);
@@ -240,22 +313,14 @@ t_int *scalarminus_perf8(t_int *w)
 
 static void minus_dsp(t_minus *x, t_signal **sp)
 {
-    if (sp[0]->s_n&7)
-        dsp_add(minus_perform, 4,
-            sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[0]->s_n);
-    else
-        dsp_add(minus_perf8, 4,
-            sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[0]->s_n);
+    binop_dsp(&x->x_obj, sp, PW_MINUS, minus_perform, minus_perfvec,
+        PW_SCALARMINUS, scalarminus_perform, scalarminus_perfvec);
 }
 
 static void scalarminus_dsp(t_scalarminus *x, t_signal **sp)
 {
-    if (sp[0]->s_n&7)
-        dsp_add(scalarminus_perform, 4, sp[0]->s_vec, &x->x_g,
-            sp[1]->s_vec, sp[0]->s_n);
-    else
-        dsp_add(scalarminus_perf8, 4, sp[0]->s_vec, &x->x_g,
-            sp[1]->s_vec, sp[0]->s_n);
+    scalarbinop_dsp(sp, &x->x_g, PW_SCALARMINUS,
+        scalarminus_perform, scalarminus_perfvec);
 }
 
 static void minus_setup(void)
@@ -263,6 +328,7 @@ static void minus_setup(void)
     minus_class = class_new(gensym("-~"), (t_newmethod)minus_new, 0,
         sizeof(t_minus), 0, A_GIMME, 0);
     CLASS_MAINSIGNALIN(minus_class, t_minus, x_f);
+    class_setdspflags(minus_class, CLASS_SCALARIN);
     class_addmethod(minus_class, (t_method)minus_dsp, gensym("dsp"), A_CANT, 0);
     class_sethelpsymbol(minus_class, gensym("sigbinops"));
     scalarminus_class = class_new(gensym("-~"), 0, 0,
@@ -275,7 +341,7 @@ static void minus_setup(void)
 
 /* ----------------------------- times ----------------------------- */
 
-static t_class *times_class, *scalartimes_class;
+static t_class *times_class, *scalartimes_class, *smoothtimes_class;
 
 typedef struct _times
 {
@@ -290,8 +356,43 @@ typedef struct _scalartimes
     t_float x_g;
 } t_scalartimes;
 
+    /* "*~ -smooth <msec> <gain>": the gain set at the right inlet is ramped
+    to linearly over the given time, starting at the next block. */
+typedef struct _smoothtimes
+{
+    t_object x_obj;
+    t_float x_f;
+    t_float x_g;            /* gain from the inlet */
+    t_float x_time;         /* ramp time in msec */
+    t_sample x_target;      /* gain the current ramp is headed for */
+    t_sample x_value;       /* gain at the end of the last block */
+    t_sample x_inc;
+    int x_nleft;            /* samples to go in the ramp */
+    t_float x_sr;
+    int x_nchans;
+} t_smoothtimes;
+
 static void *times_new(t_symbol *s, int argc, t_atom *argv)
 {
+    if (argc && argv->a_type == A_SYMBOL &&
+        argv->a_w.w_symbol == gensym("-smooth"))
+    {
+        t_smoothtimes *x = (t_smoothtimes *)pd_new(smoothtimes_class);
+        argc--; argv++;
+        if (argc > 2) post("*~: extra arguments ignored");
+        x->x_time = (argc ? atom_getfloatarg(0, argc, argv) : 10);
+        if (x->x_time < 0)
+            x->x_time = 0;
+        x->x_g = x->x_target = x->x_value = atom_getfloatarg(1, argc, argv);
+        x->x_inc = 0;
+        x->x_nleft = 0;
+        x->x_sr = 44100;
+        x->x_nchans = 1;
+        floatinlet_new(&x->x_obj, &x->x_g);
+        outlet_new(&x->x_obj, &s_signal);
+        x->x_f = 0;
+        return (x);
+    }
     if (argc > 1) post("*~: extra arguments ignored");
     if (argc)
     {
@@ -369,24 +470,60 @@ t_int *scalartimes_perf8(t_int *w)
     return (w+5);
 }
 
+    /* the inlet is only looked at once per block; during a ramp the gain
+    is computed from the sample index, so there's no per-sample branching
+    or carried state and the loops can be vectorized. */
+static t_int *smoothtimes_perform(t_int *w)
+{
+    t_smoothtimes *x = (t_smoothtimes *)(w[1]);
+    t_sample *in = (t_sample *)(w[2]);
+    t_sample *out = (t_sample *)(w[3]);
+    int n = (int)(w[4]), ch, i, nramp;
+    t_sample v = x->x_value, inc, g;
+    if (x->x_g != x->x_target)
+    {
+        int nsamps = x->x_time * x->x_sr * 0.001 + 0.5;
+        x->x_target = x->x_g;
+        if (nsamps < 1)
+            nsamps = 1;
+        x->x_nleft = nsamps;
+        x->x_inc = (x->x_target - v) / nsamps;
+    }
+    nramp = (x->x_nleft < n ? x->x_nleft : n);
+    inc = x->x_inc;
+    if ((x->x_nleft -= nramp))
+        g = v + inc * nramp;
+    else g = x->x_target;
+    for (ch = 0; ch < x->x_nchans; ch++, in += n, out += n)
+    {
+        for (i = 0; i < nramp; i++)
+            out[i] = in[i] * (v + inc * (i + 1));
+        for (i = nramp; i < n; i++)
+            out[i] = in[i] * g;
+    }
+    x->x_value = g;
+    return (w+5);
+}
+
 static void times_dsp(t_times *x, t_signal **sp)
 {
-    if (sp[0]->s_n&7)
-        dsp_add(times_perform, 4,
-            sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[0]->s_n);
-    else
-        dsp_add(times_perf8, 4,
-            sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[0]->s_n);
+    binop_dsp(&x->x_obj, sp, PW_TIMES, times_perform, times_perfvec,
+        PW_SCALARTIMES, scalartimes_perform, scalartimes_perfvec);
 }
 
 static void scalartimes_dsp(t_scalartimes *x, t_signal **sp)
 {
-    if (sp[0]->s_n&7)
-        dsp_add(scalartimes_perform, 4, sp[0]->s_vec, &x->x_g,
-            sp[1]->s_vec, sp[0]->s_n);
-    else
-        dsp_add(scalartimes_perf8, 4, sp[0]->s_vec, &x->x_g,
-            sp[1]->s_vec, sp[0]->s_n);
+    scalarbinop_dsp(sp, &x->x_g, PW_SCALARTIMES,
+        scalartimes_perform, scalartimes_perfvec);
+}
+
+static void smoothtimes_dsp(t_smoothtimes *x, t_signal **sp)
+{
+    signal_setmultiout(&sp[1], sp[0]->s_nchans);
+    x->x_sr = sp[0]->s_sr;
+    x->x_nchans = sp[0]->s_nchans;
+    dsp_add(smoothtimes_perform, 4, x, sp[0]->s_vec, sp[1]->s_vec,
+        (t_int)sp[0]->s_n);
 }
 
 static void times_setup(void)
@@ -394,6 +531,7 @@ static void times_setup(void)
     times_class = class_new(gensym("*~"), (t_newmethod)times_new, 0,
         sizeof(t_times), 0, A_GIMME, 0);
     CLASS_MAINSIGNALIN(times_class, t_times, x_f);
+    class_setdspflags(times_class, CLASS_SCALARIN);
     class_addmethod(times_class, (t_method)times_dsp, gensym("dsp"), A_CANT, 0);
     class_sethelpsymbol(times_class, gensym("sigbinops"));
     scalartimes_class = class_new(gensym("*~"), 0, 0,
@@ -402,6 +540,12 @@ static void times_setup(void)
     class_addmethod(scalartimes_class, (t_method)scalartimes_dsp,
         gensym("dsp"), A_CANT, 0);
     class_sethelpsymbol(scalartimes_class, gensym("sigbinops"));
+    smoothtimes_class = class_new(gensym("*~"), 0, 0,
+        sizeof(t_smoothtimes), 0, 0);
+    CLASS_MAINSIGNALIN(smoothtimes_class, t_smoothtimes, x_f);
+    class_addmethod(smoothtimes_class, (t_method)smoothtimes_dsp,
+        gensym("dsp"), A_CANT, 0);
+    class_sethelpsymbol(smoothtimes_class, gensym("sigbinops"));
 }
 
 /* ----------------------------- over ----------------------------- */
@@ -513,22 +657,14 @@ t_int *scalarover_perf8(t_int *w)
 
 static void over_dsp(t_over *x, t_signal **sp)
 {
-    if (sp[0]->s_n&7)
-        dsp_add(over_perform, 4,
-            sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[0]->s_n);
-    else
-        dsp_add(over_perf8, 4,
-            sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[0]->s_n);
+    binop_dsp(&x->x_obj, sp, PW_OVER, over_perform, over_perfvec,
+        PW_SCALAROVER, scalarover_perform, scalarover_perfvec);
 }
 
 static void scalarover_dsp(t_scalarover *x, t_signal **sp)
 {
-    if (sp[0]->s_n&7)
-        dsp_add(scalarover_perform, 4, sp[0]->s_vec, &x->x_g,
-            sp[1]->s_vec, sp[0]->s_n);
-    else
-        dsp_add(scalarover_perf8, 4, sp[0]->s_vec, &x->x_g,
-            sp[1]->s_vec, sp[0]->s_n);
+    scalarbinop_dsp(sp, &x->x_g, PW_SCALAROVER,
+        scalarover_perform, scalarover_perfvec);
 }
 
 static void over_setup(void)
@@ -536,6 +672,7 @@ static void over_setup(void)
     over_class = class_new(gensym("/~"), (t_newmethod)over_new, 0,
         sizeof(t_over), 0, A_GIMME, 0);
     CLASS_MAINSIGNALIN(over_class, t_over, x_f);
+    class_setdspflags(over_class, CLASS_SCALARIN);
     class_addmethod(over_class, (t_method)over_dsp, gensym("dsp"), A_CANT, 0);
     class_sethelpsymbol(over_class, gensym("sigbinops"));
     scalarover_class = class_new(gensym("/~"), 0, 0,
@@ -655,22 +792,14 @@ t_int *scalarmax_perf8(t_int *w)
 
 static void max_dsp(t_max *x, t_signal **sp)
 {
-    if (sp[0]->s_n&7)
-        dsp_add(max_perform, 4,
-            sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[0]->s_n);
-    else
-        dsp_add(max_perf8, 4,
-            sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[0]->s_n);
+    binop_dsp(&x->x_obj, sp, PW_MAX, max_perform, max_perfvec,
+        PW_SCALARMAX, scalarmax_perform, scalarmax_perfvec);
 }
 
 static void scalarmax_dsp(t_scalarmax *x, t_signal **sp)
 {
-    if (sp[0]->s_n&7)
-        dsp_add(scalarmax_perform, 4, sp[0]->s_vec, &x->x_g,
-            sp[1]->s_vec, sp[0]->s_n);
-    else
-        dsp_add(scalarmax_perf8, 4, sp[0]->s_vec, &x->x_g,
-            sp[1]->s_vec, sp[0]->s_n);
+    scalarbinop_dsp(sp, &x->x_g, PW_SCALARMAX,
+        scalarmax_perform, scalarmax_perfvec);
 }
 
 static void max_setup(void)
@@ -678,6 +807,7 @@ static void max_setup(void)
     max_class = class_new(gensym("max~"), (t_newmethod)max_new, 0,
         sizeof(t_max), 0, A_GIMME, 0);
     CLASS_MAINSIGNALIN(max_class, t_max, x_f);
+    class_setdspflags(max_class, CLASS_SCALARIN);
     class_addmethod(max_class, (t_method)max_dsp, gensym("dsp"), A_CANT, 0);
     class_sethelpsymbol(max_class, gensym("sigbinops"));
     scalarmax_class = class_new(gensym("max~"), 0, 0,
@@ -797,22 +927,14 @@ t_int *scalarmin_perf8(t_int *w)
 
 static void min_dsp(t_min *x, t_signal **sp)
 {
-    if (sp[0]->s_n&7)
-        dsp_add(min_perform, 4,
-            sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[0]->s_n);
-    else
-        dsp_add(min_perf8, 4,
-            sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[0]->s_n);
+    binop_dsp(&x->x_obj, sp, PW_MIN, min_perform, min_perfvec,
+        PW_SCALARMIN, scalarmin_perform, scalarmin_perfvec);
 }
 
 static void scalarmin_dsp(t_scalarmin *x, t_signal **sp)
 {
-    if (sp[0]->s_n&7)
-        dsp_add(scalarmin_perform, 4, sp[0]->s_vec, &x->x_g,
-            sp[1]->s_vec, sp[0]->s_n);
-    else
-        dsp_add(scalarmin_perf8, 4, sp[0]->s_vec, &x->x_g,
-            sp[1]->s_vec, sp[0]->s_n);
+    scalarbinop_dsp(sp, &x->x_g, PW_SCALARMIN,
+        scalarmin_perform, scalarmin_perfvec);
 }
 
 static void min_setup(void)
@@ -820,6 +942,7 @@ static void min_setup(void)
     min_class = class_new(gensym("min~"), (t_newmethod)min_new, 0,
         sizeof(t_min), 0, A_GIMME, 0);
     CLASS_MAINSIGNALIN(min_class, t_min, x_f);
+    class_setdspflags(min_class, CLASS_SCALARIN);
     class_addmethod(min_class, (t_method)min_dsp, gensym("dsp"), A_CANT, 0);
     class_sethelpsymbol(min_class, gensym("sigbinops"));
     scalarmin_class = class_new(gensym("min~"), 0, 0,
@@ -830,9 +953,233 @@ static void min_setup(void)
     class_sethelpsymbol(scalarmin_class, gensym("sigbinops"));
 }
 
+/* ------------------------ SIMD versions ----------------------------- */
+
+/* These do the same as the "perf8" routines, four or eight samples at a time.
+They use unaligned loads and stores, which cost nothing extra on aligned
+buffers on current CPUs.  "max" and "min" are written so that they return
+the second input when comparing with a NaN, just like the C versions.  SSE
+is always there on x86-64 (and is assumed if the compiler is told to use
+it); AVX is used if the CPU turns out to have it. */
+
+#if PD_FLOATSIZE == 32 && (defined(__SSE__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#define ARITH_SSE
+#include <xmmintrin.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ARITH_AVX
+#include <immintrin.h>
+#endif
+#endif
+
+#if PD_FLOATSIZE == 32 && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define ARITH_NEON
+#include <arm_neon.h>
+#endif
+
+    /* vector/vector routine computing "op" on "width" samples at a time.
+    "count" is the number of samples, w[4] or a constant (see below). */
+#define ARITH_BINOP(name, attr, width, load, store, op, count) \
+static attr t_int *name(t_int *w) \
+{ \
+    t_sample *in1 = (t_sample *)(w[1]); \
+    t_sample *in2 = (t_sample *)(w[2]); \
+    t_sample *out = (t_sample *)(w[3]); \
+    int n = (count); \
+    for (; n; n -= width, in1 += width, in2 += width, out += width) \
+        store(out, op(load(in1), load(in2))); \
+    return (w+5); \
+}
+
+    /* vector/scalar version; "prep" is applied to the scalar first */
+#define ARITH_SCALAROP(name, attr, vtype, width, load, store, set1, prep, op, \
+    count) \
+static attr t_int *name(t_int *w) \
+{ \
+    t_sample *in = (t_sample *)(w[1]); \
+    t_float f = *(t_float *)(w[2]); \
+    t_sample *out = (t_sample *)(w[3]); \
+    int n = (count); \
+    vtype g = set1(prep(f)); \
+    for (; n; n -= width, in += width, out += width) \
+        store(out, op(load(in), g)); \
+    return (w+5); \
+}
+
+#define ARITH_SAME(f) (f)
+#define ARITH_RECIP(f) ((f) ? 1.f / (f) : 0.f)
+
+    /* all twelve routines for one instruction set and sample count, named
+    with "suffix" */
+#define ARITH_ALLN(isa, suffix, count, attr, vtype, width, load, store, set1) \
+ARITH_BINOP(plus_perf_##isa##suffix, attr, width, load, store, isa##_add, \
+    count) \
+ARITH_BINOP(minus_perf_##isa##suffix, attr, width, load, store, isa##_sub, \
+    count) \
+ARITH_BINOP(times_perf_##isa##suffix, attr, width, load, store, isa##_mul, \
+    count) \
+ARITH_BINOP(over_perf_##isa##suffix, attr, width, load, store, isa##_over, \
+    count) \
+ARITH_BINOP(max_perf_##isa##suffix, attr, width, load, store, isa##_max, \
+    count) \
+ARITH_BINOP(min_perf_##isa##suffix, attr, width, load, store, isa##_min, \
+    count) \
+ARITH_SCALAROP(scalarplus_perf_##isa##suffix, attr, vtype, width, load, \
+    store, set1, ARITH_SAME, isa##_add, count) \
+ARITH_SCALAROP(scalarminus_perf_##isa##suffix, attr, vtype, width, load, \
+    store, set1, ARITH_SAME, isa##_sub, count) \
+ARITH_SCALAROP(scalartimes_perf_##isa##suffix, attr, vtype, width, load, \
+    store, set1, ARITH_SAME, isa##_mul, count) \
+ARITH_SCALAROP(scalarover_perf_##isa##suffix, attr, vtype, width, load, \
+    store, set1, ARITH_RECIP, isa##_mul, count) \
+ARITH_SCALAROP(scalarmax_perf_##isa##suffix, attr, vtype, width, load, \
+    store, set1, ARITH_SAME, isa##_max, count) \
+ARITH_SCALAROP(scalarmin_perf_##isa##suffix, attr, vtype, width, load, \
+    store, set1, ARITH_SAME, isa##_min, count)
+
+    /* ... for any number of samples, and specialized for the common block
+    sizes of 64 and 16, where the loops can be unrolled completely. */
+#define ARITH_ALL(isa, attr, vtype, width, load, store, set1) \
+ARITH_ALLN(isa, , (int)(w[4]), attr, vtype, width, load, store, set1) \
+ARITH_ALLN(isa, _64, 64, attr, vtype, width, load, store, set1) \
+ARITH_ALLN(isa, _16, 16, attr, vtype, width, load, store, set1)
+
+    /* tell d_ugen.c to use the specialized versions of "f" */
+#define ARITH_SPECIALIZE(f, f64, f16) \
+    dsp_specialize(f, 4, 64, f64); \
+    dsp_specialize(f, 4, 16, f16)
+
+#define ARITH_SPECIALIZEALL(isa, old) \
+    ARITH_SPECIALIZE(plus_##old, plus_perf_##isa##_64, \
+        plus_perf_##isa##_16); \
+    ARITH_SPECIALIZE(minus_##old, minus_perf_##isa##_64, \
+        minus_perf_##isa##_16); \
+    ARITH_SPECIALIZE(times_##old, times_perf_##isa##_64, \
+        times_perf_##isa##_16); \
+    ARITH_SPECIALIZE(over_##old, over_perf_##isa##_64, \
+        over_perf_##isa##_16); \
+    ARITH_SPECIALIZE(max_##old, max_perf_##isa##_64, \
+        max_perf_##isa##_16); \
+    ARITH_SPECIALIZE(min_##old, min_perf_##isa##_64, \
+        min_perf_##isa##_16); \
+    ARITH_SPECIALIZE(scalarplus_##old, scalarplus_perf_##isa##_64, \
+        scalarplus_perf_##isa##_16); \
+    ARITH_SPECIALIZE(scalarminus_##old, scalarminus_perf_##isa##_64, \
+        scalarminus_perf_##isa##_16); \
+    ARITH_SPECIALIZE(scalartimes_##old, scalartimes_perf_##isa##_64, \
+        scalartimes_perf_##isa##_16); \
+    ARITH_SPECIALIZE(scalarover_##old, scalarover_perf_##isa##_64, \
+        scalarover_perf_##isa##_16); \
+    ARITH_SPECIALIZE(scalarmax_##old, scalarmax_perf_##isa##_64, \
+        scalarmax_perf_##isa##_16); \
+    ARITH_SPECIALIZE(scalarmin_##old, scalarmin_perf_##isa##_64, \
+        scalarmin_perf_##isa##_16)
+
+#define ARITH_USE(isa) \
+    plus_perfvec = plus_perf_##isa; \
+    minus_perfvec = minus_perf_##isa; \
+    times_perfvec = times_perf_##isa; \
+    over_perfvec = over_perf_##isa; \
+    max_perfvec = max_perf_##isa; \
+    min_perfvec = min_perf_##isa; \
+    scalarplus_perfvec = scalarplus_perf_##isa; \
+    scalarminus_perfvec = scalarminus_perf_##isa; \
+    scalartimes_perfvec = scalartimes_perf_##isa; \
+    scalarover_perfvec = scalarover_perf_##isa; \
+    scalarmax_perfvec = scalarmax_perf_##isa; \
+    scalarmin_perfvec = scalarmin_perf_##isa; \
+    ARITH_SPECIALIZEALL(isa, perf_##isa)
+
+    /* plain C versions of the specialized routines, to go with the "perf8"
+    ones; with a constant count the compiler can vectorize these itself */
+#define c_load(p) (*(p))
+#define c_store(p, v) (*(p) = (v))
+#define c_add(f, g) ((f) + (g))
+#define c_sub(f, g) ((f) - (g))
+#define c_mul(f, g) ((f) * (g))
+#define c_over(f, g) ((g) ? (f) / (g) : 0)
+#define c_max(f, g) ((f) > (g) ? (f) : (g))
+#define c_min(f, g) ((f) < (g) ? (f) : (g))
+ARITH_ALLN(c, _64, 64, , t_sample, 1, c_load, c_store, ARITH_SAME)
+ARITH_ALLN(c, _16, 16, , t_sample, 1, c_load, c_store, ARITH_SAME)
+
+#ifdef ARITH_SSE
+#define sse_add _mm_add_ps
+#define sse_sub _mm_sub_ps
+#define sse_mul _mm_mul_ps
+#define sse_over(f, g) _mm_and_ps(_mm_div_ps(f, g), \
+    _mm_cmpneq_ps(g, _mm_setzero_ps()))
+#define sse_max _mm_max_ps
+#define sse_min _mm_min_ps
+ARITH_ALL(sse, , __m128, 4, _mm_loadu_ps, _mm_storeu_ps, _mm_set1_ps)
+#endif
+
+#ifdef ARITH_AVX
+#define avx_add _mm256_add_ps
+#define avx_sub _mm256_sub_ps
+#define avx_mul _mm256_mul_ps
+#define avx_over(f, g) _mm256_and_ps(_mm256_div_ps(f, g), \
+    _mm256_cmp_ps(g, _mm256_setzero_ps(), _CMP_NEQ_UQ))
+#define avx_max _mm256_max_ps
+#define avx_min _mm256_min_ps
+ARITH_ALL(avx, __attribute__((target("avx"))), __m256, 8,
+    _mm256_loadu_ps, _mm256_storeu_ps, _mm256_set1_ps)
+#endif
+
+#ifdef ARITH_NEON
+#define neon_add vaddq_f32
+#define neon_sub vsubq_f32
+#define neon_mul vmulq_f32
+#ifdef __aarch64__
+#define neon_over(f, g) vreinterpretq_f32_u32(vbicq_u32( \
+    vreinterpretq_u32_f32(vdivq_f32(f, g)), vceqq_f32(g, vdupq_n_f32(0))))
+#else
+    /* no vector division on 32-bit ARM; this one won't be used */
+#define neon_over(f, g) (f)
+#endif
+#define neon_max(f, g) vbslq_f32(vcgtq_f32(f, g), f, g)
+#define neon_min(f, g) vbslq_f32(vcltq_f32(f, g), f, g)
+ARITH_ALL(neon, , float32x4_t, 4, vld1q_f32, vst1q_f32, vdupq_n_f32)
+#endif
+
+static void arith_simd_setup(void)
+{
+    plus_perfvec = plus_perf8;
+    minus_perfvec = minus_perf8;
+    times_perfvec = times_perf8;
+    over_perfvec = over_perf8;
+    max_perfvec = max_perf8;
+    min_perfvec = min_perf8;
+    scalarplus_perfvec = scalarplus_perf8;
+    scalarminus_perfvec = scalarminus_perf8;
+    scalartimes_perfvec = scalartimes_perf8;
+    scalarover_perfvec = scalarover_perf8;
+    scalarmax_perfvec = scalarmax_perf8;
+    scalarmin_perfvec = scalarmin_perf8;
+    ARITH_SPECIALIZEALL(c, perf8);
+#ifdef ARITH_AVX
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx"))
+    {
+        ARITH_USE(avx);
+        return;
+    }
+#endif
+#ifdef ARITH_SSE
+    ARITH_USE(sse);
+#endif
+#ifdef ARITH_NEON
+    ARITH_USE(neon);
+#ifndef __aarch64__
+    over_perfvec = over_perf8;
+#endif
+#endif
+}
+
 /* ----------------------- global setup routine ---------------- */
 void d_arithmetic_setup(void)
 {
+    arith_simd_setup();
     plus_setup();
     minus_setup();
     times_setup();
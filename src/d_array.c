@@ -7,6 +7,84 @@
 /* LATER make tabread4 and tabread~ */
 
 #include "m_pd.h"
+#include "s_stuff.h"
+
+/* ------------------ copying to and from arrays --------------------- */
+
+    /* Array elements are t_words, so their floats are usually spaced two
+    apart.  With SSE2 we move four of them at a time, gathering them with
+    two unaligned loads and a shuffle, or spreading them out again with
+    unpack, which zeroes the unused half of each t_word. */
+#if PD_FLOATSIZE == 32 && (defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define TAB_SSE
+#include <emmintrin.h>
+
+static inline __m128 tab_sse_load(const t_word *p)
+{
+    if (sizeof(t_word) == sizeof(float))
+        return (_mm_loadu_ps(&p[0].w_float));
+    else if (sizeof(t_word) == 2 * sizeof(float))
+        return (_mm_shuffle_ps(_mm_loadu_ps(&p[0].w_float),
+            _mm_loadu_ps(&p[2].w_float), _MM_SHUFFLE(2, 0, 2, 0)));
+    else return (_mm_setr_ps(p[0].w_float, p[1].w_float, p[2].w_float,
+        p[3].w_float));
+}
+
+static inline void tab_sse_store(t_word *p, __m128 v)
+{
+    if (sizeof(t_word) == sizeof(float))
+        _mm_storeu_ps(&p[0].w_float, v);
+    else if (sizeof(t_word) == 2 * sizeof(float))
+    {
+        __m128 zero = _mm_setzero_ps();
+        _mm_storeu_ps(&p[0].w_float, _mm_unpacklo_ps(v, zero));
+        _mm_storeu_ps(&p[2].w_float, _mm_unpackhi_ps(v, zero));
+    }
+    else
+    {
+        float f[4];
+        _mm_storeu_ps(f, v);
+        p[0].w_float = f[0], p[1].w_float = f[1];
+        p[2].w_float = f[2], p[3].w_float = f[3];
+    }
+}
+#endif /* TAB_SSE */
+
+    /* copy n floats out of an array */
+static void tab_getwords(t_sample *out, const t_word *wp, int n)
+{
+#ifdef TAB_SSE
+    for (; n >= 4; n -= 4, wp += 4, out += 4)
+        _mm_storeu_ps(out, tab_sse_load(wp));
+#endif
+    while (n--)
+        *out++ = (wp++)->w_float;
+}
+
+    /* copy n floats into an array, replacing denormals, infinities and
+    NaNs with zero as PD_BIGORSMALL() does */
+static void tab_putwords(t_word *wp, const t_sample *in, int n)
+{
+#ifdef TAB_SSE
+    __m128i mask = _mm_set1_epi32(0x60000000), zero = _mm_setzero_si128();
+    for (; n >= 4; n -= 4, wp += 4, in += 4)
+    {
+        __m128 v = _mm_loadu_ps(in);
+        __m128i e = _mm_and_si128(_mm_castps_si128(v), mask);
+        __m128i bad = _mm_or_si128(_mm_cmpeq_epi32(e, zero),
+            _mm_cmpeq_epi32(e, mask));
+        tab_sse_store(wp, _mm_andnot_ps(_mm_castsi128_ps(bad), v));
+    }
+#endif
+    while (n--)
+    {
+        t_sample f = *in++;
+        if (PD_BIGORSMALL(f))
+            f = 0;
+        (wp++)->w_float = f;
+    }
+}
 
 
 /* ------------------------- tabwrite~ -------------------------- */
@@ -19,6 +97,7 @@ typedef struct _tabwrite_tilde
     int x_phase;
     int x_nsampsintab;
     t_word *x_vec;
+    t_garray *x_garray; /* the array x_vec is in, to report what we write */
     t_symbol *x_arrayname;
     t_float x_f;
 } t_tabwrite_tilde;
@@ -34,14 +113,6 @@ static void *tabwrite_tilde_new(t_symbol *s)
     return (x);
 }
 
-static void tabwrite_tilde_redraw(t_tabwrite_tilde *x)
-{
-    t_garray *a = (t_garray *)pd_findbyclass(x->x_arrayname, garray_class);
-    if (!a)
-        bug("tabwrite_tilde_redraw");
-    else garray_redraw(a);
-}
-
 static t_int *tabwrite_tilde_perform(t_int *w)
 {
     t_tabwrite_tilde *x = (t_tabwrite_tilde *)(w[1]);
@@ -52,21 +123,15 @@ static t_int *tabwrite_tilde_perform(t_int *w)
     if (endphase > phase)
     {
         int nxfer = endphase - phase;
-        t_word *wp = x->x_vec + phase;
         if (nxfer > n) nxfer = n;
+        tab_putwords(x->x_vec + phase, in, nxfer);
+            /* report each block as we go, so that the array's peak cache
+            and anything else computed from it don't fall behind; the
+            redraws this asks for are throttled */
+        garray_redrawrange(x->x_garray, phase, phase + nxfer);
         phase += nxfer;
-        while (nxfer--)
-        {
-            t_sample f = *in++;
-            if (PD_BIGORSMALL(f))
-                f = 0;
-            (wp++)->w_float = f;
-        }
         if (phase >= endphase)
-        {
-            tabwrite_tilde_redraw(x);
             phase = 0x7fffffff;
-        }
         x->x_phase = phase;
     }
     else x->x_phase = 0x7fffffff;
@@ -90,7 +155,11 @@ static void tabwrite_tilde_set(t_tabwrite_tilde *x, t_symbol *s)
         pd_error(x, "%s: bad template for tabwrite~", x->x_arrayname->s_name);
         x->x_vec = 0;
     }
-    else garray_usedindsp(a);
+    else
+    {
+        x->x_garray = a;
+        garray_usedindsp(a);
+    }
 }
 
 static void tabwrite_tilde_dsp(t_tabwrite_tilde *x, t_signal **sp)
@@ -111,11 +180,7 @@ static void tabwrite_tilde_start(t_tabwrite_tilde *x, t_floatarg f)
 
 static void tabwrite_tilde_stop(t_tabwrite_tilde *x)
 {
-    if (x->x_phase != 0x7fffffff)
-    {
-        tabwrite_tilde_redraw(x);
-        x->x_phase = 0x7fffffff;
-    }
+    x->x_phase = 0x7fffffff;
 }
 
 static void tabwrite_tilde_setup(void)
@@ -123,6 +188,7 @@ static void tabwrite_tilde_setup(void)
     tabwrite_tilde_class = class_new(gensym("tabwrite~"),
         (t_newmethod)tabwrite_tilde_new, 0,
         sizeof(t_tabwrite_tilde), 0, A_DEFSYM, 0);
+    class_setdspflags(tabwrite_tilde_class, CLASS_NOPARALLEL);
     CLASS_MAINSIGNALIN(tabwrite_tilde_class, t_tabwrite_tilde, x_f);
     class_addmethod(tabwrite_tilde_class, (t_method)tabwrite_tilde_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -147,8 +213,15 @@ typedef struct _tabplay_tilde
     int x_nsampsintab;
     int x_limit;
     t_word *x_vec;
+    t_sftable *x_sftable;   /* if no array, an sftable to play instead */
     t_symbol *x_arrayname;
     t_clock *x_clock;
+    int x_nextphase;        /* start and end of a "play" message... */
+    int x_nextlimit;
+    double x_nexttime;      /* ... and the logical time it arrived */
+    int x_pending;          /* true if it hasn't taken effect yet */
+    t_float x_sr;
+    t_blocktime x_blocktime;
 } t_tabplay_tilde;
 
 static void tabplay_tilde_tick(t_tabplay_tilde *x);
@@ -159,31 +232,42 @@ static void *tabplay_tilde_new(t_symbol *s)
     x->x_clock = clock_new(x, (t_method)tabplay_tilde_tick);
     x->x_phase = 0x7fffffff;
     x->x_limit = 0;
+    x->x_pending = 0;
+    x->x_sr = 44100;
+    blocktime_init(&x->x_blocktime);
     x->x_arrayname = s;
+    x->x_vec = 0;
+    x->x_sftable = 0;
     outlet_new(&x->x_obj, &s_signal);
     x->x_bangout = outlet_new(&x->x_obj, &s_bang);
     return (x);
 }
 
-static t_int *tabplay_tilde_perform(t_int *w)
+static void tabplay_tilde_play(t_tabplay_tilde *x, t_sample *out, int n)
 {
-    t_tabplay_tilde *x = (t_tabplay_tilde *)(w[1]);
-    t_sample *out = (t_sample *)(w[2]);
-    t_word *wp;
-    int n = (int)(w[3]), phase = x->x_phase,
+    int phase = x->x_phase,
         endphase = (x->x_nsampsintab < x->x_limit ?
             x->x_nsampsintab : x->x_limit), nxfer, n3;
-    if (!x->x_vec || phase >= endphase)
+    if ((!x->x_vec && !x->x_sftable) || phase >= endphase)
         goto zero;
 
     nxfer = endphase - phase;
-    wp = x->x_vec + phase;
     if (nxfer > n)
         nxfer = n;
     n3 = n - nxfer;
-    phase += nxfer;
-    while (nxfer--)
-        *out++ = (wp++)->w_float;
+    if (x->x_sftable)
+    {
+        long i;
+        for (i = phase; i < phase + nxfer; i++)
+            *out++ = sftable_get(x->x_sftable, i);
+        phase += nxfer;
+    }
+    else
+    {
+        tab_getwords(out, x->x_vec + phase, nxfer);
+        out += nxfer;
+        phase += nxfer;
+    }
     if (phase >= endphase)
     {
         clock_delay(x->x_clock, 0);
@@ -192,10 +276,35 @@ static t_int *tabplay_tilde_perform(t_int *w)
             *out++ = 0;
     }
     else x->x_phase = phase;
-
-    return (w+4);
+    return;
 zero:
     while (n--) *out++ = 0;
+}
+
+    /* "play" messages start at the sample they arrived at */
+static t_int *tabplay_tilde_perform(t_int *w)
+{
+    t_tabplay_tilde *x = (t_tabplay_tilde *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    int n = (int)(w[3]), onset = n;
+    blocktime_advance(&x->x_blocktime, n, x->x_sr);
+    if (x->x_pending)
+        onset = blocktime_offset(&x->x_blocktime, x->x_nexttime, n);
+    if (x->x_sftable)
+    {
+        long size = sftable_lock(x->x_sftable);
+        x->x_nsampsintab = (size < 0x7fffffff ? (int)size : 0x7fffffff);
+    }
+    tabplay_tilde_play(x, out, onset);
+    if (onset < n)
+    {
+        x->x_phase = x->x_nextphase;
+        x->x_limit = x->x_nextlimit;
+        x->x_pending = 0;
+        tabplay_tilde_play(x, out + onset, n - onset);
+    }
+    if (x->x_sftable)
+        sftable_unlock(x->x_sftable);
     return (w+4);
 }
 
@@ -204,9 +313,12 @@ static void tabplay_tilde_set(t_tabplay_tilde *x, t_symbol *s)
     t_garray *a;
 
     x->x_arrayname = s;
+    x->x_sftable = 0;
     if (!(a = (t_garray *)pd_findbyclass(x->x_arrayname, garray_class)))
     {
-        if (*s->s_name) pd_error(x, "tabplay~: %s: no such array",
+        if ((x->x_sftable = sftable_find(s)))
+            x->x_nsampsintab = 0;
+        else if (*s->s_name) pd_error(x, "tabplay~: %s: no such array",
             x->x_arrayname->s_name);
         x->x_vec = 0;
     }
@@ -221,6 +333,7 @@ static void tabplay_tilde_set(t_tabplay_tilde *x, t_symbol *s)
 static void tabplay_tilde_dsp(t_tabplay_tilde *x, t_signal **sp)
 {
     tabplay_tilde_set(x, x->x_arrayname);
+    x->x_sr = sp[0]->s_sr;
     dsp_add(tabplay_tilde_perform, 3, x, sp[0]->s_vec, sp[0]->s_n);
 }
 
@@ -230,16 +343,24 @@ static void tabplay_tilde_list(t_tabplay_tilde *x, t_symbol *s,
     long start = atom_getfloatarg(0, argc, argv);
     long length = atom_getfloatarg(1, argc, argv);
     if (start < 0) start = 0;
+    if (x->x_pending)
+    {
+        x->x_phase = x->x_nextphase;
+        x->x_limit = x->x_nextlimit;
+    }
     if (length <= 0)
-        x->x_limit = 0x7fffffff;
+        x->x_nextlimit = 0x7fffffff;
     else
-        x->x_limit = (int)(start + length);
-    x->x_phase = (int)start;
+        x->x_nextlimit = (int)(start + length);
+    x->x_nextphase = (int)start;
+    x->x_nexttime = clock_getlogicaltime();
+    x->x_pending = 1;
 }
 
 static void tabplay_tilde_stop(t_tabplay_tilde *x)
 {
     x->x_phase = 0x7fffffff;
+    x->x_pending = 0;
 }
 
 static void tabplay_tilde_tick(t_tabplay_tilde *x)
@@ -257,6 +378,7 @@ static void tabplay_tilde_setup(void)
     tabplay_tilde_class = class_new(gensym("tabplay~"),
         (t_newmethod)tabplay_tilde_new, (t_method)tabplay_tilde_free,
         sizeof(t_tabplay_tilde), 0, A_DEFSYM, 0);
+    class_setdspflags(tabplay_tilde_class, CLASS_NOPARALLEL);
     class_addmethod(tabplay_tilde_class, (t_method)tabplay_tilde_dsp,
         gensym("dsp"), A_CANT, 0);
     class_addmethod(tabplay_tilde_class, (t_method)tabplay_tilde_stop,
@@ -372,6 +494,7 @@ typedef struct _tabread4_tilde
     t_object x_obj;
     int x_npoints;
     t_word *x_vec;
+    t_sftable *x_sftable;   /* if no array, an sftable to read instead */
     t_symbol *x_arrayname;
     t_float x_f;
     t_float x_onset;
@@ -382,6 +505,7 @@ static void *tabread4_tilde_new(t_symbol *s)
     t_tabread4_tilde *x = (t_tabread4_tilde *)pd_new(tabread4_tilde_class);
     x->x_arrayname = s;
     x->x_vec = 0;
+    x->x_sftable = 0;
     outlet_new(&x->x_obj, gensym("signal"));
     floatinlet_new(&x->x_obj, &x->x_onset);
     x->x_f = 0;
@@ -389,6 +513,100 @@ static void *tabread4_tilde_new(t_symbol *s)
     return (x);
 }
 
+    /* the same, reading from an sftable a sample at a time */
+static t_int *tabread4_tilde_sfperform(t_int *w)
+{
+    t_tabread4_tilde *x = (t_tabread4_tilde *)(w[1]);
+    t_sample *in = (t_sample *)(w[2]);
+    t_sample *out = (t_sample *)(w[3]);
+    int n = (int)(w[4]), i;
+    t_sftable *sf = x->x_sftable;
+    long maxindex = sftable_lock(sf) - 3;
+    double onset = x->x_onset;
+
+    for (i = 0; i < n; i++)
+    {
+        double findex = *in++ + onset;
+        long index = findex;
+        t_sample frac,  a,  b,  c,  d, cminusb;
+        if (maxindex < 0)
+        {
+            *out++ = 0;
+            continue;
+        }
+        if (index < 1)
+            index = 1, frac = 0;
+        else if (index > maxindex)
+            index = maxindex, frac = 1;
+        else frac = findex - index;
+        a = sftable_get(sf, index - 1);
+        b = sftable_get(sf, index);
+        c = sftable_get(sf, index + 1);
+        d = sftable_get(sf, index + 2);
+        cminusb = c-b;
+        *out++ = b + frac * (
+            cminusb - 0.1666667f * (1.-frac) * (
+                (d - a - 3.0f * cminusb) * frac + (d + 2.0f*a - 3.0f*b)
+            )
+        );
+    }
+    sftable_unlock(sf);
+    return (w+5);
+}
+
+    /* The SSE2 code below does four-point interpolation four samples at a
+    time.  The four points for each sample are got with tab_sse_load() and
+    the four samples' points are then transposed. */
+#ifdef TAB_SSE
+    /* interpolate four samples; p[i] points to the first of sample i's
+    four points */
+static inline __m128 tab4_sse_interp(t_word **p, __m128 frac)
+{
+    __m128 a = tab_sse_load(p[0]), b = tab_sse_load(p[1]),
+        c = tab_sse_load(p[2]), d = tab_sse_load(p[3]), cminusb,
+        three = _mm_set1_ps(3.0f);
+    _MM_TRANSPOSE4_PS(a, b, c, d);
+    cminusb = _mm_sub_ps(c, b);
+    return (_mm_add_ps(b, _mm_mul_ps(frac, _mm_sub_ps(cminusb, _mm_mul_ps(
+        _mm_mul_ps(_mm_set1_ps(0.1666667f), _mm_sub_ps(_mm_set1_ps(1.0f),
+            frac)),
+        _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_sub_ps(d, a),
+            _mm_mul_ps(three, cminusb)), frac),
+            _mm_sub_ps(_mm_add_ps(d, _mm_add_ps(a, a)),
+                _mm_mul_ps(three, b))))))));
+}
+#endif /* TAB_SSE */
+
+    /* the general case, clamping the index to the table */
+static void tabread4_tilde_clamped(t_word *buf, int maxindex,
+    t_sample *in, t_sample *out, int n, double onset)
+{
+    int i;
+    t_word *wp;
+    for (i = 0; i < n; i++)
+    {
+        double findex = *in++ + onset;
+        int index = findex;
+        t_sample frac,  a,  b,  c,  d, cminusb;
+        if (index < 1)
+            index = 1, frac = 0;
+        else if (index > maxindex)
+            index = maxindex, frac = 1;
+        else frac = findex - index;
+        wp = buf + index;
+        a = wp[-1].w_float;
+        b = wp[0].w_float;
+        c = wp[1].w_float;
+        d = wp[2].w_float;
+        cminusb = c-b;
+        *out++ = b + frac * (
+            cminusb - 0.1666667f * (1.-frac) * (
+                (d - a - 3.0f * cminusb) * frac + (d + 2.0f*a - 3.0f*b)
+            )
+        );
+    }
+}
+
 static t_int *tabread4_tilde_perform(t_int *w)
 {
     t_tabread4_tilde *x = (t_tabread4_tilde *)(w[1]);
@@ -396,10 +614,12 @@ static t_int *tabread4_tilde_perform(t_int *w)
     t_sample *out = (t_sample *)(w[3]);
     int n = (int)(w[4]);
     int maxindex;
-    t_word *buf = x->x_vec, *wp;
+    t_word *buf = x->x_vec;
     double onset = x->x_onset;
-    int i;
+    int i = 0;
 
+    if (x->x_sftable)
+        return (tabread4_tilde_sfperform(w));
     maxindex = x->x_npoints - 3;
     if(maxindex<0) goto zero;
 
@@ -421,28 +641,40 @@ static t_int *tabread4_tilde_perform(t_int *w)
     }
 #endif
 
-    for (i = 0; i < n; i++)
+#ifdef TAB_SSE
+        /* groups of four that are all within the table need no clamping
+        (comparisons with a NAN fail, so those go the slow way too) */
     {
-        double findex = *in++ + onset;
-        int index = findex;
-        t_sample frac,  a,  b,  c,  d, cminusb;
-        if (index < 1)
-            index = 1, frac = 0;
-        else if (index > maxindex)
-            index = maxindex, frac = 1;
-        else frac = findex - index;
-        wp = buf + index;
-        a = wp[-1].w_float;
-        b = wp[0].w_float;
-        c = wp[1].w_float;
-        d = wp[2].w_float;
-        cminusb = c-b;
-        *out++ = b + frac * (
-            cminusb - 0.1666667f * (1.-frac) * (
-                (d - a - 3.0f * cminusb) * frac + (d + 2.0f*a - 3.0f*b)
-            )
-        );
+        __m128d vonset = _mm_set1_pd(onset), lo = _mm_set1_pd(1),
+            hi = _mm_set1_pd(maxindex + 1.);
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128 f = _mm_loadu_ps(in + i);
+            __m128d f0 = _mm_add_pd(_mm_cvtps_pd(f), vonset),
+                f1 = _mm_add_pd(_mm_cvtps_pd(_mm_movehl_ps(f, f)), vonset);
+            __m128i i0, i1;
+            int k[4];
+            t_word *p[4];
+            if ((_mm_movemask_pd(_mm_and_pd(_mm_cmpge_pd(f0, lo),
+                _mm_cmplt_pd(f0, hi))) & _mm_movemask_pd(_mm_and_pd(
+                    _mm_cmpge_pd(f1, lo), _mm_cmplt_pd(f1, hi)))) != 3)
+            {
+                tabread4_tilde_clamped(buf, maxindex, in + i, out + i, 4,
+                    onset);
+                continue;
+            }
+            i0 = _mm_cvttpd_epi32(f0);
+            i1 = _mm_cvttpd_epi32(f1);
+            f = _mm_movelh_ps(_mm_cvtpd_ps(_mm_sub_pd(f0, _mm_cvtepi32_pd(i0))),
+                _mm_cvtpd_ps(_mm_sub_pd(f1, _mm_cvtepi32_pd(i1))));
+            _mm_storeu_si128((__m128i *)k, _mm_unpacklo_epi64(i0, i1));
+            p[0] = buf + k[0] - 1; p[1] = buf + k[1] - 1;
+            p[2] = buf + k[2] - 1; p[3] = buf + k[3] - 1;
+            _mm_storeu_ps(out + i, tab4_sse_interp(p, f));
+        }
     }
+#endif
+    tabread4_tilde_clamped(buf, maxindex, in + i, out + i, n - i, onset);
     return (w+5);
  zero:
     while (n--) *out++ = 0;
@@ -455,9 +687,10 @@ static void tabread4_tilde_set(t_tabread4_tilde *x, t_symbol *s)
     t_garray *a;
 
     x->x_arrayname = s;
+    x->x_sftable = 0;
     if (!(a = (t_garray *)pd_findbyclass(x->x_arrayname, garray_class)))
     {
-        if (*s->s_name)
+        if (!(x->x_sftable = sftable_find(s)) && *s->s_name)
             pd_error(x, "tabread4~: %s: no such array", x->x_arrayname->s_name);
         x->x_vec = 0;
     }
@@ -582,6 +815,25 @@ static t_int *tabosc4_tilde_perform(t_int *w)
     tf.tf_d = UNITBIT32;
     normhipart = tf.tf_i[HIOFFSET];
 
+#ifdef TAB_SSE
+        /* the phase is still advanced a sample at a time, in double
+        precision, but the table lookups are done four at a time */
+    for (; n >= 4; n -= 4, in += 4, out += 4)
+    {
+        t_word *p[4];
+        float f[4];
+        int i;
+        for (i = 0; i < 4; i++)
+        {
+            tf.tf_d = dphase;
+            dphase += in[i] * conv;
+            p[i] = tab + (tf.tf_i[HIOFFSET] & mask);
+            tf.tf_i[HIOFFSET] = normhipart;
+            f[i] = tf.tf_d - UNITBIT32;
+        }
+        _mm_storeu_ps(out, tab4_sse_interp(p, _mm_loadu_ps(f)));
+    }
+#endif
 #if 1
     while (n--)
     {
@@ -684,6 +936,7 @@ typedef struct _tabsend
 {
     t_object x_obj;
     t_word *x_vec;
+    t_garray *x_garray; /* the array x_vec is in, to report what we write */
     int x_graphperiod;
     int x_graphcount;
     t_symbol *x_arrayname;
@@ -712,21 +965,15 @@ static t_int *tabsend_perform(t_int *w)
     if (!x->x_vec) goto bad;
     if (n > x->x_npoints)
         n = x->x_npoints;
-    while (n--)
-    {
-        t_sample f = *in++;
-        if (PD_BIGORSMALL(f))
-            f = 0;
-         (dest++)->w_float = f;
-    }
+    tab_putwords(dest, in, n);
+        /* the whole thing changes every block, but is only redrawn about
+        once a second */
     if (!i--)
     {
-        t_garray *a = (t_garray *)pd_findbyclass(x->x_arrayname, garray_class);
-        if (!a)
-            bug("tabsend_dsp");
-        else garray_redraw(a);
+        garray_redrawrange(x->x_garray, 0, n);
         i = x->x_graphperiod;
     }
+    else garray_dirtyrange(x->x_garray, 0, n);
     x->x_graphcount = i;
 bad:
     return (w+4);
@@ -748,7 +995,11 @@ static void tabsend_set(t_tabsend *x, t_symbol *s)
         pd_error(x, "%s: bad template for tabsend~", x->x_arrayname->s_name);
         x->x_vec = 0;
     }
-    else garray_usedindsp(a);
+    else
+    {
+        x->x_garray = a;
+        garray_usedindsp(a);
+    }
 }
 
 static void tabsend_dsp(t_tabsend *x, t_signal **sp)
@@ -766,6 +1017,7 @@ static void tabsend_setup(void)
 {
     tabsend_class = class_new(gensym("tabsend~"), (t_newmethod)tabsend_new,
         0, sizeof(t_tabsend), 0, A_DEFSYM, 0);
+    class_setdspflags(tabsend_class, CLASS_NOPARALLEL);
     CLASS_MAINSIGNALIN(tabsend_class, t_tabsend, x_f);
     class_addmethod(tabsend_class, (t_method)tabsend_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -796,8 +1048,8 @@ static t_int *tabreceive_perform(t_int *w)
         t_int vecsize = x->x_npoints;
         if (vecsize > n)
             vecsize = n;
-        while (vecsize--)
-            *out++ = (from++)->w_float;
+        tab_getwords(out, from, (int)vecsize);
+        out += vecsize;
         vecsize = n - x->x_npoints;
         if (vecsize > 0)
             while (vecsize--)
@@ -2,12 +2,29 @@
 * For information on usage and redistribution, and for a DISCLAIMER OF ALL
 * WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
 
-/*  sig~ and line~ control-to-signal converters;
+/*  sig~, line~ and smooth~ control-to-signal converters;
     snapshot~ signal-to-control converter.
+
+    sig~ and line~ apply incoming messages at the sample corresponding to
+    the logical time they arrive at (see blocktime_advance() in m_sched.c),
+    not at the start of the next block.  If a second message arrives before
+    the first one takes effect, the first one takes effect right away.
+    line~ keeps its old, block-quantized ramps for compatibility 0.50 and
+    earlier.
+    smooth~, which is meant for de-zippering parameters, only looks at its
+    target at the start of each block.
 */
 
 #include "m_pd.h"
+#include "s_stuff.h"
 #include "math.h"
+#include <string.h>
+
+#if PD_FLOATSIZE == 32 && (defined(__SSE__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#define CTL_SSE
+#include <xmmintrin.h>
+#endif
 
 /* -------------------------- sig~ ------------------------------ */
 static t_class *sig_tilde_class;
@@ -16,6 +33,11 @@ typedef struct _sig
 {
     t_object x_obj;
     t_float x_f;
+    t_float x_next;         /* new value waiting to take effect */
+    double x_nexttime;      /* logical time it arrived */
+    int x_pending;          /* true if there's one */
+    t_float x_sr;
+    t_blocktime x_blocktime;
 } t_sig;
 
 static t_int *sig_tilde_perform(t_int *w)
@@ -56,20 +78,50 @@ void dsp_add_scalarcopy(t_float *in, t_sample *out, int n)
         dsp_add(sig_tilde_perf8, 3, in, out, n);
 }
 
+static t_int *sig_tilde_perfevent(t_int *w)
+{
+    t_sig *x = (t_sig *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    int n = (int)(w[3]), i, onset = n;
+    t_sample f = x->x_f;
+    blocktime_advance(&x->x_blocktime, n, x->x_sr);
+    if (x->x_pending)
+        onset = blocktime_offset(&x->x_blocktime, x->x_nexttime, n);
+    for (i = 0; i < onset; i++)
+        out[i] = f;
+    if (onset < n)
+    {
+        f = x->x_f = x->x_next;
+        x->x_pending = 0;
+        for (; i < n; i++)
+            out[i] = f;
+    }
+    return (w+4);
+}
+
 static void sig_tilde_float(t_sig *x, t_float f)
 {
-    x->x_f = f;
+    if (x->x_pending)
+        x->x_f = x->x_next;
+    x->x_next = f;
+    x->x_nexttime = clock_getlogicaltime();
+    x->x_pending = 1;
 }
 
 static void sig_tilde_dsp(t_sig *x, t_signal **sp)
 {
-    dsp_add(sig_tilde_perform, 3, &x->x_f, sp[0]->s_vec, sp[0]->s_n);
+    x->x_sr = sp[0]->s_sr;
+    dsp_add(sig_tilde_perfevent, 3, x, sp[0]->s_vec, sp[0]->s_n);
 }
 
 static void *sig_tilde_new(t_floatarg f)
 {
     t_sig *x = (t_sig *)pd_new(sig_tilde_class);
-    x->x_f = f;
+    x->x_f = x->x_next = f;
+    x->x_nexttime = 0;
+    x->x_pending = 0;
+    x->x_sr = 44100;
+    blocktime_init(&x->x_blocktime);
     outlet_new(&x->x_obj, gensym("signal"));
     return (x);
 }
@@ -90,53 +142,92 @@ typedef struct _line
 {
     t_object x_obj;
     t_sample x_target; /* target value of ramp */
-    t_sample x_value; /* current value of ramp at block-borders */
-    t_sample x_biginc;
-    t_sample x_inc;
+    double x_value;     /* value of the next sample */
+    double x_inc;       /* increment per sample */
+    int x_samplesleft;  /* samples to go in the current ramp */
+    t_float x_sr;
+    t_float x_inletvalue;
+    t_sample x_nexttarget;  /* next ramp waiting to start: */
+    t_float x_nexttime;     /* ... its length in msec */
+    double x_nextlogicaltime;   /* ... and when it arrived */
+    int x_pending;          /* true if there's one */
+    t_blocktime x_blocktime;
+        /* before Pd 0.51, ramps started at the next block boundary and
+        lasted a whole number of blocks; we still do that for
+        "pd compatibility 0.50" and earlier: */
+    int x_oldramps;         /* true to do it the old way */
+    t_sample x_biginc;      /* increment per block */
+    t_sample x_blockinc;    /* and per sample within it */
     t_float x_1overn;
     t_float x_dspticktomsec;
-    t_float x_inletvalue;
     t_float x_inletwas;
     int x_ticksleft;
     int x_retarget;
 } t_line;
 
-static t_int *line_tilde_perform(t_int *w)
+    /* start the waiting ramp from wherever we are now */
+static void line_tilde_start(t_line *x)
 {
-    t_line *x = (t_line *)(w[1]);
-    t_sample *out = (t_sample *)(w[2]);
-    int n = (int)(w[3]);
-    t_sample f = x->x_value;
-
-    if (PD_BIGORSMALL(f))
-            x->x_value = f = 0;
-    if (x->x_retarget)
+    int nsamps = x->x_nexttime * x->x_sr * 0.001 + 0.5;
+    x->x_target = x->x_nexttarget;
+    if (x->x_nexttime <= 0)
     {
-        int nticks = x->x_inletwas * x->x_dspticktomsec;
-        if (!nticks) nticks = 1;
-        x->x_ticksleft = nticks;
-        x->x_biginc = (x->x_target - x->x_value)/(t_float)nticks;
-        x->x_inc = x->x_1overn * x->x_biginc;
-        x->x_retarget = 0;
+        x->x_value = x->x_target;
+        x->x_samplesleft = 0;
     }
-    if (x->x_ticksleft)
+    else
     {
-        t_sample f = x->x_value;
-        while (n--) *out++ = f, f += x->x_inc;
-        x->x_value += x->x_biginc;
-        x->x_ticksleft--;
+        if (nsamps < 1)
+            nsamps = 1;
+        x->x_samplesleft = nsamps;
+        x->x_inc = (x->x_target - x->x_value) / nsamps;
     }
-    else
+    x->x_pending = 0;
+}
+
+static void line_tilde_run(t_line *x, t_sample *out, int n)
+{
+    if (x->x_samplesleft)
     {
-        t_sample g = x->x_value = x->x_target;
+        int nramp = (x->x_samplesleft < n ? x->x_samplesleft : n);
+        double f = x->x_value, inc = x->x_inc;
+        n -= nramp;
+        x->x_samplesleft -= nramp;
+        while (nramp--)
+            *out++ = f, f += inc;
+        x->x_value = f;
+    }
+    if (n)
+    {
+        t_sample g = x->x_target;
+        x->x_value = g;
         while (n--)
             *out++ = g;
     }
+}
+
+static t_int *line_tilde_perform(t_int *w)
+{
+    t_line *x = (t_line *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    int n = (int)(w[3]), onset = n;
+    t_sample f = x->x_value;
+
+    if (PD_BIGORSMALL(f))
+        x->x_value = 0;
+    blocktime_advance(&x->x_blocktime, n, x->x_sr);
+    if (x->x_pending)
+        onset = blocktime_offset(&x->x_blocktime, x->x_nextlogicaltime, n);
+    line_tilde_run(x, out, onset);
+    if (onset < n)
+    {
+        line_tilde_start(x);
+        line_tilde_run(x, out + onset, n - onset);
+    }
     return (w+4);
 }
 
-/* TB: vectorized version */
-static t_int *line_tilde_perf8(t_int *w)
+static t_int *line_tilde_perform_old(t_int *w)
 {
     t_line *x = (t_line *)(w[1]);
     t_sample *out = (t_sample *)(w[2]);
@@ -150,59 +241,70 @@ static t_int *line_tilde_perf8(t_int *w)
         int nticks = x->x_inletwas * x->x_dspticktomsec;
         if (!nticks) nticks = 1;
         x->x_ticksleft = nticks;
-        x->x_biginc = (x->x_target - x->x_value)/(t_sample)nticks;
-        x->x_inc = x->x_1overn * x->x_biginc;
+        x->x_biginc = (x->x_target - x->x_value)/(t_float)nticks;
+        x->x_blockinc = x->x_1overn * x->x_biginc;
         x->x_retarget = 0;
     }
     if (x->x_ticksleft)
     {
         t_sample f = x->x_value;
-        while (n--) *out++ = f, f += x->x_inc;
+        while (n--) *out++ = f, f += x->x_blockinc;
         x->x_value += x->x_biginc;
         x->x_ticksleft--;
     }
     else
     {
-        t_sample f = x->x_value = x->x_target;
-        for (; n; n -= 8, out += 8)
-        {
-            out[0] = f; out[1] = f; out[2] = f; out[3] = f;
-            out[4] = f; out[5] = f; out[6] = f; out[7] = f;
-        }
+        t_sample g = x->x_value = x->x_target;
+        while (n--)
+            *out++ = g;
     }
     return (w+4);
 }
 
 static void line_tilde_float(t_line *x, t_float f)
 {
-    if (x->x_inletvalue <= 0)
+    if (x->x_oldramps)
     {
-        x->x_target = x->x_value = f;
-        x->x_ticksleft = x->x_retarget = 0;
-    }
-    else
-    {
-        x->x_target = f;
-        x->x_retarget = 1;
-        x->x_inletwas = x->x_inletvalue;
-        x->x_inletvalue = 0;
+        if (x->x_inletvalue <= 0)
+        {
+            x->x_target = x->x_value = f;
+            x->x_ticksleft = x->x_retarget = 0;
+        }
+        else
+        {
+            x->x_target = f;
+            x->x_retarget = 1;
+            x->x_inletwas = x->x_inletvalue;
+            x->x_inletvalue = 0;
+        }
+        return;
     }
+    if (x->x_pending)
+        line_tilde_start(x);
+    x->x_nexttarget = f;
+    x->x_nexttime = x->x_inletvalue;
+    x->x_nextlogicaltime = clock_getlogicaltime();
+    x->x_pending = 1;
+    x->x_inletvalue = 0;
 }
 
 static void line_tilde_stop(t_line *x)
 {
     x->x_target = x->x_value;
+    x->x_samplesleft = x->x_pending = 0;
     x->x_ticksleft = x->x_retarget = 0;
 }
 
 static void line_tilde_dsp(t_line *x, t_signal **sp)
 {
-    if(sp[0]->s_n&7)
-        dsp_add(line_tilde_perform, 3, x, sp[0]->s_vec, sp[0]->s_n);
-    else
-        dsp_add(line_tilde_perf8, 3, x, sp[0]->s_vec, sp[0]->s_n);
-    x->x_1overn = 1./sp[0]->s_n;
-    x->x_dspticktomsec = sp[0]->s_sr / (1000 * sp[0]->s_n);
+    x->x_sr = sp[0]->s_sr;
+    if ((x->x_oldramps = (pd_compatibilitylevel < 51)))
+    {
+        x->x_1overn = 1./sp[0]->s_n;
+        x->x_dspticktomsec = sp[0]->s_sr / (1000 * sp[0]->s_n);
+        dsp_add(line_tilde_perform_old, 3, x, sp[0]->s_vec, sp[0]->s_n);
+    }
+    else dsp_add(line_tilde_perform, 3, x, sp[0]->s_vec, sp[0]->s_n);
 }
 
 static void *line_tilde_new(void)
@@ -210,8 +312,18 @@ static void *line_tilde_new(void)
     t_line *x = (t_line *)pd_new(line_tilde_class);
     outlet_new(&x->x_obj, gensym("signal"));
     floatinlet_new(&x->x_obj, &x->x_inletvalue);
+    x->x_samplesleft = x->x_pending = 0;
+    x->x_value = x->x_inc = 0;
+    x->x_target = x->x_nexttarget = x->x_inletvalue = x->x_nexttime = 0;
+    x->x_nextlogicaltime = 0;
+    x->x_sr = 44100;
+    blocktime_init(&x->x_blocktime);
+    x->x_oldramps = (pd_compatibilitylevel < 51);
+    x->x_biginc = x->x_blockinc = 0;
+    x->x_1overn = 1./64;
+    x->x_dspticktomsec = 44100. / (1000 * 64);
+    x->x_inletwas = 0;
     x->x_ticksleft = x->x_retarget = 0;
-    x->x_value = x->x_target = x->x_inletvalue = x->x_inletwas = 0;
     return (x);
 }
 
@@ -228,7 +340,7 @@ static void line_tilde_setup(void)
 
 /* -------------------------- vline~ ------------------------------ */
 static t_class *vline_tilde_class;
-#include "s_stuff.h"    /* for DEFDACBLKSIZE; this should be in m_pd.h */
+#include "s_stuff.h"    /* for st_schedblocksize */
 typedef struct _vseg
 {
     double s_targettime;
@@ -266,7 +378,8 @@ static t_int *vline_tilde_perform(t_int *w)
     t_vseg *s = x->x_list;
     if (logicaltimenow != x->x_lastlogicaltime)
     {
-        int sampstotime = (n > DEFDACBLKSIZE ? n : DEFDACBLKSIZE);
+        int sampstotime = (n > STUFF->st_schedblocksize ?
+            n : STUFF->st_schedblocksize);
         x->x_lastlogicaltime = logicaltimenow;
         x->x_nextblocktime = logicaltimenow - sampstotime * msecpersamp;
     }
@@ -420,6 +533,172 @@ static void vline_tilde_setup(void)
         gensym("stop"), 0);
 }
 
+/* -------------------------- smooth~ ------------------------------ */
+static t_class *smooth_tilde_class;
+
+typedef struct _smooth
+{
+    t_object x_obj;
+    t_float x_target;       /* value we're headed for */
+    t_float x_time;         /* ramp time or time constant in msec */
+    t_sample x_value;       /* value of the last sample output */
+    t_sample x_inc;         /* linear: increment per sample */
+    int x_nleft;            /* linear: samples to go in the ramp */
+    t_sample x_start;       /* value the current ramp was started toward */
+    int x_exp;              /* true for one-pole, false for linear */
+    t_sample *x_pw;         /* one-pole: decay after 1, 2, ... n samples */
+    int x_n;
+    t_float x_sr;
+} t_smooth;
+
+    /* the one-pole filter's output at sample i of a block is
+
+        target + (value - target) * pw[i],  pw[i] = (1-coef)^(i+1)
+
+    which doesn't depend on the previous output, so the loop can be done
+    in any order or several samples at once. */
+static void smooth_tilde_setpw(t_smooth *x)
+{
+    double k = x->x_time * x->x_sr * 0.001, g = 0, p = 1;
+    int i;
+    if (!x->x_pw)
+        return;
+    if (k > 0)
+        g = exp(-1. / k);
+    for (i = 0; i < x->x_n; i++)
+        x->x_pw[i] = (p *= g);
+}
+
+static t_int *smooth_tilde_perform(t_int *w)
+{
+    t_smooth *x = (t_smooth *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    int n = (int)(w[3]), i, nramp;
+    t_sample target = x->x_target, v = x->x_value, inc;
+    if (x->x_exp)
+    {
+        t_sample d = v - target, *pw = x->x_pw;
+        if (PD_BIGORSMALL(d) || d == 0)
+        {
+            for (i = 0; i < n; i++)
+                out[i] = target;
+            x->x_value = target;
+        }
+        else
+        {
+            for (i = 0; i < n; i++)
+                out[i] = target + d * pw[i];
+            x->x_value = out[n-1];
+        }
+        return (w+4);
+    }
+        /* linear: a new target starts a ramp from where we are now */
+    if (target != x->x_start)
+    {
+        int nsamps = x->x_time * x->x_sr * 0.001 + 0.5;
+        x->x_start = target;
+        if (nsamps < 1)
+            nsamps = 1;
+        x->x_nleft = nsamps;
+        x->x_inc = (target - v) / nsamps;
+    }
+    nramp = (x->x_nleft < n ? x->x_nleft : n);
+    inc = x->x_inc;
+    for (i = 0; i < nramp; i++)
+        out[i] = v + inc * (i + 1);
+    if ((x->x_nleft -= nramp))
+        v += inc * nramp;
+    else v = target;
+    for (i = nramp; i < n; i++)
+        out[i] = v;
+    x->x_value = v;
+    return (w+4);
+}
+
+static void smooth_tilde_float(t_smooth *x, t_float f)
+{
+    x->x_target = f;
+}
+
+    /* jump to a value with no ramp */
+static void smooth_tilde_set(t_smooth *x, t_floatarg f)
+{
+    x->x_target = x->x_start = x->x_value = f;
+    x->x_nleft = 0;
+}
+
+static void smooth_tilde_time(t_smooth *x, t_floatarg f)
+{
+    x->x_time = (f > 0 ? f : 0);
+    if (x->x_exp)
+        smooth_tilde_setpw(x);
+}
+
+static void smooth_tilde_dsp(t_smooth *x, t_signal **sp)
+{
+    if (x->x_exp && x->x_n != sp[0]->s_n)
+    {
+        if (x->x_pw)
+            freebytes(x->x_pw, x->x_n * sizeof(*x->x_pw));
+        x->x_pw = (t_sample *)getbytes(sp[0]->s_n * sizeof(*x->x_pw));
+    }
+    x->x_n = sp[0]->s_n;
+    x->x_sr = sp[0]->s_sr;
+    if (x->x_exp)
+        smooth_tilde_setpw(x);
+    dsp_add(smooth_tilde_perform, 3, x, sp[0]->s_vec, (t_int)sp[0]->s_n);
+}
+
+static void *smooth_tilde_new(t_symbol *s, int argc, t_atom *argv)
+{
+    t_smooth *x = (t_smooth *)pd_new(smooth_tilde_class);
+    x->x_exp = 0;
+    while (argc && argv->a_type == A_SYMBOL &&
+        *argv->a_w.w_symbol->s_name == '-')
+    {
+        if (!strcmp(argv->a_w.w_symbol->s_name, "-exp"))
+            x->x_exp = 1;
+        else if (strcmp(argv->a_w.w_symbol->s_name, "-lin"))
+            pd_error(x, "smooth~: unknown flag %s",
+                argv->a_w.w_symbol->s_name);
+        argc--; argv++;
+    }
+    x->x_time = atom_getfloatarg(0, argc, argv);
+    if (!argc)
+        x->x_time = 10;
+    else if (x->x_time < 0)
+        x->x_time = 0;
+    x->x_target = x->x_start = x->x_value = atom_getfloatarg(1, argc, argv);
+    x->x_inc = 0;
+    x->x_nleft = 0;
+    x->x_pw = 0;
+    x->x_n = 0;
+    x->x_sr = 44100;
+    inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_float, gensym("time"));
+    outlet_new(&x->x_obj, &s_signal);
+    return (x);
+}
+
+static void smooth_tilde_free(t_smooth *x)
+{
+    if (x->x_pw)
+        freebytes(x->x_pw, x->x_n * sizeof(*x->x_pw));
+}
+
+static void smooth_tilde_setup(void)
+{
+    smooth_tilde_class = class_new(gensym("smooth~"),
+        (t_newmethod)smooth_tilde_new, (t_method)smooth_tilde_free,
+            sizeof(t_smooth), 0, A_GIMME, 0);
+    class_addfloat(smooth_tilde_class, (t_method)smooth_tilde_float);
+    class_addmethod(smooth_tilde_class, (t_method)smooth_tilde_set,
+        gensym("set"), A_FLOAT, 0);
+    class_addmethod(smooth_tilde_class, (t_method)smooth_tilde_time,
+        gensym("time"), A_FLOAT, 0);
+    class_addmethod(smooth_tilde_class, (t_method)smooth_tilde_dsp,
+        gensym("dsp"), A_CANT, 0);
+}
+
 /* -------------------------- snapshot~ ------------------------------ */
 static t_class *snapshot_tilde_class;
 
@@ -561,6 +840,263 @@ static void vsnapshot_tilde_setup(void)
     class_addbang(vsnapshot_tilde_class, vsnapshot_tilde_bang);
 }
 
+/* -------------------------- probe~ ------------------------------ */
+
+/* probe~ watches many signals at once, as one DSP chain entry: its
+inlets (one by default, more if given a number) may each be multichannel,
+and a bang outputs one list with a value for every channel of every inlet
+in order.  The value is the latest sample ("last", the default, like
+snapshot~) or the minimum, maximum or mean over the blocks computed since
+the previous bang. */
+
+#define PROBE_LAST 0
+#define PROBE_MIN 1
+#define PROBE_MAX 2
+#define PROBE_MEAN 3
+
+static t_class *probe_tilde_class;
+
+typedef struct _probe
+{
+    t_object x_obj;
+    int x_ninlets;
+    int x_mode;
+    int x_nchans;           /* channels of all the inlets together */
+    int x_n;
+    int x_nblocks;          /* blocks since the last bang */
+    double *x_value;        /* latest sample, or min, max or sum so far */
+    t_atom *x_list;
+    t_float x_f;
+} t_probe;
+
+static t_int *probe_tilde_perform(t_int *w)
+{
+    t_probe *x = (t_probe *)(w[1]);
+    int n = (int)(w[2]), nchans = x->x_nchans, mode = x->x_mode, ch, i;
+    double *value = x->x_value;
+    for (ch = 0; ch < nchans; ch++)
+    {
+        t_sample *in = (t_sample *)(w[3 + ch]);
+        double v = value[ch];
+        if (mode == PROBE_LAST)
+            v = in[n-1];
+        else if (mode == PROBE_MEAN)
+        {
+            if (!x->x_nblocks)
+                v = 0;
+            for (i = 0; i < n; i++)
+                v += in[i];
+        }
+        else
+        {
+            if (!x->x_nblocks)
+                v = in[0];
+            if (mode == PROBE_MIN)
+            {
+                for (i = 0; i < n; i++)
+                    if (in[i] < v)
+                        v = in[i];
+            }
+            else for (i = 0; i < n; i++)
+                if (in[i] > v)
+                    v = in[i];
+        }
+        value[ch] = v;
+    }
+    x->x_nblocks++;
+    return (w + 3 + nchans);
+}
+
+static void probe_tilde_freechans(t_probe *x)
+{
+    if (x->x_nchans)
+    {
+        freebytes(x->x_value, x->x_nchans * sizeof(*x->x_value));
+        freebytes(x->x_list, x->x_nchans * sizeof(*x->x_list));
+    }
+    x->x_nchans = 0;
+}
+
+static void probe_tilde_dsp(t_probe *x, t_signal **sp)
+{
+    int nchans = 0, i, j, k;
+    t_int *vec;
+    for (i = 0; i < x->x_ninlets; i++)
+        nchans += sp[i]->s_nchans;
+    if (nchans != x->x_nchans)
+    {
+        probe_tilde_freechans(x);
+        x->x_value = (double *)getbytes(nchans * sizeof(*x->x_value));
+        x->x_list = (t_atom *)getbytes(nchans * sizeof(*x->x_list));
+        x->x_nchans = nchans;
+    }
+    x->x_n = sp[0]->s_n;
+    x->x_nblocks = 0;
+    vec = (t_int *)getbytes((2 + nchans) * sizeof(*vec));
+    vec[0] = (t_int)x;
+    vec[1] = (t_int)x->x_n;
+    for (i = 0, k = 2; i < x->x_ninlets; i++)
+        for (j = 0; j < sp[i]->s_nchans; j++)
+            vec[k++] = (t_int)(sp[i]->s_vec + j * sp[i]->s_n);
+    dsp_addv(probe_tilde_perform, 2 + nchans, vec);
+    freebytes(vec, (2 + nchans) * sizeof(*vec));
+}
+
+static void probe_tilde_bang(t_probe *x)
+{
+    int i;
+    for (i = 0; i < x->x_nchans; i++)
+    {
+        double v = x->x_value[i];
+        if (x->x_mode == PROBE_MEAN)
+            v = (x->x_nblocks ? v / ((double)x->x_nblocks * x->x_n) : 0);
+        SETFLOAT(&x->x_list[i], v);
+    }
+    if (x->x_mode != PROBE_LAST)
+    {
+            /* start over, unless nothing has been computed since */
+        if (x->x_nblocks)
+            x->x_nblocks = 0;
+        else for (i = 0; i < x->x_nchans; i++)
+            x->x_value[i] = 0;
+    }
+    outlet_list(x->x_obj.ob_outlet, 0, x->x_nchans, x->x_list);
+}
+
+static void probe_tilde_mode(t_probe *x, t_symbol *s)
+{
+    int i;
+    if (s == gensym("last"))
+        x->x_mode = PROBE_LAST;
+    else if (s == gensym("min"))
+        x->x_mode = PROBE_MIN;
+    else if (s == gensym("max"))
+        x->x_mode = PROBE_MAX;
+    else if (s == gensym("mean"))
+        x->x_mode = PROBE_MEAN;
+    else
+    {
+        pd_error(x, "probe~: %s: unknown mode (last, min, max or mean)",
+            s->s_name);
+        return;
+    }
+    x->x_nblocks = 0;
+    for (i = 0; i < x->x_nchans; i++)
+        x->x_value[i] = 0;
+}
+
+static void *probe_tilde_new(t_symbol *s, int argc, t_atom *argv)
+{
+    t_probe *x = (t_probe *)pd_new(probe_tilde_class);
+    int i;
+    x->x_ninlets = 1;
+    x->x_mode = PROBE_LAST;
+    x->x_nchans = 0;
+    x->x_n = 0;
+    x->x_nblocks = 0;
+    x->x_f = 0;
+    for (; argc--; argv++)
+    {
+        if (argv->a_type == A_FLOAT)
+            x->x_ninlets = (argv->a_w.w_float > 1 ? argv->a_w.w_float : 1);
+        else if (argv->a_type == A_SYMBOL)
+            probe_tilde_mode(x, argv->a_w.w_symbol);
+    }
+    for (i = 1; i < x->x_ninlets; i++)
+        inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
+    outlet_new(&x->x_obj, &s_list);
+    return (x);
+}
+
+static void probe_tilde_setup(void)
+{
+    probe_tilde_class = class_new(gensym("probe~"),
+        (t_newmethod)probe_tilde_new, (t_method)probe_tilde_freechans,
+            sizeof(t_probe), 0, A_GIMME, 0);
+    CLASS_MAINSIGNALIN(probe_tilde_class, t_probe, x_f);
+    class_addmethod(probe_tilde_class, (t_method)probe_tilde_dsp,
+        gensym("dsp"), A_CANT, 0);
+    class_addmethod(probe_tilde_class, (t_method)probe_tilde_mode,
+        gensym("mode"), A_SYMBOL, 0);
+    class_addbang(probe_tilde_class, probe_tilde_bang);
+}
+
+/* ------------------------ metering kernels ------------------------- */
+
+    /* these are shared by env~ and meter~ below and by the audio level
+    meters in s_audio.c.  Return the larger of "max" and the largest
+    absolute value in "in": */
+t_sample dsp_peak(const t_sample *in, int n, t_sample max)
+{
+#ifdef CTL_SSE
+    if (n >= 4)
+    {
+        __m128 m = _mm_set1_ps(max), sign = _mm_set1_ps(-0.f);
+        float m4[4];
+        for (; n >= 4; n -= 4, in += 4)
+            m = _mm_max_ps(m, _mm_andnot_ps(sign, _mm_loadu_ps(in)));
+        m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+        m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+        _mm_storeu_ps(m4, m);
+        max = m4[0];
+    }
+#endif
+    for (; n--; in++)
+    {
+        t_sample f = *in;
+        if (f > max) max = f;
+        else if (-f > max) max = -f;
+    }
+    return (max);
+}
+
+    /* sum of squares */
+t_sample dsp_sumsq(const t_sample *in, int n)
+{
+    t_sample sum = 0;
+#ifdef CTL_SSE
+    if (n >= 8)
+    {
+        __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+        float s4[4];
+        for (; n >= 8; n -= 8, in += 8)
+        {
+            __m128 f0 = _mm_loadu_ps(in), f1 = _mm_loadu_ps(in + 4);
+            s0 = _mm_add_ps(s0, _mm_mul_ps(f0, f0));
+            s1 = _mm_add_ps(s1, _mm_mul_ps(f1, f1));
+        }
+        _mm_storeu_ps(s4, _mm_add_ps(s0, s1));
+        sum = (s4[0] + s4[1]) + (s4[2] + s4[3]);
+    }
+#endif
+    for (; n--; in++)
+        sum += *in * *in;
+    return (sum);
+}
+
+    /* dot product */
+t_sample dsp_dot(const t_sample *a, const t_sample *b, int n)
+{
+    t_sample sum = 0;
+#ifdef CTL_SSE
+    if (n >= 8)
+    {
+        __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+        float s4[4];
+        for (; n >= 8; n -= 8, a += 8, b += 8)
+        {
+            s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a), _mm_loadu_ps(b)));
+            s1 = _mm_add_ps(s1,
+                _mm_mul_ps(_mm_loadu_ps(a + 4), _mm_loadu_ps(b + 4)));
+        }
+        _mm_storeu_ps(s4, _mm_add_ps(s0, s1));
+        sum = (s4[0] + s4[1]) + (s4[2] + s4[3]);
+    }
+#endif
+    for (; n--; a++, b++)
+        sum += *a * *b;
+    return (sum);
+}
 
 /* ---------------- env~ - simple envelope follower. ----------------- */
 
@@ -581,6 +1117,8 @@ typedef struct sigenv
     t_sample x_sumbuf[MAXOVERLAP];     /* summing buffer */
     t_float x_f;
     int x_allocforvs;               /* extra buffer for DSP vector size */
+    t_sample *x_sq;                 /* this block's input squared, reversed */
+    int x_sqsize;
 } t_sigenv;
 
 t_class *env_tilde_class;
@@ -616,6 +1154,8 @@ static void *env_tilde_new(t_floatarg fnpoints, t_floatarg fperiod)
     x->x_outlet = outlet_new(&x->x_obj, gensym("float"));
     x->x_f = 0;
     x->x_allocforvs = INITVSTAKEN;
+    x->x_sq = 0;
+    x->x_sqsize = 0;
     return (x);
 }
 
@@ -624,24 +1164,15 @@ static t_int *env_tilde_perform(t_int *w)
     t_sigenv *x = (t_sigenv *)(w[1]);
     t_sample *in = (t_sample *)(w[2]);
     int n = (int)(w[3]);
-    int count;
-    t_sample *sump;
-    in += n;
+    int count, i;
+    t_sample *sump, *sq = x->x_sq;
+        /* each overlapping window takes the same squared input, newest
+        sample first, against a different part of the Hanning window */
+    for (i = 0; i < n; i++)
+        sq[i] = in[n-1-i] * in[n-1-i];
     for (count = x->x_phase, sump = x->x_sumbuf;
         count < x->x_npoints; count += x->x_realperiod, sump++)
-    {
-        t_sample *hp = x->x_buf + count;
-        t_sample *fp = in;
-        t_sample sum = *sump;
-        int i;
-
-        for (i = 0; i < n; i++)
-        {
-            fp--;
-            sum += *hp++ * (*fp * *fp);
-        }
-        *sump = sum;
-    }
+            *sump += dsp_dot(x->x_buf + count, sq, n);
     sump[0] = 0;
     x->x_phase -= n;
     if (x->x_phase < 0)
@@ -675,6 +1206,13 @@ static void env_tilde_dsp(t_sigenv *x, t_signal **sp)
         x->x_buf = (t_sample *)xx;
         x->x_allocforvs = sp[0]->s_n;
     }
+    if (sp[0]->s_n != x->x_sqsize)
+    {
+        if (x->x_sq)
+            freebytes(x->x_sq, x->x_sqsize * sizeof(*x->x_sq));
+        x->x_sq = (t_sample *)getbytes(sp[0]->s_n * sizeof(*x->x_sq));
+        x->x_sqsize = sp[0]->s_n;
+    }
     dsp_add(env_tilde_perform, 3, x, sp[0]->s_vec, sp[0]->s_n);
 }
 
@@ -687,6 +1225,8 @@ static void env_tilde_ff(t_sigenv *x)           /* cleanup on free */
 {
     clock_free(x->x_clock);
     freebytes(x->x_buf, (x->x_npoints + x->x_allocforvs) * sizeof(*x->x_buf));
+    if (x->x_sq)
+        freebytes(x->x_sq, x->x_sqsize * sizeof(*x->x_sq));
 }
 
 
@@ -694,11 +1234,150 @@ void env_tilde_setup(void)
 {
     env_tilde_class = class_new(gensym("env~"), (t_newmethod)env_tilde_new,
         (t_method)env_tilde_ff, sizeof(t_sigenv), 0, A_DEFFLOAT, A_DEFFLOAT, 0);
+    class_setdspflags(env_tilde_class, CLASS_NOPARALLEL);
     CLASS_MAINSIGNALIN(env_tilde_class, t_sigenv, x_f);
     class_addmethod(env_tilde_class, (t_method)env_tilde_dsp,
         gensym("dsp"), A_CANT, 0);
 }
 
+/* ---------------- meter~ - levels of many channels ----------------- */
+
+    /* meter~ reports the RMS and peak level of each channel of a
+    multichannel signal, in dB, as two lists once per period.  The period
+    is rounded up to a whole number of blocks. */
+
+typedef struct _meter
+{
+    t_object x_obj;
+    t_outlet *x_rmsout;
+    t_outlet *x_peakout;
+    t_clock *x_clock;
+    t_float x_periodms;
+    int x_period;               /* period in samples */
+    int x_count;                /* samples so far in this period */
+    int x_nchans;
+    int x_n;                    /* block size and ... */
+    t_float x_sr;               /* sample rate from the last "dsp" call */
+    t_sample *x_sumsq;          /* per channel, accumulating */
+    t_sample *x_peak;
+    t_atom *x_rmslist;          /* last period's results */
+    t_atom *x_peaklist;
+    t_float x_f;
+} t_meter;
+
+static t_class *meter_tilde_class;
+
+static void meter_tilde_setperiod(t_meter *x)
+{
+    int nblocks = x->x_periodms * 0.001 * x->x_sr / x->x_n + 0.99;
+    x->x_period = (nblocks < 1 ? 1 : nblocks) * x->x_n;
+}
+
+static t_int *meter_tilde_perform(t_int *w)
+{
+    t_meter *x = (t_meter *)(w[1]);
+    t_sample *in = (t_sample *)(w[2]);
+    int n = (int)(w[3]), i;
+    for (i = 0; i < x->x_nchans; i++, in += n)
+    {
+        x->x_sumsq[i] += dsp_sumsq(in, n);
+        x->x_peak[i] = dsp_peak(in, n, x->x_peak[i]);
+    }
+    if ((x->x_count += n) >= x->x_period)
+    {
+        for (i = 0; i < x->x_nchans; i++)
+        {
+            SETFLOAT(&x->x_rmslist[i], powtodb(x->x_sumsq[i] / x->x_count));
+            SETFLOAT(&x->x_peaklist[i], rmstodb(x->x_peak[i]));
+            x->x_sumsq[i] = x->x_peak[i] = 0;
+        }
+        x->x_count = 0;
+        clock_delay(x->x_clock, 0L);
+    }
+    return (w+4);
+}
+
+static void meter_tilde_tick(t_meter *x)
+{
+    outlet_list(x->x_peakout, 0, x->x_nchans, x->x_peaklist);
+    outlet_list(x->x_rmsout, 0, x->x_nchans, x->x_rmslist);
+}
+
+static void meter_tilde_freechans(t_meter *x)
+{
+    if (x->x_nchans)
+    {
+        freebytes(x->x_sumsq, x->x_nchans * sizeof(*x->x_sumsq));
+        freebytes(x->x_peak, x->x_nchans * sizeof(*x->x_peak));
+        freebytes(x->x_rmslist, x->x_nchans * sizeof(*x->x_rmslist));
+        freebytes(x->x_peaklist, x->x_nchans * sizeof(*x->x_peaklist));
+    }
+    x->x_nchans = 0;
+}
+
+static void meter_tilde_dsp(t_meter *x, t_signal **sp)
+{
+    int nchans = sp[0]->s_nchans;
+    if (nchans != x->x_nchans)
+    {
+        meter_tilde_freechans(x);
+        x->x_sumsq = (t_sample *)getbytes(nchans * sizeof(*x->x_sumsq));
+        x->x_peak = (t_sample *)getbytes(nchans * sizeof(*x->x_peak));
+        x->x_rmslist = (t_atom *)getbytes(nchans * sizeof(*x->x_rmslist));
+        x->x_peaklist = (t_atom *)getbytes(nchans * sizeof(*x->x_peaklist));
+        x->x_nchans = nchans;
+    }
+    x->x_n = sp[0]->s_n;
+    x->x_sr = sp[0]->s_sr;
+    meter_tilde_setperiod(x);
+    x->x_count = 0;
+    memset(x->x_sumsq, 0, nchans * sizeof(*x->x_sumsq));
+    memset(x->x_peak, 0, nchans * sizeof(*x->x_peak));
+    dsp_add(meter_tilde_perform, 3, x, sp[0]->s_vec, (t_int)sp[0]->s_n);
+}
+
+static void meter_tilde_period(t_meter *x, t_floatarg f)
+{
+    x->x_periodms = (f > 0 ? f : 0);
+    if (x->x_n)
+        meter_tilde_setperiod(x);
+}
+
+static void *meter_tilde_new(t_floatarg fperiod)
+{
+    t_meter *x = (t_meter *)pd_new(meter_tilde_class);
+    x->x_periodms = (fperiod > 0 ? fperiod : 50);
+    x->x_period = 1;
+    x->x_count = 0;
+    x->x_nchans = 0;
+    x->x_n = 0;
+    x->x_sr = 44100;
+    x->x_f = 0;
+    x->x_clock = clock_new(x, (t_method)meter_tilde_tick);
+    x->x_rmsout = outlet_new(&x->x_obj, &s_list);
+    x->x_peakout = outlet_new(&x->x_obj, &s_list);
+    return (x);
+}
+
+static void meter_tilde_free(t_meter *x)
+{
+    clock_free(x->x_clock);
+    meter_tilde_freechans(x);
+}
+
+static void meter_tilde_setup(void)
+{
+    meter_tilde_class = class_new(gensym("meter~"),
+        (t_newmethod)meter_tilde_new, (t_method)meter_tilde_free,
+            sizeof(t_meter), 0, A_DEFFLOAT, 0);
+    class_setdspflags(meter_tilde_class, CLASS_NOPARALLEL);
+    CLASS_MAINSIGNALIN(meter_tilde_class, t_meter, x_f);
+    class_addmethod(meter_tilde_class, (t_method)meter_tilde_dsp,
+        gensym("dsp"), A_CANT, 0);
+    class_addmethod(meter_tilde_class, (t_method)meter_tilde_period,
+        gensym("period"), A_FLOAT, 0);
+}
+
 /* --------------------- threshold~ ----------------------------- */
 
 static t_class *threshold_tilde_class;
@@ -825,6 +1504,7 @@ static void threshold_tilde_setup(void)
         (t_newmethod)threshold_tilde_new, (t_method)threshold_tilde_ff,
         sizeof(t_threshold_tilde), 0,
             A_DEFFLOAT, A_DEFFLOAT, A_DEFFLOAT, A_DEFFLOAT, 0);
+    class_setdspflags(threshold_tilde_class, CLASS_NOPARALLEL);
     CLASS_MAINSIGNALIN(threshold_tilde_class, t_threshold_tilde, x_f);
     class_addmethod(threshold_tilde_class, (t_method)threshold_tilde_set,
         gensym("set"), A_FLOAT, A_FLOAT, A_FLOAT, A_FLOAT, 0);
@@ -841,9 +1521,12 @@ void d_ctl_setup(void)
     sig_tilde_setup();
     line_tilde_setup();
     vline_tilde_setup();
+    smooth_tilde_setup();
     snapshot_tilde_setup();
     vsnapshot_tilde_setup();
+    probe_tilde_setup();
     env_tilde_setup();
+    meter_tilde_setup();
     threshold_tilde_setup();
 }
 
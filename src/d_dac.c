@@ -7,6 +7,9 @@
 
 #include "m_pd.h"
 #include "s_stuff.h"
+void signal_setborrowed(t_signal *sig, t_signal *sig2);
+t_signal *signal_newfromcontext(int borrowed);
+void signal_makereusable(t_signal *sig);
 
 /* ----------------------------- dac~ --------------------------- */
 static t_class *dac_class;
@@ -41,18 +44,23 @@ static void *dac_new(t_symbol *s, int argc, t_atom *argv)
     return (x);
 }
 
+    /* a multichannel input goes to as many output channels as it has,
+    starting at the one given for its inlet */
 static void dac_dsp(t_dac *x, t_signal **sp)
 {
     t_int i, *ip;
     t_signal **sp2;
+    int blksize = STUFF->st_schedblocksize, j;
     for (i = x->x_n, ip = x->x_vec, sp2 = sp; i--; ip++, sp2++)
     {
         int ch = (int)(*ip - 1);
-        if ((*sp2)->s_n != DEFDACBLKSIZE)
+        if ((*sp2)->s_n != blksize)
             error("dac~: bad vector size");
-        else if (ch >= 0 && ch < sys_get_outchannels())
-            dsp_add(plus_perform, 4, STUFF->st_soundout + DEFDACBLKSIZE*ch,
-                (*sp2)->s_vec, STUFF->st_soundout + DEFDACBLKSIZE*ch, DEFDACBLKSIZE);
+        else for (j = 0; j < (*sp2)->s_nchans; j++, ch++)
+            if (ch >= 0 && ch < sys_get_outchannels())
+                dsp_add(plus_perform, 4, STUFF->st_soundout + blksize*ch,
+                    (*sp2)->s_vec + blksize*j,
+                        STUFF->st_soundout + blksize*ch, blksize);
     }
 }
 
@@ -73,6 +81,7 @@ static void dac_setup(void)
 {
     dac_class = class_new(gensym("dac~"), (t_newmethod)dac_new,
         (t_method)dac_free, sizeof(t_dac), 0, A_GIMME, 0);
+    class_setdspflags(dac_class, CLASS_NOPARALLEL);
     CLASS_MAINSIGNALIN(dac_class, t_dac, x_f);
     class_addmethod(dac_class, (t_method)dac_dsp, gensym("dsp"), A_CANT, 0);
     class_addmethod(dac_class, (t_method)dac_set, gensym("set"), A_GIMME, 0);
@@ -87,6 +96,7 @@ typedef struct _adc
     t_object x_obj;
     t_int x_n;
     t_int *x_vec;
+    t_signal *x_planes;     /* stand-ins for channels of st_soundin */
 } t_adc;
 
 static void *adc_new(t_symbol *s, int argc, t_atom *argv)
@@ -105,6 +115,7 @@ static void *adc_new(t_symbol *s, int argc, t_atom *argv)
     x->x_vec = (t_int *)getbytes(argc * sizeof(*x->x_vec));
     for (i = 0; i < argc; i++)
         x->x_vec[i] = atom_getfloatarg(i, argc, argv);
+    x->x_planes = (t_signal *)getbytes(argc * sizeof(*x->x_planes));
     for (i = 0; i < argc; i++)
         outlet_new(&x->x_obj, &s_signal);
     return (x);
@@ -148,6 +159,26 @@ static t_int *copy_perf8(t_int *w)
     return (w+4);
 }
 
+static t_int *copy_perf64(t_int *w)
+{
+    t_sample *in1 = (t_sample *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    int i;
+    for (i = 0; i < 64; i++)
+        out[i] = in1[i];
+    return (w+4);
+}
+
+static t_int *copy_perf16(t_int *w)
+{
+    t_sample *in1 = (t_sample *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    int i;
+    for (i = 0; i < 16; i++)
+        out[i] = in1[i];
+    return (w+4);
+}
+
 void dsp_add_copy(t_sample *in, t_sample *out, int n)
 {
     if (n&7)
@@ -156,19 +187,40 @@ void dsp_add_copy(t_sample *in, t_sample *out, int n)
         dsp_add(copy_perf8, 3, in, out, n);
 }
 
+    /* Our outputs are borrowed (CLASS_DSPBORROWS).  If the block size is
+    the system's we lend out the input channel's part of st_soundin, which
+    the audio backend fills before every tick, so there's nothing to copy.
+    Since that memory is never on a free list, nobody can write to it in
+    place.  Otherwise we make a signal of our own and zero it. */
 static void adc_dsp(t_adc *x, t_signal **sp)
 {
     t_int i, *ip;
-    t_signal **sp2;
-    for (i = x->x_n, ip = x->x_vec, sp2 = sp; i--; ip++, sp2++)
+    t_signal **sp2, *s2, *plane;
+    int blksize = STUFF->st_schedblocksize;
+    for (i = 0, ip = x->x_vec, sp2 = sp; i < x->x_n; i++, ip++, sp2++)
     {
         int ch = (int)(*ip - 1);
-        if ((*sp2)->s_n != DEFDACBLKSIZE)
+        s2 = signal_newfromcontext(0);
+        if (s2->s_n == blksize && ch >= 0 && ch < sys_get_inchannels())
+        {
+            plane = &x->x_planes[i];
+            plane->s_n = plane->s_vecsize = blksize;
+            plane->s_nchans = 1;
+            plane->s_vec = STUFF->st_soundin + blksize*ch;
+            plane->s_sr = s2->s_sr;
+            plane->s_isborrowed = 1;
+            plane->s_borrowedfrom = 0;
+                /* held by the audio system; never goes back to zero */
+            plane->s_refcount = 0x40000000;
+            signal_makereusable(s2);
+            signal_setborrowed(*sp2, plane);
+            continue;
+        }
+        if (s2->s_n != blksize)
             error("adc~: bad vector size");
-        else if (ch >= 0 && ch < sys_get_inchannels())
-            dsp_add_copy(STUFF->st_soundin + DEFDACBLKSIZE*ch,
-                (*sp2)->s_vec, DEFDACBLKSIZE);
-        else dsp_add_zero((*sp2)->s_vec, DEFDACBLKSIZE);
+        dsp_add_zero(s2->s_vec, s2->s_n);
+        s2->s_refcount = 1;
+        signal_setborrowed(*sp2, s2);
     }
 }
 
@@ -183,6 +235,7 @@ static void adc_set(t_adc *x, t_symbol *s, int argc, t_atom *argv)
 static void adc_free(t_adc *x)
 {
     freebytes(x->x_vec, x->x_n * sizeof(*x->x_vec));
+    freebytes(x->x_planes, x->x_n * sizeof(*x->x_planes));
 }
 
 static void adc_setup(void)
@@ -190,12 +243,15 @@ static void adc_setup(void)
     adc_class = class_new(gensym("adc~"), (t_newmethod)adc_new,
         (t_method)adc_free, sizeof(t_adc), 0, A_GIMME, 0);
     class_addmethod(adc_class, (t_method)adc_dsp, gensym("dsp"), A_CANT, 0);
+    class_setdspflags(adc_class, CLASS_DSPBORROWS);
     class_addmethod(adc_class, (t_method)adc_set, gensym("set"), A_GIMME, 0);
     class_sethelpsymbol(adc_class, gensym("adc~_dac~"));
 }
 
 void d_dac_setup(void)
 {
+    dsp_specialize(copy_perf8, 3, 64, copy_perf64);
+    dsp_specialize(copy_perf8, 3, 16, copy_perf16);
     dac_setup();
     adc_setup();
 }
@@ -7,6 +7,7 @@
 #include "m_pd.h"
 #include <string.h>
 extern int ugen_getsortno(void);
+extern void sys_prefault(void *p, size_t n);
 
 #define DEFDELVS 64             /* LATER get this from canvas at DSP time */
 static const int delread_zero = 0;    /* four bytes of zero for delread~, vd~/delread4~*/
@@ -14,11 +15,14 @@ static const int delread_zero = 0;    /* four bytes of zero for delread~, vd~/de
 /* ----------------------------- delwrite~ ----------------------------- */
 static t_class *sigdelwrite_class;
 
+    /* a multichannel delwrite~ has a line for each channel, each c_n
+    + XTRASAMPS long, one after the other in c_vec */
 typedef struct delwritectl
 {
     int c_n;
     t_sample *c_vec;
     int c_phase;
+    int c_nchans;
 } t_delwritectl;
 
 typedef struct _sigdelwrite
@@ -30,32 +34,50 @@ typedef struct _sigdelwrite
     int x_sortno;   /* DSP sort number at which this was last put on chain */
     int x_rsortno;  /* DSP sort # for first delread or write in chain */
     int x_vecsize;  /* vector size for delread~ to use */
+    t_clock *x_clock;   /* to resort DSP when our channel count changes */
     t_float x_f;
 } t_sigdelwrite;
 
 #define XTRASAMPS 4
 #define SAMPBLK 4
 
-static void sigdelwrite_updatesr(t_sigdelwrite *x, t_float sr) /* added by Mathieu Bouchard */
+static void sigdelwrite_resize(t_sigdelwrite *x, int nsamps, int nchans)
 {
-    int nsamps = x->x_deltime * sr * (t_float)(0.001f);
-    if (nsamps < 1) nsamps = 1;
-    nsamps += ((- nsamps) & (SAMPBLK - 1));
-    nsamps += DEFDELVS;
-    if (x->x_cspace.c_n != nsamps)
+    if (x->x_cspace.c_n != nsamps || x->x_cspace.c_nchans != nchans)
     {
         x->x_cspace.c_vec = (t_sample *)resizebytes(x->x_cspace.c_vec,
-            (x->x_cspace.c_n + XTRASAMPS) * sizeof(t_sample),
-            (nsamps + XTRASAMPS) * sizeof(t_sample));
+            (x->x_cspace.c_n + XTRASAMPS) * x->x_cspace.c_nchans *
+                sizeof(t_sample),
+            (nsamps + XTRASAMPS) * nchans * sizeof(t_sample));
+            /* the lines have moved, so don't play out garbage */
+        if (x->x_cspace.c_nchans != nchans)
+            memset(x->x_cspace.c_vec, 0,
+                (nsamps + XTRASAMPS) * nchans * sizeof(t_sample));
         x->x_cspace.c_n = nsamps;
+        x->x_cspace.c_nchans = nchans;
         x->x_cspace.c_phase = XTRASAMPS;
     }
 }
 
+static void sigdelwrite_updatesr(t_sigdelwrite *x, t_float sr) /* added by Mathieu Bouchard */
+{
+    int nsamps = x->x_deltime * sr * (t_float)(0.001f);
+    if (nsamps < 1) nsamps = 1;
+    nsamps += ((- nsamps) & (SAMPBLK - 1));
+    nsamps += DEFDELVS;
+    sigdelwrite_resize(x, nsamps, x->x_cspace.c_nchans);
+}
+
 static void sigdelwrite_clear (t_sigdelwrite *x) /* added by Orm Finnendahl */
 {
   if (x->x_cspace.c_n > 0)
-    memset(x->x_cspace.c_vec, 0, sizeof(t_sample)*(x->x_cspace.c_n + XTRASAMPS));
+    memset(x->x_cspace.c_vec, 0, sizeof(t_sample)*(x->x_cspace.c_n + XTRASAMPS)
+        * x->x_cspace.c_nchans);
+}
+
+static void sigdelwrite_tick(t_sigdelwrite *x)
+{
+    canvas_update_dsp();
 }
 
 
@@ -86,6 +108,8 @@ static void *sigdelwrite_new(t_symbol *s, t_floatarg msec)
     x->x_deltime = msec;
     x->x_cspace.c_n = 0;
     x->x_cspace.c_vec = getbytes(XTRASAMPS * sizeof(t_sample));
+    x->x_cspace.c_nchans = 1;
+    x->x_clock = clock_new(x, (t_method)sigdelwrite_tick);
     x->x_sortno = 0;
     x->x_vecsize = 0;
     x->x_f = 0;
@@ -97,43 +121,63 @@ static t_int *sigdelwrite_perform(t_int *w)
     t_sample *in = (t_sample *)(w[1]);
     t_delwritectl *c = (t_delwritectl *)(w[2]);
     int n = (int)(w[3]);
-    int phase = c->c_phase, nsamps = c->c_n;
-    t_sample *vp = c->c_vec, *bp = vp + phase, *ep = vp + (c->c_n + XTRASAMPS);
-    phase += n;
-
-    while (n--)
+    int nchans = (int)(w[4]);
+    int phase = c->c_phase, nsamps = c->c_n, ch, i;
+    if (nchans > c->c_nchans)
+        nchans = c->c_nchans;
+    for (ch = 0; ch < nchans; ch++)
     {
-        t_sample f = *in++;
-        if (PD_BIGORSMALL(f))
-            f = 0;
-        *bp++ = f;
-        if (bp == ep)
+        t_sample *vp = c->c_vec + ch * (nsamps + XTRASAMPS),
+            *bp = vp + c->c_phase, *ep = vp + (nsamps + XTRASAMPS);
+        phase = c->c_phase + n;
+        for (i = 0; i < n; i++)
         {
-            vp[0] = ep[-4];
-            vp[1] = ep[-3];
-            vp[2] = ep[-2];
-            vp[3] = ep[-1];
-            bp = vp + XTRASAMPS;
-            phase -= nsamps;
+            t_sample f = *in++;
+            if (PD_BIGORSMALL(f))
+                f = 0;
+            *bp++ = f;
+            if (bp == ep)
+            {
+                vp[0] = ep[-4];
+                vp[1] = ep[-3];
+                vp[2] = ep[-2];
+                vp[3] = ep[-1];
+                bp = vp + XTRASAMPS;
+                phase -= nsamps;
+            }
         }
     }
     c->c_phase = phase;
-    return (w+4);
+    return (w+5);
 }
 
+    /* readers take our channel count when they're sorted.  If it changes
+    and some of them already have been, sort again once we're done. */
 static void sigdelwrite_dsp(t_sigdelwrite *x, t_signal **sp)
 {
-    dsp_add(sigdelwrite_perform, 3, sp[0]->s_vec, &x->x_cspace, sp[0]->s_n);
+    int nchans = sp[0]->s_nchans;
+    if (nchans != x->x_cspace.c_nchans)
+    {
+        if (x->x_rsortno == ugen_getsortno())
+            clock_delay(x->x_clock, 0);
+        sigdelwrite_resize(x, x->x_cspace.c_n, nchans);
+    }
+    dsp_add(sigdelwrite_perform, 4, sp[0]->s_vec, &x->x_cspace, sp[0]->s_n,
+        nchans);
     x->x_sortno = ugen_getsortno();
     sigdelwrite_checkvecsize(x, sp[0]->s_n);
     sigdelwrite_updatesr(x, sp[0]->s_sr);
+    sys_prefault(x->x_cspace.c_vec,
+        (x->x_cspace.c_n + XTRASAMPS) * nchans * sizeof(t_sample));
 }
 
 static void sigdelwrite_free(t_sigdelwrite *x)
 {
     pd_unbind(&x->x_obj.ob_pd, x->x_sym);
+    clock_free(x->x_clock);
     freebytes(x->x_cspace.c_vec,
-        (x->x_cspace.c_n + XTRASAMPS) * sizeof(t_sample));
+        (x->x_cspace.c_n + XTRASAMPS) * x->x_cspace.c_nchans *
+            sizeof(t_sample));
 }
 
 static void sigdelwrite_setup(void)
@@ -141,6 +185,7 @@ static void sigdelwrite_setup(void)
     sigdelwrite_class = class_new(gensym("delwrite~"),
         (t_newmethod)sigdelwrite_new, (t_method)sigdelwrite_free,
         sizeof(t_sigdelwrite), 0, A_DEFSYM, A_DEFFLOAT, 0);
+    class_setdspflags(sigdelwrite_class, CLASS_NOPARALLEL | CLASS_DSPSHARED);
     CLASS_MAINSIGNALIN(sigdelwrite_class, t_sigdelwrite, x_f);
     class_addmethod(sigdelwrite_class, (t_method)sigdelwrite_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -151,63 +196,140 @@ static void sigdelwrite_setup(void)
 /* ----------------------------- delread~ ----------------------------- */
 static t_class *sigdelread_class;
 
+    /* delread~ can read several taps at once, whose delay times are given
+    as a list.  They come out as a channel each, from a one-channel delwrite~,
+    or one from each channel of a multichannel one. */
 typedef struct _sigdelread
 {
     t_object x_obj;
     t_symbol *x_sym;
-    t_float x_deltime;  /* delay in msec */
-    int x_delsamps;     /* delay in samples */
+    t_float *x_deltime; /* delay in msec for each tap */
+    int *x_delsamps;    /* delay in samples for each tap */
+    int x_ntaps;        /* number of taps */
+    int x_nalloc;       /* number allocated (never shrinks, as DSP reads it) */
+    int x_dspntaps;     /* number of taps when DSP was last sorted */
     t_float x_sr;       /* samples per msec */
     t_float x_n;        /* vector size */
     int x_zerodel;      /* 0 or vecsize depending on read/write order */
+    t_clock *x_clock;   /* to resort DSP when the number of taps changes */
 } t_sigdelread;
 
-static void sigdelread_float(t_sigdelread *x, t_float f);
+static void sigdelread_list(t_sigdelread *x, t_symbol *s, int argc,
+    t_atom *argv);
+
+static void sigdelread_tick(t_sigdelread *x)
+{
+    canvas_update_dsp();
+}
 
-static void *sigdelread_new(t_symbol *s, t_floatarg f)
+static void *sigdelread_new(t_symbol *s, int argc, t_atom *argv)
 {
     t_sigdelread *x = (t_sigdelread *)pd_new(sigdelread_class);
-    x->x_sym = s;
+    t_atom a;
+    x->x_sym = atom_getsymbolarg(0, argc, argv);
     x->x_sr = 1;
     x->x_n = 1;
     x->x_zerodel = 0;
-    sigdelread_float(x, f);
+    x->x_ntaps = x->x_nalloc = x->x_dspntaps = 0;
+    x->x_deltime = 0;
+    x->x_delsamps = 0;
+    x->x_clock = clock_new(x, (t_method)sigdelread_tick);
+    if (argc > 1)
+        sigdelread_list(x, 0, argc - 1, argv + 1);
+    else
+    {
+        SETFLOAT(&a, 0);
+        sigdelread_list(x, 0, 1, &a);
+    }
     outlet_new(&x->x_obj, &s_signal);
     return (x);
 }
 
-static void sigdelread_float(t_sigdelread *x, t_float f)
+    /* compute the taps' delays in samples from their times */
+static void sigdelread_update(t_sigdelread *x)
 {
     t_sigdelwrite *delwriter =
         (t_sigdelwrite *)pd_findbyclass(x->x_sym, sigdelwrite_class);
-    x->x_deltime = f;
+    int i;
     if (delwriter)
+        for (i = 0; i < x->x_ntaps; i++)
     {
-        x->x_delsamps = (int)(0.5 + x->x_sr * x->x_deltime)
+        int delsamps = (int)(0.5 + x->x_sr * x->x_deltime[i])
             + x->x_n - x->x_zerodel;
-        if (x->x_delsamps < x->x_n) x->x_delsamps = x->x_n;
-        else if (x->x_delsamps > delwriter->x_cspace.c_n)
-            x->x_delsamps = delwriter->x_cspace.c_n;
+        if (delsamps < x->x_n) delsamps = x->x_n;
+        else if (delsamps > delwriter->x_cspace.c_n)
+            delsamps = delwriter->x_cspace.c_n;
+        x->x_delsamps[i] = delsamps;
+    }
+}
+
+static void sigdelread_list(t_sigdelread *x, t_symbol *s, int argc,
+    t_atom *argv)
+{
+    int i;
+    if (argc < 1)
+        return;
+    if (argc > x->x_nalloc)
+    {
+        x->x_deltime = (t_float *)resizebytes(x->x_deltime,
+            x->x_nalloc * sizeof(t_float), argc * sizeof(t_float));
+        x->x_delsamps = (int *)resizebytes(x->x_delsamps,
+            x->x_nalloc * sizeof(int), argc * sizeof(int));
+        for (i = x->x_nalloc; i < argc; i++)
+            x->x_delsamps[i] = 0;
+        x->x_nalloc = argc;
     }
+    for (i = 0; i < argc; i++)
+        x->x_deltime[i] = atom_getfloatarg(i, argc, argv);
+    x->x_ntaps = argc;
+    sigdelread_update(x);
+        /* the number of output channels changes */
+    if (x->x_dspntaps && (argc > 1 || x->x_dspntaps > 1) &&
+        argc != x->x_dspntaps)
+            clock_delay(x->x_clock, 0);
+}
+
+static void sigdelread_float(t_sigdelread *x, t_float f)
+{
+    t_atom a;
+    SETFLOAT(&a, f);
+    sigdelread_list(x, 0, 1, &a);
 }
 
+    /* Each output channel reads a block from the delay line with at most two
+    copies, split where it wraps around.  If "tapinc" is set each channel has
+    its own tap; if "lineinc" is set each reads its own channel of the line. */
 static t_int *sigdelread_perform(t_int *w)
 {
     t_sample *out = (t_sample *)(w[1]);
     t_delwritectl *c = (t_delwritectl *)(w[2]);
-    int delsamps = *(int *)(w[3]);
+    t_sigdelread *x = (t_sigdelread *)(w[3]);
     int n = (int)(w[4]);
-    int phase = c->c_phase - delsamps, nsamps = c->c_n;
-    t_sample *vp = c->c_vec, *bp, *ep = vp + (c->c_n + XTRASAMPS);
-    if (phase < 0) phase += nsamps;
-    bp = vp + phase;
-
-    while (n--)
+    int nchans = (int)(w[5]);
+    int tapinc = (int)(w[6]), lineinc = (int)(w[7]);
+    int nsamps = c->c_n, ch;
+    for (ch = 0; ch < nchans; ch++, out += n)
     {
-        *out++ = *bp++;
-        if (bp == ep) bp -= nsamps;
+        int line = ch * lineinc, phase = c->c_phase - x->x_delsamps[ch * tapinc],
+            m;
+        t_sample *vp = c->c_vec + line * (nsamps + XTRASAMPS);
+            /* the delwrite~ may have fewer channels since we were sorted */
+        if (line >= c->c_nchans)
+        {
+            memset(out, 0, n * sizeof(t_sample));
+            continue;
+        }
+        if (phase < 0) phase += nsamps;
+        m = nsamps + XTRASAMPS - phase;
+        if (m >= n)
+            memcpy(out, vp + phase, n * sizeof(t_sample));
+        else
+        {
+            memcpy(out, vp + phase, m * sizeof(t_sample));
+            memcpy(out + m, vp + XTRASAMPS, (n - m) * sizeof(t_sample));
+        }
     }
-    return (w+5);
+    return (w+8);
 }
 
 static void sigdelread_dsp(t_sigdelread *x, t_signal **sp)
@@ -216,15 +338,28 @@ static void sigdelread_dsp(t_sigdelread *x, t_signal **sp)
         (t_sigdelwrite *)pd_findbyclass(x->x_sym, sigdelwrite_class);
     x->x_sr = sp[0]->s_sr * 0.001;
     x->x_n = sp[0]->s_n;
+    x->x_dspntaps = x->x_ntaps;
     if (delwriter)
     {
+        int nlines = delwriter->x_cspace.c_nchans, ntaps = x->x_ntaps,
+            nchans = (ntaps > 1 ? ntaps : nlines);
         sigdelwrite_updatesr(delwriter, sp[0]->s_sr);
         sigdelwrite_checkvecsize(delwriter, sp[0]->s_n);
         x->x_zerodel = (delwriter->x_sortno == ugen_getsortno() ?
             0 : delwriter->x_vecsize);
-        sigdelread_float(x, x->x_deltime);
-        dsp_add(sigdelread_perform, 4,
-            sp[0]->s_vec, &delwriter->x_cspace, &x->x_delsamps, sp[0]->s_n);
+        sigdelread_update(x);
+        signal_setmultiout(&sp[0], nchans);
+            /* (as for delread4~, the delwrite~ may yet sort and change) */
+        if (ntaps > 1 && nlines > 1 && ntaps != nlines)
+        {
+            if (delwriter->x_sortno == ugen_getsortno())
+                pd_error(x, "delread~ %s: %d taps for %d channels",
+                    x->x_sym->s_name, ntaps, nlines);
+            dsp_add_zero(sp[0]->s_vec, sp[0]->s_n * nchans);
+            return;
+        }
+        dsp_add(sigdelread_perform, 7, sp[0]->s_vec, &delwriter->x_cspace,
+            x, sp[0]->s_n, nchans, (ntaps > 1), (nlines > 1));
         /* check block size - but only if delwriter has been initialized */
         if (delwriter->x_cspace.c_n > 0 && sp[0]->s_n > delwriter->x_cspace.c_n)
             pd_error(x, "delread~ %s: blocksize larger than delwrite~ buffer", x->x_sym->s_name);
@@ -233,14 +368,22 @@ static void sigdelread_dsp(t_sigdelread *x, t_signal **sp)
         pd_error(x, "delread~: %s: no such delwrite~",x->x_sym->s_name);
 }
 
+static void sigdelread_free(t_sigdelread *x)
+{
+    clock_free(x->x_clock);
+    freebytes(x->x_deltime, x->x_nalloc * sizeof(t_float));
+    freebytes(x->x_delsamps, x->x_nalloc * sizeof(int));
+}
+
 static void sigdelread_setup(void)
 {
     sigdelread_class = class_new(gensym("delread~"),
-        (t_newmethod)sigdelread_new, 0,
-        sizeof(t_sigdelread), 0, A_DEFSYM, A_DEFFLOAT, 0);
+        (t_newmethod)sigdelread_new, (t_method)sigdelread_free,
+        sizeof(t_sigdelread), 0, A_GIMME, 0);
     class_addmethod(sigdelread_class, (t_method)sigdelread_dsp,
         gensym("dsp"), A_CANT, 0);
     class_addfloat(sigdelread_class, (t_method)sigdelread_float);
+    class_addlist(sigdelread_class, (t_method)sigdelread_list);
 }
 
 
@@ -267,6 +410,21 @@ static void *sigvd_new(t_symbol *s)
     return (x);
 }
 
+    /* The SSE2 version below does four output samples at a time.  The four
+points each needs from the delay line are contiguous, so they're got with
+an unaligned load per sample and then transposed.  Wrapping back around the
+delay line is done by comparison and masking instead of a branch; the
+XTRASAMPS samples delwrite~ copies to the start of each line mean that the
+four points never straddle the end of it. */
+#if PD_FLOATSIZE == 32 && (defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define VD_SSE
+#include <emmintrin.h>
+#endif
+
+    /* The delay time input has either one channel, used for every channel
+of the delwrite~, or one for each.  Or, if the delwrite~ has one channel,
+the input may have any number, and each reads a separate tap from it. */
 static t_int *sigvd_perform(t_int *w)
 {
     t_sample *in = (t_sample *)(w[1]);
@@ -274,45 +432,105 @@ static t_int *sigvd_perform(t_int *w)
     t_delwritectl *ctl = (t_delwritectl *)(w[3]);
     t_sigvd *x = (t_sigvd *)(w[4]);
     int n = (int)(w[5]);
+    int nchans = (int)(w[6]);
+    int inchans = (int)(w[7]);
+    int ntaps = (int)(w[8]);        /* nonzero if reading taps from one line */
 
-    int nsamps = ctl->c_n;
+    int nsamps = ctl->c_n, ch, i;
     t_sample limit = nsamps - n;
-    t_sample fn = n-1;
-    t_sample *vp = ctl->c_vec, *bp, *wp = vp + ctl->c_phase;
     t_sample zerodel = x->x_zerodel;
     if (limit < 0) /* blocksize is larger than delread~ buffer size */
     {
-        while (n--)
+        for (i = n * nchans; i--; )
             *out++ = 0;
-        return (w+6);
+        return (w+9);
     }
-    while (n--)
+    for (ch = 0; ch < nchans; ch++)
     {
-        t_sample delsamps = x->x_sr * *in++ - zerodel, frac;
-        int idelsamps;
-        t_sample a, b, c, d, cminusb;
-        if (!(delsamps >= 1.00001f))    /* too small or NAN */
-            delsamps = 1.00001f;
-        if (delsamps > limit)           /* too big */
-            delsamps = limit;
-        delsamps += fn;
-        fn = fn - 1.0f;
-        idelsamps = delsamps;
-        frac = delsamps - (t_sample)idelsamps;
-        bp = wp - idelsamps;
-        if (bp < vp + XTRASAMPS) bp += nsamps;
-        d = bp[-3];
-        c = bp[-2];
-        b = bp[-1];
-        a = bp[0];
-        cminusb = c-b;
-        *out++ = b + frac * (
-            cminusb - 0.1666667f * (1.-frac) * (
-                (d - a - 3.0f * cminusb) * frac + (d + 2.0f*a - 3.0f*b)
-            )
-        );
+        int line = (ntaps ? 0 : ch), wpos = ctl->c_phase;
+        t_sample fn = n-1;
+        t_sample *vp = ctl->c_vec + line * (nsamps + XTRASAMPS),
+            *tp = in + (inchans > 1) * ch * n;
+            /* the delwrite~ may have fewer channels since we were sorted */
+        if (line >= ctl->c_nchans)
+        {
+            for (i = 0; i < n; i++)
+                *out++ = 0;
+            continue;
+        }
+        i = 0;
+#ifdef VD_SSE
+        if (!(n & 3))
+        {
+            __m128 sr = _mm_set1_ps(x->x_sr), zd = _mm_set1_ps(zerodel),
+                lo = _mm_set1_ps(1.00001f), hi = _mm_set1_ps(limit),
+                vfn = _mm_setr_ps(fn, fn - 1, fn - 2, fn - 3),
+                four = _mm_set1_ps(4), one = _mm_set1_ps(1),
+                two = _mm_set1_ps(2), three = _mm_set1_ps(3),
+                sixth = _mm_set1_ps(0.1666667f);
+            __m128i vw = _mm_set1_epi32(wpos), vn = _mm_set1_epi32(nsamps),
+                vx = _mm_set1_epi32(XTRASAMPS);
+            for (; i < n; i += 4)
+            {
+                    /* max() takes "lo" if the delay is NAN */
+                __m128 del = _mm_sub_ps(_mm_mul_ps(sr, _mm_loadu_ps(tp + i)),
+                    zd), frac, a, b, c, d, cminusb;
+                __m128i idel, idx;
+                int k[4];
+                del = _mm_add_ps(_mm_min_ps(_mm_max_ps(del, lo), hi), vfn);
+                vfn = _mm_sub_ps(vfn, four);
+                idel = _mm_cvttps_epi32(del);
+                frac = _mm_sub_ps(del, _mm_cvtepi32_ps(idel));
+                idx = _mm_sub_epi32(vw, idel);
+                idx = _mm_add_epi32(idx,
+                    _mm_and_si128(vn, _mm_cmplt_epi32(idx, vx)));
+                _mm_storeu_si128((__m128i *)k, idx);
+                d = _mm_loadu_ps(vp + k[0] - 3);
+                c = _mm_loadu_ps(vp + k[1] - 3);
+                b = _mm_loadu_ps(vp + k[2] - 3);
+                a = _mm_loadu_ps(vp + k[3] - 3);
+                _MM_TRANSPOSE4_PS(d, c, b, a);
+                cminusb = _mm_sub_ps(c, b);
+                _mm_storeu_ps(out + i, _mm_add_ps(b, _mm_mul_ps(frac,
+                    _mm_sub_ps(cminusb, _mm_mul_ps(_mm_mul_ps(sixth,
+                        _mm_sub_ps(one, frac)), _mm_add_ps(_mm_mul_ps(
+                            _mm_sub_ps(_mm_sub_ps(d, a),
+                                _mm_mul_ps(three, cminusb)), frac),
+                        _mm_sub_ps(_mm_add_ps(d, _mm_mul_ps(two, a)),
+                            _mm_mul_ps(three, b))))))));
+            }
+        }
+#endif
+        for (; i < n; i++)
+        {
+            t_sample delsamps = x->x_sr * tp[i] - zerodel, frac;
+            int idelsamps, idx;
+            t_sample a, b, c, d, cminusb, *bp;
+            if (!(delsamps >= 1.00001f))    /* too small or NAN */
+                delsamps = 1.00001f;
+            if (delsamps > limit)           /* too big */
+                delsamps = limit;
+            delsamps += fn;
+            fn = fn - 1.0f;
+            idelsamps = delsamps;
+            frac = delsamps - (t_sample)idelsamps;
+            idx = wpos - idelsamps;
+            idx += nsamps & -(idx < XTRASAMPS);
+            bp = vp + idx;
+            d = bp[-3];
+            c = bp[-2];
+            b = bp[-1];
+            a = bp[0];
+            cminusb = c-b;
+            out[i] = b + frac * (
+                cminusb - 0.1666667f * (1.-frac) * (
+                    (d - a - 3.0f * cminusb) * frac + (d + 2.0f*a - 3.0f*b)
+                )
+            );
+        }
+        out += n;
     }
-    return (w+6);
+    return (w+9);
 }
 
 static void sigvd_dsp(t_sigvd *x, t_signal **sp)
@@ -322,12 +540,27 @@ static void sigvd_dsp(t_sigvd *x, t_signal **sp)
     x->x_sr = sp[0]->s_sr * 0.001;
     if (delwriter)
     {
+        int nlines = delwriter->x_cspace.c_nchans,
+            inchans = sp[0]->s_nchans,
+            ntaps = (nlines == 1 && inchans > 1),
+            nchans = (ntaps ? inchans : nlines);
         sigdelwrite_checkvecsize(delwriter, sp[0]->s_n);
         x->x_zerodel = (delwriter->x_sortno == ugen_getsortno() ?
             0 : delwriter->x_vecsize);
-        dsp_add(sigvd_perform, 5,
-            sp[0]->s_vec, sp[1]->s_vec,
-                &delwriter->x_cspace, x, sp[0]->s_n);
+        signal_setmultiout(&sp[1], nchans);
+            /* (if the delwrite~ hasn't been sorted yet, its channel count
+            may be about to change, and it will sort again if so) */
+        if (inchans != 1 && inchans != nchans)
+        {
+            if (delwriter->x_sortno == ugen_getsortno())
+                pd_error(x, "delread4~ %s: %d delay times for %d channels",
+                    x->x_sym->s_name, inchans, nchans);
+            dsp_add_zero(sp[1]->s_vec, sp[1]->s_n * nchans);
+            return;
+        }
+        dsp_add(sigvd_perform, 8,
+            sp[0]->s_vec, sp[1]->s_vec, &delwriter->x_cspace, x,
+                sp[0]->s_n, nchans, inchans, ntaps);
         /* check block size - but only if delwriter has been initialized */
         if (delwriter->x_cspace.c_n > 0 && sp[0]->s_n > delwriter->x_cspace.c_n)
             pd_error(x, "delread4~ %s: blocksize larger than delwrite~ buffer", x->x_sym->s_name);
@@ -3,6 +3,7 @@
 * WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
 
 #include "m_pd.h"
+#include <string.h>
 
 /* This file interfaces to one of the Mayer, Ooura, or fftw FFT packages
 to implement the "fft~", etc, Pd objects.  If using Mayer, also compile
@@ -21,6 +22,18 @@ static void fftclass_cleanup(t_class *c)
     mayer_term();
 }
 
+    /* get a plan for the current block size at DSP time, keeping the old
+    one if the size hasn't changed */
+static void fftclass_plan(t_fftplan **plan, int *npoints, int n, int real)
+{
+    if (*plan && *npoints == n)
+        return;
+    if (*plan)
+        fftplan_free(*plan);
+    *plan = fftplan_new(n, real);
+    *npoints = n;
+}
+
 /* ---------------- utility functions for DSP chains ---------------------- */
 
     /* swap two arrays */
@@ -59,6 +72,8 @@ typedef struct fft
 {
     t_object x_obj;
     t_float x_f;
+    t_fftplan *x_plan;
+    int x_npoints;
 } t_sigfft;
 
 static void *sigfft_new(void)
@@ -68,6 +83,8 @@ static void *sigfft_new(void)
     outlet_new(&x->x_obj, gensym("signal"));
     inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
     x->x_f = 0;
+    x->x_plan = 0;
+    x->x_npoints = 0;
     return (x);
 }
 
@@ -78,24 +95,32 @@ static void *sigifft_new(void)
     outlet_new(&x->x_obj, gensym("signal"));
     inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
     x->x_f = 0;
+    x->x_plan = 0;
+    x->x_npoints = 0;
     return (x);
 }
 
+static void sigfft_free(t_sigfft *x)
+{
+    if (x->x_plan)
+        fftplan_free(x->x_plan);
+}
+
 static t_int *sigfft_perform(t_int *w)
 {
-    t_sample *in1 = (t_sample *)(w[1]);
-    t_sample *in2 = (t_sample *)(w[2]);
-    int n = (int)w[3];
-    mayer_fft(n, in1, in2);
+    t_fftplan *plan = (t_fftplan *)(w[1]);
+    t_sample *in1 = (t_sample *)(w[2]);
+    t_sample *in2 = (t_sample *)(w[3]);
+    fftplan_complex(plan, in1, in2, 0);
     return (w+4);
 }
 
 static t_int *sigifft_perform(t_int *w)
 {
-    t_sample *in1 = (t_sample *)(w[1]);
-    t_sample *in2 = (t_sample *)(w[2]);
-    int n = (int)w[3];
-    mayer_ifft(n, in1, in2);
+    t_fftplan *plan = (t_fftplan *)(w[1]);
+    t_sample *in1 = (t_sample *)(w[2]);
+    t_sample *in2 = (t_sample *)(w[3]);
+    fftplan_complex(plan, in1, in2, 1);
     return (w+4);
 }
 
@@ -118,7 +143,9 @@ static void sigfft_dspx(t_sigfft *x, t_signal **sp, t_int *(*f)(t_int *w))
         if (out1 != in1) dsp_add(copy_perform, 3, in1, out1, n);
         if (out2 != in2) dsp_add(copy_perform, 3, in2, out2, n);
     }
-    dsp_add(f, 3, sp[2]->s_vec, sp[3]->s_vec, n);
+    fftclass_plan(&x->x_plan, &x->x_npoints, n, 0);
+    if (x->x_plan)
+        dsp_add(f, 3, x->x_plan, sp[2]->s_vec, sp[3]->s_vec);
 }
 
 static void sigfft_dsp(t_sigfft *x, t_signal **sp)
@@ -133,17 +160,19 @@ static void sigifft_dsp(t_sigfft *x, t_signal **sp)
 
 static void sigfft_setup(void)
 {
-    sigfft_class = class_new(gensym("fft~"), sigfft_new, 0,
-        sizeof(t_sigfft), 0, 0);
+    sigfft_class = class_new(gensym("fft~"), sigfft_new,
+        (t_method)sigfft_free, sizeof(t_sigfft), 0, 0);
     class_setfreefn(sigfft_class, fftclass_cleanup);
+    class_setdspflags(sigfft_class, CLASS_DSPPURE);
     CLASS_MAINSIGNALIN(sigfft_class, t_sigfft, x_f);
     class_addmethod(sigfft_class, (t_method)sigfft_dsp,
         gensym("dsp"), A_CANT, 0);
     mayer_init();
 
-    sigifft_class = class_new(gensym("ifft~"), sigifft_new, 0,
-        sizeof(t_sigfft), 0, 0);
+    sigifft_class = class_new(gensym("ifft~"), sigifft_new,
+        (t_method)sigfft_free, sizeof(t_sigfft), 0, 0);
     class_setfreefn(sigifft_class, fftclass_cleanup);
+    class_setdspflags(sigifft_class, CLASS_DSPPURE);
     CLASS_MAINSIGNALIN(sigifft_class, t_sigfft, x_f);
     class_addmethod(sigifft_class, (t_method)sigifft_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -159,6 +188,8 @@ typedef struct rfft
 {
     t_object x_obj;
     t_float x_f;
+    t_fftplan *x_plan;
+    int x_npoints;
 } t_sigrfft;
 
 static void *sigrfft_new(void)
@@ -167,14 +198,22 @@ static void *sigrfft_new(void)
     outlet_new(&x->x_obj, gensym("signal"));
     outlet_new(&x->x_obj, gensym("signal"));
     x->x_f = 0;
+    x->x_plan = 0;
+    x->x_npoints = 0;
     return (x);
 }
 
+static void sigrfft_free(t_sigrfft *x)
+{
+    if (x->x_plan)
+        fftplan_free(x->x_plan);
+}
+
 static t_int *sigrfft_perform(t_int *w)
 {
-    t_sample *in = (t_sample *)(w[1]);
-    int n = (int)w[2];
-    mayer_realfft(n, in);
+    t_fftplan *plan = (t_fftplan *)(w[1]);
+    t_sample *in = (t_sample *)(w[2]);
+    fftplan_real(plan, in, 0);
     return (w+3);
 }
 
@@ -189,9 +228,12 @@ static void sigrfft_dsp(t_sigrfft *x, t_signal **sp)
         error("fft: minimum 4 points");
         return;
     }
+    fftclass_plan(&x->x_plan, &x->x_npoints, n, 1);
+    if (!x->x_plan)
+        return;
     if (in1 != out1)
         dsp_add(copy_perform, 3, in1, out1, n);
-    dsp_add(sigrfft_perform, 2, out1, n);
+    dsp_add(sigrfft_perform, 2, x->x_plan, out1);
     dsp_add(sigrfft_flip, 3, out1 + (n2+1), out2 + n2, n2-1);
     dsp_add_zero(out1 + (n2+1), ((n2-1)&(~7)));
     dsp_add_zero(out1 + (n2+1) + ((n2-1)&(~7)), ((n2-1)&7));
@@ -201,9 +243,10 @@ static void sigrfft_dsp(t_sigrfft *x, t_signal **sp)
 
 static void sigrfft_setup(void)
 {
-    sigrfft_class = class_new(gensym("rfft~"), sigrfft_new, 0,
-        sizeof(t_sigrfft), 0, 0);
+    sigrfft_class = class_new(gensym("rfft~"), sigrfft_new,
+        (t_method)sigrfft_free, sizeof(t_sigrfft), 0, 0);
     class_setfreefn(sigrfft_class, fftclass_cleanup);
+    class_setdspflags(sigrfft_class, CLASS_DSPPURE);
     CLASS_MAINSIGNALIN(sigrfft_class, t_sigrfft, x_f);
     class_addmethod(sigrfft_class, (t_method)sigrfft_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -219,6 +262,8 @@ typedef struct rifft
 {
     t_object x_obj;
     t_float x_f;
+    t_fftplan *x_plan;
+    int x_npoints;
 } t_sigrifft;
 
 static void *sigrifft_new(void)
@@ -227,14 +272,22 @@ static void *sigrifft_new(void)
     inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
     outlet_new(&x->x_obj, gensym("signal"));
     x->x_f = 0;
+    x->x_plan = 0;
+    x->x_npoints = 0;
     return (x);
 }
 
+static void sigrifft_free(t_sigrifft *x)
+{
+    if (x->x_plan)
+        fftplan_free(x->x_plan);
+}
+
 static t_int *sigrifft_perform(t_int *w)
 {
-    t_sample *in = (t_sample *)(w[1]);
-    int n = (int)w[2];
-    mayer_realifft(n, in);
+    t_fftplan *plan = (t_fftplan *)(w[1]);
+    t_sample *in = (t_sample *)(w[2]);
+    fftplan_real(plan, in, 1);
     return (w+3);
 }
 
@@ -249,6 +302,9 @@ static void sigrifft_dsp(t_sigrifft *x, t_signal **sp)
         error("fft: minimum 4 points");
         return;
     }
+    fftclass_plan(&x->x_plan, &x->x_npoints, n, 1);
+    if (!x->x_plan)
+        return;
     if (in2 == out1)
     {
         dsp_add(sigrfft_flip, 3, out1+1, out1 + n, n2-1);
@@ -259,14 +315,15 @@ static void sigrifft_dsp(t_sigrifft *x, t_signal **sp)
         if (in1 != out1) dsp_add(copy_perform, 3, in1, out1, n2+1);
         dsp_add(sigrfft_flip, 3, in2+1, out1 + n, n2-1);
     }
-    dsp_add(sigrifft_perform, 2, out1, n);
+    dsp_add(sigrifft_perform, 2, x->x_plan, out1);
 }
 
 static void sigrifft_setup(void)
 {
-    sigrifft_class = class_new(gensym("rifft~"), sigrifft_new, 0,
-        sizeof(t_sigrifft), 0, 0);
+    sigrifft_class = class_new(gensym("rifft~"), sigrifft_new,
+        (t_method)sigrifft_free, sizeof(t_sigrifft), 0, 0);
     class_setfreefn(sigrifft_class, fftclass_cleanup);
+    class_setdspflags(sigrifft_class, CLASS_DSPPURE);
     CLASS_MAINSIGNALIN(sigrifft_class, t_sigrifft, x_f);
     class_addmethod(sigrifft_class, (t_method)sigrifft_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -358,12 +415,364 @@ static void sigframp_setup(void)
     sigframp_class = class_new(gensym("framp~"), sigframp_new, 0,
         sizeof(t_sigframp), 0, 0);
     class_setfreefn(sigframp_class, fftclass_cleanup);
+    class_setdspflags(sigframp_class, CLASS_DSPPURE);
     CLASS_MAINSIGNALIN(sigframp_class, t_sigframp, x_f);
     class_addmethod(sigframp_class, (t_method)sigframp_dsp,
         gensym("dsp"), A_CANT, 0);
     mayer_init();
 }
 
+/* ----------------------- convolve~ -------------------------------- */
+
+/* convolve~ convolves its input with an impulse response read from an
+array, by uniformly partitioned FFT convolution.  The impulse response is
+cut into partitions the size of the block, and each is transformed once.
+Every block, the spectrum of the last two blocks of input goes into a
+"frequency-domain delay line", and the output is the inverse transform of
+the sum of each partition's spectrum times that of the input as many blocks
+back.  There's no latency beyond the block itself.
+
+Rereading the array with "set" transforms the new partitions a few at a
+time from a clock, between DSP ticks, and swaps them in when they are all
+done, so that a long impulse response doesn't stall the audio. */
+
+#define CONVCHUNK 16384     /* samples of impulse response per clock tick */
+
+static t_class *sigconvolve_class;
+
+typedef struct _convset
+{
+    int s_npart;            /* number of partitions */
+    t_sample *s_spectra;    /* their spectra, 2 * blocksize points each */
+} t_convset;
+
+typedef struct _sigconvolve
+{
+    t_object x_obj;
+    t_float x_f;
+    t_symbol *x_arrayname;
+    t_clock *x_clock;
+    int x_blocksize;        /* partition size, from the last "dsp" */
+    t_fftplan *x_plan;
+    int x_npoints;
+    t_convset *x_set;       /* partitions in use */
+    t_sample *x_fdl;        /* spectra of past input, one per partition */
+    int x_fdlpos;           /* where the next one goes */
+    t_sample *x_inbuf;      /* last two blocks of input */
+    t_sample *x_outbuf;     /* output spectrum */
+    t_sample *x_ir;         /* copy of the array being partitioned, or 0 */
+    int x_irsize;
+    t_convset *x_newset;    /* ... and the partitions done so far */
+    int x_nextpart;
+} t_sigconvolve;
+
+    /* Pd's real FFT leaves the imaginary parts backward in the top half;
+    turn them around so that both halves run forward (or back again) */
+static void sigconvolve_flip(t_sample *buf, int n)
+{
+    t_sample *fp1 = buf + (n/2 + 1), *fp2 = buf + (n - 1);
+    for (; fp1 < fp2; fp1++, fp2--)
+    {
+        t_sample f = *fp1;
+        *fp1 = *fp2;
+        *fp2 = f;
+    }
+}
+
+static t_convset *sigconvolve_newset(int npart, int blocksize)
+{
+    t_convset *set = (t_convset *)getbytes(sizeof(*set));
+    set->s_npart = npart;
+    if (!(set->s_spectra = (t_sample *)getbytes(
+        (size_t)npart * 2 * blocksize * sizeof(t_sample))))
+    {
+        freebytes(set, sizeof(*set));
+        return (0);
+    }
+    return (set);
+}
+
+static void sigconvolve_freeset(t_convset *set, int blocksize)
+{
+    freebytes(set->s_spectra,
+        (size_t)set->s_npart * 2 * blocksize * sizeof(t_sample));
+    freebytes(set, sizeof(*set));
+}
+
+    /* transform one partition of the impulse response, scaled to undo the
+    gain of the FFT and inverse FFT */
+static void sigconvolve_partition(t_sigconvolve *x, t_convset *set, int part)
+{
+    int n = x->x_blocksize, i, onset = part * n;
+    t_sample *buf = set->s_spectra + (size_t)part * 2 * n;
+    t_sample scale = 1. / (2 * n);
+    for (i = 0; i < n; i++)
+        buf[i] = (onset + i < x->x_irsize ? scale * x->x_ir[onset + i] : 0);
+    for (; i < 2 * n; i++)
+        buf[i] = 0;
+    fftplan_real(x->x_plan, buf, 0);
+    sigconvolve_flip(buf, 2 * n);
+}
+
+    /* drop a partitioning in progress */
+static void sigconvolve_cancel(t_sigconvolve *x)
+{
+    clock_unset(x->x_clock);
+    if (x->x_ir)
+        freebytes(x->x_ir, x->x_irsize * sizeof(t_sample));
+    if (x->x_newset)
+        sigconvolve_freeset(x->x_newset, x->x_blocksize);
+    x->x_ir = 0;
+    x->x_irsize = 0;
+    x->x_newset = 0;
+}
+
+    /* copy the array, ready to partition it.  Return 0 if there's none. */
+static int sigconvolve_getarray(t_sigconvolve *x)
+{
+    t_garray *a;
+    t_word *vec;
+    int npoints, i;
+    sigconvolve_cancel(x);
+    if (!(a = (t_garray *)pd_findbyclass(x->x_arrayname, garray_class)))
+    {
+        if (*x->x_arrayname->s_name)
+            pd_error(x, "convolve~: %s: no such array",
+                x->x_arrayname->s_name);
+        return (0);
+    }
+    if (!garray_getfloatwords(a, &npoints, &vec))
+    {
+        pd_error(x, "%s: bad template for convolve~",
+            x->x_arrayname->s_name);
+        return (0);
+    }
+    if (npoints < 1)
+        npoints = 1;
+    if (!(x->x_ir = (t_sample *)getbytes(npoints * sizeof(t_sample))))
+    {
+        pd_error(x, "convolve~: out of memory");
+        return (0);
+    }
+    x->x_irsize = npoints;
+    for (i = 0; i < npoints; i++)
+        x->x_ir[i] = vec[i].w_float;
+    return (1);
+}
+
+    /* put in a finished set of partitions, keeping as much of the input's
+    past as the new set has room for */
+static void sigconvolve_install(t_sigconvolve *x, t_convset *set)
+{
+    int n2 = 2 * x->x_blocksize, nold = (x->x_set ? x->x_set->s_npart : 0),
+        nkeep = (nold < set->s_npart ? nold : set->s_npart), i;
+    t_sample *fdl = (t_sample *)getbytes(
+        (size_t)set->s_npart * n2 * sizeof(t_sample));
+    if (!fdl)
+    {
+        pd_error(x, "convolve~: out of memory");
+        sigconvolve_freeset(set, x->x_blocksize);
+        return;
+    }
+    for (i = 0; i < nkeep; i++)
+        memcpy(fdl + (size_t)(nkeep - 1 - i) * n2, x->x_fdl +
+            (size_t)((x->x_fdlpos - 1 - i + nold) % nold) * n2,
+                n2 * sizeof(t_sample));
+    if (x->x_set)
+    {
+        freebytes(x->x_fdl, (size_t)nold * n2 * sizeof(t_sample));
+        sigconvolve_freeset(x->x_set, x->x_blocksize);
+    }
+    x->x_set = set;
+    x->x_fdl = fdl;
+    x->x_fdlpos = nkeep % set->s_npart;
+}
+
+    /* clock callback: transform some more partitions */
+static void sigconvolve_tick(t_sigconvolve *x)
+{
+    t_convset *set = x->x_newset;
+    int chunk = CONVCHUNK / x->x_blocksize, i;
+    if (!set)
+        return;
+    for (i = 0; i < chunk && x->x_nextpart < set->s_npart; i++)
+        sigconvolve_partition(x, set, x->x_nextpart++);
+    if (x->x_nextpart < set->s_npart)
+        clock_delay(x->x_clock, 0);
+    else
+    {
+        x->x_newset = 0;
+        sigconvolve_cancel(x);
+        sigconvolve_install(x, set);
+    }
+}
+
+    /* start partitioning the copied array; if "now" is set, do it all
+    at once. */
+static void sigconvolve_start(t_sigconvolve *x, int now)
+{
+    int npart = (x->x_irsize + x->x_blocksize - 1) / x->x_blocksize;
+    if (!(x->x_newset = sigconvolve_newset(npart, x->x_blocksize)))
+    {
+        pd_error(x, "convolve~: out of memory");
+        sigconvolve_cancel(x);
+        return;
+    }
+    x->x_nextpart = 0;
+    if (now)
+    {
+        while (x->x_newset)
+            sigconvolve_tick(x);
+    }
+    else sigconvolve_tick(x);
+}
+
+static void sigconvolve_set(t_sigconvolve *x, t_symbol *s)
+{
+    if (*s->s_name)
+        x->x_arrayname = s;
+    if (sigconvolve_getarray(x) && x->x_plan)
+        sigconvolve_start(x, 0);
+}
+
+static t_int *sigconvolve_perform(t_int *w)
+{
+    t_sigconvolve *x = (t_sigconvolve *)(w[1]);
+    t_sample *in = (t_sample *)(w[2]);
+    t_sample *out = (t_sample *)(w[3]);
+    int n = (int)(w[4]), n2 = 2 * n, npart, i, k;
+    t_sample *fdl, *y = x->x_outbuf;
+    if (!x->x_set)
+    {
+        while (n--)
+            *out++ = 0;
+        return (w+5);
+    }
+    npart = x->x_set->s_npart;
+    memcpy(x->x_inbuf + n, in, n * sizeof(t_sample));
+    fdl = x->x_fdl + (size_t)x->x_fdlpos * n2;
+    memcpy(fdl, x->x_inbuf, n2 * sizeof(t_sample));
+    fftplan_real(x->x_plan, fdl, 0);
+    sigconvolve_flip(fdl, n2);
+    memmove(x->x_inbuf, x->x_inbuf + n, n * sizeof(t_sample));
+
+        /* multiply and add, real parts in y[0...n] and imaginary ones in
+        y[n+1...2n-1] */
+    for (i = 0; i < n2; i++)
+        y[i] = 0;
+    for (k = 0; k < npart; k++)
+    {
+        const t_sample *xs = x->x_fdl +
+            (size_t)((x->x_fdlpos - k + npart) % npart) * n2,
+                *hs = x->x_set->s_spectra + (size_t)k * n2,
+                *xr = xs + 1, *xi = xs + n + 1, *hr = hs + 1, *hi = hs + n + 1;
+        t_sample *yr = y + 1, *yi = y + n + 1;
+        y[0] += xs[0] * hs[0];
+        y[n] += xs[n] * hs[n];
+        for (i = 0; i < n - 1; i++)
+        {
+            yr[i] += xr[i] * hr[i] - xi[i] * hi[i];
+            yi[i] += xr[i] * hi[i] + xi[i] * hr[i];
+        }
+    }
+    sigconvolve_flip(y, n2);
+    fftplan_real(x->x_plan, y, 1);
+    memcpy(out, y + n, n * sizeof(t_sample));
+    x->x_fdlpos = (x->x_fdlpos + 1) % npart;
+    return (w+5);
+}
+
+static void sigconvolve_freebuffers(t_sigconvolve *x)
+{
+    sigconvolve_cancel(x);
+    if (x->x_set)
+    {
+        freebytes(x->x_fdl,
+            (size_t)x->x_set->s_npart * 2 * x->x_blocksize * sizeof(t_sample));
+        sigconvolve_freeset(x->x_set, x->x_blocksize);
+        x->x_set = 0;
+        x->x_fdl = 0;
+    }
+    if (x->x_inbuf)
+    {
+        freebytes(x->x_inbuf, 2 * x->x_blocksize * sizeof(t_sample));
+        freebytes(x->x_outbuf, 2 * x->x_blocksize * sizeof(t_sample));
+        x->x_inbuf = x->x_outbuf = 0;
+    }
+}
+
+static void sigconvolve_dsp(t_sigconvolve *x, t_signal **sp)
+{
+    int n = sp[0]->s_n;
+    if (n < 4)
+    {
+        error("convolve~: minimum 4 points");
+        return;
+    }
+        /* partition again (all at once) if the block size changed */
+    if (n != x->x_blocksize || !x->x_plan)
+    {
+        sigconvolve_freebuffers(x);
+        x->x_blocksize = n;
+        fftclass_plan(&x->x_plan, &x->x_npoints, 2 * n, 1);
+        if (!x->x_plan)
+            return;
+        x->x_inbuf = (t_sample *)getbytes(2 * n * sizeof(t_sample));
+        x->x_outbuf = (t_sample *)getbytes(2 * n * sizeof(t_sample));
+        if (sigconvolve_getarray(x))
+            sigconvolve_start(x, 1);
+    }
+    else if (x->x_set)
+    {
+        t_garray *a = (t_garray *)pd_findbyclass(x->x_arrayname,
+            garray_class);
+        if (a)
+            garray_usedindsp(a);
+    }
+    dsp_add(sigconvolve_perform, 4, x, sp[0]->s_vec, sp[1]->s_vec, n);
+}
+
+static void *sigconvolve_new(t_symbol *s)
+{
+    t_sigconvolve *x = (t_sigconvolve *)pd_new(sigconvolve_class);
+    x->x_arrayname = s;
+    x->x_clock = clock_new(x, (t_method)sigconvolve_tick);
+    x->x_blocksize = 0;
+    x->x_plan = 0;
+    x->x_npoints = 0;
+    x->x_set = 0;
+    x->x_fdl = 0;
+    x->x_fdlpos = 0;
+    x->x_inbuf = x->x_outbuf = 0;
+    x->x_ir = 0;
+    x->x_irsize = 0;
+    x->x_newset = 0;
+    x->x_nextpart = 0;
+    x->x_f = 0;
+    outlet_new(&x->x_obj, gensym("signal"));
+    return (x);
+}
+
+static void sigconvolve_free(t_sigconvolve *x)
+{
+    sigconvolve_freebuffers(x);
+    clock_free(x->x_clock);
+    if (x->x_plan)
+        fftplan_free(x->x_plan);
+}
+
+static void sigconvolve_setup(void)
+{
+    sigconvolve_class = class_new(gensym("convolve~"),
+        (t_newmethod)sigconvolve_new, (t_method)sigconvolve_free,
+            sizeof(t_sigconvolve), 0, A_DEFSYM, 0);
+    CLASS_MAINSIGNALIN(sigconvolve_class, t_sigconvolve, x_f);
+    class_addmethod(sigconvolve_class, (t_method)sigconvolve_dsp,
+        gensym("dsp"), A_CANT, 0);
+    class_addmethod(sigconvolve_class, (t_method)sigconvolve_set,
+        gensym("set"), A_DEFSYM, 0);
+}
+
 /* ------------------------ global setup routine ------------------------- */
 
 void d_fft_setup(void)
@@ -372,4 +781,5 @@ void d_fft_setup(void)
     sigrfft_setup();
     sigrifft_setup();
     sigframp_setup();
+    sigconvolve_setup();
 }
@@ -33,6 +33,8 @@ for another, more permissive-sounding copyright notice.  -MSP
 #define FFTFLT double
 void cdft(int, int, FFTFLT *, int *, FFTFLT *);
 void rdft(int, int, FFTFLT *, int *, FFTFLT *);
+void makewt(int nw, int *ip, FFTFLT *w);
+void makect(int nc, int *ip, FFTFLT *c);
 
 int ilog2(int n);
 
@@ -123,21 +125,20 @@ EXTERN void mayer_fht(t_sample *fz, int n)
     post("FHT: not yet implemented");
 }
 
-EXTERN void mayer_dofft(t_sample *fz1, t_sample *fz2, int n, int sgn)
+    /* the transforms themselves, given a buffer and tables big enough */
+static void ooura_cfft(t_sample *fz1, t_sample *fz2, int n, int sgn,
+    FFTFLT *buf, int *bitrev, FFTFLT *costab)
 {
-    FFTFLT *buf, *fp3;
+    FFTFLT *fp3;
     int i;
     t_sample *fp1, *fp2;
-    if (!ooura_init(2*n))
-        return;
-    buf = ooura_buffer;
     for (i = 0, fp1 = fz1, fp2 = fz2, fp3 = buf; i < n; i++)
     {
         fp3[0] = *fp1++;
         fp3[1] = *fp2++;
         fp3 += 2;
     }
-    cdft(2*n, sgn, buf, ooura_bitrev, ooura_costab);
+    cdft(2*n, sgn, buf, bitrev, costab);
     for (i = 0, fp1 = fz1, fp2 = fz2, fp3 = buf; i < n; i++)
     {
         *fp1++ = fp3[0];
@@ -146,27 +147,15 @@ EXTERN void mayer_dofft(t_sample *fz1, t_sample *fz2, int n, int sgn)
     }
 }
 
-EXTERN void mayer_fft(int n, t_sample *fz1, t_sample *fz2)
-{
-    mayer_dofft(fz1, fz2, n, -1);
-}
-
-EXTERN void mayer_ifft(int n, t_sample *fz1, t_sample *fz2)
-{
-    mayer_dofft(fz1, fz2, n, 1);
-}
-
-EXTERN void mayer_realfft(int n, t_sample *fz)
+static void ooura_rfft(t_sample *fz, int n, FFTFLT *buf, int *bitrev,
+    FFTFLT *costab)
 {
-    FFTFLT *buf, *fp3;
+    FFTFLT *fp3;
     int i, nover2 = n/2;
     t_sample *fp1, *fp2;
-    if (!ooura_init(n))
-        return;
-    buf = ooura_buffer;
-    for (i = 0, fp1 = fz, fp3 = buf; i < n; i++, fp1++, fp3++)
+    for (i = 0; i < n; i++)
         buf[i] = fz[i];
-    rdft(n, 1, buf, ooura_bitrev, ooura_costab);
+    rdft(n, 1, buf, bitrev, costab);
     fz[0] = buf[0];
     fz[nover2] = buf[1];
     for (i = 1, fp1 = fz+1, fp2 = fz+(n-1), fp3 = buf+2; i < nover2;
@@ -174,24 +163,184 @@ EXTERN void mayer_realfft(int n, t_sample *fz)
             *fp1 = fp3[0], *fp2 = fp3[1];
 }
 
-EXTERN void mayer_realifft(int n, t_sample *fz)
+static void ooura_rifft(t_sample *fz, int n, FFTFLT *buf, int *bitrev,
+    FFTFLT *costab)
 {
-    FFTFLT *buf, *fp3;
+    FFTFLT *fp3;
     int i, nover2 = n/2;
     t_sample *fp1, *fp2;
-    if (!ooura_init(n))
-        return;
-    buf = ooura_buffer;
     buf[0] = fz[0];
     buf[1] = fz[nover2];
     for (i = 1, fp1 = fz+1, fp2 = fz+(n-1), fp3 = buf+2; i < nover2;
         i++, fp1++, fp2--, fp3 += 2)
             fp3[0] = *fp1, fp3[1] = *fp2;
-    rdft(n, -1, buf, ooura_bitrev, ooura_costab);
-    for (i = 0, fp1 = fz, fp3 = buf; i < n; i++, fp1++, fp3++)
+    rdft(n, -1, buf, bitrev, costab);
+    for (i = 0; i < n; i++)
         fz[i] = 2*buf[i];
 }
 
+EXTERN void mayer_dofft(t_sample *fz1, t_sample *fz2, int n, int sgn)
+{
+    if (!ooura_init(2*n))
+        return;
+    ooura_cfft(fz1, fz2, n, sgn, ooura_buffer, ooura_bitrev, ooura_costab);
+}
+
+EXTERN void mayer_fft(int n, t_sample *fz1, t_sample *fz2)
+{
+    mayer_dofft(fz1, fz2, n, -1);
+}
+
+EXTERN void mayer_ifft(int n, t_sample *fz1, t_sample *fz2)
+{
+    mayer_dofft(fz1, fz2, n, 1);
+}
+
+EXTERN void mayer_realfft(int n, t_sample *fz)
+{
+    if (!ooura_init(n))
+        return;
+    ooura_rfft(fz, n, ooura_buffer, ooura_bitrev, ooura_costab);
+}
+
+EXTERN void mayer_realifft(int n, t_sample *fz)
+{
+    if (!ooura_init(n))
+        return;
+    ooura_rifft(fz, n, ooura_buffer, ooura_bitrev, ooura_costab);
+}
+
+/* -------- planned FFTs -------- */
+
+/* The routines above share one set of tables, sized for the largest FFT
+seen so far and reallocated (in the DSP thread) whenever a bigger one comes
+along, so that small FFTs read their twiddle factors at a stride out of a
+table much bigger than they need.  A plan instead gets tables built for its
+own size when it is made, typically in a "dsp" method.  All plans of the
+same size share the tables; like the tables above these are kept per thread
+so that separate Pd instances don't collide.  Each plan has its own work
+buffer, so that once made, a plan may be used from another thread (one at
+a time) while the thread that made it goes on with other plans. */
+
+typedef struct _ooura_table
+{
+    int t_n;                /* Ooura's size (twice the points if complex) */
+    int t_refcount;
+    int *t_bitrev;
+    int t_bitrevsize;
+    FFTFLT *t_costab;
+    struct _ooura_table *t_next;
+} t_ooura_table;
+
+struct _fftplan
+{
+    int p_npoints;
+    int p_real;
+    t_ooura_table *p_table;
+    FFTFLT *p_buffer;       /* work buffer, same size as the table's */
+};
+
+static PERTHREAD t_ooura_table *ooura_tablelist;
+
+static t_ooura_table *ooura_table_get(int n)
+{
+    t_ooura_table *t;
+    for (t = ooura_tablelist; t; t = t->t_next)
+        if (t->t_n == n)
+    {
+        t->t_refcount++;
+        return (t);
+    }
+    if (!(t = (t_ooura_table *)t_getbytes(sizeof(*t))))
+        return (0);
+    t->t_n = n;
+    t->t_refcount = 1;
+    t->t_bitrevsize = sizeof(int) * (2 + (1 << (ilog2(n)/2)));
+    t->t_bitrev = (int *)t_getbytes(t->t_bitrevsize);
+    t->t_costab = (FFTFLT *)t_getbytes(n * sizeof(FFTFLT)/2);
+    if (!t->t_bitrev || !t->t_costab)
+    {
+        error("out of memory allocating FFT buffer");
+        if (t->t_bitrev)
+            t_freebytes(t->t_bitrev, t->t_bitrevsize);
+        if (t->t_costab)
+            t_freebytes(t->t_costab, n * sizeof(FFTFLT)/2);
+        t_freebytes(t, sizeof(*t));
+        return (0);
+    }
+        /* make the tables now rather than in the first transform */
+    makewt(n >> 2, t->t_bitrev, t->t_costab);
+    makect(n >> 2, t->t_bitrev, t->t_costab + (n >> 2));
+    t->t_next = ooura_tablelist;
+    ooura_tablelist = t;
+    return (t);
+}
+
+static void ooura_table_release(t_ooura_table *t)
+{
+    t_ooura_table **tp;
+    if (--t->t_refcount)
+        return;
+    for (tp = &ooura_tablelist; *tp; tp = &(*tp)->t_next)
+        if (*tp == t)
+    {
+        *tp = t->t_next;
+        break;
+    }
+    t_freebytes(t->t_bitrev, t->t_bitrevsize);
+    t_freebytes(t->t_costab, t->t_n * sizeof(FFTFLT)/2);
+    t_freebytes(t, sizeof(*t));
+}
+
+t_fftplan *fftplan_new(int npoints, int realfft)
+{
+    t_fftplan *x;
+    t_ooura_table *t;
+    if (npoints < 4 || npoints != (1 << ilog2(npoints)))
+        return (0);
+    if (!(t = ooura_table_get(realfft ? npoints : 2 * npoints)))
+        return (0);
+    x = (t_fftplan *)t_getbytes(sizeof(*x));
+    x->p_npoints = npoints;
+    x->p_real = realfft;
+    x->p_table = t;
+    if (!(x->p_buffer = (FFTFLT *)t_getbytes(t->t_n * sizeof(FFTFLT))))
+    {
+        error("out of memory allocating FFT buffer");
+        ooura_table_release(t);
+        t_freebytes(x, sizeof(*x));
+        return (0);
+    }
+    return (x);
+}
+
+void fftplan_free(t_fftplan *x)
+{
+    t_freebytes(x->p_buffer, x->p_table->t_n * sizeof(FFTFLT));
+    ooura_table_release(x->p_table);
+    t_freebytes(x, sizeof(*x));
+}
+
+void fftplan_complex(t_fftplan *x, t_sample *real, t_sample *imag,
+    int inverse)
+{
+    t_ooura_table *t = x->p_table;
+    if (x->p_real)
+        bug("fftplan_complex");
+    else ooura_cfft(real, imag, x->p_npoints, (inverse ? 1 : -1),
+        x->p_buffer, t->t_bitrev, t->t_costab);
+}
+
+void fftplan_real(t_fftplan *x, t_sample *buf, int inverse)
+{
+    t_ooura_table *t = x->p_table;
+    if (!x->p_real)
+        bug("fftplan_real");
+    else if (inverse)
+        ooura_rifft(buf, x->p_npoints, x->p_buffer, t->t_bitrev, t->t_costab);
+    else ooura_rfft(buf, x->p_npoints, x->p_buffer, t->t_bitrev, t->t_costab);
+}
+
     /* ancient ISPW-like version, used in fiddle~ and perhaps other externs
     here and there. */
 void pd_fft(t_float *buf, int npoints, int inverse)
@@ -237,6 +237,102 @@ EXTERN void mayer_realifft(int n, t_sample *fz)
         fz[i] = p->out[i];
 }
 
+/* planned FFTs.  FFTW already plans (and measures) each size once; getting
+the plans when the plan is made moves that out of the DSP loop.  Each plan
+has its own input and output arrays, which we hand to FFTW's "new-array"
+execute functions, so that a plan can be used from another thread than the
+one that made it. */
+
+struct _fftplan
+{
+    int p_npoints;
+    int p_real;
+    void *p_fwd;
+    void *p_bwd;
+    float *p_in;
+    float *p_out;
+};
+
+t_fftplan *fftplan_new(int npoints, int realfft)
+{
+    t_fftplan *x;
+    void *fwd, *bwd;
+    int nfloats = (realfft ? npoints : 2 * npoints);
+    if (npoints < 4 || npoints != (1 << ilog2(npoints)))
+        return (0);
+    if (realfft)
+        fwd = rfftw_getplan(npoints, 1), bwd = rfftw_getplan(npoints, 0);
+    else fwd = cfftw_getplan(npoints, 1), bwd = cfftw_getplan(npoints, 0);
+    if (!fwd || !bwd)
+        return (0);
+    x = (t_fftplan *)getbytes(sizeof(*x));
+    x->p_npoints = npoints;
+    x->p_real = realfft;
+    x->p_fwd = fwd;
+    x->p_bwd = bwd;
+    x->p_in = (float *)fftwf_malloc(sizeof(float) * nfloats);
+    x->p_out = (float *)fftwf_malloc(sizeof(float) * nfloats);
+    return (x);
+}
+
+void fftplan_free(t_fftplan *x)
+{
+    fftwf_free(x->p_in);
+    fftwf_free(x->p_out);
+    freebytes(x, sizeof(*x));
+}
+
+void fftplan_complex(t_fftplan *x, t_sample *real, t_sample *imag,
+    int inverse)
+{
+    cfftw_info *p = (cfftw_info *)(inverse ? x->p_bwd : x->p_fwd);
+    int i, n = x->p_npoints;
+    float *fz;
+    if (x->p_real)
+    {
+        bug("fftplan_complex");
+        return;
+    }
+    for (i = 0, fz = x->p_in; i < n; i++)
+        fz[i*2] = real[i], fz[i*2+1] = imag[i];
+    fftwf_execute_dft(p->plan, (fftwf_complex *)x->p_in,
+        (fftwf_complex *)x->p_out);
+    for (i = 0, fz = x->p_out; i < n; i++)
+        real[i] = fz[i*2], imag[i] = fz[i*2+1];
+}
+
+    /* same sign flips as mayer_realfft() and mayer_realifft() above */
+void fftplan_real(t_fftplan *x, t_sample *buf, int inverse)
+{
+    rfftw_info *p = (rfftw_info *)(inverse ? x->p_bwd : x->p_fwd);
+    int i, n = x->p_npoints;
+    if (!x->p_real)
+    {
+        bug("fftplan_real");
+        return;
+    }
+    if (inverse)
+    {
+        for (i = 0; i < n/2+1; i++)
+            x->p_in[i] = buf[i];
+        for (; i < n; i++)
+            x->p_in[i] = -buf[i];
+        fftwf_execute_r2r(p->plan, x->p_in, x->p_out);
+        for (i = 0; i < n; i++)
+            buf[i] = x->p_out[i];
+    }
+    else
+    {
+        for (i = 0; i < n; i++)
+            x->p_in[i] = buf[i];
+        fftwf_execute_r2r(p->plan, x->p_in, x->p_out);
+        for (i = 0; i < n/2+1; i++)
+            buf[i] = x->p_out[i];
+        for (; i < n; i++)
+            buf[i] = -x->p_out[i];
+    }
+}
+
     /* ancient ISPW-like version, used in fiddle~ and perhaps other externs
     here and there. */
 void pd_fft(t_float *buf, int npoints, int inverse)
@@ -5,14 +5,62 @@
 /*  "filters", both linear and nonlinear.
 */
 #include "m_pd.h"
+#include "s_stuff.h"
 #include <math.h>
+#include <string.h>
+
+extern int ugen_getdouble(void);
+
+    /* the filters below keep their state in an array with room for each
+    channel of a multichannel input.  It grows as needed but never shrinks,
+    so that a DSP chain being replaced can still run on it.  The state is
+    kept in double so that the filters can run either in single or, when
+    ugen_getdouble() says so, in double precision, and be switched between
+    the two without a click. */
+static double *filter_growstate(double *state, int *nallocp, int nchans,
+    int nper)
+{
+    if (nchans > *nallocp)
+    {
+        state = (double *)resizebytes(state,
+            *nallocp * nper * sizeof(double),
+                nchans * nper * sizeof(double));
+        *nallocp = nchans;
+    }
+    return (state);
+}
+
+    /* whether a recursive filter has to get rid of denormals sample by
+    sample: only if the DSP chain isn't running with them flushed to zero,
+    which can be turned off with "-noftz" or "pd dspftz 0" (see d_ugen.c) */
+#ifdef PD_FLUSHDENORMALS
+#define filter_mustcheck() (!sys_dspftz)
+#else
+#define filter_mustcheck() 1
+#endif
+
+    /* PD_BIGORSMALL() for doubles, with the same thresholds (about 2^-63
+    and 2^64), and also true for infinities and NaNs */
+static int filter_bigorsmall(double f)
+{
+    union
+    {
+        double d;
+        uint64_t i;
+    } u;
+    int e;
+    u.d = f;
+    e = (int)((u.i >> 52) & 0x7ff);
+    return (e < 1023 - 63 || e >= 1023 + 64);
+}
 
 /* ---------------- hip~ - 1-pole 1-zero hipass filter. ----------------- */
 
 typedef struct hipctl
 {
-    t_sample c_x;
+    double *c_x;        /* one per channel */
     t_sample c_coef;
+    double c_dcoef;     /* the same in double precision */
 } t_hipctl;
 
 typedef struct sighip
@@ -22,6 +70,7 @@ typedef struct sighip
     t_float x_hz;
     t_hipctl x_cspace;
     t_hipctl *x_ctl;
+    int x_nalloc;       /* channels there's state for */
     t_float x_f;
 } t_sighip;
 
@@ -35,7 +84,8 @@ static void *sighip_new(t_floatarg f)
     outlet_new(&x->x_obj, &s_signal);
     x->x_sr = 44100;
     x->x_ctl = &x->x_cspace;
-    x->x_cspace.c_x = 0;
+    x->x_cspace.c_x = (double *)getbytes(sizeof(double));
+    x->x_nalloc = 1;
     sighip_ft1(x, f);
     x->x_f = 0;
     return (x);
@@ -45,11 +95,12 @@ static void sighip_ft1(t_sighip *x, t_floatarg f)
 {
     if (f < 0) f = 0;
     x->x_hz = f;
-    x->x_ctl->c_coef = 1 - f * (2 * 3.14159) / x->x_sr;
-    if (x->x_ctl->c_coef < 0)
-        x->x_ctl->c_coef = 0;
-    else if (x->x_ctl->c_coef > 1)
-        x->x_ctl->c_coef = 1;
+    x->x_ctl->c_dcoef = 1 - f * (2 * 3.14159) / x->x_sr;
+    if (x->x_ctl->c_dcoef < 0)
+        x->x_ctl->c_dcoef = 0;
+    else if (x->x_ctl->c_dcoef > 1)
+        x->x_ctl->c_dcoef = 1;
+    x->x_ctl->c_coef = x->x_ctl->c_dcoef;
 }
 
 static t_int *sighip_perform(t_int *w)
@@ -58,29 +109,68 @@ static t_int *sighip_perform(t_int *w)
     t_sample *out = (t_sample *)(w[2]);
     t_hipctl *c = (t_hipctl *)(w[3]);
     int n = (int)w[4];
-    int i;
-    t_sample last = c->c_x;
+    int nchans = (int)w[5];
+    int i, ch;
     t_sample coef = c->c_coef;
-    if (coef < 1)
+    for (ch = 0; ch < nchans; ch++)
     {
-        t_sample normal = 0.5*(1+coef);
-        for (i = 0; i < n; i++)
+        t_sample last = c->c_x[ch];
+        if (coef < 1)
         {
-            t_sample new = *in++ + coef * last;
-            *out++ = normal * (new - last);
-            last = new;
+            t_sample normal = 0.5*(1+coef);
+            for (i = 0; i < n; i++)
+            {
+                t_sample new = *in++ + coef * last;
+                *out++ = normal * (new - last);
+                last = new;
+            }
+            if (PD_BIGORSMALL(last))
+                last = 0;
+            c->c_x[ch] = last;
+        }
+        else
+        {
+            for (i = 0; i < n; i++)
+                *out++ = *in++;
+            c->c_x[ch] = 0;
         }
-        if (PD_BIGORSMALL(last))
-            last = 0;
-        c->c_x = last;
     }
-    else
+    return (w+6);
+}
+
+static t_int *sighip_perform_double(t_int *w)
+{
+    t_sample *in = (t_sample *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    t_hipctl *c = (t_hipctl *)(w[3]);
+    int n = (int)w[4];
+    int nchans = (int)w[5];
+    int i, ch;
+    double coef = c->c_dcoef;
+    for (ch = 0; ch < nchans; ch++)
     {
-        for (i = 0; i < n; i++)
-            *out++ = *in++;
-        c->c_x = 0;
+        double last = c->c_x[ch];
+        if (coef < 1)
+        {
+            double normal = 0.5*(1+coef);
+            for (i = 0; i < n; i++)
+            {
+                double new = *in++ + coef * last;
+                *out++ = normal * (new - last);
+                last = new;
+            }
+            if (filter_bigorsmall(last))
+                last = 0;
+            c->c_x[ch] = last;
+        }
+        else
+        {
+            for (i = 0; i < n; i++)
+                *out++ = *in++;
+            c->c_x[ch] = 0;
+        }
     }
-    return (w+5);
+    return (w+6);
 }
 
 static t_int *sighip_perform_old(t_int *w)
@@ -89,48 +179,63 @@ static t_int *sighip_perform_old(t_int *w)
     t_sample *out = (t_sample *)(w[2]);
     t_hipctl *c = (t_hipctl *)(w[3]);
     int n = (int)w[4];
-    int i;
-    t_sample last = c->c_x;
+    int nchans = (int)w[5];
+    int i, ch;
     t_sample coef = c->c_coef;
-    if (coef < 1)
+    for (ch = 0; ch < nchans; ch++)
     {
-        for (i = 0; i < n; i++)
+        t_sample last = c->c_x[ch];
+        if (coef < 1)
         {
-            t_sample new = *in++ + coef * last;
-            *out++ = new - last;
-            last = new;
+            for (i = 0; i < n; i++)
+            {
+                t_sample new = *in++ + coef * last;
+                *out++ = new - last;
+                last = new;
+            }
+            if (PD_BIGORSMALL(last))
+                last = 0;
+            c->c_x[ch] = last;
+        }
+        else
+        {
+            for (i = 0; i < n; i++)
+                *out++ = *in++;
+            c->c_x[ch] = 0;
         }
-        if (PD_BIGORSMALL(last))
-            last = 0;
-        c->c_x = last;
-    }
-    else
-    {
-        for (i = 0; i < n; i++)
-            *out++ = *in++;
-        c->c_x = 0;
     }
-    return (w+5);
+    return (w+6);
 }
 
 static void sighip_dsp(t_sighip *x, t_signal **sp)
 {
+    int nchans = sp[0]->s_nchans;
     x->x_sr = sp[0]->s_sr;
     sighip_ft1(x,  x->x_hz);
-    dsp_add((pd_compatibilitylevel > 43 ?
-        sighip_perform : sighip_perform_old),
-            4, sp[0]->s_vec, sp[1]->s_vec, x->x_ctl, sp[0]->s_n);
+    x->x_cspace.c_x = filter_growstate(x->x_cspace.c_x, &x->x_nalloc,
+        nchans, 1);
+    signal_setmultiout(&sp[1], nchans);
+    dsp_add((pd_compatibilitylevel <= 43 ? sighip_perform_old :
+        (ugen_getdouble() ? sighip_perform_double : sighip_perform)),
+            5, sp[0]->s_vec, sp[1]->s_vec, x->x_ctl, sp[0]->s_n, nchans);
 }
 
 static void sighip_clear(t_sighip *x, t_floatarg q)
 {
-    x->x_cspace.c_x = 0;
+    int i;
+    for (i = 0; i < x->x_nalloc; i++)
+        x->x_cspace.c_x[i] = 0;
+}
+
+static void sighip_free(t_sighip *x)
+{
+    freebytes(x->x_cspace.c_x, x->x_nalloc * sizeof(double));
 }
 
 void sighip_setup(void)
 {
-    sighip_class = class_new(gensym("hip~"), (t_newmethod)sighip_new, 0,
-        sizeof(t_sighip), 0, A_DEFFLOAT, 0);
+    sighip_class = class_new(gensym("hip~"), (t_newmethod)sighip_new,
+        (t_method)sighip_free, sizeof(t_sighip), 0, A_DEFFLOAT, 0);
     CLASS_MAINSIGNALIN(sighip_class, t_sighip, x_f);
     class_addmethod(sighip_class, (t_method)sighip_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -143,8 +248,9 @@ void sighip_setup(void)
 
 typedef struct lopctl
 {
-    t_sample c_x;
+    double *c_x;        /* one per channel */
     t_sample c_coef;
+    double c_dcoef;     /* the same in double precision */
 } t_lopctl;
 
 typedef struct siglop
@@ -154,6 +260,7 @@ typedef struct siglop
     t_float x_hz;
     t_lopctl x_cspace;
     t_lopctl *x_ctl;
+    int x_nalloc;       /* channels there's state for */
     t_float x_f;
 } t_siglop;
 
@@ -168,7 +275,8 @@ static void *siglop_new(t_floatarg f)
     outlet_new(&x->x_obj, &s_signal);
     x->x_sr = 44100;
     x->x_ctl = &x->x_cspace;
-    x->x_cspace.c_x = 0;
+    x->x_cspace.c_x = (double *)getbytes(sizeof(double));
+    x->x_nalloc = 1;
     siglop_ft1(x, f);
     x->x_f = 0;
     return (x);
@@ -178,16 +286,19 @@ static void siglop_ft1(t_siglop *x, t_floatarg f)
 {
     if (f < 0) f = 0;
     x->x_hz = f;
-    x->x_ctl->c_coef = f * (2 * 3.14159) / x->x_sr;
-    if (x->x_ctl->c_coef > 1)
-        x->x_ctl->c_coef = 1;
-    else if (x->x_ctl->c_coef < 0)
-        x->x_ctl->c_coef = 0;
+    x->x_ctl->c_dcoef = f * (2 * 3.14159) / x->x_sr;
+    if (x->x_ctl->c_dcoef > 1)
+        x->x_ctl->c_dcoef = 1;
+    else if (x->x_ctl->c_dcoef < 0)
+        x->x_ctl->c_dcoef = 0;
+    x->x_ctl->c_coef = x->x_ctl->c_dcoef;
 }
 
 static void siglop_clear(t_siglop *x, t_floatarg q)
 {
-    x->x_cspace.c_x = 0;
+    int i;
+    for (i = 0; i < x->x_nalloc; i++)
+        x->x_cspace.c_x[i] = 0;
 }
 
 static t_int *siglop_perform(t_int *w)
@@ -196,32 +307,67 @@ static t_int *siglop_perform(t_int *w)
     t_sample *out = (t_sample *)(w[2]);
     t_lopctl *c = (t_lopctl *)(w[3]);
     int n = (int)w[4];
-    int i;
-    t_sample last = c->c_x;
+    int nchans = (int)w[5];
+    int i, ch;
     t_sample coef = c->c_coef;
     t_sample feedback = 1 - coef;
-    for (i = 0; i < n; i++)
-        last = *out++ = coef * *in++ + feedback * last;
-    if (PD_BIGORSMALL(last))
-        last = 0;
-    c->c_x = last;
-    return (w+5);
+    for (ch = 0; ch < nchans; ch++)
+    {
+        t_sample last = c->c_x[ch];
+        for (i = 0; i < n; i++)
+            last = *out++ = coef * *in++ + feedback * last;
+        if (PD_BIGORSMALL(last))
+            last = 0;
+        c->c_x[ch] = last;
+    }
+    return (w+6);
+}
+
+static t_int *siglop_perform_double(t_int *w)
+{
+    t_sample *in = (t_sample *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    t_lopctl *c = (t_lopctl *)(w[3]);
+    int n = (int)w[4];
+    int nchans = (int)w[5];
+    int i, ch;
+    double coef = c->c_dcoef;
+    double feedback = 1 - coef;
+    for (ch = 0; ch < nchans; ch++)
+    {
+        double last = c->c_x[ch];
+        for (i = 0; i < n; i++)
+            *out++ = last = coef * *in++ + feedback * last;
+        if (filter_bigorsmall(last))
+            last = 0;
+        c->c_x[ch] = last;
+    }
+    return (w+6);
 }
 
 static void siglop_dsp(t_siglop *x, t_signal **sp)
 {
+    int nchans = sp[0]->s_nchans;
     x->x_sr = sp[0]->s_sr;
     siglop_ft1(x,  x->x_hz);
-    dsp_add(siglop_perform, 4,
+    x->x_cspace.c_x = filter_growstate(x->x_cspace.c_x, &x->x_nalloc,
+        nchans, 1);
+    signal_setmultiout(&sp[1], nchans);
+    dsp_add((ugen_getdouble() ? siglop_perform_double : siglop_perform), 5,
         sp[0]->s_vec, sp[1]->s_vec,
-            x->x_ctl, sp[0]->s_n);
+            x->x_ctl, sp[0]->s_n, nchans);
 
 }
 
+static void siglop_free(t_siglop *x)
+{
+    freebytes(x->x_cspace.c_x, x->x_nalloc * sizeof(double));
+}
+
 void siglop_setup(void)
 {
-    siglop_class = class_new(gensym("lop~"), (t_newmethod)siglop_new, 0,
-        sizeof(t_siglop), 0, A_DEFFLOAT, 0);
+    siglop_class = class_new(gensym("lop~"), (t_newmethod)siglop_new,
+        (t_method)siglop_free, sizeof(t_siglop), 0, A_DEFFLOAT, 0);
     CLASS_MAINSIGNALIN(siglop_class, t_siglop, x_f);
     class_addmethod(siglop_class, (t_method)siglop_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -234,11 +380,13 @@ void siglop_setup(void)
 
 typedef struct bpctl
 {
-    t_sample c_x1;
-    t_sample c_x2;
+    double *c_x;        /* two per channel */
     t_sample c_coef1;
     t_sample c_coef2;
     t_sample c_gain;
+    double c_dcoef1;    /* the same in double precision */
+    double c_dcoef2;
+    double c_dgain;
 } t_bpctl;
 
 typedef struct sigbp
@@ -249,6 +397,7 @@ typedef struct sigbp
     t_float x_q;
     t_bpctl x_cspace;
     t_bpctl *x_ctl;
+    int x_nalloc;       /* channels there's state for */
     t_float x_f;
 } t_sigbp;
 
@@ -264,8 +413,8 @@ static void *sigbp_new(t_floatarg f, t_floatarg q)
     outlet_new(&x->x_obj, &s_signal);
     x->x_sr = 44100;
     x->x_ctl = &x->x_cspace;
-    x->x_cspace.c_x1 = 0;
-    x->x_cspace.c_x2 = 0;
+    x->x_cspace.c_x = (double *)getbytes(2 * sizeof(double));
+    x->x_nalloc = 1;
     sigbp_docoef(x, f, q);
     x->x_f = 0;
     return (x);
@@ -281,9 +430,21 @@ static t_float sigbp_qcos(t_float f)
     else return (0);
 }
 
+    /* the same in double precision */
+static double sigbp_dqcos(double f)
+{
+    if (f >= -(0.5*3.14159) && f <= 0.5*3.14159)
+    {
+        double g = f*f;
+        return (((g*g*g * (-1.0/720.0) + g*g*(1.0/24.0)) - g*0.5) + 1);
+    }
+    else return (0);
+}
+
 static void sigbp_docoef(t_sigbp *x, t_floatarg f, t_floatarg q)
 {
     t_float r, oneminusr, omega;
+    double dr, doneminusr, domega;
     if (f < 0.001) f = 10;
     if (q < 0) q = 0;
     x->x_freq = f;
@@ -296,6 +457,14 @@ static void sigbp_docoef(t_sigbp *x, t_floatarg f, t_floatarg q)
     x->x_ctl->c_coef1 = 2.0f * sigbp_qcos(omega) * r;
     x->x_ctl->c_coef2 = - r * r;
     x->x_ctl->c_gain = 2 * oneminusr * (oneminusr + r * omega);
+    domega = f * (2.0 * 3.14159) / x->x_sr;
+    if (q < 0.001) doneminusr = 1.0;
+    else doneminusr = domega/q;
+    if (doneminusr > 1.0) doneminusr = 1.0;
+    dr = 1.0 - doneminusr;
+    x->x_ctl->c_dcoef1 = 2.0 * sigbp_dqcos(domega) * dr;
+    x->x_ctl->c_dcoef2 = - dr * dr;
+    x->x_ctl->c_dgain = 2 * doneminusr * (doneminusr + dr * domega);
     /* post("r %f, omega %f, coef1 %f, coef2 %f",
         r, omega, x->x_ctl->c_coef1, x->x_ctl->c_coef2); */
 }
@@ -312,7 +481,9 @@ static void sigbp_ft2(t_sigbp *x, t_floatarg q)
 
 static void sigbp_clear(t_sigbp *x, t_floatarg q)
 {
-    x->x_ctl->c_x1 = x->x_ctl->c_x2 = 0;
+    int i;
+    for (i = 0; i < 2 * x->x_nalloc; i++)
+        x->x_ctl->c_x[i] = 0;
 }
 
 static t_int *sigbp_perform(t_int *w)
@@ -321,42 +492,87 @@ static t_int *sigbp_perform(t_int *w)
     t_sample *out = (t_sample *)(w[2]);
     t_bpctl *c = (t_bpctl *)(w[3]);
     int n = (int)w[4];
-    int i;
-    t_sample last = c->c_x1;
-    t_sample prev = c->c_x2;
+    int nchans = (int)w[5];
+    int i, ch;
     t_sample coef1 = c->c_coef1;
     t_sample coef2 = c->c_coef2;
     t_sample gain = c->c_gain;
-    for (i = 0; i < n; i++)
+    for (ch = 0; ch < nchans; ch++)
     {
-        t_sample output =  *in++ + coef1 * last + coef2 * prev;
-        *out++ = gain * output;
-        prev = last;
-        last = output;
+        t_sample last = c->c_x[2*ch];
+        t_sample prev = c->c_x[2*ch+1];
+        for (i = 0; i < n; i++)
+        {
+            t_sample output =  *in++ + coef1 * last + coef2 * prev;
+            *out++ = gain * output;
+            prev = last;
+            last = output;
+        }
+        if (PD_BIGORSMALL(last))
+            last = 0;
+        if (PD_BIGORSMALL(prev))
+            prev = 0;
+        c->c_x[2*ch] = last;
+        c->c_x[2*ch+1] = prev;
     }
-    if (PD_BIGORSMALL(last))
-        last = 0;
-    if (PD_BIGORSMALL(prev))
-        prev = 0;
-    c->c_x1 = last;
-    c->c_x2 = prev;
-    return (w+5);
+    return (w+6);
+}
+
+static t_int *sigbp_perform_double(t_int *w)
+{
+    t_sample *in = (t_sample *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    t_bpctl *c = (t_bpctl *)(w[3]);
+    int n = (int)w[4];
+    int nchans = (int)w[5];
+    int i, ch;
+    double coef1 = c->c_dcoef1;
+    double coef2 = c->c_dcoef2;
+    double gain = c->c_dgain;
+    for (ch = 0; ch < nchans; ch++)
+    {
+        double last = c->c_x[2*ch];
+        double prev = c->c_x[2*ch+1];
+        for (i = 0; i < n; i++)
+        {
+            double output =  *in++ + coef1 * last + coef2 * prev;
+            *out++ = gain * output;
+            prev = last;
+            last = output;
+        }
+        if (filter_bigorsmall(last))
+            last = 0;
+        if (filter_bigorsmall(prev))
+            prev = 0;
+        c->c_x[2*ch] = last;
+        c->c_x[2*ch+1] = prev;
+    }
+    return (w+6);
 }
 
 static void sigbp_dsp(t_sigbp *x, t_signal **sp)
 {
+    int nchans = sp[0]->s_nchans;
     x->x_sr = sp[0]->s_sr;
     sigbp_docoef(x, x->x_freq, x->x_q);
-    dsp_add(sigbp_perform, 4,
+    x->x_cspace.c_x = filter_growstate(x->x_cspace.c_x, &x->x_nalloc,
+        nchans, 2);
+    signal_setmultiout(&sp[1], nchans);
+    dsp_add((ugen_getdouble() ? sigbp_perform_double : sigbp_perform), 5,
         sp[0]->s_vec, sp[1]->s_vec,
-            x->x_ctl, sp[0]->s_n);
+            x->x_ctl, sp[0]->s_n, nchans);
 
 }
 
+static void sigbp_free(t_sigbp *x)
+{
+    freebytes(x->x_cspace.c_x, 2 * x->x_nalloc * sizeof(double));
+}
+
 void sigbp_setup(void)
 {
-    sigbp_class = class_new(gensym("bp~"), (t_newmethod)sigbp_new, 0,
-        sizeof(t_sigbp), 0, A_DEFFLOAT, A_DEFFLOAT, 0);
+    sigbp_class = class_new(gensym("bp~"), (t_newmethod)sigbp_new,
+        (t_method)sigbp_free, sizeof(t_sigbp), 0, A_DEFFLOAT, A_DEFFLOAT, 0);
     CLASS_MAINSIGNALIN(sigbp_class, t_sigbp, x_f);
     class_addmethod(sigbp_class, (t_method)sigbp_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -371,8 +587,7 @@ void sigbp_setup(void)
 
 typedef struct biquadctl
 {
-    t_sample c_x1;
-    t_sample c_x2;
+    double *c_x;        /* two per channel */
     t_sample c_fb1;
     t_sample c_fb2;
     t_sample c_ff1;
@@ -386,6 +601,7 @@ typedef struct sigbiquad
     t_float x_f;
     t_biquadctl x_cspace;
     t_biquadctl *x_ctl;
+    int x_nalloc;       /* channels there's state for */
 } t_sigbiquad;
 
 t_class *sigbiquad_class;
@@ -397,7 +613,8 @@ static void *sigbiquad_new(t_symbol *s, int argc, t_atom *argv)
     t_sigbiquad *x = (t_sigbiquad *)pd_new(sigbiquad_class);
     outlet_new(&x->x_obj, &s_signal);
     x->x_ctl = &x->x_cspace;
-    x->x_cspace.c_x1 = x->x_cspace.c_x2 = 0;
+    x->x_cspace.c_x = (double *)getbytes(2 * sizeof(double));
+    x->x_nalloc = 1;
     sigbiquad_list(x, s, argc, argv);
     x->x_f = 0;
     return (x);
@@ -409,55 +626,105 @@ static t_int *sigbiquad_perform(t_int *w)
     t_sample *out = (t_sample *)(w[2]);
     t_biquadctl *c = (t_biquadctl *)(w[3]);
     int n = (int)w[4];
-    int i;
-    t_sample last = c->c_x1;
-    t_sample prev = c->c_x2;
+    int nchans = (int)w[5];
+    int i, ch;
     t_sample fb1 = c->c_fb1;
     t_sample fb2 = c->c_fb2;
     t_sample ff1 = c->c_ff1;
     t_sample ff2 = c->c_ff2;
     t_sample ff3 = c->c_ff3;
-    for (i = 0; i < n; i++)
+    int check = filter_mustcheck();
+    for (ch = 0; ch < nchans; ch++)
     {
-        t_sample output =  *in++ + fb1 * last + fb2 * prev;
-        if (PD_BIGORSMALL(output))
-            output = 0;
-        *out++ = ff1 * output + ff2 * last + ff3 * prev;
-        prev = last;
-        last = output;
+        t_sample last = c->c_x[2*ch];
+        t_sample prev = c->c_x[2*ch+1];
+        for (i = 0; i < n; i++)
+        {
+            t_sample output =  *in++ + fb1 * last + fb2 * prev;
+            if (check && PD_BIGORSMALL(output))
+                output = 0;
+            *out++ = ff1 * output + ff2 * last + ff3 * prev;
+            prev = last;
+            last = output;
+        }
+        if (PD_BIGORSMALL(last))
+            last = 0;
+        if (PD_BIGORSMALL(prev))
+            prev = 0;
+        c->c_x[2*ch] = last;
+        c->c_x[2*ch+1] = prev;
     }
-    c->c_x1 = last;
-    c->c_x2 = prev;
-    return (w+5);
+    return (w+6);
 }
 
-static void sigbiquad_list(t_sigbiquad *x, t_symbol *s, int argc, t_atom *argv)
+    /* the same in double precision; the coefficients, which came in as
+    floats, are the same */
+static t_int *sigbiquad_perform_double(t_int *w)
+{
+    t_sample *in = (t_sample *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    t_biquadctl *c = (t_biquadctl *)(w[3]);
+    int n = (int)w[4];
+    int nchans = (int)w[5];
+    int i, ch;
+    double fb1 = c->c_fb1;
+    double fb2 = c->c_fb2;
+    double ff1 = c->c_ff1;
+    double ff2 = c->c_ff2;
+    double ff3 = c->c_ff3;
+    for (ch = 0; ch < nchans; ch++)
+    {
+        double last = c->c_x[2*ch];
+        double prev = c->c_x[2*ch+1];
+        for (i = 0; i < n; i++)
+        {
+            double output =  *in++ + fb1 * last + fb2 * prev;
+            *out++ = ff1 * output + ff2 * last + ff3 * prev;
+            prev = last;
+            last = output;
+        }
+        if (filter_bigorsmall(last))
+            last = 0;
+        if (filter_bigorsmall(prev))
+            prev = 0;
+        c->c_x[2*ch] = last;
+        c->c_x[2*ch+1] = prev;
+    }
+    return (w+6);
+}
+
+    /* check that the poles of a biquad with feedback coefficients fb1
+    and fb2 are inside the unit circle */
+static int biquad_isstable(t_float fb1, t_float fb2)
 {
-    t_float fb1 = atom_getfloatarg(0, argc, argv);
-    t_float fb2 = atom_getfloatarg(1, argc, argv);
-    t_float ff1 = atom_getfloatarg(2, argc, argv);
-    t_float ff2 = atom_getfloatarg(3, argc, argv);
-    t_float ff3 = atom_getfloatarg(4, argc, argv);
     t_float discriminant = fb1 * fb1 + 4 * fb2;
-    t_biquadctl *c = x->x_ctl;
     if (discriminant < 0) /* imaginary roots -- resonant filter */
     {
             /* they're conjugates so we just check that the product
             is less than one */
-        if (fb2 >= -1.0f) goto stable;
+        return (fb2 >= -1.0f);
     }
     else    /* real roots */
     {
             /* check that the parabola 1 - fb1 x - fb2 x^2 has a
                 vertex between -1 and 1, and that it's nonnegative
                 at both ends, which implies both roots are in [1-,1]. */
-        if (fb1 <= 2.0f && fb1 >= -2.0f &&
-            1.0f - fb1 -fb2 >= 0 && 1.0f + fb1 - fb2 >= 0)
-                goto stable;
+        return (fb1 <= 2.0f && fb1 >= -2.0f &&
+            1.0f - fb1 -fb2 >= 0 && 1.0f + fb1 - fb2 >= 0);
     }
+}
+
+static void sigbiquad_list(t_sigbiquad *x, t_symbol *s, int argc, t_atom *argv)
+{
+    t_float fb1 = atom_getfloatarg(0, argc, argv);
+    t_float fb2 = atom_getfloatarg(1, argc, argv);
+    t_float ff1 = atom_getfloatarg(2, argc, argv);
+    t_float ff2 = atom_getfloatarg(3, argc, argv);
+    t_float ff3 = atom_getfloatarg(4, argc, argv);
+    t_biquadctl *c = x->x_ctl;
         /* if unstable, just bash to zero */
-    fb1 = fb2 = ff1 = ff2 = ff3 = 0;
-stable:
+    if (!biquad_isstable(fb1, fb2))
+        fb1 = fb2 = ff1 = ff2 = ff3 = 0;
     c->c_fb1 = fb1;
     c->c_fb2 = fb2;
     c->c_ff1 = ff1;
@@ -465,25 +732,40 @@ stable:
     c->c_ff3 = ff3;
 }
 
+    /* "set" (and "clear") set the state of every channel alike */
 static void sigbiquad_set(t_sigbiquad *x, t_symbol *s, int argc, t_atom *argv)
 {
     t_biquadctl *c = x->x_ctl;
-    c->c_x1 = atom_getfloatarg(0, argc, argv);
-    c->c_x2 = atom_getfloatarg(1, argc, argv);
+    int i;
+    for (i = 0; i < x->x_nalloc; i++)
+    {
+        c->c_x[2*i] = atom_getfloatarg(0, argc, argv);
+        c->c_x[2*i+1] = atom_getfloatarg(1, argc, argv);
+    }
 }
 
 static void sigbiquad_dsp(t_sigbiquad *x, t_signal **sp)
 {
-    dsp_add(sigbiquad_perform, 4,
+    int nchans = sp[0]->s_nchans;
+    x->x_cspace.c_x = filter_growstate(x->x_cspace.c_x, &x->x_nalloc,
+        nchans, 2);
+    signal_setmultiout(&sp[1], nchans);
+    dsp_add((ugen_getdouble() ? sigbiquad_perform_double :
+        sigbiquad_perform), 5,
         sp[0]->s_vec, sp[1]->s_vec,
-            x->x_ctl, sp[0]->s_n);
+            x->x_ctl, sp[0]->s_n, nchans);
 
 }
 
+static void sigbiquad_free(t_sigbiquad *x)
+{
+    freebytes(x->x_cspace.c_x, 2 * x->x_nalloc * sizeof(double));
+}
+
 void sigbiquad_setup(void)
 {
     sigbiquad_class = class_new(gensym("biquad~"), (t_newmethod)sigbiquad_new,
-        0, sizeof(t_sigbiquad), 0, A_GIMME, 0);
+        (t_method)sigbiquad_free, sizeof(t_sigbiquad), 0, A_GIMME, 0);
     CLASS_MAINSIGNALIN(sigbiquad_class, t_sigbiquad, x_f);
     class_addmethod(sigbiquad_class, (t_method)sigbiquad_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -494,6 +776,428 @@ void sigbiquad_setup(void)
         A_GIMME, 0);
 }
 
+/* ---------------- biquadbank~ - many biquads at once ----------------- */
+
+/* biquadbank~ runs a number of independent biquad filters, each with its
+own coefficients, taking the same form as biquad~'s.  Its input is either
+one signal, which goes to all of them (a filter bank), or a multichannel
+signal with a channel for each.  The output has a channel for each filter,
+or, with "-sum", is their sum.  With "-tdf2" the filters are computed in
+transposed direct form II, which keeps its state better in single precision
+when poles are near the unit circle.  Coefficient changes can be made to
+ramp over a time set by "smooth".  The filters are run four at a time in
+SIMD registers; the channels are swapped in and out of them four samples
+at a time. */
+
+#if PD_FLOATSIZE == 32 && (defined(__SSE__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#define BIQUADBANK_SSE
+#include <xmmintrin.h>
+#endif
+
+#define BQ_FB1 0
+#define BQ_FB2 1
+#define BQ_FF1 2
+#define BQ_FF2 3
+#define BQ_FF3 4
+#define BQ_NCOEF 5
+
+typedef struct biquadbank
+{
+    t_object x_obj;
+    t_float x_f;
+    int x_n;            /* number of filters */
+    int x_nalloc;       /* x_n rounded up to a multiple of 4 */
+    int x_sum;          /* output the sum, not a channel for each */
+    int x_tdf2;         /* transposed direct form II */
+    t_sample *x_coef;   /* BQ_NCOEF arrays of x_nalloc: current values */
+    t_sample *x_target; /* ... the values they're ramping to */
+    t_sample *x_inc;    /* ... and their per-sample increments */
+    t_sample *x_state;  /* 2 arrays of x_nalloc */
+    int *x_ramp;        /* samples left to ramp, for each filter */
+    t_float x_smoothms; /* ramp time in msec */
+    t_float x_sr;
+    int x_blocksize;
+    t_sample *x_scratch;    /* a block for unused lanes or a copy of input */
+    int x_scratchsize;
+} t_biquadbank;
+
+static t_class *biquadbank_class;
+
+static void *biquadbank_new(t_symbol *s, int argc, t_atom *argv)
+{
+    t_biquadbank *x = (t_biquadbank *)pd_new(biquadbank_class);
+    int n = 1;
+    while (argc && argv->a_type == A_SYMBOL &&
+        *argv->a_w.w_symbol->s_name == '-')
+    {
+        if (!strcmp(argv->a_w.w_symbol->s_name, "-sum"))
+            x->x_sum = 1;
+        else if (!strcmp(argv->a_w.w_symbol->s_name, "-tdf2"))
+            x->x_tdf2 = 1;
+        else pd_error(x, "biquadbank~: unknown flag %s",
+            argv->a_w.w_symbol->s_name);
+        argc--; argv++;
+    }
+    if (argc && (n = atom_getfloatarg(0, argc, argv)) < 1)
+        n = 1;
+    x->x_n = n;
+    x->x_nalloc = (n + 3) & ~3;
+    x->x_coef = (t_sample *)getbytes(3 * BQ_NCOEF * x->x_nalloc *
+        sizeof(t_sample));
+    x->x_target = x->x_coef + BQ_NCOEF * x->x_nalloc;
+    x->x_inc = x->x_target + BQ_NCOEF * x->x_nalloc;
+    x->x_state = (t_sample *)getbytes(2 * x->x_nalloc * sizeof(t_sample));
+    x->x_ramp = (int *)getbytes(x->x_nalloc * sizeof(int));
+    x->x_sr = 44100;
+    x->x_blocksize = 0;
+    x->x_scratch = 0;
+    x->x_scratchsize = 0;
+    outlet_new(&x->x_obj, &s_signal);
+    x->x_f = 0;
+    return (x);
+}
+
+    /* "coef k fb1 fb2 ff1 ff2 ff3 ..." sets filter k's coefficients, and
+    any more groups of five set those of the filters after it */
+static void biquadbank_coef(t_biquadbank *x, t_symbol *s, int argc,
+    t_atom *argv)
+{
+    int k = atom_getfloatarg(0, argc, argv), nalloc = x->x_nalloc, j, ramp;
+    if (k < 0)
+        k = 0;
+        /* ramp a whole number of blocks so we land on the target exactly */
+    if (x->x_blocksize && x->x_smoothms > 0)
+    {
+        ramp = x->x_smoothms * 0.001 * x->x_sr;
+        ramp = ((ramp + x->x_blocksize - 1) / x->x_blocksize) *
+            x->x_blocksize;
+    }
+    else ramp = 0;
+    for (argc--, argv++; argc >= BQ_NCOEF && k < x->x_n;
+        argc -= BQ_NCOEF, argv += BQ_NCOEF, k++)
+    {
+        t_float c[BQ_NCOEF];
+        for (j = 0; j < BQ_NCOEF; j++)
+            c[j] = atom_getfloatarg(j, argc, argv);
+        if (!biquad_isstable(c[BQ_FB1], c[BQ_FB2]))
+        {
+            pd_error(x, "biquadbank~: filter %d unstable", k);
+            for (j = 0; j < BQ_NCOEF; j++)
+                c[j] = 0;
+        }
+        for (j = 0; j < BQ_NCOEF; j++)
+        {
+            x->x_target[j * nalloc + k] = c[j];
+            if (!ramp)
+                x->x_coef[j * nalloc + k] = c[j];
+        }
+        x->x_ramp[k] = ramp;
+    }
+}
+
+static void biquadbank_smooth(t_biquadbank *x, t_floatarg f)
+{
+    x->x_smoothms = (f > 0 ? f : 0);
+}
+
+static void biquadbank_clear(t_biquadbank *x)
+{
+    memset(x->x_state, 0, 2 * x->x_nalloc * sizeof(t_sample));
+}
+
+    /* set up the coefficient increments for this block.  Return 0 if none
+    of the filters is ramping. */
+static int biquadbank_ramp(t_biquadbank *x, int n)
+{
+    int k, j, nalloc = x->x_nalloc, any = 0;
+    for (k = 0; k < x->x_n; k++)
+    {
+        if (x->x_ramp[k] > 0)
+        {
+            for (j = 0; j < BQ_NCOEF; j++)
+                x->x_inc[j * nalloc + k] = (x->x_target[j * nalloc + k] -
+                    x->x_coef[j * nalloc + k]) / x->x_ramp[k];
+            any = 1;
+        }
+        else for (j = 0; j < BQ_NCOEF; j++)
+            x->x_inc[j * nalloc + k] = 0;
+    }
+    return (any);
+}
+
+    /* after the block, step the ramps on and end any that are done */
+static void biquadbank_endramp(t_biquadbank *x, int n)
+{
+    int k, j, nalloc = x->x_nalloc;
+    for (k = 0; k < x->x_n; k++)
+        if (x->x_ramp[k] > 0 && (x->x_ramp[k] -= n) <= 0)
+    {
+        x->x_ramp[k] = 0;
+        for (j = 0; j < BQ_NCOEF; j++)
+            x->x_coef[j * nalloc + k] = x->x_target[j * nalloc + k];
+    }
+}
+
+    /* run filter k on n samples from "in", writing to "out" or, if "add"
+    is set, adding into it */
+static void biquadbank_one(t_biquadbank *x, int k, const t_sample *in,
+    t_sample *out, int n, int ramp, int add)
+{
+    int nalloc = x->x_nalloc, i;
+    t_sample *c = x->x_coef + k, *inc = x->x_inc + k;
+    t_sample fb1 = c[BQ_FB1 * nalloc], fb2 = c[BQ_FB2 * nalloc],
+        ff1 = c[BQ_FF1 * nalloc], ff2 = c[BQ_FF2 * nalloc],
+        ff3 = c[BQ_FF3 * nalloc];
+    t_sample s1 = x->x_state[k], s2 = x->x_state[nalloc + k];
+    int check = filter_mustcheck();
+    for (i = 0; i < n; i++)
+    {
+        t_sample f = in[i], y;
+        if (x->x_tdf2)
+        {
+            y = ff1 * f + s1;
+            s1 = ff2 * f + fb1 * y + s2;
+            s2 = ff3 * f + fb2 * y;
+        }
+        else
+        {
+            t_sample w = f + fb1 * s1 + fb2 * s2;
+            if (check && PD_BIGORSMALL(w))
+                w = 0;
+            y = ff1 * w + ff2 * s1 + ff3 * s2;
+            s2 = s1;
+            s1 = w;
+        }
+        if (add)
+            out[i] += y;
+        else out[i] = y;
+        if (ramp)
+        {
+            fb1 += inc[BQ_FB1 * nalloc]; fb2 += inc[BQ_FB2 * nalloc];
+            ff1 += inc[BQ_FF1 * nalloc]; ff2 += inc[BQ_FF2 * nalloc];
+            ff3 += inc[BQ_FF3 * nalloc];
+        }
+    }
+    if (PD_BIGORSMALL(s1))
+        s1 = 0;
+    if (PD_BIGORSMALL(s2))
+        s2 = 0;
+    x->x_state[k] = s1;
+    x->x_state[nalloc + k] = s2;
+    if (ramp)
+    {
+        c[BQ_FB1 * nalloc] = fb1; c[BQ_FB2 * nalloc] = fb2;
+        c[BQ_FF1 * nalloc] = ff1; c[BQ_FF2 * nalloc] = ff2;
+        c[BQ_FF3 * nalloc] = ff3;
+    }
+}
+
+#ifdef BIQUADBANK_SSE
+    /* run filters k to k+3, each on four samples from "in" (whose rows are
+    the filters' inputs, or are all the same one) and "ramp" says whether
+    to step the coefficients.  "tdf2" and "ramp" should be constants so that
+    the compiler makes a version for each. */
+static inline void biquadbank_sse4(__m128 *c, const __m128 *inc,
+    __m128 *s1p, __m128 *s2p, __m128 *in, int tdf2, int ramp)
+{
+    __m128 s1 = *s1p, s2 = *s2p;
+    int i;
+    for (i = 0; i < 4; i++)
+    {
+        __m128 f = in[i], y;
+        if (tdf2)
+        {
+            y = _mm_add_ps(_mm_mul_ps(c[BQ_FF1], f), s1);
+            s1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c[BQ_FF2], f),
+                _mm_mul_ps(c[BQ_FB1], y)), s2);
+            s2 = _mm_add_ps(_mm_mul_ps(c[BQ_FF3], f),
+                _mm_mul_ps(c[BQ_FB2], y));
+        }
+        else
+        {
+            __m128 w = _mm_add_ps(_mm_add_ps(f, _mm_mul_ps(c[BQ_FB1], s1)),
+                _mm_mul_ps(c[BQ_FB2], s2));
+            y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c[BQ_FF1], w),
+                _mm_mul_ps(c[BQ_FF2], s1)), _mm_mul_ps(c[BQ_FF3], s2));
+            s2 = s1;
+            s1 = w;
+        }
+        in[i] = y;
+        if (ramp)
+        {
+            c[0] = _mm_add_ps(c[0], inc[0]); c[1] = _mm_add_ps(c[1], inc[1]);
+            c[2] = _mm_add_ps(c[2], inc[2]); c[3] = _mm_add_ps(c[3], inc[3]);
+            c[4] = _mm_add_ps(c[4], inc[4]);
+        }
+    }
+    *s1p = s1;
+    *s2p = s2;
+}
+
+    /* run four filters from k on, over the whole block.  "ip" and "op" are
+    the four input and output channels (or ip[0] for all, if "one"). */
+static inline void biquadbank_group(t_biquadbank *x, int k,
+    const t_sample **ip, t_sample **op, int n, int one, int tdf2, int ramp)
+{
+    int nalloc = x->x_nalloc, i, j;
+    __m128 c[BQ_NCOEF], inc[BQ_NCOEF], s1, s2, v[4];
+    for (j = 0; j < BQ_NCOEF; j++)
+    {
+        c[j] = _mm_loadu_ps(x->x_coef + j * nalloc + k);
+        inc[j] = _mm_loadu_ps(x->x_inc + j * nalloc + k);
+    }
+    s1 = _mm_loadu_ps(x->x_state + k);
+    s2 = _mm_loadu_ps(x->x_state + nalloc + k);
+    for (i = 0; i < n; i += 4)
+    {
+        if (one)
+        {
+            v[0] = _mm_set1_ps(ip[0][i]); v[1] = _mm_set1_ps(ip[0][i+1]);
+            v[2] = _mm_set1_ps(ip[0][i+2]); v[3] = _mm_set1_ps(ip[0][i+3]);
+        }
+        else
+        {
+            v[0] = _mm_loadu_ps(ip[0] + i); v[1] = _mm_loadu_ps(ip[1] + i);
+            v[2] = _mm_loadu_ps(ip[2] + i); v[3] = _mm_loadu_ps(ip[3] + i);
+            _MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+        }
+        biquadbank_sse4(c, inc, &s1, &s2, v, tdf2, ramp);
+        _MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+        if (x->x_sum)
+        {
+            __m128 sum = _mm_add_ps(_mm_add_ps(v[0], v[1]),
+                _mm_add_ps(v[2], v[3]));
+            _mm_storeu_ps(op[0] + i, _mm_add_ps(_mm_loadu_ps(op[0] + i), sum));
+        }
+        else
+        {
+            _mm_storeu_ps(op[0] + i, v[0]); _mm_storeu_ps(op[1] + i, v[1]);
+            _mm_storeu_ps(op[2] + i, v[2]); _mm_storeu_ps(op[3] + i, v[3]);
+        }
+    }
+    if (ramp)
+        for (j = 0; j < BQ_NCOEF; j++)
+            _mm_storeu_ps(x->x_coef + j * nalloc + k, c[j]);
+    _mm_storeu_ps(x->x_state + k, s1);
+    _mm_storeu_ps(x->x_state + nalloc + k, s2);
+    for (j = k; j < k + 4; j++)
+    {
+        if (PD_BIGORSMALL(x->x_state[j]))
+            x->x_state[j] = 0;
+        if (PD_BIGORSMALL(x->x_state[nalloc + j]))
+            x->x_state[nalloc + j] = 0;
+    }
+}
+#endif /* BIQUADBANK_SSE */
+
+static t_int *biquadbank_perform(t_int *w)
+{
+    t_biquadbank *x = (t_biquadbank *)(w[1]);
+    t_sample *in = (t_sample *)(w[2]);
+    t_sample *out = (t_sample *)(w[3]);
+    int n = (int)(w[4]);
+    int one = ((int)(w[5]) == 1);
+    int ramp = biquadbank_ramp(x, n), k;
+        /* the sum may be written over a one-channel input before the
+        last filters have read it */
+    if (x->x_sum && one && in == out)
+    {
+        memcpy(x->x_scratch, in, n * sizeof(t_sample));
+        in = x->x_scratch;
+    }
+    if (x->x_sum)
+        memset(out, 0, n * sizeof(t_sample));
+#ifdef BIQUADBANK_SSE
+    if (!(n & 3))
+    {
+        for (k = 0; k < x->x_nalloc; k += 4)
+        {
+            const t_sample *ip[4];
+            t_sample *op[4];
+            int j;
+            for (j = 0; j < 4; j++)
+            {
+                    /* the lanes past the last filter have zero coefficients;
+                    they read any input and write to the scratch block */
+                int kj = (k + j < x->x_n ? k + j : 0);
+                ip[j] = (one ? in : in + kj * n);
+                op[j] = (x->x_sum ? out : (k + j < x->x_n ?
+                    out + kj * n : x->x_scratch));
+            }
+            if (x->x_tdf2)
+            {
+                if (ramp)
+                    biquadbank_group(x, k, ip, op, n, one, 1, 1);
+                else biquadbank_group(x, k, ip, op, n, one, 1, 0);
+            }
+            else
+            {
+                if (ramp)
+                    biquadbank_group(x, k, ip, op, n, one, 0, 1);
+                else biquadbank_group(x, k, ip, op, n, one, 0, 0);
+            }
+        }
+        biquadbank_endramp(x, n);
+        return (w+6);
+    }
+#endif
+    for (k = 0; k < x->x_n; k++)
+        biquadbank_one(x, k, (one ? in : in + k * n),
+            (x->x_sum ? out : out + k * n), n, ramp, x->x_sum);
+    biquadbank_endramp(x, n);
+    return (w+6);
+}
+
+static void biquadbank_dsp(t_biquadbank *x, t_signal **sp)
+{
+    int n = sp[0]->s_n, nchans = sp[0]->s_nchans;
+    x->x_sr = sp[0]->s_sr;
+    x->x_blocksize = n;
+    if (n > x->x_scratchsize)
+    {
+        x->x_scratch = (t_sample *)resizebytes(x->x_scratch,
+            x->x_scratchsize * sizeof(t_sample), n * sizeof(t_sample));
+        x->x_scratchsize = n;
+    }
+    if (!x->x_sum)
+        signal_setmultiout(&sp[1], x->x_n);
+    if (nchans != 1 && nchans != x->x_n)
+    {
+        pd_error(x, "biquadbank~: %d input channels for %d filters",
+            nchans, x->x_n);
+        dsp_add_zero(sp[1]->s_vec, n * sp[1]->s_nchans);
+        return;
+    }
+    dsp_add(biquadbank_perform, 5, x, sp[0]->s_vec, sp[1]->s_vec,
+        n, nchans);
+}
+
+static void biquadbank_free(t_biquadbank *x)
+{
+    freebytes(x->x_coef, 3 * BQ_NCOEF * x->x_nalloc * sizeof(t_sample));
+    freebytes(x->x_state, 2 * x->x_nalloc * sizeof(t_sample));
+    freebytes(x->x_ramp, x->x_nalloc * sizeof(int));
+    if (x->x_scratch)
+        freebytes(x->x_scratch, x->x_scratchsize * sizeof(t_sample));
+}
+
+void biquadbank_setup(void)
+{
+    biquadbank_class = class_new(gensym("biquadbank~"),
+        (t_newmethod)biquadbank_new, (t_method)biquadbank_free,
+            sizeof(t_biquadbank), 0, A_GIMME, 0);
+    CLASS_MAINSIGNALIN(biquadbank_class, t_biquadbank, x_f);
+    class_addmethod(biquadbank_class, (t_method)biquadbank_dsp,
+        gensym("dsp"), A_CANT, 0);
+    class_addmethod(biquadbank_class, (t_method)biquadbank_coef,
+        gensym("coef"), A_GIMME, 0);
+    class_addmethod(biquadbank_class, (t_method)biquadbank_smooth,
+        gensym("smooth"), A_FLOAT, 0);
+    class_addmethod(biquadbank_class, (t_method)biquadbank_clear,
+        gensym("clear"), 0);
+}
+
 /* ---------------- samphold~ - sample and hold  ----------------- */
 
 typedef struct sigsamphold
@@ -1171,6 +1875,549 @@ void slop_tilde_setup(void)
         A_FLOAT, 0);
 }
 
+/* ------------- limiter~, compressor~ - lookahead dynamics ------------- */
+
+/* Both objects take a signal (any number of channels, which are all given
+the same gain), delay it by a lookahead time, and multiply it by a gain
+signal that is computed from the undelayed input and also goes out the
+right outlet.  limiter~ is a brickwall limiter: the gain each input sample
+needs to stay at the ceiling is held at its minimum over the lookahead
+window and then averaged over another window of the same length, so that
+it fades in smoothly but has got all the way down by the time the sample
+comes out.  It then recovers at a rate set by "release".  compressor~
+holds the input's peak level over the lookahead window, follows it with
+attack and release times, and reduces whatever is above a threshold by a
+ratio.  The running minimum or maximum is taken with a monotonic queue,
+which costs the same at any lookahead.  Levels are in dB, 100 being unity
+gain as for env~; times are in milliseconds. */
+
+#if PD_FLOATSIZE == 32 && (defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define DYNAMICS_SSE
+#include <emmintrin.h>
+#endif
+
+typedef struct _dynamics
+{
+    t_sample *d_ring;       /* delay line (d_window samples per channel) */
+    t_sample *d_work;       /* one block of peak level, then of gain */
+    t_sample *d_qval;       /* monotonic queue: values, increasing */
+    unsigned int *d_qtime;  /* ... and the times they came in */
+    int d_qhead;
+    int d_qcount;
+    unsigned int d_time;    /* counts input samples */
+    int d_window;           /* window length; the delay is one less */
+    int d_nchans;
+    int d_blocksize;
+    int d_wherewrite;       /* write position in the delay line */
+    t_float d_sr;
+    t_float d_lookahead;    /* in msec */
+} t_dynamics;
+
+static void dynamics_init(t_dynamics *d, t_float lookahead)
+{
+    d->d_ring = d->d_work = d->d_qval = 0;
+    d->d_qtime = 0;
+    d->d_window = d->d_nchans = d->d_blocksize = 0;
+    d->d_sr = sys_getsr();
+    d->d_lookahead = (lookahead > 0 ? lookahead : 0);
+}
+
+static void dynamics_free(t_dynamics *d)
+{
+    if (d->d_ring)
+    {
+        freebytes(d->d_ring, d->d_window * d->d_nchans * sizeof(t_sample));
+        freebytes(d->d_work, d->d_blocksize * sizeof(t_sample));
+        freebytes(d->d_qval, d->d_window * sizeof(t_sample));
+        freebytes(d->d_qtime, d->d_window * sizeof(unsigned int));
+        d->d_ring = 0;
+    }
+}
+
+    /* empty the delay line and the queue */
+static void dynamics_clear(t_dynamics *d)
+{
+    if (d->d_ring)
+        memset(d->d_ring, 0, d->d_window * d->d_nchans * sizeof(t_sample));
+    d->d_qhead = d->d_qcount = 0;
+    d->d_time = 0;
+    d->d_wherewrite = 0;
+}
+
+    /* (re)allocate for the current lookahead, channel count and block size;
+    return 1 if the window changed, which clears the state */
+static int dynamics_resize(t_dynamics *d, int nchans, int blocksize)
+{
+    int window = d->d_lookahead * 0.001 * d->d_sr + 0.5;
+    if (window < 0)
+        window = 0;
+    window += 1;
+    if (d->d_ring && window == d->d_window && nchans == d->d_nchans &&
+        blocksize == d->d_blocksize)
+            return (0);
+    dynamics_free(d);
+    d->d_window = window;
+    d->d_nchans = nchans;
+    d->d_blocksize = blocksize;
+    d->d_ring = (t_sample *)getbytes(window * nchans * sizeof(t_sample));
+    d->d_work = (t_sample *)getbytes(blocksize * sizeof(t_sample));
+    d->d_qval = (t_sample *)getbytes(window * sizeof(t_sample));
+    d->d_qtime = (unsigned int *)getbytes(window * sizeof(unsigned int));
+    dynamics_clear(d);
+    return (1);
+}
+
+    /* put the loudest of the channels' absolute values, sample by sample,
+    into d_work */
+static void dynamics_peak(t_dynamics *d, t_sample *in, int n)
+{
+    t_sample *work = d->d_work;
+    int ch, i;
+    for (ch = 0; ch < d->d_nchans; ch++, in += n)
+    {
+        i = 0;
+#ifdef DYNAMICS_SSE
+        {
+            __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+            for (; i + 4 <= n; i += 4)
+            {
+                __m128 v = _mm_and_ps(_mm_loadu_ps(in + i), mask);
+                _mm_storeu_ps(work + i,
+                    (ch ? _mm_max_ps(v, _mm_loadu_ps(work + i)) : v));
+            }
+        }
+#endif
+        for (; i < n; i++)
+        {
+            t_sample f = (in[i] >= 0 ? in[i] : -in[i]);
+            work[i] = (ch && work[i] > f ? work[i] : f);
+        }
+    }
+}
+
+    /* take in one value and return the least of the last d_window ones */
+static t_sample dynamics_runmin(t_dynamics *d, t_sample f)
+{
+    int window = d->d_window, tail;
+    unsigned int now = d->d_time++;
+    t_sample *val = d->d_qval;
+        /* drop the oldest if it's now outside the window */
+    if (d->d_qcount && now - d->d_qtime[d->d_qhead] >= (unsigned int)window)
+    {
+        if (++d->d_qhead == window)
+            d->d_qhead = 0;
+        d->d_qcount--;
+    }
+        /* drop from the back whatever the new value makes irrelevant */
+    while (d->d_qcount)
+    {
+        tail = d->d_qhead + d->d_qcount - 1;
+        if (tail >= window)
+            tail -= window;
+        if (val[tail] < f)
+            break;
+        d->d_qcount--;
+    }
+    tail = d->d_qhead + d->d_qcount;
+    if (tail >= window)
+        tail -= window;
+    val[tail] = f;
+    d->d_qtime[tail] = now;
+    d->d_qcount++;
+    return (val[d->d_qhead]);
+}
+
+    /* delay each channel by d_window - 1 samples and multiply it by the
+    gain in d_work.  The input may be the same memory as the output. */
+static void dynamics_apply(t_dynamics *d, t_sample *in, t_sample *out, int n)
+{
+    t_sample *gain = d->d_work;
+    int window = d->d_window, ch, i, wherewrite = d->d_wherewrite;
+    for (ch = 0; ch < d->d_nchans; ch++, in += n, out += n)
+    {
+        t_sample *ring = d->d_ring + ch * window;
+        int wp = wherewrite, rp = (wp + 1 < window ? wp + 1 : 0);
+        if (window == 1)
+        {
+            for (i = 0; i < n; i++)
+                out[i] = in[i] * gain[i];
+            continue;
+        }
+        for (i = 0; i < n; )
+        {
+                /* a stretch in which neither pointer wraps around.  Each
+                sample reads the place the next one writes, so read
+                first. */
+            int k, run = n - i;
+            if (run > window - wp)
+                run = window - wp;
+            if (run > window - rp)
+                run = window - rp;
+            k = 0;
+#ifdef DYNAMICS_SSE
+            for (; k + 4 <= run; k += 4)
+            {
+                __m128 old = _mm_loadu_ps(ring + rp + k);
+                _mm_storeu_ps(ring + wp + k, _mm_loadu_ps(in + i + k));
+                _mm_storeu_ps(out + i + k,
+                    _mm_mul_ps(old, _mm_loadu_ps(gain + i + k)));
+            }
+#endif
+            for (; k < run; k++)
+            {
+                t_sample old = ring[rp + k];
+                ring[wp + k] = in[i + k];
+                out[i + k] = old * gain[i + k];
+            }
+            i += run;
+            if ((wp += run) == window)
+                wp = 0;
+            if ((rp += run) == window)
+                rp = 0;
+        }
+    }
+    wherewrite += n % window;
+    if (wherewrite >= window)
+        wherewrite -= window;
+    d->d_wherewrite = wherewrite;
+}
+
+static t_float dynamics_dbtorms(t_float db)
+{
+    if (db <= 0)
+        return (0);
+    return (exp((db - 100) * (2.302585092994046 / 20)));
+}
+
+static t_float dynamics_mstocoef(t_float ms, t_float sr)
+{
+    t_float nsamps = ms * 0.001 * sr;
+    return (nsamps < 1 ? 1 : 1 - exp(-1 / nsamps));
+}
+
+    /* ---------------------------- limiter~ ---------------------------- */
+
+static t_class *limiter_tilde_class;
+
+typedef struct _limiter_tilde
+{
+    t_object x_obj;
+    t_float x_f;
+    t_dynamics x_dyn;
+    t_float x_ceilingdb;
+    t_sample x_ceiling;
+    t_float x_releasems;
+    t_sample x_release;     /* one-pole coefficient for recovery */
+    t_sample x_gain;        /* gain applied to the last sample */
+    t_sample *x_avg;        /* held gain for the averaging window */
+    int x_avgsize;
+    int x_avgphase;
+    double x_avgsum;
+} t_limiter_tilde;
+
+static void limiter_tilde_reset(t_limiter_tilde *x)
+{
+    int i;
+    for (i = 0; i < x->x_avgsize; i++)
+        x->x_avg[i] = 1;
+    x->x_avgsum = x->x_avgsize;
+    x->x_avgphase = 0;
+    x->x_gain = 1;
+}
+
+static void limiter_tilde_realloc(t_limiter_tilde *x, int nchans,
+    int blocksize)
+{
+    if (dynamics_resize(&x->x_dyn, nchans, blocksize))
+    {
+        x->x_avg = (t_sample *)resizebytes(x->x_avg,
+            x->x_avgsize * sizeof(t_sample),
+                x->x_dyn.d_window * sizeof(t_sample));
+        x->x_avgsize = x->x_dyn.d_window;
+        limiter_tilde_reset(x);
+    }
+}
+
+static void limiter_tilde_ceiling(t_limiter_tilde *x, t_floatarg f)
+{
+    x->x_ceilingdb = f;
+    x->x_ceiling = dynamics_dbtorms(f);
+}
+
+static void limiter_tilde_release(t_limiter_tilde *x, t_floatarg f)
+{
+    x->x_releasems = (f > 0 ? f : 0);
+    x->x_release = dynamics_mstocoef(x->x_releasems, x->x_dyn.d_sr);
+}
+
+static void limiter_tilde_lookahead(t_limiter_tilde *x, t_floatarg f)
+{
+    x->x_dyn.d_lookahead = (f > 0 ? f : 0);
+    if (x->x_dyn.d_ring)
+        limiter_tilde_realloc(x, x->x_dyn.d_nchans, x->x_dyn.d_blocksize);
+}
+
+static void limiter_tilde_clear(t_limiter_tilde *x)
+{
+    dynamics_clear(&x->x_dyn);
+    limiter_tilde_reset(x);
+}
+
+static void *limiter_tilde_new(t_floatarg ceiling, t_floatarg lookahead,
+    t_floatarg release)
+{
+    t_limiter_tilde *x = (t_limiter_tilde *)pd_new(limiter_tilde_class);
+    dynamics_init(&x->x_dyn, (lookahead > 0 ? lookahead : 5));
+    limiter_tilde_ceiling(x, (ceiling > 0 ? ceiling : 100));
+    limiter_tilde_release(x, (release > 0 ? release : 50));
+    x->x_avg = 0;
+    x->x_avgsize = 0;
+    limiter_tilde_reset(x);
+    outlet_new(&x->x_obj, &s_signal);
+    outlet_new(&x->x_obj, &s_signal);
+    x->x_f = 0;
+    return (x);
+}
+
+static t_int *limiter_tilde_perform(t_int *w)
+{
+    t_limiter_tilde *x = (t_limiter_tilde *)(w[1]);
+    t_sample *in = (t_sample *)(w[2]);
+    t_sample *out = (t_sample *)(w[3]);
+    t_sample *gainout = (t_sample *)(w[4]);
+    int n = (int)(w[5]), i;
+    t_dynamics *d = &x->x_dyn;
+    t_sample *work = d->d_work, ceiling = x->x_ceiling,
+        release = x->x_release, gain = x->x_gain, *avg = x->x_avg;
+    int avgsize = x->x_avgsize, avgphase = x->x_avgphase;
+    double avgsum = x->x_avgsum, avgnorm = 1. / avgsize;
+
+    dynamics_peak(d, in, n);
+        /* the gain each sample needs by itself */
+    for (i = 0; i < n; i++)
+        work[i] = (work[i] > ceiling ? ceiling / work[i] : 1);
+    for (i = 0; i < n; i++)
+    {
+            /* "held" is no more than the gain needed by any sample still
+            in the delay line, including the one going out now, so the
+            average over the last window of it is no more than what that
+            one needs either. */
+        t_sample held = dynamics_runmin(d, work[i]), target;
+        avgsum += held - avg[avgphase];
+        avg[avgphase] = held;
+        if (++avgphase == avgsize)
+            avgphase = 0;
+        target = avgsum * avgnorm;
+        if (target < gain)
+            gain = target;
+        else gain += release * (target - gain);
+        if (gain > held)
+            gain = held;
+        work[i] = gain;
+    }
+    if (PD_BIGORSMALL(gain))
+        gain = 0;
+    x->x_gain = gain;
+    x->x_avgphase = avgphase;
+    x->x_avgsum = avgsum;
+    dynamics_apply(d, in, out, n);
+    memcpy(gainout, work, n * sizeof(t_sample));
+    return (w+6);
+}
+
+static void limiter_tilde_dsp(t_limiter_tilde *x, t_signal **sp)
+{
+    int nchans = sp[0]->s_nchans;
+    if (sp[0]->s_sr != x->x_dyn.d_sr)
+    {
+        x->x_dyn.d_sr = sp[0]->s_sr;
+        limiter_tilde_release(x, x->x_releasems);
+        dynamics_free(&x->x_dyn);
+    }
+    limiter_tilde_realloc(x, nchans, sp[0]->s_n);
+    signal_setmultiout(&sp[1], nchans);
+    signal_setmultiout(&sp[2], 1);
+    dsp_add(limiter_tilde_perform, 5, x, sp[0]->s_vec, sp[1]->s_vec,
+        sp[2]->s_vec, sp[0]->s_n);
+}
+
+static void limiter_tilde_free(t_limiter_tilde *x)
+{
+    dynamics_free(&x->x_dyn);
+    if (x->x_avg)
+        freebytes(x->x_avg, x->x_avgsize * sizeof(t_sample));
+}
+
+static void limiter_tilde_setup(void)
+{
+    limiter_tilde_class = class_new(gensym("limiter~"),
+        (t_newmethod)limiter_tilde_new, (t_method)limiter_tilde_free,
+        sizeof(t_limiter_tilde), 0, A_DEFFLOAT, A_DEFFLOAT, A_DEFFLOAT, 0);
+    CLASS_MAINSIGNALIN(limiter_tilde_class, t_limiter_tilde, x_f);
+    class_addmethod(limiter_tilde_class, (t_method)limiter_tilde_dsp,
+        gensym("dsp"), A_CANT, 0);
+    class_addmethod(limiter_tilde_class, (t_method)limiter_tilde_ceiling,
+        gensym("ceiling"), A_FLOAT, 0);
+    class_addmethod(limiter_tilde_class, (t_method)limiter_tilde_lookahead,
+        gensym("lookahead"), A_FLOAT, 0);
+    class_addmethod(limiter_tilde_class, (t_method)limiter_tilde_release,
+        gensym("release"), A_FLOAT, 0);
+    class_addmethod(limiter_tilde_class, (t_method)limiter_tilde_clear,
+        gensym("clear"), 0);
+}
+
+    /* --------------------------- compressor~ --------------------------- */
+
+static t_class *compressor_tilde_class;
+
+typedef struct _compressor_tilde
+{
+    t_object x_obj;
+    t_float x_f;
+    t_dynamics x_dyn;
+    t_float x_thresholddb;
+    t_sample x_threshold;
+    t_float x_ratio;
+    t_float x_attackms;
+    t_float x_releasems;
+    t_sample x_attack;      /* one-pole coefficients for the level */
+    t_sample x_release;
+    t_sample x_level;       /* smoothed peak level */
+} t_compressor_tilde;
+
+static void compressor_tilde_threshold(t_compressor_tilde *x, t_floatarg f)
+{
+    x->x_thresholddb = f;
+    x->x_threshold = dynamics_dbtorms(f);
+    if (x->x_threshold < 1e-10)
+        x->x_threshold = 1e-10;
+}
+
+static void compressor_tilde_ratio(t_compressor_tilde *x, t_floatarg f)
+{
+    x->x_ratio = (f > 1 ? f : 1);
+}
+
+static void compressor_tilde_attack(t_compressor_tilde *x, t_floatarg f)
+{
+    x->x_attackms = (f > 0 ? f : 0);
+    x->x_attack = dynamics_mstocoef(x->x_attackms, x->x_dyn.d_sr);
+}
+
+static void compressor_tilde_release(t_compressor_tilde *x, t_floatarg f)
+{
+    x->x_releasems = (f > 0 ? f : 0);
+    x->x_release = dynamics_mstocoef(x->x_releasems, x->x_dyn.d_sr);
+}
+
+static void compressor_tilde_lookahead(t_compressor_tilde *x, t_floatarg f)
+{
+    x->x_dyn.d_lookahead = (f > 0 ? f : 0);
+    if (x->x_dyn.d_ring)
+        dynamics_resize(&x->x_dyn, x->x_dyn.d_nchans, x->x_dyn.d_blocksize);
+}
+
+static void compressor_tilde_clear(t_compressor_tilde *x)
+{
+    dynamics_clear(&x->x_dyn);
+    x->x_level = 0;
+}
+
+static void *compressor_tilde_new(t_symbol *s, int argc, t_atom *argv)
+{
+    t_compressor_tilde *x =
+        (t_compressor_tilde *)pd_new(compressor_tilde_class);
+    t_float threshold = atom_getfloatarg(0, argc, argv),
+        ratio = atom_getfloatarg(1, argc, argv),
+        attack = atom_getfloatarg(2, argc, argv),
+        release = atom_getfloatarg(3, argc, argv),
+        lookahead = atom_getfloatarg(4, argc, argv);
+    dynamics_init(&x->x_dyn, lookahead);
+    compressor_tilde_threshold(x, (threshold > 0 ? threshold : 90));
+    compressor_tilde_ratio(x, (ratio > 0 ? ratio : 4));
+    compressor_tilde_attack(x, (argc > 2 ? attack : 5));
+    compressor_tilde_release(x, (release > 0 ? release : 50));
+    x->x_level = 0;
+    outlet_new(&x->x_obj, &s_signal);
+    outlet_new(&x->x_obj, &s_signal);
+    x->x_f = 0;
+    return (x);
+}
+
+static t_int *compressor_tilde_perform(t_int *w)
+{
+    t_compressor_tilde *x = (t_compressor_tilde *)(w[1]);
+    t_sample *in = (t_sample *)(w[2]);
+    t_sample *out = (t_sample *)(w[3]);
+    t_sample *gainout = (t_sample *)(w[4]);
+    int n = (int)(w[5]), i;
+    t_dynamics *d = &x->x_dyn;
+    t_sample *work = d->d_work, threshold = x->x_threshold,
+        attack = x->x_attack, release = x->x_release, level = x->x_level;
+    double slope = 1. / x->x_ratio - 1, invthresh = 1. / threshold;
+
+    dynamics_peak(d, in, n);
+    for (i = 0; i < n; i++)
+    {
+            /* the queue keeps the minimum, so give it negated levels */
+        t_sample peak = -dynamics_runmin(d, -work[i]);
+        level += (peak > level ? attack : release) * (peak - level);
+        work[i] = (level > threshold ?
+            exp(slope * log(level * invthresh)) : 1);
+    }
+    if (PD_BIGORSMALL(level))
+        level = 0;
+    x->x_level = level;
+    dynamics_apply(d, in, out, n);
+    memcpy(gainout, work, n * sizeof(t_sample));
+    return (w+6);
+}
+
+static void compressor_tilde_dsp(t_compressor_tilde *x, t_signal **sp)
+{
+    int nchans = sp[0]->s_nchans;
+    if (sp[0]->s_sr != x->x_dyn.d_sr)
+    {
+        x->x_dyn.d_sr = sp[0]->s_sr;
+        compressor_tilde_attack(x, x->x_attackms);
+        compressor_tilde_release(x, x->x_releasems);
+        dynamics_free(&x->x_dyn);
+    }
+    dynamics_resize(&x->x_dyn, nchans, sp[0]->s_n);
+    signal_setmultiout(&sp[1], nchans);
+    signal_setmultiout(&sp[2], 1);
+    dsp_add(compressor_tilde_perform, 5, x, sp[0]->s_vec, sp[1]->s_vec,
+        sp[2]->s_vec, sp[0]->s_n);
+}
+
+static void compressor_tilde_free(t_compressor_tilde *x)
+{
+    dynamics_free(&x->x_dyn);
+}
+
+static void compressor_tilde_setup(void)
+{
+    compressor_tilde_class = class_new(gensym("compressor~"),
+        (t_newmethod)compressor_tilde_new, (t_method)compressor_tilde_free,
+        sizeof(t_compressor_tilde), 0, A_GIMME, 0);
+    CLASS_MAINSIGNALIN(compressor_tilde_class, t_compressor_tilde, x_f);
+    class_addmethod(compressor_tilde_class, (t_method)compressor_tilde_dsp,
+        gensym("dsp"), A_CANT, 0);
+    class_addmethod(compressor_tilde_class,
+        (t_method)compressor_tilde_threshold, gensym("threshold"), A_FLOAT, 0);
+    class_addmethod(compressor_tilde_class, (t_method)compressor_tilde_ratio,
+        gensym("ratio"), A_FLOAT, 0);
+    class_addmethod(compressor_tilde_class, (t_method)compressor_tilde_attack,
+        gensym("attack"), A_FLOAT, 0);
+    class_addmethod(compressor_tilde_class,
+        (t_method)compressor_tilde_release, gensym("release"), A_FLOAT, 0);
+    class_addmethod(compressor_tilde_class,
+        (t_method)compressor_tilde_lookahead, gensym("lookahead"), A_FLOAT, 0);
+    class_addmethod(compressor_tilde_class, (t_method)compressor_tilde_clear,
+        gensym("clear"), 0);
+}
+
 
 /* ------------------------ setup routine ------------------------- */
 
@@ -1180,6 +2427,7 @@ void d_filter_setup(void)
     siglop_setup();
     sigbp_setup();
     sigbiquad_setup();
+    biquadbank_setup();
     sigsamphold_setup();
     sigrpole_setup();
     sigrzero_setup();
@@ -1188,4 +2436,6 @@ void d_filter_setup(void)
     sigczero_setup();
     sigczero_rev_setup();
     slop_tilde_setup();
+    limiter_tilde_setup();
+    compressor_tilde_setup();
 }
@@ -9,6 +9,11 @@
 
 #define DEFSENDVS 64    /* LATER get send to get this from canvas */
 
+extern int ugen_getcontextno(void);
+void signal_setborrowed(t_signal *sig, t_signal *sig2);
+t_signal *signal_newfromcontext(int borrowed);
+void signal_makereusable(t_signal *sig);
+
 /* ----------------------------- send~ ----------------------------- */
 static t_class *sigsend_class;
 
@@ -19,6 +24,7 @@ typedef struct _sigsend
     int x_n;
     t_sample *x_vec;
     t_float x_f;
+    int x_contextno;    /* DSP context we were last scheduled in */
 } t_sigsend;
 
 static void *sigsend_new(t_symbol *s)
@@ -30,6 +36,7 @@ static void *sigsend_new(t_symbol *s)
     x->x_vec = (t_sample *)getbytes(DEFSENDVS * sizeof(t_sample));
     memset((char *)(x->x_vec), 0, DEFSENDVS * sizeof(t_sample));
     x->x_f = 0;
+    x->x_contextno = 0;
     return (x);
 }
 
@@ -49,6 +56,7 @@ static t_int *sigsend_perform(t_int *w)
 
 static void sigsend_dsp(t_sigsend *x, t_signal **sp)
 {
+    x->x_contextno = ugen_getcontextno();
     if (x->x_n == sp[0]->s_n)
         dsp_add(sigsend_perform, 3, sp[0]->s_vec, x->x_vec, sp[0]->s_n);
     else error("sigsend %s: unexpected vector size", x->x_sym->s_name);
@@ -64,6 +72,7 @@ static void sigsend_setup(void)
 {
     sigsend_class = class_new(gensym("send~"), (t_newmethod)sigsend_new,
         (t_method)sigsend_free, sizeof(t_sigsend), 0, A_DEFSYM, 0);
+    class_setdspflags(sigsend_class, CLASS_NOPARALLEL | CLASS_DSPSHARED);
     class_addcreator((t_newmethod)sigsend_new, gensym("s~"), A_DEFSYM, 0);
     CLASS_MAINSIGNALIN(sigsend_class, t_sigsend, x_f);
     class_addmethod(sigsend_class, (t_method)sigsend_dsp,
@@ -79,6 +88,8 @@ typedef struct _sigreceive
     t_symbol *x_sym;
     t_sample *x_wherefrom;
     int x_n;
+    t_signal x_plane;   /* the sender's buffer, when we lend it out */
+    int x_aliased;      /* true if our output is the sender's buffer */
 } t_sigreceive;
 
 static void *sigreceive_new(t_symbol *s)
@@ -87,6 +98,7 @@ static void *sigreceive_new(t_symbol *s)
     x->x_n = DEFSENDVS;             /* LATER find our vector size correctly */
     x->x_sym = s;
     x->x_wherefrom = 0;
+    x->x_aliased = 0;
     outlet_new(&x->x_obj, &s_signal);
     return (x);
 }
@@ -155,23 +167,57 @@ static void sigreceive_set(t_sigreceive *x, t_symbol *s)
         pd_error(x, "receive~ %s: no matching send", x->x_sym->s_name);
         x->x_wherefrom = 0;
     }
+        /* if our readers were handed the old sender's buffer, they have
+        to be told about the new one */
+    if (x->x_aliased)
+        canvas_update_dsp();
 }
 
+    /* Our output is borrowed (CLASS_DSPBORROWS).  If the send~ was
+    already scheduled in the same DSP context, its code always runs
+    before ours and our readers', so we simply lend them the send~'s
+    buffer; like adc~'s, it's never on a free list, so nobody can write
+    to it in place.  Otherwise we copy into a signal of our own. */
 static void sigreceive_dsp(t_sigreceive *x, t_signal **sp)
 {
-    if (sp[0]->s_n != x->x_n)
+    t_signal *s2 = signal_newfromcontext(0);
+    t_sigsend *sender;
+    int contextno = ugen_getcontextno();
+    x->x_aliased = 0;
+    if (s2->s_n != x->x_n)
     {
         pd_error(x, "receive~ %s: vector size mismatch", x->x_sym->s_name);
+        dsp_add_zero(s2->s_vec, s2->s_n);
     }
     else
     {
         sigreceive_set(x, x->x_sym);
-        if (sp[0]->s_n&7)
+        if (x->x_wherefrom && contextno &&
+            (sender = (t_sigsend *)pd_findbyclass(x->x_sym, sigsend_class)) &&
+                sender->x_contextno == contextno)
+        {
+            t_signal *plane = &x->x_plane;
+            plane->s_n = plane->s_vecsize = x->x_n;
+            plane->s_nchans = 1;
+            plane->s_vec = x->x_wherefrom;
+            plane->s_sr = s2->s_sr;
+            plane->s_isborrowed = 1;
+            plane->s_borrowedfrom = 0;
+                /* held by the send~; never goes back to zero */
+            plane->s_refcount = 0x40000000;
+            signal_makereusable(s2);
+            signal_setborrowed(sp[0], plane);
+            x->x_aliased = 1;
+            return;
+        }
+        if (s2->s_n&7)
             dsp_add(sigreceive_perform, 3,
-                x, sp[0]->s_vec, sp[0]->s_n);
+                x, s2->s_vec, s2->s_n);
         else dsp_add(sigreceive_perf8, 3,
-            x, sp[0]->s_vec, sp[0]->s_n);
+            x, s2->s_vec, s2->s_n);
     }
+    s2->s_refcount = 1;
+    signal_setborrowed(sp[0], s2);
 }
 
 static void sigreceive_setup(void)
@@ -184,6 +230,7 @@ static void sigreceive_setup(void)
         A_SYMBOL, 0);
     class_addmethod(sigreceive_class, (t_method)sigreceive_dsp,
         gensym("dsp"), A_CANT, 0);
+    class_setdspflags(sigreceive_class, CLASS_DSPBORROWS);
     class_sethelpsymbol(sigreceive_class, gensym("send~"));
 }
 
@@ -258,6 +305,7 @@ static void sigcatch_setup(void)
 {
     sigcatch_class = class_new(gensym("catch~"), (t_newmethod)sigcatch_new,
         (t_method)sigcatch_free, sizeof(t_sigcatch), CLASS_NOINLET, A_DEFSYM, 0);
+    class_setdspflags(sigcatch_class, CLASS_DSPSHARED);
     class_addmethod(sigcatch_class, (t_method)sigcatch_dsp,
         gensym("dsp"), A_CANT, 0);
     class_sethelpsymbol(sigcatch_class, gensym("throw~"));
@@ -338,6 +386,7 @@ static void sigthrow_setup(void)
 {
     sigthrow_class = class_new(gensym("throw~"), (t_newmethod)sigthrow_new, 0,
         sizeof(t_sigthrow), 0, A_DEFSYM, 0);
+    class_setdspflags(sigthrow_class, CLASS_NOPARALLEL);
     class_addmethod(sigthrow_class, (t_method)sigthrow_set, gensym("set"),
         A_SYMBOL, 0);
     CLASS_MAINSIGNALIN(sigthrow_class, t_sigthrow, x_f);
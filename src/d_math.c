@@ -7,6 +7,7 @@
 */
 
 #include "m_pd.h"
+#include "s_stuff.h"
 #include <math.h>
 #include <limits.h>
 #define LOGTEN 2.302585092994046
@@ -52,6 +53,9 @@ static t_int *clip_perform(t_int *w)
 
 static void clip_dsp(t_clip *x, t_signal **sp)
 {
+    if (dsp_addpointwise(PW_CLIP, sp[0]->s_vec, &x->x_lo, &x->x_hi,
+        sp[1]->s_vec, sp[0]->s_n))
+            return;
     dsp_add(clip_perform, 4, x, sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
 }
 
@@ -284,6 +288,9 @@ static t_int *sigwrap_old_perform(t_int *w)
 
 static void sigwrap_dsp(t_sigwrap *x, t_signal **sp)
 {
+    if (pd_compatibilitylevel >= 48 && dsp_addpointwise(PW_WRAP,
+        sp[0]->s_vec, 0, 0, sp[1]->s_vec, sp[0]->s_n))
+            return;
     dsp_add((pd_compatibilitylevel < 48 ?
         sigwrap_old_perform : sigwrap_perform),
             3, sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
@@ -298,6 +305,116 @@ void sigwrap_setup(void)
         gensym("dsp"), A_CANT, 0);
 }
 
+/* ------------------------ SSE2 exp and log ------------------------- */
+
+    /* mtof~, ftom~, the dB conversions, pow~, exp~ and log~ use the vector
+    exp and log below unless Pd is started with "-accuratemath", or block
+    sizes aren't a multiple of four.  exp itself is within 1.1e-7 relative
+    error (about one bit) and log within 2.2e-7 absolute error.  Since the
+    objects scale their arguments in single precision, their outputs' errors
+    grow with the size of the exponent: mtof~ is within 1e-6 relative, the
+    dB conversions to rms or power and pow~ within 8e-6 relative, and ftom~
+    and the conversions to dB within 2e-5 absolute. */
+
+int sys_accuratemath;
+
+#if PD_FLOATSIZE == 32 && (defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define MATH_SSE
+#include <emmintrin.h>
+
+    /* -ffast-math would let the compiler regroup the sums below that are
+    done in two steps so as not to lose precision; an empty asm statement
+    stops it.  Also tests for NAN are done on the bits, since fast math
+    assumes there are none. */
+#if defined(__GNUC__)
+#define MATH_SSE_KEEP(v) __asm__("" : "+x"(v))
+#else
+#define MATH_SSE_KEEP(v)
+#endif
+#define MATH_SSE_INF _mm_castsi128_ps(_mm_set1_epi32(0x7f800000))
+#define MATH_SSE_ISNAN(v) _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_and_si128( \
+    _mm_castps_si128(v), _mm_set1_epi32(0x7fffffff)), \
+        _mm_set1_epi32(0x7f800000)))
+
+    /* e to the x, four at a time.  x is split into n*log(2) + r with |r| at
+    most log(2)/2, using a two-part log(2) so r stays exact, and e^r is then
+    a degree-7 Taylor polynomial.  Overflow gives inf, results too small for
+    a normal float give 0, and a NAN stays a NAN. */
+static inline __m128 math_exp_sse(__m128 x)
+{
+    __m128 fn, r, p, big;
+    __m128i n;
+    n = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.44269504f)));
+    fn = _mm_cvtepi32_ps(n);
+    r = _mm_sub_ps(x, _mm_mul_ps(fn, _mm_set1_ps(0.693359375f)));
+    MATH_SSE_KEEP(r);
+    r = _mm_sub_ps(r, _mm_mul_ps(fn, _mm_set1_ps(-2.12194440e-4f)));
+    p = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(1.f/5040), r),
+        _mm_set1_ps(1.f/720));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(1.f/120));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(1.f/24));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(1.f/6));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(0.5f));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(1.f));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(1.f));
+        /* 2^128 isn't a float, so take that power as 2 * 2^127 */
+    big = _mm_castsi128_ps(_mm_cmpgt_epi32(n, _mm_set1_epi32(127)));
+    p = _mm_add_ps(p, _mm_and_ps(big, p));
+    n = _mm_sub_epi32(n, _mm_and_si128(_mm_castps_si128(big),
+        _mm_set1_epi32(1)));
+    p = _mm_mul_ps(p, _mm_castsi128_ps(_mm_slli_epi32(
+        _mm_add_epi32(n, _mm_set1_epi32(127)), 23)));
+    p = _mm_andnot_ps(_mm_cmplt_ps(x, _mm_set1_ps(-87.33654f)), p);
+    big = _mm_cmpgt_ps(x, _mm_set1_ps(88.72283f));
+    p = _mm_or_ps(_mm_andnot_ps(big, p), _mm_and_ps(big, MATH_SSE_INF));
+    return (_mm_or_ps(p, _mm_and_ps(MATH_SSE_ISNAN(x), x)));
+}
+
+    /* natural log, four at a time, for x > 0.  x is split into 2^e * m with
+    m between sqrt(1/2) and sqrt(2), and log(m) is got from the series for
+    2 * atanh((m-1)/(m+1)).  Subnormals are scaled up first; inf gives inf
+    and NAN a NAN.  Zero and negative x give garbage, so callers mask them. */
+static inline __m128 math_log_sse(__m128 x)
+{
+    __m128 small = _mm_cmplt_ps(x, _mm_set1_ps(1.17549435e-38f)), m, t, t2,
+        p, fe, bad;
+    __m128i i, e;
+    x = _mm_or_ps(_mm_andnot_ps(small, x),
+        _mm_and_ps(small, _mm_mul_ps(x, _mm_set1_ps(8388608.f))));
+    i = _mm_castps_si128(x);
+    e = _mm_sub_epi32(_mm_srli_epi32(i, 23), _mm_set1_epi32(127));
+    e = _mm_sub_epi32(e, _mm_and_si128(_mm_castps_si128(small),
+        _mm_set1_epi32(23)));
+    m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(i,
+        _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f800000)));
+    bad = _mm_cmpgt_ps(m, _mm_set1_ps(1.41421356f));
+    m = _mm_sub_ps(m, _mm_and_ps(bad, _mm_mul_ps(m, _mm_set1_ps(0.5f))));
+    e = _mm_sub_epi32(e, _mm_castps_si128(bad));     /* adds 1 where set */
+    t = _mm_div_ps(_mm_sub_ps(m, _mm_set1_ps(1.f)),
+        _mm_add_ps(m, _mm_set1_ps(1.f)));
+    t2 = _mm_mul_ps(t, t);
+    p = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.f/9), t2), _mm_set1_ps(2.f/7));
+    p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(2.f/5));
+    p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(2.f/3));
+    p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(2.f));
+    p = _mm_mul_ps(p, t);
+    fe = _mm_cvtepi32_ps(e);
+    p = _mm_add_ps(p, _mm_mul_ps(fe, _mm_set1_ps(-2.12194440e-4f)));
+    MATH_SSE_KEEP(p);
+    p = _mm_add_ps(p, _mm_mul_ps(fe, _mm_set1_ps(0.693359375f)));
+        /* inf and NAN are the only values whose exponents are all ones */
+    bad = _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_and_si128(i,
+        _mm_set1_epi32(0x7fffffff)), _mm_set1_epi32(0x7f7fffff)));
+    return (_mm_or_ps(_mm_andnot_ps(bad, p), _mm_and_ps(bad, x)));
+}
+
+    /* choose the SSE2 routine if we can */
+#define MATH_PERFORM(f, n) (!sys_accuratemath && !((n) & 3) ? f##_sse : f)
+#else
+#define MATH_PERFORM(f, n) (f)
+#endif /* MATH_SSE */
+
 /* ------------------------------ mtof_tilde~ -------------------------- */
 
 typedef struct mtof_tilde
@@ -333,9 +450,27 @@ static t_int *mtof_tilde_perform(t_int *w)
     return (w + 4);
 }
 
+#ifdef MATH_SSE
+static t_int *mtof_tilde_perform_sse(t_int *w)
+{
+    t_sample *in = (t_sample *)w[1], *out = (t_sample *)w[2];
+    int n = (int)w[3];
+    for (; n; n -= 4, in += 4, out += 4)
+    {
+        __m128 f = _mm_loadu_ps(in);
+        __m128 g = math_exp_sse(_mm_mul_ps(_mm_set1_ps(.0577622650f),
+            _mm_min_ps(f, _mm_set1_ps(1499))));
+        _mm_storeu_ps(out, _mm_andnot_ps(_mm_cmple_ps(f, _mm_set1_ps(-1500)),
+            _mm_mul_ps(_mm_set1_ps(8.17579891564f), g)));
+    }
+    return (w + 4);
+}
+#endif
+
 static void mtof_tilde_dsp(t_mtof_tilde *x, t_signal **sp)
 {
-    dsp_add(mtof_tilde_perform, 3, sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
+    dsp_add(MATH_PERFORM(mtof_tilde_perform, sp[0]->s_n), 3,
+        sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
 }
 
 void mtof_tilde_setup(void)
@@ -377,9 +512,28 @@ static t_int *ftom_tilde_perform(t_int *w)
     return (w + 4);
 }
 
+#ifdef MATH_SSE
+static t_int *ftom_tilde_perform_sse(t_int *w)
+{
+    t_sample *in = (t_sample *)w[1], *out = (t_sample *)w[2];
+    int n = (int)w[3];
+    for (; n; n -= 4, in += 4, out += 4)
+    {
+        __m128 f = _mm_loadu_ps(in);
+        __m128 pos = _mm_cmpgt_ps(f, _mm_setzero_ps()), g = _mm_mul_ps(
+            _mm_set1_ps(17.3123405046f),
+                math_log_sse(_mm_mul_ps(_mm_set1_ps(.12231220585f), f)));
+        _mm_storeu_ps(out, _mm_or_ps(_mm_and_ps(pos, g),
+            _mm_andnot_ps(pos, _mm_set1_ps(-1500))));
+    }
+    return (w + 4);
+}
+#endif
+
 static void ftom_tilde_dsp(t_ftom_tilde *x, t_signal **sp)
 {
-    dsp_add(ftom_tilde_perform, 3, sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
+    dsp_add(MATH_PERFORM(ftom_tilde_perform, sp[0]->s_n), 3,
+        sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
 }
 
 void ftom_tilde_setup(void)
@@ -427,9 +581,27 @@ static t_int *dbtorms_tilde_perform(t_int *w)
     return (w + 4);
 }
 
+#ifdef MATH_SSE
+static t_int *dbtorms_tilde_perform_sse(t_int *w)
+{
+    t_sample *in = (t_sample *)w[1], *out = (t_sample *)w[2];
+    int n = (int)w[3];
+    for (; n; n -= 4, in += 4, out += 4)
+    {
+        __m128 f = _mm_loadu_ps(in);
+        __m128 g = math_exp_sse(_mm_mul_ps(_mm_set1_ps(LOGTEN * 0.05),
+            _mm_sub_ps(_mm_min_ps(f, _mm_set1_ps(485)), _mm_set1_ps(100))));
+        _mm_storeu_ps(out, _mm_andnot_ps(_mm_cmple_ps(f, _mm_setzero_ps()),
+            g));
+    }
+    return (w + 4);
+}
+#endif
+
 static void dbtorms_tilde_dsp(t_dbtorms_tilde *x, t_signal **sp)
 {
-    dsp_add(dbtorms_tilde_perform, 3, sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
+    dsp_add(MATH_PERFORM(dbtorms_tilde_perform, sp[0]->s_n), 3,
+        sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
 }
 
 void dbtorms_tilde_setup(void)
@@ -476,9 +648,27 @@ static t_int *rmstodb_tilde_perform(t_int *w)
     return (w + 4);
 }
 
+#ifdef MATH_SSE
+static t_int *rmstodb_tilde_perform_sse(t_int *w)
+{
+    t_sample *in = (t_sample *)w[1], *out = (t_sample *)w[2];
+    int n = (int)w[3];
+    for (; n; n -= 4, in += 4, out += 4)
+    {
+        __m128 f = _mm_loadu_ps(in);
+        __m128 g = _mm_add_ps(_mm_set1_ps(100), _mm_mul_ps(
+            _mm_set1_ps(20./LOGTEN), math_log_sse(f)));
+        _mm_storeu_ps(out, _mm_andnot_ps(_mm_cmple_ps(f, _mm_setzero_ps()),
+            _mm_max_ps(g, _mm_setzero_ps())));
+    }
+    return (w + 4);
+}
+#endif
+
 static void rmstodb_tilde_dsp(t_rmstodb_tilde *x, t_signal **sp)
 {
-    dsp_add(rmstodb_tilde_perform, 3, sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
+    dsp_add(MATH_PERFORM(rmstodb_tilde_perform, sp[0]->s_n), 3,
+        sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
 }
 
 void rmstodb_tilde_setup(void)
@@ -526,9 +716,27 @@ static t_int *dbtopow_tilde_perform(t_int *w)
     return (w + 4);
 }
 
+#ifdef MATH_SSE
+static t_int *dbtopow_tilde_perform_sse(t_int *w)
+{
+    t_sample *in = (t_sample *)w[1], *out = (t_sample *)w[2];
+    int n = (int)w[3];
+    for (; n; n -= 4, in += 4, out += 4)
+    {
+        __m128 f = _mm_loadu_ps(in);
+        __m128 g = math_exp_sse(_mm_mul_ps(_mm_set1_ps(LOGTEN * 0.1),
+            _mm_sub_ps(_mm_min_ps(f, _mm_set1_ps(870)), _mm_set1_ps(100))));
+        _mm_storeu_ps(out, _mm_andnot_ps(_mm_cmple_ps(f, _mm_setzero_ps()),
+            g));
+    }
+    return (w + 4);
+}
+#endif
+
 static void dbtopow_tilde_dsp(t_dbtopow_tilde *x, t_signal **sp)
 {
-    dsp_add(dbtopow_tilde_perform, 3, sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
+    dsp_add(MATH_PERFORM(dbtopow_tilde_perform, sp[0]->s_n), 3,
+        sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
 }
 
 void dbtopow_tilde_setup(void)
@@ -575,9 +783,27 @@ static t_int *powtodb_tilde_perform(t_int *w)
     return (w + 4);
 }
 
+#ifdef MATH_SSE
+static t_int *powtodb_tilde_perform_sse(t_int *w)
+{
+    t_sample *in = (t_sample *)w[1], *out = (t_sample *)w[2];
+    int n = (int)w[3];
+    for (; n; n -= 4, in += 4, out += 4)
+    {
+        __m128 f = _mm_loadu_ps(in);
+        __m128 g = _mm_add_ps(_mm_set1_ps(100), _mm_mul_ps(
+            _mm_set1_ps(10./LOGTEN), math_log_sse(f)));
+        _mm_storeu_ps(out, _mm_andnot_ps(_mm_cmple_ps(f, _mm_setzero_ps()),
+            _mm_max_ps(g, _mm_setzero_ps())));
+    }
+    return (w + 4);
+}
+#endif
+
 static void powtodb_tilde_dsp(t_powtodb_tilde *x, t_signal **sp)
 {
-    dsp_add(powtodb_tilde_perform, 3, sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
+    dsp_add(MATH_PERFORM(powtodb_tilde_perform, sp[0]->s_n), 3,
+        sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
 }
 
 void powtodb_tilde_setup(void)
@@ -624,9 +850,39 @@ t_int *pow_tilde_perform(t_int *w)
     return (w+5);
 }
 
+#ifdef MATH_SSE
+    /* this does pow(f1, f2) as exp(f2 * log(f1)), which only works for
+    positive f1, so other groups of four go the old way */
+static t_int *pow_tilde_perform_sse(t_int *w)
+{
+    t_sample *in1 = (t_sample *)(w[1]);
+    t_sample *in2 = (t_sample *)(w[2]);
+    t_sample *out = (t_sample *)(w[3]);
+    int n = (int)(w[4]);
+    t_int w2[5];
+    for (; n; n -= 4, in1 += 4, in2 += 4, out += 4)
+    {
+        __m128 f1 = _mm_loadu_ps(in1), f2 = _mm_loadu_ps(in2),
+            lim = _mm_set1_ps(3.4e38f);
+        if (_mm_movemask_ps(_mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(f1,
+            _mm_setzero_ps()), _mm_cmplt_ps(f1, lim)), _mm_cmplt_ps(
+                _mm_max_ps(f2, _mm_sub_ps(_mm_setzero_ps(), f2)), lim)))
+                    != 15)
+        {
+            w2[1] = (t_int)in1; w2[2] = (t_int)in2; w2[3] = (t_int)out;
+            w2[4] = 4;
+            pow_tilde_perform(w2);
+        }
+        else _mm_storeu_ps(out, math_exp_sse(_mm_mul_ps(f2,
+            math_log_sse(f1))));
+    }
+    return (w+5);
+}
+#endif
+
 static void pow_tilde_dsp(t_pow_tilde *x, t_signal **sp)
 {
-    dsp_add(pow_tilde_perform, 4,
+    dsp_add(MATH_PERFORM(pow_tilde_perform, sp[0]->s_n), 4,
         sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[0]->s_n);
 }
 
@@ -665,9 +921,21 @@ t_int *exp_tilde_perform(t_int *w)
     return (w+4);
 }
 
+#ifdef MATH_SSE
+static t_int *exp_tilde_perform_sse(t_int *w)
+{
+    t_sample *in1 = (t_sample *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    int n = (int)(w[3]);
+    for (; n; n -= 4, in1 += 4, out += 4)
+        _mm_storeu_ps(out, math_exp_sse(_mm_loadu_ps(in1)));
+    return (w+4);
+}
+#endif
+
 static void exp_tilde_dsp(t_exp_tilde *x, t_signal **sp)
 {
-    dsp_add(exp_tilde_perform, 3,
+    dsp_add(MATH_PERFORM(exp_tilde_perform, sp[0]->s_n), 3,
         sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
 }
 
@@ -718,9 +986,30 @@ t_int *log_tilde_perform(t_int *w)
     return (w+5);
 }
 
+#ifdef MATH_SSE
+static t_int *log_tilde_perform_sse(t_int *w)
+{
+    t_sample *in1 = (t_sample *)(w[1]);
+    t_sample *in2 = (t_sample *)(w[2]);
+    t_sample *out = (t_sample *)(w[3]);
+    int n = (int)(w[4]);
+    for (; n; n -= 4, in1 += 4, in2 += 4, out += 4)
+    {
+        __m128 f = _mm_loadu_ps(in1), g = _mm_loadu_ps(in2),
+            lf = math_log_sse(f), zero = _mm_setzero_ps(),
+            nobase = _mm_cmple_ps(g, zero), bad = _mm_cmple_ps(f, zero);
+        lf = _mm_or_ps(_mm_and_ps(nobase, lf),
+            _mm_andnot_ps(nobase, _mm_div_ps(lf, math_log_sse(g))));
+        _mm_storeu_ps(out, _mm_or_ps(_mm_and_ps(bad, _mm_set1_ps(-1000)),
+            _mm_andnot_ps(bad, lf)));
+    }
+    return (w+5);
+}
+#endif
+
 static void log_tilde_dsp(t_log_tilde *x, t_signal **sp)
 {
-    dsp_add(log_tilde_perform, 4,
+    dsp_add(MATH_PERFORM(log_tilde_perform, sp[0]->s_n), 4,
         sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[0]->s_n);
 }
 
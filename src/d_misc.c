@@ -2,7 +2,7 @@
 * For information on usage and redistribution, and for a DISCLAIMER OF ALL
 * WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
 
-/*  miscellaneous: print~; more to come.
+/*  miscellaneous: print~, bang~, snake~; more to come.
 */
 
 #include "m_pd.h"
@@ -41,7 +41,8 @@ static t_int *print_perform(t_int *w)
 
 static void print_dsp(t_print *x, t_signal **sp)
 {
-    dsp_add(print_perform, 3, x, sp[0]->s_vec, sp[0]->s_n);
+    dsp_add(print_perform, 3, x, sp[0]->s_vec,
+        (t_int)(sp[0]->s_n * sp[0]->s_nchans));
 }
 
 static void print_float(t_print *x, t_float f)
@@ -68,6 +69,7 @@ static void print_setup(void)
 {
     print_class = class_new(gensym("print~"), (t_newmethod)print_new, 0,
         sizeof(t_print), 0, A_DEFSYM, 0);
+    class_setdspflags(print_class, CLASS_NOPARALLEL);
     CLASS_MAINSIGNALIN(print_class, t_print, x_f);
     class_addmethod(print_class, (t_method)print_dsp, gensym("dsp"), A_CANT, 0);
     class_addbang(print_class, print_bang);
@@ -118,17 +120,113 @@ static void bang_tilde_setup(void)
 {
     bang_tilde_class = class_new(gensym("bang~"), (t_newmethod)bang_tilde_new,
         (t_method)bang_tilde_free, sizeof(t_bang), 0, 0);
+    class_setdspflags(bang_tilde_class, CLASS_NOPARALLEL);
     class_addmethod(bang_tilde_class, (t_method)bang_tilde_dsp,
         gensym("dsp"), 0);
 }
 
 
+/* ------------------------ snake~ -------------------------- */
+
+/* "snake~ in n" combines n signals into one signal of n channels, and
+"snake~ out n" splits a multichannel signal into n, with zeros for any
+channels it doesn't have. */
+
+static t_class *snake_in_class, *snake_out_class;
+
+typedef struct _snake
+{
+    t_object x_obj;
+    t_float x_f;
+    int x_nchans;
+} t_snake;
+
+static void *snake_in_new(int nchans)
+{
+    t_snake *x = (t_snake *)pd_new(snake_in_class);
+    int i;
+    x->x_nchans = nchans;
+    for (i = 1; i < nchans; i++)
+        inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
+    outlet_new(&x->x_obj, &s_signal);
+    x->x_f = 0;
+    return (x);
+}
+
+static void *snake_out_new(int nchans)
+{
+    t_snake *x = (t_snake *)pd_new(snake_out_class);
+    int i;
+    x->x_nchans = nchans;
+    for (i = 0; i < nchans; i++)
+        outlet_new(&x->x_obj, &s_signal);
+    x->x_f = 0;
+    return (x);
+}
+
+static void *snake_new(t_symbol *s, int argc, t_atom *argv)
+{
+    t_symbol *s2 = gensym("in");
+    int nchans;
+    if (argc && argv[0].a_type == A_SYMBOL)
+        s2 = argv[0].a_w.w_symbol, argc--, argv++;
+    if ((nchans = atom_getfloatarg(0, argc, argv)) < 1)
+        nchans = 2;
+    if (s2 == gensym("in"))
+        return (snake_in_new(nchans));
+    else if (s2 == gensym("out"))
+        return (snake_out_new(nchans));
+    error("snake~ %s: unknown function", s2->s_name);
+    return (0);
+}
+
+static void snake_in_dsp(t_snake *x, t_signal **sp)
+{
+    int i, n = sp[0]->s_n;
+    t_sample *out;
+    signal_setmultiout(&sp[x->x_nchans], x->x_nchans);
+    out = sp[x->x_nchans]->s_vec;
+        /* the output may be an input's buffer, freed for reuse; only its
+        first channel is read, so fill that last */
+    for (i = x->x_nchans; i--; )
+        dsp_add_copy(sp[i]->s_vec, out + i * n, n);
+}
+
+static void snake_out_dsp(t_snake *x, t_signal **sp)
+{
+    int i, n = sp[0]->s_n;
+    for (i = 0; i < x->x_nchans; i++)
+    {
+        if (i < sp[0]->s_nchans)
+            dsp_add_copy(sp[0]->s_vec + i * n, sp[i+1]->s_vec, n);
+        else dsp_add_zero(sp[i+1]->s_vec, n);
+    }
+}
+
+static void snake_setup(void)
+{
+    snake_in_class = class_new(gensym("snake~ in"), 0, 0,
+        sizeof(t_snake), 0, 0);
+    CLASS_MAINSIGNALIN(snake_in_class, t_snake, x_f);
+    class_addmethod(snake_in_class, (t_method)snake_in_dsp,
+        gensym("dsp"), A_CANT, 0);
+    class_sethelpsymbol(snake_in_class, gensym("snake~"));
+    snake_out_class = class_new(gensym("snake~ out"), 0, 0,
+        sizeof(t_snake), 0, 0);
+    CLASS_MAINSIGNALIN(snake_out_class, t_snake, x_f);
+    class_addmethod(snake_out_class, (t_method)snake_out_dsp,
+        gensym("dsp"), A_CANT, 0);
+    class_sethelpsymbol(snake_out_class, gensym("snake~"));
+    class_addcreator((t_newmethod)snake_new, gensym("snake~"), A_GIMME, 0);
+}
+
 /* ------------------------ global setup routine ------------------------- */
 
 void d_misc_setup(void)
 {
     print_setup();
     bang_tilde_setup();
+    snake_setup();
 }
 
 
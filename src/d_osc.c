@@ -6,6 +6,7 @@
 */
 
 #include "m_pd.h"
+#include "s_stuff.h"
 #include "math.h"
 
 #define BIGFLOAT 1.0e+19
@@ -101,10 +102,42 @@ static t_int *phasor_perform(t_int *w)
     return (w+5);
 }
 
+    /* the same with the frequency inlet unconnected (see osc~ below) */
+static t_int *phasor_scalarperform(t_int *w)
+{
+    t_phasor *x = (t_phasor *)(w[1]);
+    t_float *in = (t_float *)(w[2]);
+    t_sample *out = (t_float *)(w[3]);
+    int n = (int)(w[4]);
+    double dphase = x->x_phase + (double)UNITBIT32;
+    union tabfudge tf;
+    int normhipart;
+    t_float incr = *in * x->x_conv;
+
+    tf.tf_d = UNITBIT32;
+    normhipart = tf.tf_i[HIOFFSET];
+    tf.tf_d = dphase;
+
+    while (n--)
+    {
+        tf.tf_i[HIOFFSET] = normhipart;
+        dphase += incr;
+        *out++ = tf.tf_d - UNITBIT32;
+        tf.tf_d = dphase;
+    }
+    tf.tf_i[HIOFFSET] = normhipart;
+    x->x_phase = tf.tf_d - UNITBIT32;
+    return (w+5);
+}
+
 static void phasor_dsp(t_phasor *x, t_signal **sp)
 {
     x->x_conv = 1./sp[0]->s_sr;
-    dsp_add(phasor_perform, 4, x, sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
+    if (sp[0]->s_scalar)
+        dsp_add(phasor_scalarperform, 4, x, sp[0]->s_scalar, sp[1]->s_vec,
+            sp[0]->s_n);
+    else dsp_add(phasor_perform, 4, x, sp[0]->s_vec, sp[1]->s_vec,
+        sp[0]->s_n);
 }
 
 static void phasor_ft1(t_phasor *x, t_float f)
@@ -117,6 +150,7 @@ static void phasor_setup(void)
     phasor_class = class_new(gensym("phasor~"), (t_newmethod)phasor_new, 0,
         sizeof(t_phasor), 0, A_DEFFLOAT, 0);
     CLASS_MAINSIGNALIN(phasor_class, t_phasor, x_f);
+    class_setdspflags(phasor_class, CLASS_SCALARIN);
     class_addmethod(phasor_class, (t_method)phasor_dsp,
         gensym("dsp"), A_CANT, 0);
     class_addmethod(phasor_class, (t_method)phasor_ft1,
@@ -129,6 +163,62 @@ static void phasor_setup(void)
 
 float *cos_table;
 
+    /* With the "-hqosc" flag, cos~ and osc~ look up a table computed with an
+    accurate pi, and correct the linear interpolation for the curvature of
+    the cosine between points: since cos'' = -cos, the interpolated value
+    falls short by about frac * (1 - frac) * h^2/2 of itself, h being the
+    table step in radians.  This brings the error down from about 2e-5 to
+    5e-8 at the cost of three more multiplies per sample.  "cos_table"
+    itself stays as it was, for vcf~ and for externs that use it. */
+int sys_hqosc;
+static float *cos_hqtable;
+#define COSPI 3.14159265358979323846
+#define COSCURVE ((float)(2 * COSPI * COSPI / ((double)COSTABSIZE * COSTABSIZE)))
+
+    /* SSE2 versions of cos~ and osc~ below do four samples at a time.  They
+    use the same "tabfudge" trick as the C code on pairs of double-precision
+    phases, whose high words hold the table index and low words the
+    fraction, which is taken to 24 bits.  osc~'s phase within each group of
+    four is summed in a different order, which can only make a difference
+    in the last bit of the phase at frequencies under a fifth of a Hertz.
+    The phase itself goes on being kept in double precision, so that osc~
+    stays locked to a phasor~ at the same frequency. */
+#if PD_FLOATSIZE == 32 && (defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define COS_SSE
+#include <emmintrin.h>
+
+    /* look up four phases, each with UNITBIT32 added, two in "lo" and two
+    in "hi" */
+static inline __m128 cos_sse_lookup(const float *tab, __m128d lo, __m128d hi,
+    int hq)
+{
+    __m128i words;
+    int32_t ix[4];
+    __m128 frac, a, b, f1, f2, y;
+        /* low and high 32-bit words: the fraction, and the table index */
+    words = _mm_castps_si128(_mm_shuffle_ps(_mm_castpd_ps(lo),
+        _mm_castpd_ps(hi), _MM_SHUFFLE(2, 0, 2, 0)));
+    _mm_storeu_si128((__m128i *)ix, _mm_and_si128(_mm_castps_si128(
+        _mm_shuffle_ps(_mm_castpd_ps(lo), _mm_castpd_ps(hi),
+            _MM_SHUFFLE(3, 1, 3, 1))), _mm_set1_epi32(COSTABSIZE-1)));
+    frac = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(words, 8)),
+        _mm_set1_ps(1.f / (1 << 24)));
+        /* each load gets a pair of neighboring points */
+    a = _mm_unpacklo_ps(_mm_castpd_ps(_mm_load_sd((const double *)(tab + ix[0]))),
+        _mm_castpd_ps(_mm_load_sd((const double *)(tab + ix[1]))));
+    b = _mm_unpacklo_ps(_mm_castpd_ps(_mm_load_sd((const double *)(tab + ix[2]))),
+        _mm_castpd_ps(_mm_load_sd((const double *)(tab + ix[3]))));
+    f1 = _mm_movelh_ps(a, b);
+    f2 = _mm_movehl_ps(b, a);
+    y = _mm_add_ps(f1, _mm_mul_ps(frac, _mm_sub_ps(f2, f1)));
+    if (hq)
+        y = _mm_add_ps(y, _mm_mul_ps(y, _mm_mul_ps(_mm_mul_ps(frac,
+            _mm_sub_ps(_mm_set1_ps(1), frac)), _mm_set1_ps(COSCURVE))));
+    return (y);
+}
+#endif
+
 static t_class *cos_class;
 
 typedef struct _cos
@@ -196,9 +286,69 @@ static t_int *cos_perform(t_int *w)
     return (w+4);
 }
 
+static t_int *cos_hqperform(t_int *w)
+{
+    t_sample *in = (t_sample *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    int n = (int)(w[3]);
+    float *tab = cos_hqtable, *addr;
+    t_float f1, f2, frac, y;
+    int normhipart;
+    union tabfudge tf;
+
+    tf.tf_d = UNITBIT32;
+    normhipart = tf.tf_i[HIOFFSET];
+    while (n--)
+    {
+        tf.tf_d = (double)(*in++ * (float)(COSTABSIZE)) + UNITBIT32;
+        addr = tab + (tf.tf_i[HIOFFSET] & (COSTABSIZE-1));
+        tf.tf_i[HIOFFSET] = normhipart;
+        frac = tf.tf_d - UNITBIT32;
+        f1 = addr[0];
+        f2 = addr[1];
+        y = f1 + frac * (f2 - f1);
+        *out++ = y + y * (frac * (1 - frac) * COSCURVE);
+    }
+    return (w+4);
+}
+
+#ifdef COS_SSE
+static inline void cos_sse(const float *tab, t_sample *in, t_sample *out,
+    int n, int hq)
+{
+    const __m128d unit = _mm_set1_pd(UNITBIT32);
+    const __m128 size = _mm_set1_ps(COSTABSIZE);
+    for (; n; n -= 4, in += 4, out += 4)
+    {
+        __m128 p = _mm_mul_ps(_mm_loadu_ps(in), size);
+        _mm_storeu_ps(out, cos_sse_lookup(tab,
+            _mm_add_pd(_mm_cvtps_pd(p), unit),
+            _mm_add_pd(_mm_cvtps_pd(_mm_movehl_ps(p, p)), unit), hq));
+    }
+}
+
+static t_int *cos_perf_sse(t_int *w)
+{
+    cos_sse(cos_table, (t_sample *)(w[1]), (t_sample *)(w[2]), (int)(w[3]), 0);
+    return (w+4);
+}
+
+static t_int *cos_hqperf_sse(t_int *w)
+{
+    cos_sse(cos_hqtable, (t_sample *)(w[1]), (t_sample *)(w[2]),
+        (int)(w[3]), 1);
+    return (w+4);
+}
+#endif
+
 static void cos_dsp(t_cos *x, t_signal **sp)
 {
-    dsp_add(cos_perform, 3, sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
+    t_perfroutine f = (sys_hqosc ? cos_hqperform : cos_perform);
+#ifdef COS_SSE
+    if (!(sp[0]->s_n & 3))
+        f = (sys_hqosc ? cos_hqperf_sse : cos_perf_sse);
+#endif
+    dsp_add(f, 3, sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
 }
 
 static void cos_maketable(void)
@@ -212,6 +362,9 @@ static void cos_maketable(void)
     for (i = COSTABSIZE + 1, fp = cos_table, phase = 0; i--;
         fp++, phase += phsinc)
             *fp = cos(phase);
+    cos_hqtable = (float *)getbytes(sizeof(float) * (COSTABSIZE+1));
+    for (i = 0; i <= COSTABSIZE; i++)
+        cos_hqtable[i] = cos(i * (2 * COSPI / COSTABSIZE));
 
         /* here we check at startup whether the byte alignment
             is as we declared it.  If not, the code has to be
@@ -224,7 +377,8 @@ static void cos_maketable(void)
 static void cos_cleanup(t_class *c)
 {
     freebytes(cos_table, sizeof(float) * (COSTABSIZE+1));
-    cos_table = 0;
+    freebytes(cos_hqtable, sizeof(float) * (COSTABSIZE+1));
+    cos_table = cos_hqtable = 0;
 }
 
 static void cos_setup(void)
@@ -318,10 +472,180 @@ static t_int *osc_perform(t_int *w)
     return (w+5);
 }
 
+    /* wrap the phase, as above, once per block */
+static double osc_wrap(double dphase)
+{
+    union tabfudge tf;
+    int normhipart;
+    tf.tf_d = UNITBIT32 * COSTABSIZE;
+    normhipart = tf.tf_i[HIOFFSET];
+    tf.tf_d = dphase + (UNITBIT32 * COSTABSIZE - UNITBIT32);
+    tf.tf_i[HIOFFSET] = normhipart;
+    return (tf.tf_d - UNITBIT32 * COSTABSIZE);
+}
+
+    /* With the frequency inlet unconnected (the usual [osc~ 440]) osc~ is
+    CLASS_SCALARIN, and reads the frequency once per block here instead of
+    having it copied into a vector first.  The phase advances exactly as
+    in osc_perform(). */
+static t_int *osc_scalarperform(t_int *w)
+{
+    t_osc *x = (t_osc *)(w[1]);
+    t_float *in = (t_float *)(w[2]);
+    t_sample *out = (t_sample *)(w[3]);
+    int n = (int)(w[4]);
+    float *tab = cos_table, *addr;
+    t_float f1, f2, frac;
+    double dphase = x->x_phase + UNITBIT32;
+    int normhipart;
+    union tabfudge tf;
+    float conv = x->x_conv;
+    t_float incr = (t_sample)*in * conv;
+
+    tf.tf_d = UNITBIT32;
+    normhipart = tf.tf_i[HIOFFSET];
+    while (n--)
+    {
+        tf.tf_d = dphase;
+        dphase += incr;
+        addr = tab + (tf.tf_i[HIOFFSET] & (COSTABSIZE-1));
+        tf.tf_i[HIOFFSET] = normhipart;
+        frac = tf.tf_d - UNITBIT32;
+        f1 = addr[0];
+        f2 = addr[1];
+        *out++ = f1 + frac * (f2 - f1);
+    }
+    x->x_phase = osc_wrap(dphase);
+    return (w+5);
+}
+
+static t_int *osc_hqperform(t_int *w)
+{
+    t_osc *x = (t_osc *)(w[1]);
+    t_sample *in = (t_sample *)(w[2]);
+    t_sample *out = (t_sample *)(w[3]);
+    int n = (int)(w[4]);
+    float *tab = cos_hqtable, *addr;
+    t_float f1, f2, frac, y;
+    double dphase = x->x_phase + UNITBIT32;
+    int normhipart;
+    union tabfudge tf;
+    float conv = x->x_conv;
+
+    tf.tf_d = UNITBIT32;
+    normhipart = tf.tf_i[HIOFFSET];
+    while (n--)
+    {
+        tf.tf_d = dphase;
+        dphase += *in++ * conv;
+        addr = tab + (tf.tf_i[HIOFFSET] & (COSTABSIZE-1));
+        tf.tf_i[HIOFFSET] = normhipart;
+        frac = tf.tf_d - UNITBIT32;
+        f1 = addr[0];
+        f2 = addr[1];
+        y = f1 + frac * (f2 - f1);
+        *out++ = y + y * (frac * (1 - frac) * COSCURVE);
+    }
+    x->x_phase = osc_wrap(dphase);
+    return (w+5);
+}
+
+#ifdef COS_SSE
+    /* the phase of each group of four samples is the running phase plus
+    partial sums of the increments: 0, a0, a0+a1, and a0+a1+a2 */
+static inline void osc_sse(t_osc *x, const float *tab, t_sample *in,
+    t_sample *out, int n, int hq)
+{
+    const __m128 conv = _mm_set1_ps(x->x_conv);
+    const __m128d zero = _mm_setzero_pd();
+    __m128d d = _mm_set1_pd(x->x_phase + UNITBIT32);
+    for (; n; n -= 4, in += 4, out += 4)
+    {
+        __m128 inc = _mm_mul_ps(_mm_loadu_ps(in), conv);
+        __m128d a01 = _mm_cvtps_pd(inc),
+            a23 = _mm_cvtps_pd(_mm_movehl_ps(inc, inc)), s01, lo, hi;
+        lo = _mm_unpacklo_pd(zero, a01);
+        s01 = _mm_add_pd(lo, a01);
+        s01 = _mm_unpackhi_pd(s01, s01);
+        hi = _mm_add_pd(s01, _mm_unpacklo_pd(zero, a23));
+        _mm_storeu_ps(out, cos_sse_lookup(tab, _mm_add_pd(d, lo),
+            _mm_add_pd(d, hi), hq));
+        hi = _mm_add_pd(hi, a23);
+        d = _mm_add_pd(d, _mm_unpackhi_pd(hi, hi));
+    }
+    x->x_phase = osc_wrap(_mm_cvtsd_f64(d));
+}
+
+static t_int *osc_perf_sse(t_int *w)
+{
+    osc_sse((t_osc *)(w[1]), cos_table, (t_sample *)(w[2]),
+        (t_sample *)(w[3]), (int)(w[4]), 0);
+    return (w+5);
+}
+
+static t_int *osc_hqperf_sse(t_int *w)
+{
+    osc_sse((t_osc *)(w[1]), cos_hqtable, (t_sample *)(w[2]),
+        (t_sample *)(w[3]), (int)(w[4]), 1);
+    return (w+5);
+}
+
+    /* the same for a constant frequency, with the partial sums computed
+    once; they're added in the same order, so the output is the same. */
+static inline void osc_ssescalar(t_osc *x, const float *tab, t_float *in,
+    t_sample *out, int n, int hq)
+{
+    double a = (float)((t_sample)*in * x->x_conv);
+    const __m128d lo = _mm_set_pd(a, 0), hi = _mm_set_pd(a + a + a, a + a),
+        step = _mm_set1_pd(a + a + a + a);
+    __m128d d = _mm_set1_pd(x->x_phase + UNITBIT32);
+    for (; n; n -= 4, out += 4)
+    {
+        _mm_storeu_ps(out, cos_sse_lookup(tab, _mm_add_pd(d, lo),
+            _mm_add_pd(d, hi), hq));
+        d = _mm_add_pd(d, step);
+    }
+    x->x_phase = osc_wrap(_mm_cvtsd_f64(d));
+}
+
+static t_int *osc_scalarperf_sse(t_int *w)
+{
+    osc_ssescalar((t_osc *)(w[1]), cos_table, (t_float *)(w[2]),
+        (t_sample *)(w[3]), (int)(w[4]), 0);
+    return (w+5);
+}
+
+static t_int *osc_hqscalarperf_sse(t_int *w)
+{
+    osc_ssescalar((t_osc *)(w[1]), cos_hqtable, (t_float *)(w[2]),
+        (t_sample *)(w[3]), (int)(w[4]), 1);
+    return (w+5);
+}
+#endif
+
 static void osc_dsp(t_osc *x, t_signal **sp)
 {
+    t_perfroutine f = (sys_hqosc ? osc_hqperform : osc_perform);
+#ifdef COS_SSE
+    if (!(sp[0]->s_n & 3))
+        f = (sys_hqosc ? osc_hqperf_sse : osc_perf_sse);
+#endif
     x->x_conv = COSTABSIZE/sp[0]->s_sr;
-    dsp_add(osc_perform, 4, x, sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
+    if (sp[0]->s_scalar)
+    {
+        t_perfroutine sf = (sys_hqosc ? 0 : osc_scalarperform);
+#ifdef COS_SSE
+        if (!(sp[0]->s_n & 3))
+            sf = (sys_hqosc ? osc_hqscalarperf_sse : osc_scalarperf_sse);
+#endif
+        if (sf)
+        {
+            dsp_add(sf, 4, x, sp[0]->s_scalar, sp[1]->s_vec, sp[0]->s_n);
+            return;
+        }
+        dsp_add_scalarcopy(sp[0]->s_scalar, sp[0]->s_vec, sp[0]->s_n);
+    }
+    dsp_add(f, 4, x, sp[0]->s_vec, sp[1]->s_vec, sp[0]->s_n);
 }
 
 static void osc_ft1(t_osc *x, t_float f)
@@ -334,12 +658,343 @@ static void osc_setup(void)
     osc_class = class_new(gensym("osc~"), (t_newmethod)osc_new, 0,
         sizeof(t_osc), 0, A_DEFFLOAT, 0);
     CLASS_MAINSIGNALIN(osc_class, t_osc, x_f);
+    class_setdspflags(osc_class, CLASS_SCALARIN);
     class_addmethod(osc_class, (t_method)osc_dsp, gensym("dsp"), A_CANT, 0);
     class_addmethod(osc_class, (t_method)osc_ft1, gensym("ft1"), A_FLOAT, 0);
 
     cos_maketable();
 }
 
+/* ------------------------ oscbank~ ----------------------------- */
+
+/* oscbank~ computes many sinusoids at once and outputs their sum, for
+additive synthesis with hundreds or thousands of partials.  The phases,
+increments and amplitudes are kept in separate arrays, so that the inner loop
+runs through each group of four partials for a whole block before moving on
+to the next group.  Phases are 32-bit integers with 2^32 to the cycle, good to
+about 1e-5 Hz; the cosine comes out of a polynomial instead of a table lookup,
+so it needs no gathering and is accurate to about 1e-7.  Frequencies in Hz and
+amplitudes can be set by message or read from a pair of arrays each block.
+Amplitudes are interpolated over the block to avoid clicks. */
+
+static t_class *oscbank_class;
+
+typedef struct _oscbank
+{
+    t_object x_obj;
+    int x_n;                /* number of partials */
+    int x_nalloc;           /* same, rounded up to a multiple of 4 */
+    int x_auto;             /* take the number of partials from the array */
+    uint32_t *x_phase;      /* phase, 2^32 to the cycle */
+    uint32_t *x_inc;        /* phase increment per sample */
+    t_float *x_freq;        /* frequencies in Hz, unless from an array */
+    t_float *x_amp;         /* amplitudes, same */
+    t_float *x_curamp;      /* amplitudes at the end of the last block */
+    t_float *x_acc;         /* per-group sums for the SIMD loop */
+    int x_accsize;
+    double x_isr;
+    t_symbol *x_freqname;   /* arrays, if any, to read frequencies */
+    t_symbol *x_ampname;    /* and amplitudes from */
+    t_word *x_freqvec;
+    t_word *x_ampvec;
+    int x_nfreqvec;
+    int x_nampvec;
+} t_oscbank;
+
+    /* sin(2 pi r) for r in [-1/4, 1/4], fit to within 4e-9 */
+#define OSCBANK_S1 6.283185160088768f
+#define OSCBANK_S3 -41.341655031463375f
+#define OSCBANK_S5 81.6010040816886f
+#define OSCBANK_S7 -76.54978254691216f
+#define OSCBANK_S9 39.536708217816546f
+
+static void oscbank_resize(t_oscbank *x, int n)
+{
+    int nalloc = (n + 3) & ~3, i;
+    if (nalloc != x->x_nalloc)
+    {
+        x->x_phase = (uint32_t *)resizebytes(x->x_phase,
+            x->x_nalloc * sizeof(uint32_t), nalloc * sizeof(uint32_t));
+        x->x_inc = (uint32_t *)resizebytes(x->x_inc,
+            x->x_nalloc * sizeof(uint32_t), nalloc * sizeof(uint32_t));
+        x->x_freq = (t_float *)resizebytes(x->x_freq,
+            x->x_nalloc * sizeof(t_float), nalloc * sizeof(t_float));
+        x->x_amp = (t_float *)resizebytes(x->x_amp,
+            x->x_nalloc * sizeof(t_float), nalloc * sizeof(t_float));
+        x->x_curamp = (t_float *)resizebytes(x->x_curamp,
+            x->x_nalloc * sizeof(t_float), nalloc * sizeof(t_float));
+        x->x_nalloc = nalloc;
+    }
+        /* the partials past the last compute silence */
+    for (i = n; i < nalloc; i++)
+    {
+        x->x_phase[i] = x->x_inc[i] = 0;
+        x->x_freq[i] = x->x_amp[i] = x->x_curamp[i] = 0;
+    }
+    x->x_n = n;
+}
+
+static t_word *oscbank_findarray(t_oscbank *x, t_symbol *s, int *npoints)
+{
+    t_garray *a;
+    t_word *vec;
+    if (!*s->s_name)
+        return (0);
+    if (!(a = (t_garray *)pd_findbyclass(s, garray_class)))
+    {
+        pd_error(x, "oscbank~: %s: no such array", s->s_name);
+        return (0);
+    }
+    if (!garray_getfloatwords(a, npoints, &vec))
+    {
+        pd_error(x, "%s: bad template for oscbank~", s->s_name);
+        return (0);
+    }
+    garray_usedindsp(a);
+    return (vec);
+}
+
+static void oscbank_set(t_oscbank *x, t_symbol *freqname, t_symbol *ampname)
+{
+    x->x_freqname = freqname;
+    x->x_ampname = ampname;
+    x->x_freqvec = oscbank_findarray(x, freqname, &x->x_nfreqvec);
+    x->x_ampvec = oscbank_findarray(x, ampname, &x->x_nampvec);
+    if (x->x_auto && x->x_freqvec)
+        oscbank_resize(x, x->x_nfreqvec);
+}
+
+static void oscbank_n(t_oscbank *x, t_floatarg f)
+{
+    int n = (f < 0 ? 0 : f);
+    x->x_auto = 0;
+    oscbank_resize(x, n);
+}
+
+    /* "freq", "amp" and "phase" set values starting from a partial number */
+static int oscbank_getindex(t_oscbank *x, const char *what,
+    int argc, t_atom *argv)
+{
+    int i = atom_getfloatarg(0, argc, argv);
+    if (argc < 1 || i < 0 || i >= x->x_n)
+    {
+        pd_error(x, "oscbank~: %s: partial number out of range", what);
+        return (-1);
+    }
+    return (i);
+}
+
+static void oscbank_freq(t_oscbank *x, t_symbol *s, int argc, t_atom *argv)
+{
+    int i = oscbank_getindex(x, "freq", argc, argv), j;
+    if (i < 0)
+        return;
+    for (j = 1; j < argc && i < x->x_n; j++, i++)
+        x->x_freq[i] = atom_getfloat(argv + j);
+}
+
+static void oscbank_amp(t_oscbank *x, t_symbol *s, int argc, t_atom *argv)
+{
+    int i = oscbank_getindex(x, "amp", argc, argv), j;
+    if (i < 0)
+        return;
+    for (j = 1; j < argc && i < x->x_n; j++, i++)
+        x->x_amp[i] = atom_getfloat(argv + j);
+}
+
+static uint32_t oscbank_tophase(double f)
+{
+    double u = (f - floor(f)) * 4294967296.;
+    return (u >= 0 && u < 4294967296. ? (uint32_t)u : 0);
+}
+
+    /* "phase" alone puts all partials back to zero phase */
+static void oscbank_phase(t_oscbank *x, t_symbol *s, int argc, t_atom *argv)
+{
+    int i, j;
+    if (!argc)
+    {
+        for (i = 0; i < x->x_n; i++)
+            x->x_phase[i] = 0;
+        return;
+    }
+    if ((i = oscbank_getindex(x, "phase", argc, argv)) < 0)
+        return;
+    for (j = 1; j < argc && i < x->x_n; j++, i++)
+        x->x_phase[i] = oscbank_tophase(atom_getfloat(argv + j));
+}
+
+    /* get this block's increments, and target amplitudes from the array */
+static void oscbank_update(t_oscbank *x)
+{
+    int i, n = x->x_n;
+    for (i = 0; i < n; i++)
+    {
+        double f = (x->x_freqvec ? (i < x->x_nfreqvec ?
+            x->x_freqvec[i].w_float : 0) : x->x_freq[i]);
+        x->x_inc[i] = oscbank_tophase(f * x->x_isr);
+    }
+    if (x->x_ampvec)
+        for (i = 0; i < n; i++)
+            x->x_amp[i] = (i < x->x_nampvec ? x->x_ampvec[i].w_float : 0);
+}
+
+static t_int *oscbank_perform(t_int *w)
+{
+    t_oscbank *x = (t_oscbank *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    int n = (int)(w[3]), i, k;
+    t_float ninv = 1.f / n;
+
+    oscbank_update(x);
+    for (i = 0; i < n; i++)
+        out[i] = 0;
+    for (k = 0; k < x->x_nalloc; k++)
+    {
+        uint32_t phase = x->x_phase[k], inc = x->x_inc[k];
+        t_float a = x->x_curamp[k], da = (x->x_amp[k] - a) * ninv;
+        if (a == 0 && da == 0)
+        {
+            x->x_phase[k] = phase + n * inc;
+            continue;
+        }
+        for (i = 0; i < n; i++, phase += inc, a += da)
+        {
+            t_float r = 0.25f - fabsf((int32_t)phase * (1.f / 4294967296.f)),
+                r2 = r * r;
+            out[i] += a * r * (OSCBANK_S1 + r2 * (OSCBANK_S3 + r2 *
+                (OSCBANK_S5 + r2 * (OSCBANK_S7 + r2 * OSCBANK_S9))));
+        }
+        x->x_phase[k] = phase;
+        x->x_curamp[k] = x->x_amp[k];
+    }
+    return (w+4);
+}
+
+#ifdef COS_SSE
+    /* four partials at a time; each lane gets summed into x_acc, four floats
+    per sample, and the lanes are added together at the end */
+static t_int *oscbank_perf_sse(t_int *w)
+{
+    t_oscbank *x = (t_oscbank *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    int n = (int)(w[3]), i, k;
+    float *acc = x->x_acc;
+    const __m128 ninv = _mm_set1_ps(1.f / n),
+        scale = _mm_set1_ps(1.f / 4294967296.f), quarter = _mm_set1_ps(0.25f),
+        absmask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff)),
+        s1 = _mm_set1_ps(OSCBANK_S1), s3 = _mm_set1_ps(OSCBANK_S3),
+        s5 = _mm_set1_ps(OSCBANK_S5), s7 = _mm_set1_ps(OSCBANK_S7),
+        s9 = _mm_set1_ps(OSCBANK_S9);
+
+    oscbank_update(x);
+    for (i = 0; i < 4 * n; i += 4)
+        _mm_storeu_ps(acc + i, _mm_setzero_ps());
+    for (k = 0; k < x->x_nalloc; k += 4)
+    {
+        __m128i phase = _mm_loadu_si128((__m128i *)(x->x_phase + k)),
+            inc = _mm_loadu_si128((__m128i *)(x->x_inc + k));
+        __m128 a = _mm_loadu_ps(x->x_curamp + k),
+            target = _mm_loadu_ps(x->x_amp + k),
+            da = _mm_mul_ps(_mm_sub_ps(target, a), ninv);
+        if (!(_mm_movemask_ps(_mm_cmpneq_ps(a, _mm_setzero_ps())) |
+            _mm_movemask_ps(_mm_cmpneq_ps(target, _mm_setzero_ps()))))
+        {
+            for (i = k; i < k + 4; i++)
+                x->x_phase[i] += n * x->x_inc[i];
+            continue;
+        }
+        for (i = 0; i < 4 * n; i += 4)
+        {
+            __m128 r = _mm_sub_ps(quarter, _mm_and_ps(_mm_mul_ps(
+                _mm_cvtepi32_ps(phase), scale), absmask)),
+                r2 = _mm_mul_ps(r, r), y;
+            y = _mm_add_ps(s7, _mm_mul_ps(r2, s9));
+            y = _mm_add_ps(s5, _mm_mul_ps(r2, y));
+            y = _mm_add_ps(s3, _mm_mul_ps(r2, y));
+            y = _mm_add_ps(s1, _mm_mul_ps(r2, y));
+            y = _mm_mul_ps(_mm_mul_ps(r, y), a);
+            _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), y));
+            phase = _mm_add_epi32(phase, inc);
+            a = _mm_add_ps(a, da);
+        }
+        _mm_storeu_si128((__m128i *)(x->x_phase + k), phase);
+        _mm_storeu_ps(x->x_curamp + k, target);
+    }
+    for (i = 0; i < n; i++, acc += 4)
+        out[i] = (acc[0] + acc[1]) + (acc[2] + acc[3]);
+    return (w+4);
+}
+#endif
+
+static void oscbank_dsp(t_oscbank *x, t_signal **sp)
+{
+    int n = sp[0]->s_n;
+    x->x_isr = 1. / sp[0]->s_sr;
+    oscbank_set(x, x->x_freqname, x->x_ampname);
+#ifdef COS_SSE
+    if (x->x_accsize != 4 * n)
+    {
+        x->x_acc = (t_float *)resizebytes(x->x_acc,
+            x->x_accsize * sizeof(t_float), 4 * n * sizeof(t_float));
+        x->x_accsize = 4 * n;
+    }
+    dsp_add(oscbank_perf_sse, 3, x, sp[0]->s_vec, n);
+#else
+    dsp_add(oscbank_perform, 3, x, sp[0]->s_vec, n);
+#endif
+}
+
+static void *oscbank_new(t_symbol *s, int argc, t_atom *argv)
+{
+    t_oscbank *x = (t_oscbank *)pd_new(oscbank_class);
+    int n = 0;
+    x->x_auto = 1;
+    if (argc && argv->a_type == A_FLOAT)
+    {
+        n = atom_getfloat(argv);
+        x->x_auto = 0;
+        argc--, argv++;
+    }
+    x->x_freqname = atom_getsymbolarg(0, argc, argv);
+    x->x_ampname = atom_getsymbolarg(1, argc, argv);
+    if (!*x->x_freqname->s_name)
+        x->x_auto = 0;
+    oscbank_resize(x, (n < 0 ? 0 : n));
+    x->x_isr = 1. / 44100.;
+    outlet_new(&x->x_obj, gensym("signal"));
+    return (x);
+}
+
+static void oscbank_free(t_oscbank *x)
+{
+    freebytes(x->x_phase, x->x_nalloc * sizeof(uint32_t));
+    freebytes(x->x_inc, x->x_nalloc * sizeof(uint32_t));
+    freebytes(x->x_freq, x->x_nalloc * sizeof(t_float));
+    freebytes(x->x_amp, x->x_nalloc * sizeof(t_float));
+    freebytes(x->x_curamp, x->x_nalloc * sizeof(t_float));
+    if (x->x_acc)
+        freebytes(x->x_acc, x->x_accsize * sizeof(t_float));
+}
+
+static void oscbank_setup(void)
+{
+    oscbank_class = class_new(gensym("oscbank~"), (t_newmethod)oscbank_new,
+        (t_method)oscbank_free, sizeof(t_oscbank), 0, A_GIMME, 0);
+    class_addmethod(oscbank_class, (t_method)oscbank_dsp,
+        gensym("dsp"), A_CANT, 0);
+    class_addmethod(oscbank_class, (t_method)oscbank_n,
+        gensym("n"), A_FLOAT, 0);
+    class_addmethod(oscbank_class, (t_method)oscbank_freq,
+        gensym("freq"), A_GIMME, 0);
+    class_addmethod(oscbank_class, (t_method)oscbank_amp,
+        gensym("amp"), A_GIMME, 0);
+    class_addmethod(oscbank_class, (t_method)oscbank_phase,
+        gensym("phase"), A_GIMME, 0);
+    class_addmethod(oscbank_class, (t_method)oscbank_set,
+        gensym("set"), A_DEFSYM, A_DEFSYM, 0);
+}
+
 /* ---- vcf~ - resonant filter with audio-rate center frequency input ----- */
 
 typedef struct vcfctl
@@ -486,19 +1141,73 @@ static void *noise_new(void)
     return (x);
 }
 
+    /* noise~ is a linear congruential generator; the state is unsigned
+    so that it wraps around cleanly. The SSE2 code below gives the same
+    sequence eight samples at a time, keeping eight consecutive states in
+    two vectors and stepping each one eight places ahead with the
+    multiplier and increment for eight steps, computed at setup. */
+#define NOISE_MUL 435898247u
+#define NOISE_ADD 382842987u
+
+#if PD_FLOATSIZE == 32 && (defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define NOISE_SSE
+#include <emmintrin.h>
+
+static unsigned int noise_mul8, noise_add8;
+
+    /* low 32 bits of the product of each pair of the four lanes */
+static inline __m128i noise_mullo(__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b),
+        odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+    return (_mm_unpacklo_epi32(
+        _mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+            _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0))));
+}
+
+static inline __m128 noise_tosample(__m128i v)
+{
+    return (_mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(
+        _mm_and_si128(v, _mm_set1_epi32(0x7fffffff)),
+            _mm_set1_epi32(0x40000000))), _mm_set1_ps(1.0f / 0x40000000)));
+}
+#endif /* NOISE_SSE */
+
 static t_int *noise_perform(t_int *w)
 {
     t_sample *out = (t_sample *)(w[1]);
     int *vp = (int *)(w[2]);
     int n = (int)(w[3]);
-    int val = *vp;
+    unsigned int val = *vp;
+#ifdef NOISE_SSE
+    if (n >= 8)
+    {
+        unsigned int v[8];
+        int i;
+        __m128i lo, hi, mul = _mm_set1_epi32(noise_mul8),
+            add = _mm_set1_epi32(noise_add8);
+        for (i = 0; i < 8; i++)
+            v[i] = val, val = val * NOISE_MUL + NOISE_ADD;
+        lo = _mm_loadu_si128((__m128i *)v);
+        hi = _mm_loadu_si128((__m128i *)(v + 4));
+        for (; n >= 8; n -= 8, out += 8)
+        {
+            _mm_storeu_ps(out, noise_tosample(lo));
+            _mm_storeu_ps(out + 4, noise_tosample(hi));
+            lo = _mm_add_epi32(noise_mullo(lo, mul), add);
+            hi = _mm_add_epi32(noise_mullo(hi, mul), add);
+        }
+        val = (unsigned int)_mm_cvtsi128_si32(lo);
+    }
+#endif
     while (n--)
     {
-        *out++ = ((t_sample)((val & 0x7fffffff) - 0x40000000)) *
+        *out++ = ((t_sample)((int)(val & 0x7fffffff) - 0x40000000)) *
             (t_sample)(1.0 / 0x40000000);
-        val = val * 435898247 + 382842987;
+        val = val * NOISE_MUL + NOISE_ADD;
     }
-    *vp = val;
+    *vp = (int)val;
     return (w+4);
 }
 
@@ -515,6 +1224,15 @@ static void noise_float(t_noise *x, t_float f)
 
 static void noise_setup(void)
 {
+#ifdef NOISE_SSE
+    int i;
+    noise_mul8 = 1, noise_add8 = 0;
+    for (i = 0; i < 8; i++)
+    {
+        noise_mul8 *= NOISE_MUL;
+        noise_add8 = noise_add8 * NOISE_MUL + NOISE_ADD;
+    }
+#endif
     noise_class = class_new(gensym("noise~"), (t_newmethod)noise_new, 0,
         sizeof(t_noise), 0, A_DEFFLOAT, 0);
     class_addmethod(noise_class, (t_method)noise_dsp,
@@ -529,6 +1247,7 @@ void d_osc_setup(void)
     phasor_setup();
     cos_setup();
     osc_setup();
+    oscbank_setup();
     sigvcf_setup();
     noise_setup();
 }
@@ -4,6 +4,22 @@
 
 
 #include "m_pd.h"
+#include <math.h>
+#include <string.h>
+
+#if PD_FLOATSIZE == 32 && (defined(__SSE__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#define RESAMPLE_SSE
+#include <xmmintrin.h>
+#endif
+
+    /* "high" quality resampling uses a Kaiser-windowed sinc lowpass with
+    RESAMPLE_FIRTAPS taps per polyphase branch, so the whole prototype
+    filter is RESAMPLE_FIRTAPS times the up- or downsampling factor long.
+    Must be a multiple of 4 for the SSE dot product. */
+#define RESAMPLE_FIRTAPS 32
+#define RESAMPLE_FIRCUTOFF 0.45  /* passband edge re the lower Nyquist */
+#define RESAMPLE_FIRBETA 8.0     /* Kaiser window shape, ~80 dB stopband */
 
 /* --------------------- up/down-sampling --------------------- */
 t_int *downsampling_perform_0(t_int *w)
@@ -97,6 +113,137 @@ t_int *upsampling_perform_linear(t_int *w)
   return (w+6);
 }
 
+    /* dot product of two vectors; n is a multiple of 4 */
+static t_sample resample_dot(const t_sample *a, const t_sample *b, int n)
+{
+#ifdef RESAMPLE_SSE
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+    float sum[4];
+    for (; n >= 8; n -= 8, a += 8, b += 8)
+    {
+        acc0 = _mm_add_ps(acc0,
+            _mm_mul_ps(_mm_loadu_ps(a), _mm_loadu_ps(b)));
+        acc1 = _mm_add_ps(acc1,
+            _mm_mul_ps(_mm_loadu_ps(a + 4), _mm_loadu_ps(b + 4)));
+    }
+    if (n)
+        acc0 = _mm_add_ps(acc0,
+            _mm_mul_ps(_mm_loadu_ps(a), _mm_loadu_ps(b)));
+    _mm_storeu_ps(sum, _mm_add_ps(acc0, acc1));
+    return ((sum[0] + sum[1]) + (sum[2] + sum[3]));
+#else
+    t_sample s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    for (; n; n -= 4, a += 4, b += 4)
+    {
+        s0 += a[0] * b[0];
+        s1 += a[1] * b[1];
+        s2 += a[2] * b[2];
+        s3 += a[3] * b[3];
+    }
+    return ((s0 + s1) + (s2 + s3));
+#endif
+}
+
+    /* polyphase FIR upsampling.  "buffer" holds RESAMPLE_FIRTAPS-1 samples
+    of input history followed by room for one input block; "coeffs" holds
+    one reversed branch of the prototype filter per output phase. */
+t_int *upsampling_perform_fir(t_int *w)
+{
+  t_resample *x= (t_resample *)(w[1]);
+  t_sample *in  = (t_sample *)(w[2]); /* original signal     */
+  t_sample *out = (t_sample *)(w[3]); /* upsampled signal    */
+  int up       = (int)(w[4]);       /* upsampling factor   */
+  int parent   = (int)(w[5]);       /* original vectorsize */
+  t_sample *hist = x->buffer;
+  int n, p;
+
+  memcpy(hist + (RESAMPLE_FIRTAPS-1), in, parent * sizeof(*in));
+  for (n = 0; n < parent; n++, hist++) {
+    t_sample *cp = x->coeffs;
+    for (p = 0; p < up; p++, cp += RESAMPLE_FIRTAPS)
+      *out++ = resample_dot(hist, cp, RESAMPLE_FIRTAPS);
+  }
+  memmove(x->buffer, x->buffer + parent,
+    (RESAMPLE_FIRTAPS-1) * sizeof(*x->buffer));
+  return (w+6);
+}
+
+    /* FIR decimation: the full prototype filter is evaluated only at the
+    output samples.  "buffer" holds coefsize-1 samples of history. */
+t_int *downsampling_perform_fir(t_int *w)
+{
+  t_resample *x= (t_resample *)(w[1]);
+  t_sample *in  = (t_sample *)(w[2]); /* original signal     */
+  t_sample *out = (t_sample *)(w[3]); /* downsampled signal  */
+  int down     = (int)(w[4]);       /* downsampling factor */
+  int parent   = (int)(w[5]);       /* original vectorsize */
+  int ncoef = x->coefsize, n = parent/down;
+  t_sample *hist = x->buffer + (down - 1);
+
+  memcpy(x->buffer + (ncoef-1), in, parent * sizeof(*in));
+  while (n--) {
+    *out++ = resample_dot(hist, x->coeffs, ncoef);
+    hist += down;
+  }
+  memmove(x->buffer, x->buffer + parent, (ncoef-1) * sizeof(*x->buffer));
+  return (w+6);
+}
+
+static double resample_bessel0(double x)
+{
+  double sum = 1, term = 1, q = x * x * 0.25;
+  int k;
+  for (k = 1; k < 50 && term > sum * 1e-12; k++)
+    sum += (term *= q / ((double)k * k));
+  return (sum);
+}
+
+    /* design the prototype lowpass for a given factor and lay it out for
+    the direction we're going in, and size the history buffer to match.
+    Upsampling stores one reversed branch per output phase, scaled by the
+    factor to make up for the inserted zeros; downsampling just stores the
+    (symmetric) filter. */
+static void resample_firsetup(t_resample *x, int factor, int insize, int up)
+{
+  int ncoef = factor * RESAMPLE_FIRTAPS, i, p, j;
+  int nbuf = (up ? RESAMPLE_FIRTAPS : ncoef) - 1 + insize;
+  double fc = RESAMPLE_FIRCUTOFF / factor, center = 0.5 * (ncoef - 1),
+    norm = 1. / resample_bessel0(RESAMPLE_FIRBETA), sum = 0;
+  double *h = (double *)t_getbytes(ncoef * sizeof(*h));
+
+  for (i = 0; i < ncoef; i++) {
+    double t = i - center, r = t / center, sinc = 2 * fc;
+    if (t != 0)
+      sinc = sin(2 * 3.14159265358979 * fc * t) / (3.14159265358979 * t);
+    h[i] = sinc * norm *
+      resample_bessel0(RESAMPLE_FIRBETA * sqrt(1 - r * r));
+    sum += h[i];
+  }
+  if (x->coefsize != ncoef) {
+    if (x->coefsize)
+      t_freebytes(x->coeffs, x->coefsize*sizeof(*x->coeffs));
+    x->coefsize = ncoef;
+    x->coeffs = (t_sample *)t_getbytes(ncoef*sizeof(*x->coeffs));
+  }
+  if (up) {
+    for (p = 0; p < factor; p++)
+      for (j = 0; j < RESAMPLE_FIRTAPS; j++)
+        x->coeffs[p * RESAMPLE_FIRTAPS + j] =
+          h[p + (RESAMPLE_FIRTAPS - 1 - j) * factor] * factor / sum;
+  } else {
+    for (i = 0; i < ncoef; i++)
+      x->coeffs[i] = h[i] / sum;
+  }
+  t_freebytes(h, ncoef * sizeof(*h));
+  if (x->bufsize != nbuf) {
+    if (x->bufsize)
+      t_freebytes(x->buffer, x->bufsize*sizeof(*x->buffer));
+    x->bufsize = nbuf;
+    x->buffer = (t_sample *)t_getbytes(nbuf*sizeof(*x->buffer));
+    memset(x->buffer, 0, nbuf*sizeof(*x->buffer));
+  }
+}
+
 /* ----------------------- public -------------------------------- */
 
 /* utils */
@@ -140,6 +287,10 @@ void resample_dsp(t_resample *x,
       return;
     }
     switch (method) {
+    case 4:
+      resample_firsetup(x, insize/outsize, insize, 0);
+      dsp_add(downsampling_perform_fir, 5, x, in, out, insize/outsize, insize);
+      break;
     default:
       dsp_add(downsampling_perform_0, 4, in, out, insize/outsize, insize);
     }
@@ -162,6 +313,10 @@ void resample_dsp(t_resample *x,
       }
       dsp_add(upsampling_perform_linear, 5, x, in, out, outsize/insize, insize);
       break;
+    case 4:
+      resample_firsetup(x, outsize/insize, insize, 1);
+      dsp_add(upsampling_perform_fir, 5, x, in, out, outsize/insize, insize);
+      break;
     default:
       dsp_add(upsampling_perform_0, 4, in, out, outsize/insize, insize);
     }
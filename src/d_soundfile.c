@@ -11,6 +11,9 @@ readsf~ and writesf~ are defined which confine disk operations to a separate
 thread so that they can be used in real time.  The readsf~ and writesf~
 objects use Posix-like threads.  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE     /* for O_DIRECT and fallocate() */
+#endif
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
@@ -21,17 +24,38 @@ objects use Posix-like threads.  */
 #include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 #include <errno.h>
 #include <math.h>
 #include <limits.h>
+#ifndef _WIN32
+#define SOUNDFILE_MMAP
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/vfs.h>
+#endif
+#ifdef __APPLE__
+#include <sys/param.h>
+#include <sys/mount.h>
+#endif
+#endif
 
 #include "m_pd.h"
+#include "s_stuff.h"
 
 #define MAXSFCHANS 64
 
 #ifdef _LARGEFILE64_SOURCE
 # define open open64
 # define lseek lseek64
+# define fstat fstat64
+# define stat stat64
+# define mmap mmap64
+#ifdef __linux__
+# define fallocate fallocate64
+#endif
 #define off_t __off64_t
 #endif
 
@@ -54,6 +78,9 @@ typedef union _floatuint {
 #define FORMAT_WAVE 0
 #define FORMAT_AIFF 1
 #define FORMAT_NEXT 2
+#define FORMAT_W64 3
+
+#define SFMAXLENGTH LONG_MAX    /* byte or frame count when there's no limit */
 
 /* the NeXTStep sound header structure; can be big or little endian  */
 
@@ -116,6 +143,48 @@ typedef struct _wavechunk           /* ... and the last two items */
 #define WAV_INT 1
 #define WAV_FLOAT 3
 
+/* Wave files bigger than 4 GB are written as RF64 (EBU Tech 3306): "RIFF"
+becomes "RF64", the 32-bit sizes are set to 0xffffffff, and the real ones go
+in a "ds64" chunk right after "WAVE".  When we don't know how big a file
+will get, we write a "JUNK" chunk of the same size there, which is changed
+into "ds64" when the file gets too big.  "BW64" (ITU BS.2088) is the same
+thing as far as we're concerned.  The 64-bit numbers are split into
+halves so that the structure has no padding. */
+
+typedef struct _ds64
+{
+    char  d_id[4];                  /* chunk id 'ds64' or 'JUNK'  */
+    uint32_t d_size;                /* chunk size, 28             */
+    uint32_t d_riffsizelo;          /* size of the RF64 chunk     */
+    uint32_t d_riffsizehi;
+    uint32_t d_datasizelo;          /* size of the data chunk     */
+    uint32_t d_datasizehi;
+    uint32_t d_nframeslo;           /* number of sample frames    */
+    uint32_t d_nframeshi;
+    uint32_t d_tablelength;         /* entries in a table we don't write */
+} t_ds64;
+
+#define WAVEBIGHDRSIZE (sizeof(t_wave) + sizeof(t_ds64))
+
+/* Sony Wave64 files are laid out like wave files, but chunks are named by
+16-byte GUIDs and have 64-bit sizes that count the 24-byte chunk header.
+Chunks are padded to 8 bytes.  We write a "riff" header, a "fmt " chunk
+holding a t_fmt, and the "data" chunk header, for W64HDRSIZE bytes. */
+
+#define W64GUIDSIZE 16
+#define W64CHUNKSIZE 24             /* GUID and 64-bit size */
+#define W64HDRSIZE (W64CHUNKSIZE + W64GUIDSIZE + W64CHUNKSIZE + \
+    sizeof(t_fmt) + W64CHUNKSIZE)
+
+static const unsigned char w64_riff[W64GUIDSIZE] = {'r', 'i', 'f', 'f',
+    0x2e, 0x91, 0xcf, 0x11, 0xa5, 0xd6, 0x28, 0xdb, 0x04, 0xc1, 0x00, 0x00};
+static const unsigned char w64_wave[W64GUIDSIZE] = {'w', 'a', 'v', 'e',
+    0xf3, 0xac, 0xd3, 0x11, 0x8c, 0xd1, 0x00, 0xc0, 0x4f, 0x8e, 0xdb, 0x8a};
+static const unsigned char w64_fmt[W64GUIDSIZE] = {'f', 'm', 't', ' ',
+    0xf3, 0xac, 0xd3, 0x11, 0x8c, 0xd1, 0x00, 0xc0, 0x4f, 0x8e, 0xdb, 0x8a};
+static const unsigned char w64_data[W64GUIDSIZE] = {'d', 'a', 't', 'a',
+    0xf3, 0xac, 0xd3, 0x11, 0x8c, 0xd1, 0x00, 0xc0, 0x4f, 0x8e, 0xdb, 0x8a};
+
 /* the AIFF header.  I'm assuming AIFC is compatible but don't really know
     that. */
 
@@ -155,8 +224,9 @@ typedef struct _aiff
 #define AIFFPLUS (AIFFHDRSIZE + 16)  /* header size including SSND chunk hdr */
 
 #define WHDR1 sizeof(t_nextstep)
-#define WHDR2 (sizeof(t_wave) > WHDR1 ? sizeof (t_wave) : WHDR1)
-#define WRITEHDRSIZE (AIFFPLUS > WHDR2 ? AIFFPLUS : WHDR2)
+#define WHDR2 (WAVEBIGHDRSIZE > WHDR1 ? WAVEBIGHDRSIZE : WHDR1)
+#define WHDR3 (W64HDRSIZE > WHDR2 ? W64HDRSIZE : WHDR2)
+#define WRITEHDRSIZE (AIFFPLUS > WHDR3 ? AIFFPLUS : WHDR3)
 
 #define READHDRSIZE (16 > WHDR2 + 2 ? 16 : WHDR2 + 2)
 
@@ -240,6 +310,15 @@ typedef struct _soundfile_info
     long bytelimit;
 } t_soundfile_info;
 
+    /* part of a soundfile mapped into memory; see soundfile_map() */
+typedef struct _sfmap
+{
+    void *m_base;           /* start of the mapping, or 0 if none */
+    size_t m_size;          /* size of the mapping */
+    char *m_data;           /* first byte of the frames wanted */
+    long m_nframes;         /* number of frames mapped */
+} t_sfmap;
+
 static void outlet_soundfile_info(t_outlet *out, t_soundfile_info *info)
 {
     t_atom info_list[5];
@@ -251,20 +330,695 @@ static void outlet_soundfile_info(t_outlet *out, t_soundfile_info *info)
     outlet_list(out, &s_list, 5, (t_atom *)info_list);
 }
 
+/********************** decoded (compressed) soundfiles ******************/
+
+/* Compressed soundfiles are read through a "codec" which decodes them on the
+fly, so that to the rest of this file they look like headerless little-endian
+PCM in the format given in their t_soundfile_info.  The decoder hangs off the
+file descriptor, so sample data must be read with soundfile_read() and the
+file closed with soundfile_close(): a plain read() would see the compressed
+bytes.  Decoding happens in whichever thread reads the file (a readsf~ I/O
+thread, a soundfiler loader, or soundfiler itself), never in the DSP thread.
+To teach Pd another format, write a t_sfcodec and add it to sfcodec_list. */
+
+typedef struct _sfcodec
+{
+    const char *c_name;
+        /* true if the first "n" bytes of a file look like ours */
+    int (*c_probe)(const unsigned char *buf, long n);
+        /* read the header from the start of the file and fill in "info";
+        returns the decoder's state, or 0 (with errno set) on failure */
+    void *(*c_open)(int fd, t_soundfile_info *info);
+        /* skip the first "nframes" frames; returns -1 on failure */
+    int (*c_skip)(void *state, long nframes);
+        /* get up to "nbytes" of decoded samples, like read() */
+    long (*c_read)(void *state, char *buf, long nbytes);
+    void (*c_close)(void *state);
+} t_sfcodec;
+
+typedef struct _sfdecoder
+{
+    struct _sfdecoder *d_next;
+    int d_fd;
+    const t_sfcodec *d_codec;
+    void *d_state;
+} t_sfdecoder;
+
+static pthread_mutex_t sfcodec_mutex = PTHREAD_MUTEX_INITIALIZER;
+static t_sfdecoder *sfcodec_decoders;   /* files now open through a codec */
+
+static t_sfdecoder *soundfile_decoder(int fd)
+{
+    t_sfdecoder *d;
+    pthread_mutex_lock(&sfcodec_mutex);
+    for (d = sfcodec_decoders; d; d = d->d_next)
+        if (d->d_fd == fd)
+            break;
+    pthread_mutex_unlock(&sfcodec_mutex);
+    return (d);
+}
+
+    /* read sample data from a soundfile opened by open_soundfile_via_fd() */
+static long soundfile_read(int fd, void *buf, long nbytes)
+{
+    t_sfdecoder *d = soundfile_decoder(fd);
+    if (d)
+        return ((*d->d_codec->c_read)(d->d_state, (char *)buf, nbytes));
+    else return (read(fd, buf, nbytes));
+}
+
+    /* close a soundfile opened by open_soundfile_via_fd() */
+static void soundfile_close(int fd)
+{
+    t_sfdecoder *d, **dp;
+    pthread_mutex_lock(&sfcodec_mutex);
+    for (dp = &sfcodec_decoders; (d = *dp); dp = &d->d_next)
+        if (d->d_fd == fd)
+    {
+        *dp = d->d_next;
+        break;
+    }
+    pthread_mutex_unlock(&sfcodec_mutex);
+    if (d)
+    {
+        (*d->d_codec->c_close)(d->d_state);
+        freebytes(d, sizeof(*d));
+    }
+    sys_close(fd);
+}
+
+/* FLAC.  This is a plain decoder following the format description at
+xiph.org; it handles everything the reference encoder writes for 4 to 24
+bits per sample and up to 8 channels.  Checksums aren't verified.  Skipping
+uses the seek table if there is one, then decodes up to the onset. */
+
+#define FLACINSIZE 65536        /* bytes of compressed data read at once */
+#define FLACMAXCHANS 8
+
+typedef struct _flac
+{
+    int f_fd;
+    unsigned char f_in[FLACINSIZE];
+    int f_inpos, f_inlen;       /* unused part of f_in */
+    uint64_t f_bits;            /* bit reservoir, next bit at the top */
+    int f_nbits;
+    int f_error;                /* ran out of data, or the data was bad */
+    int f_channels;
+    int f_bitspersample;
+    int f_samplerate;
+    int f_maxblocksize;
+    long f_totalframes;         /* 0 if unknown */
+    off_t f_firstframe;         /* file offset of the first frame */
+    int f_nseek;                /* seek table as sample numbers and offsets */
+    long *f_seekframe;
+    off_t *f_seekoffset;
+    int32_t *f_samples[FLACMAXCHANS];   /* the current block */
+    int f_blocksize;
+    int f_blockpos;             /* frames of the block already read */
+    long f_framepos;            /* frame number of the next block */
+    int f_outbytes;             /* bytes per decoded sample */
+    char f_pend[FLACMAXCHANS * 3];  /* a frame only partly read */
+    int f_pendpos, f_pendlen;
+} t_flac;
+
+static int flac_byte(t_flac *f)
+{
+    if (f->f_inpos == f->f_inlen)
+    {
+        long got = read(f->f_fd, f->f_in, FLACINSIZE);
+        if (got <= 0)
+            return (-1);
+        f->f_inlen = (int)got;
+        f->f_inpos = 0;
+    }
+    return (f->f_in[f->f_inpos++]);
+}
+
+    /* top up the bit reservoir; at the end of the file pad with zeros
+    and note the error if anyone asks for more bits than there are */
+static void flac_fill(t_flac *f, int n)
+{
+    int c;
+    while (f->f_nbits <= 56)
+    {
+        if ((c = flac_byte(f)) < 0)
+        {
+            if (f->f_nbits < n)
+            {
+                f->f_error = 1;
+                f->f_nbits = n;
+            }
+            return;
+        }
+        f->f_bits |= (uint64_t)c << (56 - f->f_nbits);
+        f->f_nbits += 8;
+    }
+}
+
+static uint32_t flac_bits(t_flac *f, int n)
+{
+    uint32_t v;
+    if (!n)
+        return (0);
+    if (f->f_nbits < n)
+        flac_fill(f, n);
+    v = (uint32_t)(f->f_bits >> (64 - n));
+    f->f_bits <<= n;
+    f->f_nbits -= n;
+    return (v);
+}
+
+static int32_t flac_sbits(t_flac *f, int n)
+{
+    uint32_t v = flac_bits(f, n);
+    if (n && n < 32 && (v & ((uint32_t)1 << (n - 1))))
+        v |= ~(uint32_t)0 << n;
+    return ((int32_t)v);
+}
+
+    /* count zero bits up to the next one bit, and eat them all */
+static uint32_t flac_unary(t_flac *f)
+{
+    uint32_t q = 0;
+    while (1)
+    {
+        if (!f->f_nbits)
+            flac_fill(f, 1);
+        if (f->f_bits)
+        {
+            int z = 0;
+#ifdef __GNUC__
+            z = __builtin_clzll(f->f_bits);
+#else
+            while (!(f->f_bits & ((uint64_t)1 << (63 - z))))
+                z++;
+#endif
+            if (z < f->f_nbits)
+            {
+                f->f_bits <<= z;
+                f->f_bits <<= 1;
+                f->f_nbits -= z + 1;
+                return (q + z);
+            }
+        }
+        q += f->f_nbits;
+        f->f_bits = 0;
+        f->f_nbits = 0;
+        if (f->f_error)
+            return (q);
+    }
+}
+
+    /* drop bits up to the next byte boundary */
+static void flac_align(t_flac *f)
+{
+    flac_bits(f, f->f_nbits & 7);
+}
+
+    /* skip "n" bytes, which must start at a byte boundary */
+static void flac_skipbytes(t_flac *f, long n)
+{
+    while (n > 0 && f->f_nbits)
+        flac_bits(f, 8), n--;
+    if (n <= f->f_inlen - f->f_inpos)
+        f->f_inpos += (int)n;
+    else
+    {
+        n -= f->f_inlen - f->f_inpos;
+        f->f_inpos = f->f_inlen = 0;
+        if (lseek(f->f_fd, n, SEEK_CUR) < 0)
+            f->f_error = 1;
+    }
+}
+
+    /* read the next byte at a byte boundary, or -1 at the end of file */
+static int flac_nextbyte(t_flac *f)
+{
+    if (f->f_nbits >= 8)
+        return (flac_bits(f, 8));
+    return (flac_byte(f));
+}
+
+static void flac_residual(t_flac *f, int32_t *out, int n, int order)
+{
+    int method = flac_bits(f, 2), porder, parambits, escape, p, i = order;
+    if (method > 1)
+    {
+        f->f_error = 1;
+        return;
+    }
+    parambits = (method ? 5 : 4);
+    escape = (1 << parambits) - 1;
+    porder = flac_bits(f, 4);
+    if ((n >> porder) << porder != n || (n >> porder) < order)
+    {
+        f->f_error = 1;
+        return;
+    }
+    for (p = 0; p < (1 << porder) && !f->f_error; p++)
+    {
+        int count = (n >> porder) - (p ? 0 : order),
+            k = flac_bits(f, parambits);
+        if (k == escape)
+        {
+            int nb = flac_bits(f, 5);
+            while (count--)
+                out[i++] = flac_sbits(f, nb);
+        }
+        else while (count--)
+        {
+            uint32_t v = (flac_unary(f) << k) | flac_bits(f, k);
+            out[i++] = (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+        }
+    }
+}
+
+static void flac_subframe(t_flac *f, int32_t *out, int n, int bps)
+{
+    int type, wasted = 0, order, i, j;
+    flac_bits(f, 1);
+    type = flac_bits(f, 6);
+    if (flac_bits(f, 1))
+        wasted = flac_unary(f) + 1;
+    if ((bps -= wasted) < 1)
+    {
+        f->f_error = 1;
+        return;
+    }
+    if (type == 0)
+    {
+        int32_t v = flac_sbits(f, bps);
+        for (i = 0; i < n; i++)
+            out[i] = v;
+    }
+    else if (type == 1)
+    {
+        for (i = 0; i < n; i++)
+            out[i] = flac_sbits(f, bps);
+    }
+    else if (type >= 8 && type <= 12)
+    {
+            /* fixed polynomial predictor */
+        if ((order = type - 8) > n)
+            goto bad;
+        for (i = 0; i < order; i++)
+            out[i] = flac_sbits(f, bps);
+        flac_residual(f, out, n, order);
+        for (i = order; i < n; i++)
+        {
+            int64_t pred = 0;
+            switch (order)
+            {
+            case 1: pred = out[i-1]; break;
+            case 2: pred = 2 * (int64_t)out[i-1] - out[i-2]; break;
+            case 3: pred = 3 * ((int64_t)out[i-1] - out[i-2]) + out[i-3];
+                break;
+            case 4: pred = 4 * ((int64_t)out[i-1] + out[i-3]) -
+                6 * (int64_t)out[i-2] - out[i-4]; break;
+            }
+            out[i] = (int32_t)(out[i] + pred);
+        }
+    }
+    else if (type >= 32)
+    {
+            /* linear predictor with quantized coefficients */
+        int32_t coefs[32];
+        int precision, shift;
+        if ((order = type - 31) > n)
+            goto bad;
+        for (i = 0; i < order; i++)
+            out[i] = flac_sbits(f, bps);
+        if ((precision = flac_bits(f, 4) + 1) == 16 ||
+            (shift = flac_sbits(f, 5)) < 0)
+                goto bad;
+        for (j = 0; j < order; j++)
+            coefs[j] = flac_sbits(f, precision);
+        flac_residual(f, out, n, order);
+        for (i = order; i < n; i++)
+        {
+            int64_t sum = 0;
+            for (j = 0; j < order; j++)
+                sum += (int64_t)coefs[j] * out[i - 1 - j];
+            out[i] = (int32_t)(out[i] + (sum >> shift));
+        }
+    }
+    else goto bad;
+    if (wasted)
+        for (i = 0; i < n; i++)
+            out[i] = (int32_t)((uint32_t)out[i] << wasted);
+    return;
+bad:
+    f->f_error = 1;
+}
+
+    /* decode the next block.  Returns 1 on success, 0 at the end of the
+    stream, and -1 if the data is bad. */
+static int flac_decodeframe(t_flac *f)
+{
+    static const int sizes[8] = {0, 8, 12, 0, 16, 20, 24, 0};
+    int c, bscode, srcode, chassign, bps, blocksize, ch, i;
+    int32_t *s0 = f->f_samples[0], *s1 = f->f_samples[1];
+    if (f->f_error)
+        return (-1);
+    if (f->f_totalframes && f->f_framepos >= f->f_totalframes)
+        return (0);
+    flac_align(f);
+        /* find the frame sync code 0xfff8 or 0xfff9 */
+    for (c = flac_nextbyte(f); ; )
+    {
+        if (c < 0)
+            return (0);
+        if (c == 0xff)
+        {
+            if (((c = flac_nextbyte(f)) & 0xfe) == 0xf8)
+                break;
+        }
+        else c = flac_nextbyte(f);
+    }
+    bscode = flac_bits(f, 4);
+    srcode = flac_bits(f, 4);
+    chassign = flac_bits(f, 4);
+    bps = flac_bits(f, 3);
+    flac_bits(f, 1);
+        /* frame or sample number, UTF-8 style; we keep our own count */
+    for (c = flac_bits(f, 8), i = 0x40; (c & 0x80) && (c & i); i >>= 1)
+        flac_bits(f, 8);
+    if (bscode == 1)
+        blocksize = 192;
+    else if (bscode >= 2 && bscode <= 5)
+        blocksize = 576 << (bscode - 2);
+    else if (bscode == 6)
+        blocksize = flac_bits(f, 8) + 1;
+    else if (bscode == 7)
+        blocksize = flac_bits(f, 16) + 1;
+    else if (bscode >= 8)
+        blocksize = 256 << (bscode - 8);
+    else blocksize = 0;
+    if (srcode == 12)
+        flac_bits(f, 8);
+    else if (srcode == 13 || srcode == 14)
+        flac_bits(f, 16);
+    flac_bits(f, 8);    /* CRC-8 */
+    bps = (bps ? sizes[bps] : f->f_bitspersample);
+    if (f->f_error || !blocksize || blocksize > f->f_maxblocksize ||
+        bps != f->f_bitspersample || chassign > 10 ||
+            (chassign < 8 ? chassign + 1 : 2) != f->f_channels)
+    {
+        f->f_error = 1;
+        return (-1);
+    }
+    for (ch = 0; ch < f->f_channels; ch++)
+        flac_subframe(f, f->f_samples[ch], blocksize,
+            bps + ((chassign == 8 || chassign == 10) ? (ch == 1) :
+                (chassign == 9 ? (ch == 0) : 0)));
+    if (chassign == 8)          /* left and side */
+        for (i = 0; i < blocksize; i++)
+            s1[i] = (int32_t)((uint32_t)s0[i] - (uint32_t)s1[i]);
+    else if (chassign == 9)     /* side and right */
+        for (i = 0; i < blocksize; i++)
+            s0[i] = (int32_t)((uint32_t)s0[i] + (uint32_t)s1[i]);
+    else if (chassign == 10)    /* mid and side */
+        for (i = 0; i < blocksize; i++)
+    {
+        int64_t mid = ((int64_t)s0[i] * 2) | (s1[i] & 1), side = s1[i];
+        s0[i] = (int32_t)((mid + side) >> 1);
+        s1[i] = (int32_t)((mid - side) >> 1);
+    }
+    flac_align(f);
+    flac_bits(f, 16);   /* CRC-16 */
+    if (f->f_error)
+        return (-1);
+    if (f->f_totalframes && blocksize > f->f_totalframes - f->f_framepos)
+        blocksize = (int)(f->f_totalframes - f->f_framepos);
+    f->f_blocksize = blocksize;
+    f->f_blockpos = 0;
+    f->f_framepos += blocksize;
+    return (1);
+}
+
+    /* write "nframes" frames from the current block as little-endian PCM */
+static void flac_emit(t_flac *f, char *buf, int nframes)
+{
+    int nchannels = f->f_channels, outbytes = f->f_outbytes,
+        shift = 8 * outbytes - f->f_bitspersample, i, ch;
+    unsigned char *sp = (unsigned char *)buf;
+    for (i = f->f_blockpos; i < f->f_blockpos + nframes; i++)
+        for (ch = 0; ch < nchannels; ch++)
+    {
+        uint32_t v = (uint32_t)f->f_samples[ch][i] << shift;
+        *sp++ = v;
+        *sp++ = v >> 8;
+        if (outbytes == 3)
+            *sp++ = v >> 16;
+    }
+    f->f_blockpos += nframes;
+}
+
+static int flac_probe(const unsigned char *buf, long n)
+{
+    return (n >= 4 && !memcmp(buf, "fLaC", 4));
+}
+
+static void flac_close(void *z)
+{
+    t_flac *f = (t_flac *)z;
+    int i;
+    for (i = 0; i < f->f_channels; i++)
+        if (f->f_samples[i])
+            freebytes(f->f_samples[i], f->f_maxblocksize * sizeof(int32_t));
+    if (f->f_nseek)
+    {
+        freebytes(f->f_seekframe, f->f_nseek * sizeof(long));
+        freebytes(f->f_seekoffset, f->f_nseek * sizeof(off_t));
+    }
+    freebytes(f, sizeof(*f));
+}
+
+static void *flac_open(int fd, t_soundfile_info *info)
+{
+    t_flac *f = (t_flac *)getbytes(sizeof(*f));
+    int last, type, gotinfo = 0, i;
+    long len, bytesperframe;
+    uint64_t total;
+    off_t pos;
+    f->f_fd = fd;
+    if (flac_bits(f, 32) != 0x664c6143)     /* "fLaC" */
+        goto bad;
+    do
+    {
+        last = flac_bits(f, 1);
+        type = flac_bits(f, 7);
+        len = flac_bits(f, 24);
+        if (type == 0 && len >= 34 && !gotinfo)
+        {
+                /* STREAMINFO */
+            flac_bits(f, 16);
+            f->f_maxblocksize = flac_bits(f, 16);
+            flac_bits(f, 24);
+            flac_bits(f, 24);
+            f->f_samplerate = flac_bits(f, 20);
+            f->f_channels = flac_bits(f, 3) + 1;
+            f->f_bitspersample = flac_bits(f, 5) + 1;
+            total = (uint64_t)flac_bits(f, 4) << 32;
+            total |= flac_bits(f, 32);
+            f->f_totalframes = (total > LONG_MAX ? 0 : (long)total);
+            flac_skipbytes(f, len - 18);    /* MD5 and anything after */
+            gotinfo = 1;
+        }
+        else if (type == 3 && len >= 18 && !f->f_nseek)
+        {
+                /* SEEKTABLE; placeholder points have all bits set */
+            int n = (int)(len / 18);
+            f->f_seekframe = (long *)getbytes(n * sizeof(long));
+            f->f_seekoffset = (off_t *)getbytes(n * sizeof(off_t));
+            f->f_nseek = n;
+            for (i = 0; i < n; i++)
+            {
+                uint64_t frame = (uint64_t)flac_bits(f, 32) << 32, offset;
+                frame |= flac_bits(f, 32);
+                offset = (uint64_t)flac_bits(f, 32) << 32;
+                offset |= flac_bits(f, 32);
+                flac_bits(f, 16);
+                f->f_seekframe[i] = (frame > LONG_MAX ? -1 : (long)frame);
+                f->f_seekoffset[i] = (off_t)offset;
+            }
+            flac_skipbytes(f, len - 18 * n);
+        }
+        else flac_skipbytes(f, len);
+        if (f->f_error)
+            goto bad;
+    } while (!last);
+    if (!gotinfo || f->f_bitspersample < 4 || f->f_bitspersample > 24 ||
+        f->f_maxblocksize < 16)
+            goto bad;
+    for (i = 0; i < f->f_channels; i++)
+        f->f_samples[i] = (int32_t *)getbytes(
+            f->f_maxblocksize * sizeof(int32_t));
+    if ((pos = lseek(fd, 0, SEEK_CUR)) >= 0)
+        f->f_firstframe = pos - (f->f_inlen - f->f_inpos) - f->f_nbits / 8;
+    else f->f_nseek = 0, f->f_firstframe = -1;
+    f->f_outbytes = (f->f_bitspersample > 16 ? 3 : 2);
+    bytesperframe = f->f_channels * f->f_outbytes;
+    info->samplerate = f->f_samplerate;
+    info->channels = f->f_channels;
+    info->bytespersample = f->f_outbytes;
+    info->headersize = 0;
+    info->bigendian = 0;
+    info->bytelimit = (f->f_totalframes &&
+        f->f_totalframes < SFMAXLENGTH / bytesperframe ?
+            f->f_totalframes * bytesperframe : SFMAXLENGTH);
+    return (f);
+bad:
+    flac_close(f);
+    errno = EIO;
+    return (0);
+}
+
+static int flac_skip(void *z, long nframes)
+{
+    t_flac *f = (t_flac *)z;
+    int i, best = -1;
+        /* jump to the last seek point at or before the onset */
+    for (i = 0; i < f->f_nseek; i++)
+        if (f->f_seekframe[i] >= 0 && f->f_seekframe[i] <= nframes &&
+            (best < 0 || f->f_seekframe[i] > f->f_seekframe[best]))
+                best = i;
+    if (best >= 0 && f->f_seekframe[best] > 0 &&
+        lseek(f->f_fd, f->f_firstframe + f->f_seekoffset[best], SEEK_SET) >= 0)
+    {
+        f->f_inpos = f->f_inlen = 0;
+        f->f_bits = 0;
+        f->f_nbits = 0;
+        f->f_blocksize = f->f_blockpos = 0;
+        f->f_framepos = f->f_seekframe[best];
+        nframes -= f->f_seekframe[best];
+    }
+        /* then decode our way to it */
+    while (nframes > 0)
+    {
+        int n;
+        if (f->f_blockpos == f->f_blocksize)
+        {
+            int ret = flac_decodeframe(f);
+            if (ret <= 0)
+                return (ret);
+        }
+        n = f->f_blocksize - f->f_blockpos;
+        if (n > nframes)
+            n = (int)nframes;
+        f->f_blockpos += n;
+        nframes -= n;
+    }
+    return (0);
+}
+
+static long flac_read(void *z, char *buf, long nbytes)
+{
+    t_flac *f = (t_flac *)z;
+    int framebytes = f->f_channels * f->f_outbytes;
+    long done = 0;
+    while (done < nbytes)
+    {
+        if (f->f_pendpos < f->f_pendlen)
+        {
+                /* the rest of a frame the last read stopped partway into */
+            int n = f->f_pendlen - f->f_pendpos;
+            if (n > nbytes - done)
+                n = (int)(nbytes - done);
+            memcpy(buf + done, f->f_pend + f->f_pendpos, n);
+            f->f_pendpos += n;
+            done += n;
+        }
+        else if (f->f_blockpos == f->f_blocksize)
+        {
+            int ret = flac_decodeframe(f);
+            if (ret < 0 && !done)
+            {
+                errno = EIO;
+                return (-1);
+            }
+            else if (ret <= 0)
+                break;
+        }
+        else if (nbytes - done >= framebytes)
+        {
+            long n = (nbytes - done) / framebytes;
+            if (n > f->f_blocksize - f->f_blockpos)
+                n = f->f_blocksize - f->f_blockpos;
+            flac_emit(f, buf + done, (int)n);
+            done += n * framebytes;
+        }
+        else
+        {
+            flac_emit(f, f->f_pend, 1);
+            f->f_pendpos = 0;
+            f->f_pendlen = framebytes;
+        }
+    }
+    return (done);
+}
+
+static const t_sfcodec sfcodec_flac =
+{
+    "flac", flac_probe, flac_open, flac_skip, flac_read, flac_close
+};
+
+static const t_sfcodec *sfcodec_list[] =
+{
+    &sfcodec_flac,
+    0
+};
+
+    /* open a file through a codec.  It's positioned just after "nread"
+    header bytes that the codec's probe function recognized. */
+static int soundfile_opencodec(int fd, const t_sfcodec *codec,
+    t_soundfile_info *p_info, long skipframes, long nread)
+{
+    t_soundfile_info info;
+    t_sfdecoder *d;
+    void *state;
+    long bytesperframe;
+    if (lseek(fd, -nread, SEEK_CUR) < 0)
+        return (-1);
+    if (!(state = (*codec->c_open)(fd, &info)))
+        return (-1);
+    if (skipframes > 0 && (*codec->c_skip)(state, skipframes) < 0)
+    {
+        (*codec->c_close)(state);
+        errno = EIO;
+        return (-1);
+    }
+    bytesperframe = info.channels * info.bytespersample;
+    if (info.bytelimit < SFMAXLENGTH &&
+        (info.bytelimit -= skipframes * bytesperframe) < 0)
+            info.bytelimit = 0;
+    d = (t_sfdecoder *)getbytes(sizeof(*d));
+    d->d_fd = fd;
+    d->d_codec = codec;
+    d->d_state = state;
+    pthread_mutex_lock(&sfcodec_mutex);
+    d->d_next = sfcodec_decoders;
+    sfcodec_decoders = d;
+    pthread_mutex_unlock(&sfcodec_mutex);
+    *p_info = info;
+    return (fd);
+}
+
 /* This routine opens a file, looks for either a nextstep or "wave" header,
 * seeks to end of it, and fills in bytes per sample and number of channels.
 * Only 2- and 3-byte fixed-point samples and 4-byte floating point samples
 * are supported.  If "headersize" is nonzero, the
 * caller should supply the number of channels, endinanness, and bytes per
 * sample; the header is ignored.  Otherwise, the routine tries to read the
-* header and fill in the properties.
+* header and fill in the properties.  Compressed files recognized by one of
+* the codecs above are decoded as they're read; see soundfile_read().
 */
 
 int open_soundfile_via_fd(int fd, t_soundfile_info *p_info, long skipframes)
 {
     int nchannels, bigendian, bytespersamp, samprate, swap;
     int headersize = 0;
-    long sysrtn, bytelimit = 0x7fffffff;
+    long sysrtn, bytelimit = SFMAXLENGTH;
     errno = 0;
     if (p_info->headersize >= 0) /* header detection overridden */
     {
@@ -285,16 +1039,23 @@ int open_soundfile_via_fd(int fd, t_soundfile_info *p_info, long skipframes)
             t_wavechunk b_wavechunk;
             t_datachunk b_datachunk;
             t_comm b_commchunk;
+            t_ds64 b_ds64;
         } buf;
-        long bytesread = read(fd, buf.b_c, READHDRSIZE);
-        int format;
+        long bytesread = read(fd, buf.b_c, READHDRSIZE), ds64size;
+        int format, i;
         if (bytesread < 4)
             goto badheader;
+        for (i = 0; sfcodec_list[i]; i++)
+            if ((*sfcodec_list[i]->c_probe)((unsigned char *)buf.b_c,
+                bytesread))
+                    return (soundfile_opencodec(fd, sfcodec_list[i], p_info,
+                        skipframes, bytesread));
         if (!strncmp(buf.b_c, ".snd", 4))
             format = FORMAT_NEXT, bigendian = 1;
         else if (!strncmp(buf.b_c, "dns.", 4))
             format = FORMAT_NEXT, bigendian = 0;
-        else if (!strncmp(buf.b_c, "RIFF", 4))
+        else if (!strncmp(buf.b_c, "RIFF", 4) ||
+            !strncmp(buf.b_c, "RF64", 4) || !strncmp(buf.b_c, "BW64", 4))
         {
             if (bytesread < 12 || strncmp(buf.b_c + 8, "WAVE", 4))
                 goto badheader;
@@ -306,6 +1067,10 @@ int open_soundfile_via_fd(int fd, t_soundfile_info *p_info, long skipframes)
                 goto badheader;
             format = FORMAT_AIFF, bigendian = 1;
         }
+        else if (bytesread >= W64CHUNKSIZE + W64GUIDSIZE &&
+            !memcmp(buf.b_c, w64_riff, W64GUIDSIZE) &&
+            !memcmp(buf.b_c + W64CHUNKSIZE, w64_wave, W64GUIDSIZE))
+                format = FORMAT_W64, bigendian = 0;
         else
             goto badheader;
         swap = (bigendian != garray_ambigendian());
@@ -324,7 +1089,7 @@ int open_soundfile_via_fd(int fd, t_soundfile_info *p_info, long skipframes)
             else if (format == NS_FORMAT_FLOAT)
                 bytespersamp = 4;
             else goto badheader;
-            bytelimit = 0x7fffffff;
+            bytelimit = SFMAXLENGTH;
             samprate = swap4(nsbuf->ns_sr, swap);
         }
         else if (format == FORMAT_WAVE)     /* wave header */
@@ -342,6 +1107,7 @@ int open_soundfile_via_fd(int fd, t_soundfile_info *p_info, long skipframes)
             nchannels = 1;
             bytespersamp = 2;
             samprate = 44100;
+            ds64size = -1;
                 /* copy the first chunk header to beginnning of buffer. */
             memcpy(buf.b_c, buf.b_c + headersize, sizeof(t_wavechunk));
             /* post("chunk %c %c %c %c",
@@ -375,6 +1141,17 @@ int open_soundfile_via_fd(int fd, t_soundfile_info *p_info, long skipframes)
                     else goto badheader;
                     samprate = swap4(buf.b_fmt.f_samplespersec, swap);
                 }
+                else if (!strncmp(wavechunk->wc_id, "ds64", 4))
+                {
+                        /* RF64: remember the real size of the data */
+                    if (lseek(fd, headersize, SEEK_SET) != headersize ||
+                        read(fd, buf.b_c, sizeof(t_ds64)) <
+                            (int)sizeof(t_ds64))
+                                goto badheader;
+                    ds64size = swap4(buf.b_ds64.d_datasizelo, swap) |
+                        ((long)(swap4(buf.b_ds64.d_datasizehi, swap) &
+                            0x7fffffff) << 32);
+                }
                 seekout = (long)lseek(fd, seekto, SEEK_SET);
                 if (seekout != seekto)
                     goto badheader;
@@ -389,8 +1166,52 @@ int open_soundfile_via_fd(int fd, t_soundfile_info *p_info, long skipframes)
                 headersize = (int)seekto;
             }
             bytelimit = swap4(wavechunk->wc_size, swap);
+            if (bytelimit == 0xffffffff && ds64size >= 0)
+                bytelimit = ds64size;
             headersize += 8;
         }
+        else if (format == FORMAT_W64)
+        {
+                /* Wave64: like wave, but with GUIDs and 64-bit sizes */
+            unsigned char *chunk = (unsigned char *)buf.b_c;
+            long chunksize, where = W64CHUNKSIZE + W64GUIDSIZE;
+            nchannels = 1;
+            bytespersamp = 2;
+            samprate = 44100;
+            while (1)
+            {
+                if (where > INT_MAX - W64CHUNKSIZE ||
+                    lseek(fd, where, SEEK_SET) != where ||
+                    read(fd, buf.b_c, W64CHUNKSIZE) < W64CHUNKSIZE)
+                        goto badheader;
+                if (chunk[W64CHUNKSIZE - 1] & 0x80)
+                    goto badheader;
+                for (i = 0, chunksize = 0; i < 8; i++)
+                    chunksize |= (long)chunk[W64GUIDSIZE + i] << (8 * i);
+                if (chunksize < W64CHUNKSIZE || chunksize > SFMAXLENGTH - 7)
+                    goto badheader;
+                if (!memcmp(chunk, w64_data, W64GUIDSIZE))
+                    break;
+                if (!memcmp(chunk, w64_fmt, W64GUIDSIZE))
+                {
+                    if (read(fd, buf.b_c, sizeof(t_fmt)) < (int)sizeof(t_fmt))
+                        goto badheader;
+                    nchannels = swap2(buf.b_fmt.f_nchannels, swap);
+                    format = swap2(buf.b_fmt.f_nbitspersample, swap);
+                    if (format == 16)
+                        bytespersamp = 2;
+                    else if (format == 24)
+                        bytespersamp = 3;
+                    else if (format == 32)
+                        bytespersamp = 4;
+                    else goto badheader;
+                    samprate = swap4(buf.b_fmt.f_samplespersec, swap);
+                }
+                where += (chunksize + 7) & ~7L;
+            }
+            bytelimit = chunksize - W64CHUNKSIZE;
+            headersize = where + W64CHUNKSIZE;
+        }
         else
         {
                 /* AIFF.  same as WAVE; actually predates it.  Disgusting. */
@@ -507,46 +1328,277 @@ int open_soundfile_via_canvas(t_canvas *canvas, const char *filename,
     return (sf_fd);
 }
 
-static void soundfile_xferin_sample(int sfchannels, int nvecs, t_sample **vecs,
-    long itemsread, unsigned char *buf, int nitems, int bytespersamp,
-    int bigendian)
+/* Soundfiles on local disks are mapped into memory rather than read, so
+that loading big files into arrays or streaming them doesn't copy everything
+through a small buffer; we tell the kernel we'll go through them sequentially
+and ask for pages a little before we need them.  Pipes, devices and network
+filesystems (where a mapping can fault for a long time, or die under us with
+SIGBUS) are read as before. */
+
+#ifdef SOUNDFILE_MMAP
+static int soundfile_canmap(int fd, struct stat *st)
 {
-    int i, j;
-    unsigned char *sp, *sp2;
-    t_sample *fp;
-    int nchannels = (sfchannels < nvecs ? sfchannels : nvecs);
-    int bytespersample = bytespersamp;
-    int bytesperframe = bytespersample * sfchannels;
-    int framesread = itemsread, nframes = nitems;
-    for (i = 0, sp = buf; i < nchannels; i++, sp += bytespersample)
+#if defined(__linux__) || defined(__APPLE__)
+    struct statfs sfs;
+#endif
+    if (fstat(fd, st) < 0 || !S_ISREG(st->st_mode))
+        return (0);
+#if defined(__linux__)
+    if (fstatfs(fd, &sfs) < 0)
+        return (0);
+    switch ((unsigned long)sfs.f_type)
     {
-        if (bytespersample == 2)
-        {
-            if (bigendian)
-            {
-                for (j = 0, sp2 = sp, fp = vecs[i] + framesread;
-                    j < nframes; j++, sp2 += bytesperframe, fp++)
-                        *fp = SCALE * ((sp2[0] << 24) | (sp2[1] << 16));
-            }
-            else
-            {
-                for (j = 0, sp2 = sp, fp = vecs[i] + framesread;
-                    j < nframes; j++, sp2 += bytesperframe, fp++)
-                        *fp = SCALE * ((sp2[1] << 24) | (sp2[0] << 16));
-            }
-        }
-        else if (bytespersample == 3)
-        {
-            if (bigendian)
-            {
-                for (j = 0, sp2 = sp, fp = vecs[i] + framesread;
-                    j < nframes; j++, sp2 += bytesperframe, fp++)
-                        *fp = SCALE * ((sp2[0] << 24) | (sp2[1] << 16) |
-                                       (sp2[2] << 8));
-            }
+    case 0x6969:        /* NFS */
+    case 0x517b:        /* SMB */
+    case 0xff534d42:    /* CIFS */
+    case 0xfe534d42:    /* SMB2 */
+    case 0x65735546:    /* FUSE */
+    case 0x01021997:    /* v9fs */
+    case 0x73757245:    /* Coda */
+    case 0x564c:        /* NCP */
+    case 0x5346414f:    /* AFS */
+        return (0);
+    }
+#elif defined(__APPLE__)
+    if (fstatfs(fd, &sfs) < 0 || !(sfs.f_flags & MNT_LOCAL))
+        return (0);
+#endif
+    return (1);
+}
+#endif /* SOUNDFILE_MMAP */
+
+    /* try to map the rest of an open soundfile from its current position,
+    up to "maxframes" frames.  Returns 1 on success; on failure the caller
+    should read() from the file as usual. */
+static int soundfile_map(t_sfmap *m, int fd, long maxframes,
+    int bytesperframe)
+{
+#ifdef SOUNDFILE_MMAP
+    struct stat st;
+    off_t pos, start;
+    long pagesize = sysconf(_SC_PAGESIZE), nframes;
+    void *base;
+    m->m_base = 0;
+    if (soundfile_decoder(fd))
+        return (0);
+    if (bytesperframe < 1 || maxframes < 1 || pagesize <= 0 ||
+        !soundfile_canmap(fd, &st) || (pos = lseek(fd, 0, SEEK_CUR)) < 0 ||
+            pos >= st.st_size)
+                return (0);
+    nframes = ((st.st_size - pos) / bytesperframe > maxframes ?
+        maxframes : (long)((st.st_size - pos) / bytesperframe));
+    start = pos - pos % pagesize;
+        /* don't overflow the address space on 32-bit machines */
+    if (!nframes || (double)nframes * bytesperframe + (double)(pos - start)
+        >= (double)SIZE_MAX)
+            return (0);
+    m->m_size = (size_t)(pos - start) + (size_t)nframes * bytesperframe;
+    if ((base = mmap(0, m->m_size, PROT_READ, MAP_SHARED, fd, start))
+        == MAP_FAILED)
+            return (0);
+    madvise(base, m->m_size, MADV_SEQUENTIAL);
+    m->m_base = base;
+    m->m_data = (char *)base + (pos - start);
+    m->m_nframes = nframes;
+    return (1);
+#else
+    m->m_base = 0;
+    return (0);
+#endif
+}
+
+static void soundfile_unmap(t_sfmap *m)
+{
+#ifdef SOUNDFILE_MMAP
+    if (m->m_base)
+        munmap(m->m_base, m->m_size);
+#endif
+    m->m_base = 0;
+}
+
+    /* ask for "nbytes" of the mapping starting "onset" bytes into the data
+    to be paged in ahead of time */
+static void soundfile_prefetch(t_sfmap *m, long onset, long nbytes)
+{
+#ifdef SOUNDFILE_MMAP
+    long pagesize = sysconf(_SC_PAGESIZE), skip;
+    char *from, *end = (char *)m->m_base + m->m_size;
+    if (!m->m_base || nbytes <= 0 || pagesize <= 0)
+        return;
+    from = m->m_data + onset;
+    if (from >= end)
+        return;
+    if (nbytes > end - from)
+        nbytes = end - from;
+    skip = (long)((from - (char *)m->m_base) % pagesize);
+    madvise(from - skip, nbytes + skip, MADV_WILLNEED);
+#endif
+}
+
+    /* how many frames there are from the current position to the end of
+    the file, or -1 if we can't seek in it.  For a decoded file we only
+    know what the header said. */
+static long soundfile_framesleft(int fd, t_soundfile_info *info)
+{
+    int bytesperframe = info->channels * info->bytespersample;
+    long poswas, eofis;
+    if (soundfile_decoder(fd))
+        return (info->bytelimit / bytesperframe);
+    poswas = (long)lseek(fd, 0, SEEK_CUR);
+    eofis = (long)lseek(fd, 0, SEEK_END);
+    if (poswas < 0 || eofis < 0 || eofis < poswas)
+        return (-1);
+    lseek(fd, poswas, SEEK_SET);
+    return ((eofis - poswas) / bytesperframe);
+}
+
+    /* read up to "nframes" whole frames, as fread() would */
+static long soundfile_readframes(int fd, char *buf, long nframes,
+    int bytesperframe)
+{
+    long want = nframes * bytesperframe, have = 0, got;
+    while (have < want &&
+        (got = soundfile_read(fd, buf + have, want - have)) > 0)
+            have += got;
+    return (have / bytesperframe);
+}
+
+/* With SSE2 the sample converters below do four frames of a channel at a
+time: a 32-bit load for each sample (whatever its size), byte swapping and
+shifting the sample into the top of the word, and then float conversion, all
+in vector registers.  This gives the same results as the byte-by-byte C loops,
+which still do the rest of each buffer and everything on other machines. */
+
+#if PD_FLOATSIZE == 32 && (defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define SOUNDFILE_SSE2
+#include <emmintrin.h>
+
+static inline __m128i soundfile_bswap4(__m128i v)
+{
+    v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    return (_mm_shufflehi_epi16(_mm_shufflelo_epi16(v,
+        _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+    /* decode the samples at sp, sp + stride, ... sp + 3 * stride.  This
+    reads the 4 bytes from each, so there must be another sample after the
+    last one. */
+static inline __m128 soundfile_decode4(const unsigned char *sp, int stride,
+    int bytespersamp, int bigendian)
+{
+    uint32_t w[4];
+    __m128i v;
+    memcpy(&w[0], sp, 4);
+    memcpy(&w[1], sp + stride, 4);
+    memcpy(&w[2], sp + 2 * stride, 4);
+    memcpy(&w[3], sp + 3 * stride, 4);
+    v = _mm_loadu_si128((const __m128i *)w);
+    if (bigendian)
+    {
+        v = soundfile_bswap4(v);
+        if (bytespersamp == 2)
+            v = _mm_and_si128(v, _mm_set1_epi32((int)0xffff0000));
+        else if (bytespersamp == 3)
+            v = _mm_and_si128(v, _mm_set1_epi32((int)0xffffff00));
+    }
+    else if (bytespersamp == 2)
+        v = _mm_slli_epi32(v, 16);
+    else if (bytespersamp == 3)
+        v = _mm_slli_epi32(v, 8);
+    if (bytespersamp == 4)
+        return (_mm_castsi128_ps(v));
+    else return (_mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps((float)SCALE)));
+}
+
+    /* encode four samples already multiplied by 32768 or 8388608 into
+    sp, sp + stride, ...  Fixed point samples are rounded down and clipped
+    to +/-32767 or +/-8388607 as the C loops do. */
+static inline void soundfile_encode4(unsigned char *sp, int stride,
+    __m128 f, int bytespersamp, int bigendian)
+{
+    int32_t w[4];
+    __m128i v;
+    int k, off;
+    if (bytespersamp == 4)
+        v = _mm_castps_si128(f);
+    else
+    {
+        __m128 lim = _mm_set1_ps(bytespersamp == 2 ? 32767.f : 8388607.f);
+        f = _mm_min_ps(_mm_max_ps(f, _mm_sub_ps(_mm_setzero_ps(), lim)), lim);
+        v = _mm_cvttps_epi32(f);
+            /* truncation went up for negative non-integers; take one off */
+        v = _mm_add_epi32(v, _mm_castps_si128(
+            _mm_cmpgt_ps(_mm_cvtepi32_ps(v), f)));
+    }
+    if (bigendian)
+        v = soundfile_bswap4(v), off = 4 - bytespersamp;
+    else off = 0;
+    _mm_storeu_si128((__m128i *)w, v);
+    for (k = 0; k < 4; k++, sp += stride)
+    {
+        unsigned char *from = (unsigned char *)&w[k] + off;
+        sp[0] = from[0];
+        sp[1] = from[1];
+        if (bytespersamp > 2)
+            sp[2] = from[2];
+        if (bytespersamp > 3)
+            sp[3] = from[3];
+    }
+}
+#endif /* SOUNDFILE_SSE2 */
+
+static void soundfile_xferin_sample(int sfchannels, int nvecs, t_sample **vecs,
+    long itemsread, unsigned char *buf, int nitems, int bytespersamp,
+    int bigendian)
+{
+    int i, j, k;
+    unsigned char *sp, *sp2;
+    t_sample *fp;
+    int nchannels = (sfchannels < nvecs ? sfchannels : nvecs);
+    int bytespersample = bytespersamp;
+    int bytesperframe = bytespersample * sfchannels;
+    int framesread = itemsread, nframes = nitems;
+    for (i = 0, sp = buf; i < nchannels; i++, sp += bytespersample)
+    {
+        k = 0;
+#ifdef SOUNDFILE_SSE2
+        for (sp2 = sp, fp = vecs[i] + framesread; k + 4 < nframes;
+            k += 4, sp2 += 4 * bytesperframe, fp += 4)
+                _mm_storeu_ps(fp, soundfile_decode4(sp2, bytesperframe,
+                    bytespersample, bigendian));
+#endif
+        if (bytespersample == 2)
+        {
+            if (bigendian)
+            {
+                for (j = k, sp2 = sp + k * bytesperframe,
+                    fp = vecs[i] + framesread + k;
+                    j < nframes; j++, sp2 += bytesperframe, fp++)
+                        *fp = SCALE * ((sp2[0] << 24) | (sp2[1] << 16));
+            }
+            else
+            {
+                for (j = k, sp2 = sp + k * bytesperframe,
+                    fp = vecs[i] + framesread + k;
+                    j < nframes; j++, sp2 += bytesperframe, fp++)
+                        *fp = SCALE * ((sp2[1] << 24) | (sp2[0] << 16));
+            }
+        }
+        else if (bytespersample == 3)
+        {
+            if (bigendian)
+            {
+                for (j = k, sp2 = sp + k * bytesperframe,
+                    fp = vecs[i] + framesread + k;
+                    j < nframes; j++, sp2 += bytesperframe, fp++)
+                        *fp = SCALE * ((sp2[0] << 24) | (sp2[1] << 16) |
+                                       (sp2[2] << 8));
+            }
             else
             {
-                for (j = 0, sp2 = sp, fp = vecs[i] + framesread;
+                for (j = k, sp2 = sp + k * bytesperframe,
+                    fp = vecs[i] + framesread + k;
                     j < nframes; j++, sp2 += bytesperframe, fp++)
                         *fp = SCALE * ((sp2[2] << 24) | (sp2[1] << 16) |
                                        (sp2[0] << 8));
@@ -557,7 +1609,8 @@ static void soundfile_xferin_sample(int sfchannels, int nvecs, t_sample **vecs,
             t_floatuint alias;
             if (bigendian)
             {
-                for (j = 0, sp2 = sp, fp = vecs[i] + framesread;
+                for (j = k, sp2 = sp + k * bytesperframe,
+                    fp = vecs[i] + framesread + k;
                     j < nframes; j++, sp2 += bytesperframe, fp++)
                 {
                     alias.ui = ((sp2[0] << 24) | (sp2[1] << 16) |
@@ -567,7 +1620,8 @@ static void soundfile_xferin_sample(int sfchannels, int nvecs, t_sample **vecs,
             }
             else
             {
-                for (j = 0, sp2 = sp, fp = vecs[i] + framesread;
+                for (j = k, sp2 = sp + k * bytesperframe,
+                    fp = vecs[i] + framesread + k;
                     j < nframes; j++, sp2 += bytesperframe, fp++)
                 {
                     alias.ui = ((sp2[3] << 24) | (sp2[2] << 16) |
@@ -589,7 +1643,7 @@ static void soundfile_xferin_words(int sfchannels, int nvecs, t_word **vecs,
     int bigendian)
 {
     int i;
-    long j;
+    long j, k;
     unsigned char *sp, *sp2;
     t_word *wp;
     int nchannels = (sfchannels < nvecs ? sfchannels : nvecs);
@@ -597,17 +1651,33 @@ static void soundfile_xferin_words(int sfchannels, int nvecs, t_word **vecs,
     int bytesperframe = bytespersample * sfchannels;
     for (i = 0, sp = buf; i < nchannels; i++, sp += bytespersample)
     {
+        k = 0;
+#ifdef SOUNDFILE_SSE2
+        for (sp2 = sp, wp = vecs[i] + itemsread; k + 4 < nitems;
+            k += 4, sp2 += 4 * bytesperframe, wp += 4)
+        {
+            float f[4];
+            _mm_storeu_ps(f, soundfile_decode4(sp2, bytesperframe,
+                bytespersample, bigendian));
+            wp[0].w_float = f[0];
+            wp[1].w_float = f[1];
+            wp[2].w_float = f[2];
+            wp[3].w_float = f[3];
+        }
+#endif
         if (bytespersample == 2)
         {
             if (bigendian)
             {
-                for (j = 0, sp2 = sp, wp = vecs[i] + itemsread;
+                for (j = k, sp2 = sp + k * bytesperframe,
+                    wp = vecs[i] + itemsread + k;
                     j < nitems; j++, sp2 += bytesperframe, wp++)
                         wp->w_float = SCALE * ((sp2[0] << 24) | (sp2[1] << 16));
             }
             else
             {
-                for (j = 0, sp2 = sp, wp = vecs[i] + itemsread;
+                for (j = k, sp2 = sp + k * bytesperframe,
+                    wp = vecs[i] + itemsread + k;
                     j < nitems; j++, sp2 += bytesperframe, wp++)
                         wp->w_float = SCALE * ((sp2[1] << 24) | (sp2[0] << 16));
             }
@@ -616,14 +1686,16 @@ static void soundfile_xferin_words(int sfchannels, int nvecs, t_word **vecs,
         {
             if (bigendian)
             {
-                for (j = 0, sp2 = sp, wp = vecs[i] + itemsread;
+                for (j = k, sp2 = sp + k * bytesperframe,
+                    wp = vecs[i] + itemsread + k;
                     j < nitems; j++, sp2 += bytesperframe, wp++)
                         wp->w_float = SCALE * ((sp2[0] << 24) | (sp2[1] << 16)
                             | (sp2[2] << 8));
             }
             else
             {
-                for (j = 0, sp2 = sp, wp = vecs[i] + itemsread;
+                for (j = k, sp2 = sp + k * bytesperframe,
+                    wp = vecs[i] + itemsread + k;
                     j < nitems; j++, sp2 += bytesperframe, wp++)
                         wp->w_float = SCALE * ((sp2[2] << 24) | (sp2[1] << 16)
                             | (sp2[0] << 8));
@@ -634,7 +1706,8 @@ static void soundfile_xferin_words(int sfchannels, int nvecs, t_word **vecs,
             t_floatuint alias;
             if (bigendian)
             {
-                for (j = 0, sp2 = sp, wp = vecs[i] + itemsread;
+                for (j = k, sp2 = sp + k * bytesperframe,
+                    wp = vecs[i] + itemsread + k;
                     j < nitems; j++, sp2 += bytesperframe, wp++)
                 {
                     alias.ui = ((sp2[0] << 24) | (sp2[1] << 16) |
@@ -644,7 +1717,8 @@ static void soundfile_xferin_words(int sfchannels, int nvecs, t_word **vecs,
             }
             else
             {
-                for (j = 0, sp2 = sp, wp = vecs[i] + itemsread;
+                for (j = k, sp2 = sp + k * bytesperframe,
+                    wp = vecs[i] + itemsread + k;
                     j < nitems; j++, sp2 += bytesperframe, wp++)
                 {
                     alias.ui = ((sp2[3] << 24) | (sp2[2] << 16) |
@@ -686,16 +1760,19 @@ static void soundfile_xferin_words(int sfchannels, int nvecs, t_word **vecs,
 static int soundfiler_writeargparse(void *obj, int *p_argc, t_atom **p_argv,
     t_symbol **p_filesym,
     int *p_filetype, int *p_bytespersamp, int *p_swap, int *p_bigendian,
-    int *p_normalize, long *p_onset, long *p_nframes, t_float *p_rate)
+    int *p_normalize, long *p_onset, long *p_nframes, t_float *p_rate,
+    int *p_direct)
 {
     int argc = *p_argc;
     t_atom *argv = *p_argv;
     int bytespersamp = 2, bigendian = 0,
         endianness = -1, swap, filetype = -1, normalize = 0;
-    long onset = 0, nframes = 0x7fffffff;
+    long onset = 0, nframes = SFMAXLENGTH;
     t_symbol *filesym;
     t_float rate = -1;
 
+    if (p_direct)
+        *p_direct = 0;
     while (argc > 0 && argv->a_type == A_SYMBOL &&
         *argv->a_w.w_symbol->s_name == '-')
     {
@@ -742,6 +1819,11 @@ static int soundfiler_writeargparse(void *obj, int *p_argc, t_atom **p_argv,
             filetype = FORMAT_AIFF;
             argc -= 1; argv += 1;
         }
+        else if (!strcmp(flag, "w64"))
+        {
+            filetype = FORMAT_W64;
+            argc -= 1; argv += 1;
+        }
         else if (!strcmp(flag, "big"))
         {
             endianness = 1;
@@ -752,6 +1834,11 @@ static int soundfiler_writeargparse(void *obj, int *p_argc, t_atom **p_argv,
             endianness = 0;
             argc -= 1; argv += 1;
         }
+        else if (!strcmp(flag, "direct") && p_direct)
+        {
+            *p_direct = 1;
+            argc -= 1; argv += 1;
+        }
         else if (!strcmp(flag, "r") || !strcmp(flag, "rate"))
         {
             if (argc < 2 || argv[1].a_type != A_FLOAT ||
@@ -784,6 +1871,10 @@ static int soundfiler_writeargparse(void *obj, int *p_argc, t_atom **p_argv,
                         (!strcmp(filesym->s_name + strlen(filesym->s_name) - 3, ".au") ||
                         !strcmp(filesym->s_name + strlen(filesym->s_name) - 3, ".AU")))
                 filetype = FORMAT_NEXT;
+        if (strlen(filesym->s_name) >= 5 &&
+                        (!strcmp(filesym->s_name + strlen(filesym->s_name) - 4, ".w64") ||
+                        !strcmp(filesym->s_name + strlen(filesym->s_name) - 4, ".W64")))
+                filetype = FORMAT_W64;
         if (filetype < 0)
             filetype = FORMAT_WAVE;
     }
@@ -797,7 +1888,7 @@ static int soundfiler_writeargparse(void *obj, int *p_argc, t_atom **p_argv,
         }
     }
         /* for WAVE force little endian; for nextstep use machine native */
-    if (filetype == FORMAT_WAVE)
+    if (filetype == FORMAT_WAVE || filetype == FORMAT_W64)
     {
         bigendian = 0;
         if (endianness == 1)
@@ -834,6 +1925,39 @@ usage:
     return (-1);
 }
 
+    /* fill in the RIFF header and the ds64 chunk of a wave file that has
+    room for one, as RF64 if the sizes don't fit in 32 bits.  Returns 1 for
+    RF64, in which case the data chunk's size should be 0xffffffff. */
+static int soundfile_wavebighead(char *buf, long datasize, long nframes,
+    int swap)
+{
+    t_ds64 *ds64 = (t_ds64 *)(buf + 12);
+    int64_t riffsize = (int64_t)datasize + WAVEBIGHDRSIZE - 8;
+    int rf64 = (riffsize >= 0xffffffffLL);
+    uint32_t riffsize32 = swap4(rf64 ? 0xffffffff : (uint32_t)riffsize, swap);
+    strncpy(buf, (rf64 ? "RF64" : "RIFF"), 4);
+    memcpy(buf + 4, &riffsize32, 4);
+    strncpy(buf + 8, "WAVE", 4);
+    strncpy(ds64->d_id, (rf64 ? "ds64" : "JUNK"), 4);
+    ds64->d_size = swap4(sizeof(t_ds64) - 8, swap);
+    ds64->d_riffsizelo = swap4((uint32_t)riffsize, swap);
+    ds64->d_riffsizehi = swap4((uint32_t)(riffsize >> 32), swap);
+    ds64->d_datasizelo = swap4((uint32_t)datasize, swap);
+    ds64->d_datasizehi = swap4((uint32_t)((int64_t)datasize >> 32), swap);
+    ds64->d_nframeslo = swap4((uint32_t)nframes, swap);
+    ds64->d_nframeshi = swap4((uint32_t)((int64_t)nframes >> 32), swap);
+    ds64->d_tablelength = 0;
+    return (rf64);
+}
+
+    /* store a 64-bit Wave64 chunk size, always little endian */
+static void soundfile_w64size(char *buf, long size)
+{
+    int i;
+    for (i = 0; i < 8; i++)
+        buf[i] = (char)((int64_t)size >> (8 * i));
+}
+
 /* p_headersize is a getter, set to NULL if not needed */
 static int create_soundfile(t_canvas *canvas, const char *filename,
     int filetype, long nframes, int bytespersamp, int bigendian, int nchannels,
@@ -845,6 +1969,10 @@ static int create_soundfile(t_canvas *canvas, const char *filename,
     t_nextstep *nexthdr = (t_nextstep *)headerbuf;
     t_aiff *aiffhdr = (t_aiff *)headerbuf;
     int fd, headersize = 0;
+        /* size of the sound, or 0 if we don't know how long it will be */
+    long datasize = (nframes > 0 &&
+        nframes < SFMAXLENGTH / (nchannels * bytespersamp) ?
+            nframes * nchannels * bytespersamp : 0);
 
     strncpy(filenamebuf, filename, MAXPDSTRING);
     filenamebuf[MAXPDSTRING-10] = 0;
@@ -868,7 +1996,6 @@ static int create_soundfile(t_canvas *canvas, const char *filename,
     }
     else if (filetype == FORMAT_AIFF)
     {
-        long datasize = nframes * nchannels * bytespersamp;
         long longtmp;
         if (strcmp(filenamebuf + strlen(filenamebuf)-4, ".aif") &&
             strcmp(filenamebuf + strlen(filenamebuf)-5, ".aiff"))
@@ -889,9 +2016,31 @@ static int create_soundfile(t_canvas *canvas, const char *filename,
         memset(((char *)(&aiffhdr->a_samprate))+18, 0, 8);
         headersize = AIFFPLUS;
     }
+    else if (filetype == FORMAT_W64)
+    {
+        t_fmt fmt;
+        if (strcmp(filenamebuf + strlen(filenamebuf)-4, ".w64"))
+            strcat(filenamebuf, ".w64");
+        fmt.f_fmttag =
+            swap2((bytespersamp == 4 ? WAV_FLOAT : WAV_INT), swap);
+        fmt.f_nchannels = swap2(nchannels, swap);
+        fmt.f_samplespersec = swap4(samplerate, swap);
+        fmt.f_navgbytespersec =
+            swap4((int)(samplerate * nchannels * bytespersamp), swap);
+        fmt.f_nblockalign = swap2(nchannels * bytespersamp, swap);
+        fmt.f_nbitspersample = swap2(8 * bytespersamp, swap);
+        memcpy(headerbuf, w64_riff, W64GUIDSIZE);
+        soundfile_w64size(headerbuf + W64GUIDSIZE, datasize + W64HDRSIZE);
+        memcpy(headerbuf + W64CHUNKSIZE, w64_wave, W64GUIDSIZE);
+        memcpy(headerbuf + 40, w64_fmt, W64GUIDSIZE);
+        soundfile_w64size(headerbuf + 56, W64CHUNKSIZE + sizeof(t_fmt));
+        memcpy(headerbuf + 64, &fmt, sizeof(t_fmt));
+        memcpy(headerbuf + 80, w64_data, W64GUIDSIZE);
+        soundfile_w64size(headerbuf + 96, datasize + W64CHUNKSIZE);
+        headersize = W64HDRSIZE;
+    }
     else    /* WAVE format */
     {
-        long datasize = nframes * nchannels * bytespersamp;
         if (strcmp(filenamebuf + strlen(filenamebuf)-4, ".wav"))
             strcat(filenamebuf, ".wav");
         strncpy(wavehdr->w_fileid, "RIFF", 4);
@@ -910,9 +2059,26 @@ static int create_soundfile(t_canvas *canvas, const char *filename,
         strncpy(wavehdr->w_datachunkid, "data", 4);
         wavehdr->w_datachunksize = swap4((uint32_t)datasize, swap);
         headersize = sizeof(t_wave);
+            /* if we don't know how big the file will be, or know it will
+            be too big for a plain wave header, make room for a ds64 chunk
+            and write RF64 if needed. */
+        if (!datasize ||
+            (int64_t)datasize > 0xffffffffLL - (int64_t)WAVEBIGHDRSIZE)
+        {
+            uint32_t datasize32;
+            memmove(headerbuf + 12 + sizeof(t_ds64), headerbuf + 12,
+                sizeof(t_wave) - 12);
+            headersize = WAVEBIGHDRSIZE;
+            datasize32 = (soundfile_wavebighead(headerbuf, datasize,
+                datasize / (nchannels * bytespersamp), swap) ?
+                    0xffffffff : swap4((uint32_t)datasize, swap));
+            memcpy(headerbuf + headersize - 4, &datasize32, 4);
+        }
     }
 
-    canvas_makefilename(canvas, filenamebuf, buf2, MAXPDSTRING);
+    if (canvas)
+        canvas_makefilename(canvas, filenamebuf, buf2, MAXPDSTRING);
+    else strncpy(buf2, filenamebuf, MAXPDSTRING);
     if ((fd = sys_open(buf2, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0)
         return (-1);
 
@@ -927,15 +2093,29 @@ static int create_soundfile(t_canvas *canvas, const char *filename,
 }
 
 static void soundfile_finishwrite(void *obj, const char *filename, int fd,
-    int filetype, long nframes, long itemswritten, int bytesperframe, int swap)
+    int filetype, long nframes, long itemswritten, int bytesperframe, int swap,
+    int headersize)
 {
     if (itemswritten < nframes)
     {
-        if (nframes < 0x7fffffff)
+        if (nframes < SFMAXLENGTH)
             pd_error(obj, "soundfiler_write: %ld out of %ld bytes written",
                 itemswritten, nframes);
             /* try to fix size fields in header */
-        if (filetype == FORMAT_WAVE)
+        if (filetype == FORMAT_WAVE && headersize == WAVEBIGHDRSIZE)
+        {
+            char head[12 + sizeof(t_ds64)];
+            long datasize = itemswritten * bytesperframe;
+            uint32_t datasize32 = (soundfile_wavebighead(head, datasize,
+                itemswritten, swap) ? 0xffffffff :
+                    swap4((uint32_t)datasize, swap));
+            if (lseek(fd, 0, SEEK_SET) < 0 ||
+                write(fd, head, sizeof(head)) < (int)sizeof(head) ||
+                lseek(fd, headersize - 4, SEEK_SET) < 0 ||
+                write(fd, &datasize32, 4) < 4)
+                    goto baddonewrite;
+        }
+        else if (filetype == FORMAT_WAVE)
         {
             long datasize = itemswritten * bytesperframe, mofo;
 
@@ -977,6 +2157,19 @@ static void soundfile_finishwrite(void *obj, const char *filename, int fd,
             if (write(fd, (char *)(&mofo), 4) < 4)
                 goto baddonewrite;
         }
+        if (filetype == FORMAT_W64)
+        {
+            char size[8];
+            long datasize = itemswritten * bytesperframe;
+            soundfile_w64size(size, datasize + W64HDRSIZE);
+            if (lseek(fd, W64GUIDSIZE, SEEK_SET) < 0 ||
+                write(fd, size, 8) < 8)
+                    goto baddonewrite;
+            soundfile_w64size(size, datasize + W64CHUNKSIZE);
+            if (lseek(fd, W64HDRSIZE - 8, SEEK_SET) < 0 ||
+                write(fd, size, 8) < 8)
+                    goto baddonewrite;
+        }
         if (filetype == FORMAT_NEXT)
         {
             /* do it the lazy way: just set the size field to 'unknown size'*/
@@ -1000,18 +2193,32 @@ static void soundfile_xferout_sample(int nchannels, t_sample **vecs,
     unsigned char *buf, int nitems, long onset, int bytespersamp,
     int bigendian, t_sample normalfactor)
 {
-    int i, j;
+    int i, j, k;
     unsigned char *sp, *sp2;
     t_sample *fp;
     int bytesperframe = bytespersamp * nchannels;
     for (i = 0, sp = buf; i < nchannels; i++, sp += bytespersamp)
     {
+        k = 0;
+#ifdef SOUNDFILE_SSE2
+        {
+            __m128 g = _mm_set1_ps(bytespersamp == 2 ?
+                (t_sample)(normalfactor * 32768.) : (bytespersamp == 3 ?
+                    (t_sample)(normalfactor * 8388608.) : normalfactor));
+            for (sp2 = sp, fp = vecs[i] + onset; k + 4 <= nitems;
+                k += 4, sp2 += 4 * bytesperframe, fp += 4)
+                    soundfile_encode4(sp2, bytesperframe,
+                        _mm_mul_ps(_mm_loadu_ps(fp), g), bytespersamp,
+                            bigendian);
+        }
+#endif
         if (bytespersamp == 2)
         {
             t_sample ff = normalfactor * 32768.;
             if (bigendian)
             {
-                for (j = 0, sp2 = sp, fp = vecs[i] + onset;
+                for (j = k, sp2 = sp + k * bytesperframe,
+                    fp = vecs[i] + onset + k;
                     j < nitems; j++, sp2 += bytesperframe, fp++)
                 {
                     int xx = 32768. + (*fp * ff);
@@ -1026,7 +2233,8 @@ static void soundfile_xferout_sample(int nchannels, t_sample **vecs,
             }
             else
             {
-                for (j = 0, sp2 = sp, fp=vecs[i] + onset;
+                for (j = k, sp2 = sp + k * bytesperframe,
+                    fp = vecs[i] + onset + k;
                     j < nitems; j++, sp2 += bytesperframe, fp++)
                 {
                     int xx = 32768. + (*fp * ff);
@@ -1045,7 +2253,8 @@ static void soundfile_xferout_sample(int nchannels, t_sample **vecs,
             t_sample ff = normalfactor * 8388608.;
             if (bigendian)
             {
-                for (j = 0, sp2 = sp, fp=vecs[i] + onset;
+                for (j = k, sp2 = sp + k * bytesperframe,
+                    fp = vecs[i] + onset + k;
                     j < nitems; j++, sp2 += bytesperframe, fp++)
                 {
                     int xx = 8388608. + (*fp * ff);
@@ -1061,7 +2270,8 @@ static void soundfile_xferout_sample(int nchannels, t_sample **vecs,
             }
             else
             {
-                for (j = 0, sp2 = sp, fp=vecs[i] + onset;
+                for (j = k, sp2 = sp + k * bytesperframe,
+                    fp = vecs[i] + onset + k;
                     j < nitems; j++, sp2 += bytesperframe, fp++)
                 {
                     int xx = 8388608. + (*fp * ff);
@@ -1081,7 +2291,8 @@ static void soundfile_xferout_sample(int nchannels, t_sample **vecs,
             t_floatuint f2;
             if (bigendian)
             {
-                for (j = 0, sp2 = sp, fp=vecs[i] + onset;
+                for (j = k, sp2 = sp + k * bytesperframe,
+                    fp = vecs[i] + onset + k;
                     j < nitems; j++, sp2 += bytesperframe, fp++)
                 {
                     f2.f = *fp * normalfactor;
@@ -1091,7 +2302,8 @@ static void soundfile_xferout_sample(int nchannels, t_sample **vecs,
             }
             else
             {
-                for (j = 0, sp2 = sp, fp=vecs[i] + onset;
+                for (j = k, sp2 = sp + k * bytesperframe,
+                    fp = vecs[i] + onset + k;
                     j < nitems; j++, sp2 += bytesperframe, fp++)
                 {
                     f2.f = *fp * normalfactor;
@@ -1107,18 +2319,33 @@ static void soundfile_xferout_words(int nchannels, t_word **vecs,
     unsigned char *buf, long nitems, long onset, int bytespersamp,
     int bigendian, t_sample normalfactor)
 {
-    int i, j;
+    int i, j, k;
     unsigned char *sp, *sp2;
     t_word *wp;
     int bytesperframe = bytespersamp * nchannels;
     for (i = 0, sp = buf; i < nchannels; i++, sp += bytespersamp)
     {
+        k = 0;
+#ifdef SOUNDFILE_SSE2
+        {
+            __m128 g = _mm_set1_ps(bytespersamp == 2 ?
+                (t_sample)(normalfactor * 32768.) : (bytespersamp == 3 ?
+                    (t_sample)(normalfactor * 8388608.) : normalfactor));
+            for (sp2 = sp, wp = vecs[i] + onset; k + 4 <= nitems;
+                k += 4, sp2 += 4 * bytesperframe, wp += 4)
+                    soundfile_encode4(sp2, bytesperframe, _mm_mul_ps(
+                        _mm_setr_ps(wp[0].w_float, wp[1].w_float,
+                            wp[2].w_float, wp[3].w_float), g),
+                                bytespersamp, bigendian);
+        }
+#endif
         if (bytespersamp == 2)
         {
             t_sample ff = normalfactor * 32768.;
             if (bigendian)
             {
-                for (j = 0, sp2 = sp, wp = vecs[i] + onset;
+                for (j = k, sp2 = sp + k * bytesperframe,
+                    wp = vecs[i] + onset + k;
                     j < nitems; j++, sp2 += bytesperframe, wp++)
                 {
                     int xx = 32768. + (wp->w_float * ff);
@@ -1133,7 +2360,8 @@ static void soundfile_xferout_words(int nchannels, t_word **vecs,
             }
             else
             {
-                for (j = 0, sp2 = sp, wp = vecs[i] + onset;
+                for (j = k, sp2 = sp + k * bytesperframe,
+                    wp = vecs[i] + onset + k;
                     j < nitems; j++, sp2 += bytesperframe, wp++)
                 {
                     int xx = 32768. + (wp->w_float * ff);
@@ -1152,7 +2380,8 @@ static void soundfile_xferout_words(int nchannels, t_word **vecs,
             t_sample ff = normalfactor * 8388608.;
             if (bigendian)
             {
-                for (j = 0, sp2 = sp, wp = vecs[i] + onset;
+                for (j = k, sp2 = sp + k * bytesperframe,
+                    wp = vecs[i] + onset + k;
                     j < nitems; j++, sp2 += bytesperframe, wp++)
                 {
                     int xx = 8388608. + (wp->w_float * ff);
@@ -1168,7 +2397,8 @@ static void soundfile_xferout_words(int nchannels, t_word **vecs,
             }
             else
             {
-                for (j = 0, sp2 = sp, wp = vecs[i] + onset;
+                for (j = k, sp2 = sp + k * bytesperframe,
+                    wp = vecs[i] + onset + k;
                     j < nitems; j++, sp2 += bytesperframe, wp++)
                 {
                     int xx = 8388608. + (wp->w_float * ff);
@@ -1188,7 +2418,8 @@ static void soundfile_xferout_words(int nchannels, t_word **vecs,
             t_floatuint f2;
             if (bigendian)
             {
-                for (j = 0, sp2 = sp, wp = vecs[i] + onset;
+                for (j = k, sp2 = sp + k * bytesperframe,
+                    wp = vecs[i] + onset + k;
                     j < nitems; j++, sp2 += bytesperframe, wp++)
                 {
                     f2.f = wp->w_float * normalfactor;
@@ -1198,7 +2429,8 @@ static void soundfile_xferout_words(int nchannels, t_word **vecs,
             }
             else
             {
-                for (j = 0, sp2 = sp, wp = vecs[i] + onset;
+                for (j = k, sp2 = sp + k * bytesperframe,
+                    wp = vecs[i] + onset + k;
                     j < nitems; j++, sp2 += bytesperframe, wp++)
                 {
                     f2.f = wp->w_float * normalfactor;
@@ -1213,6 +2445,7 @@ static void soundfile_xferout_words(int nchannels, t_word **vecs,
 /* ------- soundfiler - reads and writes soundfiles to/from "garrays" ---- */
 #define DEFMAXSIZE 0x7fffffff      /* default maximum size in sample frames */
 #define SAMPBUFSIZE 1024
+#define MAPCHUNKSIZE 1048576    /* bytes to convert at once from a mapping */
 
 
 static t_class *soundfiler_class;
@@ -1222,12 +2455,18 @@ typedef struct _soundfiler
     t_object x_obj;
     t_outlet *x_out2;
     t_canvas *x_canvas;
+    t_clock *x_clock;               /* polls for "-async" reads */
+    struct _sfload *x_loads;        /* "-async" reads, oldest first */
 } t_soundfiler;
 
+static void soundfiler_tick(t_soundfiler *x);
+
 static t_soundfiler *soundfiler_new(void)
 {
     t_soundfiler *x = (t_soundfiler *)pd_new(soundfiler_class);
     x->x_canvas = canvas_getcurrent();
+    x->x_clock = clock_new(x, (t_method)soundfiler_tick);
+    x->x_loads = 0;
     outlet_new(&x->x_obj, &s_float);
     x->x_out2 = outlet_new(&x->x_obj, &s_float);
     return (x);
@@ -1289,6 +2528,367 @@ static void soundfiler_readascii(t_soundfiler *x, const char *filename,
         -maxsize <max-size>
     */
 
+/* "read -async" hands the file to a pool of loader threads (as many as
+"-sfthreads" asks for) which parse the header and convert the samples into
+staging vectors, so that the scheduler and audio keep running meanwhile.
+The file is found and opened here since canvas_open() isn't threadsafe.  A
+clock polls for finished loads, which are copied into the arrays (resizing
+them first if asked) and reported in the order they were asked for, just as
+a synchronous read would report them.  readsf~ uses the same threads for
+"preload", keeping the bytes as they are in the file. */
+
+#define LOADBUFSIZE 65536       /* bytes per read() if we can't map the file */
+#define LOADPOLLMS 2            /* msec between checks for finished loads */
+
+typedef struct _sfload
+{
+    struct _sfload *l_next;     /* next load for the same owner */
+    struct _sfload *l_qnext;    /* next load waiting for a thread */
+    void *l_owner;              /* zero if the owner went away */
+    int l_done;                 /* set by the loader thread when finished */
+    int l_fd;                   /* file, positioned at its start */
+    const char *l_filename;
+    t_soundfile_info l_info;
+    long l_skipframes;
+    int l_resize;
+    long l_maxframes;           /* most frames to read */
+    int l_narray;
+    t_symbol *l_arrays[MAXSFCHANS];
+    int l_raw;                  /* just read the bytes into l_rawbuf */
+    t_float l_ms;               /* if l_raw, how many msec to read (0: all) */
+    long l_maxbytes;            /* if l_raw, most bytes to read */
+    t_soundfile_info l_asked;   /* l_info as it was asked for */
+        /* results */
+    int l_errno;                /* nonzero if the file couldn't be read */
+    int l_nvec;                 /* number of staging vectors */
+    long l_nframes;             /* frames to read */
+    long l_vecsize;             /* allocated size of each staging vector */
+    int l_truncated;            /* true if "-maxsize" cut the file short */
+    long l_itemsread;
+    t_word *l_vecs[MAXSFCHANS];
+    char *l_rawbuf;             /* l_itemsread frames if l_raw */
+    long l_rawsize;
+    int l_rawend;               /* true if l_rawbuf reaches the end */
+} t_sfload;
+
+static pthread_mutex_t sfload_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sfload_cond = PTHREAD_COND_INITIALIZER;
+static t_sfload *sfload_qhead, *sfload_qtail;
+static int sfload_nthreads;
+
+static void sfload_free(t_sfload *l)
+{
+    int i;
+    for (i = 0; i < l->l_nvec; i++)
+        freebytes(l->l_vecs[i], l->l_vecsize * sizeof(t_word));
+    if (l->l_rawbuf)
+        freebytes(l->l_rawbuf, l->l_rawsize);
+    if (l->l_fd >= 0)
+        soundfile_close(l->l_fd);
+    freebytes(l, sizeof(*l));
+}
+
+    /* the work done by a loader thread (without any locks held) */
+static void sfload_doload(t_sfload *l)
+{
+    long nframes, itemsread = 0;
+    int i, bytesperframe;
+    t_sfmap map;
+    if (open_soundfile_via_fd(l->l_fd, &l->l_info, l->l_skipframes) < 0)
+    {
+        l->l_errno = errno;
+        return;
+    }
+    bytesperframe = l->l_info.channels * l->l_info.bytespersample;
+    if (l->l_raw)
+    {
+        long want, have;
+        nframes = l->l_maxbytes / bytesperframe;
+        if (l->l_ms > 0 && l->l_ms * 0.001 * l->l_info.samplerate < nframes)
+            nframes = l->l_ms * 0.001 * l->l_info.samplerate;
+        if (nframes >= l->l_info.bytelimit / bytesperframe)
+        {
+            nframes = l->l_info.bytelimit / bytesperframe;
+            l->l_rawend = 1;
+        }
+        want = nframes * bytesperframe;
+        l->l_rawsize = (want ? want : 1);
+        if (!(l->l_rawbuf = (char *)getbytes(l->l_rawsize)))
+        {
+            l->l_errno = ENOMEM;
+            return;
+        }
+        have = soundfile_readframes(l->l_fd, l->l_rawbuf, nframes,
+            bytesperframe);
+        if (have < nframes)
+            l->l_rawend = 1;
+        l->l_itemsread = have;
+        return;
+    }
+    nframes = l->l_maxframes;
+    if (l->l_resize)
+    {
+            /* figure out what to resize to as soundfiler_read() does */
+        long framesinfile = soundfile_framesleft(l->l_fd, &l->l_info);
+        if (framesinfile < 0)
+        {
+            l->l_errno = ESPIPE;
+            return;
+        }
+        if (framesinfile > nframes)
+            l->l_truncated = 1;
+        else nframes = framesinfile;
+    }
+    if (nframes > l->l_info.bytelimit / bytesperframe)
+        nframes = l->l_info.bytelimit / bytesperframe;
+    l->l_nvec = (l->l_info.channels < l->l_narray ?
+        l->l_info.channels : l->l_narray);
+    l->l_nframes = nframes;
+    l->l_vecsize = (nframes ? nframes : 1);
+    for (i = 0; i < l->l_nvec; i++)
+        if (!(l->l_vecs[i] =
+            (t_word *)getbytes(l->l_vecsize * sizeof(t_word))))
+    {
+        l->l_nvec = i;
+        l->l_errno = ENOMEM;
+        return;
+    }
+    if (soundfile_map(&map, l->l_fd, nframes, bytesperframe))
+    {
+        long chunk = MAPCHUNKSIZE / bytesperframe;
+        for (itemsread = 0; itemsread < map.m_nframes; )
+        {
+            long thisread = map.m_nframes - itemsread;
+            thisread = (thisread > chunk ? chunk : thisread);
+            soundfile_prefetch(&map, (itemsread + thisread) * bytesperframe,
+                chunk * bytesperframe);
+            soundfile_xferin_words(l->l_info.channels, l->l_nvec, l->l_vecs,
+                itemsread, (unsigned char *)map.m_data +
+                    itemsread * bytesperframe, thisread,
+                        l->l_info.bytespersample, l->l_info.bigendian);
+            itemsread += thisread;
+        }
+        soundfile_unmap(&map);
+    }
+    else
+    {
+        char *buf = (char *)getbytes(LOADBUFSIZE);
+        long bufframes = LOADBUFSIZE / bytesperframe, have = 0;
+        if (!buf)
+        {
+            l->l_errno = ENOMEM;
+            return;
+        }
+            /* read() may return partial frames, so keep leftovers */
+        while (itemsread < nframes)
+        {
+            long want = nframes - itemsread, got;
+            want = (want > bufframes ? bufframes : want) * bytesperframe;
+            if ((got = soundfile_read(l->l_fd, buf + have, want - have)) <= 0)
+                break;
+            have += got;
+            got = have / bytesperframe;
+            soundfile_xferin_words(l->l_info.channels, l->l_nvec, l->l_vecs,
+                itemsread, (unsigned char *)buf, got,
+                    l->l_info.bytespersample, l->l_info.bigendian);
+            itemsread += got;
+            have -= got * bytesperframe;
+            memmove(buf, buf + got * bytesperframe, have);
+        }
+        freebytes(buf, LOADBUFSIZE);
+    }
+    l->l_itemsread = itemsread;
+}
+
+static void *sfload_thread(void *dummy)
+{
+    sys_setthreadrole(SYS_THREAD_FILE);
+    pthread_mutex_lock(&sfload_mutex);
+    while (1)
+    {
+        t_sfload *l;
+        if (!(l = sfload_qhead))
+        {
+            pthread_cond_wait(&sfload_cond, &sfload_mutex);
+            continue;
+        }
+        if (!(sfload_qhead = l->l_qnext))
+            sfload_qtail = 0;
+        if (!l->l_owner)
+        {
+            sfload_free(l);
+            continue;
+        }
+        pthread_mutex_unlock(&sfload_mutex);
+        sfload_doload(l);
+        pthread_mutex_lock(&sfload_mutex);
+        if (l->l_owner)
+            l->l_done = 1;
+        else sfload_free(l);
+    }
+    return (0);
+}
+
+    /* hand a load to the loader threads, starting them the first time.
+    Called with sfload_mutex held; returns 0 if no thread could be started. */
+static int sfload_submit(t_sfload *l)
+{
+    if (!sfload_nthreads)
+    {
+        int i, n = (sys_sfthreads > 0 ? sys_sfthreads : 1);
+        for (i = 0; i < n; i++)
+        {
+            pthread_t thread;
+            if (pthread_create(&thread, 0, sfload_thread, 0))
+                break;
+            pthread_detach(thread);
+        }
+        if (!(sfload_nthreads = i))
+            return (0);
+    }
+    if (sfload_qtail)
+        sfload_qtail->l_qnext = l;
+    else sfload_qhead = l;
+    sfload_qtail = l;
+    pthread_cond_signal(&sfload_cond);
+    return (1);
+}
+
+    /* copy a finished load into its arrays and report it */
+static void soundfiler_finishload(t_soundfiler *x, t_sfload *l)
+{
+    int i;
+    long j;
+    if (l->l_errno)
+    {
+        pd_error(x, "soundfiler_read: %s: %s", l->l_filename,
+            (l->l_errno == EIO ? "unknown or bad header format" :
+                (l->l_errno == ESPIPE ? "lseek failed" :
+                    strerror(l->l_errno))));
+        l->l_itemsread = 0;
+    }
+    else
+    {
+        if (l->l_truncated)
+            pd_error(x, "soundfiler_read: truncated to %ld elements",
+                l->l_nframes);
+        for (i = 0; i < l->l_narray; i++)
+        {
+            t_garray *a;
+            int vecsize;
+            t_word *vec;
+            if (!(a = (t_garray *)pd_findbyclass(l->l_arrays[i],
+                garray_class)))
+            {
+                pd_error(x, "%s: no such table", l->l_arrays[i]->s_name);
+                continue;
+            }
+            if (l->l_resize)
+            {
+                garray_resize_long(a, l->l_nframes);
+                    /* for sanity's sake clear the save-in-patch flag */
+                garray_setsaveit(a, 0);
+            }
+            if (!garray_getfloatwords(a, &vecsize, &vec))
+            {
+                error("%s: bad template for tabwrite", l->l_arrays[i]->s_name);
+                continue;
+            }
+            j = (i < l->l_nvec ? l->l_itemsread : 0);
+            if (j > vecsize)
+                j = vecsize;
+            if (j)
+                memcpy(vec, l->l_vecs[i], j * sizeof(t_word));
+                /* zero out remaining elements, and vectors in excess of the
+                number of channels */
+            for (; j < vecsize; j++)
+                vec[j].w_float = 0;
+            garray_redraw(a);
+        }
+    }
+    outlet_soundfile_info(x->x_out2, &l->l_info);
+    outlet_float(x->x_obj.ob_outlet, (t_float)l->l_itemsread);
+}
+
+static void soundfiler_tick(t_soundfiler *x)
+{
+    t_sfload *l;
+    while (1)
+    {
+        pthread_mutex_lock(&sfload_mutex);
+        if ((l = x->x_loads) && l->l_done)
+            x->x_loads = l->l_next;
+        else l = 0;
+        pthread_mutex_unlock(&sfload_mutex);
+        if (!l)
+            break;
+        soundfiler_finishload(x, l);
+        sfload_free(l);
+    }
+    if (x->x_loads)
+        clock_delay(x->x_clock, LOADPOLLMS);
+}
+
+static void soundfiler_readasync(t_soundfiler *x, const char *filename,
+    t_soundfile_info *info, long skipframes, int resize, long maxframes,
+    int narray, t_atom *arrays)
+{
+    char buf[MAXPDSTRING], *bufptr;
+    t_sfload *l, **lp;
+    int i, fd = canvas_open(x->x_canvas, filename, "", buf, &bufptr,
+        MAXPDSTRING, 1);
+    if (fd < 0)
+    {
+        pd_error(x, "soundfiler_read: %s: %s", filename, strerror(errno));
+        outlet_soundfile_info(x->x_out2, info);
+        outlet_float(x->x_obj.ob_outlet, 0);
+        return;
+    }
+    l = (t_sfload *)getbytes(sizeof(*l));
+    l->l_owner = x;
+    l->l_fd = fd;
+    l->l_filename = filename;
+    l->l_info = *info;
+    l->l_skipframes = skipframes;
+    l->l_resize = resize;
+    l->l_maxframes = maxframes;
+    l->l_narray = narray;
+    for (i = 0; i < narray; i++)
+        l->l_arrays[i] = arrays[i].a_w.w_symbol;
+    pthread_mutex_lock(&sfload_mutex);
+    if (!sfload_submit(l))
+    {
+        pthread_mutex_unlock(&sfload_mutex);
+        pd_error(x, "soundfiler_read: couldn't start loader thread");
+        sfload_free(l);
+        outlet_soundfile_info(x->x_out2, info);
+        outlet_float(x->x_obj.ob_outlet, 0);
+        return;
+    }
+    for (lp = &x->x_loads; *lp; lp = &(*lp)->l_next)
+        ;
+    *lp = l;
+    pthread_mutex_unlock(&sfload_mutex);
+    clock_delay(x->x_clock, LOADPOLLMS);
+}
+
+static void soundfiler_free(t_soundfiler *x)
+{
+    t_sfload *l, *next;
+        /* loads still waiting or in progress are freed by the loader
+        threads; finished ones we free here. */
+    pthread_mutex_lock(&sfload_mutex);
+    for (l = x->x_loads; l; l = next)
+    {
+        next = l->l_next;
+        l->l_owner = 0;
+        if (l->l_done)
+            sfload_free(l);
+    }
+    pthread_mutex_unlock(&sfload_mutex);
+    clock_free(x->x_clock);
+}
+
 static void soundfiler_read(t_soundfiler *x, t_symbol *s,
     int argc, t_atom *argv)
 {
@@ -1302,16 +2902,16 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
     t_garray *garrays[MAXSFCHANS];
     t_word *vecs[MAXSFCHANS];
     char sampbuf[SAMPBUFSIZE];
-    int bufframes;
+    int bufframes, bytesperframe;
     long nitems;
-    FILE *fp;
-    int ascii = 0;
+    t_sfmap map;
+    int ascii = 0, async = 0;
     info.samplerate = 0,
     info.channels = 0,
     info.bytespersample = 0,
     info.headersize = -1,
     info.bigendian = 0,
-    info.bytelimit = 0x7fffffff;
+    info.bytelimit = SFMAXLENGTH;
     while (argc > 0 && argv->a_type == A_SYMBOL &&
         *argv->a_w.w_symbol->s_name == '-')
     {
@@ -1361,6 +2961,11 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
             resize = 1;
             argc -= 1; argv += 1;
         }
+        else if (!strcmp(flag, "async"))
+        {
+            async = 1;
+            argc -= 1; argv += 1;
+        }
         else if (!strcmp(flag, "maxsize"))
         {
             if (argc < 2 || argv[1].a_type != A_FLOAT ||
@@ -1407,6 +3012,13 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
             argc, garrays, vecs, resize, finalsize);
         return;
     }
+    if (async)
+    {
+        soundfiler_readasync(x, filename, &info, skipframes, resize,
+            (resize ? maxsize : (finalsize ? finalsize : 0x7fffffff)),
+                argc, argv);
+        return;
+    }
     fd = open_soundfile_via_canvas(x->x_canvas, filename, &info, skipframes);
 
     if (fd < 0)
@@ -1419,17 +3031,13 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
     if (resize)
     {
             /* figure out what to resize to */
-        long poswas, eofis, framesinfile;
+        long framesinfile = soundfile_framesleft(fd, &info);
 
-        poswas = (long)lseek(fd, 0, SEEK_CUR);
-        eofis = (long)lseek(fd, 0, SEEK_END);
-        if (poswas < 0 || eofis < 0 || eofis < poswas)
+        if (framesinfile < 0)
         {
             pd_error(x, "soundfiler_read: lseek failed");
             goto done;
         }
-        lseek(fd, poswas, SEEK_SET);
-        framesinfile = (eofis - poswas) / (info.channels * info.bytespersample);
         if (framesinfile > maxsize)
         {
             pd_error(x, "soundfiler_read: truncated to %ld elements", maxsize);
@@ -1457,18 +3065,41 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
     if (!finalsize) finalsize = 0x7fffffff;
     if (finalsize > info.bytelimit / (info.channels * info.bytespersample))
         finalsize = info.bytelimit / (info.channels * info.bytespersample);
-    fp = fdopen(fd, "rb");
-    bufframes = SAMPBUFSIZE / (info.channels * info.bytespersample);
-
-    for (itemsread = 0; itemsread < finalsize; )
+    bytesperframe = info.channels * info.bytespersample;
+    if (soundfile_map(&map, fd, finalsize, bytesperframe))
+    {
+            /* convert straight out of the mapping, a chunk at a time,
+            asking for each next chunk before converting this one */
+        bufframes = MAPCHUNKSIZE / bytesperframe;
+        for (itemsread = 0; itemsread < map.m_nframes; )
+        {
+            long thisread = map.m_nframes - itemsread;
+            thisread = (thisread > bufframes ? bufframes : thisread);
+            soundfile_prefetch(&map, (itemsread + thisread) * bytesperframe,
+                (long)bufframes * bytesperframe);
+            soundfile_xferin_words(info.channels, argc, vecs, itemsread,
+                (unsigned char *)map.m_data + itemsread * bytesperframe,
+                    thisread, info.bytespersample, info.bigendian);
+            itemsread += thisread;
+        }
+        soundfile_unmap(&map);
+    }
+    else
     {
-        long thisread = finalsize - itemsread;
-        thisread = (thisread > bufframes ? bufframes : thisread);
-        nitems = fread(sampbuf, info.channels * info.bytespersample, thisread, fp);
-        if (nitems <= 0) break;
-        soundfile_xferin_words(info.channels, argc, vecs, itemsread,
-            (unsigned char *)sampbuf, nitems, info.bytespersample, info.bigendian);
-        itemsread += nitems;
+        bufframes = SAMPBUFSIZE / bytesperframe;
+
+        for (itemsread = 0; itemsread < finalsize; )
+        {
+            long thisread = finalsize - itemsread;
+            thisread = (thisread > bufframes ? bufframes : thisread);
+            nitems = soundfile_readframes(fd, sampbuf, thisread,
+                bytesperframe);
+            if (nitems <= 0) break;
+            soundfile_xferin_words(info.channels, argc, vecs, itemsread,
+                (unsigned char *)sampbuf, nitems, info.bytespersample,
+                    info.bigendian);
+            itemsread += nitems;
+        }
     }
         /* zero out remaining elements of vectors */
     for (i = 0; i < argc; i++)
@@ -1490,16 +3121,14 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
         /* do all graphics updates */
     for (i = 0; i < argc; i++)
         garray_redraw(garrays[i]);
-    fclose(fp);
-    fd = -1;
     goto done;
 usage:
     pd_error(x, "usage: read [flags] filename tablename...");
-    post("flags: -skip <n> -resize -maxsize <n> ...");
+    post("flags: -skip <n> -resize -maxsize <n> -async ...");
     post("-raw <headerbytes> <channels> <bytespersamp> <endian (b, l, or n)>.");
 done:
     if (fd >= 0)
-        close (fd);
+        soundfile_close(fd);
     outlet_soundfile_info(x->x_out2, &info);
     outlet_float(x->x_obj.ob_outlet, (t_float)itemsread);
 }
@@ -1523,7 +3152,7 @@ long soundfiler_dowrite(void *obj, t_canvas *canvas,
 
     if (soundfiler_writeargparse(obj, &argc, &argv, &filesym, &filetype,
         &info->bytespersample, &swap, &info->bigendian, &normalize, &onset, &nframes,
-            &samplerate))
+            &samplerate, 0))
                 goto usage;
     info->channels = argc;
     if (info->channels < 1 || info->channels > MAXSFCHANS)
@@ -1607,7 +3236,8 @@ long soundfiler_dowrite(void *obj, t_canvas *canvas,
     if (fd >= 0)
     {
         soundfile_finishwrite(obj, filesym->s_name, fd,
-            filetype, nframes, itemswritten, info->channels * info->bytespersample, swap);
+            filetype, nframes, itemswritten, info->channels * info->bytespersample, swap,
+                info->headersize);
         close (fd);
     }
     return ((float)itemswritten);
@@ -1632,7 +3262,7 @@ static void soundfiler_write(t_soundfiler *x, t_symbol *s,
     info.bytespersample = 0,
     info.headersize = -1,
     info.bigendian = 0,
-    info.bytelimit = 0x7fffffff;
+    info.bytelimit = SFMAXLENGTH;
     bozo = soundfiler_dowrite(x, x->x_canvas, argc, argv, &info);
     outlet_soundfile_info(x->x_out2, &info);
     outlet_float(x->x_obj.ob_outlet, (t_float)bozo);
@@ -1641,7 +3271,7 @@ static void soundfiler_write(t_soundfiler *x, t_symbol *s,
 static void soundfiler_setup(void)
 {
     soundfiler_class = class_new(gensym("soundfiler"), (t_newmethod)soundfiler_new,
-        0, sizeof(t_soundfiler), 0, 0);
+        (t_method)soundfiler_free, sizeof(t_soundfiler), 0, 0);
     class_addmethod(soundfiler_class, (t_method)soundfiler_read, gensym("read"),
         A_GIMME, 0);
     class_addmethod(soundfiler_class, (t_method)soundfiler_write,
@@ -1654,14 +3284,18 @@ static void soundfiler_setup(void)
 /* READSF uses the Posix threads package; for the moment we're Linux
 only although this should be portable to the other platforms.
 
-Each instance of readsf~ owns a "child" thread for doing the unix (MSW?) file
-reading.  The parent thread signals the child each time:
+The unix (MSW?) file reading and writing for all readsf~ and writesf~ objects
+is done by a shared pool of "child" threads (see "-sfthreads").  The parent
+thread signals the pool each time:
     (1) a file wants opening or closing;
     (2) we've eaten another 1/16 of the shared buffer (so that the
-        child thread should check if it's time to read some more.)
-The child signals the parent whenever a read has completed.  Signalling
-is done by setting "conditions" and putting data in mutex-controlled common
-areas.
+        child should check if it's time to read some more.)
+Signalled objects wait in a priority queue ordered by how many frames are
+left before their FIFO runs dry (or, for writesf~, overflows); a child takes
+the most urgent one, does one open, close or READSIZE transfer for it, and
+puts it back in the queue if there's more to do.  The child signals the parent
+whenever a read has completed.  Signalling is done by setting "conditions" and
+putting data in mutex-controlled common areas.
 */
 
 #define MAXBYTESPERSAMPLE 4
@@ -1669,9 +3303,12 @@ areas.
 
 #define READSIZE 65536
 #define WRITESIZE 65536
+#define DIRECTALIGN 4096        /* "-direct" block alignment for O_DIRECT */
+#define DIRECTALLOC 33554432    /* "-direct" disk space to reserve at once */
 #define DEFBUFPERCHAN 262144
 #define MINBUFSIZE (4 * READSIZE)
 #define MAXBUFSIZE 16777216     /* arbitrary; just don't want to hang malloc */
+#define LOWWATERFRACTION 8      /* with "autogrow", grow if less is left */
 
 #define REQUEST_NOTHING 0
 #define REQUEST_OPEN 1
@@ -1710,6 +3347,8 @@ typedef struct _readsf
     long x_onsetframes;     /* number of sample frames to skip */
     long x_bytelimit;       /* max number of data bytes to read */
     int x_fd;               /* filedesc */
+    t_sfmap x_map;          /* the file mapped into memory if possible */
+    long x_mappos;          /* bytes taken from the mapping so far */
     int x_fifosize;         /* buffer size appropriately rounded down */
     int x_fifohead;         /* index of next byte to get from file */
     int x_fifotail;         /* index of next byte the ugen will read */
@@ -1717,17 +3356,39 @@ typedef struct _readsf
     int x_sigcountdown;     /* counter for signalling child for more data */
     int x_sigperiod;        /* number of ticks per signal */
     int x_filetype;         /* writesf~ only; type of file to create */
-    int x_itemswritten;     /* writesf~ only; items written */
+    long x_itemswritten;    /* writesf~ only; items written */
     int x_swap;             /* writesf~ only; true if byte swapping */
     t_float x_f;              /* writesf~ only; scalar for signal inlet */
     pthread_mutex_t x_mutex;
-    pthread_cond_t x_requestcondition;
     pthread_cond_t x_answercondition;
-    pthread_t x_childthread;
+    int x_iswriter;         /* true for writesf~ */
+    int (*x_servicefn)(struct _readsf *x);  /* one step of I/O work */
+    int x_poolstate;        /* POOL_IDLE etc; protected by the pool mutex */
+    int x_poolindex;        /* position in the pool's queue if queued */
+    long x_urgency;         /* frames left before under/overrun */
+    int x_inio;             /* true while the child reads into x_buf */
+    int x_primed;           /* FIFO was started off from a preload */
+    t_soundfile_info x_askinfo; /* file format as given to "open" */
+    t_sfload *x_cues;       /* readsf~ only; preloaded file onsets */
+    int x_played;           /* readsf~: output has begun since the open */
+    int x_full;             /* readsf~: FIFO has filled since the open */
+    int x_underruns;        /* readsf~: times we waited for the child */
+    long x_lowwater;        /* readsf~: fewest frames left once full */
+    int x_autogrow;         /* readsf~: grow buffer when running low */
+    t_clock *x_growclock;
+    int x_direct;           /* writesf~: DIRECT_NO etc. below */
+    char *x_dmem;           /* writesf~: memory for the "-direct" stage */
+    char *x_dbuf;           /* ... and the stage itself, DIRECTALIGN-ed */
+    int x_dfill;            /* bytes waiting in the stage */
+    off_t x_dpos;           /* file offset where the stage goes */
+    off_t x_dalloc;         /* file space reserved so far, or -1 */
+    long x_dsynced;         /* frames in the header at the last sync */
 } t_readsf;
 
+#define DIRECT_NO 0         /* ordinary writes through the page cache */
+#define DIRECT_CACHED 1     /* WRITESIZE blocks, but without O_DIRECT */
+#define DIRECT_ON 2         /* WRITESIZE blocks with O_DIRECT */
 
-/************** the child thread which performs file I/O ***********/
 
 #if 0
 static void pute(char *s)   /* debug routine */
@@ -1757,294 +3418,414 @@ static void readsf_fakewait(pthread_mutex_t *b)
 #define sfread_cond_signal(a)
 #endif
 
-static void *readsf_child_main(void *zz)
+/************** the pool of child threads which perform file I/O ***********/
+
+#define POOL_IDLE 0         /* not in the queue and not being serviced */
+#define POOL_QUEUED 1       /* waiting in the queue */
+#define POOL_RUNNING 2      /* being serviced by a child */
+#define POOL_SIGNALED 3     /* being serviced, and signalled again meanwhile */
+
+#define DEFSFTHREADS 4
+
+int sys_sfthreads = DEFSFTHREADS;   /* number of I/O threads in the pool */
+
+static pthread_mutex_t sfpool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sfpool_cond = PTHREAD_COND_INITIALIZER;
+static t_readsf **sfpool_heap;      /* objects waiting, most urgent first */
+static int sfpool_n, sfpool_size;
+static int sfpool_nthreads;
+
+    /* how many frames the object can go before its FIFO underruns (or for
+    writesf~, overflows).  Requests other than streaming go first. */
+static long sfpool_urgency(t_readsf *x)
 {
-    t_readsf *x = zz;
-#ifdef DEBUG_SOUNDFILE
-    pute("1\n");
-#endif
-    pthread_mutex_lock(&x->x_mutex);
-    while (1)
+    int n, bytesperframe = x->x_bytespersample * x->x_sfchannels;
+    if (x->x_requestcode != REQUEST_BUSY || x->x_fd < 0 || !bytesperframe)
+        return (-1);
+    if (x->x_iswriter)
     {
-        int fd, fifohead;
-        char *buf;
-#ifdef DEBUG_SOUNDFILE
-        pute("0\n");
-#endif
-        if (x->x_requestcode == REQUEST_NOTHING)
-        {
-#ifdef DEBUG_SOUNDFILE
-            pute("wait 2\n");
-#endif
-            sfread_cond_signal(&x->x_answercondition);
-            sfread_cond_wait(&x->x_requestcondition, &x->x_mutex);
-#ifdef DEBUG_SOUNDFILE
-            pute("3\n");
-#endif
+        if ((n = x->x_fifotail - x->x_fifohead) <= 0)
+            n += x->x_fifosize;
+    }
+    else if ((n = x->x_fifohead - x->x_fifotail) < 0)
+        n += x->x_fifosize;
+    return (n / bytesperframe);
+}
+
+static void sfpool_swap(int i, int j)
+{
+    t_readsf *x = sfpool_heap[i];
+    sfpool_heap[i] = sfpool_heap[j];
+    sfpool_heap[j] = x;
+    sfpool_heap[i]->x_poolindex = i;
+    sfpool_heap[j]->x_poolindex = j;
+}
+
+static void sfpool_sift(int i)
+{
+    while (i > 0 && sfpool_heap[i]->x_urgency <
+        sfpool_heap[(i-1)/2]->x_urgency)
+            sfpool_swap(i, (i-1)/2), i = (i-1)/2;
+    while (1)
+    {
+        int least = i, l = 2*i + 1, r = 2*i + 2;
+        if (l < sfpool_n &&
+            sfpool_heap[l]->x_urgency < sfpool_heap[least]->x_urgency)
+                least = l;
+        if (r < sfpool_n &&
+            sfpool_heap[r]->x_urgency < sfpool_heap[least]->x_urgency)
+                least = r;
+        if (least == i)
+            break;
+        sfpool_swap(i, least);
+        i = least;
+    }
+}
+
+    /* put an object in the queue, or requeue it by its current urgency.
+    Called with both the object's and the pool's mutex held. */
+static void sfpool_push(t_readsf *x)
+{
+    x->x_urgency = sfpool_urgency(x);
+    if (x->x_poolstate == POOL_QUEUED)
+    {
+        sfpool_sift(x->x_poolindex);
+        return;
+    }
+    if (sfpool_n == sfpool_size)
+    {
+        int newsize = (sfpool_size ? 2 * sfpool_size : 16);
+        sfpool_heap = (t_readsf **)resizebytes(sfpool_heap,
+            sfpool_size * sizeof(*sfpool_heap),
+                newsize * sizeof(*sfpool_heap));
+        sfpool_size = newsize;
+    }
+    x->x_poolstate = POOL_QUEUED;
+    sfpool_heap[x->x_poolindex = sfpool_n++] = x;
+    sfpool_sift(x->x_poolindex);
+    pthread_cond_signal(&sfpool_cond);
+}
+
+static t_readsf *sfpool_pop(void)
+{
+    t_readsf *x = sfpool_heap[0];
+    if (--sfpool_n)
+    {
+        sfpool_heap[0] = sfpool_heap[sfpool_n];
+        sfpool_heap[0]->x_poolindex = 0;
+        sfpool_sift(0);
+    }
+    return (x);
+}
+
+    /* signal the pool that the object wants attention.  Called with the
+    object's mutex held, where a private child used to be signalled. */
+static void sfpool_signal(t_readsf *x)
+{
+    pthread_mutex_lock(&sfpool_mutex);
+    if (x->x_poolstate == POOL_RUNNING)
+        x->x_poolstate = POOL_SIGNALED;
+    else if (x->x_poolstate != POOL_SIGNALED)
+        sfpool_push(x);
+    pthread_mutex_unlock(&sfpool_mutex);
+}
+
+static void *sfpool_child_main(void *dummy)
+{
+    sys_setthreadrole(SYS_THREAD_FILE);
+    pthread_mutex_lock(&sfpool_mutex);
+    while (1)
+    {
+        t_readsf *x;
+        int more;
+        if (!sfpool_n)
+        {
+            pthread_cond_wait(&sfpool_cond, &sfpool_mutex);
+            continue;
         }
-        else if (x->x_requestcode == REQUEST_OPEN)
-        {
-            char boo[80];
-            long sysrtn, wantbytes;
-
-                /* copy file stuff out of the data structure so we can
-                relinquish the mutex while we're in open_soundfile(). */
-            t_soundfile_info info;
-            long onsetframes = x->x_onsetframes;
-            const char *filename = x->x_filename;
-            const char *dirname = canvas_getdir(x->x_canvas)->s_name;
-            info.samplerate = x->x_samplerate;
-            info.channels = x->x_sfchannels;
-            info.headersize = x->x_skipheaderbytes;
-            info.bytespersample = x->x_bytespersample;
-            info.bigendian = x->x_bigendian;
-            info.bytelimit = 0x7fffffff;
-#ifdef DEBUG_SOUNDFILE
-            pute("4\n");
-#endif
-                /* alter the request code so that an ensuing "open" will get
-                noticed. */
-            x->x_requestcode = REQUEST_BUSY;
-            x->x_fileerror = 0;
+        x = sfpool_pop();
+        x->x_poolstate = POOL_RUNNING;
+        pthread_mutex_unlock(&sfpool_mutex);
 
-                /* if there's already a file open, close it */
-            if (x->x_fd >= 0)
-            {
-                fd = x->x_fd;
-                pthread_mutex_unlock(&x->x_mutex);
-                close (fd);
-                pthread_mutex_lock(&x->x_mutex);
-                x->x_fd = -1;
-                if (x->x_requestcode != REQUEST_BUSY)
-                    goto lost;
-            }
-                /* open the soundfile with the mutex unlocked */
-            pthread_mutex_unlock(&x->x_mutex);
-            fd = open_soundfile(dirname, filename, &info, onsetframes);
-            pthread_mutex_lock(&x->x_mutex);
+        pthread_mutex_lock(&x->x_mutex);
+        more = (*x->x_servicefn)(x);
+        pthread_mutex_lock(&sfpool_mutex);
+            /* once the object has quit its owner may free it as soon as we
+            let go of its mutex, so it must never go back in the queue. */
+        if (more > 0 || (more == 0 && x->x_poolstate == POOL_SIGNALED))
+        {
+            x->x_poolstate = POOL_IDLE;
+            sfpool_push(x);
+        }
+        else x->x_poolstate = POOL_IDLE;
+        pthread_mutex_unlock(&x->x_mutex);
+    }
+    return (0);
+}
 
-#ifdef DEBUG_SOUNDFILE
-            pute("5\n");
-#endif
-                /* copy back into the instance structure. */
-            x->x_bytespersample = info.bytespersample;
-            x->x_sfchannels = info.channels;
-            x->x_bigendian = info.bigendian;
-            x->x_fd = fd;
-            x->x_bytelimit = info.bytelimit;
-            if (fd < 0)
-            {
-                x->x_fileerror = errno;
-                x->x_eof = 1;
-#ifdef DEBUG_SOUNDFILE
-                pute("open failed\n");
-                pute(filename);
-                pute(dirname);
-#endif
-                goto lost;
-            }
-                /* check if another request has been made; if so, field it */
+    /* start the pool the first time a readsf~ or writesf~ is made */
+static void sfpool_start(void)
+{
+    pthread_mutex_lock(&sfpool_mutex);
+    if (!sfpool_nthreads)
+    {
+        int i, n = (sys_sfthreads > 0 ? sys_sfthreads : 1);
+        for (i = 0; i < n; i++)
+        {
+            pthread_t thread;
+            if (pthread_create(&thread, 0, sfpool_child_main, 0))
+                break;
+            pthread_detach(thread);
+        }
+        if (i < n)
+            error("sfthreads: only %d I/O threads could be started", i);
+        sfpool_nthreads = i;
+    }
+    pthread_mutex_unlock(&sfpool_mutex);
+}
+
+    /* close the file if one is open, relinquishing the mutex meanwhile */
+static void readsf_closefile(t_readsf *x)
+{
+    if (x->x_fd >= 0)
+    {
+        int fd = x->x_fd;
+        pthread_mutex_unlock(&x->x_mutex);
+        soundfile_unmap(&x->x_map);
+        soundfile_close(fd);
+        pthread_mutex_lock(&x->x_mutex);
+        x->x_fd = -1;
+    }
+}
+
+    /* copy the next "nbytes" out of the mapped file, like read() would.
+    The mapping is only touched by the child servicing us so we can do this
+    with the mutex relinquished. */
+static long readsf_mapread(t_readsf *x, char *buf, long nbytes)
+{
+    long pos = x->x_mappos;
+    if (nbytes > x->x_map.m_nframes - pos)
+        nbytes = x->x_map.m_nframes - pos;
+    if (nbytes <= 0)
+        return (0);
+        /* each time we go into another chunk, ask for the one after it */
+    if (pos / MAPCHUNKSIZE != (pos + nbytes) / MAPCHUNKSIZE)
+        soundfile_prefetch(&x->x_map,
+            ((pos + nbytes) / MAPCHUNKSIZE + 1) * MAPCHUNKSIZE, MAPCHUNKSIZE);
+    memcpy(buf, x->x_map.m_data + pos, nbytes);
+    x->x_mappos = pos + nbytes;
+    return (nbytes);
+}
+
+    /* fell out of streaming: close file if necessary, and signal once
+    more.  Returns nonzero if another request came in meanwhile. */
+static int readsf_lost(t_readsf *x)
+{
+    if (x->x_requestcode == REQUEST_BUSY)
+        x->x_requestcode = REQUEST_NOTHING;
+    readsf_closefile(x);
+    sfread_cond_signal(&x->x_answercondition);
+    return (x->x_requestcode != REQUEST_NOTHING);
+}
+
+    /* do one step of work for a readsf~: field a request or read one chunk
+    into the FIFO.  Called from a pool child with the mutex held.  Returns
+    1 if there's more to do right away, 0 to wait to be signalled again, or
+    -1 once the object has quit. */
+static int readsf_service(t_readsf *x)
+{
+    if (x->x_requestcode == REQUEST_NOTHING)
+    {
+        sfread_cond_signal(&x->x_answercondition);
+        return (0);
+    }
+    else if (x->x_requestcode == REQUEST_OPEN)
+    {
+        int fd;
+            /* copy file stuff out of the data structure so we can
+            relinquish the mutex while we're in open_soundfile(). */
+        t_soundfile_info info;
+        long onsetframes = x->x_onsetframes;
+        const char *filename = x->x_filename;
+        int primed = x->x_primed;
+        const char *dirname = canvas_getdir(x->x_canvas)->s_name;
+        info.samplerate = x->x_samplerate;
+        info.channels = x->x_sfchannels;
+        info.headersize = x->x_skipheaderbytes;
+        info.bytespersample = x->x_bytespersample;
+        info.bigendian = x->x_bigendian;
+        info.bytelimit = SFMAXLENGTH;
+            /* alter the request code so that an ensuing "open" will get
+            noticed. */
+        x->x_requestcode = REQUEST_BUSY;
+        x->x_fileerror = 0;
+        x->x_primed = 0;
+
+            /* if there's already a file open, close it */
+        if (x->x_fd >= 0)
+        {
+            readsf_closefile(x);
             if (x->x_requestcode != REQUEST_BUSY)
-                goto lost;
-#ifdef DEBUG_SOUNDFILE
-            pute("6\n");
-#endif
-            x->x_fifohead = 0;
-                    /* set fifosize from bufsize.  fifosize must be a
-                    multiple of the number of bytes eaten for each DSP
-                    tick.  We pessimistically assume MAXVECSIZE samples
-                    per tick since that could change.  There could be a
-                    problem here if the vector size increases while a
-                    soundfile is being played...  */
-            x->x_fifosize = x->x_bufsize - (x->x_bufsize %
-                (x->x_bytespersample * x->x_sfchannels * MAXVECSIZE));
-                    /* arrange for the "request" condition to be signalled 16
-                    times per buffer */
-#ifdef DEBUG_SOUNDFILE
-            sprintf(boo, "fifosize %d\n",
-                x->x_fifosize);
-            pute(boo);
-#endif
-            x->x_sigcountdown = x->x_sigperiod =
-                (x->x_fifosize /
-                    (16 * x->x_bytespersample * x->x_sfchannels *
-                        x->x_vecsize));
-                /* in a loop, wait for the fifo to get hungry and feed it */
+                return (readsf_lost(x));
+        }
+            /* open the soundfile with the mutex unlocked */
+        pthread_mutex_unlock(&x->x_mutex);
+        fd = open_soundfile(dirname, filename, &info, onsetframes);
+        pthread_mutex_lock(&x->x_mutex);
+            /* check if another request has been made; if so, field it
+            without copying anything back. */
+        if (x->x_requestcode != REQUEST_BUSY)
+        {
+            x->x_fd = fd;
+            return (readsf_lost(x));
+        }
+            /* if the FIFO holds a preload, the file had better not have
+            changed format since. */
+        if (primed && fd >= 0 && (info.bytespersample != x->x_bytespersample
+            || info.channels != x->x_sfchannels
+                || info.bigendian != x->x_bigendian))
+        {
+            soundfile_close(fd);
+            fd = -1;
+            errno = EIO;
+        }
 
-            while (x->x_requestcode == REQUEST_BUSY)
+            /* copy back into the instance structure. */
+        x->x_bytespersample = info.bytespersample;
+        x->x_sfchannels = info.channels;
+        x->x_bigendian = info.bigendian;
+        x->x_fd = fd;
+        x->x_bytelimit = info.bytelimit;
+        if (fd < 0)
+        {
+            x->x_fileerror = errno;
+            x->x_eof = 1;
+            return (readsf_lost(x));
+        }
+            /* map the file if we can (here the "frames" are bytes) */
+        x->x_mappos = 0;
+        if (soundfile_map(&x->x_map, fd, x->x_bytelimit, 1))
+            soundfile_prefetch(&x->x_map, 0, 2 * MAPCHUNKSIZE);
+        if (primed)
+            return (1);
+        x->x_fifohead = 0;
+                /* set fifosize from bufsize.  fifosize must be a
+                multiple of the number of bytes eaten for each DSP
+                tick.  We pessimistically assume MAXVECSIZE samples
+                per tick since that could change.  There could be a
+                problem here if the vector size increases while a
+                soundfile is being played...  */
+        x->x_fifosize = x->x_bufsize - (x->x_bufsize %
+            (x->x_bytespersample * x->x_sfchannels * MAXVECSIZE));
+                /* arrange for the "request" condition to be signalled 16
+                times per buffer */
+        x->x_sigcountdown = x->x_sigperiod =
+            (x->x_fifosize /
+                (16 * x->x_bytespersample * x->x_sfchannels *
+                    x->x_vecsize));
+            /* from now on, each time the fifo gets hungry we feed it */
+        return (1);
+    }
+    else if (x->x_requestcode == REQUEST_BUSY)
+    {
+        int fd, fifohead, fifosize = x->x_fifosize;
+        long sysrtn, wantbytes;
+        char *buf;
+        if (x->x_eof)
+            return (readsf_lost(x));
+        if (x->x_fifohead >= x->x_fifotail)
+        {
+                /* if the head is >= the tail, we can immediately read
+                to the end of the fifo.  Unless, that is, we would
+                read all the way to the end of the buffer and the
+                "tail" is zero; this would fill the buffer completely
+                which isn't allowed because you can't tell a completely
+                full buffer from an empty one. */
+            if (x->x_fifotail || (fifosize - x->x_fifohead > READSIZE))
             {
-                int fifosize = x->x_fifosize;
-#ifdef DEBUG_SOUNDFILE
-                pute("77\n");
-#endif
-                if (x->x_eof)
-                    break;
-                if (x->x_fifohead >= x->x_fifotail)
-                {
-                        /* if the head is >= the tail, we can immediately read
-                        to the end of the fifo.  Unless, that is, we would
-                        read all the way to the end of the buffer and the
-                        "tail" is zero; this would fill the buffer completely
-                        which isn't allowed because you can't tell a completely
-                        full buffer from an empty one. */
-                    if (x->x_fifotail || (fifosize - x->x_fifohead > READSIZE))
-                    {
-                        wantbytes = fifosize - x->x_fifohead;
-                        if (wantbytes > READSIZE)
-                            wantbytes = READSIZE;
-                        if (wantbytes > x->x_bytelimit)
-                            wantbytes = x->x_bytelimit;
-#ifdef DEBUG_SOUNDFILE
-                        sprintf(boo, "head %d, tail %d, size %d\n",
-                            x->x_fifohead, x->x_fifotail, wantbytes);
-                        pute(boo);
-#endif
-                    }
-                    else
-                    {
-#ifdef DEBUG_SOUNDFILE
-                        pute("wait 7a ...\n");
-#endif
-                        sfread_cond_signal(&x->x_answercondition);
-#ifdef DEBUG_SOUNDFILE
-                        pute("signalled\n");
-#endif
-                        sfread_cond_wait(&x->x_requestcondition,
-                            &x->x_mutex);
-#ifdef DEBUG_SOUNDFILE
-                        pute("7a done\n");
-#endif
-                        continue;
-                    }
-                }
-                else
-                {
-                        /* otherwise check if there are at least READSIZE
-                        bytes to read.  If not, wait and loop back. */
-                    wantbytes =  x->x_fifotail - x->x_fifohead - 1;
-                    if (wantbytes < READSIZE)
-                    {
-#ifdef DEBUG_SOUNDFILE
-                        pute("wait 7...\n");
-#endif
-                        sfread_cond_signal(&x->x_answercondition);
-                        sfread_cond_wait(&x->x_requestcondition,
-                            &x->x_mutex);
-#ifdef DEBUG_SOUNDFILE
-                        pute("7 done\n");
-#endif
-                        continue;
-                    }
-                    else wantbytes = READSIZE;
-                    if (wantbytes > x->x_bytelimit)
-                        wantbytes = x->x_bytelimit;
-                }
-#ifdef DEBUG_SOUNDFILE
-                pute("8\n");
-#endif
-                fd = x->x_fd;
-                buf = x->x_buf;
-                fifohead = x->x_fifohead;
-                pthread_mutex_unlock(&x->x_mutex);
-                sysrtn = read(fd, buf + fifohead, wantbytes);
-                pthread_mutex_lock(&x->x_mutex);
-                if (x->x_requestcode != REQUEST_BUSY)
-                    break;
-                if (sysrtn < 0)
-                {
-#ifdef DEBUG_SOUNDFILE
-                    pute("fileerror\n");
-#endif
-                    x->x_fileerror = errno;
-                    break;
-                }
-                else if (sysrtn == 0)
-                {
-                    x->x_eof = 1;
-                    break;
-                }
-                else
-                {
-                    x->x_fifohead += sysrtn;
-                    x->x_bytelimit -= sysrtn;
-                    if (x->x_fifohead == fifosize)
-                        x->x_fifohead = 0;
-                    if (x->x_bytelimit <= 0)
-                    {
-                        x->x_eof = 1;
-                        break;
-                    }
-                }
-#ifdef DEBUG_SOUNDFILE
-                sprintf(boo, "after: head %d, tail %d\n",
-                    x->x_fifohead, x->x_fifotail);
-                pute(boo);
-#endif
-                    /* signal parent in case it's waiting for data */
-                sfread_cond_signal(&x->x_answercondition);
+                wantbytes = fifosize - x->x_fifohead;
+                if (wantbytes > READSIZE)
+                    wantbytes = READSIZE;
+                if (wantbytes > x->x_bytelimit)
+                    wantbytes = x->x_bytelimit;
             }
-        lost:
-
-            if (x->x_requestcode == REQUEST_BUSY)
-                x->x_requestcode = REQUEST_NOTHING;
-                /* fell out of read loop: close file if necessary,
-                set EOF and signal once more */
-            if (x->x_fd >= 0)
+            else
             {
-                fd = x->x_fd;
-                pthread_mutex_unlock(&x->x_mutex);
-                close (fd);
-                pthread_mutex_lock(&x->x_mutex);
-                x->x_fd = -1;
+                sfread_cond_signal(&x->x_answercondition);
+                return (0);
             }
-            sfread_cond_signal(&x->x_answercondition);
-
         }
-        else if (x->x_requestcode == REQUEST_CLOSE)
+        else
         {
-            if (x->x_fd >= 0)
+                /* otherwise check if there are at least READSIZE
+                bytes to read.  If not, wait to be signalled. */
+            wantbytes =  x->x_fifotail - x->x_fifohead - 1;
+            if (wantbytes < READSIZE)
             {
-                fd = x->x_fd;
-                pthread_mutex_unlock(&x->x_mutex);
-                close (fd);
-                pthread_mutex_lock(&x->x_mutex);
-                x->x_fd = -1;
+                sfread_cond_signal(&x->x_answercondition);
+                return (0);
             }
-            if (x->x_requestcode == REQUEST_CLOSE)
-                x->x_requestcode = REQUEST_NOTHING;
-            sfread_cond_signal(&x->x_answercondition);
+            else wantbytes = READSIZE;
+            if (wantbytes > x->x_bytelimit)
+                wantbytes = x->x_bytelimit;
         }
-        else if (x->x_requestcode == REQUEST_QUIT)
+        fd = x->x_fd;
+        buf = x->x_buf;
+        fifohead = x->x_fifohead;
+        x->x_inio = 1;
+        pthread_mutex_unlock(&x->x_mutex);
+        if (x->x_map.m_base)
+            sysrtn = readsf_mapread(x, buf + fifohead, wantbytes);
+        else sysrtn = soundfile_read(fd, buf + fifohead, wantbytes);
+        pthread_mutex_lock(&x->x_mutex);
+        x->x_inio = 0;
+        if (x->x_requestcode != REQUEST_BUSY)
+            return (readsf_lost(x));
+        if (sysrtn < 0)
         {
-            if (x->x_fd >= 0)
-            {
-                fd = x->x_fd;
-                pthread_mutex_unlock(&x->x_mutex);
-                close (fd);
-                pthread_mutex_lock(&x->x_mutex);
-                x->x_fd = -1;
-            }
-            x->x_requestcode = REQUEST_NOTHING;
-            sfread_cond_signal(&x->x_answercondition);
-            break;
+            x->x_fileerror = errno;
+            return (readsf_lost(x));
         }
-        else
+        else if (sysrtn == 0)
         {
-#ifdef DEBUG_SOUNDFILE
-            pute("13\n");
-#endif
+            x->x_eof = 1;
+            return (readsf_lost(x));
         }
+        x->x_fifohead += sysrtn;
+        x->x_bytelimit -= sysrtn;
+        if (x->x_fifohead == fifosize)
+            x->x_fifohead = 0;
+        if (x->x_bytelimit <= 0)
+        {
+            x->x_eof = 1;
+            return (readsf_lost(x));
+        }
+            /* signal parent in case it's waiting for data */
+        sfread_cond_signal(&x->x_answercondition);
+        return (1);
+    }
+    else if (x->x_requestcode == REQUEST_CLOSE)
+    {
+        readsf_closefile(x);
+        if (x->x_requestcode == REQUEST_CLOSE)
+            x->x_requestcode = REQUEST_NOTHING;
+        sfread_cond_signal(&x->x_answercondition);
+        return (x->x_requestcode != REQUEST_NOTHING);
+    }
+    else if (x->x_requestcode == REQUEST_QUIT)
+    {
+        readsf_closefile(x);
+        x->x_requestcode = REQUEST_NOTHING;
+        sfread_cond_signal(&x->x_answercondition);
+        return (-1);
     }
-#ifdef DEBUG_SOUNDFILE
-    pute("thread exit\n");
-#endif
-    pthread_mutex_unlock(&x->x_mutex);
     return (0);
 }
 
 /******** the object proper runs in the calling (parent) thread ****/
 
 static void readsf_tick(t_readsf *x);
+static void readsf_grow(t_readsf *x);
 
 static void *readsf_new(t_floatarg fnchannels, t_floatarg fbufsize)
 {
@@ -2071,11 +3852,12 @@ static void *readsf_new(t_floatarg fnchannels, t_floatarg fbufsize)
     x->x_noutlets = nchannels;
     x->x_bangout = outlet_new(&x->x_obj, &s_bang);
     pthread_mutex_init(&x->x_mutex, 0);
-    pthread_cond_init(&x->x_requestcondition, 0);
     pthread_cond_init(&x->x_answercondition, 0);
     x->x_vecsize = MAXVECSIZE;
     x->x_state = STATE_IDLE;
     x->x_clock = clock_new(x, (t_method)readsf_tick);
+    x->x_growclock = clock_new(x, (t_method)readsf_grow);
+    x->x_lowwater = -1;
     x->x_canvas = canvas_getcurrent();
     x->x_bytespersample = 2;
     x->x_sfchannels = 1;
@@ -2083,7 +3865,11 @@ static void *readsf_new(t_floatarg fnchannels, t_floatarg fbufsize)
     x->x_buf = buf;
     x->x_bufsize = bufsize;
     x->x_fifosize = x->x_fifohead = x->x_fifotail = x->x_requestcode = 0;
-    pthread_create(&x->x_childthread, 0, readsf_child_main, x);
+    x->x_map.m_base = 0;
+    x->x_iswriter = 0;
+    x->x_servicefn = readsf_service;
+    x->x_poolstate = POOL_IDLE;
+    sfpool_start();
     return (x);
 }
 
@@ -2092,6 +3878,56 @@ static void readsf_tick(t_readsf *x)
     outlet_bang(x->x_bangout);
 }
 
+    /* double the buffer, keeping what's in the FIFO.  Scheduled from the
+    perform routine when the FIFO ran low and "autogrow" is on. */
+static void readsf_grow(t_readsf *x)
+{
+    int newsize = 2 * x->x_bufsize, oldsize = x->x_bufsize, nbytes,
+        head, tail, fifosize, bytesperframe;
+    char *newbuf, *oldbuf;
+    if (newsize > MAXBUFSIZE)
+        newsize = MAXBUFSIZE;
+    if (newsize <= oldsize || !(newbuf = getbytes(newsize)))
+        return;
+    pthread_mutex_lock(&x->x_mutex);
+    if (x->x_inio)
+    {
+            /* the child is reading into the buffer; try again shortly */
+        pthread_mutex_unlock(&x->x_mutex);
+        freebytes(newbuf, newsize);
+        clock_delay(x->x_growclock, 1);
+        return;
+    }
+    head = x->x_fifohead;
+    tail = x->x_fifotail;
+    fifosize = x->x_fifosize;
+    if (head >= tail)
+        memcpy(newbuf, x->x_buf + tail, (nbytes = head - tail));
+    else
+    {
+        memcpy(newbuf, x->x_buf + tail, fifosize - tail);
+        memcpy(newbuf + (fifosize - tail), x->x_buf, head);
+        nbytes = fifosize - tail + head;
+    }
+    oldbuf = x->x_buf;
+    x->x_buf = newbuf;
+    x->x_bufsize = newsize;
+    x->x_fifotail = 0;
+    x->x_fifohead = nbytes;
+    if (fifosize)
+    {
+        bytesperframe = x->x_bytespersample * x->x_sfchannels;
+        x->x_fifosize = newsize - (newsize % (bytesperframe * MAXVECSIZE));
+        x->x_sigcountdown = x->x_sigperiod =
+            (x->x_fifosize / (16 * bytesperframe * x->x_vecsize));
+    }
+        /* wait for the bigger FIFO to fill before watching it again */
+    x->x_full = 0;
+    pthread_mutex_unlock(&x->x_mutex);
+    freebytes(oldbuf, oldsize);
+    post("readsf~: buffer grown to %d bytes", newsize);
+}
+
 static t_int *readsf_perform(t_int *w)
 {
     t_readsf *x = (t_readsf *)(w[1]);
@@ -2101,7 +3937,7 @@ static t_int *readsf_perform(t_int *w)
     t_sample *fp;
     if (x->x_state == STATE_STREAM)
     {
-        int wantbytes, sfchannels = x->x_sfchannels;
+        int wantbytes, sfchannels = x->x_sfchannels, waited = 0, fill;
         pthread_mutex_lock(&x->x_mutex);
         wantbytes = sfchannels * vecsize * bytespersample;
         while (
@@ -2111,7 +3947,8 @@ static t_int *readsf_perform(t_int *w)
 #ifdef DEBUG_SOUNDFILE
             pute("wait...\n");
 #endif
-            sfread_cond_signal(&x->x_requestcondition);
+            waited = 1;
+            sfpool_signal(x);
             sfread_cond_wait(&x->x_answercondition, &x->x_mutex);
                 /* resync local cariables -- bug fix thanks to Shahrokh */
             vecsize = x->x_vecsize;
@@ -2123,6 +3960,13 @@ static t_int *readsf_perform(t_int *w)
             pute("done\n");
 #endif
         }
+        if (waited && x->x_played)
+        {
+            x->x_underruns++;
+            if (x->x_autogrow && x->x_full)
+                clock_delay(x->x_growclock, 0);
+        }
+        x->x_played = 1;
         if (x->x_eof && x->x_fifohead >= x->x_fifotail &&
             x->x_fifohead < x->x_fifotail + wantbytes-1)
         {
@@ -2152,7 +3996,7 @@ static t_int *readsf_perform(t_int *w)
                 for (j = vecsize, fp = x->x_outvec[i] + xfersize; j--; )
                     *fp++ = 0;
 
-            sfread_cond_signal(&x->x_requestcondition);
+            sfpool_signal(x);
             pthread_mutex_unlock(&x->x_mutex);
             return (w+2);
         }
@@ -2164,9 +4008,23 @@ static t_int *readsf_perform(t_int *w)
         x->x_fifotail += wantbytes;
         if (x->x_fifotail >= x->x_fifosize)
             x->x_fifotail = 0;
+            /* keep track of how low the FIFO gets once it has first
+            filled up, ignoring the end of the file */
+        if ((fill = x->x_fifohead - x->x_fifotail) < 0)
+            fill += x->x_fifosize;
+        if (!x->x_full)
+            x->x_full = (fill >= x->x_fifosize / 2);
+        else if (!x->x_eof)
+        {
+            long frames = fill / (sfchannels * bytespersample);
+            if (x->x_lowwater < 0 || frames < x->x_lowwater)
+                x->x_lowwater = frames;
+            if (x->x_autogrow && fill < x->x_fifosize / LOWWATERFRACTION)
+                clock_delay(x->x_growclock, 0);
+        }
         if ((--x->x_sigcountdown) <= 0)
         {
-            sfread_cond_signal(&x->x_requestcondition);
+            sfpool_signal(x);
             x->x_sigcountdown = x->x_sigperiod;
         }
         pthread_mutex_unlock(&x->x_mutex);
@@ -2195,7 +4053,7 @@ static void readsf_stop(t_readsf *x)
     pthread_mutex_lock(&x->x_mutex);
     x->x_state = STATE_IDLE;
     x->x_requestcode = REQUEST_CLOSE;
-    sfread_cond_signal(&x->x_requestcondition);
+    sfpool_signal(x);
     pthread_mutex_unlock(&x->x_mutex);
 }
 
@@ -2206,46 +4064,254 @@ static void readsf_float(t_readsf *x, t_floatarg f)
     else readsf_stop(x);
 }
 
-    /* open method.  Called as:
-    open filename [skipframes headersize channels bytespersamp endianness]
+    /* get "skipframes headersize channels bytespersamp endianness", as
+    given to "open" or "preload", into "onset" and "info".
         (if headersize is zero, header is taken to be automatically
         detected; thus, use the special "-1" to mean a truly headerless file.)
     */
+static void readsf_getinfo(t_readsf *x, int argc, t_atom *argv,
+    long *onset, t_soundfile_info *info)
+{
+    t_float onsetframes = atom_getfloatarg(0, argc, argv);
+    t_float headerbytes = atom_getfloatarg(1, argc, argv);
+    t_float channels = atom_getfloatarg(2, argc, argv);
+    t_float bytespersamp = atom_getfloatarg(3, argc, argv);
+    t_symbol *endian = atom_getsymbolarg(4, argc, argv);
+    if (*endian->s_name == 'b')
+         info->bigendian = 1;
+    else if (*endian->s_name == 'l')
+         info->bigendian = 0;
+    else if (*endian->s_name)
+    {
+        pd_error(x, "endianness neither 'b' nor 'l'");
+        info->bigendian = x->x_bigendian;
+    }
+    else info->bigendian = garray_ambigendian();
+    *onset = (onsetframes > 0 ? onsetframes : 0);
+    info->headersize = (headerbytes > 0 ? headerbytes :
+        (headerbytes == 0 ? -1 : 0));
+    info->channels = (channels >= 1 ? channels : 1);
+    info->bytespersample = (bytespersamp > 2 ? bytespersamp : 2);
+    info->samplerate = 0;
+    info->bytelimit = SFMAXLENGTH;
+}
 
-static void readsf_open(t_readsf *x, t_symbol *s, int argc, t_atom *argv)
+    /* find a finished preload to start playing "filename" at "onset" from */
+static t_sfload *readsf_findcue(t_readsf *x, const char *filename,
+    long onset)
 {
-    t_symbol *filesym = atom_getsymbolarg(0, argc, argv);
-    t_float onsetframes = atom_getfloatarg(1, argc, argv);
-    t_float headerbytes = atom_getfloatarg(2, argc, argv);
-    t_float channels = atom_getfloatarg(3, argc, argv);
-    t_float bytespersamp = atom_getfloatarg(4, argc, argv);
-    t_symbol *endian = atom_getsymbolarg(5, argc, argv);
-    if (!*filesym->s_name)
+    t_sfload *l;
+    t_soundfile_info *ask = &x->x_askinfo;
+    pthread_mutex_lock(&sfload_mutex);
+    for (l = x->x_cues; l; l = l->l_next)
+        if (l->l_done && !l->l_errno && l->l_itemsread &&
+            !strcmp(l->l_filename, filename) && l->l_skipframes == onset &&
+            l->l_asked.headersize == ask->headersize &&
+            l->l_asked.channels == ask->channels &&
+            l->l_asked.bytespersample == ask->bytespersample &&
+            l->l_asked.bigendian == ask->bigendian)
+                break;
+    pthread_mutex_unlock(&sfload_mutex);
+    return (l);
+}
+
+    /* start the FIFO off with the contents of a preload, so that playback
+    can begin at once; the child then opens the file just after the end of
+    the preload and carries on from there.  Called with the mutex held.  */
+static void readsf_prime(t_readsf *x, t_sfload *l)
+{
+    int bytesperframe = l->l_info.channels * l->l_info.bytespersample,
+        fifosize = x->x_bufsize - (x->x_bufsize %
+            (bytesperframe * MAXVECSIZE));
+    long nbytes = l->l_itemsread * bytesperframe;
+    if (fifosize <= bytesperframe)
         return;
+        /* keep the child from starting another read, and wait for any
+        read in progress so it doesn't land on top of the preload. */
+    x->x_requestcode = REQUEST_NOTHING;
+    while (x->x_inio)
+        sfread_cond_wait(&x->x_answercondition, &x->x_mutex);
+        /* leave room in the FIFO so that it doesn't look empty */
+    if (nbytes > fifosize - bytesperframe)
+        nbytes = fifosize - bytesperframe;
+    memcpy(x->x_buf, l->l_rawbuf, nbytes);
+    x->x_bytespersample = l->l_info.bytespersample;
+    x->x_sfchannels = l->l_info.channels;
+    x->x_bigendian = l->l_info.bigendian;
+    x->x_fifosize = fifosize;
+    x->x_fifohead = nbytes;
+    x->x_fifotail = 0;
+    x->x_sigcountdown = x->x_sigperiod =
+        (fifosize / (16 * bytesperframe * x->x_vecsize));
+    x->x_onsetframes += nbytes / bytesperframe;
+    if (l->l_rawend && nbytes == l->l_itemsread * bytesperframe)
+    {
+            /* the whole file is in the FIFO; no need to open it again */
+        x->x_eof = 1;
+        x->x_requestcode = REQUEST_CLOSE;
+    }
+    else
+    {
+        x->x_primed = 1;
+        x->x_requestcode = REQUEST_OPEN;
+    }
+}
+
+    /* ask the child to open "filename" at "onset" with the format in
+    x_askinfo, and go to state "state" */
+static void readsf_doopen(t_readsf *x, const char *filename, long onset,
+    int state)
+{
+    t_sfload *l = readsf_findcue(x, filename, onset);
     pthread_mutex_lock(&x->x_mutex);
     x->x_requestcode = REQUEST_OPEN;
-    x->x_filename = filesym->s_name;
+    x->x_filename = filename;
     x->x_fifotail = 0;
     x->x_fifohead = 0;
-    if (*endian->s_name == 'b')
-         x->x_bigendian = 1;
-    else if (*endian->s_name == 'l')
-         x->x_bigendian = 0;
-    else if (*endian->s_name)
-        pd_error(x, "endianness neither 'b' nor 'l'");
-    else x->x_bigendian = garray_ambigendian();
-    x->x_onsetframes = (onsetframes > 0 ? onsetframes : 0);
-    x->x_skipheaderbytes = (headerbytes > 0 ? headerbytes :
-        (headerbytes == 0 ? -1 : 0));
-    x->x_sfchannels = (channels >= 1 ? channels : 1);
-    x->x_bytespersample = (bytespersamp > 2 ? bytespersamp : 2);
+    x->x_bigendian = x->x_askinfo.bigendian;
+    x->x_onsetframes = onset;
+    x->x_skipheaderbytes = x->x_askinfo.headersize;
+    x->x_sfchannels = x->x_askinfo.channels;
+    x->x_bytespersample = x->x_askinfo.bytespersample;
     x->x_eof = 0;
     x->x_fileerror = 0;
-    x->x_state = STATE_STARTUP;
-    sfread_cond_signal(&x->x_requestcondition);
+    x->x_primed = 0;
+    x->x_played = x->x_full = 0;
+    if (l)
+        readsf_prime(x, l);
+    x->x_state = state;
+    sfpool_signal(x);
     pthread_mutex_unlock(&x->x_mutex);
 }
 
+    /* open method.  Called as:
+    open filename [skipframes headersize channels bytespersamp endianness]
+    */
+
+static void readsf_open(t_readsf *x, t_symbol *s, int argc, t_atom *argv)
+{
+    t_symbol *filesym = atom_getsymbolarg(0, argc, argv);
+    long onset;
+    if (!*filesym->s_name)
+        return;
+    readsf_getinfo(x, argc - 1, argv + 1, &onset, &x->x_askinfo);
+    readsf_doopen(x, filesym->s_name, onset, STATE_STARTUP);
+}
+
+    /* seek method: reopen the current file at another onset, going on
+    playing if we were.  This is instant if the onset was preloaded. */
+static void readsf_seek(t_readsf *x, t_floatarg f)
+{
+    if (!x->x_filename)
+    {
+        pd_error(x, "readsf: seek requested with no prior 'open'");
+        return;
+    }
+    readsf_doopen(x, x->x_filename, (f > 0 ? f : 0),
+        (x->x_state == STATE_STREAM ? STATE_STREAM : STATE_STARTUP));
+}
+
+    /* forget a preload; if it's still loading the loader thread frees it */
+static void readsf_freecue(t_sfload *l)
+{
+    pthread_mutex_lock(&sfload_mutex);
+    l->l_owner = 0;
+    if (l->l_done)
+        sfload_free(l);
+    pthread_mutex_unlock(&sfload_mutex);
+}
+
+    /* unload method: forget preloads of "filename", or all of them */
+static void readsf_unload(t_readsf *x, t_symbol *s, int argc, t_atom *argv)
+{
+    t_symbol *filesym = atom_getsymbolarg(0, argc, argv);
+    t_sfload *l, **lp = &x->x_cues;
+    while ((l = *lp))
+    {
+        if (!*filesym->s_name || !strcmp(l->l_filename, filesym->s_name))
+        {
+            *lp = l->l_next;
+            readsf_freecue(l);
+        }
+        else lp = &l->l_next;
+    }
+}
+
+    /* preload method.  Called as:
+    preload [-ms <msec>] filename [skipframes headersize channels
+        bytespersamp endianness]
+        Reads the start of the file (as much as fits in the buffer, or
+    "msec" of it) into memory in the background, so that a later "open" of
+    the same file and onset, or a "seek" to the onset, starts at once. */
+static void readsf_preload(t_readsf *x, t_symbol *s, int argc, t_atom *argv)
+{
+    t_float ms = 0;
+    t_symbol *filesym;
+    t_soundfile_info info;
+    long onset;
+    char buf[MAXPDSTRING], *bufptr;
+    t_sfload *l, **lp;
+    int fd;
+    while (argc > 0 && argv->a_type == A_SYMBOL &&
+        *argv->a_w.w_symbol->s_name == '-')
+    {
+        if (!strcmp(argv->a_w.w_symbol->s_name, "-ms") && argc > 1 &&
+            argv[1].a_type == A_FLOAT)
+        {
+            ms = argv[1].a_w.w_float;
+            argc -= 2; argv += 2;
+        }
+        else goto usage;
+    }
+    filesym = atom_getsymbolarg(0, argc, argv);
+    if (!*filesym->s_name)
+        goto usage;
+    readsf_getinfo(x, argc - 1, argv + 1, &onset, &info);
+        /* for headerless files */
+    info.samplerate = sys_getsr();
+        /* a new preload replaces an old one of the same file and onset */
+    for (lp = &x->x_cues; (l = *lp); )
+    {
+        if (!strcmp(l->l_filename, filesym->s_name) &&
+            l->l_skipframes == onset)
+        {
+            *lp = l->l_next;
+            readsf_freecue(l);
+        }
+        else lp = &l->l_next;
+    }
+    if ((fd = canvas_open(x->x_canvas, filesym->s_name, "", buf, &bufptr,
+        MAXPDSTRING, 1)) < 0)
+    {
+        pd_error(x, "readsf~: preload %s: %s", filesym->s_name,
+            strerror(errno));
+        return;
+    }
+    l = (t_sfload *)getbytes(sizeof(*l));
+    l->l_owner = x;
+    l->l_fd = fd;
+    l->l_filename = filesym->s_name;
+    l->l_info = l->l_asked = info;
+    l->l_skipframes = onset;
+    l->l_raw = 1;
+    l->l_ms = ms;
+    l->l_maxbytes = x->x_bufsize;
+    pthread_mutex_lock(&sfload_mutex);
+    if (!sfload_submit(l))
+    {
+        pthread_mutex_unlock(&sfload_mutex);
+        pd_error(x, "readsf~: couldn't start loader thread");
+        sfload_free(l);
+        return;
+    }
+    l->l_next = x->x_cues;
+    x->x_cues = l;
+    pthread_mutex_unlock(&sfload_mutex);
+    return;
+usage:
+    pd_error(x, "usage: preload [-ms <msec>] filename [skipframes ...]");
+}
+
 static void readsf_dsp(t_readsf *x, t_signal **sp)
 {
     int i, noutlets = x->x_noutlets;
@@ -2268,35 +4334,44 @@ static void readsf_print(t_readsf *x)
     post("fifo size %d", x->x_fifosize);
     post("fd %d", x->x_fd);
     post("eof %d", x->x_eof);
+    post("buffer size %d", x->x_bufsize);
+    post("underruns %d", x->x_underruns);
+    if (x->x_lowwater >= 0)
+        post("low water %ld frames (%g msec)", x->x_lowwater,
+            1000. * x->x_lowwater / sys_getsr());
+}
+
+static void readsf_autogrow(t_readsf *x, t_floatarg f)
+{
+    x->x_autogrow = (f != 0);
 }
 
 static void readsf_free(t_readsf *x)
 {
         /* request QUIT and wait for acknowledge */
-    void *threadrtn;
     pthread_mutex_lock(&x->x_mutex);
     x->x_requestcode = REQUEST_QUIT;
-    sfread_cond_signal(&x->x_requestcondition);
+    sfpool_signal(x);
     while (x->x_requestcode != REQUEST_NOTHING)
     {
-        sfread_cond_signal(&x->x_requestcondition);
+        sfpool_signal(x);
         sfread_cond_wait(&x->x_answercondition, &x->x_mutex);
     }
     pthread_mutex_unlock(&x->x_mutex);
-    if (pthread_join(x->x_childthread, &threadrtn))
-        error("readsf_free: join failed");
+    readsf_unload(x, 0, 0, 0);
 
-    pthread_cond_destroy(&x->x_requestcondition);
     pthread_cond_destroy(&x->x_answercondition);
     pthread_mutex_destroy(&x->x_mutex);
     freebytes(x->x_buf, x->x_bufsize);
     clock_free(x->x_clock);
+    clock_free(x->x_growclock);
 }
 
 static void readsf_setup(void)
 {
     readsf_class = class_new(gensym("readsf~"), (t_newmethod)readsf_new,
         (t_method)readsf_free, sizeof(t_readsf), 0, A_DEFFLOAT, A_DEFFLOAT, 0);
+    class_setdspflags(readsf_class, CLASS_NOPARALLEL);
     class_addfloat(readsf_class, (t_method)readsf_float);
     class_addmethod(readsf_class, (t_method)readsf_start, gensym("start"), 0);
     class_addmethod(readsf_class, (t_method)readsf_stop, gensym("stop"), 0);
@@ -2304,7 +4379,15 @@ static void readsf_setup(void)
         gensym("dsp"), A_CANT, 0);
     class_addmethod(readsf_class, (t_method)readsf_open, gensym("open"),
         A_GIMME, 0);
+    class_addmethod(readsf_class, (t_method)readsf_seek, gensym("seek"),
+        A_FLOAT, 0);
+    class_addmethod(readsf_class, (t_method)readsf_preload,
+        gensym("preload"), A_GIMME, 0);
+    class_addmethod(readsf_class, (t_method)readsf_unload,
+        gensym("unload"), A_GIMME, 0);
     class_addmethod(readsf_class, (t_method)readsf_print, gensym("print"), 0);
+    class_addmethod(readsf_class, (t_method)readsf_autogrow,
+        gensym("autogrow"), A_FLOAT, 0);
 }
 
 /******************************* writesf *******************/
@@ -2313,232 +4396,296 @@ static t_class *writesf_class;
 
 #define t_writesf t_readsf      /* just re-use the structure */
 
-/************** the child thread which performs file I/O ***********/
+/************** the child's work for writesf~ ***********/
 
-static void *writesf_child_main(void *zz)
-{
-    t_writesf *x = zz;
-#ifdef DEBUG_SOUNDFILE
-    pute("1\n");
-#endif
-    pthread_mutex_lock(&x->x_mutex);
-    while (1)
-    {
-#ifdef DEBUG_SOUNDFILE
-        pute("0\n");
-#endif
-        if (x->x_requestcode == REQUEST_NOTHING)
-        {
-#ifdef DEBUG_SOUNDFILE
-            pute("wait 2\n");
-#endif
-            sfread_cond_signal(&x->x_answercondition);
-            sfread_cond_wait(&x->x_requestcondition, &x->x_mutex);
-#ifdef DEBUG_SOUNDFILE
-            pute("3\n");
-#endif
-        }
-        else if (x->x_requestcode == REQUEST_OPEN)
-        {
-            char boo[80];
-            int fd, writebytes;
-            long sysrtn;
+/* With "open -direct" the child gathers the sound into a WRITESIZE stage
+aligned in memory and on disk, and writes it out with O_DIRECT (F_NOCACHE
+on macOS) so that long recordings don't fill the page cache and stall the
+whole machine every time it is flushed.  Disk space is reserved DIRECTALLOC
+bytes at a time, and about once a second of sound the header is updated and
+synced so that a crash leaves a readable file.  The first block, which holds
+the header, goes through the cache like any other write.  The parent leaves
+these fields alone until the child is idle again. */
 
-                /* copy file stuff out of the data structure so we can
-                relinquish the mutex while we're in open_soundfile(). */
-            int bytespersample = x->x_bytespersample;
-            int sfchannels = x->x_sfchannels;
-            int bigendian = x->x_bigendian;
-            int filetype = x->x_filetype;
-            const char *filename = x->x_filename;
-            t_canvas *canvas = x->x_canvas;
-            t_float samplerate = x->x_samplerate;
-
-                /* alter the request code so that an ensuing "open" will get
-                noticed. */
-#ifdef DEBUG_SOUNDFILE
-            pute("4\n");
-#endif
-            x->x_requestcode = REQUEST_BUSY;
-            x->x_fileerror = 0;
-
-                /* if there's already a file open, close it.  This
-                should never happen since writesf_open() calls stop if
-                needed and then waits until we're idle. */
-            if (x->x_fd >= 0)
-            {
-                int bytesperframe = x->x_bytespersample * x->x_sfchannels;
-                const char *filename = x->x_filename;
-                int fd = x->x_fd;
-                int filetype = x->x_filetype;
-                int itemswritten = x->x_itemswritten;
-                int swap = x->x_swap;
-                pthread_mutex_unlock(&x->x_mutex);
-
-                soundfile_finishwrite(x, filename, fd,
-                    filetype, 0x7fffffff, itemswritten,
-                    bytesperframe, swap);
-                close (fd);
-
-                pthread_mutex_lock(&x->x_mutex);
-                x->x_fd = -1;
-#ifdef DEBUG_SOUNDFILE
-                {
-                    char s[1000];
-                    sprintf(s, "bug??? ditched %d\n", itemswritten);
-                    pute(s);
-                }
-#endif
-                if (x->x_requestcode != REQUEST_BUSY)
-                    continue;
-            }
-                /* open the soundfile with the mutex unlocked */
-            pthread_mutex_unlock(&x->x_mutex);
-            fd = create_soundfile(canvas, filename, filetype, 0,
-                    bytespersample, bigendian, sfchannels,
-                        garray_ambigendian() != bigendian, samplerate, 0);
-            pthread_mutex_lock(&x->x_mutex);
-#ifdef DEBUG_SOUNDFILE
-            pute("5\n");
-#endif
-
-            if (fd < 0)
-            {
-                x->x_fd = -1;
-                x->x_eof = 1;
-                x->x_fileerror = errno;
-#ifdef DEBUG_SOUNDFILE
-                pute("open failed\n");
-                pute(filename);
-#endif
-                x->x_requestcode = REQUEST_NOTHING;
-                continue;
-            }
-            /* check if another request has been made; if so, field it */
-            if (x->x_requestcode != REQUEST_BUSY)
-                continue;
-#ifdef DEBUG_SOUNDFILE
-            pute("6\n");
-#endif
-            x->x_fd = fd;
-            x->x_fifotail = 0;
-            x->x_itemswritten = 0;
-            x->x_swap = garray_ambigendian() != bigendian;
-                /* in a loop, wait for the fifo to have data and write it
-                    to disk */
-            while (x->x_requestcode == REQUEST_BUSY ||
-                (x->x_requestcode == REQUEST_CLOSE &&
-                    x->x_fifohead != x->x_fifotail))
-            {
-                int fifosize = x->x_fifosize, fifotail;
-                char *buf = x->x_buf;
-#ifdef DEBUG_SOUNDFILE
-                pute("77\n");
-#endif
-                    /* if the head is < the tail, we can immediately write
-                    from tail to end of fifo to disk; otherwise we hold off
-                    writing until there are at least WRITESIZE bytes in the
-                    buffer */
-                if (x->x_fifohead < x->x_fifotail ||
-                    x->x_fifohead >= x->x_fifotail + WRITESIZE
-                    || (x->x_requestcode == REQUEST_CLOSE &&
-                        x->x_fifohead != x->x_fifotail))
-                {
-                    writebytes = (x->x_fifohead < x->x_fifotail ?
-                        fifosize : x->x_fifohead) - x->x_fifotail;
-                    if (writebytes > READSIZE)
-                        writebytes = READSIZE;
-                }
-                else
-                {
-#ifdef DEBUG_SOUNDFILE
-                    pute("wait 7a ...\n");
-#endif
-                    sfread_cond_signal(&x->x_answercondition);
-#ifdef DEBUG_SOUNDFILE
-                    pute("signalled\n");
-#endif
-                    sfread_cond_wait(&x->x_requestcondition,
-                        &x->x_mutex);
-#ifdef DEBUG_SOUNDFILE
-                    pute("7a done\n");
-#endif
-                    continue;
-                }
-#ifdef DEBUG_SOUNDFILE
-                pute("8\n");
+#ifndef _WIN32
+static int writesf_fddirect(int fd, int on)
+{
+#if defined(O_DIRECT)
+    int flags = fcntl(fd, F_GETFL);
+    return (flags >= 0 && fcntl(fd, F_SETFL,
+        (on ? (flags | O_DIRECT) : (flags & ~O_DIRECT))) >= 0);
+#elif defined(F_NOCACHE)
+    return (fcntl(fd, F_NOCACHE, on) >= 0);
+#else
+    return (0);
 #endif
-                fifotail = x->x_fifotail;
-                fd = x->x_fd;
-                pthread_mutex_unlock(&x->x_mutex);
-                sysrtn = write(fd, buf + fifotail, writebytes);
-                pthread_mutex_lock(&x->x_mutex);
-                if (x->x_requestcode != REQUEST_BUSY &&
-                    x->x_requestcode != REQUEST_CLOSE)
-                        break;
-                if (sysrtn < writebytes)
-                {
-#ifdef DEBUG_SOUNDFILE
-                    pute("fileerror\n");
+}
+
+    /* write "nbytes" of the stage to disk and empty it.  nbytes is WRITESIZE
+    except for the last, partial block at close, when O_DIRECT is off. */
+static int writesf_flushdirect(t_writesf *x, int fd, int nbytes)
+{
+    char *from = x->x_dbuf;
+    off_t where = x->x_dpos;
+    int n = nbytes, headersize = x->x_skipheaderbytes;
+    long sysrtn, ondisk;
+    if (!where)     /* create_soundfile() already wrote the header */
+    {
+        from += headersize;
+        where += headersize;
+        n -= headersize;
+    }
+#ifdef __linux__
+    if (x->x_dalloc >= 0 && x->x_dpos + nbytes > x->x_dalloc)
+    {
+            /* reserve space ahead without changing the file's length */
+        if (fallocate(fd, FALLOC_FL_KEEP_SIZE, x->x_dalloc, DIRECTALLOC) < 0)
+            x->x_dalloc = -1;   /* not supported here; don't try again */
+        else x->x_dalloc += DIRECTALLOC;
+    }
 #endif
-                    x->x_fileerror = errno;
-                    break;
-                }
-                else
-                {
-                    x->x_fifotail += sysrtn;
-                    if (x->x_fifotail == fifosize)
-                        x->x_fifotail = 0;
-                }
-                x->x_itemswritten +=
-                    sysrtn / (x->x_bytespersample * x->x_sfchannels);
-#ifdef DEBUG_SOUNDFILE
-                sprintf(boo, "after: head %d, tail %d written %d\n",
-                    x->x_fifohead, x->x_fifotail, x->x_itemswritten);
-                pute(boo);
+    if (lseek(fd, where, SEEK_SET) < 0)
+        return (-1);
+    sysrtn = write(fd, from, n);
+    if (sysrtn < 0 && errno == EINVAL && x->x_direct == DIRECT_ON)
+    {
+            /* the filesystem wants another alignment: use the cache */
+        writesf_fddirect(fd, 0);
+        x->x_direct = DIRECT_CACHED;
+        sysrtn = write(fd, from, n);
+    }
+    if (sysrtn < n)
+        return (-1);
+    if (!x->x_dpos && nbytes == WRITESIZE && writesf_fddirect(fd, 1))
+        x->x_direct = DIRECT_ON;
+    x->x_dpos += nbytes;
+    x->x_dfill = 0;
+    ondisk = (x->x_dpos - headersize) /
+        (x->x_bytespersample * x->x_sfchannels);
+    if (nbytes == WRITESIZE && ondisk - x->x_dsynced >= x->x_samplerate)
+    {
+        if (x->x_direct == DIRECT_ON)
+            writesf_fddirect(fd, 0);
+        soundfile_finishwrite(x, x->x_filename, fd, x->x_filetype,
+            SFMAXLENGTH, ondisk, x->x_bytespersample * x->x_sfchannels,
+                x->x_swap, headersize);
+#ifdef __linux__
+        fdatasync(fd);
+#else
+        fsync(fd);
 #endif
-                    /* signal parent in case it's waiting for data */
-                sfread_cond_signal(&x->x_answercondition);
-            }
+        if (x->x_direct == DIRECT_ON)
+            writesf_fddirect(fd, 1);
+        x->x_dsynced = ondisk;
+    }
+    return (0);
+}
+
+    /* copy a chunk of the FIFO into the stage, writing the stage out
+    whenever it fills.  Returns the number of bytes taken, or -1. */
+static long writesf_directwrite(t_writesf *x, int fd, const char *buf,
+    int nbytes)
+{
+    int left = nbytes;
+    while (left > 0)
+    {
+        int n = WRITESIZE - x->x_dfill;
+        if (n > left)
+            n = left;
+        memcpy(x->x_dbuf + x->x_dfill, buf, n);
+        x->x_dfill += n;
+        buf += n;
+        left -= n;
+        if (x->x_dfill == WRITESIZE && writesf_flushdirect(x, fd, WRITESIZE))
+            return (-1);
+    }
+    return (nbytes);
+}
+
+    /* write out whatever is left in the stage at close, and give back
+    the space we reserved beyond it */
+static void writesf_closedirect(t_writesf *x, int fd)
+{
+    if (x->x_direct == DIRECT_ON)
+        writesf_fddirect(fd, 0);
+    x->x_direct = DIRECT_CACHED;
+    if (writesf_flushdirect(x, fd, x->x_dfill) < 0 ||
+        ftruncate(fd, x->x_dpos) < 0)
+            post("%s: %s", x->x_filename, strerror(errno));
+}
+#endif /* _WIN32 */
+
+    /* finish the header and close the file if one is open, relinquishing
+    the mutex meanwhile */
+static void writesf_closefile(t_writesf *x)
+{
+    if (x->x_fd >= 0)
+    {
+        int bytesperframe = x->x_bytespersample * x->x_sfchannels;
+        const char *filename = x->x_filename;
+        int fd = x->x_fd;
+        int filetype = x->x_filetype;
+        long itemswritten = x->x_itemswritten;
+        int swap = x->x_swap, headersize = x->x_skipheaderbytes;
+        pthread_mutex_unlock(&x->x_mutex);
+
+#ifndef _WIN32
+        if (x->x_direct)
+            writesf_closedirect(x, fd);
+#endif
+        soundfile_finishwrite(x, filename, fd,
+            filetype, SFMAXLENGTH, itemswritten,
+            bytesperframe, swap, headersize);
+        close (fd);
+
+        pthread_mutex_lock(&x->x_mutex);
+        x->x_fd = -1;
+    }
+}
+
+    /* do one step of work for a writesf~: field a request or write one
+    chunk out of the FIFO.  Returns as readsf_service() does. */
+static int writesf_service(t_writesf *x)
+{
+    if (x->x_requestcode == REQUEST_NOTHING)
+    {
+            /* no file to write to: drop anything the parent queued so it
+            never waits for room. */
+        x->x_fifotail = x->x_fifohead;
+        sfread_cond_signal(&x->x_answercondition);
+        return (0);
+    }
+    else if (x->x_requestcode == REQUEST_OPEN)
+    {
+        int fd, headersize = 0;
+
+            /* copy file stuff out of the data structure so we can
+            relinquish the mutex while we're in open_soundfile(). */
+        int bytespersample = x->x_bytespersample;
+        int sfchannels = x->x_sfchannels;
+        int bigendian = x->x_bigendian;
+        int filetype = x->x_filetype;
+        const char *filename = x->x_filename;
+        t_canvas *canvas = x->x_canvas;
+        t_float samplerate = x->x_samplerate;
+
+            /* alter the request code so that an ensuing "open" will get
+            noticed. */
+        x->x_requestcode = REQUEST_BUSY;
+        x->x_fileerror = 0;
+
+            /* if there's already a file open, close it.  This
+            should never happen since writesf_open() calls stop if
+            needed and then waits until we're idle. */
+        if (x->x_fd >= 0)
+        {
+            writesf_closefile(x);
+            if (x->x_requestcode != REQUEST_BUSY)
+                return (1);
         }
-        else if (x->x_requestcode == REQUEST_CLOSE ||
-            x->x_requestcode == REQUEST_QUIT)
+            /* open the soundfile with the mutex unlocked */
+        pthread_mutex_unlock(&x->x_mutex);
+        fd = create_soundfile(canvas, filename, filetype, 0,
+                bytespersample, bigendian, sfchannels,
+                    garray_ambigendian() != bigendian, samplerate,
+                        &headersize);
+        pthread_mutex_lock(&x->x_mutex);
+
+        if (fd < 0)
         {
-            int quit = (x->x_requestcode == REQUEST_QUIT);
-            if (x->x_fd >= 0)
-            {
-                int bytesperframe = x->x_bytespersample * x->x_sfchannels;
-                const char *filename = x->x_filename;
-                int fd = x->x_fd;
-                int filetype = x->x_filetype;
-                int itemswritten = x->x_itemswritten;
-                int swap = x->x_swap;
-                pthread_mutex_unlock(&x->x_mutex);
-
-                soundfile_finishwrite(x, filename, fd,
-                    filetype, 0x7fffffff, itemswritten,
-                    bytesperframe, swap);
-                close (fd);
-
-                pthread_mutex_lock(&x->x_mutex);
-                x->x_fd = -1;
-            }
+            x->x_fd = -1;
+            x->x_eof = 1;
+            x->x_fileerror = errno;
             x->x_requestcode = REQUEST_NOTHING;
-            sfread_cond_signal(&x->x_answercondition);
-            if (quit)
-                break;
+            return (1);
+        }
+        /* check if another request has been made; if so, field it */
+        if (x->x_requestcode != REQUEST_BUSY)
+            return (1);
+        x->x_fd = fd;
+        x->x_fifotail = 0;
+        x->x_itemswritten = 0;
+        x->x_swap = garray_ambigendian() != bigendian;
+        x->x_skipheaderbytes = x->x_dfill = headersize;
+        x->x_dpos = x->x_dalloc = 0;
+        x->x_dsynced = 0;
+            /* from now on, each time the fifo has data we write it
+                to disk */
+        return (1);
+    }
+    else if (x->x_fd >= 0 && !x->x_eof &&
+        (x->x_requestcode == REQUEST_BUSY ||
+        (x->x_requestcode == REQUEST_CLOSE &&
+            x->x_fifohead != x->x_fifotail)))
+    {
+        int fd, writebytes, fifosize = x->x_fifosize, fifotail;
+        long sysrtn;
+        char *buf = x->x_buf;
+            /* if the head is < the tail, we can immediately write
+            from tail to end of fifo to disk; otherwise we hold off
+            writing until there are at least WRITESIZE bytes in the
+            buffer */
+        if (x->x_fifohead < x->x_fifotail ||
+            x->x_fifohead >= x->x_fifotail + WRITESIZE
+            || (x->x_requestcode == REQUEST_CLOSE &&
+                x->x_fifohead != x->x_fifotail))
+        {
+            writebytes = (x->x_fifohead < x->x_fifotail ?
+                fifosize : x->x_fifohead) - x->x_fifotail;
+                /* whole frames only, so that x_itemswritten stays exact */
+            if (writebytes > READSIZE)
+                writebytes = READSIZE - READSIZE %
+                    (x->x_bytespersample * x->x_sfchannels);
         }
         else
         {
-#ifdef DEBUG_SOUNDFILE
-            pute("13\n");
+            sfread_cond_signal(&x->x_answercondition);
+            return (0);
+        }
+        fifotail = x->x_fifotail;
+        fd = x->x_fd;
+        pthread_mutex_unlock(&x->x_mutex);
+#ifndef _WIN32
+        if (x->x_direct)
+            sysrtn = writesf_directwrite(x, fd, buf + fifotail, writebytes);
+        else
 #endif
+        sysrtn = write(fd, buf + fifotail, writebytes);
+        pthread_mutex_lock(&x->x_mutex);
+        if (x->x_requestcode != REQUEST_BUSY &&
+            x->x_requestcode != REQUEST_CLOSE)
+                return (1);
+        if (sysrtn < writebytes)
+        {
+            x->x_fileerror = errno;
+            x->x_eof = 1;
+            return (1);
+        }
+        else
+        {
+            x->x_fifotail += sysrtn;
+            if (x->x_fifotail == fifosize)
+                x->x_fifotail = 0;
         }
+        x->x_itemswritten +=
+            sysrtn / (x->x_bytespersample * x->x_sfchannels);
+            /* signal parent in case it's waiting for data */
+        sfread_cond_signal(&x->x_answercondition);
+        return (1);
     }
-#ifdef DEBUG_SOUNDFILE
-    pute("thread exit\n");
-#endif
-    pthread_mutex_unlock(&x->x_mutex);
+    else if (x->x_requestcode == REQUEST_CLOSE ||
+        x->x_requestcode == REQUEST_QUIT)
+    {
+        int quit = (x->x_requestcode == REQUEST_QUIT);
+        writesf_closefile(x);
+        x->x_requestcode = REQUEST_NOTHING;
+        sfread_cond_signal(&x->x_answercondition);
+        return (quit ? -1 : 0);
+    }
+        /* a write failed: stop writing and drop whatever the parent
+        queues until it asks us to close. */
+    x->x_fifotail = x->x_fifohead;
+    sfread_cond_signal(&x->x_answercondition);
     return (0);
 }
 
@@ -2572,7 +4719,6 @@ static void *writesf_new(t_floatarg fnchannels, t_floatarg fbufsize)
     x->x_f = 0;
     x->x_sfchannels = nchannels;
     pthread_mutex_init(&x->x_mutex, 0);
-    pthread_cond_init(&x->x_requestcondition, 0);
     pthread_cond_init(&x->x_answercondition, 0);
     x->x_vecsize = MAXVECSIZE;
     x->x_insamplerate = x->x_samplerate = 0;
@@ -2584,7 +4730,13 @@ static void *writesf_new(t_floatarg fnchannels, t_floatarg fbufsize)
     x->x_buf = buf;
     x->x_bufsize = bufsize;
     x->x_fifosize = x->x_fifohead = x->x_fifotail = x->x_requestcode = 0;
-    pthread_create(&x->x_childthread, 0, writesf_child_main, x);
+    x->x_map.m_base = 0;
+    x->x_iswriter = 1;
+    x->x_direct = 0;
+    x->x_dmem = x->x_dbuf = 0;
+    x->x_servicefn = writesf_service;
+    x->x_poolstate = POOL_IDLE;
+    sfpool_start();
     return (x);
 }
 
@@ -2607,7 +4759,7 @@ static t_int *writesf_perform(t_int *w)
             fprintf(stderr, "writesf waiting for disk write..\n");
             fprintf(stderr, "(head %d, tail %d, room %d, want %d)\n",
                 x->x_fifohead, x->x_fifotail, roominfifo, wantbytes);
-            sfread_cond_signal(&x->x_requestcondition);
+            sfpool_signal(x);
             sfread_cond_wait(&x->x_answercondition, &x->x_mutex);
             fprintf(stderr, "... done waiting.\n");
             roominfifo = x->x_fifotail - x->x_fifohead;
@@ -2627,7 +4779,7 @@ static t_int *writesf_perform(t_int *w)
 #ifdef DEBUG_SOUNDFILE
             pute("signal 1\n");
 #endif
-            sfread_cond_signal(&x->x_requestcondition);
+            sfpool_signal(x);
             x->x_sigcountdown = x->x_sigperiod;
         }
         pthread_mutex_unlock(&x->x_mutex);
@@ -2654,7 +4806,7 @@ static void writesf_stop(t_writesf *x)
 #ifdef DEBUG_SOUNDFILE
     pute("signal 2\n");
 #endif
-    sfread_cond_signal(&x->x_requestcondition);
+    sfpool_signal(x);
     pthread_mutex_unlock(&x->x_mutex);
 }
 
@@ -2666,7 +4818,7 @@ static void writesf_stop(t_writesf *x)
 static void writesf_open(t_writesf *x, t_symbol *s, int argc, t_atom *argv)
 {
     t_symbol *filesym;
-    int filetype, bytespersamp, swap, bigendian, normalize;
+    int filetype, bytespersamp, swap, bigendian, normalize, direct;
     long onset, nframes;
     t_float samplerate;
     if (x->x_state != STATE_IDLE)
@@ -2675,21 +4827,38 @@ static void writesf_open(t_writesf *x, t_symbol *s, int argc, t_atom *argv)
     }
     if (soundfiler_writeargparse(x, &argc,
         &argv, &filesym, &filetype, &bytespersamp, &swap, &bigendian,
-        &normalize, &onset, &nframes, &samplerate))
+        &normalize, &onset, &nframes, &samplerate, &direct))
     {
         pd_error(x,
             "writesf~: usage: open [-bytes [234]] [-wave,-nextstep,-aiff] ...");
-        post("... [-big,-little] [-rate ####] filename");
+        post("... [-big,-little] [-rate ####] [-direct] filename");
         return;
     }
-    if (normalize || onset || (nframes != 0x7fffffff))
+#ifdef _WIN32
+    if (direct)
+    {
+        pd_error(x, "writesf~: -direct: not available on this platform");
+        direct = 0;
+    }
+#endif
+    if (direct && !x->x_dmem)
+    {
+        if (!(x->x_dmem = (char *)getbytes(WRITESIZE + DIRECTALIGN)))
+        {
+            pd_error(x, "writesf~: -direct: out of memory");
+            direct = 0;
+        }
+        else x->x_dbuf = (char *)(((uintptr_t)x->x_dmem + DIRECTALIGN - 1) &
+            ~(uintptr_t)(DIRECTALIGN - 1));
+    }
+    if (normalize || onset || (nframes != SFMAXLENGTH))
         pd_error(x, "normalize/onset/nframes argument to writesf~: ignored");
     if (argc)
         pd_error(x, "extra argument(s) to writesf~: ignored");
     pthread_mutex_lock(&x->x_mutex);
     while (x->x_requestcode != REQUEST_NOTHING)
     {
-        sfread_cond_signal(&x->x_requestcondition);
+        sfpool_signal(x);
         sfread_cond_wait(&x->x_answercondition, &x->x_mutex);
     }
     x->x_bytespersample = bytespersamp;
@@ -2698,6 +4867,7 @@ static void writesf_open(t_writesf *x, t_symbol *s, int argc, t_atom *argv)
     x->x_filename = filesym->s_name;
     x->x_filetype = filetype;
     x->x_itemswritten = 0;
+    x->x_direct = (direct ? DIRECT_CACHED : DIRECT_NO);
     x->x_requestcode = REQUEST_OPEN;
     x->x_fifotail = 0;
     x->x_fifohead = 0;
@@ -2719,7 +4889,7 @@ static void writesf_open(t_writesf *x, t_symbol *s, int argc, t_atom *argv)
             times per buffer */
     x->x_sigcountdown = x->x_sigperiod = (x->x_fifosize /
             (16 * x->x_bytespersample * x->x_sfchannels * x->x_vecsize));
-    sfread_cond_signal(&x->x_requestcondition);
+    sfpool_signal(x);
     pthread_mutex_unlock(&x->x_mutex);
 }
 
@@ -2745,31 +4915,30 @@ static void writesf_print(t_writesf *x)
     post("fifo size %d", x->x_fifosize);
     post("fd %d", x->x_fd);
     post("eof %d", x->x_eof);
+    post("direct %d", x->x_direct);
 }
 
 static void writesf_free(t_writesf *x)
 {
         /* request QUIT and wait for acknowledge */
-    void *threadrtn;
     pthread_mutex_lock(&x->x_mutex);
     x->x_requestcode = REQUEST_QUIT;
     /* post("stopping writesf thread..."); */
-    sfread_cond_signal(&x->x_requestcondition);
+    sfpool_signal(x);
     while (x->x_requestcode != REQUEST_NOTHING)
     {
         /* post("signalling..."); */
-        sfread_cond_signal(&x->x_requestcondition);
+        sfpool_signal(x);
         sfread_cond_wait(&x->x_answercondition, &x->x_mutex);
     }
     pthread_mutex_unlock(&x->x_mutex);
-    if (pthread_join(x->x_childthread, &threadrtn))
-        error("writesf_free: join failed");
     /* post("... done."); */
 
-    pthread_cond_destroy(&x->x_requestcondition);
     pthread_cond_destroy(&x->x_answercondition);
     pthread_mutex_destroy(&x->x_mutex);
     freebytes(x->x_buf, x->x_bufsize);
+    if (x->x_dmem)
+        freebytes(x->x_dmem, WRITESIZE + DIRECTALIGN);
 }
 
 static void writesf_setup(void)
@@ -2786,6 +4955,534 @@ static void writesf_setup(void)
     CLASS_MAINSIGNALIN(writesf_class, t_writesf, x_f);
 }
 
+/* -------- writing Pd's output to a soundfile for "-batch -render" -------- */
+
+static int render_fd = -1;
+static t_symbol *render_filesym;
+static int render_filetype, render_bytespersamp, render_bigendian, render_swap,
+    render_nchannels, render_headersize;
+static long render_nframes, render_framesdone;
+
+    /* finish the file; called at exit too, so that "pd quit" leaves a
+    usable file behind */
+void soundfile_endrender(void)
+{
+    if (render_fd < 0)
+        return;
+    soundfile_finishwrite(0, render_filesym->s_name, render_fd,
+        render_filetype, render_nframes, render_framesdone,
+            render_nchannels * render_bytespersamp, render_swap,
+                render_headersize);
+    sys_close(render_fd);
+    render_fd = -1;
+}
+
+    /* open a file to render "nframes" frames of output to, choosing the
+    format from the file's extension as the soundfiler does.  Return 0 on
+    success. */
+int soundfile_startrender(const char *filename, int bytespersamp,
+    int nchannels, t_float samplerate, long nframes)
+{
+    static int atexitdone;
+    t_atom at[3], *argv = at;
+    int argc = 3, normalize;
+    long onset, nframesarg;
+    t_float rate;
+    SETSYMBOL(&at[0], gensym("-bytes"));
+    SETFLOAT(&at[1], bytespersamp);
+    SETSYMBOL(&at[2], gensym(filename));
+    if (soundfiler_writeargparse(0, &argc, &argv, &render_filesym,
+        &render_filetype, &render_bytespersamp, &render_swap,
+            &render_bigendian, &normalize, &onset, &nframesarg, &rate, 0))
+    {
+        error("-render %s: bad sample size %d", filename, bytespersamp);
+        return (-1);
+    }
+    if (nchannels < 1 || nchannels > MAXSFCHANS)
+    {
+        error("-render: can't write %d channels", nchannels);
+        return (-1);
+    }
+    if ((render_fd = create_soundfile(0, render_filesym->s_name,
+        render_filetype, nframes, render_bytespersamp, render_bigendian,
+            nchannels, render_swap, samplerate, &render_headersize)) < 0)
+    {
+        error("%s: %s", filename, strerror(errno));
+        return (-1);
+    }
+    render_nchannels = nchannels;
+    render_nframes = nframes;
+    render_framesdone = 0;
+    if (!atexitdone)
+        atexit(soundfile_endrender), atexitdone = 1;
+    return (0);
+}
+
+    /* write up to one scheduler block of output, laid out as in
+    STUFF->st_soundout */
+void soundfile_render(t_sample *soundout, int nframes)
+{
+    unsigned char buf[MAXSFCHANS * 4 * DEFDACBLKSIZE];
+    t_sample *vecs[MAXSFCHANS];
+    int i, nbytes, onset, blksize = STUFF->st_schedblocksize;
+    if (nframes > blksize)
+        nframes = blksize;
+        /* the buffer holds DEFDACBLKSIZE frames; bigger blocks go in pieces */
+    for (onset = 0; onset < nframes && render_fd >= 0; onset += DEFDACBLKSIZE)
+    {
+        int chunk = (nframes - onset < DEFDACBLKSIZE ?
+            nframes - onset : DEFDACBLKSIZE);
+        nbytes = chunk * render_nchannels * render_bytespersamp;
+        for (i = 0; i < render_nchannels; i++)
+            vecs[i] = soundout + i * blksize + onset;
+        soundfile_xferout_sample(render_nchannels, vecs, buf, chunk, 0,
+            render_bytespersamp, render_bigendian, 1);
+        if (write(render_fd, buf, nbytes) < nbytes)
+        {
+            error("%s: %s", render_filesym->s_name, strerror(errno));
+            sys_close(render_fd);
+            render_fd = -1;
+        }
+        else render_framesdone += chunk;
+    }
+}
+
+/* ------------- sftable: a soundfile as a table, paged on demand ---------- */
+
+/* An sftable makes one channel of a soundfile look like an array for
+tabread4~ and tabplay~ without reading the whole file into memory.  The file
+is cut into pages of SFPAGEFRAMES frames; a fixed number of them are kept in
+memory and a child thread reads the others in as they're asked for, throwing
+out the least recently used ones.  Pages the DSP asks for that aren't in
+memory yet read as zero, so the DSP never waits for the disk; the pages
+after the one being read are asked for ahead of time so that playing straight
+through a file doesn't miss. */
+
+#define SFPAGEBITS 14
+#define SFPAGEFRAMES (1 << SFPAGEBITS)
+#define DEFSFPAGES 64           /* default number of pages kept in memory */
+#define DEFSFREADAHEAD 4        /* default number of pages to read ahead */
+
+#define SLOT_NONE -1            /* value of x_slotof[] for a page not in memory */
+#define SLOT_WANTED -2          /* ... and for one waiting in x_queue */
+
+static t_class *sftable_class;
+
+typedef struct _sfpage
+{
+    long p_page;            /* page of the file held here, or -1 */
+    int p_ready;            /* false while the child is reading it in */
+    unsigned int p_used;    /* x_clock when it was last read from */
+    t_sample *p_data;
+} t_sfpage;
+
+struct _sftable
+{
+    t_object x_obj;
+    t_symbol *x_name;
+    t_canvas *x_canvas;
+    int x_nslots;           /* number of pages kept in memory */
+    t_sfpage *x_slots;
+    t_sample *x_pagemem;    /* memory for all the pages */
+    int x_fd;               /* the soundfile, or -1 */
+    t_soundfile_info x_info;
+    int x_channel;          /* channel of the file we read */
+    int x_readahead;        /* pages to ask for past the one being read */
+    long x_nframes;         /* length of the file in frames */
+    long x_npages;          /* ... and in pages */
+    int *x_slotof;          /* slot holding each page, or SLOT_NONE etc. */
+    long *x_queue;          /* pages wanted, most urgent first */
+    int x_qhead;
+    int x_qcount;
+    char *x_raw;            /* the child's buffer for one page of the file */
+    unsigned int x_clock;   /* counts DSP ticks the table was read in */
+    double x_lasttime;      /* logical time of the last sftable_lock() */
+    long x_lastpage;        /* page last read from */
+    long x_misses;          /* samples read as zero because not in memory */
+    long x_loads;           /* pages read in */
+    int x_busy;             /* true while the child reads from x_fd */
+    int x_quit;
+    pthread_mutex_t x_mutex;
+    pthread_cond_t x_requestcondition;
+    pthread_cond_t x_answercondition;
+    pthread_t x_childthread;
+};
+
+    /* ask the child for a page, at the head of the queue if "urgent".
+    Called with the mutex held. */
+static void sftable_want(t_sftable *x, long page, int urgent)
+{
+    if (page < 0 || page >= x->x_npages || x->x_slotof[page] != SLOT_NONE ||
+        x->x_qcount == x->x_nslots)
+            return;
+    if (urgent)
+    {
+        x->x_qhead = (x->x_qhead + x->x_nslots - 1) % x->x_nslots;
+        x->x_queue[x->x_qhead] = page;
+    }
+    else x->x_queue[(x->x_qhead + x->x_qcount) % x->x_nslots] = page;
+    x->x_qcount++;
+    x->x_slotof[page] = SLOT_WANTED;
+    pthread_cond_signal(&x->x_requestcondition);
+}
+
+static void *sftable_child_main(void *zz)
+{
+    t_sftable *x = zz;
+    pthread_mutex_lock(&x->x_mutex);
+    while (!x->x_quit)
+    {
+        long page, frames;
+        int slot, i, fd, bytesperframe;
+        t_soundfile_info info;
+        t_sfpage *p;
+        t_sample *vec;
+        if (x->x_fd < 0 || !x->x_qcount)
+        {
+            pthread_cond_wait(&x->x_requestcondition, &x->x_mutex);
+            continue;
+        }
+        page = x->x_queue[x->x_qhead];
+        x->x_qhead = (x->x_qhead + 1) % x->x_nslots;
+        x->x_qcount--;
+            /* take a free slot, or else the least recently used page that
+            hasn't been read in this DSP tick or the one before */
+        for (i = 0, slot = -1; i < x->x_nslots; i++)
+        {
+            p = &x->x_slots[i];
+            if (p->p_page < 0)
+            {
+                slot = i;
+                break;
+            }
+            if (p->p_ready && (int)(x->x_clock - p->p_used) > 1 &&
+                (slot < 0 || (int)(p->p_used - x->x_slots[slot].p_used) < 0))
+                    slot = i;
+        }
+        if (slot < 0)
+        {
+            x->x_slotof[page] = SLOT_NONE;  /* all in use; ask again later */
+            continue;
+        }
+        p = &x->x_slots[slot];
+        if (p->p_page >= 0)
+            x->x_slotof[p->p_page] = SLOT_NONE;
+        p->p_page = page;
+        p->p_ready = 0;
+        p->p_used = x->x_clock;
+        x->x_slotof[page] = slot;
+        fd = x->x_fd;
+        info = x->x_info;
+        bytesperframe = info.channels * info.bytespersample;
+        frames = x->x_nframes - page * SFPAGEFRAMES;
+        if (frames > SFPAGEFRAMES)
+            frames = SFPAGEFRAMES;
+        x->x_busy = 1;
+        pthread_mutex_unlock(&x->x_mutex);
+
+            /* nobody else touches a page until it's ready */
+        if (lseek(fd, info.headersize + (off_t)page * SFPAGEFRAMES *
+            bytesperframe, SEEK_SET) < 0 ||
+                (frames = soundfile_readframes(fd, x->x_raw, frames,
+                    bytesperframe)) < 0)
+                        frames = 0;
+        vec = p->p_data;
+        soundfile_xferin_sample(info.channels, 1, &vec, 0,
+            (unsigned char *)x->x_raw + x->x_channel * info.bytespersample,
+                frames, info.bytespersample, info.bigendian);
+        memset(p->p_data + frames, 0,
+            (SFPAGEFRAMES - frames) * sizeof(t_sample));
+
+        pthread_mutex_lock(&x->x_mutex);
+        x->x_busy = 0;
+        p->p_ready = 1;
+        x->x_loads++;
+        pthread_cond_signal(&x->x_answercondition);
+    }
+    pthread_mutex_unlock(&x->x_mutex);
+    return (0);
+}
+
+    /* find an sftable by name, for tabread4~ and tabplay~ */
+t_sftable *sftable_find(t_symbol *s)
+{
+    return ((t_sftable *)pd_findbyclass(s, sftable_class));
+}
+
+    /* lock the table for reading during a DSP tick and return its length
+    in frames (0 if there's no file).  Call sftable_unlock() when done. */
+long sftable_lock(t_sftable *x)
+{
+    double now = clock_getlogicaltime();
+    int i;
+    pthread_mutex_lock(&x->x_mutex);
+    if (now != x->x_lasttime)
+    {
+        x->x_clock++, x->x_lasttime = now;
+            /* ask again for any pages ahead the child had no room for */
+        if (x->x_lastpage >= 0)
+            for (i = 1; i <= x->x_readahead; i++)
+                sftable_want(x, x->x_lastpage + i, 0);
+    }
+    return (x->x_fd >= 0 ? x->x_nframes : 0);
+}
+
+void sftable_unlock(t_sftable *x)
+{
+    pthread_mutex_unlock(&x->x_mutex);
+}
+
+    /* get one sample, with the table locked */
+t_sample sftable_get(t_sftable *x, long index)
+{
+    long page;
+    int slot, i;
+    if (index < 0 || index >= x->x_nframes || x->x_fd < 0)
+        return (0);
+    page = index >> SFPAGEBITS;
+    if (page != x->x_lastpage)
+    {
+        x->x_lastpage = page;
+        for (i = 1; i <= x->x_readahead; i++)
+            sftable_want(x, page + i, 0);
+    }
+    slot = x->x_slotof[page];
+    if (slot >= 0 && x->x_slots[slot].p_ready)
+    {
+        x->x_slots[slot].p_used = x->x_clock;
+        return (x->x_slots[slot].p_data[index & (SFPAGEFRAMES - 1)]);
+    }
+    if (slot == SLOT_NONE)
+        sftable_want(x, page, 1);
+    x->x_misses++;
+    return (0);
+}
+
+    /* wait for the child to finish any read, then swap in a new file (or
+    none if fd < 0) and forget all the pages */
+static void sftable_setfile(t_sftable *x, int fd, t_soundfile_info *info,
+    int channel, long nframes)
+{
+    long npages = (fd >= 0 ? (nframes + SFPAGEFRAMES - 1) / SFPAGEFRAMES : 0);
+    int *slotof = 0, *oldslotof, i, oldfd;
+    long j, oldnpages;
+    char *raw = 0, *oldraw;
+    size_t rawsize = 0, oldrawsize;
+    if (fd >= 0)
+    {
+        rawsize = (size_t)SFPAGEFRAMES * info->channels * info->bytespersample;
+        if (!(slotof = (int *)getbytes(npages * sizeof(int))) ||
+            !(raw = (char *)getbytes(rawsize)))
+        {
+            pd_error(x, "sftable: out of memory");
+            if (slotof)
+                freebytes(slotof, npages * sizeof(int));
+            soundfile_close(fd);
+            fd = -1, npages = 0, rawsize = 0, slotof = 0;
+        }
+        else for (j = 0; j < npages; j++)
+            slotof[j] = SLOT_NONE;
+    }
+    pthread_mutex_lock(&x->x_mutex);
+    while (x->x_busy)
+        pthread_cond_wait(&x->x_answercondition, &x->x_mutex);
+    oldfd = x->x_fd;
+    oldslotof = x->x_slotof;
+    oldnpages = x->x_npages;
+    oldraw = x->x_raw;
+    oldrawsize = (oldfd >= 0 ? (size_t)SFPAGEFRAMES * x->x_info.channels *
+        x->x_info.bytespersample : 0);
+    x->x_fd = fd;
+    if (fd >= 0)
+        x->x_info = *info;
+    x->x_channel = channel;
+    x->x_nframes = (fd >= 0 ? nframes : 0);
+    x->x_npages = npages;
+    x->x_slotof = slotof;
+    x->x_raw = raw;
+    x->x_qhead = x->x_qcount = 0;
+    x->x_lastpage = -1;
+    x->x_misses = x->x_loads = 0;
+    for (i = 0; i < x->x_nslots; i++)
+        x->x_slots[i].p_page = -1, x->x_slots[i].p_ready = 0;
+        /* start reading the beginning of the file right away */
+    for (j = 0; j <= x->x_readahead && j < npages; j++)
+        sftable_want(x, j, 0);
+    pthread_mutex_unlock(&x->x_mutex);
+    if (oldfd >= 0)
+    {
+        soundfile_close(oldfd);
+        freebytes(oldslotof, oldnpages * sizeof(int));
+        freebytes(oldraw, oldrawsize);
+    }
+}
+
+    /* open message: open [-channel n] [-readahead n] filename */
+static void sftable_open(t_sftable *x, t_symbol *s, int argc, t_atom *argv)
+{
+    int channel = 0, readahead = DEFSFREADAHEAD, fd;
+    const char *filename;
+    t_soundfile_info info;
+    long nframes;
+    while (argc > 0 && argv->a_type == A_SYMBOL &&
+        *argv->a_w.w_symbol->s_name == '-')
+    {
+        const char *flag = argv->a_w.w_symbol->s_name + 1;
+        if (!strcmp(flag, "channel"))
+        {
+            if (argc < 2 || argv[1].a_type != A_FLOAT ||
+                (channel = argv[1].a_w.w_float) < 0)
+                    goto usage;
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(flag, "readahead"))
+        {
+            if (argc < 2 || argv[1].a_type != A_FLOAT ||
+                (readahead = argv[1].a_w.w_float) < 0)
+                    goto usage;
+            argc -= 2; argv += 2;
+        }
+        else goto usage;
+    }
+    if (argc != 1 || argv->a_type != A_SYMBOL)
+        goto usage;
+    filename = argv->a_w.w_symbol->s_name;
+    info.headersize = -1;
+    if ((fd = open_soundfile_via_canvas(x->x_canvas, filename, &info, 0)) < 0)
+    {
+        pd_error(x, "sftable: %s: %s", filename, (errno == EIO ?
+            "unknown or bad header format" : strerror(errno)));
+        return;
+    }
+    if (soundfile_decoder(fd))
+    {
+        pd_error(x, "sftable: %s: can't page a compressed soundfile",
+            filename);
+        soundfile_close(fd);
+        return;
+    }
+    if (channel >= info.channels)
+    {
+        pd_error(x, "sftable: %s: no channel %d (%d channels)",
+            filename, channel, info.channels);
+        soundfile_close(fd);
+        return;
+    }
+    nframes = soundfile_framesleft(fd, &info);
+    if (nframes > info.bytelimit / (info.channels * info.bytespersample))
+        nframes = info.bytelimit / (info.channels * info.bytespersample);
+    if (nframes < 0)
+        nframes = 0;
+    x->x_readahead = (readahead < x->x_nslots / 2 ?
+        readahead : x->x_nslots / 2);
+    sftable_setfile(x, fd, &info, channel, nframes);
+    return;
+usage:
+    pd_error(x, "usage: open [-channel n] [-readahead n] filename");
+}
+
+static void sftable_close(t_sftable *x)
+{
+    sftable_setfile(x, -1, 0, 0, 0);
+}
+
+static void sftable_print(t_sftable *x)
+{
+    int i, nready = 0;
+    pthread_mutex_lock(&x->x_mutex);
+    for (i = 0; i < x->x_nslots; i++)
+        if (x->x_slots[i].p_ready)
+            nready++;
+    post("%s: %ld frames, %d of %d pages in memory, %ld pages read",
+        x->x_name->s_name, x->x_nframes, nready, x->x_nslots, x->x_loads);
+    post("%ld samples missed, read-ahead %d pages", x->x_misses,
+        x->x_readahead);
+    pthread_mutex_unlock(&x->x_mutex);
+}
+
+static void *sftable_new(t_symbol *s, t_floatarg fnpages)
+{
+    t_sftable *x;
+    int npages = fnpages, i;
+    t_sample *mem;
+    t_sfpage *slots;
+    long *queue;
+    if (npages <= 0)
+        npages = DEFSFPAGES;
+    else if (npages < 4)
+        npages = 4;
+    if (!(mem = (t_sample *)getbytes((size_t)npages * SFPAGEFRAMES *
+        sizeof(t_sample))))
+    {
+        pd_error(0, "sftable: can't allocate %d pages", npages);
+        return (0);
+    }
+    slots = (t_sfpage *)getbytes(npages * sizeof(t_sfpage));
+    queue = (long *)getbytes(npages * sizeof(long));
+    x = (t_sftable *)pd_new(sftable_class);
+    x->x_name = s;
+    x->x_canvas = canvas_getcurrent();
+    x->x_nslots = npages;
+    x->x_slots = slots;
+    x->x_pagemem = mem;
+    for (i = 0; i < npages; i++)
+    {
+        slots[i].p_page = -1;
+        slots[i].p_ready = 0;
+        slots[i].p_used = 0;
+        slots[i].p_data = mem + (size_t)i * SFPAGEFRAMES;
+    }
+    x->x_queue = queue;
+    x->x_fd = -1;
+    x->x_slotof = 0;
+    x->x_raw = 0;
+    x->x_npages = x->x_nframes = 0;
+    x->x_readahead = DEFSFREADAHEAD;
+    x->x_lastpage = -1;
+    x->x_lasttime = -1;
+    pthread_mutex_init(&x->x_mutex, 0);
+    pthread_cond_init(&x->x_requestcondition, 0);
+    pthread_cond_init(&x->x_answercondition, 0);
+    pthread_create(&x->x_childthread, 0, sftable_child_main, x);
+    if (*s->s_name)
+        pd_bind(&x->x_obj.ob_pd, s);
+    return (x);
+}
+
+static void sftable_free(t_sftable *x)
+{
+    sftable_close(x);
+    pthread_mutex_lock(&x->x_mutex);
+    x->x_quit = 1;
+    pthread_cond_signal(&x->x_requestcondition);
+    pthread_mutex_unlock(&x->x_mutex);
+    pthread_join(x->x_childthread, 0);
+    pthread_cond_destroy(&x->x_requestcondition);
+    pthread_cond_destroy(&x->x_answercondition);
+    pthread_mutex_destroy(&x->x_mutex);
+    if (*x->x_name->s_name)
+        pd_unbind(&x->x_obj.ob_pd, x->x_name);
+    freebytes(x->x_pagemem, (size_t)x->x_nslots * SFPAGEFRAMES *
+        sizeof(t_sample));
+    freebytes(x->x_slots, x->x_nslots * sizeof(t_sfpage));
+    freebytes(x->x_queue, x->x_nslots * sizeof(long));
+        /* make any tabread4~ or tabplay~ let go of us */
+    canvas_update_dsp();
+}
+
+static void sftable_setup(void)
+{
+    sftable_class = class_new(gensym("sftable"), (t_newmethod)sftable_new,
+        (t_method)sftable_free, sizeof(t_sftable), 0,
+            A_DEFSYM, A_DEFFLOAT, 0);
+    class_addmethod(sftable_class, (t_method)sftable_open, gensym("open"),
+        A_GIMME, 0);
+    class_addmethod(sftable_class, (t_method)sftable_close, gensym("close"),
+        0);
+    class_addmethod(sftable_class, (t_method)sftable_print, gensym("print"),
+        0);
+}
+
 /* ------------------------ global setup routine ------------------------- */
 
 void d_soundfile_setup(void)
@@ -2793,5 +5490,6 @@ void d_soundfile_setup(void)
     soundfiler_setup();
     readsf_setup();
     writesf_setup();
+    sftable_setup();
 }
 
@@ -11,10 +11,32 @@
     interconnections.
 */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE     /* for dladdr() */
+#endif
 #include "m_pd.h"
 #include "m_imp.h"
+#include "g_canvas.h"
+#include "s_stuff.h"
 #include <stdlib.h>
 #include <stdarg.h>
+#include <limits.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(_M_X64)
+#include <xmmintrin.h>
+#endif
+#ifdef HAVE_LIBDL
+#include <dlfcn.h>
+#endif
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
 
 extern t_class *vinlet_class, *voutlet_class, *canvas_class, *text_class;
 
@@ -23,44 +45,166 @@ EXTERN_STRUCT _voutlet;
 
 void vinlet_dspprolog(struct _vinlet *x, t_signal **parentsigs,
     int myvecsize, int calcsize, int phase, int period, int frequency,
-    int downsample, int upsample,  int reblock, int switched);
+    int downsample, int upsample, int quality, int reblock, int switched,
+    t_sample *window);
 void voutlet_dspprolog(struct _voutlet *x, t_signal **parentsigs,
     int myvecsize, int calcsize, int phase, int period, int frequency,
-    int downsample, int upsample, int reblock, int switched);
+    int downsample, int upsample, int reblock, int switched, t_sample *window);
 void voutlet_dspepilog(struct _voutlet *x, t_signal **parentsigs,
     int myvecsize, int calcsize, int phase, int period, int frequency,
-    int downsample, int upsample, int reblock, int switched);
+    int downsample, int upsample, int quality, int reblock, int switched);
+
+#define PWMAXOPS 16     /* most operations fused into one perform routine */
+
+    /* the last pointwise operation(s) put on the chain, in case the next
+    ugen can be fused with them */
+typedef struct _pwstate
+{
+    int p_start;            /* chain index of their code, -1 if none */
+    int p_end;              /* chain index past it */
+    int p_open;             /* true if the code is still being added */
+    t_sample *p_in;         /* input vector */
+    t_sample *p_out;        /* output vector */
+    int p_n;
+    int p_nops;
+    t_int p_ops[3 * PWMAXOPS];  /* operation, two arguments each */
+} t_pwstate;
+
+    /* for the profiler, each object's "dsp" method gets one of these, and
+    the chain element where each of its perform routines starts points to it.
+    Code that isn't added by an object belongs to its canvas (o_obj = 0). */
+typedef struct _dspowner
+{
+    t_object *o_obj;
+    t_canvas *o_canvas;         /* canvas it's in, 0 if code was replaced */
+    double o_time;              /* seconds spent in its perform routines */
+    struct _dspowner *o_next;
+} t_dspowner;
 
 struct _instanceugen
 {
     t_int *u_dspchain;         /* DSP chain */
     int u_dspchainsize;        /* number of elements in DSP chain */
+    int u_dspchainalloc;       /* number of elements allocated */
     t_signal *u_signals;       /* list of signals used by DSP chain */
     int u_sortno;               /* number of DSP sortings so far */
+    int u_contextno;            /* number of DSP contexts started so far */
         /* list of signals which can be reused, sorted by buffer size */
     t_signal *u_freelist[MAXLOGSIG+1];
         /* list of reusable "borrowed" signals (which don't own sample buffers) */
     t_signal *u_freeborrowed;
+    int u_nlive;                /* signal buffers in use while sorting */
+    int u_livebytes;
+    int u_peaklive;             /* the most of them in use at any point */
+    int u_peakbytes;
+    int u_work;                 /* DSP objects in the chain, see below */
+    int u_critpath;             /* most of them any one depends on in turn */
     int u_phase;
     int u_loud;
     struct _dspcontext *u_context;
+    struct _dspsection *u_sections;     /* parallel sections in DSP chain */
+    struct _dspsection *u_building;     /* innermost section being built */
+    struct _dsppool *u_pool;            /* worker threads to run them */
+    struct _dsprange *u_ranges;         /* canvases that can be redone */
+    int u_deadwords;            /* chain elements bypassed by updates */
+    struct _dspupdate *u_update;        /* update in progress if any */
+    t_pwstate u_pw;                     /* pointwise code to fuse with */
+    t_sample *u_pwinput;        /* input the ugen being scheduled frees */
+    t_dspowner **u_dspowner;    /* owner of each DSP chain element, if any */
+    t_dspowner *u_owners;       /* list of all of them */
+    t_dspowner *u_curowner;     /* owner of code being added now */
+    int u_profile;              /* true if dsp_tick() is profiling */
+    int u_profticks;            /* number of ticks profiled */
+    double u_proftime;          /* total time they took */
 };
 
 #define THIS (pd_this->pd_ugen)
 
+int sys_dspthreads = 1;     /* number of threads to compute DSP with */
+int sys_dspfuse = 0;        /* true to fuse pointwise objects */
+int sys_dsplocal = 0;       /* true to order the chain for locality */
+int sys_dspftz = 1;         /* true to flush denormals to zero during DSP */
+
+static void dsppool_free(struct _dsppool *p);
+
 void d_ugen_newpdinstance(void)
 {
     THIS = getbytes(sizeof(*THIS));
     THIS->u_dspchain = 0;
-    THIS->u_dspchainsize = 0;
+    THIS->u_dspchainsize = THIS->u_dspchainalloc = 0;
     THIS->u_signals = 0;
+    THIS->u_nlive = THIS->u_livebytes = 0;
+    THIS->u_peaklive = THIS->u_peakbytes = 0;
+    THIS->u_work = THIS->u_critpath = 0;
+    THIS->u_sections = THIS->u_building = 0;
+    THIS->u_pool = 0;
+    THIS->u_ranges = 0;
+    THIS->u_deadwords = 0;
+    THIS->u_update = 0;
+    THIS->u_pw.p_start = -1;
+    THIS->u_pwinput = 0;
+    THIS->u_dspowner = 0;
+    THIS->u_owners = THIS->u_curowner = 0;
+    THIS->u_profile = THIS->u_profticks = 0;
+    THIS->u_proftime = 0;
 }
 
 void d_ugen_freepdinstance(void)
 {
+    if (THIS->u_pool)
+        dsppool_free(THIS->u_pool);
     freebytes(THIS, sizeof(*THIS));
 }
 
+/* ---------------------- flushing denormals ------------------------- */
+
+/* Where the CPU can do it (see PD_FLUSHDENORMALS in m_pd.h) the DSP chain
+is run with denormal numbers flushed to zero, by dsp_tick() and by the
+threads computing parallel sections.  The previous floating-point mode is
+put back afterward so that message-level computation isn't affected. */
+
+#if defined(__x86_64__) || defined(_M_X64)
+typedef unsigned int t_fpmode;
+
+static t_fpmode dsp_flushdenormals(void)
+{
+    t_fpmode was = _mm_getcsr();
+    _mm_setcsr(was | 0x8040);   /* flush to zero, denormals are zero */
+    return (was);
+}
+
+static void dsp_restorefpmode(t_fpmode was)
+{
+    _mm_setcsr(was);
+}
+#elif defined(__aarch64__) && defined(__GNUC__)
+typedef unsigned long t_fpmode;
+
+static t_fpmode dsp_flushdenormals(void)
+{
+    t_fpmode was;
+    __asm__ __volatile__ ("mrs %0, fpcr" : "=r" (was));
+    __asm__ __volatile__ ("msr fpcr, %0" : : "r" (was | (1UL << 24)));
+    return (was);
+}
+
+static void dsp_restorefpmode(t_fpmode was)
+{
+    __asm__ __volatile__ ("msr fpcr, %0" : : "r" (was));
+}
+#else
+    /* otherwise the per-sample checks in the filters stay in */
+typedef int t_fpmode;
+#define dsp_flushdenormals() 0
+#define dsp_restorefpmode(was) ((void)(was))
+#endif
+
+    /* "dspftz" message to Pd */
+void glob_dspftz(void *dummy, t_floatarg f)
+{
+    sys_dspftz = (f != 0);
+}
+
 t_int *zero_perform(t_int *w)   /* zero out a vector */
 {
     t_sample *out = (t_sample *)(w[1]);
@@ -88,6 +232,24 @@ t_int *zero_perf8(t_int *w)
     return (w+3);
 }
 
+static t_int *zero_perf64(t_int *w)
+{
+    t_sample *out = (t_sample *)(w[1]);
+    int i;
+    for (i = 0; i < 64; i++)
+        out[i] = 0;
+    return (w+3);
+}
+
+static t_int *zero_perf16(t_int *w)
+{
+    t_sample *out = (t_sample *)(w[1]);
+    int i;
+    for (i = 0; i < 16; i++)
+        out[i] = 0;
+    return (w+3);
+}
+
 void dsp_add_zero(t_sample *out, int n)
 {
     if (n&7)
@@ -124,6 +286,15 @@ overlapping and buffering to deal with vector size changes.  If we're switched
 but not reblocked, the inlet prolog is not needed, and the output epilog is
 ONLY run when the block is switched off; in this case the epilog code simply
 copies zeros to all signal outlets.
+
+"switch~ -auto <threshold> <holdms>" also switches itself off ("goes to
+sleep") once everything leaving the subcanvas -- the inputs of its outlet~s
+and of other objects without signal outputs, such as throw~ or dac~ --
+and all its signal inputs have stayed below the threshold (an amplitude) for
+holdms milliseconds.  The sorter puts a block_peak() call before each such
+object to measure its input.  A sleeping switch~ wakes up as soon as a signal
+input goes above the threshold or a message arrives at one of the
+subcanvas's inlets (see canvas_dspwake()) or at the switch~ itself.
 */
 
 static t_class *block_class;
@@ -146,22 +317,120 @@ typedef struct _block
     char x_reblock;     /* true if inlets and outlets are reblocking */
     int x_upsample;     /* upsampling-factor */
     int x_downsample;   /* downsampling-factor */
+    int x_quality;      /* nonzero to filter when up/downsampling */
+    int x_precision;    /* 1 for double, 0 for single, -1 as parent */
     int x_return;       /* stop right after this block (for one-shots) */
+    char x_auto;        /* true if we switch off by ourselves (see above) */
+    char x_asleep;      /* true if we've done so */
+    t_sample x_autothresh;  /* silence threshold */
+    t_float x_autoholdms;   /* how long it takes */
+    int x_autohold;     /* ... in blocks */
+    int x_autoquiet;    /* number of blocks we've been quiet for */
+    t_sample x_autopeak;    /* peak output in the current block */
+    int x_nautoin;      /* number of signal inputs to watch */
+    t_sample **x_autoin;    /* the inputs' sample vectors */
+    int *x_autoinsize;  /* their sizes, counting all channels */
+    int x_window;       /* window shape (BLOCKWIN_xxx below) */
+    int x_windowwhere;  /* 1 to apply it on input, 2 on output, 3 both */
+    int x_windowsize;   /* size of x_windowvec */
+    t_sample *x_windowvec;  /* the window, computed when DSP is set up */
+    int x_windowvecshape;   /* shape it was last computed for */
 } t_block;
 
+#define BLOCKWIN_NONE 0
+#define BLOCKWIN_HANN 1
+#define BLOCKWIN_HAMMING 2
+#define BLOCKWIN_BLACKMAN 3
+#define BLOCKWIN_SINE 4
+
+static int block_nauto;     /* number of "switch~ -auto" objects */
+
 static void block_set(t_block *x, t_floatarg fvecsize, t_floatarg foverlap,
     t_floatarg fupsample);
-
-static void *block_new(t_floatarg fvecsize, t_floatarg foverlap,
-                       t_floatarg fupsample)
+static int block_setwindow(t_block *x, t_symbol *shape, t_symbol *where);
+
+    /* creation arguments are up to three numbers (block size, overlap,
+    up/downsampling factor) and the flag "-quality high", which makes
+    inlet~ and outlet~ objects that don't name a method of their own
+    resample through a polyphase filter instead of sample/hold and
+    decimation.  "-precision double" asks the filters in this window and
+    those beneath it to keep their state and coefficients in double
+    precision (see ugen_getdouble()); "-precision single" undoes that for
+    a window inside one that asked.  "-window <shape> [in|out]" has inlet~
+    and outlet~ multiply each block by a window as they reblock it (see
+    block_window() below). */
+static void *block_new(t_symbol *s, int argc, t_atom *argv)
 {
     t_block *x = (t_block *)pd_new(block_class);
+    t_float fargs[3] = {0, 0, 0};
+    int nfargs = 0;
+    x->x_quality = 0;
+    x->x_precision = -1;
+    x->x_window = BLOCKWIN_NONE;
+    x->x_windowwhere = 3;
+    x->x_windowsize = 0;
+    x->x_windowvec = 0;
+    x->x_windowvecshape = -1;
+    while (argc)
+    {
+        if (argv->a_type == A_SYMBOL &&
+            !strcmp(argv->a_w.w_symbol->s_name, "-quality") && argc > 1 &&
+                argv[1].a_type == A_SYMBOL)
+        {
+            if (argv[1].a_w.w_symbol == gensym("high"))
+                x->x_quality = 1;
+            else if (argv[1].a_w.w_symbol != gensym("low"))
+                pd_error(x, "%s: unknown quality '%s'", s->s_name,
+                    argv[1].a_w.w_symbol->s_name);
+            argc -= 2; argv += 2;
+        }
+        else if (argv->a_type == A_SYMBOL &&
+            !strcmp(argv->a_w.w_symbol->s_name, "-precision") && argc > 1 &&
+                argv[1].a_type == A_SYMBOL)
+        {
+            if (argv[1].a_w.w_symbol == gensym("double"))
+                x->x_precision = 1;
+            else if (argv[1].a_w.w_symbol == gensym("single"))
+                x->x_precision = 0;
+            else pd_error(x, "%s: unknown precision '%s'", s->s_name,
+                argv[1].a_w.w_symbol->s_name);
+            argc -= 2; argv += 2;
+        }
+        else if (argv->a_type == A_SYMBOL &&
+            !strcmp(argv->a_w.w_symbol->s_name, "-window") && argc > 1 &&
+                argv[1].a_type == A_SYMBOL)
+        {
+            t_symbol *where = (argc > 2 && argv[2].a_type == A_SYMBOL ?
+                argv[2].a_w.w_symbol : &s_);
+            if (!block_setwindow(x, argv[1].a_w.w_symbol, where))
+                where = &s_;
+            argc -= 2; argv += 2;
+            if (*where->s_name)
+                argc--, argv++;
+        }
+        else
+        {
+                /* as before, anything else in a number's place reads 0 */
+            if (nfargs < 3)
+                fargs[nfargs++] = atom_getfloat(argv);
+            argc--; argv++;
+        }
+    }
     x->x_phase = 0;
     x->x_period = 1;
     x->x_frequency = 1;
     x->x_switched = 0;
     x->x_switchon = 1;
-    block_set(x, fvecsize, foverlap, fupsample);
+    x->x_auto = x->x_asleep = 0;
+    x->x_autothresh = 0;
+    x->x_autoholdms = 0;
+    x->x_autohold = 1;
+    x->x_autoquiet = 0;
+    x->x_autopeak = 0;
+    x->x_nautoin = 0;
+    x->x_autoin = 0;
+    x->x_autoinsize = 0;
+    block_set(x, fargs[0], fargs[1], fargs[2]);
     return (x);
 }
 
@@ -226,19 +495,232 @@ static void block_set(t_block *x, t_floatarg fcalcsize, t_floatarg foverlap,
     canvas_resume_dsp(dspstate);
 }
 
-static void *switch_new(t_floatarg fvecsize, t_floatarg foverlap,
-                        t_floatarg fupsample)
+static void *switch_new(t_symbol *s, int argc, t_atom *argv)
 {
-    t_block *x = (t_block *)(block_new(fvecsize, foverlap, fupsample));
+    t_block *x;
+    int autoswitch = 0;
+    t_float thresh = 0.0001, holdms = 100;
+    while (argc && argv->a_type == A_SYMBOL &&
+        *argv->a_w.w_symbol->s_name == '-')
+    {
+        if (!strcmp(argv->a_w.w_symbol->s_name, "-auto"))
+        {
+            autoswitch = 1;
+            argc--; argv++;
+            if (argc && argv->a_type == A_FLOAT)
+            {
+                thresh = argv->a_w.w_float;
+                argc--; argv++;
+                if (argc && argv->a_type == A_FLOAT)
+                {
+                    holdms = argv->a_w.w_float;
+                    argc--; argv++;
+                }
+            }
+        }
+        else if (!strcmp(argv->a_w.w_symbol->s_name, "-quality") ||
+            !strcmp(argv->a_w.w_symbol->s_name, "-precision") ||
+            !strcmp(argv->a_w.w_symbol->s_name, "-window"))
+                break;      /* leave these to block_new() */
+        else
+        {
+            pd_error(0, "switch~: unknown flag %s",
+                argv->a_w.w_symbol->s_name);
+            argc--; argv++;
+        }
+    }
+    x = (t_block *)block_new(s, argc, argv);
     x->x_switched = 1;
     x->x_switchon = 0;
+    if (autoswitch)
+    {
+            /* an automatic switch starts out on */
+        x->x_auto = 1;
+        x->x_switchon = 1;
+        x->x_autothresh = (thresh > 0 ? thresh : 0);
+        x->x_autoholdms = (holdms > 0 ? holdms : 0);
+        block_nauto++;
+    }
     return (x);
 }
 
+static void block_wake(t_block *x)
+{
+    x->x_asleep = 0;
+    x->x_autoquiet = 0;
+}
+
 static void block_float(t_block *x, t_floatarg f)
 {
     if (x->x_switched)
         x->x_switchon = (f != 0);
+    if (x->x_auto)
+        block_wake(x);
+}
+
+    /* find the automatic switch~ in a canvas if any */
+static t_block *canvas_findautoblock(t_canvas *x)
+{
+    t_gobj *y;
+    for (y = x->gl_list; y; y = y->g_next)
+        if (pd_class(&y->g_pd) == block_class && ((t_block *)y)->x_auto)
+            return ((t_block *)y);
+    return (0);
+}
+
+    /* a message has come in to a canvas: wake it and the canvases it's in up
+    if they've gone to sleep */
+void canvas_dspwake(t_canvas *x)
+{
+    t_block *b;
+    if (!block_nauto)
+        return;
+    for (; x; x = x->gl_owner)
+        if ((b = canvas_findautoblock(x)))
+            block_wake(b);
+}
+
+    /* measure the peak input to an object leaving the subcanvas */
+static t_int *block_peak(t_int *w)
+{
+    t_block *x = (t_block *)(w[1]);
+    t_sample *in = (t_sample *)(w[2]), peak = x->x_autopeak;
+    int n = (int)(w[3]);
+    while (n--)
+    {
+        t_sample f = *in++;
+        if (f < 0)
+            f = -f;
+        if (f > peak)
+            peak = f;
+    }
+    x->x_autopeak = peak;
+    return (w+4);
+}
+
+    /* true if all the signal inputs are below the threshold */
+static int block_inputsquiet(t_block *x)
+{
+    int i, j;
+    t_sample thresh = x->x_autothresh;
+    for (i = 0; i < x->x_nautoin; i++)
+    {
+        t_sample *in = x->x_autoin[i];
+        for (j = 0; j < x->x_autoinsize[i]; j++)
+            if (in[j] > thresh || in[j] < -thresh)
+                return (0);
+    }
+    return (1);
+}
+
+    /* after each block, see if it's been quiet long enough to sleep */
+static void block_autocheck(t_block *x)
+{
+    if (x->x_autopeak <= x->x_autothresh && block_inputsquiet(x))
+    {
+        if (++x->x_autoquiet >= x->x_autohold)
+            x->x_asleep = 1;
+    }
+    else x->x_autoquiet = 0;
+    x->x_autopeak = 0;
+}
+
+    /* set the window shape and where to apply it; return 1 if "where"
+    was one of the words "in", "out", or "both" (and so was used up) */
+static int block_setwindow(t_block *x, t_symbol *shape, t_symbol *where)
+{
+    int window, usedwhere = 1;
+    if (shape == gensym("none") || shape == gensym("rectangular"))
+        window = BLOCKWIN_NONE;
+    else if (shape == gensym("hann") || shape == gensym("hanning"))
+        window = BLOCKWIN_HANN;
+    else if (shape == gensym("hamming"))
+        window = BLOCKWIN_HAMMING;
+    else if (shape == gensym("blackman"))
+        window = BLOCKWIN_BLACKMAN;
+    else if (shape == gensym("sine"))
+        window = BLOCKWIN_SINE;
+    else
+    {
+        pd_error(x, "block~: unknown window '%s'", shape->s_name);
+        window = BLOCKWIN_NONE;
+    }
+    if (where == gensym("in"))
+        x->x_windowwhere = 1;
+    else if (where == gensym("out"))
+        x->x_windowwhere = 2;
+    else
+    {
+        x->x_windowwhere = 3;
+        usedwhere = (where == gensym("both"));
+    }
+    x->x_window = window;
+    return (usedwhere);
+}
+
+    /* "window <shape> [in|out|both]" message.  A windowed block~ always
+    reblocks, and its inlet~s multiply each block they hand in by the window
+    ("in"), its outlet~s multiply each block they overlap-add out ("out"),
+    or both.  The shapes are the periodic ones that overlap-add to a
+    constant: "hann" (or "hanning"), "hamming", "blackman", and "sine", the
+    square root of hann, for windowing both in and out.  "none" turns
+    windowing off. */
+static void block_window(t_block *x, t_symbol *shape, t_symbol *where)
+{
+    int dspstate = canvas_suspend_dsp();
+    block_setwindow(x, shape, where);
+    canvas_resume_dsp(dspstate);
+}
+
+    /* get the window at the DSP block size, computing it if needed, or
+    zero if there isn't one where asked ("where" is 1 for input and 2 for
+    output) */
+static t_sample *block_getwindow(t_block *x, int n, int where)
+{
+    int i;
+    if (x->x_window == BLOCKWIN_NONE || !(x->x_windowwhere & where))
+        return (0);
+    if (x->x_windowsize != n)
+    {
+        x->x_windowvec = (t_sample *)resizebytes(x->x_windowvec,
+            x->x_windowsize * sizeof(t_sample), n * sizeof(t_sample));
+        x->x_windowsize = n;
+        x->x_windowvecshape = -1;
+    }
+    if (x->x_windowvecshape != x->x_window)
+    {
+        for (i = 0; i < n; i++)
+        {
+            double phase = 2 * 3.14159265358979 * i / n;
+            switch (x->x_window)
+            {
+            case BLOCKWIN_HANN:
+                x->x_windowvec[i] = 0.5 - 0.5 * cos(phase); break;
+            case BLOCKWIN_HAMMING:
+                x->x_windowvec[i] = 0.54 - 0.46 * cos(phase); break;
+            case BLOCKWIN_BLACKMAN:
+                x->x_windowvec[i] = 0.42 - 0.5 * cos(phase) +
+                    0.08 * cos(2 * phase); break;
+            default:
+                x->x_windowvec[i] = sin(0.5 * phase); break;
+            }
+        }
+        x->x_windowvecshape = x->x_window;
+    }
+    return (x->x_windowvec);
+}
+
+static void block_free(t_block *x)
+{
+    if (x->x_auto)
+        block_nauto--;
+    if (x->x_autoin)
+    {
+        freebytes(x->x_autoin, x->x_nautoin * sizeof(*x->x_autoin));
+        freebytes(x->x_autoinsize, x->x_nautoin * sizeof(*x->x_autoinsize));
+    }
+    if (x->x_windowvec)
+        freebytes(x->x_windowvec, x->x_windowsize * sizeof(t_sample));
 }
 
 static void block_bang(t_block *x)
@@ -246,10 +728,15 @@ static void block_bang(t_block *x)
     if (x->x_switched && !x->x_switchon && THIS->u_dspchain)
     {
         t_int *ip;
+        t_fpmode was = 0;
+        if (sys_dspftz)
+            was = dsp_flushdenormals();
         x->x_return = 1;
         for (ip = THIS->u_dspchain + x->x_chainonset; ip; )
             ip = (*(t_perfroutine)(*ip))(ip);
         x->x_return = 0;
+        if (sys_dspftz)
+            dsp_restorefpmode(was);
     }
     else pd_error(x, "bang to block~ or on-state switch~ has no effect");
 }
@@ -265,6 +752,12 @@ static t_int *block_prolog(t_int *w)
         /* if we're switched off, jump past the epilog code */
     if (!x->x_switchon)
         return (w + x->x_blocklength);
+    if (x->x_asleep)
+    {
+        if (block_inputsquiet(x))
+            return (w + x->x_blocklength);
+        block_wake(x);
+    }
     if (phase)
     {
         phase++;
@@ -286,6 +779,8 @@ static t_int *block_epilog(t_int *w)
     int count = x->x_count - 1;
     if (x->x_return)
         return (0);
+    if (x->x_auto)
+        block_autocheck(x);
     if (!x->x_reblock)
         return (w + x->x_epiloglength + EPILOGCALL);
     if (count)
@@ -304,12 +799,13 @@ static void block_dsp(t_block *x, t_signal **sp)
 
 void block_tilde_setup(void)
 {
-    block_class = class_new(gensym("block~"), (t_newmethod)block_new, 0,
-            sizeof(t_block), 0, A_DEFFLOAT, A_DEFFLOAT, A_DEFFLOAT, 0);
-    class_addcreator((t_newmethod)switch_new, gensym("switch~"),
-        A_DEFFLOAT, A_DEFFLOAT, A_DEFFLOAT, 0);
+    block_class = class_new(gensym("block~"), (t_newmethod)block_new,
+        (t_method)block_free, sizeof(t_block), 0, A_GIMME, 0);
+    class_addcreator((t_newmethod)switch_new, gensym("switch~"), A_GIMME, 0);
     class_addmethod(block_class, (t_method)block_set, gensym("set"),
         A_DEFFLOAT, A_DEFFLOAT, A_DEFFLOAT, 0);
+    class_addmethod(block_class, (t_method)block_window, gensym("window"),
+        A_SYMBOL, A_DEFSYM, 0);
     class_addmethod(block_class, (t_method)block_dsp, gensym("dsp"), A_CANT, 0);
     class_addfloat(block_class, block_float);
     class_addbang(block_class, block_bang);
@@ -322,14 +818,94 @@ static t_int dsp_done(t_int *w)
     return (0);
 }
 
+#define DSPCHAINMINALLOC 1024
+
+    /* make room for "newsize" elements in the DSP chain.  The allocation
+    grows geometrically so that building a chain of n elements takes O(n)
+    time; ugen_finish() trims it to size when the chain is complete. */
+static void dsp_growchain(int newsize)
+{
+    if (newsize > THIS->u_dspchainalloc)
+    {
+        int newalloc = 2 * THIS->u_dspchainalloc;
+        if (newalloc < DSPCHAINMINALLOC)
+            newalloc = DSPCHAINMINALLOC;
+        if (newalloc < newsize)
+            newalloc = newsize;
+        THIS->u_dspchain = t_resizebytes(THIS->u_dspchain,
+            THIS->u_dspchainalloc * sizeof (t_int), newalloc * sizeof (t_int));
+        THIS->u_dspowner = t_resizebytes(THIS->u_dspowner,
+            THIS->u_dspchainalloc * sizeof (t_dspowner *),
+                newalloc * sizeof (t_dspowner *));
+        memset(THIS->u_dspowner + THIS->u_dspchainalloc, 0,
+            (newalloc - THIS->u_dspchainalloc) * sizeof (t_dspowner *));
+        THIS->u_dspchainalloc = newalloc;
+    }
+}
+
+/* ------------------ specialized perform routines -------------------- */
+
+/* A perform routine can have versions for particular vector sizes, in which
+the size is a constant so that the compiler can unroll their loops
+completely.  Once "special" is registered for "f", dsp_add() and dsp_addv()
+put it on the chain in place of "f" whenever f's argument number "nindex"
+(counting as in the perform routine's w[], so 1 is the first) is "n".  This
+is usually called from a setup routine. */
+
+typedef struct _dspspecial
+{
+    t_perfroutine s_f;
+    int s_nindex;
+    int s_n;
+    t_perfroutine s_special;
+} t_dspspecial;
+
+static t_dspspecial *dsp_specials;
+static int dsp_nspecials;
+
+void dsp_specialize(t_perfroutine f, int nindex, int n, t_perfroutine special)
+{
+    int i;
+    for (i = 0; i < dsp_nspecials; i++)
+        if (dsp_specials[i].s_f == f && dsp_specials[i].s_nindex == nindex &&
+            dsp_specials[i].s_n == n)
+                break;
+    if (i == dsp_nspecials)
+    {
+        dsp_specials = (t_dspspecial *)resizebytes(dsp_specials,
+            dsp_nspecials * sizeof(*dsp_specials),
+                (dsp_nspecials + 1) * sizeof(*dsp_specials));
+        dsp_nspecials++;
+    }
+    dsp_specials[i].s_f = f;
+    dsp_specials[i].s_nindex = nindex;
+    dsp_specials[i].s_n = n;
+    dsp_specials[i].s_special = special;
+}
+
+    /* if there's a specialized version of the "nargs"-argument routine just
+    put on the chain at "ip", swap it in */
+static void dsp_dospecialize(t_int *ip, int nargs)
+{
+    int i;
+    for (i = 0; i < dsp_nspecials; i++)
+        if ((t_perfroutine)ip[0] == dsp_specials[i].s_f &&
+            dsp_specials[i].s_nindex <= nargs &&
+                ip[dsp_specials[i].s_nindex] == dsp_specials[i].s_n)
+    {
+        ip[0] = (t_int)dsp_specials[i].s_special;
+        return;
+    }
+}
+
 void dsp_add(t_perfroutine f, int n, ...)
 {
     int newsize = THIS->u_dspchainsize + n+1, i;
     va_list ap;
 
-    THIS->u_dspchain = t_resizebytes(THIS->u_dspchain,
-        THIS->u_dspchainsize * sizeof (t_int), newsize * sizeof (t_int));
+    dsp_growchain(newsize);
     THIS->u_dspchain[THIS->u_dspchainsize-1] = (t_int)f;
+    THIS->u_dspowner[THIS->u_dspchainsize-1] = THIS->u_curowner;
     if (THIS->u_loud)
         post("add to chain: %lx",
             THIS->u_dspchain[THIS->u_dspchainsize-1]);
@@ -342,6 +918,8 @@ void dsp_add(t_perfroutine f, int n, ...)
                 THIS->u_dspchain[THIS->u_dspchainsize + i]);
     }
     va_end(ap);
+    if (dsp_nspecials)
+        dsp_dospecialize(THIS->u_dspchain + THIS->u_dspchainsize - 1, n);
     THIS->u_dspchain[newsize-1] = (t_int)dsp_done;
     THIS->u_dspchainsize = newsize;
 }
@@ -351,125 +929,841 @@ void dsp_addv(t_perfroutine f, int n, t_int *vec)
 {
     int newsize = THIS->u_dspchainsize + n+1, i;
 
-    THIS->u_dspchain = t_resizebytes(THIS->u_dspchain,
-        THIS->u_dspchainsize * sizeof (t_int), newsize * sizeof (t_int));
+    dsp_growchain(newsize);
     THIS->u_dspchain[THIS->u_dspchainsize-1] = (t_int)f;
+    THIS->u_dspowner[THIS->u_dspchainsize-1] = THIS->u_curowner;
     for (i = 0; i < n; i++)
         THIS->u_dspchain[THIS->u_dspchainsize + i] = vec[i];
+    if (dsp_nspecials)
+        dsp_dospecialize(THIS->u_dspchain + THIS->u_dspchainsize - 1, n);
     THIS->u_dspchain[newsize-1] = (t_int)dsp_done;
     THIS->u_dspchainsize = newsize;
 }
 
-void dsp_tick(void)
+    /* "dspthreads" message to Pd: set number of threads and resort */
+void glob_dspthreads(void *dummy, t_floatarg f)
 {
-    if (THIS->u_dspchain)
+    int n = (f < 1 ? 1 : f);
+    if (n != sys_dspthreads)
     {
-        t_int *ip;
-        for (ip = THIS->u_dspchain; ip; ) ip = (*(t_perfroutine)(*ip))(ip);
-        THIS->u_phase++;
+        sys_dspthreads = n;
+        if (THIS->u_pool)
+        {
+            dsppool_free(THIS->u_pool);
+            THIS->u_pool = 0;
+        }
+        canvas_update_dsp();
     }
 }
 
-/* ---------------- signals ---------------------------- */
-
-int ilog2(int n)
+    /* "dspfuse" message to Pd: turn fusion on or off and resort */
+void glob_dspfuse(void *dummy, t_floatarg f)
 {
-    int r = -1;
-    if (n <= 0) return(0);
-    while (n)
+    int onoff = (f != 0);
+    if (onoff != sys_dspfuse)
     {
-        r++;
-        n >>= 1;
+        sys_dspfuse = onoff;
+        canvas_update_dsp();
     }
-    return (r);
 }
 
-
-    /* call this when DSP is stopped to free all the signals */
-static void signal_cleanup(void)
+    /* "dsplocal" message to Pd: turn locality ordering on or off */
+void glob_dsplocal(void *dummy, t_floatarg f)
 {
-    t_signal *sig;
-    int i;
-    while ((sig = THIS->u_signals))
+    int onoff = (f != 0);
+    if (onoff != sys_dsplocal)
     {
-        THIS->u_signals = sig->s_nextused;
-        if (!sig->s_isborrowed)
-            t_freebytes(sig->s_vec, sig->s_vecsize * sizeof (*sig->s_vec));
-        t_freebytes(sig, sizeof *sig);
+        sys_dsplocal = onoff;
+        canvas_update_dsp();
     }
-    for (i = 0; i <= MAXLOGSIG; i++)
-        THIS->u_freelist[i] = 0;
-    THIS->u_freeborrowed = 0;
 }
 
-    /* mark the signal "reusable." */
-void signal_makereusable(t_signal *sig)
+/* ------------------ fusing pointwise operations ------------------- */
+
+/* When the "-dspfuse" flag is given, chains of pointwise objects such as
+[*~ 0.5] -> [+~ 1] -> [clip~ -1 1], where each one's output goes only to
+the next, are computed by a single perform routine, eight samples at a time,
+without storing the intermediate vectors.  Objects tell us about their
+operation by calling dsp_addpointwise() from their "dsp" method.  If that
+returns 1 the operation has been fused with the code put on the chain just
+before; otherwise the object adds its own code and we remember it in case
+the next one can be fused with it.  The sorter tells us (in u_pwinput) if
+the ugen's first input signal isn't used by anyone else. */
+
+static t_int *pointwise_perform(t_int *w)
 {
-    int logn = ilog2(sig->s_vecsize);
-#if 1
-    t_signal *s5;
-    for (s5 = THIS->u_freeborrowed; s5; s5 = s5->s_nextfree)
-    {
-        if (s5 == sig)
-        {
-            bug("signal_free 3");
-            return;
-        }
-    }
-    for (s5 = THIS->u_freelist[logn]; s5; s5 = s5->s_nextfree)
+    t_sample *in = (t_sample *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    int n = (int)(w[3]), nops = (int)(w[4]), i, j, k;
+    t_sample buf[8];
+    for (i = 0; i < n; i += 8, in += 8, out += 8)
     {
-        if (s5 == sig)
+        t_int *op = w + 5;
+        for (j = 0; j < 8; j++)
+            buf[j] = in[j];
+        for (k = 0; k < nops; k++, op += 3)
         {
-            bug("signal_free 4");
-            return;
+            t_sample *a = (t_sample *)(op[1]) + i, g, h;
+            switch (op[0])
+            {
+            case PW_PLUS:
+                for (j = 0; j < 8; j++) buf[j] += a[j];
+                break;
+            case PW_MINUS:
+                for (j = 0; j < 8; j++) buf[j] -= a[j];
+                break;
+            case PW_TIMES:
+                for (j = 0; j < 8; j++) buf[j] *= a[j];
+                break;
+            case PW_OVER:
+                for (j = 0; j < 8; j++)
+                    buf[j] = (a[j] ? buf[j] / a[j] : 0);
+                break;
+            case PW_MAX:
+                for (j = 0; j < 8; j++)
+                    buf[j] = (buf[j] > a[j] ? buf[j] : a[j]);
+                break;
+            case PW_MIN:
+                for (j = 0; j < 8; j++)
+                    buf[j] = (buf[j] < a[j] ? buf[j] : a[j]);
+                break;
+            case PW_SCALARPLUS:
+                g = *(t_sample *)(op[1]);
+                for (j = 0; j < 8; j++) buf[j] += g;
+                break;
+            case PW_SCALARMINUS:
+                g = *(t_sample *)(op[1]);
+                for (j = 0; j < 8; j++) buf[j] -= g;
+                break;
+            case PW_SCALARTIMES:
+                g = *(t_sample *)(op[1]);
+                for (j = 0; j < 8; j++) buf[j] *= g;
+                break;
+            case PW_SCALAROVER:
+                g = *(t_sample *)(op[1]);
+                if (g) g = 1.f / g;
+                for (j = 0; j < 8; j++) buf[j] *= g;
+                break;
+            case PW_SCALARMAX:
+                g = *(t_sample *)(op[1]);
+                for (j = 0; j < 8; j++)
+                    buf[j] = (buf[j] > g ? buf[j] : g);
+                break;
+            case PW_SCALARMIN:
+                g = *(t_sample *)(op[1]);
+                for (j = 0; j < 8; j++)
+                    buf[j] = (buf[j] < g ? buf[j] : g);
+                break;
+            case PW_CLIP:
+                g = *(t_sample *)(op[1]);
+                h = *(t_sample *)(op[2]);
+                for (j = 0; j < 8; j++)
+                {
+                    t_sample f = buf[j];
+                    if (f < g) f = g;
+                    if (f > h) f = h;
+                    buf[j] = f;
+                }
+                break;
+            case PW_WRAP:
+                for (j = 0; j < 8; j++)
+                {
+                    t_sample f = buf[j];
+                    int m;
+                    f = (f>INT_MAX || f<INT_MIN)?0.:f;
+                    m = (int)f;
+                    if (m <= f) buf[j] = f-m;
+                    else buf[j] = f - (m-1);
+                }
+                break;
+            }
         }
+        for (j = 0; j < 8; j++)
+            out[j] = buf[j];
     }
-#endif
-    if (THIS->u_loud) post("free %lx: %d", sig, sig->s_isborrowed);
-    if (sig->s_isborrowed)
+    return (w + 5 + 3 * nops);
+}
+
+    /* forget the last pointwise code, e.g., because something may jump
+    between it and what comes next */
+static void dsp_pointwisebreak(void)
+{
+    THIS->u_pw.p_start = -1;
+}
+
+int dsp_addpointwise(int op, t_sample *in, t_sample *a, t_sample *b,
+    t_sample *out, int n)
+{
+    t_pwstate *p = &THIS->u_pw;
+    int vecop = (op < PW_SCALARPLUS);
+    if (!sys_dspfuse || (n & 7))
     {
-            /* if the signal is borrowed, decrement the borrowed-from signal's
-                reference count, possibly marking it reusable too */
-        t_signal *s2 = sig->s_borrowedfrom;
-        if ((s2 == sig) || !s2)
-            bug("signal_free");
-        s2->s_refcount--;
-        if (!s2->s_refcount)
-            signal_makereusable(s2);
-        sig->s_nextfree = THIS->u_freeborrowed;
-        THIS->u_freeborrowed = sig;
+        p->p_start = -1;
+        return (0);
     }
-    else
+        /* we can fuse if the last pointwise code is the last thing on the
+        chain, its output is our first input and no one else reads that,
+        and we don't also read it as our second input. */
+    if (p->p_start >= 0 && !p->p_open &&
+        p->p_end == THIS->u_dspchainsize - 1 &&
+        p->p_out == in && p->p_n == n && p->p_nops < PWMAXOPS &&
+        THIS->u_pwinput == in &&
+        !(vecop && a == in))
     {
-            /* if it's a real signal (not borrowed), put it on the free list
-                so we can reuse it. */
-        if (THIS->u_freelist[logn] == sig) bug("signal_free 2");
-        sig->s_nextfree = THIS->u_freelist[logn];
-        THIS->u_freelist[logn] = sig;
+        t_int vec[4 + 3 * PWMAXOPS];
+        int i;
+        p->p_ops[3 * p->p_nops] = op;
+        p->p_ops[3 * p->p_nops + 1] = (t_int)a;
+        p->p_ops[3 * p->p_nops + 2] = (t_int)b;
+        p->p_nops++;
+        p->p_out = out;
+            /* replace the code with a pointwise_perform() call */
+        THIS->u_dspchainsize = p->p_start + 1;
+        THIS->u_dspchain[p->p_start] = (t_int)dsp_done;
+        vec[0] = (t_int)p->p_in;
+        vec[1] = (t_int)p->p_out;
+        vec[2] = n;
+        vec[3] = p->p_nops;
+        for (i = 0; i < 3 * p->p_nops; i++)
+            vec[4 + i] = p->p_ops[i];
+        dsp_addv(pointwise_perform, 4 + 3 * p->p_nops, vec);
+        p->p_end = THIS->u_dspchainsize - 1;
+        if (THIS->u_loud)
+            post("fused %d pointwise operations", p->p_nops);
+        return (1);
     }
+        /* otherwise remember this one; the sorter fills in p_end when
+        the object's "dsp" method returns. */
+    p->p_start = THIS->u_dspchainsize - 1;
+    p->p_open = 1;
+    p->p_in = in;
+    p->p_out = out;
+    p->p_n = n;
+    p->p_nops = 1;
+    p->p_ops[0] = op;
+    p->p_ops[1] = (t_int)a;
+    p->p_ops[2] = (t_int)b;
+    return (0);
 }
 
-    /* reclaim or make an audio signal.  If n is zero, return a "borrowed"
-    signal whose buffer and size will be obtained later via
-    signal_setborrowed(). */
+/* ------------------------- profiling ----------------------------- */
 
-static t_signal *signal_new(int n, t_float sr)
+/* "pd dsp-profile 1" makes dsp_tick() time every perform routine and charge
+it to the object whose "dsp" method put it on the chain (see t_dspowner).
+"pd dsp-profile print [n] [filename]" reports the n most expensive objects
+and canvases since the last sort or "dsp-profile 1", and "pd dsp-profile 0"
+goes back to running the chain untimed.  Code in a parallel section is
+charged as a whole to whatever owns the section's perform routine. */
+
+static double dsp_profclock(void)
 {
-    int logn, vecsize = 0;
-    t_signal *ret, **whichlist;
-    logn = ilog2(n);
-    if (n)
+    return (1e-9 * sys_getnanotime());
+}
+
+static t_dspowner *dsp_newowner(t_object *obj, t_canvas *canvas)
+{
+    t_dspowner *o = (t_dspowner *)getbytes(sizeof(*o));
+    o->o_obj = obj;
+    o->o_canvas = canvas;
+    o->o_time = 0;
+    o->o_next = THIS->u_owners;
+    THIS->u_owners = o;
+    return (o);
+}
+
+static void dsp_freeowners(void)
+{
+    t_dspowner *o, *next;
+    for (o = THIS->u_owners; o; o = next)
     {
-        if ((vecsize = (1<<logn)) != n)
-            vecsize *= 2;
-        if (logn > MAXLOGSIG)
-            bug("signal buffer too large");
-        whichlist = THIS->u_freelist + logn;
+        next = o->o_next;
+        freebytes(o, sizeof(*o));
     }
-    else
-        whichlist = &THIS->u_freeborrowed;
+    THIS->u_owners = THIS->u_curowner = 0;
+    if (THIS->u_dspowner)
+        freebytes(THIS->u_dspowner,
+            THIS->u_dspchainalloc * sizeof (t_dspowner *));
+    THIS->u_dspowner = 0;
+}
 
-        /* first try to reclaim one from the free list */
+    /* the owners of chain elements "from" to "to"-1 have been replaced by
+    an update; forget them and the time they took. */
+static void dsp_killowners(int from, int to)
+{
+    int i;
+    for (i = from; i < to; i++)
+    {
+        if (THIS->u_dspowner[i])
+        {
+            THIS->u_dspowner[i]->o_obj = 0;
+            THIS->u_dspowner[i]->o_canvas = 0;
+            THIS->u_proftime -= THIS->u_dspowner[i]->o_time;
+            THIS->u_dspowner[i]->o_time = 0;
+            THIS->u_dspowner[i] = 0;
+        }
+    }
+}
+
+static void dsp_profiletick(void)
+{
+    t_int *chain = THIS->u_dspchain, *ip, *next;
+    t_dspowner **owner = THIS->u_dspowner;
+    double start = dsp_profclock(), then = start, now;
+    for (ip = chain; ip; ip = next)
+    {
+        next = (*(t_perfroutine)(*ip))(ip);
+        now = dsp_profclock();
+        if (owner[ip - chain])
+            owner[ip - chain]->o_time += now - then;
+        then = now;
+    }
+    THIS->u_proftime += then - start;
+    THIS->u_profticks++;
+}
+
+static int dsp_owncompare(const void *p1, const void *p2)
+{
+    double t1 = (*(t_dspowner **)p1)->o_time, t2 = (*(t_dspowner **)p2)->o_time;
+    return (t1 < t2 ? 1 : (t1 > t2 ? -1 : 0));
+}
+
+    /* print a line of the report, to the file if there is one */
+static void dsp_profprint(FILE *fd, const char *fmt, ...)
+{
+    char buf[MAXPDSTRING];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buf, MAXPDSTRING-1, fmt, ap);
+    va_end(ap);
+    buf[MAXPDSTRING-1] = 0;
+    if (fd)
+        fprintf(fd, "%s\n", buf);
+    else post("%s", buf);
+}
+
+static void dsp_profreport(int n, FILE *fd)
+{
+    t_dspowner *o, **objs, **canvases;
+    int nobj = 0, ncanvas = 0, i, j, size;
+    double total = THIS->u_proftime, ticktime, *self;
+    if (!THIS->u_profticks || total <= 0)
+    {
+        dsp_profprint(fd, "dsp-profile: nothing measured yet");
+        return;
+    }
+    for (o = THIS->u_owners, size = 0; o; o = o->o_next)
+        size++;
+    objs = (t_dspowner **)getbytes(2 * (size + 1) * sizeof(*objs));
+    canvases = objs + size + 1;
+        /* add up the time spent in each object, and, separately, each
+        canvas.  There's usually one owner per object but an update can
+        leave more. */
+    for (o = THIS->u_owners; o; o = o->o_next)
+    {
+        if (!o->o_canvas)
+            continue;
+        if (o->o_obj)
+        {
+            for (i = 0; i < nobj; i++)
+                if (objs[i]->o_obj == o->o_obj)
+                    break;
+            if (i == nobj)
+            {
+                objs[nobj] = (t_dspowner *)getbytes(sizeof(*o));
+                *objs[nobj++] = *o;
+            }
+            else objs[i]->o_time += o->o_time;
+        }
+        for (i = 0; i < ncanvas; i++)
+            if (canvases[i]->o_canvas == o->o_canvas)
+                break;
+        if (i == ncanvas)
+        {
+            canvases[ncanvas] = (t_dspowner *)getbytes(sizeof(*o));
+            *canvases[ncanvas++] = *o;
+        }
+        else canvases[i]->o_time += o->o_time;
+    }
+    qsort(objs, nobj, sizeof(*objs), dsp_owncompare);
+    qsort(canvases, ncanvas, sizeof(*canvases), dsp_owncompare);
+    ticktime = (STUFF->st_dacsr > 0 ?
+        STUFF->st_schedblocksize / STUFF->st_dacsr : 0);
+    dsp_profprint(fd, "dsp-profile: %d ticks, %.2f usec per tick (%.1f%% CPU)",
+        THIS->u_profticks, 1e6 * total / THIS->u_profticks,
+            (ticktime > 0 ? 100. * total / (THIS->u_profticks * ticktime) : 0));
+    dsp_profprint(fd, "objects:");
+    for (i = 0; i < nobj && i < n && objs[i]->o_time > 0; i++)
+    {
+        char *text;
+        int textsize;
+        binbuf_gettext(objs[i]->o_obj->te_binbuf, &text, &textsize);
+        dsp_profprint(fd, "%6.2f%% %10.3f usec  %.*s  (%s)",
+            100. * objs[i]->o_time / total,
+                1e6 * objs[i]->o_time / THIS->u_profticks,
+                    (textsize > 40 ? 40 : textsize), text,
+                        objs[i]->o_canvas->gl_name->s_name);
+        freebytes(text, textsize);
+    }
+    dsp_profprint(fd, "canvases (including the objects in them):");
+        /* a canvas's time is its own plus that of the subcanvases in it;
+        keep their own times aside so as not to count anything twice */
+    self = (double *)getbytes((ncanvas + 1) * sizeof(*self));
+    for (i = 0; i < ncanvas; i++)
+        self[i] = canvases[i]->o_time;
+    for (i = 0; i < ncanvas; i++)
+    {
+        t_canvas *gl;
+        for (j = 0; j < ncanvas; j++)
+            for (gl = canvases[j]->o_canvas->gl_owner; gl; gl = gl->gl_owner)
+                if (gl == canvases[i]->o_canvas)
+                    canvases[i]->o_time += self[j];
+    }
+    freebytes(self, (ncanvas + 1) * sizeof(*self));
+    qsort(canvases, ncanvas, sizeof(*canvases), dsp_owncompare);
+    for (i = 0; i < ncanvas && i < n && canvases[i]->o_time > 0; i++)
+        dsp_profprint(fd, "%6.2f%% %10.3f usec  %s",
+            100. * canvases[i]->o_time / total,
+                1e6 * canvases[i]->o_time / THIS->u_profticks,
+                    canvases[i]->o_canvas->gl_name->s_name);
+    for (i = 0; i < nobj; i++)
+        freebytes(objs[i], sizeof(*o));
+    for (i = 0; i < ncanvas; i++)
+        freebytes(canvases[i], sizeof(*o));
+    freebytes(objs, 2 * (size + 1) * sizeof(*objs));
+}
+
+    /* "dsp-profile" message to Pd */
+void glob_dspprofile(void *dummy, t_symbol *s, int argc, t_atom *argv)
+{
+    t_symbol *what = atom_getsymbolarg(0, argc, argv);
+    if (argc && argv->a_type == A_FLOAT)
+    {
+        t_dspowner *o;
+        if ((THIS->u_profile = (argv->a_w.w_float != 0)))
+        {
+            for (o = THIS->u_owners; o; o = o->o_next)
+                o->o_time = 0;
+            THIS->u_profticks = 0;
+            THIS->u_proftime = 0;
+        }
+    }
+    else if (what == gensym("print"))
+    {
+        int n = atom_getfloatarg(1, argc, argv);
+        t_symbol *filename = atom_getsymbolarg(2, argc, argv);
+        FILE *fd = 0;
+        if (n <= 0)
+            n = 10;
+        if (*filename->s_name &&
+            !(fd = sys_fopen(filename->s_name, "w")))
+        {
+            pd_error(0, "%s: %s", filename->s_name, strerror(errno));
+            return;
+        }
+        dsp_profreport(n, fd);
+        if (fd)
+            sys_fclose(fd);
+    }
+    else pd_error(0, "usage: dsp-profile 0|1 or dsp-profile print [n] [file]");
+}
+
+/* ------------------------- chain map ------------------------------ */
+
+/* "pd dsp-map <filename>" (or "pd -dspmap <filename>") writes a table of
+the DSP chain to the file every time the chain is built or updated, so that
+time a native profiler such as perf or VTune charges to a perform routine
+can be traced back to the objects that put it there.  Each line gives a
+chain index, the perform routine's address and name, and the class, index
+and canvas of the object that owns it (as in "dsp-profile").  If the routine
+isn't an exported symbol we give its file and the offset in it, which
+"addr2line" or the profiler's own symbol tables can resolve.  Code that
+belongs to a canvas rather than an object shows up with class "-" and index
+-1.  "pd dsp-map" without a file name stops writing. */
+
+char sys_dspmap[MAXPDSTRING];
+
+static void dsp_mapcanvas(FILE *fd, t_canvas *x)
+{
+    if (x->gl_owner)
+    {
+        dsp_mapcanvas(fd, x->gl_owner);
+        fputc('/', fd);
+    }
+    fputs(x->gl_name->s_name, fd);
+}
+
+static void dsp_maproutine(FILE *fd, t_int f)
+{
+#ifdef HAVE_LIBDL
+    Dl_info info;
+    if (dladdr((void *)f, &info) && info.dli_fname)
+    {
+        const char *file = strrchr(info.dli_fname, '/');
+        if (info.dli_sname && (t_int)info.dli_saddr == f)
+            fputs(info.dli_sname, fd);
+        else fprintf(fd, "%s+0x%lx", (file ? file + 1 : info.dli_fname),
+            (unsigned long)(f - (t_int)info.dli_fbase));
+        return;
+    }
+#endif
+    fputs("?", fd);
+}
+
+static void dsp_writemap(void)
+{
+    FILE *fd;
+    int i;
+    if (!*sys_dspmap || !THIS->u_dspchain || !THIS->u_dspowner)
+        return;
+    if (!(fd = sys_fopen(sys_dspmap, "w")))
+    {
+        pd_error(0, "%s: %s", sys_dspmap, strerror(errno));
+        *sys_dspmap = 0;
+        return;
+    }
+    fprintf(fd, "# pd DSP chain map: pid %d, sort %d, %d elements\n",
+        (int)getpid(), THIS->u_sortno, THIS->u_dspchainsize);
+    fprintf(fd, "# index\taddress\troutine\tclass\tobject\tcanvas\n");
+    for (i = 0; i < THIS->u_dspchainsize; i++)
+    {
+        t_dspowner *o = THIS->u_dspowner[i];
+        t_int f = THIS->u_dspchain[i];
+        if (!o || !o->o_canvas)
+            continue;
+        fprintf(fd, "%d\t0x%lx\t", i, (unsigned long)f);
+        dsp_maproutine(fd, f);
+        if (o->o_obj)
+            fprintf(fd, "\t%s\t%d\t", class_getname(pd_class(&o->o_obj->ob_pd)),
+                canvas_getindex(o->o_canvas, &o->o_obj->ob_g));
+        else fprintf(fd, "\t-\t-1\t");
+        dsp_mapcanvas(fd, o->o_canvas);
+        fputc('\n', fd);
+    }
+    if (fclose(fd) != 0)
+        pd_error(0, "%s: %s", sys_dspmap, strerror(errno));
+}
+
+    /* "dsp-map" message to Pd */
+void glob_dspmap(void *dummy, t_symbol *s, int argc, t_atom *argv)
+{
+    t_symbol *filename = atom_getsymbolarg(0, argc, argv);
+    snprintf(sys_dspmap, MAXPDSTRING, "%s", filename->s_name);
+    if (THIS->u_dspchain)
+        dsp_writemap();
+}
+
+/* ------------------------- benchmarking ---------------------------- */
+
+/* "pd -bench dsp" times every signal class that Pd knows by name (those
+ending in "~"), one at a time, in a toplevel canvas of its own with noise~
+going into each signal inlet and "block~" setting the block size.  For each
+block size it runs the DSP chain BENCH_RUNS times for BENCH_TICKS ticks,
+charging time to objects as "dsp-profile" does, and reports the mean time
+per sample with a 95% confidence interval over the runs.  "pd -bench osc~"
+(or any other name) times just that class.  This runs in batch mode, so
+there's no audio device; the figures include one clock read per perform
+routine per block, which is measured and reported first. */
+
+#define BENCH_TICKS 1024
+#define BENCH_RUNS 10
+#define BENCH_T95 2.262     /* Student's t, 95%, BENCH_RUNS - 1 degrees */
+
+static const int bench_blocksizes[] = {16, 64, 256};
+#define BENCH_NBLOCKSIZES \
+    ((int)(sizeof(bench_blocksizes)/sizeof(bench_blocksizes[0])))
+
+static int bench_compare(const void *p1, const void *p2)
+{
+    return (strcmp((*(t_symbol **)p1)->s_name, (*(t_symbol **)p2)->s_name));
+}
+
+    /* make the test canvas; return the object, or 0 if it can't be made
+    or doesn't do DSP */
+static t_object *bench_make(t_symbol *name, int blocksize, t_canvas **xp)
+{
+    char buf[MAXPDSTRING];
+    t_binbuf *b = binbuf_new();
+    t_canvas *x;
+    t_object *ob;
+    int i, n;
+    glob_setfilename(0, gensym("bench"), gensym("."));
+    *xp = x = canvas_new(0, 0, 0, 0);
+    glob_setfilename(0, &s_, &s_);
+    snprintf(buf, MAXPDSTRING,
+        "obj 10 10 noise~, obj 10 40 block~ %d, obj 10 70 %s",
+            blocksize, name->s_name);
+    binbuf_text(b, buf, strlen(buf));
+    binbuf_eval(b, &x->gl_pd, 0, 0);
+    binbuf_free(b);
+    if (!(ob = pd_checkobject(&glist_nth(x, 2)->g_pd)) ||
+        !zgetfn(&ob->ob_pd, gensym("dsp")))
+            ob = 0;
+    else for (i = 0, n = obj_ninlets(ob); i < n; i++)
+        if (obj_issignalinlet(ob, i))
+            canvas_connect(x, 0, 0, 2, i);
+    pd_vmess(&x->gl_pd, gensym("pop"), "i", 0);
+    return (ob);
+}
+
+static double bench_objtime(t_object *ob)
+{
+    t_dspowner *o;
+    double time = 0;
+    for (o = THIS->u_owners; o; o = o->o_next)
+        if (o->o_obj == ob)
+            time += o->o_time;
+    return (time);
+}
+
+    /* time one class at one block size, in ns per sample; return 0 if it
+    can't be done */
+static int bench_one(t_symbol *name, int blocksize, double *meanp,
+    double *intervalp)
+{
+    t_canvas *x = 0;
+    t_object *ob;
+    t_dspowner *o;
+    double ns[BENCH_RUNS], mean = 0, var = 0;
+    int i, run;
+    canvas_suspend_dsp();
+    ob = bench_make(name, blocksize, &x);
+    canvas_resume_dsp(1);
+    if (ob)
+    {
+        for (i = 0; i < BENCH_TICKS / 8; i++)     /* warm up */
+            sched_tick();
+        THIS->u_profile = 1;
+        for (run = 0; run < BENCH_RUNS; run++)
+        {
+            for (o = THIS->u_owners; o; o = o->o_next)
+                o->o_time = 0;
+            for (i = 0; i < BENCH_TICKS; i++)
+                sched_tick();
+            ns[run] = 1e9 * bench_objtime(ob) /
+                ((double)BENCH_TICKS * STUFF->st_schedblocksize);
+            mean += ns[run];
+        }
+        THIS->u_profile = 0;
+        if (mean <= 0)      /* no perform routine of its own */
+            ob = 0;
+        mean /= BENCH_RUNS;
+        for (run = 0; run < BENCH_RUNS; run++)
+            var += (ns[run] - mean) * (ns[run] - mean);
+        var /= (BENCH_RUNS - 1);
+        *meanp = mean;
+        *intervalp = BENCH_T95 * sqrt(var / BENCH_RUNS);
+    }
+    canvas_suspend_dsp();
+    if (x)
+        pd_free(&x->gl_pd);
+    return (ob != 0);
+}
+
+    /* called from m_batchmain() for "-bench" */
+int dsp_bench(const char *which)
+{
+    t_class *c = pd_objectmaker;
+#ifdef PDINSTANCE
+    t_methodentry *m = c->c_methods[pd_this->pd_instanceno];
+#else
+    t_methodentry *m = c->c_methods;
+#endif
+    t_symbol **names;
+    int nnames = 0, i, j, printed;
+    double overhead, start;
+
+    sched_tick();       /* let startup (libraries, patches) happen first */
+    names = (t_symbol **)getbytes((c->c_nmethod + 1) * sizeof(*names));
+    if (!strcmp(which, "dsp"))
+    {
+        for (i = 0; i < c->c_nmethod; i++)
+        {
+            const char *s = m[i].me_name->s_name;
+            int len = (int)strlen(s);
+            if (len > 1 && s[len-1] == '~')
+                names[nnames++] = m[i].me_name;
+        }
+        qsort(names, nnames, sizeof(*names), bench_compare);
+    }
+    else names[nnames++] = gensym(which);
+
+    start = dsp_profclock();
+    for (i = 0; i < 100000; i++)
+        dsp_profclock();
+    overhead = 1e9 * (dsp_profclock() - start) / 100000;
+    post("bench: %d runs of %d ticks of %d samples at %g Hz; "
+        "%.1f ns per clock read", BENCH_RUNS, BENCH_TICKS,
+            STUFF->st_schedblocksize, STUFF->st_dacsr, overhead);
+    post("%-16s %6s %12s %10s", "class", "block", "ns/sample", "+/- (95%)");
+    for (i = 0; i < nnames; i++)
+    {
+        for (j = printed = 0; j < BENCH_NBLOCKSIZES; j++)
+        {
+            double mean, interval;
+            if (!bench_one(names[i], bench_blocksizes[j], &mean, &interval))
+                break;
+            post("%-16s %6d %12.3f %10.3f", (printed++ ? "" :
+                names[i]->s_name), bench_blocksizes[j], mean, interval);
+        }
+        if (!printed)
+            post("%-16s (not timed: can't create it, or no DSP code)",
+                names[i]->s_name);
+    }
+    freebytes(names, (c->c_nmethod + 1) * sizeof(*names));
+    return (0);
+}
+
+void dsp_tick(void)
+{
+    if (THIS->u_dspchain)
+    {
+        t_int *ip;
+        t_fpmode was = 0;
+        if (sys_dspftz)
+            was = dsp_flushdenormals();
+        if (THIS->u_profile)
+            dsp_profiletick();
+        else for (ip = THIS->u_dspchain; ip; )
+            ip = (*(t_perfroutine)(*ip))(ip);
+        if (sys_dspftz)
+            dsp_restorefpmode(was);
+        THIS->u_phase++;
+    }
+        /* array storage given up before this tick is no longer in use */
+    array_freeretired();
+}
+
+/* ---------------- signals ---------------------------- */
+
+int ilog2(int n)
+{
+    int r = -1;
+    if (n <= 0) return(0);
+    while (n)
+    {
+        r++;
+        n >>= 1;
+    }
+    return (r);
+}
+
+
+    /* allocate a zeroed sample vector aligned to PD_SIGNALALIGN bytes.  The
+    byte just before it says how far into the allocated block it starts. */
+static t_sample *signal_allocvec(int n)
+{
+    char *mem = (char *)getbytes(n * sizeof(t_sample) + PD_SIGNALALIGN);
+    char *vec = (char *)(((size_t)mem + PD_SIGNALALIGN) &
+        ~(size_t)(PD_SIGNALALIGN - 1));
+    ((unsigned char *)vec)[-1] = (unsigned char)(vec - mem);
+    return ((t_sample *)vec);
+}
+
+static void signal_freevec(t_sample *vec, int n)
+{
+    char *mem = (char *)vec - ((unsigned char *)vec)[-1];
+    freebytes(mem, n * sizeof(t_sample) + PD_SIGNALALIGN);
+}
+
+int signal_isaligned(const t_signal *sig)
+{
+    return (!((size_t)sig->s_vec & (PD_SIGNALALIGN - 1)));
+}
+
+static void signal_freeall(t_signal *sig)
+{
+    t_signal *next;
+    for (; sig; sig = next)
+    {
+        next = sig->s_nextused;
+        if (!sig->s_isborrowed)
+            signal_freevec(sig->s_vec, sig->s_vecsize);
+        t_freebytes(sig, sizeof *sig);
+    }
+}
+
+    /* call this when DSP is stopped to free all the signals */
+static void signal_cleanup(void)
+{
+    int i;
+    signal_freeall(THIS->u_signals);
+    THIS->u_signals = 0;
+    for (i = 0; i <= MAXLOGSIG; i++)
+        THIS->u_freelist[i] = 0;
+    THIS->u_freeborrowed = 0;
+}
+
+    /* mark the signal "reusable." */
+void signal_makereusable(t_signal *sig)
+{
+    int logn = ilog2(sig->s_vecsize);
+#if 1
+    t_signal *s5;
+    for (s5 = THIS->u_freeborrowed; s5; s5 = s5->s_nextfree)
+    {
+        if (s5 == sig)
+        {
+            bug("signal_free 3");
+            return;
+        }
+    }
+    for (s5 = THIS->u_freelist[logn]; s5; s5 = s5->s_nextfree)
+    {
+        if (s5 == sig)
+        {
+            bug("signal_free 4");
+            return;
+        }
+    }
+#endif
+    if (THIS->u_loud) post("free %lx: %d", sig, sig->s_isborrowed);
+    if (sig->s_isborrowed)
+    {
+            /* if the signal is borrowed, decrement the borrowed-from signal's
+                reference count, possibly marking it reusable too */
+        t_signal *s2 = sig->s_borrowedfrom;
+        if ((s2 == sig) || !s2)
+            bug("signal_free");
+        s2->s_refcount--;
+        if (!s2->s_refcount)
+            signal_makereusable(s2);
+        sig->s_nextfree = THIS->u_freeborrowed;
+        THIS->u_freeborrowed = sig;
+    }
+    else
+    {
+            /* if it's a real signal (not borrowed), put it on the free list
+                so we can reuse it. */
+        if (THIS->u_freelist[logn] == sig) bug("signal_free 2");
+        sig->s_nextfree = THIS->u_freelist[logn];
+        THIS->u_freelist[logn] = sig;
+        THIS->u_nlive--;
+        THIS->u_livebytes -= sig->s_vecsize * sizeof(*sig->s_vec);
+    }
+}
+
+    /* reclaim or make an audio signal.  If n is zero, return a "borrowed"
+    signal whose buffer and size will be obtained later via
+    signal_setborrowed(). */
+
+static t_signal *signal_new(int n, t_float sr)
+{
+    int logn, vecsize = 0;
+    t_signal *ret, **whichlist;
+    logn = ilog2(n);
+    if (n)
+    {
+            /* the freelists are by allocated size, so round up */
+        if ((vecsize = (1<<logn)) != n)
+            vecsize *= 2, logn++;
+        if (logn > MAXLOGSIG)
+            bug("signal buffer too large");
+        whichlist = THIS->u_freelist + logn;
+    }
+    else
+        whichlist = &THIS->u_freeborrowed;
+
+        /* first try to reclaim one from the free list */
     if ((ret = *whichlist))
         *whichlist = ret->s_nextfree;
     else
@@ -478,108 +1772,792 @@ static t_signal *signal_new(int n, t_float sr)
         ret = (t_signal *)t_getbytes(sizeof *ret);
         if (n)
         {
-            ret->s_vec = (t_sample *)getbytes(vecsize * sizeof (*ret->s_vec));
+            ret->s_vec = signal_allocvec(vecsize);
             ret->s_isborrowed = 0;
         }
         else
         {
-            ret->s_vec = 0;
-            ret->s_isborrowed = 1;
+            ret->s_vec = 0;
+            ret->s_isborrowed = 1;
+        }
+        ret->s_nextused = THIS->u_signals;
+        THIS->u_signals = ret;
+    }
+    ret->s_n = n;
+    ret->s_vecsize = vecsize;
+    ret->s_nchans = 1;
+    ret->s_scalar = 0;
+    ret->s_sr = sr;
+    ret->s_refcount = 0;
+    ret->s_borrowedfrom = 0;
+    if (n)
+    {
+            /* since signals are freed as soon as their last reader is
+            scheduled, and the freelists hand back the most recently freed
+            buffer first, this peak is the least number of buffers the
+            sorted graph can be computed in. */
+        THIS->u_nlive++;
+        THIS->u_livebytes += vecsize * sizeof (*ret->s_vec);
+        if (THIS->u_nlive > THIS->u_peaklive)
+            THIS->u_peaklive = THIS->u_nlive;
+        if (THIS->u_livebytes > THIS->u_peakbytes)
+            THIS->u_peakbytes = THIS->u_livebytes;
+    }
+    if (THIS->u_loud) post("new %lx: %lx", ret, ret->s_vec);
+    return (ret);
+}
+
+    /* a signal of "nchans" channels of "n" points each */
+static t_signal *signal_newmulti(int n, int nchans, t_float sr)
+{
+    t_signal *ret = signal_new(n * nchans, sr);
+    ret->s_n = n;
+    ret->s_nchans = nchans;
+    return (ret);
+}
+
+static t_signal *signal_newlike(const t_signal *sig)
+{
+    return (signal_newmulti(sig->s_n, sig->s_nchans, sig->s_sr));
+}
+
+    /* called from a "dsp" method to give output signal *sig "nchans"
+    channels.  The one the object was handed is swapped for a bigger one,
+    which keeps its readers. */
+void signal_setmultiout(t_signal **sig, int nchans)
+{
+    t_signal *s1 = *sig, *s2;
+    if (nchans < 1)
+        nchans = 1;
+    if (s1->s_nchans == nchans)
+        return;
+    if (s1->s_isborrowed)
+    {
+        bug("signal_setmultiout");
+        return;
+    }
+    s2 = signal_newmulti(s1->s_n, nchans, s1->s_sr);
+    s2->s_refcount = s1->s_refcount;
+    signal_makereusable(s1);
+    *sig = s2;
+}
+
+void signal_setborrowed(t_signal *sig, t_signal *sig2)
+{
+    if (!sig->s_isborrowed || sig->s_borrowedfrom)
+        bug("signal_setborrowed");
+    if (sig == sig2)
+        bug("signal_setborrowed 2");
+    sig->s_borrowedfrom = sig2;
+    sig->s_vec = sig2->s_vec;
+    sig->s_n = sig2->s_n;
+    sig->s_vecsize = sig2->s_vecsize;
+    sig->s_nchans = sig2->s_nchans;
+    if (THIS->u_loud) post("set borrowed %lx: %lx", sig, sig->s_vec);
+}
+
+static int signal_compatible(t_signal *s1, t_signal *s2)
+{
+    return (s1->s_n == s2->s_n && s1->s_sr == s2->s_sr);
+}
+
+/* ------------------ ugen ("unit generator") sorting ----------------- */
+
+typedef struct _ugenbox
+{
+    struct _siginlet *u_in;
+    int u_nin;
+    struct _sigoutlet *u_out;
+    int u_nout;
+    int u_phase;
+    struct _ugenbox *u_next;
+    t_object *u_obj;
+    int u_done;
+    int u_path;                 /* longest chain of objects ending here */
+    int u_index;                /* place in the list, for ugen_dolocal() */
+    struct _ugenbox *u_share;   /* first of a group that share outputs */
+    struct _ugenbox *u_sharer;  /* (in the first) the one that computes them */
+} t_ugenbox;
+
+typedef struct _siginlet
+{
+    int i_nconnect;
+    int i_ngot;
+    t_signal *i_signal;
+    t_ugenbox *i_from;          /* who the first connection comes from */
+    int i_fromout;              /* ... and from which signal outlet */
+} t_siginlet;
+
+typedef struct _sigoutconnect
+{
+    t_ugenbox *oc_who;
+    int oc_inno;
+    struct _sigoutconnect *oc_next;
+} t_sigoutconnect;
+
+typedef struct _sigoutlet
+{
+    int o_nconnect;
+    int o_nsent;
+    t_signal *o_signal;
+    t_sigoutconnect *o_connections;
+} t_sigoutlet;
+
+
+struct _dspcontext
+{
+    struct _ugenbox *dc_ugenlist;
+    struct _dspcontext *dc_parentcontext;
+    int dc_ninlets;
+    int dc_noutlets;
+    t_signal **dc_iosigs;
+    t_float dc_srate;
+    int dc_vecsize;         /* vector size, power of two */
+    int dc_calcsize;        /* number of elements to calculate */
+    char dc_toplevel;       /* true if "iosigs" is invalid. */
+    char dc_reblock;        /* true if we have to reblock inlets/outlets */
+    char dc_switched;       /* true if we're switched */
+    int dc_contextno;       /* serial number, see ugen_getcontextno() */
+    char dc_double;         /* true if filters should run in double */
+    t_canvas *dc_canvas;    /* canvas we're scheduling if known */
+    int dc_chainonset;      /* where our code starts, -1 if in a section */
+    struct _block *dc_autoblock;    /* automatic switch~ we're inside of */
+    struct _sortframe *dc_sortstack;    /* for ugen_doit() */
+    int dc_work;            /* objects scheduled, counting those inside */
+    int dc_path;            /* the longest chain of them (critical path) */
+    int dc_childwork;       /* the same for subcanvases as they're done */
+    int dc_childpath;
+};
+
+#define t_dspcontext struct _dspcontext
+
+    /* get a new signal for the current context - used by clone~ object */
+t_signal *signal_newfromcontext(int borrowed)
+{
+    return (signal_new((borrowed? 0 : THIS->u_context->dc_calcsize),
+        THIS->u_context->dc_srate));
+}
+
+/* ------------------ parallel DSP sections ----------------------- */
+
+/* If more than one DSP thread is asked for (via the "-dspthreads" flag or
+the "dspthreads" message to Pd), parts of the graph which don't depend on
+each other are put on the DSP chain as a "section".  A section begins with
+a fork point, followed by any number of contiguous "segments", each ending
+in a dsp_done word so that it can be run on its own.  At run time the fork
+point hands the segments out to a pool of worker threads, takes part in
+computing them, waits until all are done, and jumps past the last one.
+
+While a segment is being built it gets its own, initially empty signal
+freelists, so that two segments never share a signal buffer; signals
+freed inside a segment aren't recycled until the section is finished.
+
+Objects whose class is marked CLASS_NOPARALLEL and which have no signal
+outputs (dac~, throw~, send~, delwrite~, ...) are "deferred": their "dsp"
+method is only called after the outermost section is joined so that their
+code runs on the calling thread, after all the segments.  If such an object
+can't be deferred (because it has signal outputs, or lives in a reblocked
+or switched subpatch), its whole segment is run after the join instead. */
+
+typedef struct _deferredugen
+{
+    t_object *d_obj;
+    t_dspowner *d_owner;
+    int d_nsig;
+    t_signal **d_sig;
+    struct _deferredugen *d_next;
+} t_deferredugen;
+
+typedef struct _dspsection
+{
+        /* run-time state */
+    int ds_nseg;                /* number of segments */
+    int ds_npar;                /* how many of them (the first) are parallel */
+    int *ds_onset;              /* chain offset of each, from the fork point */
+    int ds_end;                 /* chain offset past the last segment */
+    t_int *ds_fork;             /* location of the fork point when running */
+    int ds_nclaimed;            /* number of segments handed out */
+    int ds_ndone;               /* number of parallel segments finished */
+    struct _dspsection *ds_nextrunning;   /* sections waiting for threads */
+    struct _dspsection *ds_next;          /* all sections on the chain */
+        /* build-time state */
+    int ds_forkindex;           /* chain index of the fork point */
+    int ds_segonset;            /* chain index where current segment began */
+    int ds_insegment;           /* true if a segment is being built */
+    int ds_segserial;           /* true if it has to run after the join */
+    char *ds_serial;            /* the same for each finished segment */
+    t_signal *ds_savefree[MAXLOGSIG+1];   /* freelists outside the section */
+    t_signal *ds_saveborrowed;
+    t_signal *ds_usedfree[MAXLOGSIG+1];   /* signals freed inside segments */
+    t_signal *ds_usedborrowed;
+    t_deferredugen *ds_deferred;          /* ugens to schedule after join */
+    t_dspcontext *ds_context;             /* context section was begun in */
+    struct _dspsection *ds_parent;        /* enclosing section, if any */
+} t_dspsection;
+
+typedef struct _dsppool
+{
+    int p_nthreads;             /* number of worker threads */
+    pthread_t *p_threads;
+    pthread_mutex_t p_mutex;
+    pthread_cond_t p_wakecond;  /* workers wait on this for sections */
+    pthread_cond_t p_donecond;  /* fork points wait on this for workers */
+    t_dspsection *p_running;    /* sections with segments left to hand out */
+    int p_quit;
+#ifdef PDINSTANCE
+    t_pdinstance *p_instance;
+#endif
+} t_dsppool;
+
+static void dsp_runsegment(t_int *ip)
+{
+    while (ip)
+        ip = (*(t_perfroutine)(*ip))(ip);
+}
+
+    /* hand out the next segment of the first waiting section.  Called with
+    the pool locked; return 0 if there's nothing to do. */
+static t_int *dsppool_claim(t_dsppool *p, t_dspsection **sectionp)
+{
+    t_dspsection *x = p->p_running;
+    t_int *ip;
+    if (!x)
+        return (0);
+    ip = x->ds_fork + x->ds_onset[x->ds_nclaimed++];
+    if (x->ds_nclaimed == x->ds_npar)
+        p->p_running = x->ds_nextrunning;
+    *sectionp = x;
+    return (ip);
+}
+
+static void dsppool_finish(t_dsppool *p, t_dspsection *x)
+{
+    if (++x->ds_ndone == x->ds_npar)
+        pthread_cond_broadcast(&p->p_donecond);
+}
+
+static void *dsppool_thread(void *z)
+{
+    t_dsppool *p = (t_dsppool *)z;
+    t_dspsection *x;
+    t_int *ip;
+#ifdef PDINSTANCE
+    pd_setinstance(p->p_instance);
+#endif
+    sys_setthreadrole(SYS_THREAD_WORKER);
+    pthread_mutex_lock(&p->p_mutex);
+    while (!p->p_quit)
+    {
+        if ((ip = dsppool_claim(p, &x)))
+        {
+            pthread_mutex_unlock(&p->p_mutex);
+            if (sys_dspftz)
+            {
+                t_fpmode was = dsp_flushdenormals();
+                dsp_runsegment(ip);
+                dsp_restorefpmode(was);
+            }
+            else dsp_runsegment(ip);
+            pthread_mutex_lock(&p->p_mutex);
+            dsppool_finish(p, x);
+        }
+        else pthread_cond_wait(&p->p_wakecond, &p->p_mutex);
+    }
+    pthread_mutex_unlock(&p->p_mutex);
+    return (0);
+}
+
+static t_dsppool *dsppool_new(int nthreads)
+{
+    t_dsppool *p = (t_dsppool *)getbytes(sizeof(*p));
+    int i;
+    pthread_mutex_init(&p->p_mutex, 0);
+    pthread_cond_init(&p->p_wakecond, 0);
+    pthread_cond_init(&p->p_donecond, 0);
+    p->p_running = 0;
+    p->p_quit = 0;
+#ifdef PDINSTANCE
+    p->p_instance = pd_this;
+#endif
+    p->p_threads = (pthread_t *)getbytes(nthreads * sizeof(*p->p_threads));
+    for (i = 0; i < nthreads; i++)
+        if (pthread_create(&p->p_threads[i], 0, dsppool_thread, p))
+    {
+        error("dspthreads: only %d worker threads could be started", i);
+        break;
+    }
+    p->p_nthreads = i;
+    return (p);
+}
+
+static void dsppool_free(t_dsppool *p)
+{
+    int i;
+    pthread_mutex_lock(&p->p_mutex);
+    p->p_quit = 1;
+    pthread_cond_broadcast(&p->p_wakecond);
+    pthread_mutex_unlock(&p->p_mutex);
+    for (i = 0; i < p->p_nthreads; i++)
+        pthread_join(p->p_threads[i], 0);
+    pthread_mutex_destroy(&p->p_mutex);
+    pthread_cond_destroy(&p->p_wakecond);
+    pthread_cond_destroy(&p->p_donecond);
+    freebytes(p->p_threads, sizeof(*p->p_threads) * p->p_nthreads);
+    freebytes(p, sizeof(*p));
+}
+
+    /* run the parallel segments of a section on the pool, helping out
+    ourselves.  Other threads may be running segments of other sections
+    (nested ones, or ones in other segments) at the same time. */
+static void dsppool_run(t_dsppool *p, t_dspsection *x, t_int *w)
+{
+    t_dspsection *x2, **xp;
+    t_int *ip;
+    pthread_mutex_lock(&p->p_mutex);
+    x->ds_fork = w;
+    x->ds_nclaimed = x->ds_ndone = 0;
+    x->ds_nextrunning = 0;
+    for (xp = &p->p_running; *xp; xp = &(*xp)->ds_nextrunning)
+        ;
+    *xp = x;
+    pthread_cond_broadcast(&p->p_wakecond);
+    while (x->ds_nclaimed < x->ds_npar)
+    {
+            /* only take segments from our own section here, so that we
+            can't get stuck inside somebody else's */
+        for (xp = &p->p_running; *xp != x; xp = &(*xp)->ds_nextrunning)
+            ;
+        ip = w + x->ds_onset[x->ds_nclaimed++];
+        if (x->ds_nclaimed == x->ds_npar)
+            *xp = x->ds_nextrunning;
+        pthread_mutex_unlock(&p->p_mutex);
+        dsp_runsegment(ip);
+        pthread_mutex_lock(&p->p_mutex);
+        dsppool_finish(p, x);
+    }
+    while (x->ds_ndone < x->ds_npar)
+        pthread_cond_wait(&p->p_donecond, &p->p_mutex);
+    pthread_mutex_unlock(&p->p_mutex);
+}
+
+static t_int *dsp_parallel_perform(t_int *w)
+{
+    t_dspsection *x = (t_dspsection *)(w[1]);
+    t_dsppool *p = THIS->u_pool;
+    int i;
+    if (x->ds_npar > 1 && p && p->p_nthreads)
+        dsppool_run(p, x, w);
+    else for (i = 0; i < x->ds_npar; i++)
+        dsp_runsegment(w + x->ds_onset[i]);
+    for (i = x->ds_npar; i < x->ds_nseg; i++)
+        dsp_runsegment(w + x->ds_onset[i]);
+    return (w + x->ds_end);
+}
+
+static void signal_appendfree(t_signal **to, t_signal *from)
+{
+    while (*to)
+        to = &(*to)->s_nextfree;
+    *to = from;
+}
+
+    /* move the current freelists onto "to" and empty them */
+static void signal_stashfree(t_signal **to, t_signal **toborrowed)
+{
+    int i;
+    for (i = 0; i <= MAXLOGSIG; i++)
+    {
+        signal_appendfree(&to[i], THIS->u_freelist[i]);
+        THIS->u_freelist[i] = 0;
+    }
+    signal_appendfree(toborrowed, THIS->u_freeborrowed);
+    THIS->u_freeborrowed = 0;
+}
+
+    /* start a parallel section on the DSP chain, to be computed by
+    "nthreads" threads or by as many as "-dspthreads" asked for, whichever is
+    more.  This returns zero (and all other ugen_parallel_...() calls do
+    nothing) if that comes to only one thread. */
+t_dspsection *ugen_parallel_begin(int nthreads)
+{
+    t_dspsection *x;
+    int i;
+    if (nthreads < sys_dspthreads)
+        nthreads = sys_dspthreads;
+    if (nthreads < 2)
+        return (0);
+    if (THIS->u_pool && THIS->u_pool->p_nthreads < nthreads - 1)
+    {
+        dsppool_free(THIS->u_pool);
+        THIS->u_pool = 0;
+    }
+    if (!THIS->u_pool)
+        THIS->u_pool = dsppool_new(nthreads - 1);
+    x = (t_dspsection *)getbytes(sizeof(*x));
+    x->ds_nseg = x->ds_npar = 0;
+    x->ds_onset = 0;
+    x->ds_serial = 0;
+    x->ds_insegment = 0;
+    x->ds_deferred = 0;
+    x->ds_saveborrowed = x->ds_usedborrowed = 0;
+    for (i = 0; i <= MAXLOGSIG; i++)
+        x->ds_savefree[i] = x->ds_usedfree[i] = 0;
+    signal_stashfree(x->ds_savefree, &x->ds_saveborrowed);
+    x->ds_context = THIS->u_context;
+    x->ds_parent = THIS->u_building;
+    THIS->u_building = x;
+    x->ds_forkindex = THIS->u_dspchainsize - 1;
+    dsp_add(dsp_parallel_perform, 1, x);
+    return (x);
+}
+
+static void ugen_parallel_endsegment(t_dspsection *x)
+{
+    if (!x->ds_insegment)
+        return;
+        /* drop empty segments altogether */
+    if (THIS->u_dspchainsize - 1 > x->ds_segonset)
+    {
+        dsp_add((t_perfroutine)dsp_done, 0);
+        x->ds_onset = (int *)t_resizebytes(x->ds_onset,
+            x->ds_nseg * sizeof(*x->ds_onset),
+                (x->ds_nseg + 1) * sizeof(*x->ds_onset));
+        x->ds_serial = (char *)t_resizebytes(x->ds_serial,
+            x->ds_nseg * sizeof(*x->ds_serial),
+                (x->ds_nseg + 1) * sizeof(*x->ds_serial));
+        x->ds_onset[x->ds_nseg] = x->ds_segonset - x->ds_forkindex;
+        x->ds_serial[x->ds_nseg] = x->ds_segserial;
+        x->ds_nseg++;
+    }
+    signal_stashfree(x->ds_usedfree, &x->ds_usedborrowed);
+    x->ds_insegment = 0;
+}
+
+    /* start a new segment (ending the previous one if there is one) */
+    /* where the next code will go in the DSP chain, for objects such as
+    clone that jump over code they've added.  Pointwise code before this
+    point won't be fused with anything after it. */
+int ugen_chainposition(void)
+{
+    dsp_pointwisebreak();
+    return (THIS->u_dspchainsize - 1);
+}
+
+void ugen_parallel_segment(t_dspsection *x)
+{
+    if (!x)
+        return;
+    ugen_parallel_endsegment(x);
+    dsp_pointwisebreak();
+    x->ds_segonset = THIS->u_dspchainsize - 1;
+    x->ds_segserial = 0;
+    x->ds_insegment = 1;
+}
+
+void ugen_parallel_end(t_dspsection *x)
+{
+    int i, j, *onset;
+    if (!x)
+        return;
+    ugen_parallel_endsegment(x);
+    dsp_pointwisebreak();
+    x->ds_end = (THIS->u_dspchainsize - 1) - x->ds_forkindex;
+    for (i = 0; i <= MAXLOGSIG; i++)
+    {
+        THIS->u_freelist[i] = x->ds_savefree[i];
+        signal_appendfree(&THIS->u_freelist[i], x->ds_usedfree[i]);
+    }
+    THIS->u_freeborrowed = x->ds_saveborrowed;
+    signal_appendfree(&THIS->u_freeborrowed, x->ds_usedborrowed);
+
+        /* put the parallel segments first, then the serial ones */
+    onset = (int *)getbytes(x->ds_nseg * sizeof(*onset));
+    for (i = j = 0; i < x->ds_nseg; i++)
+        if (!x->ds_serial[i])
+            onset[j++] = x->ds_onset[i];
+    x->ds_npar = j;
+    for (i = 0; i < x->ds_nseg; i++)
+        if (x->ds_serial[i])
+            onset[j++] = x->ds_onset[i];
+    freebytes(x->ds_onset, x->ds_nseg * sizeof(*x->ds_onset));
+    freebytes(x->ds_serial, x->ds_nseg * sizeof(*x->ds_serial));
+    x->ds_onset = onset;
+    x->ds_serial = 0;
+    if (THIS->u_loud)
+        post("parallel section: %d segments, %d parallel",
+            x->ds_nseg, x->ds_npar);
+
+    THIS->u_building = x->ds_parent;
+    x->ds_next = THIS->u_sections;
+    THIS->u_sections = x;
+
+        /* now that we're past the join, schedule the deferred objects */
+    while (x->ds_deferred)
+    {
+        t_deferredugen *d = x->ds_deferred;
+        t_dspowner *was = THIS->u_curowner;
+        THIS->u_curowner = d->d_owner;
+        mess1(&d->d_obj->ob_pd, gensym("dsp"), d->d_sig);
+        THIS->u_curowner = was;
+        for (i = 0; i < d->d_nsig; i++)
+            if (!--d->d_sig[i]->s_refcount)
+                signal_makereusable(d->d_sig[i]);
+        x->ds_deferred = d->d_next;
+        freebytes(d->d_sig, d->d_nsig * sizeof(*d->d_sig));
+        freebytes(d, sizeof(*d));
+    }
+}
+
+    /* a CLASS_NOPARALLEL object is being scheduled while a section is
+    being built.  Either defer it to the end of the outermost section
+    (returning 1), or mark all the enclosing segments to run serially. */
+static int ugen_parallel_defer(t_dspcontext *dc, t_object *obj,
+    int nin, int nout, t_signal **insig)
+{
+    t_dspsection *x, *outer;
+    t_dspcontext *dc2;
+    t_deferredugen *d, **dp;
+    int i;
+    for (outer = THIS->u_building; outer->ds_parent; outer = outer->ds_parent)
+        ;
+    if (!nout)
+    {
+        for (dc2 = dc; dc2 && dc2 != outer->ds_context;
+            dc2 = dc2->dc_parentcontext)
+                if (dc2->dc_reblock || dc2->dc_switched)
+                    break;
+        if (dc2 == outer->ds_context)
+        {
+            d = (t_deferredugen *)getbytes(sizeof(*d));
+            d->d_obj = obj;
+            d->d_owner = THIS->u_curowner;
+            d->d_nsig = nin;
+            d->d_sig = (t_signal **)copybytes(insig, nin * sizeof(*insig));
+            d->d_next = 0;
+            for (dp = &outer->ds_deferred; *dp; dp = &(*dp)->d_next)
+                ;
+            *dp = d;
+            return (1);
         }
-        ret->s_nextused = THIS->u_signals;
-        THIS->u_signals = ret;
     }
-    ret->s_n = n;
-    ret->s_vecsize = vecsize;
-    ret->s_sr = sr;
-    ret->s_refcount = 0;
-    ret->s_borrowedfrom = 0;
-    if (THIS->u_loud) post("new %lx: %lx", ret, ret->s_vec);
-    return (ret);
+    for (x = THIS->u_building; x; x = x->ds_parent)
+        x->ds_segserial = 1;
+    return (0);
 }
 
-static t_signal *signal_newlike(const t_signal *sig)
+/* ------------------ incremental updates ----------------------- */
+
+/* Editing a connection calls canvas_update_dsp(), which would normally
+resort the whole DSP graph.  To avoid that, we remember where on the chain
+the code for each canvas went.  If the canvas has no signal inlets or
+outlets and wasn't scheduled inside a parallel section, its code only
+depends on the block size and sample rate it was scheduled with, so it can
+be resorted by itself: the new code is appended to the end of the chain,
+the beginning of the old code is overwritten with a jump to it, and the new
+code ends with a jump back to the end of the old code.  This happens between
+DSP ticks so the change takes effect at a tick boundary.
+
+Signals for the new code are all newly allocated, since any signal on the
+freelist may still be in use by the running code.  The old code and its
+signals stay around until the next time the whole chain is rebuilt, which
+we force when the bypassed code gets bigger than the chain itself. */
+
+typedef struct _dsprange
 {
-    return (signal_new(sig->s_n, sig->s_sr));
+    t_canvas *r_canvas;
+    int r_onset;            /* chain index where its code begins */
+    int r_end;              /* chain index past its code */
+    char r_toplevel;
+    t_float r_srate;        /* the context it was scheduled in */
+    int r_vecsize;
+    int r_calcsize;
+    struct _dsprange *r_next;
+} t_dsprange;
+
+typedef struct _dspupdate
+{
+    int d_oldonset;         /* chain range of the code being replaced */
+    int d_oldend;
+    int d_onset;            /* chain index the new code starts at */
+    t_dspcontext *d_context;    /* stand-in for the parent context */
+    t_signal *d_savefree[MAXLOGSIG+1];
+    t_signal *d_saveborrowed;
+} t_dspupdate;
+
+static t_int *dsp_jump(t_int *w)
+{
+    return (w + w[1]);
 }
 
-void signal_setborrowed(t_signal *sig, t_signal *sig2)
+static t_dsprange *ugen_findrange(t_canvas *x)
 {
-    if (!sig->s_isborrowed || sig->s_borrowedfrom)
-        bug("signal_setborrowed");
-    if (sig == sig2)
-        bug("signal_setborrowed 2");
-    sig->s_borrowedfrom = sig2;
-    sig->s_vec = sig2->s_vec;
-    sig->s_n = sig2->s_n;
-    sig->s_vecsize = sig2->s_vecsize;
-    if (THIS->u_loud) post("set borrowed %lx: %lx", sig, sig->s_vec);
+    t_dsprange *r;
+    for (r = THIS->u_ranges; r; r = r->r_next)
+        if (r->r_canvas == x)
+            return (r);
+    return (0);
 }
 
-static int signal_compatible(t_signal *s1, t_signal *s2)
+static void ugen_addrange(t_dspcontext *dc)
 {
-    return (s1->s_n == s2->s_n && s1->s_sr == s2->s_sr);
+    t_dsprange *r, **rp;
+        /* during an update, forget where this canvas's code used to be */
+    if (THIS->u_update)
+        for (rp = &THIS->u_ranges; (r = *rp); rp = &r->r_next)
+            if (r->r_canvas == dc->dc_canvas)
+    {
+        *rp = r->r_next;
+        freebytes(r, sizeof(*r));
+        break;
+    }
+    if (dc->dc_chainonset < 0 ||
+        (!dc->dc_toplevel && (dc->dc_ninlets || dc->dc_noutlets)))
+            return;
+        /* make sure there's room for the jump */
+    while (THIS->u_dspchainsize - 1 - dc->dc_chainonset < 2)
+        dsp_add(dsp_jump, 1, (t_int)2);
+    r = (t_dsprange *)getbytes(sizeof(*r));
+    r->r_canvas = dc->dc_canvas;
+    r->r_onset = dc->dc_chainonset;
+    r->r_end = THIS->u_dspchainsize - 1;
+    r->r_toplevel = dc->dc_toplevel;
+    if (dc->dc_parentcontext)
+    {
+        r->r_srate = dc->dc_parentcontext->dc_srate;
+        r->r_vecsize = dc->dc_parentcontext->dc_vecsize;
+        r->r_calcsize = dc->dc_parentcontext->dc_calcsize;
+    }
+    else r->r_srate = r->r_vecsize = r->r_calcsize = 0;
+    r->r_next = THIS->u_ranges;
+    THIS->u_ranges = r;
 }
 
-/* ------------------ ugen ("unit generator") sorting ----------------- */
-
-typedef struct _ugenbox
+static void ugen_freeranges(void)
 {
-    struct _siginlet *u_in;
-    int u_nin;
-    struct _sigoutlet *u_out;
-    int u_nout;
-    int u_phase;
-    struct _ugenbox *u_next;
-    t_object *u_obj;
-    int u_done;
-} t_ugenbox;
+    t_dsprange *r;
+    while ((r = THIS->u_ranges))
+    {
+        THIS->u_ranges = r->r_next;
+        freebytes(r, sizeof(*r));
+    }
+    THIS->u_deadwords = 0;
+}
 
-typedef struct _siginlet
+    /* called when canvas "x" is freed: its code, if any, is inside that of
+    whatever contained it, which has to be rescheduled anyway */
+void ugen_forgetcanvas(t_canvas *x)
 {
-    int i_nconnect;
-    int i_ngot;
-    t_signal *i_signal;
-} t_siginlet;
+    t_dsprange *r, **rp;
+    for (rp = &THIS->u_ranges; (r = *rp); )
+        if (r->r_canvas == x)
+    {
+        *rp = r->r_next;
+        freebytes(r, sizeof(*r));
+    }
+    else rp = &r->r_next;
+}
 
-typedef struct _sigoutconnect
+    /* check whether canvas "x" can be rescheduled by itself.  Replaced code
+    stays in the chain, jumped over, until the next full sort; once it would
+    be half the chain we'd rather sort everything and get rid of it. */
+int ugen_canupdate(t_canvas *x)
 {
-    t_ugenbox *oc_who;
-    int oc_inno;
-    struct _sigoutconnect *oc_next;
-} t_sigoutconnect;
+    t_dsprange *r;
+    if (!THIS->u_dspchain || THIS->u_context || THIS->u_update ||
+        !(r = ugen_findrange(x)))
+            return (0);
+    return (2 * (THIS->u_deadwords + (r->r_end - r->r_onset)) <
+        THIS->u_dspchainsize);
+}
 
-typedef struct _sigoutlet
+    /* start rescheduling canvas "x" (which ugen_canupdate() has okayed).
+    The caller then schedules the canvas as usual with canvas_dodsp(),
+    passing it the "toplevel" flag returned here, and calls
+    ugen_done_update(). */
+int ugen_start_update(t_canvas *x)
 {
-    int o_nconnect;
-    int o_nsent;
-    t_signal *o_signal;
-    t_sigoutconnect *o_connections;
-} t_sigoutlet;
-
+    t_dsprange *r = ugen_findrange(x);
+    t_dspupdate *u = (t_dspupdate *)getbytes(sizeof(*u));
+    int i;
+    u->d_oldonset = r->r_onset;
+    u->d_oldend = r->r_end;
+    for (i = 0; i <= MAXLOGSIG; i++)
+        u->d_savefree[i] = 0;
+    u->d_saveborrowed = 0;
+    signal_stashfree(u->d_savefree, &u->d_saveborrowed);
+    if (r->r_toplevel)
+        u->d_context = 0;
+    else
+    {
+        t_dspcontext *dc = (t_dspcontext *)getbytes(sizeof(*dc));
+        t_canvas *gl;
+        dc->dc_ugenlist = 0;
+        dc->dc_parentcontext = 0;
+        dc->dc_ninlets = dc->dc_noutlets = 0;
+        dc->dc_iosigs = 0;
+        dc->dc_srate = r->r_srate;
+        dc->dc_vecsize = r->r_vecsize;
+        dc->dc_calcsize = r->r_calcsize;
+        dc->dc_toplevel = 1;
+        dc->dc_reblock = dc->dc_switched = 0;
+        dc->dc_canvas = 0;
+        dc->dc_chainonset = -1;
+        dc->dc_autoblock = 0;
+        for (gl = r->r_canvas->gl_owner; gl && !dc->dc_autoblock;
+            gl = gl->gl_owner)
+                dc->dc_autoblock = canvas_findautoblock(gl);
+        u->d_context = dc;
+    }
+    THIS->u_context = u->d_context;
+    THIS->u_update = u;
+        /* end the chain where it ends now, and start the new code after */
+    dsp_add((t_perfroutine)dsp_done, 0);
+    dsp_pointwisebreak();
+    u->d_onset = THIS->u_dspchainsize - 1;
+    return (r->r_toplevel);
+}
 
-struct _dspcontext
+void ugen_done_update(void)
 {
-    struct _ugenbox *dc_ugenlist;
-    struct _dspcontext *dc_parentcontext;
-    int dc_ninlets;
-    int dc_noutlets;
-    t_signal **dc_iosigs;
-    t_float dc_srate;
-    int dc_vecsize;         /* vector size, power of two */
-    int dc_calcsize;        /* number of elements to calculate */
-    char dc_toplevel;       /* true if "iosigs" is invalid. */
-    char dc_reblock;        /* true if we have to reblock inlets/outlets */
-    char dc_switched;       /* true if we're switched */
-};
+    t_dspupdate *u = THIS->u_update;
+    int oldonset = u->d_oldonset, oldend = u->d_oldend, i;
+    if (THIS->u_context != u->d_context)
+        bug("ugen_done_update");
+        /* jump back to the end of the old code... */
+    dsp_add(dsp_jump, 1, (t_int)0);
+    THIS->u_dspchain[THIS->u_dspchainsize - 2] =
+        oldend - (THIS->u_dspchainsize - 3);
+        /* ... and patch the old code to jump to the new */
+    dsp_killowners(oldonset, oldend);
+    THIS->u_dspchain[oldonset] = (t_int)dsp_jump;
+    THIS->u_dspchain[oldonset + 1] = u->d_onset - oldonset;
+    THIS->u_deadwords += oldend - oldonset;
+    if (THIS->u_loud)
+        post("update: %d chain elements replaced by %d", oldend - oldonset,
+            THIS->u_dspchainsize - 1 - u->d_onset);
 
-#define t_dspcontext struct _dspcontext
+        /* signals freed by the new code stay on the signal list but
+        mustn't be reused; go back to the freelists from before */
+    for (i = 0; i <= MAXLOGSIG; i++)
+        THIS->u_freelist[i] = u->d_savefree[i];
+    THIS->u_freeborrowed = u->d_saveborrowed;
+    if (u->d_context)
+        freebytes(u->d_context, sizeof(*u->d_context));
+    THIS->u_context = 0;
+    THIS->u_update = 0;
+    freebytes(u, sizeof(*u));
+    dsp_writemap();
+}
 
-    /* get a new signal for the current context - used by clone~ object */
-t_signal *signal_newfromcontext(int borrowed)
+static void ugen_parallel_free(t_dspsection *x)
 {
-    return (signal_new((borrowed? 0 : THIS->u_context->dc_calcsize),
-        THIS->u_context->dc_srate));
+    t_dspsection *next;
+    for (; x; x = next)
+    {
+        next = x->ds_next;
+        freebytes(x->ds_onset, x->ds_nseg * sizeof(*x->ds_onset));
+        freebytes(x, sizeof(*x));
+    }
 }
 
 void ugen_stop(void)
@@ -587,21 +2565,59 @@ void ugen_stop(void)
     if (THIS->u_dspchain)
     {
         freebytes(THIS->u_dspchain,
-            THIS->u_dspchainsize * sizeof (t_int));
+            THIS->u_dspchainalloc * sizeof (t_int));
         THIS->u_dspchain = 0;
     }
+    dsp_freeowners();
+    THIS->u_dspchainsize = THIS->u_dspchainalloc = 0;
+    ugen_parallel_free(THIS->u_sections);
+    THIS->u_sections = 0;
+    ugen_freeranges();
     signal_cleanup();
 
 }
 
+    /* start building a new DSP chain.  The chain is built on the scheduler
+    thread between two DSP ticks, so the old one can't go on running while
+    we build; free it first so that the two never take up memory together. */
 void ugen_start(void)
 {
+    if (THIS->u_context) bug("ugen_start");
     ugen_stop();
+    THIS->u_nlive = THIS->u_livebytes = 0;
+    THIS->u_peaklive = THIS->u_peakbytes = 0;
+    THIS->u_work = THIS->u_critpath = 0;
     THIS->u_sortno++;
-    THIS->u_dspchain = (t_int *)getbytes(sizeof(*THIS->u_dspchain));
+    dsp_growchain(DSPCHAINMINALLOC);
     THIS->u_dspchain[0] = (t_int)dsp_done;
     THIS->u_dspchainsize = 1;
-    if (THIS->u_context) bug("ugen_start");
+    dsp_pointwisebreak();
+}
+
+    /* called when all root canvases have been added to the chain: give back
+    the space we didn't use, leaving the chain in one block of exactly the
+    size needed. */
+void ugen_finish(void)
+{
+    if (THIS->u_dspchain && THIS->u_dspchainalloc > THIS->u_dspchainsize)
+    {
+        THIS->u_dspchain = t_resizebytes(THIS->u_dspchain,
+            THIS->u_dspchainalloc * sizeof (t_int),
+                THIS->u_dspchainsize * sizeof (t_int));
+        THIS->u_dspowner = t_resizebytes(THIS->u_dspowner,
+            THIS->u_dspchainalloc * sizeof (t_dspowner *),
+                THIS->u_dspchainsize * sizeof (t_dspowner *));
+        THIS->u_dspchainalloc = THIS->u_dspchainsize;
+    }
+    if (sys_prefaulting)
+    {
+        t_signal *sig;
+        for (sig = THIS->u_signals; sig; sig = sig->s_nextused)
+            if (!sig->s_isborrowed)
+                sys_prefault(sig->s_vec, sig->s_vecsize * sizeof(t_sample));
+        sys_prefault(THIS->u_dspchain, THIS->u_dspchainsize * sizeof(t_int));
+    }
+    dsp_writemap();
 }
 
 int ugen_getsortno(void)
@@ -609,15 +2625,45 @@ int ugen_getsortno(void)
     return (THIS->u_sortno);
 }
 
-#if 0
+    /* a number identifying the DSP context now being scheduled, never
+    reused.  If two objects get the same nonzero number, the code
+    scheduled for the first one runs before the second's every time the
+    second's does, so that the second may hand out the first one's memory
+    in place of a copy (see receive~).  Inside parallel sections segments
+    can run in any order, so we give out zero there. */
+int ugen_getcontextno(void)
+{
+    return ((THIS->u_building || !THIS->u_context) ?
+        0 : THIS->u_context->dc_contextno);
+}
+
+    /* true if the objects now being scheduled should keep their state and
+    coefficients in double precision, as asked by "block~ -precision
+    double" here or in a window above.  Signals stay t_sample, so this only
+    matters for objects with long-memory state, like the filters.  It is
+    false if t_sample is already double. */
+int ugen_getdouble(void)
+{
+    return (sizeof(t_sample) < sizeof(double) && THIS->u_context &&
+        THIS->u_context->dc_double);
+}
+
+    /* the "dspstatus" message to Pd */
 void glob_ugen_printstate(void *dummy, t_symbol *s, int argc, t_atom *argv)
 {
-    int i, count;
+    int i, count, bytes;
     t_signal *sig;
-    for (count = 0, sig = THIS->u_signals; sig;
+    for (count = bytes = 0, sig = THIS->u_signals; sig;
         count++, sig = sig->s_nextused)
-            ;
-    post("used signals %d", count);
+            if (!sig->s_isborrowed)
+                bytes += sig->s_vecsize * sizeof(*sig->s_vec);
+    post("used signals %d (%d bytes of samples)", count, bytes);
+    post("peak signals in use %d (%d bytes of samples)",
+        THIS->u_peaklive, THIS->u_peakbytes);
+    if (THIS->u_critpath)
+        post("DSP objects %d, critical path %d (parallelism at most %.1f)",
+            THIS->u_work, THIS->u_critpath,
+                (double)THIS->u_work / THIS->u_critpath);
     for (i = 0; i < MAXLOGSIG; i++)
     {
         for (count = 0, sig = THIS->u_freelist[i]; sig;
@@ -633,7 +2679,6 @@ void glob_ugen_printstate(void *dummy, t_symbol *s, int argc, t_atom *argv)
 
     THIS->u_loud = argc;
 }
-#endif
 
     /* start building the graph for a canvas */
 t_dspcontext *ugen_start_graph(int toplevel, t_signal **sp,
@@ -654,10 +2699,23 @@ t_dspcontext *ugen_start_graph(int toplevel, t_signal **sp,
     dc->dc_ninlets = ninlets;
     dc->dc_noutlets = noutlets;
     dc->dc_parentcontext = THIS->u_context;
+    dc->dc_canvas = 0;
+    dc->dc_chainonset = (THIS->u_building ? -1 : THIS->u_dspchainsize - 1);
+    dc->dc_autoblock = 0;
+    dc->dc_contextno = ++THIS->u_contextno;
+    dc->dc_double = (THIS->u_context ? THIS->u_context->dc_double : 0);
     THIS->u_context = dc;
+    dsp_pointwisebreak();
     return (dc);
 }
 
+    /* tell the DSP graph which canvas it belongs to, so that the canvas can
+    later be rescheduled by itself (see ugen_start_update() below). */
+void ugen_setcanvas(t_dspcontext *dc, t_canvas *x)
+{
+    dc->dc_canvas = x;
+}
+
     /* first the canvas calls this to create all the boxes... */
 void ugen_add(t_dspcontext *dc, t_object *obj)
 {
@@ -669,10 +2727,11 @@ void ugen_add(t_dspcontext *dc, t_object *obj)
     x->u_next = dc->dc_ugenlist;
     dc->dc_ugenlist = x;
     x->u_obj = obj;
+    x->u_share = x->u_sharer = 0;
     x->u_nin = obj_nsiginlets(obj);
     x->u_in = getbytes(x->u_nin * sizeof (*x->u_in));
     for (uin = x->u_in, i = x->u_nin; i--; uin++)
-        uin->i_nconnect = 0;
+        uin->i_nconnect = 0, uin->i_from = 0;
     x->u_nout = obj_nsigoutlets(obj);
     x->u_out = getbytes(x->u_nout * sizeof (*x->u_out));
     for (uout = x->u_out, i = x->u_nout; i--; uout++)
@@ -724,7 +2783,8 @@ void ugen_connect(t_dspcontext *dc, t_object *x1, int outno, t_object *x2,
     oc->oc_inno = siginno;
         /* update inlet and outlet counts  */
     uout->o_nconnect++;
-    uin->i_nconnect++;
+    if (!uin->i_nconnect++)
+        uin->i_from = u1, uin->i_fromout = sigoutno;
 }
 
     /* get the index of a ugenbox or -1 if it's not on the list */
@@ -738,33 +2798,122 @@ static int ugen_index(t_dspcontext *dc, t_ugenbox *x)
 }
 extern t_class *clone_class;
 
-    /* put a ugenbox on the chain, recursively putting any others on that
-    this one might uncover. */
-static void ugen_doit(t_dspcontext *dc, t_ugenbox *u)
+static void ugen_doit(t_dspcontext *dc, t_ugenbox *u);
+
+    /* can a ugenbox share its outputs with others like it?  It has to be of
+    a CLASS_DSPPURE class and have each signal inlet fed by exactly one
+    connection. */
+static int ugen_canshare(t_ugenbox *u)
+{
+    int i;
+    if (!u->u_nin || !u->u_nout ||
+        !(class_getdspflags(pd_class(&u->u_obj->ob_pd)) & CLASS_DSPPURE))
+            return (0);
+    for (i = 0; i < u->u_nin; i++)
+        if (u->u_in[i].i_nconnect != 1)
+            return (0);
+    return (1);
+}
+
+    /* group ugenboxes of the same pure class whose inlets are all connected
+    from the same outlets.  They compute the same thing, so only the first
+    of each group to be scheduled runs and the others alias its outputs. */
+static void ugen_findshared(t_dspcontext *dc)
+{
+    t_ugenbox *u, *u2;
+    int i;
+    for (u = dc->dc_ugenlist; u; u = u->u_next)
+        u->u_share = u->u_sharer = 0;
+    for (u = dc->dc_ugenlist; u; u = u->u_next)
+    {
+        if (!ugen_canshare(u))
+            continue;
+        for (u2 = dc->dc_ugenlist; u2 != u; u2 = u2->u_next)
+        {
+            if (pd_class(&u2->u_obj->ob_pd) != pd_class(&u->u_obj->ob_pd) ||
+                u2->u_nin != u->u_nin || !ugen_canshare(u2))
+                    continue;
+            for (i = 0; i < u->u_nin; i++)
+                if (u2->u_in[i].i_from != u->u_in[i].i_from ||
+                    u2->u_in[i].i_fromout != u->u_in[i].i_fromout)
+                        break;
+            if (i == u->u_nin)
+            {
+                if (!u2->u_share)
+                    u2->u_share = u2;
+                u->u_share = u2->u_share;
+                if (THIS->u_loud)
+                    post("share %s %d with %d", class_getname(
+                        pd_class(&u->u_obj->ob_pd)), ugen_index(dc, u),
+                            ugen_index(dc, u2->u_share));
+                break;
+            }
+        }
+    }
+}
+
+    /* schedule a ugenbox whose group already has its outputs: just release
+    its inputs and pass the group's outputs for its own. */
+static void ugen_scheduleshared(t_ugenbox *u)
+{
+    t_ugenbox *sharer = u->u_share->u_sharer;
+    int i;
+    for (i = 0; i < u->u_nin; i++)
+        if (!--u->u_in[i].i_signal->s_refcount)
+            signal_makereusable(u->u_in[i].i_signal);
+    for (i = 0; i < u->u_nout; i++)
+        u->u_out[i].o_signal = sharer->u_out[i].o_signal;
+}
+
+    /* how many readers the outputs of a ugenbox's group have besides its own */
+static int ugen_sharedconnects(t_dspcontext *dc, t_ugenbox *u, int outno)
+{
+    t_ugenbox *u2;
+    int n = 0;
+    for (u2 = dc->dc_ugenlist; u2; u2 = u2->u_next)
+        if (u2 != u && u2->u_share == u->u_share)
+            n += u2->u_out[outno].o_nconnect;
+    return (n);
+}
+
+    /* put a ugenbox's code on the chain and make its output signals. */
+static void ugen_schedule(t_dspcontext *dc, t_ugenbox *u)
 {
     t_sigoutlet *uout;
     t_siginlet *uin;
-    t_sigoutconnect *oc;
     t_class *class = pd_class(&u->u_obj->ob_pd);
-    int i, n;
+    int i, defer = 0;
         /* suppress creating new signals for the outputs of signal
         inlets and subpatchs; except in the case we're an inlet and "blocking"
         is set.  We don't yet know if a subcanvas will be "blocking" so there
         we delay new signal creation, which will be handled by calling
-        signal_setborrowed in the ugen_done_graph routine below. */
+        signal_setborrowed in the ugen_done_graph routine below.  Classes
+        flagged CLASS_DSPBORROWS always borrow their outputs. */
     int nonewsigs = (class == canvas_class ||
-        ((class == vinlet_class) && !(dc->dc_reblock)));
+        ((class == vinlet_class) && !(dc->dc_reblock)) ||
+            (class_getdspflags(class) & CLASS_DSPBORROWS));
         /* when we encounter a subcanvas or a signal outlet, suppress freeing
         the input signals as they may be "borrowed" for the super or sub
-        patch; same exception as above, but also if we're "switched" we
-        have to do a copy rather than a borrow.  */
+        patch; same exception as above, but also if we're "switched" and
+        the input is itself borrowed we have to do a copy rather than a
+        borrow (see voutlet_dsp()).  */
     int nofreesigs = (class == canvas_class || class == clone_class ||
-        ((class == voutlet_class) &&  !(dc->dc_reblock || dc->dc_switched)));
-    t_signal **insig, **outsig, **sig, *s1, *s2, *s3;
-    t_ugenbox *u2;
+        ((class == voutlet_class) && !dc->dc_reblock && !(dc->dc_switched &&
+            u->u_nin && u->u_in[0].i_signal &&
+                u->u_in[0].i_signal->s_isborrowed)));
+    t_signal **insig, **outsig, **sig, *s3;
+    t_dspowner *was = THIS->u_curowner;
 
+    if (u->u_share && u->u_share->u_sharer)
+    {
+        ugen_scheduleshared(u);
+        return;
+    }
+    if (u->u_share)
+        u->u_share->u_sharer = u;
     if (THIS->u_loud) post("doit %s %d %d", class_getname(class), nofreesigs,
         nonewsigs);
+    THIS->u_curowner = dsp_newowner(u->u_obj, dc->dc_canvas);
     for (i = 0, uin = u->u_in; i < u->u_nin; i++, uin++)
     {
         if (!uin->i_nconnect)
@@ -773,7 +2922,12 @@ static void ugen_doit(t_dspcontext *dc, t_ugenbox *u)
             s3 = signal_new(dc->dc_calcsize, dc->dc_srate);
             /* post("%s: unconnected signal inlet set to zero",
                 class_getname(u->u_obj->ob_pd)); */
-            if ((scalar = obj_findsignalscalar(u->u_obj, i)))
+                /* classes that can read the float directly are left to */
+                /* do so (see CLASS_SCALARIN in m_pd.h); no copy is made */
+            if ((scalar = obj_findsignalscalar(u->u_obj, i)) &&
+                (class_getdspflags(class) & CLASS_SCALARIN))
+                    s3->s_scalar = scalar;
+            else if (scalar)
                 dsp_add_scalarcopy(scalar, s3->s_vec, s3->s_n);
             else
                 dsp_add_zero(s3->s_vec, s3->s_n);
@@ -783,17 +2937,41 @@ static void ugen_doit(t_dspcontext *dc, t_ugenbox *u)
     }
     insig = (t_signal **)getbytes((u->u_nin + u->u_nout) * sizeof(t_signal *));
     outsig = insig + u->u_nin;
-    for (sig = insig, uin = u->u_in, i = u->u_nin; i--; sig++, uin++)
+    for (sig = insig, uin = u->u_in, i = u->u_nin; i--; sig++)
+        *sig = (uin++)->i_signal;
+        /* inside a parallel section, objects that touch shared state are
+        scheduled after the section if possible.  Their inputs are then held
+        the same way subcanvases hold theirs, and released afterward. */
+    if (THIS->u_building && (class_getdspflags(class) & CLASS_NOPARALLEL))
+        defer = ugen_parallel_defer(dc, u->u_obj, u->u_nin, u->u_nout, insig);
+        /* inside an automatic switch~, measure whatever leaves the
+        subcanvas.  The contents of nested subcanvases and clones measure
+        their own. */
+    if (dc->dc_autoblock && (class == voutlet_class ||
+        (!u->u_nout && class != canvas_class && class != clone_class)))
+            for (i = 0; i < u->u_nin; i++)
+                dsp_add(block_peak, 3, dc->dc_autoblock, insig[i]->s_vec,
+                    (t_int)(insig[i]->s_n * insig[i]->s_nchans));
+    THIS->u_pwinput = 0;
+    for (sig = insig, i = u->u_nin; i--; sig++)
     {
-        int newrefcount;
-        *sig = uin->i_signal;
-        newrefcount = --(*sig)->s_refcount;
+        int newrefcount = --(*sig)->s_refcount;
+            /* note if our first input isn't used by anyone else, in which
+            case we may be able to fuse with whoever computed it */
+        if (sig == insig && !newrefcount && !nofreesigs && !defer &&
+            !(*sig)->s_isborrowed)
+                THIS->u_pwinput = (*sig)->s_vec;
             /* if the reference count went to zero, we free the signal now,
             unless it's a subcanvas or outlet; these might keep the
             signal around to send to objects connected to them.  In this
             case we increment the reference count; the corresponding decrement
             is in sig_makereusable(). */
-        if (nofreesigs)
+        if (nofreesigs || defer)
+            (*sig)->s_refcount++;
+            /* an unfilled scalar input is held until the "dsp" method has
+            seen it; otherwise it might be handed back as an output, which
+            would clear s_scalar */
+        else if ((*sig)->s_scalar)
             (*sig)->s_refcount++;
         else if (!newrefcount)
             signal_makereusable(*sig);
@@ -815,79 +2993,367 @@ static void ugen_doit(t_dspcontext *dc, t_ugenbox *u)
         else
             *sig = uout->o_signal = signal_new(dc->dc_calcsize, dc->dc_srate);
         (*sig)->s_refcount = uout->o_nconnect;
+            /* the rest of our group reads our outputs too */
+        if (u->u_share)
+            (*sig)->s_refcount += ugen_sharedconnects(dc, u, u->u_nout - 1 - i);
     }
         /* now call the DSP scheduling routine for the ugen.  This
         routine must fill in "borrowed" signal outputs in case it's either
         a subcanvas or a signal inlet. */
-    mess1(&u->u_obj->ob_pd, gensym("dsp"), insig);
+    if (!defer)
+    {
+        mess1(&u->u_obj->ob_pd, gensym("dsp"), insig);
+        THIS->u_pwinput = 0;
+        if (THIS->u_pw.p_open)
+        {
+            THIS->u_pw.p_end = THIS->u_dspchainsize - 1;
+            THIS->u_pw.p_open = 0;
+        }
+    }
 
         /* if any output signals aren't connected to anyone, free them
         now; otherwise they'll either get freed when the reference count
-        goes back to zero, or even later as explained above. */
+        goes back to zero, or even later as explained above.  The "dsp"
+        method may have replaced some with multichannel ones. */
 
     for (sig = outsig, uout = u->u_out, i = u->u_nout; i--; sig++, uout++)
     {
+        uout->o_signal = *sig;
         if (!(*sig)->s_refcount)
             signal_makereusable(*sig);
     }
+    if (!nofreesigs && !defer)
+        for (sig = insig, i = u->u_nin; i--; sig++)
+            if ((*sig)->s_scalar && !--(*sig)->s_refcount)
+                signal_makereusable(*sig);
     if (THIS->u_loud)
     {
         if (u->u_nin + u->u_nout == 0) post("put %s %d",
             class_getname(u->u_obj->ob_pd), ugen_index(dc, u));
         else if (u->u_nin + u->u_nout == 1) post("put %s %d (%lx)",
-            class_getname(u->u_obj->ob_pd), ugen_index(dc, u), sig[0]);
+            class_getname(u->u_obj->ob_pd), ugen_index(dc, u), insig[0]);
         else if (u->u_nin + u->u_nout == 2) post("put %s %d (%lx %lx)",
             class_getname(u->u_obj->ob_pd), ugen_index(dc, u),
-                sig[0], sig[1]);
+                insig[0], insig[1]);
         else post("put %s %d (%lx %lx %lx ...)",
             class_getname(u->u_obj->ob_pd), ugen_index(dc, u),
-                sig[0], sig[1], sig[2]);
+                insig[0], insig[1], insig[2]);
+    }
+    t_freebytes(insig,(u->u_nin + u->u_nout) * sizeof(t_signal *));
+    THIS->u_curowner = was;
+}
+
+    /* schedule a ugenbox, and work out how long a chain of objects leads to
+and through it.  A subcanvas counts as the longest chain inside it (which its
+own context reports back to us while we schedule it), and a clone as the
+longest in any of its copies. */
+static void ugen_place(t_dspcontext *dc, t_ugenbox *u)
+{
+    dc->dc_childwork = dc->dc_childpath = 0;
+    ugen_schedule(dc, u);
+    u->u_path += (dc->dc_childpath ? dc->dc_childpath : 1);
+    dc->dc_work += (dc->dc_childwork ? dc->dc_childwork : 1);
+    if (u->u_path > dc->dc_path)
+        dc->dc_path = u->u_path;
+}
+
+    /* pass one of a scheduled ugenbox's outputs on to one inlet.  Return 1
+    if that fills the last inlet of the ugenbox on the other end, 0 if not,
+    and -1 on failure. */
+static int ugen_pass(t_dspcontext *dc, t_ugenbox *u, t_sigoutlet *uout,
+    t_sigoutconnect *oc)
+{
+    t_siginlet *uin;
+    t_signal *s1 = uout->o_signal, *s2, *s3, *wide;
+    t_ugenbox *u2 = oc->oc_who;
+    int n, nsum;
+    uin = &u2->u_in[oc->oc_inno];
+    if (u->u_path > u2->u_path)
+        u2->u_path = u->u_path;
+        /* if there's already someone here, sum the two */
+    if ((s2 = uin->i_signal))
+    {
+        s1->s_refcount--;
+        s2->s_refcount--;
+        if (!signal_compatible(s1, s2))
+        {
+            pd_error(u->u_obj, "%s: incompatible signal inputs",
+                class_getname(u->u_obj->ob_pd));
+            return (-1);
+        }
+            /* if the two have different numbers of channels, the
+            sum has the larger number and the other one is added
+            into its first channels */
+        wide = (s2->s_nchans >= s1->s_nchans ? s2 : s1);
+        nsum = s1->s_n * (wide == s2 ? s1 : s2)->s_nchans;
+            /* if nobody else reads the signal already here, and it
+            has its own buffer, add into it instead of into a new one
+            (it's usually the sum of the connections before) */
+        if (!s2->s_refcount && !s2->s_isborrowed && wide == s2)
+        {
+            dsp_add_plus(s1->s_vec, s2->s_vec, s2->s_vec, nsum);
+            s2->s_refcount = 1;
+            if (!s1->s_refcount) signal_makereusable(s1);
+        }
+        else
+        {
+            s3 = signal_newlike(wide);
+            if (wide->s_n * wide->s_nchans > nsum)
+                dsp_add_copy(wide->s_vec + nsum, s3->s_vec + nsum,
+                    wide->s_n * wide->s_nchans - nsum);
+            dsp_add_plus(s1->s_vec, s2->s_vec, s3->s_vec, nsum);
+            uin->i_signal = s3;
+            s3->s_refcount = 1;
+            if (!s1->s_refcount) signal_makereusable(s1);
+            if (!s2->s_refcount) signal_makereusable(s2);
+        }
+    }
+    else uin->i_signal = s1;
+    uin->i_ngot++;
+        /* if we didn't fill this inlet don't bother yet */
+    if (uin->i_ngot < uin->i_nconnect)
+        return (0);
+        /* if there's more than one, check them all */
+    if (u2->u_nin > 1)
+    {
+        for (uin = u2->u_in, n = u2->u_nin; n--; uin++)
+            if (uin->i_ngot < uin->i_nconnect)
+                return (0);
+    }
+    return (1);
+}
+
+    /* a ugenbox on the sorting stack and how far we've got passing its
+    outputs on */
+typedef struct _sortframe
+{
+    t_ugenbox *f_ugen;
+    int f_outno;
+    t_sigoutconnect *f_oc;      /* next connection to pass on to */
+} t_sortframe;
+
+    /* pass an already scheduled ugenbox's outputs on, scheduling anyone
+    whose last inlet that fills and passing theirs on in turn before going
+    on to our next connection.  That's the order a recursive walk would take;
+    keeping the stack ourselves means a long serial chain can't overflow the
+    C stack.  The ugenboxes that get all their outputs passed on are marked
+    done. */
+static void ugen_sortfrom(t_dspcontext *dc, t_ugenbox *u)
+{
+    t_sortframe *f = dc->dc_sortstack;
+    t_sigoutconnect *oc;
+    int ready;
+    f->f_ugen = u;
+    f->f_outno = 0;
+    f->f_oc = (u->u_nout ? u->u_out[0].o_connections : 0);
+    while (f >= dc->dc_sortstack)
+    {
+        u = f->f_ugen;
+        while (!f->f_oc && ++f->f_outno < u->u_nout)
+            f->f_oc = u->u_out[f->f_outno].o_connections;
+        if (!(oc = f->f_oc))
+        {
+            u->u_done = 1;
+            f--;
+            continue;
+        }
+        f->f_oc = oc->oc_next;
+        if ((ready = ugen_pass(dc, u, &u->u_out[f->f_outno], oc)) < 0)
+            f--;        /* give up on this one; it stays undone */
+        else if (ready)
+        {
+            u = oc->oc_who;
+            ugen_place(dc, u);
+            f++;
+            f->f_ugen = u;
+            f->f_outno = 0;
+            f->f_oc = (u->u_nout ? u->u_out[0].o_connections : 0);
+        }
+    }
+}
+
+    /* put a ugenbox on the chain, and then any others this one uncovers */
+static void ugen_doit(t_dspcontext *dc, t_ugenbox *u)
+{
+    ugen_place(dc, u);
+    ugen_sortfrom(dc, u);
+}
+
+    /* in a root canvas, subpatches and clones that have no signal inputs
+    connected don't depend on anything else in the canvas, so we schedule
+    them first, each in its own segment of a parallel section. */
+static int ugen_isparallel(t_ugenbox *u)
+{
+    t_class *class = pd_class(&u->u_obj->ob_pd);
+    t_siginlet *uin;
+    int i;
+    if (class != canvas_class && class != clone_class)
+        return (0);
+    for (uin = u->u_in, i = u->u_nin; i--; uin++)
+        if (uin->i_nconnect)
+            return (0);
+    return (1);
+}
+
+static void ugen_doparallel(t_dspcontext *dc)
+{
+    t_ugenbox *u;
+    t_dspsection *x;
+    int n = 0;
+    for (u = dc->dc_ugenlist; u; u = u->u_next)
+        if (ugen_isparallel(u))
+            n++;
+    if (n < 2 || !(x = ugen_parallel_begin(sys_dspthreads)))
+        return;
+    for (u = dc->dc_ugenlist; u; u = u->u_next)
+        if (ugen_isparallel(u))
+    {
+        ugen_parallel_segment(x);
+        ugen_place(dc, u);
+    }
+    ugen_parallel_end(x);
+    for (u = dc->dc_ugenlist; u; u = u->u_next)
+        if (ugen_isparallel(u))
+    {
+        ugen_sortfrom(dc, u);
+        u->u_done = 1;
     }
+}
 
-        /* pass it on and trip anyone whose last inlet was filled */
-    for (uout = u->u_out, i = u->u_nout; i--; uout++)
+    /* With "-dsplocal" we start from the sources (ugenboxes with no signal
+inputs connected) in the order that a walk back from the outputs finds them,
+inlet by inlet, instead of in the order they were made.  Sources feeding the
+same object then get scheduled one after another, so that a signal is used
+soon after it's written rather than waiting in a buffer, likely out of the
+cache, while unrelated parts of the graph are done.  It also means fewer
+buffers in use at once ("peak signals in use" from "pd dspstatus").  From
+each source we go on depth first as always. */
+static void ugen_dolocal(t_dspcontext *dc, int nugen)
+{
+    t_ugenbox *u, **list, **pred, **sources;
+    t_sigoutlet *uout;
+    t_sigoutconnect *oc;
+    int *first, *npred, *inno, *stack, *next, i, j, k, n, npredtotal,
+        nsources = 0, depth, pass;
+    char *seen;
+    if (!nugen)
+        return;
+    list = (t_ugenbox **)getbytes(nugen * sizeof(*list));
+    first = (int *)getbytes(nugen * sizeof(*first));
+    npred = (int *)getbytes(nugen * sizeof(*npred));
+    stack = (int *)getbytes(nugen * sizeof(*stack));
+    next = (int *)getbytes(nugen * sizeof(*next));
+    seen = (char *)getbytes(nugen);
+    sources = (t_ugenbox **)getbytes(nugen * sizeof(*sources));
+    for (u = dc->dc_ugenlist, i = 0; u; u = u->u_next, i++)
+        list[i] = u, u->u_index = i;
+        /* collect everyone's predecessors, sorted by inlet */
+    for (i = npredtotal = 0; i < nugen; i++)
+        for (uout = list[i]->u_out, j = list[i]->u_nout; j--; uout++)
+            for (oc = uout->o_connections; oc; oc = oc->oc_next)
+                npred[oc->oc_who->u_index]++, npredtotal++;
+    for (i = n = 0; i < nugen; n += npred[i], npred[i++] = 0)
+        first[i] = n;
+    pred = (t_ugenbox **)getbytes((npredtotal ? npredtotal : 1) *
+        sizeof(*pred));
+    inno = (int *)getbytes((npredtotal ? npredtotal : 1) * sizeof(*inno));
+    for (i = 0; i < nugen; i++)
+        for (uout = list[i]->u_out, j = list[i]->u_nout; j--; uout++)
+            for (oc = uout->o_connections; oc; oc = oc->oc_next)
+    {
+        int w = oc->oc_who->u_index;
+        for (k = first[w] + npred[w]++; k > first[w] &&
+            inno[k-1] > oc->oc_inno; k--)
+                pred[k] = pred[k-1], inno[k] = inno[k-1];
+        pred[k] = list[i];
+        inno[k] = oc->oc_inno;
+    }
+        /* walk back from those whose outputs go nowhere, then from anyone
+        left over (in loops, say) */
+    for (pass = 0; pass < 2; pass++)
+        for (i = 0; i < nugen; i++)
     {
-        s1 = uout->o_signal;
-        for (oc = uout->o_connections; oc; oc = oc->oc_next)
+        if (seen[i])
+            continue;
+        if (!pass)
         {
-            u2 = oc->oc_who;
-            uin = &u2->u_in[oc->oc_inno];
-                /* if there's already someone here, sum the two */
-            if ((s2 = uin->i_signal))
+            for (uout = list[i]->u_out, j = list[i]->u_nout; j--; uout++)
+                if (uout->o_connections)
+                    break;
+            if (j >= 0)
+                continue;
+        }
+        seen[i] = 1;
+        stack[0] = i;
+        next[0] = 0;
+        depth = 1;
+        while (depth)
+        {
+            int v = stack[depth-1];
+            if (next[depth-1] < npred[v])
             {
-                s1->s_refcount--;
-                s2->s_refcount--;
-                if (!signal_compatible(s1, s2))
+                int w = pred[first[v] + next[depth-1]++]->u_index;
+                if (!seen[w])
                 {
-                    pd_error(u->u_obj, "%s: incompatible signal inputs",
-                        class_getname(u->u_obj->ob_pd));
-                    return;
+                    seen[w] = 1;
+                    stack[depth] = w;
+                    next[depth++] = 0;
                 }
-                s3 = signal_newlike(s1);
-                dsp_add_plus(s1->s_vec, s2->s_vec, s3->s_vec, s1->s_n);
-                uin->i_signal = s3;
-                s3->s_refcount = 1;
-                if (!s1->s_refcount) signal_makereusable(s1);
-                if (!s2->s_refcount) signal_makereusable(s2);
             }
-            else uin->i_signal = s1;
-            uin->i_ngot++;
-                /* if we didn't fill this inlet don't bother yet */
-            if (uin->i_ngot < uin->i_nconnect)
-                goto notyet;
-                /* if there's more than one, check them all */
-            if (u2->u_nin > 1)
+            else
             {
-                for (uin = u2->u_in, n = u2->u_nin; n--; uin++)
-                    if (uin->i_ngot < uin->i_nconnect) goto notyet;
+                if (!npred[v])
+                    sources[nsources++] = list[v];
+                depth--;
             }
-                /* so now we can schedule the ugen.  */
-            ugen_doit(dc, u2);
-        notyet: ;
         }
     }
-    t_freebytes(insig,(u->u_nin + u->u_nout) * sizeof(t_signal *));
-    u->u_done = 1;
+    for (i = 0; i < nsources; i++)
+        if (!sources[i]->u_done)
+            ugen_doit(dc, sources[i]);
+    freebytes(inno, (npredtotal ? npredtotal : 1) * sizeof(*inno));
+    freebytes(pred, (npredtotal ? npredtotal : 1) * sizeof(*pred));
+    freebytes(sources, nugen * sizeof(*sources));
+    freebytes(seen, nugen);
+    freebytes(next, nugen * sizeof(*next));
+    freebytes(stack, nugen * sizeof(*stack));
+    freebytes(npred, nugen * sizeof(*npred));
+    freebytes(first, nugen * sizeof(*first));
+    freebytes(list, nugen * sizeof(*list));
+}
+
+    /* tell an automatic switch~ which signal inputs to watch and how many
+    blocks its hold time is */
+static void block_setauto(t_block *x, t_dspcontext *dc)
+{
+    int i, n = 0;
+    t_float nblocks = x->x_autoholdms * 0.001 * dc->dc_srate /
+        (dc->dc_calcsize > 0 ? dc->dc_calcsize : 1);
+    x->x_autohold = (nblocks > 1 ? (int)(nblocks + 0.5) : 1);
+    if (x->x_autoin)
+    {
+        freebytes(x->x_autoin, x->x_nautoin * sizeof(*x->x_autoin));
+        freebytes(x->x_autoinsize, x->x_nautoin * sizeof(*x->x_autoinsize));
+    }
+    x->x_autoin = 0;
+    x->x_autoinsize = 0;
+    x->x_nautoin = 0;
+    if (dc->dc_iosigs)
+        for (i = 0; i < dc->dc_ninlets; i++)
+            if (dc->dc_iosigs[i]->s_vec)
+                n++;
+    if (n)
+    {
+        x->x_autoin = (t_sample **)getbytes(n * sizeof(*x->x_autoin));
+        x->x_autoinsize = (int *)getbytes(n * sizeof(*x->x_autoinsize));
+        for (i = 0; i < dc->dc_ninlets; i++)
+            if (dc->dc_iosigs[i]->s_vec)
+            {
+                t_signal *sig = dc->dc_iosigs[i];
+                x->x_autoin[x->x_nautoin] = sig->s_vec;
+                x->x_autoinsize[x->x_nautoin++] = sig->s_n * sig->s_nchans;
+            }
+    }
 }
 
     /* once the DSP graph is built, we call this routine to sort it.
@@ -901,7 +3367,7 @@ void ugen_done_graph(t_dspcontext *dc)
     t_sigoutlet *uout;
     t_siginlet *uin;
     t_sigoutconnect *oc, *oc2;
-    int i, n;
+    int i, n, nugen;
     t_block *blk;
     t_dspcontext *parent_context = dc->dc_parentcontext;
     t_float parent_srate;
@@ -913,6 +3379,10 @@ void ugen_done_graph(t_dspcontext *dc)
     int chainafterall;      /* and after signal outlet epilog */
     int reblock = 0, switched;
     int downsample = 1, upsample = 1;
+        /* code that the objects' "dsp" methods don't add belongs to the
+        canvas itself */
+    t_dspowner *was = THIS->u_curowner;
+    THIS->u_curowner = dsp_newowner(0, dc->dc_canvas);
     /* debugging printout */
 
     if (THIS->u_loud)
@@ -943,6 +3413,9 @@ void ugen_done_graph(t_dspcontext *dc)
         }
     }
 
+    if (blk && blk->x_precision >= 0)
+        dc->dc_double = blk->x_precision;
+
         /* figure out block size, calling frequency, sample rate */
     if (parent_context)
     {
@@ -982,8 +3455,9 @@ void ugen_done_graph(t_dspcontext *dc)
         blk->x_phase = THIS->u_phase & (period - 1);
         if (! parent_context || (realoverlap != 1) ||
             (vecsize != parent_vecsize) ||
-                (downsample != 1) || (upsample != 1))
-                    reblock = 1;
+                (downsample != 1) || (upsample != 1) ||
+                    blk->x_window != BLOCKWIN_NONE)
+                        reblock = 1;
         switched = blk->x_switched;
     }
     else
@@ -1002,14 +3476,21 @@ void ugen_done_graph(t_dspcontext *dc)
     dc->dc_srate = srate;
     dc->dc_vecsize = vecsize;
     dc->dc_calcsize = calcsize;
+    if (blk && blk->x_auto)
+    {
+        block_setauto(blk, dc);
+        dc->dc_autoblock = blk;
+    }
+    else dc->dc_autoblock =
+        (parent_context ? parent_context->dc_autoblock : 0);
 
-        /* if we're reblocking or switched, we now have to create output
-        signals to fill in for the "borrowed" ones we have now.  This
-        is also possibly true even if we're not blocked/switched, in
-        the case that there was a signal loop.  But we don't know this
-        yet.  */
+        /* if we're reblocking, we now have to create output signals to
+        fill in for the "borrowed" ones we have now.  This is also possibly
+        true even if we're not blocked, in the case that there was a signal
+        loop.  But we don't know this yet.  If we're only switched, the
+        outlets decide for themselves in voutlet_dsp(). */
 
-    if (dc->dc_iosigs && (switched || reblock))
+    if (dc->dc_iosigs && reblock)
     {
         t_signal **sigp;
         for (i = 0, sigp = dc->dc_iosigs + dc->dc_ninlets; i < dc->dc_noutlets;
@@ -1047,11 +3528,14 @@ void ugen_done_graph(t_dspcontext *dc)
         if (pd_class(zz) == vinlet_class)
             vinlet_dspprolog((struct _vinlet *)zz,
                 dc->dc_iosigs, vecsize, calcsize, THIS->u_phase, period, frequency,
-                    downsample, upsample, reblock, switched);
+                    downsample, upsample, (blk ? blk->x_quality : 0),
+                        reblock, switched,
+                            (blk ? block_getwindow(blk, vecsize, 1) : 0));
         else if (pd_class(zz) == voutlet_class)
             voutlet_dspprolog((struct _voutlet *)zz,
                 outsigs, vecsize, calcsize, THIS->u_phase, period, frequency,
-                    downsample, upsample, reblock, switched);
+                    downsample, upsample, reblock, switched,
+                        (blk ? block_getwindow(blk, vecsize, 2) : 0));
     }
     chainblockbegin = THIS->u_dspchainsize;
 
@@ -1061,17 +3545,26 @@ void ugen_done_graph(t_dspcontext *dc)
         blk->x_chainonset = THIS->u_dspchainsize - 1;
     }
         /* Initialize for sorting */
-    for (u = dc->dc_ugenlist; u; u = u->u_next)
+    for (u = dc->dc_ugenlist, nugen = 0; u; u = u->u_next, nugen++)
     {
         u->u_done = 0;
+        u->u_path = 0;
         for (uout = u->u_out, i = u->u_nout; i--; uout++)
             uout->o_nsent = 0;
         for (uin = u->u_in, i = u->u_nin; i--; uin++)
             uin->i_ngot = 0, uin->i_signal = 0;
    }
+    dc->dc_sortstack = (t_sortframe *)getbytes((nugen ? nugen : 1) *
+        sizeof(*dc->dc_sortstack));
+    dc->dc_work = dc->dc_path = 0;
+    ugen_findshared(dc);
 
         /* Do the sort */
 
+    if (!parent_context && sys_dspthreads > 1)
+        ugen_doparallel(dc);
+    if (sys_dsplocal)
+        ugen_dolocal(dc, nugen);
     for (u = dc->dc_ugenlist; u; u = u->u_next)
     {
             /* check that we have no connected signal inlets */
@@ -1111,6 +3604,24 @@ void ugen_done_graph(t_dspcontext *dc)
         break;   /* don't need to keep looking. */
     }
 
+    freebytes(dc->dc_sortstack,
+        (nugen ? nugen : 1) * sizeof(*dc->dc_sortstack));
+    dc->dc_sortstack = 0;
+        /* report the work and critical path to the context we're in, or, at
+        the top, to "dspstatus" */
+    if (parent_context)
+    {
+        parent_context->dc_childwork += dc->dc_work;
+        if (dc->dc_path > parent_context->dc_childpath)
+            parent_context->dc_childpath = dc->dc_path;
+    }
+    else if (!THIS->u_update)
+    {
+        THIS->u_work += dc->dc_work;
+        if (dc->dc_path > THIS->u_critpath)
+            THIS->u_critpath = dc->dc_path;
+    }
+
     if (blk && (reblock || switched))    /* add block DSP epilog */
         dsp_add(block_epilog, 1, blk);
     chainblockend = THIS->u_dspchainsize;
@@ -1126,7 +3637,8 @@ void ugen_done_graph(t_dspcontext *dc)
             if (iosigs) iosigs += dc->dc_ninlets;
             voutlet_dspepilog((struct _voutlet *)zz,
                 iosigs, vecsize, calcsize, THIS->u_phase, period, frequency,
-                    downsample, upsample, reblock, switched);
+                    downsample, upsample, (blk ? blk->x_quality : 0),
+                        reblock, switched);
         }
     }
 
@@ -1138,6 +3650,9 @@ void ugen_done_graph(t_dspcontext *dc)
         blk->x_reblock = reblock;
     }
 
+    if (dc->dc_canvas)
+        ugen_addrange(dc);
+
     if (THIS->u_loud)
     {
         t_int *ip;
@@ -1172,8 +3687,9 @@ void ugen_done_graph(t_dspcontext *dc)
     if (THIS->u_context == dc)
         THIS->u_context = dc->dc_parentcontext;
     else bug("THIS->u_context");
+    dsp_pointwisebreak();
     freebytes(dc, sizeof(*dc));
-
+    THIS->u_curowner = was;
 }
 
 static t_signal *ugen_getiosig(int index, int inout)
@@ -1229,6 +3745,8 @@ static void samplerate_tilde_setup(void)
 
 void d_ugen_setup(void)
 {
+    dsp_specialize(zero_perf8, 2, 64, zero_perf64);
+    dsp_specialize(zero_perf8, 2, 16, zero_perf16);
     block_tilde_setup();
     samplerate_tilde_setup();
 }
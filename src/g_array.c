@@ -8,9 +8,19 @@
 #include "m_pd.h"
 #include "g_canvas.h"
 #include <math.h>
+#if !defined(_WIN32) && !defined(__ANDROID__)
+#define ARRAY_SHM
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
 
 /* jsarlo { */
 #define ARRAYPAGESIZE 1000  /* this should match the page size in u_main.tk */
+#define GARRAY_REDRAWINTERVAL 40    /* min msec between DSP-driven redraws */
 /* } jsarlo */
 
 /* --------- "pure" arrays with scalars for elements. --------------- */
@@ -19,13 +29,15 @@
 They are instantiated by "garrays" below or can be elements of other
 scalars (g_scalar.c); their graphical behavior is defined accordingly. */
 
+static int array_nchanges;     /* last number given out for a_changes */
+
 t_array *array_new(t_symbol *templatesym, t_gpointer *parent)
 {
     t_array *x = (t_array *)getbytes(sizeof (*x));
     t_template *template;
     template = template_findbyname(templatesym);
     x->a_templatesym = templatesym;
-    x->a_n = 1;
+    x->a_n = x->a_nalloc = 1;
     x->a_elemsize = sizeof(t_word) * template->t_n;
     x->a_vec = (char *)getbytes(x->a_elemsize);
         /* note here we blithely copy a gpointer instead of "setting" a
@@ -34,6 +46,7 @@ t_array *array_new(t_symbol *templatesym, t_gpointer *parent)
         see array_free. */
     x->a_gp = *parent;
     x->a_stub = gstub_new(0, x);
+    x->a_changes = ++array_nchanges;
     word_init((t_word *)(x->a_vec), template, parent);
     return (x);
 }
@@ -42,20 +55,116 @@ t_array *array_new(t_symbol *templatesym, t_gpointer *parent)
 void garray_arrayviewlist_close(t_garray *x);
 /* } jsarlo */
 
+/* The storage of an array that DSP objects read or write (that is, of a
+garray after garray_usedindsp()) may still be in use by the DSP chain when
+the array is resized or deleted: the chain is rebuilt right after, but other
+DSP threads and helpers shouldn't have to worry about when exactly that
+happens.  So, rather than freeing or reallocating it in place, we copy
+it if necessary and "retire" the old block, which is then freed at the end of
+the next DSP tick (see dsp_tick()).  Nobody waits for anybody: a reader is
+only required to fetch the pointer afresh from one tick to the next.  Pd
+runs all this with the Pd lock held, so the list needs no further locking. */
+
+typedef struct _retiredvec
+{
+    void *r_vec;
+    size_t r_size;
+    int r_mapped;       /* true if r_vec is a shared mapping, see below */
+    struct _retiredvec *r_next;
+} t_retiredvec;
+
+    /* an array attached to shared memory (garray_attach()) keeps its
+    elements ARRAY_SHMHEAD bytes into the mapping */
+#define ARRAY_SHMHEAD 64
+
+static void array_dofreevec(void *vec, size_t nbytes, int mapped)
+{
+#ifdef ARRAY_SHM
+    if (mapped)
+        munmap((char *)vec - ARRAY_SHMHEAD, nbytes);
+    else
+#endif
+    freebytes(vec, nbytes);
+}
+
+    /* free storage that used to be an array's, or retire it as above.  If
+    the array was attached to shared memory the storage is the mapping; the
+    caller has to replace a_vec with ordinary storage before or right after
+    this. */
+void array_freevec(t_array *x, char *vec, size_t nbytes)
+{
+    t_retiredvec *r;
+    int mapped = (x->a_mapsize != 0);
+    if (mapped)
+        nbytes = x->a_mapsize, x->a_mapsize = 0;
+    if (!x->a_usedindsp || !(r = (t_retiredvec *)getbytes(sizeof(*r))))
+    {
+        array_dofreevec(vec, nbytes, mapped);
+        return;
+    }
+    r->r_vec = vec;
+    r->r_size = nbytes;
+    r->r_mapped = mapped;
+    r->r_next = THISGUI->i_retired;
+    THISGUI->i_retired = r;
+}
+
+    /* called at the end of each DSP tick to free what was retired before */
+void array_freeretired(void)
+{
+    t_retiredvec *r;
+    while ((r = THISGUI->i_retired))
+    {
+        THISGUI->i_retired = r->r_next;
+        array_dofreevec(r->r_vec, r->r_size, r->r_mapped);
+        freebytes(r, sizeof(*r));
+    }
+}
+
+    /* make room for at least n elements (of a_elemsize bytes) without
+    touching a_n or the elements themselves.  When growing by small steps we
+    allocate half again as much as asked for so that, e.g., arrays grown one
+    element at a time aren't copied each time; big jumps and shrinking by
+    more than half get exactly what they ask for.  Returns 0 if out of
+    memory, in which case nothing has changed. */
+int array_setalloc(t_array *x, int n)
+{
+    int nalloc = x->a_nalloc;
+    char *tmp;
+    if (n > nalloc)
+        nalloc = (n < nalloc + (nalloc >> 1) ? nalloc + (nalloc >> 1) : n);
+    else if (n < (nalloc >> 1))
+        nalloc = n;
+    else if (!x->a_mapsize)
+        return (1);
+        /* a shared mapping can't be resized, so copy out of it */
+    if (x->a_usedindsp || x->a_mapsize)
+    {
+        int ncopy = (x->a_n < nalloc ? x->a_n : nalloc);
+        if (!(tmp = (char *)getbytes((size_t)nalloc * x->a_elemsize)))
+            return (0);
+        memcpy(tmp, x->a_vec, (size_t)ncopy * x->a_elemsize);
+        array_freevec(x, x->a_vec, (size_t)x->a_nalloc * x->a_elemsize);
+    }
+    else if (!(tmp = (char *)resizebytes(x->a_vec,
+        (size_t)x->a_nalloc * x->a_elemsize, (size_t)nalloc * x->a_elemsize)))
+            return (0);
+    x->a_vec = tmp;
+    x->a_nalloc = nalloc;
+    return (1);
+}
+
 void array_resize(t_array *x, int n)
 {
     int elemsize, oldn;
-    char *tmp;
     t_template *template = template_findbyname(x->a_templatesym);
     if (n < 1)
         n = 1;
     oldn = x->a_n;
     elemsize = sizeof(t_word) * template->t_n;
 
-    tmp = (char *)resizebytes(x->a_vec, oldn * elemsize, n * elemsize);
-    if (!tmp)
+    if (!array_setalloc(x, n))
         return;
-    x->a_vec = tmp;
     x->a_n = n;
     if (n > oldn)
     {
@@ -67,7 +176,7 @@ void array_resize(t_array *x, int n)
             word_init(wp, template, &x->a_gp);
         }
     }
-    x->a_valid = ++glist_valid;
+    x->a_valid = glist_newvalid();
 }
 
 void array_resize_and_redraw(t_array *array, t_glist *glist, int n)
@@ -76,11 +185,14 @@ void array_resize_and_redraw(t_array *array, t_glist *glist, int n)
     int vis = glist_isvisible(glist);
     while (a2->a_gp.gp_stub->gs_which == GP_ARRAY)
         a2 = a2->a_gp.gp_stub->gs_un.gs_array;
+        /* erase now, while the old elements are there, but draw through
+        the GUI queue so that whatever else happens to the array before
+        the next GUI update (e.g., filling it in) costs no extra drawing */
     if (vis)
         gobj_vis(&a2->a_gp.gp_un.gp_scalar->sc_gobj, glist, 0);
     array_resize(array, n);
     if (vis)
-        gobj_vis(&a2->a_gp.gp_un.gp_scalar->sc_gobj, glist, 1);
+        scalar_redraw(a2->a_gp.gp_un.gp_scalar, glist);
 }
 
 void word_free(t_word *wp, t_template *template);
@@ -89,13 +201,14 @@ void array_free(t_array *x)
 {
     int i;
     t_template *scalartemplate = template_findbyname(x->a_templatesym);
+    array_freepeaks(x);
     gstub_cutoff(x->a_stub);
     for (i = 0; i < x->a_n; i++)
     {
         t_word *wp = (t_word *)(x->a_vec + x->a_elemsize * i);
         word_free(wp, scalartemplate);
     }
-    freebytes(x->a_vec, x->a_elemsize * x->a_n);
+    array_freevec(x, x->a_vec, x->a_elemsize * x->a_nalloc);
     freebytes(x, sizeof *x);
 }
 
@@ -114,8 +227,19 @@ struct _garray
     char x_saveit;          /* true if we should save this with parent */
     char x_listviewing;     /* true if list view window is open */
     char x_hidename;        /* don't print name above graph */
+    char x_savebinary;      /* save contents to the patch's sidecar file */
+    char x_redrawpending;   /* true if x_redrawclock is set */
+    t_symbol *x_sharename;  /* shared memory segment we made, if any */
+    struct _garray *x_nextshared;   /* next garray that has a segment */
+    int x_dirtyfrom;        /* range written by DSP since the last redraw */
+    int x_dirtyto;
+    double x_redrawtime;    /* logical time of the last ranged redraw */
+    t_clock *x_redrawclock; /* to throttle ranged redraws */
 };
 
+static void garray_redrawtick(t_garray *x);
+static void garray_unshare(t_garray *x);
+
 static t_pd *garray_arraytemplatecanvas;  /* written at setup w/ global lock */
 static const char garray_arraytemplatefile[] = "\
 canvas 0 0 458 153 10;\n\
@@ -164,12 +288,21 @@ static t_garray *graph_scalar(t_glist *gl, t_symbol *s, t_symbol *templatesym,
         return (0);
     x = (t_garray *)pd_new(garray_class);
     x->x_scalar = scalar_new(gl, templatesym);
+    if (x->x_scalar && garray_getarray(x))
+        garray_getarray(x)->a_cachepeaks = 1;
     x->x_name = s;
     x->x_realname = canvas_realizedollar(gl, s);
     pd_bind(&x->x_gobj.g_pd, x->x_realname);
     x->x_usedindsp = 0;
     x->x_saveit = saveit;
+    x->x_savebinary = 0;
+    x->x_sharename = 0;
     x->x_listviewing = 0;
+    x->x_redrawpending = 0;
+    x->x_dirtyfrom = 0x7fffffff;
+    x->x_dirtyto = 0;
+    x->x_redrawtime = clock_getsystimeafter(-GARRAY_REDRAWINTERVAL);
+    x->x_redrawclock = clock_new(x, (t_method)garray_redrawtick);
     glist_add(gl, &x->x_gobj);
     x->x_glist = gl;
     return (x);
@@ -314,6 +447,7 @@ t_garray *graph_array(t_glist *gl, t_symbol *s, t_symbol *templateargsym,
     saveit = ((flags & 1) != 0);
     x = graph_scalar(gl, s, templatesym, saveit);
     x->x_hidename = ((flags & 8) >> 3);
+    x->x_savebinary = ((flags & 16) != 0);
 
     if (n <= 0)
         n = 100;
@@ -333,7 +467,7 @@ t_garray *graph_array(t_glist *gl, t_symbol *s, t_symbol *templateargsym,
     pd_bind(&x->x_gobj.g_pd, asym);
 
     garray_redraw(x);
-    canvas_update_dsp();
+    canvas_update_alldsp();
     return (x);
 }
 
@@ -372,7 +506,7 @@ void garray_properties(t_garray *x)
         it.  There should be a systematic way of doing this. */
     sprintf(cmdbuf, "pdtk_array_dialog %%s %s %d %d 0\n",
             iemgui_dollar2raute(x->x_name)->s_name, a->a_n, x->x_saveit +
-            2 * filestyle);
+            2 * filestyle + 16 * x->x_savebinary);
     gfxstub_new(&x->x_gobj.g_pd, x, cmdbuf);
 }
 
@@ -410,7 +544,7 @@ void garray_arraydialog(t_garray *x, t_symbol *name, t_floatarg fsize,
         int wasused = x->x_usedindsp;
         glist_delete(x->x_glist, &x->x_gobj);
         if (wasused)
-            canvas_update_dsp();
+            canvas_update_alldsp();
     }
     else
     {
@@ -449,7 +583,7 @@ void garray_arraydialog(t_garray *x, t_symbol *name, t_floatarg fsize,
                 gobj_vis(&x->x_glist->gl_gobj, x->x_glist->gl_owner, 0);
                 gobj_vis(&x->x_glist->gl_gobj, x->x_glist->gl_owner, 1);
             }
-            canvas_update_dsp();
+            canvas_update_alldsp();
         }
         size = fsize;
         if (size < 1)
@@ -462,6 +596,7 @@ void garray_arraydialog(t_garray *x, t_symbol *name, t_floatarg fsize,
             x->x_scalar->sc_vec, (t_float)style, 0);
 
         garray_setsaveit(x, (saveit != 0));
+        x->x_savebinary = ((flags & 16) != 0);
         garray_redraw(x);
         canvas_dirty(x->x_glist, 1);
     }
@@ -557,6 +692,7 @@ static void garray_free(t_garray *x)
 {
     t_pd *x2;
         sys_unqueuegui(&x->x_gobj);
+    clock_free(x->x_redrawclock);
     /* jsarlo { */
     if (x->x_listviewing)
     {
@@ -569,12 +705,162 @@ static void garray_free(t_garray *x)
     while ((x2 = pd_findbyclass(gensym("#A"), garray_class)))
         pd_unbind(x2, gensym("#A"));
     pd_free(&x->x_scalar->sc_gobj.g_pd);
+    garray_unshare(x);
+        /* the storage is retired (see array_freevec()); make the DSP
+        objects that were using it let go before it's actually freed */
+    if (x->x_usedindsp)
+        canvas_update_alldsp();
 }
 
 /* ------------- code used by both array and plot widget functions ---- */
 
+/* When a big array is plotted, each horizontal pixel shows the minimum and
+maximum of all the elements that fall into it (see plot_vis()).  So that
+redrawing doesn't have to look at every element, we can keep the minimum and
+maximum of each block of PEAKBLOCK elements.  This is only done for the
+arrays of garrays, whose writers always call garray_redraw() afterward,
+which throws the cache away, or garray_redrawrange() or garray_dirtyrange(),
+which only mark the blocks they overlap to be recomputed next time.  DSP
+writers report every block they write that way, even when they don't want
+it redrawn yet, so the cache is never behind the array.  Resizing or moving the array or plotting
+another field is caught by checking a_n, a_vec, etc.  Each such report also
+sets a_changes to a new number (never used by any array before), so that
+others (such as "array random") can keep things they've computed from the
+contents until it moves. */
+
+#define PEAKBLOCK 64
+
+typedef struct _arraypeaks
+{
+    char *p_vec;        /* a_vec, a_n, etc., when we made it */
+    int p_n;
+    int p_elemsize;
+    int p_yonset;
+    int p_nblocks;
+    int p_dirtyfrom;    /* blocks to recompute before use */
+    int p_dirtyto;
+    t_float p_minmax[1];    /* min and max for each block (extends) */
+} t_arraypeaks;
+
+void array_freepeaks(t_array *x)
+{
+    x->a_changes = ++array_nchanges;
+    if (x->a_peaks)
+    {
+        freebytes(x->a_peaks, sizeof(t_arraypeaks) +
+            (2 * x->a_peaks->p_nblocks - 1) * sizeof(t_float));
+        x->a_peaks = 0;
+    }
+}
+
+static void array_dogetpeaks(t_array *x, int yonset, int from, int to,
+    t_float *minp, t_float *maxp)
+{
+    int elemsize = x->a_elemsize;
+    char *elem = x->a_vec + elemsize * from + yonset;
+    t_float min = *minp, max = *maxp;
+    for (; from < to; from++, elem += elemsize)
+    {
+        t_float f = *(t_float *)elem;
+        if (f < min)
+            min = f;
+        if (f > max)
+            max = f;
+    }
+    *minp = min;
+    *maxp = max;
+}
+
+static t_arraypeaks *array_makepeaks(t_array *x, int yonset)
+{
+    t_arraypeaks *p = x->a_peaks;
+    int i, nblocks = (x->a_n + PEAKBLOCK - 1) / PEAKBLOCK;
+    if (p && p->p_vec == x->a_vec && p->p_n == x->a_n &&
+        p->p_elemsize == x->a_elemsize && p->p_yonset == yonset)
+    {
+        for (i = p->p_dirtyfrom; i < p->p_dirtyto; i++)
+        {
+            int to = (i + 1) * PEAKBLOCK;
+            p->p_minmax[2*i] = 1e20;
+            p->p_minmax[2*i+1] = -1e20;
+            array_dogetpeaks(x, yonset, i * PEAKBLOCK,
+                (to < x->a_n ? to : x->a_n),
+                    &p->p_minmax[2*i], &p->p_minmax[2*i+1]);
+        }
+        p->p_dirtyfrom = nblocks;
+        p->p_dirtyto = 0;
+        return (p);
+    }
+    array_freepeaks(x);
+    if (!(p = (t_arraypeaks *)getbytes(sizeof(t_arraypeaks) +
+        (2 * nblocks - 1) * sizeof(t_float))))
+            return (0);
+    p->p_vec = x->a_vec;
+    p->p_n = x->a_n;
+    p->p_elemsize = x->a_elemsize;
+    p->p_yonset = yonset;
+    p->p_nblocks = nblocks;
+    p->p_dirtyfrom = nblocks;
+    p->p_dirtyto = 0;
+    for (i = 0; i < nblocks; i++)
+    {
+        int to = (i + 1) * PEAKBLOCK;
+        p->p_minmax[2*i] = 1e20;
+        p->p_minmax[2*i+1] = -1e20;
+        array_dogetpeaks(x, yonset, i * PEAKBLOCK, (to < x->a_n ? to : x->a_n),
+            &p->p_minmax[2*i], &p->p_minmax[2*i+1]);
+    }
+    x->a_peaks = p;
+    return (p);
+}
+
+    /* mark elements "from" to "to" (not included) as changed, so that only
+    the blocks they fall in are rescanned. */
+static void array_dirtypeaks(t_array *x, int from, int to)
+{
+    t_arraypeaks *p = x->a_peaks;
+    int firstblock = from / PEAKBLOCK,
+        lastblock = (to + PEAKBLOCK - 1) / PEAKBLOCK;
+    x->a_changes = ++array_nchanges;
+    if (!p || p->p_vec != x->a_vec || p->p_n != x->a_n)
+        return;
+    if (lastblock > p->p_nblocks)
+        lastblock = p->p_nblocks;
+    if (firstblock < p->p_dirtyfrom)
+        p->p_dirtyfrom = firstblock;
+    if (lastblock > p->p_dirtyto)
+        p->p_dirtyto = lastblock;
+}
+
+    /* get the minimum and maximum of the float field at "yonset" over
+    elements "from" to "to" (not included). */
+void array_getpeaks(t_array *x, int yonset, int from, int to,
+    t_float *minp, t_float *maxp)
+{
+    t_arraypeaks *p;
+    *minp = 1e20;
+    *maxp = -1e20;
+    if (to - from >= 2 * PEAKBLOCK && x->a_cachepeaks &&
+        (p = array_makepeaks(x, yonset)))
+    {
+        int firstblock = (from + PEAKBLOCK - 1) / PEAKBLOCK,
+            lastblock = to / PEAKBLOCK, i;
+        array_dogetpeaks(x, yonset, from, firstblock * PEAKBLOCK, minp, maxp);
+        for (i = firstblock; i < lastblock; i++)
+        {
+            if (p->p_minmax[2*i] < *minp)
+                *minp = p->p_minmax[2*i];
+            if (p->p_minmax[2*i+1] > *maxp)
+                *maxp = p->p_minmax[2*i+1];
+        }
+        array_dogetpeaks(x, yonset, lastblock * PEAKBLOCK, to, minp, maxp);
+    }
+    else array_dogetpeaks(x, yonset, from, to, minp, maxp);
+}
+
 void array_redraw(t_array *a, t_glist *glist)
 {
+    array_freepeaks(a);
     while (a->a_gp.gp_stub->gs_which == GP_ARRAY)
         a = a->a_gp.gp_stub->gs_un.gs_array;
     scalar_redraw(a->a_gp.gp_un.gp_scalar, glist);
@@ -700,12 +986,116 @@ static int garray_click(t_gobj *z, t_glist *glist,
 
 #define ARRAYWRITECHUNKSIZE 1000
 
+/* Arrays with the "save as binary" flag (16) don't write their contents into
+the patch as text; instead, when a patch is saved to a file, they're written
+as little-endian 32-bit floats into a "sidecar" file next to it, named after
+the patch with ".arrays" appended, and the patch gets a line
+
+    #A binread <sidecar> <onset> <n>;
+
+which reads them straight back into the array on loading.  All arrays in the
+patch (and its subpatches) share the one sidecar.  When there's no file being
+saved (copying, undo) or the sidecar can't be written we fall back to text. */
+
+static FILE *garray_sidecarfd;      /* open sidecar file if any */
+static int garray_sidecarstate;     /* 0 none, 1 not yet opened, 2 open */
+static long garray_sidecaronset;    /* points written so far */
+static char garray_sidecarname[MAXPDSTRING];
+static char garray_sidecarpath[MAXPDSTRING];
+
+    /* called from canvas_savetofile() around saving the patch; the file is
+    only created once an array wants it */
+void garray_sidecarbegin(t_symbol *filename, t_symbol *dir)
+{
+    garray_sidecarend();
+    snprintf(garray_sidecarname, MAXPDSTRING, "%s.arrays", filename->s_name);
+    snprintf(garray_sidecarpath, MAXPDSTRING, "%s/%s", dir->s_name,
+        garray_sidecarname);
+    garray_sidecaronset = 0;
+    garray_sidecarstate = 1;
+}
+
+void garray_sidecarend(void)
+{
+    if (garray_sidecarstate == 2 && fclose(garray_sidecarfd) != 0)
+        error("%s: write failed", garray_sidecarpath);
+    garray_sidecarfd = 0;
+    garray_sidecarstate = 0;
+}
+
+static void garray_putfloat32(unsigned char *p, t_float f)
+{
+    union
+    {
+        float f;
+        unsigned int u;
+    } w;
+    w.f = f;
+    p[0] = w.u & 0xff;
+    p[1] = (w.u >> 8) & 0xff;
+    p[2] = (w.u >> 16) & 0xff;
+    p[3] = (w.u >> 24) & 0xff;
+}
+
+static t_float garray_getfloat32(const unsigned char *p)
+{
+    union
+    {
+        float f;
+        unsigned int u;
+    } w;
+    w.u = p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+    return (w.f);
+}
+
+    /* write the contents to the sidecar; return 0 if we can't */
+static int garray_savecontentsbinary(t_garray *x, t_binbuf *b)
+{
+    t_array *array = garray_getarray(x);
+    unsigned char buf[4 * ARRAYWRITECHUNKSIZE];
+    int n = array->a_n, n2 = 0;
+    if (garray_sidecarstate == 1)
+    {
+        if (!(garray_sidecarfd = sys_fopen(garray_sidecarpath, "wb")))
+        {
+            error("%s: can't create; saving arrays as text",
+                garray_sidecarpath);
+            garray_sidecarstate = 0;
+            return (0);
+        }
+        garray_sidecarstate = 2;
+    }
+    if (garray_sidecarstate != 2)
+        return (0);
+    while (n2 < n)
+    {
+        int chunk = n - n2, i;
+        if (chunk > ARRAYWRITECHUNKSIZE)
+            chunk = ARRAYWRITECHUNKSIZE;
+        for (i = 0; i < chunk; i++)
+            garray_putfloat32(buf + 4 * i,
+                ((t_word *)(array->a_vec))[n2+i].w_float);
+        if (fwrite(buf, 4, chunk, garray_sidecarfd) != (size_t)chunk)
+        {
+            error("%s: write failed", garray_sidecarpath);
+            break;
+        }
+        n2 += chunk;
+    }
+    binbuf_addv(b, "sssii;", gensym("#A"), gensym("binread"),
+        gensym(garray_sidecarname), (int)garray_sidecaronset, n);
+    garray_sidecaronset += n;
+    return (1);
+}
+
 void garray_savecontentsto(t_garray *x, t_binbuf *b)
 {
     if (x->x_saveit)
     {
         t_array *array = garray_getarray(x);
         int n = array->a_n, n2 = 0;
+        if (x->x_savebinary && garray_savecontentsbinary(x, b))
+            return;
         if (n > 200000)
             post("warning: I'm saving an array with %d points!\n", n);
         while (n2 < n)
@@ -747,7 +1137,8 @@ static void garray_save(t_gobj *z, t_binbuf *b)
         (style == PLOTSTYLE_POLY ? 0 : style));
     binbuf_addv(b, "sssisi;", gensym("#X"), gensym("array"),
         x->x_name, array->a_n, &s_float,
-            x->x_saveit + 2 * filestyle + 8*x->x_hidename);
+            x->x_saveit + 2 * filestyle + 8*x->x_hidename +
+                16*x->x_savebinary);
     garray_savecontentsto(x, b);
 }
 
@@ -766,7 +1157,10 @@ const t_widgetbehavior garray_widgetbehavior =
 
 void garray_usedindsp(t_garray *x)
 {
+    t_array *a = garray_getarray(x);
     x->x_usedindsp = 1;
+    if (a)
+        a->a_usedindsp = 1;
 }
 
 static void garray_doredraw(t_gobj *client, t_glist *glist)
@@ -781,6 +1175,9 @@ static void garray_doredraw(t_gobj *client, t_glist *glist)
 
 void garray_redraw(t_garray *x)
 {
+    t_array *a = garray_getarray(x);
+    if (a)
+        array_freepeaks(a);
     if (glist_isvisible(x->x_glist))
         sys_queuegui(&x->x_gobj, x->x_glist, garray_doredraw);
     /* jsarlo { */
@@ -795,6 +1192,80 @@ void garray_redraw(t_garray *x)
     /* } jsarlo */
 }
 
+    /* send the range collected by garray_redrawrange() to the GUI.  The
+    trace is a single canvas item so it is drawn anew, but not if the range
+    lies outside the graph's bounds, and the peak cache is kept. */
+static void garray_redrawtick(t_garray *x)
+{
+    t_glist *gl = x->x_glist;
+    int from = x->x_dirtyfrom, to = x->x_dirtyto;
+    x->x_redrawpending = 0;
+    x->x_dirtyfrom = 0x7fffffff;
+    x->x_dirtyto = 0;
+    x->x_redrawtime = clock_getlogicaltime();
+    if (glist_isvisible(gl))
+    {
+        t_float lo = (gl->gl_x1 < gl->gl_x2 ? gl->gl_x1 : gl->gl_x2),
+            hi = (gl->gl_x1 < gl->gl_x2 ? gl->gl_x2 : gl->gl_x1);
+        if (!gl->gl_isgraph || (to > lo - 1 && from < hi + 1))
+            sys_queuegui(&x->x_gobj, gl, garray_doredraw);
+    }
+    else if (x->x_listviewing)
+        sys_vgui("pdtk_array_listview_fillpage %s\n",
+                 x->x_realname->s_name);
+}
+
+    /* tell the array that elements "from" to "to" (not included) have
+    changed without redrawing it, for writers that change it more often than
+    it should be redrawn.  Returns 0 if the range is empty. */
+static int garray_dodirtyrange(t_garray *x, int *fromp, int *top)
+{
+    t_array *a = garray_getarray(x);
+    int from = *fromp, to = *top;
+    if (!a)
+        return (0);
+    if (from < 0)
+        from = 0;
+    if (to > a->a_n)
+        to = a->a_n;
+    if (from >= to)
+        return (0);
+    array_dirtypeaks(a, from, to);
+    *fromp = from;
+    *top = to;
+    return (1);
+}
+
+void garray_dirtyrange(t_garray *x, int from, int to)
+{
+    garray_dodirtyrange(x, &from, &to);
+}
+
+    /* like garray_redraw(), for writers (typically DSP objects) that know
+    which elements they changed, from "from" to "to" (not included).  The
+    ranges are collected and sent at most every GARRAY_REDRAWINTERVAL msec
+    of logical time. */
+void garray_redrawrange(t_garray *x, int from, int to)
+{
+    double elapsed;
+    if (!garray_dodirtyrange(x, &from, &to))
+        return;
+    if (from < x->x_dirtyfrom)
+        x->x_dirtyfrom = from;
+    if (to > x->x_dirtyto)
+        x->x_dirtyto = to;
+    if (x->x_redrawpending)
+        return;
+    elapsed = clock_gettimesince(x->x_redrawtime);
+    if (elapsed >= GARRAY_REDRAWINTERVAL)
+        garray_redrawtick(x);
+    else
+    {
+        clock_delay(x->x_redrawclock, GARRAY_REDRAWINTERVAL - elapsed);
+        x->x_redrawpending = 1;
+    }
+}
+
    /* This functiopn gets the template of an array; if we can't figure
    out what template an array's elements belong to we're in grave trouble
    when it's time to free or resize it.  */
@@ -881,6 +1352,51 @@ static void garray_const(t_garray *x, t_floatarg g)
     garray_redraw(x);
 }
 
+    /* for big tables, garray_dofo() below gets one period by an inverse
+    FFT instead of summing the partials point by point.  The spectrum is
+    laid out as rifft~ wants it: real parts of bins 0 to n/2, then minus the
+    imaginary parts of bins n/2-1 down to 1; bins k and n-k both contribute,
+    so each partial goes in at half strength except at DC and Nyquist.
+    Partials at n/2 and beyond fold over just as sampling would fold them.
+    Returns 0 if we couldn't get an FFT plan. */
+#define GARRAY_FFTMIN 64
+
+static int garray_dofo_fft(t_array *array, int yonset, int elemsize,
+    int npoints, t_float dcval, int nsin, t_float *vsin, int sineflag)
+{
+    t_fftplan *plan = fftplan_new(npoints, 1);
+    t_sample *buf;
+    int i, j, nhalf = npoints >> 1;
+    if (!plan)
+        return (0);
+    buf = (t_sample *)getbytes(npoints * sizeof(t_sample));
+    buf[0] = dcval;
+        /* sines start at the first harmonic, cosines at DC */
+    for (j = 0; j < nsin; j++)
+    {
+        int k = (sineflag ? j + 1 : j) % npoints;
+        t_float a = vsin[j];
+        if (k > nhalf)
+            k = npoints - k, a = (sineflag ? -a : a);
+        if (k == 0 || k == nhalf)
+        {
+            if (!sineflag)
+                buf[k] += a;
+        }
+        else if (sineflag)
+            buf[npoints - k] += 0.5 * a;
+        else buf[k] += 0.5 * a;
+    }
+    fftplan_real(plan, buf, 1);
+        /* one guard point before the period and two after it */
+    for (i = 0; i < npoints + 3; i++)
+        *((t_float *)((array->a_vec + elemsize * i)) + yonset) =
+            buf[(i + npoints - 1) % npoints];
+    freebytes(buf, npoints * sizeof(t_sample));
+    fftplan_free(plan);
+    return (1);
+}
+
     /* sum of Fourier components; called from routines below */
 static void garray_dofo(t_garray *x, long npoints, t_float dcval,
     int nsin, t_float *vsin, int sineflag)
@@ -899,6 +1415,13 @@ static void garray_dofo(t_garray *x, long npoints, t_float dcval,
         post("%s: rounding to %d points", array->a_templatesym->s_name,
             (npoints = (1<<ilog2((int)npoints))));
     garray_resize_long(x, npoints + 3);
+    if (npoints >= GARRAY_FFTMIN &&
+        garray_dofo_fft(array, yonset, elemsize, (int)npoints, dcval,
+            nsin, vsin, sineflag))
+    {
+        garray_redraw(x);
+        return;
+    }
     phaseincr = 2. * 3.14159 / npoints;
     for (i = 0, phase = -phaseincr; i < array->a_n; i++, phase += phaseincr)
     {
@@ -1147,6 +1670,243 @@ static void garray_write(t_garray *x, t_symbol *filename)
 }
 
 
+    /* read points saved by garray_savecontentsbinary() */
+static void garray_binread(t_garray *x, t_symbol *filename, t_floatarg fonset,
+    t_floatarg fn)
+{
+    int filedesc, yonset, elemsize, n = fn, n2 = 0;
+    long onset = fonset;
+    FILE *fd;
+    char buf[MAXPDSTRING], *bufptr;
+    unsigned char fbuf[4 * ARRAYWRITECHUNKSIZE];
+    t_array *array = garray_getarray_floatonly(x, &yonset, &elemsize);
+    if (!array)
+    {
+        error("%s: needs floating-point 'y' field", x->x_realname->s_name);
+        return;
+    }
+    if (n > array->a_n)
+        n = array->a_n;
+    if ((filedesc = canvas_open(glist_getcanvas(x->x_glist),
+            filename->s_name, "", buf, &bufptr, MAXPDSTRING, 1)) < 0
+                || !(fd = fdopen(filedesc, "rb")))
+    {
+        error("%s: can't open", filename->s_name);
+        return;
+    }
+    if (onset < 0 || fseek(fd, 4 * onset, SEEK_SET) < 0)
+        n = 0;
+    while (n2 < n)
+    {
+        int chunk = n - n2, got, i;
+        if (chunk > ARRAYWRITECHUNKSIZE)
+            chunk = ARRAYWRITECHUNKSIZE;
+        got = fread(fbuf, 4, chunk, fd);
+        for (i = 0; i < got; i++)
+            *((t_float *)(array->a_vec + elemsize * (n2 + i)) + yonset) =
+                garray_getfloat32(fbuf + 4 * i);
+        n2 += got;
+        if (got < chunk)
+            break;
+    }
+    if (n2 < n)
+        error("%s: read %d of %d points for array %s", filename->s_name,
+            n2, n, x->x_realname->s_name);
+    fclose(fd);
+    garray_redraw(x);
+}
+
+/* Shared arrays.  "share <name>" copies a float array into a POSIX shared
+memory segment, and "attach <name>" points an array in this or any other Pd
+process on the machine (pd~ subprocesses included) at the segment, so that
+a big sample library is loaded and kept in memory only once.  The array
+sharing it still holds ordinary t_words, so tabread~ and its cousins don't
+know the difference.  The mapping is private: pages are shared until
+somebody writes to them, and a process that writes gets its own copy of the
+pages it touches, so nobody else's data changes.  Resizing the array copies
+it out into ordinary memory.  The segment goes away (for new attaches; the
+processes that have it keep it) when the array that shared it is deleted or
+shared again, or when Pd exits. */
+
+#ifdef ARRAY_SHM
+static t_garray *garray_sharedlist;  /* garrays with a segment to unlink */
+static int garray_atexit;            /* true once that's set up */
+
+typedef struct _arrayshmhead
+{
+    char h_magic[8];    /* "pdarray" */
+    int h_elemsize;     /* sizeof(t_word) in the process that made it */
+    int h_floatsize;    /* and sizeof(t_float) */
+    int h_n;            /* number of elements */
+} t_arrayshmhead;
+
+static int garray_shmname(t_symbol *s, char *buf)
+{
+    if (!*s->s_name || strchr(s->s_name, '/') ||
+        strlen(s->s_name) > 200)
+    {
+        pd_error(0, "%s: bad name for shared array", s->s_name);
+        return (0);
+    }
+    snprintf(buf, MAXPDSTRING, "/pd-%s", s->s_name);
+    return (1);
+}
+#endif
+
+static void garray_unshare(t_garray *x)
+{
+#ifdef ARRAY_SHM
+    char buf[MAXPDSTRING];
+    t_garray **xp;
+    if (!x->x_sharename)
+        return;
+    if (garray_shmname(x->x_sharename, buf))
+        shm_unlink(buf);
+    for (xp = &garray_sharedlist; *xp; xp = &(*xp)->x_nextshared)
+        if (*xp == x)
+    {
+        *xp = x->x_nextshared;
+        break;
+    }
+#endif
+    x->x_sharename = 0;
+}
+
+#ifdef ARRAY_SHM
+    /* Pd exits without deleting its patches, so unlink segments here */
+static void garray_unshareall(void)
+{
+    while (garray_sharedlist)
+        garray_unshare(garray_sharedlist);
+}
+#endif
+
+static void garray_attach(t_garray *x, t_symbol *s)
+{
+#ifdef ARRAY_SHM
+    char buf[MAXPDSTRING], *base;
+    t_arrayshmhead head;
+    t_array *array;
+    struct stat st;
+    int fd, yonset, elemsize, vis;
+    size_t size;
+    if (!(array = garray_getarray_floatonly(x, &yonset, &elemsize)) ||
+        elemsize != sizeof(t_word))
+    {
+        pd_error(x, "%s: can only attach plain float arrays",
+            x->x_realname->s_name);
+        return;
+    }
+    if (!garray_shmname(s, buf))
+        return;
+    if ((fd = shm_open(buf, O_RDONLY, 0)) < 0)
+    {
+        pd_error(x, "%s: %s: %s", x->x_realname->s_name, s->s_name,
+            strerror(errno));
+        return;
+    }
+    if (fstat(fd, &st) < 0 || read(fd, &head, sizeof(head)) != sizeof(head)
+        || strcmp(head.h_magic, "pdarray") ||
+            head.h_elemsize != sizeof(t_word) ||
+                head.h_floatsize != sizeof(t_float) || head.h_n < 1 ||
+                (size = ARRAY_SHMHEAD + (size_t)head.h_n * sizeof(t_word))
+                    > (size_t)st.st_size)
+    {
+        pd_error(x, "%s: %s: not a shared array from this version of Pd",
+            x->x_realname->s_name, s->s_name);
+        close(fd);
+        return;
+    }
+    base = (char *)mmap(0, size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        pd_error(x, "%s: %s: %s", x->x_realname->s_name, s->s_name,
+            strerror(errno));
+        return;
+    }
+    garray_fittograph(x, head.h_n, template_getfloat(
+        template_findbyname(x->x_scalar->sc_template),
+            gensym("style"), x->x_scalar->sc_vec, 1));
+    if ((vis = glist_isvisible(x->x_glist)))
+        gobj_vis(&x->x_scalar->sc_gobj, x->x_glist, 0);
+        /* float arrays have nothing to word_free() */
+    array_freevec(array, array->a_vec,
+        (size_t)array->a_nalloc * array->a_elemsize);
+    array->a_vec = base + ARRAY_SHMHEAD;
+    array->a_n = array->a_nalloc = head.h_n;
+    array->a_mapsize = size;
+    array->a_valid = glist_newvalid();
+    if (vis)
+        scalar_redraw(x->x_scalar, x->x_glist);
+    if (x->x_usedindsp)
+        canvas_update_alldsp();
+#else
+    pd_error(x, "%s: shared arrays aren't available on this platform",
+        x->x_realname->s_name);
+#endif
+}
+
+static void garray_share(t_garray *x, t_symbol *s)
+{
+#ifdef ARRAY_SHM
+    char buf[MAXPDSTRING], *base;
+    t_arrayshmhead head;
+    t_array *array;
+    int fd, yonset, elemsize;
+    size_t size;
+    if (!(array = garray_getarray_floatonly(x, &yonset, &elemsize)) ||
+        elemsize != sizeof(t_word))
+    {
+        pd_error(x, "%s: can only share plain float arrays",
+            x->x_realname->s_name);
+        return;
+    }
+    if (!garray_shmname(s, buf))
+        return;
+    garray_unshare(x);
+        /* never truncate a segment others may have mapped (they'd crash);
+        unlink it and make a new one instead */
+    shm_unlink(buf);
+    size = ARRAY_SHMHEAD + (size_t)array->a_n * sizeof(t_word);
+    if ((fd = shm_open(buf, O_RDWR|O_CREAT|O_EXCL, 0644)) < 0)
+    {
+        pd_error(x, "%s: %s: %s", x->x_realname->s_name, s->s_name,
+            strerror(errno));
+        return;
+    }
+    if (ftruncate(fd, size) < 0 || (base = (char *)mmap(0, size,
+        PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        pd_error(x, "%s: %s: %s", x->x_realname->s_name, s->s_name,
+            strerror(errno));
+        close(fd);
+        shm_unlink(buf);
+        return;
+    }
+    close(fd);
+    memset(&head, 0, sizeof(head));
+    strcpy(head.h_magic, "pdarray");
+    head.h_elemsize = sizeof(t_word);
+    head.h_floatsize = sizeof(t_float);
+    head.h_n = array->a_n;
+    memcpy(base, &head, sizeof(head));
+    memcpy(base + ARRAY_SHMHEAD, array->a_vec,
+        (size_t)array->a_n * sizeof(t_word));
+    munmap(base, size);
+    if (!garray_atexit)
+        atexit(garray_unshareall), garray_atexit = 1;
+    x->x_sharename = s;
+    x->x_nextshared = garray_sharedlist;
+    garray_sharedlist = x;
+        /* and use the shared copy ourselves, too */
+    garray_attach(x, s);
+#else
+    pd_error(x, "%s: shared arrays aren't available on this platform",
+        x->x_realname->s_name);
+#endif
+}
+
     /* this should be renamed and moved... */
 int garray_ambigendian(void)
 {
@@ -1167,7 +1927,7 @@ void garray_resize_long(t_garray *x, long n)
             gensym("style"), x->x_scalar->sc_vec, 1));
     array_resize_and_redraw(array, x->x_glist, (int)n);
     if (x->x_usedindsp)
-        canvas_update_dsp();
+        canvas_update_alldsp();
 }
 
     /* float version to use as Pd method */
@@ -1212,6 +1972,12 @@ void g_array_setup(void)
         A_SYMBOL, A_NULL);
     class_addmethod(garray_class, (t_method)garray_write, gensym("write"),
         A_SYMBOL, A_NULL);
+    class_addmethod(garray_class, (t_method)garray_binread, gensym("binread"),
+        A_SYMBOL, A_FLOAT, A_FLOAT, A_NULL);
+    class_addmethod(garray_class, (t_method)garray_share, gensym("share"),
+        A_SYMBOL, A_NULL);
+    class_addmethod(garray_class, (t_method)garray_attach, gensym("attach"),
+        A_SYMBOL, A_NULL);
     class_addmethod(garray_class, (t_method)garray_resize, gensym("resize"),
         A_FLOAT, A_NULL);
     class_addmethod(garray_class, (t_method)garray_zoom, gensym("zoom"),
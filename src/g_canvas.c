@@ -29,10 +29,23 @@ struct _canvasenvironment
     t_atom *ce_argv;       /* array of "$" arguments */
     int ce_dollarzero;     /* value of "$0" */
     t_namelist *ce_path;   /* search path */
+    struct _openmemo *ce_openmemo;  /* files found by canvas_open() */
 };
+    /* an object not drawn because it was out of view (see canvas_cullmap) */
+typedef struct _culled
+{
+    t_gobj *c_obj;
+    int c_x1, c_y1, c_x2, c_y2;     /* where it was when we decided */
+} t_culled;
+
 typedef struct _canvas_private
 {
     t_undo undo;
+    t_culled *cull_vec;     /* objects not drawn yet, open addressing */
+    int cull_size;          /* a power of two, or 0 */
+    int cull_n;
+    int cull_haveview;      /* if the GUI has told us what's in view */
+    int cull_view[4];       /* the part of the canvas in view, in pixels */
 } t_canvas_private;
 
 #define GLIST_DEFCANVASWIDTH 450
@@ -57,6 +70,8 @@ t_canvas *canvas_whichfind;         /* last canvas we did a find in */
 static void canvas_start_dsp(void);
 static void canvas_stop_dsp(void);
 static void canvas_drawlines(t_canvas *x);
+static void canvas_cullmap(t_canvas *x);
+static void canvas_cullclear(t_canvas *x);
 static void canvas_dosetbounds(t_canvas *x, int x1, int y1, int x2, int y2);
 void canvas_reflecttitle(t_canvas *x);
 static void canvas_addtolist(t_canvas *x);
@@ -227,13 +242,128 @@ void canvas_rename(t_canvas *x, t_symbol *s, t_symbol *dir)
 
 /* --------------- traversing the set of lines in a canvas ----------- */
 
+/* Objects in a canvas are referred to by their position in gl_list (in
+saved patches, undo buffers and so on), and the editor asks for the position
+of each of a selection, or for the nth object, in loops.  To keep these from
+walking the list every time, we keep a table of the positions for one canvas
+at a time, rebuilt when gl_order says the list has changed since. */
+
+typedef struct _objindex
+{
+    t_canvas *o_canvas;
+    int o_order;                /* gl_order when built */
+    int o_n;
+    t_gobj **o_vec;             /* the objects in order, room for hashsize/2 */
+    int o_hashsize;             /* a power of two */
+    t_gobj **o_hashob;          /* the objects again, open addressing */
+    int *o_hashindex;           /* and their positions */
+} t_objindex;
+
+static PERTHREAD t_objindex *canvas_objindex;
+
+static void objindex_forget(t_canvas *x)
+{
+    t_objindex *o = canvas_objindex;
+    if (!o || (x && o->o_canvas != x))
+        return;
+    freebytes(o->o_vec, (o->o_hashsize / 2) * sizeof(*o->o_vec));
+    freebytes(o->o_hashob, o->o_hashsize * sizeof(*o->o_hashob));
+    freebytes(o->o_hashindex, o->o_hashsize * sizeof(*o->o_hashindex));
+    freebytes(o, sizeof(*o));
+    canvas_objindex = 0;
+}
+
+static int objindex_slot(const t_objindex *o, const t_gobj *y)
+{
+    int mask = o->o_hashsize - 1, i = ((size_t)y >> 4) & mask;
+    while (o->o_hashob[i] && o->o_hashob[i] != y)
+        i = (i + 1) & mask;
+    return (i);
+}
+
+static t_objindex *canvas_getobjindex(t_canvas *x)
+{
+    t_objindex *o = canvas_objindex;
+    t_gobj *y;
+    int n, i;
+    if (o && o->o_canvas == x && o->o_order == x->gl_order)
+        return (o);
+    objindex_forget(0);
+    for (n = 0, y = x->gl_list; y; y = y->g_next)
+        n++;
+    o = canvas_objindex = (t_objindex *)getbytes(sizeof(*o));
+    o->o_canvas = x;
+    o->o_order = x->gl_order;
+    o->o_n = n;
+        /* leave room for as many again to be added by glist_indexadd() */
+    for (o->o_hashsize = 16; o->o_hashsize < 4 * n; )
+        o->o_hashsize *= 2;
+    o->o_vec = (t_gobj **)getbytes((o->o_hashsize / 2) * sizeof(*o->o_vec));
+    o->o_hashob = (t_gobj **)getbytes(o->o_hashsize * sizeof(*o->o_hashob));
+    o->o_hashindex = (int *)getbytes(o->o_hashsize * sizeof(*o->o_hashindex));
+    for (i = 0, y = x->gl_list; y && i < n; y = y->g_next, i++)
+    {
+        int j = objindex_slot(o, y);
+        o->o_vec[i] = y;
+        o->o_hashob[j] = y;
+        o->o_hashindex[j] = i;
+    }
+    return (o);
+}
+
+    /* called from glist_add() after appending "y" and bumping gl_order, so
+    that an index that was up to date stays so */
+void glist_indexadd(t_glist *x, t_gobj *y)
+{
+    t_objindex *o = canvas_objindex;
+    int j;
+    if (!o || o->o_canvas != x || o->o_order != x->gl_order - 1)
+        return;
+    if (2 * (o->o_n + 1) > o->o_hashsize)
+    {
+        objindex_forget(0);
+        return;
+    }
+    o->o_vec[o->o_n] = y;
+    j = objindex_slot(o, y);
+    o->o_hashob[j] = y;
+    o->o_hashindex[j] = o->o_n++;
+    o->o_order = x->gl_order;
+}
+
+    /* get the position of an object in the canvas.  If it isn't there (or
+    y is zero) this is the total number of objects. */
 int canvas_getindex(t_canvas *x, t_gobj *y)
 {
-    t_gobj *y2;
-    int indexno;
-    for (indexno = 0, y2 = x->gl_list; y2 && y2 != y; y2 = y2->g_next)
-        indexno++;
-    return (indexno);
+    t_objindex *o = canvas_getobjindex(x);
+    int i;
+    if (!y)
+        return (o->o_n);
+    i = objindex_slot(o, y);
+    return (o->o_hashob[i] ? o->o_hashindex[i] : o->o_n);
+}
+
+    /* get the nth object in the canvas, or zero if there aren't that many */
+t_gobj *glist_nth(t_glist *x, int n)
+{
+    t_objindex *o = canvas_getobjindex(x);
+    return (n >= 0 && n < o->o_n ? o->o_vec[n] : 0);
+}
+
+    /* the ends of a line from outlet "outno" of "nout" on a box from x11 to
+    x12, bottom y12, to inlet "inno" of "nin" on one from x21 to x22, top y21 */
+static void canvas_linecoords(t_canvas *x, int x11, int x12, int y12,
+    int outno, int nout, int x21, int x22, int y21, int inno, int nin,
+    int *lx1, int *ly1, int *lx2, int *ly2)
+{
+    int inplus = (nin == 1 ? 1 : nin - 1);
+    int outplus = (nout == 1 ? 1 : nout - 1);
+    int iow = IOWIDTH * x->gl_zoom;
+    int iom = IOMIDDLE * x->gl_zoom;
+    *lx1 = x11 + ((x12 - x11 - iow) * outno) / outplus + iom;
+    *ly1 = y12;
+    *lx2 = x21 + ((x22 - x21 - iow) * inno) / inplus + iom;
+    *ly2 = y21;
 }
 
 void linetraverser_start(t_linetraverser *t, t_canvas *x)
@@ -278,20 +408,12 @@ t_outconnect *linetraverser_next(t_linetraverser *t)
     if (!t->tr_nin) bug("drawline");
     if (glist_isvisible(t->tr_x))
     {
-        int inplus = (t->tr_nin == 1 ? 1 : t->tr_nin - 1);
-        int outplus = (t->tr_nout == 1 ? 1 : t->tr_nout - 1);
-        int iow = IOWIDTH * t->tr_x->gl_zoom;
-        int iom = IOMIDDLE * t->tr_x->gl_zoom;
         gobj_getrect(&t->tr_ob2->ob_g, t->tr_x,
             &t->tr_x21, &t->tr_y21, &t->tr_x22, &t->tr_y22);
-        t->tr_lx1 = t->tr_x11 +
-            ((t->tr_x12 - t->tr_x11 - iow) * t->tr_outno) /
-                outplus + iom;
-        t->tr_ly1 = t->tr_y12;
-        t->tr_lx2 = t->tr_x21 +
-            ((t->tr_x22 - t->tr_x21 - iow) * t->tr_inno)/inplus +
-                iom;
-        t->tr_ly2 = t->tr_y21;
+        canvas_linecoords(t->tr_x, t->tr_x11, t->tr_x12, t->tr_y12,
+            t->tr_outno, t->tr_nout, t->tr_x21, t->tr_x22, t->tr_y21,
+                t->tr_inno, t->tr_nin,
+                    &t->tr_lx1, &t->tr_ly1, &t->tr_lx2, &t->tr_ly2);
     }
     else
     {
@@ -311,12 +433,22 @@ void linetraverser_skipobject(t_linetraverser *t)
 /* -------------------- the canvas object -------------------------- */
 int glist_valid = 10000;
 
+    /* all Pd instances share the count, so bump it atomically */
+int glist_newvalid(void)
+{
+#ifdef __GNUC__
+    return (__atomic_add_fetch(&glist_valid, 1, __ATOMIC_RELAXED));
+#else
+    return (++glist_valid);
+#endif
+}
+
 void glist_init(t_glist *x)
 {
         /* zero out everyone except "pd" field */
     memset(((char *)x) + sizeof(x->gl_pd), 0, sizeof(*x) - sizeof(x->gl_pd));
     x->gl_stub = gstub_new(x, 0);
-    x->gl_valid = ++glist_valid;
+    x->gl_valid = glist_newvalid();
     x->gl_xlabel = (t_symbol **)t_getbytes(0);
     x->gl_ylabel = (t_symbol **)t_getbytes(0);
     x->gl_privatedata = getbytes(sizeof(t_canvas_private));
@@ -370,6 +502,7 @@ t_canvas *canvas_new(void *dummy, t_symbol *sel, int argc, t_atom *argv)
         env->ce_argv = THISGUI->i_newargv;
         env->ce_dollarzero = THISGUI->i_dollarzero++;
         env->ce_path = 0;
+        env->ce_openmemo = 0;
         THISGUI->i_newdirectory = &s_;
         THISGUI->i_newargc = 0;
         THISGUI->i_newargv = 0;
@@ -520,7 +653,8 @@ void glist_glist(t_glist *g, t_symbol *s, int argc, t_atom *argv)
     t_float px2 = atom_getfloatarg(7, argc, argv);
     t_float py2 = atom_getfloatarg(8, argc, argv);
     glist_addglist(g, sym, x1, y1, x2, y2, px1, py1, px2, py2);
-    if (!canvas_undo_get(glist_getcanvas(g))->u_doing)
+    if (!canvas_undo_get(glist_getcanvas(g))->u_doing &&
+        !canvas_isbatching(g))
         canvas_undo_add(glist_getcanvas(g), UNDO_CREATE, "create",
             (void *)canvas_undo_set_create(glist_getcanvas(g)));
 }
@@ -667,7 +801,6 @@ void canvas_drawredrect(t_canvas *x, int doit)
 void canvas_map(t_canvas *x, t_floatarg f)
 {
     int flag = (f != 0);
-    t_gobj *y;
     if (flag)
     {
         if (!glist_isvisible(x))
@@ -678,8 +811,7 @@ void canvas_map(t_canvas *x, t_floatarg f)
                 bug("canvas_map");
                 canvas_vis(x, 1);
             }
-            for (y = x->gl_list; y; y = y->g_next)
-                gobj_vis(y, x, 1);
+            canvas_cullmap(x);
             x->gl_mapped = 1;
             for (sel = x->gl_editor->e_selection; sel; sel = sel->sel_next)
                 gobj_select(sel->sel_what, x, 1);
@@ -700,6 +832,7 @@ void canvas_map(t_canvas *x, t_floatarg f)
             }
                 /* just clear out the whole canvas */
             sys_vgui(".x%lx.c delete all\n", x);
+            canvas_cullclear(x);
             x->gl_mapped = 0;
         }
     }
@@ -741,7 +874,8 @@ void glist_menu_open(t_glist *x)
 
 int glist_isvisible(t_glist *x)
 {
-    return ((!x->gl_loading) && glist_getcanvas(x)->gl_mapped);
+    return ((!x->gl_loading) && glist_getcanvas(x)->gl_mapped &&
+        !canvas_isbatching(x));
 }
 
 int glist_istoplevel(t_glist *x)
@@ -778,11 +912,20 @@ int glist_fontheight(t_glist *x)
     return (sys_zoomfontheight(glist_getfont(x), glist_getzoom(x), 0));
 }
 
+static void canvas_openmemo_free(t_canvasenvironment *e);
+static void lineindex_forget(t_canvas *x);
+static void canvas_dofinishbatch(t_canvas *x);
+void ugen_forgetcanvas(t_canvas *x);
+
 void canvas_free(t_canvas *x)
 {
     t_gobj *y;
     t_canvas_private*private = x->gl_privatedata;
-    int dspstate = canvas_suspend_dsp();
+        /* a subpatch is deleted from its owner, so (unless the owner goes
+        too) only the owner needs rescheduling */
+    t_glist *owner = x->gl_owner;
+    int dspstate = (owner ?
+        canvas_suspend_dspfor(owner) : canvas_suspend_dsp());
     canvas_noundo(x);
     if (canvas_whichfind == x)
         canvas_whichfind = 0;
@@ -797,12 +940,24 @@ void canvas_free(t_canvas *x)
 
     if (x->gl_env)
     {
+        canvas_openmemo_free(x->gl_env);
         freebytes(x->gl_env->ce_argv, x->gl_env->ce_argc * sizeof(t_atom));
         freebytes(x->gl_env, sizeof(*x->gl_env));
     }
     canvas_undo_free(x);
+    objindex_forget(x);
+    lineindex_forget(x);
+    if (x->gl_batch)
+    {
+        x->gl_batch = 0;
+        canvas_dofinishbatch(x);
+    }
+    canvas_cullclear(x);
     freebytes(private, sizeof(*private));
-    canvas_resume_dsp(dspstate);
+    ugen_forgetcanvas(x);
+    if (owner)
+        canvas_resume_dspfor(owner, dspstate);
+    else canvas_resume_dsp(dspstate);
     freebytes(x->gl_xlabel, x->gl_nxlabels * sizeof(*(x->gl_xlabel)));
     freebytes(x->gl_ylabel, x->gl_nylabels * sizeof(*(x->gl_ylabel)));
     gstub_cutoff(x->gl_stub);
@@ -813,10 +968,15 @@ void canvas_free(t_canvas *x)
 
 /* ----------------- lines ---------- */
 
+static void canvas_culldrawlines(t_canvas *x);
+
 static void canvas_drawlines(t_canvas *x)
 {
     t_linetraverser t;
     t_outconnect *oc;
+    if (((t_canvas_private *)x->gl_privatedata)->cull_n)
+        canvas_culldrawlines(x);
+    else
     {
         linetraverser_start(&t, x);
         while ((oc = linetraverser_next(&t)))
@@ -829,63 +989,655 @@ static void canvas_drawlines(t_canvas *x)
     }
 }
 
-void canvas_fixlinesfor(t_canvas *x, t_text *text)
+/* An index of the lines in a canvas by the objects at either end, so that
+canvas_fixlinesfor() and friends, which are called for every selected object
+on every mouse motion while dragging, needn't look at every line in the
+canvas.  It's kept for one canvas at a time (the one being edited, in
+practice).  obj_connect() and obj_disconnect() tell us about each line made
+or broken and we add or remove it in place.  We only start over if an inlet
+or outlet of an object with lines is freed or moved (which renumbers them),
+or if we can't tell whether a new line is ours. */
+
+typedef struct _lineentry
+{
+    t_object *e_from;
+    t_outlet *e_outlet;
+    int e_outno;
+    t_object *e_to;
+    t_inlet *e_inlet;
+    int e_inno;
+    t_outconnect *e_oc;
+    int e_nextfrom;             /* next line from the same object, or -1 */
+    int e_nextto;               /* next line to the same object, or -1 */
+} t_lineentry;
+
+typedef struct _lineindex
+{
+    t_canvas *l_canvas;
+    int l_nline;
+    int l_maxline;              /* room in l_lines */
+    t_lineentry *l_lines;
+    int l_hashsize;             /* a power of two */
+    int l_nhash;                /* slots in use */
+    t_object **l_hashob;        /* objects with lines, open addressing */
+    int *l_hashfrom;            /* their first line out, or -1 */
+    int *l_hashto;              /* and first line in */
+} t_lineindex;
+
+static PERTHREAD t_lineindex *canvas_lineindex;
+
+static void lineindex_free(void)
+{
+    t_lineindex *l = canvas_lineindex;
+    if (!l)
+        return;
+    freebytes(l->l_lines, l->l_maxline * sizeof(*l->l_lines));
+    freebytes(l->l_hashob, l->l_hashsize * sizeof(*l->l_hashob));
+    freebytes(l->l_hashfrom, l->l_hashsize * sizeof(*l->l_hashfrom));
+    freebytes(l->l_hashto, l->l_hashsize * sizeof(*l->l_hashto));
+    freebytes(l, sizeof(*l));
+    canvas_lineindex = 0;
+}
+
+static void lineindex_forget(t_canvas *x)
 {
-    t_linetraverser t;
-    t_outconnect *oc;
-    
-    linetraverser_start(&t, x);
-    while ((oc = linetraverser_next(&t)))
+    if (canvas_lineindex && canvas_lineindex->l_canvas == x)
+        lineindex_free();
+}
+
+static int lineindex_slot(const t_lineindex *l, const t_object *ob)
+{
+    int mask = l->l_hashsize - 1, i = ((size_t)ob >> 4) & mask;
+    while (l->l_hashob[i] && l->l_hashob[i] != ob)
+        i = (i + 1) & mask;
+    return (i);
+}
+
+    /* make a new hash table with room for the objects that still have lines,
+    dropping those that don't (which may have been freed since) */
+static void lineindex_rehash(t_lineindex *l)
+{
+    t_object **hashob = l->l_hashob;
+    int *hashfrom = l->l_hashfrom, *hashto = l->l_hashto;
+    int oldsize = l->l_hashsize, n, i, j;
+    for (i = n = 0; i < oldsize; i++)
+        if (hashob[i] && (hashfrom[i] >= 0 || hashto[i] >= 0))
+            n++;
+    for (l->l_hashsize = 16; l->l_hashsize < 4 * (n + 1); )
+        l->l_hashsize *= 2;
+    l->l_hashob = (t_object **)getbytes(l->l_hashsize * sizeof(*l->l_hashob));
+    l->l_hashfrom = (int *)getbytes(l->l_hashsize * sizeof(*l->l_hashfrom));
+    l->l_hashto = (int *)getbytes(l->l_hashsize * sizeof(*l->l_hashto));
+    for (i = 0; i < l->l_hashsize; i++)
+        l->l_hashfrom[i] = l->l_hashto[i] = -1;
+    for (i = 0, l->l_nhash = 0; i < oldsize; i++)
+        if (hashob[i] && (hashfrom[i] >= 0 || hashto[i] >= 0))
+    {
+        j = lineindex_slot(l, hashob[i]);
+        l->l_hashob[j] = hashob[i];
+        l->l_hashfrom[j] = hashfrom[i];
+        l->l_hashto[j] = hashto[i];
+        l->l_nhash++;
+    }
+    if (oldsize)
     {
-        if (t.tr_ob == text || t.tr_ob2 == text)
+        freebytes(hashob, oldsize * sizeof(*hashob));
+        freebytes(hashfrom, oldsize * sizeof(*hashfrom));
+        freebytes(hashto, oldsize * sizeof(*hashto));
+    }
+}
+
+    /* find the slot for an object, adding it if it isn't there */
+static int lineindex_enter(t_lineindex *l, t_object *ob)
+{
+    int i = lineindex_slot(l, ob);
+    if (!l->l_hashob[i])
+    {
+        if (2 * (l->l_nhash + 1) > l->l_hashsize)
         {
-            sys_vgui(".x%lx.c coords l%lx %d %d %d %d\n",
-                glist_getcanvas(x), oc,
-                t.tr_lx1, t.tr_ly1, t.tr_lx2, t.tr_ly2);
+            lineindex_rehash(l);
+            i = lineindex_slot(l, ob);
         }
+        l->l_hashob[i] = ob;
+        l->l_nhash++;
     }
+    return (i);
 }
 
-    /* kill all lines for the object */
-void canvas_deletelinesfor(t_canvas *x, t_text *text)
+    /* does the object have lines in the index? */
+static int lineindex_has(const t_lineindex *l, const t_object *ob)
 {
-    t_linetraverser t;
-    t_outconnect *oc;
-    linetraverser_start(&t, x);
-    while ((oc = linetraverser_next(&t)))
+    int i = lineindex_slot(l, ob);
+    return (l->l_hashob[i] && (l->l_hashfrom[i] >= 0 || l->l_hashto[i] >= 0));
+}
+
+    /* put line "i" on the lists for the objects at its ends */
+static void lineindex_link(t_lineindex *l, int i)
+{
+    t_lineentry *e = &l->l_lines[i];
+    int j = lineindex_enter(l, e->e_from);
+    e->e_nextfrom = l->l_hashfrom[j];
+    l->l_hashfrom[j] = i;
+    j = lineindex_enter(l, e->e_to);
+    e->e_nextto = l->l_hashto[j];
+    l->l_hashto[j] = i;
+}
+
+    /* and take it off them again */
+static void lineindex_unlink(t_lineindex *l, int i)
+{
+    t_lineentry *e = &l->l_lines[i];
+    int *p;
+    for (p = &l->l_hashfrom[lineindex_slot(l, e->e_from)]; *p != i;
+        p = &l->l_lines[*p].e_nextfrom)
+            ;
+    *p = e->e_nextfrom;
+    for (p = &l->l_hashto[lineindex_slot(l, e->e_to)]; *p != i;
+        p = &l->l_lines[*p].e_nextto)
+            ;
+    *p = e->e_nextto;
+}
+
+static void lineindex_add(t_lineindex *l, t_object *from, t_outlet *outlet,
+    int outno, t_outconnect *oc)
+{
+    t_lineentry *e;
+    if (l->l_nline == l->l_maxline)
+    {
+        int newmax = (l->l_maxline ? 2 * l->l_maxline : 16);
+        l->l_lines = (t_lineentry *)resizebytes(l->l_lines,
+            l->l_maxline * sizeof(*l->l_lines), newmax * sizeof(*l->l_lines));
+        l->l_maxline = newmax;
+    }
+    e = &l->l_lines[l->l_nline];
+    e->e_from = from;
+    e->e_outlet = outlet;
+    e->e_outno = outno;
+    e->e_oc = oc;
+    obj_nexttraverseoutlet(oc, &e->e_to, &e->e_inlet, &e->e_inno);
+    lineindex_link(l, l->l_nline++);
+}
+
+    /* remove line "i", moving the last one into its place */
+static void lineindex_remove(t_lineindex *l, int i)
+{
+    int last = l->l_nline - 1;
+    lineindex_unlink(l, i);
+    if (i != last)
+    {
+        lineindex_unlink(l, last);
+        l->l_lines[i] = l->l_lines[last];
+        lineindex_link(l, i);
+    }
+    l->l_nline--;
+}
+
+static t_lineindex *canvas_getlineindex(t_canvas *x)
+{
+    t_lineindex *l = canvas_lineindex;
+    t_gobj *y;
+    if (l && l->l_canvas == x)
+        return (l);
+    lineindex_free();
+    l = canvas_lineindex = (t_lineindex *)getbytes(sizeof(*l));
+    l->l_canvas = x;
+    lineindex_rehash(l);
+    for (y = x->gl_list; y; y = y->g_next)
+    {
+        t_object *ob = pd_checkobject(&y->g_pd), *ob2;
+        t_outconnect *oc, *next;
+        t_outlet *outlet;
+        t_inlet *inlet;
+        int nout, outno, inno;
+        if (!ob)
+            continue;
+        for (outno = 0, nout = obj_noutlets(ob); outno < nout; outno++)
+            for (oc = obj_starttraverseoutlet(ob, &outlet, outno); oc;
+                oc = next)
+        {
+            next = obj_nexttraverseoutlet(oc, &ob2, &inlet, &inno);
+            lineindex_add(l, ob, outlet, outno, oc);
+        }
+    }
+    return (l);
+}
+
+    /* called from obj_connect() once the new connection is in place.  The
+    line is ours if either end already has lines here, or failing that if
+    the object index (which is usually for the same canvas) says so. */
+void canvas_lineconnected(t_object *source, int outno, t_outlet *outlet,
+    t_outconnect *oc)
+{
+    t_lineindex *l = canvas_lineindex;
+    t_objindex *o = canvas_objindex;
+    t_object *sink;
+    t_inlet *inlet;
+    int inno;
+    if (!l)
+        return;
+    obj_nexttraverseoutlet(oc, &sink, &inlet, &inno);
+    if (lineindex_has(l, source) || lineindex_has(l, sink))
+        lineindex_add(l, source, outlet, outno, oc);
+    else if (o && o->o_canvas == l->l_canvas &&
+        o->o_order == l->l_canvas->gl_order)
+    {
+        if (o->o_hashob[objindex_slot(o, &source->ob_g)])
+            lineindex_add(l, source, outlet, outno, oc);
+    }
+    else lineindex_free();
+}
+
+    /* called from obj_disconnect() before the connection is freed */
+void canvas_linedisconnected(t_object *source, t_outconnect *oc)
+{
+    t_lineindex *l = canvas_lineindex;
+    int i;
+    if (!l)
+        return;
+    for (i = l->l_hashfrom[lineindex_slot(l, source)]; i >= 0;
+        i = l->l_lines[i].e_nextfrom)
+            if (l->l_lines[i].e_oc == oc)
+    {
+        lineindex_remove(l, i);
+        return;
+    }
+}
+
+    /* called when an inlet or outlet is freed or moved */
+void canvas_linesrenumbered(t_object *ob)
+{
+    t_lineindex *l = canvas_lineindex;
+    if (l && lineindex_has(l, ob))
+        lineindex_free();
+}
+
+    /* step through the lines to and from an object: start with i = -1 and
+    feed back what we return until that's -1 again.  Lines from the object
+    to itself are on both its lists, so we skip them the second time. */
+static int lineindex_next(const t_lineindex *l, const t_object *ob, int i)
+{
+    int slot = lineindex_slot(l, ob);
+    if (i < 0)
+    {
+        if ((i = l->l_hashfrom[slot]) >= 0)
+            return (i);
+        i = l->l_hashto[slot];
+    }
+    else if (l->l_lines[i].e_from == ob)
+    {
+        if (l->l_lines[i].e_nextfrom >= 0)
+            return (l->l_lines[i].e_nextfrom);
+        i = l->l_hashto[slot];
+    }
+    else i = l->l_lines[i].e_nextto;
+    while (i >= 0 && l->l_lines[i].e_from == ob)
+        i = l->l_lines[i].e_nextto;
+    return (i);
+}
+
+void canvas_fixlinesfor(t_canvas *x, t_text *text)
+{
+    t_lineindex *l = canvas_getlineindex(x);
+    t_lineentry *e;
+    int i, x11, y11, x12, y12, x21, y21, x22, y22;
+    int lx1, ly1, lx2, ly2;
+    for (i = lineindex_next(l, text, -1); i >= 0;
+        i = lineindex_next(l, text, i))
     {
-        if (t.tr_ob == text || t.tr_ob2 == text)
+        e = &l->l_lines[i];
+        if (glist_isvisible(x))
+        {
+            gobj_getrect(&e->e_from->ob_g, x, &x11, &y11, &x12, &y12);
+            gobj_getrect(&e->e_to->ob_g, x, &x21, &y21, &x22, &y22);
+            canvas_linecoords(x, x11, x12, y12,
+                e->e_outno, obj_noutlets(e->e_from), x21, x22, y21,
+                    e->e_inno, obj_ninlets(e->e_to), &lx1, &ly1, &lx2, &ly2);
+        }
+        else lx1 = ly1 = lx2 = ly2 = 0;
+        sys_vgui(".x%lx.c coords l%lx %d %d %d %d\n",
+            glist_getcanvas(x), e->e_oc, lx1, ly1, lx2, ly2);
+    }
+}
+
+    /* kill the lines for an object, or only those for one of its inlets or
+    outlets if "inp" or "outp" is set.  We work from a copy of the list
+    since disconnecting changes the index under us. */
+static void canvas_dodeletelinesfor(t_canvas *x, t_text *text,
+    t_inlet *inp, t_outlet *outp, int all)
+{
+    t_lineindex *l = canvas_getlineindex(x);
+    t_lineentry *copy;
+    int n, i;
+    for (n = 0, i = lineindex_next(l, text, -1); i >= 0;
+        i = lineindex_next(l, text, i))
+            n++;
+    if (!n)
+        return;
+    copy = (t_lineentry *)getbytes(n * sizeof(*copy));
+    for (n = 0, i = lineindex_next(l, text, -1); i >= 0;
+        i = lineindex_next(l, text, i))
+            copy[n++] = l->l_lines[i];
+    for (i = 0; i < n; i++)
+    {
+        t_lineentry *e = &copy[i];
+        if (all || (e->e_from == text && e->e_outlet == outp) ||
+            (e->e_to == text && e->e_inlet == inp))
         {
             if (glist_isvisible(x))
             {
                 sys_vgui(".x%lx.c delete l%lx\n",
-                    glist_getcanvas(x), oc);
+                    glist_getcanvas(x), e->e_oc);
             }
-            obj_disconnect(t.tr_ob, t.tr_outno, t.tr_ob2, t.tr_inno);
+            obj_disconnect(e->e_from, e->e_outno, e->e_to, e->e_inno);
         }
     }
+    freebytes(copy, n * sizeof(*copy));
+}
+
+    /* kill all lines for the object */
+void canvas_deletelinesfor(t_canvas *x, t_text *text)
+{
+    canvas_dodeletelinesfor(x, text, 0, 0, 1);
 }
 
     /* kill all lines for one inlet or outlet */
 void canvas_deletelinesforio(t_canvas *x, t_text *text,
     t_inlet *inp, t_outlet *outp)
 {
-    t_linetraverser t;
-    t_outconnect *oc;
-    linetraverser_start(&t, x);
-    while ((oc = linetraverser_next(&t)))
+    canvas_dodeletelinesfor(x, text, inp, outp, 0);
+}
+
+/* ----------------- drawing only what's in view ----------------------- */
+
+/* When a canvas is mapped we only draw the objects that are in the window or
+near it, along with lines that reach one of them or cross the window.  The GUI
+tells us what part of the canvas is in view ("view" message) each time it
+scrolls or is resized and we draw whatever comes into it then.  So that the
+GUI can still scroll to them, we tell it the bounds of everything not yet
+drawn.  Objects that are drawn stay drawn until the window is unmapped. */
+
+    /* how far outside the window (in unzoomed pixels) to draw anyway */
+#define CULL_MARGIN 200
+
+static int cull_slot(const t_canvas_private *p, const t_gobj *y)
+{
+    int mask = p->cull_size - 1, i = ((size_t)y >> 4) & mask;
+    while (p->cull_vec[i].c_obj && p->cull_vec[i].c_obj != y)
+        i = (i + 1) & mask;
+    return (i);
+}
+
+static void canvas_cullclear(t_canvas *x)
+{
+    t_canvas_private *p = x->gl_privatedata;
+    if (p->cull_size)
+        freebytes(p->cull_vec, p->cull_size * sizeof(*p->cull_vec));
+    p->cull_vec = 0;
+    p->cull_size = p->cull_n = 0;
+}
+
+    /* if "y" hasn't been drawn because it was out of view, forget that
+    and return 1.  This is called from gobj_vis() so that anyone drawing or
+    erasing an object keeps us up to date, and from glist_delete(). */
+int glist_uncull(t_glist *x, t_gobj *y)
+{
+    t_canvas_private *p = x->gl_privatedata;
+    int mask, i, j, k;
+    if (!p || !p->cull_n)
+        return (0);
+    if (!p->cull_vec[i = cull_slot(p, y)].c_obj)
+        return (0);
+        /* close up the gap so that later probes still find their objects */
+    mask = p->cull_size - 1;
+    for (j = (i + 1) & mask; p->cull_vec[j].c_obj; j = (j + 1) & mask)
     {
-        if ((t.tr_ob == text && t.tr_outlet == outp) ||
-            (t.tr_ob2 == text && t.tr_inlet == inp))
+        k = ((size_t)p->cull_vec[j].c_obj >> 4) & mask;
+        if ((j > i && (k <= i || k > j)) || (j < i && k <= i && k > j))
         {
-            if (glist_isvisible(x))
-            {
-                sys_vgui(".x%lx.c delete l%lx\n",
-                    glist_getcanvas(x), oc);
-            }
-            obj_disconnect(t.tr_ob, t.tr_outno, t.tr_ob2, t.tr_inno);
+            p->cull_vec[i] = p->cull_vec[j];
+            i = j;
+        }
+    }
+    p->cull_vec[i].c_obj = 0;
+    if (!--p->cull_n)
+        canvas_cullclear(x);
+    return (1);
+}
+
+    /* keep the position of an undrawn object right as it's moved; called
+    after gobj_displace() with the displacement in pixels */
+void glist_culldisplace(t_glist *x, t_gobj *y, int dx, int dy)
+{
+    t_canvas_private *p = x->gl_privatedata;
+    t_culled *c;
+    if (!p || !p->cull_n || !(c = &p->cull_vec[cull_slot(p, y)])->c_obj)
+        return;
+    c->c_x1 += dx;
+    c->c_x2 += dx;
+    c->c_y1 += dy;
+    c->c_y2 += dy;
+}
+
+    /* the region to draw in: the view and a margin around it */
+static void canvas_cullregion(t_canvas *x, const int *view, int *region)
+{
+    int margin = CULL_MARGIN * x->gl_zoom;
+    region[0] = view[0] - margin;
+    region[1] = view[1] - margin;
+    region[2] = view[2] + margin;
+    region[3] = view[3] + margin;
+}
+
+static int cull_overlaps(const int *region, int x1, int y1, int x2, int y2)
+{
+    if (x1 > x2)
+        x1 ^= x2, x2 ^= x1, x1 ^= x2;
+    if (y1 > y2)
+        y1 ^= y2, y2 ^= y1, y1 ^= y2;
+    return (x2 >= region[0] && x1 <= region[2] &&
+        y2 >= region[1] && y1 <= region[3]);
+}
+
+    /* draw a line, first deleting it in case it's already there */
+static void canvas_drawline(t_canvas *x, t_lineentry *e, int redraw)
+{
+    int x11, y11, x12, y12, x21, y21, x22, y22, lx1, ly1, lx2, ly2;
+    gobj_getrect(&e->e_from->ob_g, x, &x11, &y11, &x12, &y12);
+    gobj_getrect(&e->e_to->ob_g, x, &x21, &y21, &x22, &y22);
+    canvas_linecoords(x, x11, x12, y12,
+        e->e_outno, obj_noutlets(e->e_from), x21, x22, y21,
+            e->e_inno, obj_ninlets(e->e_to), &lx1, &ly1, &lx2, &ly2);
+    if (redraw)
+        sys_vgui(".x%lx.c delete l%lx\n", glist_getcanvas(x), e->e_oc);
+    sys_vgui(
+        ".x%lx.c create line %d %d %d %d -width %d -tags [list l%lx cord]\n",
+            glist_getcanvas(x), lx1, ly1, lx2, ly2,
+            (outlet_getsymbol(e->e_outlet) == &s_signal ? 2:1) * x->gl_zoom,
+            e->e_oc);
+}
+
+    /* draw the lines for an object that's just come into view */
+static void canvas_drawlinesfor(t_canvas *x, t_text *text)
+{
+    t_lineindex *l = canvas_getlineindex(x);
+    int i;
+    for (i = lineindex_next(l, text, -1); i >= 0;
+        i = lineindex_next(l, text, i))
+            canvas_drawline(x, &l->l_lines[i], 1);
+}
+
+    /* does a line between two undrawn objects cross "region"?  We use the
+    rectangles we kept for them since asking the objects is slow. */
+static int canvas_culllinecrosses(t_canvas *x, t_lineentry *e,
+    const int *region)
+{
+    t_canvas_private *p = x->gl_privatedata;
+    t_culled *c1 = &p->cull_vec[cull_slot(p, &e->e_from->ob_g)],
+        *c2 = &p->cull_vec[cull_slot(p, &e->e_to->ob_g)];
+    int lx1, ly1, lx2, ly2;
+    canvas_linecoords(x, c1->c_x1, c1->c_x2, c1->c_y2,
+        e->e_outno, obj_noutlets(e->e_from), c2->c_x1, c2->c_x2, c2->c_y1,
+            e->e_inno, obj_ninlets(e->e_to), &lx1, &ly1, &lx2, &ly2);
+    return (cull_overlaps(region, lx1, ly1, lx2, ly2));
+}
+
+static int cull_has(t_canvas_private *p, t_object *ob)
+{
+    return (p->cull_vec[cull_slot(p, &ob->ob_g)].c_obj != 0);
+}
+
+static void canvas_culldrawlines(t_canvas *x)
+{
+    t_canvas_private *p = x->gl_privatedata;
+    t_lineindex *l = canvas_getlineindex(x);
+    int i, region[4];
+    canvas_cullregion(x, p->cull_view, region);
+    for (i = 0; i < l->l_nline; i++)
+    {
+        t_lineentry *e = &l->l_lines[i];
+        if (!cull_has(p, e->e_from) || !cull_has(p, e->e_to) ||
+            canvas_culllinecrosses(x, e, region))
+                canvas_drawline(x, e, 0);
+    }
+}
+
+    /* tell the GUI the bounds of what isn't drawn (or that nothing is
+    left) so that it can set the scroll region to include it */
+static void canvas_sendculled(t_canvas *x)
+{
+    t_canvas_private *p = x->gl_privatedata;
+    int i, x1 = 0x7fffffff, y1 = 0x7fffffff, x2 = -x1, y2 = -y1;
+    for (i = 0; i < p->cull_size; i++)
+    {
+        t_culled *c = &p->cull_vec[i];
+        if (!c->c_obj)
+            continue;
+        if (c->c_x1 < x1) x1 = c->c_x1;
+        if (c->c_y1 < y1) y1 = c->c_y1;
+        if (c->c_x2 > x2) x2 = c->c_x2;
+        if (c->c_y2 > y2) y2 = c->c_y2;
+    }
+    if (p->cull_n)
+        sys_vgui("pdtk_canvas_culled .x%lx.c %d %d %d %d\n",
+            x, x1, y1, x2, y2);
+    else sys_vgui("pdtk_canvas_culled .x%lx.c\n", x);
+}
+
+    /* draw the canvas's contents on mapping it */
+static void canvas_cullmap(t_canvas *x)
+{
+    t_canvas_private *p = x->gl_privatedata;
+    t_gobj *y;
+    int n, i, region[4], (*rects)[4];
+    canvas_cullclear(x);
+    for (n = 0, y = x->gl_list; y; y = y->g_next)
+        n++;
+    rects = (int (*)[4])getbytes((n ? n : 1) * sizeof(*rects));
+    for (i = 0, y = x->gl_list; y; y = y->g_next, i++)
+        if (pd_checkobject(&y->g_pd))
+            gobj_getrect(y, x, &rects[i][0], &rects[i][1],
+                &rects[i][2], &rects[i][3]);
+    if (!p->cull_haveview)
+    {
+            /* not told yet; guess that the window will show its top left,
+            which the GUI puts at the origin or the topmost, leftmost object
+            if that's further up or left */
+        p->cull_view[0] = p->cull_view[1] = 0;
+        for (i = 0, y = x->gl_list; y; y = y->g_next, i++)
+            if (pd_checkobject(&y->g_pd))
+        {
+            if (rects[i][0] < p->cull_view[0])
+                p->cull_view[0] = rects[i][0];
+            if (rects[i][1] < p->cull_view[1])
+                p->cull_view[1] = rects[i][1];
         }
+        p->cull_view[2] = p->cull_view[0] + x->gl_screenx2 - x->gl_screenx1;
+        p->cull_view[3] = p->cull_view[1] + x->gl_screeny2 - x->gl_screeny1;
     }
+    canvas_cullregion(x, p->cull_view, region);
+        /* scalars and their drawing instructions aren't culled */
+    for (i = 0, y = x->gl_list; y; y = y->g_next, i++)
+        if (pd_checkobject(&y->g_pd) && !cull_overlaps(region,
+            rects[i][0], rects[i][1], rects[i][2], rects[i][3]))
+                p->cull_n++;
+    if (p->cull_n)
+    {
+        for (p->cull_size = 16; p->cull_size < 2 * p->cull_n; )
+            p->cull_size *= 2;
+        p->cull_vec = (t_culled *)getbytes(p->cull_size * sizeof(*p->cull_vec));
+    }
+    for (i = 0, y = x->gl_list; y; y = y->g_next, i++)
+    {
+        if (pd_checkobject(&y->g_pd) && !cull_overlaps(region,
+            rects[i][0], rects[i][1], rects[i][2], rects[i][3]))
+        {
+            t_culled *c = &p->cull_vec[cull_slot(p, y)];
+            c->c_obj = y;
+            c->c_x1 = rects[i][0];
+            c->c_y1 = rects[i][1];
+            c->c_x2 = rects[i][2];
+            c->c_y2 = rects[i][3];
+        }
+        else gobj_vis(y, x, 1);
+    }
+    freebytes(rects, (n ? n : 1) * sizeof(*rects));
+    canvas_sendculled(x);
+}
+
+    /* the GUI tells us what part of the canvas is in view.  Draw whatever
+    has come into it, and lines between undrawn objects that now cross it
+    (those reaching a newly drawn object come with it from gobj_vis()). */
+static void canvas_view(t_canvas *x, t_floatarg x1, t_floatarg y1,
+    t_floatarg x2, t_floatarg y2)
+{
+    t_canvas_private *p = x->gl_privatedata;
+    int oldregion[4], region[4], i, n, ntodraw;
+    t_gobj **todraw;
+    canvas_cullregion(x, p->cull_view, oldregion);
+    p->cull_view[0] = x1;
+    p->cull_view[1] = y1;
+    p->cull_view[2] = x2;
+    p->cull_view[3] = y2;
+    p->cull_haveview = 1;
+    if (!glist_isvisible(x) || !p->cull_n)
+        return;
+    canvas_cullregion(x, p->cull_view, region);
+        /* collect them first since drawing them takes them out of the table */
+    todraw = (t_gobj **)getbytes((ntodraw = p->cull_n) * sizeof(*todraw));
+    for (i = n = 0; i < p->cull_size; i++)
+    {
+        t_culled *c = &p->cull_vec[i];
+        if (c->c_obj && cull_overlaps(region, c->c_x1, c->c_y1,
+            c->c_x2, c->c_y2))
+                todraw[n++] = c->c_obj;
+    }
+    for (i = 0; i < n; i++)
+        gobj_vis(todraw[i], x, 1);
+    freebytes(todraw, ntodraw * sizeof(*todraw));
+    if (p->cull_n)
+    {
+        t_lineindex *l = canvas_getlineindex(x);
+        for (i = 0; i < l->l_nline; i++)
+        {
+            t_lineentry *e = &l->l_lines[i];
+            if (cull_has(p, e->e_from) && cull_has(p, e->e_to) &&
+                canvas_culllinecrosses(x, e, region) &&
+                    !canvas_culllinecrosses(x, e, oldregion))
+                        canvas_drawline(x, e, 1);
+        }
+    }
+    if (n)
+        canvas_sendculled(x);
+}
+
+    /* called from gobj_vis() when an undrawn object gets drawn */
+void glist_unculled(t_glist *x, t_gobj *y)
+{
+    t_object *ob = pd_checkobject(&y->g_pd);
+    if (ob)
+        canvas_drawlinesfor(x, ob);
+    if (glist_isselected(x, y))
+        gobj_select(y, x, 1);
 }
 
 typedef void (*t_zoomfn)(void *x, t_floatarg arg1);
@@ -1199,9 +1951,14 @@ EXTERN_STRUCT _dspcontext;
 
 void ugen_start(void);
 void ugen_stop(void);
+void ugen_finish(void);
+int ugen_canupdate(t_canvas *x);
+int ugen_start_update(t_canvas *x);
+void ugen_done_update(void);
 
 t_dspcontext *ugen_start_graph(int toplevel, t_signal **sp,
     int ninlets, int noutlets);
+void ugen_setcanvas(t_dspcontext *dc, t_canvas *x);
 void ugen_add(t_dspcontext *dc, t_object *x);
 void ugen_connect(t_dspcontext *dc, t_object *x1, int outno,
     t_object *x2, int inno);
@@ -1226,6 +1983,7 @@ void canvas_dodsp(t_canvas *x, int toplevel, t_signal **sp)
     dc = ugen_start_graph(toplevel, sp,
         obj_nsiginlets(&x->gl_obj),
         obj_nsigoutlets(&x->gl_obj));
+    ugen_setcanvas(dc, x);
 
         /* find all the "dsp" boxes and add them to the graph */
 
@@ -1260,6 +2018,8 @@ static void canvas_start_dsp(void)
 
     for (x = pd_getcanvaslist(); x; x = x->gl_next)
         canvas_dodsp(x, 1, 0);
+    ugen_finish();
+    THISGUI->i_dspshared = 0;
 
     canvas_dspstate = THISGUI->i_dspstate = 1;
     if (gensym("pd-dsp-started")->s_thing)
@@ -1295,10 +2055,141 @@ void canvas_resume_dsp(int oldstate)
     if (oldstate) canvas_start_dsp();
 }
 
-    /* this is equivalent to suspending and resuming in one step. */
+    /* check whether anything in a canvas (or its subpatches) has a DSP
+    method whose effects other objects pick up in their own "dsp" methods,
+    in which case the canvas can't be rescheduled without everything else */
+static int canvas_hasshareddsp(t_canvas *x)
+{
+    t_gobj *y;
+    for (y = x->gl_list; y; y = y->g_next)
+    {
+        if (class_getdspflags(pd_class(&y->g_pd)) & CLASS_DSPSHARED)
+            return (1);
+        if (pd_class(&y->g_pd) == canvas_class &&
+            canvas_hasshareddsp((t_canvas *)y))
+                return (1);
+    }
+    return (0);
+}
+
+    /* after an edit in canvas "x", try to reschedule only it, or the nearest
+    canvas containing it that can be rescheduled by itself, instead of the
+    whole DSP chain.  Only subpatches without signal inlets or outlets can
+    be (see ugen_addrange()); if the edit gave one some, its owner has to
+    be rescheduled too.  Return 1 if that worked. */
+static int canvas_update_graph(t_canvas *x)
+{
+    int toplevel;
+    while (x && (!ugen_canupdate(x) || (x->gl_owner &&
+        (obj_nsiginlets(&x->gl_obj) || obj_nsigoutlets(&x->gl_obj)))))
+            x = x->gl_owner;
+    if (!x || canvas_hasshareddsp(x))
+        return (0);
+    toplevel = ugen_start_update(x);
+    canvas_dodsp(x, toplevel, 0);
+    ugen_done_update();
+    return (1);
+}
+
+    /* this is equivalent to suspending and resuming in one step.  If we know
+    which canvas was edited, we may get away with rescheduling just that. */
 void canvas_update_dsp(void)
 {
-    if (THISGUI->i_dspstate) canvas_start_dsp();
+    if (THISGUI->i_batching)
+    {
+        THISGUI->i_batchdsp = 1;
+        return;
+    }
+    if (THISGUI->i_dspdefer)
+    {
+        THISGUI->i_dspdeferred = 1;
+        return;
+    }
+    if (THISGUI->i_dspstate)
+    {
+        if (THISGUI->i_dspedit && !THISGUI->i_dspshared &&
+            canvas_update_graph(THISGUI->i_dspedit))
+                return;
+        canvas_start_dsp();
+    }
+}
+
+    /* same, when something that other objects' DSP routines may point to
+    (a delay line, a send~ or catch~ buffer, or array storage) goes away or
+    moves: they might be anywhere, so we always resort everything. */
+void canvas_update_alldsp(void)
+{
+    THISGUI->i_dspshared = 1;
+    canvas_update_dsp();
+}
+
+    /* like canvas_suspend_dsp() and canvas_resume_dsp(), for an edit that
+    only changes what's inside canvas "x" and is done all at once, with no
+    DSP tick in between (deleting, retyping, or clearing objects).  The
+    chain is left as it is meanwhile, and afterward we try to reschedule
+    just "x" as canvas_update_dsp() does after a connection is made. */
+int canvas_suspend_dspfor(t_glist *x)
+{
+    if (!THISGUI->i_dspstate)
+        return (0);
+    THISGUI->i_dspdefer++;
+    return (1);
+}
+
+void canvas_resume_dspfor(t_glist *x, int oldstate)
+{
+    t_glist *was = THISGUI->i_dspedit;
+    if (!oldstate || --THISGUI->i_dspdefer || !THISGUI->i_dspdeferred)
+        return;
+    THISGUI->i_dspdeferred = 0;
+    THISGUI->i_dspedit = x;
+    canvas_update_dsp();
+    THISGUI->i_dspedit = was;
+}
+
+/* "begin-batch" and "end-batch" bracket a lot of dynamic patching: until
+the last batch has ended, nothing in the canvas (or its subpatches) is drawn,
+no undo steps are kept for it, and DSP isn't resorted for new connections.
+Then the window is redrawn and DSP updated once.  Batches can be nested. */
+
+    /* true if "x" or a canvas containing it is in a batch */
+int canvas_isbatching(t_glist *x)
+{
+    if (!THISGUI->i_batching)
+        return (0);
+    for (; x; x = x->gl_owner)
+        if (x->gl_batch)
+            return (1);
+    return (0);
+}
+
+static void canvas_beginbatch(t_canvas *x)
+{
+    if (!x->gl_batch++)
+        THISGUI->i_batching++;
+}
+
+static void canvas_dofinishbatch(t_canvas *x)
+{
+    THISGUI->i_batching--;
+    if (glist_isvisible(x))
+        canvas_redraw(glist_getcanvas(x));
+    if (!THISGUI->i_batching && THISGUI->i_batchdsp)
+    {
+        THISGUI->i_batchdsp = 0;
+        canvas_update_dsp();
+    }
+}
+
+static void canvas_endbatch(t_canvas *x)
+{
+    if (!x->gl_batch)
+    {
+        pd_error(x, "end-batch: no batch begun");
+        return;
+    }
+    if (!--x->gl_batch)
+        canvas_dofinishbatch(x);
 }
 
 /* the "dsp" message to pd starts and stops DSP somputation, and, if
@@ -1347,31 +2238,31 @@ void *canvas_getblock(t_class *blockclass, t_canvas **canvasp)
 
 /******************* redrawing  data *********************/
 
-    /* redraw all "scalars" (do this if a drawing command is changed.)
-    LATER we'll use the "template" information to select which ones we
-    redraw.   Action = 0 for redraw, 1 for draw only, 2 for erase. */
-static void glist_redrawall(t_glist *gl, int action)
+    /* redraw all "scalars" drawn using a template (or all of them if the
+    template is zero) -- do this if a drawing command is changed.  Action =
+    0 for redraw, 1 for draw only, 2 for erase.  Erasing has to happen
+    right away since the template may be about to change; drawing goes
+    through the GUI queue like any other scalar redraw so that each scalar
+    is drawn at most once per GUI frame however many changes pile up. */
+static void glist_redrawall(t_template *template, t_glist *gl, int action)
 {
     t_gobj *g;
     int vis = glist_isvisible(gl);
     for (g = gl->gl_list; g; g = g->g_next)
     {
-        if (vis && g->g_pd == scalar_class)
+        if (vis && g->g_pd == scalar_class && (!template ||
+            template_uses(template_findbyname(((t_scalar *)g)->sc_template),
+                template)))
         {
-            if (action == 1)
+            if (action == 2)
             {
-                if (glist_isvisible(gl))
-                    gobj_vis(g, gl, 1);
-            }
-            else if (action == 2)
-            {
-                if (glist_isvisible(gl))
-                    gobj_vis(g, gl, 0);
+                sys_unqueuegui(g);
+                gobj_vis(g, gl, 0);
             }
             else scalar_redraw((t_scalar *)g, gl);
         }
         else if (g->g_pd == canvas_class)
-            glist_redrawall((t_glist *)g, action);
+            glist_redrawall(template, (t_glist *)g, action);
     }
 }
 
@@ -1381,7 +2272,7 @@ void canvas_redrawallfortemplate(t_template *template, int action)
     t_canvas *x;
         /* find all root canvases */
     for (x = pd_getcanvaslist(); x; x = x->gl_next)
-        glist_redrawall(x, action);
+        glist_redrawall(template, x, action);
 }
 
     /* find the template defined by a canvas, and redraw all elements
@@ -1391,6 +2282,7 @@ void canvas_redrawallfortemplatecanvas(t_canvas *x, int action)
     t_gobj *g;
     t_template *tmpl;
     t_symbol *s1 = gensym("struct");
+    int found = 0;
     for (g = x->gl_list; g; g = g->g_next)
     {
         t_object *ob = pd_checkobject(&g->g_pd);
@@ -1402,10 +2294,16 @@ void canvas_redrawallfortemplatecanvas(t_canvas *x, int action)
         if (argv[0].a_type != A_SYMBOL || argv[1].a_type != A_SYMBOL
             || argv[0].a_w.w_symbol != s1)
                 continue;
-        tmpl = template_findbyname(argv[1].a_w.w_symbol);
-        canvas_redrawallfortemplate(tmpl, action);
+        if ((tmpl = template_findbyname(
+            canvas_makebindsym(argv[1].a_w.w_symbol))))
+        {
+            canvas_redrawallfortemplate(tmpl, action);
+            found = 1;
+        }
     }
-    canvas_redrawallfortemplate(0, action);
+        /* no struct found here; fall back on redrawing everything */
+    if (!found)
+        canvas_redrawallfortemplate(0, action);
 }
 
 /* ------------------------------- declare ------------------------ */
@@ -1664,6 +2562,7 @@ void canvas_declare(t_canvas *x, t_symbol *s, int argc, t_atom *argv)
 {
     int i;
     t_canvasenvironment *e = canvas_getenv(x);
+    canvas_openmemo_free(e);    /* the search path is changing */
 #if 0
     startpost("declare:: %s", s->s_name);
     postatom(argc, argv);
@@ -1696,6 +2595,94 @@ void canvas_declare(t_canvas *x, t_symbol *s, int argc, t_atom *argv)
     }
 }
 
+/* Memo of what canvas_open() found, per canvas environment.  Creating many
+copies of an abstraction, or reading the same soundfile again and again,
+would otherwise repeat the whole path search each time.  We remember the
+directory each (name, ext) was found in, and for abstractions and other
+names with an extension also that it wasn't found at all.  A hit is still
+opened (and we search again if that fails); the whole memo is dropped
+when sys_flushdircache() says paths or files may have changed, and when a
+"declare" changes this environment's own path. */
+
+typedef struct _openmemoentry
+{
+    t_symbol *m_name;
+    t_symbol *m_ext;
+    t_symbol *m_dir;        /* directory found in, or 0 if not found */
+    t_symbol *m_file;       /* basename found, including extension */
+} t_openmemoentry;
+
+struct _openmemo
+{
+    int m_gen;              /* STUFF->st_pathgen when made */
+    int m_n;                /* number of entries */
+    int m_size;             /* size of m_vec, a power of 2 */
+    t_openmemoentry *m_vec;
+};
+
+#define OPENMEMO_HASH(name, ext, mask) \
+    ((((size_t)(name) >> 3) * 31 + ((size_t)(ext) >> 3)) & (mask))
+
+static void canvas_openmemo_free(t_canvasenvironment *e)
+{
+    struct _openmemo *m = e->ce_openmemo;
+    if (m)
+    {
+        freebytes(m->m_vec, m->m_size * sizeof(*m->m_vec));
+        freebytes(m, sizeof(*m));
+        e->ce_openmemo = 0;
+    }
+}
+
+static t_openmemoentry *canvas_openmemo_find(struct _openmemo *m,
+    t_symbol *name, t_symbol *ext)
+{
+    size_t mask = m->m_size - 1, i;
+    for (i = OPENMEMO_HASH(name, ext, mask); m->m_vec[i].m_name;
+        i = (i + 1) & mask)
+            if (m->m_vec[i].m_name == name && m->m_vec[i].m_ext == ext)
+                return (&m->m_vec[i]);
+    return (&m->m_vec[i]);
+}
+
+static t_openmemoentry *canvas_openmemo_get(t_canvasenvironment *e,
+    t_symbol *name, t_symbol *ext)
+{
+    struct _openmemo *m = e->ce_openmemo;
+    t_openmemoentry *me;
+    if (m && m->m_gen != STUFF->st_pathgen)
+        canvas_openmemo_free(e), m = 0;
+    if (!m)
+    {
+        m = e->ce_openmemo = (struct _openmemo *)getbytes(sizeof(*m));
+        m->m_gen = STUFF->st_pathgen;
+        m->m_n = 0;
+        m->m_size = 16;
+        m->m_vec = (t_openmemoentry *)getbytes(m->m_size * sizeof(*m->m_vec));
+    }
+    else if (2 * (m->m_n + 1) > m->m_size)
+    {
+        t_openmemoentry *oldvec = m->m_vec;
+        int oldsize = m->m_size, i;
+        m->m_size *= 2;
+        m->m_vec = (t_openmemoentry *)getbytes(m->m_size * sizeof(*m->m_vec));
+        for (i = 0; i < oldsize; i++)
+            if (oldvec[i].m_name)
+                *canvas_openmemo_find(m, oldvec[i].m_name, oldvec[i].m_ext) =
+                    oldvec[i];
+        freebytes(oldvec, oldsize * sizeof(*oldvec));
+    }
+    me = canvas_openmemo_find(m, name, ext);
+    if (!me->m_name)
+    {
+        me->m_name = name;
+        me->m_ext = ext;
+        me->m_dir = me->m_file = 0;
+        m->m_n++;
+    }
+    return (me);
+}
+
 typedef struct _canvasopen
 {
     const char *name;
@@ -1736,11 +2723,27 @@ int canvas_open(const t_canvas *x, const char *name, const char *ext,
 {
     int fd = -1;
     t_canvasopen co;
+    t_canvasenvironment *e = (x ? canvas_getenv(x) : 0);
+    t_openmemoentry *me = 0;
 
         /* first check if "name" is absolute (and if so, try to open) */
     if (sys_open_absolute(name, ext, dirresult, nameresult, size, bin, &fd))
         return (fd);
 
+        /* then see if we've looked before */
+    if (e)
+    {
+        me = canvas_openmemo_get(e, gensym(name), gensym(ext));
+        if (me->m_dir)
+        {
+            if ((fd = sys_trytoopenone(me->m_dir->s_name, me->m_file->s_name,
+                "", dirresult, nameresult, size, bin)) >= 0)
+                    return (fd);
+        }
+        else if (me->m_file)
+            return (-1);
+    }
+
         /* otherwise "name" is relative; iterate over all the search-paths */
     co.name = name;
     co.ext = ext;
@@ -1752,6 +2755,16 @@ int canvas_open(const t_canvas *x, const char *name, const char *ext,
 
     canvas_path_iterate(x, (t_canvas_path_iterator)canvas_open_iter, &co);
 
+    if (me)
+    {
+        if (co.fd >= 0 && *nameresult != dirresult)
+        {
+            me->m_dir = gensym(dirresult);
+            me->m_file = gensym(*nameresult);
+        }
+        else if (*ext)
+            me->m_dir = 0, me->m_file = &s_;
+    }
     return (co.fd);
 }
 
@@ -1949,6 +2962,10 @@ void g_canvas_setup(void)
         A_DEFFLOAT, A_NULL);
     class_addmethod(canvas_class, (t_method)canvas_loadbang,
         gensym("loadbang"), A_NULL);
+    class_addmethod(canvas_class, (t_method)canvas_beginbatch,
+        gensym("begin-batch"), A_NULL);
+    class_addmethod(canvas_class, (t_method)canvas_endbatch,
+        gensym("end-batch"), A_NULL);
     class_addmethod(canvas_class, (t_method)canvas_setbounds,
         gensym("setbounds"), A_FLOAT, A_FLOAT, A_FLOAT, A_FLOAT, A_NULL);
     class_addmethod(canvas_class, (t_method)canvas_relocate,
@@ -1959,6 +2976,8 @@ void g_canvas_setup(void)
         gensym("menu-open"), A_NULL);
     class_addmethod(canvas_class, (t_method)canvas_map,
         gensym("map"), A_FLOAT, A_NULL);
+    class_addmethod(canvas_class, (t_method)canvas_view,
+        gensym("view"), A_FLOAT, A_FLOAT, A_FLOAT, A_FLOAT, A_NULL);
     class_addmethod(canvas_class, (t_method)canvas_dirty,
         gensym("dirty"), A_FLOAT, A_NULL);
     class_setpropertiesfn(canvas_class, canvas_properties);
@@ -2009,6 +3028,8 @@ void canvas_add_for_class(t_class *c)
         gensym("dsp"), A_CANT, 0);
     class_addmethod(c, (t_method)canvas_map,
         gensym("map"), A_FLOAT, A_NULL);
+    class_addmethod(c, (t_method)canvas_view,
+        gensym("view"), A_FLOAT, A_FLOAT, A_FLOAT, A_FLOAT, A_NULL);
     class_addmethod(c, (t_method)canvas_setbounds,
         gensym("setbounds"), A_FLOAT, A_FLOAT, A_FLOAT, A_FLOAT, A_NULL);
     canvas_editor_for_class(c);
@@ -2024,6 +3045,8 @@ void g_canvas_newpdinstance(void)
     THISGUI->i_newargv = 0;
     THISGUI->i_reloadingabstraction = 0;
     THISGUI->i_dspstate = 0;
+    THISGUI->i_dspedit = 0;
+    THISGUI->i_retired = 0;
     THISGUI->i_dollarzero = 1000;
     g_editor_newpdinstance();
     g_template_newpdinstance();
@@ -2031,6 +3054,7 @@ void g_canvas_newpdinstance(void)
 
 void g_canvas_freepdinstance(void)
 {
+    array_freeretired();
     g_editor_freepdinstance();
     g_template_freepdinstance();
     freebytes(THISGUI, sizeof(*THISGUI));
@@ -2086,5 +3110,6 @@ void glob_open(t_pd *ignore, t_symbol *name, t_symbol *dir, t_floatarg f)
         canvas_vis(gl, 1);
         return;
     }
+    sys_flushdircache();    /* look again for any new externs */
     glob_evalfile(ignore, name, dir);
 }
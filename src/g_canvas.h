@@ -117,6 +117,9 @@ typedef struct _editor
     t_clock *e_clock;               /* clock to filter GUI move messages */
     int e_xnew;                     /* xpos for next move event */
     int e_ynew;                     /* ypos, similarly */
+    t_gobj **e_selhash;             /* the selection again, hashed */
+    int e_selhashsize;              /* size of e_selhash, a power of two */
+    int e_nselected;                /* number of objects in e_selhash */
 } t_editor;
 
 #define MA_NONE    0    /* e_onmotion: do nothing on mouse motion */
@@ -197,6 +200,9 @@ struct _glist
     unsigned int gl_isclone:1;      /* exists as part of a clone object */
     int gl_zoom;                    /* zoom factor (integer zoom-in only) */
     void *gl_privatedata;           /* private data */
+    int gl_order;                   /* incremented when the list is added to,
+                                    deleted from or rearranged */
+    int gl_batch;                   /* depth of "begin-batch" messages */
 };
 
 #define gl_gobj gl_obj.te_g
@@ -235,6 +241,12 @@ struct _array
     int a_valid;        /* protection against stale pointers into array */
     t_gpointer a_gp;    /* pointer to scalar or array element we're in */
     t_gstub *a_stub;    /* stub for pointing into this array */
+    int a_cachepeaks;   /* true if writers call garray_redraw(), see below */
+    struct _arraypeaks *a_peaks;    /* cached min and max for plotting */
+    int a_changes;      /* renewed when writers report a change (g_array.c) */
+    int a_nalloc;       /* number of elements allocated, at least a_n */
+    int a_usedindsp;    /* DSP may hold a_vec: retire it, don't free it */
+    size_t a_mapsize;   /* if nonzero, a_vec is in a shared mapping (g_array.c) */
 };
 
     /* structure for traversing all the connections in a glist */
@@ -266,6 +278,15 @@ struct _instancecanvas
     t_atom *i_newargv;
     t_glist *i_reloadingabstraction;
     int i_dspstate;
+    t_glist *i_dspedit;         /* canvas being edited, if known, so that
+                                canvas_update_dsp() can limit the damage */
+    struct _retiredvec *i_retired;  /* array storage to free after DSP */
+    int i_batching;             /* number of canvases in a batch */
+    int i_batchdsp;             /* DSP update put off until batches end */
+    int i_dspdefer;             /* nesting of canvas_suspend_dspfor() */
+    int i_dspdeferred;          /* ... and true if DSP needs updating after */
+    int i_dspshared;            /* something others' DSP used went away, so
+                                the next update has to resort everything */
     int i_dollarzero;
     t_float i_graph_lastxpix, i_graph_lastypix;
 };
@@ -372,6 +393,7 @@ EXTERN void canvas_setcursor(t_glist *x, unsigned int cursornum);
 extern t_canvas *canvas_whichfind;  /* last canvas we did a find in */
 extern t_class *vinlet_class, *voutlet_class;
 extern int glist_valid;         /* incremented when pointers might be stale */
+EXTERN int glist_newvalid(void);    /* ... which this does for you */
 
 #define PLOTSTYLE_POINTS 0     /* plotting styles for arrays */
 #define PLOTSTYLE_POLY 1
@@ -528,6 +550,15 @@ EXTERN void canvas_setundo(t_canvas *x, t_undofn undofn, void *buf,
     const char *name);
 EXTERN void canvas_noundo(t_canvas *x);
 EXTERN int canvas_getindex(t_canvas *x, t_gobj *y);
+EXTERN t_gobj *glist_nth(t_glist *x, int n);
+void glist_indexadd(t_glist *x, t_gobj *y);
+int glist_uncull(t_glist *x, t_gobj *y);
+void glist_unculled(t_glist *x, t_gobj *y);
+void glist_culldisplace(t_glist *x, t_gobj *y, int dx, int dy);
+EXTERN int canvas_isbatching(t_glist *x);
+EXTERN int canvas_suspend_dspfor(t_glist *x);
+EXTERN void canvas_resume_dspfor(t_glist *x, int oldstate);
+EXTERN void canvas_update_alldsp(void);
 
 EXTERN void canvas_connect(t_canvas *x,
     t_floatarg fwhoout, t_floatarg foutno, t_floatarg fwhoin, t_floatarg finno);
@@ -551,15 +582,23 @@ EXTERN void linetraverser_skipobject(t_linetraverser *t);
 /* --------- functions on garrays (graphical arrays) -------------------- */
 
 EXTERN t_template *garray_template(t_garray *x);
+void garray_sidecarbegin(t_symbol *filename, t_symbol *dir);
+void garray_sidecarend(void);
 
 /* -------------------- arrays --------------------- */
 EXTERN t_garray *graph_array(t_glist *gl, t_symbol *s, t_symbol *tmpl,
     t_floatarg f, t_floatarg saveit);
 EXTERN t_array *array_new(t_symbol *templatesym, t_gpointer *parent);
 EXTERN void array_resize(t_array *x, int n);
+EXTERN int array_setalloc(t_array *x, int n);
+EXTERN void array_freevec(t_array *x, char *vec, size_t nbytes);
+EXTERN void array_freeretired(void);
 EXTERN void array_free(t_array *x);
 EXTERN void array_redraw(t_array *a, t_glist *glist);
 EXTERN void array_resize_and_redraw(t_array *array, t_glist *glist, int n);
+EXTERN void array_getpeaks(t_array *x, int yonset, int from, int to,
+    t_float *minp, t_float *maxp);
+EXTERN void array_freepeaks(t_array *x);
 
 /* --------------------- gpointers and stubs ---------------- */
 EXTERN t_gstub *gstub_new(t_glist *gl, t_array *a);
@@ -611,6 +650,8 @@ EXTERN void template_setsymbol(t_template *x, t_symbol *fieldname,
 
 EXTERN t_template *gtemplate_get(t_gtemplate *x);
 EXTERN t_template *template_findbyname(t_symbol *s);
+EXTERN int template_uses(t_template *x, t_template *other);
+EXTERN unsigned long template_getstamp(void);
 EXTERN t_canvas *template_findcanvas(t_template *tmpl);
 EXTERN void template_notify(t_template *tmpl,
     t_symbol *s, int argc, t_atom *argv);
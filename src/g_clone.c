@@ -26,6 +26,13 @@ typedef struct _copy
 {
     t_glist *c_gl;
     int c_on;           /* DSP running */
+    t_float c_key;      /* what "alloc" gave it, if c_held */
+    int c_held;         /* allocated and not yet released */
+    int c_serial;       /* when it was last allocated */
+    t_sample c_level;   /* peak output in the last block (with -voices) */
+    int c_quiet;        /* blocks it's been quiet for */
+    int c_asleep;       /* its DSP is being skipped */
+    int c_skip;         /* chain length from its prolog to voice_zero */
 } t_copy;
 
 typedef struct _in
@@ -59,6 +66,15 @@ typedef struct _clone
     int x_phase;
     int x_startvoice;   /* number of first voice, 0 by default */
     int x_suppressvoice; /* suppress voice number as $1 arg */
+    int x_nthreads;     /* number of threads to compute copies on */
+    int x_lazy;         /* make copies only when they're first used */
+    t_canvas *x_canvas; /* canvas we're in, to make copies from later */
+    int x_loaded;       /* loadbang has been sent */
+    int x_voices;       /* skip the DSP of voices that have gone quiet */
+    t_sample x_thresh;  /* ... below this peak level */
+    t_float x_holdms;   /* ... for this long */
+    int x_hold;         /* ... in blocks */
+    int x_serial;       /* counts "alloc" messages */
 } t_clone;
 
 int clone_match(t_pd *z, t_symbol *name, t_symbol *dir)
@@ -67,11 +83,73 @@ int clone_match(t_pd *z, t_symbol *name, t_symbol *dir)
     if (!x->x_n)
         return (0);
     return (x->x_vec[0].c_gl->gl_name == name &&
-        canvas_getdir(x->x_vec[0].c_gl) == dir);
+        (!dir || canvas_getdir(x->x_vec[0].c_gl) == dir));
+}
+
+static t_canvas *clone_makeone(t_symbol *s, int argc, t_atom *argv);
+
+    /* make copy number "i" (without connecting it) */
+static t_canvas *clone_makecopy(t_clone *x, int i)
+{
+    t_canvas *c;
+    SETFLOAT(x->x_argv, x->x_startvoice + i);
+        /* when made from a message there's no canvas being loaded */
+    canvas_setcurrent(x->x_canvas);
+    if (!(c = clone_makeone(x->x_s, x->x_argc - x->x_suppressvoice,
+        x->x_argv + x->x_suppressvoice)))
+            pd_error(x, "clone: couldn't create '%s'", x->x_s->s_name);
+    canvas_unsetcurrent(x->x_canvas);
+    return (c);
+}
+
+static void clone_connectcopy(t_clone *x, int i)
+{
+    int j;
+    for (j = 0; j < x->x_nout; j++)
+        obj_connect(&x->x_vec[i].c_gl->gl_obj, j,
+            (t_object *)(&x->x_outvec[i][j]), 0);
+}
+
+    /* with "-lazy", copies other than the first are only made when they're
+    first sent a message (or opened); until then they're silent.  Return
+    zero if the copy can't be made. */
+static t_canvas *clone_getcopy(t_clone *x, int i)
+{
+    if (!x->x_vec[i].c_gl)
+    {
+        int dspstate = canvas_suspend_dsp();
+        if ((x->x_vec[i].c_gl = clone_makecopy(x, i)))
+        {
+            clone_connectcopy(x, i);
+            if (x->x_loaded)
+                canvas_loadbang(x->x_vec[i].c_gl);
+        }
+        canvas_resume_dsp(dspstate);
+    }
+    return (x->x_vec[i].c_gl);
 }
 
 void obj_sendinlet(t_object *x, int n, t_symbol *s, int argc, t_atom *argv);
 
+static void clone_wake(t_clone *x, int n)
+{
+    x->x_vec[n].c_asleep = 0;
+    x->x_vec[n].c_quiet = 0;
+}
+
+    /* send a message to copy n's inlet, waking it if it's asleep */
+static void clone_sendcopy(t_in *x, int n, int argc, t_atom *argv)
+{
+    if (!clone_getcopy(x->i_owner, n))
+        return;
+    clone_wake(x->i_owner, n);
+    if (argc > 0 && argv->a_type == A_SYMBOL)
+        obj_sendinlet(&x->i_owner->x_vec[n].c_gl->gl_obj, x->i_n,
+            argv[0].a_w.w_symbol, argc-1, argv+1);
+    else obj_sendinlet(&x->i_owner->x_vec[n].c_gl->gl_obj, x->i_n,
+            &s_list, argc, argv);
+}
+
 static void clone_in_list(t_in *x, t_symbol *s, int argc, t_atom *argv)
 {
     int n;
@@ -81,11 +159,7 @@ static void clone_in_list(t_in *x, t_symbol *s, int argc, t_atom *argv)
         n >= x->i_owner->x_n)
             pd_error(x->i_owner, "clone: instance number %d out of range",
                 n + x->i_owner->x_startvoice);
-    else if (argc > 1 && argv[1].a_type == A_SYMBOL)
-        obj_sendinlet(&x->i_owner->x_vec[n].c_gl->gl_obj, x->i_n,
-            argv[1].a_w.w_symbol, argc-2, argv+2);
-    else obj_sendinlet(&x->i_owner->x_vec[n].c_gl->gl_obj, x->i_n,
-            &s_list, argc-1, argv+1);
+    else clone_sendcopy(x, n, argc-1, argv+1);
 }
 
 static void clone_in_this(t_in *x, t_symbol *s, int argc, t_atom *argv)
@@ -93,13 +167,8 @@ static void clone_in_this(t_in *x, t_symbol *s, int argc, t_atom *argv)
     int phase = x->i_owner->x_phase;
     if (phase < 0 || phase >= x->i_owner->x_n)
         phase = 0;
-    if (argc <= 0)
-        return;
-    else if (argv->a_type == A_SYMBOL)
-        obj_sendinlet(&x->i_owner->x_vec[phase].c_gl->gl_obj, x->i_n,
-            argv[0].a_w.w_symbol, argc-1, argv+1);
-    else obj_sendinlet(&x->i_owner->x_vec[phase].c_gl->gl_obj, x->i_n,
-            &s_list, argc, argv);
+    if (argc > 0)
+        clone_sendcopy(x, phase, argc, argv);
 }
 
 static void clone_in_next(t_in *x, t_symbol *s, int argc, t_atom *argv)
@@ -111,6 +180,82 @@ static void clone_in_next(t_in *x, t_symbol *s, int argc, t_atom *argv)
     clone_in_this(x, s, argc, argv);
 }
 
+    /* "alloc <key> ..." gives a voice to "key" (say, a MIDI pitch) and sends
+    it the rest of the message: the voice already playing that key if any,
+    else a free one (a sleeping one if possible, else the quietest), else
+    the quietest of the ones in use, the one allocated longest ago breaking
+    ties.  "release <key> ..." frees the key's voice to be reused and sends
+    it the rest.  Either way "this" then goes to the voice. */
+static void clone_in_alloc(t_in *x, t_symbol *s, int argc, t_atom *argv)
+{
+    t_clone *owner = x->i_owner;
+    t_float key;
+    int i, best = -1;
+    if (argc < 1 || argv[0].a_type != A_FLOAT)
+    {
+        pd_error(owner, "clone: alloc: no key");
+        return;
+    }
+    key = argv[0].a_w.w_float;
+    for (i = 0; i < owner->x_n; i++)
+        if (owner->x_vec[i].c_held && owner->x_vec[i].c_key == key)
+            break;
+    if (i < owner->x_n)
+        best = i;
+    else for (i = 0; i < owner->x_n; i++)
+    {
+        t_copy *c = &owner->x_vec[i], *b;
+        if (best < 0)
+        {
+            best = i;
+            continue;
+        }
+        b = &owner->x_vec[best];
+        if (c->c_held != b->c_held)
+        {
+            if (!c->c_held)
+                best = i;
+        }
+        else if (c->c_asleep != b->c_asleep)
+        {
+            if (c->c_asleep)
+                best = i;
+        }
+        else if (c->c_level != b->c_level)
+        {
+            if (c->c_level < b->c_level)
+                best = i;
+        }
+        else if (c->c_serial < b->c_serial)
+            best = i;
+    }
+    owner->x_vec[best].c_key = key;
+    owner->x_vec[best].c_held = 1;
+    owner->x_vec[best].c_serial = ++owner->x_serial;
+    owner->x_phase = best;
+    clone_sendcopy(x, best, argc-1, argv+1);
+}
+
+static void clone_in_release(t_in *x, t_symbol *s, int argc, t_atom *argv)
+{
+    t_clone *owner = x->i_owner;
+    int i;
+    if (argc < 1 || argv[0].a_type != A_FLOAT)
+    {
+        pd_error(owner, "clone: release: no key");
+        return;
+    }
+    for (i = 0; i < owner->x_n; i++)
+        if (owner->x_vec[i].c_held &&
+            owner->x_vec[i].c_key == argv[0].a_w.w_float)
+    {
+        owner->x_vec[i].c_held = 0;
+        owner->x_phase = i;
+        clone_sendcopy(x, i, argc-1, argv+1);
+        return;
+    }
+}
+
 static void clone_in_set(t_in *x, t_floatarg f)
 {
     int phase = f;
@@ -137,7 +282,15 @@ static void clone_in_vis(t_in *x, t_floatarg fn, t_floatarg vis)
         n = 0;
     else if (n >= x->i_owner->x_n)
         n = x->i_owner->x_n - 1;
-    canvas_vis(x->i_owner->x_vec[n].c_gl, (vis != 0));
+    if (clone_getcopy(x->i_owner, n))
+        canvas_vis(x->i_owner->x_vec[n].c_gl, (vis != 0));
+}
+
+void clone_setn(t_clone *x, t_floatarg f);
+
+static void clone_in_resize(t_in *x, t_floatarg f)
+{
+    clone_setn(x->i_owner, f);
 }
 
 static void clone_in_fwd(t_in *x, t_symbol *s, int argc, t_atom *argv)
@@ -171,13 +324,17 @@ static void clone_free(t_clone *x)
         if (THISGUI->i_reloadingabstraction)
         {
             for (i = 0; i < x->x_n; i++)
-                if (x->x_vec[i].c_gl == THISGUI->i_reloadingabstraction)
-                    voicetovis = i;
+                if (x->x_vec[i].c_gl &&
+                    x->x_vec[i].c_gl == THISGUI->i_reloadingabstraction)
+                        voicetovis = i;
         }
         for (i = 0; i < x->x_n; i++)
         {
-            canvas_closebang(x->x_vec[i].c_gl);
-            pd_free(&x->x_vec[i].c_gl->gl_pd);
+            if (x->x_vec[i].c_gl)
+            {
+                canvas_closebang(x->x_vec[i].c_gl);
+                pd_free(&x->x_vec[i].c_gl->gl_pd);
+            }
             t_freebytes(x->x_outvec[i],
                 x->x_nout * sizeof(*x->x_outvec[i]));
         }
@@ -227,19 +384,17 @@ void clone_setn(t_clone *x, t_floatarg f)
     if (wantn > nwas)
         for (i = nwas; i < wantn; i++)
     {
-        t_canvas *c;
+        t_canvas *c = 0;
         t_out *outvec;
-        SETFLOAT(x->x_argv, x->x_startvoice + i);
-        if (!(c = clone_makeone(x->x_s, x->x_argc - x->x_suppressvoice,
-            x->x_argv + x->x_suppressvoice)))
-        {
-            pd_error(x, "clone: couldn't create '%s'", x->x_s->s_name);
+        if (!x->x_lazy && !(c = clone_makecopy(x, i)))
             goto done;
-        }
         x->x_vec = (t_copy *)t_resizebytes(x->x_vec, i * sizeof(t_copy),
             (i+1) * sizeof(t_copy));
         x->x_vec[i].c_gl = c;
         x->x_vec[i].c_on = 0;
+        x->x_vec[i].c_held = x->x_vec[i].c_serial = 0;
+        x->x_vec[i].c_level = 0;
+        x->x_vec[i].c_quiet = x->x_vec[i].c_asleep = 0;
         x->x_outvec = (t_out **)t_resizebytes(x->x_outvec,
             i * sizeof(*x->x_outvec), (i+1) * sizeof(*x->x_outvec));
         x->x_outvec[i] = outvec =
@@ -248,12 +403,16 @@ void clone_setn(t_clone *x, t_floatarg f)
         {
             outvec[j].o_pd = clone_out_class;
             outvec[j].o_signal =
-                obj_issignaloutlet(&x->x_vec[0].c_gl->gl_obj, i);
+                obj_issignaloutlet(&x->x_vec[0].c_gl->gl_obj, j);
             outvec[j].o_n = x->x_startvoice + i;
             outvec[j].o_outlet =
                 x->x_outvec[0][j].o_outlet;
-            obj_connect(&x->x_vec[i].c_gl->gl_obj, j,
-                (t_object *)(&outvec[j]), 0);
+        }
+        if (c)
+        {
+            clone_connectcopy(x, i);
+            if (x->x_loaded)
+                canvas_loadbang(c);
         }
         x->x_n++;
     }
@@ -261,12 +420,20 @@ void clone_setn(t_clone *x, t_floatarg f)
     {
         for (i = wantn; i < nwas; i++)
         {
-            canvas_closebang(x->x_vec[i].c_gl);
-            pd_free(&x->x_vec[i].c_gl->gl_pd);
+            if (x->x_vec[i].c_gl)
+            {
+                canvas_closebang(x->x_vec[i].c_gl);
+                pd_free(&x->x_vec[i].c_gl->gl_pd);
+            }
+            t_freebytes(x->x_outvec[i], x->x_nout * sizeof(*x->x_outvec[i]));
         }
         x->x_vec = (t_copy *)t_resizebytes(x->x_vec, nwas * sizeof(t_copy),
             wantn * sizeof(*x->x_vec));
+        x->x_outvec = (t_out **)t_resizebytes(x->x_outvec,
+            nwas * sizeof(*x->x_outvec), wantn * sizeof(*x->x_outvec));
         x->x_n = wantn;
+        if (x->x_phase >= wantn)
+            x->x_phase = wantn - 1;
     }
 done:
     canvas_resume_dsp(dspstate);
@@ -284,35 +451,204 @@ static void clone_loadbang(t_clone *x, t_floatarg f)
 {
     int i;
     if (f == LB_LOAD)
+    {
+        x->x_loaded = 1;
         for (i = 0; i < x->x_n; i++)
-            canvas_loadbang(x->x_vec[i].c_gl);
+            if (x->x_vec[i].c_gl)
+                canvas_loadbang(x->x_vec[i].c_gl);
+    }
     else if (f == LB_CLOSE)
         for (i = 0; i < x->x_n; i++)
-            canvas_closebang(x->x_vec[i].c_gl);
+            if (x->x_vec[i].c_gl)
+                canvas_closebang(x->x_vec[i].c_gl);
 }
 
 void canvas_dodsp(t_canvas *x, int toplevel, t_signal **sp);
 t_signal *signal_newfromcontext(int borrowed);
 void signal_makereusable(t_signal *sig);
 
+EXTERN_STRUCT _dspsection;
+struct _dspsection *ugen_parallel_begin(int nthreads);
+void ugen_parallel_segment(struct _dspsection *x);
+void ugen_parallel_end(struct _dspsection *x);
+int ugen_chainposition(void);
+
+/* With "-voices", each copy's code in the DSP chain is bracketed by
+voice_prolog and voice_epilog, followed by voice_zero:
+
+    voice_prolog(clone, copy, ninputs, input, size, ...)
+    ... the copy's own code ...
+    voice_epilog(clone, copy, noutputs, output, size, ...)
+    voice_zero(noutputs, output, size, ...)
+
+The epilog measures the copy's output and jumps over voice_zero; after the
+copy has been quiet for long enough (and isn't held by "alloc") it goes to
+sleep, and the prolog then jumps straight to voice_zero until a message
+comes in for the copy or one of the clone's signal inputs gets loud. */
+
+static t_int *voice_prolog(t_int *w)
+{
+    t_clone *x = (t_clone *)(w[1]);
+    t_copy *c = (t_copy *)(w[2]);
+    int nin = (int)(w[3]), i, j;
+    if (c->c_asleep)
+    {
+        for (i = 0; i < nin; i++)
+        {
+            t_sample *in = (t_sample *)(w[4 + 2*i]);
+            int n = (int)(w[5 + 2*i]);
+            for (j = 0; j < n; j++)
+                if (in[j] > x->x_thresh || in[j] < -x->x_thresh)
+                    goto wake;
+        }
+        return (w + c->c_skip);
+    wake:
+        c->c_asleep = 0;
+        c->c_quiet = 0;
+    }
+    return (w + 4 + 2 * nin);
+}
+
+static t_int *voice_epilog(t_int *w)
+{
+    t_clone *x = (t_clone *)(w[1]);
+    t_copy *c = (t_copy *)(w[2]);
+    int nout = (int)(w[3]), i, j;
+    t_sample peak = 0;
+    for (i = 0; i < nout; i++)
+    {
+        t_sample *out = (t_sample *)(w[4 + 2*i]);
+        int n = (int)(w[5 + 2*i]);
+        for (j = 0; j < n; j++)
+        {
+            t_sample f = (out[j] < 0 ? -out[j] : out[j]);
+            if (f > peak)
+                peak = f;
+        }
+    }
+    c->c_level = peak;
+    if (peak <= x->x_thresh && !c->c_held)
+    {
+        if (++c->c_quiet >= x->x_hold)
+            c->c_asleep = 1;
+    }
+    else c->c_quiet = 0;
+        /* skip voice_zero */
+    return (w + (4 + 2 * nout) + (2 + 2 * nout));
+}
+
+static t_int *voice_zero(t_int *w)
+{
+    int nout = (int)(w[1]), i;
+    for (i = 0; i < nout; i++)
+        memset((t_sample *)(w[2 + 2*i]), 0,
+            (int)(w[3 + 2*i]) * sizeof(t_sample));
+    return (w + 2 + 2 * nout);
+}
+
+    /* add a voice prolog, epilog or zero; "sigs" are the signals to pass */
+static int clone_addvoicecode(t_perfroutine f, t_clone *x, t_copy *c,
+    int nsig, t_signal **sigs)
+{
+    int nargs = (f == voice_zero ? 1 : 3) + 2 * nsig, i, k = 0,
+        where = ugen_chainposition();
+    t_int *vec = (t_int *)alloca(nargs * sizeof(*vec));
+    if (f != voice_zero)
+    {
+        vec[k++] = (t_int)x;
+        vec[k++] = (t_int)c;
+    }
+    vec[k++] = nsig;
+    for (i = 0; i < nsig; i++)
+    {
+        vec[k++] = (t_int)sigs[i]->s_vec;
+        vec[k++] = sigs[i]->s_n * sigs[i]->s_nchans;
+    }
+    dsp_addv(f, nargs, vec);
+    return (where);
+}
+
+    /* schedule copies copies[from] to copies[to-1], summing their outputs
+    into "sums".  The first copy's outputs are held until the second one's
+    are known so that the two can be added straight into the sums; only a
+    lone copy gets copied out. */
+static void clone_dodsp(t_clone *x, const int *copies, int from, int to,
+    int nin, int nout, t_signal **sums, t_signal **tempio)
+{
+    int i, j;
+    t_signal **first = (t_signal **)alloca((nout ? nout : 1) *
+        sizeof(*first));
+    for (j = from; j < to; j++)
+    {
+        t_copy *c = &x->x_vec[copies[j]];
+        int prolog = 0;
+        for (i = 0; i < nout; i++)
+            tempio[nin + i] = signal_newfromcontext(1);
+        if (x->x_voices && nout)
+            prolog = clone_addvoicecode(voice_prolog, x, c, nin, tempio);
+        canvas_dodsp(c->c_gl, 0, tempio);
+        if (x->x_voices && nout)
+        {
+            clone_addvoicecode(voice_epilog, x, c, nout, tempio + nin);
+            c->c_skip = clone_addvoicecode(voice_zero, x, c, nout,
+                tempio + nin) - prolog;
+        }
+        for (i = 0; i < nout; i++)
+        {
+            t_signal *sig = tempio[nin + i];
+            if (j == from)
+            {
+                if (to - from > 1)
+                {
+                    first[i] = sig;
+                    continue;
+                }
+                dsp_add_copy(sig->s_vec, sums[i]->s_vec, sums[i]->s_n);
+            }
+            else if (j == from + 1)
+            {
+                dsp_add_plus(first[i]->s_vec, sig->s_vec,
+                    sums[i]->s_vec, sums[i]->s_n);
+                signal_makereusable(first[i]);
+            }
+            else dsp_add_plus(sig->s_vec, sums[i]->s_vec,
+                    sums[i]->s_vec, sums[i]->s_n);
+            signal_makereusable(sig);
+        }
+    }
+}
+
 static void clone_dsp(t_clone *x, t_signal **sp)
 {
-    int i, j, nin, nout;
+    int i, j, nin, nout, ngroup, ncopies, *copies;
     t_signal **tempsigs, **tempio;
+    struct _dspsection *section;
     if (!x->x_n)
         return;
+        /* only the copies that exist yet (see clone_getcopy()) */
+    copies = (int *)alloca(x->x_n * sizeof(*copies));
+    for (j = ncopies = 0; j < x->x_n; j++)
+        if (x->x_vec[j].c_gl)
+            copies[ncopies++] = j;
     for (i = nin = 0; i < x->x_nin; i++)
         if (x->x_invec[i].i_signal)
             nin++;
     for (i = nout = 0; i < x->x_nout; i++)
         if (x->x_outvec[0][i].o_signal)
             nout++;
-    for (j = 0; j < x->x_n; j++)
+    if (x->x_voices && nout)
+    {
+        x->x_hold = x->x_holdms * sp[nin]->s_sr / (1000. * sp[nin]->s_n);
+        if (x->x_hold < 1)
+            x->x_hold = 1;
+        for (j = 0; j < ncopies; j++)
+            clone_wake(x, copies[j]);
+    }
+    for (j = 0; j < ncopies; j++)
     {
-        if (obj_ninlets(&x->x_vec[j].c_gl->gl_obj) != x->x_nin ||
-            obj_noutlets(&x->x_vec[j].c_gl->gl_obj) != x->x_nout ||
-                obj_nsiginlets(&x->x_vec[j].c_gl->gl_obj) != nin ||
-                    obj_nsigoutlets(&x->x_vec[j].c_gl->gl_obj) != nout)
+        t_object *ob = &x->x_vec[copies[j]].c_gl->gl_obj;
+        if (obj_ninlets(ob) != x->x_nin || obj_noutlets(ob) != x->x_nout ||
+            obj_nsiginlets(ob) != nin || obj_nsigoutlets(ob) != nout)
         {
             pd_error(x, "clone: can't do DSP until edited copy is saved");
             for (i = 0; i < nout; i++)
@@ -320,40 +656,50 @@ static void clone_dsp(t_clone *x, t_signal **sp)
             return;
         }
     }
-    tempsigs = (t_signal **)alloca((nin + 2 * nout) * sizeof(*tempsigs));
-    tempio = tempsigs + nout;
+        /* with "-threads", split the copies into that many groups, each
+    computed in its own segment of a parallel section and summed into its
+    own temp sigs.  The groups' sums are added up after the join. */
+    if ((ngroup = x->x_nthreads) > ncopies)
+        ngroup = ncopies;
+    if (ngroup < 2 || !(section = ugen_parallel_begin(ngroup)))
+        ngroup = 1, section = 0;
+    tempsigs = (t_signal **)alloca((nin + (ngroup + 1) * nout) *
+        sizeof(*tempsigs));
+    tempio = tempsigs + ngroup * nout;
+        /* the first group sums right into our outputs; the others need
+        their own signals so that they can run alongside it. */
+    for (i = 0; i < nout; i++)
+    {
+        tempsigs[i] = sp[nin+i];
+        for (j = 1; j < ngroup; j++)
+            tempsigs[j * nout + i] = signal_newfromcontext(0);
+    }
         /* load input signals into signal vector to send subpatches */
     for (i = 0; i < nin; i++)
     {
             /* we already have one reference "counted" for our presumed
             use of this input signal but add one for each additional copy. */
-        sp[i]->s_refcount += x->x_n-1;
+        sp[i]->s_refcount += ncopies-1;
         tempio[i] = sp[i];
     }
-        /* for first copy, write output to first nout temp sigs */
-    for (i = 0; i < nout; i++)
-        tempsigs[i] = signal_newfromcontext(0);
-
-    for (j = 0; j < x->x_n; j++)
+    for (j = 0; j < ngroup; j++)
     {
-        for (i = 0; i < nout; i++)
-            tempio[nin + i] = signal_newfromcontext(1);
-        canvas_dodsp(x->x_vec[j].c_gl, 0, tempio);
-        for (i = 0; i < nout; i++)
-        {
-            if (j == 0)
-                dsp_add_copy(tempio[nin + i]->s_vec, tempsigs[i]->s_vec,
-                    tempsigs[i]->s_n);
-            else dsp_add_plus(tempio[nin + i]->s_vec, tempsigs[i]->s_vec,
-                    tempsigs[i]->s_vec, tempsigs[i]->s_n);
-            signal_makereusable(tempio[nin + i]);
-        }
+        ugen_parallel_segment(section);
+        clone_dodsp(x, copies, (j * ncopies) / ngroup,
+            ((j + 1) * ncopies) / ngroup, nin, nout, tempsigs + j * nout,
+                tempio);
     }
-        /* copy to output signsls */
+    ugen_parallel_end(section);
+        /* add the other groups' sums to the output signals */
     for (i = 0; i < nout; i++)
     {
-        dsp_add_copy(tempsigs[i]->s_vec, sp[nin+i]->s_vec, tempsigs[i]->s_n);
-        signal_makereusable(tempsigs[i]);
+        for (j = 1; j < ngroup; j++)
+        {
+            t_signal *sig = tempsigs[j * nout + i];
+            dsp_add_plus(sig->s_vec, sp[nin+i]->s_vec, sp[nin+i]->s_vec,
+                sig->s_n);
+            signal_makereusable(sig);
+        }
     }
 }
 
@@ -367,6 +713,13 @@ static void *clone_new(t_symbol *s, int argc, t_atom *argv)
     x->x_outvec = 0;
     x->x_startvoice = 0;
     x->x_suppressvoice = 0;
+    x->x_nthreads = 1;
+    x->x_lazy = x->x_loaded = 0;
+    x->x_voices = x->x_serial = 0;
+    x->x_thresh = 0;
+    x->x_holdms = 0;
+    x->x_hold = 1;
+    x->x_canvas = canvas_getcurrent();
     clone_voicetovis = -1;
     if (argc == 0)
     {
@@ -386,6 +739,25 @@ static void *clone_new(t_symbol *s, int argc, t_atom *argv)
         }
         else if (!strcmp(argv[0].a_w.w_symbol->s_name, "-x"))
             x->x_suppressvoice = 1, argc--, argv++;
+        else if (!strcmp(argv[0].a_w.w_symbol->s_name, "-threads") &&
+            argc > 1 && argv[1].a_type == A_FLOAT)
+        {
+            x->x_nthreads = argv[1].a_w.w_float;
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(argv[0].a_w.w_symbol->s_name, "-lazy"))
+            x->x_lazy = 1, argc--, argv++;
+        else if (!strcmp(argv[0].a_w.w_symbol->s_name, "-voices") &&
+            argc > 2 && argv[1].a_type == A_FLOAT &&
+                argv[2].a_type == A_FLOAT)
+        {
+            x->x_voices = 1;
+            x->x_thresh = (argv[1].a_w.w_float > 0 ?
+                argv[1].a_w.w_float : 0);
+            x->x_holdms = (argv[2].a_w.w_float > 0 ?
+                argv[2].a_w.w_float : 0);
+            argc -= 3; argv += 3;
+        }
         else goto usage;
     }
     if (argc >= 2 && (wantn = atom_getfloatarg(0, argc, argv)) >= 0
@@ -406,6 +778,9 @@ static void *clone_new(t_symbol *s, int argc, t_atom *argv)
             goto fail;
     x->x_vec = (t_copy *)getbytes(sizeof(*x->x_vec));
     x->x_vec[0].c_gl = c;
+    x->x_vec[0].c_held = x->x_vec[0].c_serial = 0;
+    x->x_vec[0].c_level = 0;
+    x->x_vec[0].c_quiet = x->x_vec[0].c_asleep = 0;
     x->x_n = 1;
     x->x_nin = obj_ninlets(&x->x_vec[0].c_gl->gl_obj);
     x->x_invec = (t_in *)getbytes(x->x_nin * sizeof(*x->x_invec));
@@ -439,11 +814,13 @@ static void *clone_new(t_symbol *s, int argc, t_atom *argv)
     clone_setn(x, (t_floatarg)(wantn));
     x->x_phase = wantn-1;
     canvas_resume_dsp(dspstate);
-    if (voicetovis >= 0 && voicetovis < x->x_n)
+    if (voicetovis >= 0 && voicetovis < x->x_n &&
+        clone_getcopy(x, voicetovis))
         canvas_vis(x->x_vec[voicetovis].c_gl, 1);
     return (x);
 usage:
-    error("usage: clone [-s starting-number] <number> <name> [arguments]");
+    error("usage: clone [-s starting-number] [-threads n] [-lazy] "
+        "[-voices threshold holdms] <number> <name> [arguments]");
 fail:
     freebytes(x, sizeof(t_clone));
     canvas_resume_dsp(dspstate);
@@ -454,6 +831,9 @@ void clone_setup(void)
 {
     clone_class = class_new(gensym("clone"), (t_newmethod)clone_new,
         (t_method)clone_free, sizeof(t_clone), CLASS_NOINLET, A_GIMME, 0);
+        /* the copies aren't on the canvas's list, so we can't tell what's
+        in them; assume the worst when editing around us */
+    class_setdspflags(clone_class, CLASS_DSPSHARED);
     class_addmethod(clone_class, (t_method)clone_click, gensym("click"),
         A_FLOAT, A_FLOAT, A_FLOAT, A_FLOAT, A_FLOAT, 0);
     class_addmethod(clone_class, (t_method)clone_loadbang, gensym("loadbang"),
@@ -471,10 +851,16 @@ void clone_setup(void)
         A_FLOAT, 0);
     class_addmethod(clone_in_class, (t_method)clone_in_all, gensym("all"),
         A_GIMME, 0);
+    class_addmethod(clone_in_class, (t_method)clone_in_alloc, gensym("alloc"),
+        A_GIMME, 0);
+    class_addmethod(clone_in_class, (t_method)clone_in_release,
+        gensym("release"), A_GIMME, 0);
     class_addmethod(clone_in_class, (t_method)clone_in_vis, gensym("vis"),
         A_FLOAT, A_FLOAT, 0);
     class_addmethod(clone_in_class, (t_method)clone_in_fwd, gensym("fwd"),
         A_GIMME, 0);
+    class_addmethod(clone_in_class, (t_method)clone_in_resize,
+        gensym("resize"), A_FLOAT, 0);
     class_addlist(clone_in_class, (t_method)clone_in_list);
 
     clone_out_class = class_new(gensym("clone-outlet"), 0, 0,
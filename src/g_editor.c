@@ -71,6 +71,7 @@ void gobj_displace(t_gobj *x, t_glist *glist, int dx, int dy)
 {
     if (x->g_pd->c_wb && x->g_pd->c_wb->w_displacefn)
         (*x->g_pd->c_wb->w_displacefn)(x, glist, dx, dy);
+    glist_culldisplace(glist, x, dx * glist->gl_zoom, dy * glist->gl_zoom);
 }
 
     /* here we add an extra check whether we're mapped, because some
@@ -146,8 +147,15 @@ int gobj_shouldvis(t_gobj *x, struct _glist *glist)
 
 void gobj_vis(t_gobj *x, struct _glist *glist, int flag)
 {
+        /* if it was left undrawn because it was out of view, there's
+        nothing to erase; if we're drawing it now, draw its lines too */
+    int unculled = glist_uncull(glist, x);
+    if (unculled && !flag)
+        return;
     if (x->g_pd->c_wb && x->g_pd->c_wb->w_visfn && gobj_shouldvis(x, glist))
         (*x->g_pd->c_wb->w_visfn)(x, glist, flag);
+    if (unculled)
+        glist_unculled(glist, x);
 }
 
 int gobj_click(t_gobj *x, struct _glist *glist,
@@ -189,15 +197,67 @@ void glist_deselectline(t_glist *x)
     }
 }
 
-int glist_isselected(t_glist *x, t_gobj *y)
+    /* the selection is also kept in a hash table in the editor so that
+    glist_isselected(), which is called for every object or line in many
+    loops, doesn't have to walk the selection list.  glist_selectchanges
+    counts changes to any selection, for glist_selectionindex() below. */
+static PERTHREAD int glist_selectchanges;
+
+static int selhash_slot(t_gobj **vec, int size, t_gobj *y)
 {
-    if (x->gl_editor)
+    int mask = size - 1, i = ((size_t)y >> 4) & mask;
+    while (vec[i] && vec[i] != y)
+        i = (i + 1) & mask;
+    return (i);
+}
+
+static void selhash_add(t_editor *e, t_gobj *y)
+{
+    if (2 * (e->e_nselected + 1) > e->e_selhashsize)
     {
-        t_selection *sel;
-        for (sel = x->gl_editor->e_selection; sel; sel = sel->sel_next)
-            if (sel->sel_what == y) return (1);
+        int oldsize = e->e_selhashsize, i,
+            newsize = (oldsize ? 2 * oldsize : 16);
+        t_gobj **oldvec = e->e_selhash,
+            **newvec = (t_gobj **)getbytes(newsize * sizeof(*newvec));
+        for (i = 0; i < oldsize; i++)
+            if (oldvec[i])
+                newvec[selhash_slot(newvec, newsize, oldvec[i])] = oldvec[i];
+        freebytes(oldvec, oldsize * sizeof(*oldvec));
+        e->e_selhash = newvec;
+        e->e_selhashsize = newsize;
     }
-    return (0);
+    e->e_selhash[selhash_slot(e->e_selhash, e->e_selhashsize, y)] = y;
+    e->e_nselected++;
+    glist_selectchanges++;
+}
+
+static void selhash_remove(t_editor *e, t_gobj *y)
+{
+    int mask = e->e_selhashsize - 1, i, j;
+    if (!e->e_selhashsize ||
+        !e->e_selhash[i = selhash_slot(e->e_selhash, e->e_selhashsize, y)])
+            return;
+        /* close up the gap so that later entries are still found */
+    e->e_selhash[i] = 0;
+    for (j = (i + 1) & mask; e->e_selhash[j]; j = (j + 1) & mask)
+    {
+        int home = ((size_t)e->e_selhash[j] >> 4) & mask;
+        if (i <= j ? (home <= i || home > j) : (home <= i && home > j))
+        {
+            e->e_selhash[i] = e->e_selhash[j];
+            e->e_selhash[j] = 0;
+            i = j;
+        }
+    }
+    e->e_nselected--;
+    glist_selectchanges++;
+}
+
+int glist_isselected(t_glist *x, t_gobj *y)
+{
+    t_editor *e = x->gl_editor;
+    return (e && e->e_nselected &&
+        e->e_selhash[selhash_slot(e->e_selhash, e->e_selhashsize, y)] == y);
 }
 
     /* call this for unselected objects only */
@@ -211,6 +271,7 @@ void glist_select(t_glist *x, t_gobj *y)
         sel->sel_next = x->gl_editor->e_selection;
         sel->sel_what = y;
         x->gl_editor->e_selection = sel;
+        selhash_add(x->gl_editor, y);
         gobj_select(y, x, 1);
     }
 }
@@ -257,8 +318,9 @@ void glist_deselect(t_glist *x, t_gobj *y)
             gobj_activate(y, x, 0);
         }
         if (zgetfn(&y->g_pd, gensym("dsp")))
-            fixdsp = canvas_suspend_dsp();
+            fixdsp = canvas_suspend_dspfor(x);
     }
+    selhash_remove(x->gl_editor, y);
     if ((sel = x->gl_editor->e_selection)->sel_what == y)
     {
         x->gl_editor->e_selection = x->gl_editor->e_selection->sel_next;
@@ -291,7 +353,7 @@ void glist_deselect(t_glist *x, t_gobj *y)
         canvas_undo_add(x, UNDO_SEQUENCE_END, "typing", 0);
     }
     if (fixdsp)
-        canvas_resume_dsp(1);
+        canvas_resume_dspfor(x, 1);
 }
 
 void glist_noselect(t_glist *x)
@@ -316,6 +378,7 @@ void glist_selectall(t_glist *x)
             t_gobj *y = x->gl_list;
             x->gl_editor->e_selection = sel;
             sel->sel_what = y;
+            selhash_add(x->gl_editor, y);
             gobj_select(y, x, 1);
             while ((y = y->g_next))
             {
@@ -323,6 +386,7 @@ void glist_selectall(t_glist *x)
                 sel->sel_next = sel2;
                 sel = sel2;
                 sel->sel_what = y;
+                selhash_add(x->gl_editor, y);
                 gobj_select(y, x, 1);
             }
             sel->sel_next = 0;
@@ -334,36 +398,45 @@ void glist_selectall(t_glist *x)
        total number of objects. */
 int glist_getindex(t_glist *x, t_gobj *y)
 {
-    t_gobj *y2;
-    int indx;
-
-    for (y2 = x->gl_list, indx = 0; y2 && y2 != y; y2 = y2->g_next)
-        indx++;
-    return (indx);
+    return (canvas_getindex(x, y));
 }
 
+    /* for glist_selectionindex(): how many objects before each one in a
+    glist are selected, kept for one glist until it or a selection changes */
+static PERTHREAD struct _selindex
+{
+    t_glist *s_glist;
+    int s_order;
+    int s_selectchanges;
+    int s_n;
+    int *s_nbefore;             /* s_n + 1 counts */
+} glist_selindex;
+
     /* get the index of the object, among selected items, if "selected"
        is set; otherwise, among unselected ones.  If y is zero, just
        counts the selected or unselected objects. */
 int glist_selectionindex(t_glist *x, t_gobj *y, int selected)
 {
-    t_gobj *y2;
-    int indx;
-
-    for (y2 = x->gl_list, indx = 0; y2 && y2 != y; y2 = y2->g_next)
-        if (selected == glist_isselected(x, y2))
-            indx++;
-    return (indx);
-}
-
-static t_gobj *glist_nth(t_glist *x, int n)
-{
-    t_gobj *y;
-    int indx;
-    for (y = x->gl_list, indx = 0; y; y = y->g_next, indx++)
-        if (indx == n)
-            return (y);
-    return (0);
+    struct _selindex *s = &glist_selindex;
+    int indx, n = glist_getindex(x, 0);
+    if (s->s_glist != x || s->s_order != x->gl_order || s->s_n != n ||
+        s->s_selectchanges != glist_selectchanges)
+    {
+        t_gobj *y2;
+        s->s_nbefore = (int *)resizebytes(s->s_nbefore,
+            (s->s_n + 1) * sizeof(int), (n + 1) * sizeof(int));
+        s->s_n = n;
+        s->s_nbefore[0] = 0;
+        for (y2 = x->gl_list, indx = 0; y2 && indx < n;
+            y2 = y2->g_next, indx++)
+                s->s_nbefore[indx + 1] = s->s_nbefore[indx] +
+                    glist_isselected(x, y2);
+        s->s_glist = x;
+        s->s_order = x->gl_order;
+        s->s_selectchanges = glist_selectchanges;
+    }
+    indx = glist_getindex(x, y);
+    return (selected ? s->s_nbefore[indx] : indx - s->s_nbefore[indx]);
 }
 
 /* ------------------- support for undo/redo  -------------------------- */
@@ -553,7 +626,9 @@ void canvas_disconnect(t_canvas *x,
             sinkno == index2 && t.tr_inno == inno)
         {
             sys_vgui(".x%lx.c delete l%lx\n", x, oc);
+            THISGUI->i_dspedit = x;
             obj_disconnect(t.tr_ob, t.tr_outno, t.tr_ob2, t.tr_inno);
+            THISGUI->i_dspedit = 0;
             break;
         }
     }
@@ -734,6 +809,7 @@ int canvas_undo_cut(t_canvas *x, void *z, int action)
                         }
                         else if (y_prev && !y_next)
                             y_prev->g_next = NULL;
+                        x->gl_order++;
                             /* now put the moved object at the beginning of the cue */
                         y->g_next = glist_nth(x, 0);
                         x->gl_list = y;
@@ -749,6 +825,7 @@ int canvas_undo_cut(t_canvas *x, void *z, int action)
                         {
                             y_prev->g_next = NULL;
                         }
+                        x->gl_order++;
                             /* now put the moved object in its right place */
                         y_prev = glist_nth(x, buf->p_a[i]-1);
                         y_next = glist_nth(x, buf->p_a[i]);
@@ -757,6 +834,7 @@ int canvas_undo_cut(t_canvas *x, void *z, int action)
                         y->g_next = y_next;
                             /* LATER when objects are properly tagged lower y here */
                     }
+                    x->gl_order++;
                 }
             }
                 /* LATER disable redrawing here */
@@ -1111,6 +1189,7 @@ int canvas_apply_restore_original_position(t_canvas *x, int orig_pos)
         y_prev = glist_nth(x, glist_getindex(x, 0) - 2);
         if (y_prev)
             y_prev->g_next = NULL;
+        x->gl_order++;
             /* if the object is supposed to be first in the gl_list */
         if (orig_pos == 0)
         {
@@ -1124,6 +1203,7 @@ int canvas_apply_restore_original_position(t_canvas *x, int orig_pos)
             y_prev->g_next = y;
             y->g_next = y_next;
         }
+        x->gl_order++;
         return(1);
     }
     return(0);
@@ -1210,6 +1290,7 @@ static void canvas_doarrange(t_canvas *x, t_float which, t_gobj *oldy,
         bug("canvas_arrange");
         return;
     }
+    x->gl_order++;
     canvas_dirty(x, 1);
 }
 
@@ -1240,6 +1321,7 @@ int canvas_undo_arrange(t_canvas *x, void *z, int action)
                 /* first previous object should point to nothing */
             prev = glist_nth(x, buf->u_newindex - 1);
             prev->g_next = NULL;
+            x->gl_order++;
 
                 /* now we reuse vars for the following:
                    old index should be right before the object previndex
@@ -1282,6 +1364,7 @@ int canvas_undo_arrange(t_canvas *x, void *z, int action)
             prev->g_next = y;
             y->g_next = next;
         }
+        x->gl_order++;
             /* and finally redraw canvas */
         if (x->gl_havewindow)
             canvas_redraw(x);
@@ -1479,17 +1562,10 @@ void *canvas_undo_set_create(t_canvas *x)
     nnotsel= glist_selectionindex(x, 0, 0);
 
     buf->u_objectbuf = binbuf_new();
-    if (x->gl_list)
+    if ((y = glist_nth(x, buf->u_index)))
     {
         t_outconnect *oc;
-        for (y = x->gl_list; y; y = y->g_next)
-        {
-            if (!y->g_next)
-            {
-                gobj_save(y, buf->u_objectbuf);
-                break;
-            }
-        }
+        gobj_save(y, buf->u_objectbuf);
         buf->u_reconnectbuf = binbuf_new();
         linetraverser_start(&t, x);
         while ((oc = linetraverser_next(&t)))
@@ -1715,14 +1791,78 @@ int canvas_undo_font(t_canvas *x, void *z, int action)
     return 1;
 }
 
+/* ----------- size of the undo data, for keeping the queue in bounds ---- */
+
+static int undo_binbufsize(t_binbuf *b)
+{
+    return (b ? (int)(binbuf_getnatom(b) * sizeof(t_atom)) : 0);
+}
+
+    /* roughly how much memory an undo action's data holds.  Symbols are
+    shared so only the atoms that refer to them count. */
+int canvas_undo_datasize(t_undo_type type, void *data)
+{
+    if (!data)
+        return (0);
+    switch (type)
+    {
+    case UNDO_CONNECT:
+    case UNDO_DISCONNECT:
+        return (sizeof(t_undo_connect));
+    case UNDO_CUT:
+    {
+        t_undo_cut *buf = data;
+        return (sizeof(*buf) + (buf->n_obj - 1) * sizeof(buf->p_a[0]) +
+            undo_binbufsize(buf->u_objectbuf) +
+            undo_binbufsize(buf->u_reconnectbuf) +
+            undo_binbufsize(buf->u_redotextbuf));
+    }
+    case UNDO_MOTION:
+    {
+        t_undo_move *buf = data;
+        return (sizeof(*buf) + buf->u_n * sizeof(*buf->u_vec));
+    }
+    case UNDO_PASTE:
+    {
+        t_undo_paste *buf = data;
+        return (sizeof(*buf) + undo_binbufsize(buf->u_objectbuf));
+    }
+    case UNDO_APPLY:
+    {
+        t_undo_apply *buf = data;
+        return (sizeof(*buf) + undo_binbufsize(buf->u_objectbuf) +
+            undo_binbufsize(buf->u_reconnectbuf));
+    }
+    case UNDO_ARRANGE:
+        return (sizeof(t_undo_arrange));
+    case UNDO_CANVAS_APPLY:
+        return (sizeof(t_undo_canvas_properties));
+    case UNDO_CREATE:
+    case UNDO_RECREATE:
+    {
+        t_undo_create *buf = data;
+        return (sizeof(*buf) + undo_binbufsize(buf->u_objectbuf) +
+            undo_binbufsize(buf->u_reconnectbuf));
+    }
+    case UNDO_FONT:
+        return (sizeof(t_undo_font));
+    default:
+        return (0);
+    }
+}
+
 int clone_match(t_pd *z, t_symbol *name, t_symbol *dir);
 static void canvas_cut(t_canvas *x);
 
     /* recursively check for abstractions to reload as result of a save.
        Don't reload the one we just saved ("except") though. */
     /* LATER try to do the same trick for externs. */
-static void glist_doreload(t_glist *gl, t_symbol *name, t_symbol *dir,
-    t_gobj *except)
+    /* A zero "dir" matches abstractions from any directory.  If "externdir"
+       is nonzero, objects whose classes were loaded from that directory are
+       remade instead (after "pd reload" has loaded an external again).
+       Returns the number of objects remade. */
+static int glist_doreload(t_glist *gl, t_symbol *name, t_symbol *dir,
+    t_gobj *except, t_symbol *externdir)
 {
     t_gobj *g;
     int hadwindow = gl->gl_havewindow;
@@ -1734,17 +1874,21 @@ static void glist_doreload(t_glist *gl, t_symbol *name, t_symbol *dir,
     {
             /* remake the object if it's an abstraction that appears to have
                been loaded from the file we just saved */
-        int remakeit = (g != except && pd_class(&g->g_pd) == canvas_class &&
+        int remakeit = (!externdir && g != except &&
+            pd_class(&g->g_pd) == canvas_class &&
             canvas_isabstraction((t_canvas *)g) &&
                 ((t_canvas *)g)->gl_name == name &&
-                    canvas_getdir((t_canvas *)g) == dir);
+                    (!dir || canvas_getdir((t_canvas *)g) == dir));
             /* also remake it if it's a "clone" with that name */
-        if (pd_class(&g->g_pd) == clone_class &&
+        if (!externdir && pd_class(&g->g_pd) == clone_class &&
             clone_match(&g->g_pd, name, dir))
         {
                 /* LATER try not to remake the one that equals "except" */
             remakeit = 1;
         }
+        if (externdir && pd_class(&g->g_pd) != canvas_class &&
+            pd_class(&g->g_pd)->c_externdir == externdir)
+                remakeit = 1;
         if (remakeit)
         {
                 /* Bugfix for cases where canvas_vis doesn't actually create a
@@ -1759,10 +1903,8 @@ static void glist_doreload(t_glist *gl, t_symbol *name, t_symbol *dir,
                 canvas_vis(glist_getcanvas(gl), 1);
             }
             if (!found)
-            {
                 glist_noselect(gl);
-                found = 1;
-            }
+            found++;
             glist_select(gl, g);
         }
     }
@@ -1779,14 +1921,16 @@ static void glist_doreload(t_glist *gl, t_symbol *name, t_symbol *dir,
     for (g = gl->gl_list; g; g = g->g_next)
     {
         if (g != except && pd_class(&g->g_pd) == canvas_class &&
-            (!canvas_isabstraction((t_canvas *)g) ||
+            (externdir || !canvas_isabstraction((t_canvas *)g) ||
                  ((t_canvas *)g)->gl_name != name ||
-                 canvas_getdir((t_canvas *)g) != dir)
+                 (dir && canvas_getdir((t_canvas *)g) != dir))
            )
-                glist_doreload((t_canvas *)g, name, dir, except);
+                found += glist_doreload((t_canvas *)g, name, dir, except,
+                    externdir);
     }
     if (!hadwindow && gl->gl_havewindow)
         canvas_vis(glist_getcanvas(gl), 0);
+    return (found);
 }
 
     /* call canvas_doreload on everyone */
@@ -1801,7 +1945,7 @@ void canvas_reload(t_symbol *name, t_symbol *dir, t_glist *except)
     THISGUI->i_reloadingabstraction = except;
         /* find all root canvases */
     for (x = pd_getcanvaslist(); x; x = x->gl_next)
-        glist_doreload(x, name, dir, &except->gl_gobj);
+        glist_doreload(x, name, dir, &except->gl_gobj, 0);
     THISGUI->i_reloadingabstraction = 0;
     if(b)
     {
@@ -1812,6 +1956,49 @@ void canvas_reload(t_symbol *name, t_symbol *dir, t_glist *except)
     canvas_resume_dsp(dspwas);
 }
 
+    /* "reload <name>" message to Pd: load an external or abstraction again
+       and remake everything made from it, keeping connections.  DSP is
+       rebuilt once, at the end. */
+void glob_reload(void *dummy, t_symbol *s)
+{
+    t_canvas *x;
+    t_symbol *externdir, *name = s;
+    int dspwas = canvas_suspend_dsp(), found = 0;
+    t_binbuf*b = 0;
+    const char *slash = strrchr(s->s_name, '/');
+    if(EDITOR->copy_binbuf)
+        b = binbuf_duplicate(EDITOR->copy_binbuf);
+    if (!(externdir = sys_reload_lib(s)))
+    {
+            /* an abstraction: match "name.pd" in any directory */
+        char buf[MAXPDSTRING];
+        const char *dot;
+        if (slash)
+            s = gensym(slash + 1);
+        dot = strrchr(s->s_name, '.');
+        if (!dot || (strcmp(dot, ".pd") && strcmp(dot, ".pat")))
+        {
+            snprintf(buf, MAXPDSTRING, "%s.pd", s->s_name);
+            s = gensym(buf);
+        }
+        binbuf_forgetcached(s->s_name);
+    }
+    for (x = pd_getcanvaslist(); x; x = x->gl_next)
+        found += glist_doreload(x, s, 0, 0, externdir);
+    if(b)
+    {
+        if(EDITOR->copy_binbuf)
+            binbuf_free(EDITOR->copy_binbuf);
+        EDITOR->copy_binbuf = b;
+    }
+    canvas_resume_dsp(dspwas);
+    if (externdir || found)
+        post("reload %s: remade %d object%s", name->s_name, found,
+            (found == 1 ? "" : "s"));
+    else pd_error(0, "reload %s: no such external or abstraction in use",
+        name->s_name);
+}
+
 /* ------------------------ event handling ------------------------ */
 
 static const char *cursorlist[] = {
@@ -1915,6 +2102,7 @@ static t_editor *editor_new(t_glist *owner)
 static void editor_free(t_editor *x, t_glist *y)
 {
     glist_noselect(y);
+    freebytes(x->e_selhash, x->e_selhashsize * sizeof(*x->e_selhash));
     guiconnect_notarget(x->e_guiconnect, 1000);
     binbuf_free(x->e_connectbuf);
     binbuf_free(x->e_deleted);
@@ -2615,7 +2803,10 @@ static int tryconnect(t_canvas*x, t_object*src, int nout, t_object*sink, int nin
 {
     if(canconnect(x, src, nout, sink, nin))
     {
-        t_outconnect *oc = obj_connect(src, nout, sink, nin);
+        t_outconnect *oc;
+        THISGUI->i_dspedit = x;
+        oc = obj_connect(src, nout, sink, nin);
+        THISGUI->i_dspedit = 0;
         if(oc)
         {
             int iow = IOWIDTH * x->gl_zoom;
@@ -3590,6 +3781,7 @@ void canvas_stowconnections(t_canvas *x)
         /* move the selected part to the end */
     if (!nonhead) x->gl_list = selhead;
     else x->gl_list = nonhead, nontail->g_next = selhead;
+    x->gl_order++;
 
         /* add connections to binbuf */
     binbuf_clear(x->gl_editor->e_connectbuf);
@@ -4311,10 +4503,8 @@ void canvas_connect(t_canvas *x, t_floatarg fwhoout, t_floatarg foutno,
     int nin = whoin, nout = whoout;
     if (EDITOR->paste_canvas == x) whoout += EDITOR->paste_onset,
         whoin += EDITOR->paste_onset;
-    for (src = x->gl_list; whoout; src = src->g_next, whoout--)
-        if (!src->g_next) goto bad; /* bug fix thanks to Hannes */
-    for (sink = x->gl_list; whoin; sink = sink->g_next, whoin--)
-        if (!sink->g_next) goto bad;
+    if (!(src = glist_nth(x, whoout)) || !(sink = glist_nth(x, whoin)))
+        goto bad;
 
         /* check they're both patchable objects */
     if (!(objsrc = pd_checkobject(&src->g_pd)) ||
@@ -4330,7 +4520,10 @@ void canvas_connect(t_canvas *x, t_floatarg fwhoout, t_floatarg foutno,
         while (inno >= obj_ninlets(objsink))
             inlet_new(objsink, &objsink->ob_pd, 0, 0);
 
-    if (!(oc = obj_connect(objsrc, outno, objsink, inno))) goto bad;
+    THISGUI->i_dspedit = x;
+    oc = obj_connect(objsrc, outno, objsink, inno);
+    THISGUI->i_dspedit = 0;
+    if (!oc) goto bad;
     if (glist_isvisible(x))
     {
         sys_vgui(
@@ -30,12 +30,9 @@ void glist_add(t_glist *x, t_gobj *y)
     t_object *ob;
     y->g_next = 0;
     if (!x->gl_list) x->gl_list = y;
-    else
-    {
-        t_gobj *y2;
-        for (y2 = x->gl_list; y2->g_next; y2 = y2->g_next);
-        y2->g_next = y;
-    }
+    else glist_nth(x, canvas_getindex(x, 0) - 1)->g_next = y;
+    x->gl_order++;
+    glist_indexadd(x, y);
     if (x->gl_editor && (ob = pd_checkobject(&y->g_pd)))
         rtext_new(x, ob);
     if (x->gl_editor && x->gl_isgraph && !x->gl_goprect
@@ -47,8 +44,7 @@ void glist_add(t_glist *x, t_gobj *y)
     if (glist_isvisible(x))
         gobj_vis(y, x, 1);
     if (class_isdrawcommand(y->g_pd))
-        canvas_redrawallfortemplate(template_findbyname(canvas_makebindsym(
-            glist_getcanvas(x)->gl_name)), 0);
+        canvas_redrawallfortemplatecanvas(glist_getcanvas(x), 0);
 }
 
     /* this is to protect against a hairy problem in which deleting
@@ -112,13 +108,13 @@ void glist_delete(t_glist *x, t_gobj *y)
         /* if we're a drawing command, erase all scalars now, before deleting
         it; we'll redraw them once it's deleted below. */
     if (drawcommand)
-        canvas_redrawallfortemplate(template_findbyname(canvas_makebindsym(
-            glist_getcanvas(x)->gl_name)), 2);
+        canvas_redrawallfortemplatecanvas(glist_getcanvas(x), 2);
     gobj_delete(y, x);
     if (glist_isvisible(canvas))
     {
         gobj_vis(y, x, 0);
     }
+    else glist_uncull(x, y);
     if (x->gl_editor && (ob = pd_checkobject(&y->g_pd)) &&
         !(rtext = glist_findrtext(x, ob)))
             rtext = rtext_new(x, ob);
@@ -129,15 +125,26 @@ void glist_delete(t_glist *x, t_gobj *y)
         g->g_next = y->g_next;
         break;
     }
+    x->gl_order++;
     if (y->g_pd == scalar_class)
-        x->gl_valid = ++glist_valid;
+        x->gl_valid = glist_newvalid();
+        /* DSP objects elsewhere may be using what this one shares; then
+        the update below can't stay inside this canvas (garray_free() does
+        the same for arrays) */
+    if (chkdsp && (class_getdspflags(pd_class(&y->g_pd)) & CLASS_DSPSHARED))
+        THISGUI->i_dspshared = 1;
     pd_free(&y->g_pd);
     if (rtext)
         rtext_free(rtext);
-    if (chkdsp) canvas_update_dsp();
+    if (chkdsp)
+    {
+        t_glist *was = THISGUI->i_dspedit;
+        THISGUI->i_dspedit = x;
+        canvas_update_dsp();
+        THISGUI->i_dspedit = was;
+    }
     if (drawcommand)
-        canvas_redrawallfortemplate(template_findbyname(canvas_makebindsym(
-            glist_getcanvas(x)->gl_name)), 1);
+        canvas_redrawallfortemplatecanvas(glist_getcanvas(x), 1);
     canvas_setdeleting(canvas, wasdeleting);
 }
 
@@ -153,14 +160,14 @@ void glist_clear(t_glist *x)
             only if we hit a patchable object. */
         if (!suspended && pd_checkobject(&y->g_pd) && zgetfn(&y->g_pd, dspsym))
         {
-            dspstate = canvas_suspend_dsp();
+            dspstate = canvas_suspend_dspfor(x);
             suspended = 1;
         }
             /* here's the real deletion. */
         glist_delete(x, y);
     }
     if (suspended)
-        canvas_resume_dsp(dspstate);
+        canvas_resume_dspfor(x, dspstate);
 }
 
 void glist_retext(t_glist *glist, t_text *y)
@@ -283,7 +290,10 @@ void glist_sort(t_glist *x)
         nitems++;
     }
     if (foo)
+    {
         x->gl_list = glist_dosort(x, x->gl_list, nitems);
+        x->gl_order++;
+    }
 }
 
 /* --------------- inlets and outlets  ----------- */
@@ -17,6 +17,7 @@ life elsewhere. */
 #include "g_canvas.h"
 #include <string.h>
 void signal_setborrowed(t_signal *sig, t_signal *sig2);
+t_signal *signal_newfromcontext(int borrowed);
 void signal_makereusable(t_signal *sig);
 
 /* ------------------------- vinlet -------------------------- */
@@ -29,10 +30,11 @@ typedef struct _vinlet
     t_inlet *x_inlet;
     int x_bufsize;
     t_sample *x_buf;         /* signal buffer; zero if not a signal */
-    t_sample *x_endbuf;
+    t_sample *x_endbuf;      /* end of the ring, start of its mirror */
     t_sample *x_fill;
     t_sample *x_read;
     int x_hop;
+    t_sample *x_window;      /* block~'s analysis window if any */
   /* if not reblocking, the next slot communicates the parent's inlet
      signal from the prolog to the DSP routine: */
     t_signal *x_directsignal;
@@ -51,33 +53,41 @@ static void *vinlet_new(t_symbol *s)
     return (x);
 }
 
+void canvas_dspwake(t_canvas *x);
+
 static void vinlet_bang(t_vinlet *x)
 {
+    canvas_dspwake(x->x_canvas);
     outlet_bang(x->x_obj.ob_outlet);
 }
 
 static void vinlet_pointer(t_vinlet *x, t_gpointer *gp)
 {
+    canvas_dspwake(x->x_canvas);
     outlet_pointer(x->x_obj.ob_outlet, gp);
 }
 
 static void vinlet_float(t_vinlet *x, t_float f)
 {
+    canvas_dspwake(x->x_canvas);
     outlet_float(x->x_obj.ob_outlet, f);
 }
 
 static void vinlet_symbol(t_vinlet *x, t_symbol *s)
 {
+    canvas_dspwake(x->x_canvas);
     outlet_symbol(x->x_obj.ob_outlet, s);
 }
 
 static void vinlet_list(t_vinlet *x, t_symbol *s, int argc, t_atom *argv)
 {
+    canvas_dspwake(x->x_canvas);
     outlet_list(x->x_obj.ob_outlet, s, argc, argv);
 }
 
 static void vinlet_anything(t_vinlet *x, t_symbol *s, int argc, t_atom *argv)
 {
+    canvas_dspwake(x->x_canvas);
     outlet_anything(x->x_obj.ob_outlet, s, argc, argv);
 }
 
@@ -85,7 +95,7 @@ static void vinlet_free(t_vinlet *x)
 {
     canvas_rminlet(x->x_canvas, x->x_inlet);
     if (x->x_buf)
-        t_freebytes(x->x_buf, x->x_bufsize * sizeof(*x->x_buf));
+        t_freebytes(x->x_buf, 2 * x->x_bufsize * sizeof(*x->x_buf));
     resample_free(&x->x_updown);
 }
 
@@ -101,6 +111,9 @@ int vinlet_issignal(t_vinlet *x)
     return (x->x_buf != 0);
 }
 
+    /* when reblocking, the buffer is a ring of x_bufsize samples followed
+    by a mirror of it, so that the block's input can be read straight out
+    of it however far the ring has turned. */
 t_int *vinlet_perform(t_int *w)
 {
     t_vinlet *x = (t_vinlet *)(w[1]);
@@ -108,7 +121,20 @@ t_int *vinlet_perform(t_int *w)
     int n = (int)(w[3]);
     t_sample *in = x->x_read;
     while (n--) *out++ = *in++;
-    if (in == x->x_endbuf) in = x->x_buf;
+    if (in >= x->x_endbuf) in -= x->x_bufsize;
+    x->x_read = in;
+    return (w+4);
+}
+
+    /* same, applying block~'s window on the way out */
+static t_int *vinlet_perform_window(t_int *w)
+{
+    t_vinlet *x = (t_vinlet *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    int n = (int)(w[3]);
+    t_sample *in = x->x_read, *win = x->x_window;
+    while (n--) *out++ = *in++ * *win++;
+    if (in >= x->x_endbuf) in -= x->x_bufsize;
     x->x_read = in;
     return (w+4);
 }
@@ -133,28 +159,28 @@ static void vinlet_dsp(t_vinlet *x, t_signal **sp)
     }
     else
     {
-        dsp_add(vinlet_perform, 3, x, outsig->s_vec, outsig->s_vecsize);
+        dsp_add((x->x_window ? vinlet_perform_window : vinlet_perform), 3,
+            x, outsig->s_vec, outsig->s_vecsize);
         x->x_read = x->x_buf;
     }
 }
 
-    /* prolog code: loads buffer from parent patch */
+    /* prolog code: loads buffer from parent patch.  Each sample goes into
+    the ring and its mirror, so nothing ever has to be shifted down; the
+    block then reads the latest x_bufsize samples starting from the oldest
+    one, which is where the next incoming sample will go. */
 t_int *vinlet_doprolog(t_int *w)
 {
     t_vinlet *x = (t_vinlet *)(w[1]);
     t_sample *in = (t_sample *)(w[2]);
     int n = (int)(w[3]);
-    t_sample *out = x->x_fill;
+    t_sample *out = x->x_fill, *mirror;
     if (out == x->x_endbuf)
-    {
-        t_sample *f1 = x->x_buf, *f2 = x->x_buf + x->x_hop;
-        int nshift = x->x_bufsize - x->x_hop;
-        out -= x->x_hop;
-        while (nshift--) *f1++ = *f2++;
-    }
-
-    while (n--) *out++ = *in++;
+        out = x->x_buf;
+    mirror = out + x->x_bufsize;
+    while (n--) *out++ = *mirror++ = *in++;
     x->x_fill = out;
+    x->x_read = (out == x->x_endbuf ? x->x_buf : out);
     return (w+4);
 }
 
@@ -163,7 +189,8 @@ int inlet_getsignalindex(t_inlet *x);
         /* set up prolog DSP code  */
 void vinlet_dspprolog(struct _vinlet *x, t_signal **parentsigs,
     int myvecsize, int calcsize, int phase, int period, int frequency,
-    int downsample, int upsample,  int reblock, int switched)
+    int downsample, int upsample, int quality, int reblock, int switched,
+    t_sample *window)
 {
     t_signal *insig;
         /* no buffer means we're not a signal inlet */
@@ -171,6 +198,7 @@ void vinlet_dspprolog(struct _vinlet *x, t_signal **parentsigs,
         return;
     x->x_updown.downsample = downsample;
     x->x_updown.upsample   = upsample;
+    x->x_window = (reblock ? window : 0);
 
         /* if the "reblock" flag is set, arrange to copy data in from the
         parent. */
@@ -188,7 +216,10 @@ void vinlet_dspprolog(struct _vinlet *x, t_signal **parentsigs,
         if (parentsigs)
         {
             insig = parentsigs[inlet_getsignalindex(x->x_inlet)];
-            parentvecsize = insig->s_vecsize;
+                /* only the first channel of a multichannel signal is
+                reblocked */
+            parentvecsize = (insig->s_nchans > 1 ?
+                insig->s_n : insig->s_vecsize);
             re_parentvecsize = parentvecsize * upsample / downsample;
         }
         else
@@ -203,9 +234,9 @@ void vinlet_dspprolog(struct _vinlet *x, t_signal **parentsigs,
         if (bufsize != (oldbufsize = x->x_bufsize))
         {
             t_sample *buf = x->x_buf;
-            t_freebytes(buf, oldbufsize * sizeof(*buf));
-            buf = (t_sample *)t_getbytes(bufsize * sizeof(*buf));
-            memset((char *)buf, 0, bufsize * sizeof(*buf));
+            t_freebytes(buf, 2 * oldbufsize * sizeof(*buf));
+            buf = (t_sample *)t_getbytes(2 * bufsize * sizeof(*buf));
+            memset((char *)buf, 0, 2 * bufsize * sizeof(*buf));
             x->x_bufsize = bufsize;
             x->x_endbuf = buf + bufsize;
             x->x_buf = buf;
@@ -222,8 +253,11 @@ void vinlet_dspprolog(struct _vinlet *x, t_signal **parentsigs,
                     dsp_add(vinlet_doprolog, 3, x, insig->s_vec,
                         re_parentvecsize);
             else {
+                /* the default method is sample/hold, or the polyphase
+                filter if the block~ asked for high quality */
               int method = (x->x_updown.method == 3?
-                (pd_compatibilitylevel < 44 ? 0 : 1) : x->x_updown.method);
+                (quality ? 4 : (pd_compatibilitylevel < 44 ? 0 : 1)) :
+                    x->x_updown.method);
               resamplefrom_dsp(&x->x_updown, insig->s_vec, parentvecsize,
                 re_parentvecsize, method);
               dsp_add(vinlet_doprolog, 3, x, x->x_updown.s_vec,
@@ -235,7 +269,8 @@ void vinlet_dspprolog(struct _vinlet *x, t_signal **parentsigs,
             if (!insig->s_refcount)
                 signal_makereusable(insig);
         }
-        else memset((char *)(x->x_buf), 0, bufsize * sizeof(*x->x_buf));
+        else memset((char *)(x->x_buf), 0,
+            2 * bufsize * sizeof(*x->x_buf));
         x->x_directsignal = 0;
     }
     else
@@ -254,6 +289,7 @@ static void *vinlet_newsig(t_symbol *s)
     x->x_endbuf = x->x_buf = (t_sample *)getbytes(0);
     x->x_bufsize = 0;
     x->x_directsignal = 0;
+    x->x_window = 0;
     x->x_fwdout = 0;
     outlet_new(&x->x_obj, &s_signal);
     inlet_new(&x->x_obj, (t_pd *)x->x_inlet, 0, 0);
@@ -264,6 +300,7 @@ static void *vinlet_newsig(t_symbol *s)
      * maybe indices would be better...
      *
      * up till now we provide several upsampling methods and 1 single downsampling method (no filtering !)
+     * except for "high", which filters in both directions
      */
     if (s == gensym("hold"))
         x->x_updown.method = 1;       /* up: sample and hold */
@@ -271,6 +308,8 @@ static void *vinlet_newsig(t_symbol *s)
         x->x_updown.method = 2;       /* up: linear interpolation */
     else if (s == gensym("pad"))
         x->x_updown.method = 0;       /* up: zero-padding */
+    else if (s == gensym("high"))
+        x->x_updown.method = 4;       /* up and down: polyphase filter */
     else x->x_updown.method = 3;      /* sample/hold unless version<0.44 */
 
     if (s == gensym("fwd"))         /* turn on forwarding */
@@ -311,6 +350,8 @@ typedef struct _voutlet
     t_sample *x_empty;       /* next to read out of buffer in epilog code */
     t_sample *x_write;       /* next to write in to buffer */
     int x_hop;              /* hopsize */
+    t_sample *x_window;      /* block~'s synthesis window if any */
+    char x_overlapped;      /* true if successive blocks overlap */
         /* vice versa from the inlet, if we don't block, this holds the
         parent's outlet signal, valid between the prolog and the dsp setup
         routines.  */
@@ -383,18 +424,55 @@ int voutlet_issignal(t_voutlet *x)
     return (x->x_buf != 0);
 }
 
-    /* LATER optimize for non-overlapped case where the "+=" isn't needed */
+    /* overlap-add the block into the ring buffer in place, in at most two
+    runs split where the ring wraps around.  The epilog zeroes what it
+    empties, so if blocks don't overlap we can just copy. */
 t_int *voutlet_perform(t_int *w)
 {
     t_voutlet *x = (t_voutlet *)(w[1]);
     t_sample *in = (t_sample *)(w[2]);
-    int n = (int)(w[3]);
+    int n = (int)(w[3]), n2;
     t_sample *out = x->x_write, *outwas = out;
-    while (n--)
-    {
-        *out++ += *in++;
-        if (out == x->x_endbuf) out = x->x_buf;
-    }
+    if ((n2 = n - (int)(x->x_endbuf - out)) > 0)
+        n -= n2;
+    else n2 = 0;
+    while (n--) *out++ += *in++;
+    for (out = x->x_buf; n2--; ) *out++ += *in++;
+    outwas += x->x_hop;
+    if (outwas >= x->x_endbuf) outwas = x->x_buf;
+    x->x_write = outwas;
+    return (w+4);
+}
+
+static t_int *voutlet_perform_copy(t_int *w)
+{
+    t_voutlet *x = (t_voutlet *)(w[1]);
+    t_sample *in = (t_sample *)(w[2]);
+    int n = (int)(w[3]), n2;
+    t_sample *out = x->x_write, *outwas = out;
+    if ((n2 = n - (int)(x->x_endbuf - out)) > 0)
+        n -= n2;
+    else n2 = 0;
+    memcpy(out, in, n * sizeof(*out));
+    memcpy(x->x_buf, in + n, n2 * sizeof(*out));
+    outwas += x->x_hop;
+    if (outwas >= x->x_endbuf) outwas = x->x_buf;
+    x->x_write = outwas;
+    return (w+4);
+}
+
+    /* overlap-add, applying block~'s window on the way in */
+static t_int *voutlet_perform_window(t_int *w)
+{
+    t_voutlet *x = (t_voutlet *)(w[1]);
+    t_sample *in = (t_sample *)(w[2]);
+    int n = (int)(w[3]), n2;
+    t_sample *out = x->x_write, *outwas = out, *win = x->x_window;
+    if ((n2 = n - (int)(x->x_endbuf - out)) > 0)
+        n -= n2;
+    else n2 = 0;
+    while (n--) *out++ += *in++ * *win++;
+    for (out = x->x_buf; n2--; ) *out++ += *in++ * *win++;
     outwas += x->x_hop;
     if (outwas >= x->x_endbuf) outwas = x->x_buf;
     x->x_write = outwas;
@@ -437,7 +515,7 @@ int outlet_getsignalindex(t_outlet *x);
         called later.  */
 void voutlet_dspprolog(struct _voutlet *x, t_signal **parentsigs,
     int myvecsize, int calcsize, int phase, int period, int frequency,
-    int downsample, int upsample, int reblock, int switched)
+    int downsample, int upsample, int reblock, int switched, t_sample *window)
 {
         /* no buffer means we're not a signal outlet */
     if (!x->x_buf)
@@ -445,9 +523,22 @@ void voutlet_dspprolog(struct _voutlet *x, t_signal **parentsigs,
     x->x_updown.downsample=downsample;
     x->x_updown.upsample=upsample;
     x->x_justcopyout = (switched && !reblock);
+    x->x_window = (reblock ? window : 0);
+    x->x_overlapped = 1;
     if (reblock)
     {
         x->x_directsignal = 0;
+            /* find the hop size the epilog setup will arrive at, so that
+            our DSP method can tell whether it has to add or can copy */
+        if (parentsigs)
+        {
+            t_signal *outsig =
+                parentsigs[outlet_getsignalindex(x->x_parentoutlet)];
+            int re_parentvecsize = outsig->s_vecsize * upsample / downsample;
+            int hop = (period == 1 && frequency > 1 ?
+                re_parentvecsize / frequency : period * re_parentvecsize);
+            x->x_overlapped = (hop < myvecsize);
+        }
     }
     else
     {
@@ -462,8 +553,19 @@ static void voutlet_dsp(t_voutlet *x, t_signal **sp)
     t_signal *insig;
     if (!x->x_buf) return;
     insig = sp[0];
-    if (x->x_justcopyout)
-        dsp_add_copy(insig->s_vec, x->x_directsignal->s_vec, insig->s_n);
+        /* if we're switched we can still hand our input to the parent
+        (whose epilog zeros it when we're off) unless it's borrowed from
+        somewhere else, which we mustn't overwrite.  In that case make the
+        parent a signal of its own and copy into it. */
+    if (x->x_justcopyout && insig->s_isborrowed)
+    {
+        t_signal *copy = signal_newfromcontext(0);
+        signal_setmultiout(&copy, insig->s_nchans);
+        signal_setborrowed(x->x_directsignal, copy);
+        x->x_directsignal->s_refcount++;
+        dsp_add_copy(insig->s_vec, x->x_directsignal->s_vec,
+            insig->s_n * insig->s_nchans);
+    }
     else if (x->x_directsignal)
     {
             /* if we're just going to make the signal available on the
@@ -471,8 +573,10 @@ static void voutlet_dsp(t_voutlet *x, t_signal **sp)
         /* this is done elsewhere--> sp[0]->s_refcount++; */
         signal_setborrowed(x->x_directsignal, sp[0]);
     }
-    else
-        dsp_add(voutlet_perform, 3, x, insig->s_vec, insig->s_n);
+    else if (x->x_window)
+        dsp_add(voutlet_perform_window, 3, x, insig->s_vec, insig->s_n);
+    else dsp_add((x->x_overlapped ? voutlet_perform : voutlet_perform_copy),
+        3, x, insig->s_vec, insig->s_n);
 }
 
         /* set up epilog DSP code.  If we're reblocking, this is the
@@ -480,7 +584,7 @@ static void voutlet_dsp(t_voutlet *x, t_signal **sp)
         If we aren't reblocking, there's nothing to do here.  */
 void voutlet_dspepilog(struct _voutlet *x, t_signal **parentsigs,
     int myvecsize, int calcsize, int phase, int period, int frequency,
-    int downsample, int upsample, int reblock, int switched)
+    int downsample, int upsample, int quality, int reblock, int switched)
 {
     if (!x->x_buf) return;  /* this shouldn't be necesssary... */
     x->x_updown.downsample=downsample;
@@ -537,7 +641,8 @@ void voutlet_dspepilog(struct _voutlet *x, t_signal **parentsigs,
             else
             {
                 int method = (x->x_updown.method == 3?
-                    (pd_compatibilitylevel < 44 ? 0 : 1) : x->x_updown.method);
+                    (quality ? 4 : (pd_compatibilitylevel < 44 ? 0 : 1)) :
+                        x->x_updown.method);
                 dsp_add(voutlet_doepilog_resampling, 2, x, re_parentvecsize);
                 resampleto_dsp(&x->x_updown, outsig->s_vec, re_parentvecsize,
                     parentvecsize, method);
@@ -553,7 +658,7 @@ void voutlet_dspepilog(struct _voutlet *x, t_signal **parentsigs,
         {
             t_signal *outsig =
                 parentsigs[outlet_getsignalindex(x->x_parentoutlet)];
-            dsp_add_zero(outsig->s_vec, outsig->s_n);
+            dsp_add_zero(outsig->s_vec, outsig->s_n * outsig->s_nchans);
         }
     }
 }
@@ -567,6 +672,8 @@ static void *voutlet_newsig(t_symbol *s)
     inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
     x->x_endbuf = x->x_buf = (t_sample *)getbytes(0);
     x->x_bufsize = 0;
+    x->x_window = 0;
+    x->x_overlapped = 1;
 
     resample_init(&x->x_updown);
 
@@ -575,11 +682,13 @@ static void *voutlet_newsig(t_symbol *s)
      * maybe indices would be better...
      *
      * up till now we provide several upsampling methods and 1 single downsampling method (no filtering !)
+     * except for "high", which filters in both directions
      */
     if (s == gensym("hold"))x->x_updown.method=1;        /* up: sample and hold */
     else if (s == gensym("lin"))x->x_updown.method=2;    /* up: linear interpolation */
     else if (s == gensym("linear"))x->x_updown.method=2; /* up: linear interpolation */
     else if (s == gensym("pad"))x->x_updown.method=0;    /* up: zero pad */
+    else if (s == gensym("high"))x->x_updown.method=4;   /* polyphase filter */
     else x->x_updown.method=3;                           /* up: zero-padding; down: ignore samples inbetween */
 
     return (x);
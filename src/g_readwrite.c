@@ -441,7 +441,7 @@ void canvas_dataproperties(t_canvas *x, t_scalar *sc, t_binbuf *b)
         else newone->g_next = x->gl_list, x->gl_list = newone;
     }
 didit:
-    ;
+    x->gl_order++;
 }
 
     /* ----------- routines to write data to a binbuf ----------- */
@@ -797,7 +797,9 @@ static void canvas_savetofile(t_canvas *x, t_symbol *filename, t_symbol *dir,
 {
     t_binbuf *b = binbuf_new();
     canvas_savetemplatesto(x, b, 1);
+    garray_sidecarbegin(filename, dir);
     canvas_saveto(x, b);
+    garray_sidecarend();
     errno = 0;
     if (binbuf_write(b, filename->s_name, dir->s_name, 0))
         post("%s/%s: %s", dir->s_name, filename->s_name,
@@ -7,6 +7,7 @@
 #include <stdio.h>
 
 #include "m_pd.h"
+#include "s_stuff.h"
 #include "g_canvas.h"
 
 /*
@@ -81,6 +82,7 @@ static void template_conformarray(t_template *tfrom, t_template *tto,
     int *conformaction, t_array *a);
 static void template_conformglist(t_template *tfrom, t_template *tto,
     t_glist *glist,  int *conformaction);
+static int template_douses(t_template *x, t_template *other, int depth);
 
 /* ---------------------- storage ------------------------- */
 
@@ -102,6 +104,16 @@ static int dataslot_matches(t_dataslot *ds1, t_dataslot *ds2,
 
 /* -- templates, the active ingredient in gtemplates defined below. ------- */
 
+    /* Templates never change once made; they are replaced by new ones.  This
+    counts templates made and freed, so that objects that keep a template
+    and its field onsets around can tell when to look them up again. */
+static PERTHREAD unsigned long template_stamp;
+
+unsigned long template_getstamp(void)
+{
+    return (template_stamp);
+}
+
     /* add a template to the list */
 static void template_addtolist(t_template *x)
 {
@@ -125,6 +137,7 @@ static void template_takeofflist(t_template *x)
 t_template *template_new(t_symbol *templatesym, int argc, t_atom *argv)
 {
     t_template *x = (t_template *)pd_new(template_class);
+    template_stamp++;
     x->t_n = 0;
     x->t_vec = (t_dataslot *)t_getbytes(0);
     x->t_next = 0;
@@ -319,9 +332,11 @@ static void template_conformwords(t_template *tfrom, t_template *tto,
     }
 }
 
-    /* conform a scalar, recursively conforming arrays  */
+    /* conform a scalar, recursively conforming arrays.  "prev" is the
+    object before it in the glist (zero if it's first) so that we can swap
+    in the new one without searching the list for it. */
 static t_scalar *template_conformscalar(t_template *tfrom, t_template *tto,
-    int *conformaction, t_glist *glist, t_scalar *scfrom)
+    int *conformaction, t_glist *glist, t_gobj *prev, t_scalar *scfrom)
 {
     t_scalar *x;
     t_gpointer gp;
@@ -346,24 +361,11 @@ static t_scalar *template_conformscalar(t_template *tfrom, t_template *tto,
             scfrom->sc_vec, x->sc_vec);
 
             /* replace the old one with the new one in the list */
-        if (glist->gl_list == &scfrom->sc_gobj)
-        {
-            glist->gl_list = &x->sc_gobj;
-            x->sc_gobj.g_next = scfrom->sc_gobj.g_next;
-        }
-        else
-        {
-            t_gobj *y, *y2;
-            for (y = glist->gl_list; (y2 = y->g_next); y = y2)
-                if (y2 == &scfrom->sc_gobj)
-            {
-                x->sc_gobj.g_next = y2->g_next;
-                y->g_next = &x->sc_gobj;
-                goto nobug;
-            }
-            bug("template_conformscalar");
-        nobug: ;
-        }
+        x->sc_gobj.g_next = scfrom->sc_gobj.g_next;
+        if (prev)
+            prev->g_next = &x->sc_gobj;
+        else glist->gl_list = &x->sc_gobj;
+        glist->gl_order++;
             /* burn the old one */
         pd_free(&scfrom->sc_gobj.g_pd);
         scalartemplate = tto;
@@ -372,6 +374,9 @@ static t_scalar *template_conformscalar(t_template *tfrom, t_template *tto,
     {
         x = scfrom;
         scalartemplate = template_findbyname(x->sc_template);
+            /* nothing to do unless it has arrays of the template inside */
+        if (!template_douses(scalartemplate, tfrom, 0))
+            return (x);
     }
         /* convert all array elements */
     for (i = 0; i < scalartemplate->t_n; i++)
@@ -411,13 +416,25 @@ static void template_conformarray(t_template *tfrom, t_template *tto,
         }
         scalartemplate = tto;
         a->a_vec = newarray;
-        freebytes(oldarray, oldelemsize * a->a_n);
+        a->a_elemsize = newelemsize;
+        array_freevec(a, oldarray, oldelemsize * a->a_nalloc);
+        a->a_nalloc = a->a_n;
     }
     else scalartemplate = template_findbyname(a->a_templatesym);
-        /* convert all arrays and sublist fields in each element of the array */
+        /* convert all arrays and sublist fields in each element of the
+        array, unless there can't be any of the template down there */
+    if (!scalartemplate)
+        return;
+    for (j = 0; j < scalartemplate->t_n; j++)
+        if (scalartemplate->t_vec[j].ds_type == DT_ARRAY &&
+            template_douses(template_findbyname(
+                scalartemplate->t_vec[j].ds_arraytemplate), tfrom, 0))
+                    break;
+    if (j == scalartemplate->t_n)
+        return;
     for (i = 0; i < a->a_n; i++)
     {
-        t_word *wp = (t_word *)(a->a_vec + sizeof(t_word) * a->a_n * i);
+        t_word *wp = (t_word *)(a->a_vec + a->a_elemsize * i);
         for (j = 0; j < scalartemplate->t_n; j++)
         {
             t_dataslot *ds = scalartemplate->t_vec + j;
@@ -440,13 +457,13 @@ t_array *garray_getarray(t_garray *x);
 static void template_conformglist(t_template *tfrom, t_template *tto,
     t_glist *glist,  int *conformaction)
 {
-    t_gobj *g;
+    t_gobj *g, *prev = 0;
     /* post("conform glist %s", glist->gl_name->s_name); */
-    for (g = glist->gl_list; g; g = g->g_next)
+    for (g = glist->gl_list; g; prev = g, g = g->g_next)
     {
         if (pd_class(&g->g_pd) == scalar_class)
             g = &template_conformscalar(tfrom, tto, conformaction,
-                glist, (t_scalar *)g)->sc_gobj;
+                glist, prev, (t_scalar *)g)->sc_gobj;
         else if (pd_class(&g->g_pd) == canvas_class)
             template_conformglist(tfrom, tto, (t_glist *)g, conformaction);
         else if (pd_class(&g->g_pd) == garray_class)
@@ -511,6 +528,29 @@ t_template *template_findbyname(t_symbol *s)
     return ((t_template *)pd_findbyclass(s, template_class));
 }
 
+    /* check whether scalars of template x are drawn using "other", either
+    because it's x itself or the element template of one of x's arrays (at
+    any depth, short of going around in circles). */
+static int template_douses(t_template *x, t_template *other, int depth)
+{
+    int i;
+    t_dataslot *ds;
+    if (x == other)
+        return (1);
+    if (!x || depth > 100)
+        return (0);
+    for (i = 0, ds = x->t_vec; i < x->t_n; i++, ds++)
+        if (ds->ds_type == DT_ARRAY && template_douses(
+            template_findbyname(ds->ds_arraytemplate), other, depth + 1))
+                return (1);
+    return (0);
+}
+
+int template_uses(t_template *x, t_template *other)
+{
+    return (template_douses(x, other, 0));
+}
+
 t_canvas *template_findcanvas(t_template *template)
 {
     t_gtemplate *gt;
@@ -591,6 +631,7 @@ static void *template_usetemplate(void *dummy, t_symbol *s,
     /* here we assume someone has already cleaned up all instances of this. */
 void template_free(t_template *x)
 {
+    template_stamp++;
     if (*x->t_sym->s_name)
         pd_unbind(&x->t_pdobj, x->t_sym);
     t_freebytes(x->t_vec, x->t_n * sizeof(*x->t_vec));
@@ -725,6 +766,7 @@ static void gtemplate_free(t_gtemplate *x)
             z->t_list = x->x_next;
             for (y = z->t_list; y ; y = y->x_next)
                 y->x_template = z;
+            t = z;
         }
         else t->t_list = 0;
         canvas_redrawallfortemplate(t, 1);
@@ -1732,6 +1774,56 @@ static void plot_activate(t_gobj *z, t_glist *glist,
 
 #define CLIP(x) ((x) < 1e20 && (x) > -1e20 ? x : 0)
 
+/* An array without an "x" field that has many more elements than its graph
+has pixels is plotted a pixel at a time, from the minimum and maximum of the
+elements falling into each (see array_getpeaks()), so that redrawing it takes
+time in proportion to the width of the graph, not the size of the array. */
+
+typedef struct _plotxmap
+{
+    t_glist *m_glist;
+    t_fielddesc *m_fielddesc;
+    t_float m_base;         /* added after converting to coordinates */
+    t_float m_x0;           /* x value of the first element */
+    t_float m_xinc;         /* ... and increment per element */
+    int m_round;            /* round pixels (or else truncate) */
+} t_plotxmap;
+
+static int plot_ixpix(t_plotxmap *m, int i)
+{
+    t_float xpix = glist_xtopixels(m->m_glist, m->m_base +
+        fielddesc_cvttocoord(m->m_fielddesc, m->m_x0 + i * m->m_xinc));
+    return (m->m_round ? (int)(xpix + 0.5) : (int)xpix);
+}
+
+    /* how many elements fall into each pixel */
+static t_float plot_perpixel(t_plotxmap *m, int nelem)
+{
+    t_float dx = glist_xtopixels(m->m_glist, m->m_base +
+        fielddesc_cvttocoord(m->m_fielddesc, m->m_x0 + m->m_xinc)) -
+        glist_xtopixels(m->m_glist, m->m_base +
+            fielddesc_cvttocoord(m->m_fielddesc, m->m_x0));
+    if (dx < 0)
+        dx = -dx;
+    return (dx * nelem > 1 ? 1. / dx : nelem);
+}
+
+    /* first element after "i" that falls into another pixel */
+static int plot_nextpixel(t_plotxmap *m, int i, int nelem, int ixpix,
+    t_float perpixel)
+{
+    int next = i + (int)perpixel;
+    if (next <= i)
+        next = i + 1;
+    if (next > nelem)
+        next = nelem;
+    while (next < nelem && plot_ixpix(m, next) == ixpix)
+        next++;
+    while (next > i + 1 && plot_ixpix(m, next - 1) != ixpix)
+        next--;
+    return (next);
+}
+
 static void plot_vis(t_gobj *z, t_glist *glist,
     t_word *data, t_template *template, t_float basex, t_float basey,
     int tovis)
@@ -1774,8 +1866,23 @@ static void plot_vis(t_gobj *z, t_glist *glist,
     {
         if (style == PLOTSTYLE_POINTS)
         {
-            t_float minyval = 1e20, maxyval = -1e20;
-            int ndrawn = 0;
+            t_float minyval = 1e20, maxyval = -1e20, perpixel = 0;
+            int ndrawn = 0, binary = sys_binarycoords();
+            t_plotxmap xmap;
+                /* if the GUI can take binary coordinates, send all the
+                points in one go for pdtk_rectangles to draw */
+            if (binary)
+                sys_coordsbegin();
+            if (xonset < 0 && yonset >= 0)
+            {
+                xmap.m_glist = glist;
+                xmap.m_fielddesc = xfielddesc;
+                xmap.m_base = 0;
+                xmap.m_x0 = basex + xloc;
+                xmap.m_xinc = xinc;
+                xmap.m_round = 0;
+                perpixel = plot_perpixel(&xmap, nelem);
+            }
             for (xsum = basex + xloc, i = 0; i < nelem; i++)
             {
                 t_float yval, xpix, ypix, nextxloc;
@@ -1789,6 +1896,19 @@ static void plot_vis(t_gobj *z, t_glist *glist,
                         fielddesc_cvttocoord(xfielddesc, usexloc));
                     inextx = ixpix + 2;
                 }
+                else if (perpixel >= 2)
+                {
+                        /* take all the elements in this pixel at once and
+                        carry on below with the last one */
+                    int next;
+                    ixpix = plot_ixpix(&xmap, i);
+                    next = plot_nextpixel(&xmap, i, nelem, ixpix, perpixel);
+                    inextx = plot_ixpix(&xmap, next);
+                    array_getpeaks(array, yonset, i, next, &minyval, &maxyval);
+                    minyval = CLIP(yloc + minyval);
+                    maxyval = CLIP(yloc + maxyval);
+                    i = next - 1;
+                }
                 else
                 {
                     usexloc = xsum;
@@ -1809,20 +1929,33 @@ static void plot_vis(t_gobj *z, t_glist *glist,
                     maxyval = yval;
                 if (i == nelem-1 || inextx != ixpix)
                 {
-                    sys_vgui(".x%lx.c create rectangle %d %d %d %d "
+                    int iy1 = glist_ytopixels(glist,
+                        basey + fielddesc_cvttocoord(yfielddesc, minyval)),
+                        iy2 = glist_ytopixels(glist,
+                        basey + fielddesc_cvttocoord(yfielddesc, maxyval))
+                            + linewidth;
+                    if (binary)
+                    {
+                        sys_coordsadd(ixpix, iy1);
+                        sys_coordsadd(inextx, iy2);
+                    }
+                    else sys_vgui(".x%lx.c create rectangle %d %d %d %d "
                         "-fill black -width 0 -tags [list plot%lx array]\n",
-                        glist_getcanvas(glist),
-                        ixpix, (int)glist_ytopixels(glist,
-                            basey + fielddesc_cvttocoord(yfielddesc, minyval)),
-                        inextx, (int)(glist_ytopixels(glist,
-                            basey + fielddesc_cvttocoord(yfielddesc, maxyval))
-                                + linewidth), data);
+                        glist_getcanvas(glist), ixpix, iy1, inextx, iy2, data);
                     ndrawn++;
                     minyval = 1e20;
                     maxyval = -1e20;
                 }
                 if (ndrawn > 2000 || ixpix >= 3000) break;
             }
+            if (binary)
+            {
+                sys_vgui("pdtk_rectangles .x%lx.c \\\n",
+                    glist_getcanvas(glist));
+                sys_coordsend();
+                sys_vgui("-fill black -width 0 -tags [list plot%lx array]\n",
+                    data);
+            }
         }
         else
         {
@@ -1839,7 +1972,7 @@ static void plot_vis(t_gobj *z, t_glist *glist,
                     a filled polygon with 2n points. */
                 sys_vgui(".x%lx.c create polygon \\\n",
                     glist_getcanvas(glist));
-
+                sys_coordsbegin();
                 for (i = 0, xsum = xloc; i < nelem; i++)
                 {
                     if (xonset >= 0)
@@ -1857,7 +1990,7 @@ static void plot_vis(t_gobj *z, t_glist *glist,
                     ixpix = xpix + 0.5;
                     if (xonset >= 0 || ixpix != lastpixel)
                     {
-                        sys_vgui("%d %f \\\n", ixpix,
+                        sys_coordsadd(ixpix,
                             glist_ytopixels(glist,
                                 basey + fielddesc_cvttocoord(yfielddesc,
                                     yloc + yval) -
@@ -1886,7 +2019,7 @@ static void plot_vis(t_gobj *z, t_glist *glist,
                     ixpix = xpix + 0.5;
                     if (xonset >= 0 || ixpix != lastpixel)
                     {
-                        sys_vgui("%d %f \\\n", ixpix, glist_ytopixels(glist,
+                        sys_coordsadd(ixpix, glist_ytopixels(glist,
                             basey + yloc + fielddesc_cvttocoord(yfielddesc,
                                 yval) +
                                     fielddesc_cvttocoord(wfielddesc, wval)));
@@ -1899,16 +2032,17 @@ static void plot_vis(t_gobj *z, t_glist *glist,
                     There should be at least two already. */
                 if (ndrawn < 4)
                 {
-                    sys_vgui("%d %f \\\n", ixpix + 10, glist_ytopixels(glist,
+                    sys_coordsadd(ixpix + 10, glist_ytopixels(glist,
                         basey + yloc + fielddesc_cvttocoord(yfielddesc,
                             yval) +
                                 fielddesc_cvttocoord(wfielddesc, wval)));
-                    sys_vgui("%d %f \\\n", ixpix + 10, glist_ytopixels(glist,
+                    sys_coordsadd(ixpix + 10, glist_ytopixels(glist,
                         basey + yloc + fielddesc_cvttocoord(yfielddesc,
                             yval) -
                                 fielddesc_cvttocoord(wfielddesc, wval)));
                 }
             ouch:
+                sys_coordsend();
                 sys_vgui(" -width %d -fill %s -outline %s\\\n",
                     (glist->gl_isgraph ? glist_getzoom(glist) : 1),
                     outline, outline);
@@ -1921,9 +2055,52 @@ static void plot_vis(t_gobj *z, t_glist *glist,
                     /* no "w" field.  If the linewidth is positive, draw a
                     segmented line with the requested width; otherwise don't
                     draw the trace at all. */
+                t_plotxmap xmap;
+                t_float perpixel = 0;
                 sys_vgui(".x%lx.c create line \\\n", glist_getcanvas(glist));
-
-                for (xsum = xloc, i = 0; i < nelem; i++)
+                sys_coordsbegin();
+                if (xonset < 0 && yonset >= 0)
+                {
+                    xmap.m_glist = glist;
+                    xmap.m_fielddesc = xfielddesc;
+                    xmap.m_base = basex;
+                    xmap.m_x0 = xloc;
+                    xmap.m_xinc = xinc;
+                    xmap.m_round = 1;
+                    perpixel = plot_perpixel(&xmap, nelem);
+                }
+                if (perpixel >= 2)
+                {
+                        /* draw a vertical stroke from min to max in each
+                        pixel, starting from the end closest to where the
+                        last one ended */
+                    t_float min, max, ypix1, ypix2, lastypix = 0;
+                    int next;
+                    for (i = 0; i < nelem && ndrawn < 1000; i = next)
+                    {
+                        ixpix = plot_ixpix(&xmap, i);
+                        next = plot_nextpixel(&xmap, i, nelem, ixpix, perpixel);
+                        array_getpeaks(array, yonset, i, next, &min, &max);
+                        ypix1 = glist_ytopixels(glist, basey + yloc +
+                            fielddesc_cvttocoord(yfielddesc, CLIP(min)));
+                        ypix2 = glist_ytopixels(glist, basey + yloc +
+                            fielddesc_cvttocoord(yfielddesc, CLIP(max)));
+                        if (ndrawn && (ypix2 - lastypix) * (ypix2 - lastypix) <
+                            (ypix1 - lastypix) * (ypix1 - lastypix))
+                        {
+                            t_float swap = ypix1;
+                            ypix1 = ypix2;
+                            ypix2 = swap;
+                        }
+                        sys_coordsadd(ixpix, ypix1);
+                        if (ypix2 != ypix1)
+                            sys_coordsadd(ixpix, ypix2);
+                        lastypix = ypix2;
+                        yval = CLIP(max);
+                        ndrawn++;
+                    }
+                }
+                else for (xsum = xloc, i = 0; i < nelem; i++)
                 {
                     t_float usexloc;
                     if (xonset >= 0)
@@ -1939,7 +2116,7 @@ static void plot_vis(t_gobj *z, t_glist *glist,
                     ixpix = xpix + 0.5;
                     if (xonset >= 0 || ixpix != lastpixel)
                     {
-                        sys_vgui("%d %f \\\n", ixpix,
+                        sys_coordsadd(ixpix,
                             glist_ytopixels(glist,
                                 basey + yloc + fielddesc_cvttocoord(yfielddesc,
                                     yval)));
@@ -1949,10 +2126,12 @@ static void plot_vis(t_gobj *z, t_glist *glist,
                     if (ndrawn >= 1000) break;
                 }
                     /* TK will complain if there aren't at least 2 points... */
-                if (ndrawn == 0) sys_vgui("0 0 0 0 \\\n");
-                else if (ndrawn == 1) sys_vgui("%d %f \\\n", ixpix + 10,
+                if (ndrawn == 0)
+                    sys_coordsadd(0, 0), sys_coordsadd(0, 0);
+                else if (ndrawn == 1) sys_coordsadd(ixpix + 10,
                     glist_ytopixels(glist, basey + yloc +
                         fielddesc_cvttocoord(yfielddesc, yval)));
+                sys_coordsend();
 
                 sys_vgui("-width %f\\\n", linewidth);
                 sys_vgui("-fill %s\\\n", outline);
@@ -82,7 +82,8 @@ void glist_text(t_glist *gl, t_symbol *s, int argc, t_atom *argv)
             and objects though since there's no text in them at menu
             creation. */
             /* gobj_activate(&x->te_g, gl, 1); */
-        if (!canvas_undo_get(glist_getcanvas(gl))->u_doing)
+        if (!canvas_undo_get(glist_getcanvas(gl))->u_doing &&
+            !canvas_isbatching(gl))
             canvas_undo_add(glist_getcanvas(gl), UNDO_CREATE, "create",
                 (void *)canvas_undo_set_create(glist_getcanvas(gl)));
         canvas_startmotion(glist_getcanvas(gl));
@@ -216,7 +217,8 @@ void canvas_obj(t_glist *gl, t_symbol *s, int argc, t_atom *argv)
         if (connectme)
             canvas_connect(gl, indx, 0, nobj, 0);
         else canvas_startmotion(glist_getcanvas(gl));
-        if (!canvas_undo_get(glist_getcanvas(gl))->u_doing)
+        if (!canvas_undo_get(glist_getcanvas(gl))->u_doing &&
+            !canvas_isbatching(gl))
             canvas_undo_add(glist_getcanvas(gl), UNDO_CREATE, "create",
                 (void *)canvas_undo_set_create(glist_getcanvas(gl)));
     }
@@ -1444,6 +1446,8 @@ void text_setto(t_text *x, t_glist *glist, char *buf, int bufsize)
                 (void *)canvas_undo_set_recreate(glist_getcanvas(glist),
                 &x->te_g, pos));
             glist_delete(glist, &x->te_g);
+                /* the user may have just installed the object's class */
+            sys_flushdircache();
             canvas_objtext(glist, xwas, ywas, widthwas, 0, b);
             canvas_restoreconnections(glist_getcanvas(glist));
                 /* if it's an abstraction loadbang it here */
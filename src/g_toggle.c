@@ -42,6 +42,11 @@ void toggle_draw_update(t_toggle *x, t_glist *glist)
     }
 }
 
+static void toggle_draw_queued(t_gobj *client, t_glist *glist)
+{
+    toggle_draw_update((t_toggle *)client, glist);
+}
+
 void toggle_draw_new(t_toggle *x, t_glist *glist)
 {
     int xpos = text_xpix(&x->x_gui.x_obj, glist);
@@ -213,7 +218,10 @@ void toggle_draw_select(t_toggle* x, t_glist* glist)
 void toggle_draw(t_toggle *x, t_glist *glist, int mode)
 {
     if(mode == IEM_GUI_DRAW_MODE_UPDATE)
-        toggle_draw_update(x, glist);
+    {
+        if(glist_isvisible(glist))
+            sys_queuegui(x, glist, toggle_draw_queued);
+    }
     else if(mode == IEM_GUI_DRAW_MODE_MOVE)
         toggle_draw_move(x, glist);
     else if(mode == IEM_GUI_DRAW_MODE_NEW)
@@ -231,6 +231,13 @@ typedef struct _ptrobj
     int x_ntypedout;
     t_outlet *x_otherout;
     t_outlet *x_bangout;
+    t_glist *x_indexglist;      /* glist the index below was made for */
+    int x_indexvalid;           /* its gl_valid and gl_order at the time */
+    int x_indexorder;
+    t_symbol *x_indextemplate;  /* template indexed, or &s_ for all */
+    int x_nindex;
+    int x_indexsize;
+    t_scalar **x_index;         /* the scalars, in order */
 } t_ptrobj;
 
 static void *ptrobj_new(t_symbol *classname, int argc, t_atom *argv)
@@ -249,6 +256,9 @@ static void *ptrobj_new(t_symbol *classname, int argc, t_atom *argv)
     x->x_otherout = outlet_new(&x->x_obj, &s_pointer);
     x->x_bangout = outlet_new(&x->x_obj, &s_bang);
     pointerinlet_new(&x->x_obj, &x->x_gp);
+    x->x_indexglist = 0;
+    x->x_nindex = x->x_indexsize = 0;
+    x->x_index = 0;
     return (x);
 }
 
@@ -327,6 +337,69 @@ static void ptrobj_next(t_ptrobj *x)
     ptrobj_vnext(x, 0);
 }
 
+static void ptrobj_bang(t_ptrobj *x);
+
+    /* "nth" goes straight to the nth scalar (counting from zero) in the
+    list we point into, or the nth one of a given template.  The scalars are
+    indexed the first time and again only when a scalar is deleted (which
+    changes gl_valid) or the list is added to or rearranged (gl_order).  The
+    pointer needn't be fresh, only still in a list; past the end we point
+    to the head of the list and output a bang as "next" would. */
+static void ptrobj_nth(t_ptrobj *x, t_floatarg f, t_symbol *templatesym)
+{
+    t_gpointer *gp = &x->x_gp;
+    t_gstub *gs = gp->gp_stub;
+    t_glist *glist;
+    int n = f;
+    if (!gs || gs->gs_which == GP_NONE)
+    {
+        pd_error(x, "pointer nth: no current list");
+        return;
+    }
+    if (gs->gs_which != GP_GLIST)
+    {
+        pd_error(x, "pointer nth: lists only, not arrays");
+        return;
+    }
+    glist = gs->gs_un.gs_glist;
+    templatesym = template_getbindsym(templatesym);
+    if (glist != x->x_indexglist || glist->gl_valid != x->x_indexvalid ||
+        glist->gl_order != x->x_indexorder ||
+            templatesym != x->x_indextemplate)
+    {
+        t_gobj *y;
+        x->x_nindex = 0;
+        for (y = glist->gl_list; y; y = y->g_next)
+            if (pd_class(&y->g_pd) == scalar_class && (!*templatesym->s_name ||
+                ((t_scalar *)y)->sc_template == templatesym))
+        {
+            if (x->x_nindex == x->x_indexsize)
+            {
+                int newsize = (x->x_indexsize ? 2 * x->x_indexsize : 64);
+                x->x_index = (t_scalar **)resizebytes(x->x_index,
+                    x->x_indexsize * sizeof(*x->x_index),
+                        newsize * sizeof(*x->x_index));
+                x->x_indexsize = newsize;
+            }
+            x->x_index[x->x_nindex++] = (t_scalar *)y;
+        }
+        x->x_indexglist = glist;
+        x->x_indexvalid = glist->gl_valid;
+        x->x_indexorder = glist->gl_order;
+        x->x_indextemplate = templatesym;
+    }
+    if (n >= 0 && n < x->x_nindex)
+    {
+        gpointer_setglist(gp, glist, x->x_index[n]);
+        ptrobj_bang(x);
+    }
+    else
+    {
+        gpointer_setglist(gp, glist, 0);
+        outlet_bang(x->x_bangout);
+    }
+}
+
 static void ptrobj_delete(t_ptrobj *x)
 {
     t_gobj *gobj, *old;
@@ -527,6 +600,7 @@ static void ptrobj_rewind(t_ptrobj *x)
 static void ptrobj_free(t_ptrobj *x)
 {
     freebytes(x->x_typedout, x->x_ntypedout * sizeof (*x->x_typedout));
+    freebytes(x->x_index, x->x_indexsize * sizeof(*x->x_index));
     gpointer_unset(&x->x_gp);
 }
 
@@ -541,6 +615,8 @@ static void ptrobj_setup(void)
         A_SYMBOL, 0);
     class_addmethod(ptrobj_class, (t_method)ptrobj_vnext, gensym("vnext"),
         A_DEFFLOAT, 0);
+    class_addmethod(ptrobj_class, (t_method)ptrobj_nth, gensym("nth"),
+        A_FLOAT, A_DEFSYM, 0);
     class_addmethod(ptrobj_class, (t_method)ptrobj_delete, gensym("delete"), 0);
     class_addmethod(ptrobj_class, (t_method)ptrobj_equal, gensym("equal"), A_POINTER, 0);
     class_addmethod(ptrobj_class, (t_method)ptrobj_sendwindow,
@@ -551,6 +627,91 @@ static void ptrobj_setup(void)
     class_addbang(ptrobj_class, ptrobj_bang);
 }
 
+/* get, set, element and getsize keep the template they last found and
+where their fields are in it, until the template they found (or some other
+one) is replaced, which template_getstamp() tells them.  x_cachesym is the
+template name the rest was looked up for, or 0 to look it up next time. */
+
+    /* "get -all" and "set -all" work on every scalar of a template in the
+    list a pointer points into (either template given or, for a wild card,
+    the one pointed to), or on every element of the array it points into. */
+typedef struct _allwalk
+{
+    t_symbol *w_templatesym;
+    t_glist *w_glist;           /* 0 for arrays */
+    t_gobj *w_next;
+    t_array *w_array;
+    int w_index;
+} t_allwalk;
+
+static int allwalk_start(t_allwalk *w, t_object *x, const char *name,
+    t_gpointer *gp, t_symbol *templatesym)
+{
+    t_gstub *gs;
+    if (!gpointer_check(gp, 1))
+    {
+        pd_error(x, "%s: stale or empty pointer", name);
+        return (0);
+    }
+    gs = gp->gp_stub;
+    if (gs->gs_which == GP_ARRAY)
+    {
+        w->w_glist = 0;
+        w->w_array = gs->gs_un.gs_array;
+        w->w_index = 0;
+        w->w_templatesym = w->w_array->a_templatesym;
+    }
+    else
+    {
+        w->w_glist = gs->gs_un.gs_glist;
+        w->w_next = w->w_glist->gl_list;
+        if (*templatesym->s_name)
+            w->w_templatesym = templatesym;
+        else if (gp->gp_un.gp_scalar)
+            w->w_templatesym = gp->gp_un.gp_scalar->sc_template;
+        else
+        {
+            pd_error(x, "%s: can't use a wild card from the head of a list",
+                name);
+            return (0);
+        }
+    }
+    if (*templatesym->s_name && templatesym != w->w_templatesym)
+    {
+        pd_error(x, "%s %s: got wrong template (%s)", name,
+            templatesym->s_name, w->w_templatesym->s_name);
+        return (0);
+    }
+    return (1);
+}
+
+    /* the next scalar's or element's words, or 0 at the end */
+static t_word *allwalk_next(t_allwalk *w, t_scalar **scp)
+{
+    if (w->w_glist)
+    {
+        t_gobj *y;
+        while ((y = w->w_next))
+        {
+            w->w_next = y->g_next;
+            if (pd_class(&y->g_pd) == scalar_class &&
+                ((t_scalar *)y)->sc_template == w->w_templatesym)
+            {
+                *scp = (t_scalar *)y;
+                return (((t_scalar *)y)->sc_vec);
+            }
+        }
+        return (0);
+    }
+    else if (w->w_index < w->w_array->a_n)
+    {
+        *scp = 0;
+        return ((t_word *)(w->w_array->a_vec +
+            w->w_array->a_elemsize * w->w_index++));
+    }
+    else return (0);
+}
+
 /* ---------------------- get ----------------------------- */
 
 static t_class *get_class;
@@ -559,14 +720,20 @@ typedef struct _getvariable
 {
     t_symbol *gv_sym;
     t_outlet *gv_outlet;
+    int gv_onset;
+    int gv_type;            /* -1 if there's no such field */
 } t_getvariable;
 
 typedef struct _get
 {
     t_object x_obj;
     t_symbol *x_templatesym;
+    int x_all;              /* "-all" flag: get from every scalar as lists */
     int x_nout;
     t_getvariable *x_variables;
+    t_symbol *x_cachesym;
+    unsigned long x_stamp;
+    t_template *x_template;
 } t_get;
 
 static void *get_new(t_symbol *why, int argc, t_atom *argv)
@@ -576,6 +743,14 @@ static void *get_new(t_symbol *why, int argc, t_atom *argv)
     t_atom at, *varvec;
     t_getvariable *sp;
 
+    if (argc && (argv[0].a_type == A_SYMBOL) &&
+        !strcmp(argv[0].a_w.w_symbol->s_name, "-all"))
+    {
+        x->x_all = 1;
+        argc--;
+        argv++;
+    }
+    else x->x_all = 0;
     x->x_templatesym = template_getbindsym(atom_getsymbolarg(0, argc, argv));
     if (argc < 2)
     {
@@ -595,6 +770,7 @@ static void *get_new(t_symbol *why, int argc, t_atom *argv)
             correctly.  We can't yet guarantee that the template is there
             before we hit this routine. */
     }
+    x->x_cachesym = 0;
     return (x);
 }
 
@@ -606,6 +782,70 @@ static void get_set(t_get *x, t_symbol *templatesym, t_symbol *field)
     {
         x->x_templatesym = template_getbindsym(templatesym);
         x->x_variables->gv_sym = field;
+        x->x_cachesym = 0;
+    }
+}
+
+static t_template *get_findtemplate(t_get *x, t_symbol *templatesym)
+{
+    if (templatesym != x->x_cachesym || x->x_stamp != template_getstamp())
+    {
+        t_getvariable *vp;
+        t_symbol *arraytype;
+        int i;
+        x->x_cachesym = templatesym;
+        x->x_stamp = template_getstamp();
+        if ((x->x_template = template_findbyname(templatesym)))
+            for (i = x->x_nout, vp = x->x_variables; i--; vp++)
+                if (!template_find_field(x->x_template, vp->gv_sym,
+                    &vp->gv_onset, &vp->gv_type, &arraytype))
+                        vp->gv_type = -1;
+    }
+    return (x->x_template);
+}
+
+static void get_pointerall(t_get *x, t_gpointer *gp)
+{
+    t_template *template;
+    t_getvariable *vp;
+    t_scalar *sc;
+    int i;
+        /* start over for each field since output may change the list */
+    for (i = x->x_nout - 1, vp = x->x_variables + i; i >= 0; i--, vp--)
+    {
+        t_allwalk w, w2;
+        t_atom *vec;
+        t_word *wp;
+        int n = 0, j;
+        if (!allwalk_start(&w, &x->x_obj, "get", gp, x->x_templatesym))
+            return;
+        if (!(template = get_findtemplate(x, w.w_templatesym)))
+        {
+            pd_error(x, "get: couldn't find template %s",
+                w.w_templatesym->s_name);
+            return;
+        }
+        if (vp->gv_type != DT_FLOAT && vp->gv_type != DT_SYMBOL)
+        {
+            if (vp->gv_type >= 0)
+                pd_error(x, "get: %s.%s is not a number or symbol",
+                    template->t_sym->s_name, vp->gv_sym->s_name);
+            else pd_error(x, "get: %s.%s: no such field",
+                template->t_sym->s_name, vp->gv_sym->s_name);
+            continue;
+        }
+        for (w2 = w; allwalk_next(&w2, &sc); )
+            n++;
+        vec = (t_atom *)getbytes(n * sizeof(*vec));
+        for (j = 0; j < n && (wp = allwalk_next(&w, &sc)); j++)
+        {
+            if (vp->gv_type == DT_FLOAT)
+                SETFLOAT(vec + j, *(t_float *)(((char *)wp) + vp->gv_onset));
+            else SETSYMBOL(vec + j,
+                *(t_symbol **)(((char *)wp) + vp->gv_onset));
+        }
+        outlet_list(vp->gv_outlet, 0, n, vec);
+        freebytes(vec, n * sizeof(*vec));
     }
 }
 
@@ -618,6 +858,11 @@ static void get_pointer(t_get *x, t_gpointer *gp)
     t_word *vec;
     t_getvariable *vp;
 
+    if (x->x_all)
+    {
+        get_pointerall(x, gp);
+        return;
+    }
     if (!gpointer_check(gp, 0))
     {
         pd_error(x, "get: stale or empty pointer");
@@ -633,7 +878,7 @@ static void get_pointer(t_get *x, t_gpointer *gp)
         }
     }
     else templatesym = gpointer_gettemplatesym(gp);
-    if (!(template = template_findbyname(templatesym)))
+    if (!(template = get_findtemplate(x, templatesym)))
     {
         pd_error(x, "get: couldn't find template %s", templatesym->s_name);
         return;
@@ -642,16 +887,14 @@ static void get_pointer(t_get *x, t_gpointer *gp)
     else vec = gp->gp_un.gp_scalar->sc_vec;
     for (i = nitems - 1, vp = x->x_variables + i; i >= 0; i--, vp--)
     {
-        int onset, type;
-        t_symbol *arraytype;
-        if (template_find_field(template, vp->gv_sym, &onset, &type, &arraytype))
+        if (vp->gv_type >= 0)
         {
-            if (type == DT_FLOAT)
+            if (vp->gv_type == DT_FLOAT)
                 outlet_float(vp->gv_outlet,
-                    *(t_float *)(((char *)vec) + onset));
-            else if (type == DT_SYMBOL)
+                    *(t_float *)(((char *)vec) + vp->gv_onset));
+            else if (vp->gv_type == DT_SYMBOL)
                 outlet_symbol(vp->gv_outlet,
-                    *(t_symbol **)(((char *)vec) + onset));
+                    *(t_symbol **)(((char *)vec) + vp->gv_onset));
             else pd_error(x, "get: %s.%s is not a number or symbol",
                     template->t_sym->s_name, vp->gv_sym->s_name);
         }
@@ -676,12 +919,14 @@ static void get_setup(void)
 
 /* ---------------------- set ----------------------------- */
 
-static t_class *set_class;
+static t_class *set_class, *setall_class;
 
 typedef struct _setvariable
 {
     t_symbol *gv_sym;
     union word gv_w;
+    int gv_onset;
+    int gv_type;            /* -1 if there's no such field */
 } t_setvariable;
 
 typedef struct _set
@@ -692,22 +937,30 @@ typedef struct _set
     int x_nin;
     int x_issymbol;
     t_setvariable *x_variables;
+    t_symbol *x_cachesym;
+    unsigned long x_stamp;
+    t_template *x_template;
 } t_set;
 
 static void *set_new(t_symbol *why, int argc, t_atom *argv)
 {
-    t_set *x = (t_set *)pd_new(set_class);
-    int i, varcount;
+    t_set *x;
+    int i, varcount, issymbol = 0, all = 0;
     t_setvariable *sp;
     t_atom at, *varvec;
-    if (argc && (argv[0].a_type == A_SYMBOL) &&
-        !strcmp(argv[0].a_w.w_symbol->s_name, "-symbol"))
+    while (argc && (argv[0].a_type == A_SYMBOL) &&
+        (!strcmp(argv[0].a_w.w_symbol->s_name, "-symbol") ||
+            !strcmp(argv[0].a_w.w_symbol->s_name, "-all")))
     {
-        x->x_issymbol = 1;
+        if (!strcmp(argv[0].a_w.w_symbol->s_name, "-symbol"))
+            issymbol = 1;
+        else all = 1;
         argc--;
         argv++;
     }
-    else x->x_issymbol = 0;
+        /* with "-all" there's just a list inlet and the pointer inlet */
+    x = (t_set *)pd_new(all ? setall_class : set_class);
+    x->x_issymbol = issymbol;
     x->x_templatesym = template_getbindsym(atom_getsymbolarg(0, argc, argv));
     if (argc < 2)
     {
@@ -725,7 +978,7 @@ static void *set_new(t_symbol *why, int argc, t_atom *argv)
         if (x->x_issymbol)
             sp->gv_w.w_symbol = &s_;
         else sp->gv_w.w_float = 0;
-        if (i)
+        if (i && !all)
         {
             if (x->x_issymbol)
                 symbolinlet_new(&x->x_obj, &sp->gv_w.w_symbol);
@@ -734,6 +987,7 @@ static void *set_new(t_symbol *why, int argc, t_atom *argv)
     }
     pointerinlet_new(&x->x_obj, &x->x_gp);
     gpointer_init(&x->x_gp);
+    x->x_cachesym = 0;
     return (x);
 }
 
@@ -749,9 +1003,28 @@ static void set_set(t_set *x, t_symbol *templatesym, t_symbol *field)
            x->x_variables->gv_w.w_symbol = &s_;
        else
            x->x_variables->gv_w.w_float = 0;
+       x->x_cachesym = 0;
     }
 }
 
+static t_template *set_findtemplate(t_set *x, t_symbol *templatesym)
+{
+    if (templatesym != x->x_cachesym || x->x_stamp != template_getstamp())
+    {
+        t_setvariable *vp;
+        t_symbol *arraytype;
+        int i;
+        x->x_cachesym = templatesym;
+        x->x_stamp = template_getstamp();
+        if ((x->x_template = template_findbyname(templatesym)))
+            for (i = x->x_nin, vp = x->x_variables; i--; vp++)
+                if (!template_find_field(x->x_template, vp->gv_sym,
+                    &vp->gv_onset, &vp->gv_type, &arraytype))
+                        vp->gv_type = -1;
+    }
+    return (x->x_template);
+}
+
 static void set_bang(t_set *x)
 {
     int nitems = x->x_nin, i;
@@ -776,7 +1049,7 @@ static void set_bang(t_set *x)
         }
     }
     else templatesym = gpointer_gettemplatesym(gp);
-    if (!(template = template_findbyname(templatesym)))
+    if (!(template = set_findtemplate(x, templatesym)))
     {
         pd_error(x, "set: couldn't find template %s", templatesym->s_name);
         return;
@@ -786,11 +1059,22 @@ static void set_bang(t_set *x)
     if (gs->gs_which == GP_ARRAY)
         vec = gp->gp_un.gp_w;
     else vec = gp->gp_un.gp_scalar->sc_vec;
-    if (x->x_issymbol)
-        for (i = 0, vp = x->x_variables; i < nitems; i++, vp++)
-            template_setsymbol(template, vp->gv_sym, vec, vp->gv_w.w_symbol, 1);
-    else for (i = 0, vp = x->x_variables; i < nitems; i++, vp++)
-        template_setfloat(template, vp->gv_sym, vec, vp->gv_w.w_float, 1);
+    for (i = 0, vp = x->x_variables; i < nitems; i++, vp++)
+    {
+        if (vp->gv_type == (x->x_issymbol ? DT_SYMBOL : DT_FLOAT))
+        {
+            if (x->x_issymbol)
+                *(t_symbol **)(((char *)vec) + vp->gv_onset) =
+                    vp->gv_w.w_symbol;
+            else *(t_float *)(((char *)vec) + vp->gv_onset) =
+                vp->gv_w.w_float;
+        }
+        else if (vp->gv_type >= 0)
+            error("%s.%s: not a %s", template->t_sym->s_name,
+                vp->gv_sym->s_name, (x->x_issymbol ? "symbol" : "number"));
+        else error("%s.%s: no such field",
+            template->t_sym->s_name, vp->gv_sym->s_name);
+    }
     if (gs->gs_which == GP_GLIST)
         scalar_redraw(gp->gp_un.gp_scalar, gs->gs_un.gs_glist);
     else
@@ -803,6 +1087,58 @@ static void set_bang(t_set *x)
     }
 }
 
+    /* "set -all": list values go to successive scalars, as many at a time
+    as there are fields, until either runs out */
+static void set_list(t_set *x, t_symbol *s, int argc, t_atom *argv)
+{
+    int nitems = x->x_nin, i;
+    t_allwalk w;
+    t_template *template;
+    t_setvariable *vp;
+    t_scalar *sc;
+    t_word *vec;
+    t_gpointer *gp = &x->x_gp;
+    if (!allwalk_start(&w, &x->x_obj, "set", gp, x->x_templatesym))
+        return;
+    if (!(template = set_findtemplate(x, w.w_templatesym)))
+    {
+        pd_error(x, "set: couldn't find template %s", w.w_templatesym->s_name);
+        return;
+    }
+    for (i = 0, vp = x->x_variables; i < nitems; i++, vp++)
+        if (vp->gv_type != (x->x_issymbol ? DT_SYMBOL : DT_FLOAT))
+    {
+        if (vp->gv_type >= 0)
+            error("%s.%s: not a %s", template->t_sym->s_name,
+                vp->gv_sym->s_name, (x->x_issymbol ? "symbol" : "number"));
+        else error("%s.%s: no such field",
+            template->t_sym->s_name, vp->gv_sym->s_name);
+        return;
+    }
+    while (argc > 0 && nitems && (vec = allwalk_next(&w, &sc)))
+    {
+        for (i = 0, vp = x->x_variables; i < nitems && argc > 0;
+            i++, vp++, argc--, argv++)
+        {
+            if (x->x_issymbol)
+                *(t_symbol **)(((char *)vec) + vp->gv_onset) =
+                    atom_getsymbol(argv);
+            else *(t_float *)(((char *)vec) + vp->gv_onset) =
+                atom_getfloat(argv);
+        }
+        if (sc)
+            scalar_redraw(sc, w.w_glist);
+    }
+    if (!w.w_glist)
+    {
+        t_array *owner_array = w.w_array;
+        while (owner_array->a_gp.gp_stub->gs_which == GP_ARRAY)
+            owner_array = owner_array->a_gp.gp_stub->gs_un.gs_array;
+        scalar_redraw(owner_array->a_gp.gp_un.gp_scalar,
+            owner_array->a_gp.gp_stub->gs_un.gs_glist);
+    }
+}
+
 static void set_float(t_set *x, t_float f)
 {
     if (x->x_nin && !x->x_issymbol)
@@ -838,6 +1174,12 @@ static void set_setup(void)
     class_addbang(set_class, set_bang);
     class_addmethod(set_class, (t_method)set_set, gensym("set"),
         A_SYMBOL, A_SYMBOL, 0);
+
+    setall_class = class_new(gensym("set"), 0,
+        (t_method)set_free, sizeof(t_set), 0, 0);
+    class_addlist(setall_class, set_list);
+    class_addmethod(setall_class, (t_method)set_set, gensym("set"),
+        A_SYMBOL, A_SYMBOL, 0);
 }
 
 /* ---------------------- elem ----------------------------- */
@@ -851,6 +1193,13 @@ typedef struct _elem
     t_symbol *x_fieldsym;
     t_gpointer x_gp;
     t_gpointer x_gparent;
+    t_symbol *x_cachesym;
+    unsigned long x_stamp;
+    t_template *x_template;
+    int x_onset;
+    int x_type;             /* -1 if there's no such field */
+    t_symbol *x_elemtemplatesym;
+    t_template *x_elemtemplate;
 } t_elem;
 
 static void *elem_new(t_symbol *templatesym, t_symbol *fieldsym)
@@ -862,6 +1211,7 @@ static void *elem_new(t_symbol *templatesym, t_symbol *fieldsym)
     gpointer_init(&x->x_gparent);
     pointerinlet_new(&x->x_obj, &x->x_gparent);
     outlet_new(&x->x_obj, &s_pointer);
+    x->x_cachesym = 0;
     return (x);
 }
 
@@ -869,18 +1219,36 @@ static void elem_set(t_elem *x, t_symbol *templatesym, t_symbol *fieldsym)
 {
     x->x_templatesym = template_getbindsym(templatesym);
     x->x_fieldsym = fieldsym;
+    x->x_cachesym = 0;
+}
+
+static t_template *elem_findtemplate(t_elem *x, t_symbol *templatesym)
+{
+    if (templatesym != x->x_cachesym || x->x_stamp != template_getstamp())
+    {
+        x->x_cachesym = templatesym;
+        x->x_stamp = template_getstamp();
+        x->x_type = -1;
+        x->x_elemtemplate = 0;
+        if ((x->x_template = template_findbyname(templatesym)) &&
+            template_find_field(x->x_template, x->x_fieldsym,
+                &x->x_onset, &x->x_type, &x->x_elemtemplatesym) &&
+                    x->x_type == DT_ARRAY)
+            x->x_elemtemplate = template_findbyname(x->x_elemtemplatesym);
+    }
+    return (x->x_template);
 }
 
 static void elem_float(t_elem *x, t_float f)
 {
-    int indx = f, nitems, onset;
-    t_symbol *templatesym, *fieldsym = x->x_fieldsym, *elemtemplatesym;
+    int indx = f, nitems;
+    t_symbol *templatesym, *fieldsym = x->x_fieldsym;
     t_template *template;
     t_template *elemtemplate;
     t_gpointer *gparent = &x->x_gparent;
     t_word *w;
     t_array *array;
-    int elemsize, type;
+    int elemsize;
 
     if (!gpointer_check(gparent, 0))
     {
@@ -898,7 +1266,7 @@ static void elem_float(t_elem *x, t_float f)
         }
     }
     else templatesym = gpointer_gettemplatesym(gparent);
-    if (!(template = template_findbyname(templatesym)))
+    if (!(template = elem_findtemplate(x, templatesym)))
     {
         pd_error(x, "elem: couldn't find template %s", templatesym->s_name);
         return;
@@ -910,27 +1278,26 @@ static void elem_float(t_elem *x, t_float f)
         pd_error(x, "element: couldn't find template %s", templatesym->s_name);
         return;
     }
-    if (!template_find_field(template, fieldsym,
-        &onset, &type, &elemtemplatesym))
+    if (x->x_type < 0)
     {
         pd_error(x, "element: couldn't find array field %s", fieldsym->s_name);
         return;
     }
-    if (type != DT_ARRAY)
+    if (x->x_type != DT_ARRAY)
     {
         pd_error(x, "element: field %s not of type array", fieldsym->s_name);
         return;
     }
-    if (!(elemtemplate = template_findbyname(elemtemplatesym)))
+    if (!(elemtemplate = x->x_elemtemplate))
     {
         pd_error(x, "element: couldn't find field template %s",
-            elemtemplatesym->s_name);
+            x->x_elemtemplatesym->s_name);
         return;
     }
 
     elemsize = elemtemplate->t_n * sizeof(t_word);
 
-    array = *(t_array **)(((char *)w) + onset);
+    array = *(t_array **)(((char *)w) + x->x_onset);
 
     nitems = array->a_n;
     if (indx < 0) indx = 0;
@@ -965,6 +1332,11 @@ typedef struct _getsize
     t_object x_obj;
     t_symbol *x_templatesym;
     t_symbol *x_fieldsym;
+    t_symbol *x_cachesym;
+    unsigned long x_stamp;
+    t_template *x_template;
+    int x_onset;
+    int x_type;             /* -1 if there's no such field */
 } t_getsize;
 
 static void *getsize_new(t_symbol *templatesym, t_symbol *fieldsym)
@@ -973,6 +1345,7 @@ static void *getsize_new(t_symbol *templatesym, t_symbol *fieldsym)
     x->x_templatesym = template_getbindsym(templatesym);
     x->x_fieldsym = fieldsym;
     outlet_new(&x->x_obj, &s_float);
+    x->x_cachesym = 0;
     return (x);
 }
 
@@ -980,16 +1353,30 @@ static void getsize_set(t_getsize *x, t_symbol *templatesym, t_symbol *fieldsym)
 {
     x->x_templatesym = template_getbindsym(templatesym);
     x->x_fieldsym = fieldsym;
+    x->x_cachesym = 0;
+}
+
+static t_template *getsize_findtemplate(t_getsize *x, t_symbol *templatesym)
+{
+    if (templatesym != x->x_cachesym || x->x_stamp != template_getstamp())
+    {
+        t_symbol *elemtemplatesym;
+        x->x_cachesym = templatesym;
+        x->x_stamp = template_getstamp();
+        if ((x->x_template = template_findbyname(templatesym)) &&
+            !template_find_field(x->x_template, x->x_fieldsym,
+                &x->x_onset, &x->x_type, &elemtemplatesym))
+                    x->x_type = -1;
+    }
+    return (x->x_template);
 }
 
 static void getsize_pointer(t_getsize *x, t_gpointer *gp)
 {
-    int nitems, onset, type;
-    t_symbol *templatesym, *fieldsym = x->x_fieldsym, *elemtemplatesym;
+    t_symbol *templatesym, *fieldsym = x->x_fieldsym;
     t_template *template;
     t_word *w;
     t_array *array;
-    int elemsize;
     t_gstub *gs = gp->gp_stub;
     if (!gpointer_check(gp, 0))
     {
@@ -1007,18 +1394,17 @@ static void getsize_pointer(t_getsize *x, t_gpointer *gp)
         }
     }
     else templatesym = gpointer_gettemplatesym(gp);
-    if (!(template = template_findbyname(templatesym)))
+    if (!(template = getsize_findtemplate(x, templatesym)))
     {
         pd_error(x, "elem: couldn't find template %s", templatesym->s_name);
         return;
     }
-    if (!template_find_field(template, fieldsym,
-        &onset, &type, &elemtemplatesym))
+    if (x->x_type < 0)
     {
         pd_error(x, "getsize: couldn't find array field %s", fieldsym->s_name);
         return;
     }
-    if (type != DT_ARRAY)
+    if (x->x_type != DT_ARRAY)
     {
         pd_error(x, "getsize: field %s not of type array", fieldsym->s_name);
         return;
@@ -1026,7 +1412,7 @@ static void getsize_pointer(t_getsize *x, t_gpointer *gp)
     if (gs->gs_which == GP_ARRAY) w = gp->gp_un.gp_w;
     else w = gp->gp_un.gp_scalar->sc_vec;
 
-    array = *(t_array **)(((char *)w) + onset);
+    array = *(t_array **)(((char *)w) + x->x_onset);
     outlet_float(x->x_obj.ob_outlet, (t_float)(array->a_n));
 }
 
@@ -1165,8 +1551,11 @@ static void setsize_float(t_setsize *x, t_float f)
                 word_free((t_word *)elem, elemtemplate);
     }
         /* resize the array  */
-    array->a_vec = (char *)resizebytes(array->a_vec,
-        elemsize * nitems, elemsize * newsize);
+    if (!array_setalloc(array, newsize) && newsize > nitems)
+    {
+        pd_error(x, "setsize: out of memory");
+        newsize = nitems;
+    }
     array->a_n = newsize;
         /* if growing, initialize new scalars */
     if (newsize > nitems)
@@ -1180,20 +1569,16 @@ static void setsize_float(t_setsize *x, t_float f)
         /* invalidate all gpointers into the array */
     array->a_valid++;
 
-    /* redraw again. */
+    /* redraw again (through the GUI queue). */
     if (gs->gs_which == GP_GLIST)
-    {
-        if (glist_isvisible(gs->gs_un.gs_glist))
-            gobj_vis((t_gobj *)(gp->gp_un.gp_scalar), gs->gs_un.gs_glist, 1);
-    }
+        scalar_redraw(gp->gp_un.gp_scalar, gs->gs_un.gs_glist);
     else
     {
         t_array *owner_array = gs->gs_un.gs_array;
         while (owner_array->a_gp.gp_stub->gs_which == GP_ARRAY)
             owner_array = owner_array->a_gp.gp_stub->gs_un.gs_array;
-        if (glist_isvisible(owner_array->a_gp.gp_stub->gs_un.gs_glist))
-            gobj_vis((t_gobj *)(owner_array->a_gp.gp_un.gp_scalar),
-                owner_array->a_gp.gp_stub->gs_un.gs_glist, 1);
+        scalar_redraw(owner_array->a_gp.gp_un.gp_scalar,
+            owner_array->a_gp.gp_stub->gs_un.gs_glist);
     }
 }
 
@@ -1334,6 +1719,7 @@ static void append_float(t_append *x, t_float f)
         sc->sc_gobj.g_next = glist->gl_list;
         glist->gl_list = &sc->sc_gobj;
     }
+    glist->gl_order++;
 
     gp->gp_un.gp_scalar = sc;
     vec = sc->sc_vec;
@@ -1342,10 +1728,9 @@ static void append_float(t_append *x, t_float f)
         template_setfloat(template, vp->gv_sym, vec, vp->gv_f, 1);
     }
 
-    if (glist_isvisible(glist_getcanvas(glist)))
-        gobj_vis(&sc->sc_gobj, glist, 1);
-    /*  scalar_redraw(sc, glist);  ... have to do 'vis' instead here because
-    redraw assumes we're already visible??? ... */
+        /* queue the drawing (erasing first does no harm) so that appending
+        many scalars at once doesn't draw each one on the spot */
+    scalar_redraw(sc, glist);
 
     outlet_pointer(x->x_obj.ob_outlet, gp);
 }
@@ -7,6 +7,12 @@
 # define DEBUG_UNDO(x) startpost("[%s:%d] ", __FILE__, __LINE__), x
 #else
 # define DEBUG_UNDO(x) do { } while(0)
+#endif
+
+    /* the undo queue of a canvas is allowed to hold about this much memory;
+    beyond it, the oldest steps are dropped (but never the latest one). */
+#ifndef UNDO_BUDGET
+#define UNDO_BUDGET (32 * 1024 * 1024)
 #endif
 
 /* used for canvas_objtext to differentiate between objects being created
@@ -103,6 +109,55 @@ t_undo_action *canvas_undo_init(t_canvas *x)
     return(a);
 }
 
+static int canvas_undo_doit(t_canvas *x, t_undo_action *udo, int action,
+    const char*funname);
+
+static void canvas_undo_dofree(t_canvas *x, t_undo *udo, t_undo_action *a)
+{
+    canvas_undo_doit(x, a, UNDO_FREE, __FUNCTION__);
+    udo->u_size -= a->size;
+    freebytes(a, sizeof(*a));
+}
+
+    /* drop the oldest steps (a sequence counting as one) until the queue
+    is within UNDO_BUDGET again */
+static void canvas_undo_trim(t_canvas *x, t_undo *udo)
+{
+    while (udo->u_size > UNDO_BUDGET && !udo->u_doing)
+    {
+        t_undo_action *first = udo->u_queue->next, *end, *a, *next;
+        int depth = 0, lostclean = 0;
+        for (end = first; end; end = end->next)
+        {
+            if (end->type == UNDO_SEQUENCE_START)
+                depth++;
+            else if (end->type == UNDO_SEQUENCE_END)
+                depth--;
+            if (depth <= 0)
+                break;
+        }
+        if (!end || end == udo->u_last)
+            return;
+        for (a = first; ; a = next)
+        {
+            next = a->next;
+            if (udo->u_cleanstate == a && a != end)
+                lostclean = 1;
+            if (a == end)
+                break;
+            canvas_undo_dofree(x, udo, a);
+        }
+            /* the head of the queue now stands for the state after "end" */
+        if (udo->u_cleanstate == end)
+            udo->u_cleanstate = udo->u_queue;
+        else if (lostclean)
+            udo->u_cleanstate = (void *)1;
+        canvas_undo_dofree(x, udo, end);
+        udo->u_queue->next = next;
+        next->prev = udo->u_queue;
+    }
+}
+
 t_undo_action *canvas_undo_add(t_canvas *x, t_undo_type type, const char *name,
     void *data)
 {
@@ -122,11 +177,23 @@ t_undo_action *canvas_undo_add(t_canvas *x, t_undo_type type, const char *name,
         return 0;
     }
 
+        /* dynamic patching in a batch isn't undoable */
+    if (canvas_isbatching(x))
+    {
+        t_undo_action tmp;
+        tmp.type = type;
+        tmp.data = data;
+        canvas_undo_doit(x, &tmp, UNDO_FREE, __FUNCTION__);
+        return 0;
+    }
     a = canvas_undo_init(x);
     if(!a)return a;
     a->type = type;
     a->data = (void *)data;
     a->name = (char *)name;
+    a->size = sizeof(*a) + canvas_undo_datasize(type, data);
+    udo->u_size += a->size;
+    canvas_undo_trim(x, udo);
     canvas_undo_set_name(name);
     canvas_show_undomenu(x, a->name, "no");
     DEBUG_UNDO(post("%s: done!", __FUNCTION__));
@@ -285,9 +352,8 @@ void canvas_undo_rebranch(t_canvas *x)
         a1 = udo->u_last->next;
         while(a1)
         {
-            canvas_undo_doit(x, a1, UNDO_FREE, __FUNCTION__);
             a2 = a1->next;
-            freebytes(a1, sizeof(*a1));
+            canvas_undo_dofree(x, udo, a1);
             a1 = a2;
         }
         udo->u_last->next = 0;
@@ -308,13 +374,12 @@ void canvas_undo_purge_abstraction_actions(t_canvas *x)
        for all patchers */
 }
 
+    /* only called from canvas_free(), which takes care of DSP */
 void canvas_undo_free(t_canvas *x)
 {
-    int dspwas;
     t_undo_action *a1, *a2;
     t_undo *udo = canvas_undo_get(x);
     if (!udo) return;
-    dspwas = canvas_suspend_dsp();
     if (udo->u_queue)
     {
         a1 = udo->u_queue;
@@ -326,5 +391,4 @@ void canvas_undo_free(t_canvas *x)
             a1 = a2;
         }
     }
-    canvas_resume_dsp(dspwas);
 }
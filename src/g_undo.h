@@ -70,6 +70,7 @@ struct _undo_action
 	char *name;					/* name of current action */
 	struct _undo_action *prev;	/* previous undo action */
 	struct _undo_action *next;	/* next undo action */
+	int size;					/* memory held, estimated (see UNDO_BUDGET) */
 };
 
 #ifndef t_undo_action
@@ -82,6 +83,7 @@ struct _undo
     t_undo_action *u_last;
     void *u_cleanstate; /* pointer to non-dirty state */
     int u_doing; /* currently undoing */
+    size_t u_size; /* total size of the actions in the queue */
 };
 #define t_undo struct _undo
 
@@ -165,4 +167,7 @@ EXTERN int canvas_undo_font(t_canvas *x, void *z, int action);
 
 /* ------------------------------- */
 
+    /* estimated memory held by an action's data, for UNDO_BUDGET */
+EXTERN int canvas_undo_datasize(t_undo_type type, void *data);
+
 #endif /* __g_undo_h_ */
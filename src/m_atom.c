@@ -5,6 +5,7 @@
 #include "m_pd.h"
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
 
     /* convenience routines for checking and getting values of
         atoms.  There's no "pointer" version since there's nothing
@@ -27,12 +28,87 @@ t_symbol *atom_getsymbol(const t_atom *a)  /* LATER think about this more carefu
     else return (&s_float);
 }
 
+    /* write a float the way sprintf's "%g" would.  This is under every
+    patch save and text-mode message, so we do the common cases ourselves:
+    between 1e-4 and 1e6 "%g" means rounding to six significant digits in
+    fixed notation, and a single-precision float times a power of ten up to
+    1e9 is exact in a double, so we can round it to an integer just as the
+    C library rounds the exact decimal expansion.  Anything else (exponents,
+    infinities, NaNs, and non-integers in double precision) goes to sprintf.
+    "buf" needs to hold at least 30 characters. */
+
+static const double atom_pow10[] =
+    {1, 10, 100, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+
+static void atom_formatfloat(t_float f, char *buf)
+{
+    double a = f, y, frac;
+    char digits[6], *bp = buf;
+    int e, p, i, ndigits, nint;
+    long n;
+    if (a == 0)
+    {
+        strcpy(buf, (signbit(a) ? "-0" : "0"));
+        return;
+    }
+    if (a < 0)
+        a = -a, *bp++ = '-';
+    if (!(a >= 1e-4 && a < 999999.5))
+        goto fallback;
+    for (e = 5; e > 0 && a < atom_pow10[e]; e--)
+        ;
+    if (e == 0 && a < 1)
+        for (e = -1; a < 1. / atom_pow10[-e]; e--)
+            ;
+    p = 5 - e;
+#if PD_FLOATSIZE != 32
+    if (a != (double)(long)a)
+        goto fallback;
+#endif
+    y = a * atom_pow10[p];
+    n = (long)y;
+    frac = y - n;
+    if (frac > 0.5 || (frac == 0.5 && (n & 1)))
+        n++;
+    if (n >= 1000000)
+        n /= 10, p--;
+    for (i = 5; i >= 0; i--)
+        digits[i] = '0' + n % 10, n /= 10;
+    for (ndigits = 6; digits[ndigits-1] == '0'; ndigits--)
+        ;
+    if (p <= 5)
+    {
+        nint = 6 - p;
+        for (i = 0; i < nint; i++)
+            *bp++ = digits[i];
+        if (ndigits > nint)
+        {
+            *bp++ = '.';
+            for (; i < ndigits; i++)
+                *bp++ = digits[i];
+        }
+    }
+    else
+    {
+        *bp++ = '0';
+        *bp++ = '.';
+        for (i = 6; i < p; i++)
+            *bp++ = '0';
+        for (i = 0; i < ndigits; i++)
+            *bp++ = digits[i];
+    }
+    *bp = 0;
+    return;
+fallback:
+    sprintf(buf, "%g", f);
+}
+
 t_symbol *atom_gensym(const t_atom *a)  /* this works  better for graph labels */
 {
     char buf[30];
     if (a->a_type == A_SYMBOL) return (a->a_w.w_symbol);
     else if (a->a_type == A_FLOAT)
-        sprintf(buf, "%g", a->a_w.w_float);
+        atom_formatfloat(a->a_w.w_float, buf);
     else strcpy(buf, "???");
     return (gensym(buf));
 }
@@ -75,7 +151,7 @@ void atom_string(const t_atom *a, char *buf, unsigned int bufsize)
         strcpy(buf, "(pointer)");
         break;
     case A_FLOAT:
-        sprintf(tbuf, "%g", a->a_w.w_float);
+        atom_formatfloat(a->a_w.w_float, tbuf);
         if (strlen(tbuf) < bufsize-1) strcpy(buf, tbuf);
         else if (a->a_w.w_float < 0) strcpy(buf, "-");
         else  strcpy(buf, "+");
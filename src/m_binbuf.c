@@ -4,7 +4,9 @@
 
 
 #include <stdlib.h>
+#include <stdint.h>
 #include "m_pd.h"
+#include "m_imp.h"
 #include "s_stuff.h"
 #include "g_canvas.h"
 #include <stdio.h>
@@ -16,6 +18,8 @@
 #include <io.h>
 #endif
 #include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <string.h>
 #include <stdarg.h>
 
@@ -27,35 +31,503 @@ struct _binbuf
 {
     int b_n;
     t_atom *b_vec;
+    unsigned long b_stamp;  /* changes whenever the contents might have */
+    uint32_t *b_packed;     /* b_n words instead of b_vec if packed */
+    t_symbol **b_syms;      /* symbols the packed words refer to */
+    int b_nsyms;
 };
 
+static void binbuf_unpack(const t_binbuf *x);
+static t_atom *binbuf_tempvec(const t_binbuf *x);
+static void binbuf_freetempvec(const t_binbuf *x, t_atom *vec);
+
+    /* source of change stamps.  Stamps are never reused, so a cache keyed
+    on one can't be fooled by a binbuf freed and allocated again. */
+static PERTHREAD unsigned long binbuf_nextstamp;
+
 t_binbuf *binbuf_new(void)
 {
     t_binbuf *x = (t_binbuf *)t_getbytes(sizeof(*x));
     x->b_n = 0;
     x->b_vec = t_getbytes(0);
+    x->b_stamp = ++binbuf_nextstamp;
+    x->b_packed = 0;
+    x->b_syms = 0;
+    x->b_nsyms = 0;
     return (x);
 }
 
+static void binbuf_freepacked(t_binbuf *x)
+{
+    if (!x->b_packed)
+        return;
+    t_freebytes(x->b_packed, x->b_n * sizeof(*x->b_packed));
+    t_freebytes(x->b_syms, x->b_nsyms * sizeof(*x->b_syms));
+    x->b_packed = 0;
+    x->b_syms = 0;
+    x->b_nsyms = 0;
+    x->b_n = 0;
+}
+
 void binbuf_free(t_binbuf *x)
 {
-    t_freebytes(x->b_vec, x->b_n * sizeof(*x->b_vec));
+    if (x->b_packed)
+        binbuf_freepacked(x);
+    else t_freebytes(x->b_vec, x->b_n * sizeof(*x->b_vec));
     t_freebytes(x,  sizeof(*x));
 }
 
 t_binbuf *binbuf_duplicate(const t_binbuf *y)
 {
     t_binbuf *x = (t_binbuf *)t_getbytes(sizeof(*x));
+    t_atom *vec = binbuf_tempvec(y);
     x->b_n = y->b_n;
     x->b_vec = t_getbytes(x->b_n * sizeof(*x->b_vec));
-    memcpy(x->b_vec, y->b_vec, x->b_n * sizeof(*x->b_vec));
+    memcpy(x->b_vec, vec, x->b_n * sizeof(*x->b_vec));
+    binbuf_freetempvec(y, vec);
+    x->b_stamp = ++binbuf_nextstamp;
+    x->b_packed = 0;
+    x->b_syms = 0;
+    x->b_nsyms = 0;
     return (x);
 }
 
 void binbuf_clear(t_binbuf *x)
 {
+    if (x->b_packed)
+        binbuf_freepacked(x);
     x->b_vec = t_resizebytes(x->b_vec, x->b_n * sizeof(*x->b_vec), 0);
     x->b_n = 0;
+    x->b_stamp = ++binbuf_nextstamp;
+}
+
+    /* anything that caches facts about a binbuf's contents (see x_text.c)
+    compares stamps to know when to recompute them.  Everything that
+    changes the size goes through binbuf_resize() which takes a new stamp;
+    code that writes atoms in place through binbuf_getvec() calls
+    binbuf_touch() afterward. */
+unsigned long binbuf_getstamp(const t_binbuf *x)
+{
+    return (x->b_stamp);
+}
+
+void binbuf_touch(t_binbuf *x)
+{
+    x->b_stamp = ++binbuf_nextstamp;
+}
+
+/* Big buffers (text define, qlist, textfile) can be "packed" to save memory:
+each atom becomes one 32-bit word, a quarter the size of a t_atom on 64-bit
+machines.  A float is stored as its single-precision bits (any NaN becoming
+the one positive quiet NaN), and anything else as a negative NaN whose
+mantissa holds a tag and a 20-bit value: the index of a symbol in b_syms,
+or a dollar number.  Since there's still one word per atom, atom indices
+(and so line tables and playback positions) are the same either way.
+
+binbuf_getatoms() and binbuf_nextbreak() read a packed buffer as it is; all
+other access goes through binbuf_getvec() or binbuf_resize(), which unpack
+it first, so code that doesn't know about packing never sees it.  Packing
+and unpacking don't take a new stamp since the contents don't change.
+Buffers with pointers, values that don't fit, or (with 64-bit floats)
+floats that don't survive a round trip to single precision stay unpacked. */
+
+#define BINBUF_PACKMIN 4096         /* don't bother below this many atoms */
+#define PK_NAN 0x7fc00000u          /* the packed form of a NaN float */
+#define PK_TAGGED 0xff800000u       /* sign and exponent of a tagged word */
+#define PK_TAGSHIFT 20
+#define PK_VALUEMASK 0xfffffu
+#define PK_SEMI 1
+#define PK_COMMA 2
+#define PK_SYMBOL 3
+#define PK_DOLLAR 4
+#define PK_DOLLSYM 5
+#define PK_WORD(tag, value) (PK_TAGGED | ((uint32_t)(tag) << PK_TAGSHIFT) | \
+    (uint32_t)(value))
+#define PK_ISTAGGED(w) (((w) & PK_TAGGED) == PK_TAGGED && \
+    ((w) & ~PK_TAGGED) != 0)
+
+typedef union _pkfloat
+{
+    float f;
+    uint32_t w;
+} t_pkfloat;
+
+static void binbuf_unpackatom(const t_binbuf *x, uint32_t w, t_atom *ap)
+{
+    if (PK_ISTAGGED(w))
+    {
+        int value = (int)(w & PK_VALUEMASK);
+        switch ((w & ~PK_TAGGED) >> PK_TAGSHIFT)
+        {
+        case PK_SEMI: SETSEMI(ap); break;
+        case PK_COMMA: SETCOMMA(ap); break;
+        case PK_SYMBOL: SETSYMBOL(ap, x->b_syms[value]); break;
+        case PK_DOLLAR: SETDOLLAR(ap, value); break;
+        default: SETDOLLSYM(ap, x->b_syms[value]); break;
+        }
+    }
+    else
+    {
+        t_pkfloat u;
+        u.w = w;
+        SETFLOAT(ap, u.f);
+    }
+}
+
+    /* pack the buffer if it's big enough and everything in it fits.
+    Returns 1 if the buffer is (now) packed. */
+int binbuf_pack(t_binbuf *x)
+{
+    int n = x->b_n, i, hashsize, nsyms = 0, symsize = 16;
+    t_symbol **hash, **syms;
+    int *hashindex;
+    uint32_t *packed;
+    if (x->b_packed)
+        return (1);
+    if (n < BINBUF_PACKMIN)
+        return (0);
+    for (hashsize = 64; hashsize < n / 4; hashsize *= 2)
+        ;
+    if (!(packed = (uint32_t *)t_getbytes(n * sizeof(*packed))))
+        return (0);
+    hash = (t_symbol **)t_getbytes(hashsize * sizeof(*hash));
+    hashindex = (int *)t_getbytes(hashsize * sizeof(*hashindex));
+    syms = (t_symbol **)t_getbytes(symsize * sizeof(*syms));
+    for (i = 0; i < n; i++)
+    {
+        t_atom *ap = x->b_vec + i;
+        int tag;
+        switch (ap->a_type)
+        {
+        case A_FLOAT:
+        {
+            t_pkfloat u;
+            u.f = ap->a_w.w_float;
+            if ((t_float)u.f != ap->a_w.w_float)
+            {
+                if (ap->a_w.w_float == ap->a_w.w_float)
+                    goto cantpack;  /* precision would be lost */
+                u.w = PK_NAN;
+            }
+            packed[i] = u.w;
+            continue;
+        }
+        case A_SEMI: packed[i] = PK_WORD(PK_SEMI, 0); continue;
+        case A_COMMA: packed[i] = PK_WORD(PK_COMMA, 0); continue;
+        case A_DOLLAR:
+            if (ap->a_w.w_index < 0 || ap->a_w.w_index > (int)PK_VALUEMASK)
+                goto cantpack;
+            packed[i] = PK_WORD(PK_DOLLAR, ap->a_w.w_index);
+            continue;
+        case A_SYMBOL: tag = PK_SYMBOL; break;
+        case A_DOLLSYM: tag = PK_DOLLSYM; break;
+        default: goto cantpack;
+        }
+            /* symbols: find or add this one in the table */
+        {
+            t_symbol *s = ap->a_w.w_symbol;
+            int h = (int)(((size_t)s >> 4) & (hashsize - 1));
+            while (hash[h] && hash[h] != s)
+                h = (h + 1) & (hashsize - 1);
+            if (!hash[h])
+            {
+                if (nsyms > (int)PK_VALUEMASK)
+                    goto cantpack;
+                if (nsyms == symsize)
+                {
+                    syms = (t_symbol **)t_resizebytes(syms,
+                        symsize * sizeof(*syms), 2 * symsize * sizeof(*syms));
+                    symsize *= 2;
+                }
+                    /* keep the hash table at most half full */
+                if (2 * (nsyms + 1) > hashsize)
+                {
+                    int newsize = 2 * hashsize, j, k;
+                    t_symbol **newhash = (t_symbol **)t_getbytes(
+                        newsize * sizeof(*newhash));
+                    int *newindex = (int *)t_getbytes(
+                        newsize * sizeof(*newindex));
+                    for (j = 0; j < hashsize; j++)
+                        if (hash[j])
+                    {
+                        k = (int)(((size_t)hash[j] >> 4) & (newsize - 1));
+                        while (newhash[k])
+                            k = (k + 1) & (newsize - 1);
+                        newhash[k] = hash[j];
+                        newindex[k] = hashindex[j];
+                    }
+                    t_freebytes(hash, hashsize * sizeof(*hash));
+                    t_freebytes(hashindex, hashsize * sizeof(*hashindex));
+                    hash = newhash;
+                    hashindex = newindex;
+                    hashsize = newsize;
+                    h = (int)(((size_t)s >> 4) & (hashsize - 1));
+                    while (hash[h])
+                        h = (h + 1) & (hashsize - 1);
+                }
+                hash[h] = s;
+                hashindex[h] = nsyms;
+                syms[nsyms++] = s;
+            }
+            packed[i] = PK_WORD(tag, hashindex[h]);
+        }
+    }
+    t_freebytes(hash, hashsize * sizeof(*hash));
+    t_freebytes(hashindex, hashsize * sizeof(*hashindex));
+    x->b_syms = (t_symbol **)t_resizebytes(syms, symsize * sizeof(*syms),
+        nsyms * sizeof(*syms));
+    x->b_nsyms = nsyms;
+    t_freebytes(x->b_vec, n * sizeof(*x->b_vec));
+    x->b_vec = 0;
+    x->b_packed = packed;
+    return (1);
+cantpack:
+    t_freebytes(hash, hashsize * sizeof(*hash));
+    t_freebytes(hashindex, hashsize * sizeof(*hashindex));
+    t_freebytes(syms, symsize * sizeof(*syms));
+    t_freebytes(packed, n * sizeof(*packed));
+    return (0);
+}
+
+int binbuf_ispacked(const t_binbuf *x)
+{
+    return (x->b_packed != 0);
+}
+
+    /* copy "n" atoms starting at "onset" into "to", packed or not */
+void binbuf_getatoms(const t_binbuf *x, int onset, int n, t_atom *to)
+{
+    int i;
+    if (onset < 0 || n < 0 || onset + n > x->b_n)
+    {
+        bug("binbuf_getatoms");
+        return;
+    }
+    if (!x->b_packed)
+        memcpy(to, x->b_vec + onset, n * sizeof(*to));
+    else for (i = 0; i < n; i++)
+        binbuf_unpackatom(x, x->b_packed[onset + i], to + i);
+}
+
+    /* index of the first semicolon or comma at or after "onset", or the
+    number of atoms if there's none */
+int binbuf_nextbreak(const t_binbuf *x, int onset)
+{
+    int i, n = x->b_n;
+    if (x->b_packed)
+    {
+        const uint32_t *w = x->b_packed;
+        for (i = onset; i < n; i++)
+            if (w[i] == PK_WORD(PK_SEMI, 0) || w[i] == PK_WORD(PK_COMMA, 0))
+                return (i);
+    }
+    else
+    {
+        const t_atom *vec = x->b_vec;
+        for (i = onset; i < n; i++)
+            if (vec[i].a_type == A_SEMI || vec[i].a_type == A_COMMA)
+                return (i);
+    }
+    return (n);
+}
+
+    /* go back to atoms.  The binbuf is only logically const. */
+static void binbuf_unpack(const t_binbuf *y)
+{
+    t_binbuf *x = (t_binbuf *)y;
+    t_atom *vec;
+    int n = x->b_n, i;
+    if (!x->b_packed)
+        return;
+    if (!(vec = (t_atom *)t_getbytes(n * sizeof(*vec))))
+    {
+        error("binbuf: out of space unpacking");
+        binbuf_freepacked(x);
+        x->b_vec = t_getbytes(0);
+        return;
+    }
+    for (i = 0; i < n; i++)
+        binbuf_unpackatom(x, x->b_packed[i], vec + i);
+    binbuf_freepacked(x);
+    x->b_vec = vec;
+    x->b_n = n;
+}
+
+    /* the atoms for something that only reads them, without unpacking
+    the buffer for good; give them back with binbuf_freetempvec() */
+static t_atom *binbuf_tempvec(const t_binbuf *x)
+{
+    t_atom *vec;
+    if (!x->b_packed)
+        return (x->b_vec);
+    vec = (t_atom *)t_getbytes(x->b_n * sizeof(*vec));
+    binbuf_getatoms(x, 0, x->b_n, vec);
+    return (vec);
+}
+
+static void binbuf_freetempvec(const t_binbuf *x, t_atom *vec)
+{
+    if (vec != x->b_vec)
+        t_freebytes(vec, x->b_n * sizeof(*vec));
+}
+
+    /* character classes for the parser: white space, ';' and ',', and
+    backslash.  Everything else (BB_WORD) can only be part of a word. */
+#define BB_WORD 0
+#define BB_SPACE 1
+#define BB_BREAK 2
+#define BB_SLASH 3
+static const unsigned char binbuf_charclass[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 1, 0, 0,     /* \t \n \r */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0, 0, 0,     /* space , */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0, 0, 0, 0,     /* ; */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 3, 0, 0, 0,     /* \ */
+};
+#define BINBUF_CLASS(c) (binbuf_charclass[(unsigned char)(c)])
+
+    /* one step of the state machine that decides whether a word is a number:
+    it ends in 2, 4, 5, or 8 if it is, and goes to -1 as soon as it can't be */
+static int binbuf_floatstate(int floatstate, char c)
+{
+    int digit = (c >= '0' && c <= '9'),
+        dot = (c == '.'), minus = (c == '-'),
+        plusminus = (minus || (c == '+')),
+        expon = (c == 'e' || c == 'E');
+    if (floatstate == 0)    /* beginning */
+    {
+        if (minus) floatstate = 1;
+        else if (digit) floatstate = 2;
+        else if (dot) floatstate = 3;
+        else floatstate = -1;
+    }
+    else if (floatstate == 1)   /* got minus */
+    {
+        if (digit) floatstate = 2;
+        else if (dot) floatstate = 3;
+        else floatstate = -1;
+    }
+    else if (floatstate == 2)   /* got digits */
+    {
+        if (dot) floatstate = 4;
+        else if (expon) floatstate = 6;
+        else if (!digit) floatstate = -1;
+    }
+    else if (floatstate == 3)   /* got '.' without digits */
+    {
+        if (digit) floatstate = 5;
+        else floatstate = -1;
+    }
+    else if (floatstate == 4)   /* got '.' after digits */
+    {
+        if (digit) floatstate = 5;
+        else if (expon) floatstate = 6;
+        else floatstate = -1;
+    }
+    else if (floatstate == 5)   /* got digits after . */
+    {
+        if (expon) floatstate = 6;
+        else if (!digit) floatstate = -1;
+    }
+    else if (floatstate == 6)   /* got 'e' */
+    {
+        if (plusminus) floatstate = 7;
+        else if (digit) floatstate = 8;
+        else floatstate = -1;
+    }
+    else if (floatstate == 7)   /* got plus or minus */
+    {
+        if (digit) floatstate = 8;
+        else floatstate = -1;
+    }
+    else if (floatstate == 8)   /* got digits */
+    {
+        if (!digit) floatstate = -1;
+    }
+    return (floatstate);
+}
+
+    /* convert a string the parser has found to be a number.  Most numbers in
+    patches have few enough digits that they convert exactly by scaling a
+    64-bit mantissa by an exact power of ten, which gives the same result as
+    strtod()  (this is the "fast path" of Clinger's algorithm) and doesn't
+    depend on the locale's decimal point.  Anything else goes to atof(). */
+static double binbuf_atof(const char *s)
+{
+    static const double powersof10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+        1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18,
+        1e19, 1e20, 1e21, 1e22};
+    const char *p = s;
+    uint64_t mantissa = 0;
+    int ndigits = 0, exp10 = 0, negative = 0, inexact = 0;
+    double d;
+    if (*p == '-')
+        negative = 1, p++;
+    for (; *p >= '0' && *p <= '9'; p++)
+    {
+        if (ndigits < 19)
+        {
+            mantissa = 10 * mantissa + (*p - '0');
+            ndigits += (mantissa != 0);
+        }
+        else exp10++, inexact |= (*p != '0');
+    }
+    if (*p == '.')
+        for (p++; *p >= '0' && *p <= '9'; p++)
+    {
+        if (ndigits < 19)
+        {
+            mantissa = 10 * mantissa + (*p - '0');
+            ndigits += (mantissa != 0);
+            exp10--;
+        }
+        else inexact |= (*p != '0');
+    }
+    if (*p == 'e' || *p == 'E')
+    {
+        int expon = 0, expneg = 0;
+        if (*++p == '-')
+            expneg = 1, p++;
+        else if (*p == '+')
+            p++;
+        for (; *p >= '0' && *p <= '9'; p++)
+            if (expon < 10000)
+                expon = 10 * expon + (*p - '0');
+        exp10 += (expneg ? -expon : expon);
+    }
+    if (inexact || mantissa > ((uint64_t)1 << 53) || exp10 < -22 || exp10 > 22)
+        return (atof(s));
+    d = (double)mantissa;
+    d = (exp10 < 0 ? d / powersof10[-exp10] : d * powersof10[exp10]);
+    return (negative ? -d : d);
+}
+
+    /* make an atom out of a word the parser has found, with backslashes
+    already stripped */
+static void binbuf_wordtoatom(t_atom *ap, const char *buf, int floatstate,
+    int dollar)
+{
+    const char *bufp;
+    if (floatstate == 2 || floatstate == 4 || floatstate == 5 ||
+        floatstate == 8)
+            SETFLOAT(ap, binbuf_atof(buf));
+        /* LATER try to figure out how to mix "$" and "\$" correctly;
+        here, the backslashes were already stripped so we assume all
+        "$" chars are real dollars.  In fact, we only know at least one
+        was. */
+    else if (dollar)
+    {
+        if (buf[0] != '$')
+            dollar = 0;
+        for (bufp = buf+1; *bufp; bufp++)
+            if (*bufp < '0' || *bufp > '9')
+                dollar = 0;
+        if (dollar)
+            SETDOLLAR(ap, atoi(buf+1));
+        else SETDOLLSYM(ap, gensym(buf));
+    }
+    else SETSYMBOL(ap, gensym(buf));
 }
 
     /* convert text to a binbuf */
@@ -70,10 +542,10 @@ void binbuf_text(t_binbuf *x, const char *text, size_t size)
     ap = x->b_vec;
     while (1)
     {
-        int type;
+        int charclass;
             /* skip leading space */
-        while ((textp != etext) && (*textp == ' ' || *textp == '\n'
-            || *textp == '\r' || *textp == '\t')) textp++;
+        while ((textp != etext) && BINBUF_CLASS(*textp) == BB_SPACE)
+            textp++;
         if (textp == etext) break;
         if (*textp == ';') SETSEMI(ap), textp++;
         else if (*textp == ',') SETCOMMA(ap), textp++;
@@ -82,106 +554,59 @@ void binbuf_text(t_binbuf *x, const char *text, size_t size)
                 /* it's an atom other than a comma or semi */
             char c;
             int floatstate = 0, slash = 0, lastslash = 0, dollar = 0;
+            const char *wordp = textp;
+                /* most words have no backslashes and aren't too long; find
+                the end of those quickly; otherwise start over and handle
+                the escapes one character at a time. */
             bufp = buf;
-            do
+            while (wordp != etext && BINBUF_CLASS(*wordp) == BB_WORD &&
+                bufp != ebuf)
+                    *bufp++ = *wordp++;
+            if (bufp != ebuf &&
+                (wordp == etext || BINBUF_CLASS(*wordp) != BB_SLASH))
             {
-                c = *bufp = *textp++;
-                lastslash = slash;
-                slash = (c == '\\');
-
-                if (floatstate >= 0)
+                int n = (int)(bufp - buf), i;
+                *bufp = 0;
+                textp = wordp;
+                if ((buf[0] >= '0' && buf[0] <= '9') || buf[0] == '-' ||
+                    buf[0] == '.')
+                        for (i = 0; i < n && floatstate >= 0; i++)
+                            floatstate = binbuf_floatstate(floatstate, buf[i]);
+                else floatstate = -1;
+                for (bufp = buf; (bufp = strchr(bufp, '$')); bufp++)
+                    if (bufp[1] >= '0' && bufp[1] <= '9')
+                        dollar = 1;
+            }
+            else
+            {
+                bufp = buf;
+                do
                 {
-                    int digit = (c >= '0' && c <= '9'),
-                        dot = (c == '.'), minus = (c == '-'),
-                        plusminus = (minus || (c == '+')),
-                        expon = (c == 'e' || c == 'E');
-                    if (floatstate == 0)    /* beginning */
-                    {
-                        if (minus) floatstate = 1;
-                        else if (digit) floatstate = 2;
-                        else if (dot) floatstate = 3;
-                        else floatstate = -1;
-                    }
-                    else if (floatstate == 1)   /* got minus */
-                    {
-                        if (digit) floatstate = 2;
-                        else if (dot) floatstate = 3;
-                        else floatstate = -1;
-                    }
-                    else if (floatstate == 2)   /* got digits */
-                    {
-                        if (dot) floatstate = 4;
-                        else if (expon) floatstate = 6;
-                        else if (!digit) floatstate = -1;
-                    }
-                    else if (floatstate == 3)   /* got '.' without digits */
-                    {
-                        if (digit) floatstate = 5;
-                        else floatstate = -1;
-                    }
-                    else if (floatstate == 4)   /* got '.' after digits */
-                    {
-                        if (digit) floatstate = 5;
-                        else if (expon) floatstate = 6;
-                        else floatstate = -1;
-                    }
-                    else if (floatstate == 5)   /* got digits after . */
-                    {
-                        if (expon) floatstate = 6;
-                        else if (!digit) floatstate = -1;
-                    }
-                    else if (floatstate == 6)   /* got 'e' */
+                    c = *bufp = *textp++;
+                    lastslash = slash;
+                    slash = (c == '\\');
+
+                    if (floatstate >= 0)
+                        floatstate = binbuf_floatstate(floatstate, c);
+                    if (!lastslash && c == '$' && (textp != etext &&
+                        textp[0] >= '0' && textp[0] <= '9'))
+                            dollar = 1;
+                    if (!slash) bufp++;
+                    else if (lastslash)
                     {
-                        if (plusminus) floatstate = 7;
-                        else if (digit) floatstate = 8;
-                        else floatstate = -1;
+                        bufp++;
+                        slash = 0;
                     }
-                    else if (floatstate == 7)   /* got plus or minus */
-                    {
-                        if (digit) floatstate = 8;
-                        else floatstate = -1;
-                    }
-                    else if (floatstate == 8)   /* got digits */
-                    {
-                        if (!digit) floatstate = -1;
-                    }
-                }
-                if (!lastslash && c == '$' && (textp != etext &&
-                    textp[0] >= '0' && textp[0] <= '9'))
-                        dollar = 1;
-                if (!slash) bufp++;
-                else if (lastslash)
-                {
-                    bufp++;
-                    slash = 0;
                 }
+                while (textp != etext && bufp != ebuf &&
+                    (slash || ((charclass = BINBUF_CLASS(*textp)) == BB_WORD ||
+                        charclass == BB_SLASH)));
+                *bufp = 0;
             }
-            while (textp != etext && bufp != ebuf &&
-                (slash || (*textp != ' ' && *textp != '\n' && *textp != '\r'
-                    && *textp != '\t' &&*textp != ',' && *textp != ';')));
-            *bufp = 0;
 #if 0
             post("binbuf_text: buf %s", buf);
 #endif
-            if (floatstate == 2 || floatstate == 4 || floatstate == 5 ||
-                floatstate == 8)
-                    SETFLOAT(ap, atof(buf));
-                /* LATER try to figure out how to mix "$" and "\$" correctly;
-                here, the backslashes were already stripped so we assume all
-                "$" chars are real dollars.  In fact, we only know at least one
-                was. */
-            else if (dollar)
-            {
-                if (buf[0] != '$')
-                    dollar = 0;
-                for (bufp = buf+1; *bufp; bufp++)
-                    if (*bufp < '0' || *bufp > '9')
-                        dollar = 0;
-                if (dollar)
-                    SETDOLLAR(ap, atoi(buf+1));
-                else SETDOLLSYM(ap, gensym(buf));
-            }
-            else SETSYMBOL(ap, gensym(buf));
+            binbuf_wordtoatom(ap, buf, floatstate, dollar);
         }
         ap++;
         natom++;
@@ -197,16 +622,166 @@ void binbuf_text(t_binbuf *x, const char *text, size_t size)
     binbuf_resize(x, natom);
 }
 
+/* An incremental version of binbuf_text() for streams of messages such as
+socket input.  The text can come in pieces split anywhere, even inside a word
+or an escape, and is looked at only once: the parser keeps the word and the
+atoms it has so far and takes up where it left off.  Each time a ';' ends a
+message the atoms go into a binbuf.  Words come out the same as from
+binbuf_text().  A message longer than BINBUFPARSER_MAXATOMS is dropped
+whole, up to its ';', so that a peer that never sends one can't make us
+grow without bound. */
+
+#define BINBUFPARSER_MAXATOMS (1 << 20)
+
+struct _binbufparser
+{
+    t_atom *p_vec;      /* atoms of the message so far */
+    int p_n;
+    int p_size;         /* allocated size of p_vec */
+    int p_wordlen;      /* chars of the current word, or -1 between words */
+    int p_floatstate;
+    int p_slash;        /* last char was a backslash that escapes the next */
+    int p_dollar;       /* word has a "$" followed by a digit */
+    int p_lastdollar;   /* last char was an unescaped "$" */
+    int p_toolong;      /* dropping the rest of an overlong message */
+    char p_word[MAXPDSTRING+1];
+};
+
+t_binbufparser *binbufparser_new(void)
+{
+    t_binbufparser *p = (t_binbufparser *)getbytes(sizeof(*p));
+    p->p_vec = (t_atom *)getbytes((p->p_size = 16) * sizeof(t_atom));
+    p->p_n = 0;
+    p->p_wordlen = -1;
+    p->p_toolong = 0;
+    return (p);
+}
+
+void binbufparser_free(t_binbufparser *p)
+{
+    freebytes(p->p_vec, p->p_size * sizeof(t_atom));
+    freebytes(p, sizeof(*p));
+}
+
+    /* forget any partial message, as when a connection is reset */
+void binbufparser_clear(t_binbufparser *p)
+{
+    p->p_n = 0;
+    p->p_wordlen = -1;
+    p->p_toolong = 0;
+}
+
+    /* room for another atom.  Once a message gets too long (or we run out
+    of memory) we throw away what we have and keep handing back the first
+    slot, which nobody will look at, until the message ends. */
+static t_atom *binbufparser_newatom(t_binbufparser *p)
+{
+    if (p->p_toolong)
+        return (p->p_vec);
+    if (p->p_n == p->p_size)
+    {
+        t_atom *vec = 0;
+        if (p->p_size >= BINBUFPARSER_MAXATOMS || !(vec = (t_atom *)
+            resizebytes(p->p_vec, p->p_size * sizeof(t_atom),
+                2 * p->p_size * sizeof(t_atom))))
+        {
+            pd_error(0, "message longer than %d atoms dropped", p->p_size);
+            binbufparser_clear(p);
+            p->p_toolong = 1;
+            return (p->p_vec);
+        }
+        p->p_vec = vec;
+        p->p_size *= 2;
+    }
+    return (p->p_vec + p->p_n++);
+}
+
+static void binbufparser_endword(t_binbufparser *p)
+{
+    p->p_word[p->p_wordlen] = 0;
+    binbuf_wordtoatom(binbufparser_newatom(p), p->p_word, p->p_floatstate,
+        p->p_dollar);
+    p->p_wordlen = -1;
+}
+
+    /* parse up to "size" chars of text.  If that finishes a message, put it
+    in "b" (replacing what was there) and return 1; otherwise return 0.
+    Either way "*nused" gets the number of chars used up, which are no
+    longer needed. */
+int binbufparser_text(t_binbufparser *p, t_binbuf *b, const char *text,
+    int size, int *nused)
+{
+    int i;
+    for (i = 0; i < size; i++)
+    {
+        char c = text[i];
+        int charclass = BINBUF_CLASS(c);
+        if (p->p_wordlen < 0)
+        {
+            if (charclass == BB_SPACE)
+                continue;
+            else if (c == ';')
+            {
+                t_atom *ap = binbufparser_newatom(p);
+                SETSEMI(ap);
+                if (p->p_toolong)
+                {
+                    binbufparser_clear(p);
+                    continue;
+                }
+                binbuf_clear(b);
+                binbuf_add(b, p->p_n, p->p_vec);
+                p->p_n = 0;
+                *nused = i + 1;
+                return (1);
+            }
+            else if (c == ',')
+            {
+                t_atom *ap = binbufparser_newatom(p);
+                SETCOMMA(ap);
+                continue;
+            }
+            p->p_wordlen = p->p_floatstate = 0;
+            p->p_slash = p->p_dollar = p->p_lastdollar = 0;
+        }
+        else if (!p->p_slash && charclass != BB_WORD && charclass != BB_SLASH)
+        {
+                /* the word ends here; look at this char again */
+            binbufparser_endword(p);
+            i--;
+            continue;
+        }
+            /* a char of a word */
+        if (p->p_floatstate >= 0)
+            p->p_floatstate = binbuf_floatstate(p->p_floatstate, c);
+        if (p->p_lastdollar && c >= '0' && c <= '9')
+            p->p_dollar = 1;
+        p->p_lastdollar = (!p->p_slash && c == '$');
+        if (c != '\\' || p->p_slash)
+        {
+            p->p_word[p->p_wordlen++] = c;
+            p->p_slash = 0;
+        }
+        else p->p_slash = 1;
+            /* binbuf_text() also splits words this long */
+        if (p->p_wordlen == MAXPDSTRING)
+            binbufparser_endword(p);
+    }
+    *nused = size;
+    return (0);
+}
+
     /* convert a binbuf to text; no null termination. */
 void binbuf_gettext(const t_binbuf *x, char **bufp, int *lengthp)
 {
     char *buf = getbytes(0), *newbuf;
     int length = 0;
     char string[MAXPDSTRING];
+    t_atom *vec = binbuf_tempvec(x);
     const t_atom *ap;
     int indx;
 
-    for (ap = x->b_vec, indx = x->b_n; indx--; ap++)
+    for (ap = vec, indx = x->b_n; indx--; ap++)
     {
         int newlength;
         if ((ap->a_type == A_SEMI || ap->a_type == A_COMMA) &&
@@ -228,6 +803,7 @@ void binbuf_gettext(const t_binbuf *x, char **bufp, int *lengthp)
             length--;
         }
     }
+    binbuf_freetempvec(x, vec);
     *bufp = buf;
     *lengthp = length;
 }
@@ -296,8 +872,9 @@ void binbuf_addbinbuf(t_binbuf *x, const t_binbuf *y)
 {
     t_binbuf *z = binbuf_new();
     int i, fixit;
-    t_atom *ap;
-    binbuf_add(z, y->b_n, y->b_vec);
+    t_atom *ap, *vec = binbuf_tempvec(y);
+    binbuf_add(z, y->b_n, vec);
+    binbuf_freetempvec(y, vec);
     for (i = 0, ap = z->b_vec; i < z->b_n; i++, ap++)
     {
         char tbuf[MAXPDSTRING];
@@ -432,6 +1009,7 @@ void binbuf_restore(t_binbuf *x, int argc, const t_atom *argv)
 void binbuf_print(const t_binbuf *x)
 {
     int i, startedpost = 0, newline = 1;
+    t_atom *vec = binbuf_tempvec(x);
     for (i = 0; i < x->b_n; i++)
     {
         if (newline)
@@ -440,12 +1018,13 @@ void binbuf_print(const t_binbuf *x)
             startpost("");
             startedpost = 1;
         }
-        postatom(1, x->b_vec + i);
-        if (x->b_vec[i].a_type == A_SEMI)
+        postatom(1, vec + i);
+        if (vec[i].a_type == A_SEMI)
             newline = 1;
         else newline = 0;
     }
     if (startedpost) endpost();
+    binbuf_freetempvec(x, vec);
 }
 
 int binbuf_getnatom(const t_binbuf *x)
@@ -455,15 +1034,21 @@ int binbuf_getnatom(const t_binbuf *x)
 
 t_atom *binbuf_getvec(const t_binbuf *x)
 {
+    if (x->b_packed)
+        binbuf_unpack(x);
     return (x->b_vec);
 }
 
 int binbuf_resize(t_binbuf *x, int newsize)
 {
-    t_atom *new = t_resizebytes(x->b_vec,
+    t_atom *new;
+    if (x->b_packed)
+        binbuf_unpack(x);
+    new = t_resizebytes(x->b_vec,
         x->b_n * sizeof(*x->b_vec), newsize * sizeof(*x->b_vec));
     if (new)
         x->b_vec = new, x->b_n = newsize;
+    x->b_stamp = ++binbuf_nextstamp;
     return (new != 0);
 }
 
@@ -611,14 +1196,32 @@ done:
 #define ATOMS_FREEA(x, n) (freebytes((x), (n) * sizeof(t_atom)))
 #endif
 
+    /* Messages longer than SMALLMSG are built in a scratch stack kept for
+    each level of nested binbuf_eval() calls, grown on demand and kept for
+    the next call, so that a message box evaluated over and over neither
+    allocates nor has to pre-scan its contents to see how much room it needs.
+    Only beyond EVALMAXDEPTH levels do we go back to sizing the stack here. */
+#define EVALMAXDEPTH 64
+static PERTHREAD t_atom *binbuf_evalstack[EVALMAXDEPTH];
+static PERTHREAD int binbuf_evalstacksize[EVALMAXDEPTH];
+static PERTHREAD int binbuf_evaldepth;
+
 void binbuf_eval(const t_binbuf *x, t_pd *target, int argc, const t_atom *argv)
 {
     t_atom smallstack[SMALLMSG], *mstack, *msp;
-    const t_atom *at = x->b_vec;
+    const t_atom *at = binbuf_getvec(x);
     int ac = x->b_n;
-    int nargs, maxnargs = 0;
+    int nargs, maxnargs = 0, depth = binbuf_evaldepth, stacksize = 0,
+        scratch = 0, named = 0;
     if (ac <= SMALLMSG)
         mstack = smallstack;
+    else if (depth < EVALMAXDEPTH)
+    {
+        mstack = binbuf_evalstack[depth];
+        stacksize = binbuf_evalstacksize[depth];
+        binbuf_evaldepth = depth + 1;
+        scratch = 1;
+    }
     else
     {
 #if 1
@@ -707,6 +1310,7 @@ void binbuf_eval(const t_binbuf *x, t_pd *target, int argc, const t_atom *argv)
             else
             {
                 at++, ac--;
+                named = 1;
                 break;
             }
         }
@@ -717,6 +1321,15 @@ void binbuf_eval(const t_binbuf *x, t_pd *target, int argc, const t_atom *argv)
         {
             t_symbol *s9;
             if (!ac) goto gotmess;
+            if (scratch && nargs == stacksize)
+            {
+                int newsize = 2 * stacksize + 4 * SMALLMSG;
+                mstack = (t_atom *)resizebytes(mstack,
+                    stacksize * sizeof(t_atom), newsize * sizeof(t_atom));
+                binbuf_evalstack[depth] = mstack;
+                binbuf_evalstacksize[depth] = stacksize = newsize;
+                msp = mstack + nargs;
+            }
             switch (at->a_type)
             {
             case A_SEMI:
@@ -782,6 +1395,9 @@ void binbuf_eval(const t_binbuf *x, t_pd *target, int argc, const t_atom *argv)
     gotmess:
         if (nargs)
         {
+                /* "pd msg-profile" times messages to receive names */
+            if (named && sched_msgprofile)
+                sched_msgenter(target);
             switch (mstack->a_type)
             {
             case A_SYMBOL:
@@ -794,6 +1410,8 @@ void binbuf_eval(const t_binbuf *x, t_pd *target, int argc, const t_atom *argv)
             default:
                 break;
             }
+            if (named && sched_msgprofile)
+                sched_msgleave();
         }
         msp = mstack;
         if (!ac) break;
@@ -802,17 +1420,408 @@ void binbuf_eval(const t_binbuf *x, t_pd *target, int argc, const t_atom *argv)
         ac--;
     }
 broken:
-    if (maxnargs > SMALLMSG)
+    if (scratch)
+    {
+            /* don't hang on to the room for an unusually big message */
+        if (stacksize > HUGEMSG)
+        {
+            freebytes(mstack, stacksize * sizeof(t_atom));
+            binbuf_evalstack[depth] = 0;
+            binbuf_evalstacksize[depth] = 0;
+        }
+        binbuf_evaldepth = depth;
+    }
+    else if (maxnargs > SMALLMSG)
          ATOMS_FREEA(mstack, maxnargs);
 }
 
-int binbuf_read(t_binbuf *b, const char *filename, const char *dirname, int crflag)
+/* Patch files read by binbuf_evalfile() are kept, parsed, in a per-instance
+cache, so that an abstraction that's instantiated many times (by [clone],
+for instance) is only read and parsed once.  There's room for enough files
+that a voice built from many different abstractions doesn't cycle through
+the whole cache for every copy; with least-recently-used eviction that would
+miss every time.  Each use still checks the
+file's size, modification time, and inode, so editing the file (or saving it
+from Pd, which drops the entry) makes it read again.  The atoms are
+copied out of the cache before being evaluated, since evaluating them
+might save, and so invalidate, the very same file.  "pd patchcache 0" turns
+this off. */
+
+#define PATCHCACHESIZE 256          /* files kept */
+#define PATCHCACHEMAXATOMS 0x100000 /* total atoms kept */
+
+typedef struct _patchcacheentry
+{
+    t_symbol *e_path;           /* dir/name as passed to binbuf_read() */
+    off_t e_size;
+    time_t e_mtime;
+    ino_t e_ino;
+    t_binbuf *e_binbuf;
+    unsigned int e_lastused;
+} t_patchcacheentry;
+
+struct _patchcache
+{
+    t_patchcacheentry p_vec[PATCHCACHESIZE];
+    int p_n;
+    int p_natom;
+    unsigned int p_clock;
+};
+
+static int binbuf_usecache = 1;
+
+static void patchcache_drop(struct _patchcache *c, int i)
+{
+    c->p_natom -= c->p_vec[i].e_binbuf->b_n;
+    binbuf_free(c->p_vec[i].e_binbuf);
+    c->p_vec[i] = c->p_vec[--c->p_n];
+}
+
+static t_patchcacheentry *patchcache_find(const char *path)
+{
+    struct _patchcache *c = STUFF->st_patchcache;
+    t_symbol *s;
+    int i;
+    if (!c)
+        return (0);
+    s = gensym(path);
+    for (i = 0; i < c->p_n; i++)
+        if (c->p_vec[i].e_path == s)
+            return (&c->p_vec[i]);
+    return (0);
+}
+
+static void patchcache_forget(const char *path)
+{
+    t_patchcacheentry *e = patchcache_find(path);
+    if (e)
+        patchcache_drop(STUFF->st_patchcache,
+            (int)(e - STUFF->st_patchcache->p_vec));
+}
+
+static void patchcache_add(const char *path, const struct stat *st,
+    const t_binbuf *b)
+{
+    struct _patchcache *c = STUFF->st_patchcache;
+    t_patchcacheentry *e;
+    if (b->b_n > PATCHCACHEMAXATOMS / 4)
+        return;
+    if (!c && !(c = STUFF->st_patchcache =
+        (struct _patchcache *)getbytes(sizeof(*c))))
+            return;
+    patchcache_forget(path);
+        /* make room by dropping whatever was used longest ago */
+    while (c->p_n && (c->p_n == PATCHCACHESIZE ||
+        c->p_natom + b->b_n > PATCHCACHEMAXATOMS))
+    {
+        int i, oldest = 0;
+        for (i = 1; i < c->p_n; i++)
+            if (c->p_vec[i].e_lastused < c->p_vec[oldest].e_lastused)
+                oldest = i;
+        patchcache_drop(c, oldest);
+    }
+    e = &c->p_vec[c->p_n++];
+    e->e_path = gensym(path);
+    e->e_size = st->st_size;
+    e->e_mtime = st->st_mtime;
+    e->e_ino = st->st_ino;
+    e->e_binbuf = binbuf_duplicate(b);
+    e->e_lastused = ++c->p_clock;
+    c->p_natom += b->b_n;
+}
+
+    /* free the cache; called when the Pd instance is freed */
+void binbuf_freecache(void)
+{
+    struct _patchcache *c = STUFF->st_patchcache;
+    if (c)
+    {
+        while (c->p_n)
+            patchcache_drop(c, 0);
+        freebytes(c, sizeof(*c));
+        STUFF->st_patchcache = 0;
+    }
+}
+
+    /* drop cached copies of a file by name ("name.pd"), wherever it is */
+void binbuf_forgetcached(const char *name)
+{
+    struct _patchcache *c = STUFF->st_patchcache;
+    int i, len = (int)strlen(name);
+    if (!c)
+        return;
+    for (i = c->p_n; i--; )
+    {
+        const char *path = c->p_vec[i].e_path->s_name;
+        int pathlen = (int)strlen(path);
+        if (pathlen >= len && !strcmp(path + pathlen - len, name) &&
+            (pathlen == len || path[pathlen - len - 1] == '/'))
+                patchcache_drop(c, i);
+    }
+}
+
+    /* "patchcache" message to Pd */
+void glob_patchcache(void *dummy, t_floatarg f)
+{
+    binbuf_usecache = (f != 0);
+    if (!binbuf_usecache)
+        binbuf_freecache();
+}
+
+/* While a patch is being instantiated, the files of the abstractions it uses
+are read ahead by a few file threads, so that reading one abstraction from
+disk overlaps with reading the others and with creating objects.  When
+binbuf_evalfile() has read a patch, it looks for "#X obj" lines naming
+classes that don't exist yet, and queues each name with a list of the
+places the loader would look for "name.pd" and "name/name.pd" (the patch's
+own directory and the search paths, but not "declare" paths, which don't
+exist until the patch is running).  A thread opens the first one there and
+reads it into memory.  binbuf_doread() then takes the bytes instead of
+reading the file itself if a finished read is of the same file (by device,
+inode, size and modification time); otherwise the read-ahead was wasted but
+harmless.  The bytes are still parsed here in the scheduler thread, since
+gensym() isn't threadsafe, but the patch cache above means each file is
+parsed only once anyway.  Reads nobody wanted are dropped when the
+outermost binbuf_evalfile() returns. */
+
+#ifdef HAVE_UNISTD_H
+#define PREFETCH
+#include <pthread.h>
+
+#define PREFETCHTHREADS 4       /* reading is I/O bound, so not nproc */
+#define PREFETCHMAX 256         /* most reads queued or kept at once */
+
+typedef struct _prefetch
+{
+    struct _prefetch *f_next;   /* all of them, in the order queued */
+    struct _prefetch *f_qnext;  /* next waiting for a thread */
+    t_symbol *f_name;           /* class name we're looking for */
+    char *f_where;              /* candidate paths, null-terminated */
+    int f_wheresize;            /* bytes allocated for f_where */
+    int f_wherelen;             /* bytes used */
+    int f_state;                /* see below */
+    int f_dropped;              /* nobody wants it; thread should free */
+    struct stat f_st;           /* the file that was read */
+    char *f_buf;
+    long f_length;
+} t_prefetch;
+
+#define PF_QUEUED 0
+#define PF_READING 1
+#define PF_DONE 2
+#define PF_FAILED 3
+
+static pthread_mutex_t prefetch_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t prefetch_cond = PTHREAD_COND_INITIALIZER;
+static t_prefetch *prefetch_list, *prefetch_qhead, *prefetch_qtail;
+static int prefetch_n, prefetch_nthreads, prefetch_depth;
+
+static void prefetch_free(t_prefetch *f)
+{
+    if (f->f_buf)
+        freebytes(f->f_buf, f->f_length);
+    freebytes(f->f_where, f->f_wheresize);
+    freebytes(f, sizeof(*f));
+}
+
+    /* the work done by a file thread, without the lock */
+static void prefetch_doread(t_prefetch *f)
+{
+    char *path;
+    int fd;
+    for (path = f->f_where; path < f->f_where + f->f_wherelen;
+        path += strlen(path) + 1)
+    {
+        if ((fd = sys_open(path, 0)) < 0)
+            continue;
+        if (fstat(fd, &f->f_st) < 0 || S_ISDIR(f->f_st.st_mode) ||
+            !(f->f_buf = (char *)getbytes(f->f_st.st_size)))
+        {
+            close(fd);
+            continue;
+        }
+        f->f_length = f->f_st.st_size;
+        if (read(fd, f->f_buf, f->f_st.st_size) != f->f_st.st_size)
+        {
+            freebytes(f->f_buf, f->f_length);
+            f->f_buf = 0;
+        }
+        close(fd);
+        return;     /* the loader would stop at the first file it opens */
+    }
+}
+
+static void *prefetch_thread(void *dummy)
+{
+    sys_setthreadrole(SYS_THREAD_FILE);
+    pthread_mutex_lock(&prefetch_mutex);
+    while (1)
+    {
+        t_prefetch *f;
+        if (!(f = prefetch_qhead))
+        {
+            pthread_cond_wait(&prefetch_cond, &prefetch_mutex);
+            continue;
+        }
+        if (!(prefetch_qhead = f->f_qnext))
+            prefetch_qtail = 0;
+        f->f_state = PF_READING;
+        pthread_mutex_unlock(&prefetch_mutex);
+        prefetch_doread(f);
+        pthread_mutex_lock(&prefetch_mutex);
+        if (f->f_dropped)
+            prefetch_free(f);
+        else f->f_state = (f->f_buf ? PF_DONE : PF_FAILED);
+    }
+    return (0);
+}
+
+    /* queue a read-ahead for "name", unless one is already there */
+static void prefetch_add(t_symbol *name, const char *dirs, int dirsize)
+{
+    t_prefetch *f;
+    const char *dir;
+    int size = 0, len = strlen(name->s_name), n;
+    for (f = prefetch_list; f; f = f->f_next)
+        if (f->f_name == name)
+            return;
+    for (dir = dirs; dir < dirs + dirsize; dir += strlen(dir) + 1)
+        size += 2 * (strlen(dir) + 2 * len + 6);
+    f = (t_prefetch *)getbytes(sizeof(*f));
+    f->f_name = name;
+    f->f_where = (char *)getbytes(f->f_wheresize = size);
+    for (n = 0, dir = dirs; dir < dirs + dirsize; dir += strlen(dir) + 1)
+    {
+        n += sprintf(f->f_where + n, "%s/%s.pd", dir, name->s_name) + 1;
+        n += sprintf(f->f_where + n, "%s/%s/%s.pd", dir,
+            name->s_name, name->s_name) + 1;
+    }
+    f->f_wherelen = n;
+    f->f_state = PF_QUEUED;
+    f->f_dropped = 0;
+    f->f_buf = 0;
+    f->f_length = 0;
+    f->f_qnext = 0;
+    f->f_next = prefetch_list;
+    prefetch_list = f;
+    prefetch_n++;
+    if (prefetch_qtail)
+        prefetch_qtail->f_qnext = f;
+    else prefetch_qhead = f;
+    prefetch_qtail = f;
+    pthread_cond_signal(&prefetch_cond);
+}
+
+    /* look through a patch for abstractions we'll need and queue them */
+static void binbuf_prefetch(const t_binbuf *b, const char *dirname)
+{
+    int i, dirsize = 0;
+    char dirs[MAXPDSTRING * 8];
+    const t_atom *ap = b->b_vec;
+        /* instances on other threads may be loading patches too */
+    pthread_mutex_lock(&prefetch_mutex);
+    if (!prefetch_nthreads)
+    {
+        for (i = 0; i < PREFETCHTHREADS; i++)
+        {
+            pthread_t thread;
+            if (pthread_create(&thread, 0, prefetch_thread, 0))
+                break;
+            pthread_detach(thread);
+        }
+        if (!(prefetch_nthreads = i))
+        {
+            pthread_mutex_unlock(&prefetch_mutex);
+            return;
+        }
+    }
+    for (i = 0; i + 4 < b->b_n && prefetch_n < PREFETCHMAX; i++)
+    {
+        t_symbol *s;
+        if (ap[i].a_type == A_SYMBOL && ap[i].a_w.w_symbol == &s__X &&
+            ap[i+1].a_type == A_SYMBOL &&
+                !strcmp(ap[i+1].a_w.w_symbol->s_name, "obj") &&
+            ap[i+4].a_type == A_SYMBOL &&
+            !strchr((s = ap[i+4].a_w.w_symbol)->s_name, '$') &&
+            !zgetfn(&pd_objectmaker, s))
+        {
+            if (!dirsize && !(dirsize =
+                sys_getsearchdirs(dirname, dirs, sizeof(dirs))))
+                    break;
+            prefetch_add(s, dirs, dirsize);
+            i += 4;
+        }
+    }
+    pthread_mutex_unlock(&prefetch_mutex);
+}
+
+    /* take a finished read of the file "st" if there is one.  On success
+    the caller owns the buffer */
+static char *prefetch_take(const struct stat *st, long *length)
+{
+    t_prefetch *f, **fp;
+    char *buf = 0;
+    pthread_mutex_lock(&prefetch_mutex);
+    for (fp = &prefetch_list; (f = *fp); fp = &f->f_next)
+        if (f->f_state == PF_DONE && f->f_st.st_dev == st->st_dev &&
+            f->f_st.st_ino == st->st_ino && f->f_st.st_size == st->st_size &&
+            f->f_st.st_mtime == st->st_mtime)
+    {
+        *fp = f->f_next;
+        buf = f->f_buf;
+        *length = f->f_length;
+        f->f_buf = 0;
+        prefetch_free(f);
+        prefetch_n--;
+        break;
+    }
+    pthread_mutex_unlock(&prefetch_mutex);
+    return (buf);
+}
+
+    /* drop reads nobody took */
+    /* patches being loaded, counting nested ones and those of other Pd
+    instances, which may be loading on threads of their own */
+static void prefetch_enter(void)
+{
+    pthread_mutex_lock(&prefetch_mutex);
+    prefetch_depth++;
+    pthread_mutex_unlock(&prefetch_mutex);
+}
+
+    /* once nobody is loading any more, drop whatever wasn't used */
+static void prefetch_leave(void)
+{
+    t_prefetch *f;
+    pthread_mutex_lock(&prefetch_mutex);
+    if (--prefetch_depth)
+    {
+        pthread_mutex_unlock(&prefetch_mutex);
+        return;
+    }
+    prefetch_qhead = prefetch_qtail = 0;
+    while ((f = prefetch_list))
+    {
+        prefetch_list = f->f_next;
+        if (f->f_state == PF_READING)
+            f->f_dropped = 1;
+        else prefetch_free(f);
+    }
+    prefetch_n = 0;
+    pthread_mutex_unlock(&prefetch_mutex);
+}
+
+#endif /* PREFETCH */
+
+static int binbuf_doread(t_binbuf *b, const char *filename,
+    const char *dirname, int crflag, int cache)
 {
     long length;
     int fd;
     int readret;
     char *buf;
     char namebuf[MAXPDSTRING];
+    struct stat st;
 
     if (*dirname)
         snprintf(namebuf, MAXPDSTRING-1, "%s/%s", dirname, filename);
@@ -820,6 +1829,31 @@ int binbuf_read(t_binbuf *b, const char *filename, const char *dirname, int crfl
         snprintf(namebuf, MAXPDSTRING-1, "%s", filename);
     namebuf[MAXPDSTRING-1] = 0;
 
+        /* a cached copy saves opening the file at all; it's checked with
+        stat(), which just fails (and sends us to the file) for names that
+        sys_open() would have to translate */
+    if (cache && !stat(namebuf, &st))
+    {
+        t_patchcacheentry *e = patchcache_find(namebuf);
+        if (e && e->e_size == st.st_size && e->e_mtime == st.st_mtime &&
+            e->e_ino == st.st_ino)
+        {
+            binbuf_clear(b);
+            binbuf_add(b, e->e_binbuf->b_n, e->e_binbuf->b_vec);
+            e->e_lastused = ++STUFF->st_patchcache->p_clock;
+            return (0);
+        }
+#ifdef PREFETCH
+        if ((buf = prefetch_take(&st, &length)))
+        {
+            binbuf_text(b, buf, length);
+            patchcache_add(namebuf, &st, b);
+            freebytes(buf, length);
+            return (0);
+        }
+#endif
+    }
+    else cache = 0;
     if ((fd = sys_open(namebuf, 0)) < 0)
     {
         fprintf(stderr, "open: ");
@@ -851,6 +1885,8 @@ int binbuf_read(t_binbuf *b, const char *filename, const char *dirname, int crfl
                 buf[i] = ';';
     }
     binbuf_text(b, buf, length);
+    if (cache)
+        patchcache_add(namebuf, &st, b);
 
 #if 0
     startpost("binbuf_read "); postatom(b->b_n, b->b_vec); endpost();
@@ -861,6 +1897,11 @@ int binbuf_read(t_binbuf *b, const char *filename, const char *dirname, int crfl
     return (0);
 }
 
+int binbuf_read(t_binbuf *b, const char *filename, const char *dirname, int crflag)
+{
+    return (binbuf_doread(b, filename, dirname, crflag, 0));
+}
+
     /* read a binbuf from a file, via the search patch of a canvas */
 int binbuf_read_via_canvas(t_binbuf *b, const char *filename,
     const t_canvas *canvas, int crflag)
@@ -906,7 +1947,7 @@ int binbuf_write(const t_binbuf *x, const char *filename, const char *dir, int c
 {
     FILE *f = 0;
     char sbuf[WBUFSIZE], fbuf[MAXPDSTRING], *bp = sbuf, *ep = sbuf + WBUFSIZE;
-    t_atom *ap;
+    t_atom *ap, *vec = 0;
     t_binbuf *y = 0;
     const t_binbuf *z = x;
     int indx;
@@ -917,6 +1958,7 @@ int binbuf_write(const t_binbuf *x, const char *filename, const char *dir, int c
     else
         snprintf(fbuf, MAXPDSTRING-1, "%s", filename);
     fbuf[MAXPDSTRING-1] = 0;
+    patchcache_forget(fbuf);
 
     if (!strcmp(filename + strlen(filename) - 4, ".pat") ||
         !strcmp(filename + strlen(filename) - 4, ".mxt"))
@@ -927,7 +1969,8 @@ int binbuf_write(const t_binbuf *x, const char *filename, const char *dir, int c
 
     if (!(f = sys_fopen(fbuf, "w")))
         goto fail;
-    for (ap = z->b_vec, indx = z->b_n; indx--; ap++)
+    vec = binbuf_tempvec(z);
+    for (ap = vec, indx = z->b_n; indx--; ap++)
     {
         int length;
             /* estimate how many characters will be needed.  Printing out
@@ -967,11 +2010,15 @@ int binbuf_write(const t_binbuf *x, const char *filename, const char *dir, int c
     if (fflush(f) != 0)
         goto fail;
 
+    binbuf_freetempvec(z, vec);
     if (y)
         binbuf_free(y);
     fclose(f);
+    sys_flushdircache();    /* it might be a new abstraction */
     return (0);
 fail:
+    if (vec)
+        binbuf_freetempvec(z, vec);
     if (y)
         binbuf_free(y);
     if (f)
@@ -992,7 +2039,7 @@ from Pd to Max hasn't been tested for patches with subpatches yet!  */
 static t_binbuf *binbuf_convert(const t_binbuf *oldb, int maxtopd)
 {
     t_binbuf *newb = binbuf_new();
-    t_atom *vec = oldb->b_vec;
+    t_atom *vec = binbuf_getvec(oldb);
     t_int n = oldb->b_n, nextindex, stackdepth = 0, stack[MAXSTACK] = {0},
         nobj = 0, gotfontsize = 0;
 	int i;
@@ -1471,7 +2518,7 @@ void binbuf_evalfile(t_symbol *name, t_symbol *dir)
     int dspstate = canvas_suspend_dsp();
         /* set filename so that new canvases can pick them up */
     glob_setfilename(0, name, dir);
-    if (binbuf_read(b, name->s_name, dir->s_name, 0))
+    if (binbuf_doread(b, name->s_name, dir->s_name, 0, binbuf_usecache))
         error("%s: read failed; %s", name->s_name, strerror(errno));
     else
     {
@@ -1485,7 +2532,15 @@ void binbuf_evalfile(t_symbol *name, t_symbol *dir)
             binbuf_free(b);
             b = newb;
         }
+#ifdef PREFETCH
+        else if (binbuf_usecache)
+            binbuf_prefetch(b, dir->s_name);
+        prefetch_enter();
+#endif
         binbuf_eval(b, 0, 0, 0);
+#ifdef PREFETCH
+        prefetch_leave();
+#endif
             /* avoid crashing if no canvas was created by binbuf eval */
         if (s__X.s_thing && *s__X.s_thing == canvas_class)
             canvas_initbang((t_canvas *)(s__X.s_thing)); /* JMZ*/
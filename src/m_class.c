@@ -44,6 +44,9 @@ t_pdinstance pd_maininstance;
 
 static t_symbol *dogensym(const char *s, t_symbol *oldsym,
     t_pdinstance *pdinstance);
+static void symtab_rehash(t_pdinstance *x, int nslots);
+static void symtab_freechunks(t_pdinstance *x);
+static void method_setcall(t_class *c, t_methodentry *m);
 void x_midi_newpdinstance( void);
 void x_midi_freepdinstance( void);
 void s_inter_newpdinstance( void);
@@ -52,6 +55,9 @@ void g_canvas_newpdinstance( void);
 void g_canvas_freepdinstance( void);
 void d_ugen_newpdinstance( void);
 void d_ugen_freepdinstance( void);
+void m_memory_freepdinstance(void);
+void s_print_newpdinstance(void);
+void s_print_freepdinstance(void);
 void new_anything(void *dummy, t_symbol *s, int argc, t_atom *argv);
 
 void s_stuff_newpdinstance(void)
@@ -60,10 +66,23 @@ void s_stuff_newpdinstance(void)
     STUFF->st_externlist = STUFF->st_searchpath =
         STUFF->st_staticpath = STUFF->st_helppath = STUFF->st_temppath = 0;
     STUFF->st_schedblocksize = STUFF->st_blocksize = DEFDACBLKSIZE;
+    STUFF->st_clockheap = 0;
+    STUFF->st_nclocks = STUFF->st_clockheapsize = 0;
+    STUFF->st_clockorder = 0;
+    STUFF->st_patchcache = 0;
+    STUFF->st_dircache = 0;
+    STUFF->st_pathgen = 0;
+    s_print_newpdinstance();
 }
 
 void s_stuff_freepdinstance(void)
 {
+    s_print_freepdinstance();
+    if (STUFF->st_clockheap)
+        freebytes(STUFF->st_clockheap,
+            STUFF->st_clockheapsize * sizeof(*STUFF->st_clockheap));
+    binbuf_freecache();
+    sys_flushdircache();
     freebytes(STUFF, sizeof(*STUFF));
 }
 
@@ -77,6 +96,11 @@ static t_pdinstance *pdinstance_init(t_pdinstance *x)
     x->pd_symhash = getbytes(SYMTABHASHSIZE * sizeof(*x->pd_symhash));
     for (i = 0; i < SYMTABHASHSIZE; i++)
         x->pd_symhash[i] = 0;
+    x->pd_symhashsize = SYMTABHASHSIZE;
+    x->pd_nsym = 0;
+    x->pd_symoldhash = 0;
+    x->pd_symoldsize = x->pd_symrehashed = 0;
+    x->pd_symchunks = 0;
 #ifdef PDINSTANCE
     dogensym("pointer",   &x->pd_s_pointer,  x);
     dogensym("float",     &x->pd_s_float,    x);
@@ -112,16 +136,18 @@ static t_pdinstance *pdinstance_init(t_pdinstance *x)
     return (x);
 }
 
-static void class_addmethodtolist(t_class *c, t_methodentry **methodlist,
+    /* returns true if an old method by the same name had to be renamed */
+static int class_addmethodtolist(t_class *c, t_methodentry **methodlist,
     int nmethod, t_gotfn fn, t_symbol *sel, t_atomtype *args,
         t_pdinstance *pdinstance)
 {
-    int i;
+    int i, aliased = 0;
     t_methodentry *m;
     for (i = 0; i < nmethod; i++)
         if ((*methodlist)[i].me_name == sel)
     {
         char nbuf[80];
+        aliased = 1;
         snprintf(nbuf, 80, "%s_aliased", sel->s_name);
         nbuf[79] = 0;
         (*methodlist)[i].me_name = dogensym(nbuf, 0, pdinstance);
@@ -140,6 +166,81 @@ static void class_addmethodtolist(t_class *c, t_methodentry **methodlist,
     i = 0;
     while ((m->me_arg[i] = args[i]))
         i++;
+    method_setcall(c, m);
+    return (aliased);
+}
+
+    /* Classes with more than a few methods (pd_objectmaker above all) get a
+    hash table mapping selectors to indices in the method list, using the
+    hash stored in the symbol.  Names, and therefore hashes and indices, are
+    the same in every Pd instance, so one table serves all of them. */
+
+#define METHODHASHMIN 8     /* fewer methods than this are just searched */
+
+static void class_hashmethod(t_class *c, int n)
+{
+    t_methodentry *mlist;
+    unsigned int mask = c->c_methodhashsize - 1, i;
+#ifdef PDINSTANCE
+    mlist = c->c_methods[0];
+#else
+    mlist = c->c_methods;
+#endif
+    i = mlist[n].me_name->s_hash & mask;
+    while (c->c_methodhash[i] >= 0)
+        i = (i + 1) & mask;
+    c->c_methodhash[i] = n;
+}
+
+    /* update the table after adding method number c_nmethod-1.  If that
+    renamed an older method we have to start over since its slot moved. */
+static void class_updatemethodhash(t_class *c, int rebuild)
+{
+    int i;
+    if (c->c_nmethod < METHODHASHMIN)
+        return;
+    if (!c->c_methodhash || rebuild || 2 * c->c_nmethod > c->c_methodhashsize)
+    {
+        int size = (c->c_methodhashsize ? c->c_methodhashsize : 16);
+        while (2 * c->c_nmethod > size)
+            size *= 2;
+        if (c->c_methodhash)
+            freebytes(c->c_methodhash,
+                c->c_methodhashsize * sizeof(*c->c_methodhash));
+        c->c_methodhash = (int *)getbytes(size * sizeof(*c->c_methodhash));
+        c->c_methodhashsize = size;
+        for (i = 0; i < size; i++)
+            c->c_methodhash[i] = -1;
+        for (i = 0; i < c->c_nmethod; i++)
+            class_hashmethod(c, i);
+    }
+    else class_hashmethod(c, c->c_nmethod - 1);
+}
+
+static t_methodentry *class_findmethod(const t_class *c, t_symbol *s)
+{
+    t_methodentry *m, *mlist;
+    int i;
+#ifdef PDINSTANCE
+    mlist = c->c_methods[pd_this->pd_instanceno];
+#else
+    mlist = c->c_methods;
+#endif
+    if (c->c_methodhash)
+    {
+        unsigned int mask = c->c_methodhashsize - 1, j = s->s_hash & mask;
+        while ((i = c->c_methodhash[j]) >= 0)
+        {
+            if (mlist[i].me_name == s)
+                return (mlist + i);
+            j = (j + 1) & mask;
+        }
+        return (0);
+    }
+    for (i = c->c_nmethod, m = mlist; i--; m++)
+        if (m->me_name == s)
+            return (m);
+    return (0);
 }
 
 #ifdef PDINSTANCE
@@ -196,14 +297,15 @@ EXTERN t_pdinstance *pdinstance_new(void)
 
 EXTERN void pdinstance_free(t_pdinstance *x)
 {
-    t_symbol *s;
     t_canvas *canvas;
-    int i, instanceno = x->pd_instanceno;
+    int i, instanceno;
     t_class *c;
     t_instanceinter *inter = x->pd_inter;
     pd_setinstance(x);
     sys_lock();
     pd_globallock();
+        /* only now, since other instances coming or going renumber us */
+    instanceno = x->pd_instanceno;
 
     canvas_suspend_dsp();
     while (x->pd_canvaslist)
@@ -220,34 +322,14 @@ EXTERN void pdinstance_free(t_pdinstance *x)
             pd_ninstances * sizeof(*c->c_methods),
             (pd_ninstances - 1) * sizeof(*c->c_methods));
     }
-    for (i =0; i < SYMTABHASHSIZE; i++)
-    {
-        while ((s = x->pd_symhash[i]))
-        {
-            x->pd_symhash[i] = s->s_next;
-            if(s != &x->pd_s_pointer &&
-               s != &x->pd_s_float &&
-               s != &x->pd_s_symbol &&
-               s != &x->pd_s_bang &&
-               s != &x->pd_s_list &&
-               s != &x->pd_s_anything &&
-               s != &x->pd_s_signal &&
-               s != &x->pd_s__N &&
-               s != &x->pd_s__X &&
-               s != &x->pd_s_x &&
-               s != &x->pd_s_y &&
-               s != &x->pd_s_)
-            {
-                freebytes(s->s_name, strlen(s->s_name)+1);
-                freebytes(s, sizeof(*s));
-            }
-        }
-    }
-    freebytes(x->pd_symhash, SYMTABHASHSIZE * sizeof (*x->pd_symhash));
+    symtab_rehash(x, x->pd_symoldsize);
+    symtab_freechunks(x);
+    freebytes(x->pd_symhash, x->pd_symhashsize * sizeof (*x->pd_symhash));
     x_midi_freepdinstance();
     g_canvas_freepdinstance();
     d_ugen_freepdinstance();
     s_stuff_freepdinstance();
+    m_memory_freepdinstance();
     for (i = instanceno; i < pd_ninstances-1; i++)
         pd_instances[i] = pd_instances[i+1];
     pd_instances = (t_pdinstance **)resizebytes(pd_instances,
@@ -472,6 +554,8 @@ t_class *class_new(t_symbol *s, t_newmethod newmethod, t_method freemethod,
     c->c_name = c->c_helpname = s;
     c->c_size = size;
     c->c_nmethod = 0;
+    c->c_methodhash = 0;
+    c->c_methodhashsize = 0;
     c->c_freemethod = (t_method)freemethod;
     c->c_bangmethod = pd_defaultbang;
     c->c_pointermethod = pd_defaultpointer;
@@ -489,6 +573,7 @@ t_class *class_new(t_symbol *s, t_newmethod newmethod, t_method freemethod,
     c->c_externdir = class_extern_dir;
     c->c_savefn = (typeflag == CLASS_PATCHABLE ? text_save : class_nosavefn);
     c->c_classfreefn = 0;
+    c->c_dspflags = 0;
 #if PDINSTANCE
     c->c_methods = (t_methodentry **)t_getbytes(
         pd_ninstances * sizeof(*c->c_methods));
@@ -529,6 +614,9 @@ void class_free(t_class *c)
 #else
     freebytes(c->c_methods, c->c_nmethod * sizeof(*c->c_methods));
 #endif
+    if (c->c_methodhash)
+        freebytes(c->c_methodhash,
+            c->c_methodhashsize * sizeof(*c->c_methodhash));
     freebytes(c, sizeof(*c));
 }
 
@@ -580,7 +668,7 @@ void class_addmethod(t_class *c, t_method fn, t_symbol *sel,
 {
     va_list ap;
     t_atomtype argtype = arg1;
-    int nargs, i;
+    int nargs, i, aliased;
     if(!c)
         return;
     va_start(ap, arg1);
@@ -634,17 +722,19 @@ void class_addmethod(t_class *c, t_method fn, t_symbol *sel,
                 c->c_name->s_name, sel->s_name);
         argvec[nargs] = 0;
 #ifdef PDINSTANCE
-        for (i = 0; i < pd_ninstances; i++)
+        for (i = 0, aliased = 0; i < pd_ninstances; i++)
         {
-            class_addmethodtolist(c, &c->c_methods[i], c->c_nmethod,
-                (t_gotfn)fn, dogensym(sel->s_name, 0, pd_instances[i]),
-                    argvec, pd_instances[i]);
+            aliased |= class_addmethodtolist(c, &c->c_methods[i],
+                c->c_nmethod, (t_gotfn)fn,
+                    dogensym(sel->s_name, 0, pd_instances[i]),
+                        argvec, pd_instances[i]);
         }
 #else
-        class_addmethodtolist(c, &c->c_methods, c->c_nmethod,
+        aliased = class_addmethodtolist(c, &c->c_methods, c->c_nmethod,
             (t_gotfn)fn, sel, argvec, &pd_maininstance);
 #endif
         c->c_nmethod++;
+        class_updatemethodhash(c, aliased);
     }
     goto done;
 phooey:
@@ -752,6 +842,20 @@ int class_isdrawcommand(const t_class *c)
     return (c->c_drawcommand);
 }
 
+void class_setdspflags(t_class *c, int flags)
+{
+    if(!c)
+        return;
+    c->c_dspflags = flags;
+}
+
+int class_getdspflags(const t_class *c)
+{
+    if(!c)
+        return 0;
+    return (c->c_dspflags);
+}
+
 static void pd_floatforsignal(t_pd *x, t_float f)
 {
     int offset = (*x)->c_floatsignalin;
@@ -823,6 +927,124 @@ t_propertiesfn class_getpropertiesfn(const t_class *c)
 
 /* ---------------- the symbol table ------------------------ */
 
+    /* The symbol table is an open-addressed hash table (linear probing)
+    that doubles whenever it gets half full.  Symbols are never removed, so
+    rather than rehashing everything at once we keep the old table around and
+    move a few of its slots into the new one on each insertion; meanwhile,
+    lookups that miss in the new table also try the old one. */
+
+#define SYMREHASHSTEP 8     /* old slots moved per new symbol */
+
+static t_symbol *symtab_find(t_symbol **tab, int size, const char *s,
+    unsigned int hash, int length, t_symbol ***slotp)
+{
+    unsigned int mask = size - 1, i = hash & mask;
+    t_symbol *sym;
+    while ((sym = tab[i]))
+    {
+        if (sym->s_hash == hash && sym->s_length == length &&
+            !memcmp(sym->s_name, s, length))
+                break;
+        i = (i + 1) & mask;
+    }
+    if (slotp)
+        *slotp = tab + i;
+    return (sym);
+}
+
+static void symtab_place(t_symbol **tab, int size, t_symbol *sym)
+{
+    unsigned int mask = size - 1, i = sym->s_hash & mask;
+    while (tab[i])
+        i = (i + 1) & mask;
+    tab[i] = sym;
+}
+
+static void symtab_rehash(t_pdinstance *x, int nslots)
+{
+    while (x->pd_symoldhash && nslots--)
+    {
+        t_symbol *sym = x->pd_symoldhash[x->pd_symrehashed];
+        if (sym)
+            symtab_place(x->pd_symhash, x->pd_symhashsize, sym);
+        if (++x->pd_symrehashed == x->pd_symoldsize)
+        {
+            freebytes(x->pd_symoldhash,
+                x->pd_symoldsize * sizeof(*x->pd_symoldhash));
+            x->pd_symoldhash = 0;
+            x->pd_symoldsize = x->pd_symrehashed = 0;
+        }
+    }
+}
+
+static void symtab_grow(t_pdinstance *x)
+{
+        /* the step size should make this impossible, but in case we get
+        here mid-rehash, finish the previous one first */
+    symtab_rehash(x, x->pd_symoldsize);
+    x->pd_symoldhash = x->pd_symhash;
+    x->pd_symoldsize = x->pd_symhashsize;
+    x->pd_symrehashed = 0;
+    x->pd_symhashsize *= 2;
+    x->pd_symhash = (t_symbol **)getbytes(
+        x->pd_symhashsize * sizeof(*x->pd_symhash));
+}
+
+    /* Symbols are never freed (anyone may be holding a pointer to one), so
+    rather than paying for two heap allocations per symbol we carve symbols
+    and their names out of large chunks.  Names too big to share a chunk
+    get a chunk of their own. */
+
+#define SYMCHUNKSIZE 65536
+
+typedef struct _symchunk
+{
+    struct _symchunk *sc_next;
+    size_t sc_size;         /* bytes available after the header */
+    size_t sc_used;
+} t_symchunk;
+
+#define SYMCHUNKHEADER \
+    ((sizeof(t_symchunk) + sizeof(double) - 1) & ~(sizeof(double) - 1))
+
+static void *symtab_alloc(t_pdinstance *x, size_t n)
+{
+    t_symchunk *c = x->pd_symchunks;
+    if (!c || c->sc_used + n > c->sc_size)
+    {
+        size_t size = (n > SYMCHUNKSIZE/4 ? n : SYMCHUNKSIZE);
+        t_symchunk *c2 = (t_symchunk *)getbytes(SYMCHUNKHEADER + size);
+        c2->sc_size = size;
+        c2->sc_used = 0;
+            /* a private chunk for one big name goes after the current one
+            so that we keep filling that */
+        if (c && size != SYMCHUNKSIZE)
+        {
+            c2->sc_next = c->sc_next;
+            c->sc_next = c2;
+        }
+        else
+        {
+            c2->sc_next = c;
+            x->pd_symchunks = c2;
+        }
+        c = c2;
+    }
+    c->sc_used += n;
+    return ((char *)c + SYMCHUNKHEADER + (c->sc_used - n));
+}
+
+static void symtab_freechunks(t_pdinstance *x)
+{
+    t_symchunk *c, *next;
+    for (c = x->pd_symchunks; c; c = next)
+    {
+        next = c->sc_next;
+        freebytes(c, SYMCHUNKHEADER + c->sc_size);
+    }
+    x->pd_symchunks = 0;
+}
+
 static t_symbol *dogensym(const char *s, t_symbol *oldsym,
     t_pdinstance *pdinstance)
 {
@@ -837,25 +1059,75 @@ static t_symbol *dogensym(const char *s, t_symbol *oldsym,
         length++;
         s2++;
     }
-    symhashloc = pdinstance->pd_symhash + (hash & (SYMTABHASHSIZE-1));
-    while ((sym2 = *symhashloc))
-    {
-        if (!strcmp(sym2->s_name, s))
-            return(sym2);
-        symhashloc = &sym2->s_next;
-    }
+        /* djb2 puts similar names ("sym1", "sym2", ...) in neighboring
+        slots, which is bad for linear probing; scramble the bits */
+    hash ^= hash >> 16;
+    hash *= 0x45d9f3b;
+    hash ^= hash >> 16;
+    if ((sym2 = symtab_find(pdinstance->pd_symhash,
+        pdinstance->pd_symhashsize, s, hash, length, &symhashloc)))
+            return (sym2);
+    if (pdinstance->pd_symoldhash &&
+        (sym2 = symtab_find(pdinstance->pd_symoldhash,
+            pdinstance->pd_symoldsize, s, hash, length, 0)))
+                return (sym2);
     if (oldsym)
         sym2 = oldsym;
-    else sym2 = (t_symbol *)t_getbytes(sizeof(*sym2));
-    symname = t_getbytes(length+1);
+    else sym2 = (t_symbol *)symtab_alloc(pdinstance,
+        (sizeof(*sym2) + sizeof(double) - 1) & ~(sizeof(double) - 1));
+    symname = symtab_alloc(pdinstance,
+        (length + sizeof(double)) & ~(sizeof(double) - 1));
     sym2->s_next = 0;
     sym2->s_thing = 0;
+    sym2->s_hash = hash;
+    sym2->s_length = length;
     strcpy(symname, s);
     sym2->s_name = symname;
     *symhashloc = sym2;
+    pdinstance->pd_nsym++;
+    symtab_rehash(pdinstance, SYMREHASHSTEP);
+    if (2 * pdinstance->pd_nsym >= pdinstance->pd_symhashsize)
+        symtab_grow(pdinstance);
     return (sym2);
 }
 
+    /* "symtabstatus" message to Pd: print table size and probe lengths */
+void glob_symtabstatus(void *dummy)
+{
+    t_pdinstance *x = pd_this;
+    int i, n = 0, maxprobe = 0;
+    double totprobe = 0;
+    for (i = 0; i < x->pd_symhashsize; i++)
+    {
+        t_symbol *sym = x->pd_symhash[i];
+        if (sym)
+        {
+            int probe = 1 + ((i - (int)(sym->s_hash & (x->pd_symhashsize -
+                1))) & (x->pd_symhashsize - 1));
+            totprobe += probe;
+            if (probe > maxprobe)
+                maxprobe = probe;
+            n++;
+        }
+    }
+    post("symbol table: %d symbols, %d slots (%.1f%% full)",
+        x->pd_nsym, x->pd_symhashsize,
+            (100. * x->pd_nsym) / x->pd_symhashsize);
+    post("probe length: average %.2f, maximum %d",
+        (n ? totprobe / n : 0.), maxprobe);
+    {
+        t_symchunk *c;
+        size_t nbytes = 0, nused = 0;
+        for (c = x->pd_symchunks; c; c = c->sc_next)
+            nbytes += c->sc_size, nused += c->sc_used;
+        post("symbol storage: %lu bytes in use of %lu allocated",
+            (unsigned long)nused, (unsigned long)nbytes);
+    }
+    if (x->pd_symoldhash)
+        post("rehashing: %d of %d old slots moved",
+            x->pd_symrehashed, x->pd_symoldsize);
+}
+
 t_symbol *gensym(const char *s)
 {
     return(dogensym(s, 0, pd_this));
@@ -872,8 +1144,54 @@ static t_symbol *addfileextent(t_symbol *s)
     return (gensym(namebuf));
 }
 
+/* A setup function may be put off until one of the classes it makes is
+first asked for: register each of their names with class_addlazy() and
+new_anything() below runs the setup the first time one of them turns up. */
+
+typedef struct _lazyclass
+{
+    t_symbol *l_name;
+    t_lazysetup l_fn;
+    struct _lazyclass *l_next;
+} t_lazyclass;
+
+static t_lazyclass *class_lazylist;
+
+void class_addlazy(t_symbol *name, t_lazysetup fn)
+{
+    t_lazyclass *l = (t_lazyclass *)getbytes(sizeof(*l));
+    l->l_name = name;
+    l->l_fn = fn;
+    l->l_next = class_lazylist;
+    class_lazylist = l;
+}
+
+    /* run the setup for "s" if it was put off; true if there was one */
+static int class_runlazy(t_symbol *s)
+{
+    t_lazyclass *l, **lp;
+    t_lazysetup fn = 0;
+    for (l = class_lazylist; l; l = l->l_next)
+        if (l->l_name == s)
+            fn = l->l_fn;
+    if (!fn)
+        return (0);
+        /* forget all the names it makes before making them */
+    for (lp = &class_lazylist; (l = *lp); )
+    {
+        if (l->l_fn == fn)
+        {
+            *lp = l->l_next;
+            freebytes(l, sizeof(*l));
+        }
+        else lp = &l->l_next;
+    }
+    (*fn)();
+    return (1);
+}
+
 #define MAXOBJDEPTH 1000
-static int tryingalready;
+static PERTHREAD int tryingalready;
 
 void canvas_popabstraction(t_canvas *x);
 
@@ -895,10 +1213,19 @@ void new_anything(void *dummy, t_symbol *s, int argc, t_atom *argv)
       return;
     }
     pd_this->pd_newest = 0;
+    pd_globallock();    /* class_loadsym and the class list are shared */
+    if (class_runlazy(s))
+    {
+        pd_globalunlock();
+        tryingalready++;
+        typedmess(dummy, s, argc, argv);
+        tryingalready--;
+        return;
+    }
     class_loadsym = s;
-    pd_globallock();
     if (sys_load_lib(canvas_getcurrent(), s->s_name))
     {
+        pd_globalunlock();
         tryingalready++;
         typedmess(dummy, s, argc, argv);
         tryingalready--;
@@ -935,18 +1262,170 @@ typedef t_pd *(*t_fun5)(t_int i1, t_int i2, t_int i3, t_int i4, t_int i5,
 typedef t_pd *(*t_fun6)(t_int i1, t_int i2, t_int i3, t_int i4, t_int i5, t_int i6,
     t_floatarg d1, t_floatarg d2, t_floatarg d3, t_floatarg d4, t_floatarg d5);
 
-void pd_typedmess(t_pd *x, t_symbol *s, int argc, t_atom *argv)
+    /* Each method entry gets a "call" routine chosen when the method is
+    added, so that pd_typedmess() does one indirect call without looking at
+    the argument types again.  Methods taking A_GIMME, and those taking only
+    floats (the common "set 1 2 3" case), get their own short routines;
+    anything else goes through the general one that marshals pointers,
+    floats and symbols into the t_int and t_floatarg slots.  These return 0
+    if the arguments don't match. */
+
+static int method_callgimme(t_pd *x, t_methodentry *m, t_symbol *s,
+    int argc, t_atom *argv)
+{
+    (*((t_messgimme)(m->me_fun)))(x, s, argc, argv);
+    return (1);
+}
+
+static int method_callnewgimme(t_pd *x, t_methodentry *m, t_symbol *s,
+    int argc, t_atom *argv)
+{
+    pd_this->pd_newest = (*((t_newgimme)(m->me_fun)))(s, argc, argv);
+    return (1);
+}
+
+static int method_callfloats(t_pd *x, t_methodentry *m, t_symbol *s,
+    int argc, t_atom *argv)
+{
+    t_floatarg ad[MAXPDARG];
+    int i, n = (argc < m->me_nfloat ? argc : m->me_nfloat);
+    if (argc < m->me_nreq)
+        return (0);
+    for (i = 0; i < n; i++)
+    {
+        if (argv[i].a_type != A_FLOAT)
+            return (0);
+        ad[i] = argv[i].a_w.w_float;
+    }
+    for (; i < MAXPDARG; i++)
+        ad[i] = 0;
+    (*(t_fun1)(m->me_fun))((t_int)x, ad[0], ad[1], ad[2], ad[3], ad[4]);
+    return (1);
+}
+
+static int method_callgeneric(t_pd *x, t_methodentry *m, t_symbol *s,
+    int argc, t_atom *argv)
 {
-    t_method *f;
-    t_class *c = *x;
-    t_methodentry *m, *mlist;
     t_atomtype *wp, wanttype;
-    int i;
     t_int ai[MAXPDARG+1], *ap = ai;
     t_floatarg ad[MAXPDARG+1], *dp = ad;
     int narg = 0;
     t_pd *bonzo;
 
+    wp = m->me_arg;
+    if (argc > MAXPDARG) argc = MAXPDARG;
+    if (x != &pd_objectmaker) *(ap++) = (t_int)x, narg++;
+    while ((wanttype = *wp++))
+    {
+        switch (wanttype)
+        {
+        case A_POINTER:
+            if (!argc) return (0);
+            else
+            {
+                if (argv->a_type == A_POINTER)
+                    *ap = (t_int)(argv->a_w.w_gpointer);
+                else return (0);
+                argc--;
+                argv++;
+            }
+            narg++;
+            ap++;
+            break;
+        case A_FLOAT:
+            if (!argc) return (0);  /* falls through */
+        case A_DEFFLOAT:
+            if (!argc) *dp = 0;
+            else
+            {
+                if (argv->a_type == A_FLOAT)
+                    *dp = argv->a_w.w_float;
+                else return (0);
+                argc--;
+                argv++;
+            }
+            dp++;
+            break;
+        case A_SYMBOL:
+            if (!argc) return (0);  /* falls through */
+        case A_DEFSYM:
+            if (!argc) *ap = (t_int)(&s_);
+            else
+            {
+                if (argv->a_type == A_SYMBOL)
+                    *ap = (t_int)(argv->a_w.w_symbol);
+                        /* if it's an unfilled "dollar" argument it appears
+                        as zero here; cheat and bash it to the null
+                        symbol.  Unfortunately, this lets real zeros
+                        pass as symbols too, which seems wrong... */
+                else if (x == &pd_objectmaker && argv->a_type == A_FLOAT
+                    && argv->a_w.w_float == 0)
+                    *ap = (t_int)(&s_);
+                else return (0);
+                argc--;
+                argv++;
+            }
+            narg++;
+            ap++;
+            break;
+        default:
+            return (0);
+        }
+    }
+    switch (narg)
+    {
+    case 0 : bonzo = (*(t_fun0)(m->me_fun))
+        (ad[0], ad[1], ad[2], ad[3], ad[4]); break;
+    case 1 : bonzo = (*(t_fun1)(m->me_fun))
+        (ai[0], ad[0], ad[1], ad[2], ad[3], ad[4]); break;
+    case 2 : bonzo = (*(t_fun2)(m->me_fun))
+        (ai[0], ai[1], ad[0], ad[1], ad[2], ad[3], ad[4]); break;
+    case 3 : bonzo = (*(t_fun3)(m->me_fun))
+        (ai[0], ai[1], ai[2], ad[0], ad[1], ad[2], ad[3], ad[4]); break;
+    case 4 : bonzo = (*(t_fun4)(m->me_fun))
+        (ai[0], ai[1], ai[2], ai[3],
+            ad[0], ad[1], ad[2], ad[3], ad[4]); break;
+    case 5 : bonzo = (*(t_fun5)(m->me_fun))
+        (ai[0], ai[1], ai[2], ai[3], ai[4],
+            ad[0], ad[1], ad[2], ad[3], ad[4]); break;
+    case 6 : bonzo = (*(t_fun6)(m->me_fun))
+        (ai[0], ai[1], ai[2], ai[3], ai[4], ai[5],
+            ad[0], ad[1], ad[2], ad[3], ad[4]); break;
+    default: bonzo = 0;
+    }
+    if (x == &pd_objectmaker)
+        pd_this->pd_newest = bonzo;
+    return (1);
+}
+
+static void method_setcall(t_class *c, t_methodentry *m)
+{
+    t_atomtype *wp;
+    int nfloat = 0, nreq = 0, allfloat = 1;
+    for (wp = m->me_arg; *wp; wp++)
+    {
+        if (*wp == A_FLOAT)
+            nreq = ++nfloat;
+        else if (*wp == A_DEFFLOAT)
+            nfloat++;
+        else allfloat = 0;
+    }
+    m->me_nfloat = nfloat;
+    m->me_nreq = nreq;
+    if (m->me_arg[0] == A_GIMME)
+        m->me_call = (c == pd_objectmaker ?
+            method_callnewgimme : method_callgimme);
+    else if (allfloat && c != pd_objectmaker)
+        m->me_call = method_callfloats;
+    else m->me_call = method_callgeneric;
+}
+
+static void dotypedmess(t_pd *x, t_symbol *s, int argc, t_atom *argv)
+{
+    t_method *f;
+    t_class *c = *x;
+    t_methodentry *m;
+
         /* check for messages that are handled by fixed slots in the class
         structure.  We don't catch "pointer" though so that sending "pointer"
         to pd_objectmaker doesn't require that we supply a pointer value. */
@@ -976,105 +1455,10 @@ void pd_typedmess(t_pd *x, t_symbol *s, int argc, t_atom *argv)
             (*c->c_symbolmethod)(x, &s_);
         return;
     }
-#ifdef PDINSTANCE
-    mlist = c->c_methods[pd_this->pd_instanceno];
-#else
-    mlist = c->c_methods;
-#endif
-    for (i = c->c_nmethod, m = mlist; i--; m++)
-        if (m->me_name == s)
+    if ((m = class_findmethod(c, s)))
     {
-        wp = m->me_arg;
-        if (*wp == A_GIMME)
-        {
-            if (x == &pd_objectmaker)
-                pd_this->pd_newest =
-                    (*((t_newgimme)(m->me_fun)))(s, argc, argv);
-            else (*((t_messgimme)(m->me_fun)))(x, s, argc, argv);
-            return;
-        }
-        if (argc > MAXPDARG) argc = MAXPDARG;
-        if (x != &pd_objectmaker) *(ap++) = (t_int)x, narg++;
-        while ((wanttype = *wp++))
-        {
-            switch (wanttype)
-            {
-            case A_POINTER:
-                if (!argc) goto badarg;
-                else
-                {
-                    if (argv->a_type == A_POINTER)
-                        *ap = (t_int)(argv->a_w.w_gpointer);
-                    else goto badarg;
-                    argc--;
-                    argv++;
-                }
-                narg++;
-                ap++;
-                break;
-            case A_FLOAT:
-                if (!argc) goto badarg;  /* falls through */
-            case A_DEFFLOAT:
-                if (!argc) *dp = 0;
-                else
-                {
-                    if (argv->a_type == A_FLOAT)
-                        *dp = argv->a_w.w_float;
-                    else goto badarg;
-                    argc--;
-                    argv++;
-                }
-                dp++;
-                break;
-            case A_SYMBOL:
-                if (!argc) goto badarg;  /* falls through */
-            case A_DEFSYM:
-                if (!argc) *ap = (t_int)(&s_);
-                else
-                {
-                    if (argv->a_type == A_SYMBOL)
-                        *ap = (t_int)(argv->a_w.w_symbol);
-                            /* if it's an unfilled "dollar" argument it appears
-                            as zero here; cheat and bash it to the null
-                            symbol.  Unfortunately, this lets real zeros
-                            pass as symbols too, which seems wrong... */
-                    else if (x == &pd_objectmaker && argv->a_type == A_FLOAT
-                        && argv->a_w.w_float == 0)
-                        *ap = (t_int)(&s_);
-                    else goto badarg;
-                    argc--;
-                    argv++;
-                }
-                narg++;
-                ap++;
-                break;
-            default:
-                goto badarg;
-            }
-        }
-        switch (narg)
-        {
-        case 0 : bonzo = (*(t_fun0)(m->me_fun))
-            (ad[0], ad[1], ad[2], ad[3], ad[4]); break;
-        case 1 : bonzo = (*(t_fun1)(m->me_fun))
-            (ai[0], ad[0], ad[1], ad[2], ad[3], ad[4]); break;
-        case 2 : bonzo = (*(t_fun2)(m->me_fun))
-            (ai[0], ai[1], ad[0], ad[1], ad[2], ad[3], ad[4]); break;
-        case 3 : bonzo = (*(t_fun3)(m->me_fun))
-            (ai[0], ai[1], ai[2], ad[0], ad[1], ad[2], ad[3], ad[4]); break;
-        case 4 : bonzo = (*(t_fun4)(m->me_fun))
-            (ai[0], ai[1], ai[2], ai[3],
-                ad[0], ad[1], ad[2], ad[3], ad[4]); break;
-        case 5 : bonzo = (*(t_fun5)(m->me_fun))
-            (ai[0], ai[1], ai[2], ai[3], ai[4],
-                ad[0], ad[1], ad[2], ad[3], ad[4]); break;
-        case 6 : bonzo = (*(t_fun6)(m->me_fun))
-            (ai[0], ai[1], ai[2], ai[3], ai[4], ai[5],
-                ad[0], ad[1], ad[2], ad[3], ad[4]); break;
-        default: bonzo = 0;
-        }
-        if (x == &pd_objectmaker)
-            pd_this->pd_newest = bonzo;
+        if (!(*m->me_call)(x, m, s, argc, argv))
+            goto badarg;
         return;
     }
     (*c->c_anymethod)(x, s, argc, argv);
@@ -1084,6 +1468,18 @@ badarg:
         s->s_name, c->c_name->s_name);
 }
 
+void pd_typedmess(t_pd *x, t_symbol *s, int argc, t_atom *argv)
+{
+    if (sys_memstat)
+    {
+        const t_class *save = sys_memstatclass;
+        sys_memstatclass = *x;
+        dotypedmess(x, s, argc, argv);
+        sys_memstatclass = save;
+    }
+    else dotypedmess(x, s, argc, argv);
+}
+
     /* convenience routine giving a stdarg interface to typedmess().  Only
     ten args supported; it seems unlikely anyone will need more since
     longer messages are likely to be programmatically generated anyway. */
@@ -1144,16 +1540,10 @@ void nullfn(void) {}
 t_gotfn getfn(const t_pd *x, t_symbol *s)
 {
     const t_class *c = *x;
-    t_methodentry *m, *mlist;
-    int i;
+    t_methodentry *m;
 
-#ifdef PDINSTANCE
-    mlist = c->c_methods[pd_this->pd_instanceno];
-#else
-    mlist = c->c_methods;
-#endif
-    for (i = c->c_nmethod, m = mlist; i--; m++)
-        if (m->me_name == s) return(m->me_fun);
+    if ((m = class_findmethod(c, s)))
+        return(m->me_fun);
     pd_error(x, "%s: no method for message '%s'", c->c_name->s_name, s->s_name);
     return((t_gotfn)nullfn);
 }
@@ -1161,16 +1551,10 @@ t_gotfn getfn(const t_pd *x, t_symbol *s)
 t_gotfn zgetfn(const t_pd *x, t_symbol *s)
 {
     const t_class *c = *x;
-    t_methodentry *m, *mlist;
-    int i;
+    t_methodentry *m;
 
-#ifdef PDINSTANCE
-    mlist = c->c_methods[pd_this->pd_instanceno];
-#else
-    mlist = c->c_methods;
-#endif
-    for (i = c->c_nmethod, m = mlist; i--; m++)
-        if (m->me_name == s) return(m->me_fun);
+    if ((m = class_findmethod(c, s)))
+        return(m->me_fun);
     return(0);
 }
 
@@ -6,6 +6,8 @@
 /* all changes are labeled with      iemlib      */
 
 #include "m_pd.h"
+#include "m_imp.h"
+#include "s_stuff.h"
 
 void g_array_setup(void);
 void g_canvas_setup(void);
@@ -56,54 +58,67 @@ void d_osc_setup(void);
 void d_soundfile_setup(void);
 void d_ugen_setup(void);
 
+    /* time each setup function for "-startup-profile" */
+static void conf_timedsetup(void (*fn)(void), const char *name)
+{
+    uint64_t start = sys_getnanotime();
+    (*fn)();
+    sys_startupphase(name, sys_getnanotime() - start);
+}
+
+#define SETUP(fn) conf_timedsetup(fn, #fn)
+
 void conf_init(void)
 {
-    g_array_setup();
-    g_canvas_setup();
-    g_guiconnect_setup();
+    SETUP(g_array_setup);
+    SETUP(g_canvas_setup);
+    SETUP(g_guiconnect_setup);
 /* iemlib */
-    g_bang_setup();
-    g_hradio_setup();
-    g_hslider_setup();
-    g_mycanvas_setup();
-    g_numbox_setup();
-    g_toggle_setup();
-    g_vradio_setup();
-    g_vslider_setup();
-    g_vumeter_setup();
+    SETUP(g_bang_setup);
+    SETUP(g_hradio_setup);
+    SETUP(g_hslider_setup);
+    SETUP(g_mycanvas_setup);
+    SETUP(g_numbox_setup);
+    SETUP(g_toggle_setup);
+    SETUP(g_vradio_setup);
+    SETUP(g_vslider_setup);
+    SETUP(g_vumeter_setup);
 /* iemlib */
-    g_io_setup();
-    g_scalar_setup();
-    g_template_setup();
-    g_text_setup();
-    g_traversal_setup();
-    clone_setup();
-    m_pd_setup();
-    x_acoustics_setup();
-    x_interface_setup();
-    x_connective_setup();
-    x_time_setup();
-    x_arithmetic_setup();
-    x_array_setup();
-    x_midi_setup();
-    x_misc_setup();
-    x_net_setup();
-    x_qlist_setup();
-    x_gui_setup();
-    x_list_setup();
-    x_scalar_setup();
-    expr_setup();
-    d_arithmetic_setup();
-    d_array_setup();
-    d_ctl_setup();
-    d_dac_setup();
-    d_delay_setup();
-    d_fft_setup();
-    d_filter_setup();
-    d_global_setup();
-    d_math_setup();
-    d_misc_setup();
-    d_osc_setup();
-    d_soundfile_setup();
-    d_ugen_setup();
+    SETUP(g_io_setup);
+    SETUP(g_scalar_setup);
+    SETUP(g_template_setup);
+    SETUP(g_text_setup);
+    SETUP(g_traversal_setup);
+    SETUP(clone_setup);
+    SETUP(m_pd_setup);
+    SETUP(x_acoustics_setup);
+    SETUP(x_interface_setup);
+    SETUP(x_connective_setup);
+    SETUP(x_time_setup);
+    SETUP(x_arithmetic_setup);
+    SETUP(x_array_setup);
+    SETUP(x_midi_setup);
+    SETUP(x_misc_setup);
+    SETUP(x_net_setup);
+    SETUP(x_qlist_setup);
+    SETUP(x_gui_setup);
+    SETUP(x_list_setup);
+    SETUP(x_scalar_setup);
+        /* expr isn't set up until it's first used */
+    class_addlazy(gensym("expr"), expr_setup);
+    class_addlazy(gensym("expr~"), expr_setup);
+    class_addlazy(gensym("fexpr~"), expr_setup);
+    SETUP(d_arithmetic_setup);
+    SETUP(d_array_setup);
+    SETUP(d_ctl_setup);
+    SETUP(d_dac_setup);
+    SETUP(d_delay_setup);
+    SETUP(d_fft_setup);
+    SETUP(d_filter_setup);
+    SETUP(d_global_setup);
+    SETUP(d_math_setup);
+    SETUP(d_misc_setup);
+    SETUP(d_osc_setup);
+    SETUP(d_soundfile_setup);
+    SETUP(d_ugen_setup);
 }
@@ -18,9 +18,29 @@ over.  Some others are prototyped in m_imp.h as well. */
 void glob_menunew(void *dummy, t_symbol *name, t_symbol *dir);
 void glob_verifyquit(void *dummy, t_floatarg f);
 void glob_dsp(void *dummy, t_symbol *s, int argc, t_atom *argv);
+void glob_dspthreads(void *dummy, t_floatarg f);
+void glob_dspfuse(void *dummy, t_floatarg f);
+void glob_dsplocal(void *dummy, t_floatarg f);
+void glob_dummystats(void *dummy);
+void glob_dspftz(void *dummy, t_floatarg f);
+void glob_dspprofile(void *dummy, t_symbol *s, int argc, t_atom *argv);
+void glob_dspmap(void *dummy, t_symbol *s, int argc, t_atom *argv);
+void glob_ugen_printstate(void *dummy, t_symbol *s, int argc, t_atom *argv);
 void glob_meters(void *dummy, t_floatarg f);
 void glob_key(void *dummy, t_symbol *s, int ac, t_atom *av);
 void glob_audiostatus(void *dummy);
+void glob_symtabstatus(void *dummy);
+void glob_metrics(void *dummy, t_symbol *s, int argc, t_atom *argv);
+void glob_trace(void *dummy, t_symbol *s, int argc, t_atom *argv);
+void glob_msgprofile(void *dummy, t_symbol *s, int argc, t_atom *argv);
+void glob_loglimit(void *dummy, t_floatarg f);
+void glob_logfile(void *dummy, t_symbol *s, int argc, t_atom *argv);
+void glob_memstat(void *dummy, t_symbol *s, int argc, t_atom *argv);
+void glob_patchcache(void *dummy, t_floatarg f);
+void glob_reload(void *dummy, t_symbol *s);
+void glob_refreshpaths(void *dummy);
+void glob_guifps(void *dummy, t_floatarg f);
+void glob_guicoords(void *dummy, t_floatarg f);
 void glob_finderror(t_pd *dummy);
 void glob_findinstance(t_pd *dummy, t_symbol*s);
 void glob_audio_properties(t_pd *dummy, t_floatarg flongform);
@@ -146,11 +166,53 @@ void glob_init(void)
         gensym("verifyquit"), A_DEFFLOAT, 0);
     class_addmethod(glob_pdobject, (t_method)glob_foo, gensym("foo"), A_GIMME, 0);
     class_addmethod(glob_pdobject, (t_method)glob_dsp, gensym("dsp"), A_GIMME, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_dspthreads,
+        gensym("dspthreads"), A_FLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_dspfuse,
+        gensym("dspfuse"), A_FLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_dsplocal,
+        gensym("dsplocal"), A_FLOAT, 0);
+#ifdef USEAPI_DUMMY
+    class_addmethod(glob_pdobject, (t_method)glob_dummystats,
+        gensym("dummy-stats"), 0);
+#endif
+    class_addmethod(glob_pdobject, (t_method)glob_dspftz,
+        gensym("dspftz"), A_FLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_dspprofile,
+        gensym("dsp-profile"), A_GIMME, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_dspmap,
+        gensym("dsp-map"), A_GIMME, 0);
     class_addmethod(glob_pdobject, (t_method)glob_meters, gensym("meters"),
         A_FLOAT, 0);
     class_addmethod(glob_pdobject, (t_method)glob_key, gensym("key"), A_GIMME, 0);
     class_addmethod(glob_pdobject, (t_method)glob_audiostatus,
         gensym("audiostatus"), 0);
+    class_addmethod(glob_pdobject, (t_method)glob_symtabstatus,
+        gensym("symtabstatus"), 0);
+    class_addmethod(glob_pdobject, (t_method)glob_metrics,
+        gensym("metrics"), A_GIMME, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_trace,
+        gensym("trace"), A_GIMME, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_msgprofile,
+        gensym("msg-profile"), A_GIMME, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_loglimit,
+        gensym("log-limit"), A_FLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_logfile,
+        gensym("log-file"), A_GIMME, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_memstat,
+        gensym("memstat"), A_GIMME, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_patchcache,
+        gensym("patchcache"), A_FLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_reload,
+        gensym("reload"), A_SYMBOL, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_refreshpaths,
+        gensym("refresh-paths"), 0);
+    class_addmethod(glob_pdobject, (t_method)glob_guifps,
+        gensym("guifps"), A_FLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_guicoords,
+        gensym("guicoords"), A_FLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_ugen_printstate,
+        gensym("dspstatus"), A_GIMME, 0);
     class_addmethod(glob_pdobject, (t_method)glob_finderror,
         gensym("finderror"), 0);
     class_addmethod(glob_pdobject, (t_method)glob_findinstance,
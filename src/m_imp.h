@@ -12,11 +12,18 @@ in future releases.  The public (stable) API is in m_pd.h. */
 #ifndef __m_imp_h_
 
 /* the structure for a method handler ala Max */
+struct _methodentry;
+typedef int (*t_methodcall)(t_pd *x, struct _methodentry *m, t_symbol *s,
+    int argc, t_atom *argv);
+
 typedef struct _methodentry
 {
     t_symbol *me_name;
     t_gotfn me_fun;
     t_atomtype me_arg[MAXPDARG+1];
+    t_methodcall me_call;       /* routine to marshal args and call me_fun */
+    unsigned char me_nfloat;    /* float args if they're all floats */
+    unsigned char me_nreq;      /* how many of those are required */
 } t_methodentry;
 
 EXTERN_STRUCT _widgetbehavior;
@@ -40,6 +47,8 @@ struct _class
     t_methodentry *c_methods;
 #endif
     int c_nmethod;                      /* number of methods */
+    int *c_methodhash;                  /* index into methods by selector */
+    int c_methodhashsize;               /* slots in c_methodhash */
     t_method c_freemethod;              /* function to call before freeing */
     t_bangmethod c_bangmethod;          /* common methods */
     t_pointermethod c_pointermethod;
@@ -58,6 +67,7 @@ struct _class
     char c_firstin;                 /* if patchable, true if draw first inlet */
     char c_drawcommand;             /* a drawing command for a template */
     t_classfreefn c_classfreefn;    /* function to call before freeing class */
+    int c_dspflags;                 /* flags from class_setdspflags() */
 };
 
 /* m_pd.c */
@@ -66,6 +76,8 @@ EXTERN void pd_term_systems(void);
 
 /* m_class.c */
 EXTERN void pd_emptylist(t_pd *x);
+typedef void (*t_lazysetup)(void);
+EXTERN void class_addlazy(t_symbol *name, t_lazysetup fn);
 
 /* m_obj.c */
 EXTERN int obj_noutlets(const t_object *x);
@@ -78,6 +90,11 @@ EXTERN t_outconnect *obj_connect(t_object *source, int outno,
     t_object *sink, int inno);
 EXTERN void obj_disconnect(t_object *source, int outno, t_object *sink,
     int inno);
+    /* in g_canvas.c: keep its line index up to date */
+EXTERN void canvas_lineconnected(t_object *source, int outno,
+    t_outlet *outlet, t_outconnect *oc);
+EXTERN void canvas_linedisconnected(t_object *source, t_outconnect *oc);
+EXTERN void canvas_linesrenumbered(t_object *ob);
 EXTERN void outlet_setstacklim(void);
 EXTERN int obj_issignalinlet(const t_object *x, int m);
 EXTERN int obj_issignaloutlet(const t_object *x, int m);
@@ -87,12 +104,25 @@ EXTERN int obj_siginletindex(const t_object *x, int m);
 EXTERN int obj_sigoutletindex(const t_object *x, int m);
 EXTERN t_float *obj_findsignalscalar(const t_object *x, int m);
 
+/* m_memory.c */
+EXTERN int sys_memstat;                     /* true if accounting memory */
+EXTERN const struct _class *sys_memstatclass;   /* class to charge it to */
+
+/* m_sched.c */
+EXTERN int sched_msgprofile;        /* true during "pd msg-profile 1" */
+EXTERN void sched_msgenter(void *owner);
+EXTERN void sched_msgleave(void);
+
+/* x_connective.c */
+EXTERN t_float *value_find(t_symbol *s);
+extern int value_changes;           /* bumped whenever a variable is freed */
+
 /* s_inter.c */
 void pd_globallock(void);
 void pd_globalunlock(void);
 
 /* misc */
-#define SYMTABHASHSIZE 1024
+#define SYMTABHASHSIZE 1024     /* initial size of the symbol table */
 
 EXTERN t_pd *glob_evalfile(t_pd *ignore, t_symbol *name, t_symbol *dir);
 EXTERN void glob_initfromgui(void *dummy, t_symbol *s, int argc, t_atom *argv);
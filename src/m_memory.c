@@ -4,8 +4,15 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
 #include "m_pd.h"
 #include "m_imp.h"
+#include "s_stuff.h"
+#include "s_audio_paring.h"
 
 /* #define LOUD */
 #ifdef LOUD
@@ -17,11 +24,269 @@
 static int totalmem = 0;
 #endif
 
-void *getbytes(size_t nbytes)
+/* Small requests (up to POOLMAXSIZE bytes) are served from per-instance
+pools of fixed-size items carved out of aligned "slabs", one size class per
+POOLGRAIN bytes.  A slab is found from any pointer into it by masking, and
+a global bitmap of slab addresses tells whether a pointer came from a slab
+at all, so freebytes() and resizebytes() never have to trust the size
+they're handed, and memory from malloc() can still be freed here.
+
+A pool belongs to the thread that created it; other threads get memory
+from calloc(), and items they free are queued for the owner to take back
+on its next allocation.  Slabs that become empty are returned to the
+system unless they're the only one left in their size class. */
+
+#define POOLSLABSHIFT 16
+#define POOLSLABSIZE (1 << POOLSLABSHIFT)
+#define POOLGRAIN 16
+#define POOLNCLASS 16
+#define POOLMAXSIZE (POOLGRAIN * POOLNCLASS)
+#define POOLMAPBITS 16      /* slab bitmap: 2^16 pages of 2^16 slabs each */
+#define POOLMAPPAGE (1 << POOLMAPBITS)
+
+typedef struct _poolitem
+{
+    struct _poolitem *pi_next;
+} t_poolitem;
+
+typedef struct _slab
+{
+    struct _mempool *sl_pool;
+    struct _slab *sl_prev;      /* doubly linked list of slabs with room */
+    struct _slab *sl_next;
+    t_poolitem *sl_free;        /* items freed back to this slab */
+    char *sl_fresh;             /* start of space never handed out */
+    int sl_class;
+    int sl_nused;
+    int sl_nitems;
+} t_slab;
+
+#define SLABHEADER ((sizeof(t_slab) + 63) & ~63)
+
+typedef struct _mempool
+{
+    t_slab *p_partial[POOLNCLASS];  /* slabs that can still allocate */
+    pthread_t p_owner;
+    pthread_mutex_t p_mutex;        /* protects p_remote */
+    t_poolitem *p_remote;           /* items freed by other threads */
+} t_mempool;
+
+static unsigned char *pool_map[POOLMAPPAGE];
+static pthread_mutex_t pool_maplock = PTHREAD_MUTEX_INITIALIZER;
+
+    /* the map, and a pool's list of items coming back from other threads,
+    are read without the lock */
+#ifdef __GNUC__
+#define POOL_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define POOL_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define POOL_SETBITS(p, v) __atomic_fetch_or((p), (v), __ATOMIC_RELAXED)
+#define POOL_CLEARBITS(p, v) __atomic_fetch_and((p), ~(v), __ATOMIC_RELAXED)
+#else
+#define POOL_LOAD(p) (*(p))
+#define POOL_STORE(p, v) (*(p) = (v))
+#define POOL_SETBITS(p, v) (*(p) |= (v))
+#define POOL_CLEARBITS(p, v) (*(p) &= ~(v))
+#endif
+#ifndef PDINSTANCE
+static t_mempool *pool_main;
+#endif
+
+    /* set or clear the bitmap entry for a slab; returns 0 if the address is
+    out of the map's range, in which case we don't use the slab */
+static int pool_mapslab(t_slab *s, int on)
+{
+    uintptr_t index = (uintptr_t)s >> POOLSLABSHIFT;
+    uintptr_t page = index >> POOLMAPBITS, bit = index & (POOLMAPPAGE-1);
+    unsigned char *map;
+    if (page >= POOLMAPPAGE)
+        return (0);
+    pthread_mutex_lock(&pool_maplock);
+    if (!(map = pool_map[page]))
+    {
+        if (!(map = (unsigned char *)calloc(POOLMAPPAGE/8, 1)))
+        {
+            pthread_mutex_unlock(&pool_maplock);
+            return (0);
+        }
+        POOL_STORE(&pool_map[page], map);
+    }
+    if (on)
+        POOL_SETBITS(&map[bit >> 3], (unsigned char)(1 << (bit & 7)));
+    else POOL_CLEARBITS(&map[bit >> 3], (unsigned char)(1 << (bit & 7)));
+    pthread_mutex_unlock(&pool_maplock);
+    return (1);
+}
+
+static t_slab *pool_findslab(void *ptr)
+{
+    uintptr_t index = (uintptr_t)ptr >> POOLSLABSHIFT;
+    uintptr_t page = index >> POOLMAPBITS, bit = index & (POOLMAPPAGE-1);
+    unsigned char *map;
+    if (page >= POOLMAPPAGE || !(map = POOL_LOAD(&pool_map[page])) ||
+        !(POOL_LOAD(&map[bit >> 3]) & (1 << (bit & 7))))
+            return (0);
+    return ((t_slab *)(index << POOLSLABSHIFT));
+}
+
+static void *pool_sysalloc(void)
 {
     void *ret;
+#ifdef _WIN32
+    ret = _aligned_malloc(POOLSLABSIZE, POOLSLABSIZE);
+#else
+    if (posix_memalign(&ret, POOLSLABSIZE, POOLSLABSIZE))
+        ret = 0;
+#endif
+    return (ret);
+}
+
+static void pool_sysfree(void *x)
+{
+#ifdef _WIN32
+    _aligned_free(x);
+#else
+    free(x);
+#endif
+}
+
+static t_slab *slab_new(t_mempool *p, int class)
+{
+    t_slab *s = (t_slab *)pool_sysalloc();
+    size_t size = (class + 1) * POOLGRAIN;
+    if (!s)
+        return (0);
+    if (!pool_mapslab(s, 1))
+    {
+        pool_sysfree(s);
+        return (0);
+    }
+    s->sl_pool = p;
+    s->sl_free = 0;
+    s->sl_fresh = (char *)s + SLABHEADER;
+    s->sl_class = class;
+    s->sl_nused = 0;
+    s->sl_nitems = (int)((POOLSLABSIZE - SLABHEADER) / size);
+    s->sl_prev = 0;
+    if ((s->sl_next = p->p_partial[class]))
+        s->sl_next->sl_prev = s;
+    p->p_partial[class] = s;
+    return (s);
+}
+
+static void slab_unlink(t_slab *s)
+{
+    if (s->sl_next)
+        s->sl_next->sl_prev = s->sl_prev;
+    if (s->sl_prev)
+        s->sl_prev->sl_next = s->sl_next;
+    else s->sl_pool->p_partial[s->sl_class] = s->sl_next;
+    s->sl_next = s->sl_prev = 0;
+}
+
+static void pool_free(t_slab *s, void *ptr)
+{
+    t_mempool *p = s->sl_pool;
+    t_poolitem *it = (t_poolitem *)ptr;
+    it->pi_next = s->sl_free;
+    s->sl_free = it;
+    if (s->sl_nused-- == s->sl_nitems)
+    {
+        s->sl_prev = 0;
+        if ((s->sl_next = p->p_partial[s->sl_class]))
+            s->sl_next->sl_prev = s;
+        p->p_partial[s->sl_class] = s;
+    }
+    else if (!s->sl_nused && (s->sl_prev || s->sl_next))
+    {
+        slab_unlink(s);
+        pool_mapslab(s, 0);
+        pool_sysfree(s);
+    }
+}
+
+    /* take back items that other threads have freed */
+static void pool_drain(t_mempool *p)
+{
+    t_poolitem *it, *next;
+    pthread_mutex_lock(&p->p_mutex);
+    it = p->p_remote;
+    POOL_STORE(&p->p_remote, (t_poolitem *)0);
+    pthread_mutex_unlock(&p->p_mutex);
+    for (; it; it = next)
+    {
+        next = it->pi_next;
+        pool_free(pool_findslab(it), it);
+    }
+}
+
+static t_mempool *pool_get(void)
+{
+    t_mempool **pp;
+#ifdef PDINSTANCE
+    if (!pd_this)
+        return (0);
+    pp = &pd_this->pd_mempool;
+#else
+    pp = &pool_main;
+#endif
+    if (!*pp)
+    {
+        t_mempool *p = (t_mempool *)calloc(1, sizeof(*p));
+        if (!p)
+            return (0);
+        p->p_owner = pthread_self();
+        pthread_mutex_init(&p->p_mutex, 0);
+        *pp = p;
+    }
+    return (pthread_equal((*pp)->p_owner, pthread_self()) ? *pp : 0);
+}
+
+static void *pool_alloc(t_mempool *p, size_t nbytes)
+{
+    int class = (int)((nbytes - 1) / POOLGRAIN);
+    t_slab *s;
+    t_poolitem *it;
+    if (POOL_LOAD(&p->p_remote))
+        pool_drain(p);
+    if (!(s = p->p_partial[class]) && !(s = slab_new(p, class)))
+        return (0);
+    if ((it = s->sl_free))
+        s->sl_free = it->pi_next;
+    else
+    {
+        it = (t_poolitem *)s->sl_fresh;
+        s->sl_fresh += (class + 1) * POOLGRAIN;
+    }
+    if (++s->sl_nused == s->sl_nitems)
+        slab_unlink(s);
+    memset(it, 0, nbytes);
+    return (it);
+}
+
+static void pool_release(t_slab *s, void *ptr)
+{
+    t_mempool *p = s->sl_pool;
+    if (pthread_equal(p->p_owner, pthread_self()))
+        pool_free(s, ptr);
+    else
+    {
+        t_poolitem *it = (t_poolitem *)ptr;
+        pthread_mutex_lock(&p->p_mutex);
+        it->pi_next = p->p_remote;
+        POOL_STORE(&p->p_remote, it);
+        pthread_mutex_unlock(&p->p_mutex);
+    }
+}
+
+static void *dogetbytes(size_t nbytes)
+{
+    void *ret = 0;
+    t_mempool *p;
     if (nbytes < 1) nbytes = 1;
-    ret = (void *)calloc(nbytes, 1);
+    if (nbytes <= POOLMAXSIZE && (p = pool_get()))
+        ret = pool_alloc(p, nbytes);
+    if (!ret)
+        ret = (void *)calloc(nbytes, 1);
 #ifdef LOUD
     fprintf(stderr, "new  %lx %d\n", (int)ret, nbytes);
 #endif /* LOUD */
@@ -33,6 +298,18 @@ void *getbytes(size_t nbytes)
     return (ret);
 }
 
+static void memstat_add(void *x, size_t nbytes, const t_class *c);
+static void memstat_remove(void *x);
+static int memstat_find(void *x, const t_class **cp);
+
+void *getbytes(size_t nbytes)
+{
+    void *ret = dogetbytes(nbytes);
+    if (sys_memstat && ret)
+        memstat_add(ret, nbytes, sys_memstatclass);
+    return (ret);
+}
+
 void *getzbytes(size_t nbytes)  /* obsolete name */
 {
     return (getbytes(nbytes));
@@ -47,14 +324,33 @@ void *copybytes(const void *src, size_t nbytes)
     return (ret);
 }
 
-void *resizebytes(void *old, size_t oldsize, size_t newsize)
+static void *doresizebytes(void *old, size_t oldsize, size_t newsize)
 {
     void *ret;
+    t_slab *s;
     if (newsize < 1) newsize = 1;
     if (oldsize < 1) oldsize = 1;
-    ret = (void *)realloc((char *)old, newsize);
-    if (newsize > oldsize && ret)
-        memset(((char *)ret) + oldsize, 0, newsize - oldsize);
+    if (old && (s = pool_findslab(old)))
+    {
+        size_t size = (s->sl_class + 1) * POOLGRAIN;
+        if (newsize <= size)
+        {
+            if (newsize > oldsize)
+                memset(((char *)old) + oldsize, 0, newsize - oldsize);
+            ret = old;
+        }
+        else if ((ret = dogetbytes(newsize)))
+        {
+            memcpy(ret, old, (oldsize < size ? oldsize : size));
+            pool_release(s, old);
+        }
+    }
+    else
+    {
+        ret = (void *)realloc((char *)old, newsize);
+        if (newsize > oldsize && ret)
+            memset(((char *)ret) + oldsize, 0, newsize - oldsize);
+    }
 #ifdef LOUD
     fprintf(stderr, "resize %lx %d --> %lx %d\n", (int)old, oldsize, (int)ret, newsize);
 #endif /* LOUD */
@@ -66,8 +362,27 @@ void *resizebytes(void *old, size_t oldsize, size_t newsize)
     return (ret);
 }
 
-void freebytes(void *fatso, size_t nbytes)
+void *resizebytes(void *old, size_t oldsize, size_t newsize)
+{
+    void *ret;
+    if (sys_memstat)
+    {
+        const t_class *c = sys_memstatclass;
+        int tracked = (!old || memstat_find(old, &c));
+        if ((ret = doresizebytes(old, oldsize, newsize)) && tracked)
+        {
+            if (old)
+                memstat_remove(old);
+            memstat_add(ret, newsize, c);
+        }
+        return (ret);
+    }
+    return (doresizebytes(old, oldsize, newsize));
+}
+
+static void dofreebytes(void *fatso, size_t nbytes)
 {
+    t_slab *s;
     if (nbytes == 0)
         nbytes = 1;
 #ifdef LOUD
@@ -76,7 +391,536 @@ void freebytes(void *fatso, size_t nbytes)
 #ifdef DEBUGMEM
     totalmem -= nbytes;
 #endif
-    free(fatso);
+    if (fatso && (s = pool_findslab(fatso)))
+        pool_release(s, fatso);
+    else free(fatso);
+}
+
+void freebytes(void *fatso, size_t nbytes)
+{
+    if (sys_memstat && fatso)
+        memstat_remove(fatso);
+    dofreebytes(fatso, nbytes);
+}
+
+/* The "real-time" allocator for objects that allocate from message methods
+that may be running in the audio thread (clocks in callback mode, for
+instance).  Blocks come in power-of-two size classes; each class keeps a
+cache of blocks freed by Pd, and a ring buffer that the main thread keeps
+topped up with fresh blocks from sys_rtrefill() without taking the Pd lock.
+Each Pd instance has its own set of classes, which only that instance's
+thread uses with its lock held, so the caches need no further locking, and
+each ring has exactly one writer and one reader.  Surplus freed blocks go
+back to the main thread through a second ring to be freed there.  If a class
+runs dry we fall back on getbytes() and the main thread doubles that class's
+reserve.  Blocks bigger than the largest class always use getbytes(). */
+
+#define RTNCLASS 13             /* 16 bytes to 64 KB */
+#define RTMINSIZE 16
+#define RTMAXFILL 256           /* most blocks kept in reserve per class */
+#define RTRINGSIZE (RTMAXFILL * 2 * sizeof(void *))
+#define RTLARGE RTNCLASS        /* class of blocks that bypass the arena */
+
+    /* c_misses and c_target are each written by one thread and read by the
+    other; a stale value only makes the reserve adapt a little later */
+#ifdef __GNUC__
+#define RT_LOAD(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#define RT_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#else
+#define RT_LOAD(p) (*(volatile int *)(p))
+#define RT_STORE(p, v) (*(volatile int *)(p) = (v))
+#endif
+
+typedef struct _rtblock
+{
+    union
+    {
+        struct _rtblock *b_next;    /* in the cache */
+        double b_align;
+    } b_u;
+    int b_class;
+} t_rtblock;
+
+#define RTHEADER ((sizeof(t_rtblock) + 15) & ~15)
+
+typedef struct _rtclass
+{
+    t_rtblock *c_cache;         /* blocks freed by Pd, ready to reuse */
+    int c_ncache;
+    int c_target;               /* reserve to keep in the fill ring */
+    int c_misses;               /* times we had to call getbytes() ... */
+    int c_seenmisses;           /* ... and how many sys_rtrefill() saw */
+    sys_ringbuf c_fill;         /* main thread -> Pd: fresh blocks */
+    char c_fillbuf[RTRINGSIZE];
+    sys_ringbuf c_return;       /* Pd -> main thread: blocks to free */
+    char c_returnbuf[RTRINGSIZE];
+} t_rtclass;
+
+typedef struct _rtalloc
+{
+    t_rtclass a_class[RTNCLASS];
+    struct _rtalloc *a_next;    /* list of all of them for sys_rtrefill() */
+} t_rtalloc;
+
+static t_rtalloc *rt_list;
+static pthread_mutex_t rt_listlock = PTHREAD_MUTEX_INITIALIZER;
+#ifndef PDINSTANCE
+static t_rtalloc *rt_main;
+#endif
+
+static size_t rt_classsize(int class)
+{
+    return ((size_t)RTMINSIZE << class);
+}
+
+static t_rtalloc *rt_get(void)
+{
+    t_rtalloc **ap, *a;
+    int i;
+#ifdef PDINSTANCE
+    if (!pd_this)
+        return (0);
+    ap = &pd_this->pd_rtalloc;
+#else
+    ap = &rt_main;
+#endif
+    if (*ap)
+        return (*ap);
+    if (!(a = (t_rtalloc *)calloc(1, sizeof(*a))))
+        return (0);
+    for (i = 0; i < RTNCLASS; i++)
+    {
+        t_rtclass *c = &a->a_class[i];
+        sys_ringbuf_init(&c->c_fill, RTRINGSIZE, c->c_fillbuf, 0);
+        sys_ringbuf_init(&c->c_return, RTRINGSIZE, c->c_returnbuf, 0);
+            /* small blocks are cheap to keep around */
+        c->c_target = (i <= 6 ? 8 : (i <= 10 ? 2 : 0));
+    }
+    pthread_mutex_lock(&rt_listlock);
+    a->a_next = rt_list;
+    rt_list = a;
+    pthread_mutex_unlock(&rt_listlock);
+    return (*ap = a);
+}
+
+static void rt_refillclass(t_rtclass *c, int class)
+{
+    t_rtblock *b;
+    int n, misses = RT_LOAD(&c->c_misses);
+    while (sys_ringbuf_getreadavailable(&c->c_return) >= (long)sizeof(b))
+    {
+        sys_ringbuf_read(&c->c_return, &b, sizeof(b), c->c_returnbuf);
+        free(b);
+    }
+    if (misses != c->c_seenmisses)
+    {
+        n = (c->c_target ? 2 * c->c_target : 4);
+        RT_STORE(&c->c_target, (n > RTMAXFILL ? RTMAXFILL : n));
+        c->c_seenmisses = misses;
+    }
+    n = c->c_target - (int)(sys_ringbuf_getreadavailable(&c->c_fill) /
+        sizeof(b));
+    while (n-- > 0 && (b = (t_rtblock *)malloc(RTHEADER +
+        rt_classsize(class))))
+    {
+        b->b_class = class;
+        sys_ringbuf_write(&c->c_fill, &b, sizeof(b), c->c_fillbuf);
+    }
+}
+
+    /* called from the main thread, without the Pd lock, whenever it's idle.
+    Every instance's classes are refilled; rt_listlock only keeps instances
+    from coming or going meanwhile. */
+void sys_rtrefill(void)
+{
+    t_rtalloc *a;
+    int i;
+    pthread_mutex_lock(&rt_listlock);
+    for (a = rt_list; a; a = a->a_next)
+        for (i = 0; i < RTNCLASS; i++)
+            rt_refillclass(&a->a_class[i], i);
+    pthread_mutex_unlock(&rt_listlock);
+}
+
+    /* free the current instance's classes when it is deleted */
+void m_memory_freepdinstance(void)
+{
+    t_rtalloc **ap, *a, *a2;
+    t_rtblock *b;
+    int i;
+#ifdef PDINSTANCE
+    ap = &pd_this->pd_rtalloc;
+#else
+    ap = &rt_main;
+#endif
+    if (!(a = *ap))
+        return;
+    pthread_mutex_lock(&rt_listlock);
+    if (rt_list == a)
+        rt_list = a->a_next;
+    else for (a2 = rt_list; a2; a2 = a2->a_next)
+        if (a2->a_next == a)
+    {
+        a2->a_next = a->a_next;
+        break;
+    }
+    pthread_mutex_unlock(&rt_listlock);
+    for (i = 0; i < RTNCLASS; i++)
+    {
+        t_rtclass *c = &a->a_class[i];
+        while ((b = c->c_cache))
+        {
+            c->c_cache = b->b_u.b_next;
+            dofreebytes(b, RTHEADER + rt_classsize(i));
+        }
+        while (sys_ringbuf_getreadavailable(&c->c_fill) >= (long)sizeof(b))
+        {
+            sys_ringbuf_read(&c->c_fill, &b, sizeof(b), c->c_fillbuf);
+            free(b);
+        }
+        while (sys_ringbuf_getreadavailable(&c->c_return) >= (long)sizeof(b))
+        {
+            sys_ringbuf_read(&c->c_return, &b, sizeof(b), c->c_returnbuf);
+            free(b);
+        }
+    }
+    free(a);
+    *ap = 0;
+}
+
+void *rt_getbytes(size_t nbytes)
+{
+    t_rtblock *b = 0;
+    t_rtalloc *a = rt_get();
+    int class = 0;
+    if (nbytes < 1) nbytes = 1;
+    while (class < RTNCLASS && rt_classsize(class) < nbytes)
+        class++;
+    if (class < RTNCLASS && a)
+    {
+        t_rtclass *c = &a->a_class[class];
+        if ((b = c->c_cache))
+            c->c_cache = b->b_u.b_next, c->c_ncache--;
+        else if (sys_ringbuf_getreadavailable(&c->c_fill) >= (long)sizeof(b))
+            sys_ringbuf_read(&c->c_fill, &b, sizeof(b), c->c_fillbuf);
+        else RT_STORE(&c->c_misses, c->c_misses + 1);
+        if (b)
+            memset((char *)b + RTHEADER, 0, nbytes);
+    }
+    if (!b)
+    {
+        if (!(b = (t_rtblock *)dogetbytes(RTHEADER + (class < RTNCLASS ?
+            rt_classsize(class) : nbytes))))
+                return (0);
+        b->b_class = (class < RTNCLASS ? class : RTLARGE);
+    }
+    if (sys_memstat)
+        memstat_add((char *)b + RTHEADER, nbytes, sys_memstatclass);
+    return ((char *)b + RTHEADER);
+}
+
+void rt_freebytes(void *x, size_t nbytes)
+{
+    t_rtblock *b;
+    t_rtclass *c;
+    t_rtalloc *a;
+    if (!x)
+        return;
+    if (sys_memstat)
+        memstat_remove(x);
+    b = (t_rtblock *)((char *)x - RTHEADER);
+    if (b->b_class == RTLARGE || !(a = rt_get()))
+    {
+            /* dofreebytes() knows which blocks came from malloc() */
+        dofreebytes(b, RTHEADER + (b->b_class == RTLARGE ?
+            nbytes : rt_classsize(b->b_class)));
+        return;
+    }
+    c = &a->a_class[b->b_class];
+        /* keep enough to cover the reserve; hand the rest back */
+    if (c->c_ncache >= RT_LOAD(&c->c_target) + 8 &&
+        sys_ringbuf_getwriteavailable(&c->c_return) >= (long)sizeof(b))
+    {
+            /* blocks from getbytes() can't go to free() */
+        if (pool_findslab(b))
+            dofreebytes(b, RTHEADER + rt_classsize(b->b_class));
+        else sys_ringbuf_write(&c->c_return, &b, sizeof(b),
+            c->c_returnbuf);
+        return;
+    }
+    b->b_u.b_next = c->c_cache;
+    c->c_cache = b;
+    c->c_ncache++;
+}
+
+void *rt_resizebytes(void *x, size_t oldsize, size_t newsize)
+{
+    t_rtblock *b;
+    void *ret;
+    size_t size;
+    if (!x)
+        return (rt_getbytes(newsize));
+    if (newsize < 1) newsize = 1;
+    b = (t_rtblock *)((char *)x - RTHEADER);
+    size = (b->b_class == RTLARGE ? oldsize : rt_classsize(b->b_class));
+    if (newsize <= size)
+    {
+        if (newsize > oldsize)
+            memset((char *)x + oldsize, 0, newsize - oldsize);
+        return (x);
+    }
+    if ((ret = rt_getbytes(newsize)))
+    {
+        memcpy(ret, x, (oldsize < size ? oldsize : size));
+        rt_freebytes(x, oldsize);
+    }
+    return (ret);
+}
+
+/* Memory accounting, turned on by "pd memstat 1".  Every block allocated
+while it's on is charged to the class of the object that was being created
+or sent a message at the time (sys_memstatclass, maintained by the message
+dispatch routines), and remembered in a hash table so that freeing it later
+credits the same class.  Blocks allocated before accounting started aren't
+counted.  "pd memstat print" lists classes by live bytes, so that a class
+(or an abstraction's contents) that keeps growing shows up at the top. */
+
+int sys_memstat;
+const t_class *sys_memstatclass;
+
+typedef struct _memstatentry
+{
+    const t_class *e_class;
+    size_t e_bytes;             /* live bytes */
+    long e_nlive;               /* live blocks */
+    long e_nalloc;              /* allocations since accounting started */
+} t_memstatentry;
+
+typedef struct _memstatblock
+{
+    void *b_ptr;                /* 0 if empty, MEMSTATDELETED if deleted */
+    size_t b_size;
+    int b_entry;                /* index into memstat_entries */
+} t_memstatblock;
+
+#define MEMSTATDELETED ((void *)1)
+
+static pthread_mutex_t memstat_lock = PTHREAD_MUTEX_INITIALIZER;
+static t_memstatentry *memstat_entries;
+static int memstat_nentries, memstat_entrysize;
+static int *memstat_classhash;  /* class -> entry index, -1 if empty */
+static int memstat_classhashsize;
+static t_memstatblock *memstat_blocks;
+static size_t memstat_nblocks, memstat_nused, memstat_blocksize;
+
+static size_t memstat_hashptr(const void *x, size_t size)
+{
+    uintptr_t h = (uintptr_t)x >> 4;
+    h ^= h >> 17;
+    h *= 0x9e3779b1;
+    return ((h ^ (h >> 15)) & (size - 1));
+}
+
+    /* the memory for the tables themselves comes from malloc() so that it
+    isn't counted */
+static int memstat_entry(const t_class *c)
+{
+    size_t i;
+    int n;
+    if (2 * (memstat_nentries + 1) > memstat_classhashsize)
+    {
+        int size = (memstat_classhashsize ? 2 * memstat_classhashsize : 256);
+        int *hash = (int *)malloc(size * sizeof(*hash));
+        if (!hash)
+            return (-1);
+        free(memstat_classhash);
+        memstat_classhash = hash;
+        memstat_classhashsize = size;
+        for (i = 0; i < (size_t)size; i++)
+            hash[i] = -1;
+        for (n = 0; n < memstat_nentries; n++)
+        {
+            for (i = memstat_hashptr(memstat_entries[n].e_class, size);
+                hash[i] >= 0; i = (i + 1) & (size - 1))
+                    ;
+            hash[i] = n;
+        }
+    }
+    for (i = memstat_hashptr(c, memstat_classhashsize);
+        (n = memstat_classhash[i]) >= 0; i = (i + 1) & (memstat_classhashsize-1))
+            if (memstat_entries[n].e_class == c)
+                return (n);
+    if (memstat_nentries == memstat_entrysize)
+    {
+        int size = (memstat_entrysize ? 2 * memstat_entrysize : 128);
+        t_memstatentry *e = (t_memstatentry *)realloc(memstat_entries,
+            size * sizeof(*e));
+        if (!e)
+            return (-1);
+        memstat_entries = e;
+        memstat_entrysize = size;
+    }
+    n = memstat_nentries++;
+    memstat_entries[n].e_class = c;
+    memstat_entries[n].e_bytes = 0;
+    memstat_entries[n].e_nlive = memstat_entries[n].e_nalloc = 0;
+    memstat_classhash[i] = n;
+    return (n);
+}
+
+static t_memstatblock *memstat_lookup(void *x)
+{
+    size_t i;
+    if (!memstat_blocksize)
+        return (0);
+    for (i = memstat_hashptr(x, memstat_blocksize); memstat_blocks[i].b_ptr;
+        i = (i + 1) & (memstat_blocksize - 1))
+            if (memstat_blocks[i].b_ptr == x)
+                return (&memstat_blocks[i]);
+    return (0);
+}
+
+static int memstat_grow(void)
+{
+    size_t size = (memstat_blocksize ? 2 * memstat_blocksize : 65536), i, j;
+    t_memstatblock *old = memstat_blocks, *b;
+    if (memstat_nblocks * 4 < memstat_blocksize)
+        size = memstat_blocksize;   /* just clean out deleted slots */
+    if (!(b = (t_memstatblock *)calloc(size, sizeof(*b))))
+        return (0);
+    for (i = 0; i < memstat_blocksize; i++)
+        if (old[i].b_ptr && old[i].b_ptr != MEMSTATDELETED)
+    {
+        for (j = memstat_hashptr(old[i].b_ptr, size); b[j].b_ptr;
+            j = (j + 1) & (size - 1))
+                ;
+        b[j] = old[i];
+    }
+    free(old);
+    memstat_blocks = b;
+    memstat_blocksize = size;
+    memstat_nused = memstat_nblocks;
+    return (1);
+}
+
+static void memstat_add(void *x, size_t nbytes, const t_class *c)
+{
+    size_t i;
+    int n;
+    pthread_mutex_lock(&memstat_lock);
+    if (!sys_memstat || (2 * (memstat_nused + 1) > memstat_blocksize &&
+        !memstat_grow()) || (n = memstat_entry(c)) < 0)
+            goto done;
+    for (i = memstat_hashptr(x, memstat_blocksize);
+        memstat_blocks[i].b_ptr && memstat_blocks[i].b_ptr != MEMSTATDELETED;
+            i = (i + 1) & (memstat_blocksize - 1))
+                ;
+    if (!memstat_blocks[i].b_ptr)
+        memstat_nused++;
+    memstat_blocks[i].b_ptr = x;
+    memstat_blocks[i].b_size = nbytes;
+    memstat_blocks[i].b_entry = n;
+    memstat_nblocks++;
+    memstat_entries[n].e_bytes += nbytes;
+    memstat_entries[n].e_nlive++;
+    memstat_entries[n].e_nalloc++;
+done:
+    pthread_mutex_unlock(&memstat_lock);
+}
+
+static void memstat_remove(void *x)
+{
+    t_memstatblock *b;
+    pthread_mutex_lock(&memstat_lock);
+    if ((b = memstat_lookup(x)))
+    {
+        memstat_entries[b->b_entry].e_bytes -= b->b_size;
+        memstat_entries[b->b_entry].e_nlive--;
+        b->b_ptr = MEMSTATDELETED;
+        memstat_nblocks--;
+    }
+    pthread_mutex_unlock(&memstat_lock);
+}
+
+static int memstat_find(void *x, const t_class **cp)
+{
+    t_memstatblock *b;
+    pthread_mutex_lock(&memstat_lock);
+    if ((b = memstat_lookup(x)))
+        *cp = memstat_entries[b->b_entry].e_class;
+    pthread_mutex_unlock(&memstat_lock);
+    return (b != 0);
+}
+
+static void memstat_clear(void)
+{
+    free(memstat_blocks);
+    memstat_blocks = 0;
+    memstat_nblocks = memstat_nused = memstat_blocksize = 0;
+}
+
+static int memstat_compare(const void *p1, const void *p2)
+{
+    const t_memstatentry *e1 = *(const t_memstatentry **)p1,
+        *e2 = *(const t_memstatentry **)p2;
+    return (e1->e_bytes < e2->e_bytes ? 1 :
+        (e1->e_bytes > e2->e_bytes ? -1 : 0));
+}
+
+static void memstat_print(int n)
+{
+    t_memstatentry **sorted;
+    size_t bytes = 0;
+    long nlive = 0;
+    int i;
+    pthread_mutex_lock(&memstat_lock);
+    if (!memstat_nentries ||
+        !(sorted = (t_memstatentry **)malloc(memstat_nentries *
+            sizeof(*sorted))))
+    {
+        pthread_mutex_unlock(&memstat_lock);
+        post("memstat: nothing recorded%s",
+            (sys_memstat ? "" : " (use 'memstat 1' to start)"));
+        return;
+    }
+    for (i = 0; i < memstat_nentries; i++)
+    {
+        sorted[i] = &memstat_entries[i];
+        bytes += sorted[i]->e_bytes;
+        nlive += sorted[i]->e_nlive;
+    }
+    qsort(sorted, memstat_nentries, sizeof(*sorted), memstat_compare);
+    post("%-24s %12s %10s %10s", "class", "live bytes", "blocks", "allocs");
+    for (i = 0; i < memstat_nentries && i < n; i++)
+        post("%-24s %12lu %10ld %10ld",
+            (sorted[i]->e_class ? sorted[i]->e_class->c_name->s_name :
+                "(none)"), (unsigned long)sorted[i]->e_bytes,
+                    sorted[i]->e_nlive, sorted[i]->e_nalloc);
+    post("%-24s %12lu %10ld", "total", (unsigned long)bytes, nlive);
+    free(sorted);
+    pthread_mutex_unlock(&memstat_lock);
+}
+
+    /* "memstat" message to Pd */
+void glob_memstat(void *dummy, t_symbol *s, int argc, t_atom *argv)
+{
+    t_symbol *what = atom_getsymbolarg(0, argc, argv);
+    if (argc && argv->a_type == A_FLOAT)
+    {
+        int on = (argv->a_w.w_float != 0);
+        pthread_mutex_lock(&memstat_lock);
+        memstat_clear();
+        if (on)
+            memstat_nentries = 0;
+        sys_memstat = on;
+        pthread_mutex_unlock(&memstat_lock);
+    }
+    else if (what == gensym("print"))
+    {
+        int n = atom_getfloatarg(1, argc, argv);
+        memstat_print(n > 0 ? n : 20);
+    }
+    else pd_error(0, "usage: memstat 0|1 or memstat print [n]");
 }
 
 #ifdef DEBUGMEM
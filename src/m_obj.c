@@ -188,6 +188,7 @@ void inlet_free(t_inlet *x)
 {
     t_object *y = x->i_owner;
     t_inlet *x2;
+    canvas_linesrenumbered(y);
     if (y->ob_inlet == x) y->ob_inlet = x->i_next;
     else for (x2 = y->ob_inlet; x2; x2 = x2->i_next)
         if (x2->i_next == x)
@@ -347,6 +348,7 @@ int sched_geteventno(void)
 struct _outconnect
 {
     struct _outconnect *oc_next;
+    struct _outconnect *oc_prev;    /* so that unlinking is constant time */
     t_pd *oc_to;
 };
 
@@ -355,6 +357,7 @@ struct _outlet
     t_object *o_owner;
     struct _outlet *o_next;
     t_outconnect *o_connections;
+    t_outconnect *o_lastconnection; /* tail of o_connections, for appending */
     t_symbol *o_sym;
 };
 
@@ -369,11 +372,18 @@ t_outlet *outlet_new(t_object *owner, t_symbol *s)
         y->o_next = x;
     }
     else owner->ob_outlet = x;
-    x->o_connections = 0;
+    x->o_connections = x->o_lastconnection = 0;
     x->o_sym = s;
     return (x);
 }
 
+    /* for "pd msg-profile", charge a message to the object it goes to,
+    even if it goes to one of the object's inlets after the first */
+static void outlet_msgenter(t_pd *to)
+{
+    sched_msgenter(ISINLET(to) ? (void *)((t_inlet *)to)->i_owner : to);
+}
+
 static void outlet_stackerror(t_outlet *x)
 {
     pd_error(x->o_owner, "stack overflow");
@@ -386,7 +396,13 @@ void outlet_bang(t_outlet *x)
         outlet_stackerror(x);
     else
     for (oc = x->o_connections; oc; oc = oc->oc_next)
+    {
+        if (sched_msgprofile)
+            outlet_msgenter(oc->oc_to);
         pd_bang(oc->oc_to);
+        if (sched_msgprofile)
+            sched_msgleave();
+    }
     --stackcount;
 }
 
@@ -400,7 +416,13 @@ void outlet_pointer(t_outlet *x, t_gpointer *gp)
     {
         gpointer = *gp;
         for (oc = x->o_connections; oc; oc = oc->oc_next)
+        {
+            if (sched_msgprofile)
+                outlet_msgenter(oc->oc_to);
             pd_pointer(oc->oc_to, &gpointer);
+            if (sched_msgprofile)
+                sched_msgleave();
+        }
     }
     --stackcount;
 }
@@ -412,7 +434,13 @@ void outlet_float(t_outlet *x, t_float f)
         outlet_stackerror(x);
     else
     for (oc = x->o_connections; oc; oc = oc->oc_next)
+    {
+        if (sched_msgprofile)
+            outlet_msgenter(oc->oc_to);
         pd_float(oc->oc_to, f);
+        if (sched_msgprofile)
+            sched_msgleave();
+    }
     --stackcount;
 }
 
@@ -423,7 +451,13 @@ void outlet_symbol(t_outlet *x, t_symbol *s)
         outlet_stackerror(x);
     else
     for (oc = x->o_connections; oc; oc = oc->oc_next)
+    {
+        if (sched_msgprofile)
+            outlet_msgenter(oc->oc_to);
         pd_symbol(oc->oc_to, s);
+        if (sched_msgprofile)
+            sched_msgleave();
+    }
     --stackcount;
 }
 
@@ -434,7 +468,13 @@ void outlet_list(t_outlet *x, t_symbol *s, int argc, t_atom *argv)
         outlet_stackerror(x);
     else
     for (oc = x->o_connections; oc; oc = oc->oc_next)
+    {
+        if (sched_msgprofile)
+            outlet_msgenter(oc->oc_to);
         pd_list(oc->oc_to, s, argc, argv);
+        if (sched_msgprofile)
+            sched_msgleave();
+    }
     --stackcount;
 }
 
@@ -445,7 +485,13 @@ void outlet_anything(t_outlet *x, t_symbol *s, int argc, t_atom *argv)
         outlet_stackerror(x);
     else
     for (oc = x->o_connections; oc; oc = oc->oc_next)
+    {
+        if (sched_msgprofile)
+            outlet_msgenter(oc->oc_to);
         typedmess(oc->oc_to, s, argc, argv);
+        if (sched_msgprofile)
+            sched_msgleave();
+    }
     --stackcount;
 }
 
@@ -459,6 +505,7 @@ void outlet_free(t_outlet *x)
 {
     t_object *y = x->o_owner;
     t_outlet *x2;
+    canvas_linesrenumbered(y);
     if (y->ob_outlet == x) y->ob_outlet = x->o_next;
     else for (x2 = y->ob_outlet; x2; x2 = x2->o_next)
         if (x2->o_next == x)
@@ -479,8 +526,9 @@ t_outconnect *obj_connect(t_object *source, int outno,
     t_outlet *o;
     t_pd *to;
     t_outconnect *oc, *oc2;
+    int n;
 
-    for (o = source->ob_outlet; o && outno; o = o->o_next, outno--) ;
+    for (o = source->ob_outlet, n = outno; o && n; o = o->o_next, n--) ;
     if (!o) return (0);
 
     if (sink->ob_pd->c_firstin)
@@ -498,15 +546,14 @@ t_outconnect *obj_connect(t_object *source, int outno,
 doit:
     oc = (t_outconnect *)t_getbytes(sizeof(*oc));
     oc->oc_next = 0;
+    oc->oc_prev = o->o_lastconnection;
     oc->oc_to = to;
         /* append it to the end of the list */
-        /* LATER we might cache the last "oc" to make this faster. */
-    if ((oc2 = o->o_connections))
-    {
-        while (oc2->oc_next) oc2 = oc2->oc_next;
+    if ((oc2 = o->o_lastconnection))
         oc2->oc_next = oc;
-    }
     else o->o_connections = oc;
+    o->o_lastconnection = oc;
+    canvas_lineconnected(source, outno, o, oc);
     if (o->o_sym == &s_signal) canvas_update_dsp();
 
     return (oc);
@@ -517,7 +564,7 @@ void obj_disconnect(t_object *source, int outno, t_object *sink, int inno)
     t_inlet *i;
     t_outlet *o;
     t_pd *to;
-    t_outconnect *oc, *oc2;
+    t_outconnect *oc;
 
     for (o = source->ob_outlet; o && outno; o = o->o_next, outno--) ;
     if (!o) return;
@@ -534,23 +581,27 @@ void obj_disconnect(t_object *source, int outno, t_object *sink, int inno)
     if (!i) return;
     to = &i->i_pd;
 doit:
+        /* look at the ends first: connections are mostly undone either
+        most recent first (undo) or in the order they were made (deleting
+        a whole patch) */
     if (!(oc = o->o_connections)) return;
-    if (oc->oc_to == to)
-    {
-        o->o_connections = oc->oc_next;
-        freebytes(oc, sizeof(*oc));
-        goto done;
-    }
-    while ((oc2 = oc->oc_next))
+    if (oc->oc_to != to)
     {
-        if (oc2->oc_to == to)
-        {
-            oc->oc_next = oc2->oc_next;
-            freebytes(oc2, sizeof(*oc2));
+        if ((oc = o->o_lastconnection)->oc_to != to)
+            for (oc = o->o_connections->oc_next; oc && oc->oc_to != to;
+                oc = oc->oc_next)
+                    ;
+        if (!oc)
             goto done;
-        }
-        oc = oc2;
     }
+    canvas_linedisconnected(source, oc);
+    if (oc->oc_prev)
+        oc->oc_prev->oc_next = oc->oc_next;
+    else o->o_connections = oc->oc_next;
+    if (oc->oc_next)
+        oc->oc_next->oc_prev = oc->oc_prev;
+    else o->o_lastconnection = oc->oc_prev;
+    freebytes(oc, sizeof(*oc));
 done:
     if (o->o_sym == &s_signal) canvas_update_dsp();
 }
@@ -620,6 +671,7 @@ t_object *pd_checkobject(t_pd *x)
 void obj_moveinletfirst(t_object *x, t_inlet *i)
 {
     t_inlet *i2;
+    canvas_linesrenumbered(x);
     if (x->ob_inlet == i) return;
     else for (i2 = x->ob_inlet; i2; i2 = i2->i_next)
         if (i2->i_next == i)
@@ -634,6 +686,7 @@ void obj_moveinletfirst(t_object *x, t_inlet *i)
 void obj_moveoutletfirst(t_object *x, t_outlet *o)
 {
     t_outlet *o2;
+    canvas_linesrenumbered(x);
     if (x->ob_outlet == o) return;
     else for (o2 = x->ob_outlet; o2; o2 = o2->o_next)
         if (o2->o_next == o)
@@ -15,6 +15,11 @@ t_pd *pd_new(t_class *c)
     t_pd *x;
     if (!c)
         bug ("pd_new: apparently called before setup routine");
+        /* when accounting memory, charge the new object, and whatever else
+        its creator allocates, to its class */
+    if (sys_memstat && (sys_memstatclass == pd_objectmaker ||
+        sys_memstatclass == pd_canvasmaker))
+                sys_memstatclass = c;
     x = (t_pd *)t_getbytes(c->c_size);
     *x = c;
     if (c->c_patchable)
@@ -54,60 +59,112 @@ to the symbol. */
 
 static t_class *bindlist_class;
 
-typedef struct _bindelem
-{
-    t_pd *e_who;
-    struct _bindelem *e_next;
-} t_bindelem;
+    /* When more than one object is bound to a symbol, the symbol is bound
+    to a "bindlist" holding an array of the receivers in the order they were
+    bound; messages go to the most recently bound first.  A receiver may
+    unbind (or be deleted) while a message is being distributed, so while
+    we're iterating, unbinding just clears the slot and the array is
+    compacted when the outermost iteration finishes.  Receivers bound during
+    an iteration are appended and so don't get the message in progress. */
 
 typedef struct _bindlist
 {
     t_pd b_pd;
-    t_bindelem *b_list;
+    t_symbol *b_sym;        /* the symbol we're bound to */
+    t_pd **b_vec;           /* receivers, zero if unbound during iteration */
+    int b_n;                /* number of slots in use */
+    int b_size;             /* number allocated */
+    int b_depth;            /* how many iterations are in progress */
+    int b_ndead;            /* how many slots have been zeroed */
 } t_bindlist;
 
+    /* squeeze out zeroed slots; if only one receiver (or none) is left,
+    bind the symbol straight to it and get rid of the bindlist. */
+static void bindlist_tidy(t_bindlist *x)
+{
+    if (x->b_ndead)
+    {
+        int i, j;
+        for (i = j = 0; i < x->b_n; i++)
+            if (x->b_vec[i])
+                x->b_vec[j++] = x->b_vec[i];
+        x->b_n = j;
+        x->b_ndead = 0;
+    }
+    if (x->b_n < 2)
+    {
+        x->b_sym->s_thing = (x->b_n ? x->b_vec[0] : 0);
+        freebytes(x->b_vec, x->b_size * sizeof(*x->b_vec));
+        pd_free(&x->b_pd);
+    }
+}
+
+static void bindlist_done(t_bindlist *x)
+{
+    if (!--x->b_depth && x->b_ndead)
+        bindlist_tidy(x);
+}
+
 static void bindlist_bang(t_bindlist *x)
 {
-    t_bindelem *e;
-    for (e = x->b_list; e; e = e->e_next)
-        pd_bang(e->e_who);
+    int i;
+    x->b_depth++;
+    for (i = x->b_n; i--; )
+        if (x->b_vec[i])
+            pd_bang(x->b_vec[i]);
+    bindlist_done(x);
 }
 
 static void bindlist_float(t_bindlist *x, t_float f)
 {
-    t_bindelem *e;
-    for (e = x->b_list; e; e = e->e_next)
-        pd_float(e->e_who, f);
+    int i;
+    x->b_depth++;
+    for (i = x->b_n; i--; )
+        if (x->b_vec[i])
+            pd_float(x->b_vec[i], f);
+    bindlist_done(x);
 }
 
 static void bindlist_symbol(t_bindlist *x, t_symbol *s)
 {
-    t_bindelem *e;
-    for (e = x->b_list; e; e = e->e_next)
-        pd_symbol(e->e_who, s);
+    int i;
+    x->b_depth++;
+    for (i = x->b_n; i--; )
+        if (x->b_vec[i])
+            pd_symbol(x->b_vec[i], s);
+    bindlist_done(x);
 }
 
 static void bindlist_pointer(t_bindlist *x, t_gpointer *gp)
 {
-    t_bindelem *e;
-    for (e = x->b_list; e; e = e->e_next)
-        pd_pointer(e->e_who, gp);
+    int i;
+    x->b_depth++;
+    for (i = x->b_n; i--; )
+        if (x->b_vec[i])
+            pd_pointer(x->b_vec[i], gp);
+    bindlist_done(x);
 }
 
 static void bindlist_list(t_bindlist *x, t_symbol *s,
     int argc, t_atom *argv)
 {
-    t_bindelem *e;
-    for (e = x->b_list; e; e = e->e_next)
-        pd_list(e->e_who, s, argc, argv);
+    int i;
+    x->b_depth++;
+    for (i = x->b_n; i--; )
+        if (x->b_vec[i])
+            pd_list(x->b_vec[i], s, argc, argv);
+    bindlist_done(x);
 }
 
 static void bindlist_anything(t_bindlist *x, t_symbol *s,
     int argc, t_atom *argv)
 {
-    t_bindelem *e;
-    for (e = x->b_list; e; e = e->e_next)
-        pd_typedmess(e->e_who, s, argc, argv);
+    int i;
+    x->b_depth++;
+    for (i = x->b_n; i--; )
+        if (x->b_vec[i])
+            pd_typedmess(x->b_vec[i], s, argc, argv);
+    bindlist_done(x);
 }
 
 void m_pd_setup(void)
@@ -122,28 +179,33 @@ void m_pd_setup(void)
     class_addanything(bindlist_class, bindlist_anything);
 }
 
+static void bindlist_add(t_bindlist *b, t_pd *x)
+{
+    if (b->b_n == b->b_size)
+    {
+        int newsize = 2 * b->b_size;
+        b->b_vec = (t_pd **)resizebytes(b->b_vec,
+            b->b_size * sizeof(*b->b_vec), newsize * sizeof(*b->b_vec));
+        b->b_size = newsize;
+    }
+    b->b_vec[b->b_n++] = x;
+}
+
 void pd_bind(t_pd *x, t_symbol *s)
 {
     if (s->s_thing)
     {
         if (*s->s_thing == bindlist_class)
-        {
-            t_bindlist *b = (t_bindlist *)s->s_thing;
-            t_bindelem *e = (t_bindelem *)getbytes(sizeof(t_bindelem));
-            e->e_next = b->b_list;
-            e->e_who = x;
-            b->b_list = e;
-        }
+            bindlist_add((t_bindlist *)s->s_thing, x);
         else
         {
             t_bindlist *b = (t_bindlist *)pd_new(bindlist_class);
-            t_bindelem *e1 = (t_bindelem *)getbytes(sizeof(t_bindelem));
-            t_bindelem *e2 = (t_bindelem *)getbytes(sizeof(t_bindelem));
-            b->b_list = e1;
-            e1->e_who = x;
-            e1->e_next = e2;
-            e2->e_who = s->s_thing;
-            e2->e_next = 0;
+            b->b_sym = s;
+            b->b_size = 4;
+            b->b_vec = (t_pd **)getbytes(b->b_size * sizeof(*b->b_vec));
+            b->b_n = b->b_depth = b->b_ndead = 0;
+            bindlist_add(b, s->s_thing);
+            bindlist_add(b, x);
             s->s_thing = &b->b_pd;
         }
     }
@@ -155,30 +217,27 @@ void pd_unbind(t_pd *x, t_symbol *s)
     if (s->s_thing == x) s->s_thing = 0;
     else if (s->s_thing && *s->s_thing == bindlist_class)
     {
-            /* bindlists always have at least two elements... if the number
-            goes down to one, get rid of the bindlist and bind the symbol
-            straight to the remaining element. */
-
         t_bindlist *b = (t_bindlist *)s->s_thing;
-        t_bindelem *e, *e2;
-        if ((e = b->b_list)->e_who == x)
+        int i;
+            /* most recent binding first, as we send */
+        for (i = b->b_n; i--; )
+            if (b->b_vec[i] == x)
         {
-            b->b_list = e->e_next;
-            freebytes(e, sizeof(t_bindelem));
-        }
-        else for (e = b->b_list; (e2 = e->e_next); e = e2)
-            if (e2->e_who == x)
-        {
-            e->e_next = e2->e_next;
-            freebytes(e2, sizeof(t_bindelem));
+            if (b->b_depth)
+            {
+                b->b_vec[i] = 0;
+                b->b_ndead++;
+            }
+            else
+            {
+                memmove(b->b_vec + i, b->b_vec + i + 1,
+                    (b->b_n - i - 1) * sizeof(*b->b_vec));
+                b->b_n--;
+                if (b->b_n < 2)
+                    bindlist_tidy(b);
+            }
             break;
         }
-        if (!b->b_list->e_next)
-        {
-            s->s_thing = b->b_list->e_who;
-            freebytes(b->b_list, sizeof(t_bindelem));
-            pd_free(&b->b_pd);
-        }
     }
     else pd_error(x, "%s: couldn't unbind", s->s_name);
 }
@@ -192,17 +251,16 @@ t_pd *pd_findbyclass(t_symbol *s, const t_class *c)
     if (*s->s_thing == bindlist_class)
     {
         t_bindlist *b = (t_bindlist *)s->s_thing;
-        t_bindelem *e, *e2;
-        int warned = 0;
-        for (e = b->b_list; e; e = e->e_next)
-            if (*e->e_who == c)
+        int i, warned = 0;
+        for (i = b->b_n; i--; )
+            if (b->b_vec[i] && *b->b_vec[i] == c)
         {
             if (x && !warned)
             {
                 post("warning: %s: multiply defined", s->s_name);
                 warned = 1;
             }
-            x = e->e_who;
+            x = b->b_vec[i];
         }
     }
     return x;
@@ -218,9 +276,9 @@ typedef struct _gstack
     struct _gstack *g_next;
 } t_gstack;
 
-static t_gstack *gstack_head = 0;
-static t_pd *lastpopped;
-static t_symbol *pd_loadingabstraction;
+static PERTHREAD t_gstack *gstack_head = 0;
+static PERTHREAD t_pd *lastpopped;
+static PERTHREAD t_symbol *pd_loadingabstraction;
 
 int pd_setloadingabstraction(t_symbol *sym)
 {
@@ -265,32 +323,74 @@ void pd_doloadbang(void)
 
 void pd_bang(t_pd *x)
 {
-    (*(*x)->c_bangmethod)(x);
+    if (sys_memstat)
+    {
+        const t_class *save = sys_memstatclass;
+        sys_memstatclass = *x;
+        (*(*x)->c_bangmethod)(x);
+        sys_memstatclass = save;
+    }
+    else (*(*x)->c_bangmethod)(x);
 }
 
 void pd_float(t_pd *x, t_float f)
 {
-    (*(*x)->c_floatmethod)(x, f);
+    if (sys_memstat)
+    {
+        const t_class *save = sys_memstatclass;
+        sys_memstatclass = *x;
+        (*(*x)->c_floatmethod)(x, f);
+        sys_memstatclass = save;
+    }
+    else (*(*x)->c_floatmethod)(x, f);
 }
 
 void pd_pointer(t_pd *x, t_gpointer *gp)
 {
-    (*(*x)->c_pointermethod)(x, gp);
+    if (sys_memstat)
+    {
+        const t_class *save = sys_memstatclass;
+        sys_memstatclass = *x;
+        (*(*x)->c_pointermethod)(x, gp);
+        sys_memstatclass = save;
+    }
+    else (*(*x)->c_pointermethod)(x, gp);
 }
 
 void pd_symbol(t_pd *x, t_symbol *s)
 {
-    (*(*x)->c_symbolmethod)(x, s);
+    if (sys_memstat)
+    {
+        const t_class *save = sys_memstatclass;
+        sys_memstatclass = *x;
+        (*(*x)->c_symbolmethod)(x, s);
+        sys_memstatclass = save;
+    }
+    else (*(*x)->c_symbolmethod)(x, s);
 }
 
 void pd_list(t_pd *x, t_symbol *s, int argc, t_atom *argv)
 {
-    (*(*x)->c_listmethod)(x, &s_list, argc, argv);
+    if (sys_memstat)
+    {
+        const t_class *save = sys_memstatclass;
+        sys_memstatclass = *x;
+        (*(*x)->c_listmethod)(x, &s_list, argc, argv);
+        sys_memstatclass = save;
+    }
+    else (*(*x)->c_listmethod)(x, &s_list, argc, argv);
 }
 
 void pd_anything(t_pd *x, t_symbol *s, int argc, t_atom *argv)
 {
-    (*(*x)->c_anymethod)(x, s, argc, argv);
+    if (sys_memstat)
+    {
+        const t_class *save = sys_memstatclass;
+        sys_memstatclass = *x;
+        (*(*x)->c_anymethod)(x, s, argc, argv);
+        sys_memstatclass = save;
+    }
+    else (*(*x)->c_anymethod)(x, s, argc, argv);
 }
 
 void mess_init(void);
@@ -115,7 +115,9 @@ typedef struct _symbol
 {
     const char *s_name;
     struct _class **s_thing;
-    struct _symbol *s_next;
+    struct _symbol *s_next;     /* unused; kept for binary compatibility */
+    unsigned int s_hash;        /* full hash of the name */
+    int s_length;               /* strlen() of the name */
 } t_symbol;
 
 EXTERN_STRUCT _array;
@@ -310,6 +312,11 @@ EXTERN void *getzbytes(size_t nbytes);
 EXTERN void *copybytes(const void *src, size_t nbytes);
 EXTERN void freebytes(void *x, size_t nbytes);
 EXTERN void *resizebytes(void *x, size_t oldsize, size_t newsize);
+    /* versions that are safe to call from the audio thread; memory from
+    rt_getbytes() must be freed with rt_freebytes() and vice versa */
+EXTERN void *rt_getbytes(size_t nbytes);
+EXTERN void rt_freebytes(void *x, size_t nbytes);
+EXTERN void *rt_resizebytes(void *x, size_t oldsize, size_t newsize);
 
 /* -------------------- atoms ----------------------------- */
 
@@ -381,6 +388,21 @@ EXTERN double clock_gettimesincewithunits(double prevsystime,
 EXTERN double clock_getsystimeafter(double delaytime);
 EXTERN void clock_free(t_clock *x);
 
+    /* sample-accurate control.  A signal object keeps a t_blocktime, calls
+    blocktime_advance() once per DSP block, and then blocktime_offset() to
+    find the sample in the block at which a message that arrived at logical
+    time "when" (from clock_getlogicaltime()) takes effect. */
+typedef struct _blocktime
+{
+    double b_lasttime;      /* logical time when last advanced */
+    double b_start;         /* logical time the current block starts */
+    double b_next;          /* ... and the next one */
+    double b_persample;     /* logical time per sample */
+} t_blocktime;
+EXTERN void blocktime_init(t_blocktime *x);
+EXTERN void blocktime_advance(t_blocktime *x, int n, t_float sr);
+EXTERN int blocktime_offset(t_blocktime *x, double when, int n);
+
 /* ----------------- pure data ---------------- */
 EXTERN t_pd *pd_new(t_class *cls);
 EXTERN void pd_free(t_pd *x);
@@ -497,6 +519,32 @@ EXTERN void class_setdrawcommand(t_class *c);
 EXTERN int class_isdrawcommand(const t_class *c);
 EXTERN void class_domainsignalin(t_class *c, int onset);
 EXTERN void class_set_extern_dir(t_symbol *s);
+
+    /* flags for class_setdspflags().  CLASS_NOPARALLEL marks classes whose
+    perform routines touch state shared with other objects (DSP clocks,
+    the dac~ buffer, send~ and throw~ buffers, delay lines...); these are
+    kept out of parallel DSP sections.  CLASS_DSPSHARED marks classes whose
+    "dsp" method sets up something other objects find in theirs (send~,
+    catch~, delwrite~); editing a patch containing one resorts all DSP.
+    CLASS_DSPBORROWS marks classes whose "dsp" method fills in every signal
+    output with signal_setborrowed() instead of being given vectors to
+    write to (adc~, which hands out the audio input buffer itself).
+    CLASS_DSPPURE marks classes whose outputs depend only on their signal
+    inputs and block size (fft~ and its relatives); when several in the same
+    DSP context are fed from the same outlets, only one is run and the rest
+    share its outputs.  CLASS_SCALARIN marks classes whose "dsp" method
+    deals with unconnected signal inlets itself: for those the input signal's
+    s_scalar points to the inlet's float and its vector is left unfilled, so
+    the method must either read the float in its perform routine or fill the
+    vector with dsp_add_scalarcopy(s_scalar, s_vec, s_n). */
+#define CLASS_NOPARALLEL 1
+#define CLASS_DSPSHARED 2
+#define CLASS_DSPBORROWS 4
+#define CLASS_DSPPURE 8
+#define CLASS_SCALARIN 16
+
+EXTERN void class_setdspflags(t_class *c, int flags);
+EXTERN int class_getdspflags(const t_class *c);
 #define CLASS_MAINSIGNALIN(c, type, field) \
     class_domainsignalin(c, (char *)(&((type *)0)->field) - (char *)0)
 
@@ -549,6 +597,12 @@ EXTERN int open_via_path(const char *dir, const char *name, const char *ext,
     char *dirresult, char **nameresult, unsigned int size, int bin);
 EXTERN int sched_geteventno(void);
 EXTERN double sys_getrealtime(void);
+    /* finer clocks for timing sections of code: a monotonic clock and the
+    calling thread's CPU time, both in nanoseconds from an arbitrary origin,
+    and a raw cycle (or, failing that, tick) count */
+EXTERN uint64_t sys_getnanotime(void);
+EXTERN uint64_t sys_getthreadcputime(void);
+EXTERN uint64_t sys_getcycles(void);
 EXTERN int (*sys_idlehook)(void);   /* hook to add idle time computation */
 
 /* Win32's open()/fopen() do not handle UTF-8 filenames so we need
@@ -587,8 +641,20 @@ typedef struct _signal
     struct _signal *s_nextfree;         /* next in freelist */
     struct _signal *s_nextused;         /* next in used list */
     int s_vecsize;      /* allocated size of array in points */
+    int s_nchans;       /* number of channels, each s_n points, end to end */
+    t_float *s_scalar;  /* unconnected inlet's value, unfilled (CLASS_SCALARIN) */
 } t_signal;
 
+    /* the sample vector of every signal Pd allocates starts on a multiple
+    of this many bytes, so perform routines may use aligned SIMD loads and
+    stores on them.  signal_isaligned() checks a particular signal's. */
+#define PD_SIGNALALIGN 64
+
+    /* a signal may hold several channels of s_n points each, one after the
+    other in s_vec.  A "dsp" method can make any of its outputs multichannel
+    by calling signal_setmultiout() on its entry in the signal array, which
+    replaces it; objects that don't look at s_nchans only see the first. */
+
 typedef t_int *(*t_perfroutine)(t_int *args);
 
 EXTERN t_int *plus_perform(t_int *args);
@@ -599,6 +665,8 @@ EXTERN void dsp_add_plus(t_sample *in1, t_sample *in2, t_sample *out, int n);
 EXTERN void dsp_add_copy(t_sample *in, t_sample *out, int n);
 EXTERN void dsp_add_scalarcopy(t_float *in, t_sample *out, int n);
 EXTERN void dsp_add_zero(t_sample *out, int n);
+EXTERN int signal_isaligned(const t_signal *sig);
+EXTERN void signal_setmultiout(t_signal **sig, int nchans);
 
 EXTERN int sys_getblksize(void);
 EXTERN t_float sys_getsr(void);
@@ -607,6 +675,8 @@ EXTERN int sys_get_outchannels(void);
 
 EXTERN void dsp_add(t_perfroutine f, int n, ...);
 EXTERN void dsp_addv(t_perfroutine f, int n, t_int *vec);
+EXTERN void dsp_specialize(t_perfroutine f, int nindex, int n,
+    t_perfroutine special);
 EXTERN void pd_fft(t_float *buf, int npoints, int inverse);
 EXTERN int ilog2(int n);
 
@@ -616,6 +686,16 @@ EXTERN void mayer_ifft(int n, t_sample *real, t_sample *imag);
 EXTERN void mayer_realfft(int n, t_sample *real);
 EXTERN void mayer_realifft(int n, t_sample *real);
 
+    /* planned FFTs: make a plan for one size (a power of two, at least 4)
+    outside the DSP loop, e.g. in a "dsp" method, then transform in place.
+    A plan made with "realfft" set is only for fftplan_real(). */
+typedef struct _fftplan t_fftplan;
+EXTERN t_fftplan *fftplan_new(int npoints, int realfft);
+EXTERN void fftplan_free(t_fftplan *x);
+EXTERN void fftplan_complex(t_fftplan *x, t_sample *real, t_sample *imag,
+    int inverse);
+EXTERN void fftplan_real(t_fftplan *x, t_sample *buf, int inverse);
+
 EXTERN float *cos_table;
 #define LOGCOSTABSIZE 9
 #define COSTABSIZE (1<<LOGCOSTABSIZE)
@@ -675,6 +755,8 @@ EXTERN t_class *garray_class;
 EXTERN int garray_getfloatarray(t_garray *x, int *size, t_float **vec);
 EXTERN int garray_getfloatwords(t_garray *x, int *size, t_word **vec);
 EXTERN void garray_redraw(t_garray *x);
+EXTERN void garray_redrawrange(t_garray *x, int from, int to);
+EXTERN void garray_dirtyrange(t_garray *x, int from, int to);
 EXTERN int garray_npoints(t_garray *x);
 EXTERN char *garray_vec(t_garray *x);
 EXTERN void garray_resize(t_garray *x, t_floatarg f);  /* avoid; use this: */
@@ -794,6 +876,16 @@ static inline int PD_BIGORSMALL(t_float f)  /* exponent outside (-512,512) */
     || (f) > -1e-150 && (f) < 1e-150 )
 #endif
 #endif /* _MSC_VER */
+
+    /* where this is defined, DSP code runs with denormal numbers flushed to
+    zero (unless Pd is started with "-noftz") so that recursive filters
+    needn't check for them sample by sample.  They should still check their
+    state with PD_BIGORSMALL() once per block to get rid of NaNs, infinities,
+    and very small numbers. */
+#if defined(__x86_64__) || defined(_M_X64) || \
+    (defined(__aarch64__) && defined(__GNUC__))
+#define PD_FLUSHDENORMALS
+#endif
     /* get version number at run time */
 EXTERN void sys_getversion(int *major, int *minor, int *bugfix);
 
@@ -845,8 +937,16 @@ struct _pdinstance
     t_symbol  pd_s_;
 #endif
 #if PDTHREADS
-    int pd_islocked;
+    int pd_islocked;            /* 1 if locked, more with pd_globallock() */
 #endif
+    int pd_symhashsize;         /* slots in symbol table, a power of two */
+    int pd_nsym;                /* number of symbols in the table */
+    t_symbol **pd_symoldhash;   /* previous table while it's being rehashed */
+    int pd_symoldsize;          /* its size */
+    int pd_symrehashed;         /* how many of its slots we've moved so far */
+    struct _symchunk *pd_symchunks; /* arena holding symbols and names */
+    struct _mempool *pd_mempool;    /* small-object pools for getbytes() */
+    struct _rtalloc *pd_rtalloc;    /* size classes for rt_getbytes() */
 };
 #define t_pdinstance struct _pdinstance
 EXTERN t_pdinstance pd_maininstance;
@@ -7,6 +7,8 @@
 #include "m_pd.h"
 #include "m_imp.h"
 #include "s_stuff.h"
+#include "s_net.h"
+#include "g_canvas.h"
 #ifdef _WIN32
 #include <windows.h>
 #endif
@@ -22,6 +24,7 @@ static int sys_quit;
 
 int sys_usecsincelastsleep(void);
 int sys_sleepgrain;
+int sys_adaptivesleep;
 
 typedef void (*t_clockmethod)(void *client);
 
@@ -30,21 +33,80 @@ struct _clock
     double c_settime;       /* in TIMEUNITS; <0 if unset */
     void *c_owner;
     t_clockmethod c_fn;
-    struct _clock *c_next;
+    int c_index;            /* where we are in the heap if set */
+    double c_order;         /* order set, to break ties */
     t_float c_unit;         /* >0 if in TIMEUNITS; <0 if in samples */
 };
 
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+
+/* Set clocks are kept in a binary heap (STUFF->st_clockheap) ordered by
+time, so that setting and unsetting them takes O(log n) time however many are
+set.  Clocks set for the same time go off in the order they were set, as they
+did when this was a sorted list.  pd_clock_setlist always points to the next
+clock to go off. */
+
+    /* true if clock x should go off before clock y */
+#define CLOCK_BEFORE(x, y) ((x)->c_settime < (y)->c_settime || \
+    ((x)->c_settime == (y)->c_settime && (x)->c_order < (y)->c_order))
+
+static void clock_heapput(t_clock **heap, int i, t_clock *x)
+{
+    heap[i] = x;
+    x->c_index = i;
+}
+
+    /* move a clock toward the top of the heap as far as it belongs */
+static void clock_heapup(t_clock **heap, int i)
+{
+    t_clock *x = heap[i];
+    while (i > 0)
+    {
+        int parent = (i - 1) >> 1;
+        if (!CLOCK_BEFORE(x, heap[parent]))
+            break;
+        clock_heapput(heap, i, heap[parent]);
+        i = parent;
+    }
+    clock_heapput(heap, i, x);
+}
+
+    /* ... and toward the bottom */
+static void clock_heapdown(t_clock **heap, int n, int i)
+{
+    t_clock *x = heap[i];
+    while (1)
+    {
+        int child = 2 * i + 1;
+        if (child >= n)
+            break;
+        if (child + 1 < n && CLOCK_BEFORE(heap[child + 1], heap[child]))
+            child++;
+        if (!CLOCK_BEFORE(heap[child], x))
+            break;
+        clock_heapput(heap, i, heap[child]);
+        i = child;
+    }
+    clock_heapput(heap, i, x);
+}
 
 t_clock *clock_new(void *owner, t_method fn)
 {
-    t_clock *x = (t_clock *)getbytes(sizeof *x);
+    t_clock *x = (t_clock *)rt_getbytes(sizeof *x);
     x->c_settime = -1;
     x->c_owner = owner;
     x->c_fn = (t_clockmethod)fn;
-    x->c_next = 0;
+    x->c_index = -1;
+    x->c_order = 0;
     x->c_unit = TIMEUNITPERMSEC;
     return (x);
 }
@@ -53,41 +115,41 @@ void clock_unset(t_clock *x)
 {
     if (x->c_settime >= 0)
     {
-        if (x == pd_this->pd_clock_setlist)
-            pd_this->pd_clock_setlist = x->c_next;
-        else
+        t_clock **heap = STUFF->st_clockheap;
+        int i = x->c_index, n = --STUFF->st_nclocks;
+        if (i < n)
         {
-            t_clock *x2 = pd_this->pd_clock_setlist;
-            while (x2->c_next != x) x2 = x2->c_next;
-            x2->c_next = x->c_next;
+                /* put the last one in our place and let it find its own */
+            clock_heapput(heap, i, heap[n]);
+            if (i > 0 && CLOCK_BEFORE(heap[i], heap[(i - 1) >> 1]))
+                clock_heapup(heap, i);
+            else clock_heapdown(heap, n, i);
         }
+        pd_this->pd_clock_setlist = (n ? heap[0] : 0);
         x->c_settime = -1;
+        x->c_index = -1;
     }
 }
 
     /* set the clock to call back at an absolute system time */
 void clock_set(t_clock *x, double setticks)
 {
+    int n;
     if (setticks < pd_this->pd_systime) setticks = pd_this->pd_systime;
     clock_unset(x);
-    x->c_settime = setticks;
-    if (pd_this->pd_clock_setlist &&
-        pd_this->pd_clock_setlist->c_settime <= setticks)
+    if ((n = STUFF->st_nclocks) == STUFF->st_clockheapsize)
     {
-        t_clock *cbefore, *cafter;
-        for (cbefore = pd_this->pd_clock_setlist,
-            cafter = pd_this->pd_clock_setlist->c_next;
-                cbefore; cbefore = cafter, cafter = cbefore->c_next)
-        {
-            if (!cafter || cafter->c_settime > setticks)
-            {
-                cbefore->c_next = x;
-                x->c_next = cafter;
-                return;
-            }
-        }
+        int newsize = (n ? 2 * n : 64);
+        STUFF->st_clockheap = (t_clock **)resizebytes(STUFF->st_clockheap,
+            n * sizeof(t_clock *), newsize * sizeof(t_clock *));
+        STUFF->st_clockheapsize = newsize;
     }
-    else x->c_next = pd_this->pd_clock_setlist, pd_this->pd_clock_setlist = x;
+    x->c_settime = setticks;
+    x->c_order = STUFF->st_clockorder++;
+    STUFF->st_clockheap[n] = x;
+    STUFF->st_nclocks = n + 1;
+    clock_heapup(STUFF->st_clockheap, n);
+    pd_this->pd_clock_setlist = STUFF->st_clockheap[0];
 }
 
     /* set the clock to call back after a delay in msec */
@@ -162,7 +224,48 @@ double clock_getsystimeafter(double delaytime)
 void clock_free(t_clock *x)
 {
     clock_unset(x);
-    freebytes(x, sizeof *x);
+    rt_freebytes(x, sizeof *x);
+}
+
+/* As in vline~, a DSP tick computes the time up to the current logical
+time; all of it if the block is larger than the scheduler's, otherwise
+in as many blocks as it takes. */
+
+void blocktime_init(t_blocktime *x)
+{
+    x->b_lasttime = -1;
+    x->b_start = x->b_next = pd_this->pd_systime;
+    x->b_persample = TIMEUNITPERSECOND/44100.;
+}
+
+void blocktime_advance(t_blocktime *x, int n, t_float sr)
+{
+    double persample = TIMEUNITPERSECOND / (sr > 0 ? sr : 44100.);
+    if (pd_this->pd_systime != x->b_lasttime)
+    {
+        double blocklength = n * persample, ticklength =
+            STUFF->st_schedblocksize * (TIMEUNITPERSECOND/STUFF->st_dacsr);
+        x->b_lasttime = pd_this->pd_systime;
+        x->b_next = pd_this->pd_systime -
+            (blocklength > ticklength ? blocklength : ticklength);
+    }
+    x->b_start = x->b_next;
+    x->b_next = x->b_start + n * persample;
+    x->b_persample = persample;
+}
+
+    /* the first sample at or after the given time, or n if that's not in
+    this block */
+int blocktime_offset(t_blocktime *x, double when, int n)
+{
+    double f = (when - x->b_start) / x->b_persample;
+    int i;
+    if (f <= 0)
+        return (0);
+    if (f >= n)
+        return (n);
+    i = (int)f;
+    return (i < f ? i + 1 : i);
 }
 
 /* the following routines maintain a real-execution-time histogram of the
@@ -273,12 +376,480 @@ void glob_audiostatus(void)
     }
 }
 
+/* "pd trace 1 [nevents]" records what each tick did into a ring buffer (the
+last 65536 events by default): when the audio backend let us go, the DSP
+computation, the output buffer's fill level where the backend reports it
+(sys_tracefill()) and every error passed to sys_log_error(), all stamped
+from a monotonic clock.  "pd trace write <file>" dumps it in the Chrome
+trace-event JSON format that chrome://tracing and ui.perfetto.dev load, and
+"pd trace 0" stops.  Events come from whichever thread computes DSP, and
+recording one costs a clock read and a few stores. */
+
+#define TRACE_WAKE 0
+#define TRACE_DSP 1
+#define TRACE_FILL 2
+#define TRACE_ERROR 3
+#define TRACE_DEFSIZE 65536
+
+typedef struct _traceevent
+{
+    double e_time;      /* seconds, monotonic */
+    double e_value;     /* DSP duration, frames buffered, or error type */
+    int e_tick;         /* DSP ticks done at the time */
+    int e_type;
+} t_traceevent;
+
+static t_traceevent *sched_trace;
+static int sched_tracesize, sched_tracehead, sched_tracecount;
+static int sched_tracing;
+
+static double sched_tracetime(void)
+{
+    return (1e-9 * sys_getnanotime());
+}
+
+static void sched_traceadd(int type, double time, double value)
+{
+    t_traceevent *e = &sched_trace[sched_tracehead];
+    e->e_time = time;
+    e->e_value = value;
+    e->e_tick = sched_diddsp;
+    e->e_type = type;
+    if (++sched_tracehead == sched_tracesize)
+        sched_tracehead = 0;
+    if (sched_tracecount < sched_tracesize)
+        sched_tracecount++;
+}
+
+    /* called by backends that know how many frames of output are queued */
+void sys_tracefill(int nframes)
+{
+    if (sched_tracing)
+        sched_traceadd(TRACE_FILL, sched_tracetime(), nframes);
+}
+
+static void sched_tracewrite(const char *filename)
+{
+    FILE *fd;
+    int i, n = sched_tracecount, wastracing = sched_tracing,
+        onset = sched_tracehead - n;
+    double t0;
+    if (!(fd = sys_fopen(filename, "w")))
+    {
+        pd_error(0, "%s: %s", filename, strerror(errno));
+        return;
+    }
+    sched_tracing = 0;
+    if (onset < 0)
+        onset += sched_tracesize;
+    t0 = (n ? sched_trace[onset].e_time : 0);
+    fprintf(fd, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(fd, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+        "\"tid\":1,\"args\":{\"name\":\"pd scheduler\"}}");
+    for (i = 0; i < n; i++)
+    {
+        t_traceevent *e = &sched_trace[(onset + i) % sched_tracesize];
+        double ts = 1e6 * (e->e_time - t0);
+        switch (e->e_type)
+        {
+        case TRACE_WAKE:
+            fprintf(fd, ",\n{\"name\":\"wakeup\",\"ph\":\"i\",\"s\":\"t\","
+                "\"ts\":%.3f,\"pid\":1,\"tid\":1,\"args\":{\"tick\":%d}}",
+                    ts, e->e_tick);
+            break;
+        case TRACE_DSP:
+            fprintf(fd, ",\n{\"name\":\"dsp\",\"ph\":\"X\",\"ts\":%.3f,"
+                "\"dur\":%.3f,\"pid\":1,\"tid\":1,\"args\":{\"tick\":%d}}",
+                    ts, 1e6 * e->e_value, e->e_tick);
+            break;
+        case TRACE_FILL:
+            fprintf(fd, ",\n{\"name\":\"output buffer\",\"ph\":\"C\","
+                "\"ts\":%.3f,\"pid\":1,\"args\":{\"frames\":%g}}",
+                    ts, e->e_value);
+            break;
+        default:
+        {
+            int errtype = (int)e->e_value;
+            if (errtype < 0 || errtype > ERR_DATALATE)
+                errtype = 0;
+            fprintf(fd, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"g\","
+                "\"ts\":%.3f,\"pid\":1,\"tid\":1,\"args\":{\"tick\":%d}}",
+                    oss_errornames[errtype], ts, e->e_tick);
+        }
+        }
+    }
+    fprintf(fd, "\n]}\n");
+    if (fclose(fd) < 0)
+        pd_error(0, "%s: %s", filename, strerror(errno));
+    else post("trace: wrote %d events to %s", n, filename);
+    sched_tracing = wastracing;
+}
+
+    /* "trace" message to Pd */
+void glob_trace(void *dummy, t_symbol *s, int argc, t_atom *argv)
+{
+    if (argc >= 2 && argv->a_type == A_SYMBOL &&
+        argv->a_w.w_symbol == gensym("write"))
+    {
+        if (!sched_trace)
+            pd_error(0, "trace: nothing recorded");
+        else sched_tracewrite(atom_getsymbolarg(1, argc, argv)->s_name);
+    }
+    else if (argc >= 1 && argv->a_type == A_FLOAT)
+    {
+        int size = atom_getfloatarg(1, argc, argv);
+        sched_tracing = 0;
+        if (argv->a_w.w_float == 0)
+            return;
+        if (size < 1)
+            size = TRACE_DEFSIZE;
+        if (size != sched_tracesize)
+        {
+            if (sched_trace)
+                freebytes(sched_trace, sched_tracesize * sizeof(*sched_trace));
+            sched_trace = (t_traceevent *)getbytes(size * sizeof(*sched_trace));
+            sched_tracesize = size;
+        }
+        sched_tracehead = sched_tracecount = 0;
+        sched_tracing = 1;
+    }
+    else pd_error(0, "usage: trace 1 [nevents] | 0 | write <file>");
+}
+
+/* "pd msg-profile 1" times the messages objects get from outlets, the
+clock callbacks in sched_tick(), and the messages binbuf_eval() sends to
+receive names (which is how GUI input and "; receiver message" arrive),
+charging each to the object or canvas it went to.  An object's exclusive
+time leaves out the messages it sent on while handling one; its inclusive
+time includes them, counting a recursive call only once.  "pd msg-profile
+print [n] [filename]" reports the n objects with the most exclusive time,
+and the canvases with that of everything in them, since "msg-profile 1";
+"pd msg-profile 0" stops.  Each timed message costs two clock reads and a
+hash lookup; with profiling off, one test per message. */
+
+#define MSGPROF_MAXDEPTH 1024   /* deeper messages are charged to the caller */
+
+typedef struct _msgprof
+{
+    void *m_owner;          /* object, receiver, or a clock's owner */
+    t_canvas *m_canvas;     /* canvas it's in, found when reporting */
+    int m_calls;
+    int m_depth;            /* number of times it's on the stack now */
+    double m_incl;          /* seconds, including messages it sent on */
+    double m_excl;          /* seconds, not including them */
+} t_msgprof;
+
+typedef struct _msgframe
+{
+    int f_prof;             /* index into sched_msgprof */
+    double f_start;
+    double f_children;      /* time taken by messages sent from here */
+} t_msgframe;
+
+typedef struct _msgcanvas
+{
+    t_canvas *c_canvas;
+    double c_time;
+} t_msgcanvas;
+
+int sched_msgprofile;
+static t_msgprof *sched_msgprof;
+static int sched_nmsgprof;
+static int *sched_msghash;      /* index into sched_msgprof plus one, or 0 */
+static int sched_msghashsize;   /* power of two; sched_msgprof has half that */
+static t_msgframe sched_msgstack[MSGPROF_MAXDEPTH];
+static int sched_msgdepth, sched_msgoverflow;
+static int sched_nmsgs;
+static double sched_msgstart, sched_msgstop, sched_msgtotal;
+
+static int *sched_msgslot(void *owner)
+{
+    unsigned int h = ((unsigned int)((size_t)owner >> 3) * 2654435761u) &
+        (sched_msghashsize - 1);
+    while (sched_msghash[h] &&
+        sched_msgprof[sched_msghash[h] - 1].m_owner != owner)
+            h = (h + 1) & (sched_msghashsize - 1);
+    return (&sched_msghash[h]);
+}
+
+    /* find the owner's entry, making one if "create" is set; -1 if none */
+static int sched_msgfind(void *owner, int create)
+{
+    int *slot = (sched_msghashsize ? sched_msgslot(owner) : 0), i;
+    if (slot && *slot)
+        return (*slot - 1);
+    if (!create)
+        return (-1);
+    if (2 * (sched_nmsgprof + 1) > sched_msghashsize)
+    {
+        int newsize = (sched_msghashsize ? 2 * sched_msghashsize : 256);
+        sched_msgprof = (t_msgprof *)resizebytes(sched_msgprof,
+            (sched_msghashsize / 2) * sizeof(*sched_msgprof),
+                (newsize / 2) * sizeof(*sched_msgprof));
+        if (sched_msghash)
+            freebytes(sched_msghash, sched_msghashsize * sizeof(int));
+        sched_msghash = (int *)getbytes(newsize * sizeof(int));
+        sched_msghashsize = newsize;
+        for (i = 0; i < sched_nmsgprof; i++)
+            *sched_msgslot(sched_msgprof[i].m_owner) = i + 1;
+        slot = sched_msgslot(owner);
+    }
+    i = sched_nmsgprof++;
+    sched_msgprof[i].m_owner = owner;
+    sched_msgprof[i].m_canvas = 0;
+    sched_msgprof[i].m_calls = sched_msgprof[i].m_depth = 0;
+    sched_msgprof[i].m_incl = sched_msgprof[i].m_excl = 0;
+    *slot = i + 1;
+    return (i);
+}
+
+    /* called (if sched_msgprofile is set) before a message to "owner"... */
+void sched_msgenter(void *owner)
+{
+    t_msgframe *f;
+    int i;
+    if (sched_msgdepth == MSGPROF_MAXDEPTH)
+    {
+        sched_msgoverflow++;
+        return;
+    }
+    i = sched_msgfind(owner, 1);
+    sched_msgprof[i].m_calls++;
+    sched_msgprof[i].m_depth++;
+    sched_nmsgs++;
+    f = &sched_msgstack[sched_msgdepth++];
+    f->f_prof = i;
+    f->f_children = 0;
+    f->f_start = sched_tracetime();
+}
+
+    /* ... and this after it.  Profiling may have been started or stopped
+    in between, in which case there's nothing on the stack to pop. */
+void sched_msgleave(void)
+{
+    double now = sched_tracetime(), elapsed;
+    t_msgframe *f;
+    t_msgprof *p;
+    if (sched_msgoverflow)
+    {
+        sched_msgoverflow--;
+        return;
+    }
+    if (!sched_msgdepth)
+        return;
+    f = &sched_msgstack[--sched_msgdepth];
+    p = &sched_msgprof[f->f_prof];
+    elapsed = now - f->f_start;
+    p->m_excl += elapsed - f->f_children;
+    if (!--p->m_depth)
+        p->m_incl += elapsed;
+    if (sched_msgdepth)
+        sched_msgstack[sched_msgdepth - 1].f_children += elapsed;
+    else sched_msgtotal += elapsed;
+}
+
+    /* find out which canvas each object we timed is in.  A toplevel
+    canvas that got messages itself (from the GUI, say) is its own. */
+static void sched_msgprofwalk(t_canvas *gl)
+{
+    t_gobj *y;
+    int i;
+    if ((i = sched_msgfind(gl, 0)) >= 0 && !sched_msgprof[i].m_canvas)
+        sched_msgprof[i].m_canvas = gl;
+    for (y = gl->gl_list; y; y = y->g_next)
+    {
+        if ((i = sched_msgfind(y, 0)) >= 0)
+            sched_msgprof[i].m_canvas = gl;
+        if (pd_class(&y->g_pd) == canvas_class)
+            sched_msgprofwalk((t_canvas *)y);
+    }
+}
+
+static int sched_msgcompare(const void *p1, const void *p2)
+{
+    double t1 = (*(t_msgprof **)p1)->m_excl, t2 = (*(t_msgprof **)p2)->m_excl;
+    return (t1 < t2 ? 1 : (t1 > t2 ? -1 : 0));
+}
+
+static int sched_msgcanvascompare(const void *p1, const void *p2)
+{
+    double t1 = ((t_msgcanvas *)p1)->c_time, t2 = ((t_msgcanvas *)p2)->c_time;
+    return (t1 < t2 ? 1 : (t1 > t2 ? -1 : 0));
+}
+
+    /* print a line of the report, to the file if there is one */
+static void sched_msgprint(FILE *fd, const char *fmt, ...)
+{
+    char buf[MAXPDSTRING];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buf, MAXPDSTRING-1, fmt, ap);
+    va_end(ap);
+    buf[MAXPDSTRING-1] = 0;
+    if (fd)
+        fprintf(fd, "%s\n", buf);
+    else post("%s", buf);
+}
+
+static void sched_msgreport(int n, FILE *fd)
+{
+    t_msgprof **objs;
+    t_msgcanvas *canvases;
+    t_canvas *gl;
+    int nobj = 0, ncanvas = 0, nother = 0, i, j;
+    double total = sched_msgtotal, elapsed, other = 0;
+    if (!sched_nmsgs || total <= 0)
+    {
+        sched_msgprint(fd, "msg-profile: nothing measured yet");
+        return;
+    }
+    elapsed = (sched_msgprofile ? sched_tracetime() : sched_msgstop) -
+        sched_msgstart;
+    for (i = 0; i < sched_nmsgprof; i++)
+        sched_msgprof[i].m_canvas = 0;
+    for (gl = pd_getcanvaslist(); gl; gl = gl->gl_next)
+        sched_msgprofwalk(gl);
+    objs = (t_msgprof **)getbytes((sched_nmsgprof + 1) * sizeof(*objs));
+    canvases = (t_msgcanvas *)getbytes(
+        (sched_nmsgprof + 1) * sizeof(*canvases));
+        /* charge each object's time to its canvas and the ones that
+        contain it.  Whatever isn't in a canvas any more (or never was, like
+        the "pd" object or a clock's owner that isn't an object) is lumped
+        together at the end. */
+    for (i = 0; i < sched_nmsgprof; i++)
+    {
+        t_msgprof *p = &sched_msgprof[i];
+        if (!p->m_canvas)
+        {
+            other += p->m_excl;
+            nother++;
+            continue;
+        }
+        objs[nobj++] = p;
+        for (gl = p->m_canvas; gl; gl = gl->gl_owner)
+        {
+            for (j = 0; j < ncanvas; j++)
+                if (canvases[j].c_canvas == gl)
+                    break;
+            if (j == ncanvas)
+            {
+                    /* there can be more canvases than entries, but only
+                    when some of them contain nothing we timed */
+                if (ncanvas == sched_nmsgprof + 1)
+                    break;
+                canvases[ncanvas].c_canvas = gl;
+                canvases[ncanvas++].c_time = 0;
+            }
+            canvases[j].c_time += p->m_excl;
+        }
+    }
+    qsort(objs, nobj, sizeof(*objs), sched_msgcompare);
+    qsort(canvases, ncanvas, sizeof(*canvases), sched_msgcanvascompare);
+    sched_msgprint(fd,
+        "msg-profile: %d messages, %.3f msec in %.2f sec (%.1f%% CPU)",
+            sched_nmsgs, 1e3 * total, elapsed,
+                (elapsed > 0 ? 100. * total / elapsed : 0));
+    sched_msgprint(fd, "objects (exclusive msec, inclusive msec, calls):");
+    for (i = 0; i < nobj && i < n && objs[i]->m_calls > 0; i++)
+    {
+        t_msgprof *p = objs[i];
+        t_object *ob = pd_checkobject((t_pd *)p->m_owner);
+        char *text;
+        int textsize;
+        if (p->m_canvas == p->m_owner)
+        {
+            sched_msgprint(fd, "%6.2f%% %10.3f %10.3f %8d  (canvas %s)",
+                100. * p->m_excl / total, 1e3 * p->m_excl, 1e3 * p->m_incl,
+                    p->m_calls, p->m_canvas->gl_name->s_name);
+            continue;
+        }
+        if (ob)
+        {
+            binbuf_gettext(ob->te_binbuf, &text, &textsize);
+            for (j = 0; j < textsize; j++)
+                if (text[j] == '\n')
+                    text[j] = ' ';
+        }
+        else text = 0, textsize = 0;
+        sched_msgprint(fd, "%6.2f%% %10.3f %10.3f %8d  %.*s  (%s)",
+            100. * p->m_excl / total, 1e3 * p->m_excl, 1e3 * p->m_incl,
+                p->m_calls, (textsize > 40 ? 40 : textsize), text,
+                    p->m_canvas->gl_name->s_name);
+        if (text)
+            freebytes(text, textsize);
+    }
+    if (nother)
+        sched_msgprint(fd, "%6.2f%% %10.3f  (%d other receivers or clocks)",
+            100. * other / total, 1e3 * other, nother);
+    sched_msgprint(fd, "canvases (including the objects in them):");
+    for (i = 0; i < ncanvas && i < n; i++)
+        sched_msgprint(fd, "%6.2f%% %10.3f  %s",
+            100. * canvases[i].c_time / total, 1e3 * canvases[i].c_time,
+                canvases[i].c_canvas->gl_name->s_name);
+    freebytes(objs, (sched_nmsgprof + 1) * sizeof(*objs));
+    freebytes(canvases, (sched_nmsgprof + 1) * sizeof(*canvases));
+}
+
+    /* "msg-profile" message to Pd */
+void glob_msgprofile(void *dummy, t_symbol *s, int argc, t_atom *argv)
+{
+    t_symbol *what = atom_getsymbolarg(0, argc, argv);
+    if (argc && argv->a_type == A_FLOAT)
+    {
+        sched_msgdepth = sched_msgoverflow = 0;
+        if ((sched_msgprofile = (argv->a_w.w_float != 0)))
+        {
+            if (sched_msghash)
+                memset(sched_msghash, 0, sched_msghashsize * sizeof(int));
+            sched_nmsgprof = sched_nmsgs = 0;
+            sched_msgtotal = 0;
+            sched_msgstart = sched_tracetime();
+        }
+        else sched_msgstop = sched_tracetime();
+    }
+    else if (what == gensym("print"))
+    {
+        int n = atom_getfloatarg(1, argc, argv);
+        t_symbol *filename = atom_getsymbolarg(2, argc, argv);
+        FILE *fd = 0;
+        if (n <= 0)
+            n = 10;
+        if (*filename->s_name &&
+            !(fd = sys_fopen(filename->s_name, "w")))
+        {
+            pd_error(0, "%s: %s", filename->s_name, strerror(errno));
+            return;
+        }
+        sched_msgreport(n, fd);
+        if (fd)
+            sys_fclose(fd);
+    }
+    else pd_error(0, "usage: msg-profile 0|1 or msg-profile print [n] [file]");
+}
+
 static int sched_diored;
 static int sched_dioredtime;
 static int sched_meterson;
 
+    /* running counts for "pd metrics": audio errors by type, DSP time per
+    tick, and ticks whose DSP computation took longer than the tick lasts */
+static int sched_nerror[ERR_DATALATE + 1];
+static int sched_nlate, sched_ntimed;
+static double sched_dsptime, sched_dspmaxtime;
+
+    /* the same since the watchdog was last pinged */
+static int sched_wdnlate, sched_wdnxrun;
+static double sched_wdmaxtime;
+
 void sys_log_error(int type)
 {
+    if (type > ERR_NOTHING && type <= ERR_DATALATE)
+    {
+        sched_nerror[type]++;
+        sched_wdnxrun++;
+    }
+    if (sched_tracing)
+        sched_traceadd(TRACE_ERROR, sched_tracetime(), type);
     oss_resync[oss_resyncphase].r_ntick = sched_diddsp;
     oss_resync[oss_resyncphase].r_error = type;
     oss_nresync++;
@@ -293,6 +864,208 @@ void sys_log_error(int type)
         sched_diddsp + (int)(STUFF->st_dacsr /(double)STUFF->st_schedblocksize);
 }
 
+    /* "pd metrics" reports the above, along with the execution-time
+    histogram, as messages to a receive name ("pd-metrics" by default) so
+    that a patch can log or display them.  "pd metrics push" also sends them
+    periodically over UDP as statsd gauges for an external collector. */
+
+static t_symbol *sched_metricssym;
+static int sched_metricsfd = -1;
+static struct sockaddr_storage sched_metricsaddr;
+static socklen_t sched_metricsaddrlen;
+static t_clock *sched_metricsclock;
+static double sched_metricsinterval;
+static char sched_metricsprefix[MAXPDSTRING];
+
+static void sched_clearmetrics(void)
+{
+    unsigned int i;
+    for (i = 0; i <= ERR_DATALATE; i++)
+        sched_nerror[i] = 0;
+    sched_nlate = sched_ntimed = 0;
+    sched_dsptime = sched_dspmaxtime = 0;
+}
+
+    /* worst DSP time per tick, late ticks, and audio errors since the last
+    call, for the watchdog ping (s_inter.c) */
+void sched_watchdogstats(double *maxtime, int *nlate, int *nxrun)
+{
+    *maxtime = sched_wdmaxtime;
+    *nlate = sched_wdnlate;
+    *nxrun = sched_wdnxrun;
+    sched_wdmaxtime = 0;
+    sched_wdnlate = sched_wdnxrun = 0;
+}
+
+static int sched_nxruns(void)
+{
+    int i, n = 0;
+    for (i = ERR_NOTHING + 1; i <= ERR_DATALATE; i++)
+        n += sched_nerror[i];
+    return (n);
+}
+
+static void sched_sendmetrics(t_symbol *s)
+{
+    t_atom at[NBIN + 1];
+    unsigned int i, j;
+    if (!s->s_thing)
+        return;
+    for (i = 0; i < NBIN; i++)
+        SETFLOAT(at+i, sys_bin[i]);
+    pd_typedmess(s->s_thing, gensym("bins"), NBIN, at);
+    for (i = 0; i < NHIST; i++)
+    {
+        int doit = 0;
+        for (j = 0; j < NBIN; j++) if (sys_histogram[i][j]) doit = 1;
+        if (doit)
+        {
+            SETFLOAT(at, i);
+            for (j = 0; j < NBIN; j++)
+                SETFLOAT(at+j+1, sys_histogram[i][j]);
+            pd_typedmess(s->s_thing, gensym("hist"), NBIN + 1, at);
+        }
+    }
+    SETFLOAT(at, sched_diddsp);
+    SETFLOAT(at+1, sched_didpoll);
+    SETFLOAT(at+2, sched_didnothing);
+    pd_typedmess(s->s_thing, gensym("ticks"), 3, at);
+    SETFLOAT(at, sched_nxruns());
+    for (i = ERR_NOTHING + 1; i <= ERR_DATALATE; i++)
+        SETFLOAT(at+i, sched_nerror[i]);
+    pd_typedmess(s->s_thing, gensym("xruns"), ERR_DATALATE + 1, at);
+    SETFLOAT(at, (sched_ntimed ? 1000. * sched_dsptime / sched_ntimed : 0));
+    SETFLOAT(at+1, 1000. * sched_dspmaxtime);
+    pd_typedmess(s->s_thing, gensym("dsptime"), 2, at);
+    SETFLOAT(at, sched_nlate);
+    pd_typedmess(s->s_thing, gensym("late"), 1, at);
+}
+
+    /* append one statsd gauge to the packet, flushing it first if full */
+static void sched_pushgauge(char *buf, int *len, const char *name,
+    double value)
+{
+    char line[MAXPDSTRING];
+    int n = snprintf(line, MAXPDSTRING, "%s%s:%g|g\n",
+        sched_metricsprefix, name, value);
+    if (n >= MAXPDSTRING)
+        return;
+    if (*len + n > 1400 && *len)
+    {
+        sendto(sched_metricsfd, buf, *len, 0,
+            (struct sockaddr *)&sched_metricsaddr, sched_metricsaddrlen);
+        *len = 0;
+    }
+    memcpy(buf + *len, line, n);
+    *len += n;
+}
+
+static void sched_pushmetrics(void *dummy)
+{
+    static char *errnames[] = {"", "adcblocked", "dacblocked", "sync", "late"};
+    char buf[1400 + MAXPDSTRING], name[MAXPDSTRING];
+    int len = 0;
+    unsigned int i, j;
+    for (i = 0; i < NHIST; i++)
+        for (j = 0; j < NBIN; j++)
+            if (sys_histogram[i][j])
+    {
+        snprintf(name, MAXPDSTRING, "hist.%d.%d", i, sys_bin[j]);
+        sched_pushgauge(buf, &len, name, sys_histogram[i][j]);
+    }
+    sched_pushgauge(buf, &len, "ticks.dsp", sched_diddsp);
+    sched_pushgauge(buf, &len, "ticks.pollgui", sched_didpoll);
+    sched_pushgauge(buf, &len, "ticks.nothing", sched_didnothing);
+    sched_pushgauge(buf, &len, "xruns", sched_nxruns());
+    for (i = ERR_NOTHING + 1; i <= ERR_DATALATE; i++)
+    {
+        snprintf(name, MAXPDSTRING, "xruns.%s", errnames[i]);
+        sched_pushgauge(buf, &len, name, sched_nerror[i]);
+    }
+    sched_pushgauge(buf, &len, "dsptime.mean",
+        (sched_ntimed ? 1000. * sched_dsptime / sched_ntimed : 0));
+    sched_pushgauge(buf, &len, "dsptime.max", 1000. * sched_dspmaxtime);
+    sched_pushgauge(buf, &len, "late", sched_nlate);
+    if (len)
+        sendto(sched_metricsfd, buf, len, 0,
+            (struct sockaddr *)&sched_metricsaddr, sched_metricsaddrlen);
+    clock_delay(sched_metricsclock, sched_metricsinterval);
+}
+
+static void sched_stoppush(void)
+{
+    if (sched_metricsclock)
+        clock_free(sched_metricsclock), sched_metricsclock = 0;
+    if (sched_metricsfd >= 0)
+        sys_closesocket(sched_metricsfd), sched_metricsfd = -1;
+}
+
+static void sched_startpush(const char *hostname, int port, double interval,
+    const char *prefix)
+{
+    struct addrinfo *ailist = NULL, *ai;
+    int status;
+    sched_stoppush();
+    if ((status = addrinfo_get_list(&ailist, hostname, port, SOCK_DGRAM)))
+    {
+        pd_error(0, "metrics: bad host or port? %s (%d)",
+            gai_strerror(status), status);
+        return;
+    }
+    for (ai = ailist; ai != NULL; ai = ai->ai_next)
+    {
+        if ((sched_metricsfd = (int)socket(ai->ai_family, ai->ai_socktype,
+            ai->ai_protocol)) < 0)
+                continue;
+        memcpy(&sched_metricsaddr, ai->ai_addr, ai->ai_addrlen);
+        sched_metricsaddrlen = (socklen_t)ai->ai_addrlen;
+        break;
+    }
+    freeaddrinfo(ailist);
+    if (sched_metricsfd < 0)
+    {
+        sys_sockerror("metrics");
+        return;
+    }
+    socket_set_nonblocking(sched_metricsfd, 1);
+    snprintf(sched_metricsprefix, MAXPDSTRING, "%s%s", prefix,
+        (*prefix ? "." : ""));
+    sched_metricsinterval = (interval > 0 ? interval : 1000);
+    sched_metricsclock = clock_new(0, (t_method)sched_pushmetrics);
+    clock_delay(sched_metricsclock, sched_metricsinterval);
+}
+
+    /* "metrics" message to Pd */
+void glob_metrics(void *dummy, t_symbol *s, int argc, t_atom *argv)
+{
+    t_symbol *what = atom_getsymbolarg(0, argc, argv);
+    if (!sched_metricssym)
+        sched_metricssym = gensym("pd-metrics");
+    if (what == gensym("reset"))
+    {
+        sys_clearhist();
+        sched_clearmetrics();
+    }
+    else if (what == gensym("push"))
+    {
+        t_symbol *host = atom_getsymbolarg(1, argc, argv);
+        int port = atom_getfloatarg(2, argc, argv);
+        t_symbol *prefix = (argc > 4 ? atom_getsymbolarg(4, argc, argv) :
+            gensym("pd"));
+        if (argc < 2 || (argc == 2 && argv[1].a_type == A_FLOAT &&
+            argv[1].a_w.w_float == 0))
+                sched_stoppush();
+        else if (!*host->s_name || port <= 0)
+            pd_error(0,
+                "usage: metrics push <host> <port> [msec] [prefix] | push 0");
+        else sched_startpush(host->s_name, port,
+            atom_getfloatarg(3, argc, argv), prefix->s_name);
+    }
+    else if (!argc || argv->a_type == A_SYMBOL)
+        sched_sendmetrics(*what->s_name ? what : sched_metricssym);
+    else pd_error(0, "usage: metrics [receive-name] | reset | push ...");
+}
+
 static int sched_lastinclip, sched_lastoutclip,
     sched_lastindb, sched_lastoutdb;
 
@@ -397,19 +1170,41 @@ void sched_set_using_audio(int flag)
 }
 
     /* take the scheduler forward one DSP tick, also handling clock timeouts */
-void sched_tick(void)
+    /* Instances other than the main one are run by whoever embeds Pd,
+    possibly many at once, each on its own thread.  They don't get MIDI
+    from -midithread or keep the scheduler's statistics, both of which
+    are global, so that their ticks don't touch any shared state. */
+static void sched_dotick(void)
 {
     double next_sys_time = pd_this->pd_systime +
         (STUFF->st_schedblocksize/STUFF->st_dacsr) * TIMEUNITPERSECOND;
-    int countdown = 5000;
-    while (pd_this->pd_clock_setlist &&
-        pd_this->pd_clock_setlist->c_settime < next_sys_time)
+    int countdown = 5000, ismain = (pd_this == &pd_maininstance);
+    while (1)
     {
         t_clock *c = pd_this->pd_clock_setlist;
-        pd_this->pd_systime = c->c_settime;
-        clock_unset(pd_this->pd_clock_setlist);
-        outlet_setstacklim();
-        (*c->c_fn)(c->c_owner);
+            /* MIDI input from -midithread comes in timestamped and goes
+            out in time order with the clocks */
+        double miditime = (ismain ? sys_midiinnexttime() : 1e300);
+        if (miditime < next_sys_time && (!c || miditime <= c->c_settime))
+        {
+            if (miditime > pd_this->pd_systime)
+                pd_this->pd_systime = miditime;
+            sys_midiindispatch();
+        }
+        else if (c && c->c_settime < next_sys_time)
+        {
+            pd_this->pd_systime = c->c_settime;
+            clock_unset(pd_this->pd_clock_setlist);
+            outlet_setstacklim();
+            if (sched_msgprofile)
+            {
+                sched_msgenter(c->c_owner);
+                (*c->c_fn)(c->c_owner);
+                sched_msgleave();
+            }
+            else (*c->c_fn)(c->c_owner);
+        }
+        else break;
         if (!countdown--)
         {
             countdown = 5000;
@@ -419,10 +1214,42 @@ void sched_tick(void)
             return;
     }
     pd_this->pd_systime = next_sys_time;
-    dsp_tick();
+    if (!ismain)
+    {
+        dsp_tick();
+        return;
+    }
+    {
+        double starttime = sys_getrealtime(), elapsed,
+            tracestart = (sched_tracing ? sched_tracetime() : 0);
+        dsp_tick();
+        elapsed = sys_getrealtime() - starttime;
+        if (sched_tracing)
+            sched_traceadd(TRACE_DSP, tracestart,
+                sched_tracetime() - tracestart);
+        sched_dsptime += elapsed;
+        if (elapsed > sched_dspmaxtime)
+            sched_dspmaxtime = elapsed;
+        if (elapsed > sched_wdmaxtime)
+            sched_wdmaxtime = elapsed;
+        if (elapsed * STUFF->st_dacsr > STUFF->st_schedblocksize)
+        {
+            sched_nlate++;
+            sched_wdnlate++;
+        }
+        sched_ntimed++;
+    }
     sched_diddsp++;
 }
 
+    /* messages posted during a tick go out together at the end of it */
+void sched_tick(void)
+{
+    sys_deferlog(1);
+    sched_dotick();
+    sys_deferlog(0);
+}
+
 /*
 Here is Pd's "main loop."  This routine dispatches clock timeouts and DSP
 "ticks" deterministically, and polls for input from MIDI and the GUI.  If
@@ -442,6 +1269,33 @@ nonzero if you actually used the time; otherwise we're really really idle and
 will now sleep. */
 int (*sys_idlehook)(void);
 
+    /* with -adaptivesleep, instead of sleeping sys_sleepgrain when idle we
+    guess when the next DSP tick will be due: from the logical and real time
+    if there's no audio, or else one tick after the last one, when the
+    audio device will probably have room for another block.  If we wake up
+    and it doesn't, we sleep longer and longer, up to a tick, which takes care
+    of devices that take blocks several at a time.  Input on a file
+    descriptor wakes us up in any case (see sys_domicrosleep()). */
+static double sched_lastticktime;   /* real time we last sent the DACs */
+static int sched_sleepbackoff;      /* times we've woken up too early */
+
+static int sched_sleeptime(void)
+{
+    double tickusec = (1000000. * STUFF->st_schedblocksize) / STUFF->st_dacsr,
+        waitusec;
+    if (sched_useaudio == SCHED_AUDIO_NONE)
+        waitusec = 1000. * clock_gettimesince(sched_referencelogicaltime) -
+            1000000. * (sys_getrealtime() - sched_referencerealtime);
+    else waitusec = tickusec -
+        1000000. * (sys_getrealtime() - sched_lastticktime);
+    if (waitusec < 100)
+    {
+        waitusec = 100 << (sched_sleepbackoff < 10 ? sched_sleepbackoff : 10);
+        sched_sleepbackoff++;
+    }
+    return (waitusec < tickusec ? waitusec : tickusec);
+}
+
 static void m_pollingscheduler(void)
 {
     int idlecount = 0;
@@ -513,8 +1367,14 @@ static void m_pollingscheduler(void)
         }
         sys_setmiditimediff(0, 1e-6 * sys_schedadvance);
         sys_addhist(1);
+        if (timeforward != SENDDACS_NO && sched_tracing)
+            sched_traceadd(TRACE_WAKE, sched_tracetime(), timeforward);
         if (timeforward != SENDDACS_NO)
+        {
             sched_tick();
+            sched_lastticktime = sys_getrealtime();
+            sched_sleepbackoff = 0;
+        }
         if (timeforward == SENDDACS_YES)
             didsomething = 1;
 
@@ -533,12 +1393,14 @@ static void m_pollingscheduler(void)
             sched_pollformeters();
             sys_reportidle();
             sys_unlock();   /* unlock while we idle */
+            sys_rtrefill();
                 /* call externally installed idle function if any. */
             if (!sys_idlehook || !sys_idlehook())
             {
                     /* if even that had nothing to do, sleep. */
                 if (timeforward != SENDDACS_SLEPT)
-                    sys_microsleep(sys_sleepgrain);
+                    sys_microsleep(sys_adaptivesleep ? sched_sleeptime() :
+                        sys_sleepgrain);
             }
             sys_lock();
             sys_addhist(5);
@@ -548,9 +1410,14 @@ static void m_pollingscheduler(void)
     sys_unlock();
 }
 
+    /* called from the audio thread in callback mode.  If the main thread
+    has Pd locked (see below) we skip a block rather than wait for it. */
 void sched_audio_callbackfn(void)
 {
-    sys_lock();
+    if (sys_trylock())
+        return;
+    if (sched_tracing)
+        sched_traceadd(TRACE_WAKE, sched_tracetime(), SENDDACS_YES);
     sys_setmiditimediff(0, 1e-6 * sys_schedadvance);
     sys_addhist(1);
     sched_tick();
@@ -564,27 +1431,48 @@ void sched_audio_callbackfn(void)
     sys_unlock();
 }
 
+    /* in callback mode the main thread waits for input and hands it to the
+    audio thread (see sys_waitforfds()).  Only if the audio thread hasn't
+    advanced logical time for a second, for instance because audio is off,
+    does it lock Pd and take over. */
 static void m_callbackscheduler(void)
 {
+    double timewas = pd_this->pd_systime, changetime = sys_getrealtime();
     sys_initmidiqueue();
+    sys_lock();
+    sys_setfdqueue(1);
+    sys_unlock();
     while (!sys_quit)
     {
-        double timewas = pd_this->pd_systime;
+        double now;
+        if (sys_fdqueuebusy())
+        {
 #ifdef _WIN32
-        Sleep(1000);
+            Sleep(1);
 #else
-        sleep(1);
+            usleep(1000);
 #endif
-        if (pd_this->pd_systime == timewas)
+        }
+        else sys_waitforfds(10000);
+        now = sys_getrealtime();
+        if (pd_this->pd_systime != timewas)
+            timewas = pd_this->pd_systime, changetime = now;
+        else if (now > changetime + 1)
         {
             sys_lock();
             sys_pollgui();
             sched_tick();
             sys_unlock();
+            timewas = pd_this->pd_systime;
+            changetime = now;
         }
+        sys_rtrefill();
         if (sys_idlehook)
             sys_idlehook();
     }
+    sys_lock();
+    sys_setfdqueue(0);
+    sys_unlock();
 }
 
 int m_mainloop(void)
@@ -607,8 +1495,354 @@ int m_mainloop(void)
     return (0);
 }
 
+const char *sys_renderfile;
+const char *sys_bench;
+int sys_renderbytes = 4;
+t_float sys_renderduration = -1;
+
+    /* "-batch -render <file>": compute as fast as we can, writing the output
+    to a soundfile, until the duration is up or the patch quits */
+static int m_batchrender(void)
+{
+    int nchannels = STUFF->st_outchannels, blksize = STUFF->st_schedblocksize;
+    long nframes = (sys_renderduration >= 0 ?
+        (long)(sys_renderduration * STUFF->st_dacsr + 0.5) : LONG_MAX),
+            framesdone = 0;
+    if (nchannels < 1)
+    {
+        error("-render: no output channels (see -outchannels)");
+        return (1);
+    }
+    if (STUFF->st_dacsr <= 0 || nframes <= 0)
+    {
+        error("-render: nothing to render (sample rate %g, %ld frames)",
+            STUFF->st_dacsr, nframes);
+        return (1);
+    }
+    if (soundfile_startrender(sys_renderfile, sys_renderbytes, nchannels,
+        STUFF->st_dacsr, nframes))
+            return (1);
+    canvas_resume_dsp(1);
+    while (sys_quit != SYS_QUIT_QUIT && framesdone < nframes)
+    {
+        sched_tick();
+        soundfile_render(STUFF->st_soundout, (nframes - framesdone <
+            blksize ? nframes - framesdone : blksize));
+        memset(STUFF->st_soundout, 0, nchannels * blksize * sizeof(t_sample));
+        framesdone += blksize;
+    }
+    soundfile_endrender();
+    return (0);
+}
+
+/* "pd -bench control" times the message-passing and patch-loading paths on
+workloads it makes up itself: typed messages to a method and to the float
+method, outlet_float() to 1 and 16 inlets, binbuf_text() on a patch's worth
+of text, gensym() of new and of existing symbols, setting and unsetting many
+clocks and letting them go off, and opening and closing patches of 1000,
+10000 and 100000 objects.  Each is run several times and reported, as the
+mean and a 95% confidence interval over the runs, to the Pd window and as
+JSON on the standard output so that results can be kept and compared. */
+
+#define BENCH_NOPS 100000       /* operations per run for the fast ones */
+#define BENCH_NCLOCKS 10000
+#define BENCH_MAXRUNS 10
+
+    /* Student's t for 95% with 1, 2, ... degrees of freedom */
+static const double bench_t95[BENCH_MAXRUNS] =
+    {0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262};
+
+typedef struct _benchobj
+{
+    t_object b_obj;
+    int b_count;
+} t_benchobj;
+
+static t_class *benchobj_class;
+static int bench_nresults;
+static unsigned int bench_seed = 1;
+
+static void benchobj_float(t_benchobj *x, t_floatarg f)
+{
+    x->b_count++;
+}
+
+static void benchobj_foo(t_benchobj *x, t_symbol *s, int argc, t_atom *argv)
+{
+    x->b_count += argc;
+}
+
+static t_benchobj *benchobj_new(void)
+{
+    t_benchobj *x = (t_benchobj *)pd_new(benchobj_class);
+    x->b_count = 0;
+    outlet_new(&x->b_obj, &s_float);
+    return (x);
+}
+
+static int bench_random(int n)
+{
+    bench_seed = bench_seed * 1103515245 + 12345;
+    return ((bench_seed >> 8) % n);
+}
+
+    /* report one result, "values" being "nruns" measurements */
+static void bench_result(const char *name, const char *unit, double *values,
+    int nruns)
+{
+    double mean = 0, var = 0, interval;
+    int i;
+    for (i = 0; i < nruns; i++)
+        mean += values[i];
+    mean /= nruns;
+    for (i = 0; i < nruns; i++)
+        var += (values[i] - mean) * (values[i] - mean);
+    interval = (nruns > 1 ?
+        bench_t95[nruns - 1] * sqrt(var / (nruns - 1) / nruns) : 0);
+    post("%-28s %12.3f %10.3f  %s", name, mean, interval, unit);
+    printf("%s\n    {\"name\": \"%s\", \"unit\": \"%s\", \"mean\": %g, "
+        "\"ci95\": %g, \"runs\": %d}", (bench_nresults++ ? "," : ""),
+            name, unit, mean, interval, nruns);
+}
+
+static void bench_typedmess(void)
+{
+    t_benchobj *x = benchobj_new();
+    t_symbol *foo = gensym("foo");
+    t_atom av[3];
+    double values[BENCH_MAXRUNS], start;
+    int run, i;
+    SETFLOAT(av, 1);
+    SETFLOAT(av+1, 2);
+    SETSYMBOL(av+2, foo);
+    for (run = 0; run < BENCH_MAXRUNS; run++)
+    {
+        start = sched_tracetime();
+        for (i = 0; i < BENCH_NOPS; i++)
+            pd_typedmess(&x->b_obj.ob_pd, foo, 3, av);
+        values[run] = 1e9 * (sched_tracetime() - start) / BENCH_NOPS;
+    }
+    bench_result("typedmess-method", "ns/message", values, BENCH_MAXRUNS);
+    for (run = 0; run < BENCH_MAXRUNS; run++)
+    {
+        start = sched_tracetime();
+        for (i = 0; i < BENCH_NOPS; i++)
+            pd_typedmess(&x->b_obj.ob_pd, &s_float, 1, av);
+        values[run] = 1e9 * (sched_tracetime() - start) / BENCH_NOPS;
+    }
+    bench_result("typedmess-float", "ns/message", values, BENCH_MAXRUNS);
+    pd_free(&x->b_obj.ob_pd);
+}
+
+static void bench_outlet(int fanout)
+{
+    t_benchobj *x = benchobj_new(), *sinks[16];
+    double values[BENCH_MAXRUNS], start;
+    char name[MAXPDSTRING];
+    int run, i;
+    for (i = 0; i < fanout; i++)
+    {
+        sinks[i] = benchobj_new();
+        obj_connect(&x->b_obj, 0, &sinks[i]->b_obj, 0);
+    }
+    for (run = 0; run < BENCH_MAXRUNS; run++)
+    {
+        start = sched_tracetime();
+        for (i = 0; i < BENCH_NOPS; i++)
+            outlet_float(x->b_obj.ob_outlet, i);
+        values[run] = 1e9 * (sched_tracetime() - start) / BENCH_NOPS;
+    }
+    snprintf(name, MAXPDSTRING, "outlet_float-fanout-%d", fanout);
+    bench_result(name, "ns/message", values, BENCH_MAXRUNS);
+    for (i = 0; i < fanout; i++)
+        pd_free(&sinks[i]->b_obj.ob_pd);
+    pd_free(&x->b_obj.ob_pd);
+}
+
+    /* make the text of a patch with "nobj" objects in a chain */
+static t_binbuf *bench_patch(int nobj)
+{
+    t_binbuf *b = binbuf_new();
+    int i;
+    binbuf_addv(b, "ssiiiii;", gensym("#N"), gensym("canvas"),
+        0, 0, 450, 300, 12);
+    for (i = 0; i < nobj; i++)
+    {
+        switch (i % 4)
+        {
+        case 0: binbuf_addv(b, "ssiisf;", gensym("#X"), gensym("obj"),
+            10, i, gensym("+"), 1.); break;
+        case 1: binbuf_addv(b, "ssiiss;", gensym("#X"), gensym("obj"),
+            10, i, gensym("t"), gensym("f")); break;
+        case 2: binbuf_addv(b, "ssiisf;", gensym("#X"), gensym("obj"),
+            10, i, gensym("*"), 0.5); break;
+        default: binbuf_addv(b, "ssiis;", gensym("#X"), gensym("msg"),
+            10, i, gensym("$1")); break;
+        }
+    }
+    for (i = 0; i < nobj - 1; i++)
+        binbuf_addv(b, "ssiiii;", gensym("#X"), gensym("connect"),
+            i, 0, i + 1, 0);
+    return (b);
+}
+
+static void bench_binbuftext(void)
+{
+    t_binbuf *b = bench_patch(10000), *b2 = binbuf_new();
+    double values[BENCH_MAXRUNS], start;
+    char *text;
+    int size, run;
+    binbuf_gettext(b, &text, &size);
+    for (run = 0; run < BENCH_MAXRUNS; run++)
+    {
+        start = sched_tracetime();
+        binbuf_text(b2, text, size);
+        values[run] = 1e9 * (sched_tracetime() - start) / size;
+    }
+    bench_result("binbuf_text", "ns/byte", values, BENCH_MAXRUNS);
+    freebytes(text, size);
+    binbuf_free(b2);
+    binbuf_free(b);
+}
+
+static void bench_gensym(void)
+{
+    static int serial;      /* so that every run makes new symbols */
+    double values[BENCH_MAXRUNS], start;
+    char (*names)[24] = getbytes(BENCH_NOPS * sizeof(*names));
+    int run, i;
+    for (run = 0; run < BENCH_MAXRUNS; run++)
+    {
+        for (i = 0; i < BENCH_NOPS; i++)
+            snprintf(names[i], sizeof(names[i]), "bench-%d-%d", serial, i);
+        serial++;
+        start = sched_tracetime();
+        for (i = 0; i < BENCH_NOPS; i++)
+            gensym(names[i]);
+        values[run] = 1e9 * (sched_tracetime() - start) / BENCH_NOPS;
+    }
+    bench_result("gensym-new", "ns/symbol", values, BENCH_MAXRUNS);
+    for (run = 0; run < BENCH_MAXRUNS; run++)
+    {
+        start = sched_tracetime();
+        for (i = 0; i < BENCH_NOPS; i++)
+            gensym(names[i]);
+        values[run] = 1e9 * (sched_tracetime() - start) / BENCH_NOPS;
+    }
+    bench_result("gensym-existing", "ns/symbol", values, BENCH_MAXRUNS);
+    freebytes(names, BENCH_NOPS * sizeof(*names));
+}
+
+static void bench_clockfn(int *count)
+{
+    (*count)++;
+}
+
+static void bench_clocks(void)
+{
+    t_clock **clocks = getbytes(BENCH_NCLOCKS * sizeof(*clocks));
+    double values[BENCH_MAXRUNS], start;
+    int run, i, count;
+    for (i = 0; i < BENCH_NCLOCKS; i++)
+        clocks[i] = clock_new(&count, (t_method)bench_clockfn);
+    for (run = 0; run < BENCH_MAXRUNS; run++)
+    {
+        start = sched_tracetime();
+        for (i = 0; i < BENCH_NCLOCKS; i++)
+            clock_delay(clocks[i], 1 + bench_random(1000));
+        for (i = 0; i < BENCH_NCLOCKS; i++)
+            clock_unset(clocks[i]);
+        values[run] = 1e9 * (sched_tracetime() - start) / BENCH_NCLOCKS;
+    }
+    bench_result("clock-set-unset-10000", "ns/clock", values,
+        BENCH_MAXRUNS);
+        /* let them go off: the time includes the ticks themselves, but
+        with no DSP running they're cheap */
+    for (run = 0; run < BENCH_MAXRUNS; run++)
+    {
+        count = 0;
+        for (i = 0; i < BENCH_NCLOCKS; i++)
+            clock_delay(clocks[i], bench_random(100));
+        start = sched_tracetime();
+        while (count < BENCH_NCLOCKS && !sys_quit)
+            sched_tick();
+        values[run] = 1e9 * (sched_tracetime() - start) / BENCH_NCLOCKS;
+    }
+    bench_result("clock-fire-10000", "ns/clock", values, BENCH_MAXRUNS);
+    for (i = 0; i < BENCH_NCLOCKS; i++)
+        clock_free(clocks[i]);
+    freebytes(clocks, BENCH_NCLOCKS * sizeof(*clocks));
+}
+
+static void bench_patches(int nobj, int nruns)
+{
+    t_binbuf *b = bench_patch(nobj);
+    double openvalues[BENCH_MAXRUNS], closevalues[BENCH_MAXRUNS], start;
+    char name[MAXPDSTRING];
+    int run;
+    for (run = 0; run < nruns; run++)
+    {
+        t_pd *boundn = s__N.s_thing, *x;
+        start = sched_tracetime();
+        s__N.s_thing = &pd_canvasmaker;
+        glob_setfilename(0, gensym("bench.pd"), gensym("."));
+        binbuf_eval(b, 0, 0, 0);
+        glob_setfilename(0, &s_, &s_);
+        s__N.s_thing = boundn;
+        if (!(x = s__X.s_thing) || *x != canvas_class)
+        {
+            pd_error(0, "bench: patch didn't load");
+            break;
+        }
+        pd_vmess(x, gensym("pop"), "i", 0);
+        openvalues[run] = 1e3 * (sched_tracetime() - start);
+        start = sched_tracetime();
+        pd_free(x);
+        closevalues[run] = 1e3 * (sched_tracetime() - start);
+    }
+    if (run == nruns)
+    {
+        snprintf(name, MAXPDSTRING, "patch-open-%d", nobj);
+        bench_result(name, "ms/patch", openvalues, nruns);
+        snprintf(name, MAXPDSTRING, "patch-close-%d", nobj);
+        bench_result(name, "ms/patch", closevalues, nruns);
+    }
+    binbuf_free(b);
+}
+
+static int m_benchcontrol(void)
+{
+    sched_tick();       /* let startup (libraries, patches) happen first */
+    benchobj_class = class_new(gensym("bench-object"), 0, 0,
+        sizeof(t_benchobj), 0, 0);
+    class_addfloat(benchobj_class, benchobj_float);
+    class_addmethod(benchobj_class, (t_method)benchobj_foo, gensym("foo"),
+        A_GIMME, 0);
+    post("%-28s %12s %10s", "benchmark", "mean", "+/- (95%)");
+    printf("{\"pd\": \"%d.%d-%d\", \"suite\": \"control\", \"results\": [",
+        PD_MAJOR_VERSION, PD_MINOR_VERSION, PD_BUGFIX_VERSION);
+    bench_typedmess();
+    bench_outlet(1);
+    bench_outlet(16);
+    bench_binbuftext();
+    bench_gensym();
+    bench_clocks();
+    bench_patches(1000, BENCH_MAXRUNS);
+    bench_patches(10000, 5);
+    bench_patches(100000, 1);
+    printf("\n]}\n");
+    fflush(stdout);
+    return (0);
+}
+
 int m_batchmain(void)
 {
+    if (sys_renderfile)
+        return (m_batchrender());
+    if (sys_bench && !strcmp(sys_bench, "control"))
+        return (m_benchcontrol());
+    else if (sys_bench)
+        return (dsp_bench(sys_bench));
     while (sys_quit != SYS_QUIT_QUIT)
         sched_tick();
     return (0);
@@ -74,7 +74,7 @@ MORELDFLAGS =
 
 # libraries and system-dependent sources.
 # These  get added onto if JACK, etc., are defined below
-LIB = -ldl -lm -lpthread
+LIB = -ldl -lm -lpthread -lrt
 SYSSRC = s_midi_oss.c
 
 # conditionally add code and flags for various audio APIs
@@ -82,30 +82,26 @@ ifeq ($(ALSA), true)
 CPPFLAGS += -DUSEAPI_ALSA
 SYSSRC += s_audio_alsa.c s_audio_alsamm.c s_midi_alsa.c
 LIB += -lasound
-HAVEAUDIOAPI=true
 endif
 ifdef JACK
 CPPFLAGS += -DUSEAPI_JACK
 SYSSRC += s_audio_jack.c
 LIB += -ljack
-HAVEAUDIOAPI=true
 endif
 ifeq ($(OSS), true)
 #error foo
 CPPFLAGS += -DUSEAPI_OSS
 SYSSRC += s_audio_oss.c
-HAVEAUDIOAPI=true
 endif
 ifdef PA
 CPPFLAGS += -DUSEAPI_PORTAUDIO
 SYSSRC += s_audio_pa.c
 LIB += -lportaudio
-HAVEAUDIOAPI=true
 endif
-ifndef HAVEAUDIOAPI
+# the dummy API is always there: it's the default if there's no other, and
+# otherwise it's a clock for testing ("-dummy", "-dummyfree")
 CPPFLAGS += -DUSEAPI_DUMMY
 SYSSRC += s_audio_dummy.c
-endif
 
 CFLAGS = $(CPPFLAGS) $(CODECFLAGS) $(MORECFLAGS)
 
@@ -147,7 +143,7 @@ endif
 #  ------------------ targets ------------------------------------
 #
 
-.PHONY: pd externs all depend
+.PHONY: pd externs all depend instancetest
 
 all: pd $(BIN_DIR)/pd-watchdog $(BIN_DIR)/pdsend $(BIN_DIR)/pdreceive externs \
     makefile.dependencies
@@ -173,6 +169,18 @@ $(BIN_DIR)/pdreceive: u_pdreceive.c s_net.c
 	test -d $(BIN_DIR) || mkdir -p $(BIN_DIR)
 	$(CC) $(CFLAGS) -o $(BIN_DIR)/pdreceive u_pdreceive.c s_net.c
 
+# several Pd instances at once, each on a thread of its own; not built by
+# default.  See u_instancetest.c.
+INSTANCETEST_SRC = $(filter-out s_entry.c, $(SRC)) u_instancetest.c
+
+instancetest: $(BIN_DIR)/pd-instancetest
+	$(BIN_DIR)/pd-instancetest
+
+$(BIN_DIR)/pd-instancetest: $(INSTANCETEST_SRC)
+	test -d $(BIN_DIR) || mkdir -p $(BIN_DIR)
+	$(CC) $(CFLAGS) -DPDINSTANCE $(INCLUDE) $(LDFLAGS) $(MORELDFLAGS) \
+	    -o $(BIN_DIR)/pd-instancetest $(INSTANCETEST_SRC) $(LIB)
+
 $(PDEXEC): $(OBJ_DIR) $(OBJ)
 	test -d $(BIN_DIR) || mkdir -p $(BIN_DIR)
 	cd ../obj;  $(CC) $(LDFLAGS) $(MORELDFLAGS) -o $(PDEXEC) $(OBJ) $(LIB)
@@ -233,6 +241,7 @@ install:  all
 local-clean:
 	-rm -f ../obj/* $(BIN_DIR)/pd $(BIN_DIR)/pdsend \
 	    $(BIN_DIR)/pdreceive $(BIN_DIR)/pd-watchdog m_stamp.c \
+	    $(BIN_DIR)/pd-instancetest \
             $(BIN_DIR)/*.tcl
 	-rm -f `find ../portaudio -name "*.o"` 
 	-rm -f *~
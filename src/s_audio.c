@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <math.h>
 
 #define SYS_DEFAULTCH 2
 typedef long t_pa_sample;
@@ -155,32 +156,54 @@ static void audio_init(void)
 
     /* set channels and sample rate.  */
 
+    /* the channels are aligned like signal vectors, since adc~ lends them
+    out as signals (see adc_dsp()) */
+static t_sample *audio_allocplanes(int nbytes)
+{
+    char *mem = (char *)getbytes(nbytes + PD_SIGNALALIGN);
+    char *vec = (char *)(((size_t)mem + PD_SIGNALALIGN) &
+        ~(size_t)(PD_SIGNALALIGN - 1));
+    ((unsigned char *)vec)[-1] = (unsigned char)(vec - mem);
+    return ((t_sample *)vec);
+}
+
+static void audio_freeplanes(t_sample *vec, int nbytes)
+{
+    char *mem = (char *)vec - ((unsigned char *)vec)[-1];
+    freebytes(mem, nbytes + PD_SIGNALALIGN);
+}
+
 void sys_setchsr(int chin, int chout, int sr)
 {
-    int inbytes = (chin ? chin : 2) *
-                (DEFDACBLKSIZE*sizeof(t_sample));
-    int outbytes = (chout ? chout : 2) *
-                (DEFDACBLKSIZE*sizeof(t_sample));
+    int blksize = STUFF->st_schedblocksize;
+    int inbytes = (chin ? chin : 2) * (blksize*sizeof(t_sample));
+    int outbytes = (chout ? chout : 2) * (blksize*sizeof(t_sample));
 
     if (STUFF->st_soundin)
-        freebytes(STUFF->st_soundin,
+        audio_freeplanes(STUFF->st_soundin,
             (STUFF->st_inchannels? STUFF->st_inchannels : 2) *
-                (DEFDACBLKSIZE*sizeof(t_sample)));
+                (blksize*sizeof(t_sample)));
     if (STUFF->st_soundout)
-        freebytes(STUFF->st_soundout,
+        audio_freeplanes(STUFF->st_soundout,
             (STUFF->st_outchannels? STUFF->st_outchannels : 2) *
-                (DEFDACBLKSIZE*sizeof(t_sample)));
+                (blksize*sizeof(t_sample)));
     STUFF->st_inchannels = chin;
     STUFF->st_outchannels = chout;
     STUFF->st_dacsr = sr;
-    sys_advance_samples = (sys_schedadvance * STUFF->st_dacsr) / (1000000.);
-    if (sys_advance_samples < DEFDACBLKSIZE)
-        sys_advance_samples = DEFDACBLKSIZE;
+        /* only the main instance talks to an audio device; others may be
+        calling this at the same time from threads of their own */
+    if (pd_this == &pd_maininstance)
+    {
+        sys_advance_samples =
+            (sys_schedadvance * STUFF->st_dacsr) / (1000000.);
+        if (sys_advance_samples < blksize)
+            sys_advance_samples = blksize;
+    }
 
-    STUFF->st_soundin = (t_sample *)getbytes(inbytes);
+    STUFF->st_soundin = audio_allocplanes(inbytes);
     memset(STUFF->st_soundin, 0, inbytes);
 
-    STUFF->st_soundout = (t_sample *)getbytes(outbytes);
+    STUFF->st_soundout = audio_allocplanes(outbytes);
     memset(STUFF->st_soundout, 0, outbytes);
 
     if (sys_verbose)
@@ -189,6 +212,34 @@ void sys_setchsr(int chin, int chout, int sr)
     canvas_resume_dsp(canvas_suspend_dsp());
 }
 
+    /* set the scheduler's block size; meant to be called at startup before
+    audio is opened.  The I/O planes are reallocated if they exist. */
+void sys_setschedblocksize(int n)
+{
+    if (n < 1 || n > MAXDACBLKSIZE || n != (1 << ilog2(n)))
+    {
+        error("scheduler block size %d: must be a power of 2 up to %d",
+            n, MAXDACBLKSIZE);
+        return;
+    }
+    if (n == STUFF->st_schedblocksize)
+        return;
+    if (STUFF->st_soundin || STUFF->st_soundout)
+    {
+        int chin = STUFF->st_inchannels, chout = STUFF->st_outchannels;
+        if (STUFF->st_soundin)
+            audio_freeplanes(STUFF->st_soundin, (chin ? chin : 2) *
+                (STUFF->st_schedblocksize*sizeof(t_sample)));
+        if (STUFF->st_soundout)
+            audio_freeplanes(STUFF->st_soundout, (chout ? chout : 2) *
+                (STUFF->st_schedblocksize*sizeof(t_sample)));
+        STUFF->st_soundin = STUFF->st_soundout = 0;
+        STUFF->st_schedblocksize = n;
+        sys_setchsr(chin, chout, STUFF->st_dacsr);
+    }
+    else STUFF->st_schedblocksize = n;
+}
+
 /* ----------------------- public routines ----------------------- */
 
     /* set audio device settings (after cleaning up the specified device and
@@ -224,8 +275,9 @@ void sys_set_audio_settings(int naudioindev, int *audioindev, int nchindev,
         rate = DEFAULTSRATE;
     if (advance < 0)
         advance = DEFAULTADVANCE;
-    if (blocksize != (1 << ilog2(blocksize)) || blocksize < DEFDACBLKSIZE)
-        blocksize = DEFDACBLKSIZE;
+    if (blocksize != (1 << ilog2(blocksize)) ||
+        blocksize < STUFF->st_schedblocksize)
+            blocksize = STUFF->st_schedblocksize;
      audio_init();
         /* Since the channel vector might be longer than the
         audio device vector, or vice versa, we fill the shorter one
@@ -396,6 +448,11 @@ void sys_close_audio(void)
         audiounit_close_audio();
     else
 #endif
+#ifdef USEAPI_WASAPI
+    if (sys_audioapiopened == API_WASAPI)
+        wasapi_close_audio();
+    else
+#endif
 #ifdef USEAPI_ESD
     if (sys_audioapiopened == API_ESD)
         esd_close_audio();
@@ -434,7 +491,8 @@ void sys_reopen_audio(void)
 #ifdef USEAPI_PORTAUDIO
     if (sys_audioapi == API_PORTAUDIO)
     {
-        int blksize = (audio_blocksize ? audio_blocksize : 64);
+        int blksize = (audio_blocksize ? audio_blocksize :
+            STUFF->st_schedblocksize);
         int nbufs = sys_advance_samples / blksize;
         if (nbufs < 1) nbufs = 1;
         if (sys_verbose)
@@ -481,8 +539,32 @@ void sys_reopen_audio(void)
 #endif
 #ifdef USEAPI_AUDIOUNIT
     if (sys_audioapi == API_AUDIOUNIT)
+    {
+        int blksize = (audio_blocksize ? audio_blocksize :
+            STUFF->st_schedblocksize);
+        int nbufs = sys_advance_samples / blksize;
+        if (nbufs < 1) nbufs = 1;
         outcome = audiounit_open_audio((naudioindev > 0 ? chindev[0] : 0),
-            (naudioindev > 0 ? choutdev[0] : 0), rate);
+            (naudiooutdev > 0 ? choutdev[0] : 0), rate, blksize, nbufs,
+                (naudioindev > 0 ? audioindev[0] : 0),
+                    (naudiooutdev > 0 ? audiooutdev[0] : 0),
+                        (callback ? sched_audio_callbackfn : 0));
+    }
+    else
+#endif
+#ifdef USEAPI_WASAPI
+    if (sys_audioapi == API_WASAPI)
+    {
+        int blksize = (audio_blocksize ? audio_blocksize :
+            STUFF->st_schedblocksize);
+        int nbufs = sys_advance_samples / blksize;
+        if (nbufs < 1) nbufs = 1;
+        outcome = wasapi_open_audio((naudioindev > 0 ? chindev[0] : 0),
+            (naudiooutdev > 0 ? choutdev[0] : 0), rate, blksize, nbufs,
+                (naudioindev > 0 ? audioindev[0] : 0),
+                    (naudiooutdev > 0 ? audiooutdev[0] : 0),
+                        (callback ? sched_audio_callbackfn : 0));
+    }
     else
 #endif
 #ifdef USEAPI_ESD
@@ -493,7 +575,8 @@ void sys_reopen_audio(void)
 #endif
 #ifdef USEAPI_DUMMY
     if (sys_audioapi == API_DUMMY)
-        outcome = dummy_open_audio(naudioindev, naudiooutdev, rate);
+        outcome = dummy_open_audio(naudioindev, naudiooutdev, rate,
+            audio_blocksize);
     else
 #endif
     if (sys_audioapi == API_NONE)
@@ -522,24 +605,10 @@ int sys_send_dacs(void)
 {
     if (sys_meters)
     {
-        int i, n;
-        t_sample maxsamp;
-        for (i = 0, n = sys_inchannels * DEFDACBLKSIZE, maxsamp = sys_inmax;
-            i < n; i++)
-        {
-            t_sample f = STUFF->st_soundin[i];
-            if (f > maxsamp) maxsamp = f;
-            else if (-f > maxsamp) maxsamp = -f;
-        }
-        sys_inmax = maxsamp;
-        for (i = 0, n = STUFF->st_outchannels * DEFDACBLKSIZE,
-            maxsamp = sys_outmax; i < n; i++)
-        {
-            t_sample f = STUFF->st_soundout[i];
-            if (f > maxsamp) maxsamp = f;
-            else if (-f > maxsamp) maxsamp = -f;
-        }
-        sys_outmax = maxsamp;
+        sys_inmax = dsp_peak(STUFF->st_soundin,
+            sys_inchannels * STUFF->st_schedblocksize, sys_inmax);
+        sys_outmax = dsp_peak(STUFF->st_soundout,
+            STUFF->st_outchannels * STUFF->st_schedblocksize, sys_outmax);
     }
 
 #ifdef USEAPI_PORTAUDIO
@@ -572,6 +641,11 @@ int sys_send_dacs(void)
         return (audiounit_send_dacs());
     else
 #endif
+#ifdef USEAPI_WASAPI
+    if (sys_audioapi == API_WASAPI)
+        return (wasapi_send_dacs());
+    else
+#endif
 #ifdef USEAPI_ESD
     if (sys_audioapi == API_ESD)
         return (esd_send_dacs());
@@ -676,6 +750,18 @@ static void audio_getdevs(char *indevlist, int *nindevs,
 #ifdef USEAPI_AUDIOUNIT
     if (sys_audioapi == API_AUDIOUNIT)
     {
+        audiounit_getdevs(indevlist, nindevs, outdevlist, noutdevs, canmulti,
+            maxndev, devdescsize);
+        *cancallback = 1;
+    }
+    else
+#endif
+#ifdef USEAPI_WASAPI
+    if (sys_audioapi == API_WASAPI)
+    {
+        wasapi_getdevs(indevlist, nindevs, outdevlist, noutdevs, canmulti,
+            maxndev, devdescsize);
+        *cancallback = 1;
     }
     else
 #endif
@@ -868,8 +954,9 @@ void sys_set_audio_settings_reopen(int naudioindev, int *audioindev, int nchinde
     if (callback < 0)
         callback = 0;
     if (newblocksize != (1<<ilog2(newblocksize)) ||
-        newblocksize < DEFDACBLKSIZE || newblocksize > 2048)
-            newblocksize = DEFDACBLKSIZE;
+        newblocksize < STUFF->st_schedblocksize ||
+            newblocksize > MAXDACBLKSIZE)
+                newblocksize = STUFF->st_schedblocksize;
 
     if (!audio_callback_is_open && !callback)
         sys_close_audio();
@@ -913,6 +1000,11 @@ void sys_listdevs(void)
         sys_listaudiodevs();
     else
 #endif
+#ifdef USEAPI_WASAPI
+    if (sys_audioapi == API_WASAPI)
+        sys_listaudiodevs();
+    else
+#endif
 #ifdef USEAPI_ESD
     if (sys_audioapi == API_ESD)
         sys_listaudiodevs();
@@ -959,6 +1051,9 @@ void sys_set_audio_api(int which)
 #ifdef USEAPI_AUDIOUNIT
     ok += (which == API_AUDIOUNIT);
 #endif
+#ifdef USEAPI_WASAPI
+    ok += (which == API_WASAPI);
+#endif
 #ifdef USEAPI_ESD
     ok += (which == API_ESD);
 #endif
@@ -1009,6 +1104,10 @@ void glob_audio_setapi(void *dummy, t_floatarg f)
     /* start or stop the audio hardware */
 void sys_set_audio_state(int onoff)
 {
+        /* when rendering to a file there's no device to open, and reopening
+        would lose the output channels set up for the file */
+    if (sys_renderfile)
+        return;
     if (onoff)  /* start */
     {
         if (!audio_isopen())
@@ -1054,6 +1153,9 @@ void sys_get_audio_apis(char *buf)
 #ifdef USEAPI_AUDIOUNIT
     sprintf(buf + strlen(buf), "{AudioUnit %d} ", API_AUDIOUNIT); n++;
 #endif
+#ifdef USEAPI_WASAPI
+    sprintf(buf + strlen(buf), "{WASAPI %d} ", API_WASAPI); n++;
+#endif
 #ifdef USEAPI_ESD
     sprintf(buf + strlen(buf), "{ESD %d} ", API_ESD); n++;
 #endif
@@ -1138,3 +1240,457 @@ void sys_audiodevnumbertoname(int output, int devno, char *name, int namesize)
     else *name = 0;
     name[namesize-1] = 0;
 }
+
+/* ------------- sample format conversion for the backends --------------- */
+
+/* Backends that talk to integer devices (OSS, ALSA) convert each channel of
+st_soundout into and out of their interleaved buffers with these.  'format'
+is the sample size in bytes: 2, 3 (packed little-endian 24 bit) or 4; 'p'
+points to this channel's first sample and 'stride' is the number of channels
+interleaved there.  The scaling, clipping and rounding is done SIMD, a chunk
+at a time, into a scratch vector of int32s, and only the final narrowing
+store or load is done a sample at a time.  With "-dither" we add triangular
+(TPDF) noise of +/-1 LSB before rounding to 16 or 24 bits. */
+
+int sys_dither;     /* "-dither" flag */
+
+#define CONVCHUNK 64
+
+typedef void (*t_toint)(const t_sample *in, const float *noise,
+    int32_t *out, int n, float scale, float lo, float hi);
+typedef void (*t_fromint)(const int32_t *in, t_sample *out, int n,
+    float scale);
+
+static void toint_c(const t_sample *in, const float *noise, int32_t *out,
+    int n, float scale, float lo, float hi)
+{
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        float f = in[i] * scale + (noise ? noise[i] : 0);
+        if (!(f >= lo))     /* catch NaN too */
+            f = lo;
+        else if (f > hi)
+            f = hi;
+        out[i] = (int32_t)lrintf(f);
+    }
+}
+
+static void fromint_c(const int32_t *in, t_sample *out, int n, float scale)
+{
+    int i;
+    for (i = 0; i < n; i++)
+        out[i] = (t_sample)in[i] * scale;
+}
+
+#if PD_FLOATSIZE == 32 && (defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define CONV_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CONV_AVX
+#include <immintrin.h>
+#endif
+#endif
+
+#if PD_FLOATSIZE == 32 && defined(__aarch64__)
+#define CONV_NEON
+#include <arm_neon.h>
+#endif
+
+    /* The vector versions need 'n' to be a multiple of their width, which
+    it usually is in Pd (the scheduler block size); any rest goes to the C version.
+    max() before min() turns NaN into 'lo' like the C version does.
+    Rounding is the CPU's default, to nearest. */
+#ifdef CONV_SSE2
+static void toint_sse2(const t_sample *in, const float *noise, int32_t *out,
+    int n, float scale, float lo, float hi)
+{
+    __m128 g = _mm_set1_ps(scale), l = _mm_set1_ps(lo), h = _mm_set1_ps(hi);
+    int i, m = n & ~3;
+    for (i = 0; i < m; i += 4)
+    {
+        __m128 f = _mm_mul_ps(_mm_loadu_ps(in + i), g);
+        if (noise)
+            f = _mm_add_ps(f, _mm_loadu_ps(noise + i));
+        f = _mm_min_ps(_mm_max_ps(f, l), h);
+        _mm_storeu_si128((__m128i *)(out + i), _mm_cvtps_epi32(f));
+    }
+    if (m < n)
+        toint_c(in + m, (noise ? noise + m : 0), out + m, n - m, scale, lo, hi);
+}
+
+static void fromint_sse2(const int32_t *in, t_sample *out, int n, float scale)
+{
+    __m128 g = _mm_set1_ps(scale);
+    int i, m = n & ~3;
+    for (i = 0; i < m; i += 4)
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(
+            _mm_loadu_si128((const __m128i *)(in + i))), g));
+    if (m < n)
+        fromint_c(in + m, out + m, n - m, scale);
+}
+#endif
+
+#ifdef CONV_AVX
+static __attribute__((target("avx"))) void toint_avx(const t_sample *in,
+    const float *noise, int32_t *out, int n, float scale, float lo, float hi)
+{
+    __m256 g = _mm256_set1_ps(scale), l = _mm256_set1_ps(lo),
+        h = _mm256_set1_ps(hi);
+    int i, m = n & ~7;
+    for (i = 0; i < m; i += 8)
+    {
+        __m256 f = _mm256_mul_ps(_mm256_loadu_ps(in + i), g);
+        if (noise)
+            f = _mm256_add_ps(f, _mm256_loadu_ps(noise + i));
+        f = _mm256_min_ps(_mm256_max_ps(f, l), h);
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_cvtps_epi32(f));
+    }
+    if (m < n)
+        toint_c(in + m, (noise ? noise + m : 0), out + m, n - m, scale, lo, hi);
+}
+
+static __attribute__((target("avx"))) void fromint_avx(const int32_t *in,
+    t_sample *out, int n, float scale)
+{
+    __m256 g = _mm256_set1_ps(scale);
+    int i, m = n & ~7;
+    for (i = 0; i < m; i += 8)
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(
+            _mm256_loadu_si256((const __m256i *)(in + i))), g));
+    if (m < n)
+        fromint_c(in + m, out + m, n - m, scale);
+}
+#endif
+
+#ifdef CONV_NEON
+static void toint_neon(const t_sample *in, const float *noise, int32_t *out,
+    int n, float scale, float lo, float hi)
+{
+    float32x4_t g = vdupq_n_f32(scale), l = vdupq_n_f32(lo),
+        h = vdupq_n_f32(hi);
+    int i, m = n & ~3;
+    for (i = 0; i < m; i += 4)
+    {
+        float32x4_t f = vmulq_f32(vld1q_f32(in + i), g);
+        if (noise)
+            f = vaddq_f32(f, vld1q_f32(noise + i));
+        f = vminq_f32(vmaxq_f32(f, l), h);
+        vst1q_s32(out + i, vcvtnq_s32_f32(f));
+    }
+    if (m < n)
+        toint_c(in + m, (noise ? noise + m : 0), out + m, n - m, scale, lo, hi);
+}
+
+static void fromint_neon(const int32_t *in, t_sample *out, int n, float scale)
+{
+    float32x4_t g = vdupq_n_f32(scale);
+    int i, m = n & ~3;
+    for (i = 0; i < m; i += 4)
+        vst1q_f32(out + i, vmulq_f32(vcvtq_f32_s32(vld1q_s32(in + i)), g));
+    if (m < n)
+        fromint_c(in + m, out + m, n - m, scale);
+}
+#endif
+
+static t_toint audio_toint;
+static t_fromint audio_fromint;
+
+static void audio_convsetup(void)
+{
+    audio_toint = toint_c;
+    audio_fromint = fromint_c;
+#ifdef CONV_AVX
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx"))
+    {
+        audio_toint = toint_avx;
+        audio_fromint = fromint_avx;
+        return;
+    }
+#endif
+#ifdef CONV_SSE2
+    audio_toint = toint_sse2;
+    audio_fromint = fromint_sse2;
+#endif
+#ifdef CONV_NEON
+    audio_toint = toint_neon;
+    audio_fromint = fromint_neon;
+#endif
+}
+
+    /* triangular noise in (-1, 1) from two uniform numbers; a plain LCG is
+    plenty for dither */
+static void audio_makedither(float *noise, int n)
+{
+    static uint32_t seed = 307;
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        uint32_t r1 = (seed = seed * 1664525 + 1013904223);
+        uint32_t r2 = (seed = seed * 1664525 + 1013904223);
+        noise[i] = ((float)(r1 >> 8) - (float)(r2 >> 8)) * (1.f / 16777216.f);
+    }
+}
+
+void sys_audio_topcm(const t_sample *in, void *p, int n, int stride,
+    int format)
+{
+    int32_t ibuf[CONVCHUNK];
+    float noise[CONVCHUNK];
+    int onset, i;
+    if (!audio_toint)
+        audio_convsetup();
+    for (onset = 0; onset < n; onset += CONVCHUNK, in += CONVCHUNK)
+    {
+        int chunk = (n - onset < CONVCHUNK ? n - onset : CONVCHUNK);
+        int dither = (sys_dither && format < 4);
+        if (dither)
+            audio_makedither(noise, chunk);
+        if (format == 2)
+        {
+            int16_t *sp = (int16_t *)p + (size_t)onset * stride;
+            audio_toint(in, (dither ? noise : 0), ibuf, chunk, 32767.f,
+                -32767.f, 32767.f);
+            for (i = 0; i < chunk; i++, sp += stride)
+                *sp = (int16_t)ibuf[i];
+        }
+        else if (format == 3)
+        {
+            unsigned char *cp = (unsigned char *)p + (size_t)onset * 3 * stride;
+            audio_toint(in, (dither ? noise : 0), ibuf, chunk, 8388607.f,
+                -8388607.f, 8388607.f);
+            for (i = 0; i < chunk; i++, cp += 3 * stride)
+            {
+                cp[0] = ibuf[i] & 255;
+                cp[1] = (ibuf[i] >> 8) & 255;
+                cp[2] = (ibuf[i] >> 16) & 255;
+            }
+        }
+        else
+        {
+            int32_t *ip = (int32_t *)p + (size_t)onset * stride;
+                /* don't use all 31 bits; some drivers (e.g. Midiman/ALSA)
+                wrap around near full scale. */
+            audio_toint(in, 0, (stride == 1 ? ip : ibuf), chunk,
+                2147483648.f, -2147479552.f, 2147479552.f);
+            if (stride != 1)
+                for (i = 0; i < chunk; i++, ip += stride)
+                    *ip = ibuf[i];
+        }
+    }
+}
+
+void sys_audio_frompcm(const void *p, t_sample *out, int n, int stride,
+    int format)
+{
+    int32_t ibuf[CONVCHUNK];
+    int onset, i;
+    if (!audio_fromint)
+        audio_convsetup();
+    for (onset = 0; onset < n; onset += CONVCHUNK, out += CONVCHUNK)
+    {
+        int chunk = (n - onset < CONVCHUNK ? n - onset : CONVCHUNK);
+        if (format == 2)
+        {
+            const int16_t *sp = (const int16_t *)p + (size_t)onset * stride;
+            for (i = 0; i < chunk; i++, sp += stride)
+                ibuf[i] = *sp;
+            audio_fromint(ibuf, out, chunk, 1.f / 32767.f);
+        }
+        else if (format == 3)
+        {
+            const unsigned char *cp =
+                (const unsigned char *)p + (size_t)onset * 3 * stride;
+            for (i = 0; i < chunk; i++, cp += 3 * stride)
+                ibuf[i] = (int32_t)(((uint32_t)cp[0] << 8) |
+                    ((uint32_t)cp[1] << 16) | ((uint32_t)cp[2] << 24));
+            audio_fromint(ibuf, out, chunk, 1.f / 2147483647.f);
+        }
+        else
+        {
+            const int32_t *ip = (const int32_t *)p + (size_t)onset * stride;
+            if (stride == 1)
+                audio_fromint(ip, out, chunk, 1.f / 2147483647.f);
+            else
+            {
+                for (i = 0; i < chunk; i++, ip += stride)
+                    ibuf[i] = *ip;
+                audio_fromint(ibuf, out, chunk, 1.f / 2147483647.f);
+            }
+        }
+    }
+}
+
+/* ---------- clock drift compensation for devices that aren't synced ------- */
+
+/* With "-driftcomp" the OSS and ALSA backends let their first device set the
+pace and pass every other one through one of these: an elastic FIFO, one
+plane of t_samples per channel.  The device (or Pd, for outputs) puts frames
+in at its own rate, and the other side takes exactly n at a time, stepping
+through the FIFO by 'd_ratio' frames per frame with tabread4~'s 4-point
+interpolation.  A slow PI loop steers the ratio to hold the low-passed fill
+level at its target, so that the ratio settles on the clock mismatch itself
+(typically tens to hundreds of ppm between USB interfaces).  If the FIFO still
+runs dry or overflows, say after a stall, it's refilled to the target and the
+error logged, instead of drifting until the device xruns. */
+
+int sys_driftcomp;      /* "-driftcomp" flag */
+
+#define DRIFT_MAXRATIO 0.005    /* never resample by more than 0.5% */
+#define DRIFT_KP 1e-5           /* ratio per frame of fill error */
+#define DRIFT_SMOOTH 0.01       /* fill level low-pass, per call */
+
+struct _audiodrift
+{
+    int d_nchans;
+    int d_size;             /* frames per plane, a power of two */
+    int d_target;           /* fill level to hold, in frames */
+    t_sample *d_buf;        /* d_nchans planes of d_size frames */
+    int d_write;            /* where the next frame goes */
+    int d_read;             /* frame 'b' of the next interpolation */
+    double d_frac;          /* fractional read position past d_read */
+    double d_fill;          /* low-passed fill level */
+    double d_drift;         /* integral term: the ratio's steady part */
+    double d_ratio;         /* frames consumed per frame produced */
+    int d_priming;          /* wait for the target before reading */
+};
+
+static int audiodrift_avail(t_audiodrift *x)
+{
+    return ((x->d_write - x->d_read) & (x->d_size - 1));
+}
+
+    /* 'target' should cover the device's granularity (its fragment or
+    period size) plus a couple of blocks. */
+t_audiodrift *sys_audiodrift_new(int nchans, int target)
+{
+    t_audiodrift *x = (t_audiodrift *)getbytes(sizeof(*x));
+    int size = 64;
+    while (size < 4 * target + 16)
+        size *= 2;
+    x->d_nchans = nchans;
+    x->d_size = size;
+    x->d_target = target;
+    x->d_buf = (t_sample *)getbytes(nchans * size * sizeof(t_sample));
+    x->d_drift = 0;
+    sys_audiodrift_reset(x);
+    return (x);
+}
+
+void sys_audiodrift_free(t_audiodrift *x)
+{
+    if (sys_verbose)
+        post("drift compensation: %.1f ppm", sys_audiodrift_ppm(x));
+    freebytes(x->d_buf, x->d_nchans * x->d_size * sizeof(t_sample));
+    freebytes(x, sizeof(*x));
+}
+
+    /* empty the FIFO, keeping the drift estimate */
+void sys_audiodrift_reset(t_audiodrift *x)
+{
+    memset(x->d_buf, 0, x->d_nchans * x->d_size * sizeof(t_sample));
+        /* start one frame in so that frame 'a' is always there */
+    x->d_read = 1;
+    x->d_write = 1;
+    x->d_frac = 0;
+    x->d_fill = x->d_target;
+    x->d_ratio = 1 + x->d_drift;
+    x->d_priming = 1;
+}
+
+    /* the estimated clock mismatch: how much faster the producer runs */
+double sys_audiodrift_ppm(t_audiodrift *x)
+{
+    return (1e6 * x->d_drift);
+}
+
+    /* add n frames; channel 'i' starts at in + i * instride */
+void sys_audiodrift_put(t_audiodrift *x, const t_sample *in, int n,
+    int instride)
+{
+    int mask = x->d_size - 1, i, j;
+    if (audiodrift_avail(x) + n > x->d_size - 4)
+    {
+        sys_log_error(ERR_RESYNC);
+        sys_audiodrift_reset(x);
+        if (n > x->d_size - 4)
+            return;
+    }
+    for (i = 0; i < x->d_nchans; i++)
+    {
+        t_sample *plane = x->d_buf + i * x->d_size;
+        const t_sample *fp = in + i * instride;
+        for (j = 0; j < n; j++)
+            plane[(x->d_write + j) & mask] = fp[j];
+    }
+    x->d_write = (x->d_write + n) & mask;
+}
+
+    /* take exactly n frames, resampled; channel 'i' goes to out + i *
+    outstride.  Outputs zeros while priming. */
+void sys_audiodrift_get(t_audiodrift *x, t_sample *out, int n, int outstride)
+{
+    int mask = x->d_size - 1, i, j, avail = audiodrift_avail(x),
+        read = x->d_read;
+    double err, frac = x->d_frac, ratio;
+
+    if (x->d_priming)
+    {
+        if (avail < x->d_target)
+            goto zero;
+        x->d_priming = 0;
+    }
+        /* steer: PI on the smoothed fill error, with the integral gain
+        set for critical damping at this call size */
+    x->d_fill += DRIFT_SMOOTH * (avail - x->d_frac - x->d_fill);
+    err = x->d_fill - x->d_target;
+    x->d_drift += 0.25 * n * DRIFT_KP * DRIFT_KP * err;
+    if (x->d_drift > DRIFT_MAXRATIO)
+        x->d_drift = DRIFT_MAXRATIO;
+    else if (x->d_drift < -DRIFT_MAXRATIO)
+        x->d_drift = -DRIFT_MAXRATIO;
+    ratio = 1 + x->d_drift + DRIFT_KP * err;
+    if (ratio > 1 + 2 * DRIFT_MAXRATIO)
+        ratio = 1 + 2 * DRIFT_MAXRATIO;
+    else if (ratio < 1 - 2 * DRIFT_MAXRATIO)
+        ratio = 1 - 2 * DRIFT_MAXRATIO;
+    x->d_ratio = ratio;
+
+        /* need frames 'b' through 'd' for the last output */
+    if (x->d_frac + n * ratio + 3 > avail)
+    {
+        sys_log_error(ERR_RESYNC);
+        sys_audiodrift_reset(x);
+        goto zero;
+    }
+    for (i = 0; i < x->d_nchans; i++)
+    {
+        t_sample *plane = x->d_buf + i * x->d_size, *fp = out + i * outstride;
+        read = x->d_read;
+        frac = x->d_frac;
+        for (j = 0; j < n; j++)
+        {
+            t_sample a = plane[(read - 1) & mask], b = plane[read],
+                c = plane[(read + 1) & mask], d = plane[(read + 2) & mask],
+                cminusb = c - b, f = frac;
+            int step;
+            fp[j] = b + f * (
+                cminusb - 0.1666667f * (1.-f) * (
+                    (d - a - 3.0f * cminusb) * f + (d + 2.0f*a - 3.0f*b)
+                )
+            );
+            frac += ratio;
+            step = (int)frac;
+            frac -= step;
+            read = (read + step) & mask;
+        }
+    }
+    x->d_read = read;
+    x->d_frac = frac;
+    return;
+zero:
+    for (i = 0; i < x->d_nchans; i++)
+        memset(out + i * outstride, 0, n * sizeof(t_sample));
+}
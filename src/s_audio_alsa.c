@@ -41,11 +41,6 @@ static void alsa_numbertoname(int iodev, char *devname, int nchar);
 static int alsa_jittermax;
 #define ALSA_DEFJITTERMAX 5
 
-    /* don't assume we can turn all 31 bits when doing float-to-fix;
-    otherwise some audio drivers (e.g. Midiman/ALSA) wrap around. */
-#define FMAX 0x7ffff000
-#define CLIP32(x) (((x)>FMAX)?FMAX:((x) < -FMAX)?-FMAX:(x))
-
 static char *alsa_snd_buf;
 static int alsa_snd_bufsize;
 static int alsa_buf_samps;
@@ -203,7 +198,7 @@ static int alsaio_setup(t_alsa_dev *dev, int out, int *channels, int *rate,
     check_error(err, out, "snd_pcm_hw_params");
 
         /* set up the buffer */
-    bufsizeforthis = DEFDACBLKSIZE * dev->a_sampwidth * *channels;
+    bufsizeforthis = ALSA_BLKSIZE * dev->a_sampwidth * *channels;
     if (alsa_snd_buf)
     {
         if (alsa_snd_bufsize < bufsizeforthis)
@@ -381,12 +376,12 @@ int alsa_open_audio(int naudioindev, int *audioindev, int nchindev,
 
     if (outchans)
     {
-        i = (frag_size * nfrags)/DEFDACBLKSIZE + 1;
+        i = (frag_size * nfrags)/ALSA_BLKSIZE + 1;
         while (i--)
         {
             for (iodev = 0; iodev < alsa_noutdev; iodev++)
                 snd_pcm_writei(alsa_outdev[iodev].a_handle, alsa_snd_buf,
-                    DEFDACBLKSIZE);
+                    ALSA_BLKSIZE);
         }
     }
     if (inchans)
@@ -432,7 +427,7 @@ int alsa_send_dacs(void)
 {
     static double timenow;
     double timelast;
-    t_sample *fp, *fp1, *fp2;
+    t_sample *fp, *fp1;
     int i, j, k, err, iodev, result, ch, goterror = 0;
     int chansintogo, chansouttogo;
     unsigned int transfersize;
@@ -445,7 +440,7 @@ int alsa_send_dacs(void)
 
     chansintogo = STUFF->st_inchannels;
     chansouttogo = STUFF->st_outchannels;
-    transfersize = DEFDACBLKSIZE;
+    transfersize = ALSA_BLKSIZE;
 
     timelast = timenow;
     timenow = sys_getrealtime();
@@ -483,6 +478,8 @@ int alsa_send_dacs(void)
                 fprintf(stderr, "alsa xrun recovery apparently failed\n");
         }
         snd_pcm_status(alsa_outdev[iodev].a_handle, alsa_status);
+        if (!iodev)
+            sys_tracefill(snd_pcm_status_get_delay(alsa_status));
         if (snd_pcm_status_get_avail(alsa_status) < transfersize)
             return (SENDDACS_NO);
     }
@@ -496,63 +493,15 @@ int alsa_send_dacs(void)
     {
         int thisdevchans = alsa_outdev[iodev].a_channels;
         int chans = (chansouttogo < thisdevchans ? chansouttogo : thisdevchans);
+        int width = alsa_outdev[iodev].a_sampwidth;
         chansouttogo -= chans;
 
-        if (alsa_outdev[iodev].a_sampwidth == 4)
-        {
-            for (i = 0; i < chans; i++, ch++, fp1 += DEFDACBLKSIZE)
-                for (j = i, k = DEFDACBLKSIZE, fp2 = fp1; k--;
-                     j += thisdevchans, fp2++)
-            {
-                t_sample s1 = *fp2 * INT32_MAX;
-                ((t_alsa_sample32 *)alsa_snd_buf)[j] = CLIP32(s1);
-            }
-            for (; i < thisdevchans; i++, ch++)
-                for (j = i, k = DEFDACBLKSIZE; k--; j += thisdevchans)
-                    ((t_alsa_sample32 *)alsa_snd_buf)[j] = 0;
-        }
-        else if (alsa_outdev[iodev].a_sampwidth == 3)
-        {
-            for (i = 0; i < chans; i++, ch++, fp1 += DEFDACBLKSIZE)
-                for (j = i, k = DEFDACBLKSIZE, fp2 = fp1; k--;
-                     j += thisdevchans, fp2++)
-            {
-                int s = *fp2 * 8388352.;
-                if (s > 8388351)
-                    s = 8388351;
-                else if (s < -8388351)
-                    s = -8388351;
-#if BYTE_ORDER == LITTLE_ENDIAN
-                ((char *)(alsa_snd_buf))[3*j] = (s & 255);
-                ((char *)(alsa_snd_buf))[3*j+1] = ((s>>8) & 255);
-                ((char *)(alsa_snd_buf))[3*j+2] = ((s>>16) & 255);
-#else
-                fprintf(stderr, "big endian 24-bit not supported");
-#endif
-            }
-            for (; i < thisdevchans; i++, ch++)
-                for (j = i, k = DEFDACBLKSIZE; k--; j += thisdevchans)
-                    ((char *)(alsa_snd_buf))[3*j] =
-                    ((char *)(alsa_snd_buf))[3*j+1] =
-                    ((char *)(alsa_snd_buf))[3*j+2] = 0;
-        }
-        else        /* 16 bit samples */
-        {
-            for (i = 0; i < chans; i++, ch++, fp1 += DEFDACBLKSIZE)
-                for (j = ch, k = DEFDACBLKSIZE, fp2 = fp1; k--;
-                     j += thisdevchans, fp2++)
-            {
-                int s = *fp2 * 32767.;
-                if (s > 32767)
-                    s = 32767;
-                else if (s < -32767)
-                    s = -32767;
-                ((t_alsa_sample16 *)alsa_snd_buf)[j] = s;
-            }
-            for (; i < thisdevchans; i++, ch++)
-                for (j = ch, k = DEFDACBLKSIZE; k--; j += thisdevchans)
-                    ((t_alsa_sample16 *)alsa_snd_buf)[j] = 0;
-        }
+        for (i = 0; i < chans; i++, ch++, fp1 += ALSA_BLKSIZE)
+            sys_audio_topcm(fp1, (char *)alsa_snd_buf + i * width,
+                ALSA_BLKSIZE, thisdevchans, width);
+        for (; i < thisdevchans; i++, ch++)
+            for (j = i, k = ALSA_BLKSIZE; k--; j += thisdevchans)
+                memset((char *)alsa_snd_buf + j * width, 0, width);
         result = snd_pcm_writei(alsa_outdev[iodev].a_handle, alsa_snd_buf,
             transfersize);
 
@@ -580,9 +529,6 @@ int alsa_send_dacs(void)
             }
         }
 
-        /* zero out the output buffer */
-        memset(STUFF->st_soundout, 0, DEFDACBLKSIZE * sizeof(*STUFF->st_soundout) *
-               STUFF->st_outchannels);
         if (sys_getrealtime() - timenow > 0.002)
         {
     #ifdef DEBUG_ALSA_XFER
@@ -593,6 +539,9 @@ int alsa_send_dacs(void)
             sys_log_error(ERR_DACSLEPT);
         }
     }
+        /* zero out the output buffer, once every device has had it */
+    memset(STUFF->st_soundout, 0, ALSA_BLKSIZE * sizeof(*STUFF->st_soundout) *
+           STUFF->st_outchannels);
 
             /* do input */
     for (iodev = 0, fp1 = STUFF->st_soundin, ch = 0; iodev < alsa_nindev; iodev++)
@@ -625,43 +574,10 @@ int alsa_send_dacs(void)
                 goterror = 1;
             }
         }
-        if (alsa_indev[iodev].a_sampwidth == 4)
-        {
-            for (i = 0; i < chans; i++, ch++, fp1 += DEFDACBLKSIZE)
-            {
-                for (j = ch, k = DEFDACBLKSIZE, fp2 = fp1; k--;
-                     j += thisdevchans, fp2++)
-                    *fp2 = (t_sample) ((t_alsa_sample32 *)alsa_snd_buf)[j]
-                        * (1./ INT32_MAX);
-            }
-        }
-        else if (alsa_indev[iodev].a_sampwidth == 3)
-        {
-#if BYTE_ORDER == LITTLE_ENDIAN
-            for (i = 0; i < chans; i++, ch++, fp1 += DEFDACBLKSIZE)
-            {
-                for (j = ch, k = DEFDACBLKSIZE, fp2 = fp1; k--;
-                     j += thisdevchans, fp2++)
-                    *fp2 = ((t_sample) (
-                        (((unsigned char *)alsa_snd_buf)[3*j] << 8)
-                        | (((unsigned char *)alsa_snd_buf)[3*j+1] << 16)
-                        | (((unsigned char *)alsa_snd_buf)[3*j+2] << 24)))
-                        * (1./ INT32_MAX);
-            }
-#else
-                fprintf(stderr, "big endian 24-bit not supported");
-#endif
-        }
-        else
-        {
-            for (i = 0; i < chans; i++, ch++, fp1 += DEFDACBLKSIZE)
-            {
-                for (j = ch, k = DEFDACBLKSIZE, fp2 = fp1; k--;
-                    j += thisdevchans, fp2++)
-                        *fp2 = (t_sample) ((t_alsa_sample16 *)alsa_snd_buf)[j]
-                            * 3.051850e-05;
-            }
-        }
+        for (i = 0; i < chans; i++, ch++, fp1 += ALSA_BLKSIZE)
+            sys_audio_frompcm((char *)alsa_snd_buf +
+                i * alsa_indev[iodev].a_sampwidth, fp1, ALSA_BLKSIZE,
+                    thisdevchans, alsa_indev[iodev].a_sampwidth);
     }
 #ifdef DEBUG_ALSA_XFER
     xferno++;
@@ -727,14 +643,14 @@ void alsa_putzeros(int iodev, int n)
 {
     int i, result;
     memset(alsa_snd_buf, 0,
-        alsa_outdev[iodev].a_sampwidth * DEFDACBLKSIZE *
+        alsa_outdev[iodev].a_sampwidth * ALSA_BLKSIZE *
             alsa_outdev[iodev].a_channels);
     for (i = 0; i < n; i++)
     {
         result = snd_pcm_writei(alsa_outdev[iodev].a_handle, alsa_snd_buf,
-            DEFDACBLKSIZE);
+            ALSA_BLKSIZE);
 #if 0
-        if (result != DEFDACBLKSIZE)
+        if (result != ALSA_BLKSIZE)
             post("result %d", result);
 #endif
     }
@@ -747,9 +663,9 @@ void alsa_getzeros(int iodev, int n)
     for (i = 0; i < n; i++)
     {
         result = snd_pcm_readi(alsa_indev[iodev].a_handle, alsa_snd_buf,
-            DEFDACBLKSIZE);
+            ALSA_BLKSIZE);
 #if 0
-        if (result != DEFDACBLKSIZE)
+        if (result != ALSA_BLKSIZE)
             post("result %d", result);
 #endif
     }
@@ -841,10 +757,10 @@ static void alsa_checkiosync(void)
                 maxphase = thisphase;
         }
             /* the "correct" position is for all the phases to be exactly
-            equal; but since we only make corrections DEFDACBLKSIZE samples
+            equal; but since we only make corrections a block
             at a time, we just ask that the spread be not more than 3/4
             of a block.  */
-        if (maxphase <= minphase + (alsa_jittermax * (DEFDACBLKSIZE / 4)))
+        if (maxphase <= minphase + (alsa_jittermax * (ALSA_BLKSIZE / 4)))
                 break;
 
 #ifdef DEBUG_ALSA_XFER
@@ -857,7 +773,7 @@ static void alsa_checkiosync(void)
             if (result < 0)
                 outdelay = result;
             thisphase = alsa_buf_samps - outdelay;
-            if (thisphase > minphase + DEFDACBLKSIZE)
+            if (thisphase > minphase + ALSA_BLKSIZE)
             {
                 alsa_putzeros(iodev, 1);
                 if (!alreadylogged)
@@ -873,7 +789,7 @@ static void alsa_checkiosync(void)
             result = snd_pcm_delay(alsa_indev[iodev].a_handle, &thisphase);
             if (result < 0)
                 thisphase = 0;
-            if (thisphase > minphase + DEFDACBLKSIZE)
+            if (thisphase > minphase + ALSA_BLKSIZE)
             {
                 alsa_getzeros(iodev, 1);
                 if (!alreadylogged)
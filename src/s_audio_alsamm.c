@@ -200,6 +200,7 @@ int alsamm_open_audio(int rate, int blocksize)
   short* tmp_buf;
   unsigned int tmp_uint;
 
+  alsamm_transfersize = ALSA_BLKSIZE;
   snd_pcm_hw_params_alloca(&hw_params);
   snd_pcm_sw_params_alloca(&sw_params);
 
@@ -1029,7 +1030,7 @@ static int alsamm_stop()
 /* I see: (a guess as a documentation)
 
    all DAC data is in sys_soundout array with
-   DEFDACBLKSIZE (mostly 64) for each channels which
+   ALSA_BLKSIZE (mostly 64) for each channels which
    if we have more channels opened then dac-channels = sys_outchannels
    we have to zero (silence them), which should be done once.
 
@@ -1153,6 +1154,8 @@ int alsamm_send_dacs(void)
       out_avail[dac_send] = oavail;
     }
 #endif
+    if(devno == 0)
+      sys_tracefill(alsamm_buffer_size - oavail);
 
     /* we only transfer transfersize of bytes request,
        this should only happen on first card otherwise we got a problem :-(()*/
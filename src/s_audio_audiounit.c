@@ -1,43 +1,828 @@
+/* Copyright (c) 1997-2010 Miller Puckette and others.
+* For information on usage and redistribution, and for a DISCLAIMER OF ALL
+* WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
 
 /* ------------- routines for Apple AudioUnit in AudioToolbox -------------- */
-#ifdef USEAPI_AUDIOUNIT
 
-/* this is currently a placeholder file while we decide which one of three implementations of this API we use */
+/* This talks to the hardware through the HAL output unit ("AUHAL").  Its
+render callback gets the device's buffers non-interleaved, which is how Pd
+keeps its own, so there's no interleaving step.  With "-callback", DSP runs
+right in the render callback, as with JACK: when the device's buffer size is
+a whole number of Pd blocks we go straight from the device's buffers to a
+tick and back; otherwise we trade samples with the last block computed,
+adding one block of delay.  Input from the same device is rendered into
+buffers the unit provides itself, so it's copied once, into Pd's input
+array.  Without "-callback" the scheduler thread exchanges samples with the
+render callback through lock-free rings, as for portaudio.
+
+If input comes from a different device than output (the built-in microphone
+and speakers are two devices, for instance) we need a second unit, whose
+callback feeds a ring that the output unit's callback drains.  The two
+devices' clocks aren't synchronized so this drops or repeats samples now and
+then; make an aggregate device in Audio MIDI Setup if that matters.
+
+Since macOS 11 the HAL puts each device's I/O thread in an "audio
+workgroup" so that the scheduler can plan for its deadlines.  The render
+callback is already a member; in polling mode, where Pd's own thread does
+the DSP, we join that thread to the output device's workgroup as well. */
+
+#ifdef USEAPI_AUDIOUNIT
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "m_pd.h"
 #include "s_stuff.h"
+#include "s_audio_paring.h"
 #include <AudioToolbox/AudioToolbox.h>
+#include <CoreAudio/CoreAudio.h>
+#include <Availability.h>
+#if defined(__MAC_11_0)
+#include <os/workgroup.h>
+#define AU_WORKGROUP
+#endif
+
+#define AU_BLKSIZE (STUFF->st_schedblocksize)
+#define AU_MAXCHANS 128
+#define AU_MAXFRAMES 4096   /* largest device buffer we'll accept */
+#define AU_MAXDEV 64
+#define AU_POLLTIMEOUT 1.   /* seconds to wait for the device in send_dacs */
+#define AU_ELEMENT 0        /* kAudioObjectPropertyElementMain */
+
+static AudioUnit au_outunit;    /* output, and input from the same device */
+static AudioUnit au_inunit;     /* input from any other device */
+static int au_inviaring;        /* we have both, so input goes through ring */
+static AudioBufferList *au_inlist;  /* input rendered by a unit */
+static int au_inchans, au_outchans;
+static t_audiocallback au_callback;
+static volatile int au_dio_error;
+static int au_threadset;
+
+    /* rings: in polling mode au_outring carries output from Pd to the
+    render callback and au_inring carries input back; with a separate input
+    device au_inring carries that device's input to whoever consumes it.
+    Both hold interleaved frames. */
+static sys_ringbuf au_inring, au_outring;
+static char *au_inbuf, *au_outbuf;
+static float *au_scratch;       /* render callback's interleaving buffer */
+
+    /* callback mode: how far we are into the block last computed */
+static int au_blockpos;
+static int au_buffered;
+
+#ifdef AU_WORKGROUP
+static os_workgroup_t au_workgroup;
+static struct os_workgroup_join_token_opaque_s au_jointoken;
+static int au_joined;
+#endif
+
+/* --------------------- devices ------------------------- */
+
+static int au_getprop(AudioObjectID obj, AudioObjectPropertySelector sel,
+    AudioObjectPropertyScope scope, UInt32 size, void *data)
+{
+    AudioObjectPropertyAddress addr = {sel, scope, AU_ELEMENT};
+    return (AudioObjectGetPropertyData(obj, &addr, 0, 0, &size, data) !=
+        noErr);
+}
+
+static int au_setprop(AudioObjectID obj, AudioObjectPropertySelector sel,
+    AudioObjectPropertyScope scope, UInt32 size, const void *data)
+{
+    AudioObjectPropertyAddress addr = {sel, scope, AU_ELEMENT};
+    return (AudioObjectSetPropertyData(obj, &addr, 0, 0, size, data) !=
+        noErr);
+}
+
+    /* number of channels a device has in the given direction */
+static int au_devchannels(AudioDeviceID dev, int input)
+{
+    AudioObjectPropertyAddress addr = {kAudioDevicePropertyStreamConfiguration,
+        (input ? kAudioObjectPropertyScopeInput :
+            kAudioObjectPropertyScopeOutput), AU_ELEMENT};
+    UInt32 size = 0, i;
+    AudioBufferList *list;
+    int nchans = 0;
+    if (AudioObjectGetPropertyDataSize(dev, &addr, 0, 0, &size) != noErr ||
+        !size)
+            return (0);
+    list = (AudioBufferList *)getbytes(size);
+    if (AudioObjectGetPropertyData(dev, &addr, 0, 0, &size, list) == noErr)
+        for (i = 0; i < list->mNumberBuffers; i++)
+            nchans += list->mBuffers[i].mNumberChannels;
+    freebytes(list, size);
+    return (nchans);
+}
+
+static void au_devname(AudioDeviceID dev, char *buf, int bufsize)
+{
+    CFStringRef name = 0;
+    *buf = 0;
+    if (!au_getprop(dev, kAudioObjectPropertyName,
+        kAudioObjectPropertyScopeGlobal, sizeof(name), &name) && name)
+    {
+        CFStringGetCString(name, buf, bufsize, kCFStringEncodingUTF8);
+        CFRelease(name);
+    }
+    if (!*buf)
+        snprintf(buf, bufsize, "device %u", (unsigned)dev);
+}
+
+    /* list the devices that can do input (or output) with the system's
+    default first, so that Pd's default device number 0 picks it. */
+static int au_listdevices(AudioDeviceID *devs, int maxdev, int input)
+{
+    AudioObjectPropertyAddress addr = {kAudioHardwarePropertyDevices,
+        kAudioObjectPropertyScopeGlobal, AU_ELEMENT};
+    AudioDeviceID all[AU_MAXDEV], def = kAudioObjectUnknown;
+    UInt32 size = sizeof(all);
+    int nall, i, n = 0;
+    if (AudioObjectGetPropertyData(kAudioObjectSystemObject, &addr, 0, 0,
+        &size, all) != noErr)
+            return (0);
+    nall = size / sizeof(AudioDeviceID);
+    if (!au_getprop(kAudioObjectSystemObject, (input ?
+        kAudioHardwarePropertyDefaultInputDevice :
+            kAudioHardwarePropertyDefaultOutputDevice),
+                kAudioObjectPropertyScopeGlobal, sizeof(def), &def) &&
+                    def != kAudioObjectUnknown && n < maxdev)
+                        devs[n++] = def;
+    for (i = 0; i < nall && n < maxdev; i++)
+        if (all[i] != def && au_devchannels(all[i], input) > 0)
+            devs[n++] = all[i];
+    return (n);
+}
+
+static AudioDeviceID au_finddevice(int devno, int input)
+{
+    AudioDeviceID devs[AU_MAXDEV];
+    int ndev = au_listdevices(devs, AU_MAXDEV, input);
+    if (devno < 0 || devno >= ndev)
+        return (kAudioObjectUnknown);
+    return (devs[devno]);
+}
+
+/* --------------------- the audio callbacks --------------------- */
+
+    /* Pd's input and output arrays hold one block per channel; "in" and
+    "out" point to each channel's first sample at the device, "stride"
+    apart. */
+static void au_copyin(float **in, int stride, unsigned int onset, int pos,
+    int n)
+{
+    int chan, j;
+    for (chan = 0; chan < au_inchans; chan++)
+    {
+        t_sample *fp = STUFF->st_soundin + chan*AU_BLKSIZE + pos;
+        float *sp;
+        if (!in[chan])
+            memset(fp, 0, n * sizeof(t_sample));
+        else for (j = 0, sp = in[chan] + onset * stride; j < n;
+            j++, sp += stride)
+                *fp++ = *sp;
+    }
+}
+
+static void au_copyout(float **out, unsigned int onset, int pos, int n)
+{
+    int chan, j;
+    for (chan = 0; chan < au_outchans; chan++)
+        if (out[chan])
+    {
+        t_sample *fp = STUFF->st_soundout + chan*AU_BLKSIZE + pos;
+        float *sp = out[chan] + onset;
+        if (sizeof(t_sample) == sizeof(float))
+            memcpy(sp, fp, n * sizeof(float));
+        else for (j = 0; j < n; j++)
+            *sp++ = *fp++;
+    }
+}
+
+static void au_tick(void)
+{
+    memset(STUFF->st_soundout, 0,
+        au_outchans * AU_BLKSIZE * sizeof(t_sample));
+    (*au_callback)();
+}
+
+    /* get this period's input, pointing in[] at it.  Returns the stride
+    between samples of a channel. */
+static int au_getinput(AudioUnitRenderActionFlags *flags,
+    const AudioTimeStamp *ts, UInt32 nframes, float **in)
+{
+    int chan;
+    if (!au_inchans)
+        return (1);
+    if (!au_inviaring)
+    {
+            /* let the unit hand us its own buffers */
+        for (chan = 0; chan < au_inchans; chan++)
+        {
+            au_inlist->mBuffers[chan].mData = 0;
+            au_inlist->mBuffers[chan].mDataByteSize = nframes * sizeof(float);
+        }
+        if (AudioUnitRender((au_inunit ? au_inunit : au_outunit), flags, ts,
+            1, nframes, au_inlist) != noErr)
+        {
+            au_dio_error = 1;
+            for (chan = 0; chan < au_inchans; chan++)
+                in[chan] = 0;
+            return (1);
+        }
+        for (chan = 0; chan < au_inchans; chan++)
+            in[chan] = (float *)au_inlist->mBuffers[chan].mData;
+        return (1);
+    }
+        /* from the other device's ring; if it's behind, repeat silence */
+    if (sys_ringbuf_getreadavailable(&au_inring) <
+        (long)(nframes * au_inchans * sizeof(float)))
+    {
+        au_dio_error = 1;
+        memset(au_scratch, 0, nframes * au_inchans * sizeof(float));
+    }
+    else sys_ringbuf_read(&au_inring, au_scratch,
+        nframes * au_inchans * sizeof(float), au_inbuf);
+    for (chan = 0; chan < au_inchans; chan++)
+        in[chan] = au_scratch + chan;
+    return (au_inchans);
+}
+
+static OSStatus au_callbackrender(void *refcon,
+    AudioUnitRenderActionFlags *flags, const AudioTimeStamp *ts,
+    UInt32 bus, UInt32 nframes, AudioBufferList *data)
+{
+    float *in[AU_MAXCHANS], *out[AU_MAXCHANS];
+    int chan, stride;
+    unsigned int n, len;
+    if (nframes > AU_MAXFRAMES)
+        return (kAudioUnitErr_TooManyFramesToProcess);
+    for (chan = 0; chan < au_outchans; chan++)
+        out[chan] = (data && chan < (int)data->mNumberBuffers ?
+            (float *)data->mBuffers[chan].mData : 0);
+        /* the device may have more channels than we asked for */
+    for (; data && chan < (int)data->mNumberBuffers; chan++)
+        memset(data->mBuffers[chan].mData, 0,
+            data->mBuffers[chan].mDataByteSize);
+    stride = au_getinput(flags, ts, nframes, in);
+    if (!au_blockpos && !(nframes % AU_BLKSIZE))
+    {
+        au_buffered = 0;
+        for (n = 0; n < nframes; n += AU_BLKSIZE)
+        {
+            au_copyin(in, stride, n, 0, AU_BLKSIZE);
+            au_tick();
+            au_copyout(out, n, 0, AU_BLKSIZE);
+        }
+        return (noErr);
+    }
+    if (!au_buffered)
+    {
+            /* the last block has already gone out */
+        memset(STUFF->st_soundout, 0,
+            au_outchans * AU_BLKSIZE * sizeof(t_sample));
+        au_buffered = 1;
+    }
+    for (n = 0; n < nframes; n += len)
+    {
+        len = AU_BLKSIZE - au_blockpos;
+        if (len > nframes - n)
+            len = nframes - n;
+        au_copyin(in, stride, n, au_blockpos, len);
+        au_copyout(out, n, au_blockpos, len);
+        if ((au_blockpos += len) == AU_BLKSIZE)
+        {
+            au_tick();
+            au_blockpos = 0;
+        }
+    }
+    return (noErr);
+}
+
+    /* polling mode: trade samples with the scheduler through the rings */
+static OSStatus au_pollrender(void *refcon,
+    AudioUnitRenderActionFlags *flags, const AudioTimeStamp *ts,
+    UInt32 nframes, AudioBufferList *data)
+{
+    int chan, j;
+    long nout = nframes * au_outchans * sizeof(float),
+        nin = nframes * au_inchans * sizeof(float);
+    if (nframes > AU_MAXFRAMES)
+        return (kAudioUnitErr_TooManyFramesToProcess);
+    if (au_outchans && sys_ringbuf_getreadavailable(&au_outring) < nout)
+    {
+            /* Pd didn't keep up; output zeros and drop the input */
+        au_dio_error = 1;
+        for (chan = 0; chan < (int)data->mNumberBuffers; chan++)
+            memset(data->mBuffers[chan].mData, 0,
+                data->mBuffers[chan].mDataByteSize);
+        if (au_inchans && !au_inviaring)
+        {
+            float *in[AU_MAXCHANS];
+            au_getinput(flags, ts, nframes, in);
+        }
+        return (noErr);
+    }
+    if (au_outchans)
+    {
+        sys_ringbuf_read(&au_outring, au_scratch, nout, au_outbuf);
+        for (chan = 0; chan < (int)data->mNumberBuffers; chan++)
+        {
+            float *sp = au_scratch + chan, *fp =
+                (float *)data->mBuffers[chan].mData;
+            if (chan >= au_outchans)
+                memset(fp, 0, data->mBuffers[chan].mDataByteSize);
+            else for (j = 0; j < (int)nframes; j++, sp += au_outchans)
+                *fp++ = *sp;
+        }
+    }
+    if (au_inchans && !au_inviaring)
+    {
+        float *in[AU_MAXCHANS];
+        au_getinput(flags, ts, nframes, in);
+        for (chan = 0; chan < au_inchans; chan++)
+        {
+            float *sp = in[chan], *fp = au_scratch + chan;
+            for (j = 0; j < (int)nframes; j++, fp += au_inchans)
+                *fp = (sp ? *sp++ : 0);
+        }
+        if (sys_ringbuf_getwriteavailable(&au_inring) >= nin)
+            sys_ringbuf_write(&au_inring, au_scratch, nin, au_inbuf);
+        else au_dio_error = 1;
+    }
+    return (noErr);
+}
+
+static OSStatus au_render(void *refcon,
+    AudioUnitRenderActionFlags *flags, const AudioTimeStamp *ts,
+    UInt32 bus, UInt32 nframes, AudioBufferList *data)
+{
+    if (!au_threadset)
+        sys_setthreadrole(SYS_THREAD_AUDIO), au_threadset = 1;
+    if (au_callback)
+        return (au_callbackrender(refcon, flags, ts, bus, nframes, data));
+    else return (au_pollrender(refcon, flags, ts, nframes, data));
+}
+
+    /* callback from the input unit: push its input into au_inring, unless
+    there's no output at all and this is where we compute DSP */
+static float au_interleaved[AU_MAXFRAMES * 2];
+
+static OSStatus au_inputproc(void *refcon,
+    AudioUnitRenderActionFlags *flags, const AudioTimeStamp *ts,
+    UInt32 bus, UInt32 nframes, AudioBufferList *data)
+{
+    long nin = nframes * au_inchans * sizeof(float);
+    float *fp;
+    int chan, j;
+    if (nframes > AU_MAXFRAMES)
+        return (kAudioUnitErr_TooManyFramesToProcess);
+    if (!au_threadset)
+        sys_setthreadrole(SYS_THREAD_AUDIO), au_threadset = 1;
+    if (!au_outunit && au_callback)
+        return (au_callbackrender(refcon, flags, ts, bus, nframes, 0));
+    for (chan = 0; chan < au_inchans; chan++)
+    {
+        au_inlist->mBuffers[chan].mData = 0;
+        au_inlist->mBuffers[chan].mDataByteSize = nframes * sizeof(float);
+    }
+    if (AudioUnitRender(au_inunit, flags, ts, 1, nframes, au_inlist) != noErr)
+    {
+        au_dio_error = 1;
+        return (noErr);
+    }
+    if (sys_ringbuf_getwriteavailable(&au_inring) < nin)
+    {
+        au_dio_error = 1;   /* the output side fell behind; drop this */
+        return (noErr);
+    }
+        /* interleave in pieces small enough for our buffer */
+    for (j = 0; j < (int)nframes; )
+    {
+        int n = (AU_MAXFRAMES * 2) / au_inchans, k;
+        if (n > (int)nframes - j)
+            n = nframes - j;
+        for (chan = 0; chan < au_inchans; chan++)
+        {
+            float *sp = (float *)au_inlist->mBuffers[chan].mData + j;
+            for (k = 0, fp = au_interleaved + chan; k < n;
+                k++, fp += au_inchans)
+                    *fp = *sp++;
+        }
+        sys_ringbuf_write(&au_inring, au_interleaved,
+            n * au_inchans * sizeof(float), au_inbuf);
+        j += n;
+    }
+    return (noErr);
+}
+
+/* --------------------- opening and closing --------------------- */
+
+static AudioBufferList *au_newbufferlist(int nchans)
+{
+    AudioBufferList *list = (AudioBufferList *)getbytes(
+        sizeof(AudioBufferList) + (nchans - 1) * sizeof(AudioBuffer));
+    int i;
+    list->mNumberBuffers = nchans;
+    for (i = 0; i < nchans; i++)
+    {
+        list->mBuffers[i].mNumberChannels = 1;
+        list->mBuffers[i].mDataByteSize = 0;
+        list->mBuffers[i].mData = 0;
+    }
+    return (list);
+}
+
+static void au_freebufferlist(AudioBufferList *list)
+{
+    freebytes(list, sizeof(AudioBufferList) +
+        (list->mNumberBuffers - 1) * sizeof(AudioBuffer));
+}
 
-pthread_mutex_t audiounit_mutex;
-pthread_cond_t audiounit_sem;
+static void au_setformat(AudioStreamBasicDescription *fmt, int nchans,
+    int rate)
+{
+    memset(fmt, 0, sizeof(*fmt));
+    fmt->mSampleRate = rate;
+    fmt->mFormatID = kAudioFormatLinearPCM;
+    fmt->mFormatFlags = kAudioFormatFlagsNativeFloatPacked |
+        kAudioFormatFlagIsNonInterleaved;
+    fmt->mBytesPerPacket = sizeof(float);
+    fmt->mFramesPerPacket = 1;
+    fmt->mBytesPerFrame = sizeof(float);
+    fmt->mChannelsPerFrame = nchans;
+    fmt->mBitsPerChannel = 8 * sizeof(float);
+}
+
+    /* set the device's rate and buffer size; complain but go on if it
+    won't (the unit converts the rate if it must, at a cost) */
+static void au_setupdevice(AudioDeviceID dev, int rate, int blocksize)
+{
+    Float64 sr = rate;
+    UInt32 frames = blocksize;
+    if (au_setprop(dev, kAudioDevicePropertyNominalSampleRate,
+        kAudioObjectPropertyScopeGlobal, sizeof(sr), &sr))
+            error("AudioUnit: couldn't set sample rate to %d", rate);
+    if (au_setprop(dev, kAudioDevicePropertyBufferFrameSize,
+        kAudioObjectPropertyScopeGlobal, sizeof(frames), &frames))
+            error("AudioUnit: couldn't set buffer size to %d", blocksize);
+}
+
+    /* make a HAL unit for a device with the given numbers of input and
+    output channels (either may be zero) */
+static AudioUnit au_newunit(AudioDeviceID dev, int inchans, int outchans,
+    int rate, int blocksize)
+{
+    AudioComponentDescription desc;
+    AudioComponent comp;
+    AudioUnit unit = 0;
+    AudioStreamBasicDescription fmt;
+    UInt32 doin = (inchans > 0), doout = (outchans > 0),
+        maxframes = AU_MAXFRAMES;
+    memset(&desc, 0, sizeof(desc));
+    desc.componentType = kAudioUnitType_Output;
+    desc.componentSubType = kAudioUnitSubType_HALOutput;
+    desc.componentManufacturer = kAudioUnitManufacturer_Apple;
+    if (!(comp = AudioComponentFindNext(0, &desc)) ||
+        AudioComponentInstanceNew(comp, &unit) != noErr)
+    {
+        error("AudioUnit: couldn't make HAL output unit");
+        return (0);
+    }
+        /* element 1 is the input side, element 0 the output side.  These
+        have to be set before the device is. */
+    if (AudioUnitSetProperty(unit, kAudioOutputUnitProperty_EnableIO,
+        kAudioUnitScope_Input, 1, &doin, sizeof(doin)) ||
+        AudioUnitSetProperty(unit, kAudioOutputUnitProperty_EnableIO,
+        kAudioUnitScope_Output, 0, &doout, sizeof(doout)) ||
+        AudioUnitSetProperty(unit, kAudioOutputUnitProperty_CurrentDevice,
+        kAudioUnitScope_Global, 0, &dev, sizeof(dev)))
+    {
+        error("AudioUnit: couldn't attach to device");
+        goto fail;
+    }
+    au_setupdevice(dev, rate, blocksize);
+    AudioUnitSetProperty(unit, kAudioUnitProperty_MaximumFramesPerSlice,
+        kAudioUnitScope_Global, 0, &maxframes, sizeof(maxframes));
+    if (inchans)
+    {
+        au_setformat(&fmt, inchans, rate);
+        if (AudioUnitSetProperty(unit, kAudioUnitProperty_StreamFormat,
+            kAudioUnitScope_Output, 1, &fmt, sizeof(fmt)))
+        {
+            error("AudioUnit: couldn't open %d input channels", inchans);
+            goto fail;
+        }
+    }
+    if (outchans)
+    {
+        au_setformat(&fmt, outchans, rate);
+        if (AudioUnitSetProperty(unit, kAudioUnitProperty_StreamFormat,
+            kAudioUnitScope_Input, 0, &fmt, sizeof(fmt)))
+        {
+            error("AudioUnit: couldn't open %d output channels", outchans);
+            goto fail;
+        }
+    }
+    return (unit);
+fail:
+    AudioComponentInstanceDispose(unit);
+    return (0);
+}
+
+#ifdef AU_WORKGROUP
+    /* join the calling thread to the output device's workgroup */
+static void au_joinworkgroup(AudioDeviceID dev)
+{
+    if (__builtin_available(macOS 11.0, *))
+    {
+        os_workgroup_t wg = 0;
+        if (au_getprop(dev, kAudioDevicePropertyIOThreadOSWorkgroup,
+            kAudioObjectPropertyScopeGlobal, sizeof(wg), &wg) || !wg)
+                return;
+        if (os_workgroup_join(wg, &au_jointoken))
+        {
+            if (sys_verbose)
+                post("AudioUnit: couldn't join device's workgroup");
+            os_release(wg);
+            return;
+        }
+        au_workgroup = wg;
+        au_joined = 1;
+    }
+}
+
+static void au_leaveworkgroup(void)
+{
+    if (__builtin_available(macOS 11.0, *))
+    {
+        if (au_joined)
+        {
+            os_workgroup_leave(au_workgroup, &au_jointoken);
+            os_release(au_workgroup);
+            au_workgroup = 0;
+            au_joined = 0;
+        }
+    }
+}
+#endif /* AU_WORKGROUP */
 
-int audiounit_open_audio(int inchans, int outchans, int rate)
+int audiounit_open_audio(int inchans, int outchans, int rate,
+    int blocksize, int nbuffers, int indevno, int outdevno,
+    t_audiocallback callback)
 {
-    return 0;
+    AudioDeviceID indev = kAudioObjectUnknown, outdev = kAudioObjectUnknown;
+    if (inchans > AU_MAXCHANS)
+        inchans = AU_MAXCHANS;
+    if (outchans > AU_MAXCHANS)
+        outchans = AU_MAXCHANS;
+    if (!inchans && !outchans)
+        return (0);
+    if (blocksize > AU_MAXFRAMES)
+        blocksize = AU_MAXFRAMES;
+    if (nbuffers < 1)
+        nbuffers = 1;
+    if (inchans && (indev = au_finddevice(indevno, 1)) == kAudioObjectUnknown)
+    {
+        error("AudioUnit: no input device %d", indevno);
+        return (1);
+    }
+    if (outchans &&
+        (outdev = au_finddevice(outdevno, 0)) == kAudioObjectUnknown)
+    {
+        error("AudioUnit: no output device %d", outdevno);
+        return (1);
+    }
+    au_inchans = inchans;
+    au_outchans = outchans;
+    au_callback = callback;
+    au_blockpos = au_buffered = au_threadset = 0;
+    au_dio_error = 0;
+    au_scratch = (float *)getbytes(AU_MAXFRAMES *
+        (inchans > outchans ? inchans : outchans) * sizeof(float));
+    if (inchans)
+        au_inlist = au_newbufferlist(inchans);
+    if (outchans && (!inchans || indev == outdev))
+    {
+        if (!(au_outunit = au_newunit(outdev, inchans, outchans, rate,
+            blocksize)))
+                goto fail;
+    }
+    else
+    {
+        AURenderCallbackStruct incb;
+        if ((outchans && !(au_outunit = au_newunit(outdev, 0, outchans, rate,
+            blocksize))) ||
+                !(au_inunit = au_newunit(indev, inchans, 0, rate, blocksize)))
+                    goto fail;
+        incb.inputProc = au_inputproc;
+        incb.inputProcRefCon = 0;
+        if (AudioUnitSetProperty(au_inunit,
+            kAudioOutputUnitProperty_SetInputCallback, kAudioUnitScope_Global,
+                0, &incb, sizeof(incb)))
+        {
+            error("AudioUnit: couldn't set input callback");
+            goto fail;
+        }
+        if (outchans)
+        {
+            au_inviaring = 1;
+            post("AudioUnit: input and output are different devices; use an "
+                "aggregate device to keep them in sync");
+        }
+    }
+    if (callback && au_inviaring)
+    {
+            /* start with some silence to ride out the two devices'
+            scheduling jitter */
+        long nbytes = (2 * AU_MAXFRAMES + nbuffers * blocksize) *
+            inchans * sizeof(float);
+        au_inbuf = getbytes(nbytes);
+        sys_ringbuf_init(&au_inring, nbytes, au_inbuf,
+            nbuffers * blocksize * inchans * sizeof(float));
+    }
+    else if (!callback)
+    {
+            /* as for portaudio: Pd computes "nbuffers" blocks ahead */
+        long ringframes = nbuffers * blocksize + AU_MAXFRAMES;
+        if (inchans)
+        {
+            long nbytes = ringframes * inchans * sizeof(float);
+            au_inbuf = getbytes(nbytes);
+            sys_ringbuf_init(&au_inring, nbytes, au_inbuf,
+                (outchans ? nbuffers * blocksize * inchans * sizeof(float) :
+                    0));
+        }
+        if (outchans)
+        {
+            long nbytes = ringframes * outchans * sizeof(float);
+            au_outbuf = getbytes(nbytes);
+            sys_ringbuf_init(&au_outring, nbytes, au_outbuf, 0);
+        }
+    }
+    if (au_outunit)
+    {
+        AURenderCallbackStruct cb;
+        cb.inputProc = au_render;
+        cb.inputProcRefCon = 0;
+        if (AudioUnitSetProperty(au_outunit,
+            kAudioUnitProperty_SetRenderCallback, kAudioUnitScope_Input, 0,
+                &cb, sizeof(cb)))
+        {
+            error("AudioUnit: couldn't set render callback");
+            goto fail;
+        }
+    }
+    if ((au_outunit && AudioUnitInitialize(au_outunit)) ||
+        (au_inunit && AudioUnitInitialize(au_inunit)))
+    {
+        error("AudioUnit: couldn't initialize");
+        goto fail;
+    }
+    if ((au_inunit && AudioOutputUnitStart(au_inunit)) ||
+        (au_outunit && AudioOutputUnitStart(au_outunit)))
+    {
+        error("AudioUnit: couldn't start");
+        goto fail;
+    }
+#ifdef AU_WORKGROUP
+    if (!callback)
+        au_joinworkgroup(outchans ? outdev : indev);
+#endif
+    if (sys_verbose)
+        post("AudioUnit: opened %d in, %d out, %s", inchans, outchans,
+            (callback ? "callback" : "polling"));
+    return (0);
+fail:
+    audiounit_close_audio();
+    return (1);
 }
 
 void audiounit_close_audio(void)
 {
+#ifdef AU_WORKGROUP
+    au_leaveworkgroup();
+#endif
+    if (au_outunit)
+    {
+        AudioOutputUnitStop(au_outunit);
+        AudioUnitUninitialize(au_outunit);
+        AudioComponentInstanceDispose(au_outunit);
+        au_outunit = 0;
+    }
+    if (au_inunit)
+    {
+        AudioOutputUnitStop(au_inunit);
+        AudioUnitUninitialize(au_inunit);
+        AudioComponentInstanceDispose(au_inunit);
+        au_inunit = 0;
+    }
+    au_inviaring = 0;
+    if (au_inlist)
+        au_freebufferlist(au_inlist), au_inlist = 0;
+    if (au_inbuf)
+        freebytes(au_inbuf, au_inring.bufferSize), au_inbuf = 0;
+    if (au_outbuf)
+        freebytes(au_outbuf, au_outring.bufferSize), au_outbuf = 0;
+    if (au_scratch)
+        freebytes(au_scratch, AU_MAXFRAMES *
+            (au_inchans > au_outchans ? au_inchans : au_outchans) *
+                sizeof(float)), au_scratch = 0;
+    au_inchans = au_outchans = 0;
+    au_callback = 0;
 }
 
+    /* polling mode only */
 int audiounit_send_dacs(void)
 {
-    return 0;
+    t_sample *fp;
+    float *sp;
+    int j, k, rtnval = SENDDACS_YES;
+    long nout = au_outchans * AU_BLKSIZE * sizeof(float),
+        nin = au_inchans * AU_BLKSIZE * sizeof(float);
+    double timebefore = sys_getrealtime();
+    if (!au_outunit && !au_inunit)
+        return (SENDDACS_NO);
+    if (au_dio_error)
+    {
+        sys_log_error(ERR_RESYNC);
+        au_dio_error = 0;
+    }
+        /* sync on output if there is any, otherwise on input */
+    while (au_outchans ? sys_ringbuf_getwriteavailable(&au_outring) < nout :
+        sys_ringbuf_getreadavailable(&au_inring) < nin)
+    {
+        if (sys_getrealtime() - timebefore > AU_POLLTIMEOUT)
+            return (SENDDACS_NO);
+        rtnval = SENDDACS_SLEPT;
+        sys_microsleep(sys_sleepgrain);
+            /* sys_microsleep() may have closed device */
+        if (!au_outunit && !au_inunit)
+            return (SENDDACS_NO);
+    }
+    if (au_outchans)
+    {
+        for (j = 0, fp = STUFF->st_soundout; j < au_outchans; j++)
+            for (k = 0, sp = au_scratch + j; k < AU_BLKSIZE;
+                k++, sp += au_outchans)
+                    *sp = *fp, *fp++ = 0;
+        sys_ringbuf_write(&au_outring, au_scratch, nout, au_outbuf);
+        sys_tracefill(sys_ringbuf_getreadavailable(&au_outring) /
+            (au_outchans * sizeof(float)));
+    }
+    if (au_inchans)
+    {
+        if (sys_ringbuf_getreadavailable(&au_inring) < nin)
+        {
+                /* input fell behind the output; give Pd silence */
+            memset(STUFF->st_soundin, 0,
+                au_inchans * AU_BLKSIZE * sizeof(t_sample));
+            return (rtnval);
+        }
+        sys_ringbuf_read(&au_inring, au_scratch, nin, au_inbuf);
+        for (j = 0, fp = STUFF->st_soundin; j < au_inchans; j++)
+            for (k = 0, sp = au_scratch + j; k < AU_BLKSIZE;
+                k++, sp += au_inchans)
+                    *fp++ = *sp;
+    }
+    return (rtnval);
 }
 
 void audiounit_getdevs(char *indevlist, int *nindevs,
     char *outdevlist, int *noutdevs, int *canmulti,
         int maxndev, int devdescsize)
 {
-    post("device getting not implemented for AudioUnit yet\n");
+    AudioDeviceID devs[AU_MAXDEV];
+    int i, n;
+    *canmulti = 0;
+    n = au_listdevices(devs, (maxndev < AU_MAXDEV ? maxndev : AU_MAXDEV), 1);
+    for (i = 0; i < n; i++)
+        au_devname(devs[i], indevlist + i * devdescsize, devdescsize);
+    *nindevs = n;
+    n = au_listdevices(devs, (maxndev < AU_MAXDEV ? maxndev : AU_MAXDEV), 0);
+    for (i = 0; i < n; i++)
+        au_devname(devs[i], outdevlist + i * devdescsize, devdescsize);
+    *noutdevs = n;
 }
 
 void audiounit_listdevs(void)
 {
-    post("device listing not implemented for AudioUnit yet\n");
+    AudioDeviceID devs[AU_MAXDEV];
+    char name[MAXPDSTRING];
+    int i, n;
+    post("input devices:");
+    n = au_listdevices(devs, AU_MAXDEV, 1);
+    for (i = 0; i < n; i++)
+    {
+        au_devname(devs[i], name, MAXPDSTRING);
+        post("%d. %s (%d channels)", i + 1, name, au_devchannels(devs[i], 1));
+    }
+    post("output devices:");
+    n = au_listdevices(devs, AU_MAXDEV, 0);
+    for (i = 0; i < n; i++)
+    {
+        au_devname(devs[i], name, MAXPDSTRING);
+        post("%d. %s (%d channels)", i + 1, name, au_devchannels(devs[i], 0));
+    }
 }
 
 #endif /* AUDIOUNIT */
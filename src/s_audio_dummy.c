@@ -5,20 +5,96 @@
  * WARRANTIES, see the file, "LICENSE.txt," in this distribution.
  */
 
+/* The dummy backend has no device, but it can stand in for one as a clock,
+ * for load testing and benchmarking without audio hardware.  Paced ("-dummy")
+ * it hands the scheduler a period of frames (the audio block size) at a
+ * time, each one arriving up to "-dummyjitter" msec late, into a buffer as
+ * big as the audio buffer ("-audiobuf").  If a period arrives to find the
+ * buffer full, Pd has missed a deadline and, as with a real device, frames
+ * are lost.  Free-running ("-dummyfree") it advances as fast as Pd can
+ * compute.  "pd dummy-stats" reports what happened. */
+
 #ifdef USEAPI_DUMMY
 
 #include <stdio.h>
+#include "m_pd.h"
+#include "s_stuff.h"
+
+static int dummy_free;          /* true to run as fast as possible */
+static double dummy_jitter;     /* most a period may arrive late, seconds */
+static int dummy_isopen;
+static int dummy_sr;
+static int dummy_period;        /* frames in a period */
+static int dummy_avail;         /* frames arrived and not yet computed */
+static int dummy_bufsize;       /* most that can be waiting */
+static long dummy_nperiods;     /* periods since opening */
+static double dummy_starttime;
+static double dummy_due;        /* when the next period arrives */
+static unsigned int dummy_seed;
+static long dummy_ticks, dummy_late, dummy_lost;
+static double dummy_maxbehind;  /* most frames ever waiting, in seconds */
+
+    /* either argument may be negative to leave it as it was */
+void dummy_setmode(int freerun, double jitterms) {
+  if (freerun >= 0)
+    dummy_free = freerun;
+  if (jitterms >= 0)
+    dummy_jitter = 0.001 * jitterms;
+}
+
+static double dummy_random(void) {
+  dummy_seed = dummy_seed * 435898247 + 382842987;
+  return ((dummy_seed >> 8) / 16777216.);
+}
 
-int dummy_open_audio(int nin, int nout, int sr) {
+int dummy_open_audio(int nin, int nout, int sr, int blocksize) {
+  dummy_sr = (sr > 0 ? sr : 44100);
+  dummy_period = (blocksize > STUFF->st_schedblocksize ?
+    blocksize : STUFF->st_schedblocksize);
+  dummy_avail = 0;
+  dummy_bufsize = (sys_advance_samples > 2 * dummy_period ?
+    sys_advance_samples : 2 * dummy_period);
+  dummy_nperiods = 0;
+  dummy_seed = 1;
+  dummy_ticks = dummy_late = dummy_lost = 0;
+  dummy_maxbehind = 0;
+  dummy_due = dummy_starttime = sys_getrealtime();
+  dummy_isopen = 1;
   return 0;
 }
 
 int dummy_close_audio(void) {
+  dummy_isopen = 0;
   return 0;
 }
 
 int dummy_send_dacs(void) {
-  return 0;
+  int blksize = STUFF->st_schedblocksize;
+  double now;
+  if (dummy_free) {
+    dummy_ticks++;
+    return (SENDDACS_YES);
+  }
+  now = sys_getrealtime();
+  while (now >= dummy_due) {
+    dummy_avail += dummy_period;
+    if (dummy_avail > dummy_bufsize) {
+      dummy_late++;
+      dummy_lost += dummy_avail - dummy_bufsize;
+      dummy_avail = dummy_bufsize;
+    }
+    if ((double)dummy_avail / dummy_sr > dummy_maxbehind)
+      dummy_maxbehind = (double)dummy_avail / dummy_sr;
+    dummy_nperiods++;
+    dummy_due = dummy_starttime +
+      (double)dummy_nperiods * dummy_period / dummy_sr +
+        dummy_jitter * dummy_random();
+  }
+  if (dummy_avail < blksize)
+    return (SENDDACS_NO);
+  dummy_avail -= blksize;
+  dummy_ticks++;
+  return (SENDDACS_YES);
 }
 
 void dummy_getdevs(char *indevlist, int *nindevs, char *outdevlist,
@@ -33,5 +109,22 @@ void dummy_listdevs(void) {
   // do nothing
 }
 
-#endif
+    /* the "dummy-stats" message to Pd */
+void glob_dummystats(void *dummy) {
+  double elapsed = sys_getrealtime() - dummy_starttime,
+    computed = (double)dummy_ticks * STUFF->st_schedblocksize /
+      (dummy_sr ? dummy_sr : 1);
+  if (!dummy_isopen) {
+    post("dummy audio isn't open");
+    return;
+  }
+  post("dummy audio (%s): %ld ticks, %.3f sec computed in %.3f (%.2f x real time)",
+    (dummy_free ? "free-running" : "paced"), dummy_ticks, computed, elapsed,
+      (elapsed > 0 ? computed / elapsed : 0));
+  if (!dummy_free)
+    post("... %ld periods of %d, %ld late (%ld frames lost), at most %.2f msec behind",
+      dummy_nperiods, dummy_period, dummy_late, dummy_lost,
+        1000 * dummy_maxbehind);
+}
 
+#endif
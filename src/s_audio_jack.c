@@ -21,6 +21,7 @@
 #define MAX_CLIENTS 100
 #define MAX_JACK_PORTS 128  /* higher values seem to give bad xrun problems */
 #define BUF_JACK 4096
+#define JACK_BLKSIZE (STUFF->st_schedblocksize)
 #define JACK_OUT_MAX  64
 
 static jack_nframes_t jack_out_max;
@@ -110,45 +111,102 @@ static int pollprocess(jack_nframes_t nframes, void *arg)
     return 0;
 }
 
-static int callbackprocess(jack_nframes_t nframes, void *arg)
+    /* In callback mode JACK's process thread computes Pd's DSP itself.  When
+    JACK's period is a whole number of DSP blocks we go straight from the
+    port buffers to a tick and back; otherwise we trade samples with the
+    last block computed, which delays the output by one block.
+    jack_blockpos is how far into that block we are. */
+static int jack_blockpos;
+static int jack_buffered;
+
+static void jack_copyin(jack_default_audio_sample_t **in, unsigned int onset,
+    int pos, int n)
 {
-    int chan, j, k;
-    unsigned int n;
-    jack_default_audio_sample_t *out[MAX_JACK_PORTS], *in[MAX_JACK_PORTS], *jp;
+    int chan, j;
+    for (chan = 0; chan < STUFF->st_inchannels; chan++)
+    {
+        t_sample *fp = STUFF->st_soundin + chan*JACK_BLKSIZE + pos;
+        jack_default_audio_sample_t *jp;
+        if (!in[chan])
+        {
+            memset(fp, 0, n * sizeof(t_sample));
+            continue;
+        }
+        jp = in[chan] + onset;
+        if (sizeof(t_sample) == sizeof(jack_default_audio_sample_t))
+            memcpy(fp, jp, n * sizeof(t_sample));
+        else for (j = 0; j < n; j++)
+            *fp++ = *jp++;
+    }
+}
 
-    if (nframes % DEFDACBLKSIZE)
+static void jack_copyout(jack_default_audio_sample_t **out,
+    unsigned int onset, int pos, int n)
+{
+    int chan, j;
+    for (chan = 0; chan < STUFF->st_outchannels; chan++)
+        if (out[chan])
     {
-        fprintf(stderr, "jack: nframes %d not a multiple of blocksize %d\n",
-            nframes, DEFDACBLKSIZE);
-        nframes -= (nframes % DEFDACBLKSIZE);
+        t_sample *fp = STUFF->st_soundout + chan*JACK_BLKSIZE + pos;
+        jack_default_audio_sample_t *jp = out[chan] + onset;
+        if (sizeof(t_sample) == sizeof(jack_default_audio_sample_t))
+            memcpy(jp, fp, n * sizeof(t_sample));
+        else for (j = 0; j < n; j++)
+            *jp++ = *fp++;
     }
+}
+
+static void jack_tick(void)
+{
+    memset(STUFF->st_soundout, 0,
+        STUFF->st_outchannels * JACK_BLKSIZE * sizeof(t_sample));
+    (*jack_callback)();
+}
+
+static void jack_threadinit(void *arg)
+{
+    sys_setthreadrole(SYS_THREAD_AUDIO);
+}
+
+static int callbackprocess(jack_nframes_t nframes, void *arg)
+{
+    int chan;
+    unsigned int n, len;
+    jack_default_audio_sample_t *out[MAX_JACK_PORTS], *in[MAX_JACK_PORTS];
+
     for (chan = 0; chan < STUFF->st_inchannels; chan++)
         in[chan] = jack_port_get_buffer(input_port[chan], nframes);
     for (chan = 0; chan < STUFF->st_outchannels; chan++)
         out[chan] = jack_port_get_buffer(output_port[chan], nframes);
-    for (n = 0; n < nframes; n += DEFDACBLKSIZE)
+    if (!jack_blockpos && !(nframes % JACK_BLKSIZE))
     {
-        t_sample *fp;
-        for (chan = 0; chan < STUFF->st_inchannels; chan++)
-            if (in[chan])
+        jack_buffered = 0;
+        for (n = 0; n < nframes; n += JACK_BLKSIZE)
         {
-            for (fp = STUFF->st_soundin + chan*DEFDACBLKSIZE,
-                jp = in[chan] + n, j=0; j < DEFDACBLKSIZE; j++)
-                    *fp++ = *jp++;
+            jack_copyin(in, n, 0, JACK_BLKSIZE);
+            jack_tick();
+            jack_copyout(out, n, 0, JACK_BLKSIZE);
         }
-        for (chan = 0; chan < STUFF->st_outchannels; chan++)
-        {
-            for (fp = STUFF->st_soundout + chan*DEFDACBLKSIZE,
-                j = 0; j < DEFDACBLKSIZE; j++)
-                    *fp++ = 0;
-        }
-        (*jack_callback)();
-        for (chan = 0; chan < STUFF->st_outchannels; chan++)
-            if (out[chan])
+        return 0;
+    }
+    if (!jack_buffered)
+    {
+            /* the last block has already gone out */
+        memset(STUFF->st_soundout, 0,
+            STUFF->st_outchannels * JACK_BLKSIZE * sizeof(t_sample));
+        jack_buffered = 1;
+    }
+    for (n = 0; n < nframes; n += len)
+    {
+        len = JACK_BLKSIZE - jack_blockpos;
+        if (len > nframes - n)
+            len = nframes - n;
+        jack_copyin(in, n, jack_blockpos, len);
+        jack_copyout(out, n, jack_blockpos, len);
+        if ((jack_blockpos += len) == JACK_BLKSIZE)
         {
-            for (fp = STUFF->st_soundout + chan*DEFDACBLKSIZE, jp = out[chan] + n,
-                j=0; j < DEFDACBLKSIZE; j++)
-                    *jp++ = *fp++;
+            jack_tick();
+            jack_blockpos = 0;
         }
     }
     return 0;
@@ -368,8 +426,10 @@ jack_open_audio(int inchans, int outchans, int rate, t_audiocallback callback)
         /* set JACK callback functions */
 
         jack_callback = callback;
+        jack_blockpos = jack_buffered = 0;
         jack_set_process_callback(jack_client,
             (callback? callbackprocess : pollprocess), 0);
+        jack_set_thread_init_callback(jack_client, jack_threadinit, 0);
 
         jack_set_error_function (pd_jack_error_callback);
 
@@ -511,24 +571,24 @@ int jack_send_dacs(void)
     for (j = 0; j < STUFF->st_outchannels; j++)
     {
         memcpy(jack_outbuf + (j * BUF_JACK) + jack_filled, fp,
-            DEFDACBLKSIZE*sizeof(t_sample));
-        fp += DEFDACBLKSIZE;
+            JACK_BLKSIZE*sizeof(t_sample));
+        fp += JACK_BLKSIZE;
     }
     fp = STUFF->st_soundin;
     for (j = 0; j < STUFF->st_inchannels; j++)
     {
         memcpy(fp, jack_inbuf + (j * BUF_JACK) + jack_filled,
-            DEFDACBLKSIZE*sizeof(t_sample));
-        fp += DEFDACBLKSIZE;
+            JACK_BLKSIZE*sizeof(t_sample));
+        fp += JACK_BLKSIZE;
     }
-    jack_filled += DEFDACBLKSIZE;
+    jack_filled += JACK_BLKSIZE;
     pthread_mutex_unlock(&jack_mutex);
 
     if ((timenow = sys_getrealtime()) - timeref > 0.002)
     {
         rtnval = SENDDACS_SLEPT;
     }
-    memset(STUFF->st_soundout, 0, DEFDACBLKSIZE*sizeof(t_sample)*STUFF->st_outchannels);
+    memset(STUFF->st_soundout, 0, JACK_BLKSIZE*sizeof(t_sample)*STUFF->st_outchannels);
     return rtnval;
 }
 
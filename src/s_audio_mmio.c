@@ -27,7 +27,8 @@ static void postflags(void);
 #define SAMPSIZE 2
 
 int nt_realdacblksize;
-#define DEFREALDACBLKSIZE (4 * DEFDACBLKSIZE) /* larger underlying bufsize */
+#define MMIO_BLKSIZE (STUFF->st_schedblocksize)
+#define DEFREALDACBLKSIZE (4 * MMIO_BLKSIZE) /* larger underlying bufsize */
 
 #define MAXBUFFER 100   /* number of buffers in use at maximum advance */
 #define DEFBUFFER 30    /* default is about 30x6 = 180 msec! */
@@ -504,7 +505,7 @@ int mmio_send_dacs(void)
     {
         int i, n;
         t_sample maxsamp;
-        for (i = 0, n = 2 * nt_nwavein * DEFDACBLKSIZE, maxsamp = nt_inmax;
+        for (i = 0, n = 2 * nt_nwavein * MMIO_BLKSIZE, maxsamp = nt_inmax;
             i < n; i++)
         {
             t_sample f = STUFF->st_soundin[i];
@@ -512,7 +513,7 @@ int mmio_send_dacs(void)
             else if (-f > maxsamp) maxsamp = -f;
         }
         nt_inmax = maxsamp;
-        for (i = 0, n = 2 * nt_nwaveout * DEFDACBLKSIZE, maxsamp = nt_outmax;
+        for (i = 0, n = 2 * nt_nwaveout * MMIO_BLKSIZE, maxsamp = nt_outmax;
             i < n; i++)
         {
             t_sample f = STUFF->st_soundout[i];
@@ -568,9 +569,9 @@ int mmio_send_dacs(void)
 
         for (i = 0, sp1 = (short *)(ntsnd_outvec[nda][phase].lpData) +
             CHANNELS_PER_DEVICE * nt_fill;
-                i < 2; i++, fp1 += DEFDACBLKSIZE, sp1++)
+                i < 2; i++, fp1 += MMIO_BLKSIZE, sp1++)
         {
-            for (j = 0, fp2 = fp1, sp2 = sp1; j < DEFDACBLKSIZE;
+            for (j = 0, fp2 = fp1, sp2 = sp1; j < MMIO_BLKSIZE;
                 j++, fp2++, sp2 += CHANNELS_PER_DEVICE)
             {
                 int x1 = 32767.f * *fp2;
@@ -581,7 +582,7 @@ int mmio_send_dacs(void)
         }
     }
     memset(STUFF->st_soundout, 0,
-        (DEFDACBLKSIZE *sizeof(t_sample)*CHANNELS_PER_DEVICE)*nt_nwaveout);
+        (MMIO_BLKSIZE *sizeof(t_sample)*CHANNELS_PER_DEVICE)*nt_nwaveout);
 
         /* vice versa for the input buffer */
 
@@ -591,9 +592,9 @@ int mmio_send_dacs(void)
 
         for (i = 0, sp1 = (short *)(ntsnd_invec[nad][phase].lpData) +
             CHANNELS_PER_DEVICE * nt_fill;
-                i < 2; i++, fp1 += DEFDACBLKSIZE, sp1++)
+                i < 2; i++, fp1 += MMIO_BLKSIZE, sp1++)
         {
-            for (j = 0, fp2 = fp1, sp2 = sp1; j < DEFDACBLKSIZE;
+            for (j = 0, fp2 = fp1, sp2 = sp1; j < MMIO_BLKSIZE;
                 j++, fp2++, sp2 += CHANNELS_PER_DEVICE)
             {
                 *fp2 = ((t_sample)(1./32767.)) * (t_sample)(*sp2);
@@ -601,7 +602,7 @@ int mmio_send_dacs(void)
         }
     }
 
-    nt_fill = nt_fill + DEFDACBLKSIZE;
+    nt_fill = nt_fill + MMIO_BLKSIZE;
     if (nt_fill == nt_realdacblksize)
     {
         nt_fill = 0;
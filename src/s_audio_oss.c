@@ -43,9 +43,10 @@
 typedef int16_t t_oss_int16;
 typedef int32_t t_oss_int32;
 #define OSS_MAXSAMPLEWIDTH sizeof(t_oss_int32)
-#define OSS_BYTESPERCHAN(width) (DEFDACBLKSIZE * (width))
-#define OSS_XFERSAMPS(chans) (DEFDACBLKSIZE* (chans))
-#define OSS_XFERSIZE(chans, width) (DEFDACBLKSIZE * (chans) * (width))
+#define OSS_BLKSIZE (STUFF->st_schedblocksize)
+#define OSS_BYTESPERCHAN(width) (OSS_BLKSIZE * (width))
+#define OSS_XFERSAMPS(chans) (OSS_BLKSIZE* (chans))
+#define OSS_XFERSIZE(chans, width) (OSS_BLKSIZE * (chans) * (width))
 
 /* GLOBALS */
 static int linux_meters;        /* true if we're metering */
@@ -63,9 +64,15 @@ typedef struct _oss_dev
     int d_dropcount;        /* # of buffers to drop for resync (output only) */
     unsigned int d_nchannels;   /* number of channels for this device */
     unsigned int d_bytespersamp; /* bytes per sample (2 for 16 bit, 4 for 32) */
+    t_audiodrift *d_drift;  /* resampler if not clocked with the first one */
 } t_oss_dev;
 
 static t_oss_dev linux_dacs[OSS_MAXDEV];
+    /* one block of interleaved samples; static since it's sized for the
+    largest scheduler block */
+static char oss_buf[OSS_MAXSAMPLEWIDTH * MAXDACBLKSIZE * OSS_MAXCHPERDEV];
+    /* and one block of channel planes, going through a drift resampler */
+static t_sample oss_driftbuf[MAXDACBLKSIZE * OSS_MAXCHPERDEV];
 static t_oss_dev linux_adcs[OSS_MAXDEV];
 static int linux_noutdevs = 0;
 static int linux_nindevs = 0;
@@ -160,7 +167,7 @@ void oss_configure(t_oss_dev *dev, int srate, int dac, int skipblocksize,
         if (!linux_fragsize)
         {
             linux_fragsize = OSS_DEFFRAGSIZE;
-            while (linux_fragsize > DEFDACBLKSIZE
+            while (linux_fragsize > OSS_BLKSIZE
                 && linux_fragsize * 6 > sys_advance_samples)
                     linux_fragsize = linux_fragsize/2;
         }
@@ -256,6 +263,22 @@ whynot:
     return (0);
 }
 
+    /* make a drift resampler for a device whose clock may differ from
+    the pacing one's; its FIFO has to ride out a whole fragment */
+static t_audiodrift *oss_newdrift(t_oss_dev *dev, int dac)
+{
+    audio_buf_info ainfo;
+    int framebytes = dev->d_bytespersamp * dev->d_nchannels,
+        frag = OSS_BLKSIZE;
+    if (ioctl(dev->d_fd, (dac ? SNDCTL_DSP_GETOSPACE : SNDCTL_DSP_GETISPACE),
+        &ainfo) >= 0 && ainfo.fragsize > 0)
+            frag = ainfo.fragsize / framebytes;
+    if (sys_verbose)
+        post("OSS: %s fd %d: drift compensation, fragment %d",
+            (dac ? "output" : "input"), dev->d_fd, frag);
+    return (sys_audiodrift_new(dev->d_nchannels, frag + 2 * OSS_BLKSIZE));
+}
+
 int oss_open_audio(int nindev,  int *indev,  int nchin,  int *chin,
     int noutdev, int *outdev, int nchout, int *chout, int rate,
         int blocksize)
@@ -264,7 +287,7 @@ int oss_open_audio(int nindev,  int *indev,  int nchin,  int *chin,
     int inchannels = 0, outchannels = 0;
     char devname[20];
     int n, i, fd, flags;
-    char buf[OSS_MAXSAMPLEWIDTH * DEFDACBLKSIZE * OSS_MAXCHPERDEV];
+    char *buf = oss_buf;
     int num_devs = 0;
     int wantmore=0;
     int spread = 0;
@@ -273,7 +296,10 @@ int oss_open_audio(int nindev,  int *indev,  int nchin,  int *chin,
     linux_nindevs = linux_noutdevs = 0;
         /* mark devices unopened */
     for (i = 0; i < OSS_MAXDEV; i++)
+    {
         linux_adcs[i].d_fd = linux_dacs[i].d_fd = -1;
+        linux_adcs[i].d_drift = linux_dacs[i].d_drift = 0;
+    }
 
     /* open output devices */
     wantmore=0;
@@ -460,20 +486,40 @@ int oss_open_audio(int nindev,  int *indev,  int nchin,  int *chin,
             fprintf(stderr,("OSS: issuing first ADC 'read' ... "));
         read(linux_adcs[0].d_fd, buf,
             linux_adcs[0].d_bytespersamp *
-                linux_adcs[0].d_nchannels * DEFDACBLKSIZE);
+                linux_adcs[0].d_nchannels * OSS_BLKSIZE);
         if (sys_verbose)
             fprintf(stderr, "...done.\n");
     }
+
+        /* with "-driftcomp", run every device except the one that sets the
+        pace (the first output, or else the first input) through a drift
+        resampler.  Those inputs need a read of their own to get going. */
+    if (sys_driftcomp && (linux_noutdevs || linux_nindevs))
+    {
+        int pacefd = (linux_noutdevs ? linux_dacs[0].d_fd :
+            linux_adcs[0].d_fd);
+        for (i = 0; i < linux_noutdevs; i++)
+            if (linux_dacs[i].d_fd != pacefd)
+                linux_dacs[i].d_drift = oss_newdrift(&linux_dacs[i], 1);
+        for (i = 0; i < linux_nindevs; i++)
+            if (linux_adcs[i].d_fd != pacefd)
+        {
+            linux_adcs[i].d_drift = oss_newdrift(&linux_adcs[i], 0);
+            if (i > 0)
+                read(linux_adcs[i].d_fd, buf, linux_adcs[i].d_bytespersamp *
+                    linux_adcs[i].d_nchannels * OSS_BLKSIZE);
+        }
+    }
         /* now go and fill all the output buffers. */
     for (i = 0; i < linux_noutdevs; i++)
     {
         int j;
         memset(buf, 0, linux_dacs[i].d_bytespersamp *
-                linux_dacs[i].d_nchannels * DEFDACBLKSIZE);
-        for (j = 0; j < sys_advance_samples/DEFDACBLKSIZE; j++)
+                linux_dacs[i].d_nchannels * OSS_BLKSIZE);
+        for (j = 0; j < sys_advance_samples/OSS_BLKSIZE; j++)
             write(linux_dacs[i].d_fd, buf,
                 linux_dacs[i].d_bytespersamp *
-                    linux_dacs[i].d_nchannels * DEFDACBLKSIZE);
+                    linux_dacs[i].d_nchannels * OSS_BLKSIZE);
     }
     sys_setalarm(0);
     STUFF->st_inchannels = inchannels;
@@ -485,10 +531,20 @@ void oss_close_audio(void)
 {
      int i;
      for (i=0;i<linux_nindevs;i++)
+     {
           close(linux_adcs[i].d_fd);
+          if (linux_adcs[i].d_drift)
+               sys_audiodrift_free(linux_adcs[i].d_drift);
+          linux_adcs[i].d_drift = 0;
+     }
 
      for (i=0;i<linux_noutdevs;i++)
+     {
           close(linux_dacs[i].d_fd);
+          if (linux_dacs[i].d_drift)
+               sys_audiodrift_free(linux_dacs[i].d_drift);
+          linux_dacs[i].d_drift = 0;
+     }
 
     linux_nindevs = linux_noutdevs = 0;
 }
@@ -545,7 +601,7 @@ in audio output and/or input. */
 static void oss_doresync(void)
 {
     int dev, zeroed = 0, wantsize;
-    char buf[OSS_MAXSAMPLEWIDTH * DEFDACBLKSIZE * OSS_MAXCHPERDEV];
+    char *buf = oss_buf;
     audio_buf_info ainfo;
 
         /* 1. if any input devices are ahead (have more than 1 buffer stored),
@@ -620,14 +676,58 @@ static void oss_doresync(void)
     }
 }
 
+    /* a device with a drift resampler runs on its own clock.  Output: queue
+    this tick's block, then write resampled blocks while the device has room
+    and less than the scheduler advance queued, which keeps it as far ahead
+    as the pacing device is. */
+static void oss_driftwrite(t_oss_dev *dev, t_sample *fp)
+{
+    int j, nchannels = dev->d_nchannels,
+        xfer = OSS_XFERSIZE(nchannels, dev->d_bytespersamp);
+    audio_buf_info ainfo;
+    sys_audiodrift_put(dev->d_drift, fp, OSS_BLKSIZE, OSS_BLKSIZE);
+    if (ioctl(dev->d_fd, SNDCTL_DSP_GETOSPACE, &ainfo) < 0)
+        return;
+    while (ainfo.bytes >= xfer && dev->d_bufsize - ainfo.bytes <
+        sys_advance_samples * (int)(nchannels * dev->d_bytespersamp))
+    {
+        sys_audiodrift_get(dev->d_drift, oss_driftbuf, OSS_BLKSIZE,
+            OSS_BLKSIZE);
+        for (j = 0; j < nchannels; j++)
+            sys_audio_topcm(oss_driftbuf + j * OSS_BLKSIZE,
+                (t_oss_int16 *)oss_buf + j, OSS_BLKSIZE, nchannels, 2);
+        linux_dacs_write(dev->d_fd, oss_buf, xfer);
+        ainfo.bytes -= xfer;
+    }
+}
+
+    /* input: queue whatever the device has, then take one block out */
+static void oss_driftread(t_oss_dev *dev, t_sample *fp)
+{
+    int j, nchannels = dev->d_nchannels,
+        framebytes = nchannels * dev->d_bytespersamp, nframes, n;
+    audio_buf_info ainfo;
+    if (ioctl(dev->d_fd, SNDCTL_DSP_GETISPACE, &ainfo) >= 0)
+        for (nframes = ainfo.bytes / framebytes; nframes > 0; nframes -= n)
+    {
+        n = (nframes < OSS_BLKSIZE ? nframes : OSS_BLKSIZE);
+        if (linux_adcs_read(dev->d_fd, oss_buf, n * framebytes) !=
+            n * framebytes)
+                break;
+        for (j = 0; j < nchannels; j++)
+            sys_audio_frompcm((t_oss_int16 *)oss_buf + j,
+                oss_driftbuf + j * OSS_BLKSIZE, n, nchannels, 2);
+        sys_audiodrift_put(dev->d_drift, oss_driftbuf, n, OSS_BLKSIZE);
+    }
+    sys_audiodrift_get(dev->d_drift, fp, OSS_BLKSIZE, OSS_BLKSIZE);
+}
+
 int oss_send_dacs(void)
 {
-    t_sample *fp1, *fp2;
+    t_sample *fp1;
     long fill;
-    int i, j, dev, rtnval = SENDDACS_YES;
-    char buf[OSS_MAXSAMPLEWIDTH * DEFDACBLKSIZE * OSS_MAXCHPERDEV];
-    t_oss_int16 *sp;
-    t_oss_int32 *lp;
+    int j, dev, rtnval = SENDDACS_YES;
+    char *buf = oss_buf;
         /* the maximum number of samples we should have in the ADC buffer */
     int idle = 0;
     int thischan;
@@ -643,15 +743,20 @@ int oss_send_dacs(void)
         output device has fewer than (sys_advance_samples) blocks buffered
         already. */
         oss_calcspace();
+        if (linux_noutdevs)
+            sys_tracefill((linux_dacs[0].d_bufsize - linux_dacs[0].d_space) /
+                (int)(linux_dacs[0].d_bytespersamp * linux_dacs[0].d_nchannels));
 
         for (dev=0; dev < linux_noutdevs; dev++)
-            if (linux_dacs[dev].d_dropcount ||
+            if (linux_dacs[dev].d_drift)
+                continue;
+            else if (linux_dacs[dev].d_dropcount ||
                 (linux_dacs[dev].d_bufsize - linux_dacs[dev].d_space >
                     sys_advance_samples * linux_dacs[dev].d_bytespersamp *
                         linux_dacs[dev].d_nchannels))
                             idle = 1;
         for (dev=0; dev < linux_nindevs; dev++)
-            if (linux_adcs[dev].d_space <
+            if (!linux_adcs[dev].d_drift && linux_adcs[dev].d_space <
                 OSS_XFERSIZE(linux_adcs[dev].d_nchannels,
                     linux_adcs[dev].d_bytespersamp))
                         idle = 1;
@@ -666,7 +771,7 @@ int oss_send_dacs(void)
             There should be an error flag we could check instead; look for this
             someday... */
         for (dev = 0;dev < linux_nindevs; dev++)
-            if (linux_adcs[dev].d_space == 0)
+            if (!linux_adcs[dev].d_drift && linux_adcs[dev].d_space == 0)
         {
             audio_buf_info ainfo;
             sys_microsleep(2000);
@@ -686,14 +791,14 @@ int oss_send_dacs(void)
             */
 
         for (dev=0; dev < linux_noutdevs; dev++)
-            if (!linux_dacs[dev].d_dropcount &&
+            if (!linux_dacs[dev].d_drift && !linux_dacs[dev].d_dropcount &&
                 (linux_dacs[dev].d_bufsize - linux_dacs[dev].d_space <
                     (sys_advance_samples - 2) *
                         (linux_dacs[dev].d_bytespersamp *
                             linux_dacs[dev].d_nchannels)))
                         goto badsync;
         for (dev=0; dev < linux_nindevs; dev++)
-            if (linux_adcs[dev].d_space > 3 *
+            if (!linux_adcs[dev].d_drift && linux_adcs[dev].d_space > 3 *
                 OSS_XFERSIZE(linux_adcs[dev].d_nchannels,
                     linux_adcs[dev].d_bytespersamp))
                         goto badsync;
@@ -713,24 +818,19 @@ int oss_send_dacs(void)
     for (dev=0, thischan = 0; dev < linux_noutdevs; dev++)
     {
         int nchannels = linux_dacs[dev].d_nchannels;
-        if (linux_dacs[dev].d_dropcount)
+        if (linux_dacs[dev].d_drift)
+            oss_driftwrite(&linux_dacs[dev],
+                STUFF->st_soundout + OSS_BLKSIZE * thischan);
+        else if (linux_dacs[dev].d_dropcount)
             linux_dacs[dev].d_dropcount--;
         else
         {
             if (linux_dacs[dev].d_bytespersamp == 2)
             {
-                for (i = DEFDACBLKSIZE,  fp1 = STUFF->st_soundout +
-                    DEFDACBLKSIZE*thischan,
-                    sp = (t_oss_int16 *)buf; i--; fp1++, sp += nchannels)
-                {
-                    for (j=0, fp2 = fp1; j<nchannels; j++, fp2 += DEFDACBLKSIZE)
-                    {
-                        int s = *fp2 * 32767.;
-                        if (s > 32767) s = 32767;
-                        else if (s < -32767) s = -32767;
-                        sp[j] = s;
-                    }
-                }
+                for (j = 0, fp1 = STUFF->st_soundout + OSS_BLKSIZE * thischan;
+                    j < nchannels; j++, fp1 += OSS_BLKSIZE)
+                        sys_audio_topcm(fp1, (t_oss_int16 *)buf + j,
+                            OSS_BLKSIZE, nchannels, 2);
             }
             linux_dacs_write(linux_dacs[dev].d_fd, buf,
                 OSS_XFERSIZE(nchannels, linux_dacs[dev].d_bytespersamp));
@@ -745,13 +845,20 @@ int oss_send_dacs(void)
         thischan += nchannels;
     }
     memset(STUFF->st_soundout, 0,
-        STUFF->st_outchannels * (sizeof(t_sample) * DEFDACBLKSIZE));
+        STUFF->st_outchannels * (sizeof(t_sample) * OSS_BLKSIZE));
 
         /* do input */
 
     for (dev = 0, thischan = 0; dev < linux_nindevs; dev++)
     {
         int nchannels = linux_adcs[dev].d_nchannels;
+        if (linux_adcs[dev].d_drift)
+        {
+            oss_driftread(&linux_adcs[dev],
+                STUFF->st_soundin + thischan*OSS_BLKSIZE);
+            thischan += nchannels;
+            continue;
+        }
         linux_adcs_read(linux_adcs[dev].d_fd, buf,
             OSS_XFERSIZE(nchannels, linux_adcs[dev].d_bytespersamp));
 
@@ -766,12 +873,10 @@ int oss_send_dacs(void)
 
         if (linux_adcs[dev].d_bytespersamp == 2)
         {
-            for (i = DEFDACBLKSIZE,fp1 = STUFF->st_soundin + thischan*DEFDACBLKSIZE,
-                sp = (t_oss_int16 *)buf; i--; fp1++, sp += nchannels)
-            {
-                for (j=0;j<nchannels;j++)
-                    fp1[j*DEFDACBLKSIZE] = (t_sample)sp[j]*(t_sample)3.051850e-05;
-            }
+            for (j = 0, fp1 = STUFF->st_soundin + thischan*OSS_BLKSIZE;
+                j < nchannels; j++, fp1 += OSS_BLKSIZE)
+                    sys_audio_frompcm((t_oss_int16 *)buf + j, fp1,
+                        OSS_BLKSIZE, nchannels, 2);
         }
         thischan += nchannels;
      }
@@ -13,8 +13,9 @@
     works better in MAXOSX (gets 40 msec lower latency!) and might also in
     Windows.  If FAKEBLOCKING is defined we can choose between two methods
     for waiting on the (presumebly other-thread) I/O to complete, either
-    correct thread synchronization (by defining THREADSIGNAL) or just sleeping
-    and polling; the latter seems to work better so far.
+    blocking on a semaphore the callback posts (by defining THREADSIGNAL,
+    the default) or just sleeping and polling.  The semaphore wakes us
+    exactly when the FIFO moves instead of up to a sleep grain late.
 */
 
 /* dolist...
@@ -50,7 +51,9 @@
 #endif
 
 /* define this to enable thread signaling instead of polling */
-/* #define THREADSIGNAL */
+#define THREADSIGNAL
+
+#define PA_BLKSIZE (STUFF->st_schedblocksize)
 
     /* LATER try to figure out how to handle default devices in portaudio;
     the way s_audio.c handles them isn't going to work here. */
@@ -64,28 +67,104 @@ static t_sample *pa_soundin, *pa_soundout;
 static t_audiocallback pa_callback;
 
 static int pa_started;
+static int pa_threadset;    /* the callback thread has taken its role */
 static int pa_nbuffers;
 static int pa_dio_error;
 
 #ifdef FAKEBLOCKING
 #include "s_audio_paring.h"
-static PA_VOLATILE char *pa_outbuf;
-static PA_VOLATILE sys_ringbuf pa_outring;
-static PA_VOLATILE char *pa_inbuf;
-static PA_VOLATILE sys_ringbuf pa_inring;
+static char *pa_outbuf;
+static sys_ringbuf pa_outring;
+static char *pa_inbuf;
+static sys_ringbuf pa_inring;
 #ifdef THREADSIGNAL
-#include <pthread.h>
-#ifdef _WIN32
-#include <sys/timeb.h>
-#else
-#include <sys/time.h>
-#endif
-/* maximum time (in ms) to wait for the condition variable. */
+/* maximum time (in ms) to wait for the callback before giving up. */
 #ifndef THREADSIGNAL_TIMEOUT
 #define THREADSIGNAL_TIMEOUT 1000
 #endif
-static pthread_mutex_t pa_mutex;
-static pthread_cond_t pa_sem;
+    /* The callback posts this each time it has moved samples through the
+    FIFOs.  It's a counting semaphore, not a mutex and condition variable,
+    so that the audio thread never has to block to signal us. */
+#if defined(_WIN32)
+#include <windows.h>
+static HANDLE pa_wakeup;
+#elif defined(__APPLE__)
+#include <dispatch/dispatch.h>
+static dispatch_semaphore_t pa_wakeup;
+#else
+#include <semaphore.h>
+#include <errno.h>
+#include <time.h>
+static sem_t pa_wakeup;
+#endif
+static int pa_havewakeup;
+
+static void pa_wakeup_free(void)
+{
+    if (!pa_havewakeup)
+        return;
+#if defined(_WIN32)
+    CloseHandle(pa_wakeup);
+#elif defined(__APPLE__)
+    dispatch_release(pa_wakeup);
+#else
+    sem_destroy(&pa_wakeup);
+#endif
+    pa_havewakeup = 0;
+}
+
+static void pa_wakeup_init(void)
+{
+    pa_wakeup_free();
+#if defined(_WIN32)
+    pa_havewakeup = ((pa_wakeup = CreateSemaphore(0, 0, 0x7fffffff, 0)) != 0);
+#elif defined(__APPLE__)
+    pa_havewakeup = ((pa_wakeup = dispatch_semaphore_create(0)) != 0);
+#else
+    pa_havewakeup = (sem_init(&pa_wakeup, 0, 0) == 0);
+#endif
+    if (!pa_havewakeup)
+        error("portaudio: couldn't create semaphore");
+}
+
+    /* called from the audio callback */
+static void pa_wakeup_post(void)
+{
+    if (!pa_havewakeup)
+        return;
+#if defined(_WIN32)
+    ReleaseSemaphore(pa_wakeup, 1, 0);
+#elif defined(__APPLE__)
+    dispatch_semaphore_signal(pa_wakeup);
+#else
+    sem_post(&pa_wakeup);
+#endif
+}
+
+    /* wait up to 'ms' milliseconds for the callback; return 1 on timeout */
+static int pa_wakeup_wait(int ms)
+{
+#if defined(_WIN32)
+    return (!pa_havewakeup ||
+        WaitForSingleObject(pa_wakeup, ms) != WAIT_OBJECT_0);
+#elif defined(__APPLE__)
+    return (!pa_havewakeup || dispatch_semaphore_wait(pa_wakeup,
+        dispatch_time(DISPATCH_TIME_NOW, (int64_t)ms * NSEC_PER_MSEC)) != 0);
+#else
+    struct timespec ts;
+    int ret;
+    if (!pa_havewakeup)
+        return (1);
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += ms / 1000;
+    ts.tv_nsec += (long)(ms % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000)
+        ts.tv_sec++, ts.tv_nsec -= 1000000000;
+    while ((ret = sem_timedwait(&pa_wakeup, &ts)) < 0 && errno == EINTR)
+        ;
+    return (ret < 0);
+#endif
+}
 #else /* THREADSIGNAL */
 #if defined (FAKEBLOCKING) && defined(_WIN32)
 #include <windows.h>    /* for Sleep() */
@@ -141,34 +220,36 @@ static int pa_lowlevel_callback(const void *inputBuffer,
     unsigned int n, j;
     float *fbuf, *fp2, *fp3;
     t_sample *soundiop;
-    if (nframes % DEFDACBLKSIZE)
+    if (!pa_threadset)
+        sys_setthreadrole(SYS_THREAD_AUDIO), pa_threadset = 1;
+    if (nframes % PA_BLKSIZE)
     {
         post("warning: audio nframes %ld not a multiple of blocksize %d",
-            nframes, (int)DEFDACBLKSIZE);
-        nframes -= (nframes % DEFDACBLKSIZE);
+            nframes, (int)PA_BLKSIZE);
+        nframes -= (nframes % PA_BLKSIZE);
     }
-    for (n = 0; n < nframes; n += DEFDACBLKSIZE)
+    for (n = 0; n < nframes; n += PA_BLKSIZE)
     {
         if (inputBuffer != NULL)
         {
             fbuf = ((float *)inputBuffer) + n*pa_inchans;
             soundiop = pa_soundin;
             for (i = 0, fp2 = fbuf; i < pa_inchans; i++, fp2++)
-                    for (j = 0, fp3 = fp2; j < DEFDACBLKSIZE;
+                    for (j = 0, fp3 = fp2; j < PA_BLKSIZE;
                         j++, fp3 += pa_inchans)
                             *soundiop++ = (t_sample)*fp3;
         }
         else memset((void *)pa_soundin, 0,
-            DEFDACBLKSIZE * pa_inchans * sizeof(t_sample));
+            PA_BLKSIZE * pa_inchans * sizeof(t_sample));
         memset((void *)pa_soundout, 0,
-            DEFDACBLKSIZE * pa_outchans * sizeof(t_sample));
+            PA_BLKSIZE * pa_outchans * sizeof(t_sample));
         (*pa_callback)();
         if (outputBuffer != NULL)
         {
             fbuf = ((float *)outputBuffer) + n*pa_outchans;
             soundiop = pa_soundout;
             for (i = 0, fp2 = fbuf; i < pa_outchans; i++, fp2++)
-                for (j = 0, fp3 = fp2; j < DEFDACBLKSIZE;
+                for (j = 0, fp3 = fp2; j < PA_BLKSIZE;
                     j++, fp3 += pa_outchans)
                         *fp3 = (float)*soundiop++;
         }
@@ -183,8 +264,8 @@ static int pa_lowlevel_callback(const void *inputBuffer,
     we sync on, not waiting for it but supplying zeros to the audio output if
     there aren't enough samples in the FIFO when we are called), then write
     to the audio input FIFO.  The main thread will wait for the input fifo.
-    We can either throw it a pthreads condition or just allow the main thread
-    to poll for us; so far polling seems to work better. */
+    We either post it a semaphore or just allow the main thread to poll
+    for us. */
 static int pa_fifo_callback(const void *inputBuffer,
     void *outputBuffer, unsigned long nframes,
     const PaStreamCallbackTimeInfo *outTime, PaStreamCallbackFlags myflags,
@@ -196,6 +277,9 @@ static int pa_fifo_callback(const void *inputBuffer,
     long fiforoom;
     float *fbuf;
 
+    if (!pa_threadset)
+        sys_setthreadrole(SYS_THREAD_AUDIO), pa_threadset = 1;
+
 #if CHECKFIFOS
     if (pa_inchans * sys_ringbuf_getreadavailable(&pa_outring) !=
         pa_outchans * sys_ringbuf_getwriteavailable(&pa_inring))
@@ -233,9 +317,7 @@ static int pa_fifo_callback(const void *inputBuffer,
         }
     }
 #ifdef THREADSIGNAL
-    pthread_mutex_lock(&pa_mutex);
-    pthread_cond_signal(&pa_sem);
-    pthread_mutex_unlock(&pa_mutex);
+    pa_wakeup_post();
 #endif
     return 0;
 }
@@ -419,14 +501,14 @@ int pa_open_audio(int inchans, int outchans, int rate, t_sample *soundin,
     if (pa_outbuf)
         free((char *)pa_outbuf), pa_outbuf = 0;
 #ifdef THREADSIGNAL
-    pthread_mutex_init(&pa_mutex, 0);
-    pthread_cond_init(&pa_sem, 0);
+    pa_wakeup_init();
 #endif
 #endif
 
     if (! inchans && !outchans)
         return (0);
 
+    pa_threadset = 0;
     if (callbackfn)
     {
         pa_callback = callbackfn;
@@ -483,8 +565,7 @@ void pa_close_audio(void)
     if (pa_outbuf)
         free((char *)pa_outbuf), pa_outbuf = 0;
 #ifdef THREADSIGNAL
-    pthread_mutex_destroy(&pa_mutex);
-    pthread_cond_destroy(&pa_sem);
+    pa_wakeup_free();
 #endif
 #endif
 }
@@ -497,45 +578,24 @@ int pa_send_dacs(void)
     int j, k;
     int rtnval =  SENDDACS_YES;
     int locked = 0;
-    double timebefore;
-#ifdef FAKEBLOCKING
-#ifdef THREADSIGNAL
-    struct timespec ts;
-    double timeout;
-#ifdef _WIN32
-    struct __timeb64 tb;
-    _ftime64(&tb);
-    timeout = (double)tb.time + tb.millitm * 0.001;
-#else
-    struct timeval now;
-    gettimeofday(&now, 0);
-    timeout = (double)now.tv_sec + (1./1000000.) * now.tv_usec;
+#if !defined(FAKEBLOCKING) || !defined(THREADSIGNAL)
+    double timebefore = sys_getrealtime();
 #endif
-    timeout += THREADSIGNAL_TIMEOUT * 0.001;
-    ts.tv_sec = (long long)timeout;
-    ts.tv_nsec = (timeout - (double)ts.tv_sec) * 1e9;
-#else
-#endif /* THREADSIGNAL */
-#endif /* FAKEBLOCKING */
-    timebefore = sys_getrealtime();
 
     if ((!STUFF->st_inchannels && !STUFF->st_outchannels) || !pa_stream)
         return (SENDDACS_NO);
     conversionbuf = (float *)alloca((STUFF->st_inchannels > STUFF->st_outchannels?
-        STUFF->st_inchannels:STUFF->st_outchannels) * DEFDACBLKSIZE * sizeof(float));
+        STUFF->st_inchannels:STUFF->st_outchannels) * PA_BLKSIZE * sizeof(float));
 
 #ifdef FAKEBLOCKING
     if (!STUFF->st_inchannels)    /* if no input channels sync on output */
     {
-#ifdef THREADSIGNAL
-        pthread_mutex_lock(&pa_mutex);
-#endif
         while (sys_ringbuf_getwriteavailable(&pa_outring) <
-            (long)(STUFF->st_outchannels * DEFDACBLKSIZE * sizeof(float)))
+            (long)(STUFF->st_outchannels * PA_BLKSIZE * sizeof(float)))
         {
             rtnval = SENDDACS_SLEPT;
 #ifdef THREADSIGNAL
-            if (pthread_cond_timedwait(&pa_sem, &pa_mutex, &ts) == ETIMEDOUT)
+            if (pa_wakeup_wait(THREADSIGNAL_TIMEOUT))
             {
                 locked = 1;
                 break;
@@ -552,32 +612,28 @@ int pa_send_dacs(void)
                 return SENDDACS_NO;
 #endif /* THREADSIGNAL */
         }
-#ifdef THREADSIGNAL
-        pthread_mutex_unlock(&pa_mutex);
-#endif
     }
         /* write output */
     if (STUFF->st_outchannels && !locked)
     {
         for (j = 0, fp = STUFF->st_soundout, fp2 = conversionbuf;
             j < STUFF->st_outchannels; j++, fp2++)
-                for (k = 0, fp3 = fp2; k < DEFDACBLKSIZE;
+                for (k = 0, fp3 = fp2; k < PA_BLKSIZE;
                     k++, fp++, fp3 += STUFF->st_outchannels)
                         *fp3 = *fp;
         sys_ringbuf_write(&pa_outring, conversionbuf,
-            STUFF->st_outchannels*(DEFDACBLKSIZE*sizeof(float)), pa_outbuf);
+            STUFF->st_outchannels*(PA_BLKSIZE*sizeof(float)), pa_outbuf);
+        sys_tracefill(sys_ringbuf_getreadavailable(&pa_outring) /
+            (STUFF->st_outchannels * sizeof(float)));
     }
     if (STUFF->st_inchannels)    /* if there is input sync on it */
     {
-#ifdef THREADSIGNAL
-        pthread_mutex_lock(&pa_mutex);
-#endif
         while (sys_ringbuf_getreadavailable(&pa_inring) <
-            (long)(STUFF->st_inchannels * DEFDACBLKSIZE * sizeof(float)))
+            (long)(STUFF->st_inchannels * PA_BLKSIZE * sizeof(float)))
         {
             rtnval = SENDDACS_SLEPT;
 #ifdef THREADSIGNAL
-            if (pthread_cond_timedwait(&pa_sem, &pa_mutex, &ts) == ETIMEDOUT)
+            if (pa_wakeup_wait(THREADSIGNAL_TIMEOUT))
             {
                 locked = 1;
                 break;
@@ -594,17 +650,14 @@ int pa_send_dacs(void)
                 return SENDDACS_NO;
 #endif /* THREADSIGNAL */
         }
-#ifdef THREADSIGNAL
-        pthread_mutex_unlock(&pa_mutex);
-#endif
     }
     if (STUFF->st_inchannels && !locked)
     {
         sys_ringbuf_read(&pa_inring, conversionbuf,
-            STUFF->st_inchannels*(DEFDACBLKSIZE*sizeof(float)), pa_inbuf);
+            STUFF->st_inchannels*(PA_BLKSIZE*sizeof(float)), pa_inbuf);
         for (j = 0, fp = STUFF->st_soundin, fp2 = conversionbuf;
             j < STUFF->st_inchannels; j++, fp2++)
-                for (k = 0, fp3 = fp2; k < DEFDACBLKSIZE;
+                for (k = 0, fp3 = fp2; k < PA_BLKSIZE;
                     k++, fp++, fp3 += STUFF->st_inchannels)
                         *fp = *fp3;
     }
@@ -616,28 +669,28 @@ int pa_send_dacs(void)
         if (!pa_started)
         {
             memset(conversionbuf, 0,
-                STUFF->st_outchannels * DEFDACBLKSIZE * sizeof(float));
+                STUFF->st_outchannels * PA_BLKSIZE * sizeof(float));
             for (j = 0; j < pa_nbuffers-1; j++)
-                Pa_WriteStream(pa_stream, conversionbuf, DEFDACBLKSIZE);
+                Pa_WriteStream(pa_stream, conversionbuf, PA_BLKSIZE);
         }
         for (j = 0, fp = STUFF->st_soundout, fp2 = conversionbuf;
             j < STUFF->st_outchannels; j++, fp2++)
-                for (k = 0, fp3 = fp2; k < DEFDACBLKSIZE;
+                for (k = 0, fp3 = fp2; k < PA_BLKSIZE;
                     k++, fp++, fp3 += STUFF->st_outchannels)
                         *fp3 = *fp;
-        if (Pa_WriteStream(pa_stream, conversionbuf, DEFDACBLKSIZE) != paNoError)
+        if (Pa_WriteStream(pa_stream, conversionbuf, PA_BLKSIZE) != paNoError)
             if (Pa_IsStreamActive(&pa_stream) < 0)
                 locked = 1;
     }
 
     if (STUFF->st_inchannels)
     {
-        if (Pa_ReadStream(pa_stream, conversionbuf, DEFDACBLKSIZE) != paNoError)
+        if (Pa_ReadStream(pa_stream, conversionbuf, PA_BLKSIZE) != paNoError)
             if (Pa_IsStreamActive(&pa_stream) < 0)
                 locked = 1;
         for (j = 0, fp = STUFF->st_soundin, fp2 = conversionbuf;
             j < STUFF->st_inchannels; j++, fp2++)
-                for (k = 0, fp3 = fp2; k < DEFDACBLKSIZE;
+                for (k = 0, fp3 = fp2; k < PA_BLKSIZE;
                     k++, fp++, fp3 += STUFF->st_inchannels)
                         *fp = *fp3;
     }
@@ -649,7 +702,7 @@ int pa_send_dacs(void)
     pa_started = 1;
 
     memset(STUFF->st_soundout, 0,
-        DEFDACBLKSIZE*sizeof(t_sample)*STUFF->st_outchannels);
+        PA_BLKSIZE*sizeof(t_sample)*STUFF->st_outchannels);
     if (locked)
     {
         PaError err = Pa_IsStreamActive(&pa_stream);
@@ -38,218 +38,141 @@
  */
 
 #include <stdio.h>
-#include <stdlib.h>
-#include <math.h>
-#include "s_audio_paring.h"
 #include <string.h>
+#include "s_audio_paring.h"
 
-/* Clear buffer. Should only be called when buffer is NOT being read. */
-static void sys_ringbuf_Flush(PA_VOLATILE sys_ringbuf *rbuf,
-    PA_VOLATILE void *dataPtr, long nfill);
-
-/* Get address of region(s) to which we can write data.
-** If the region is contiguous, size2 will be zero.
-** If non-contiguous, size2 will be the size of second region.
-** Returns room available to be written or numBytes, whichever is smaller.
-*/
-static long sys_ringbuf_GetWriteRegions(PA_VOLATILE  sys_ringbuf *rbuf,
-    long numBytes, PA_VOLATILE void **dataPtr1, long *sizePtr1,
-    PA_VOLATILE void **dataPtr2, long *sizePtr2, PA_VOLATILE char *buffer);
-static long sys_ringbuf_AdvanceWriteIndex(PA_VOLATILE sys_ringbuf *rbuf,
-    long numBytes);
-
-/* Get address of region(s) from which we can read data.
-** If the region is contiguous, size2 will be zero.
-** If non-contiguous, size2 will be the size of second region.
-** Returns room available to be read or numBytes, whichever is smaller.
-*/
-static long sys_ringbuf_GetReadRegions(PA_VOLATILE sys_ringbuf *rbuf,
-    long numBytes, PA_VOLATILE void **dataPtr1, long *sizePtr1,
-    PA_VOLATILE void **dataPtr2, long *sizePtr2, PA_VOLATILE char *buffer);
-
-static long sys_ringbuf_AdvanceReadIndex(PA_VOLATILE sys_ringbuf *rbuf,
-    long numBytes );
+/* Indices run from 0 to 2*bufferSize-1 so that a full buffer can be told
+from an empty one.  The writer owns writeIndex and the reader readIndex;
+each loads its own index relaxed and the other's with acquire ordering, and
+stores its own with release ordering after it's done touching the data. */
 
-/***************************************************************************
- * Initialize FIFO.
- */
-long sys_ringbuf_init(PA_VOLATILE sys_ringbuf *rbuf, long numBytes,
-    PA_VOLATILE char *dataPtr, long nfill)
+#if defined(SYS_RINGBUF_C11)
+#define RB_LOADOWN(p) atomic_load_explicit((p), memory_order_relaxed)
+#define RB_LOAD(p) atomic_load_explicit((p), memory_order_acquire)
+#define RB_STORE(p, v) atomic_store_explicit((p), (v), memory_order_release)
+#elif defined(__GNUC__)
+#define RB_LOADOWN(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#define RB_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define RB_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#elif defined(_MSC_VER)
+#include <windows.h>
+static long rb_load(volatile long *p)
 {
-    rbuf->bufferSize = numBytes;
-    sys_ringbuf_Flush(rbuf, dataPtr,  nfill);
-    return 0;
+    long v = *p;
+    MemoryBarrier();
+    return (v);
 }
-/***************************************************************************
-** Return number of bytes available for reading. */
-long sys_ringbuf_getreadavailable(PA_VOLATILE sys_ringbuf *rbuf)
+static void rb_store(volatile long *p, long v)
 {
-    long ret = rbuf->writeIndex - rbuf->readIndex;
+    MemoryBarrier();
+    *p = v;
+}
+#define RB_LOADOWN(p) (*(p))
+#define RB_LOAD(p) rb_load(p)
+#define RB_STORE(p, v) rb_store((p), (v))
+#else
+#error "no atomics for sys_ringbuf on this compiler"
+#endif
+
+static long sys_ringbuf_distance(sys_ringbuf *rbuf, long writeIndex,
+    long readIndex)
+{
+    long ret = writeIndex - readIndex;
     if (ret < 0)
         ret += 2 * rbuf->bufferSize;
     if (ret < 0 || ret > rbuf->bufferSize)
         fprintf(stderr,
             "consistency check failed: sys_ringbuf_getreadavailable\n");
-    return ( ret );
-}
-/***************************************************************************
-** Return number of bytes available for writing. */
-long sys_ringbuf_getwriteavailable(PA_VOLATILE sys_ringbuf *rbuf)
-{
-    return ( rbuf->bufferSize - sys_ringbuf_getreadavailable(rbuf));
+    return (ret);
 }
 
-/***************************************************************************
-** Clear buffer. Should only be called when buffer is NOT being read. */
-static void sys_ringbuf_Flush(PA_VOLATILE sys_ringbuf *rbuf,
-    PA_VOLATILE void *dataPtr, long nfill)
+static long sys_ringbuf_advance(sys_ringbuf *rbuf, long index, long numBytes)
 {
-    PA_VOLATILE char *s;
-    long n;
-    rbuf->readIndex = 0;
-    rbuf->writeIndex = nfill;
-    for (n = nfill, s = dataPtr; n--; s++)
-        *s = 0;
+    index += numBytes;
+    if (index >= 2 * rbuf->bufferSize)
+        index -= 2 * rbuf->bufferSize;
+    return (index);
 }
 
 /***************************************************************************
-** Get address of region(s) to which we can write data.
-** If the region is contiguous, size2 will be zero.
-** If non-contiguous, size2 will be the size of second region.
-** Returns room available to be written or numBytes, whichever is smaller.
-*/
-static long sys_ringbuf_GetWriteRegions(PA_VOLATILE  sys_ringbuf *rbuf,
-    long numBytes, PA_VOLATILE void **dataPtr1, long *sizePtr1,
-    PA_VOLATILE void **dataPtr2, long *sizePtr2, PA_VOLATILE char *buffer)
+ * Initialize FIFO.
+ */
+long sys_ringbuf_init(sys_ringbuf *rbuf, long numBytes, char *dataPtr,
+    long nfill)
 {
-    long   index;
-    long   available = sys_ringbuf_getwriteavailable( rbuf );
-    if( numBytes > available ) numBytes = available;
-    /* Check to see if write is not contiguous. */
-    index = rbuf->writeIndex;
-    while (index >= rbuf->bufferSize)
-        index -= rbuf->bufferSize;
-    if( (index + numBytes) > rbuf->bufferSize )
-    {
-        /* Write data in two blocks that wrap the buffer. */
-        long   firstHalf = rbuf->bufferSize - index;
-        *dataPtr1 = &buffer[index];
-        *sizePtr1 = firstHalf;
-        *dataPtr2 = &buffer[0];
-        *sizePtr2 = numBytes - firstHalf;
-    }
-    else
-    {
-        *dataPtr1 = &buffer[index];
-        *sizePtr1 = numBytes;
-        *dataPtr2 = NULL;
-        *sizePtr2 = 0;
-    }
-    return numBytes;
+    rbuf->bufferSize = numBytes;
+    memset(dataPtr, 0, nfill);
+    RB_STORE(&rbuf->readIndex, 0);
+    RB_STORE(&rbuf->writeIndex, nfill);
+    return 0;
 }
 
-
 /***************************************************************************
-*/
-static long sys_ringbuf_AdvanceWriteIndex(PA_VOLATILE sys_ringbuf *rbuf,
-    long numBytes)
+** Return number of bytes available for reading.  Either thread may ask. */
+long sys_ringbuf_getreadavailable(sys_ringbuf *rbuf)
 {
-    long ret = (rbuf->writeIndex + numBytes);
-    if ( ret >= 2 * rbuf->bufferSize)
-        ret -= 2 * rbuf->bufferSize;    /* check for end of buffer */
-    return rbuf->writeIndex = ret;
+    long readIndex = RB_LOAD(&rbuf->readIndex);
+    return (sys_ringbuf_distance(rbuf, RB_LOAD(&rbuf->writeIndex),
+        readIndex));
 }
 
 /***************************************************************************
-** Get address of region(s) from which we can read data.
-** If the region is contiguous, size2 will be zero.
-** If non-contiguous, size2 will be the size of second region.
-** Returns room available to be written or numBytes, whichever is smaller.
-*/
-static long sys_ringbuf_GetReadRegions(PA_VOLATILE sys_ringbuf *rbuf,
-    long numBytes, PA_VOLATILE void **dataPtr1, long *sizePtr1,
-    PA_VOLATILE void **dataPtr2, long *sizePtr2, PA_VOLATILE char *buffer)
-{
-    long   index;
-    long   available = sys_ringbuf_getreadavailable( rbuf );
-    if( numBytes > available ) numBytes = available;
-    /* Check to see if read is not contiguous. */
-    index = rbuf->readIndex;
-    while (index >= rbuf->bufferSize)
-        index -= rbuf->bufferSize;
-
-    if( (index + numBytes) > rbuf->bufferSize )
-    {
-        /* Write data in two blocks that wrap the buffer. */
-        long firstHalf = rbuf->bufferSize - index;
-        *dataPtr1 = &buffer[index];
-        *sizePtr1 = firstHalf;
-        *dataPtr2 = &buffer[0];
-        *sizePtr2 = numBytes - firstHalf;
-    }
-    else
-    {
-        *dataPtr1 = &buffer[index];
-        *sizePtr1 = numBytes;
-        *dataPtr2 = NULL;
-        *sizePtr2 = 0;
-    }
-    return numBytes;
-}
-/***************************************************************************
-*/
-static long sys_ringbuf_AdvanceReadIndex(PA_VOLATILE sys_ringbuf *rbuf,
-    long numBytes)
+** Return number of bytes available for writing. */
+long sys_ringbuf_getwriteavailable(sys_ringbuf *rbuf)
 {
-    long ret = (rbuf->readIndex + numBytes);
-    if( ret >= 2 * rbuf->bufferSize)
-        ret -= 2 * rbuf->bufferSize;
-    return rbuf->readIndex = ret;
+    return (rbuf->bufferSize - sys_ringbuf_getreadavailable(rbuf));
 }
 
 /***************************************************************************
-** Return bytes written. */
-long sys_ringbuf_write(PA_VOLATILE sys_ringbuf *rbuf, const void *data,
-    long numBytes, PA_VOLATILE char *buffer)
+** Return bytes written.  Only the writing thread may call this. */
+long sys_ringbuf_write(sys_ringbuf *rbuf, const void *data, long numBytes,
+    char *buffer)
 {
-    long size1, size2, numWritten;
-    PA_VOLATILE void *data1, *data2;
-    numWritten = sys_ringbuf_GetWriteRegions( rbuf, numBytes, &data1, &size1,
-        &data2, &size2, buffer);
-    if( size2 > 0 )
-    {
-
-        memcpy((void *)data1, data, size1 );
-        data = ((char *)data) + size1;
-        memcpy((void *)data2, data, size2 );
-    }
+    long writeIndex = RB_LOADOWN(&rbuf->writeIndex), index, size1,
+        room = rbuf->bufferSize - sys_ringbuf_distance(rbuf, writeIndex,
+            RB_LOAD(&rbuf->readIndex));
+    if (numBytes > room)
+        numBytes = room;
+    if (numBytes <= 0)
+        return (0);
+    index = (writeIndex >= rbuf->bufferSize ?
+        writeIndex - rbuf->bufferSize : writeIndex);
+    size1 = rbuf->bufferSize - index;
+    if (size1 >= numBytes)
+        memcpy(buffer + index, data, numBytes);
     else
     {
-        memcpy((void *)data1, data, size1 );
+        memcpy(buffer + index, data, size1);
+        memcpy(buffer, (const char *)data + size1, numBytes - size1);
     }
-    sys_ringbuf_AdvanceWriteIndex( rbuf, numWritten );
-    return numWritten;
+    RB_STORE(&rbuf->writeIndex,
+        sys_ringbuf_advance(rbuf, writeIndex, numBytes));
+    return (numBytes);
 }
 
 /***************************************************************************
-** Return bytes read. */
-long sys_ringbuf_read(PA_VOLATILE sys_ringbuf *rbuf, void *data, long numBytes,
-    PA_VOLATILE char *buffer)
+** Return bytes read.  Only the reading thread may call this. */
+long sys_ringbuf_read(sys_ringbuf *rbuf, void *data, long numBytes,
+    char *buffer)
 {
-    long size1, size2, numRead;
-    PA_VOLATILE void *data1, *data2;
-    numRead = sys_ringbuf_GetReadRegions( rbuf, numBytes, &data1, &size1,
-        &data2, &size2, buffer);
-    if( size2 > 0 )
-    {
-        memcpy(data, (void *)data1, size1 );
-        data = ((char *)data) + size1;
-        memcpy(data, (void *)data2, size2 );
-    }
+    long readIndex = RB_LOADOWN(&rbuf->readIndex), index, size1,
+        avail = sys_ringbuf_distance(rbuf, RB_LOAD(&rbuf->writeIndex),
+            readIndex);
+    if (numBytes > avail)
+        numBytes = avail;
+    if (numBytes <= 0)
+        return (0);
+    index = (readIndex >= rbuf->bufferSize ?
+        readIndex - rbuf->bufferSize : readIndex);
+    size1 = rbuf->bufferSize - index;
+    if (size1 >= numBytes)
+        memcpy(data, buffer + index, numBytes);
     else
     {
-        memcpy( data, (void *)data1, size1 );
+        memcpy(data, buffer + index, size1);
+        memcpy((char *)data + size1, buffer, numBytes - size1);
     }
-    sys_ringbuf_AdvanceReadIndex( rbuf, numRead );
-    return numRead;
+    RB_STORE(&rbuf->readIndex,
+        sys_ringbuf_advance(rbuf, readIndex, numBytes));
+    return (numBytes);
 }
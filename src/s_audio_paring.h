@@ -40,34 +40,46 @@ extern "C"
  *
  */
 
-/* If it's ever desired to use shared memory so that one process reads and
-another one writes to the same ring buffer, define this as 'volatile' : */
-#define PA_VOLATILE
+/* This is a single-producer, single-consumer FIFO: one thread may call
+sys_ringbuf_write() while another calls sys_ringbuf_read(), with no lock.
+Each side publishes its own index with release ordering and reads the
+other's with acquire ordering, so the bytes behind an index are always in
+memory by the time the other thread sees it move. */
+
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && \
+    !defined(__STDC_NO_ATOMICS__) && !defined(__cplusplus)
+#include <stdatomic.h>
+#define SYS_RINGBUF_C11
+typedef atomic_long sys_ringbuf_index;
+#else
+typedef volatile long sys_ringbuf_index;
+#endif
 
 typedef struct
 {
-    long   bufferSize;              /* Number of bytes in FIFO.
+    long bufferSize;                /* Number of bytes in FIFO.
                                         Set by sys_ringbuf_init */
-    PA_VOLATILE long   writeIndex; /* Index of next writable byte.
-                                        Set by sys_ringbuf_AdvanceWriteIndex */
-    PA_VOLATILE long   readIndex;  /* Index of next readable byte.
-                                        Set by sys_ringbuf_AdvanceReadIndex */
+    sys_ringbuf_index writeIndex;   /* Index of next writable byte,
+                                        only changed by the writer */
+    sys_ringbuf_index readIndex;    /* Index of next readable byte,
+                                        only changed by the reader */
 } sys_ringbuf;
 
-/* Initialize Ring Buffer. */
-long sys_ringbuf_init(PA_VOLATILE sys_ringbuf *rbuf, long numBytes,
-    PA_VOLATILE char *dataPtr, long nfill);
+/* Initialize Ring Buffer, with the first 'nfill' bytes zeroed and readable.
+Neither thread may be using it at the time. */
+long sys_ringbuf_init(sys_ringbuf *rbuf, long numBytes, char *dataPtr,
+    long nfill);
 
 /* Return number of bytes available for writing. */
-long sys_ringbuf_getwriteavailable(PA_VOLATILE sys_ringbuf *rbuf);
+long sys_ringbuf_getwriteavailable(sys_ringbuf *rbuf);
 /* Return number of bytes available for read. */
-long sys_ringbuf_getreadavailable(PA_VOLATILE sys_ringbuf *rbuf);
+long sys_ringbuf_getreadavailable(sys_ringbuf *rbuf);
 /* Return bytes written. */
-long sys_ringbuf_write(PA_VOLATILE sys_ringbuf *rbuf, const void *data,
-    long numBytes, PA_VOLATILE char *buffer);
+long sys_ringbuf_write(sys_ringbuf *rbuf, const void *data, long numBytes,
+    char *buffer);
 /* Return bytes read. */
-long sys_ringbuf_read(PA_VOLATILE sys_ringbuf *rbuf, void *data, long numBytes,
-    PA_VOLATILE char *buffer);
+long sys_ringbuf_read(sys_ringbuf *rbuf, void *data, long numBytes,
+    char *buffer);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,849 @@
+/* Copyright (c) 1997-2010 Miller Puckette and others.
+* For information on usage and redistribution, and for a DISCLAIMER OF ALL
+* WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
+
+/* Audio back-end for the Windows Audio Session API (Vista and later).
+
+We ask for exclusive mode first, in which we own the device and it
+signals us once per hardware period, so that the latency is about two
+periods (a few milliseconds on most hardware).  If the device is busy or
+exclusive mode isn't allowed we fall back to shared mode, which goes
+through the system mixer and costs another 10 msec or so.  Either way a
+thread of ours waits on the device's event, with "Pro Audio" scheduling
+from the MMCSS service.  With "-callback" that thread computes DSP itself
+(as the JACK and AudioUnit back ends do); otherwise it trades samples with
+the scheduler through lock-free rings, as portaudio does.
+
+Capture and render are separate endpoints, with clocks that aren't
+necessarily the same, so input always comes through a ring: each time the
+thread wakes up it first takes whatever the capture device has, then fills
+the render buffer. */
+
+#ifdef USEAPI_WASAPI
+
+#define COBJMACROS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <windows.h>
+#include <mmreg.h>
+#include <objbase.h>
+#include <mmdeviceapi.h>
+#include <audioclient.h>
+#include "m_pd.h"
+#include "s_stuff.h"
+#include "s_audio_paring.h"
+
+#define WASAPI_BLKSIZE (STUFF->st_schedblocksize)
+#define WASAPI_MAXCHANS 64
+#define WASAPI_MAXDEV 64
+#define WASAPI_MAXFRAMES 8192   /* largest device buffer we'll accept */
+#define WASAPI_POLLTIMEOUT 1.   /* seconds to wait in wasapi_send_dacs() */
+#define WASAPI_WAIT 200         /* msec to wait for the device's event */
+
+    /* spelled out here so we needn't link with uuid.lib or ksuser.lib */
+static const CLSID wasapi_clsid_enumerator = {0xbcde0395, 0xe52f, 0x467c,
+    {0x8e, 0x3d, 0xc4, 0x57, 0x92, 0x91, 0x69, 0x2e}};
+static const IID wasapi_iid_enumerator = {0xa95664d2, 0x9614, 0x4f35,
+    {0xa7, 0x46, 0xde, 0x8d, 0xb6, 0x36, 0x17, 0xe6}};
+static const IID wasapi_iid_client = {0x1cb9ad4c, 0xdbfa, 0x4c32,
+    {0xb1, 0x78, 0xc2, 0xf5, 0x68, 0xa7, 0x03, 0xb2}};
+static const IID wasapi_iid_render = {0xf294acfc, 0x3146, 0x4483,
+    {0xa7, 0xbf, 0xad, 0xdc, 0xa7, 0xc2, 0x60, 0xe2}};
+static const IID wasapi_iid_capture = {0xc8adbd64, 0xe71e, 0x48a0,
+    {0xa4, 0xde, 0x18, 0x5c, 0x39, 0x5c, 0xd3, 0x17}};
+static const GUID wasapi_subtype_float = {0x00000003, 0x0000, 0x0010,
+    {0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71}};
+static const GUID wasapi_subtype_pcm = {0x00000001, 0x0000, 0x0010,
+    {0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71}};
+static const PROPERTYKEY wasapi_key_name = {{0xa45c254e, 0xdf1c, 0x4efd,
+    {0x80, 0x20, 0x67, 0xd1, 0x46, 0xa8, 0x50, 0xe0}}, 14};
+
+    /* sample formats we can talk to the device in */
+#define WASAPI_FLOAT32 0
+#define WASAPI_INT32 1      /* including 24 bits in 32 */
+#define WASAPI_INT16 2
+
+    /* one endpoint, either direction */
+typedef struct _wasapi_dev
+{
+    IAudioClient *d_client;
+    IAudioRenderClient *d_render;
+    IAudioCaptureClient *d_capture;
+    HANDLE d_event;
+    int d_nchans;           /* channels as the device has them */
+    int d_format;           /* WASAPI_FLOAT32, etc. */
+    int d_bytesperframe;
+    UINT32 d_bufframes;     /* size of the device's buffer */
+    int d_exclusive;
+} t_wasapi_dev;
+
+static t_wasapi_dev wasapi_in, wasapi_out;
+static int wasapi_inchans, wasapi_outchans;
+static t_audiocallback wasapi_callback;
+static pthread_t wasapi_thread;
+static int wasapi_threadrunning;
+static volatile int wasapi_quit;
+static volatile int wasapi_dio_error;
+static volatile int wasapi_isopen;
+
+    /* interleaved float frames: input from the capture side, and in
+    polling mode output from Pd to the render side */
+static sys_ringbuf wasapi_inring, wasapi_outring;
+static char *wasapi_inbuf, *wasapi_outbuf;
+static long wasapi_inbufsize, wasapi_outbufsize;
+static float *wasapi_scratch;       /* audio thread's, interleaved */
+static float *wasapi_sendscratch;   /* wasapi_send_dacs()'s, interleaved */
+
+    /* callback mode: how far we are into the block last computed */
+static int wasapi_blockpos;
+static int wasapi_buffered;
+
+/* --------------------- devices ------------------------- */
+
+static void wasapi_initcom(void)
+{
+        /* S_FALSE or RPC_E_CHANGED_MODE just mean it's already done */
+    CoInitializeEx(0, COINIT_MULTITHREADED);
+}
+
+static IMMDeviceEnumerator *wasapi_enumerator(void)
+{
+    IMMDeviceEnumerator *e = 0;
+    wasapi_initcom();
+    if (FAILED(CoCreateInstance(&wasapi_clsid_enumerator, 0, CLSCTX_ALL,
+        &wasapi_iid_enumerator, (void **)&e)))
+            return (0);
+    return (e);
+}
+
+static int wasapi_sameid(IMMDevice *a, IMMDevice *b)
+{
+    LPWSTR ida = 0, idb = 0;
+    int same = 0;
+    if (SUCCEEDED(IMMDevice_GetId(a, &ida)) &&
+        SUCCEEDED(IMMDevice_GetId(b, &idb)))
+            same = !wcscmp(ida, idb);
+    if (ida)
+        CoTaskMemFree(ida);
+    if (idb)
+        CoTaskMemFree(idb);
+    return (same);
+}
+
+    /* list active endpoints in one direction with the system's default
+    first, so that Pd's default device number 0 picks it.  The caller
+    releases them. */
+static int wasapi_listdevices(IMMDevice **devs, int maxdev, int input)
+{
+    IMMDeviceEnumerator *e = wasapi_enumerator();
+    IMMDeviceCollection *coll = 0;
+    IMMDevice *def = 0;
+    UINT count = 0, i;
+    int n = 0;
+    EDataFlow flow = (input ? eCapture : eRender);
+    if (!e)
+        return (0);
+    if (SUCCEEDED(IMMDeviceEnumerator_GetDefaultAudioEndpoint(e, flow,
+        eConsole, &def)) && n < maxdev)
+            devs[n++] = def;
+    if (SUCCEEDED(IMMDeviceEnumerator_EnumAudioEndpoints(e, flow,
+        DEVICE_STATE_ACTIVE, &coll)))
+    {
+        IMMDeviceCollection_GetCount(coll, &count);
+        for (i = 0; i < count && n < maxdev; i++)
+        {
+            IMMDevice *dev;
+            if (FAILED(IMMDeviceCollection_Item(coll, i, &dev)))
+                continue;
+            if (def && wasapi_sameid(dev, def))
+                IMMDevice_Release(dev);
+            else devs[n++] = dev;
+        }
+        IMMDeviceCollection_Release(coll);
+    }
+    IMMDeviceEnumerator_Release(e);
+    return (n);
+}
+
+static void wasapi_releasedevices(IMMDevice **devs, int n)
+{
+    int i;
+    for (i = 0; i < n; i++)
+        IMMDevice_Release(devs[i]);
+}
+
+static void wasapi_devname(IMMDevice *dev, char *buf, int bufsize)
+{
+    IPropertyStore *props = 0;
+    PROPVARIANT var;
+    *buf = 0;
+    PropVariantInit(&var);
+    if (SUCCEEDED(IMMDevice_OpenPropertyStore(dev, STGM_READ, &props)))
+    {
+        if (SUCCEEDED(IPropertyStore_GetValue(props, &wasapi_key_name,
+            &var)) && var.vt == VT_LPWSTR)
+                WideCharToMultiByte(CP_UTF8, 0, var.pwszVal, -1, buf,
+                    bufsize, 0, 0);
+        PropVariantClear(&var);
+        IPropertyStore_Release(props);
+    }
+    if (!*buf)
+        strncpy(buf, "(unnamed device)", bufsize);
+    buf[bufsize-1] = 0;
+}
+
+/* --------------------- sample conversion --------------------- */
+
+    /* device buffer to interleaved floats, taking the first "nchans"
+    channels (or padding with zeros) */
+static void wasapi_fromdevice(t_wasapi_dev *d, const BYTE *src, float *dst,
+    int nchans, UINT32 nframes)
+{
+    UINT32 i;
+    int ch;
+    for (i = 0; i < nframes; i++, src += d->d_bytesperframe)
+        for (ch = 0; ch < nchans; ch++)
+    {
+        if (ch >= d->d_nchans)
+            *dst++ = 0;
+        else if (d->d_format == WASAPI_FLOAT32)
+            *dst++ = ((const float *)src)[ch];
+        else if (d->d_format == WASAPI_INT32)
+            *dst++ = ((const INT32 *)src)[ch] * (1.f / 2147483648.f);
+        else *dst++ = ((const INT16 *)src)[ch] * (1.f / 32768.f);
+    }
+}
+
+    /* interleaved floats to device buffer, clipping for integer formats */
+static void wasapi_todevice(t_wasapi_dev *d, const float *src, BYTE *dst,
+    int nchans, UINT32 nframes)
+{
+    UINT32 i;
+    int ch;
+    for (i = 0; i < nframes; i++, dst += d->d_bytesperframe, src += nchans)
+        for (ch = 0; ch < d->d_nchans; ch++)
+    {
+        float f = (ch < nchans ? src[ch] : 0);
+        if (d->d_format == WASAPI_FLOAT32)
+            ((float *)dst)[ch] = f;
+        else
+        {
+            if (f > 1)
+                f = 1;
+            else if (f < -1)
+                f = -1;
+            if (d->d_format == WASAPI_INT32)
+                ((INT32 *)dst)[ch] = (INT32)(f * 2147483647.);
+            else ((INT16 *)dst)[ch] = (INT16)(f * 32767.f);
+        }
+    }
+}
+
+/* --------------------- the audio thread --------------------- */
+
+    /* take everything the capture device has into wasapi_inring */
+static void wasapi_docapture(void)
+{
+    BYTE *data;
+    UINT32 nframes, packet;
+    DWORD flags;
+    long nbytes;
+    while (SUCCEEDED(IAudioCaptureClient_GetNextPacketSize(
+        wasapi_in.d_capture, &packet)) && packet)
+    {
+        if (FAILED(IAudioCaptureClient_GetBuffer(wasapi_in.d_capture,
+            &data, &nframes, &flags, 0, 0)))
+                return;
+        if (nframes > WASAPI_MAXFRAMES)
+            nframes = WASAPI_MAXFRAMES;
+        if (flags & AUDCLNT_BUFFERFLAGS_SILENT)
+            memset(wasapi_scratch, 0,
+                nframes * wasapi_inchans * sizeof(float));
+        else wasapi_fromdevice(&wasapi_in, data, wasapi_scratch,
+            wasapi_inchans, nframes);
+        if (flags & AUDCLNT_BUFFERFLAGS_DATA_DISCONTINUITY)
+            wasapi_dio_error = 1;
+        IAudioCaptureClient_ReleaseBuffer(wasapi_in.d_capture, nframes);
+        nbytes = nframes * wasapi_inchans * sizeof(float);
+        if (sys_ringbuf_getwriteavailable(&wasapi_inring) >= nbytes)
+            sys_ringbuf_write(&wasapi_inring, wasapi_scratch, nbytes,
+                wasapi_inbuf);
+        else wasapi_dio_error = 1;  /* nobody's reading; drop it */
+    }
+}
+
+    /* get "nframes" of input from the ring into "buf", or zeros if it
+    hasn't arrived yet */
+static void wasapi_getinput(float *buf, UINT32 nframes)
+{
+    long nbytes = nframes * wasapi_inchans * sizeof(float);
+    if (!wasapi_inchans)
+        return;
+    if (sys_ringbuf_getreadavailable(&wasapi_inring) >= nbytes)
+        sys_ringbuf_read(&wasapi_inring, buf, nbytes, wasapi_inbuf);
+    else
+    {
+        memset(buf, 0, nbytes);
+        wasapi_dio_error = 1;
+    }
+}
+
+static void wasapi_tick(void)
+{
+    memset(STUFF->st_soundout, 0,
+        wasapi_outchans * WASAPI_BLKSIZE * sizeof(t_sample));
+    (*wasapi_callback)();
+}
+
+    /* trade "n" frames between interleaved buffers and Pd's sound arrays,
+    which hold one block per channel, starting "pos" into the block */
+static void wasapi_copyin(const float *in, int pos, int n)
+{
+    int chan, j;
+    for (chan = 0; chan < wasapi_inchans; chan++)
+    {
+        t_sample *fp = STUFF->st_soundin + chan*WASAPI_BLKSIZE + pos;
+        const float *sp = in + chan;
+        for (j = 0; j < n; j++, sp += wasapi_inchans)
+            *fp++ = *sp;
+    }
+}
+
+static void wasapi_copyout(float *out, int pos, int n)
+{
+    int chan, j;
+    for (chan = 0; chan < wasapi_outchans; chan++)
+    {
+        t_sample *fp = STUFF->st_soundout + chan*WASAPI_BLKSIZE + pos;
+        float *sp = out + chan;
+        for (j = 0; j < n; j++, sp += wasapi_outchans)
+            *sp = *fp++;
+    }
+}
+
+    /* callback mode: compute "nframes" of output into wasapi_scratch, as
+    in callbackprocess() in s_audio_jack.c.  The input is in "in". */
+static void wasapi_compute(const float *in, UINT32 nframes)
+{
+    UINT32 n, len;
+    float *out = wasapi_scratch;
+    if (!wasapi_blockpos && !(nframes % WASAPI_BLKSIZE))
+    {
+        wasapi_buffered = 0;
+        for (n = 0; n < nframes; n += WASAPI_BLKSIZE)
+        {
+            wasapi_copyin(in + n * wasapi_inchans, 0, WASAPI_BLKSIZE);
+            wasapi_tick();
+            wasapi_copyout(out + n * wasapi_outchans, 0, WASAPI_BLKSIZE);
+        }
+        return;
+    }
+    if (!wasapi_buffered)
+    {
+            /* the last block has already gone out */
+        memset(STUFF->st_soundout, 0,
+            wasapi_outchans * WASAPI_BLKSIZE * sizeof(t_sample));
+        wasapi_buffered = 1;
+    }
+    for (n = 0; n < nframes; n += len)
+    {
+        len = WASAPI_BLKSIZE - wasapi_blockpos;
+        if (len > nframes - n)
+            len = nframes - n;
+        wasapi_copyin(in + n * wasapi_inchans, wasapi_blockpos, len);
+        wasapi_copyout(out + n * wasapi_outchans, wasapi_blockpos, len);
+        if ((wasapi_blockpos += len) == WASAPI_BLKSIZE)
+        {
+            wasapi_tick();
+            wasapi_blockpos = 0;
+        }
+    }
+}
+
+    /* fill what the render device has room for */
+static void wasapi_dorender(float *inscratch)
+{
+    UINT32 nframes, padding = 0;
+    BYTE *data;
+    if (wasapi_out.d_exclusive)
+        nframes = wasapi_out.d_bufframes;
+    else
+    {
+        if (FAILED(IAudioClient_GetCurrentPadding(wasapi_out.d_client,
+            &padding)))
+                return;
+        nframes = wasapi_out.d_bufframes - padding;
+    }
+    if (!nframes)
+        return;
+    if (nframes > WASAPI_MAXFRAMES)
+        nframes = WASAPI_MAXFRAMES;
+    if (FAILED(IAudioRenderClient_GetBuffer(wasapi_out.d_render, nframes,
+        &data)))
+            return;
+    if (wasapi_callback)
+    {
+        wasapi_getinput(inscratch, nframes);
+        wasapi_compute(inscratch, nframes);
+    }
+    else
+    {
+        long nbytes = nframes * wasapi_outchans * sizeof(float);
+        if (sys_ringbuf_getreadavailable(&wasapi_outring) >= nbytes)
+            sys_ringbuf_read(&wasapi_outring, wasapi_scratch, nbytes,
+                wasapi_outbuf);
+        else
+        {
+                /* Pd didn't keep up; output zeros */
+            memset(wasapi_scratch, 0, nbytes);
+            wasapi_dio_error = 1;
+        }
+    }
+    wasapi_todevice(&wasapi_out, wasapi_scratch, data, wasapi_outchans,
+        nframes);
+    IAudioRenderClient_ReleaseBuffer(wasapi_out.d_render, nframes, 0);
+}
+
+    /* input only, callback mode: compute whole blocks as input comes in */
+static void wasapi_inputonly(float *inscratch)
+{
+    UINT32 nblock = WASAPI_BLKSIZE;
+    while (sys_ringbuf_getreadavailable(&wasapi_inring) >=
+        (long)(nblock * wasapi_inchans * sizeof(float)))
+    {
+        wasapi_getinput(inscratch, nblock);
+        wasapi_copyin(inscratch, 0, nblock);
+        wasapi_tick();
+    }
+}
+
+static void *wasapi_threadfn(void *z)
+{
+    HANDLE (WINAPI *setchar)(LPCWSTR, LPDWORD) = 0;
+    BOOL (WINAPI *revert)(HANDLE) = 0;
+    HMODULE avrt = LoadLibraryA("avrt.dll");
+    HANDLE task = 0, wake;
+    DWORD taskindex = 0;
+    float *inscratch = (float *)getbytes(WASAPI_MAXFRAMES *
+        (wasapi_inchans ? wasapi_inchans : 1) * sizeof(float));
+    wasapi_initcom();
+    sys_setthreadrole(SYS_THREAD_AUDIO);
+        /* ask MMCSS for real-time scheduling; avrt.dll is only there
+        on Vista and later so we look it up rather than linking to it */
+    if (avrt)
+    {
+        setchar = (HANDLE (WINAPI *)(LPCWSTR, LPDWORD))GetProcAddress(avrt,
+            "AvSetMmThreadCharacteristicsW");
+        revert = (BOOL (WINAPI *)(HANDLE))GetProcAddress(avrt,
+            "AvRevertMmThreadCharacteristics");
+        if (setchar)
+            task = (*setchar)(L"Pro Audio", &taskindex);
+    }
+    if (!task)
+        SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+    wake = (wasapi_outchans ? wasapi_out.d_event : wasapi_in.d_event);
+    while (!wasapi_quit)
+    {
+        if (WaitForSingleObject(wake, WASAPI_WAIT) != WAIT_OBJECT_0)
+        {
+            wasapi_dio_error = 1;
+            continue;
+        }
+        if (wasapi_quit)
+            break;
+        if (wasapi_inchans)
+            wasapi_docapture();
+        if (wasapi_outchans)
+            wasapi_dorender(inscratch);
+        else if (wasapi_callback)
+            wasapi_inputonly(inscratch);
+    }
+    if (task && revert)
+        (*revert)(task);
+    if (avrt)
+        FreeLibrary(avrt);
+    freebytes(inscratch, WASAPI_MAXFRAMES *
+        (wasapi_inchans ? wasapi_inchans : 1) * sizeof(float));
+    CoUninitialize();
+    return (0);
+}
+
+/* --------------------- opening and closing --------------------- */
+
+static void wasapi_setformat(WAVEFORMATEXTENSIBLE *fmt, int format,
+    int nchans, int rate)
+{
+    int bits = (format == WASAPI_INT16 ? 16 : 32);
+    memset(fmt, 0, sizeof(*fmt));
+    fmt->Format.wFormatTag = WAVE_FORMAT_EXTENSIBLE;
+    fmt->Format.nChannels = nchans;
+    fmt->Format.nSamplesPerSec = rate;
+    fmt->Format.wBitsPerSample = bits;
+    fmt->Format.nBlockAlign = nchans * bits / 8;
+    fmt->Format.nAvgBytesPerSec = rate * fmt->Format.nBlockAlign;
+    fmt->Format.cbSize = sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX);
+    fmt->Samples.wValidBitsPerSample = bits;
+    fmt->dwChannelMask = 0;
+    fmt->SubFormat = (format == WASAPI_FLOAT32 ?
+        wasapi_subtype_float : wasapi_subtype_pcm);
+}
+
+static void wasapi_freedev(t_wasapi_dev *d)
+{
+    if (d->d_render)
+        IAudioRenderClient_Release(d->d_render);
+    if (d->d_capture)
+        IAudioCaptureClient_Release(d->d_capture);
+    if (d->d_client)
+        IAudioClient_Release(d->d_client);
+    if (d->d_event)
+        CloseHandle(d->d_event);
+    memset(d, 0, sizeof(*d));
+}
+
+    /* try to open a device in exclusive mode, with "nchans" channels or
+    else as many as it has, in the first of our formats it takes */
+static HRESULT wasapi_tryexclusive(t_wasapi_dev *d, IMMDevice *dev,
+    int nchans, int rate, int blocksize)
+{
+    static const int formats[] = {WASAPI_FLOAT32, WASAPI_INT32, WASAPI_INT16};
+    WAVEFORMATEXTENSIBLE fmt;
+    WAVEFORMATEX *mix = 0;
+    REFERENCE_TIME defperiod, minperiod, period;
+    HRESULT hr;
+    int i, tries, nc;
+    if (FAILED(hr = IMMDevice_Activate(dev, &wasapi_iid_client, CLSCTX_ALL,
+        0, (void **)&d->d_client)))
+            return (hr);
+    IAudioClient_GetMixFormat(d->d_client, &mix);
+    for (tries = 0, hr = AUDCLNT_E_UNSUPPORTED_FORMAT; tries < 2; tries++)
+    {
+        nc = (tries == 0 || !mix ? nchans : mix->nChannels);
+        for (i = 0; i < (int)(sizeof(formats)/sizeof(*formats)); i++)
+        {
+            wasapi_setformat(&fmt, formats[i], nc, rate);
+            if ((hr = IAudioClient_IsFormatSupported(d->d_client,
+                AUDCLNT_SHAREMODE_EXCLUSIVE, (WAVEFORMATEX *)&fmt, 0)) == S_OK)
+                    goto found;
+        }
+    }
+    if (mix)
+        CoTaskMemFree(mix);
+    return (hr);
+found:
+    if (mix)
+        CoTaskMemFree(mix);
+    d->d_format = formats[i];
+    d->d_nchans = nc;
+    d->d_bytesperframe = fmt.Format.nBlockAlign;
+        /* one period of "blocksize" frames, but not less than the device
+        can do */
+    IAudioClient_GetDevicePeriod(d->d_client, &defperiod, &minperiod);
+    period = (REFERENCE_TIME)(10000000. * blocksize / rate + 0.5);
+    if (period < minperiod)
+        period = minperiod;
+    hr = IAudioClient_Initialize(d->d_client, AUDCLNT_SHAREMODE_EXCLUSIVE,
+        AUDCLNT_STREAMFLAGS_EVENTCALLBACK, period, period,
+            (WAVEFORMATEX *)&fmt, 0);
+    if (hr == AUDCLNT_E_BUFFER_SIZE_NOT_ALIGNED)
+    {
+            /* the device wants a particular size; ask again with that */
+        UINT32 frames;
+        IAudioClient_GetBufferSize(d->d_client, &frames);
+        period = (REFERENCE_TIME)(10000000. * frames / rate + 0.5);
+        IAudioClient_Release(d->d_client);
+        d->d_client = 0;
+        if (FAILED(hr = IMMDevice_Activate(dev, &wasapi_iid_client,
+            CLSCTX_ALL, 0, (void **)&d->d_client)))
+                return (hr);
+        hr = IAudioClient_Initialize(d->d_client,
+            AUDCLNT_SHAREMODE_EXCLUSIVE, AUDCLNT_STREAMFLAGS_EVENTCALLBACK,
+                period, period, (WAVEFORMATEX *)&fmt, 0);
+    }
+    if (SUCCEEDED(hr))
+        d->d_exclusive = 1;
+    return (hr);
+}
+
+    /* shared mode: floats at our rate and channel count, which the
+    system converts to the mixer's format */
+static HRESULT wasapi_tryshared(t_wasapi_dev *d, IMMDevice *dev,
+    int nchans, int rate)
+{
+    WAVEFORMATEXTENSIBLE fmt;
+    HRESULT hr;
+    if (!d->d_client && FAILED(hr = IMMDevice_Activate(dev,
+        &wasapi_iid_client, CLSCTX_ALL, 0, (void **)&d->d_client)))
+            return (hr);
+    wasapi_setformat(&fmt, WASAPI_FLOAT32, nchans, rate);
+    d->d_format = WASAPI_FLOAT32;
+    d->d_nchans = nchans;
+    d->d_bytesperframe = fmt.Format.nBlockAlign;
+    d->d_exclusive = 0;
+    return (IAudioClient_Initialize(d->d_client, AUDCLNT_SHAREMODE_SHARED,
+        AUDCLNT_STREAMFLAGS_EVENTCALLBACK | AUDCLNT_STREAMFLAGS_AUTOCONVERTPCM |
+            AUDCLNT_STREAMFLAGS_SRC_DEFAULT_QUALITY, 0, 0,
+                (WAVEFORMATEX *)&fmt, 0));
+}
+
+static int wasapi_opendev(t_wasapi_dev *d, int devno, int input,
+    int nchans, int rate, int blocksize)
+{
+    IMMDevice *devs[WASAPI_MAXDEV];
+    int ndev = wasapi_listdevices(devs, WASAPI_MAXDEV, input);
+    char name[MAXPDSTRING];
+    HRESULT hr;
+    if (devno < 0 || devno >= ndev)
+    {
+        error("WASAPI: no %s device %d", (input ? "input" : "output"),
+            devno);
+        wasapi_releasedevices(devs, ndev);
+        return (1);
+    }
+    wasapi_devname(devs[devno], name, MAXPDSTRING);
+    if (FAILED(hr = wasapi_tryexclusive(d, devs[devno], nchans, rate,
+        blocksize)))
+    {
+        if (d->d_client)
+            IAudioClient_Release(d->d_client), d->d_client = 0;
+        if (FAILED(hr = wasapi_tryshared(d, devs[devno], nchans, rate)))
+        {
+            error("WASAPI: couldn't open %s (error 0x%lx)", name,
+                (unsigned long)hr);
+            wasapi_releasedevices(devs, ndev);
+            wasapi_freedev(d);
+            return (1);
+        }
+        post("WASAPI: %s: exclusive mode unavailable, using shared mode",
+            name);
+    }
+    wasapi_releasedevices(devs, ndev);
+    if (!(d->d_event = CreateEvent(0, FALSE, FALSE, 0)) ||
+        FAILED(IAudioClient_SetEventHandle(d->d_client, d->d_event)) ||
+        FAILED(IAudioClient_GetBufferSize(d->d_client, &d->d_bufframes)) ||
+        FAILED(input ?
+            IAudioClient_GetService(d->d_client, &wasapi_iid_capture,
+                (void **)&d->d_capture) :
+            IAudioClient_GetService(d->d_client, &wasapi_iid_render,
+                (void **)&d->d_render)))
+    {
+        error("WASAPI: couldn't set up %s", name);
+        wasapi_freedev(d);
+        return (1);
+    }
+    if (d->d_bufframes > WASAPI_MAXFRAMES)
+    {
+        error("WASAPI: %s: buffer of %d frames is too big", name,
+            (int)d->d_bufframes);
+        wasapi_freedev(d);
+        return (1);
+    }
+    if (sys_verbose)
+        post("WASAPI: %s: %s mode, %d channels, %d-frame buffer", name,
+            (d->d_exclusive ? "exclusive" : "shared"), d->d_nchans,
+                (int)d->d_bufframes);
+    return (0);
+}
+
+int wasapi_open_audio(int inchans, int outchans, int rate,
+    int blocksize, int nbuffers, int indevno, int outdevno,
+    t_audiocallback callback)
+{
+    int maxchans;
+    if (inchans > WASAPI_MAXCHANS)
+        inchans = WASAPI_MAXCHANS;
+    if (outchans > WASAPI_MAXCHANS)
+        outchans = WASAPI_MAXCHANS;
+    if (!inchans && !outchans)
+        return (0);
+    if (nbuffers < 1)
+        nbuffers = 1;
+    if ((inchans && wasapi_opendev(&wasapi_in, indevno, 1, inchans, rate,
+        blocksize)) ||
+        (outchans && wasapi_opendev(&wasapi_out, outdevno, 0, outchans, rate,
+            blocksize)))
+    {
+        wasapi_freedev(&wasapi_in);
+        wasapi_freedev(&wasapi_out);
+        return (1);
+    }
+    wasapi_inchans = inchans;
+    wasapi_outchans = outchans;
+    wasapi_callback = callback;
+    wasapi_blockpos = wasapi_buffered = 0;
+    wasapi_dio_error = 0;
+    maxchans = (inchans > outchans ? inchans : outchans);
+    wasapi_scratch = (float *)getbytes(WASAPI_MAXFRAMES * maxchans *
+        sizeof(float));
+    wasapi_sendscratch = (float *)getbytes(WASAPI_BLKSIZE * maxchans *
+        sizeof(float));
+        /* input ring: in callback mode, start it with enough silence to
+        ride out the two devices' jitter; in polling mode fill it so that
+        Pd computes "nbuffers" blocks ahead, as for portaudio */
+    if (inchans)
+    {
+        long prefill = nbuffers * blocksize * inchans * sizeof(float);
+        if (callback && outchans)
+            prefill = (wasapi_out.d_bufframes > wasapi_in.d_bufframes ?
+                wasapi_out.d_bufframes : wasapi_in.d_bufframes) *
+                    inchans * sizeof(float);
+        else if (callback)
+            prefill = 0;
+        wasapi_inbufsize = (2 * WASAPI_MAXFRAMES + nbuffers * blocksize) *
+            inchans * sizeof(float);
+        wasapi_inbuf = getbytes(wasapi_inbufsize);
+        sys_ringbuf_init(&wasapi_inring, wasapi_inbufsize, wasapi_inbuf,
+            (outchans ? prefill : 0));
+    }
+    if (outchans && !callback)
+    {
+            /* Pd stays "nbuffers" blocks ahead of the device's buffer */
+        wasapi_outbufsize = (wasapi_out.d_bufframes + nbuffers * blocksize) *
+            outchans * sizeof(float);
+        wasapi_outbuf = getbytes(wasapi_outbufsize);
+        sys_ringbuf_init(&wasapi_outring, wasapi_outbufsize, wasapi_outbuf, 0);
+    }
+        /* in exclusive mode the render buffer has to be full before we
+        start or the first period glitches */
+    if (outchans)
+    {
+        BYTE *data;
+        if (SUCCEEDED(IAudioRenderClient_GetBuffer(wasapi_out.d_render,
+            wasapi_out.d_bufframes, &data)))
+                IAudioRenderClient_ReleaseBuffer(wasapi_out.d_render,
+                    wasapi_out.d_bufframes, AUDCLNT_BUFFERFLAGS_SILENT);
+    }
+    wasapi_quit = 0;
+    if (pthread_create(&wasapi_thread, 0, wasapi_threadfn, 0))
+    {
+        error("WASAPI: couldn't start audio thread");
+        wasapi_close_audio();
+        return (1);
+    }
+    wasapi_threadrunning = 1;
+    if ((inchans && FAILED(IAudioClient_Start(wasapi_in.d_client))) ||
+        (outchans && FAILED(IAudioClient_Start(wasapi_out.d_client))))
+    {
+        error("WASAPI: couldn't start audio");
+        wasapi_close_audio();
+        return (1);
+    }
+    wasapi_isopen = 1;
+    return (0);
+}
+
+void wasapi_close_audio(void)
+{
+    int maxchans = (wasapi_inchans > wasapi_outchans ?
+        wasapi_inchans : wasapi_outchans);
+    wasapi_isopen = 0;
+    if (wasapi_threadrunning)
+    {
+        wasapi_quit = 1;
+        if (wasapi_out.d_event)
+            SetEvent(wasapi_out.d_event);
+        if (wasapi_in.d_event)
+            SetEvent(wasapi_in.d_event);
+        pthread_join(wasapi_thread, 0);
+        wasapi_threadrunning = 0;
+    }
+    if (wasapi_in.d_client)
+        IAudioClient_Stop(wasapi_in.d_client);
+    if (wasapi_out.d_client)
+        IAudioClient_Stop(wasapi_out.d_client);
+    wasapi_freedev(&wasapi_in);
+    wasapi_freedev(&wasapi_out);
+    if (wasapi_inbuf)
+        freebytes(wasapi_inbuf, wasapi_inbufsize), wasapi_inbuf = 0;
+    if (wasapi_outbuf)
+        freebytes(wasapi_outbuf, wasapi_outbufsize), wasapi_outbuf = 0;
+    if (wasapi_scratch)
+        freebytes(wasapi_scratch, WASAPI_MAXFRAMES * maxchans *
+            sizeof(float)), wasapi_scratch = 0;
+    if (wasapi_sendscratch)
+        freebytes(wasapi_sendscratch, WASAPI_BLKSIZE * maxchans *
+            sizeof(float)), wasapi_sendscratch = 0;
+    wasapi_inchans = wasapi_outchans = 0;
+    wasapi_callback = 0;
+}
+
+    /* polling mode only */
+int wasapi_send_dacs(void)
+{
+    t_sample *fp;
+    float *sp;
+    int j, k, rtnval = SENDDACS_YES;
+    long nout = wasapi_outchans * WASAPI_BLKSIZE * sizeof(float),
+        nin = wasapi_inchans * WASAPI_BLKSIZE * sizeof(float);
+    double timebefore = sys_getrealtime();
+    if (!wasapi_isopen)
+        return (SENDDACS_NO);
+    if (wasapi_dio_error)
+    {
+        sys_log_error(ERR_RESYNC);
+        wasapi_dio_error = 0;
+    }
+        /* sync on output if there is any, otherwise on input */
+    while (wasapi_outchans ?
+        sys_ringbuf_getwriteavailable(&wasapi_outring) < nout :
+            sys_ringbuf_getreadavailable(&wasapi_inring) < nin)
+    {
+        if (sys_getrealtime() - timebefore > WASAPI_POLLTIMEOUT)
+            return (SENDDACS_NO);
+        rtnval = SENDDACS_SLEPT;
+        sys_microsleep(sys_sleepgrain);
+        if (!wasapi_isopen)     /* sys_microsleep() may have closed it */
+            return (SENDDACS_NO);
+    }
+    if (wasapi_outchans)
+    {
+        for (j = 0, fp = STUFF->st_soundout; j < wasapi_outchans; j++)
+            for (k = 0, sp = wasapi_sendscratch + j; k < WASAPI_BLKSIZE;
+                k++, sp += wasapi_outchans)
+                    *sp = *fp, *fp++ = 0;
+        sys_ringbuf_write(&wasapi_outring, wasapi_sendscratch, nout,
+            wasapi_outbuf);
+        sys_tracefill(sys_ringbuf_getreadavailable(&wasapi_outring) /
+            (wasapi_outchans * sizeof(float)));
+    }
+    if (wasapi_inchans)
+    {
+        if (sys_ringbuf_getreadavailable(&wasapi_inring) < nin)
+        {
+                /* input fell behind the output; give Pd silence */
+            memset(STUFF->st_soundin, 0,
+                wasapi_inchans * WASAPI_BLKSIZE * sizeof(t_sample));
+            return (rtnval);
+        }
+        sys_ringbuf_read(&wasapi_inring, wasapi_sendscratch, nin,
+            wasapi_inbuf);
+        for (j = 0, fp = STUFF->st_soundin; j < wasapi_inchans; j++)
+            for (k = 0, sp = wasapi_sendscratch + j; k < WASAPI_BLKSIZE;
+                k++, sp += wasapi_inchans)
+                    *fp++ = *sp;
+    }
+    return (rtnval);
+}
+
+void wasapi_getdevs(char *indevlist, int *nindevs,
+    char *outdevlist, int *noutdevs, int *canmulti,
+        int maxndev, int devdescsize)
+{
+    IMMDevice *devs[WASAPI_MAXDEV];
+    int i, n, max = (maxndev < WASAPI_MAXDEV ? maxndev : WASAPI_MAXDEV);
+    *canmulti = 0;
+    n = wasapi_listdevices(devs, max, 1);
+    for (i = 0; i < n; i++)
+        wasapi_devname(devs[i], indevlist + i * devdescsize, devdescsize);
+    wasapi_releasedevices(devs, n);
+    *nindevs = n;
+    n = wasapi_listdevices(devs, max, 0);
+    for (i = 0; i < n; i++)
+        wasapi_devname(devs[i], outdevlist + i * devdescsize, devdescsize);
+    wasapi_releasedevices(devs, n);
+    *noutdevs = n;
+}
+
+#endif /* USEAPI_WASAPI */
@@ -651,6 +651,7 @@ void sys_loadpreferences(const char *filename, int startingup)
     sys_open_midi(nmidiindev, midiindev, nmidioutdev, midioutdev, 0);
 
         /* search path */
+    sys_flushdircache();
     if (sys_getpreference("npath", prefbuf, MAXPDSTRING))
         sscanf(prefbuf, "%d", &maxi);
     else maxi = 0x7fffffff;
@@ -837,6 +838,7 @@ void glob_loadpreferences(t_pd *dummy, t_symbol *filesym)
     sys_loadpreferences(filesym->s_name, 0);
     sys_close_audio();
     sys_reopen_audio();
+    sys_stopmidithread();
     sys_close_midi();
     sys_reopen_midi();
 }
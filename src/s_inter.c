@@ -5,6 +5,9 @@
 /* Pd side of the Pd/Pd-gui interface.  Also, some system interface routines
 that didn't really belong anywhere. */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE     /* for per-thread CPU affinity and ppoll() */
+#endif
 #include "m_pd.h"
 #include "s_stuff.h"
 #include "m_imp.h"
@@ -15,6 +18,7 @@ that didn't really belong anywhere. */
 #include <unistd.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <time.h>
 #include <sys/mman.h>
 #include <sys/resource.h>
 #include <sys/types.h>
@@ -72,8 +76,38 @@ that didn't really belong anywhere. */
 
 #if PDTHREADS
 #include "pthread.h"
+#include "s_audio_paring.h"
+#endif
+
+    /* where we can, the kernel keeps the list of descriptors to poll, so
+    that a poll costs what's ready rather than what's open and there's no
+    FD_SETSIZE limit.  If it can't be set up we use select(). */
+#if defined(__linux__)
+#define FDPOLL_EPOLL
+#include <sys/epoll.h>
+#include <poll.h>
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || \
+    defined(__OpenBSD__)
+#define FDPOLL_KQUEUE
+#include <sys/event.h>
+#endif
+#if defined(FDPOLL_EPOLL) || defined(FDPOLL_KQUEUE)
+#define FDPOLL_KERNEL
 #endif
 
+#define FDQUEUESIZE 1024    /* bytes in FIFO for ready fds (power of 2) */
+#define MAXQUEUEDFDS 64     /* most fds we'll hand over at once */
+
+    /* with "-guithread" a separate thread talks to the GUI socket (see
+    below).  It needs a pipe to be woken up, so not on Windows for now. */
+#if PDTHREADS && !defined(_WIN32)
+#define GUITHREAD 1
+#else
+#define GUITHREAD 0
+#endif
+#define GUIOUTSIZE 65536     /* bytes in FIFO to the GUI thread (power of 2) */
+#define GUIINSIZE 16384      /* ... and from it (power of 2) */
+
 typedef struct _fdpoll
 {
     int fdp_fd;
@@ -94,25 +128,44 @@ struct _socketreceiver
     t_socketnotifier sr_notifier;
     t_socketreceivefn sr_socketreceivefn;
     t_socketfromaddrfn sr_fromaddrfn; /* optional */
+    t_binbufparser *sr_parser;  /* for TCP: what we have of the next message */
+    char *sr_udpbuf;            /* for UDP: a batch of datagrams at a time */
+    int *sr_freed;              /* set if we're freed while reading */
 };
 
+    /* GUI updates waiting to be sent, in order, each client at most once.
+    The queue is doubly linked and a hash table on the client finds its
+    entry, so that queueing and unqueueing don't have to search the queue. */
 typedef struct _guiqueue
 {
     void *gq_client;
     t_glist *gq_glist;
     t_guicallbackfn gq_fn;
     struct _guiqueue *gq_next;
+    struct _guiqueue *gq_prev;
+    struct _guiqueue *gq_hashnext;  /* next in hash bucket */
+    unsigned int gq_seq;            /* order in which it was queued */
 } t_guiqueue;
 
+#define GUIHASHMIN 64
+
 struct _instanceinter
 {
     int i_havegui;
     int i_nfdpoll;
     t_fdpoll *i_fdpoll;
     int i_maxfd;
+    int i_pollfd;               /* epoll or kqueue descriptor, or -1 */
     int i_guisock;
     t_socketreceiver *i_socketreceiver;
     t_guiqueue *i_guiqueuehead;
+    t_guiqueue *i_guiqueuetail;
+    t_guiqueue **i_guihash;     /* hash table of queued clients */
+    int i_guihashsize;          /* number of buckets, a power of two */
+    int i_nguiqueue;            /* number of clients in the queue */
+    unsigned int i_guiseq;      /* sequence number of last one queued */
+    unsigned int i_guiframeseq; /* last one to send in the current frame */
+    double i_guiframetime;      /* when the current frame started */
     t_binbuf *i_inbinbuf;
     char *i_guibuf;
     int i_guihead;
@@ -120,13 +173,39 @@ struct _instanceinter
     int i_guisize;
     int i_waitingforping;
     int i_bytessincelastping;
+    int i_binarycoords;         /* GUI can decode binary coordinates */
+    int *i_coords;              /* coordinates collected for it */
+    int i_ncoords;
+    int i_coordsize;
 
 #ifdef _WIN32
     LARGE_INTEGER i_inittime;
     double i_freq;
 #endif
+    int i_fdqueued;         /* take ready fds from i_fdqueue, see below */
 #if PDTHREADS
     pthread_mutex_t i_mutex;
+#ifdef PDINSTANCE
+    pthread_mutex_t i_globalmutex;  /* our share of the global lock, below */
+#endif
+    pthread_mutex_t i_fdlistmutex;  /* so other threads can read i_fdpoll */
+    sys_ringbuf i_fdqueue;
+    char i_fdqueuebuf[FDQUEUESIZE];
+    volatile int i_fdsent;      /* number of fds put in the queue ... */
+    volatile int i_fdhandled;   /* ... and number dealt with */
+#endif
+    int i_guithreaded;          /* GUI socket serviced by i_guithread */
+#if GUITHREAD
+    pthread_t i_guithread;
+    sys_ringbuf i_guiout;       /* bytes for the GUI thread to send ... */
+    char *i_guioutbuf;
+    sys_ringbuf i_guiin;        /* ... and bytes it has received */
+    char *i_guiinbuf;
+    int i_guiwakefd[2];         /* pipe to wake it up ... */
+    int i_guinotifyfd[2];       /* ... and for it to wake us up */
+    volatile int i_guiquit;     /* set to stop the thread */
+    volatile int i_guieof;      /* the thread saw the GUI close ... */
+    volatile int i_guierror;    /* ... or couldn't send to it */
 #endif
 };
 
@@ -170,17 +249,26 @@ double nt_tixtotime(LARGE_INTEGER *dumbass)
 #endif
 #endif /* _WIN32 */
 
+#ifndef _WIN32
+static uint64_t realtime_then;
+static pthread_once_t realtime_once = PTHREAD_ONCE_INIT;
+
+static void realtime_start(void)
+{
+    realtime_then = sys_getnanotime();
+}
+#endif
+
     /* get "real time" in seconds; take the
-    first time we get called as a reference time of zero. */
+    first time we get called as a reference time of zero.  Any thread
+    (and any Pd instance) might be first. */
 double sys_getrealtime(void)
 {
 #ifndef _WIN32
-    static struct timeval then;
-    struct timeval now;
-    gettimeofday(&now, 0);
-    if (then.tv_sec == 0 && then.tv_usec == 0) then = now;
-    return ((now.tv_sec - then.tv_sec) +
-        (1./1000000.) * (now.tv_usec - then.tv_usec));
+    uint64_t now;
+    pthread_once(&realtime_once, realtime_start);
+    now = sys_getnanotime();
+    return (1e-9 * (now - realtime_then));
 #else
     LARGE_INTEGER now;
     QueryPerformanceCounter(&now);
@@ -188,6 +276,71 @@ double sys_getrealtime(void)
     return (((double)(now.QuadPart -
         pd_this->pd_inter->i_inittime.QuadPart)) / pd_this->pd_inter->i_freq);
 #endif
+}
+
+    /* monotonic time in nanoseconds.  This never jumps when the date is
+    set, so it's what to time things with; the origin is arbitrary. */
+uint64_t sys_getnanotime(void)
+{
+#ifndef _WIN32
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000000 + now.tv_nsec);
+#else
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (!freq.QuadPart && !QueryPerformanceFrequency(&freq))
+        freq.QuadPart = 1;
+    QueryPerformanceCounter(&now);
+        /* split it up so as not to overflow */
+    return ((uint64_t)(now.QuadPart / freq.QuadPart) * 1000000000 +
+        (uint64_t)(now.QuadPart % freq.QuadPart) * 1000000000 /
+            freq.QuadPart);
+#endif
+}
+
+    /* CPU time used by the calling thread, in nanoseconds; zero if the
+    system can't tell us. */
+uint64_t sys_getthreadcputime(void)
+{
+#if defined(_WIN32)
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+        return (0);
+    return (100 * (((uint64_t)kernel.dwHighDateTime << 32) +
+        kernel.dwLowDateTime + ((uint64_t)user.dwHighDateTime << 32) +
+            user.dwLowDateTime));
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec now;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) < 0)
+        return (0);
+    return ((uint64_t)now.tv_sec * 1000000000 + now.tv_nsec);
+#else
+    return (0);
+#endif
+}
+
+    /* the processor's cycle counter where we can read it cheaply.  On
+    modern x86 this runs at a fixed rate whatever the clock speed, and on
+    ARM it's the virtual timer, which is slower still; elsewhere we just
+    return nanoseconds. */
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+uint64_t sys_getcycles(void)
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    return (__builtin_ia32_rdtsc());
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    return (__rdtsc());
+#elif defined(__GNUC__) && defined(__aarch64__)
+    uint64_t ticks;
+    __asm__ __volatile__ ("mrs %0, cntvct_el0" : "=r" (ticks));
+    return (ticks);
+#else
+    return (sys_getnanotime());
+#endif
 }
 
 extern int sys_nosleep;
@@ -196,6 +349,120 @@ extern int sys_nosleep;
 ready - in that case, dispatch any resulting Pd messages and return.  Called
 with sys_lock() set.  We will temporarily release the lock if we actually
 sleep. */
+static int sys_pollqueuedfds(void);
+static int sys_pollguithread(void);
+
+#ifdef FDPOLL_KERNEL
+    /* register or unregister a descriptor with i_pollfd.  If that fails
+    (epoll won't take regular files, for instance) we go back to select()
+    for good. */
+static void fdpoll_add(t_instanceinter *inter, int fd)
+{
+    int ret = 0;
+    if (inter->i_pollfd < 0)
+        return;
+#if defined(FDPOLL_EPOLL)
+    {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        ret = epoll_ctl(inter->i_pollfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+#elif defined(FDPOLL_KQUEUE)
+    {
+        struct kevent ev;
+        EV_SET(&ev, fd, EVFILT_READ, EV_ADD, 0, 0, 0);
+        ret = kevent(inter->i_pollfd, &ev, 1, 0, 0, 0);
+    }
+#endif
+    if (ret < 0)
+    {
+        close(inter->i_pollfd);
+        inter->i_pollfd = -1;
+    }
+}
+
+    /* errors are OK here: the descriptor may be closed already, which
+    drops it anyway. */
+static void fdpoll_rm(t_instanceinter *inter, int fd)
+{
+    if (inter->i_pollfd < 0)
+        return;
+#if defined(FDPOLL_EPOLL)
+    {
+        struct epoll_event ev;
+        epoll_ctl(inter->i_pollfd, EPOLL_CTL_DEL, fd, &ev);
+    }
+#elif defined(FDPOLL_KQUEUE)
+    {
+        struct kevent ev;
+        EV_SET(&ev, fd, EVFILT_READ, EV_DELETE, 0, 0, 0);
+        kevent(inter->i_pollfd, &ev, 1, 0, 0, 0);
+    }
+#endif
+}
+
+    /* wait up to "microsec" for any of the descriptors to be readable and
+    put up to "maxfds" ready ones in "fds".  Returns how many, or -1. */
+static int fdpoll_wait(t_instanceinter *inter, int microsec,
+    int *fds, int maxfds)
+{
+    int i, nready = -1;
+#if defined(FDPOLL_EPOLL)
+    struct epoll_event evs[MAXQUEUEDFDS];
+    if (maxfds > MAXQUEUEDFDS)
+        maxfds = MAXQUEUEDFDS;
+    if (microsec)
+    {
+            /* epoll_wait() only counts milliseconds */
+        struct pollfd pfd;
+        struct timespec ts;
+        pfd.fd = inter->i_pollfd;
+        pfd.events = POLLIN;
+        ts.tv_sec = microsec / 1000000;
+        ts.tv_nsec = (microsec % 1000000) * 1000;
+        if (ppoll(&pfd, 1, &ts, 0) <= 0)
+            return (0);
+    }
+    if ((nready = epoll_wait(inter->i_pollfd, evs, maxfds, 0)) > 0)
+        for (i = 0; i < nready; i++)
+            fds[i] = evs[i].data.fd;
+#elif defined(FDPOLL_KQUEUE)
+    struct kevent evs[MAXQUEUEDFDS];
+    struct timespec ts;
+    if (maxfds > MAXQUEUEDFDS)
+        maxfds = MAXQUEUEDFDS;
+    ts.tv_sec = microsec / 1000000;
+    ts.tv_nsec = (microsec % 1000000) * 1000;
+    if ((nready = kevent(inter->i_pollfd, 0, 0, evs, maxfds, &ts)) > 0)
+        for (i = 0; i < nready; i++)
+            fds[i] = (int)evs[i].ident;
+#endif
+    if (nready < 0 && errno == EINTR)
+        nready = 0;
+    return (nready);
+}
+#else /* FDPOLL_KERNEL */
+static void fdpoll_add(t_instanceinter *inter, int fd) {}
+static void fdpoll_rm(t_instanceinter *inter, int fd) {}
+static int fdpoll_wait(t_instanceinter *inter, int microsec,
+    int *fds, int maxfds) { return (-1); }
+#endif /* FDPOLL_KERNEL */
+
+    /* call the poll function for "fd", if it's still in the list */
+static int sys_callpollfn(t_instanceinter *inter, int fd)
+{
+    int i;
+    for (i = 0; i < inter->i_nfdpoll; i++)
+        if (inter->i_fdpoll[i].fdp_fd == fd)
+    {
+        (*inter->i_fdpoll[i].fdp_fn)(inter->i_fdpoll[i].fdp_ptr, fd);
+        return (1);
+    }
+    return (0);
+}
+
 static int sys_domicrosleep(int microsec, int pollem)
 {
     struct timeval timout;
@@ -203,18 +470,60 @@ static int sys_domicrosleep(int microsec, int pollem)
     t_fdpoll *fp;
     timout.tv_sec = 0;
     timout.tv_usec = 0;
-    if (pollem && pd_this->pd_inter->i_nfdpoll)
+    if (pollem && pd_this->pd_inter->i_guithreaded)
+        didsomething = sys_pollguithread();
+    if (pollem && pd_this->pd_inter->i_fdqueued)
+        didsomething |= sys_pollqueuedfds();
+    else if (pollem && pd_this->pd_inter->i_nfdpoll &&
+        pd_this->pd_inter->i_pollfd >= 0)
+    {
+        int fds[MAXQUEUEDFDS],
+            nready = fdpoll_wait(pd_this->pd_inter, 0, fds, MAXQUEUEDFDS);
+        if (nready < 0)
+            perror("microsleep poll");
+        if (nready <= 0 && microsec && !didsomething)
+        {
+            sys_unlock();
+            nready = fdpoll_wait(pd_this->pd_inter, microsec,
+                fds, MAXQUEUEDFDS);
+            sys_lock();
+            if (nready <= 0)
+                return (0);
+        }
+            /* a handler may remove other descriptors, so look each one
+            up again before calling it */
+        for (i = 0; i < nready; i++)
+            didsomething |= sys_callpollfn(pd_this->pd_inter, fds[i]);
+    }
+    else if (pollem && pd_this->pd_inter->i_nfdpoll)
     {
         fd_set readset, writeset, exceptset;
+        int nready;
         FD_ZERO(&writeset);
         FD_ZERO(&readset);
         FD_ZERO(&exceptset);
         for (fp = pd_this->pd_inter->i_fdpoll,
             i = pd_this->pd_inter->i_nfdpoll; i--; fp++)
                 FD_SET(fp->fdp_fd, &readset);
-        if(select(pd_this->pd_inter->i_maxfd+1,
-                  &readset, &writeset, &exceptset, &timout) < 0)
+        if((nready = select(pd_this->pd_inter->i_maxfd+1,
+                  &readset, &writeset, &exceptset, &timout)) < 0)
           perror("microsleep select");
+            /* if nothing's ready and we're to sleep, sleep in select() so
+            that we wake up as soon as something is. */
+        if (!nready && microsec && !didsomething)
+        {
+            for (fp = pd_this->pd_inter->i_fdpoll,
+                i = pd_this->pd_inter->i_nfdpoll; i--; fp++)
+                    FD_SET(fp->fdp_fd, &readset);
+            timout.tv_sec = microsec / 1000000;
+            timout.tv_usec = microsec % 1000000;
+            sys_unlock();
+            nready = select(pd_this->pd_inter->i_maxfd+1,
+                &readset, &writeset, &exceptset, &timout);
+            sys_lock();
+            if (nready <= 0)
+                return (0);
+        }
         for (i = 0; i < pd_this->pd_inter->i_nfdpoll; i++)
             if (FD_ISSET(pd_this->pd_inter->i_fdpoll[i].fdp_fd, &readset))
         {
@@ -223,9 +532,9 @@ static int sys_domicrosleep(int microsec, int pollem)
                     pd_this->pd_inter->i_fdpoll[i].fdp_fd);
             didsomething = 1;
         }
-        if (didsomething)
-            return (1);
     }
+    if (didsomething)
+        return (1);
     if (microsec)
     {
         sys_unlock();
@@ -248,6 +557,107 @@ void sys_microsleep(int microsec)
     sys_unlock();
 }
 
+/* In callback mode (see m_callbackscheduler()) the audio thread, which
+computes Pd, shouldn't wait for anything.  So the main thread waits for input
+in sys_waitforfds(), without the Pd lock, and passes the file descriptors that
+are ready to the audio thread through a lock-free FIFO.  The audio thread then
+calls their handlers from sys_pollgui() without having to select() itself.
+The main thread waits until they've been handled before selecting again
+(sys_fdqueuebusy()), so that nobody reads from a descriptor with nothing to
+read.  The list of descriptors has its own lock, which the audio thread takes
+only when adding or removing descriptors. */
+
+#if PDTHREADS
+static int sys_pollqueuedfds(void)
+{
+    t_instanceinter *inter = pd_this->pd_inter;
+    int fd, didsomething = 0;
+    while (sys_ringbuf_getreadavailable(&inter->i_fdqueue) >=
+        (long)sizeof(fd))
+    {
+        sys_ringbuf_read(&inter->i_fdqueue, &fd, sizeof(fd),
+            inter->i_fdqueuebuf);
+            /* it might have been removed since */
+        didsomething |= sys_callpollfn(inter, fd);
+        inter->i_fdhandled++;
+    }
+    return (didsomething);
+}
+
+    /* turn the scheme above on or off.  Call with Pd locked. */
+void sys_setfdqueue(int onoff)
+{
+    pd_this->pd_inter->i_fdqueued = onoff;
+}
+
+int sys_fdqueuebusy(void)
+{
+    return (pd_this->pd_inter->i_fdhandled != pd_this->pd_inter->i_fdsent);
+}
+
+    /* wait up to "microsec" for input and queue the ready descriptors.
+    Call without Pd locked. */
+void sys_waitforfds(int microsec)
+{
+    t_instanceinter *inter = pd_this->pd_inter;
+    int i, nfd = 0, maxfd = 0, fds[MAXQUEUEDFDS];
+    fd_set readset;
+    struct timeval timout;
+    if (inter->i_pollfd >= 0)
+    {
+            /* the kernel has the list, so we needn't lock it */
+        if ((nfd = fdpoll_wait(inter, microsec, fds, MAXQUEUEDFDS)) < 0)
+            return;
+        for (i = 0; i < nfd; i++)
+        {
+            inter->i_fdsent++;
+            sys_ringbuf_write(&inter->i_fdqueue, &fds[i], sizeof(fds[i]),
+                inter->i_fdqueuebuf);
+        }
+        return;
+    }
+    FD_ZERO(&readset);
+    pthread_mutex_lock(&inter->i_fdlistmutex);
+    for (i = 0; i < inter->i_nfdpoll && nfd < MAXQUEUEDFDS; i++)
+    {
+        fds[nfd] = inter->i_fdpoll[i].fdp_fd;
+        FD_SET(fds[nfd], &readset);
+        if (fds[nfd] >= maxfd)
+            maxfd = fds[nfd] + 1;
+        nfd++;
+    }
+    pthread_mutex_unlock(&inter->i_fdlistmutex);
+    if (!nfd)
+    {
+#ifdef _WIN32
+        Sleep(microsec/1000);
+#else
+        usleep(microsec);
+#endif
+        return;
+    }
+    timout.tv_sec = microsec / 1000000;
+    timout.tv_usec = microsec % 1000000;
+    if (select(maxfd, &readset, 0, 0, &timout) <= 0)
+        return;
+    for (i = 0; i < nfd; i++)
+        if (FD_ISSET(fds[i], &readset))
+    {
+        inter->i_fdsent++;
+        sys_ringbuf_write(&inter->i_fdqueue, &fds[i], sizeof(fds[i]),
+            inter->i_fdqueuebuf);
+    }
+}
+#else /* PDTHREADS */
+static int sys_pollqueuedfds(void) { return (0); }
+void sys_setfdqueue(int onoff) {}
+int sys_fdqueuebusy(void) { return (0); }
+void sys_waitforfds(int microsec)
+{
+    sys_microsleep(microsec);
+}
+#endif /* PDTHREADS */
+
 #if !defined(_WIN32) && !defined(__CYGWIN__)
 static void sys_signal(int signo, sig_t sigfun)
 {
@@ -387,6 +797,137 @@ void sys_set_priority(int mode)
 
 #endif /* __linux__ */
 
+/* ------------- per-thread CPU affinity, policy and memory ------------ */
+
+int sys_mlock;          /* lock all memory at startup (-mlock) */
+int sys_prefaulting;    /* touch DSP buffers after compiling (-prefault) */
+
+#ifdef __linux__
+static cpu_set_t sys_threadcpus[SYS_NTHREADROLES];
+static int sys_havethreadcpus[SYS_NTHREADROLES];
+    /* the CPUs we had before the audio thread was pinned, for threads
+    that shouldn't inherit its affinity */
+static cpu_set_t sys_defaultcpus;
+static int sys_havedefaultcpus;
+#endif
+#if PDTHREADS && !defined(_WIN32)
+static int sys_audiopolicy = -1;
+static struct sched_param sys_audioparam;
+#endif
+
+    /* set the CPUs a kind of thread may run on from a list like "3" or
+    "2,4-7".  Returns -1 if the list is bad or affinity isn't available. */
+int sys_setthreadcpus(int role, const char *s)
+{
+#ifdef __linux__
+    const char *list = s;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    while (*s)
+    {
+        char *end;
+        long lo = strtol(s, &end, 10), hi = lo;
+        if (end == s || lo < 0 || lo >= CPU_SETSIZE)
+            goto bad;
+        if (*end == '-')
+        {
+            s = end + 1;
+            hi = strtol(s, &end, 10);
+            if (end == s || hi < lo || hi >= CPU_SETSIZE)
+                goto bad;
+        }
+        for (; lo <= hi; lo++)
+            CPU_SET(lo, &set);
+        if (*end == ',')
+            end++;
+        else if (*end)
+            goto bad;
+        s = end;
+    }
+    if (!CPU_COUNT(&set))
+        goto bad;
+    sys_threadcpus[role] = set;
+    sys_havethreadcpus[role] = 1;
+    return (0);
+bad:
+    fprintf(stderr, "bad CPU list '%s'\n", list);
+    return (-1);
+#else
+    fprintf(stderr, "CPU affinity is only supported on Linux\n");
+    return (-1);
+#endif
+}
+
+    /* called by each thread when it starts (and by the scheduler's thread
+    after real-time setup) to take on the CPUs and scheduling policy chosen
+    for its role.  Workers and the MIDI input thread, whose timestamps
+    matter, get the audio thread's policy; the GUI and file threads only do
+    I/O and drop back to normal priority so that they can't compete with
+    DSP.  Since this can run in any thread, complaints
+    go to stderr. */
+void sys_setthreadrole(int role)
+{
+#ifdef __linux__
+    if (role == SYS_THREAD_AUDIO && sys_havethreadcpus[role] &&
+        !sys_havedefaultcpus &&
+            !sched_getaffinity(0, sizeof(sys_defaultcpus), &sys_defaultcpus))
+                sys_havedefaultcpus = 1;
+    if (sys_havethreadcpus[role])
+    {
+        if (sched_setaffinity(0, sizeof(cpu_set_t),
+            &sys_threadcpus[role]) < 0)
+            fprintf(stderr, "couldn't set CPU affinity: %s\n",
+                strerror(errno));
+    }
+    else if (role != SYS_THREAD_AUDIO && sys_havedefaultcpus)
+        sched_setaffinity(0, sizeof(cpu_set_t), &sys_defaultcpus);
+#endif
+#if PDTHREADS && !defined(_WIN32)
+    if (role == SYS_THREAD_AUDIO)
+    {
+        if (sys_audiopolicy < 0)
+            pthread_getschedparam(pthread_self(), &sys_audiopolicy,
+                &sys_audioparam);
+    }
+    else if (sys_audiopolicy >= 0 && sys_audiopolicy != SCHED_OTHER)
+    {
+        struct sched_param par;
+        memset(&par, 0, sizeof(par));
+        if (role == SYS_THREAD_WORKER || role == SYS_THREAD_MIDI)
+            pthread_setschedparam(pthread_self(), sys_audiopolicy,
+                &sys_audioparam);
+        else pthread_setschedparam(pthread_self(), SCHED_OTHER, &par);
+    }
+#endif
+}
+
+    /* lock all present and future memory so the DSP tick never pages */
+void sys_lockmemory(void)
+{
+#ifndef _WIN32
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+        error("couldn't lock memory: %s", strerror(errno));
+    else if (sys_verbose)
+        post("memory locked");
+#else
+    error("-mlock: not supported on this platform");
+#endif
+}
+
+    /* write to every page of a buffer so that the first DSP ticks after
+    a recompile don't take page faults (4096 bytes is the smallest page
+    size we expect to meet) */
+void sys_prefault(void *p, size_t n)
+{
+    volatile char *cp = (volatile char *)p;
+    size_t i;
+    if (!sys_prefaulting || !n)
+        return;
+    for (i = 0; i < n; i += 4096)
+        cp[i] = cp[i];
+    cp[n-1] = cp[n-1];
+}
+
 /* ------------------ receiving incoming messages over sockets ------------- */
 
 void sys_sockerror(char *s)
@@ -401,6 +942,9 @@ void sys_addpollfn(int fd, t_fdpollfn fn, void *ptr)
 {
     int nfd, size;
     t_fdpoll *fp;
+#if PDTHREADS
+    pthread_mutex_lock(&pd_this->pd_inter->i_fdlistmutex);
+#endif
     sys_init_fdpoll();
     nfd = pd_this->pd_inter->i_nfdpoll;
     size = nfd * sizeof(t_fdpoll);
@@ -413,6 +957,10 @@ void sys_addpollfn(int fd, t_fdpollfn fn, void *ptr)
     pd_this->pd_inter->i_nfdpoll = nfd + 1;
     if (fd >= pd_this->pd_inter->i_maxfd)
         pd_this->pd_inter->i_maxfd = fd + 1;
+    fdpoll_add(pd_this->pd_inter, fd);
+#if PDTHREADS
+    pthread_mutex_unlock(&pd_this->pd_inter->i_fdlistmutex);
+#endif
 }
 
 void sys_rmpollfn(int fd)
@@ -420,10 +968,14 @@ void sys_rmpollfn(int fd)
     int nfd = pd_this->pd_inter->i_nfdpoll;
     int i, size = nfd * sizeof(t_fdpoll);
     t_fdpoll *fp;
+#if PDTHREADS
+    pthread_mutex_lock(&pd_this->pd_inter->i_fdlistmutex);
+#endif
     for (i = nfd, fp = pd_this->pd_inter->i_fdpoll; i--; fp++)
     {
         if (fp->fdp_fd == fd)
         {
+            fdpoll_rm(pd_this->pd_inter, fd);
             while (i--)
             {
                 fp[0] = fp[1];
@@ -432,9 +984,15 @@ void sys_rmpollfn(int fd)
             pd_this->pd_inter->i_fdpoll = (t_fdpoll *)t_resizebytes(
                 pd_this->pd_inter->i_fdpoll, size, size - sizeof(t_fdpoll));
             pd_this->pd_inter->i_nfdpoll = nfd - 1;
+#if PDTHREADS
+            pthread_mutex_unlock(&pd_this->pd_inter->i_fdlistmutex);
+#endif
             return;
         }
     }
+#if PDTHREADS
+    pthread_mutex_unlock(&pd_this->pd_inter->i_fdlistmutex);
+#endif
     post("warning: %d removed from poll list but not found", fd);
 }
 
@@ -449,61 +1007,82 @@ t_socketreceiver *socketreceiver_new(void *owner, t_socketnotifier notifier,
     x->sr_udp = udp;
     x->sr_fromaddr = NULL;
     x->sr_fromaddrfn = NULL;
+    x->sr_parser = binbufparser_new();
+    x->sr_udpbuf = NULL;
+    x->sr_freed = NULL;
     if (!(x->sr_inbuf = malloc(INBUFSIZE))) bug("t_socketreceiver");
     return (x);
 }
 
 void socketreceiver_free(t_socketreceiver *x)
 {
+    if (x->sr_freed)
+        *x->sr_freed = 1;
+    binbufparser_free(x->sr_parser);
     free(x->sr_inbuf);
+    if (x->sr_udpbuf) free(x->sr_udpbuf);
     if (x->sr_fromaddr) free(x->sr_fromaddr);
     freebytes(x, sizeof(*x));
 }
 
-    /* this is in a separately called subroutine so that the buffer isn't
-    sitting on the stack while the messages are getting passed. */
-static int socketreceiver_doread(t_socketreceiver *x)
+    /* parse the "*pending" bytes at sr_intail until a message is complete
+    and return 1 with the message in i_inbinbuf, or return 0 when they're
+    used up.  The parser keeps partial messages (and words) itself, so
+    each byte is only looked at once, however the messages are split up
+    between reads. */
+static int socketreceiver_doread(t_socketreceiver *x, int *pending)
 {
-    char messbuf[INBUFSIZE], *bp = messbuf;
-    int indx, first = 1;
-    int inhead = x->sr_inhead;
-    int intail = x->sr_intail;
-    char *inbuf = x->sr_inbuf;
-    for (indx = intail; first || (indx != inhead);
-        first = 0, (indx = (indx+1)&(INBUFSIZE-1)))
+    t_binbuf *b = pd_this->pd_inter->i_inbinbuf;
+    while (*pending > 0)
     {
-            /* if we hit a semi that isn't preceded by a \, it's a message
-            boundary.  LATER we should deal with the possibility that the
-            preceding \ might itself be escaped! */
-        char c = *bp++ = inbuf[indx];
-        if (c == ';' && (!indx || inbuf[indx-1] != '\\'))
+        int n = (*pending < INBUFSIZE - x->sr_intail ?
+            *pending : INBUFSIZE - x->sr_intail), nused,
+                gotone = binbufparser_text(x->sr_parser, b,
+                    x->sr_inbuf + x->sr_intail, n, &nused);
+        x->sr_intail = (x->sr_intail + nused) & (INBUFSIZE-1);
+        *pending -= nused;
+        if (gotone)
         {
-            intail = (indx+1)&(INBUFSIZE-1);
-            binbuf_text(pd_this->pd_inter->i_inbinbuf, messbuf, bp - messbuf);
             if (sys_debuglevel & DEBUG_MESSDOWN)
             {
-                write(2,  messbuf, bp - messbuf);
+                char *text;
+                int length;
+                binbuf_gettext(b, &text, &length);
+                write(2, text, length);
                 write(2, "\n", 1);
+                freebytes(text, length);
             }
-            x->sr_inhead = inhead;
-            x->sr_intail = intail;
             return (1);
         }
     }
     return (0);
 }
 
+    /* most datagrams we take from one socket per poll, so that a flood
+    can't keep the scheduler from getting to anything else */
+#define UDP_MAXPERPOLL (8 * SOCKET_MAXDATAGRAMS)
+
+    /* take in all datagrams pending on the socket (up to UDP_MAXPERPOLL),
+    a batch of them per system call. */
 static void socketreceiver_getudp(t_socketreceiver *x, int fd)
 {
-    char buf[INBUFSIZE+1];
-    socklen_t fromaddrlen = sizeof(struct sockaddr_storage);
-    int ret, readbytes = 0;
-    while (1)
+    struct sockaddr_storage addrs[SOCKET_MAXDATAGRAMS];
+    int sizes[SOCKET_MAXDATAGRAMS], ret, i, ndone = 0, freed = 0;
+    if (!x->sr_udpbuf &&
+        !(x->sr_udpbuf = malloc(SOCKET_MAXDATAGRAMS * INBUFSIZE)))
     {
-        ret = (int)recvfrom(fd, buf, INBUFSIZE, 0,
-            (struct sockaddr *)x->sr_fromaddr, (x->sr_fromaddr ? &fromaddrlen : 0));
+        bug("socketreceiver_getudp");
+        return;
+    }
+        /* the messages we pass on can delete our owner, and us with it */
+    x->sr_freed = &freed;
+    do
+    {
+        ret = socket_recv_datagrams(fd, x->sr_udpbuf, INBUFSIZE,
+            SOCKET_MAXDATAGRAMS, sizes, (x->sr_fromaddr ? addrs : 0));
         if (ret < 0)
         {
+            x->sr_freed = NULL;
                 /* only close the socket if there really was an error.
                 (socket_errno_udp() ignores some error codes) */
             if (socket_errno_udp())
@@ -516,115 +1095,123 @@ static void socketreceiver_getudp(t_socketreceiver *x, int fd)
             }
             return;
         }
-        else if (ret > 0)
+        for (i = 0; i < ret; i++)
         {
-            buf[ret] = 0;
-    #if 0
-            post("%s", buf);
-    #endif
-            if (buf[ret-1] != '\n')
+            char *buf = x->sr_udpbuf + i * INBUFSIZE, *semi;
+            int n = sizes[i];
+                /* drop datagrams that aren't a newline terminated message */
+            if (n <= 0 || buf[n-1] != '\n')
+                continue;
+            if ((semi = memchr(buf, ';', n)))
+                n = (int)(semi - buf);
+            if (x->sr_fromaddrfn)
             {
-    #if 0
-                error("dropped bad buffer %s\n", buf);
-    #endif
+                memcpy(x->sr_fromaddr, &addrs[i], sizeof(addrs[i]));
+                (*x->sr_fromaddrfn)(x->sr_owner, (const void *)x->sr_fromaddr);
+                if (freed)
+                    return;
             }
+            binbuf_text(pd_this->pd_inter->i_inbinbuf, buf, n);
+            outlet_setstacklim();
+            if (x->sr_socketreceivefn)
+                (*x->sr_socketreceivefn)(x->sr_owner,
+                    pd_this->pd_inter->i_inbinbuf);
+            else bug("socketreceiver_getudp");
+            if (freed)
+                return;
+        }
+        ndone += ret;
+    } while (ret == SOCKET_MAXDATAGRAMS && ndone < UDP_MAXPERPOLL);
+    x->sr_freed = NULL;
+}
+
+void sys_exit(void);
+
+    /* deal with "ret" bytes just put in the input buffer, or with the
+    connection closing if "ret" isn't positive. */
+static void socketreceiver_gotbytes(t_socketreceiver *x, int fd, int ret)
+{
+    if (ret <= 0)
+    {
+        if (ret < 0)
+            sys_sockerror("recv (tcp)");
+        if (x == pd_this->pd_inter->i_socketreceiver)
+        {
+            if (pd_this == &pd_maininstance)
+                sys_bail(1);
             else
             {
-                char *semi = strchr(buf, ';');
-                if (semi)
-                    *semi = 0;
-                if (x->sr_fromaddrfn)
-                    (*x->sr_fromaddrfn)(x->sr_owner, (const void *)x->sr_fromaddr);
-                binbuf_text(pd_this->pd_inter->i_inbinbuf, buf, strlen(buf));
-                outlet_setstacklim();
-                if (x->sr_socketreceivefn)
-                    (*x->sr_socketreceivefn)(x->sr_owner,
-                        pd_this->pd_inter->i_inbinbuf);
-                else bug("socketreceiver_getudp");
+                if (!pd_this->pd_inter->i_guithreaded)
+                {
+                    sys_rmpollfn(fd);
+                    sys_closesocket(fd);
+                }
+                sys_stopgui();
             }
-            readbytes += ret;
-            /* throttle */
-            if (readbytes >= INBUFSIZE)
-                return;
-            /* check for pending UDP packets */
-            if (socket_bytes_available(fd) <= 0)
+        }
+        else
+        {
+            if (x->sr_notifier)
+                (*x->sr_notifier)(x->sr_owner, fd);
+            sys_rmpollfn(fd);
+            sys_closesocket(fd);
+        }
+    }
+    else
+    {
+        int pending = ret, freed = 0;
+        x->sr_inhead += ret;
+        if (x->sr_inhead >= INBUFSIZE) x->sr_inhead = 0;
+            /* as in socketreceiver_getudp() */
+        x->sr_freed = &freed;
+        while (socketreceiver_doread(x, &pending))
+        {
+            if (x->sr_fromaddrfn)
+            {
+                socklen_t fromaddrlen = sizeof(struct sockaddr_storage);
+                if(!getpeername(fd,
+                                (struct sockaddr *)x->sr_fromaddr,
+                                &fromaddrlen))
+                    (*x->sr_fromaddrfn)(x->sr_owner,
+                        (const void *)x->sr_fromaddr);
+                if (freed)
+                    return;
+            }
+            outlet_setstacklim();
+            if (x->sr_socketreceivefn)
+                (*x->sr_socketreceivefn)(x->sr_owner,
+                    pd_this->pd_inter->i_inbinbuf);
+            else binbuf_eval(pd_this->pd_inter->i_inbinbuf, 0, 0, 0);
+            if (freed)
                 return;
+            if (!pending)
+                break;
         }
+        x->sr_freed = NULL;
+            /* it's all parsed, so read the next lot in from the start */
+        if (x->sr_inhead == x->sr_intail)
+            x->sr_inhead = x->sr_intail = 0;
     }
 }
 
-void sys_exit(void);
-
 void socketreceiver_read(t_socketreceiver *x, int fd)
 {
     if (x->sr_udp)   /* UDP ("datagram") socket protocol */
         socketreceiver_getudp(x, fd);
     else  /* TCP ("streaming") socket protocol */
     {
-        char *semi;
         int readto =
             (x->sr_inhead >= x->sr_intail ? INBUFSIZE : x->sr_intail-1);
-        int ret;
 
             /* the input buffer might be full.  If so, drop the whole thing */
         if (readto == x->sr_inhead)
         {
             fprintf(stderr, "pd: dropped message from gui\n");
             x->sr_inhead = x->sr_intail = 0;
-            readto = INBUFSIZE;
-        }
-        else
-        {
-            ret = (int)recv(fd, x->sr_inbuf + x->sr_inhead,
-                readto - x->sr_inhead, 0);
-            if (ret <= 0)
-            {
-                if (ret < 0)
-                    sys_sockerror("recv (tcp)");
-                if (x == pd_this->pd_inter->i_socketreceiver)
-                {
-                    if (pd_this == &pd_maininstance)
-                        sys_bail(1);
-                    else
-                    {
-                        sys_rmpollfn(fd);
-                        sys_closesocket(fd);
-                        sys_stopgui();
-                    }
-                }
-                else
-                {
-                    if (x->sr_notifier)
-                        (*x->sr_notifier)(x->sr_owner, fd);
-                    sys_rmpollfn(fd);
-                    sys_closesocket(fd);
-                }
-            }
-            else
-            {
-                x->sr_inhead += ret;
-                if (x->sr_inhead >= INBUFSIZE) x->sr_inhead = 0;
-                while (socketreceiver_doread(x))
-                {
-                    if (x->sr_fromaddrfn)
-                    {
-                        socklen_t fromaddrlen = sizeof(struct sockaddr_storage);
-                        if(!getpeername(fd,
-                                        (struct sockaddr *)x->sr_fromaddr,
-                                        &fromaddrlen))
-                            (*x->sr_fromaddrfn)(x->sr_owner,
-                                (const void *)x->sr_fromaddr);
-                    }
-                    outlet_setstacklim();
-                    if (x->sr_socketreceivefn)
-                        (*x->sr_socketreceivefn)(x->sr_owner,
-                            pd_this->pd_inter->i_inbinbuf);
-                    else binbuf_eval(pd_this->pd_inter->i_inbinbuf, 0, 0, 0);
-                    if (x->sr_inhead == x->sr_intail)
-                        break;
-                }
-            }
+            binbufparser_clear(x->sr_parser);
         }
+        else socketreceiver_gotbytes(x, fd, (int)recv(fd,
+            x->sr_inbuf + x->sr_inhead, readto - x->sr_inhead, 0));
     }
 }
 
@@ -654,6 +1241,252 @@ void sys_closesocket(int sockfd)
 #define GUI_UPDATESLICE 512 /* how much we try to do in one idle period */
 #define GUI_BYTESPERPING 1024 /* how much we send up per ping */
 
+/* With "-guithread", a separate thread does all the talking to the GUI over
+its socket, so that neither the scheduler nor the audio callback ever waits on
+it.  Output is passed to the thread through a lock-free FIFO.  Whatever
+doesn't fit stays in i_guibuf as before, so that backpressure from the GUI
+still throttles the update queue.  Input comes back through another FIFO and
+is parsed and evaluated from sys_pollgui() as if we'd read it off the socket.
+The thread sleeps in select() and is woken up through a pipe whenever
+there's new output.  It wakes the scheduler up in turn through another pipe,
+which is polled like any other file descriptor. */
+
+int sys_guithread;      /* "-guithread" flag */
+
+#if GUITHREAD
+static void *guithread_fn(void *z)
+{
+    t_instanceinter *inter = (t_instanceinter *)z;
+    char outbuf[GUI_ALLOCCHUNK], inbuf[INBUFSIZE], junk[64];
+    int outhead = 0, outtail = 0, fd = inter->i_guisock, idle = 0,
+        wakefd = inter->i_guiwakefd[0],
+        maxfd = (fd > wakefd ? fd : wakefd) + 1;
+    sys_setthreadrole(SYS_THREAD_GUI);
+    while (1)
+    {
+        fd_set readset, writeset;
+        struct timeval timout;
+        int nready;
+        if (outtail == outhead)
+        {
+            outhead = (int)sys_ringbuf_read(&inter->i_guiout,
+                outbuf, sizeof(outbuf), inter->i_guioutbuf);
+            outtail = 0;
+        }
+            /* when asked to quit, try for a second to send what's left */
+        if (inter->i_guiquit && (outtail == outhead || inter->i_guierror ||
+            idle >= 100))
+                break;
+        FD_ZERO(&readset);
+        FD_ZERO(&writeset);
+        FD_SET(wakefd, &readset);
+        if (!inter->i_guieof &&
+            sys_ringbuf_getwriteavailable(&inter->i_guiin) > 0)
+                FD_SET(fd, &readset);
+        if (outtail < outhead && !inter->i_guierror)
+            FD_SET(fd, &writeset);
+        timout.tv_sec = 0;
+        timout.tv_usec = 10000;
+        if ((nready = select(maxfd, &readset, &writeset, 0, &timout)) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            inter->i_guierror = errno;
+            break;
+        }
+        idle = (nready ? 0 : idle + 1);
+        if (FD_ISSET(wakefd, &readset))
+            while (read(wakefd, junk, sizeof(junk)) > 0)
+                ;
+        if (FD_ISSET(fd, &readset))
+        {
+            long room = sys_ringbuf_getwriteavailable(&inter->i_guiin);
+            int ret = (int)recv(fd, inbuf,
+                (room < INBUFSIZE ? room : INBUFSIZE), 0);
+            if (ret > 0)
+                sys_ringbuf_write(&inter->i_guiin, inbuf, ret,
+                    inter->i_guiinbuf);
+            else if (!ret || (errno != EAGAIN && errno != EWOULDBLOCK &&
+                errno != EINTR))
+                    inter->i_guieof = 1;
+            if ((ret > 0 || inter->i_guieof) &&
+                write(inter->i_guinotifyfd[1], "", 1) < 0)
+                    {}  /* pipe full: they haven't read the last one yet */
+        }
+        if (FD_ISSET(fd, &writeset))
+        {
+            int ret = (int)send(fd, outbuf + outtail, outhead - outtail, 0);
+            if (ret > 0)
+                outtail += ret;
+            else if (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+                errno != EINTR)
+                    inter->i_guierror = errno;
+        }
+        if (inter->i_guierror)
+            outhead = outtail = 0;
+    }
+    return (0);
+}
+
+    /* the thread has written to i_guinotifyfd; this wakes up the scheduler
+    like input from the GUI socket itself would. */
+static void sys_guithreadnotified(void *dummy, int fd)
+{
+    char junk[64];
+    while (read(fd, junk, sizeof(junk)) > 0)
+        ;
+    sys_pollguithread();
+}
+
+static void sys_closepipe(int *fds)
+{
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static int sys_opennbpipe(int *fds)
+{
+    if (pipe(fds) < 0)
+    {
+        perror("pipe");
+        return (-1);
+    }
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    return (0);
+}
+
+    /* start the thread once the GUI has connected; return 0 on success */
+static int sys_startguithread(void)
+{
+    t_instanceinter *inter = pd_this->pd_inter;
+    if (!(inter->i_guioutbuf = malloc(GUIOUTSIZE)) ||
+        !(inter->i_guiinbuf = malloc(GUIINSIZE)))
+            goto fail;
+    if (sys_opennbpipe(inter->i_guiwakefd) < 0)
+        goto fail;
+    if (sys_opennbpipe(inter->i_guinotifyfd) < 0)
+    {
+        sys_closepipe(inter->i_guiwakefd);
+        goto fail;
+    }
+    fcntl(inter->i_guisock, F_SETFL,
+        fcntl(inter->i_guisock, F_GETFL) | O_NONBLOCK);
+    sys_ringbuf_init(&inter->i_guiout, GUIOUTSIZE, inter->i_guioutbuf, 0);
+    sys_ringbuf_init(&inter->i_guiin, GUIINSIZE, inter->i_guiinbuf, 0);
+    inter->i_guiquit = inter->i_guieof = inter->i_guierror = 0;
+    if (pthread_create(&inter->i_guithread, 0, guithread_fn, inter))
+    {
+        sys_closepipe(inter->i_guiwakefd);
+        sys_closepipe(inter->i_guinotifyfd);
+        fcntl(inter->i_guisock, F_SETFL,
+            fcntl(inter->i_guisock, F_GETFL) & ~O_NONBLOCK);
+        goto fail;
+    }
+    inter->i_guithreaded = 1;
+    sys_addpollfn(inter->i_guinotifyfd[0], sys_guithreadnotified, 0);
+    return (0);
+fail:
+    fprintf(stderr, "Pd: couldn't start GUI thread\n");
+    free(inter->i_guioutbuf);
+    free(inter->i_guiinbuf);
+    inter->i_guioutbuf = inter->i_guiinbuf = 0;
+    return (-1);
+}
+
+    /* stop the thread, after it has sent what it already has */
+static void sys_stopguithread(void)
+{
+    t_instanceinter *inter = pd_this->pd_inter;
+    if (!inter->i_guithreaded)
+        return;
+    inter->i_guiquit = 1;
+    if (write(inter->i_guiwakefd[1], "", 1) < 0)
+        {}  /* the thread will notice anyway */
+    pthread_join(inter->i_guithread, 0);
+    sys_rmpollfn(inter->i_guinotifyfd[0]);
+    sys_closepipe(inter->i_guiwakefd);
+    sys_closepipe(inter->i_guinotifyfd);
+    free(inter->i_guioutbuf);
+    free(inter->i_guiinbuf);
+    inter->i_guioutbuf = inter->i_guiinbuf = 0;
+    inter->i_guithreaded = 0;
+}
+
+    /* hand output to the thread, without waiting.  Returns the number of
+    bytes it took, or -1 (and sets errno) if it failed to send earlier on. */
+static int sys_sendtoguithread(const char *buf, int n)
+{
+    t_instanceinter *inter = pd_this->pd_inter;
+    long room = sys_ringbuf_getwriteavailable(&inter->i_guiout);
+    int wasempty;
+    if (inter->i_guierror)
+    {
+        errno = inter->i_guierror;
+        return (-1);
+    }
+    if (n > room)
+        n = (int)room;
+    if (n <= 0)
+        return (0);
+    wasempty = !sys_ringbuf_getreadavailable(&inter->i_guiout);
+    sys_ringbuf_write(&inter->i_guiout, buf, n, inter->i_guioutbuf);
+        /* if there was something in the FIFO the thread is busy sending;
+        otherwise it might be asleep.  (It also wakes up every 10 msec in
+        case we guessed wrong.) */
+    if (wasempty && write(inter->i_guiwakefd[1], "", 1) < 0)
+        {}  /* pipe full: it's going to wake up anyway */
+    return (n);
+}
+
+    /* parse and evaluate whatever the thread has received.  Call with Pd
+    locked. */
+static int sys_pollguithread(void)
+{
+    t_instanceinter *inter = pd_this->pd_inter;
+    t_socketreceiver *x = inter->i_socketreceiver;
+    int didsomething = 0;
+    long avail;
+    while (inter->i_guithreaded &&
+        (avail = sys_ringbuf_getreadavailable(&inter->i_guiin)) > 0)
+    {
+        int readto =
+            (x->sr_inhead >= x->sr_intail ? INBUFSIZE : x->sr_intail-1);
+        if (readto == x->sr_inhead)
+        {
+            fprintf(stderr, "pd: dropped message from gui\n");
+            x->sr_inhead = x->sr_intail = 0;
+            continue;
+        }
+        if (avail > readto - x->sr_inhead)
+            avail = readto - x->sr_inhead;
+        socketreceiver_gotbytes(x, inter->i_guisock,
+            (int)sys_ringbuf_read(&inter->i_guiin, x->sr_inbuf + x->sr_inhead,
+                avail, inter->i_guiinbuf));
+        didsomething = 1;
+    }
+        /* the GUI went away */
+    if (inter->i_guithreaded && inter->i_guieof &&
+        !sys_ringbuf_getreadavailable(&inter->i_guiin))
+    {
+        socketreceiver_gotbytes(x, inter->i_guisock, 0);
+        didsomething = 1;
+    }
+    return (didsomething);
+}
+#else /* GUITHREAD */
+static int sys_startguithread(void)
+{
+    fprintf(stderr, "Pd: -guithread not supported in this build\n");
+    return (-1);
+}
+static void sys_stopguithread(void) {}
+static int sys_sendtoguithread(const char *buf, int n) { return (-1); }
+static int sys_pollguithread(void) { return (0); }
+#endif /* GUITHREAD */
+
+static int sys_flushtogui(void);
+
 static void sys_trytogetmoreguibuf(int newsize)
 {
     char *newbuf = realloc(pd_this->pd_inter->i_guibuf, newsize);
@@ -676,6 +1509,16 @@ static void sys_trytogetmoreguibuf(int newsize)
         /* if realloc fails, make a last-ditch attempt to stay alive by
         synchronously writing out the existing contents.  LATER test
         this by intentionally setting newbuf to zero */
+#if GUITHREAD
+    if (!newbuf && pd_this->pd_inter->i_guithreaded)
+    {
+            /* don't write to the socket behind the GUI thread's back */
+        while (pd_this->pd_inter->i_guihead > pd_this->pd_inter->i_guitail)
+            if (!sys_flushtogui())
+                usleep(1000);
+    }
+    else
+#endif
     if (!newbuf)
     {
         int bytestowrite = pd_this->pd_inter->i_guitail -
@@ -780,9 +1623,15 @@ static int sys_flushtogui(void)
     int writesize = pd_this->pd_inter->i_guihead - pd_this->pd_inter->i_guitail,
         nwrote = 0;
     if (writesize > 0)
-        nwrote = (int)send(pd_this->pd_inter->i_guisock,
+    {
+        if (pd_this->pd_inter->i_guithreaded)
+            nwrote = sys_sendtoguithread(
+                pd_this->pd_inter->i_guibuf + pd_this->pd_inter->i_guitail,
+                    writesize);
+        else nwrote = (int)send(pd_this->pd_inter->i_guisock,
             pd_this->pd_inter->i_guibuf + pd_this->pd_inter->i_guitail,
                 writesize, 0);
+    }
 
 #if 0
     if (writesize)
@@ -816,20 +1665,185 @@ static int sys_flushtogui(void)
     return (1);
 }
 
+/* Long coordinate lists, such as the trace of an array, are the bulk of what
+we send to the GUI, and printing them as decimal text only for Tcl to parse
+them back is slow at both ends.  If the GUI tells us it can decode them
+("pd guicoords 1", from Tcl 8.6 on) we send the coordinates as little-endian
+16- or 32-bit integers in base64 instead, wrapped in a call to pdtk_coords
+that turns them back into a Tcl list:
+
+    .x123.c create line [pdtk_coords s {AAAKAAUAFAA=}] -width 1 ...
+
+Otherwise sys_coordsadd() just prints them as before. */
+
+    /* "guicoords" message to Pd */
+void glob_guicoords(void *dummy, t_floatarg f)
+{
+    pd_this->pd_inter->i_binarycoords = (f != 0);
+}
+
+int sys_binarycoords(void)
+{
+    return (pd_this->pd_inter->i_binarycoords);
+}
+
+    /* start collecting a coordinate list */
+void sys_coordsbegin(void)
+{
+    pd_this->pd_inter->i_ncoords = 0;
+}
+
+void sys_coordsadd(int x, t_float y)
+{
+    t_instanceinter *inter = pd_this->pd_inter;
+    if (!inter->i_binarycoords)
+    {
+        sys_vgui("%d %f \\\n", x, y);
+        return;
+    }
+    if (inter->i_ncoords + 2 > inter->i_coordsize)
+    {
+        int newsize = 2 * inter->i_coordsize + 256;
+        inter->i_coords = (int *)resizebytes(inter->i_coords,
+            inter->i_coordsize * sizeof(int), newsize * sizeof(int));
+        inter->i_coordsize = newsize;
+    }
+    inter->i_coords[inter->i_ncoords++] = x;
+    inter->i_coords[inter->i_ncoords++] = (y < 0 ? -(int)(0.5 - y) :
+        (int)(y + 0.5));
+}
+
+static const char sys_base64[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    /* send what sys_coordsadd() collected, if we didn't print it already */
+void sys_coordsend(void)
+{
+    t_instanceinter *inter = pd_this->pd_inter;
+    unsigned char *bytes = (unsigned char *)inter->i_coords;
+    char text[4 * 512 + 1];
+    int i, j, nbytes, wordsize = 2, n = inter->i_ncoords;
+    if (!inter->i_binarycoords)
+        return;
+    for (i = 0; i < n; i++)
+        if (inter->i_coords[i] < -32768 || inter->i_coords[i] > 32767)
+            wordsize = 4;
+        /* pack them into bytes in place.  Byte i*wordsize is never past
+        the start of coordinate i, which we read before overwriting. */
+    for (i = 0; i < n; i++)
+    {
+        int w = inter->i_coords[i];
+        for (j = 0; j < wordsize; j++)
+            bytes[i * wordsize + j] = (w >> (8 * j)) & 0xff;
+    }
+    nbytes = n * wordsize;
+    sys_vgui("[pdtk_coords %c {", (wordsize == 2 ? 's' : 'i'));
+    for (i = 0; i < nbytes; )
+    {
+        int out = 0;
+        for (; i < nbytes && out < 4 * 512; i += 3)
+        {
+            int nleft = nbytes - i, w = (bytes[i] << 16) |
+                (nleft > 1 ? bytes[i+1] << 8 : 0) | (nleft > 2 ? bytes[i+2] : 0);
+            text[out++] = sys_base64[(w >> 18) & 63];
+            text[out++] = sys_base64[(w >> 12) & 63];
+            text[out++] = (nleft > 1 ? sys_base64[(w >> 6) & 63] : '=');
+            text[out++] = (nleft > 2 ? sys_base64[w & 63] : '=');
+        }
+        text[out] = 0;
+        sys_gui(text);
+    }
+    sys_gui("}] \\\n");
+    inter->i_ncoords = 0;
+}
+
 void glob_ping(t_pd *dummy)
 {
     pd_this->pd_inter->i_waitingforping = 0;
 }
 
+static unsigned int guiqueue_hash(void *client, int size)
+{
+    size_t h = (size_t)client;
+    h ^= (h >> 4) ^ (h >> 13);
+    return ((unsigned int)h & (size - 1));
+}
+
+static void guiqueue_rehash(int size)
+{
+    t_instanceinter *inter = pd_this->pd_inter;
+    t_guiqueue **hash = (t_guiqueue **)getbytes(size * sizeof(*hash)), *gq;
+    for (gq = inter->i_guiqueuehead; gq; gq = gq->gq_next)
+    {
+        t_guiqueue **bucket = &hash[guiqueue_hash(gq->gq_client, size)];
+        gq->gq_hashnext = *bucket;
+        *bucket = gq;
+    }
+    if (inter->i_guihash)
+        freebytes(inter->i_guihash,
+            inter->i_guihashsize * sizeof(*inter->i_guihash));
+    inter->i_guihash = hash;
+    inter->i_guihashsize = size;
+}
+
+    /* take an entry out of the queue and the hash table, and free it */
+static void guiqueue_remove(t_guiqueue *gq)
+{
+    t_instanceinter *inter = pd_this->pd_inter;
+    t_guiqueue **bucket =
+        &inter->i_guihash[guiqueue_hash(gq->gq_client, inter->i_guihashsize)];
+    while (*bucket != gq)
+        bucket = &(*bucket)->gq_hashnext;
+    *bucket = gq->gq_hashnext;
+    if (gq->gq_prev)
+        gq->gq_prev->gq_next = gq->gq_next;
+    else inter->i_guiqueuehead = gq->gq_next;
+    if (gq->gq_next)
+        gq->gq_next->gq_prev = gq->gq_prev;
+    else inter->i_guiqueuetail = gq->gq_prev;
+    inter->i_nguiqueue--;
+    t_freebytes(gq, sizeof(*gq));
+}
+
+    /* Queued updates are sent in "frames", at most sys_guifps times a
+    second.  A frame sends whatever was in the queue when it started (maybe
+    over several calls, as the pings allow); anything queued after that
+    waits for the next frame.  Since each client is queued only once, an
+    object that changes at control or audio rate gets redrawn with its
+    latest state once per frame, however fast it changes.  "pd guifps 0"
+    sends updates as soon as possible, as before. */
+static t_float sys_guifps = 60;
+
+static int guiqueue_inframe(t_guiqueue *gq)
+{
+    return ((int)(gq->gq_seq - pd_this->pd_inter->i_guiframeseq) <= 0);
+}
+
+    /* "guifps" message to Pd */
+void glob_guifps(void *dummy, t_floatarg f)
+{
+    sys_guifps = (f > 0 ? f : 0);
+}
+
 static int sys_flushqueue(void)
 {
-    int wherestop = pd_this->pd_inter->i_bytessincelastping + GUI_UPDATESLICE;
+    t_instanceinter *inter = pd_this->pd_inter;
+    int wherestop = inter->i_bytessincelastping + GUI_UPDATESLICE;
     if (wherestop + (GUI_UPDATESLICE >> 1) > GUI_BYTESPERPING)
         wherestop = 0x7fffffff;
-    if (pd_this->pd_inter->i_waitingforping)
+    if (inter->i_waitingforping)
         return (0);
-    if (!pd_this->pd_inter->i_guiqueuehead)
+    if (!inter->i_guiqueuehead)
         return (0);
+    if (!guiqueue_inframe(inter->i_guiqueuehead))
+    {
+            /* start a new frame if it's time */
+        double now = sys_getrealtime();
+        if (sys_guifps > 0 && now < inter->i_guiframetime + 1. / sys_guifps)
+            return (0);
+        inter->i_guiframetime = now;
+        inter->i_guiframeseq = inter->i_guiseq;
+    }
     while (1)
     {
         if (pd_this->pd_inter->i_bytessincelastping >= GUI_BYTESPERPING)
@@ -839,12 +1853,15 @@ static int sys_flushqueue(void)
             pd_this->pd_inter->i_waitingforping = 1;
             return (1);
         }
-        if (pd_this->pd_inter->i_guiqueuehead)
+        if (pd_this->pd_inter->i_guiqueuehead &&
+            guiqueue_inframe(pd_this->pd_inter->i_guiqueuehead))
         {
             t_guiqueue *headwas = pd_this->pd_inter->i_guiqueuehead;
-            pd_this->pd_inter->i_guiqueuehead = headwas->gq_next;
-            (*headwas->gq_fn)(headwas->gq_client, headwas->gq_glist);
-            t_freebytes(headwas, sizeof(*headwas));
+            void *client = headwas->gq_client;
+            t_glist *glist = headwas->gq_glist;
+            t_guicallbackfn fn = headwas->gq_fn;
+            guiqueue_remove(headwas);
+            (*fn)(client, glist);
             if (pd_this->pd_inter->i_bytessincelastping >= wherestop)
                 break;
         }
@@ -881,47 +1898,48 @@ void sys_pretendguibytes(int n)
 
 void sys_queuegui(void *client, t_glist *glist, t_guicallbackfn f)
 {
-    t_guiqueue **gqnextptr, *gq;
-    if (!pd_this->pd_inter->i_guiqueuehead)
-        gqnextptr = &pd_this->pd_inter->i_guiqueuehead;
-    else
-    {
-        for (gq = pd_this->pd_inter->i_guiqueuehead; gq->gq_next;
-            gq = gq->gq_next)
+    t_instanceinter *inter = pd_this->pd_inter;
+    t_guiqueue **bucket, *gq;
+        /* with no GUI nothing will ever be flushed; canvases are redrawn
+        from scratch if one connects later (see sys_startgui()). */
+    if (!inter->i_havegui)
+        return;
+    if (inter->i_guihashsize)
+        for (gq = inter->i_guihash[guiqueue_hash(client, inter->i_guihashsize)];
+            gq; gq = gq->gq_hashnext)
                 if (gq->gq_client == client)
                     return;
-        if (gq->gq_client == client)
-            return;
-        gqnextptr = &gq->gq_next;
-    }
+    if (inter->i_nguiqueue >= inter->i_guihashsize)
+        guiqueue_rehash(inter->i_guihashsize ?
+            2 * inter->i_guihashsize : GUIHASHMIN);
     gq = t_getbytes(sizeof(*gq));
-    gq->gq_next = 0;
     gq->gq_client = client;
     gq->gq_glist = glist;
     gq->gq_fn = f;
     gq->gq_next = 0;
-    *gqnextptr = gq;
+    gq->gq_seq = ++inter->i_guiseq;
+    if ((gq->gq_prev = inter->i_guiqueuetail))
+        inter->i_guiqueuetail->gq_next = gq;
+    else inter->i_guiqueuehead = gq;
+    inter->i_guiqueuetail = gq;
+    bucket = &inter->i_guihash[guiqueue_hash(client, inter->i_guihashsize)];
+    gq->gq_hashnext = *bucket;
+    *bucket = gq;
+    inter->i_nguiqueue++;
 }
 
 void sys_unqueuegui(void *client)
 {
-    t_guiqueue *gq, *gq2;
-    while (pd_this->pd_inter->i_guiqueuehead &&
-        pd_this->pd_inter->i_guiqueuehead->gq_client == client)
-    {
-        gq = pd_this->pd_inter->i_guiqueuehead;
-        pd_this->pd_inter->i_guiqueuehead =
-            pd_this->pd_inter->i_guiqueuehead->gq_next;
-        t_freebytes(gq, sizeof(*gq));
-    }
-    if (!pd_this->pd_inter->i_guiqueuehead)
+    t_instanceinter *inter = pd_this->pd_inter;
+    t_guiqueue *gq;
+    if (!inter->i_guihashsize)
         return;
-    for (gq = pd_this->pd_inter->i_guiqueuehead; (gq2 = gq->gq_next); gq = gq2)
-        if (gq2->gq_client == client)
+    for (gq = inter->i_guihash[guiqueue_hash(client, inter->i_guihashsize)];
+        gq; gq = gq->gq_hashnext)
+            if (gq->gq_client == client)
     {
-        gq->gq_next = gq2->gq_next;
-        t_freebytes(gq2, sizeof(*gq2));
-        break;
+        guiqueue_remove(gq);
+        return;
     }
 }
 
@@ -955,10 +1973,27 @@ void sys_init_fdpoll(void)
 
 static int sys_watchfd;
 
+    /* what the watchdog should watch for besides Pd hanging: if the worst
+    DSP tick between pings takes longer than sys_watchdogdeadline msec (or
+    audio errors occur) for sys_watchdogmisses pings running, it takes
+    sys_watchdogaction ("log", "priority", or "restart") */
+double sys_watchdogdeadline;
+int sys_watchdogmisses = 3;
+char sys_watchdogaction[10] = "log";
+
 #if defined(__linux__) || defined(__FreeBSD_kernel__) || defined(__GNU__)
+    /* each ping is a line giving the worst DSP tick time in microseconds,
+    the number of ticks that took longer than they last, and the number of
+    audio errors since the last ping. */
 void glob_watchdog(t_pd *dummy)
 {
-    if (write(sys_watchfd, "\n", 1) < 1)
+    char buf[80];
+    double maxtime;
+    int nlate, nxrun, n;
+    sched_watchdogstats(&maxtime, &nlate, &nxrun);
+    n = snprintf(buf, sizeof(buf), "%d %d %d\n",
+        (int)(1000000 * maxtime), nlate, nxrun);
+    if (write(sys_watchfd, buf, n) < n)
     {
         fprintf(stderr, "pd: watchdog process died\n");
         sys_bail(1);
@@ -1321,9 +2356,10 @@ static int sys_do_startgui(const char *libdir)
     }
 
     pd_this->pd_inter->i_socketreceiver = socketreceiver_new(0, 0, 0, 0);
-    sys_addpollfn(pd_this->pd_inter->i_guisock,
-        (t_fdpollfn)socketreceiver_read,
-            pd_this->pd_inter->i_socketreceiver);
+    if (!sys_guithread || sys_startguithread())
+        sys_addpollfn(pd_this->pd_inter->i_guisock,
+            (t_fdpollfn)socketreceiver_read,
+                pd_this->pd_inter->i_socketreceiver);
 
             /* here is where we start the pinging. */
 #if defined(__linux__) || defined(__FreeBSD_kernel__)
@@ -1375,6 +2411,13 @@ void sys_setrealtime(const char *libdir)
                 cmdbuf);
             sys_hipriority = 0;
         }
+        else if (sys_watchdogdeadline > 0)
+        {
+            int len = strlen(cmdbuf);
+            snprintf(cmdbuf + len, MAXPDSTRING - len,
+                " -deadline %g -misses %d -action %s", sys_watchdogdeadline,
+                    sys_watchdogmisses, sys_watchdogaction);
+        }
     }
     if (sys_hipriority)
     {
@@ -1483,11 +2526,14 @@ void sys_bail(int n)
 void glob_quit(void *dummy)
 {
     sys_close_audio();
+    sys_stopmidithread();
     sys_close_midi();
     if (sys_havegui())
     {
+        if (pd_this->pd_inter->i_guithreaded)
+            sys_stopguithread();
+        else sys_rmpollfn(pd_this->pd_inter->i_guisock);
         sys_closesocket(pd_this->pd_inter->i_guisock);
-        sys_rmpollfn(pd_this->pd_inter->i_guisock);
     }
     exit(0);
 }
@@ -1538,8 +2584,13 @@ void sys_stopgui(void)
     sys_vgui("%s", "exit\n");
     if (pd_this->pd_inter->i_guisock >= 0)
     {
+        if (pd_this->pd_inter->i_guithreaded)
+        {
+            sys_flushtogui();
+            sys_stopguithread();
+        }
+        else sys_rmpollfn(pd_this->pd_inter->i_guisock);
         sys_closesocket(pd_this->pd_inter->i_guisock);
-        sys_rmpollfn(pd_this->pd_inter->i_guisock);
         pd_this->pd_inter->i_guisock = -1;
     }
     pd_this->pd_inter->i_havegui = 0;
@@ -1550,9 +2601,25 @@ void sys_stopgui(void)
 void s_inter_newpdinstance(void)
 {
     pd_this->pd_inter = getbytes(sizeof(*pd_this->pd_inter));
+    pd_this->pd_inter->i_fdqueued = 0;
+#if defined(FDPOLL_EPOLL)
+    pd_this->pd_inter->i_pollfd = epoll_create1(EPOLL_CLOEXEC);
+#elif defined(FDPOLL_KQUEUE)
+    if ((pd_this->pd_inter->i_pollfd = kqueue()) >= 0)
+        fcntl(pd_this->pd_inter->i_pollfd, F_SETFD, FD_CLOEXEC);
+#else
+    pd_this->pd_inter->i_pollfd = -1;
+#endif
 #if PDTHREADS
     pthread_mutex_init(&pd_this->pd_inter->i_mutex, NULL);
+#ifdef PDINSTANCE
+    pthread_mutex_init(&pd_this->pd_inter->i_globalmutex, NULL);
+#endif
     pd_this->pd_islocked = 0;
+    pthread_mutex_init(&pd_this->pd_inter->i_fdlistmutex, NULL);
+    sys_ringbuf_init(&pd_this->pd_inter->i_fdqueue, FDQUEUESIZE,
+        pd_this->pd_inter->i_fdqueuebuf, 0);
+    pd_this->pd_inter->i_fdsent = pd_this->pd_inter->i_fdhandled = 0;
 #endif
 #ifdef _WIN32
     pd_this->pd_inter->i_freq = 0;
@@ -1562,6 +2629,17 @@ void s_inter_newpdinstance(void)
 
 void s_inter_free(t_instanceinter *inter)
 {
+    while (inter->i_guiqueuehead)
+    {
+        t_guiqueue *gq = inter->i_guiqueuehead;
+        inter->i_guiqueuehead = gq->gq_next;
+        t_freebytes(gq, sizeof(*gq));
+    }
+    if (inter->i_guihash)
+        freebytes(inter->i_guihash,
+            inter->i_guihashsize * sizeof(*inter->i_guihash));
+    if (inter->i_coords)
+        freebytes(inter->i_coords, inter->i_coordsize * sizeof(int));
     if (inter->i_fdpoll)
     {
         binbuf_free(inter->i_inbinbuf);
@@ -1570,6 +2648,16 @@ void s_inter_free(t_instanceinter *inter)
         inter->i_fdpoll = 0;
         inter->i_nfdpoll = 0;
     }
+#ifdef FDPOLL_KERNEL
+    if (inter->i_pollfd >= 0)
+        close(inter->i_pollfd);
+#endif
+#if PDTHREADS
+    pthread_mutex_destroy(&inter->i_fdlistmutex);
+#ifdef PDINSTANCE
+    pthread_mutex_destroy(&inter->i_globalmutex);
+#endif
+#endif
     freebytes(inter, sizeof(*inter));
 }
 
@@ -1580,7 +2668,7 @@ void s_inter_freepdinstance(void)
 
 #if PDTHREADS
 #ifdef PDINSTANCE
-static pthread_rwlock_t sys_rwlock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_mutex_t sys_globalmutex = PTHREAD_MUTEX_INITIALIZER;
 #else /* PDINSTANCE */
 static pthread_mutex_t sys_mutex = PTHREAD_MUTEX_INITIALIZER;
 #endif /* PDINSTANCE */
@@ -1594,23 +2682,71 @@ methods to them, or creating or freeing Pd instances.  They should probably
 not be called from outside Pd.  They should be called at a point where the
 current instance of Pd is currently locked via sys_lock() below; this gains
 read access to the class and instance lists which must be released for the
-write-lock to be available. */
+write-lock to be available.
+
+The read side is on every instance's hot path (typically once per DSP tick)
+so that, rather than a single reader/writer lock whose cache line all the
+instances' threads would fight over, each instance has a mutex of its own
+which its readers take.  A writer gives up its own, takes sys_globalmutex so
+that there's only one writer at a time, and then takes every instance's
+mutex in turn.  Instances can then run concurrently without sharing any lock
+until somebody creates a class or an instance. */
+
+#ifdef PDINSTANCE
+    /* whether the current instance is in pd_instances yet (or still) */
+static int pd_thisislisted(void)
+{
+    int n = pd_this->pd_instanceno;
+    return (n >= 0 && n < pd_ninstances && pd_instances[n] == pd_this);
+}
+#endif /* PDINSTANCE */
 
 void pd_globallock(void)
 {
 #ifdef PDINSTANCE
+    int i;
+    if (pd_this->pd_islocked > 1)   /* already have it: just count */
+    {
+        pd_this->pd_islocked++;
+        return;
+    }
     if (!pd_this->pd_islocked)
+    {
         bug("pd_globallock");
-    pthread_rwlock_unlock(&sys_rwlock);
-    pthread_rwlock_wrlock(&sys_rwlock);
+        return;
+    }
+    pthread_mutex_unlock(&pd_this->pd_inter->i_globalmutex);
+    pthread_mutex_lock(&sys_globalmutex);
+    for (i = 0; i < pd_ninstances; i++)
+        pthread_mutex_lock(&pd_instances[i]->pd_inter->i_globalmutex);
+    if (!pd_thisislisted())
+        pthread_mutex_lock(&pd_this->pd_inter->i_globalmutex);
+    pd_this->pd_islocked = 2;
 #endif /* PDINSTANCE */
 }
 
+    /* the instance list may have changed since pd_globallock() (this is
+    how instances get added and deleted) but we still hold exactly the
+    mutexes of the instances listed now, plus our own. */
 void pd_globalunlock(void)
 {
 #ifdef PDINSTANCE
-    pthread_rwlock_unlock(&sys_rwlock);
-    pthread_rwlock_rdlock(&sys_rwlock);
+    int i;
+    if (pd_this->pd_islocked > 2)
+    {
+        pd_this->pd_islocked--;
+        return;
+    }
+    if (pd_this->pd_islocked != 2)
+    {
+        bug("pd_globalunlock");
+        return;
+    }
+    for (i = 0; i < pd_ninstances; i++)
+        if (pd_instances[i] != pd_this)
+            pthread_mutex_unlock(&pd_instances[i]->pd_inter->i_globalmutex);
+    pthread_mutex_unlock(&sys_globalmutex);
+    pd_this->pd_islocked = 1;
 #endif /* PDINSTANCE */
 }
 
@@ -1621,7 +2757,7 @@ void sys_lock(void)
 {
 #ifdef PDINSTANCE
     pthread_mutex_lock(&pd_this->pd_inter->i_mutex);
-    pthread_rwlock_rdlock(&sys_rwlock);
+    pthread_mutex_lock(&pd_this->pd_inter->i_globalmutex);
     pd_this->pd_islocked = 1;
 #else
     pthread_mutex_lock(&sys_mutex);
@@ -1631,8 +2767,13 @@ void sys_lock(void)
 void sys_unlock(void)
 {
 #ifdef PDINSTANCE
+    if (pd_this->pd_islocked > 1)
+    {
+        pd_this->pd_islocked = 2;
+        pd_globalunlock();
+    }
     pd_this->pd_islocked = 0;
-    pthread_rwlock_unlock(&sys_rwlock);
+    pthread_mutex_unlock(&pd_this->pd_inter->i_globalmutex);
     pthread_mutex_unlock(&pd_this->pd_inter->i_mutex);
 #else
     pthread_mutex_unlock(&sys_mutex);
@@ -1645,8 +2786,11 @@ int sys_trylock(void)
     int ret;
     if (!(ret = pthread_mutex_trylock(&pd_this->pd_inter->i_mutex)))
     {
-        if (!(ret = pthread_rwlock_tryrdlock(&sys_rwlock)))
+        if (!(ret = pthread_mutex_trylock(&pd_this->pd_inter->i_globalmutex)))
+        {
+            pd_this->pd_islocked = 1;
             return (0);
+        }
         else
         {
             pthread_mutex_unlock(&pd_this->pd_inter->i_mutex);
@@ -1678,6 +2822,7 @@ void sys_unlock(void)
 void sys_lock(void) {}
 void sys_unlock(void) {}
 #endif
+int sys_trylock(void) { return (0); }
 void pd_globallock(void) {}
 void pd_globalunlock(void) {}
 
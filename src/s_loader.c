@@ -4,6 +4,8 @@
 
 #if defined(HAVE_LIBDL) || defined(__FreeBSD__)
 #include <dlfcn.h>
+#include <fcntl.h>
+#include <errno.h>
 #endif
 #ifdef HAVE_UNISTD_H
 #include <stdlib.h>
@@ -111,6 +113,37 @@ void sys_putonloadlist(const char *classname)
 
 void class_set_extern_dir(t_symbol *s);
 
+    /* where each external came from, so that "pd reload" can load it again */
+typedef struct _loadedlib
+{
+    t_symbol *l_name;       /* the name it was loaded by */
+    t_symbol *l_file;       /* absolute filename */
+    t_symbol *l_dir;        /* its directory */
+    t_symbol *l_setup;      /* name of the setup function */
+    struct _loadedlib *l_next;
+} t_loadedlib;
+
+static t_loadedlib *sys_loadedlibs;
+
+static void sys_noteloadedlib(const char *name, const char *file,
+    const char *dir, const char *setup)
+{
+    t_loadedlib *l;
+    for (l = sys_loadedlibs; l; l = l->l_next)
+        if (l->l_name == gensym(name))
+            break;
+    if (!l)
+    {
+        l = (t_loadedlib *)getbytes(sizeof(*l));
+        l->l_name = gensym(name);
+        l->l_next = sys_loadedlibs;
+        sys_loadedlibs = l;
+    }
+    l->l_file = gensym(file);
+    l->l_dir = gensym(dir);
+    l->l_setup = gensym(setup);
+}
+
 static int sys_do_load_abs(t_canvas *canvas, const char *objectname,
     const char *path);
 static int sys_do_load_lib(t_canvas *canvas, const char *objectname,
@@ -170,7 +203,7 @@ static int sys_do_load_lib(t_canvas *canvas, const char *objectname,
         /* try looking in the path for (objectname).(sys_dllextent) ... */
     for(dllextent=sys_dllextent; *dllextent; dllextent++)
     {
-        if ((fd = sys_trytoopenone(path, objectname, *dllextent,
+        if ((fd = sys_trytoopenlisted(path, objectname, *dllextent,
             dirbuf, &nameptr, MAXPDSTRING, 1)) >= 0)
                 goto gotone;
     }
@@ -182,7 +215,7 @@ static int sys_do_load_lib(t_canvas *canvas, const char *objectname,
     filename[MAXPDSTRING-1] = 0;
     for(dllextent=sys_dllextent; *dllextent; dllextent++)
     {
-        if ((fd = sys_trytoopenone(path, filename, *dllextent,
+        if ((fd = sys_trytoopenlisted(path, filename, *dllextent,
             dirbuf, &nameptr, MAXPDSTRING, 1)) >= 0)
                 goto gotone;
     }
@@ -194,7 +227,7 @@ static int sys_do_load_lib(t_canvas *canvas, const char *objectname,
     if (libname[len-1] == '~' && len < MAXPDSTRING - 6) {
         strcpy(libname+len-1, "_tilde");
     }
-    if ((fd = sys_trytoopenone(path, libname, ".so",
+    if ((fd = sys_trytoopenlisted(path, libname, ".so",
         dirbuf, &nameptr, MAXPDSTRING, 1)) >= 0)
             goto gotone;
 #endif
@@ -264,9 +297,94 @@ gotone:
     }
     (*makeout)();
     class_set_extern_dir(&s_);
+    sys_noteloadedlib(objectname, filename, dirbuf, symname);
     return (1);
 }
 
+    /* Load an external again from its file (for "pd reload").  The old
+    code can't be unloaded while anything might still be running it, and
+    opening the same file again would just return it, so the file is copied
+    under a fresh name and that is opened, with its own symbols taking
+    precedence over the old copy's.  Its setup function then redefines the
+    classes (the old ones are renamed out of the way by class_new()).
+    Returns the directory the external was loaded from (so the caller can
+    remake the objects whose classes came from there), or 0 if "name"
+    isn't a loaded external or reloading failed. */
+t_symbol *sys_reload_lib(t_symbol *name)
+{
+#if defined(HAVE_LIBDL) || defined(__FreeBSD__)
+    static int count;
+    t_loadedlib *l;
+    char tmpname[MAXPDSTRING], buf[8192];
+    const char *tmpdir = getenv("TMPDIR"), *base;
+    void *dlobj;
+    t_xxx makeout;
+    int from, to, n, flags = RTLD_NOW | RTLD_LOCAL;
+    for (l = sys_loadedlibs; l; l = l->l_next)
+    {
+        const char *slash = strrchr(l->l_name->s_name, '/');
+        if (l->l_name == name || (slash && !strcmp(slash + 1, name->s_name)))
+            break;
+    }
+    if (!l)
+        return (0);
+    if (!(base = strrchr(l->l_file->s_name, '/')))
+        base = l->l_file->s_name;
+    else base++;
+    snprintf(tmpname, MAXPDSTRING, "%s/pd-reload-%d-%d-%s",
+        (tmpdir ? tmpdir : "/tmp"), (int)getpid(), ++count, base);
+    if ((from = open(l->l_file->s_name, O_RDONLY)) < 0)
+    {
+        pd_error(0, "reload: %s: %s", l->l_file->s_name, strerror(errno));
+        return (0);
+    }
+    if ((to = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0700)) < 0)
+    {
+        pd_error(0, "reload: %s: %s", tmpname, strerror(errno));
+        close(from);
+        return (0);
+    }
+    while ((n = (int)read(from, buf, sizeof(buf))) > 0)
+        if (write(to, buf, n) != n)
+    {
+        n = -1;
+        break;
+    }
+    close(from);
+    if (close(to) < 0 || n < 0)
+    {
+        pd_error(0, "reload: %s: couldn't copy", tmpname);
+        unlink(tmpname);
+        return (0);
+    }
+#ifdef RTLD_DEEPBIND
+    flags |= RTLD_DEEPBIND;
+#endif
+    dlobj = dlopen(tmpname, flags);
+        /* once it's mapped the copy isn't needed */
+    unlink(tmpname);
+    if (!dlobj)
+    {
+        pd_error(0, "reload: %s", dlerror());
+        return (0);
+    }
+    if (!(makeout = (t_xxx)dlsym(dlobj, l->l_setup->s_name)) &&
+        !(makeout = (t_xxx)dlsym(dlobj, "setup")))
+    {
+        pd_error(0, "reload: %s: no function \"%s\"",
+            l->l_file->s_name, l->l_setup->s_name);
+        return (0);
+    }
+    class_set_extern_dir(l->l_dir);
+    (*makeout)();
+    class_set_extern_dir(&s_);
+    post("reloaded %s", l->l_file->s_name);
+    return (l->l_dir);
+#else
+    return (0);
+#endif
+}
+
 
 /* linked list of loaders */
 typedef struct loader_queue {
@@ -430,11 +548,8 @@ int pd_setloadingabstraction(t_symbol *sym);
 
 static t_pd *do_create_abstraction(t_symbol*s, int argc, t_atom *argv)
 {
-    /*
-     * TODO: check if the there is a binbuf cached for <canvas::symbol>
-        and use that instead.  We'll have to invalidate the cache once we
-        are done (either with a clock_delay(0) or something else)
-     */
+    /* the file's parsed contents are cached by binbuf_evalfile(), so
+    creating many copies only reads and parses it once */
     if (!pd_setloadingabstraction(s))
     {
         const char *objectname = s->s_name;
@@ -481,11 +596,11 @@ static int sys_do_load_abs(t_canvas *canvas, const char *objectname,
     if (!path) return (0);
 
     snprintf(classslashclass, MAXPDSTRING, "%s/%s", objectname, objectname);
-    if ((fd = sys_trytoopenone(path, objectname, ".pd",
+    if ((fd = sys_trytoopenlisted(path, objectname, ".pd",
               dirbuf, &nameptr, MAXPDSTRING, 1)) >= 0 ||
-        (fd = sys_trytoopenone(path, objectname, ".pat",
+        (fd = sys_trytoopenlisted(path, objectname, ".pat",
               dirbuf, &nameptr, MAXPDSTRING, 1)) >= 0 ||
-        (fd = sys_trytoopenone(path, classslashclass, ".pd",
+        (fd = sys_trytoopenlisted(path, classslashclass, ".pd",
               dirbuf, &nameptr, MAXPDSTRING, 1)) >= 0)
     {
         t_class*c=0;
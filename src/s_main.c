@@ -64,6 +64,7 @@ t_symbol *sys_libdir;
 static t_namelist *sys_openlist;
 static t_namelist *sys_messagelist;
 static int sys_version;
+static int sys_startupprofile;
 int sys_oldtclversion;      /* hack to warn g_rtext.c about old text sel */
 
 int sys_nmidiout = -1;
@@ -81,11 +82,12 @@ static int sys_main_srate;
 static int sys_main_advance;
 static int sys_main_callback;
 static int sys_main_blocksize;
+static int sys_main_schedblocksize;
 static int sys_listplease;
 
 int sys_externalschedlib;
 char sys_externalschedlibname[MAXPDSTRING];
-static int sys_batch;
+int sys_batch;
 int sys_extraflags;
 char sys_extraflagsstring[MAXPDSTRING];
 int sys_run_scheduler(const char *externalschedlibname,
@@ -201,6 +203,59 @@ int sys_fontheight(int fontsize)
 int sys_defaultfont;
 #define DEFAULTFONT 12
 
+/* Startup phases (class setup functions, preferences, GUI, libraries,
+patches) are always timed, since it's cheap and class setup happens before
+the flags are parsed; "-startup-profile" prints them once startup is done. */
+
+#define STARTUPMAXPHASES 256
+
+typedef struct _startupphase
+{
+    char sp_name[64];
+    double sp_msec;
+} t_startupphase;
+
+static t_startupphase sys_startupphases[STARTUPMAXPHASES];
+static int sys_nstartupphases;
+static uint64_t sys_startuptime, sys_startupmark;
+
+void sys_startupphase(const char *name, uint64_t nsec)
+{
+    t_startupphase *p;
+    if (sys_nstartupphases == STARTUPMAXPHASES)
+        return;
+    p = &sys_startupphases[sys_nstartupphases++];
+    strncpy(p->sp_name, name, sizeof(p->sp_name) - 1);
+    p->sp_name[sizeof(p->sp_name) - 1] = 0;
+    p->sp_msec = 1e-6 * nsec;
+}
+
+    /* time from the last mark to now, as a phase */
+static void sys_startupsince(const char *name)
+{
+    uint64_t now = sys_getnanotime();
+    sys_startupphase(name, now - sys_startupmark);
+    sys_startupmark = now;
+}
+
+static void sys_startupreport(void)
+{
+    int i;
+    double setup = 0;
+    post("startup profile (msec):");
+    for (i = 0; i < sys_nstartupphases; i++)
+    {
+        const char *name = sys_startupphases[i].sp_name;
+        int len = (int)strlen(name);
+        if (len > 6 && !strcmp(name + len - 6, "_setup"))
+            setup += sys_startupphases[i].sp_msec;
+        post("%10.3f  %s", sys_startupphases[i].sp_msec, name);
+    }
+    post("%10.3f  (class setup in all)", setup);
+    post("%10.3f  (total since start)",
+        1e-6 * (sys_getnanotime() - sys_startuptime));
+}
+
 static void openit(const char *dirname, const char *filename)
 {
     char dirbuf[MAXPDSTRING], *nameptr;
@@ -259,19 +314,34 @@ void glob_initfromgui(void *dummy, t_symbol *s, int argc, t_atom *argv)
                     sys_gotfonts[j][i].fi_height);
 #endif
     }
+    sys_startupsince(sys_dontstartgui ? "until scheduler started" :
+        "until GUI ready");
         /* load dynamic libraries specified with "-lib" args */
     if (sys_oktoloadfiles(0))
     {
         for  (nl = STUFF->st_externlist; nl; nl = nl->nl_next)
+        {
+            char buf[64];
             if (!sys_load_lib(0, nl->nl_string))
                 post("%s: can't load library", nl->nl_string);
+            snprintf(buf, sizeof(buf), "lib %s", nl->nl_string);
+            sys_startupsince(buf);
+        }
         sys_oktoloadfiles(1);
     }
         /* open patches specifies with "-open" args */
     for  (nl = sys_openlist; nl; nl = nl->nl_next)
+    {
+        char buf[64];
         openit(cwd, nl->nl_string);
+        snprintf(buf, sizeof(buf), "open %s", nl->nl_string);
+        sys_startupsince(buf);
+    }
     namelist_free(sys_openlist);
     sys_openlist = 0;
+        /* report before "-send" messages, which might quit */
+    if (sys_startupprofile)
+        sys_startupreport();
         /* send messages specified with "-send" args */
     for  (nl = sys_messagelist; nl; nl = nl->nl_next)
     {
@@ -350,9 +420,11 @@ int sys_main(int argc, char **argv)
         setuid(getuid());
     }
 #endif  /* _WIN32 */
+    sys_startuptime = sys_startupmark = sys_getnanotime();
     if (socket_init())
         sys_sockerror("socket_init()");
     pd_init();                                  /* start the message system */
+    sys_startupmark = sys_getnanotime();
     sys_findprogdir(argv[0]);                   /* set sys_progname, guipath */
     for (i = noprefs = 0; i < argc; i++)    /* prescan ... */
     {
@@ -372,9 +444,11 @@ int sys_main(int argc, char **argv)
     }
     if (!noprefs)       /* load preferences before parsing args to allow ... */
         sys_loadpreferences(prefsfile, 1);  /* args to override prefs */
+    sys_startupsince("preferences");
     if (sys_argparse(argc-1, argv+1))           /* parse cmd line args */
         return (1);
     sys_afterargparse();                    /* post-argparse settings */
+    sys_startupsince("arguments");
     if (sys_verbose || sys_version) fprintf(stderr, "%s compiled %s %s\n",
         pd_version, pd_compiletime, pd_compiledate);
     if (sys_verbose)
@@ -387,8 +461,12 @@ int sys_main(int argc, char **argv)
             clock_new(0, (t_method)sys_fakefromgui)), 0);
     else if (sys_startgui(sys_libdir->s_name)) /* start the gui */
         return (1);
+    else sys_startupsince("GUI connection");
     if (sys_hipriority)
         sys_setrealtime(sys_libdir->s_name); /* set desired process priority */
+    if (sys_mlock)
+        sys_lockmemory();
+    sys_setthreadrole(SYS_THREAD_AUDIO);    /* the scheduler runs here */
     if (sys_externalschedlib)
         return (sys_run_scheduler(sys_externalschedlibname,
             sys_extraflagsstring));
@@ -400,6 +478,7 @@ int sys_main(int argc, char **argv)
         sys_reopen_midi();
         if (audio_shouldkeepopen())
             sys_reopen_audio();
+        sys_startupsince("audio and MIDI open");
             /* run scheduler until it quits */
         return (m_mainloop());
     }
@@ -420,7 +499,26 @@ static char *(usagemessage[]) = {
 "-channels ...    -- specify both input and output channels\n",
 "-audiobuf <n>    -- specify size of audio buffer in msec\n",
 "-blocksize <n>   -- specify audio I/O block size in sample frames\n",
+"-schedblocksize <n> -- specify the top-level DSP block size (default 64)\n",
+"-audiocpu <cpus> -- run the audio thread on these CPUs (like \"3\" or \"2,4-7\")\n",
+"-guicpu <cpus>   -- CPUs for the GUI I/O thread\n",
+"-filecpu <cpus>  -- CPUs for readsf~ and writesf~ threads\n",
+"-workercpu <cpus> -- CPUs for -dspthreads workers\n",
+"-midicpu <cpus>  -- CPUs for the -midithread input thread\n",
+"-mlock           -- lock all memory into RAM\n",
+"-prefault        -- touch DSP buffers after each DSP recompile\n",
 "-sleepgrain <n>  -- specify number of milliseconds to sleep when idle\n",
+"-adaptivesleep   -- when idle, sleep until the next DSP tick is likely due\n",
+"-dspthreads <n>  -- compute independent subpatches on <n> threads\n",
+"-sfthreads <n>   -- share <n> threads for readsf~ and writesf~ disk I/O\n",
+"-dspfuse         -- fuse chains of arithmetic objects into one loop\n",
+"-dsplocal        -- order the DSP chain to use signals soon after they're made\n",
+"-dspmap <file>   -- write which object owns each DSP perform routine to <file>\n",
+"-noftz           -- don't flush denormal numbers to zero during DSP\n",
+"-hqosc           -- make cos~ and osc~ more accurate, at some extra CPU cost\n",
+"-accuratemath    -- use the C library for mtof~, exp~, pow~ and the like\n",
+"-dither          -- dither audio output to 16- and 24-bit devices\n",
+"-driftcomp       -- resample unsynced devices to follow the first (OSS)\n",
 "-nodac           -- suppress audio output\n",
 "-noadc           -- suppress audio input\n",
 "-noaudio         -- suppress audio input and output (-nosound is synonym) \n",
@@ -462,10 +560,20 @@ static char *(usagemessage[]) = {
 "-audiounit       -- use Apple AudioUnit API\n",
 #endif
 
+#ifdef USEAPI_WASAPI
+"-wasapi          -- use WASAPI (exclusive mode if the device allows)\n",
+#endif
+
 #ifdef USEAPI_ESD
 "-esd             -- use Enlightenment Sound Daemon (ESD) API\n",
 #endif
 
+#ifdef USEAPI_DUMMY
+"-dummy           -- no audio device; keep time in real time by the block size\n",
+"-dummyfree       -- no audio device; run as fast as possible\n",
+"-dummyjitter <n> -- with -dummy, let each block arrive up to n msec late\n",
+#endif
+
 "      (default audio API for this platform:  ", API_DEFSTRING, ")\n\n",
 
 "\nMIDI configuration flags:\n",
@@ -478,6 +586,8 @@ static char *(usagemessage[]) = {
 "-nomidiin        -- suppress MIDI input\n",
 "-nomidiout       -- suppress MIDI output\n",
 "-nomidi          -- suppress MIDI input and output\n",
+"-midithread      -- read MIDI input in a separate thread\n",
+"-midistamp       -- let the MIDI API time output (ALSA and portmidi)\n",
 #ifdef USEAPI_OSS
 "-ossmidi         -- use OSS midi API\n",
 #endif
@@ -499,6 +609,7 @@ static char *(usagemessage[]) = {
 "-verbose         -- extra printout on startup and when searching for files\n",
 "-noverbose       -- no extra printout\n",
 "-version         -- don't run Pd; just print out which version it is \n",
+"-startup-profile -- print how long each part of starting up took\n",
 "-d <n>           -- specify debug level\n",
 "-loadbang        -- do not suppress all loadbangs (true by default)\n",
 "-noloadbang      -- suppress all loadbangs\n",
@@ -508,6 +619,7 @@ static char *(usagemessage[]) = {
 "-nogui           -- suppress starting the GUI\n",
 "-guiport <n>     -- connect to pre-existing GUI over port <n>\n",
 "-guicmd \"cmd...\" -- start alternatve GUI program (e.g., remote via ssh)\n",
+"-guithread       -- send to and receive from the GUI in a separate thread\n",
 "-send \"msg...\"   -- send a message at startup, after patches are loaded\n",
 "-prefs           -- load preferences on startup (true by default)\n",
 "-noprefs         -- suppress loading preferences on startup\n",
@@ -515,12 +627,22 @@ static char *(usagemessage[]) = {
 #ifdef HAVE_UNISTD_H
 "-rt or -realtime -- use real-time priority\n",
 "-nrt             -- don't use real-time priority\n",
+"-watchdog <msec> -- with -rt, have the watchdog check DSP ticks against\n",
+"                    this deadline between its pings (every 2 seconds)\n",
+"-watchdogmisses <n>    -- act after n bad pings in a row (default 3)\n",
+"-watchdogaction <what> -- \"log\" (default), \"priority\" to drop real-time\n",
+"                    priority, or \"restart\" to end Pd for its supervisor\n",
 #endif
 "-sleep           -- sleep when idle, don't spin (true by default)\n",
 "-nosleep         -- spin, don't sleep (may lower latency on multi-CPUs)\n",
 "-schedlib <file> -- plug in external scheduler (omit file extensions)\n",
 "-extraflags <s>  -- string argument to send schedlib\n",
 "-batch           -- run off-line as a batch process\n",
+"-render <file>   -- run as a batch process, writing output to a soundfile\n",
+"-renderbytes <n> -- sample size for -render: 2, 3 or 4 (float; default)\n",
+"-duration <n>    -- seconds to render (else until the patch quits)\n",
+"-bench <what>    -- time signal classes (\"dsp\" for all of them) or the\n",
+"                    message path (\"control\") and exit\n",
 "-nobatch         -- run interactively (true by default)\n",
 "-autopatch       -- enable auto-patching to new objects (true by default)\n",
 "-noautopatch     -- defeat auto-patching\n",
@@ -728,6 +850,51 @@ int sys_argparse(int argc, char **argv)
             sys_main_blocksize = atoi(argv[1]);
             argc -= 2; argv += 2;
         }
+        else if (!strcmp(*argv, "-schedblocksize") && argc > 1)
+        {
+            sys_main_schedblocksize = atoi(argv[1]);
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(*argv, "-audiocpu"))
+        {
+            if (argc < 2 || sys_setthreadcpus(SYS_THREAD_AUDIO, argv[1]) < 0)
+                goto usage;
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(*argv, "-guicpu"))
+        {
+            if (argc < 2 || sys_setthreadcpus(SYS_THREAD_GUI, argv[1]) < 0)
+                goto usage;
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(*argv, "-filecpu"))
+        {
+            if (argc < 2 || sys_setthreadcpus(SYS_THREAD_FILE, argv[1]) < 0)
+                goto usage;
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(*argv, "-workercpu"))
+        {
+            if (argc < 2 || sys_setthreadcpus(SYS_THREAD_WORKER, argv[1]) < 0)
+                goto usage;
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(*argv, "-midicpu"))
+        {
+            if (argc < 2 || sys_setthreadcpus(SYS_THREAD_MIDI, argv[1]) < 0)
+                goto usage;
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(*argv, "-mlock"))
+        {
+            sys_mlock = 1;
+            argc--; argv++;
+        }
+        else if (!strcmp(*argv, "-prefault"))
+        {
+            sys_prefaulting = 1;
+            argc--; argv++;
+        }
         else if (!strcmp(*argv, "-sleepgrain"))
         {
             if (argc < 2)
@@ -736,6 +903,69 @@ int sys_argparse(int argc, char **argv)
             sys_sleepgrain = 1000 * atof(argv[1]);
             argc -= 2; argv += 2;
         }
+        else if (!strcmp(*argv, "-adaptivesleep"))
+        {
+            sys_adaptivesleep = 1;
+            argc--; argv++;
+        }
+        else if (!strcmp(*argv, "-dspthreads"))
+        {
+            if (argc < 2)
+                goto usage;
+            if ((sys_dspthreads = atoi(argv[1])) < 1)
+                sys_dspthreads = 1;
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(*argv, "-sfthreads"))
+        {
+            if (argc < 2)
+                goto usage;
+            if ((sys_sfthreads = atoi(argv[1])) < 1)
+                sys_sfthreads = 1;
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(*argv, "-dspfuse"))
+        {
+            sys_dspfuse = 1;
+            argc--; argv++;
+        }
+        else if (!strcmp(*argv, "-dsplocal"))
+        {
+            sys_dsplocal = 1;
+            argc--; argv++;
+        }
+        else if (!strcmp(*argv, "-dspmap"))
+        {
+            if (argc < 2)
+                goto usage;
+            snprintf(sys_dspmap, MAXPDSTRING, "%s", argv[1]);
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(*argv, "-noftz"))
+        {
+            sys_dspftz = 0;
+            argc--; argv++;
+        }
+        else if (!strcmp(*argv, "-hqosc"))
+        {
+            sys_hqosc = 1;
+            argc--; argv++;
+        }
+        else if (!strcmp(*argv, "-accuratemath"))
+        {
+            sys_accuratemath = 1;
+            argc--; argv++;
+        }
+        else if (!strcmp(*argv, "-dither"))
+        {
+            sys_dither = 1;
+            argc--; argv++;
+        }
+        else if (!strcmp(*argv, "-driftcomp"))
+        {
+            sys_driftcomp = 1;
+            argc--; argv++;
+        }
         else if (!strcmp(*argv, "-nodac"))
         {
             sys_nsoundout=0;
@@ -884,6 +1114,36 @@ int sys_argparse(int argc, char **argv)
             argc--; argv++;
         }
 #endif
+#ifdef USEAPI_WASAPI
+        else if (!strcmp(*argv, "-wasapi"))
+        {
+            sys_set_audio_api(API_WASAPI);
+            sys_mmio = 0;
+            argc--; argv++;
+        }
+#else
+        else if (!strcmp(*argv, "-wasapi"))
+        {
+            fprintf(stderr, "Pd compiled without WASAPI-support, ignoring '%s' flag\n", *argv);
+            argc--; argv++;
+        }
+#endif
+#ifdef USEAPI_DUMMY
+        else if (!strcmp(*argv, "-dummy") || !strcmp(*argv, "-dummyfree"))
+        {
+            sys_set_audio_api(API_DUMMY);
+            dummy_setmode(!strcmp(*argv, "-dummyfree"), -1);
+            argc--; argv++;
+        }
+        else if (!strcmp(*argv, "-dummyjitter"))
+        {
+            if (argc < 2)
+                goto usage;
+            sys_set_audio_api(API_DUMMY);
+            dummy_setmode(-1, atof(argv[1]));
+            argc -= 2; argv += 2;
+        }
+#endif
 #ifdef USEAPI_ESD
         else if (!strcmp(*argv, "-esd"))
         {
@@ -906,6 +1166,16 @@ int sys_argparse(int argc, char **argv)
             sys_nmidiin = sys_nmidiout = 0;
             argc--; argv++;
         }
+        else if (!strcmp(*argv, "-midithread"))
+        {
+            sys_midithread = 1;
+            argc--; argv++;
+        }
+        else if (!strcmp(*argv, "-midistamp"))
+        {
+            sys_midistamp = 1;
+            argc--; argv++;
+        }
         else if (!strcmp(*argv, "-midiindev"))
         {
             if (argc < 2)
@@ -1124,6 +1394,11 @@ int sys_argparse(int argc, char **argv)
             argc -= 2;
             argv += 2;
         }
+        else if (!strcmp(*argv, "-guithread"))
+        {
+            sys_guithread = 1;
+            argc--; argv++;
+        }
         else if (!strcmp(*argv, "-nostderr"))
         {
             sys_printtostderr = 0;
@@ -1186,11 +1461,46 @@ int sys_argparse(int argc, char **argv)
             argv += 2;
             argc -= 2;
         }
+        else if (!strcmp(*argv, "-startup-profile"))
+        {
+            sys_startupprofile = 1;
+            argc--; argv++;
+        }
         else if (!strcmp(*argv, "-batch"))
         {
             sys_batch = 1;
             argc--; argv++;
         }
+        else if (!strcmp(*argv, "-render"))
+        {
+            if (argc < 2)
+                goto usage;
+            sys_renderfile = argv[1];
+            sys_batch = 1;
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(*argv, "-renderbytes"))
+        {
+            if (argc < 2)
+                goto usage;
+            sys_renderbytes = atoi(argv[1]);
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(*argv, "-duration"))
+        {
+            if (argc < 2)
+                goto usage;
+            sys_renderduration = atof(argv[1]);
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(*argv, "-bench"))
+        {
+            if (argc < 2)
+                goto usage;
+            sys_bench = argv[1];
+            sys_batch = 1;
+            argc -= 2; argv += 2;
+        }
         else if (!strcmp(*argv, "-nobatch"))
         {
             sys_batch = 0;
@@ -1229,6 +1539,25 @@ int sys_argparse(int argc, char **argv)
             sys_hipriority = 0;
             argc--; argv++;
         }
+        else if (!strcmp(*argv, "-watchdog") && argc > 1)
+        {
+            sys_watchdogdeadline = atof(argv[1]);
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(*argv, "-watchdogmisses") && argc > 1)
+        {
+            if ((sys_watchdogmisses = atoi(argv[1])) < 1)
+                sys_watchdogmisses = 1;
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(*argv, "-watchdogaction") && argc > 1)
+        {
+            if (strcmp(argv[1], "log") && strcmp(argv[1], "priority") &&
+                strcmp(argv[1], "restart"))
+                    goto usage;
+            strcpy(sys_watchdogaction, argv[1]);
+            argc -= 2; argv += 2;
+        }
 #else
         else if (!strcmp(*argv, "-rt") || !strcmp(*argv, "-realtime")
                  || !strcmp(*argv, "-nrt") || !strcmp(*argv, "-nort")
@@ -1377,7 +1706,7 @@ int sys_argparse(int argc, char **argv)
 
 int sys_getblksize(void)
 {
-    return (DEFDACBLKSIZE);
+    return (STUFF->st_schedblocksize);
 }
 
     /* stuff to do, once, after calling sys_argparse() -- which may itself
@@ -1475,9 +1804,21 @@ static void sys_afterargparse(void)
         callback = sys_main_callback;
     if (sys_main_blocksize)
         blocksize = sys_main_blocksize;
+    if (sys_main_schedblocksize)
+        sys_setschedblocksize(sys_main_schedblocksize);
     sys_set_audio_settings(naudioindev, audioindev, nchindev, chindev,
         naudiooutdev, audiooutdev, nchoutdev, choutdev, rate, advance,
         callback, blocksize);
+        /* when rendering there's no audio device, but we want channels */
+    if (sys_renderfile)
+    {
+        int nch = 0;
+        for (i = 0; i < nchoutdev; i++)
+            if (choutdev[i] > 0)
+                nch += choutdev[i];
+        sys_setchsr(STUFF->st_inchannels, (nch ? nch : 2),
+            (rate > 0 ? rate : DEFAULTSRATE));
+    }
     sys_open_midi(nmidiindev, midiindev, nmidioutdev, midioutdev, 0);
 }
 
@@ -22,6 +22,7 @@
 #endif
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <signal.h>
 
 /* channel voice messages */     /* dec, # */
@@ -140,9 +141,26 @@ static double sys_getmidiinrealtime(void)
     return (sys_getrealtime() + sys_adctimeminusrealtime);
 }
 
+/* With "-midistamp", backends that can schedule output themselves (ALSA's
+sequencer and portmidi) set sys_midioutcanstamp when they open.  We then hand
+them each message as soon as it's queued, along with how far in the future
+(by our estimate of when the current logical time reaches the DAC) it should
+go out, in sys_midioutdelay.  That keeps the sub-tick offsets of [noteout],
+[midiout] and friends instead of rounding them to the next scheduler pass. */
+
+int sys_midistamp;          /* "-midistamp" flag */
+int sys_midioutcanstamp;    /* set by backends that honor sys_midioutdelay */
+double sys_midioutdelay;    /* seconds from now for the message being put */
+
 static void sys_putnext(void)
 {
     int portno = midi_outqueue[midi_outtail].q_portno;
+    if (sys_midioutcanstamp)
+    {
+        double delay = midi_outqueue[midi_outtail].q_time -
+            sys_getmidioutrealtime();
+        sys_midioutdelay = (delay > 0 ? delay : 0);
+    }
 #ifdef USEAPI_ALSA
     if (sys_midiapi == API_ALSA)
       {
@@ -161,6 +179,7 @@ static void sys_putnext(void)
                              midi_outqueue[midi_outtail].q_byte2,
                              midi_outqueue[midi_outtail].q_byte3);
       }
+    sys_midioutdelay = 0;
     midi_outtail  = (midi_outtail + 1 == MIDIQSIZE ? 0 : midi_outtail + 1);
 }
 
@@ -188,8 +207,9 @@ void sys_pollmidioutqueue(void)
             db = 1;
         }
 #endif
-        if (midi_outqueue[midi_outtail].q_time <= midirealtime)
-            sys_putnext();
+        if (sys_midioutcanstamp ||
+            midi_outqueue[midi_outtail].q_time <= midirealtime)
+                sys_putnext();
         else break;
     }
 }
@@ -268,8 +288,16 @@ void outmidi_polyaftertouch(int portno, int channel, int pitch, int value)
         pitch, value);
 }
 
+    /* raw bytes normally go straight out, but when the backend timestamps
+    output they have to take their place in line (this is how MIDI clock
+    gets out on time) */
 void outmidi_byte(int portno, int value)
 {
+    if (sys_midioutcanstamp)
+    {
+        sys_queuemidimess(portno, 1, value & 0xff, 0, 0);
+        return;
+    }
 #ifdef USEAPI_ALSA
   if (sys_midiapi == API_ALSA)
     {
@@ -282,6 +310,27 @@ void outmidi_byte(int portno, int value)
     }
 }
 
+    /* a whole sysex message from [midiout], handed to the API in one call.
+    Anything still in the output queue has to go first. */
+void outmidi_sysex(int portno, int n, const unsigned char *buf)
+{
+    while (midi_outhead != midi_outtail)
+        sys_putnext();
+    if (sys_midioutcanstamp)
+    {
+        double delay = .001 * clock_gettimesince(sys_midiinittime) -
+            sys_getmidioutrealtime();
+        sys_midioutdelay = (delay > 0 ? delay : 0);
+    }
+#ifdef USEAPI_ALSA
+    if (sys_midiapi == API_ALSA)
+        sys_alsa_putmidisysex(portno, n, buf);
+    else
+#endif
+    sys_putmidisysex(portno, n, buf);
+    sys_midioutdelay = 0;
+}
+
 /* ------------------------- MIDI input queue handling ------------------ */
 typedef struct midiparser
 {
@@ -301,15 +350,11 @@ void inmidi_pitchbend(int portno, int channel, int value);
 void inmidi_aftertouch(int portno, int channel, int value);
 void inmidi_polyaftertouch(int portno, int channel, int pitch, int value);
 
-static void sys_dispatchnextmidiin(void)
+static void sys_dispatchmidiin(int portno, int byte)
 {
     static t_midiparser parser[MAXMIDIINDEV], *parserp;
-    int portno = midi_inqueue[midi_intail].q_portno,
-        byte = midi_inqueue[midi_intail].q_byte1;
-    if (!midi_inqueue[midi_intail].q_onebyte)
-        bug("sys_dispatchnextmidiin");
     if (portno < 0 || portno >= MAXMIDIINDEV)
-        bug("sys_dispatchnextmidiin 2");
+        bug("sys_dispatchmidiin");
     parserp = parser + portno;
     outlet_setstacklim();
 
@@ -421,6 +466,14 @@ static void sys_dispatchnextmidiin(void)
             }
         }
     }
+}
+
+static void sys_dispatchnextmidiin(void)
+{
+    if (!midi_inqueue[midi_intail].q_onebyte)
+        bug("sys_dispatchnextmidiin");
+    sys_dispatchmidiin(midi_inqueue[midi_intail].q_portno,
+        midi_inqueue[midi_intail].q_byte1);
     midi_intail = (midi_intail + 1 == MIDIQSIZE ? 0 : midi_intail + 1);
 }
 
@@ -462,14 +515,199 @@ void sys_pollmidiinqueue(void)
     }
 }
 
+/* With "-midithread" the backend's input poll runs in a thread of its own,
+which stamps each byte with the time it came in and hands it to the scheduler
+through a lock-free FIFO.  The FIFO is a chain of fixed-size segments: the
+thread allocates a new one when the last is full and we free them as we drain
+them, so a burst from a controller is never dropped or flushed early.
+sched_tick() merges the events with its clock timeouts and dispatches each at
+its own logical time, one tick after it was stamped, so that the spacing of
+incoming messages survives to sample accuracy. */
+
+int sys_midithread;     /* "-midithread" flag */
+
+#if PDTHREADS && defined(HAVE_UNISTD_H) && defined(__GNUC__)
+#define MIDITHREAD 1
+#define MT_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define MT_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#else
+#define MIDITHREAD 0
+#endif
+
+#if MIDITHREAD
+#include <pthread.h>
+
+#define MIDISEGSIZE 1024    /* events per FIFO segment */
+#define MIDITHREADSLEEP 1000    /* microseconds between polls when idle */
+
+typedef struct _midiseg
+{
+    struct _midiseg *s_next;    /* set by the thread when this one is full */
+    int s_head;                 /* events written so far, ditto */
+    t_midiqelem s_vec[MIDISEGSIZE];
+} t_midiseg;
+
+static pthread_t midi_thread;
+static int midi_threaded;       /* thread running */
+static int midi_threadquit;     /* asks it to stop */
+static int midi_threadgot;      /* bytes it got in the current poll */
+static t_midiseg *midi_threadhead;  /* segment the thread writes to */
+static t_midiseg *midi_threadtail;  /* segment we read from */
+static int midi_threadtailpos;
+
+static void midi_threadpoll(void)
+{
+#ifdef USEAPI_ALSA
+    if (sys_midiapi == API_ALSA)
+        sys_alsa_poll_midi();
+    else
+#endif
+    sys_poll_midi();
+}
+
+static void *midithread_fn(void *z)
+{
+    sys_setthreadrole(SYS_THREAD_MIDI);
+    while (!MT_LOAD(&midi_threadquit))
+    {
+        int throttle = 100;
+            /* keep polling while bytes are coming in, then nap */
+        do
+        {
+            midi_threadgot = 0;
+            midi_threadpoll();
+        } while (midi_threadgot && throttle--);
+        if (!midi_threadgot)
+            usleep(MIDITHREADSLEEP);
+    }
+    return (0);
+}
+
+    /* called in the thread from sys_midibytein() */
+static void midi_threadput(int portno, int byte)
+{
+    t_midiseg *seg = midi_threadhead;
+    t_midiqelem *e;
+    if (seg->s_head == MIDISEGSIZE)
+    {
+        t_midiseg *next = (t_midiseg *)malloc(sizeof(*next));
+        if (!next)
+            return;
+        next->s_next = 0;
+        next->s_head = 0;
+        MT_STORE(&seg->s_next, next);
+        midi_threadhead = seg = next;
+    }
+    e = &seg->s_vec[seg->s_head];
+    e->q_time = sys_getmidiinrealtime();
+    e->q_portno = portno;
+    e->q_onebyte = 1;
+    e->q_byte1 = byte;
+    MT_STORE(&seg->s_head, seg->s_head + 1);
+    midi_threadgot++;
+}
+
+    /* the next event from the thread, or 0 if there's none yet */
+static t_midiqelem *midi_threadpeek(void)
+{
+    t_midiseg *seg = midi_threadtail, *next;
+    if (!seg)
+        return (0);
+    if (midi_threadtailpos < MT_LOAD(&seg->s_head))
+        return (&seg->s_vec[midi_threadtailpos]);
+    if (midi_threadtailpos == MIDISEGSIZE && (next = MT_LOAD(&seg->s_next)))
+    {
+        free(seg);
+        midi_threadtail = next;
+        midi_threadtailpos = 0;
+        if (midi_threadtailpos < MT_LOAD(&next->s_head))
+            return (&next->s_vec[0]);
+    }
+    return (0);
+}
+
+    /* logical time at which to dispatch the next event from the thread;
+    sched_tick() calls this for every clock timeout, so it has to be cheap
+    when there's no thread */
+double sys_midiinnexttime(void)
+{
+    t_midiqelem *e;
+    if (!midi_threaded && !midi_threadtail)
+        return (1e300);
+    if (!(e = midi_threadpeek()))
+        return (1e300);
+    return (clock_getsystimeafter(1000 * e->q_time -
+        clock_gettimesince(sys_midiinittime) +
+            1000. * STUFF->st_schedblocksize / STUFF->st_dacsr));
+}
+
+void sys_midiindispatch(void)
+{
+    t_midiqelem *e = midi_threadpeek();
+    if (!e)
+        return;
+    midi_threadtailpos++;
+    sys_dispatchmidiin(e->q_portno, e->q_byte1);
+}
+
+static void sys_startmidithread(void)
+{
+    if (midi_threaded)
+        return;
+    if (!midi_threadtail)
+    {
+        if (!(midi_threadtail = (t_midiseg *)malloc(sizeof(t_midiseg))))
+            goto fail;
+        midi_threadtail->s_next = 0;
+        midi_threadtail->s_head = 0;
+        midi_threadtailpos = 0;
+        midi_threadhead = midi_threadtail;
+    }
+    midi_threadquit = 0;
+    if (pthread_create(&midi_thread, 0, midithread_fn, 0))
+        goto fail;
+    midi_threaded = 1;
+    return;
+fail:
+    error("couldn't start MIDI input thread; polling instead");
+}
+
+    /* stop the thread before the devices it polls are closed.  Anything
+    it already queued still goes out from sched_tick(). */
+void sys_stopmidithread(void)
+{
+    if (!midi_threaded)
+        return;
+    MT_STORE(&midi_threadquit, 1);
+    pthread_join(midi_thread, 0);
+    midi_threaded = 0;
+}
+
+#else /* MIDITHREAD */
+double sys_midiinnexttime(void) { return (1e300); }
+void sys_midiindispatch(void) {}
+static void sys_startmidithread(void)
+{
+    error("-midithread: not supported in this build");
+}
+void sys_stopmidithread(void) {}
+#endif /* MIDITHREAD */
+
     /* this should be called from the system dependent MIDI code when a byte
     comes in, as a result of our calling sys_poll_midi.  We stick it on a
     timetag queue and dispatch it at the appropriate logical time. */
 void sys_midibytein(int portno, int byte)
 {
     static int warned = 0;
-    t_midiqelem *midiqelem;
-    int newhead = midi_inhead +1;
+    int newhead;
+#if MIDITHREAD
+    if (midi_threaded && pthread_equal(pthread_self(), midi_thread))
+    {
+        midi_threadput(portno, byte);
+        return;
+    }
+#endif
+    newhead = midi_inhead + 1;
     if (newhead == MIDIQSIZE)
         newhead = 0;
             /* if FIFO is full flush an element to make room */
@@ -499,12 +737,17 @@ void sys_pollmidiqueue(void)
         post("delay %d", (int)(1000 * (newtime - lasttime)));
     lasttime = newtime;
 #endif
+#if MIDITHREAD
+    if (!midi_threaded)
+#endif
+    {
 #ifdef USEAPI_ALSA
-      if (sys_midiapi == API_ALSA)
-        sys_alsa_poll_midi();
-      else
+          if (sys_midiapi == API_ALSA)
+            sys_alsa_poll_midi();
+          else
 #endif /* ALSA */
-    sys_poll_midi();    /* OS dependent poll for MIDI input */
+        sys_poll_midi();    /* OS dependent poll for MIDI input */
+    }
     sys_pollmidioutqueue();
     sys_pollmidiinqueue();
 }
@@ -594,8 +837,10 @@ static void sys_save_midi_params(
 void sys_open_midi(int nmidiindev, int *midiindev,
     int nmidioutdev, int *midioutdev, int enable)
 {
+    sys_stopmidithread();
     if (enable)
     {
+        sys_midioutcanstamp = 0;
 #ifdef USEAPI_ALSA
         midi_alsa_init();
 #endif
@@ -608,6 +853,8 @@ void sys_open_midi(int nmidiindev, int *midiindev,
         else
 #endif /* ALSA */
             sys_do_open_midi(nmidiindev, midiindev, nmidioutdev, midioutdev);
+        if (sys_midithread && nmidiindev)
+            sys_startmidithread();
     }
     sys_save_midi_params(nmidiindev, midiindev,
         nmidioutdev, midioutdev);
@@ -679,6 +926,7 @@ void glob_midi_setapi(void *dummy, t_floatarg f)
     int newapi = f;
     if (newapi != sys_midiapi)
     {
+        sys_stopmidithread();
 #ifdef USEAPI_ALSA
         if (sys_midiapi == API_ALSA)
             sys_alsa_close_midi();
@@ -825,6 +1073,7 @@ void glob_midi_dialog(t_pd *dummy, t_symbol *s, int argc, t_atom *argv)
 #endif
     sys_save_midi_params(nindev, newmidiindev,
         noutdev, newmidioutdev);
+    sys_stopmidithread();
 #ifdef USEAPI_ALSA
     if (sys_midiapi == API_ALSA)
     {
@@ -47,6 +47,24 @@ static snd_seq_t *midi_handle;
 
 static snd_midi_event_t *midiev;
 
+    /* with -midistamp, output goes through a sequencer queue that we start
+    when opening, and each event is scheduled on it sys_midioutdelay from
+    now */
+static int alsa_midiqueue = -1;
+
+static void alsa_settarget(snd_seq_event_t *ev)
+{
+    if (alsa_midiqueue >= 0)
+    {
+        snd_seq_real_time_t when;
+        when.tv_sec = (unsigned int)sys_midioutdelay;
+        when.tv_nsec = (unsigned int)
+            (1e9 * (sys_midioutdelay - when.tv_sec));
+        snd_seq_ev_schedule_real(ev, alsa_midiqueue, 1, &when);
+    }
+    else snd_seq_ev_set_direct(ev);
+}
+
 void sys_alsa_do_open_midi(int nmidiin, int *midiinvec,
     int nmidiout, int *midioutvec)
 {
@@ -117,6 +135,20 @@ void sys_alsa_do_open_midi(int nmidiin, int *midiinvec,
     post("opened alsa MIDI client %d in:%d out:%d", client, nmidiin, nmidiout);
     sys_setalarm(0);
     snd_midi_event_new(ALSA_MAX_EVENT_SIZE, &midiev);
+    if (sys_midistamp && nmidiout > 0)
+    {
+        if ((alsa_midiqueue = snd_seq_alloc_queue(midi_handle)) < 0 ||
+            snd_seq_start_queue(midi_handle, alsa_midiqueue, NULL) < 0)
+        {
+            post("couldn't start alsa MIDI queue; output won't be timed");
+            alsa_midiqueue = -1;
+        }
+        else
+        {
+            snd_seq_drain_output(midi_handle);
+            sys_midioutcanstamp = 1;
+        }
+    }
     alsa_nmidiout = nmidiout;
     alsa_nmidiin = nmidiin;
 
@@ -183,7 +215,7 @@ void sys_alsa_putmidimess(int portno, int a, int b, int c)
                 bug("couldn't put alsa MIDI message");
                 break;
         }
-        snd_seq_ev_set_direct(&ev);
+        alsa_settarget(&ev);
         snd_seq_ev_set_subs(&ev);
         snd_seq_ev_set_source(&ev, alsa_midioutfd[portno]);
         snd_seq_event_output_direct(midi_handle, &ev);
@@ -205,7 +237,7 @@ void sys_alsa_putmidibyte(int portno, int byte)
   res = snd_midi_event_encode_byte(dev, byte, &ev);
   if (res > 0 && ev.type != SND_SEQ_EVENT_NONE) {
     // got a complete event, output it
-    snd_seq_ev_set_direct(&ev);
+    alsa_settarget(&ev);
     snd_seq_ev_set_subs(&ev);
     snd_seq_ev_set_source(&ev, alsa_midioutfd[portno]);
     snd_seq_event_output_direct(midi_handle, &ev);
@@ -216,12 +248,26 @@ void sys_alsa_putmidibyte(int portno, int byte)
 }
 
 
+void sys_alsa_putmidisysex(int portno, int n, const unsigned char *buf)
+{
+    snd_seq_event_t ev;
+    if (portno < 0 || portno >= alsa_nmidiout)
+        return;
+    snd_seq_ev_clear(&ev);
+    snd_seq_ev_set_sysex(&ev, n, (void *)buf);
+    alsa_settarget(&ev);
+    snd_seq_ev_set_subs(&ev);
+    snd_seq_ev_set_source(&ev, alsa_midioutfd[portno]);
+    if (snd_seq_event_output_direct(midi_handle, &ev) < 0)
+        post("couldn't send alsa MIDI sysex of %d bytes", n);
+}
+
     /* this version uses the asynchronous "read()" ... */
 void sys_alsa_poll_midi(void)
 {
    unsigned char buf[ALSA_MAX_EVENT_SIZE];
    int count, alsa_source;
-   int i;
+   int i, throttle = 100;
    snd_seq_event_t *midievent = NULL;
 
    if (alsa_nmidiout == 0 && alsa_nmidiin == 0) return;
@@ -229,11 +275,13 @@ void sys_alsa_poll_midi(void)
    snd_midi_event_init(midiev);
 
    if (!alsa_nmidiout && !alsa_nmidiin) return;
-   count = snd_seq_event_input_pending(midi_handle, 1);
-   if (count != 0)
-        count = snd_seq_event_input(midi_handle, &midievent);
-   if (midievent != NULL)
+       /* take everything that's waiting, not just one event per poll,
+       so that a burst from a controller doesn't pile up in the kernel */
+   while (throttle-- > 0 && snd_seq_event_input_pending(midi_handle, 1) > 0)
    {
+       midievent = NULL;
+       if (snd_seq_event_input(midi_handle, &midievent) < 0 || !midievent)
+           break;
        count = snd_midi_event_decode(midiev, buf, sizeof(buf), midievent);
        alsa_source = midievent->dest.port;
        for(i = 0; i < count; i++)
@@ -247,8 +295,9 @@ void sys_alsa_close_midi()
     alsa_nmidiin = alsa_nmidiout = 0;
     if (midi_handle)
     {
-        snd_seq_close(midi_handle);
+        snd_seq_close(midi_handle);   /* frees the queue too */
         midi_handle = NULL;
+        alsa_midiqueue = -1;
         if (midiev)
         {
             snd_midi_event_free(midiev);
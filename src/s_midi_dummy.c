@@ -24,6 +24,10 @@ void sys_putmidibyte(int portno, int byte)
 {
 }
 
+void sys_putmidisysex(int portno, int n, const unsigned char *buf)
+{
+}
+
 void sys_poll_midi(void)
 {
 }
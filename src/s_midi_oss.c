@@ -139,6 +139,20 @@ void sys_putmidibyte(int portno, int byte)
         oss_midiout(oss_midioutfd[portno], byte);
 }
 
+void sys_putmidisysex(int portno, int n, const unsigned char *buf)
+{
+    if (portno >= 0 && portno < oss_nmidiout)
+    {
+        int ret = (int)write(oss_midioutfd[portno], buf, n);
+        if (ret < n)
+        {
+            if (ret < 0)
+                perror("MIDI write");
+            else fprintf(stderr, "MIDI write: sysex truncated\n");
+        }
+    }
+}
+
 #if 0   /* this is the "select" version which doesn't work with OSS
         driver for emu10k1 (it doesn't implement select.) */
 void sys_poll_midi(void)
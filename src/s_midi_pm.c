@@ -39,6 +39,10 @@
 #define MIDI_SONGSELECT     0xf3
 #define MIDI_SYSEXEND       0xf7
 
+    /* output latency in msec with -midistamp; portmidi sends each message
+    at its timestamp plus this */
+#define PM_STAMPLATENCY 1
+
 static PmStream *mac_midiindevlist[MAXMIDIINDEV];
 static PmStream *mac_midioutdevlist[MAXMIDIOUTDEV];
 static int mac_nmidiindev;
@@ -93,9 +97,12 @@ void sys_do_open_midi(int nmidiin, int *midiinvec,
             {
                 if (devno == midioutvec[i])
                 {
+                        /* a nonzero latency makes portmidi honor the
+                        timestamps; we add our own delay to them */
                     err = Pm_OpenOutput(
                         &mac_midioutdevlist[mac_nmidioutdev],
-                            j, NULL, 0, NULL, NULL, 0);
+                            j, NULL, 0, NULL, NULL, (sys_midistamp ?
+                                PM_STAMPLATENCY : 0));
                     if (err)
                         post("could not open MIDI output %d (%s): %s",
                             j, info->name, Pm_GetErrorText(err));
@@ -105,6 +112,7 @@ void sys_do_open_midi(int nmidiin, int *midiinvec,
                             post("MIDI output (%s) opened.",
                                 info->name);
                         mac_nmidioutdev++;
+                        sys_midioutcanstamp = sys_midistamp;
                     }
                 }
                 devno++;
@@ -124,6 +132,15 @@ void sys_close_midi(void)
     mac_nmidioutdev = 0;
 }
 
+    /* the timestamp for the message being put, from sys_midioutdelay */
+static PmTimestamp pm_timestamp(void)
+{
+    if (!sys_midioutcanstamp)
+        return (0);
+    return (Pt_Time() + (PmTimestamp)(1000 * sys_midioutdelay + 0.5) -
+        PM_STAMPLATENCY);
+}
+
 void sys_putmidimess(int portno, int a, int b, int c)
 {
     PmEvent buffer;
@@ -131,7 +148,7 @@ void sys_putmidimess(int portno, int a, int b, int c)
     if (portno >= 0 && portno < mac_nmidioutdev)
     {
         buffer.message = Pm_Message(a, b, c);
-        buffer.timestamp = 0;
+        buffer.timestamp = pm_timestamp();
         /* fprintf(stderr, "put msg\n"); */
         Pm_Write(mac_midioutdevlist[portno], &buffer, 1);
     }
@@ -140,13 +157,24 @@ void sys_putmidimess(int portno, int a, int b, int c)
 static void writemidi4(PortMidiStream* stream, int a, int b, int c, int d)
 {
     PmEvent buffer;
-    buffer.timestamp = 0;
+    buffer.timestamp = pm_timestamp();
     buffer.message = ((a & 0xff) | ((b & 0xff) << 8)
         | ((c & 0xff) << 16) | ((d & 0xff) << 24));
     Pm_Write(stream, &buffer, 1);
 }
 
 
+void sys_putmidisysex(int portno, int n, const unsigned char *buf)
+{
+    PmError err;
+    if (portno < 0 || portno >= mac_nmidioutdev)
+        return;
+        /* portmidi finds the end by looking for MIDI_SYSEXEND */
+    if ((err = Pm_WriteSysEx(mac_midioutdevlist[portno], pm_timestamp(),
+        (unsigned char *)buf)) != pmNoError)
+            post("MIDI sysex output: %s", Pm_GetErrorText(err));
+}
+
 void sys_putmidibyte(int portno, int byte)
 {
         /* try to parse the bytes into MIDI messages so they can
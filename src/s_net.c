@@ -2,6 +2,9 @@
 * For information on usage and redistribution, and for a DISCLAIMER OF ALL
 * WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE     /* for recvmmsg() and sendmmsg() */
+#endif
 #include "s_net.h"
 
 #include <stdio.h>
@@ -346,6 +349,90 @@ int socket_bytes_available(int socket)
 #endif
 }
 
+int socket_recv_datagrams(int socket, char *buf, int bufsize,
+    int maxcount, int *sizes, struct sockaddr_storage *addrs)
+{
+#ifdef __linux__
+    struct mmsghdr msgs[SOCKET_MAXDATAGRAMS];
+    struct iovec iov[SOCKET_MAXDATAGRAMS];
+    int i, ret;
+    if (maxcount > SOCKET_MAXDATAGRAMS)
+        maxcount = SOCKET_MAXDATAGRAMS;
+    memset(msgs, 0, maxcount * sizeof(*msgs));
+    for (i = 0; i < maxcount; i++)
+    {
+        iov[i].iov_base = buf + i * bufsize;
+        iov[i].iov_len = bufsize;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        if (addrs)
+        {
+            msgs[i].msg_hdr.msg_name = &addrs[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+        }
+    }
+    ret = recvmmsg(socket, msgs, maxcount, MSG_DONTWAIT, 0);
+    if (ret < 0)
+        return ((errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1);
+    for (i = 0; i < ret; i++)
+        sizes[i] = msgs[i].msg_len;
+    return ret;
+#else
+        /* one recvfrom() per datagram; the first one is only called
+        because the socket polled readable so it won't block. */
+    int i;
+    for (i = 0; i < maxcount; i++)
+    {
+        socklen_t addrlen = sizeof(struct sockaddr_storage);
+        int ret;
+        if (i > 0 && socket_bytes_available(socket) <= 0)
+            break;
+        ret = (int)recvfrom(socket, buf + i * bufsize, bufsize, 0,
+            (addrs ? (struct sockaddr *)&addrs[i] : 0), (addrs ? &addrlen : 0));
+        if (ret < 0)
+            return (i ? i : -1);
+        sizes[i] = ret;
+    }
+    return i;
+#endif
+}
+
+int socket_send_datagrams(int socket, const char *buf, const int *onsets,
+    const int *sizes, int count, const struct sockaddr *addr,
+    socklen_t addrlen)
+{
+#ifdef __linux__
+    struct mmsghdr msgs[SOCKET_MAXDATAGRAMS];
+    struct iovec iov[SOCKET_MAXDATAGRAMS];
+    int nsent = 0;
+    while (nsent < count)
+    {
+        int i, n = (count - nsent < SOCKET_MAXDATAGRAMS ?
+            count - nsent : SOCKET_MAXDATAGRAMS), ret;
+        memset(msgs, 0, n * sizeof(*msgs));
+        for (i = 0; i < n; i++)
+        {
+            iov[i].iov_base = (char *)buf + onsets[nsent + i];
+            iov[i].iov_len = sizes[nsent + i];
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = (void *)addr;
+            msgs[i].msg_hdr.msg_namelen = addrlen;
+        }
+        if ((ret = sendmmsg(socket, msgs, n, 0)) <= 0)
+            return (nsent ? nsent : -1);
+        nsent += ret;
+    }
+    return nsent;
+#else
+    int i;
+    for (i = 0; i < count; i++)
+        if (sendto(socket, buf + onsets[i], sizes[i], 0, addr, addrlen) < 0)
+            return (i ? i : -1);
+    return count;
+#endif
+}
+
 int socket_join_multicast_group(int socket, const struct sockaddr *sa)
 {
     if (sa->sa_family == AF_INET6)
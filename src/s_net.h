@@ -122,6 +122,25 @@ int socket_set_boolopt(int socket, int level, int option_name, int bool_value);
 /// enable/disable socket non-blocking mode
 int socket_set_nonblocking(int socket, int nonblocking);
 
+/// most datagrams socket_recv_datagrams() fetches in one call
+#define SOCKET_MAXDATAGRAMS 32
+
+/// receive up to maxcount pending datagrams without blocking: one
+/// recvmmsg() call on Linux, a loop of recvfrom() elsewhere. datagram i
+/// goes to buf + i * bufsize, its size to sizes[i] and, if addrs isn't
+/// NULL, its sender to addrs[i]. returns the number of datagrams, 0 if
+/// none were pending or -1 on error
+int socket_recv_datagrams(int socket, char *buf, int bufsize,
+    int maxcount, int *sizes, struct sockaddr_storage *addrs);
+
+/// send count datagrams to addr, datagram i starting at buf + onsets[i]
+/// with size sizes[i]: sendmmsg() calls of up to SOCKET_MAXDATAGRAMS on
+/// Linux, a loop of sendto() elsewhere. returns the number sent (fewer than
+/// count only if there was an error) or -1 if none could be sent
+int socket_send_datagrams(int socket, const char *buf, const int *onsets,
+    const int *sizes, int count, const struct sockaddr *addr,
+    socklen_t addrlen);
+
 /// join a multicast group address, returns < 0 on error
 int socket_join_multicast_group(int socket, const struct sockaddr *sa);
 
@@ -236,6 +236,7 @@ int sys_usestdpath = 1;
 void sys_setextrapath(const char *p)
 {
     char pathbuf[MAXPDSTRING];
+    sys_flushdircache();
     namelist_free(STUFF->st_staticpath);
     /* add standard place for users to install stuff first */
 #ifdef __gnu_linux__
@@ -324,6 +325,228 @@ int sys_trytoopenone(const char *dir, const char *name, const char* ext,
     return (-1);
 }
 
+/* Directory listings for the loader.  Looking for a class "foo" tries each
+directory on the search path with every one of sys_dllextent's extensions,
+both as "foo.ext" and "foo/foo.ext", and then as an abstraction -- about a
+dozen open() calls per directory, nearly all of which fail, and the whole
+search repeats for every object box that doesn't name a known class.  So
+the loader asks sys_trytoopenlisted() instead, which lists each directory
+once, keeps the names in a hash table, and only calls sys_trytoopenone()
+if the file is there.  The listings are thrown away whenever a search path
+changes, when Pd writes or opens a patch, when an object box is retyped,
+and on "pd refresh-paths", so that files added in the meantime are found.
+Where we can't list a directory we just try to open the file as before. */
+
+#if defined(HAVE_UNISTD_H) && !defined(_WIN32)
+#define DIRCACHE
+#include <dirent.h>
+#include <errno.h>
+#include <ctype.h>
+
+    /* case-insensitive file systems are the rule on macOS */
+#ifdef __APPLE__
+#define DIRCACHE_CHAR(c) tolower((unsigned char)(c))
+#else
+#define DIRCACHE_CHAR(c) ((unsigned char)(c))
+#endif
+
+#define DIRCACHE_NHASH 64       /* number of hash chains for directories */
+
+typedef struct _dirlisting
+{
+    char *d_dir;                /* directory name as expanded */
+    int d_unlisted;             /* couldn't read it; try opening anyway */
+    int d_tabsize;              /* size of d_tab, a power of 2, or 0 */
+    char **d_tab;               /* open-addressed hash table of file names */
+    struct _dirlisting *d_next; /* next in hash chain */
+} t_dirlisting;
+
+struct _dircache
+{
+    t_dirlisting *c_hash[DIRCACHE_NHASH];
+};
+
+static unsigned int dircache_hash(const char *s, int n)
+{
+    unsigned int h = 5381;
+    for (; n-- && *s; s++)
+        h = h * 33 + DIRCACHE_CHAR(*s);
+    return (h);
+}
+
+static int dircache_match(const char *name, const char *s, int n)
+{
+    int i;
+    for (i = 0; i < n && s[i]; i++)
+        if (DIRCACHE_CHAR(name[i]) != DIRCACHE_CHAR(s[i]))
+            return (0);
+    return (!name[i]);
+}
+
+static void dircache_add(t_dirlisting *d, const char *name, int *nnames)
+{
+    unsigned int mask, h;
+    if (2 * (*nnames + 1) > d->d_tabsize)
+    {
+        int oldsize = d->d_tabsize, i;
+        char **oldtab = d->d_tab;
+        d->d_tabsize = (oldsize ? 2 * oldsize : 64);
+        d->d_tab = (char **)getbytes(d->d_tabsize * sizeof(char *));
+        mask = d->d_tabsize - 1;
+        for (i = 0; i < oldsize; i++)
+            if (oldtab[i])
+        {
+            for (h = dircache_hash(oldtab[i], MAXPDSTRING) & mask;
+                d->d_tab[h]; h = (h + 1) & mask)
+                    ;
+            d->d_tab[h] = oldtab[i];
+        }
+        if (oldtab)
+            freebytes(oldtab, oldsize * sizeof(char *));
+    }
+    mask = d->d_tabsize - 1;
+    for (h = dircache_hash(name, MAXPDSTRING) & mask; d->d_tab[h];
+        h = (h + 1) & mask)
+            ;
+    d->d_tab[h] = (char *)getbytes(strlen(name) + 1);
+    strcpy(d->d_tab[h], name);
+    (*nnames)++;
+}
+
+    /* is the first "n" characters of "s" a name in the directory? */
+static int dircache_has(const t_dirlisting *d, const char *s, int n)
+{
+    unsigned int mask, h;
+    if (d->d_unlisted)
+        return (1);
+    if (!d->d_tabsize)
+        return (0);
+    mask = d->d_tabsize - 1;
+    for (h = dircache_hash(s, n) & mask; d->d_tab[h]; h = (h + 1) & mask)
+        if (dircache_match(d->d_tab[h], s, n))
+            return (1);
+    return (0);
+}
+
+static t_dirlisting *dircache_get(const char *dir)
+{
+    struct _dircache *c = STUFF->st_dircache;
+    unsigned int h = dircache_hash(dir, MAXPDSTRING) % DIRCACHE_NHASH;
+    t_dirlisting *d;
+    DIR *dp;
+    struct dirent *de;
+    int nnames = 0;
+    if (!c)
+        c = STUFF->st_dircache =
+            (struct _dircache *)getbytes(sizeof(struct _dircache));
+    for (d = c->c_hash[h]; d; d = d->d_next)
+        if (!strcmp(d->d_dir, dir))
+            return (d);
+    d = (t_dirlisting *)getbytes(sizeof(*d));
+    d->d_dir = (char *)getbytes(strlen(dir) + 1);
+    strcpy(d->d_dir, dir);
+    d->d_unlisted = 0;
+    d->d_tabsize = 0;
+    d->d_tab = 0;
+    if ((dp = opendir(*dir ? dir : ".")))
+    {
+            /* keep "." and ".." too, for names like "../foo/bar" */
+        while ((de = readdir(dp)))
+            dircache_add(d, de->d_name, &nnames);
+        closedir(dp);
+    }
+        /* if it isn't there it's empty; otherwise we don't know */
+    else d->d_unlisted = (errno != ENOENT && errno != ENOTDIR);
+    d->d_next = c->c_hash[h];
+    c->c_hash[h] = d;
+    return (d);
+}
+
+    /* might "dir/name.ext" exist?  "name" may itself contain slashes. */
+static int dircache_mayexist(const char *dir, const char *name,
+    const char *ext)
+{
+    char buf[MAXPDSTRING], file[MAXPDSTRING];
+    const char *slash;
+    t_dirlisting *d;
+    sys_expandpath(dir, buf, MAXPDSTRING);
+    while (strlen(buf) > 1 && buf[strlen(buf)-1] == '/')
+        buf[strlen(buf)-1] = 0;
+    while ((slash = strchr(name, '/')))
+    {
+        int len = strlen(buf);
+        if (!dircache_has(dircache_get(buf), name, slash - name))
+            return (0);
+        if (len + (slash - name) + 2 > MAXPDSTRING)
+            return (1);
+        if (len && buf[len-1] != '/')
+            buf[len++] = '/';
+        memcpy(buf + len, name, slash - name);
+        buf[len + (slash - name)] = 0;
+        name = slash + 1;
+    }
+    d = dircache_get(buf);
+    if (strlen(name) + strlen(ext) + 1 > MAXPDSTRING)
+        return (1);
+    strcpy(file, name);
+    strcat(file, ext);
+    return (dircache_has(d, file, MAXPDSTRING));
+}
+
+#endif /* DIRCACHE */
+
+    /* forget all directory listings, and tell canvas_open() to forget
+    what it has found too */
+void sys_flushdircache(void)
+{
+#ifdef DIRCACHE
+    struct _dircache *c = STUFF->st_dircache;
+    int i, j;
+#endif
+    STUFF->st_pathgen++;
+#ifdef DIRCACHE
+    if (!c)
+        return;
+    for (i = 0; i < DIRCACHE_NHASH; i++)
+        while (c->c_hash[i])
+        {
+            t_dirlisting *d = c->c_hash[i];
+            c->c_hash[i] = d->d_next;
+            for (j = 0; j < d->d_tabsize; j++)
+                if (d->d_tab[j])
+                    freebytes(d->d_tab[j], strlen(d->d_tab[j]) + 1);
+            if (d->d_tab)
+                freebytes(d->d_tab, d->d_tabsize * sizeof(char *));
+            freebytes(d->d_dir, strlen(d->d_dir) + 1);
+            freebytes(d, sizeof(*d));
+        }
+    freebytes(c, sizeof(*c));
+    STUFF->st_dircache = 0;
+#endif
+}
+
+    /* like sys_trytoopenone(), but first check the directory's listing */
+int sys_trytoopenlisted(const char *dir, const char *name, const char* ext,
+    char *dirresult, char **nameresult, unsigned int size, int bin)
+{
+#ifdef DIRCACHE
+    if (!dircache_mayexist(dir, name, ext))
+    {
+        if (sys_verbose)
+            post("tried %s/%s%s; not in directory", dir, name, ext);
+        return (-1);
+    }
+#endif
+    return (sys_trytoopenone(dir, name, ext, dirresult, nameresult,
+        size, bin));
+}
+
+    /* "refresh-paths" message to Pd */
+void glob_refreshpaths(void *dummy)
+{
+    sys_flushdircache();
+}
+
     /* check if we were given an absolute pathname, if so try to open it
     and return 1 to signal the caller to cancel any path searches */
 int sys_open_absolute(const char *name, const char* ext,
@@ -396,6 +619,34 @@ static int do_open_via_path(const char *dir, const char *name,
     return (-1);
 }
 
+static int sys_addsearchdir(const char *dir, char *buf, int size, int n)
+{
+    char expanded[MAXPDSTRING];
+    int len;
+    sys_expandpath(dir, expanded, MAXPDSTRING);
+    if (n + (len = strlen(expanded) + 1) > size)
+        return (n);
+    strcpy(buf + n, expanded);
+    return (n + len);
+}
+
+    /* list the directories open_via_path() would search from "dir",
+    expanded and end to end, each followed by a null, for threads that
+    mustn't touch the path lists themselves.  Returns the bytes used. */
+int sys_getsearchdirs(const char *dir, char *buf, int size)
+{
+    t_namelist *nl;
+    int n = sys_addsearchdir(dir, buf, size, 0);
+    for (nl = STUFF->st_searchpath; nl; nl = nl->nl_next)
+        n = sys_addsearchdir(nl->nl_string, buf, size, n);
+    for (nl = STUFF->st_temppath; nl; nl = nl->nl_next)
+        n = sys_addsearchdir(nl->nl_string, buf, size, n);
+    if (sys_usestdpath)
+        for (nl = STUFF->st_staticpath; nl; nl = nl->nl_next)
+            n = sys_addsearchdir(nl->nl_string, buf, size, n);
+    return (n);
+}
+
     /* open via path, using the global search path. */
 int open_via_path(const char *dir, const char *name, const char *ext,
     char *dirresult, char **nameresult, unsigned int size, int bin)
@@ -657,6 +908,7 @@ void glob_start_path_dialog(t_pd *dummy)
 void glob_path_dialog(t_pd *dummy, t_symbol *s, int argc, t_atom *argv)
 {
     int i;
+    sys_flushdircache();
     namelist_free(STUFF->st_searchpath);
     STUFF->st_searchpath = 0;
     sys_usestdpath = atom_getfloatarg(0, argc, argv);
@@ -677,6 +929,7 @@ void glob_addtopath(t_pd *dummy, t_symbol *path, t_float saveit)
     t_symbol *s = sys_decodedialog(path);
     if (*s->s_name)
     {
+        sys_flushdircache();
         STUFF->st_searchpath =
             namelist_append_files(STUFF->st_searchpath, s->s_name);
         if (saveit != 0)
@@ -8,6 +8,7 @@
 #include <stdarg.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 #include "s_stuff.h"
 
 #ifdef _MSC_VER
@@ -48,6 +49,79 @@ char* pdgui_strnescape(char *dst, size_t dstlen, const char *src, size_t srclen)
     return dst;
 }
 
+/* ------------------------- the log ------------------------------- */
+
+/* Unless a print hook takes them, messages for the Pd window (or stderr)
+are queued, and the queue is emptied at the end of each scheduler tick, or
+right away for messages posted outside one.  On the way out, a message the
+same as the one before it within a second is only counted, and reported as
+"(last message repeated n more times)" when another one comes or the second
+is up.  No more than "pd log-limit" lines a second (1000 by default, 0 for no
+limit) go out; the rest are counted, and the count reported as soon as
+there's room again.  So a patch that complains on every tick can't flood the
+GUI socket.  "pd log-file <filename>" also writes everything that gets past
+the coalescing to a file, without the rate limit, from a thread of its own so
+that the scheduler never waits for the disk; "pd log-file" closes it.  The
+pieces of a line from startpost(), poststring() and so on are put together
+before they're queued.
+
+Each Pd instance has a queue of its own, so that one instance's tick never
+sends out (to its own GUI) what another one posted.  Other threads may post
+too, so each queue has a mutex; it's recursive since sending a message out
+might post an error, which is then queued behind the one going out. */
+
+#define LOG_POST 0          /* kinds of message, as from dopost() etc. */
+#define LOG_ERROR 1
+#define LOG_VERBOSE 2
+#define LOG_QUEUESIZE 256   /* messages waiting to go out */
+#define LOG_DEFLIMIT 1000   /* default lines per second */
+#define LOG_REPEATTIME 1.   /* seconds to count repeats before reporting */
+#define LOG_FILEBUFSIZE 262144
+
+typedef struct _logentry
+{
+    int l_kind;
+    int l_level;
+    const void *l_object;
+    char *l_text;
+} t_logentry;
+
+typedef struct _logstate
+{
+    pthread_mutex_t g_mutex;
+    t_logentry g_queue[LOG_QUEUESIZE];
+    int g_nqueued;
+    int g_deferred;                 /* true during a scheduler tick */
+    int g_flushing;                 /* true while the queue is going out */
+    char g_partial[MAXPDSTRING];    /* line being put together */
+    int g_npartial;
+        /* the last message that went out, to compare new ones with */
+    int g_havelast, g_lastkind, g_lastlevel;
+    const void *g_lastobject;
+    char g_lasttext[MAXPDSTRING];
+    int g_repeats;
+    double g_repeattime;
+        /* the rate limit */
+    double g_tokens, g_tokentime;
+    int g_dropped;
+    double g_droptime;              /* when we last reported dropped lines */
+} t_logstate;
+
+    /* for messages posted before there's an instance, or from a thread that
+    doesn't have one */
+static t_logstate *log_default;
+static pthread_once_t log_defaultonce = PTHREAD_ONCE_INIT;
+
+static int log_limit = LOG_DEFLIMIT;
+
+    /* the file, and the bytes waiting for the thread to write there */
+static FILE *log_fd;
+static pthread_t log_thread;
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_cond = PTHREAD_COND_INITIALIZER;
+static char log_filebuf[LOG_FILEBUFSIZE];
+static int log_filehead, log_filetail, log_filequit, log_filedropped;
+
 static char* strnpointerid(char *dest, const void *pointer, size_t len)
 {
     *dest=0;
@@ -56,23 +130,438 @@ static char* strnpointerid(char *dest, const void *pointer, size_t len)
     return dest;
 }
 
-static void dopost(const char *s)
+static t_logstate *log_new(void)
 {
-    if (sys_printhook)
-        (*sys_printhook)(s);
-    else if (sys_printtostderr || !sys_havegui())
+    t_logstate *x = (t_logstate *)calloc(1, sizeof(*x));
+    pthread_mutexattr_t attr;
+    if (!x)
+        return (0);
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&x->g_mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    x->g_tokens = log_limit;
+    x->g_droptime = -1;
+    return (x);
+}
+
+static void log_makedefault(void)
+{
+    log_default = log_new();
+}
+
+    /* the current instance's queue */
+static t_logstate *log_get(void)
+{
+#ifdef PDINSTANCE
+    if (pd_this && STUFF && STUFF->st_log)
+        return (STUFF->st_log);
+#else
+    if (STUFF && STUFF->st_log)
+        return (STUFF->st_log);
+#endif
+    pthread_once(&log_defaultonce, log_makedefault);
+    return (log_default);
+}
+
+static int log_havegui(void)
+{
+#ifdef PDINSTANCE
+    if (!pd_this)
+        return (0);
+#endif
+    return (pd_this->pd_inter && sys_havegui());
+}
+
+    /* send a message to the Pd window or stderr */
+static void log_emit(int kind, int level, const void *object, const char *s)
+{
+    char upbuf[MAXPDSTRING], obuf[MAXPDSTRING];
+    if (kind == LOG_POST)
+    {
+        if (sys_printtostderr || !log_havegui())
 #ifdef _WIN32
-        fwprintf(stderr, L"%S", s);
+            fwprintf(stderr, L"%S", s);
 #else
-        fprintf(stderr, "%s", s);
+            fprintf(stderr, "%s", s);
 #endif
+        else sys_vgui("::pdwindow::post {%s}\n",
+            pdgui_strnescape(upbuf, MAXPDSTRING, s, 0));
+    }
+    else if (sys_printtostderr || !log_havegui())
+    {
+        if (kind == LOG_ERROR)
+            fprintf(stderr, "error: %s", s);
+        else fprintf(stderr, "verbose(%d): %s", level, s);
+    }
+    else sys_vgui("::pdwindow::logpost {%s} %d {%s}\n",
+        strnpointerid(obuf, object, MAXPDSTRING),
+            level, pdgui_strnescape(upbuf, MAXPDSTRING, s, 0));
+}
+
+static void *log_filethread(void *dummy)
+{
+    pthread_mutex_lock(&log_mutex);
+    while (1)
+    {
+        int n;
+        while (log_filehead == log_filetail && !log_filequit)
+            pthread_cond_wait(&log_cond, &log_mutex);
+        if (log_filehead == log_filetail)
+            break;
+            /* the scheduler only adds after log_filehead, so we can write
+            what's before it without holding the lock */
+        n = (log_filehead > log_filetail ? log_filehead : LOG_FILEBUFSIZE) -
+            log_filetail;
+        pthread_mutex_unlock(&log_mutex);
+        fwrite(log_filebuf + log_filetail, 1, n, log_fd);
+        fflush(log_fd);
+        pthread_mutex_lock(&log_mutex);
+        log_filetail = (log_filetail + n) % LOG_FILEBUFSIZE;
+    }
+    pthread_mutex_unlock(&log_mutex);
+    return (0);
+}
+
+    /* hand a line to the file thread, or count it if there's no room */
+static void log_filewrite(int kind, int level, const char *s)
+{
+    char buf[MAXPDSTRING + 40];
+    int len, room, i;
+    if (kind == LOG_ERROR)
+        snprintf(buf, sizeof(buf), "error: %s", s);
+    else if (kind == LOG_VERBOSE)
+        snprintf(buf, sizeof(buf), "verbose(%d): %s", level, s);
+    else snprintf(buf, sizeof(buf), "%s", s);
+    pthread_mutex_lock(&log_mutex);
+    if (!log_fd)
+    {
+        pthread_mutex_unlock(&log_mutex);
+        return;
+    }
+    room = (log_filetail - log_filehead - 1 + LOG_FILEBUFSIZE) %
+        LOG_FILEBUFSIZE;
+    if (log_filedropped && room > 80)
+    {
+        char note[80];
+        snprintf(note, sizeof(note),
+            "(%d messages lost: log file too slow)\n", log_filedropped);
+        for (i = 0; note[i]; i++)
+            log_filebuf[log_filehead++] = note[i],
+                log_filehead %= LOG_FILEBUFSIZE;
+        room -= i;
+        log_filedropped = 0;
+    }
+    if ((len = (int)strlen(buf)) > room)
+        log_filedropped++;
+    else for (i = 0; i < len; i++)
+        log_filebuf[log_filehead++] = buf[i],
+            log_filehead %= LOG_FILEBUFSIZE;
+    pthread_cond_signal(&log_cond);
+    pthread_mutex_unlock(&log_mutex);
+}
+
+    /* take a line out of the allowance for this second, if any is left */
+static int log_allow(t_logstate *x, double now)
+{
+    if (log_limit <= 0)
+        return (1);
+    x->g_tokens += (now - x->g_tokentime) * log_limit;
+    x->g_tokentime = now;
+    if (x->g_tokens > log_limit)
+        x->g_tokens = log_limit;
+    if (x->g_tokens < 1)
+        return (0);
+    x->g_tokens -= 1;
+    return (1);
+}
+
+    /* say how many lines the rate limit kept back, once a second at most */
+static void log_reportdropped(t_logstate *x, double now)
+{
+    char buf[80];
+    if (!x->g_dropped || now < x->g_droptime + 1 || !log_allow(x, now))
+        return;
+    x->g_droptime = now;
+    snprintf(buf, sizeof(buf),
+        "(%d messages not shown: more than %d a second)\n",
+            x->g_dropped, log_limit);
+    log_emit(LOG_ERROR, 1, 0, buf);
+    x->g_dropped = 0;
+}
+
+static void log_out(t_logstate *x, int kind, int level, const void *object,
+    const char *s, double now)
+{
+    log_filewrite(kind, level, s);
+    log_reportdropped(x, now);
+    if (log_allow(x, now))
+        log_emit(kind, level, object, s);
+    else x->g_dropped++;
+}
+
+static void log_endrepeats(t_logstate *x, double now)
+{
+    char buf[80];
+    if (!x->g_repeats)
+        return;
+    snprintf(buf, sizeof(buf), "(last message repeated %d more time%s)\n",
+        x->g_repeats, (x->g_repeats == 1 ? "" : "s"));
+    x->g_repeats = 0;
+    log_out(x, x->g_lastkind, x->g_lastlevel, x->g_lastobject, buf, now);
+}
+
+    /* send out whatever's queued.  Called with the mutex held; anything
+    posted meanwhile (by this thread, since the others wait) is queued
+    behind and goes out in the same loop. */
+static void log_flush(t_logstate *x)
+{
+    int i;
+    double now;
+    if (x->g_flushing ||
+        (!x->g_nqueued && !x->g_repeats && !x->g_dropped))
+            return;
+    x->g_flushing = 1;
+    now = sys_getrealtime();
+    for (i = 0; i < x->g_nqueued; i++)
+    {
+        t_logentry *e = &x->g_queue[i];
+            /* the same message again: count it, unless it's the first
+            in more than a second */
+        if (x->g_havelast && e->l_kind == x->g_lastkind &&
+            e->l_level == x->g_lastlevel && e->l_object == x->g_lastobject &&
+                (x->g_repeats || now < x->g_repeattime + LOG_REPEATTIME) &&
+                    !strcmp(e->l_text, x->g_lasttext))
+        {
+            x->g_repeats++;
+            if (now >= x->g_repeattime + LOG_REPEATTIME)
+            {
+                log_endrepeats(x, now);
+                x->g_repeattime = now;
+            }
+        }
+        else
+        {
+            log_endrepeats(x, now);
+            log_out(x, e->l_kind, e->l_level, e->l_object, e->l_text, now);
+            x->g_havelast = 1;
+            x->g_lastkind = e->l_kind;
+            x->g_lastlevel = e->l_level;
+            x->g_lastobject = e->l_object;
+            strncpy(x->g_lasttext, e->l_text, MAXPDSTRING-1);
+            x->g_lasttext[MAXPDSTRING-1] = 0;
+            x->g_repeattime = now;
+        }
+        freebytes(e->l_text, strlen(e->l_text) + 1);
+    }
+    x->g_nqueued = 0;
+        /* if it's still going on, keep counting for another second */
+    if (x->g_repeats && now >= x->g_repeattime + LOG_REPEATTIME)
+    {
+        log_endrepeats(x, now);
+        x->g_repeattime = now;
+    }
+    log_reportdropped(x, now);
+    x->g_flushing = 0;
+}
+
+static void log_enqueue(t_logstate *x, int kind, int level,
+    const void *object, const char *s, int len)
+{
+    t_logentry *e;
+    if (x->g_nqueued == LOG_QUEUESIZE)
+    {
+            /* full while it's going out: nothing for it but stderr */
+        if (x->g_flushing)
+        {
+            fprintf(stderr, "%.*s", len, s);
+            return;
+        }
+        log_flush(x);
+    }
+    e = &x->g_queue[x->g_nqueued++];
+    e->l_kind = kind;
+    e->l_level = level;
+    e->l_object = object;
+    e->l_text = (char *)getbytes(len + 1);
+    memcpy(e->l_text, s, len);
+    e->l_text[len] = 0;
+}
+
+static void log_endpartial(t_logstate *x)
+{
+    if (x->g_npartial)
+        log_enqueue(x, LOG_POST, 0, 0, x->g_partial, x->g_npartial);
+    x->g_npartial = 0;
+}
+
+static void log_closefile(void);
+
+    /* report what's pending regardless of the limit */
+static void log_finish(t_logstate *x)
+{
+    double now = sys_getrealtime();
+    pthread_mutex_lock(&x->g_mutex);
+    x->g_deferred = 0;
+    log_endpartial(x);
+    log_flush(x);
+    x->g_tokens = log_limit;
+    x->g_tokentime = now;
+    x->g_droptime = -1;
+    log_reportdropped(x, now);
+    log_endrepeats(x, now);
+    pthread_mutex_unlock(&x->g_mutex);
+}
+
+    /* on the way out, also let the file thread finish */
+static void log_exit(void)
+{
+    t_logstate *x = log_get();
+    log_finish(x);
+    if (log_default && log_default != x)
+        log_finish(log_default);
+    log_closefile();
+}
+
+static void log_registerexit(void)
+{
+    atexit(log_exit);
+}
+
+static void log_add(int kind, int level, const void *object, const char *s)
+{
+    static pthread_once_t registered = PTHREAD_ONCE_INIT;
+    t_logstate *x = log_get();
+    int len = (int)strlen(s);
+    pthread_once(&registered, log_registerexit);
+    if (!x)
+    {
+        fprintf(stderr, "%s", s);
+        return;
+    }
+    pthread_mutex_lock(&x->g_mutex);
+    if (kind == LOG_POST)
+    {
+        if (x->g_npartial + len >= MAXPDSTRING)
+            log_endpartial(x);
+        if (len >= MAXPDSTRING)
+            log_enqueue(x, kind, level, object, s, len);
+        else
+        {
+            memcpy(x->g_partial + x->g_npartial, s, len);
+            if ((x->g_npartial += len) &&
+                x->g_partial[x->g_npartial-1] == '\n')
+                    log_endpartial(x);
+        }
+    }
     else
     {
-        char upbuf[MAXPDSTRING];
-        sys_vgui("::pdwindow::post {%s}\n", pdgui_strnescape(upbuf, MAXPDSTRING, s, 0));
+        log_endpartial(x);
+        log_enqueue(x, kind, level, object, s, len);
+    }
+    if (!x->g_deferred)
+        log_flush(x);
+    pthread_mutex_unlock(&x->g_mutex);
+}
+
+    /* called by the scheduler around each tick; at the end of it, what's
+    been posted goes out, along with any piece of a line there was. */
+void sys_deferlog(int defer)
+{
+    t_logstate *x = log_get();
+    if (!x)
+        return;
+    pthread_mutex_lock(&x->g_mutex);
+    if (!(x->g_deferred = defer))
+    {
+        log_endpartial(x);
+        log_flush(x);
+    }
+    pthread_mutex_unlock(&x->g_mutex);
+}
+
+void s_print_newpdinstance(void)
+{
+    STUFF->st_log = log_new();
+}
+
+    /* whatever the instance still had to say goes out before it's gone */
+void s_print_freepdinstance(void)
+{
+    t_logstate *x = STUFF->st_log;
+    if (!x)
+        return;
+    log_finish(x);
+    STUFF->st_log = 0;
+    pthread_mutex_destroy(&x->g_mutex);
+    free(x);
+}
+
+    /* "log-limit" message to Pd */
+void glob_loglimit(void *dummy, t_floatarg f)
+{
+    t_logstate *x = log_get();
+    log_limit = (f > 0 ? (int)f : 0);
+    if (x)
+        x->g_tokens = log_limit;
+}
+
+    /* log_fd is set and cleared with log_mutex held, since any thread
+    might be posting; the file thread can use it without, since it's only
+    cleared after that has finished */
+static void log_closefile(void)
+{
+    FILE *fd;
+    pthread_mutex_lock(&log_mutex);
+    if (!(fd = log_fd))
+    {
+        pthread_mutex_unlock(&log_mutex);
+        return;
+    }
+    log_filequit = 1;
+    pthread_cond_signal(&log_cond);
+    pthread_mutex_unlock(&log_mutex);
+    pthread_join(log_thread, 0);
+    pthread_mutex_lock(&log_mutex);
+    log_fd = 0;
+    log_filehead = log_filetail = log_filequit = log_filedropped = 0;
+    pthread_mutex_unlock(&log_mutex);
+    fclose(fd);
+}
+
+    /* "log-file" message to Pd */
+void glob_logfile(void *dummy, t_symbol *s, int argc, t_atom *argv)
+{
+    t_symbol *filename = atom_getsymbolarg(0, argc, argv);
+    FILE *fd;
+    log_closefile();
+    if (!*filename->s_name)
+        return;
+    if (!(fd = sys_fopen(filename->s_name, "a")))
+    {
+        pd_error(0, "%s: %s", filename->s_name, strerror(errno));
+        return;
+    }
+    pthread_mutex_lock(&log_mutex);
+    log_fd = fd;
+    pthread_mutex_unlock(&log_mutex);
+    if (pthread_create(&log_thread, 0, log_filethread, 0))
+    {
+        pthread_mutex_lock(&log_mutex);
+        log_fd = 0;
+        pthread_mutex_unlock(&log_mutex);
+        fclose(fd);
+        pd_error(0, "log-file: couldn't start thread");
     }
 }
 
+static void dopost(const char *s)
+{
+    if (sys_printhook)
+        (*sys_printhook)(s);
+    else log_add(LOG_POST, 0, 0, s);
+}
+
 static void doerror(const void *object, const char *s)
 {
     char upbuf[MAXPDSTRING];
@@ -84,15 +573,7 @@ static void doerror(const void *object, const char *s)
         snprintf(upbuf, MAXPDSTRING-1, "error: %s", s);
         (*sys_printhook)(upbuf);
     }
-    else if (sys_printtostderr)
-        fprintf(stderr, "error: %s", s);
-    else
-    {
-        char obuf[MAXPDSTRING];
-        sys_vgui("::pdwindow::logpost {%s} 1 {%s}\n",
-                 strnpointerid(obuf, object, MAXPDSTRING),
-                 pdgui_strnescape(upbuf, MAXPDSTRING, s, 0));
-    }
+    else log_add(LOG_ERROR, 1, object, s);
 }
 
 static void dologpost(const void *object, const int level, const char *s)
@@ -106,17 +587,7 @@ static void dologpost(const void *object, const int level, const char *s)
         snprintf(upbuf, MAXPDSTRING-1, "verbose(%d): %s", level, s);
         (*sys_printhook)(upbuf);
     }
-    else if (sys_printtostderr)
-    {
-        fprintf(stderr, "verbose(%d): %s", level, s);
-    }
-    else
-    {
-        char obuf[MAXPDSTRING];
-        sys_vgui("::pdwindow::logpost {%s} %d {%s}\n",
-                 strnpointerid(obuf, object, MAXPDSTRING),
-                 level, pdgui_strnescape(upbuf, MAXPDSTRING, s, 0));
-    }
+    else log_add(LOG_VERBOSE, level, object, s);
 }
 
 void logpost(const void *object, const int level, const char *fmt, ...)
@@ -191,9 +662,7 @@ void endpost(void)
 {
     if (sys_printhook)
         (*sys_printhook)("\n");
-    else if (sys_printtostderr)
-        fprintf(stderr, "\n");
-    else post("");
+    else dopost("\n");
 }
 
 void error(const char *fmt, ...)
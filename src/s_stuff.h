@@ -26,6 +26,10 @@ int sys_open_absolute(const char *name, const char* ext,
     char *dirresult, char **nameresult, unsigned int size, int bin, int *fdp);
 int sys_trytoopenone(const char *dir, const char *name, const char* ext,
     char *dirresult, char **nameresult, unsigned int size, int bin);
+int sys_trytoopenlisted(const char *dir, const char *name, const char* ext,
+    char *dirresult, char **nameresult, unsigned int size, int bin);
+void sys_flushdircache(void);
+int sys_getsearchdirs(const char *dir, char *buf, int size);
 t_symbol *sys_decodedialog(t_symbol *s);
 
 /* s_file.c */
@@ -43,6 +47,7 @@ EXTERN int sys_havegui(void);
 extern char *sys_guicmd;
 
 EXTERN int sys_nearestfontsize(int fontsize);
+void sys_startupphase(const char *name, uint64_t nsec);
 
 extern int sys_defaultfont;
 EXTERN t_symbol *sys_libdir;    /* library directory for auxilliary files */
@@ -51,6 +56,7 @@ EXTERN t_symbol *sys_libdir;    /* library directory for auxilliary files */
 
 typedef int (*loader_t)(t_canvas *canvas, const char *classname, const char*path); /* callback type */
 EXTERN int sys_load_lib(t_canvas *canvas, const char *classname);
+EXTERN t_symbol *sys_reload_lib(t_symbol *name);
 EXTERN void sys_register_loader(loader_t loader);
 
 /* s_audio.c */
@@ -59,11 +65,67 @@ EXTERN void sys_register_loader(loader_t loader);
 #define SENDDACS_YES 1
 #define SENDDACS_SLEPT 2
 
+    /* the scheduler's block size is STUFF->st_schedblocksize, a power of
+    two set at startup (-schedblocksize); DEFDACBLKSIZE is its default and
+    MAXDACBLKSIZE its upper limit. */
 #define DEFDACBLKSIZE 64
+#define MAXDACBLKSIZE 2048
 extern int sys_hipriority;      /* real-time flag, true if priority boosted */
+extern double sys_watchdogdeadline; /* msec per DSP tick, 0 to not watch */
+extern int sys_watchdogmisses;  /* ... how many pings in a row may miss it */
+extern char sys_watchdogaction[]; /* ... then "log", "priority"... */
 extern int sys_schedadvance;
 extern int sys_sleepgrain;
+extern int sys_adaptivesleep;   /* true to guess how long to sleep */
+extern int sys_batch;           /* true for -batch: no polling or sleeping */
+extern const char *sys_renderfile;  /* "-render" file for batch mode if any */
+extern int sys_renderbytes;     /* ... its sample size */
+extern t_float sys_renderduration;  /* ... and how many seconds to render */
+extern const char *sys_bench;   /* "-bench" suite or class, if any */
+int dsp_bench(const char *which);
+int soundfile_startrender(const char *filename, int bytespersamp,
+    int nchannels, t_float samplerate, long nframes);
+void soundfile_render(t_sample *soundout, int nframes);
+void soundfile_endrender(void);
+typedef struct _sftable t_sftable;     /* a soundfile paged in as a table */
+t_sftable *sftable_find(t_symbol *s);
+long sftable_lock(t_sftable *x);
+t_sample sftable_get(t_sftable *x, long index);
+void sftable_unlock(t_sftable *x);
 extern int sys_advance_samples;    /* scheduler advance in samples */
+extern int sys_dspthreads;      /* number of threads to compute DSP with */
+extern int sys_dspfuse;         /* true to fuse chains of pointwise objects */
+extern int sys_dsplocal;        /* true to order the DSP chain for locality */
+extern char sys_dspmap[];       /* file to write a map of the DSP chain to */
+extern int sys_dspftz;          /* true to flush denormals while doing DSP */
+extern int sys_hqosc;           /* true for curvature-corrected cos~ and osc~ */
+extern int sys_accuratemath;    /* true for libm, not SSE, in d_math.c */
+extern int sys_sfthreads;       /* threads doing readsf~/writesf~ file I/O */
+
+/* d_ugen.c: pointwise operations the DSP graph sorter can fuse.  The first
+group takes a second input vector, the second a pointer to a scalar;
+clip~ takes pointers to its bounds. */
+#define PW_PLUS 0
+#define PW_MINUS 1
+#define PW_TIMES 2
+#define PW_OVER 3
+#define PW_MAX 4
+#define PW_MIN 5
+#define PW_SCALARPLUS 6
+#define PW_SCALARMINUS 7
+#define PW_SCALARTIMES 8
+#define PW_SCALAROVER 9
+#define PW_SCALARMAX 10
+#define PW_SCALARMIN 11
+#define PW_CLIP 12
+#define PW_WRAP 13
+int dsp_addpointwise(int op, t_sample *in, t_sample *a, t_sample *b,
+    t_sample *out, int n);
+
+/* d_ctl.c: kernels for level metering */
+t_sample dsp_peak(const t_sample *in, int n, t_sample max);
+t_sample dsp_sumsq(const t_sample *in, int n);
+t_sample dsp_dot(const t_sample *a, const t_sample *b, int n);
 EXTERN void sys_set_audio_settings(int naudioindev, int *audioindev,
     int nchindev, int *chindev,
     int naudiooutdev, int *audiooutdev, int nchoutdev, int *choutdev,
@@ -85,10 +147,44 @@ EXTERN void sys_audiodevnumbertoname(int output, int devno, char *name,
 int sys_send_dacs(void);
 void sys_reportidle(void);
 void sys_set_priority(int higher);
+
+    /* kinds of threads for CPU affinity and scheduling policy (s_inter.c) */
+#define SYS_THREAD_AUDIO 0      /* scheduler and audio callback threads */
+#define SYS_THREAD_GUI 1        /* GUI socket I/O */
+#define SYS_THREAD_FILE 2       /* readsf~/writesf~ children */
+#define SYS_THREAD_WORKER 3     /* -dspthreads workers */
+#define SYS_THREAD_MIDI 4       /* -midithread input */
+#define SYS_NTHREADROLES 5
+int sys_setthreadcpus(int role, const char *cpus);
+void sys_setthreadrole(int role);
+void sys_lockmemory(void);
+void sys_prefault(void *p, size_t n);
+extern int sys_mlock;
+extern int sys_prefaulting;
 void sys_audiobuf(int nbufs);
 void sys_getmeters(t_sample *inmax, t_sample *outmax);
 void sys_listdevs(void);
 void sys_setblocksize(int n);
+void sys_setschedblocksize(int n);
+    /* convert a channel between t_samples and an interleaved integer buffer
+    ('format' is 2, 3 or 4 bytes per sample; 'stride' the channel count) */
+void sys_audio_topcm(const t_sample *in, void *p, int n, int stride,
+    int format);
+void sys_audio_frompcm(const void *p, t_sample *out, int n, int stride,
+    int format);
+extern int sys_dither;      /* dither output to 16 and 24 bits */
+    /* elastic FIFO that resamples a device whose clock isn't synced to the
+    first one ("-driftcomp"); see s_audio.c */
+typedef struct _audiodrift t_audiodrift;
+extern int sys_driftcomp;
+t_audiodrift *sys_audiodrift_new(int nchans, int target);
+void sys_audiodrift_free(t_audiodrift *x);
+void sys_audiodrift_reset(t_audiodrift *x);
+void sys_audiodrift_put(t_audiodrift *x, const t_sample *in, int n,
+    int instride);
+void sys_audiodrift_get(t_audiodrift *x, t_sample *out, int n,
+    int outstride);
+double sys_audiodrift_ppm(t_audiodrift *x);
 
 EXTERN void sys_get_audio_devs(char *indevlist, int *nindevs,
                           char *outdevlist, int *noutdevs, int *canmulti, int *cancallback,
@@ -121,9 +217,17 @@ EXTERN void sys_reopen_midi(void);
 EXTERN void sys_close_midi(void);
 EXTERN void sys_putmidimess(int portno, int a, int b, int c);
 EXTERN void sys_putmidibyte(int portno, int a);
+void sys_putmidisysex(int portno, int n, const unsigned char *buf);
 EXTERN void sys_poll_midi(void);
 EXTERN void sys_setmiditimediff(double inbuftime, double outbuftime);
 EXTERN void sys_midibytein(int portno, int byte);
+extern int sys_midithread;  /* true to read MIDI input from its own thread */
+extern int sys_midistamp;   /* true to let the backend time MIDI output */
+extern int sys_midioutcanstamp;     /* set by backends that can */
+extern double sys_midioutdelay;     /* delay for the message being put */
+void sys_stopmidithread(void);
+double sys_midiinnexttime(void);
+void sys_midiindispatch(void);
 
     /* implemented in the system dependent MIDI code (s_midi_pm.c, etc. ) */
 void midi_getdevs(char *indevlist, int *nindevs,
@@ -134,6 +238,7 @@ void sys_do_open_midi(int nmidiindev, int *midiindev,
 #ifdef USEAPI_ALSA
 EXTERN void sys_alsa_putmidimess(int portno, int a, int b, int c);
 EXTERN void sys_alsa_putmidibyte(int portno, int a);
+void sys_alsa_putmidisysex(int portno, int n, const unsigned char *buf);
 EXTERN void sys_alsa_poll_midi(void);
 EXTERN void sys_alsa_close_midi(void);
 
@@ -147,6 +252,7 @@ void sys_alsa_do_open_midi(int nmidiindev, int *midiindev,
 
 /* m_sched.c */
 EXTERN void sys_log_error(int type);
+void sys_tracefill(int nframes);  /* output frames queued, for "pd trace" */
 #define ERR_NOTHING 0
 #define ERR_ADCSLEPT 1
 #define ERR_DACSLEPT 2
@@ -157,6 +263,36 @@ EXTERN void sys_log_error(int type);
 #define SCHED_AUDIO_POLL 1
 #define SCHED_AUDIO_CALLBACK 2
 void sched_set_using_audio(int flag);
+void sched_watchdogstats(double *maxtime, int *nlate, int *nxrun);
+
+/* m_binbuf.c */
+EXTERN void binbuf_freecache(void);
+EXTERN void binbuf_forgetcached(const char *name);
+typedef struct _binbufparser t_binbufparser;
+t_binbufparser *binbufparser_new(void);
+void binbufparser_free(t_binbufparser *p);
+void binbufparser_clear(t_binbufparser *p);
+int binbufparser_text(t_binbufparser *p, t_binbuf *b, const char *text,
+    int size, int *nused);
+unsigned long binbuf_getstamp(const t_binbuf *x);
+void binbuf_touch(t_binbuf *x);
+int binbuf_pack(t_binbuf *x);
+int binbuf_ispacked(const t_binbuf *x);
+void binbuf_getatoms(const t_binbuf *x, int onset, int n, t_atom *to);
+int binbuf_nextbreak(const t_binbuf *x, int onset);
+
+/* m_memory.c */
+EXTERN void sys_rtrefill(void);
+
+/* x_misc.c */
+typedef void (*t_oscmessagefn)(void *owner, int argc, t_atom *argv,
+    uint64_t timetag);
+int osc_decode(void *owner, const char *who, const unsigned char *buf,
+    int n, t_oscmessagefn fn, uint64_t timetag);
+int osc_encode(int argc, const t_atom *argv, char **bufp);
+double osc_walltime(void);
+    /* seconds between the NTP epoch (1900) and the Unix one (1970) */
+#define NTP_UNIXOFFSET 2208988800.
 
 /* s_inter.c */
 
@@ -165,6 +301,15 @@ EXTERN void sys_init_fdpoll(void);
 
 EXTERN void sys_bail(int exitcode);
 EXTERN int sys_pollgui(void);
+EXTERN void sys_setfdqueue(int onoff);
+EXTERN int sys_fdqueuebusy(void);
+EXTERN void sys_waitforfds(int microsec);
+extern int sys_guithread;   /* true to talk to the GUI from its own thread */
+    /* send long coordinate lists to the GUI, compactly if it can decode them */
+EXTERN int sys_binarycoords(void);
+EXTERN void sys_coordsbegin(void);
+EXTERN void sys_coordsadd(int x, t_float y);
+EXTERN void sys_coordsend(void);
 
 EXTERN_STRUCT _socketreceiver;
 #define t_socketreceiver struct _socketreceiver
@@ -199,6 +344,7 @@ void sys_setalarm(int microsec);
 #define API_AUDIOUNIT 7
 #define API_ESD 8           /* no idea what this was, probably gone now */
 #define API_DUMMY 9
+#define API_WASAPI 10
 
     /* figure out which API should be the default.  The one we judge most
     likely to offer a working device takes precedence so that if you
@@ -215,15 +361,15 @@ void sys_setalarm(int microsec);
 #elif defined(USEAPI_OSS)
 # define API_DEFAULT API_OSS
 # define API_DEFSTRING "OSS"
-#elif defined(USEAPI_AUDIOUNIT)
-# define API_DEFAULT API_AUDIOUNIT
-# define API_DEFSTRING "AudioUnit"
 #elif defined(USEAPI_ESD)
 # define API_DEFAULT API_ESD
 # define API_DEFSTRING "ESD (?)"
 #elif defined(USEAPI_PORTAUDIO)
 # define API_DEFAULT API_PORTAUDIO
 # define API_DEFSTRING "portaudio"
+#elif defined(USEAPI_AUDIOUNIT)
+# define API_DEFAULT API_AUDIOUNIT
+# define API_DEFSTRING "AudioUnit"
 #elif defined(USEAPI_JACK)
 # define API_DEFAULT API_JACK
 # define API_DEFSTRING "Jack audio connection kit"
@@ -307,9 +453,9 @@ void mmio_getdevs(char *indevlist, int *nindevs,
     char *outdevlist, int *noutdevs, int *canmulti,
         int maxndev, int devdescsize);
 
-int audiounit_open_audio(int naudioindev, int *audioindev, int nchindev,
-    int *chindev, int naudiooutdev, int *audiooutdev, int nchoutdev,
-    int *choutdev, int rate);
+int audiounit_open_audio(int inchans, int outchans, int rate,
+    int blocksize, int nbuffers, int indevno, int outdevno,
+    t_audiocallback callback);
 void audiounit_close_audio(void);
 int audiounit_send_dacs(void);
 void audiounit_listdevs(void);
@@ -317,6 +463,15 @@ void audiounit_getdevs(char *indevlist, int *nindevs,
     char *outdevlist, int *noutdevs, int *canmulti,
         int maxndev, int devdescsize);
 
+int wasapi_open_audio(int inchans, int outchans, int rate,
+    int blocksize, int nbuffers, int indevno, int outdevno,
+    t_audiocallback callback);
+void wasapi_close_audio(void);
+int wasapi_send_dacs(void);
+void wasapi_getdevs(char *indevlist, int *nindevs,
+    char *outdevlist, int *noutdevs, int *canmulti,
+        int maxndev, int devdescsize);
+
 int esd_open_audio(int naudioindev, int *audioindev, int nchindev,
     int *chindev, int naudiooutdev, int *audiooutdev, int nchoutdev,
     int *choutdev, int rate);
@@ -327,12 +482,13 @@ void esd_getdevs(char *indevlist, int *nindevs,
     char *outdevlist, int *noutdevs, int *canmulti,
         int maxndev, int devdescsize);
 
-int dummy_open_audio(int nin, int nout, int sr);
+int dummy_open_audio(int nin, int nout, int sr, int blocksize);
 int dummy_close_audio(void);
 int dummy_send_dacs(void);
 void dummy_getdevs(char *indevlist, int *nindevs, char *outdevlist,
     int *noutdevs, int *canmulti, int maxndev, int devdescsize);
 void dummy_listdevs(void);
+void dummy_setmode(int freerun, double jitterms);
 
 void sys_listmididevs(void);
 EXTERN void sys_set_midi_api(int whichapi);
@@ -358,6 +514,7 @@ void sys_save_audio_params(
 typedef void (*t_printhook)(const char *s);
 extern t_printhook sys_printhook;  /* set this to override printing */
 extern int sys_printtostderr;
+void sys_deferlog(int defer);      /* see s_print.c */
 
 /* jsarlo { */
 
@@ -413,6 +570,14 @@ struct _instancestuff
     t_sample *st_soundout;
     t_sample *st_soundin;
     double st_time_per_dsp_tick;    /* obsolete - included for GEM?? */
+    struct _clock **st_clockheap;   /* set clocks, see m_sched.c */
+    int st_nclocks;
+    int st_clockheapsize;
+    double st_clockorder;       /* count of clock_set() calls, for ties */
+    struct _patchcache *st_patchcache;  /* parsed patch files, m_binbuf.c */
+    struct _dircache *st_dircache;  /* directory listings, s_path.c */
+    int st_pathgen;     /* bumped when paths or files may have changed */
+    struct _logstate *st_log;   /* messages on their way out, s_print.c */
 };
 
 #define STUFF (pd_this->pd_stuff)
@@ -4,17 +4,48 @@
 
 /* This file is compiled into the separate program, "pd-watchdog," which
 tries to prevent Pd from locking up the processor if it's at realtime
-priority.  Linux only.  Invoked from s_inter.c. */
+priority.  Linux only.  Invoked from s_inter.c.
+
+Each ping from Pd is a line giving the worst DSP tick time in microseconds,
+the number of late ticks, and the number of audio errors since the last
+ping.  Given "-deadline <msec>", a ping whose worst tick exceeds the
+deadline or which reports audio errors is a miss, and after "-misses <n>"
+misses in a row (3 by default) the watchdog takes "-action <what>": "log"
+just complains, "priority" drops Pd to normal scheduling so that it can't
+starve the rest of the system, and "restart" terminates Pd so that
+whatever started it can start it again. */
 
 #include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+#define ACTION_LOG 0
+#define ACTION_PRIORITY 1
+#define ACTION_RESTART 2
 
 int main(int argc, char **argv)
 {
-    int happy = 1;
+    int happy = 1, misses = 3, action = ACTION_LOG, nmissed = 0, demoted = 0;
+    double deadline = 0;
+    char line[100];
+    int linelen = 0;
+    for (argc--, argv++; argc > 1; argc -= 2, argv += 2)
+    {
+        if (!strcmp(argv[0], "-deadline"))
+            deadline = atof(argv[1]);
+        else if (!strcmp(argv[0], "-misses"))
+            misses = atoi(argv[1]);
+        else if (!strcmp(argv[0], "-action"))
+            action = (!strcmp(argv[1], "restart") ? ACTION_RESTART :
+                (!strcmp(argv[1], "priority") ? ACTION_PRIORITY : ACTION_LOG));
+    }
+    if (misses < 1)
+        misses = 1;
     while (1)
     {
         struct timeval timout;
@@ -39,10 +70,54 @@ int main(int argc, char **argv)
         if (FD_ISSET(0, &readset))
         {
             char buf[100];
+            int n, i;
             happy = 1;
-            if (read(0, &buf, 100) <= 0)
+            if ((n = read(0, &buf, 100)) <= 0)
                 return (0);
-            else continue;
+                /* collect lines and check each complete one */
+            for (i = 0; i < n; i++)
+            {
+                int maxusec, nlate, nxrun;
+                if (buf[i] != '\n')
+                {
+                    if (linelen < (int)sizeof(line) - 1)
+                        line[linelen++] = buf[i];
+                    continue;
+                }
+                line[linelen] = 0;
+                linelen = 0;
+                if (deadline <= 0 ||
+                    sscanf(line, "%d %d %d", &maxusec, &nlate, &nxrun) < 3)
+                        continue;
+                if (maxusec <= 1000 * deadline && !nxrun)
+                {
+                    nmissed = 0;
+                    continue;
+                }
+                if (++nmissed < misses)
+                    continue;
+                nmissed = 0;
+                fprintf(stderr,
+    "watchdog: pd missed its deadline (worst tick %.3f msec, %d late, %d audio errors)\n",
+                    0.001 * maxusec, nlate, nxrun);
+                if (action == ACTION_PRIORITY && !demoted)
+                {
+                    struct sched_param par;
+                    memset(&par, 0, sizeof(par));
+                    if (sched_setscheduler(getppid(), SCHED_OTHER, &par) < 0)
+                        perror("watchdog: sched_setscheduler");
+                    else fprintf(stderr,
+                        "watchdog: dropped pd to normal priority\n");
+                    demoted = 1;
+                }
+                else if (action == ACTION_RESTART)
+                {
+                    fprintf(stderr, "watchdog: stopping pd\n");
+                    kill(getppid(), SIGTERM);
+                    return (0);
+                }
+            }
+            continue;
         }
         happy = 0;
         kill(getppid(), SIGHUP);
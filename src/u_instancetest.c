@@ -0,0 +1,200 @@
+/* Copyright (c) 2026 Miller Puckette and others.
+* For information on usage and redistribution, and for a DISCLAIMER OF ALL
+* WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
+
+/* Run several Pd instances at once, each ticked by a thread of its own, the
+way a program embedding Pd with PDINSTANCE might, while the main thread keeps
+refilling the real-time allocator as Pd's idle loop does.  Each instance's
+patch creates clocks (every message to "pipe" schedules one) and passes long
+lists through "list" objects, whose copies come from rt_getbytes(), and
+every so often posts something.  The numbers that come back out of the
+patch have to arrive in order and none may be missing.
+
+This is meant to be run under ThreadSanitizer, which finds the races that
+would only rarely show up as wrong numbers.  Build and run it with
+    make -f makefile.gnu instancetest MORECFLAGS=-fsanitize=thread
+It exits nonzero if an instance got the wrong answer. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "m_pd.h"
+#include "m_imp.h"
+#include "s_stuff.h"
+
+#ifndef PDINSTANCE
+#error u_instancetest.c must be compiled with -DPDINSTANCE
+#endif
+
+void pd_init(void);     /* m_pd.c; what libpd calls to start up */
+
+#define NINSTANCE 8
+#define NTICK 3000
+
+    /* each message to "pipe" carries the count, and a long list along with
+    it through "list append" and "list split", so that neither fits in
+    alloca() */
+static const char *patchtext =
+"#N canvas 0 0 450 300 10;\n"
+"#X obj 10 10 loadbang;\n"
+"#X obj 10 30 metro 1;\n"
+"#X obj 10 50 f;\n"
+"#X obj 50 50 + 1;\n"
+"#X obj 10 70 list append 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19"
+" 20 21 22 23 24 25 26 27 28 29 30 31 32 33 34 35 36 37 38 39 40 41 42 43"
+" 44 45 46 47 48 49 50 51 52 53 54 55 56 57 58 59 60 61 62 63 64 65 66 67"
+" 68 69 70 71 72 73 74 75 76 77 78 79 80 81 82 83 84 85 86 87 88 89 90 91"
+" 92 93 94 95 96 97 98 99 100 101 102 103 104 105 106 107 108 109 110 111"
+" 112 113 114 115 116 117 118 119 120;\n"
+"#X obj 10 90 list split 1;\n"
+"#X obj 10 110 pipe 2;\n"
+"#X obj 10 130 s \\$1-done;\n"
+"#X obj 150 70 mod 500;\n"
+"#X obj 150 90 sel 0;\n"
+"#X obj 150 110 f;\n"
+"#X obj 150 130 print instancetest;\n"
+"#X connect 0 0 1 0;\n"
+"#X connect 1 0 2 0;\n"
+"#X connect 2 0 3 0;\n"
+"#X connect 3 0 2 1;\n"
+"#X connect 2 0 4 0;\n"
+"#X connect 4 0 5 0;\n"
+"#X connect 5 0 6 0;\n"
+"#X connect 6 0 7 0;\n"
+"#X connect 2 0 8 0;\n"
+"#X connect 8 0 9 0;\n"
+"#X connect 9 0 10 0;\n"
+"#X connect 2 0 10 1;\n"
+"#X connect 10 0 11 0;\n";
+
+static t_class *checker_class;
+
+typedef struct _checker
+{
+    t_pd c_pd;
+    int c_next;         /* number we expect next */
+    int c_bad;          /* number of times it wasn't */
+} t_checker;
+
+static void checker_float(t_checker *x, t_floatarg f)
+{
+    if ((int)f != x->c_next)
+        x->c_bad++;
+    x->c_next = (int)f + 1;
+}
+
+typedef struct _testthread
+{
+    pthread_t t_thread;
+    int t_no;
+    char t_dir[MAXPDSTRING];
+    int t_got;
+    int t_bad;
+} t_testthread;
+
+static pthread_mutex_t test_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int test_nfinished;
+
+static void *test_run(void *z)
+{
+    t_testthread *t = (t_testthread *)z;
+    t_pdinstance *x = pdinstance_new();
+    t_checker *checker;
+    t_atom arg;
+    char name[80];
+    int i;
+
+    pd_setinstance(x);
+    sys_lock();
+    sys_setchsr(0, 0, 44100);
+    checker = (t_checker *)pd_new(checker_class);
+    checker->c_next = 0;
+    checker->c_bad = 0;
+    snprintf(name, sizeof(name), "%d-done", t->t_no);
+    pd_bind(&checker->c_pd, gensym(name));
+    SETFLOAT(&arg, t->t_no);
+    canvas_setargs(1, &arg);
+    glob_evalfile(0, gensym("instancetest.pd"), gensym(t->t_dir));
+    canvas_setargs(0, 0);
+    sys_unlock();
+
+    for (i = 0; i < NTICK; i++)
+    {
+        sys_lock();
+        sched_tick();
+        sys_unlock();
+    }
+
+    sys_lock();
+    t->t_got = checker->c_next;
+    t->t_bad = checker->c_bad;
+    pd_unbind(&checker->c_pd, gensym(name));
+    pd_free(&checker->c_pd);
+    sys_unlock();
+    pdinstance_free(x);
+    pthread_mutex_lock(&test_mutex);
+    test_nfinished++;
+    pthread_mutex_unlock(&test_mutex);
+    return (0);
+}
+
+int main(int argc, char **argv)
+{
+    t_testthread threads[NINSTANCE];
+    char dir[MAXPDSTRING], file[MAXPDSTRING];
+    const char *tmp = getenv("TMPDIR");
+    FILE *fd;
+    int i, nthread, nfinished = 0, failed = 0;
+
+    nthread = (argc > 1 ? atoi(argv[1]) : NINSTANCE);
+    if (nthread < 1 || nthread > NINSTANCE)
+        nthread = NINSTANCE;
+    snprintf(dir, sizeof(dir), "%s", (tmp && *tmp ? tmp : "/tmp"));
+    snprintf(file, sizeof(file), "%s/instancetest.pd", dir);
+    if (!(fd = fopen(file, "w")) || fputs(patchtext, fd) < 0)
+    {
+        perror(file);
+        return (1);
+    }
+    fclose(fd);
+
+    pd_init();
+    sys_lock();
+    checker_class = class_new(gensym("instancetest-checker"), 0, 0,
+        sizeof(t_checker), CLASS_PD, 0);
+    class_addfloat(checker_class, checker_float);
+    sys_unlock();
+
+    for (i = 0; i < nthread; i++)
+    {
+        threads[i].t_no = i;
+        strcpy(threads[i].t_dir, dir);
+        if (pthread_create(&threads[i].t_thread, 0, test_run, &threads[i]))
+        {
+            perror("pthread_create");
+            return (1);
+        }
+    }
+        /* what the idle loop would be doing */
+    while (nfinished < nthread)
+    {
+        sys_rtrefill();
+        usleep(100);
+        pthread_mutex_lock(&test_mutex);
+        nfinished = test_nfinished;
+        pthread_mutex_unlock(&test_mutex);
+    }
+    for (i = 0; i < nthread; i++)
+    {
+        pthread_join(threads[i].t_thread, 0);
+        printf("instance %d: %d numbers, %d out of order\n",
+            i, threads[i].t_got, threads[i].t_bad);
+        if (threads[i].t_bad || threads[i].t_got < NTICK/2)
+            failed = 1;
+    }
+    remove(file);
+    printf("%s\n", (failed ? "FAILED" : "ok"));
+    return (failed);
+}
@@ -11,6 +11,11 @@ standard output. */
     Moonix::Antoine Rousseau
 */
 
+/* Output is collected and written once per wakeup rather than once per
+message, and UDP datagrams are fetched several at a time.  "-b" copies
+what arrives verbatim (from "netsend -b"), and "-stats" reports the
+throughput on stderr every second. */
+
 #include <sys/types.h>
 #include <string.h>
 #include <stdio.h>
@@ -18,6 +23,11 @@ standard output. */
 #include <stdlib.h>
 #ifndef _WIN32
 #include <unistd.h>
+#include <sys/time.h>
+#else
+#include <io.h>
+#include <fcntl.h>
+#include <windows.h>
 #endif
 
 #include "s_net.h"
@@ -36,21 +46,53 @@ static t_fdpoll *fdpoll;
 static int maxfd;
 static int sockfd;
 static int protocol;
+static int binary;
+static int stats;
+static long nbytes, nmess;
+static double lastreport;
 
 static void sockerror(char *s);
 static void dopoll(void);
-static void sockerror(char *s);
+static void flushoutput(void);
 
 /* print addrinfo lists for debugging */
 /* #define PRINT_ADDRINFO */
 
 #define BUFSIZE 4096
+#define OUTBUFSIZE 65536
+
+static char stdoutbuf[OUTBUFSIZE];
+static int stdoutfill;
+
+static double gettime(void)
+{
+#ifdef _WIN32
+    return (0.001 * GetTickCount());
+#else
+    struct timeval now;
+    gettimeofday(&now, 0);
+    return (now.tv_sec + 0.000001 * now.tv_usec);
+#endif
+}
 
 int main(int argc, char **argv)
 {
     int status, portno, multicast = 0;
     char *hostname = NULL;
     struct addrinfo *ailist = NULL, *ai;
+    while (argc > 1 && argv[1][0] == '-')
+    {
+        if (!strcmp(argv[1], "-b"))
+            binary = 1;
+        else if (!strcmp(argv[1], "-stats"))
+            stats = 1;
+        else goto usage;
+        argc--; argv++;
+    }
+#ifdef _WIN32
+    if (binary)
+        _setmode(1, _O_BINARY);
+#endif
     if (argc < 2 || sscanf(argv[1], "%d", &portno) < 1 || portno <= 0)
         goto usage;
     if (argc > 2)
@@ -211,12 +253,16 @@ int main(int argc, char **argv)
     }
 
     /* now loop forever selecting on sockets */
+    lastreport = gettime();
     while (1)
         dopoll();
 
 usage:
-    fprintf(stderr, "usage: pdreceive <portnumber> [udp|tcp] [host]\n");
+    fprintf(stderr,
+        "usage: pdreceive [-b] [-stats] <portnumber> [udp|tcp] [host]\n");
     fprintf(stderr, "(default is tcp)\n");
+    fprintf(stderr, "-b: copy binary input verbatim, from netsend -b\n");
+    fprintf(stderr, "-stats: report throughput every second\n");
     exit(EXIT_FAILURE);
 }
 
@@ -243,7 +289,12 @@ static void addport(int fd)
         fprintf(stderr, "out of memory");
         exit(EXIT_FAILURE);
     }
-    printf("number_connected %d;\n", nfdpoll);
+    if (!binary)
+    {
+        flushoutput();
+        printf("number_connected %d;\n", nfdpoll);
+        fflush(stdout);
+    }
 }
 
 static void rmport(t_fdpoll *x)
@@ -265,7 +316,12 @@ static void rmport(t_fdpoll *x)
             fdpoll = (t_fdpoll *)realloc(fdpoll,
                 (nfdpoll-1) * sizeof(t_fdpoll));
             nfdpoll--;
-            printf("number_connected %d;\n", nfdpoll);
+            if (!binary)
+            {
+                flushoutput();
+                printf("number_connected %d;\n", nfdpoll);
+                fflush(stdout);
+            }
             return;
         }
     }
@@ -280,33 +336,61 @@ static void doconnect(void)
     else addport(fd);
 }
 
-static void makeoutput(char *buf, int len)
+static void flushoutput(void)
 {
+    if (!stdoutfill)
+        return;
 #ifdef _WIN32
-    int j;
-    for (j = 0; j < len; j++)
-        putchar(buf[j]);
+    fwrite(stdoutbuf, 1, stdoutfill, stdout);
+    fflush(stdout);
 #else
-    if (write(1, buf, len) < len)
+    if (write(1, stdoutbuf, stdoutfill) < stdoutfill)
     {
         perror("write");
         exit(EXIT_FAILURE);
     }
 #endif
+    stdoutfill = 0;
+}
+
+static void makeoutput(char *buf, int len)
+{
+    if (stdoutfill + len > OUTBUFSIZE)
+        flushoutput();
+    if (len > OUTBUFSIZE)
+    {
+        memcpy(stdoutbuf, buf, OUTBUFSIZE);
+        stdoutfill = OUTBUFSIZE;
+        flushoutput();
+        makeoutput(buf + OUTBUFSIZE, len - OUTBUFSIZE);
+        return;
+    }
+    memcpy(stdoutbuf + stdoutfill, buf, len);
+    stdoutfill += len;
 }
 
 static void udpread(void)
 {
-    char buf[BUFSIZE];
-    int ret = recv(sockfd, buf, BUFSIZE, 0);
+    static char buf[SOCKET_MAXDATAGRAMS * BUFSIZE];
+    int sizes[SOCKET_MAXDATAGRAMS], i;
+    int ret = socket_recv_datagrams(sockfd, buf, BUFSIZE,
+        SOCKET_MAXDATAGRAMS, sizes, 0);
     if (ret < 0)
     {
         sockerror("recv (udp)");
         socket_close(sockfd);
         exit(EXIT_FAILURE);
     }
-    else if (ret > 0)
-        makeoutput(buf, ret);
+    for (i = 0; i < ret; i++)
+    {
+        int j;
+        nbytes += sizes[i];
+        if (!binary)
+            for (j = 0; j < sizes[i]; j++)
+                if (buf[i * BUFSIZE + j] == ';')
+                    nmess++;
+        makeoutput(buf + i * BUFSIZE, sizes[i]);
+    }
 }
 
 static int tcpmakeoutput(t_fdpoll *x, char *inbuf, int len)
@@ -334,6 +418,7 @@ static int tcpmakeoutput(t_fdpoll *x, char *inbuf, int len)
             outbuf[outlen++] = '\n';
             if (!x->fdp_discard)
                makeoutput(outbuf, outlen);
+            nmess++;
 
             outlen = 0;
             x->fdp_discard = 0;
@@ -358,12 +443,31 @@ static void tcpread(t_fdpoll *x)
     }
     else if (ret == 0)
         rmport(x);
-    else tcpmakeoutput(x, inbuf, ret);
+    else
+    {
+        nbytes += ret;
+        if (binary)
+            makeoutput(inbuf, ret);
+        else tcpmakeoutput(x, inbuf, ret);
+    }
+}
+
+static void report(void)
+{
+    double now = gettime(), elapsed = now - lastreport;
+    if (elapsed < 1)
+        return;
+    if (nbytes)
+        fprintf(stderr,
+            "pdreceive: %.0f messages/sec, %.2f MB/sec\n",
+                nmess / elapsed, nbytes / (1000000. * elapsed));
+    nbytes = nmess = 0;
+    lastreport = now;
 }
 
 static void dopoll(void)
 {
-    int i;
+    int i, status;
     t_fdpoll *fp;
     fd_set readset, writeset, exceptset;
     FD_ZERO(&writeset);
@@ -376,7 +480,15 @@ static void dopoll(void)
         for (fp = fdpoll, i = nfdpoll; i--; fp++)
             FD_SET(fp->fdp_fd, &readset);
     }
-    if (select(maxfd+1, &readset, &writeset, &exceptset, 0) < 0)
+    if (stats)
+    {
+        struct timeval timeout;
+        timeout.tv_sec = 1;
+        timeout.tv_usec = 0;
+        status = select(maxfd+1, &readset, &writeset, &exceptset, &timeout);
+    }
+    else status = select(maxfd+1, &readset, &writeset, &exceptset, 0);
+    if (status < 0)
     {
         perror("select");
         exit(EXIT_FAILURE);
@@ -394,6 +506,9 @@ static void dopoll(void)
         if (FD_ISSET(sockfd, &readset))
             udpread();
     }
+    flushoutput();
+    if (stats)
+        report();
 }
 
 
@@ -3,13 +3,28 @@
 * WARRANTIES, see the file, "LICENSE.txt," in the Pd distribution.  */
 
 /* the "pdsend" command.  This is a standalone program that forwards messages
-from its standard input to Pd via the netsend/netreceive ("FUDI") protocol. */
+from its standard input to Pd via the netsend/netreceive ("FUDI") protocol.
+
+Normally each line is sent as soon as it's read.  With "-bulk" stdin is
+read in large pieces and sent with as few system calls as possible: for
+TCP as it comes, for UDP packed into datagrams of whole lines, each no
+bigger than Pd's receive buffer, several datagrams per call where the
+system allows.  "-b" sends stdin verbatim, for "netreceive -b", and
+"-stats" reports the throughput at the end. */
 
 #include <sys/types.h>
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
 #include <stdlib.h>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <sys/time.h>
+#endif
 
 #include "s_net.h"
 
@@ -19,14 +34,191 @@ static void sockerror(char *s);
 /* #define PRINT_ADDRINFO */
 
 #define BUFSIZE 4096
+#define BULKSIZE 65536
+#define UDPSIZE 4096    /* largest datagram netreceive takes whole */
+
+static int sockfd = -1, protocol;
+static struct sockaddr_storage server;
+static long nbytes, nmess, nwrites;
+
+static double gettime(void)
+{
+#ifdef _WIN32
+    return (0.001 * GetTickCount());
+#else
+    struct timeval now;
+    gettimeofday(&now, 0);
+    return (now.tv_sec + 0.000001 * now.tv_usec);
+#endif
+}
+
+static socklen_t serverlen(void)
+{
+    return (server.ss_family == AF_INET6 ?
+        sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
+}
+
+    /* send a buffer as one TCP write or UDP datagram; returns 0 or -1 */
+static int sendbuf(const char *bp, int nsend)
+{
+    int nsent;
+    for (nsent = 0; nsent < nsend;)
+    {
+        int res = 0;
+        if (protocol == SOCK_DGRAM)
+            res = (int)sendto(sockfd, bp, nsend-nsent, 0,
+                (struct sockaddr *)&server, serverlen());
+        else
+            res = (int)send(sockfd, bp, nsend-nsent, 0);
+
+        if (res < 0)
+        {
+            sockerror("send");
+            return (-1);
+        }
+        nwrites++;
+        nsent += res;
+        bp += res;
+    }
+    return (0);
+}
+
+static int flushdatagrams(const char *buf, int *onsets, int *sizes, int n)
+{
+    if (socket_send_datagrams(sockfd, buf, onsets, sizes, n,
+        (struct sockaddr *)&server, serverlen()) < n)
+    {
+        sockerror("send");
+        return (-1);
+    }
+    nwrites += n;
+    return (0);
+}
+
+    /* send the whole lines in buf as UDP datagrams of up to UDPSIZE bytes
+    (a longer line goes by itself); an incomplete last line waits for more
+    unless "flush" is set.  In binary mode there are no lines and the buffer
+    is just cut into pieces.  Returns how many bytes were sent, or -1. */
+static int senddatagrams(const char *buf, int n, int binary, int flush)
+{
+    int onsets[SOCKET_MAXDATAGRAMS], sizes[SOCKET_MAXDATAGRAMS];
+    int ndgram = 0, used = 0;
+    while (used < n)
+    {
+        int size;
+        if (binary)
+            size = (n - used < UDPSIZE ? n - used : UDPSIZE);
+        else
+        {
+            int i;
+            size = 0;
+            for (i = used; i < n && i - used < UDPSIZE; i++)
+                if (buf[i] == '\n')
+                    size = i + 1 - used;
+            if (!size)
+            {
+                    /* a line too long for a datagram, or not all here yet */
+                while (i < n && buf[i] != '\n')
+                    i++;
+                if (i == n && !flush)
+                    break;
+                size = (i < n ? i + 1 : n) - used;
+                if (size > UDPSIZE)
+                    fprintf(stderr,
+                        "pdsend: %d-byte line is too long for Pd\n", size);
+            }
+        }
+        onsets[ndgram] = used;
+        sizes[ndgram++] = size;
+        used += size;
+        if (ndgram == SOCKET_MAXDATAGRAMS)
+        {
+            if (flushdatagrams(buf, onsets, sizes, ndgram) < 0)
+                return (-1);
+            ndgram = 0;
+        }
+    }
+    if (ndgram && flushdatagrams(buf, onsets, sizes, ndgram) < 0)
+        return (-1);
+    return (used);
+}
+
+static void countmessages(const char *buf, int n)
+{
+    int i;
+    for (i = 0; i < n; i++)
+        if (buf[i] == ';')
+            nmess++;
+}
+
+    /* bulk and binary modes: read stdin in large pieces */
+static void sendbulk(int binary)
+{
+    static char buf[BULKSIZE];
+    int fill = 0, eof = 0;
+#ifdef _WIN32
+    if (binary)
+        _setmode(0, _O_BINARY);
+#endif
+    while (!eof || fill)
+    {
+        int n = 0, used;
+        if (!eof)
+        {
+            n = (int)read(0, buf + fill, BULKSIZE - fill);
+            if (n < 0)
+            {
+                perror("stdin");
+                return;
+            }
+            if (!n)
+                eof = 1;
+        }
+        nbytes += n;
+        if (!binary)
+            countmessages(buf + fill, n);
+        fill += n;
+        if (protocol == SOCK_STREAM)
+        {
+            if (fill && sendbuf(buf, fill) < 0)
+                return;
+            used = fill;
+        }
+        else
+        {
+                /* hold back an incomplete last line unless it fills
+                the whole buffer */
+            used = senddatagrams(buf, fill, binary, eof);
+            if (!used && fill == BULKSIZE)
+                used = senddatagrams(buf, fill, binary, 1);
+            if (used < 0)
+                return;
+        }
+        memmove(buf, buf + used, fill - used);
+        fill -= used;
+        if (eof && !used)
+            break;
+    }
+}
 
 int main(int argc, char **argv)
 {
-    int sockfd = -1, portno, protocol, status, multicast;
-    struct sockaddr_storage server;
+    int portno, status, multicast, bulk = 0, binary = 0, stats = 0;
     struct addrinfo *ailist = NULL, *ai;
     float timeout = 10;
     char *hostname;
+    double starttime;
+    while (argc > 1 && argv[1][0] == '-')
+    {
+        if (!strcmp(argv[1], "-bulk"))
+            bulk = 1;
+        else if (!strcmp(argv[1], "-b"))
+            binary = 1;
+        else if (!strcmp(argv[1], "-stats"))
+            stats = 1;
+        else goto usage;
+        argc--; argv++;
+    }
     if (argc < 2 || sscanf(argv[1], "%d", &portno) < 1 || portno <= 0)
         goto usage;
     if (argc >= 3)
@@ -105,43 +297,42 @@ int main(int argc, char **argv)
     freeaddrinfo(ailist);
 
     /* now loop reading stdin and sending it to socket */
-    while (1)
+    starttime = gettime();
+    if (bulk || binary)
+        sendbulk(binary);
+    else while (1)
     {
-        char buf[BUFSIZE], *bp;
-        int nsent, nsend;
+        char buf[BUFSIZE];
+        int nsend;
         if (!fgets(buf, BUFSIZE, stdin))
             break;
         nsend = strlen(buf);
-        for (bp = buf, nsent = 0; nsent < nsend;)
-        {
-            int res = 0;
-            if (protocol == SOCK_DGRAM)
-            {
-                socklen_t addrlen = (server.ss_family == AF_INET6 ?
-                    sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
-                res = (int)sendto(sockfd, bp, nsend-nsent, 0,
-                    (struct sockaddr *)&server, addrlen);
-            }
-            else
-                res = (int)send(sockfd, bp, nsend-nsent, 0);
-
-            if (res < 0)
-            {
-                sockerror("send");
-                goto done;
-            }
-            nsent += res;
-            bp += res;
-        }
+        nbytes += nsend;
+        countmessages(buf, nsend);
+        if (sendbuf(buf, nsend) < 0)
+            break;
     }
-done:
     if (ferror(stdin))
         perror("stdin");
+    if (stats)
+    {
+        double elapsed = gettime() - starttime;
+        if (elapsed <= 0)
+            elapsed = 0.001;
+        fprintf(stderr,
+  "pdsend: %ld messages, %ld bytes in %ld writes, %.3f sec (%.0f messages/sec, %.2f MB/sec)\n",
+            nmess, nbytes, nwrites, elapsed, nmess / elapsed,
+                nbytes / (1000000. * elapsed));
+    }
     socket_close(sockfd);
     exit(EXIT_SUCCESS);
 usage:
-    fprintf(stderr, "usage: pdsend <portnumber> [host] [udp|tcp] [timeout(s)]\n");
+    fprintf(stderr,
+        "usage: pdsend [-bulk] [-b] [-stats] <portnumber> [host] [udp|tcp] [timeout(s)]\n");
     fprintf(stderr, "(default is localhost and tcp with 10s timeout)\n");
+    fprintf(stderr, "-bulk: read and send in large pieces, not line by line\n");
+    fprintf(stderr, "-b: send stdin as binary, for netreceive -b\n");
+    fprintf(stderr, "-stats: report throughput at the end\n");
     exit(EXIT_FAILURE);
 }
 
@@ -538,7 +538,9 @@ static void *array_rangeop_new(t_class *class,
     return (x);
 }
 
-static int array_rangeop_getrange(t_array_rangeop *x,
+    /* find the array and the range in it to work on; also return the array
+    itself if "ap" isn't zero */
+static int array_rangeop_getarrayrange(t_array_rangeop *x, t_array **ap,
     char **firstitemp, int *nitemp, int *stridep, int *arrayonsetp)
 {
     t_glist *glist;
@@ -574,11 +576,115 @@ static int array_rangeop_getrange(t_array_rangeop *x,
     *nitemp = nitem;
     *stridep = stride;
     *arrayonsetp = arrayonset;
+    if (ap)
+        *ap = a;
     return (1);
 }
 
+static int array_rangeop_getrange(t_array_rangeop *x,
+    char **firstitemp, int *nitemp, int *stridep, int *arrayonsetp)
+{
+    return (array_rangeop_getarrayrange(x, 0, firstitemp, nitemp, stridep,
+        arrayonsetp));
+}
+
 /* --------  specific operations on ranges of arrays -------- */
 
+    /* reductions used below.  Elements are a stride apart (at least a
+    t_word, so even plain float arrays aren't packed and don't suit SIMD
+    loads) so we go four at a time with independent accumulators instead,
+    which keeps the loops free of dependency chains and branches. */
+#define RANGEOP_AT(p, k) (*(t_float *)((p) + (k) * stride))
+
+static double array_rangeop_sum(char *firstitem, int nitem, int stride,
+    int positiveonly)
+{
+    double sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+    char *itemp = firstitem;
+    int i;
+    if (positiveonly)
+    {
+        for (i = 0; i + 4 <= nitem; i += 4, itemp += 4 * stride)
+        {
+            t_float f0 = RANGEOP_AT(itemp, 0), f1 = RANGEOP_AT(itemp, 1),
+                f2 = RANGEOP_AT(itemp, 2), f3 = RANGEOP_AT(itemp, 3);
+            sum0 += (f0 > 0 ? f0 : 0);
+            sum1 += (f1 > 0 ? f1 : 0);
+            sum2 += (f2 > 0 ? f2 : 0);
+            sum3 += (f3 > 0 ? f3 : 0);
+        }
+        for (; i < nitem; i++, itemp += stride)
+            sum0 += (RANGEOP_AT(itemp, 0) > 0 ? RANGEOP_AT(itemp, 0) : 0);
+    }
+    else
+    {
+        for (i = 0; i + 4 <= nitem; i += 4, itemp += 4 * stride)
+        {
+            sum0 += RANGEOP_AT(itemp, 0);
+            sum1 += RANGEOP_AT(itemp, 1);
+            sum2 += RANGEOP_AT(itemp, 2);
+            sum3 += RANGEOP_AT(itemp, 3);
+        }
+        for (; i < nitem; i++, itemp += stride)
+            sum0 += RANGEOP_AT(itemp, 0);
+    }
+    return ((sum0 + sum1) + (sum2 + sum3));
+}
+
+    /* find the largest value (or smallest if "wantmin") beyond "init", then
+    go back for the first index it occurs at; -1 if none beat "init".  NaNs
+    never win, as in a plain "if (f > best)" loop. */
+static int array_rangeop_extreme(char *firstitem, int nitem, int stride,
+    int wantmin, t_float init, t_float *bestp)
+{
+    t_float b0 = init, b1 = init, b2 = init, b3 = init;
+    char *itemp = firstitem;
+    int i;
+    if (wantmin)
+    {
+        for (i = 0; i + 4 <= nitem; i += 4, itemp += 4 * stride)
+        {
+            t_float f0 = RANGEOP_AT(itemp, 0), f1 = RANGEOP_AT(itemp, 1),
+                f2 = RANGEOP_AT(itemp, 2), f3 = RANGEOP_AT(itemp, 3);
+            b0 = (f0 < b0 ? f0 : b0);
+            b1 = (f1 < b1 ? f1 : b1);
+            b2 = (f2 < b2 ? f2 : b2);
+            b3 = (f3 < b3 ? f3 : b3);
+        }
+        for (; i < nitem; i++, itemp += stride)
+            if (RANGEOP_AT(itemp, 0) < b0)
+                b0 = RANGEOP_AT(itemp, 0);
+        b0 = (b1 < b0 ? b1 : b0);
+        b2 = (b3 < b2 ? b3 : b2);
+        b0 = (b2 < b0 ? b2 : b0);
+    }
+    else
+    {
+        for (i = 0; i + 4 <= nitem; i += 4, itemp += 4 * stride)
+        {
+            t_float f0 = RANGEOP_AT(itemp, 0), f1 = RANGEOP_AT(itemp, 1),
+                f2 = RANGEOP_AT(itemp, 2), f3 = RANGEOP_AT(itemp, 3);
+            b0 = (f0 > b0 ? f0 : b0);
+            b1 = (f1 > b1 ? f1 : b1);
+            b2 = (f2 > b2 ? f2 : b2);
+            b3 = (f3 > b3 ? f3 : b3);
+        }
+        for (; i < nitem; i++, itemp += stride)
+            if (RANGEOP_AT(itemp, 0) > b0)
+                b0 = RANGEOP_AT(itemp, 0);
+        b0 = (b1 > b0 ? b1 : b0);
+        b2 = (b3 > b2 ? b3 : b2);
+        b0 = (b2 > b0 ? b2 : b0);
+    }
+    *bestp = b0;
+    if (b0 == init)
+        return (-1);
+    for (i = 0, itemp = firstitem; i < nitem; i++, itemp += stride)
+        if (RANGEOP_AT(itemp, 0) == b0)
+            return (i);
+    return (-1);
+}
+
 /* ----------------  array sum -- add them up ------------------- */
 static t_class *array_sum_class;
 
@@ -594,14 +700,12 @@ static void *array_sum_new(t_symbol *s, int argc, t_atom *argv)
 
 static void array_sum_bang(t_array_rangeop *x)
 {
-    char *itemp, *firstitem;
-    int stride, nitem, arrayonset, i;
-    double sum;
+    char *firstitem;
+    int stride, nitem, arrayonset;
     if (!array_rangeop_getrange(x, &firstitem, &nitem, &stride, &arrayonset))
         return;
-    for (i = 0, sum = 0, itemp = firstitem; i < nitem; i++, itemp += stride)
-        sum += *(t_float *)itemp;
-    outlet_float(x->x_outlet, sum);
+    outlet_float(x->x_outlet,
+        array_rangeop_sum(firstitem, nitem, stride, 0));
 }
 
 static void array_sum_float(t_array_rangeop *x, t_floatarg f)
@@ -689,9 +793,7 @@ static void array_quantile_float(t_array_rangeop *x, t_floatarg f)
     double sum;
     if (!array_rangeop_getrange(x, &firstitem, &nitem, &stride, &arrayonset))
         return;
-    for (i = 0, sum = 0, itemp = firstitem; i < nitem; i++, itemp += stride)
-        sum += (*(t_float *)itemp > 0? *(t_float *)itemp : 0);
-    sum *= f;
+    sum = f * array_rangeop_sum(firstitem, nitem, stride, 1);
     for (i = 0, itemp = firstitem; i < (nitem-1); i++, itemp += stride)
     {
         sum -= (*(t_float *)itemp > 0? *(t_float *)itemp : 0);
@@ -708,6 +810,13 @@ typedef struct _array_random   /* any operation meaningful on a subrange */
 {
     t_array_rangeop x_r;
     unsigned int x_state;
+    double *x_cumul;        /* running sums of the (positive) values */
+    int x_ncumul;           /* allocated size of x_cumul */
+    t_array *x_cachearray;  /* array, range and a_changes x_cumul is for */
+    char *x_cachefirst;
+    int x_cachenitem;
+    int x_cachestride;
+    int x_cachechanges;
 } t_array_random;
 
 static void *array_random_new(t_symbol *s, int argc, t_atom *argv)
@@ -717,6 +826,9 @@ static void *array_random_new(t_symbol *s, int argc, t_atom *argv)
     static unsigned int random_nextseed = 584926371;
     random_nextseed = random_nextseed * 435898247 + 938284287;
     x->x_state = random_nextseed;
+    x->x_cumul = 0;
+    x->x_ncumul = 0;
+    x->x_cachearray = 0;
     outlet_new(&x->x_r.x_tc.tc_obj, &s_float);
     return (x);
 }
@@ -726,16 +838,60 @@ static void array_random_seed(t_array_random *x, t_floatarg f)
     x->x_state = f;
 }
 
+    /* For garrays, whose writers tell us when they change the contents (see
+    array_freepeaks() in g_array.c), we keep the running sums and look the
+    draw up in them by bisection.  Other arrays are scanned each time as
+    "array quantile" does. */
 static void array_random_bang(t_array_random *x)
 {
-    char *firstitem;
-    int stride, nitem, arrayonset;
+    char *firstitem, *itemp;
+    int stride, nitem, arrayonset, lo, hi, i;
+    t_array *a;
+    double f, target, sum;
 
-    if (!array_rangeop_getrange(&x->x_r, &firstitem, &nitem, &stride,
-        &arrayonset))
+    if (!array_rangeop_getarrayrange(&x->x_r, &a, &firstitem, &nitem,
+        &stride, &arrayonset))
             return;
     x->x_state = x->x_state * 472940017 + 832416023;
-    array_quantile_float(&x->x_r, (1./4294967296.0) * (double)(x->x_state));
+    f = (1./4294967296.0) * (double)(x->x_state);
+    if (!a->a_cachepeaks || nitem < 2)
+    {
+        array_quantile_float(&x->x_r, f);
+        return;
+    }
+    if (a != x->x_cachearray || firstitem != x->x_cachefirst ||
+        nitem != x->x_cachenitem || stride != x->x_cachestride ||
+            a->a_changes != x->x_cachechanges)
+    {
+        if (nitem > x->x_ncumul)
+        {
+            x->x_cumul = (double *)resizebytes(x->x_cumul,
+                x->x_ncumul * sizeof(double), nitem * sizeof(double));
+            x->x_ncumul = nitem;
+        }
+        for (i = 0, sum = 0, itemp = firstitem; i < nitem;
+            i++, itemp += stride)
+        {
+            sum += (*(t_float *)itemp > 0 ? *(t_float *)itemp : 0);
+            x->x_cumul[i] = sum;
+        }
+        x->x_cachearray = a;
+        x->x_cachefirst = firstitem;
+        x->x_cachenitem = nitem;
+        x->x_cachestride = stride;
+        x->x_cachechanges = a->a_changes;
+    }
+        /* first index whose running sum exceeds the target, as in
+        array_quantile_float(); the last one if none do before it */
+    target = f * x->x_cumul[nitem-1];
+    for (lo = 0, hi = nitem - 1; lo < hi; )
+    {
+        int mid = (lo + hi) >> 1;
+        if (x->x_cumul[mid] > target)
+            hi = mid;
+        else lo = mid + 1;
+    }
+    outlet_float(x->x_r.x_outlet, lo);
 }
 
 static void array_random_float(t_array_random *x, t_floatarg f)
@@ -744,6 +900,13 @@ static void array_random_float(t_array_random *x, t_floatarg f)
     array_random_bang(x);
 }
 
+static void array_random_free(t_array_random *x)
+{
+    if (x->x_cumul)
+        freebytes(x->x_cumul, x->x_ncumul * sizeof(double));
+    array_client_free(&x->x_r.x_tc);
+}
+
 /* ----  array max -- output largest value and its index ------------ */
 static t_class *array_max_class;
 
@@ -765,16 +928,15 @@ static void *array_max_new(t_symbol *s, int argc, t_atom *argv)
 
 static void array_max_bang(t_array_max *x)
 {
-    char *itemp, *firstitem;
-    int stride, nitem, arrayonset, i, besti;
+    char *firstitem;
+    int stride, nitem, arrayonset, besti;
     t_float bestf;
     if (!array_rangeop_getrange(&x->x_rangeop, &firstitem, &nitem, &stride,
         &arrayonset))
             return;
-    for (i = 0, besti = -1, bestf= -1e30, itemp = firstitem;
-        i < nitem; i++, itemp += stride)
-            if (*(t_float *)itemp > bestf)
-                bestf = *(t_float *)itemp, besti = i+arrayonset;
+    if ((besti = array_rangeop_extreme(firstitem, nitem, stride, 0, -1e30,
+        &bestf)) >= 0)
+            besti += arrayonset;
     outlet_float(x->x_out2, besti);
     outlet_float(x->x_out1, bestf);
 }
@@ -806,16 +968,15 @@ static void *array_min_new(t_symbol *s, int argc, t_atom *argv)
 
 static void array_min_bang(t_array_min *x)
 {
-    char *itemp, *firstitem;
-    int stride, nitem, i, arrayonset, besti;
+    char *firstitem;
+    int stride, nitem, arrayonset, besti;
     t_float bestf;
     if (!array_rangeop_getrange(&x->x_rangeop, &firstitem, &nitem, &stride,
         &arrayonset))
             return;
-    for (i = 0, besti = -1, bestf= 1e30, itemp = firstitem;
-        i < nitem; i++, itemp += stride)
-            if (*(t_float *)itemp < bestf)
-                bestf = *(t_float *)itemp, besti = i+arrayonset;
+    if ((besti = array_rangeop_extreme(firstitem, nitem, stride, 1, 1e30,
+        &bestf)) >= 0)
+            besti += arrayonset;
     outlet_float(x->x_out2, besti);
     outlet_float(x->x_out1, bestf);
 }
@@ -919,7 +1080,7 @@ void x_array_setup(void)
     class_sethelpsymbol(array_quantile_class, gensym("array-object"));
 
     array_random_class = class_new(gensym("array random"),
-        (t_newmethod)array_random_new, (t_method)array_client_free,
+        (t_newmethod)array_random_new, (t_method)array_random_free,
             sizeof(t_array_random), 0, A_GIMME, 0);
     class_addmethod(array_random_class, (t_method)array_random_seed,
         gensym("seed"), A_FLOAT, 0);
@@ -383,49 +383,171 @@ typedef struct _selectelement
     t_outlet *e_outlet;
 } t_selectelement;
 
+    /* "select" and "route" with many arguments look up incoming values in
+    an index made when they're created: a hash table, using the hash stored
+    in the symbol, for symbols, and a sorted table for numbers.  Either way
+    it holds element numbers, and only the first of several equal elements
+    is entered since that's the one a search in order would have found. */
+
+#define ELEMENTINDEXMIN 8   /* fewer elements than this are just searched */
+
+typedef struct _elementindex
+{
+    int i_size;         /* slots in hash table, or entries in sorted table */
+    int *i_vec;         /* element numbers, -1 for empty hash slots */
+} t_elementindex;
+
+typedef struct _elementsort
+{
+    t_float s_value;
+    int s_which;
+} t_elementsort;
+
+static int elementindex_sortcompare(const void *z1, const void *z2)
+{
+    const t_elementsort *s1 = (const t_elementsort *)z1,
+        *s2 = (const t_elementsort *)z2;
+    if (s1->s_value < s2->s_value)
+        return (-1);
+    else if (s1->s_value > s2->s_value)
+        return (1);
+    else return (s1->s_which - s2->s_which);
+}
+
+static void elementindex_init(t_elementindex *ix, t_atomtype type,
+    t_selectelement *vec, int n)
+{
+    int i;
+    ix->i_size = 0;
+    ix->i_vec = 0;
+    if (n < ELEMENTINDEXMIN)
+        return;
+    if (type == A_FLOAT)
+    {
+        t_elementsort *sort;
+        int nsort;
+            /* leave odd numbers (NaNs above all) to the plain search */
+        for (i = 0; i < n; i++)
+            if (PD_BADFLOAT(vec[i].e_w.w_float))
+                return;
+        sort = (t_elementsort *)getbytes(n * sizeof(*sort));
+        for (i = 0; i < n; i++)
+            sort[i].s_value = vec[i].e_w.w_float, sort[i].s_which = i;
+        qsort(sort, n, sizeof(*sort), elementindex_sortcompare);
+        ix->i_vec = (int *)getbytes(n * sizeof(*ix->i_vec));
+        for (i = nsort = 0; i < n; i++)
+            if (!nsort || sort[i].s_value != sort[i-1].s_value)
+                ix->i_vec[nsort++] = sort[i].s_which;
+        freebytes(sort, n * sizeof(*sort));
+        ix->i_vec = (int *)resizebytes(ix->i_vec,
+            n * sizeof(*ix->i_vec), nsort * sizeof(*ix->i_vec));
+        ix->i_size = nsort;
+    }
+    else
+    {
+        unsigned int size = 16, mask, j;
+        int k;
+        while (size < 2 * (unsigned int)n)
+            size *= 2;
+        mask = size - 1;
+        ix->i_vec = (int *)getbytes(size * sizeof(*ix->i_vec));
+        ix->i_size = size;
+        for (j = 0; j < size; j++)
+            ix->i_vec[j] = -1;
+        for (i = 0; i < n; i++)
+        {
+            t_symbol *s = vec[i].e_w.w_symbol;
+            for (j = s->s_hash & mask; (k = ix->i_vec[j]) >= 0;
+                j = (j + 1) & mask)
+                    if (vec[k].e_w.w_symbol == s)
+                        break;
+            if (k < 0)
+                ix->i_vec[j] = i;
+        }
+    }
+}
+
+static void elementindex_free(t_elementindex *ix)
+{
+    if (ix->i_vec)
+        freebytes(ix->i_vec, ix->i_size * sizeof(*ix->i_vec));
+}
+
+    /* find the first element matching a float or symbol, or return 0 */
+static t_selectelement *elementindex_findfloat(t_elementindex *ix,
+    t_selectelement *vec, int n, t_float f)
+{
+    if (ix->i_vec)
+    {
+        int lo = 0, hi = ix->i_size;
+        while (lo < hi)
+        {
+            int mid = (lo + hi) >> 1;
+            if (vec[ix->i_vec[mid]].e_w.w_float < f)
+                lo = mid + 1;
+            else hi = mid;
+        }
+        return (lo < ix->i_size && vec[ix->i_vec[lo]].e_w.w_float == f ?
+            vec + ix->i_vec[lo] : 0);
+    }
+    for (; n--; vec++)
+        if (vec->e_w.w_float == f)
+            return (vec);
+    return (0);
+}
+
+static t_selectelement *elementindex_findsymbol(t_elementindex *ix,
+    t_selectelement *vec, int n, t_symbol *s)
+{
+    if (ix->i_vec)
+    {
+        unsigned int mask = ix->i_size - 1, j = s->s_hash & mask;
+        int i;
+        while ((i = ix->i_vec[j]) >= 0)
+        {
+            if (vec[i].e_w.w_symbol == s)
+                return (vec + i);
+            j = (j + 1) & mask;
+        }
+        return (0);
+    }
+    for (; n--; vec++)
+        if (vec->e_w.w_symbol == s)
+            return (vec);
+    return (0);
+}
+
 typedef struct _sel2
 {
     t_object x_obj;
     t_atomtype x_type;
     t_int x_nelement;
     t_selectelement *x_vec;
+    t_elementindex x_index;
     t_outlet *x_rejectout;
 } t_sel2;
 
 static void sel2_float(t_sel2 *x, t_float f)
 {
     t_selectelement *e;
-    int nelement;
-    if (x->x_type == A_FLOAT)
-    {
-        for (nelement = (int)x->x_nelement, e = x->x_vec; nelement--; e++)
-            if (e->e_w.w_float == f)
-        {
+    if (x->x_type == A_FLOAT && (e = elementindex_findfloat(&x->x_index,
+        x->x_vec, (int)x->x_nelement, f)))
             outlet_bang(e->e_outlet);
-            return;
-        }
-    }
-    outlet_float(x->x_rejectout, f);
+    else outlet_float(x->x_rejectout, f);
 }
 
 static void sel2_symbol(t_sel2 *x, t_symbol *s)
 {
     t_selectelement *e;
-    int nelement;
-    if (x->x_type == A_SYMBOL)
-    {
-        for (nelement = (int)x->x_nelement, e = x->x_vec; nelement--; e++)
-            if (e->e_w.w_symbol == s)
-        {
+    if (x->x_type == A_SYMBOL && (e = elementindex_findsymbol(&x->x_index,
+        x->x_vec, (int)x->x_nelement, s)))
             outlet_bang(e->e_outlet);
-            return;
-        }
-    }
-    outlet_symbol(x->x_rejectout, s);
+    else outlet_symbol(x->x_rejectout, s);
 }
 
 static void sel2_free(t_sel2 *x)
 {
+    elementindex_free(&x->x_index);
     freebytes(x->x_vec, x->x_nelement * sizeof(*x->x_vec));
 }
 
@@ -470,6 +592,7 @@ static void *select_new(t_symbol *s, int argc, t_atom *argv)
                 e->e_w.w_float = atom_getfloatarg(n, argc, argv);
             else e->e_w.w_symbol = atom_getsymbolarg(n, argc, argv);
         }
+        elementindex_init(&x->x_index, x->x_type, x->x_vec, argc);
         x->x_rejectout = outlet_new(&x->x_obj, &s_float);
         return (x);
     }
@@ -496,11 +619,7 @@ void select_setup(void)
 
 static t_class *route_class;
 
-typedef struct _routeelement
-{
-    t_word e_w;
-    t_outlet *e_outlet;
-} t_routeelement;
+typedef t_selectelement t_routeelement;
 
 typedef struct _route
 {
@@ -508,41 +627,35 @@ typedef struct _route
     t_atomtype x_type;
     t_int x_nelement;
     t_routeelement *x_vec;
+    t_elementindex x_index;
     t_outlet *x_rejectout;
 } t_route;
 
 static void route_anything(t_route *x, t_symbol *sel, int argc, t_atom *argv)
 {
     t_routeelement *e;
-    int nelement;
-    if (x->x_type == A_SYMBOL)
+    if (x->x_type == A_SYMBOL && (e = elementindex_findsymbol(&x->x_index,
+        x->x_vec, (int)x->x_nelement, sel)))
     {
-        for (nelement = (int)x->x_nelement, e = x->x_vec; nelement--; e++)
-            if (e->e_w.w_symbol == sel)
-        {
-            if (argc > 0 && argv[0].a_type == A_SYMBOL)
-                outlet_anything(e->e_outlet, argv[0].a_w.w_symbol,
-                    argc-1, argv+1);
-            else outlet_list(e->e_outlet, 0, argc, argv);
-            return;
-        }
+        if (argc > 0 && argv[0].a_type == A_SYMBOL)
+            outlet_anything(e->e_outlet, argv[0].a_w.w_symbol,
+                argc-1, argv+1);
+        else outlet_list(e->e_outlet, 0, argc, argv);
     }
-    outlet_anything(x->x_rejectout, sel, argc, argv);
+    else outlet_anything(x->x_rejectout, sel, argc, argv);
 }
 
 static void route_list(t_route *x, t_symbol *sel, int argc, t_atom *argv)
 {
     t_routeelement *e;
-    int nelement;
+    int nelement = (int)x->x_nelement;
     if (x->x_type == A_FLOAT)
     {
-        t_float f;
         if (!argc) return;
         if (argv->a_type != A_FLOAT)
             goto rejected;
-        f = atom_getfloat(argv);
-        for (nelement = (int)x->x_nelement, e = x->x_vec; nelement--; e++)
-            if (e->e_w.w_float == f)
+        if ((e = elementindex_findfloat(&x->x_index, x->x_vec, nelement,
+            atom_getfloat(argv))))
         {
             if (argc > 1 && argv[1].a_type == A_SYMBOL)
                 outlet_anything(e->e_outlet, argv[1].a_w.w_symbol,
@@ -555,49 +668,41 @@ static void route_list(t_route *x, t_symbol *sel, int argc, t_atom *argv)
     {
         if (argc > 1)       /* 2 or more args: treat as "list" */
         {
-            for (nelement = (int)x->x_nelement, e = x->x_vec; nelement--; e++)
+            if ((e = elementindex_findsymbol(&x->x_index, x->x_vec, nelement,
+                &s_list)))
             {
-                if (e->e_w.w_symbol == &s_list)
-                {
-                    if (argc > 0 && argv[0].a_type == A_SYMBOL)
-                        outlet_anything(e->e_outlet, argv[0].a_w.w_symbol,
-                            argc-1, argv+1);
-                    else outlet_list(e->e_outlet, 0, argc, argv);
-                    return;
-                }
+                if (argv[0].a_type == A_SYMBOL)
+                    outlet_anything(e->e_outlet, argv[0].a_w.w_symbol,
+                        argc-1, argv+1);
+                else outlet_list(e->e_outlet, 0, argc, argv);
+                return;
             }
         }
         else if (argc == 0)         /* no args: treat as "bang" */
         {
-            for (nelement = (int)x->x_nelement, e = x->x_vec; nelement--; e++)
+            if ((e = elementindex_findsymbol(&x->x_index, x->x_vec, nelement,
+                &s_bang)))
             {
-                if (e->e_w.w_symbol == &s_bang)
-                {
-                    outlet_bang(e->e_outlet);
-                    return;
-                }
+                outlet_bang(e->e_outlet);
+                return;
             }
         }
         else if (argv[0].a_type == A_FLOAT)     /* one float arg */
         {
-            for (nelement = (int)x->x_nelement, e = x->x_vec; nelement--; e++)
+            if ((e = elementindex_findsymbol(&x->x_index, x->x_vec, nelement,
+                &s_float)))
             {
-                if (e->e_w.w_symbol == &s_float)
-                {
-                    outlet_float(e->e_outlet, argv[0].a_w.w_float);
-                    return;
-                }
+                outlet_float(e->e_outlet, argv[0].a_w.w_float);
+                return;
             }
         }
         else
         {
-            for (nelement = (int)x->x_nelement, e = x->x_vec; nelement--; e++)
+            if ((e = elementindex_findsymbol(&x->x_index, x->x_vec, nelement,
+                &s_symbol)))
             {
-                if (e->e_w.w_symbol == &s_symbol)
-                {
-                    outlet_symbol(e->e_outlet, argv[0].a_w.w_symbol);
-                    return;
-                }
+                outlet_symbol(e->e_outlet, argv[0].a_w.w_symbol);
+                return;
             }
         }
     }
@@ -608,6 +713,7 @@ static void route_list(t_route *x, t_symbol *sel, int argc, t_atom *argv)
 
 static void route_free(t_route *x)
 {
+    elementindex_free(&x->x_index);
     freebytes(x->x_vec, x->x_nelement * sizeof(*x->x_vec));
 }
 
@@ -633,6 +739,7 @@ static void *route_new(t_symbol *s, int argc, t_atom *argv)
             e->e_w.w_float = atom_getfloatarg(n, argc, argv);
         else e->e_w.w_symbol = atom_getsymbolarg(n, argc, argv);
     }
+    elementindex_init(&x->x_index, x->x_type, x->x_vec, argc);
     if (argc == 1)
     {
         if (argv->a_type == A_FLOAT)
@@ -1246,11 +1353,30 @@ typedef enum {
     POINTER,
 } t_printtype;
 
+    /* Results are cached, keyed by the incoming float or symbol, so that a
+    patch stepping through the same names over and over doesn't format and
+    look up each one every time.  The table is direct mapped rather than LRU
+    so that cycling through more names than it holds (say "sample-%d" from
+    0 to 127) still mostly hits. */
+#define MFCACHESIZE 128
+
+typedef struct _mfcache
+{
+    union
+    {
+        t_float c_float;
+        t_symbol *c_symbol;
+    } c_key;
+    t_symbol *c_result;     /* zero if empty; &s_ if no output */
+    int c_issymbol;
+} t_mfcache;
+
 typedef struct _makefilename
 {
     t_object x_obj;
     t_symbol *x_format;
     t_printtype x_accept;
+    t_mfcache *x_cache;     /* allocated on first use */
 } t_makefilename;
 
 static const char* _formatscan(const char*str, t_printtype*typ) {
@@ -1316,17 +1442,78 @@ static void *makefilename_new(t_symbol *s)
     outlet_new(&x->x_obj, &s_symbol);
     x->x_format = s;
     x->x_accept = NONE;
+    x->x_cache = 0;
     makefilename_scanformat(x);
     return (x);
 }
 
+    /* find the cache slot for a float or symbol key */
+static t_mfcache *makefilename_slot(t_makefilename *x, t_float f,
+    t_symbol *s)
+{
+    unsigned int hash;
+    if (!x->x_cache)
+    {
+        x->x_cache = (t_mfcache *)getbytes(MFCACHESIZE * sizeof(t_mfcache));
+        if (!x->x_cache)
+            return (0);
+    }
+    if (s)
+        hash = (unsigned int)((size_t)s >> 4);
+    else if (f == (int)f)
+        hash = (unsigned int)(int)f;
+    else
+    {
+        union { t_float f; unsigned int u[sizeof(t_float)/sizeof(int)]; } u;
+        unsigned int i;
+        u.f = f;
+        for (i = hash = 0; i < sizeof(t_float)/sizeof(int); i++)
+            hash = hash * 31 + u.u[i] * 2654435761u;
+        hash ^= hash >> 16;
+    }
+    return (x->x_cache + (hash & (MFCACHESIZE - 1)));
+}
+
+static int makefilename_hit(t_mfcache *c, t_float f, t_symbol *s)
+{
+    if (!c || !c->c_result)
+        return (0);
+    if (s)
+        return (c->c_issymbol && c->c_key.c_symbol == s);
+        /* compare bits, to tell -0 from 0; they may print differently */
+    return (!c->c_issymbol &&
+        !memcmp(&c->c_key.c_float, &f, sizeof(f)));
+}
+
+static void makefilename_output(t_makefilename *x, t_mfcache *c,
+    t_float f, t_symbol *s, const char *buf)
+{
+    t_symbol *result = gensym(buf);
+    if (c)
+    {
+        if ((c->c_issymbol = (s != 0)))
+            c->c_key.c_symbol = s;
+        else c->c_key.c_float = f;
+        c->c_result = result;
+    }
+    if (buf[0]!=0)
+        outlet_symbol(x->x_obj.ob_outlet, result);
+}
+
 static void makefilename_float(t_makefilename *x, t_floatarg f)
 {
     char buf[MAXPDSTRING];
+    t_mfcache *c;
     if(!x->x_format) {
         pd_error(x, "makefilename: no format specifier given");
         return;
     }
+    if (makefilename_hit((c = makefilename_slot(x, f, 0)), f, 0))
+    {
+        if (*c->c_result->s_name)
+            outlet_symbol(x->x_obj.ob_outlet, c->c_result);
+        return;
+    }
     switch(x->x_accept) {
     case NONE:
         sprintf(buf, "%s",  x->x_format->s_name);
@@ -1346,17 +1533,23 @@ static void makefilename_float(t_makefilename *x, t_floatarg f)
     default:
         sprintf(buf, "%s", x->x_format->s_name);
     }
-    if (buf[0]!=0)
-        outlet_symbol(x->x_obj.ob_outlet, gensym(buf));
+    makefilename_output(x, c, f, 0, buf);
 }
 
 static void makefilename_symbol(t_makefilename *x, t_symbol *s)
 {
     char buf[MAXPDSTRING];
+    t_mfcache *c;
     if(!x->x_format) {
         pd_error(x, "makefilename: no format specifier given");
         return;
     }
+    if (makefilename_hit((c = makefilename_slot(x, 0, s)), 0, s))
+    {
+        if (*c->c_result->s_name)
+            outlet_symbol(x->x_obj.ob_outlet, c->c_result);
+        return;
+    }
     switch(x->x_accept) {
     case STRING: case POINTER:
         sprintf(buf, x->x_format->s_name, s->s_name);
@@ -1373,8 +1566,7 @@ static void makefilename_symbol(t_makefilename *x, t_symbol *s)
     default:
         sprintf(buf, "%s", x->x_format->s_name);
     }
-    if (buf[0]!=0)
-        outlet_symbol(x->x_obj.ob_outlet, gensym(buf));
+    makefilename_output(x, c, 0, s, buf);
 }
 
 static void makefilename_bang(t_makefilename *x)
@@ -1405,12 +1597,20 @@ static void makefilename_set(t_makefilename *x, t_symbol *s)
 {
     x->x_format = s;
     makefilename_scanformat(x);
+    if (x->x_cache)
+        memset(x->x_cache, 0, MFCACHESIZE * sizeof(t_mfcache));
+}
+
+static void makefilename_free(t_makefilename *x)
+{
+    if (x->x_cache)
+        freebytes(x->x_cache, MFCACHESIZE * sizeof(t_mfcache));
 }
 
 static void makefilename_setup(void)
 {
     makefilename_class = class_new(gensym("makefilename"),
-    (t_newmethod)makefilename_new, 0,
+    (t_newmethod)makefilename_new, (t_method)makefilename_free,
         sizeof(t_makefilename), 0, A_DEFSYM, 0);
     class_addfloat(makefilename_class, makefilename_float);
     class_addsymbol(makefilename_class, makefilename_symbol);
@@ -1526,6 +1726,8 @@ typedef struct _value
     t_float *x_floatstar;
 } t_value;
 
+int value_changes;
+
     /* get a pointer to a named floating-point variable.  The variable
     belongs to a "vcommon" object, which is created if necessary. */
 t_float *value_get(t_symbol *s)
@@ -1553,11 +1755,20 @@ void value_release(t_symbol *s)
         {
             pd_unbind(&c->c_pd, s);
             pd_free(&c->c_pd);
+            value_changes++;
         }
     }
     else bug("value_release");
 }
 
+    /* find a variable without claiming it, or return 0 if there's none.
+    The pointer is good until value_changes changes. */
+t_float *value_find(t_symbol *s)
+{
+    t_vcommon *c = (t_vcommon *)pd_findbyclass(s, vcommon_class);
+    return (c ? &c->c_f : 0);
+}
+
 /*
  * value_getfloat -- obtain the float value of a "value" object
  *                  return 0 on success, 1 otherwise
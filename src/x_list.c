@@ -43,30 +43,45 @@ Probably don't need:
 */
 
 /* -------------- utility functions: storage, copying  -------------- */
-    /* List element for storage.  Keep an atom and, in case it's a pointer,
-        an associated 'gpointer' to protect against stale pointers. */
-typedef struct _listelem
-{
-    t_atom l_a;
-    t_gpointer l_p;
-} t_listelem;
+    /* Storage for a list.  It's reference counted so that list objects can
+        output what they hold without copying it: the holder keeps one
+        reference and each message being output from it another one.  The
+        holder makes itself a fresh copy before changing items that are
+        still being output, which only happens if one of those messages
+        finds its way back to it.  Pointers get an associated 'gpointer' to
+        protect against stale pointers; the atom points to it.
+        The items sit in the middle of the allocation with free room on
+        both sides, which grows geometrically, so that adding or removing
+        items at either end takes constant time on average and a list
+        store can serve as a queue or a stack. */
+typedef struct _listbuf
+{
+    int b_refcount;     /* number of references */
+    int b_onset;        /* number of free slots before the items */
+    int b_n;            /* number of items */
+    int b_size;         /* number of slots allocated */
+    t_atom *b_vec;      /* the slots; the items start at b_onset */
+    t_gpointer *b_gp;   /* gpointers for the slots, or 0 if none yet */
+} t_listbuf;
 
 typedef struct _alist
 {
     t_pd l_pd;          /* object to point inlets to */
     int l_n;            /* number of items */
     int l_npointer;     /* number of pointers */
-    t_listelem *l_vec;  /* pointer to items */
+    t_listbuf *l_buf;   /* the items, or 0 if none were ever stored */
 } t_alist;
 
+#define LISTBUF_ITEMS(b) ((b)->b_vec + (b)->b_onset)
+
 #if HAVE_ALLOCA
 #define ATOMS_ALLOCA(x, n) ((x) = (t_atom *)((n) < LIST_NGETBYTE ?  \
-        alloca((n) * sizeof(t_atom)) : getbytes((n) * sizeof(t_atom))))
+        alloca((n) * sizeof(t_atom)) : rt_getbytes((n) * sizeof(t_atom))))
 #define ATOMS_FREEA(x, n) ( \
-    ((n) < LIST_NGETBYTE || (freebytes((x), (n) * sizeof(t_atom)), 0)))
+    ((n) < LIST_NGETBYTE || (rt_freebytes((x), (n) * sizeof(t_atom)), 0)))
 #else
-#define ATOMS_ALLOCA(x, n) ((x) = (t_atom *)getbytes((n) * sizeof(t_atom)))
-#define ATOMS_FREEA(x, n) (freebytes((x), (n) * sizeof(t_atom)))
+#define ATOMS_ALLOCA(x, n) ((x) = (t_atom *)rt_getbytes((n) * sizeof(t_atom)))
+#define ATOMS_FREEA(x, n) (rt_freebytes((x), (n) * sizeof(t_atom)))
 #endif
 
 static void atoms_copy(int argc, t_atom *from, t_atom *to)
@@ -76,6 +91,103 @@ static void atoms_copy(int argc, t_atom *from, t_atom *to)
         to[i] = from[i];
 }
 
+static t_listbuf *listbuf_new(int size, int withpointers)
+{
+    t_listbuf *b;
+    if (size < 1)
+        size = 1;
+    if (!(b = (t_listbuf *)rt_getbytes(sizeof(*b))))
+        return (0);
+    b->b_gp = 0;
+    if (!(b->b_vec = (t_atom *)rt_getbytes(size * sizeof(*b->b_vec))) ||
+        (withpointers && !(b->b_gp =
+            (t_gpointer *)rt_getbytes(size * sizeof(*b->b_gp)))))
+    {
+        rt_freebytes(b->b_vec, size * sizeof(*b->b_vec));
+        rt_freebytes(b, sizeof(*b));
+        return (0);
+    }
+    b->b_refcount = 1;
+    b->b_onset = b->b_n = 0;
+    b->b_size = size;
+    return (b);
+}
+
+    /* release the pointers in items onset to onset+n-1 */
+static void listbuf_unset(t_listbuf *b, int onset, int n, int *npointer)
+{
+    int i;
+    for (i = b->b_onset + onset; n--; i++)
+        if (b->b_vec[i].a_type == A_POINTER)
+        {
+            gpointer_unset(&b->b_gp[i]);
+            (*npointer)--;
+        }
+}
+
+static void listbuf_release(t_listbuf *b)
+{
+    int npointer = 0;
+    if (--b->b_refcount)
+        return;
+    if (b->b_gp)
+    {
+        listbuf_unset(b, 0, b->b_n, &npointer);
+        rt_freebytes(b->b_gp, b->b_size * sizeof(*b->b_gp));
+    }
+    rt_freebytes(b->b_vec, b->b_size * sizeof(*b->b_vec));
+    rt_freebytes(b, sizeof(*b));
+}
+
+    /* point the pointer atoms in items onset to onset+n-1 back at their
+    gpointers after these moved */
+static void listbuf_fixpointers(t_listbuf *b, int onset, int n)
+{
+    int i;
+    for (i = b->b_onset + onset; n--; i++)
+        if (b->b_vec[i].a_type == A_POINTER)
+            b->b_vec[i].a_w.w_gpointer = &b->b_gp[i];
+}
+
+    /* move items onset to onset+n-1 by 'shift' slots */
+static void listbuf_move(t_listbuf *b, int onset, int n, int shift)
+{
+    int from = b->b_onset + onset;
+    memmove(b->b_vec + from + shift, b->b_vec + from, n * sizeof(*b->b_vec));
+    if (b->b_gp)
+    {
+        memmove(b->b_gp + from + shift, b->b_gp + from, n * sizeof(*b->b_gp));
+        b->b_onset += shift;
+        listbuf_fixpointers(b, onset, n);
+        b->b_onset -= shift;
+    }
+}
+
+    /* store items at 'where', copying pointers into the buffer's own
+    gpointers; the items must already be allocated */
+static void listbuf_copyin(t_listbuf *b, int argc, t_atom *argv, int where,
+    int *npointer)
+{
+    int i, j;
+    for (i = 0, j = b->b_onset + where; i < argc; i++, j++)
+    {
+        b->b_vec[j] = argv[i];
+        if (b->b_vec[j].a_type == A_POINTER)
+        {
+            if (!b->b_gp && !(b->b_gp = (t_gpointer *)rt_getbytes(
+                b->b_size * sizeof(*b->b_gp))))
+            {
+                error("list: out of memory");
+                SETFLOAT(&b->b_vec[j], 0);
+                continue;
+            }
+            (*npointer)++;
+            gpointer_copy(argv[i].a_w.w_gpointer, &b->b_gp[j]);
+            b->b_vec[j].a_w.w_gpointer = &b->b_gp[j];
+        }
+    }
+}
+
 /* ------------- fake class to divert inlets to ----------------- */
 
 t_class *alist_class;
@@ -84,107 +196,197 @@ static void alist_init(t_alist *x)
 {
     x->l_pd = alist_class;
     x->l_n = x->l_npointer = 0;
-    x->l_vec = 0;
+    x->l_buf = 0;
 }
 
 static void alist_clear(t_alist *x)
 {
-    int i;
-    for (i = 0; i < x->l_n; i++)
-    {
-        if (x->l_vec[i].l_a.a_type == A_POINTER)
-            gpointer_unset(x->l_vec[i].l_a.a_w.w_gpointer);
-    }
-    if (x->l_vec)
-        freebytes(x->l_vec, x->l_n * sizeof(*x->l_vec));
+    if (x->l_buf)
+        listbuf_release(x->l_buf);
+    x->l_buf = 0;
+    x->l_n = x->l_npointer = 0;
 }
 
-static void alist_copyin(t_alist *x, t_symbol *s, int argc, t_atom *argv,
-    int where)
+    /* free room for a side of a list of n items that needs 'need' slots
+    and has 'have': if it ran out, as many again as there are items, so
+    that the list grows geometrically; otherwise what it has, but not
+    more than that, so that deleted items' room is given back */
+static int alist_room(int n, int need, int have)
 {
-    int i, j;
-    for (i = 0, j = where; i < argc; i++, j++)
+    if (need > have)
+        return (need + n + 8);
+    if (have > n + 8)
+        have = n + 8;
+    return (have > need ? have : need);
+}
+
+    /* make room for 'front' more items before the ones we have and 'back'
+    more after them; afterward the buffer is ours alone so that it can be
+    changed.  On failure the list is emptied. */
+static int alist_reserve(t_alist *x, int front, int back)
+{
+    t_listbuf *b = x->l_buf, *nb;
+    int n = x->l_n, size, onset;
+    if (b && b->b_refcount == 1 && b->b_onset >= front &&
+        b->b_size - b->b_onset - n >= back)
+            return (1);
+    if (b)
     {
-        x->l_vec[j].l_a = argv[i];
-        if (x->l_vec[j].l_a.a_type == A_POINTER)
+        front = alist_room(n, front, b->b_onset);
+        back = alist_room(n, back, b->b_size - b->b_onset - n);
+    }
+    size = front + n + back;
+    onset = front;
+    if (!(nb = listbuf_new(size, x->l_npointer > 0)))
+    {
+        error("list: out of memory");
+        alist_clear(x);
+        return (0);
+    }
+    nb->b_onset = onset;
+    nb->b_n = n;
+    if (b && b->b_refcount == 1)
+    {
+            /* ours: just move the items and their gpointers */
+        memcpy(LISTBUF_ITEMS(nb), LISTBUF_ITEMS(b), n * sizeof(*nb->b_vec));
+        if (x->l_npointer)
         {
-            x->l_npointer++;
-            gpointer_copy(x->l_vec[j].l_a.a_w.w_gpointer, &x->l_vec[j].l_p);
-            x->l_vec[j].l_a.a_w.w_gpointer = &x->l_vec[j].l_p;
+            memcpy(nb->b_gp + onset, b->b_gp + b->b_onset,
+                n * sizeof(*nb->b_gp));
+            listbuf_fixpointers(nb, 0, n);
         }
+        b->b_n = 0;
+    }
+    else if (b)
+    {
+            /* still being output: copy on write */
+        x->l_npointer = 0;
+        listbuf_copyin(nb, n, LISTBUF_ITEMS(b), 0, &x->l_npointer);
     }
+    if (b)
+        listbuf_release(b);
+    x->l_buf = nb;
+    return (1);
 }
 
-    /* set contents to a list */
-static void alist_list(t_alist *x, t_symbol *s, int argc, t_atom *argv)
+    /* empty the list before storing a new one, keeping the allocation if
+    no one else holds it */
+static void alist_empty(t_alist *x)
 {
-    alist_clear(x);
-    if (!(x->l_vec = (t_listelem *)getbytes(argc * sizeof(*x->l_vec))))
+    t_listbuf *b = x->l_buf;
+    if (!b)
+        return;
+    if (b->b_refcount > 1)
     {
-        x->l_n = 0;
-        error("list: out of memory");
+        alist_clear(x);
         return;
     }
-    x->l_n = argc;
-    x->l_npointer = 0;
+    if (x->l_npointer)
+        listbuf_unset(b, 0, b->b_n, &x->l_npointer);
+    b->b_onset = b->b_n = x->l_n = 0;
+}
+
+static void alist_copyin(t_alist *x, t_symbol *s, int argc, t_atom *argv,
+    int where)
+{
+    listbuf_copyin(x->l_buf, argc, argv, where, &x->l_npointer);
+}
+
+    /* set contents to a list */
+static void alist_list(t_alist *x, t_symbol *s, int argc, t_atom *argv)
+{
+    alist_empty(x);
+    if (!alist_reserve(x, 0, argc))
+        return;
     alist_copyin(x, s, argc, argv, 0);
+    x->l_buf->b_n = x->l_n = argc;
 }
 
     /* set contents to an arbitrary non-list message */
 static void alist_anything(t_alist *x, t_symbol *s, int argc, t_atom *argv)
 {
-    int i;
-    alist_clear(x);
-    if (!(x->l_vec = (t_listelem *)getbytes((argc+1) * sizeof(*x->l_vec))))
-    {
-        x->l_n = 0;
-        error("list_alloc: out of memory");
+    alist_empty(x);
+    if (!alist_reserve(x, 0, argc+1))
         return;
-    }
-    x->l_n = argc+1;
-    x->l_npointer = 0;
-    SETSYMBOL(&x->l_vec[0].l_a, s);
-    for (i = 0; i < argc; i++)
+    SETSYMBOL(LISTBUF_ITEMS(x->l_buf), s);
+    alist_copyin(x, s, argc, argv, 1);
+    x->l_buf->b_n = x->l_n = argc+1;
+}
+
+    /* insert items before item 'where', moving whichever side of it is
+    shorter */
+static void alist_insert(t_alist *x, int where, int argc, t_atom *argv)
+{
+    t_listbuf *b;
+    int atfront = (where < x->l_n - where);
+    if (!argc || !alist_reserve(x, (atfront ? argc : 0), (atfront ? 0 : argc)))
+        return;
+    b = x->l_buf;
+    if (atfront)
     {
-        x->l_vec[i+1].l_a = argv[i];
-        if (x->l_vec[i+1].l_a.a_type == A_POINTER)
-        {
-            x->l_npointer++;
-            gpointer_copy(x->l_vec[i+1].l_a.a_w.w_gpointer, &x->l_vec[i+1].l_p);
-            x->l_vec[i+1].l_a.a_w.w_gpointer = &x->l_vec[i+1].l_p;
-        }
+        listbuf_move(b, 0, where, -argc);
+        b->b_onset -= argc;
     }
+    else listbuf_move(b, where, x->l_n - where, argc);
+    alist_copyin(x, 0, argc, argv, where);
+    b->b_n = x->l_n += argc;
 }
 
-static void alist_toatoms(t_alist *x, t_atom *to, int onset, int count)
+    /* delete n items from 'where' on, moving whichever side is shorter */
+static void alist_delete(t_alist *x, int where, int n)
 {
-    int i;
-    for (i = 0; i < count; i++)
-        to[i] = x->l_vec[onset + i].l_a;
+    t_listbuf *b;
+    if (!n || !alist_reserve(x, 0, 0))
+        return;
+    b = x->l_buf;
+    if (x->l_npointer)
+        listbuf_unset(b, where, n, &x->l_npointer);
+    if (where < x->l_n - where - n)
+    {
+        listbuf_move(b, 0, where, n);
+        b->b_onset += n;
+    }
+    else listbuf_move(b, where + n, x->l_n - where - n, -n);
+    b->b_n = x->l_n -= n;
 }
 
-
-static void alist_clone(t_alist *x, t_alist *y, int onset, int count)
+    /* output 'count' stored items from 'onset' on, with the message 's'
+    (if not the empty list) before or after them.  The items are passed
+    on as they are stored: our reference keeps them around even if the
+    list is changed while the message is out. */
+static void alist_output(t_alist *x, t_outlet *outlet, int onset, int count,
+    t_symbol *s, int argc, t_atom *argv, int storedfirst)
 {
-    int i;
-    y->l_pd = alist_class;
-    y->l_n = count;
-    y->l_npointer = 0;
-    if (!(y->l_vec = (t_listelem *)getbytes(y->l_n * sizeof(*y->l_vec))))
+    t_listbuf *b = x->l_buf;
+    t_atom *outv, *inv;
+    int inc = argc + (s != &s_list), outc = count + inc;
+    if (!count && s == &s_list)
     {
-        y->l_n = 0;
-        error("list_alloc: out of memory");
+        outlet_list(outlet, &s_list, argc, argv);
+        return;
     }
-    else for (i = 0; i < count; i++)
+    if (b)
+        b->b_refcount++;
+    if (!inc)
+        outlet_list(outlet, &s_list, count, LISTBUF_ITEMS(b) + onset);
+    else
     {
-        y->l_vec[i].l_a = x->l_vec[onset + i].l_a;
-        if (y->l_vec[i].l_a.a_type == A_POINTER)
+        ATOMS_ALLOCA(outv, outc);
+        inv = outv + (storedfirst ? count : 0);
+        if (s != &s_list)
         {
-            gpointer_copy(y->l_vec[i].l_a.a_w.w_gpointer, &y->l_vec[i].l_p);
-            y->l_vec[i].l_a.a_w.w_gpointer = &y->l_vec[i].l_p;
-            y->l_npointer++;
+            SETSYMBOL(inv, s);
+            inv++;
         }
+        atoms_copy(argc, argv, inv);
+        if (count)
+            atoms_copy(count, LISTBUF_ITEMS(b) + onset,
+                outv + (storedfirst ? 0 : inc));
+        outlet_list(outlet, &s_list, outc, outv);
+        ATOMS_FREEA(outv, outc);
     }
+    if (b)
+        listbuf_release(b);
 }
 
 static void alist_setup(void)
@@ -218,80 +420,15 @@ static void *list_append_new(t_symbol *s, int argc, t_atom *argv)
 static void list_append_list(t_list_append *x, t_symbol *s,
     int argc, t_atom *argv)
 {
-    t_atom *outv;
-    int n, outc = x->x_alist.l_n + argc;
-    ATOMS_ALLOCA(outv, outc);
-    atoms_copy(argc, argv, outv);
-    if (x->x_alist.l_npointer)
-    {
-        t_alist y;
-        alist_clone(&x->x_alist, &y, 0, x->x_alist.l_n);
-        alist_toatoms(&y, outv+argc, 0, x->x_alist.l_n);
-        outlet_list(x->x_obj.ob_outlet, &s_list, outc, outv);
-        alist_clear(&y);
-    }
-    else
-    {
-        alist_toatoms(&x->x_alist, outv+argc, 0, x->x_alist.l_n);
-        outlet_list(x->x_obj.ob_outlet, &s_list, outc, outv);
-    }
-    ATOMS_FREEA(outv, outc);
+    alist_output(&x->x_alist, x->x_obj.ob_outlet, 0, x->x_alist.l_n,
+        &s_list, argc, argv, 0);
 }
 
 static void list_append_anything(t_list_append *x, t_symbol *s,
     int argc, t_atom *argv)
 {
-    t_atom *outv;
-    int n, outc = x->x_alist.l_n + argc + 1;
-    ATOMS_ALLOCA(outv, outc);
-    SETSYMBOL(outv, s);
-    atoms_copy(argc, argv, outv + 1);
-    if (x->x_alist.l_npointer)
-    {
-        t_alist y;
-        alist_clone(&x->x_alist, &y, 0, x->x_alist.l_n);
-        alist_toatoms(&y, outv + 1 + argc, 0, x->x_alist.l_n);
-        outlet_list(x->x_obj.ob_outlet, &s_list, outc, outv);
-        alist_clear(&y);
-    }
-    else
-    {
-        alist_toatoms(&x->x_alist, outv + 1 + argc, 0, x->x_alist.l_n);
-        outlet_list(x->x_obj.ob_outlet, &s_list, outc, outv);
-    }
-    ATOMS_FREEA(outv, outc);
-}
-
-static void list_append_append(t_list_append *x, t_symbol *s,
-    int argc, t_atom *argv)
-{
-    if (!(x->x_alist.l_vec = (t_listelem *)resizebytes(x->x_alist.l_vec,
-        (x->x_alist.l_n) * sizeof(*x->x_alist.l_vec),
-        (x->x_alist.l_n + argc) * sizeof(*x->x_alist.l_vec))))
-    {
-        x->x_alist.l_n = 0;
-        error("list: out of memory");
-        return;
-    }
-    alist_copyin(&x->x_alist, s, argc, argv, x->x_alist.l_n);
-    x->x_alist.l_n += argc;
-}
-
-static void list_append_prepend(t_list_append *x, t_symbol *s,
-    int argc, t_atom *argv)
-{
-    if (!(x->x_alist.l_vec = (t_listelem *)resizebytes(x->x_alist.l_vec,
-        (x->x_alist.l_n) * sizeof(*x->x_alist.l_vec),
-        (x->x_alist.l_n + argc) * sizeof(*x->x_alist.l_vec))))
-    {
-        x->x_alist.l_n = 0;
-        error("list: out of memory");
-        return;
-    }
-    memmove(x->x_alist.l_vec + argc, x->x_alist.l_vec,
-        x->x_alist.l_n * sizeof(*x->x_alist.l_vec));
-    alist_copyin(&x->x_alist, s, argc, argv, 0);
-    x->x_alist.l_n += argc;
+    alist_output(&x->x_alist, x->x_obj.ob_outlet, 0, x->x_alist.l_n,
+        s, argc, argv, 0);
 }
 
 static void list_append_free(t_list_append *x)
@@ -328,48 +465,15 @@ static void *list_prepend_new(t_symbol *s, int argc, t_atom *argv)
 static void list_prepend_list(t_list_prepend *x, t_symbol *s,
     int argc, t_atom *argv)
 {
-    t_atom *outv;
-    int n, outc = x->x_alist.l_n + argc;
-    ATOMS_ALLOCA(outv, outc);
-    atoms_copy(argc, argv, outv + x->x_alist.l_n);
-    if (x->x_alist.l_npointer)
-    {
-        t_alist y;
-        alist_clone(&x->x_alist, &y, 0, x->x_alist.l_n);
-        alist_toatoms(&y, outv, 0, x->x_alist.l_n);
-        outlet_list(x->x_obj.ob_outlet, &s_list, outc, outv);
-        alist_clear(&y);
-    }
-    else
-    {
-        alist_toatoms(&x->x_alist, outv, 0, x->x_alist.l_n);
-        outlet_list(x->x_obj.ob_outlet, &s_list, outc, outv);
-    }
-    ATOMS_FREEA(outv, outc);
+    alist_output(&x->x_alist, x->x_obj.ob_outlet, 0, x->x_alist.l_n,
+        &s_list, argc, argv, 1);
 }
 
 static void list_prepend_anything(t_list_prepend *x, t_symbol *s,
     int argc, t_atom *argv)
 {
-    t_atom *outv;
-    int n, outc = x->x_alist.l_n + argc + 1;
-    ATOMS_ALLOCA(outv, outc);
-    SETSYMBOL(outv + x->x_alist.l_n, s);
-    atoms_copy(argc, argv, outv + x->x_alist.l_n + 1);
-    if (x->x_alist.l_npointer)
-    {
-        t_alist y;
-        alist_clone(&x->x_alist, &y, 0, x->x_alist.l_n);
-        alist_toatoms(&y, outv, 0, x->x_alist.l_n);
-        outlet_list(x->x_obj.ob_outlet, &s_list, outc, outv);
-        alist_clear(&y);
-    }
-    else
-    {
-        alist_toatoms(&x->x_alist, outv, 0, x->x_alist.l_n);
-        outlet_list(x->x_obj.ob_outlet, &s_list, outc, outv);
-    }
-    ATOMS_FREEA(outv, outc);
+    alist_output(&x->x_alist, x->x_obj.ob_outlet, 0, x->x_alist.l_n,
+        s, argc, argv, 1);
 }
 
 static void list_prepend_free(t_list_prepend *x)
@@ -413,86 +517,58 @@ static void *list_store_new(t_symbol *s, int argc, t_atom *argv)
 static void list_store_list(t_list_store *x, t_symbol *s,
     int argc, t_atom *argv)
 {
-    t_atom *outv;
-    int n, outc = x->x_alist.l_n + argc;
-    ATOMS_ALLOCA(outv, outc);
-    atoms_copy(argc, argv, outv);
-    if (x->x_alist.l_npointer)
-    {
-        t_alist y;
-        alist_clone(&x->x_alist, &y, 0, x->x_alist.l_n);
-        alist_toatoms(&y, outv+argc, 0, x->x_alist.l_n);
-        outlet_list(x->x_out1, &s_list, outc, outv);
-        alist_clear(&y);
-    }
-    else
-    {
-        alist_toatoms(&x->x_alist, outv+argc, 0, x->x_alist.l_n);
-        outlet_list(x->x_out1, &s_list, outc, outv);
-    }
-    ATOMS_FREEA(outv, outc);
+    alist_output(&x->x_alist, x->x_out1, 0, x->x_alist.l_n,
+        &s_list, argc, argv, 0);
 }
 
-/* function to restore gpointers after the list has moved in memory */
-static void list_store_restore_gpointers(t_list_store *x, int offset, int count)
+static void list_store_append(t_list_store *x, t_symbol *s,
+    int argc, t_atom *argv)
 {
-    t_listelem *vec = x->x_alist.l_vec + offset;
-    while (count--)
-    {
-        if (vec->l_a.a_type == A_POINTER)
-            vec->l_a.a_w.w_gpointer = &vec->l_p;
-        vec++;
-    }
+    alist_insert(&x->x_alist, x->x_alist.l_n, argc, argv);
 }
 
-static void list_store_append(t_list_store *x, t_symbol *s,
+static void list_store_prepend(t_list_store *x, t_symbol *s,
     int argc, t_atom *argv)
 {
-    t_listelem *oldptr = x->x_alist.l_vec;
+    alist_insert(&x->x_alist, 0, argc, argv);
+}
 
-    if (!(x->x_alist.l_vec = (t_listelem *)resizebytes(x->x_alist.l_vec,
-        (x->x_alist.l_n) * sizeof(*x->x_alist.l_vec),
-        (x->x_alist.l_n + argc) * sizeof(*x->x_alist.l_vec))))
-    {
-        x->x_alist.l_n = 0;
-        error("list: out of memory");
+    /* insert items before the one at the index given first */
+static void list_store_insert(t_list_store *x, t_symbol *s,
+    int argc, t_atom *argv)
+{
+    int index;
+    if (argc < 1)
         return;
-    }
-
-        /* fix gpointers if resizebytes() has moved the alist in memory */
-    if (x->x_alist.l_vec != oldptr && x->x_alist.l_npointer)
-        list_store_restore_gpointers(x, 0, x->x_alist.l_n);
-
-    alist_copyin(&x->x_alist, s, argc, argv, x->x_alist.l_n);
-    x->x_alist.l_n += argc;
+    index = atom_getfloat(argv);
+    if (index < 0)
+        index = 0;
+    else if (index > x->x_alist.l_n)
+        index = x->x_alist.l_n;
+    alist_insert(&x->x_alist, index, argc-1, argv+1);
 }
 
-static void list_store_prepend(t_list_store *x, t_symbol *s,
-    int argc, t_atom *argv)
+    /* delete 'count' items (1 if not given, all the rest if negative)
+    from index f1 on */
+static void list_store_delete(t_list_store *x, t_floatarg f1, t_floatarg f2)
 {
-    if (!(x->x_alist.l_vec = (t_listelem *)resizebytes(x->x_alist.l_vec,
-    (x->x_alist.l_n) * sizeof(*x->x_alist.l_vec),
-    (x->x_alist.l_n + argc) * sizeof(*x->x_alist.l_vec))))
+    int index = f1, n = f2, max = x->x_alist.l_n - index;
+    if (index < 0 || max <= 0)
     {
-        x->x_alist.l_n = 0;
-        error("list: out of memory");
+        pd_error(x, "list_store_delete: index %d out of range", index);
         return;
     }
-
-    memmove(x->x_alist.l_vec + argc, x->x_alist.l_vec,
-        x->x_alist.l_n * sizeof(*x->x_alist.l_vec));
-
-        /* we always have to fix gpointers because of memmove() */
-    if (x->x_alist.l_npointer)
-        list_store_restore_gpointers(x, argc, x->x_alist.l_n);
-
-    alist_copyin(&x->x_alist, s, argc, argv, 0);
-    x->x_alist.l_n += argc;
+    if (n < 0 || n > max)
+        n = max;
+    else if (n == 0)
+        n = 1;
+    alist_delete(&x->x_alist, index, n);
 }
 
+    /* the items are output without being copied, so getting a long list
+    out of a list store costs no more than getting a short one */
 static void list_store_get(t_list_store *x, float f1, float f2)
 {
-    t_atom *outv;
     int onset = f1, outc = f2;
     if (onset < 0 || outc < 0)
     {
@@ -504,21 +580,7 @@ static void list_store_get(t_list_store *x, float f1, float f2)
         outlet_bang(x->x_out2);
         return;
     }
-    ATOMS_ALLOCA(outv, outc);
-    if (x->x_alist.l_npointer)
-    {
-        t_alist y;
-        alist_clone(&x->x_alist, &y, onset, outc);
-        alist_toatoms(&y, outv, 0, outc);
-        outlet_list(x->x_out1, &s_list, outc, outv);
-        alist_clear(&y);
-    }
-    else
-    {
-        alist_toatoms(&x->x_alist, outv, onset, outc);
-        outlet_list(x->x_out1, &s_list, outc, outv);
-    }
-    ATOMS_FREEA(outv, outc);
+    alist_output(&x->x_alist, x->x_out1, onset, outc, &s_list, 0, 0, 0);
 }
 
 static void list_store_free(t_list_store *x)
@@ -536,6 +598,10 @@ static void list_store_setup(void)
         gensym("append"), A_GIMME, 0);
     class_addmethod(list_store_class, (t_method)list_store_prepend,
         gensym("prepend"), A_GIMME, 0);
+    class_addmethod(list_store_class, (t_method)list_store_insert,
+        gensym("insert"), A_GIMME, 0);
+    class_addmethod(list_store_class, (t_method)list_store_delete,
+        gensym("delete"), A_FLOAT, A_DEFFLOAT, 0);
     class_addmethod(list_store_class, (t_method)list_store_get,
         gensym("get"), A_FLOAT, A_FLOAT, 0);
     class_sethelpsymbol(list_store_class, &s_list);
@@ -718,34 +784,71 @@ static void list_fromsymbol_setup(void)
 
 t_class *list_tosymbol_class;
 
+    /* recent results, hashed by the character codes; a hit is checked
+    against the symbol's own name so nothing else need be stored. */
+#define TOSYMCACHESIZE 16
+
 typedef struct _list_tosymbol
 {
     t_object x_obj;
+    t_symbol *x_cache[TOSYMCACHESIZE];
 } t_list_tosymbol;
 
 static void *list_tosymbol_new(void)
 {
     t_list_tosymbol *x = (t_list_tosymbol *)pd_new(list_tosymbol_class);
+    int i;
+    for (i = 0; i < TOSYMCACHESIZE; i++)
+        x->x_cache[i] = 0;
     outlet_new(&x->x_obj, &s_symbol);
     return (x);
 }
 
+    /* find the cache slot for a list, and return the symbol there if it
+    matches */
+static t_symbol *list_tosymbol_lookup(t_list_tosymbol *x, int argc,
+    t_atom *argv, t_symbol ***slotp)
+{
+    int i;
+    unsigned int hash = (unsigned int)argc;
+    const char *name;
+    for (i = 0; i < argc; i++)
+        hash = hash * 31 +
+            (unsigned char)(char)atom_getfloatarg(i, argc, argv);
+    *slotp = &x->x_cache[(hash ^ (hash >> 8)) & (TOSYMCACHESIZE - 1)];
+    if (!**slotp)
+        return (0);
+    name = (**slotp)->s_name;
+    for (i = 0; i < argc; i++)
+        if (!name[i] || name[i] != (char)atom_getfloatarg(i, argc, argv))
+            return (0);
+    return (name[argc] ? 0 : **slotp);
+}
+
 static void list_tosymbol_list(t_list_tosymbol *x, t_symbol *s,
     int argc, t_atom *argv)
 {
     int i;
+    t_symbol **slot, *sym;
+    char *str;
+    if ((sym = list_tosymbol_lookup(x, argc, argv, &slot)))
+    {
+        outlet_symbol(x->x_obj.ob_outlet, sym);
+        return;
+    }
 #if HAVE_ALLOCA
-    char *str = alloca(argc + 1);
+    str = alloca(argc + 1);
 #else
-    char *str = getbytes(argc + 1);
+    str = rt_getbytes(argc + 1);
 #endif
     for (i = 0; i < argc; i++)
         str[i] = (char)atom_getfloatarg(i, argc, argv);
     str[argc] = 0;
-    outlet_symbol(x->x_obj.ob_outlet, gensym(str));
+    *slot = sym = gensym(str);
+    outlet_symbol(x->x_obj.ob_outlet, sym);
 #if HAVE_ALLOCA
 #else
-    freebytes(str, argc+1);
+    rt_freebytes(str, argc+1);
 #endif
 }
 
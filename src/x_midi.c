@@ -5,6 +5,8 @@
 /* MIDI. */
 
 #include "m_pd.h"
+#include "s_stuff.h"
+#include <string.h>
 void outmidi_noteon(int portno, int channel, int pitch, int velo);
 void outmidi_controlchange(int portno, int channel, int ctlno, int value);
 void outmidi_programchange(int portno, int channel, int value);
@@ -12,11 +14,23 @@ void outmidi_pitchbend(int portno, int channel, int value);
 void outmidi_aftertouch(int portno, int channel, int value);
 void outmidi_polyaftertouch(int portno, int channel, int pitch, int value);
 void outmidi_byte(int portno, int value);
+void outmidi_sysex(int portno, int n, const unsigned char *buf);
+
+    /* a sysex message being collected for "sysexin -list"; slot 0 holds
+    the port number */
+typedef struct _sysexbuf
+{
+    t_atom *b_vec;
+    int b_n;
+    int b_size;
+} t_sysexbuf;
 
 struct _instancemidi
 {
     t_symbol *m_midiin_sym;
     t_symbol *m_sysexin_sym;
+    t_symbol *m_sysexbulkin_sym;
+    t_sysexbuf m_sysexbuf[MAXMIDIINDEV];
     t_symbol *m_notein_sym;
     t_symbol *m_ctlin_sym;
     t_symbol *m_pgmin_sym;
@@ -57,18 +71,90 @@ static void midiin_free(t_midiin *x)
     pd_unbind(&x->x_obj.ob_pd, pd_this->pd_midi->m_midiin_sym);
 }
 
-static void *sysexin_new(void)
+    /* "sysexin -list" puts out each complete message as one list, and
+    "sysexin -array <name>" copies it into an array and puts out its
+    length, instead of sending a float per byte */
+typedef struct _sysexin
 {
-    t_midiin *x = (t_midiin *)pd_new(sysexin_class);
-    x->x_outlet1 = outlet_new(&x->x_obj, &s_float);
+    t_object x_obj;
+    t_outlet *x_outlet1;
+    t_outlet *x_outlet2;
+    int x_bulk;
+    t_symbol *x_array;
+} t_sysexin;
+
+static t_symbol *sysexin_sym(t_sysexin *x)
+{
+    return (x->x_bulk ? pd_this->pd_midi->m_sysexbulkin_sym :
+        pd_this->pd_midi->m_sysexin_sym);
+}
+
+static void *sysexin_new(t_symbol *s, int argc, t_atom *argv)
+{
+    t_sysexin *x = (t_sysexin *)pd_new(sysexin_class);
+    x->x_bulk = 0;
+    x->x_array = 0;
+    while (argc && argv->a_type == A_SYMBOL)
+    {
+        const char *flag = argv->a_w.w_symbol->s_name;
+        if (!strcmp(flag, "-list"))
+            x->x_bulk = 1;
+        else if (!strcmp(flag, "-array") && argc > 1 &&
+            argv[1].a_type == A_SYMBOL)
+        {
+            x->x_bulk = 1;
+            x->x_array = argv[1].a_w.w_symbol;
+            argc--; argv++;
+        }
+        else pd_error(x, "sysexin: %s: unknown flag", flag);
+        argc--; argv++;
+    }
+    x->x_outlet1 = outlet_new(&x->x_obj,
+        (x->x_bulk && !x->x_array ? &s_list : &s_float));
     x->x_outlet2 = outlet_new(&x->x_obj, &s_float);
-    pd_bind(&x->x_obj.ob_pd, pd_this->pd_midi->m_sysexin_sym);
+    pd_bind(&x->x_obj.ob_pd, sysexin_sym(x));
     return (x);
 }
 
-static void sysexin_free(t_midiin *x)
+static void sysexin_list(t_sysexin *x, t_symbol *s, int ac, t_atom *av)
+{
+    t_garray *a;
+    t_word *vec;
+    int i, n;
+    if (!x->x_bulk)
+    {
+        outlet_float(x->x_outlet2, atom_getfloatarg(1, ac, av) + 1);
+        outlet_float(x->x_outlet1, atom_getfloatarg(0, ac, av));
+        return;
+    }
+    if (ac < 1)
+        return;
+    outlet_float(x->x_outlet2, atom_getfloat(av) + 1);
+    if (!x->x_array)
+    {
+        outlet_list(x->x_outlet1, &s_list, ac - 1, av + 1);
+        return;
+    }
+    if (!(a = (t_garray *)pd_findbyclass(x->x_array, garray_class)))
+    {
+        pd_error(x, "sysexin: %s: no such array", x->x_array->s_name);
+        return;
+    }
+    garray_resize_long(a, ac - 1);
+    if (!garray_getfloatwords(a, &n, &vec))
+    {
+        pd_error(x, "sysexin: %s: bad template", x->x_array->s_name);
+        return;
+    }
+    for (i = 0; i < n && i < ac - 1; i++)
+        vec[i].w_float = atom_getfloat(av + 1 + i);
+    garray_redraw(a);
+    outlet_float(x->x_outlet1, ac - 1);
+}
+
+static void sysexin_free(t_sysexin *x)
 {
-    pd_unbind(&x->x_obj.ob_pd, pd_this->pd_midi->m_sysexin_sym);
+    pd_unbind(&x->x_obj.ob_pd, sysexin_sym(x));
 }
 
 static void midiin_setup(void)
@@ -80,9 +166,9 @@ static void midiin_setup(void)
     class_sethelpsymbol(midiin_class, gensym("midi"));
 
     sysexin_class = class_new(gensym("sysexin"), (t_newmethod)sysexin_new,
-        (t_method)sysexin_free, sizeof(t_midiin),
-            CLASS_NOINLET, A_DEFFLOAT, 0);
-    class_addlist(sysexin_class, midiin_list);
+        (t_method)sysexin_free, sizeof(t_sysexin),
+            CLASS_NOINLET, A_GIMME, 0);
+    class_addlist(sysexin_class, sysexin_list);
     class_sethelpsymbol(sysexin_class, gensym("midi"));
 }
 
@@ -106,6 +192,38 @@ void inmidi_sysex(int portno, int byte)
         SETFLOAT(at+1, portno);
         pd_list(pd_this->pd_midi->m_sysexin_sym->s_thing, 0, 2, at);
     }
+        /* collect whole messages for "sysexin -list" and "-array" */
+    if (pd_this->pd_midi->m_sysexbulkin_sym->s_thing &&
+        portno >= 0 && portno < MAXMIDIINDEV)
+    {
+        t_sysexbuf *b = &pd_this->pd_midi->m_sysexbuf[portno];
+        if (byte == 0xf0)
+        {
+            if (!b->b_vec)
+                b->b_vec = (t_atom *)getbytes(
+                    (b->b_size = 256) * sizeof(t_atom));
+            b->b_n = 1;
+            SETFLOAT(b->b_vec, portno);
+        }
+        else if (!b->b_n)
+            return;     /* missed the start */
+        if (b->b_n == b->b_size)
+        {
+            int newsize = 2 * b->b_size;
+            b->b_vec = (t_atom *)resizebytes(b->b_vec,
+                b->b_size * sizeof(t_atom), newsize * sizeof(t_atom));
+            b->b_size = newsize;
+        }
+        SETFLOAT(b->b_vec + b->b_n, byte);
+        b->b_n++;
+        if (byte == 0xf7)
+        {
+            int n = b->b_n;
+            b->b_n = 0;
+            pd_list(pd_this->pd_midi->m_sysexbulkin_sym->s_thing, 0,
+                n, b->b_vec);
+        }
+    }
 }
 
 /* ----------------------- notein ------------------------- */
@@ -586,9 +704,27 @@ static void midiout_float(t_midiout *x, t_floatarg f)
     outmidi_byte(x->x_portno - 1, f);
 }
 
+    /* a list holding one whole sysex message goes to the MIDI API in one
+    piece; anything else byte by byte */
 static void midiout_list(t_midiout *x, t_symbol *s, int ac, t_atom *av)
 {
     int i;
+    if (ac >= 2 && atom_getfloat(av) == 0xf0 &&
+        atom_getfloat(av + ac - 1) == 0xf7)
+    {
+        unsigned char smallbuf[256], *buf = (ac > 256 ?
+            (unsigned char *)getbytes(ac) : smallbuf);
+        for (i = 0; i < ac; i++)
+            if (av[i].a_type != A_FLOAT)
+                break;
+            else buf[i] = (int)av[i].a_w.w_float;
+        if (i == ac)
+            outmidi_sysex(x->x_portno - 1, ac, buf);
+        if (buf != smallbuf)
+            freebytes(buf, ac);
+        if (i == ac)
+            return;
+    }
     for (i = 0; i < ac; ++i)
     {
         if(av[i].a_type == A_FLOAT)
@@ -1231,6 +1367,7 @@ void x_midi_newpdinstance(void)
     pd_this->pd_midi = getbytes(sizeof(t_instancemidi));
     pd_this->pd_midi->m_midiin_sym = gensym("#midiin");
     pd_this->pd_midi->m_sysexin_sym = gensym("#sysexin");
+    pd_this->pd_midi->m_sysexbulkin_sym = gensym("#sysexbulkin");
     pd_this->pd_midi->m_notein_sym = gensym("#notein");
     pd_this->pd_midi->m_ctlin_sym = gensym("#ctlin");
     pd_this->pd_midi->m_pgmin_sym = gensym("#pgmin");
@@ -1242,5 +1379,10 @@ void x_midi_newpdinstance(void)
 
 void x_midi_freepdinstance(void)
 {
+    int i;
+    for (i = 0; i < MAXMIDIINDEV; i++)
+        if (pd_this->pd_midi->m_sysexbuf[i].b_vec)
+            freebytes(pd_this->pd_midi->m_sysexbuf[i].b_vec,
+                pd_this->pd_midi->m_sysexbuf[i].b_size * sizeof(t_atom));
     freebytes(pd_this->pd_midi, sizeof(t_instancemidi));
 }
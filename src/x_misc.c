@@ -9,6 +9,7 @@
 #include "g_canvas.h"
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #ifdef _WIN32
 #include <wtypes.h>
@@ -280,6 +281,204 @@ static void realtime_setup(void)
         0);
 }
 
+/* -------------------------- perf ------------------------------ */
+
+/* time a section of a patch: "start" before it and "stop" (or "lap", which
+keeps going) after it.  Each measurement goes out the left outlet, in msec
+for the "real" (default) and "cpu" (this thread's CPU time) clocks, or in
+raw counts for "cycles".  "stats" sends count, min, average, max and the
+50th, 90th and 99th percentiles out the right outlet, and "print" posts
+them.  Count, min, average and max cover everything since the last
+"reset"; the percentiles only the most recent measurements, 1000 of them
+unless a second creation argument says otherwise. */
+
+#define PERF_REAL 0
+#define PERF_CPU 1
+#define PERF_CYCLES 2
+
+static t_class *perf_class;
+
+typedef struct _perf
+{
+    t_object x_obj;
+    int x_clock;
+    int x_running;
+    uint64_t x_start;       /* time of "start" ... */
+    uint64_t x_lap;         /* ... and of the last "lap" */
+    double x_count;
+    double x_min;
+    double x_max;
+    double x_sum;
+    double *x_vec;          /* most recent measurements for percentiles */
+    double *x_sorted;       /* room to sort them in */
+    int x_size;
+    int x_n;
+    int x_head;
+    t_outlet *x_statout;
+} t_perf;
+
+static uint64_t perf_now(t_perf *x)
+{
+    if (x->x_clock == PERF_CPU)
+        return (sys_getthreadcputime());
+    else if (x->x_clock == PERF_CYCLES)
+        return (sys_getcycles());
+    else return (sys_getnanotime());
+}
+
+static void perf_reset(t_perf *x)
+{
+    x->x_count = x->x_sum = x->x_max = 0;
+    x->x_min = 1e300;
+    x->x_n = x->x_head = 0;
+}
+
+static void perf_start(t_perf *x)
+{
+    x->x_start = x->x_lap = perf_now(x);
+    x->x_running = 1;
+}
+
+static void perf_add(t_perf *x, uint64_t from, uint64_t to)
+{
+    double v = (double)(to - from);
+    if (x->x_clock != PERF_CYCLES)
+        v *= 1e-6;
+    x->x_count += 1;
+    x->x_sum += v;
+    if (v < x->x_min)
+        x->x_min = v;
+    if (v > x->x_max)
+        x->x_max = v;
+    x->x_vec[x->x_head] = v;
+    if (++x->x_head == x->x_size)
+        x->x_head = 0;
+    if (x->x_n < x->x_size)
+        x->x_n++;
+    outlet_float(x->x_obj.ob_outlet, v);
+}
+
+static void perf_stop(t_perf *x)
+{
+    uint64_t now = perf_now(x);
+    if (!x->x_running)
+    {
+        pd_error(x, "perf: stop without start");
+        return;
+    }
+    x->x_running = 0;
+    perf_add(x, x->x_start, now);
+}
+
+static void perf_lap(t_perf *x)
+{
+    uint64_t now = perf_now(x), was = x->x_lap;
+    if (!x->x_running)
+    {
+        pd_error(x, "perf: lap without start");
+        return;
+    }
+    x->x_lap = now;
+    perf_add(x, was, now);
+}
+
+static int perf_compare(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x < y ? -1 : (x > y));
+}
+
+    /* fill in count, min, avg, max, and the three percentiles */
+static void perf_getstats(t_perf *x, t_atom *at)
+{
+    static const double pct[3] = {0.5, 0.9, 0.99};
+    int i;
+    if (!x->x_n)
+    {
+        for (i = 0; i < 7; i++)
+            SETFLOAT(at+i, 0);
+        return;
+    }
+    memcpy(x->x_sorted, x->x_vec, x->x_n * sizeof(double));
+    qsort(x->x_sorted, x->x_n, sizeof(double), perf_compare);
+    SETFLOAT(at, x->x_count);
+    SETFLOAT(at+1, x->x_min);
+    SETFLOAT(at+2, x->x_sum / x->x_count);
+    SETFLOAT(at+3, x->x_max);
+    for (i = 0; i < 3; i++)
+        SETFLOAT(at+4+i, x->x_sorted[(int)(pct[i] * (x->x_n - 1) + 0.5)]);
+}
+
+static void perf_stats(t_perf *x)
+{
+    t_atom at[7];
+    perf_getstats(x, at);
+    outlet_list(x->x_statout, 0, 7, at);
+}
+
+static void perf_print(t_perf *x)
+{
+    t_atom at[7];
+    const char *units = (x->x_clock == PERF_CYCLES ? "cycles" : "msec");
+    perf_getstats(x, at);
+    post("perf (%s): %d measured, min %g, avg %g, max %g %s",
+        (x->x_clock == PERF_CPU ? "cpu" :
+            (x->x_clock == PERF_CYCLES ? "cycles" : "real")),
+        (int)atom_getfloat(at), atom_getfloat(at+1),
+            atom_getfloat(at+2), atom_getfloat(at+3), units);
+    post("... percentiles (last %d): 50%% %g, 90%% %g, 99%% %g %s",
+        x->x_n, atom_getfloat(at+4), atom_getfloat(at+5),
+            atom_getfloat(at+6), units);
+}
+
+static void *perf_new(t_symbol *s, t_floatarg f)
+{
+    t_perf *x = (t_perf *)pd_new(perf_class);
+    if (!*s->s_name || s == gensym("real"))
+        x->x_clock = PERF_REAL;
+    else if (s == gensym("cpu"))
+    {
+        x->x_clock = PERF_CPU;
+        if (!sys_getthreadcputime())
+            pd_error(x, "perf: CPU time not available on this platform");
+    }
+    else if (s == gensym("cycles"))
+        x->x_clock = PERF_CYCLES;
+    else
+    {
+        pd_error(x, "perf: %s: unknown clock (use real, cpu, or cycles)",
+            s->s_name);
+        x->x_clock = PERF_REAL;
+    }
+    x->x_size = (f >= 1 ? f : 1000);
+    x->x_vec = (double *)getbytes(x->x_size * sizeof(double));
+    x->x_sorted = (double *)getbytes(x->x_size * sizeof(double));
+    x->x_running = 0;
+    perf_reset(x);
+    outlet_new(&x->x_obj, &s_float);
+    x->x_statout = outlet_new(&x->x_obj, &s_list);
+    return (x);
+}
+
+static void perf_free(t_perf *x)
+{
+    freebytes(x->x_vec, x->x_size * sizeof(double));
+    freebytes(x->x_sorted, x->x_size * sizeof(double));
+}
+
+static void perf_setup(void)
+{
+    perf_class = class_new(gensym("perf"), (t_newmethod)perf_new,
+        (t_method)perf_free, sizeof(t_perf), 0, A_DEFSYM, A_DEFFLOAT, 0);
+    class_addbang(perf_class, perf_start);
+    class_addmethod(perf_class, (t_method)perf_start, gensym("start"), 0);
+    class_addmethod(perf_class, (t_method)perf_stop, gensym("stop"), 0);
+    class_addmethod(perf_class, (t_method)perf_lap, gensym("lap"), 0);
+    class_addmethod(perf_class, (t_method)perf_reset, gensym("reset"), 0);
+    class_addmethod(perf_class, (t_method)perf_stats, gensym("stats"), 0);
+    class_addmethod(perf_class, (t_method)perf_print, gensym("print"), 0);
+}
+
 /* ---------- oscparse - parse simple OSC messages ----------------- */
 
 static t_class *oscparse_class;
@@ -291,99 +490,95 @@ typedef struct _oscparse
 
 #define ROUNDUPTO4(x) (((x) + 3) & (~3))
 
-#define READINT(x)  ((((int)(((x)  )->a_w.w_float)) & 0xff) << 24) | \
-                    ((((int)(((x)+1)->a_w.w_float)) & 0xff) << 16) | \
-                    ((((int)(((x)+2)->a_w.w_float)) & 0xff) << 8) | \
-                    ((((int)(((x)+3)->a_w.w_float)) & 0xff) << 0)
+#define READINT(p) ((((uint32_t)(p)[0]) << 24) | ((uint32_t)(p)[1] << 16) | \
+                    ((uint32_t)(p)[2] << 8) | (uint32_t)(p)[3])
 
-static t_symbol *grabstring(int argc, t_atom *argv, int *ip, int slash)
+    /* get a string at byte *ip: an address component if "slash" is set,
+    else a whole NUL-terminated and padded OSC string */
+static t_symbol *grabstring(const unsigned char *buf, int n, int *ip,
+    int slash)
 {
-    char buf[MAXPDSTRING];
-    int first, nchar;
+    char sbuf[MAXPDSTRING];
+    int nchar;
     if (slash)
-        while (*ip < argc && argv[*ip].a_w.w_float == '/')
+        while (*ip < n && buf[*ip] == '/')
             (*ip)++;
-    for (nchar = 0; nchar < MAXPDSTRING-1 && *ip < argc; nchar++, (*ip)++)
+    for (nchar = 0; nchar < MAXPDSTRING-1 && *ip < n; nchar++, (*ip)++)
     {
-        char c = argv[*ip].a_w.w_float;
+        char c = buf[*ip];
         if (c == 0 || (slash && c == '/'))
             break;
-        buf[nchar] = c;
+        sbuf[nchar] = c;
     }
-    buf[nchar] = 0;
+    sbuf[nchar] = 0;
     if (!slash)
         *ip = ROUNDUPTO4(*ip+1);
-    if (*ip > argc)
-        *ip = argc;
-    return (gensym(buf));
+    if (*ip > n)
+        *ip = n;
+    return (gensym(sbuf));
 }
 
-static void oscparse_list(t_oscparse *x, t_symbol *s, int argc, t_atom *argv)
+    /* decode one OSC packet from raw bytes.  Each message goes to "fn" as
+    oscparse outputs it (the address components as symbols, then the
+    arguments) along with the timetag of the innermost bundle holding it,
+    or 1 ("immediately") if none.  Errors are posted for "owner", with
+    "who" to say where they came from. */
+int osc_decode(void *owner, const char *who, const unsigned char *buf,
+    int n, t_oscmessagefn fn, uint64_t timetag)
 {
     int i, j, j2, k, outc = 1, blob = 0, typeonset, dataonset, nfield;
     t_atom *outv;
-    if (!argc)
-        return;
-    for (i = 0; i < argc; i++)
-        if (argv[i].a_type != A_FLOAT)
+    if (!n)
+        return (0);
+    if (buf[0] == '#') /* it's a bundle */
     {
-        pd_error(x, "oscparse: takes numbers only");
-        return;
-    }
-    if (argv[0].a_w.w_float == '#') /* it's a bundle */
-    {
-        if (argv[1].a_w.w_float != 'b' || argc < 16)
+        if (n < 16 || buf[1] != 'b')
         {
-            pd_error(x, "oscparse: malformed bundle");
-            return;
+            pd_error(owner, "%s: malformed bundle", who);
+            return (-1);
         }
-            /* we ignore the timetag since there's no correct way to
-            convert it to Pd logical time that I can think of.  LATER
-            consider at least outputting timetag differentially converted
-            into Pd time units. */
-        for (i = 16; i < argc-4; )
+        timetag = ((uint64_t)READINT(buf+8) << 32) | READINT(buf+12);
+        for (i = 16; i < n-4; )
         {
-            int msize = READINT(argv+i);
-            if (msize <= 0 || msize & 3)
+            int msize = (int)READINT(buf+i);
+            if (msize <= 0 || msize & 3 || msize > n - i - 4)
             {
-                pd_error(x, "oscparse: bad bundle element size");
-                return;
+                pd_error(owner, "%s: bad bundle element size", who);
+                return (-1);
             }
-            oscparse_list(x, 0, msize, argv+i+4);
+            if (osc_decode(owner, who, buf+i+4, msize, fn, timetag) < 0)
+                return (-1);
             i += msize+4;
         }
-        return;
+        return (0);
     }
-    else if (argv[0].a_w.w_float != '/')
+    else if (buf[0] != '/')
     {
-        pd_error(x, "oscparse: not an OSC message (no leading slash)");
-        return;
+        pd_error(owner, "%s: not an OSC message (no leading slash)", who);
+        return (-1);
     }
-    for (i = 1; i < argc && argv[i].a_w.w_float != 0; i++)
-        if (argv[i].a_w.w_float == '/')
+    for (i = 1; i < n && buf[i] != 0; i++)
+        if (buf[i] == '/')
             outc++;
     i = ROUNDUPTO4(i+1);
-    if (argv[i].a_w.w_float != ',' || (i+1) >= argc)
+    if (i >= n || buf[i] != ',' || (i+1) >= n)
     {
-        pd_error(x, "oscparse: malformed type string (char %d, index %d)",
-            (int)(argv[i].a_w.w_float), i);
-        return;
+        pd_error(owner, "%s: malformed type string (char %d, index %d)",
+            who, (i < n ? buf[i] : 0), i);
+        return (-1);
     }
     typeonset = ++i;
-    for (; i < argc && argv[i].a_w.w_float != 0; i++)
-        if (argv[i].a_w.w_float == 'b')
+    for (; i < n && buf[i] != 0; i++)
+        if (buf[i] == 'b')
             blob = 1;
     nfield = i - typeonset;
     if (blob)
-        outc += argc - typeonset;
+        outc += n - typeonset;
     else outc += nfield;
     outv = (t_atom *)alloca(outc * sizeof(t_atom));
     dataonset = ROUNDUPTO4(i + 1);
-    /* post("outc %d, typeonset %d, dataonset %d, nfield %d", outc, typeonset,
-        dataonset, nfield); */
-    for (i = j = 0; i < typeonset-1 && argv[i].a_w.w_float != 0 &&
-        j < outc; j++)
-            SETSYMBOL(outv+j, grabstring(argc, argv, &i, 1));
+    for (i = j = 0; i < typeonset-1 && buf[i] != 0 && j < outc; j++)
+        SETSYMBOL(outv+j, grabstring(buf, n, &i, 1));
     for (i = typeonset, k = dataonset; i < typeonset + nfield; i++)
     {
         union
@@ -393,72 +588,100 @@ static void oscparse_list(t_oscparse *x, t_symbol *s, int argc, t_atom *argv)
         } z;
         float f;
         int blobsize;
-        switch ((int)(argv[i].a_w.w_float))
+        switch (buf[i])
         {
         case 'f':
-            if (k > argc - 4)
+            if (k > n - 4)
                 goto tooshort;
-            z.z_i = READINT(argv+k);
+            z.z_i = READINT(buf+k);
             f = z.z_f;
             if (PD_BADFLOAT(f))
                 f = 0;
             if (j >= outc)
             {
-                bug("oscparse 1: %d >=%d", j, outc);
-                return;
+                bug("osc_decode 1: %d >=%d", j, outc);
+                return (-1);
             }
             SETFLOAT(outv+j, f);
             j++; k += 4;
             break;
         case 'i':
-            if (k > argc - 4)
+            if (k > n - 4)
                 goto tooshort;
             if (j >= outc)
             {
-                bug("oscparse 2");
-                return;
+                bug("osc_decode 2");
+                return (-1);
             }
-            SETFLOAT(outv+j, READINT(argv+k));
+            SETFLOAT(outv+j, (int32_t)READINT(buf+k));
             j++; k += 4;
             break;
         case 's':
             if (j >= outc)
             {
-                bug("oscparse 3");
-                return;
+                bug("osc_decode 3");
+                return (-1);
             }
-            SETSYMBOL(outv+j, grabstring(argc, argv, &k, 0));
+            SETSYMBOL(outv+j, grabstring(buf, n, &k, 0));
             j++;
             break;
         case 'b':
-            if (k > argc - 4)
+            if (k > n - 4)
                 goto tooshort;
-            blobsize = READINT(argv+k);
+            blobsize = (int)READINT(buf+k);
             k += 4;
-            if (blobsize < 0 || blobsize > argc - k)
+            if (blobsize < 0 || blobsize > n - k)
                 goto tooshort;
             if (j + blobsize + 1 > outc)
             {
-                bug("oscparse 4");
-                return;
+                bug("osc_decode 4");
+                return (-1);
             }
-            if (k + blobsize > argc)
-                goto tooshort;
             SETFLOAT(outv+j, blobsize);
             j++;
             for (j2 = 0; j2 < blobsize; j++, j2++, k++)
-                SETFLOAT(outv+j, argv[k].a_w.w_float);
+                SETFLOAT(outv+j, buf[k]);
             k = ROUNDUPTO4(k);
             break;
         default:
-            pd_error(x, "oscparse: unknown tag '%c' (%d)",
-                (int)(argv[i].a_w.w_float), (int)(argv[i].a_w.w_float));
+            pd_error(owner, "%s: unknown tag '%c' (%d)", who,
+                buf[i], buf[i]);
         }
     }
-    outlet_list(x->x_obj.ob_outlet, 0, j, outv);
-    return;
+    (*fn)(owner, j, outv, timetag);
+    return (0);
 tooshort:
-    pd_error(x, "oscparse: OSC message ended prematurely");
+    pd_error(owner, "%s: OSC message ended prematurely", who);
+    return (-1);
+}
+
+static void oscparse_output(void *z, int argc, t_atom *argv,
+    uint64_t timetag)
+{
+    t_oscparse *x = (t_oscparse *)z;
+    outlet_list(x->x_obj.ob_outlet, 0, argc, argv);
+}
+
+    /* we ignore bundle timetags since there's no correct way to convert
+    them to Pd logical time that I can think of.  (netreceive -o
+    schedules them against the system clock.) */
+static void oscparse_list(t_oscparse *x, t_symbol *s, int argc, t_atom *argv)
+{
+    unsigned char *buf;
+    int i;
+    if (!argc)
+        return;
+    buf = (unsigned char *)alloca(argc);
+    for (i = 0; i < argc; i++)
+    {
+        if (argv[i].a_type != A_FLOAT)
+        {
+            pd_error(x, "oscparse: takes numbers only");
+            return;
+        }
+        buf[i] = (int)argv[i].a_w.w_float;
+    }
+    osc_decode(x, "oscparse", buf, argc, oscparse_output, 1);
 }
 
 static t_oscparse *oscparse_new(t_symbol *s, int argc, t_atom *argv)
@@ -478,14 +701,68 @@ void oscparse_setup(void)
 /* --------- oscformat - format simple OSC messages -------------- */
 static t_class *oscformat_class;
 
+    /* largest bundle by default: a 1500-byte Ethernet frame less the IPv4
+    and UDP headers */
+#define OSC_DEFMTU 1472
+#define OSC_MINMTU 64
+#define OSC_MAXMTU 65507        /* largest UDP datagram */
+    /* re-read the system clock if logical time has drifted this far
+    (in seconds) from it */
+#define OSC_MAXDRIFT 0.1
+
 typedef struct _oscformat
 {
     t_object x_obj;
     char *x_pathbuf;
     size_t x_pathsize;
     t_symbol *x_format;
+    int x_bundle;           /* gather messages into bundles */
+    int x_mtu;              /* most bytes per bundle */
+    t_atom *x_bundlev;      /* bundle so far, a byte per atom */
+    int x_bundlec;
+    t_clock *x_clock;       /* sends the bundle at the end of the tick */
 } t_oscformat;
 
+    /* system clock in seconds since 1970 */
+double osc_walltime(void)
+{
+#ifdef _WIN32
+    FILETIME ft;
+    ULARGE_INTEGER u;
+    GetSystemTimeAsFileTime(&ft);
+    u.LowPart = ft.dwLowDateTime;
+    u.HighPart = ft.dwHighDateTime;
+    return (u.QuadPart * 1e-7 - 11644473600.);
+#else
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return (tv.tv_sec + tv.tv_usec * 1e-6);
+#endif
+}
+
+    /* OSC timetag for the current logical time.  We tie logical time to
+    the system clock once and then count forward in logical time, so that
+    bundles from the same tick or a regular metro get exactly spaced
+    tags; if the two clocks drift apart (or in -nrt/batch mode) we tie
+    them again. */
+static uint64_t oscformat_timetag(void)
+{
+    static double anchorlogical, anchorwall;
+    static int anchored;
+    double wall = osc_walltime(), t;
+    if (!anchored || fabs(anchorwall +
+        clock_gettimesince(anchorlogical) * 0.001 - wall) > OSC_MAXDRIFT)
+    {
+        anchorlogical = clock_getlogicaltime();
+        anchorwall = wall;
+        anchored = 1;
+    }
+    t = anchorwall + clock_gettimesince(anchorlogical) * 0.001 +
+        NTP_UNIXOFFSET;
+    return (((uint64_t)t << 32) |
+        (uint32_t)((t - floor(t)) * 4294967296.));
+}
+
 static void oscformat_set(t_oscformat *x, t_symbol *s, int argc, t_atom *argv)
 {
     char buf[MAXPDSTRING];
@@ -544,6 +821,94 @@ static void putstring(t_atom *msg, int *ip, const char *s)
     }
 }
 
+    /* encode a message as an OSC packet straight into bytes.  The first
+    atom is the address (we add the leading slash if it's missing); the
+    others are sent as 'f' if floats and 's' if symbols.  Returns the size
+    of the packet, put in *bufp for later freebytes(), or -1 if there's no
+    address. */
+int osc_encode(int argc, const t_atom *argv, char **bufp)
+{
+    const char *path;
+    unsigned char *buf;
+    int i, pathlen, slash, size, typeindex, msgindex;
+    if (!argc || argv[0].a_type != A_SYMBOL)
+        return (-1);
+    path = argv[0].a_w.w_symbol->s_name;
+    slash = (*path != '/');
+    pathlen = (int)strlen(path) + slash;
+    size = ROUNDUPTO4(pathlen + 1) + ROUNDUPTO4(argc - 1 + 2);
+    for (i = 1; i < argc; i++)
+        size += (argv[i].a_type == A_SYMBOL ?
+            ROUNDUPTO4(strlen(argv[i].a_w.w_symbol->s_name) + 1) : 4);
+    buf = (unsigned char *)getbytes(size);   /* zeroed, so padded */
+    buf[0] = '/';
+    memcpy(buf + slash, path, pathlen - slash);
+    typeindex = ROUNDUPTO4(pathlen + 1);
+    msgindex = typeindex + ROUNDUPTO4(argc - 1 + 2);
+    buf[typeindex++] = ',';
+    for (i = 1; i < argc; i++)
+    {
+        if (argv[i].a_type == A_SYMBOL)
+        {
+            const char *sp = argv[i].a_w.w_symbol->s_name;
+            int len = (int)strlen(sp);
+            buf[typeindex++] = 's';
+            memcpy(buf + msgindex, sp, len);
+            msgindex += ROUNDUPTO4(len + 1);
+        }
+        else
+        {
+            union
+            {
+                float z_f;
+                uint32_t z_i;
+            } z;
+            buf[typeindex++] = 'f';
+            z.z_f = atom_getfloat(&argv[i]);
+            buf[msgindex] = (z.z_i >> 24) & 0xff;
+            buf[msgindex+1] = (z.z_i >> 16) & 0xff;
+            buf[msgindex+2] = (z.z_i >> 8) & 0xff;
+            buf[msgindex+3] = z.z_i & 0xff;
+            msgindex += 4;
+        }
+    }
+    if (msgindex != size)
+        bug("osc_encode: msgindex %d, size %d", msgindex, size);
+    *bufp = (char *)buf;
+    return (size);
+}
+
+static void oscformat_flush(t_oscformat *x);
+
+    /* with "-bundle", messages sent in the same logical time go out
+    together as a bundle (or as several if they'd overflow x_mtu)
+    tagged with the time they were sent, when the clock goes off at the
+    end of the tick */
+static void oscformat_addtobundle(t_oscformat *x, int msgsize, t_atom *msg)
+{
+    uint64_t timetag;
+    if (x->x_bundlec && x->x_bundlec + 4 + msgsize > x->x_mtu)
+        oscformat_flush(x);
+    if (16 + 4 + msgsize > x->x_mtu)
+    {
+            /* it'll never fit in a bundle; send it by itself */
+        outlet_list(x->x_obj.ob_outlet, 0, msgsize, msg);
+        return;
+    }
+    if (!x->x_bundlec)
+    {
+        putstring(x->x_bundlev, &x->x_bundlec, "#bundle");
+        timetag = oscformat_timetag();
+        WRITEINT(x->x_bundlev + 8, (uint32_t)(timetag >> 32));
+        WRITEINT(x->x_bundlev + 12, (uint32_t)timetag);
+        x->x_bundlec = 16;
+        clock_delay(x->x_clock, 0);
+    }
+    WRITEINT(x->x_bundlev + x->x_bundlec, msgsize);
+    memcpy(x->x_bundlev + x->x_bundlec + 4, msg, msgsize * sizeof(t_atom));
+    x->x_bundlec += 4 + msgsize;
+}
+
 static void oscformat_list(t_oscformat *x, t_symbol *s, int argc, t_atom *argv)
 {
     int typeindex = 0, j, msgindex, msgsize, datastart, ndata;
@@ -651,12 +1016,47 @@ static void oscformat_list(t_oscformat *x, t_symbol *s, int argc, t_atom *argv)
         bug("oscformat: typeindex %d, datastart %d, msgindex %d, msgsize %d",
             typeindex, datastart, msgindex, msgsize);
     /* else post("datastart %d, msgsize %d", datastart, msgsize); */
-    outlet_list(x->x_obj.ob_outlet, 0, msgsize, msg);
+    if (x->x_bundle)
+        oscformat_addtobundle(x, msgsize, msg);
+    else outlet_list(x->x_obj.ob_outlet, 0, msgsize, msg);
+}
+
+static void oscformat_flush(t_oscformat *x)
+{
+    int n = x->x_bundlec;
+    if (!n)
+        return;
+    x->x_bundlec = 0;
+    clock_unset(x->x_clock);
+    outlet_list(x->x_obj.ob_outlet, 0, n, x->x_bundlev);
+}
+
+static void oscformat_bundle(t_oscformat *x, t_floatarg f)
+{
+    if (x->x_bundle && f == 0)
+        oscformat_flush(x);
+    x->x_bundle = (f != 0);
+}
+
+static void oscformat_mtu(t_oscformat *x, t_floatarg f)
+{
+    int mtu = f;
+    if (mtu < OSC_MINMTU)
+        mtu = OSC_MINMTU;
+    else if (mtu > OSC_MAXMTU)
+        mtu = OSC_MAXMTU;
+    if (mtu < x->x_mtu)
+        oscformat_flush(x);
+    x->x_bundlev = (t_atom *)resizebytes(x->x_bundlev,
+        x->x_mtu * sizeof(t_atom), mtu * sizeof(t_atom));
+    x->x_mtu = mtu;
 }
 
 static void oscformat_free(t_oscformat *x)
 {
     freebytes(x->x_pathbuf, x->x_pathsize);
+    freebytes(x->x_bundlev, x->x_mtu * sizeof(t_atom));
+    clock_free(x->x_clock);
 }
 
 static void *oscformat_new(t_symbol *s, int argc, t_atom *argv)
@@ -667,13 +1067,32 @@ static void *oscformat_new(t_symbol *s, int argc, t_atom *argv)
     x->x_pathsize = 1;
     *x->x_pathbuf = 0;
     x->x_format = &s_;
-    if (argc > 1 && argv[0].a_type == A_SYMBOL &&
-        argv[1].a_type == A_SYMBOL &&
-            !strcmp(argv[0].a_w.w_symbol->s_name, "-f"))
+    x->x_mtu = OSC_DEFMTU;
+    x->x_bundlev = (t_atom *)getbytes(x->x_mtu * sizeof(t_atom));
+    x->x_clock = clock_new(x, (t_method)oscformat_flush);
+    while (argc && argv[0].a_type == A_SYMBOL)
     {
-        oscformat_format(x, argv[1].a_w.w_symbol);
-        argc -= 2;
-        argv += 2;
+        const char *flag = argv[0].a_w.w_symbol->s_name;
+        if (argc > 1 && argv[1].a_type == A_SYMBOL && !strcmp(flag, "-f"))
+        {
+            oscformat_format(x, argv[1].a_w.w_symbol);
+            argc -= 2;
+            argv += 2;
+        }
+        else if (!strcmp(flag, "-bundle"))
+        {
+            x->x_bundle = 1;
+            argc--;
+            argv++;
+        }
+        else if (argc > 1 && argv[1].a_type == A_FLOAT &&
+            !strcmp(flag, "-mtu"))
+        {
+            oscformat_mtu(x, argv[1].a_w.w_float);
+            argc -= 2;
+            argv += 2;
+        }
+        else break;
     }
     oscformat_set(x, 0, argc, argv);
     return (x);
@@ -687,6 +1106,10 @@ void oscformat_setup(void)
         gensym("set"), A_GIMME, 0);
     class_addmethod(oscformat_class, (t_method)oscformat_format,
         gensym("format"), A_DEFSYM, 0);
+    class_addmethod(oscformat_class, (t_method)oscformat_bundle,
+        gensym("bundle"), A_FLOAT, 0);
+    class_addmethod(oscformat_class, (t_method)oscformat_mtu,
+        gensym("mtu"), A_FLOAT, 0);
     class_addlist(oscformat_class, oscformat_list);
 }
 
@@ -861,6 +1284,7 @@ void x_misc_setup(void)
     namecanvas_setup();
     cputime_setup();
     realtime_setup();
+    perf_setup();
     oscparse_setup();
     oscformat_setup();
     fudiparse_setup();
@@ -7,11 +7,13 @@
 #include "m_pd.h"
 #include "s_stuff.h"
 #include "s_net.h"
+#include "s_audio_paring.h"
 
 #include <sys/types.h>
 #include <string.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 #ifdef _WIN32
 # include <malloc.h> /* MSVC or mingw on windows */
@@ -45,6 +47,32 @@ static void outlet_sockaddr(t_outlet *o, const struct sockaddr *sa)
 
 static t_class *netsend_class;
 
+    /* TCP output that can't be sent without blocking waits here, from
+    q_head on, and is retried from a clock (Pd only polls descriptors for
+    reading).  Messages are queued or dropped whole, so that the stream
+    never loses part of one. */
+typedef struct _netqueue
+{
+    char *q_buf;
+    int q_head;
+    int q_n;            /* bytes waiting */
+    int q_size;         /* bytes allocated */
+    int q_dropping;     /* dropping messages since the queue filled up */
+} t_netqueue;
+
+    /* an OSC message from a bundle whose timetag is still in the future */
+typedef struct _oscpending
+{
+    t_clock *p_clock;
+    struct _netsend *p_owner;
+    struct _oscpending *p_next;
+    int p_argc;
+    t_atom *p_argv;
+} t_oscpending;
+
+#define NETQUEUE_SIZE 1048576   /* default "sndqueue" in bytes */
+#define NETQUEUE_FLUSHMS 1      /* how often to retry queued output */
+
 typedef struct _netsend
 {
     t_object x_obj;
@@ -57,31 +85,270 @@ typedef struct _netsend
     t_socketreceiver *x_receiver;
     struct sockaddr_storage x_server;
     t_float x_timeout; /* TCP connect timeout in seconds */
+    unsigned char *x_udpbuf; /* binary UDP: a batch of datagrams at a time */
+    t_netqueue x_queue;     /* TCP output waiting to be sent */
+    int x_sndqueue;         /* most bytes to hold in a queue */
+    int x_overflowblock;    /* wait for a full queue to drain, else drop */
+    int x_lastqueued;       /* bytes queued as last output */
+    t_outlet *x_queuedout;  /* optional, from the "-q" flag */
+    t_clock *x_flushclock;
+    int x_osc;              /* "-o": datagrams are OSC packets */
+    t_oscpending *x_oscpending;
+    double x_oscwall;       /* system clock when the packet came in */
 } t_netsend;
 
 static t_class *netreceive_class;
 
+    /* a TCP client of netreceive.  Each has its own output queue so that
+    a slow one doesn't hold up the others or the scheduler. */
+typedef struct _netclient
+{
+    int c_fd;
+    t_socketreceiver *c_receiver;
+    t_netqueue c_queue;
+} t_netclient;
+
 typedef struct _netreceive
 {
     t_netsend x_ns;
     int x_nconnections;
     int x_sockfd;
-    int *x_connections;
+    t_netclient *x_clients; /* in no particular order */
+    int x_clientsize;       /* number allocated */
+    int *x_fdindex;         /* client index by file descriptor, or -1 */
+    int x_nfdindex;
     int x_old;
-    t_socketreceiver **x_receivers;
+    int x_rcvbuf; /* socket receive buffer size in bytes, 0 for default */
+    int x_queued;           /* bytes waiting for all clients */
 } t_netreceive;
 
 static void netsend_disconnect(t_netsend *x);
 static void netreceive_notify(t_netreceive *x, int fd);
 
+/* ----------------------------- output queues ------------------------- */
+
+    /* write without blocking; returns bytes written or -1 on error */
+static int netqueue_trysend(int fd, const char *buf, int n)
+{
+#ifdef MSG_DONTWAIT
+    int res = (int)send(fd, buf, n, MSG_DONTWAIT);
+#else
+    int res = (int)send(fd, buf, n, 0); /* socket is non-blocking */
+#endif
+    if (res < 0)
+    {
+        int err = socket_errno();
+#ifdef _WIN32
+        if (err == WSAEWOULDBLOCK)
+#else
+        if (err == EAGAIN || err == EWOULDBLOCK || err == EINTR)
+#endif
+            return (0);
+    }
+    return (res);
+}
+
+static void netqueue_append(t_netqueue *q, const char *buf, int n)
+{
+    if (q->q_head + q->q_n + n > q->q_size)
+    {
+        if (q->q_head)
+        {
+            memmove(q->q_buf, q->q_buf + q->q_head, q->q_n);
+            q->q_head = 0;
+        }
+        if (q->q_n + n > q->q_size)
+        {
+            int newsize = 2 * q->q_size;
+            if (newsize < q->q_n + n)
+                newsize = q->q_n + n;
+            q->q_buf = (char *)t_resizebytes(q->q_buf, q->q_size, newsize);
+            q->q_size = newsize;
+        }
+    }
+    memcpy(q->q_buf + q->q_head + q->q_n, buf, n);
+    q->q_n += n;
+}
+
+static void netqueue_consume(t_netqueue *q, int n)
+{
+    q->q_head += n;
+    if (!(q->q_n -= n))
+        q->q_head = 0;
+}
+
+    /* send what we can of the queue; returns bytes sent or -1 on error */
+static int netqueue_flush(t_netqueue *q, int fd)
+{
+    int res;
+    if (!q->q_n)
+        return (0);
+    if ((res = netqueue_trysend(fd, q->q_buf + q->q_head, q->q_n)) > 0)
+        netqueue_consume(q, res);
+    return (res);
+}
+
+    /* send all of the queue, waiting as long as it takes */
+static int netqueue_drain(t_netqueue *q, int fd)
+{
+    int res = 0;
+#ifndef MSG_DONTWAIT
+    socket_set_nonblocking(fd, 0);
+#endif
+    while (q->q_n)
+    {
+        if ((res = (int)send(fd, q->q_buf + q->q_head, q->q_n, 0)) <= 0)
+        {
+            res = -1;
+            break;
+        }
+        netqueue_consume(q, res);
+    }
+#ifndef MSG_DONTWAIT
+    socket_set_nonblocking(fd, 1);
+#endif
+    return (res < 0 ? -1 : 0);
+}
+
+    /* send a message, or queue what can't be sent right away.  If that
+    would put more than "limit" bytes in the queue, drop the message, or
+    with "block" wait for the queue to go out first.  Returns 0 if sent or
+    queued, 1 if dropped and -1 on a socket error. */
+static int netqueue_send(t_netqueue *q, int fd, const char *buf, int n,
+    int limit, int block)
+{
+    int sent = 0;
+    if (q->q_n && q->q_n + n > limit)
+    {
+        if (!block)
+            return (1);
+        if (netqueue_drain(q, fd) < 0)
+            return (-1);
+    }
+    if (!q->q_n && (sent = netqueue_trysend(fd, buf, n)) < 0)
+        return (-1);
+    if (sent < n)
+        netqueue_append(q, buf + sent, n - sent);
+    return (0);
+}
+
+static void netqueue_clear(t_netqueue *q)
+{
+    if (q->q_buf)
+        t_freebytes(q->q_buf, q->q_size);
+    memset(q, 0, sizeof(*q));
+}
+
+    /* as netqueue_send() for "x", posting when it starts dropping */
+static int netsend_queuesend(t_netsend *x, t_netqueue *q, int fd,
+    const char *buf, int n)
+{
+    int ret = netqueue_send(q, fd, buf, n, x->x_sndqueue,
+        x->x_overflowblock);
+    if (ret == 1)
+    {
+        if (!q->q_dropping)
+            pd_error(x, "%s: output queue full; dropping messages",
+                class_getname(pd_class(&x->x_obj.ob_pd)));
+        q->q_dropping = 1;
+    }
+    else if (!ret)
+        q->q_dropping = 0;
+    return (ret);
+}
+
+    /* output the number of bytes waiting, if it changed */
+static void netsend_reportqueued(t_netsend *x, int queued)
+{
+    if (x->x_queuedout && queued != x->x_lastqueued)
+        outlet_float(x->x_queuedout, (x->x_lastqueued = queued));
+}
+
+static void netsend_initqueue(t_netsend *x, t_method flushfn)
+{
+    memset(&x->x_queue, 0, sizeof(x->x_queue));
+    x->x_sndqueue = NETQUEUE_SIZE;
+    x->x_overflowblock = 0;
+    x->x_lastqueued = 0;
+    x->x_queuedout = NULL;
+    x->x_flushclock = clock_new(x, flushfn);
+}
+
+    /* set the most bytes to hold for a peer that isn't keeping up */
+static void netsend_sndqueue(t_netsend *x, t_floatarg f)
+{
+    x->x_sndqueue = (f > 0 ? (int)f : NETQUEUE_SIZE);
+}
+
+    /* format a message for sending: bytes for binary, else FUDI text.
+    Free it with netsend_freeformat(). */
+static void netsend_format(t_netsend *x, int argc, t_atom *argv,
+    char **bufp, int *lengthp)
+{
+    if (x->x_bin)
+    {
+        int i;
+        *bufp = (char *)t_getbytes(argc);
+        for (i = 0; i < argc; i++)
+            ((unsigned char *)*bufp)[i] = atom_getfloatarg(i, argc, argv);
+        *lengthp = argc;
+    }
+    else
+    {
+        t_binbuf *b = binbuf_new();
+        t_atom at;
+        binbuf_add(b, argc, argv);
+        SETSEMI(&at);
+        binbuf_add(b, 1, &at);
+        binbuf_gettext(b, bufp, lengthp);
+        binbuf_free(b);
+    }
+}
+
+static void netsend_freeformat(char *buf, int length)
+{
+    t_freebytes(buf, length);
+}
+
 /* ----------------------------- netsend ------------------------- */
 
+    /* OSC ("-o") goes with UDP and implies binary for what comes back */
+static void netsend_checkosc(t_netsend *x)
+{
+    if (!x->x_osc)
+        return;
+    if (x->x_protocol != SOCK_DGRAM)
+    {
+        pd_error(x, "%s: -o (OSC) needs -u (UDP); ignored",
+            class_getname(pd_class(&x->x_obj.ob_pd)));
+        x->x_osc = 0;
+    }
+    else x->x_bin = 1;
+}
+
+    /* clock callback: send what we can of the queued output */
+static void netsend_flush(t_netsend *x)
+{
+    if (x->x_sockfd >= 0 && netqueue_flush(&x->x_queue, x->x_sockfd) < 0)
+    {
+        sys_sockerror("netsend: send");
+        netsend_disconnect(x);
+        return;
+    }
+    if (x->x_queue.q_n)
+        clock_delay(x->x_flushclock, NETQUEUE_FLUSHMS);
+    netsend_reportqueued(x, x->x_queue.q_n);
+}
+
 static void *netsend_new(t_symbol *s, int argc, t_atom *argv)
 {
     t_netsend *x = (t_netsend *)pd_new(netsend_class);
+    int queued = 0;
     outlet_new(&x->x_obj, &s_float);
     x->x_protocol = SOCK_STREAM;
     x->x_bin = 0;
+    x->x_osc = 0;
+    x->x_oscpending = NULL;
     if (argc && argv->a_type == A_FLOAT)
     {
         x->x_protocol = (argv->a_w.w_float != 0 ? SOCK_DGRAM : SOCK_STREAM);
@@ -94,6 +361,10 @@ static void *netsend_new(t_symbol *s, int argc, t_atom *argv)
             x->x_bin = 1;
         else if (!strcmp(argv->a_w.w_symbol->s_name, "-u"))
             x->x_protocol = SOCK_DGRAM;
+        else if (!strcmp(argv->a_w.w_symbol->s_name, "-q"))
+            queued = 1;
+        else if (!strcmp(argv->a_w.w_symbol->s_name, "-o"))
+            x->x_osc = 1;
         else
         {
             pd_error(x, "netsend: unknown flag ...");
@@ -106,81 +377,168 @@ static void *netsend_new(t_symbol *s, int argc, t_atom *argv)
         pd_error(x, "netsend: extra arguments ignored:");
         postatom(argc, argv); endpost();
     }
+    netsend_checkosc(x);
     x->x_sockfd = -1;
     x->x_receiver = NULL;
     x->x_msgout = outlet_new(&x->x_obj, &s_anything);
     x->x_connectout = NULL;
     x->x_fromout = NULL;
     x->x_timeout = 10;
+    x->x_udpbuf = NULL;
     memset(&x->x_server, 0, sizeof(struct sockaddr_storage));
+    netsend_initqueue(x, (t_method)netsend_flush);
+    if (queued && x->x_protocol == SOCK_STREAM)
+        x->x_queuedout = outlet_new(&x->x_obj, &s_float);
     return (x);
 }
 
-static void netsend_readbin(t_netsend *x, int fd)
+    /* most datagrams we take from one socket per poll (as in s_inter.c) */
+#define UDP_MAXPERPOLL (8 * SOCKET_MAXDATAGRAMS)
+
+    /* close the socket after a read error or the peer hanging up */
+static void netsend_readclosed(t_netsend *x, int fd)
 {
-    unsigned char inbuf[INBUFSIZE];
-    int ret = 0, readbytes = 0, i;
-    struct sockaddr_storage fromaddr = {0};
-    socklen_t fromaddrlen = sizeof(struct sockaddr_storage);
-    if (!x->x_msgout)
+    if (x->x_obj.ob_pd == netreceive_class)
     {
-        bug("netsend_readbin");
-        return;
+        sys_rmpollfn(fd);
+        sys_closesocket(fd);
+        netreceive_notify((t_netreceive *)x, fd);
     }
-    while (1)
+    else /* properly shutdown netsend */
+        netsend_disconnect(x);
+}
+
+/* With "-o" datagrams are decoded as OSC straight from the receive buffer
+and come out as [oscparse] would output them.  Messages in bundles wait
+until their timetag, which we take to be on the system clock: the delay
+until then (as the clock says now) is counted off in logical time. */
+
+static void oscpending_free(t_oscpending *p)
+{
+    clock_free(p->p_clock);
+    freebytes(p->p_argv, p->p_argc * sizeof(t_atom));
+    freebytes(p, sizeof(*p));
+}
+
+static void netsend_freepending(t_netsend *x)
+{
+    while (x->x_oscpending)
     {
-        if (x->x_protocol == SOCK_DGRAM)
-            ret = (int)recvfrom(fd, inbuf, INBUFSIZE, 0,
-                (struct sockaddr *)&fromaddr, &fromaddrlen);
-        else
-            ret = (int)recv(fd, inbuf, INBUFSIZE, 0);
-        if (ret <= 0)
+        t_oscpending *p = x->x_oscpending;
+        x->x_oscpending = p->p_next;
+        oscpending_free(p);
+    }
+}
+
+static void oscpending_tick(t_oscpending *p)
+{
+    t_netsend *x = p->p_owner;
+    t_oscpending **pp;
+    for (pp = &x->x_oscpending; *pp != p; pp = &(*pp)->p_next)
+        ;
+    *pp = p->p_next;
+    outlet_list(x->x_msgout, 0, p->p_argc, p->p_argv);
+    oscpending_free(p);
+}
+
+static void netsend_oscmessage(void *z, int argc, t_atom *argv,
+    uint64_t timetag)
+{
+    t_netsend *x = (t_netsend *)z;
+    double delay = 0;
+    if (timetag > 1)    /* 0 and 1 mean "immediately" */
+        delay = 1000 * ((timetag >> 32) + (timetag & 0xffffffff) *
+            (1. / 4294967296.) - NTP_UNIXOFFSET - x->x_oscwall);
+    if (delay > 0)
+    {
+        t_oscpending *p = (t_oscpending *)getbytes(sizeof(*p));
+        p->p_clock = clock_new(p, (t_method)oscpending_tick);
+        p->p_owner = x;
+        p->p_argc = argc;
+        p->p_argv = (t_atom *)copybytes(argv, argc * sizeof(t_atom));
+        p->p_next = x->x_oscpending;
+        x->x_oscpending = p;
+        clock_delay(p->p_clock, delay);
+    }
+    else outlet_list(x->x_msgout, 0, argc, argv);
+}
+
+    /* binary UDP: output each pending datagram as a list of bytes, taking
+    them in a batch at a time. */
+static void netsend_readbinudp(t_netsend *x, int fd)
+{
+    struct sockaddr_storage addrs[SOCKET_MAXDATAGRAMS];
+    int sizes[SOCKET_MAXDATAGRAMS], ret, i, j, ndone = 0;
+    t_atom *ap = (t_atom *)alloca(INBUFSIZE * sizeof(t_atom));
+    if (!x->x_udpbuf)
+        x->x_udpbuf = (unsigned char *)getbytes(
+            SOCKET_MAXDATAGRAMS * INBUFSIZE);
+    do
+    {
+        ret = socket_recv_datagrams(fd, (char *)x->x_udpbuf, INBUFSIZE,
+            SOCKET_MAXDATAGRAMS, sizes, (x->x_fromout ? addrs : 0));
+        if (ret < 0)
         {
-            if (ret < 0)
-            {
                 /* only close a UDP socket if there really was an error.
                 (socket_errno_udp() ignores some error codes) */
-                if (x->x_protocol == SOCK_DGRAM && !socket_errno_udp())
-                    return;
-                sys_sockerror("recv (bin)");
-            }
-            if (x->x_obj.ob_pd == netreceive_class)
+            if (socket_errno_udp())
             {
-                sys_rmpollfn(fd);
-                sys_closesocket(fd);
-                netreceive_notify((t_netreceive *)x, fd);
+                sys_sockerror("recv (bin)");
+                netsend_readclosed(x, fd);
             }
-            else /* properly shutdown netsend */
-                netsend_disconnect(x);
             return;
         }
-        if (x->x_protocol == SOCK_DGRAM)
+        for (i = 0; i < ret; i++)
         {
-            t_atom *ap;
+            unsigned char *inbuf = x->x_udpbuf + i * INBUFSIZE;
+            if (sizes[i] <= 0)
+                continue;
             if (x->x_fromout)
-                outlet_sockaddr(x->x_fromout, (const struct sockaddr *)&fromaddr);
-            ap = (t_atom *)alloca(ret * sizeof(t_atom));
-            for (i = 0; i < ret; i++)
-                SETFLOAT(ap+i, inbuf[i]);
-            outlet_list(x->x_msgout, 0, ret, ap);
-            readbytes += ret;
-            /* throttle */
-            if (readbytes >= INBUFSIZE)
-                return;
-            /* check for pending UDP packets */
-            if (socket_bytes_available(fd) <= 0)
-                return;
-        }
-        else
-        {
-            if (x->x_fromout &&
-                !getpeername(fd, (struct sockaddr *)&fromaddr, &fromaddrlen))
-                    outlet_sockaddr(x->x_fromout, (const struct sockaddr *)&fromaddr);
-            for (i = 0; i < ret; i++)
-                outlet_float(x->x_msgout, inbuf[i]);
-            return;
+                outlet_sockaddr(x->x_fromout, (const struct sockaddr *)&addrs[i]);
+            if (x->x_osc)
+            {
+                x->x_oscwall = osc_walltime();
+                osc_decode(x, class_getname(pd_class(&x->x_obj.ob_pd)),
+                    inbuf, sizes[i], netsend_oscmessage, 1);
+                continue;
+            }
+            for (j = 0; j < sizes[i]; j++)
+                SETFLOAT(ap+j, inbuf[j]);
+            outlet_list(x->x_msgout, 0, sizes[i], ap);
         }
+        ndone += ret;
+    } while (ret == SOCKET_MAXDATAGRAMS && ndone < UDP_MAXPERPOLL);
+}
+
+static void netsend_readbin(t_netsend *x, int fd)
+{
+    unsigned char inbuf[INBUFSIZE];
+    int ret = 0, i;
+    struct sockaddr_storage fromaddr = {0};
+    socklen_t fromaddrlen = sizeof(struct sockaddr_storage);
+    if (!x->x_msgout)
+    {
+        bug("netsend_readbin");
+        return;
+    }
+    if (x->x_protocol == SOCK_DGRAM)
+    {
+        netsend_readbinudp(x, fd);
+        return;
     }
+    ret = (int)recv(fd, inbuf, INBUFSIZE, 0);
+    if (ret <= 0)
+    {
+        if (ret < 0)
+            sys_sockerror("recv (bin)");
+        netsend_readclosed(x, fd);
+        return;
+    }
+    if (x->x_fromout &&
+        !getpeername(fd, (struct sockaddr *)&fromaddr, &fromaddrlen))
+            outlet_sockaddr(x->x_fromout, (const struct sockaddr *)&fromaddr);
+    for (i = 0; i < ret; i++)
+        outlet_float(x->x_msgout, inbuf[i]);
 }
 
 static void netsend_read(void *z, t_binbuf *b)
@@ -230,7 +588,10 @@ static void netsend_notify(void *z, int fd)
             socketreceiver_free(x->x_receiver);
         x->x_receiver = NULL;
         memset(&x->x_server, 0, sizeof(struct sockaddr_storage));
+        netqueue_clear(&x->x_queue);
+        clock_unset(x->x_flushclock);
         outlet_float(x->x_obj.ob_outlet, 0);
+        netsend_reportqueued(x, 0);
     }
 }
 
@@ -382,6 +743,10 @@ static void netsend_connect(t_netsend *x, t_symbol *s, int argc, t_atom *argv)
     }
 
     x->x_sockfd = sockfd;
+#ifndef MSG_DONTWAIT
+    if (x->x_protocol == SOCK_STREAM)
+        socket_set_nonblocking(sockfd, 1);
+#endif
     if (x->x_msgout) /* add polling function for return messages */
     {
         if (x->x_bin)
@@ -422,24 +787,15 @@ static int netsend_dosend(t_netsend *x, int sockfd, int argc, t_atom *argv)
 {
     char *buf, *bp;
     int length, sent, fail = 0;
-    t_binbuf *b = 0;
-    if (x->x_bin)
-    {
-        int i;
-        buf = alloca(argc);
-        for (i = 0; i < argc; i++)
-            ((unsigned char *)buf)[i] = atom_getfloatarg(i, argc, argv);
-        length = argc;
-    }
-    else
+    if (x->x_osc)
     {
-        t_atom at;
-        b = binbuf_new();
-        binbuf_add(b, argc, argv);
-        SETSEMI(&at);
-        binbuf_add(b, 1, &at);
-        binbuf_gettext(b, &buf, &length);
+        if ((length = osc_encode(argc, argv, &buf)) < 0)
+        {
+            pd_error(x, "netsend: OSC messages need an address");
+            return (0);
+        }
     }
+    else netsend_format(x, argc, argv, &buf, &length);
     for (bp = buf, sent = 0; sent < length;)
     {
         static double lastwarntime;
@@ -483,22 +839,46 @@ static int netsend_dosend(t_netsend *x, int sockfd, int argc, t_atom *argv)
             bp += res;
         }
     }
-    done:
-    if (!x->x_bin)
-    {
-        t_freebytes(buf, length);
-        binbuf_free(b);
-    }
+    netsend_freeformat(buf, length);
     return (fail);
 }
 
+    /* TCP goes through the output queue, so that a slow peer doesn't
+    block the scheduler; datagrams are sent right away. */
 static void netsend_send(t_netsend *x, t_symbol *s, int argc, t_atom *argv)
 {
-    if (x->x_sockfd >= 0)
+    if (x->x_sockfd < 0)
+        return;
+    if (x->x_protocol == SOCK_STREAM)
     {
-        if (netsend_dosend(x, x->x_sockfd, argc, argv))
+        char *buf;
+        int length, queued = x->x_queue.q_n, ret;
+        netsend_format(x, argc, argv, &buf, &length);
+        ret = netsend_queuesend(x, &x->x_queue, x->x_sockfd, buf, length);
+        netsend_freeformat(buf, length);
+        if (ret < 0)
+        {
+            sys_sockerror("send");
             netsend_disconnect(x);
+            return;
+        }
+        if (x->x_queue.q_n && !queued)
+            clock_delay(x->x_flushclock, NETQUEUE_FLUSHMS);
+        netsend_reportqueued(x, x->x_queue.q_n);
     }
+    else if (netsend_dosend(x, x->x_sockfd, argc, argv))
+        netsend_disconnect(x);
+}
+
+    /* what to do with a message that would overfill the queue: "drop" it
+    or "block" until the queue has gone out (as netsend used to always) */
+static void netsend_overflow(t_netsend *x, t_symbol *s)
+{
+    if (!strcmp(s->s_name, "block"))
+        x->x_overflowblock = 1;
+    else if (!strcmp(s->s_name, "drop"))
+        x->x_overflowblock = 0;
+    else pd_error(x, "netsend: overflow: expected 'drop' or 'block'");
 }
 
 static void netsend_timeout(t_netsend *x, t_float timeout)
@@ -510,6 +890,10 @@ static void netsend_timeout(t_netsend *x, t_float timeout)
 static void netsend_free(t_netsend *x)
 {
     netsend_disconnect(x);
+    netsend_freepending(x);
+    clock_free(x->x_flushclock);
+    if (x->x_udpbuf)
+        freebytes(x->x_udpbuf, SOCKET_MAXDATAGRAMS * INBUFSIZE);
 }
 
 static void netsend_setup(void)
@@ -526,35 +910,93 @@ static void netsend_setup(void)
     class_addlist(netsend_class, (t_method)netsend_send);
     class_addmethod(netsend_class, (t_method)netsend_timeout,
         gensym("timeout"), A_DEFFLOAT, 0);
+    class_addmethod(netsend_class, (t_method)netsend_sndqueue,
+        gensym("sndqueue"), A_FLOAT, 0);
+    class_addmethod(netsend_class, (t_method)netsend_overflow,
+        gensym("overflow"), A_SYMBOL, 0);
 }
 
 /* ----------------------------- netreceive ------------------------- */
 
+static t_netclient *netreceive_findclient(t_netreceive *x, int fd)
+{
+    if (fd >= 0 && fd < x->x_nfdindex && x->x_fdindex[fd] >= 0)
+        return (&x->x_clients[x->x_fdindex[fd]]);
+    return (0);
+}
+
+static t_netclient *netreceive_addclient(t_netreceive *x, int fd)
+{
+    t_netclient *c;
+    if (x->x_nconnections == x->x_clientsize)
+    {
+        int newsize = (x->x_clientsize ? 2 * x->x_clientsize : 16);
+        x->x_clients = (t_netclient *)t_resizebytes(x->x_clients,
+            x->x_clientsize * sizeof(t_netclient),
+                newsize * sizeof(t_netclient));
+        x->x_clientsize = newsize;
+    }
+    if (fd >= x->x_nfdindex)
+    {
+        int i, newsize = 2 * fd + 16;
+        x->x_fdindex = (int *)t_resizebytes(x->x_fdindex,
+            x->x_nfdindex * sizeof(int), newsize * sizeof(int));
+        for (i = x->x_nfdindex; i < newsize; i++)
+            x->x_fdindex[i] = -1;
+        x->x_nfdindex = newsize;
+    }
+    c = &x->x_clients[x->x_nconnections];
+    memset(c, 0, sizeof(*c));
+    c->c_fd = fd;
+    x->x_fdindex[fd] = x->x_nconnections++;
+    return (c);
+}
+
+    /* forget a client, moving the last one into its slot */
+static void netreceive_dropclient(t_netreceive *x, t_netclient *c)
+{
+    int i = (int)(c - x->x_clients);
+    if (c->c_receiver)
+        socketreceiver_free(c->c_receiver);
+    x->x_queued -= c->c_queue.q_n;
+    netqueue_clear(&c->c_queue);
+    x->x_fdindex[c->c_fd] = -1;
+    if (i != --x->x_nconnections)
+    {
+        *c = x->x_clients[x->x_nconnections];
+        x->x_fdindex[c->c_fd] = i;
+    }
+}
+
 static void netreceive_notify(t_netreceive *x, int fd)
 {
-    int i;
+    t_netclient *c = netreceive_findclient(x, fd);
+    if (c)
+        netreceive_dropclient(x, c);
+    outlet_float(x->x_ns.x_connectout, x->x_nconnections);
+    netsend_reportqueued(&x->x_ns, x->x_queued);
+}
+
+    /* clock callback: send what we can of the queued output.  After an
+    error we give up on the queue; the read side will find the connection
+    closed and drop the client. */
+static void netreceive_flush(t_netreceive *x)
+{
+    int i, res;
     for (i = 0; i < x->x_nconnections; i++)
     {
-        if (x->x_connections[i] == fd)
+        t_netqueue *q = &x->x_clients[i].c_queue;
+        int before = q->q_n;
+        if (netqueue_flush(q, x->x_clients[i].c_fd) < 0)
         {
-            memmove(x->x_connections+i, x->x_connections+(i+1),
-                sizeof(int) * (x->x_nconnections - (i+1)));
-            x->x_connections = (int *)t_resizebytes(x->x_connections,
-                x->x_nconnections * sizeof(int),
-                    (x->x_nconnections-1) * sizeof(int));
-
-            if (x->x_receivers[i])
-                socketreceiver_free(x->x_receivers[i]);
-            memmove(x->x_receivers+i, x->x_receivers+(i+1),
-                sizeof(t_socketreceiver*) * (x->x_nconnections - (i+1)));
-
-            x->x_receivers = (t_socketreceiver **)t_resizebytes(x->x_receivers,
-                x->x_nconnections * sizeof(t_socketreceiver*),
-                    (x->x_nconnections-1) * sizeof(t_socketreceiver*));
-            x->x_nconnections--;
+            sys_sockerror("netreceive: send");
+            netqueue_clear(q);
         }
+        x->x_queued -= before - q->q_n;
     }
-    outlet_float(x->x_ns.x_connectout, x->x_nconnections);
+    if (x->x_queued)
+        clock_delay(x->x_ns.x_flushclock, NETQUEUE_FLUSHMS);
+    netsend_reportqueued(&x->x_ns, x->x_queued);
 }
 
     /* socketreceiver from sockaddr_in */
@@ -571,15 +1013,10 @@ static void netreceive_connectpoll(t_netreceive *x)
     if (fd < 0) post("netreceive: accept failed");
     else
     {
-        int nconnections = x->x_nconnections+1;
-
-        x->x_connections = (int *)t_resizebytes(x->x_connections,
-            x->x_nconnections * sizeof(int), nconnections * sizeof(int));
-        x->x_connections[x->x_nconnections] = fd;
-        x->x_receivers = (t_socketreceiver **)t_resizebytes(x->x_receivers,
-            x->x_nconnections * sizeof(t_socketreceiver*),
-            nconnections * sizeof(t_socketreceiver*));
-        x->x_receivers[x->x_nconnections] = NULL;
+        t_netclient *c = netreceive_addclient(x, fd);
+#ifndef MSG_DONTWAIT
+        socket_set_nonblocking(fd, 1);
+#endif
         if (x->x_ns.x_bin)
             sys_addpollfn(fd, (t_fdpollfn)netsend_readbin, x);
         else
@@ -591,30 +1028,23 @@ static void netreceive_connectpoll(t_netreceive *x)
                 socketreceiver_set_fromaddrfn(y,
                     (t_socketfromaddrfn)netreceive_fromaddr);
             sys_addpollfn(fd, (t_fdpollfn)socketreceiver_read, y);
-            x->x_receivers[x->x_nconnections] = y;
+            c->c_receiver = y;
         }
-        outlet_float(x->x_ns.x_connectout, (x->x_nconnections = nconnections));
+        outlet_float(x->x_ns.x_connectout, x->x_nconnections);
     }
 }
 
 static void netreceive_closeall(t_netreceive *x)
 {
-    int i;
-    for (i = 0; i < x->x_nconnections; i++)
+    while (x->x_nconnections)
     {
-        sys_rmpollfn(x->x_connections[i]);
-        sys_closesocket(x->x_connections[i]);
-        if (x->x_receivers[i])
-        {
-            socketreceiver_free(x->x_receivers[i]);
-            x->x_receivers[i] = NULL;
-        }
+        t_netclient *c = &x->x_clients[x->x_nconnections - 1];
+        sys_rmpollfn(c->c_fd);
+        sys_closesocket(c->c_fd);
+        netreceive_dropclient(x, c);
     }
-    x->x_connections = (int *)t_resizebytes(x->x_connections,
-        x->x_nconnections * sizeof(int), 0);
-    x->x_receivers = (t_socketreceiver**)t_resizebytes(x->x_receivers,
-                x->x_nconnections * sizeof(t_socketreceiver*), 0);
-    x->x_nconnections = 0;
+    clock_unset(x->x_ns.x_flushclock);
+    netsend_reportqueued(&x->x_ns, x->x_queued);
     if (x->x_ns.x_sockfd >= 0)
     {
         sys_rmpollfn(x->x_ns.x_sockfd);
@@ -687,11 +1117,11 @@ static void netreceive_listen(t_netreceive *x, t_symbol *s, int argc, t_atom *ar
         if (socket_set_boolopt(sockfd, SOL_SOCKET, SO_REUSEADDR, 1) < 0)
             post("netreceive: setsockopt (SO_REUSEADDR) failed");
     #endif
-    #if 0
-        intarg = 0;
-        if (socket_set_boolopt(sockfd, SOL_SOCKET, SO_RCVBUF, 0) < 0)
-            post("netreceive: setsockopt (SO_RCVBUF) failed");
-    #endif
+        /* a bigger receive buffer keeps bursts of datagrams from being
+        dropped while Pd is busy computing a tick */
+        if (x->x_rcvbuf > 0 &&
+            socket_set_boolopt(sockfd, SOL_SOCKET, SO_RCVBUF, x->x_rcvbuf) < 0)
+                post("netreceive: setsockopt (SO_RCVBUF) failed");
         if (protocol == SOCK_STREAM)
         {
             /* stream (TCP) sockets are set NODELAY */
@@ -823,33 +1253,70 @@ static void netreceive_listen(t_netreceive *x, t_symbol *s, int argc, t_atom *ar
     }
 }
 
+    /* send to all clients.  The message is formatted once, and nobody
+    waits for a slow client: what it can't take now is queued for it. */
 static void netreceive_send(t_netreceive *x,
     t_symbol *s, int argc, t_atom *argv)
 {
-    int i;
+    char *buf;
+    int i, length, queued = x->x_queued;
     if (x->x_ns.x_protocol != SOCK_STREAM)
     {
         pd_error(x, "netreceive: 'send' only works for TCP");
         return;
     }
+    if (!x->x_nconnections)
+        return;
+    netsend_format(&x->x_ns, argc, argv, &buf, &length);
     for (i = 0; i < x->x_nconnections; i++)
     {
-        if (netsend_dosend(&x->x_ns, x->x_connections[i], argc, argv))
+        t_netqueue *q = &x->x_clients[i].c_queue;
+        int before = q->q_n;
+        if (netsend_queuesend(&x->x_ns, q, x->x_clients[i].c_fd,
+            buf, length) < 0)
+        {
+            sys_sockerror("netreceive: send");
             pd_error(x, "netreceive: send message failed");
                 /* should we now close the connection? */
+        }
+        x->x_queued += q->q_n - before;
     }
+    netsend_freeformat(buf, length);
+        /* the clock is set whenever something is queued */
+    if (x->x_queued && !queued)
+        clock_delay(x->x_ns.x_flushclock, NETQUEUE_FLUSHMS);
+    netsend_reportqueued(&x->x_ns, x->x_queued);
+}
+
+    /* set the socket receive buffer size (the OS may round it or cap it);
+    if we're listening, apply it right away, else at the next "listen". */
+static void netreceive_rcvbuf(t_netreceive *x, t_floatarg f)
+{
+    x->x_rcvbuf = (f > 0 ? (int)f : 0);
+    if (x->x_rcvbuf && x->x_ns.x_sockfd >= 0 &&
+        socket_set_boolopt(x->x_ns.x_sockfd, SOL_SOCKET, SO_RCVBUF,
+            x->x_rcvbuf) < 0)
+                pd_error(x, "netreceive: setsockopt (SO_RCVBUF) failed");
 }
 
 static void *netreceive_new(t_symbol *s, int argc, t_atom *argv)
 {
     t_netreceive *x = (t_netreceive *)pd_new(netreceive_class);
-    int from = 0;
+    int from = 0, queued = 0;
     x->x_ns.x_protocol = SOCK_STREAM;
     x->x_old = 0;
+    x->x_rcvbuf = 0;
+    x->x_ns.x_udpbuf = NULL;
+    x->x_ns.x_osc = 0;
+    x->x_ns.x_oscpending = NULL;
     x->x_ns.x_bin = 0;
     x->x_nconnections = 0;
-    x->x_connections = (int *)t_getbytes(0);
-    x->x_receivers = (t_socketreceiver **)t_getbytes(0);
+    x->x_clients = (t_netclient *)t_getbytes(0);
+    x->x_clientsize = 0;
+    x->x_fdindex = (int *)t_getbytes(0);
+    x->x_nfdindex = 0;
+    x->x_queued = 0;
+    netsend_initqueue(&x->x_ns, (t_method)netreceive_flush);
     x->x_ns.x_sockfd = -1;
     if (argc && argv->a_type == A_FLOAT)
     {
@@ -870,6 +1337,10 @@ static void *netreceive_new(t_symbol *s, int argc, t_atom *argv)
                 x->x_ns.x_protocol = SOCK_DGRAM;
             else if (!strcmp(argv->a_w.w_symbol->s_name, "-f"))
                 from = 1;
+            else if (!strcmp(argv->a_w.w_symbol->s_name, "-q"))
+                queued = 1;
+            else if (!strcmp(argv->a_w.w_symbol->s_name, "-o"))
+                x->x_ns.x_osc = 1;
             else
             {
                 pd_error(x, "netreceive: unknown flag ...");
@@ -878,6 +1349,7 @@ static void *netreceive_new(t_symbol *s, int argc, t_atom *argv)
             argc--; argv++;
         }
     }
+    netsend_checkosc(&x->x_ns);
     if (x->x_old)
     {
         /* old style, nonsecure version */
@@ -892,6 +1364,8 @@ static void *netreceive_new(t_symbol *s, int argc, t_atom *argv)
         x->x_ns.x_fromout = outlet_new(&x->x_ns.x_obj, &s_symbol);
     else
         x->x_ns.x_fromout = NULL;
+    if (queued && x->x_ns.x_protocol == SOCK_STREAM)
+        x->x_ns.x_queuedout = outlet_new(&x->x_ns.x_obj, &s_float);
         /* create a socket */
     netreceive_listen(x, 0, argc, argv); /* pass arguments */
 
@@ -901,6 +1375,12 @@ static void *netreceive_new(t_symbol *s, int argc, t_atom *argv)
 static void netreceive_free(t_netreceive *x)
 {
     netreceive_closeall(x);
+    netsend_freepending(&x->x_ns);
+    clock_free(x->x_ns.x_flushclock);
+    t_freebytes(x->x_clients, x->x_clientsize * sizeof(t_netclient));
+    t_freebytes(x->x_fdindex, x->x_nfdindex * sizeof(int));
+    if (x->x_ns.x_udpbuf)
+        freebytes(x->x_ns.x_udpbuf, SOCKET_MAXDATAGRAMS * INBUFSIZE);
 }
 
 static void netreceive_setup(void)
@@ -910,13 +1390,816 @@ static void netreceive_setup(void)
         sizeof(t_netreceive), 0, A_GIMME, 0);
     class_addmethod(netreceive_class, (t_method)netreceive_listen,
         gensym("listen"), A_GIMME, 0);
+    class_addmethod(netreceive_class, (t_method)netreceive_rcvbuf,
+        gensym("rcvbuf"), A_FLOAT, 0);
+    class_addmethod(netreceive_class, (t_method)netsend_sndqueue,
+        gensym("sndqueue"), A_FLOAT, 0);
     class_addmethod(netreceive_class, (t_method)netreceive_send,
         gensym("send"), A_GIMME, 0);
     class_addlist(netreceive_class, (t_method)netreceive_send);
 }
 
+/* ----------------------- netsend~ and netreceive~ ----------------------- */
+
+/* Audio over UDP between Pd instances.  netsend~ hands each DSP block to a
+thread of its own through a lock-free ring (see s_audio_paring.h), and that
+thread cuts the stream into datagrams of whole "chunks" of NETAUDIO_CHUNK
+frames.  netreceive~'s thread drops each chunk it gets into a ring of chunk
+slots, the jitter buffer, stamping the slot with the chunk's number after
+the samples are in.  The DSP side reads "latency" msec behind the newest
+frame received.  As long as the average distance stays within a quarter of
+that, the samples come out exactly as they went in; beyond it, the reading
+rate is nudged up or down (by a part in a thousand at most, interpolating)
+so that it keeps its distance even if the two machines' sample clocks
+drift apart.  Missing chunks play as silence.
+
+Each datagram starts with a 20-byte header, all little-endian:
+    "Pd~" and a version byte
+    number of the first frame (32 bits, a multiple of NETAUDIO_CHUNK)
+    channel count and frame count (16 bits each)
+    sample rate (32 bits)
+    flags (NETAUDIO_COMPRESSED) and 3 bytes of padding
+followed by the samples as 32-bit floats, one channel after another.  If
+compressed, each channel's samples are XORed with the previous one's and
+only the low bytes that aren't zero are sent, their count (0-4) going in a
+nibble per sample ahead of the channel's data.  Nearby samples share their
+sign, exponent and high mantissa bits, so this is lossless and usually
+saves a third or so; if it wouldn't save anything the datagram goes out
+uncompressed. */
+
+#define NETAUDIO_VERSION 1
+#define NETAUDIO_HEADER 20
+#define NETAUDIO_COMPRESSED 1
+#define NETAUDIO_CHUNK 16           /* frames per chunk */
+#define NETAUDIO_PACKETBYTES 1400   /* aim to keep datagrams under this */
+#define NETAUDIO_MAXCHANS 64
+#define NETAUDIO_SENDFRAMES 8192    /* netsend~'s ring, in frames */
+#define NETAUDIO_NCHUNK 2048        /* netreceive~'s jitter buffer, in chunks */
+#define NETAUDIO_MAXDRIFT 0.001     /* most we'll speed up or slow down */
+#define NETAUDIO_DRIFTGAIN 1e-5     /* rate change per frame of latency error */
+
+#ifdef SYS_RINGBUF_C11
+#define NETAUDIO_LOAD(a) atomic_load_explicit(&(a), memory_order_acquire)
+#define NETAUDIO_STORE(a, v) \
+    atomic_store_explicit(&(a), (v), memory_order_release)
+#define NETAUDIO_FENCE() atomic_thread_fence(memory_order_seq_cst)
+#else
+#define NETAUDIO_LOAD(a) (a)
+#define NETAUDIO_STORE(a, v) ((a) = (v))
+#define NETAUDIO_FENCE() __sync_synchronize()
+#endif
+
+static void netaudio_put32(unsigned char *p, unsigned int u)
+{
+    p[0] = u; p[1] = u >> 8; p[2] = u >> 16; p[3] = u >> 24;
+}
+
+static unsigned int netaudio_get32(const unsigned char *p)
+{
+    return (p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24));
+}
+
+    /* frames per datagram: as many whole chunks as fit, but at least one */
+static int netaudio_packetframes(int nchans)
+{
+    int nchunks = (NETAUDIO_PACKETBYTES - NETAUDIO_HEADER) /
+        (NETAUDIO_CHUNK * nchans * (int)sizeof(float));
+    return ((nchunks < 1 ? 1 : nchunks) * NETAUDIO_CHUNK);
+}
+
+    /* pack interleaved frames into a datagram and return its size; "packet"
+    must hold NETAUDIO_HEADER bytes plus 4.5 bytes per sample */
+static int netaudio_encode(unsigned char *packet, const float *frames,
+    int nchans, int nframes, unsigned int frame, int sr, int compress)
+{
+    unsigned char *out = packet + NETAUDIO_HEADER;
+    int ch, i, rawsize = nchans * nframes * 4;
+    packet[0] = 'P'; packet[1] = 'd'; packet[2] = '~';
+    packet[3] = NETAUDIO_VERSION;
+    netaudio_put32(packet + 4, frame);
+    packet[8] = nchans; packet[9] = nchans >> 8;
+    packet[10] = nframes; packet[11] = nframes >> 8;
+    netaudio_put32(packet + 12, sr);
+    packet[16] = packet[17] = packet[18] = packet[19] = 0;
+    if (compress)
+    {
+        for (ch = 0; ch < nchans; ch++)
+        {
+            unsigned char *nibbles = out;
+            unsigned int prev = 0;
+            memset(nibbles, 0, (nframes + 1) / 2);
+            out += (nframes + 1) / 2;
+            for (i = 0; i < nframes; i++)
+            {
+                union {float f; unsigned int u;} sample;
+                unsigned int diff;
+                int nbytes = 0;
+                sample.f = frames[i * nchans + ch];
+                diff = sample.u ^ prev;
+                prev = sample.u;
+                while (diff)
+                    *out++ = diff, diff >>= 8, nbytes++;
+                nibbles[i >> 1] |= nbytes << ((i & 1) << 2);
+            }
+            if (out - (packet + NETAUDIO_HEADER) >= rawsize)
+                break;
+        }
+        if (ch == nchans)
+        {
+            packet[16] = NETAUDIO_COMPRESSED;
+            return (out - packet);
+        }
+        out = packet + NETAUDIO_HEADER;
+    }
+    for (ch = 0; ch < nchans; ch++)
+        for (i = 0; i < nframes; i++)
+    {
+        union {float f; unsigned int u;} sample;
+        sample.f = frames[i * nchans + ch];
+        netaudio_put32(out, sample.u);
+        out += 4;
+    }
+    return (out - packet);
+}
+
+/* ---------------- netsend~ ---------------- */
+
+static t_class *netsend_tilde_class;
+
+typedef struct _netsend_tilde
+{
+    t_object x_obj;
+    t_float x_f;
+    int x_nchans;
+    int x_compress;
+    int x_sockfd;
+    int x_sr;
+    int x_vecsize;          /* size of x_frames in frames */
+    float *x_frames;        /* DSP block, interleaved for the ring */
+    char *x_ringbuf;
+    sys_ringbuf x_ring;
+    long x_ringsize;
+    int x_packetframes;
+    unsigned int x_frame;   /* number of the next frame to send */
+    int x_running;          /* true while the thread is */
+    int x_quit;             /* set to ask the thread to stop */
+    pthread_t x_thread;
+    pthread_mutex_t x_mutex;
+    pthread_cond_t x_cond;
+} t_netsend_tilde;
+
+static void *netsend_tilde_thread(void *z)
+{
+    t_netsend_tilde *x = (t_netsend_tilde *)z;
+    int nframes = x->x_packetframes, nchans = x->x_nchans;
+    long nbytes = nframes * nchans * sizeof(float);
+    float *frames = (float *)getbytes(nbytes);
+    unsigned char *packet = (unsigned char *)getbytes(NETAUDIO_HEADER +
+        nframes * nchans * 5);
+    while (1)
+    {
+        int quit;
+        pthread_mutex_lock(&x->x_mutex);
+        while (!x->x_quit &&
+            sys_ringbuf_getreadavailable(&x->x_ring) < nbytes)
+                pthread_cond_wait(&x->x_cond, &x->x_mutex);
+        quit = x->x_quit;
+        pthread_mutex_unlock(&x->x_mutex);
+        if (quit)
+            break;
+        while (sys_ringbuf_getreadavailable(&x->x_ring) >= nbytes)
+        {
+            int size;
+            sys_ringbuf_read(&x->x_ring, frames, nbytes, x->x_ringbuf);
+            size = netaudio_encode(packet, frames, nchans, nframes,
+                x->x_frame, x->x_sr, x->x_compress);
+                /* errors (like nobody listening yet) just lose the packet */
+            send(x->x_sockfd, (char *)packet, size, 0);
+            x->x_frame += nframes;
+        }
+    }
+    freebytes(frames, nbytes);
+    freebytes(packet, NETAUDIO_HEADER + nframes * nchans * 5);
+    return (0);
+}
+
+static void netsend_tilde_disconnect(t_netsend_tilde *x)
+{
+    if (!x->x_running)
+        return;
+    pthread_mutex_lock(&x->x_mutex);
+    x->x_quit = 1;
+    pthread_cond_signal(&x->x_cond);
+    pthread_mutex_unlock(&x->x_mutex);
+    pthread_join(x->x_thread, 0);
+    x->x_running = 0;
+    sys_closesocket(x->x_sockfd);
+    x->x_sockfd = -1;
+    outlet_float(x->x_obj.ob_outlet, 0);
+}
+
+static void netsend_tilde_connect(t_netsend_tilde *x, t_symbol *host,
+    t_floatarg fport)
+{
+    int portno = fport, sockfd = -1, status;
+    struct addrinfo *ailist = NULL, *ai;
+    char hostbuf[256];
+    if (x->x_running)
+    {
+        pd_error(x, "netsend~: already connected");
+        return;
+    }
+    status = addrinfo_get_list(&ailist, host->s_name, portno, SOCK_DGRAM);
+    if (status != 0)
+    {
+        pd_error(x, "netsend~: bad host or port? %s (%d)",
+            gai_strerror(status), status);
+        return;
+    }
+    addrinfo_sort_list(&ailist, addrinfo_ipv4_first);
+    for (ai = ailist; ai != NULL; ai = ai->ai_next)
+    {
+        if ((sockfd = socket(ai->ai_family, ai->ai_socktype,
+            ai->ai_protocol)) < 0)
+                continue;
+        if (socket_set_boolopt(sockfd, SOL_SOCKET, SO_BROADCAST, 1) < 0)
+            post("netsend~: setsockopt (SO_BROADCAST) failed");
+        if (connect(sockfd, ai->ai_addr, ai->ai_addrlen) < 0)
+        {
+            sys_closesocket(sockfd);
+            sockfd = -1;
+            continue;
+        }
+        sockaddr_get_addrstr(ai->ai_addr, hostbuf, sizeof(hostbuf));
+        post("netsend~: sending %d channel%s to %s %d", x->x_nchans,
+            (x->x_nchans == 1 ? "" : "s"), hostbuf, portno);
+        break;
+    }
+    freeaddrinfo(ailist);
+    if (sockfd < 0)
+    {
+        sys_sockerror("netsend~: connect");
+        return;
+    }
+    x->x_sockfd = sockfd;
+    x->x_quit = 0;
+    x->x_frame = 0;
+    sys_ringbuf_init(&x->x_ring, x->x_ringsize, x->x_ringbuf, 0);
+    if (pthread_create(&x->x_thread, 0, netsend_tilde_thread, x))
+    {
+        pd_error(x, "netsend~: couldn't start thread");
+        sys_closesocket(sockfd);
+        x->x_sockfd = -1;
+        return;
+    }
+    x->x_running = 1;
+    outlet_float(x->x_obj.ob_outlet, 1);
+}
+
+static void netsend_tilde_compress(t_netsend_tilde *x, t_floatarg f)
+{
+    x->x_compress = (f != 0);
+}
+
+static t_int *netsend_tilde_perform(t_int *w)
+{
+    t_netsend_tilde *x = (t_netsend_tilde *)(w[1]);
+    int n = (int)(w[2]), nchans = x->x_nchans, ch, i;
+    long nbytes = n * nchans * sizeof(float);
+    if (x->x_running)
+    {
+        for (ch = 0; ch < nchans; ch++)
+        {
+            t_sample *in = (t_sample *)(w[3 + ch]);
+            float *fp = x->x_frames + ch;
+            for (i = 0; i < n; i++, fp += nchans)
+                *fp = in[i];
+        }
+            /* if the thread can't keep up, drop the block */
+        if (sys_ringbuf_getwriteavailable(&x->x_ring) >= nbytes)
+        {
+            sys_ringbuf_write(&x->x_ring, x->x_frames, nbytes, x->x_ringbuf);
+            pthread_mutex_lock(&x->x_mutex);
+            pthread_cond_signal(&x->x_cond);
+            pthread_mutex_unlock(&x->x_mutex);
+        }
+    }
+    return (w + 3 + nchans);
+}
+
+static void netsend_tilde_dsp(t_netsend_tilde *x, t_signal **sp)
+{
+    int i, n = sp[0]->s_n;
+    t_int *vec = (t_int *)getbytes((x->x_nchans + 2) * sizeof(*vec));
+    if (n != x->x_vecsize)
+    {
+        x->x_frames = (float *)resizebytes(x->x_frames,
+            x->x_vecsize * x->x_nchans * sizeof(float),
+                n * x->x_nchans * sizeof(float));
+        x->x_vecsize = n;
+    }
+        /* the thread only reads this between packets */
+    x->x_sr = sp[0]->s_sr;
+    vec[0] = (t_int)x;
+    vec[1] = n;
+    for (i = 0; i < x->x_nchans; i++)
+        vec[2 + i] = (t_int)sp[i]->s_vec;
+    dsp_addv(netsend_tilde_perform, x->x_nchans + 2, vec);
+    freebytes(vec, (x->x_nchans + 2) * sizeof(*vec));
+}
+
+    /* creation arguments are the number of channels and the flag
+    "-compress"; messages are "connect <host> <port>", "disconnect" and
+    "compress <0|1>", and the outlet says 1 or 0 as we connect and
+    disconnect like netsend's. */
+static void *netsend_tilde_new(t_symbol *s, int argc, t_atom *argv)
+{
+    t_netsend_tilde *x = (t_netsend_tilde *)pd_new(netsend_tilde_class);
+    int i, nchans = 1;
+    x->x_compress = 0;
+    while (argc && argv->a_type == A_SYMBOL &&
+        *argv->a_w.w_symbol->s_name == '-')
+    {
+        if (!strcmp(argv->a_w.w_symbol->s_name, "-compress"))
+            x->x_compress = 1;
+        else pd_error(x, "netsend~: unknown flag %s",
+            argv->a_w.w_symbol->s_name);
+        argc--; argv++;
+    }
+    if (argc && argv->a_type == A_FLOAT)
+        nchans = argv->a_w.w_float;
+    if (nchans < 1)
+        nchans = 1;
+    else if (nchans > NETAUDIO_MAXCHANS)
+        nchans = NETAUDIO_MAXCHANS;
+    x->x_nchans = nchans;
+    x->x_f = 0;
+    for (i = 1; i < nchans; i++)
+        inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
+    outlet_new(&x->x_obj, &s_float);
+    x->x_sockfd = -1;
+    x->x_sr = sys_getsr();
+    x->x_vecsize = 0;
+    x->x_frames = (float *)getbytes(0);
+        /* the ring's size must be a power of two */
+    x->x_ringsize = NETAUDIO_SENDFRAMES * sizeof(float) *
+        (1 << ilog2(2 * nchans - 1));
+    x->x_ringbuf = (char *)getbytes(x->x_ringsize);
+    x->x_packetframes = netaudio_packetframes(nchans);
+    x->x_frame = 0;
+    x->x_running = x->x_quit = 0;
+    pthread_mutex_init(&x->x_mutex, 0);
+    pthread_cond_init(&x->x_cond, 0);
+    return (x);
+}
+
+static void netsend_tilde_free(t_netsend_tilde *x)
+{
+    netsend_tilde_disconnect(x);
+    freebytes(x->x_frames, x->x_vecsize * x->x_nchans * sizeof(float));
+    freebytes(x->x_ringbuf, x->x_ringsize);
+    pthread_mutex_destroy(&x->x_mutex);
+    pthread_cond_destroy(&x->x_cond);
+}
+
+/* ---------------- netreceive~ ---------------- */
+
+static t_class *netreceive_tilde_class;
+
+typedef struct _netreceive_tilde
+{
+    t_object x_obj;
+    int x_nchans;
+    int x_port;
+    int x_sockfd;
+    int x_running;
+    volatile int x_quit;
+    pthread_t x_thread;
+        /* the jitter buffer: NETAUDIO_NCHUNK slots, each holding a chunk
+        of NETAUDIO_CHUNK frames channel by channel, and each slot's stamp,
+        which is one more than the number of the chunk in it or zero while
+        it's being filled.  Both are written only by the thread. */
+    float *x_jbuf;
+    sys_ringbuf_index *x_stamps;
+    sys_ringbuf_index x_newest; /* one past the newest frame received */
+    sys_ringbuf_index x_sendersr;   /* sender's sample rate */
+        /* the rest belongs to the DSP side */
+    double x_readpos;       /* frame we'll play next */
+    double x_fill;          /* smoothed distance to x_newest */
+    double x_ratio;         /* frames per sample we're reading at */
+    int x_primed;           /* false to start over from x_newest */
+    t_float x_latencyms;
+    int x_latency;          /* the same in frames */
+    t_float x_sr;
+    int x_warnedsr;
+    long x_underruns;
+    long x_missing;         /* frames that never arrived */
+    float *x_frame1, *x_frame2; /* scratch for interpolating */
+} t_netreceive_tilde;
+
+    /* thread: file one datagram into the jitter buffer */
+static void netreceive_tilde_file(t_netreceive_tilde *x,
+    const unsigned char *packet, int size)
+{
+    unsigned int frame;
+    int nchans, nframes, ch, i, c, compressed, mychans = x->x_nchans;
+    long newest, end;
+    const unsigned char *in = packet + NETAUDIO_HEADER, *limit = packet + size;
+    if (size < NETAUDIO_HEADER || packet[0] != 'P' || packet[1] != 'd' ||
+        packet[2] != '~' || packet[3] != NETAUDIO_VERSION)
+            return;
+    frame = netaudio_get32(packet + 4);
+    nchans = packet[8] | (packet[9] << 8);
+    nframes = packet[10] | (packet[11] << 8);
+    compressed = (packet[16] & NETAUDIO_COMPRESSED);
+    if (!nchans || !nframes || (frame % NETAUDIO_CHUNK) ||
+        (nframes % NETAUDIO_CHUNK) || nframes > NETAUDIO_NCHUNK *
+            NETAUDIO_CHUNK / 2 || (!compressed && size <
+                NETAUDIO_HEADER + 4 * nchans * nframes))
+                    return;
+    NETAUDIO_STORE(x->x_sendersr, (long)netaudio_get32(packet + 12));
+    for (c = 0; c < nframes / NETAUDIO_CHUNK; c++)
+    {
+        long chunk = frame / NETAUDIO_CHUNK + c;
+        NETAUDIO_STORE(x->x_stamps[chunk & (NETAUDIO_NCHUNK-1)], 0);
+    }
+    NETAUDIO_FENCE();
+    for (ch = 0; ch < nchans; ch++)
+    {
+        const unsigned char *nibbles = in;
+        unsigned int prev = 0;
+        if (compressed)
+        {
+            in += (nframes + 1) / 2;
+            if (in > limit)
+                return;
+        }
+        for (i = 0; i < nframes; i++)
+        {
+            union {float f; unsigned int u;} sample;
+            if (compressed)
+            {
+                int nbytes = (nibbles[i >> 1] >> ((i & 1) << 2)) & 15, k;
+                unsigned int diff = 0;
+                if (nbytes > 4 || in + nbytes > limit)
+                    return;
+                for (k = 0; k < nbytes; k++)
+                    diff |= (unsigned int)(*in++) << (8 * k);
+                sample.u = prev ^= diff;
+            }
+            else sample.u = netaudio_get32(in), in += 4;
+            if (ch < mychans)
+            {
+                long chunk = frame / NETAUDIO_CHUNK + i / NETAUDIO_CHUNK;
+                x->x_jbuf[((chunk & (NETAUDIO_NCHUNK-1)) * mychans + ch) *
+                    NETAUDIO_CHUNK + (i & (NETAUDIO_CHUNK-1))] = sample.f;
+            }
+        }
+    }
+        /* channels the sender doesn't have are silent */
+    for (ch = nchans; ch < mychans; ch++)
+        for (i = 0; i < nframes; i++)
+    {
+        long chunk = frame / NETAUDIO_CHUNK + i / NETAUDIO_CHUNK;
+        x->x_jbuf[((chunk & (NETAUDIO_NCHUNK-1)) * mychans + ch) *
+            NETAUDIO_CHUNK + (i & (NETAUDIO_CHUNK-1))] = 0;
+    }
+    for (c = 0; c < nframes / NETAUDIO_CHUNK; c++)
+    {
+        long chunk = frame / NETAUDIO_CHUNK + c;
+        NETAUDIO_STORE(x->x_stamps[chunk & (NETAUDIO_NCHUNK-1)], chunk + 1);
+    }
+        /* normally the newest frame only moves forward, but if the sender
+        starts over (or leaps ahead) we follow it */
+    newest = NETAUDIO_LOAD(x->x_newest);
+    end = (long)frame + nframes;
+    if (end > newest || end < newest - NETAUDIO_NCHUNK * NETAUDIO_CHUNK)
+        NETAUDIO_STORE(x->x_newest, end);
+}
+
+static void *netreceive_tilde_thread(void *z)
+{
+    t_netreceive_tilde *x = (t_netreceive_tilde *)z;
+    unsigned char *packet = (unsigned char *)getbytes(65536);
+    while (!x->x_quit)
+    {
+        fd_set readset;
+        struct timeval timeout;
+        int size;
+            /* wake up now and then to see if we should quit */
+        timeout.tv_sec = 0;
+        timeout.tv_usec = 100000;
+        FD_ZERO(&readset);
+        FD_SET(x->x_sockfd, &readset);
+        if (select(x->x_sockfd + 1, &readset, 0, 0, &timeout) <= 0)
+            continue;
+        if ((size = recv(x->x_sockfd, (char *)packet, 65536, 0)) > 0)
+            netreceive_tilde_file(x, packet, size);
+    }
+    freebytes(packet, 65536);
+    return (0);
+}
+
+static void netreceive_tilde_stop(t_netreceive_tilde *x)
+{
+    if (!x->x_running)
+        return;
+    x->x_quit = 1;
+    pthread_join(x->x_thread, 0);
+    x->x_running = 0;
+    sys_closesocket(x->x_sockfd);
+    x->x_sockfd = -1;
+}
+
+static void netreceive_tilde_listen(t_netreceive_tilde *x, t_floatarg fport)
+{
+    int portno = fport, sockfd = -1, status, i;
+    struct addrinfo *ailist = NULL, *ai;
+    netreceive_tilde_stop(x);
+    x->x_port = 0;
+    if (portno <= 0)
+        return;
+    status = addrinfo_get_list(&ailist, NULL, portno, SOCK_DGRAM);
+    if (status != 0)
+    {
+        pd_error(x, "netreceive~: bad port? %s (%d)",
+            gai_strerror(status), status);
+        return;
+    }
+        /* prefer IPv6 so we can make a dual stack socket */
+    addrinfo_sort_list(&ailist, addrinfo_ipv6_first);
+    for (ai = ailist; ai != NULL; ai = ai->ai_next)
+    {
+        if ((sockfd = socket(ai->ai_family, ai->ai_socktype,
+            ai->ai_protocol)) < 0)
+                continue;
+        if (socket_set_boolopt(sockfd, SOL_SOCKET, SO_REUSEADDR, 1) < 0)
+            post("netreceive~: setsockopt (SO_REUSEADDR) failed");
+        if (socket_set_boolopt(sockfd, SOL_SOCKET, SO_RCVBUF, 1 << 20) < 0)
+            post("netreceive~: setsockopt (SO_RCVBUF) failed");
+        if (ai->ai_family == AF_INET6 &&
+            socket_set_boolopt(sockfd, IPPROTO_IPV6, IPV6_V6ONLY, 0) < 0)
+        {
+            sys_closesocket(sockfd);
+            sockfd = -1;
+            continue;
+        }
+        if (bind(sockfd, ai->ai_addr, ai->ai_addrlen) < 0)
+        {
+            sys_closesocket(sockfd);
+            sockfd = -1;
+            continue;
+        }
+        break;
+    }
+    freeaddrinfo(ailist);
+    if (sockfd < 0)
+    {
+        sys_sockerror("netreceive~: bind");
+        return;
+    }
+    for (i = 0; i < NETAUDIO_NCHUNK; i++)
+        NETAUDIO_STORE(x->x_stamps[i], 0);
+    NETAUDIO_STORE(x->x_newest, 0);
+    x->x_primed = 0;
+    x->x_sockfd = sockfd;
+    x->x_quit = 0;
+    if (pthread_create(&x->x_thread, 0, netreceive_tilde_thread, x))
+    {
+        pd_error(x, "netreceive~: couldn't start thread");
+        sys_closesocket(sockfd);
+        x->x_sockfd = -1;
+        return;
+    }
+    x->x_running = 1;
+    x->x_port = portno;
+}
+
+static void netreceive_tilde_latency(t_netreceive_tilde *x, t_floatarg f)
+{
+    int maxlatency = NETAUDIO_NCHUNK * NETAUDIO_CHUNK / 2;
+    x->x_latencyms = (f > 0 ? f : 0);
+    x->x_latency = x->x_latencyms * 0.001 * x->x_sr;
+    if (x->x_latency < 2 * NETAUDIO_CHUNK)
+        x->x_latency = 2 * NETAUDIO_CHUNK;
+    else if (x->x_latency > maxlatency)
+    {
+        x->x_latency = maxlatency;
+        pd_error(x, "netreceive~: latency limited to %g msec",
+            1000. * maxlatency / x->x_sr);
+    }
+    x->x_primed = 0;
+}
+
+static void netreceive_tilde_status(t_netreceive_tilde *x)
+{
+    if (!x->x_running)
+        post("netreceive~: not listening");
+    else post("netreceive~: port %d, %s, buffered %g msec of %g, rate %g, \
+%ld frames missing, %ld underruns", x->x_port,
+        (x->x_primed ? "playing" : "waiting"), 1000. * x->x_fill / x->x_sr,
+            1000. * x->x_latency / x->x_sr, x->x_ratio, x->x_missing,
+                x->x_underruns);
+}
+
+    /* DSP side: copy a frame out of the jitter buffer if it's there */
+static int netreceive_tilde_getframe(t_netreceive_tilde *x, long frame,
+    float *out)
+{
+    long chunk = frame / NETAUDIO_CHUNK;
+    int slot = chunk & (NETAUDIO_NCHUNK-1), ch, nchans = x->x_nchans;
+    float *fp;
+    if (frame < 0 || NETAUDIO_LOAD(x->x_stamps[slot]) != chunk + 1)
+        return (0);
+    fp = x->x_jbuf + slot * nchans * NETAUDIO_CHUNK +
+        (frame & (NETAUDIO_CHUNK-1));
+    for (ch = 0; ch < nchans; ch++, fp += NETAUDIO_CHUNK)
+        out[ch] = *fp;
+        /* make sure it didn't get overwritten while we looked */
+    NETAUDIO_FENCE();
+    return (NETAUDIO_LOAD(x->x_stamps[slot]) == chunk + 1);
+}
+
+static t_int *netreceive_tilde_perform(t_int *w)
+{
+    t_netreceive_tilde *x = (t_netreceive_tilde *)(w[1]);
+    int n = (int)(w[2]), nchans = x->x_nchans, ch, i;
+    long newest = NETAUDIO_LOAD(x->x_newest), lastframe = -1;
+    double fill = newest - x->x_readpos, readpos;
+    long sendersr = NETAUDIO_LOAD(x->x_sendersr);
+
+    if (sendersr && sendersr != (long)x->x_sr && !x->x_warnedsr)
+    {
+        pd_error(x, "netreceive~: sender's sample rate is %ld", sendersr);
+        x->x_warnedsr = 1;
+    }
+        /* start (or start over) "latency" behind the newest frame */
+    if (x->x_primed && (fill < 1 ||
+        fill > NETAUDIO_NCHUNK * NETAUDIO_CHUNK - 2 * NETAUDIO_CHUNK))
+    {
+        if (fill < 1)
+            x->x_underruns++;
+        x->x_primed = 0;
+    }
+    if (!x->x_primed)
+    {
+        if (!x->x_running || newest < x->x_latency)
+        {
+            for (ch = 0; ch < nchans; ch++)
+                memset((t_sample *)(w[3 + ch]), 0, n * sizeof(t_sample));
+            return (w + 3 + nchans);
+        }
+        x->x_readpos = newest - x->x_latency;
+        x->x_fill = x->x_latency;
+        x->x_ratio = 1;
+        x->x_primed = 1;
+    }
+    else
+    {
+            /* nudge the rate if the average fill strays too far */
+        double ratio = 1, error, slack = x->x_latency / 4;
+        x->x_fill += 0.01 * (fill - x->x_fill);
+        if ((error = x->x_fill - x->x_latency) > slack)
+            ratio = 1 + NETAUDIO_DRIFTGAIN * (error - slack);
+        else if (error < -slack)
+            ratio = 1 + NETAUDIO_DRIFTGAIN * (error + slack);
+        if (ratio > 1 + NETAUDIO_MAXDRIFT)
+            ratio = 1 + NETAUDIO_MAXDRIFT;
+        else if (ratio < 1 - NETAUDIO_MAXDRIFT)
+            ratio = 1 - NETAUDIO_MAXDRIFT;
+        x->x_ratio = ratio;
+    }
+    readpos = x->x_readpos;
+    for (i = 0; i < n; i++, readpos += x->x_ratio)
+    {
+        long frame = (long)readpos;
+        float frac = readpos - frame;
+        if (frame != lastframe)
+        {
+            if (frame == lastframe + 1)
+            {
+                float *swap = x->x_frame1;
+                x->x_frame1 = x->x_frame2;
+                x->x_frame2 = swap;
+            }
+            else if (!netreceive_tilde_getframe(x, frame, x->x_frame1))
+            {
+                memset(x->x_frame1, 0, nchans * sizeof(float));
+                x->x_missing++;
+            }
+            if (!netreceive_tilde_getframe(x, frame + 1, x->x_frame2))
+            {
+                memset(x->x_frame2, 0, nchans * sizeof(float));
+                x->x_missing++;
+            }
+            lastframe = frame;
+        }
+        for (ch = 0; ch < nchans; ch++)
+            ((t_sample *)(w[3 + ch]))[i] = x->x_frame1[ch] +
+                frac * (x->x_frame2[ch] - x->x_frame1[ch]);
+    }
+    x->x_readpos = readpos;
+    return (w + 3 + nchans);
+}
+
+static void netreceive_tilde_dsp(t_netreceive_tilde *x, t_signal **sp)
+{
+    int i;
+    t_int *vec = (t_int *)getbytes((x->x_nchans + 2) * sizeof(*vec));
+    if (sp[0]->s_sr != x->x_sr)
+    {
+        x->x_sr = sp[0]->s_sr;
+        x->x_warnedsr = 0;
+        netreceive_tilde_latency(x, x->x_latencyms);
+    }
+    vec[0] = (t_int)x;
+    vec[1] = sp[0]->s_n;
+    for (i = 0; i < x->x_nchans; i++)
+        vec[2 + i] = (t_int)sp[i]->s_vec;
+    dsp_addv(netreceive_tilde_perform, x->x_nchans + 2, vec);
+    freebytes(vec, (x->x_nchans + 2) * sizeof(*vec));
+}
+
+    /* creation arguments are the port, the number of channels, and the
+    latency in msec; messages are "listen <port>" (0 to stop), "latency
+    <msec>" and "status", which posts how it's going. */
+static void *netreceive_tilde_new(t_floatarg fport, t_floatarg fnchans,
+    t_floatarg flatency)
+{
+    t_netreceive_tilde *x = (t_netreceive_tilde *)pd_new(
+        netreceive_tilde_class);
+    int i, nchans = fnchans;
+    if (nchans < 1)
+        nchans = 1;
+    else if (nchans > NETAUDIO_MAXCHANS)
+        nchans = NETAUDIO_MAXCHANS;
+    x->x_nchans = nchans;
+    for (i = 0; i < nchans; i++)
+        outlet_new(&x->x_obj, &s_signal);
+    x->x_jbuf = (float *)getbytes(NETAUDIO_NCHUNK * NETAUDIO_CHUNK *
+        nchans * sizeof(float));
+    x->x_stamps = (sys_ringbuf_index *)getbytes(NETAUDIO_NCHUNK *
+        sizeof(*x->x_stamps));
+    x->x_frame1 = (float *)getbytes(nchans * sizeof(float));
+    x->x_frame2 = (float *)getbytes(nchans * sizeof(float));
+    NETAUDIO_STORE(x->x_newest, 0);
+    NETAUDIO_STORE(x->x_sendersr, 0);
+    x->x_readpos = x->x_fill = 0;
+    x->x_ratio = 1;
+    x->x_primed = 0;
+    x->x_sr = sys_getsr();
+    x->x_warnedsr = 0;
+    x->x_underruns = x->x_missing = 0;
+    x->x_port = 0;
+    x->x_sockfd = -1;
+    x->x_running = x->x_quit = 0;
+    netreceive_tilde_latency(x, (flatency > 0 ? flatency : 50));
+    netreceive_tilde_listen(x, fport);
+    return (x);
+}
+
+static void netreceive_tilde_free(t_netreceive_tilde *x)
+{
+    netreceive_tilde_stop(x);
+    freebytes(x->x_jbuf, NETAUDIO_NCHUNK * NETAUDIO_CHUNK * x->x_nchans *
+        sizeof(float));
+    freebytes(x->x_stamps, NETAUDIO_NCHUNK * sizeof(*x->x_stamps));
+    freebytes(x->x_frame1, x->x_nchans * sizeof(float));
+    freebytes(x->x_frame2, x->x_nchans * sizeof(float));
+}
+
+static void netaudio_setup(void)
+{
+    netsend_tilde_class = class_new(gensym("netsend~"),
+        (t_newmethod)netsend_tilde_new, (t_method)netsend_tilde_free,
+        sizeof(t_netsend_tilde), 0, A_GIMME, 0);
+    CLASS_MAINSIGNALIN(netsend_tilde_class, t_netsend_tilde, x_f);
+    class_addmethod(netsend_tilde_class, (t_method)netsend_tilde_dsp,
+        gensym("dsp"), A_CANT, 0);
+    class_addmethod(netsend_tilde_class, (t_method)netsend_tilde_connect,
+        gensym("connect"), A_SYMBOL, A_FLOAT, 0);
+    class_addmethod(netsend_tilde_class, (t_method)netsend_tilde_disconnect,
+        gensym("disconnect"), 0);
+    class_addmethod(netsend_tilde_class, (t_method)netsend_tilde_compress,
+        gensym("compress"), A_FLOAT, 0);
+
+    netreceive_tilde_class = class_new(gensym("netreceive~"),
+        (t_newmethod)netreceive_tilde_new, (t_method)netreceive_tilde_free,
+        sizeof(t_netreceive_tilde), 0, A_DEFFLOAT, A_DEFFLOAT, A_DEFFLOAT, 0);
+    class_addmethod(netreceive_tilde_class, (t_method)netreceive_tilde_dsp,
+        gensym("dsp"), A_CANT, 0);
+    class_addmethod(netreceive_tilde_class, (t_method)netreceive_tilde_listen,
+        gensym("listen"), A_FLOAT, 0);
+    class_addmethod(netreceive_tilde_class,
+        (t_method)netreceive_tilde_latency, gensym("latency"), A_FLOAT, 0);
+    class_addmethod(netreceive_tilde_class, (t_method)netreceive_tilde_status,
+        gensym("status"), 0);
+    class_sethelpsymbol(netreceive_tilde_class, gensym("netsend~"));
+}
+
 void x_net_setup(void)
 {
     netsend_setup();
     netreceive_setup();
+    netaudio_setup();
 }
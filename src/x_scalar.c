@@ -75,6 +75,7 @@ static void *scalar_define_new(t_symbol *s, int argc, t_atom *argv)
     }
     sc->sc_gobj.g_next = 0;
     x->gl_list = &sc->sc_gobj;
+    x->gl_order++;
     x->gl_private = keep;
            /* bashily unbind #A -- this would create garbage if #A were
            multiply bound but we believe in this context it's at most
@@ -7,8 +7,11 @@ moment it also defines "text" but it may later be better to split this off. */
 
 #include "m_pd.h"
 #include "g_canvas.h"    /* just for glist_getfont, bother */
+#include "s_stuff.h"
 #include <string.h>
 #include <stdio.h>
+#include <errno.h>
+#include <pthread.h>
 #define __USE_GNU     /* needed so stdlib will define qsort_r */
 #include <stdlib.h>
 #ifdef HAVE_UNISTD_H
@@ -47,6 +50,18 @@ static t_class *text_define_class;
 
 /* --- common code for text define, textfile, and qlist for storing text -- */
 
+    /* where each line of a text buffer starts and ends, for one version of
+    the buffer as told by its binbuf stamp.  See textlines_get() below. */
+typedef struct _textlines
+{
+    unsigned long tl_stamp;     /* binbuf stamp the table is valid for */
+    int tl_nquery;              /* times asked about this version */
+    int tl_nlines;              /* number of lines, or -1 if no table */
+    int tl_size;                /* allocated size of tl_start and tl_end */
+    int *tl_start;              /* onset of each line */
+    int *tl_end;                /* its terminator, or natom for the last */
+} t_textlines;
+
 typedef struct _textbuf
 {
     t_object b_ob;
@@ -54,19 +69,58 @@ typedef struct _textbuf
     t_canvas *b_canvas;
     t_guiconnect *b_guiconnect;
     t_symbol *b_sym;
+    t_textlines b_lines;    /* shared by the text objects that use us */
+    t_clock *b_packclock;   /* to pack the binbuf once edits settle down */
 } t_textbuf;
 
+    /* big buffers are packed (see binbuf_pack()) this long after they
+    were last changed.  Reading doesn't unpack them; editing does. */
+#define TEXTBUF_PACKDELAY 1000
+
+static void textlines_init(t_textlines *tl)
+{
+    tl->tl_stamp = 0;
+    tl->tl_nquery = 0;
+    tl->tl_nlines = -1;
+    tl->tl_size = 0;
+}
+
+static void textlines_clear(t_textlines *tl)
+{
+    if (tl->tl_size)
+    {
+        freebytes(tl->tl_start, tl->tl_size * sizeof(int));
+        freebytes(tl->tl_end, tl->tl_size * sizeof(int));
+    }
+    textlines_init(tl);
+}
+
+static void textbuf_packtick(t_textbuf *x)
+{
+    if (x->b_binbuf)
+        binbuf_pack(x->b_binbuf);
+}
+
+static void textbuf_packlater(t_textbuf *x)
+{
+    clock_delay(x->b_packclock, TEXTBUF_PACKDELAY);
+}
+
 static void textbuf_init(t_textbuf *x, t_symbol *sym)
 {
     x->b_binbuf = binbuf_new();
     x->b_canvas = canvas_getcurrent();
     x->b_sym = sym;
+    textlines_init(&x->b_lines);
+    x->b_packclock = clock_new(x, (t_method)textbuf_packtick);
 }
 
+    /* called after every change: update the window if open */
 static void textbuf_senditup(t_textbuf *x)
 {
     int i, ntxt;
     char *txt;
+    textbuf_packlater(x);
     if (!x->b_guiconnect)
         return;
     binbuf_gettext(x->b_binbuf, &txt, &ntxt);
@@ -201,6 +255,8 @@ static void textbuf_free(t_textbuf *x)
     t_pd *x2;
     if (x->b_binbuf)
         binbuf_free(x->b_binbuf);
+    textlines_clear(&x->b_lines);
+    clock_free(x->b_packclock);
     if (x->b_guiconnect)
     {
         sys_vgui("destroy .x%lx\n", x);
@@ -233,6 +289,72 @@ static int text_nthline(int n, t_atom *vec, int line, int *startp, int *endp)
     return (0);
 }
 
+    /* get the line table for a buffer.  It's made on the second query to
+    the same version of the buffer, so that alternately changing and reading
+    a buffer costs no more than scanning it; and once made, text set, insert
+    and delete keep it up to date as they edit.  Returns 0 if there's no
+    table yet, in which case the caller can fall back on text_nthline(). */
+static t_textlines *textlines_get(t_textlines *tl, t_binbuf *b)
+{
+    unsigned long stamp = binbuf_getstamp(b);
+    int n, i, j, nlines;
+    if (tl->tl_stamp != stamp)
+    {
+        tl->tl_stamp = stamp;
+        tl->tl_nquery = 1;
+        tl->tl_nlines = -1;
+        return (0);
+    }
+    if (tl->tl_nlines >= 0)
+        return (tl);
+    if (++tl->tl_nquery < 2)
+        return (0);
+        /* binbuf_nextbreak() so as not to unpack a packed buffer */
+    n = binbuf_getnatom(b);
+    for (i = nlines = 0; i < n; i = j + 1, nlines++)
+        j = binbuf_nextbreak(b, i);
+    if (nlines > tl->tl_size || nlines < tl->tl_size / 4)
+    {
+        int size = (nlines > 16 ? nlines : 16);
+        textlines_clear(tl);
+        tl->tl_start = (int *)getbytes(size * sizeof(int));
+        tl->tl_end = (int *)getbytes(size * sizeof(int));
+        tl->tl_size = size;
+        tl->tl_stamp = stamp;
+    }
+    for (i = nlines = 0; i < n; i = j + 1, nlines++)
+    {
+        tl->tl_start[nlines] = i;
+        tl->tl_end[nlines] = j = binbuf_nextbreak(b, i);
+    }
+    tl->tl_nlines = nlines;
+    return (tl);
+}
+
+    /* after an edit, move the lines from "from" on by "nline" lines (over
+    any deleted ones or to make room for new ones) and "natom" atoms. */
+static void textlines_shift(t_textlines *tl, int from, int nline, int natom)
+{
+    int i, nmove = tl->tl_nlines - from;
+    if (tl->tl_nlines + nline > tl->tl_size)
+    {
+        int size = 2 * (tl->tl_nlines + nline);
+        tl->tl_start = (int *)resizebytes(tl->tl_start,
+            tl->tl_size * sizeof(int), size * sizeof(int));
+        tl->tl_end = (int *)resizebytes(tl->tl_end,
+            tl->tl_size * sizeof(int), size * sizeof(int));
+        tl->tl_size = size;
+    }
+    memmove(tl->tl_start + from + nline, tl->tl_start + from,
+        nmove * sizeof(int));
+    memmove(tl->tl_end + from + nline, tl->tl_end + from,
+        nmove * sizeof(int));
+    if (natom)
+        for (i = from + nline; i < from + nline + nmove; i++)
+            tl->tl_start[i] += natom, tl->tl_end[i] += natom;
+    tl->tl_nlines += nline;
+}
+
 /* text_define object - text buffer, accessible by other accessor objects */
 
 typedef struct _text_define
@@ -602,11 +724,17 @@ static void text_define_free(t_text_define *x)
     gpointer_unset(&x->x_gp);
     /* deleting the scalar will automatically free the binbuf */
     pd_free(&x->x_scalar->sc_gobj.g_pd);
-    x->x_canvas->gl_valid = ++glist_valid; /* invalidate pointers */
+    x->x_canvas->gl_valid = glist_newvalid(); /* invalidate pointers */
 }
 
 /* ---  text_client - common code for objects that refer to text buffers -- */
 
+typedef struct _textsortent
+{
+    t_float se_value;
+    int se_line;
+} t_textsortent;
+
 typedef struct _text_client
 {
     t_object tc_obj;
@@ -614,6 +742,8 @@ typedef struct _text_client
     t_gpointer tc_gp;
     t_symbol *tc_struct;
     t_symbol *tc_field;
+    t_textlines *tc_lines;      /* line table for the buffer we last found */
+    t_textlines tc_ownlines;    /* ... ours, if it isn't a named one */
 } t_text_client;
 
     /* parse buffer-finding arguments */
@@ -624,6 +754,8 @@ static void text_client_argparse(t_text_client *x, int *argcp, t_atom **argvp,
     t_atom *argv = *argvp;
     x->tc_sym = x->tc_struct = x->tc_field = 0;
     gpointer_init(&x->tc_gp);
+    textlines_init(&x->tc_ownlines);
+    x->tc_lines = &x->tc_ownlines;
     if (argc && argv->a_type == A_SYMBOL &&
         !strcmp(argv->a_w.w_symbol->s_name, "-s"))
     {
@@ -655,7 +787,12 @@ static t_binbuf *text_client_getbuf(t_text_client *x)
         t_textbuf *y = (t_textbuf *)pd_findbyclass(x->tc_sym,
             text_define_class);
         if (y)
+        {
+                /* whatever we do with it might unpack it */
+            textbuf_packlater(y);
+            x->tc_lines = &y->b_lines;
             return (y->b_binbuf);
+        }
         else
         {
             pd_error(x, "text: couldn't find text buffer '%s'",
@@ -695,6 +832,7 @@ static t_binbuf *text_client_getbuf(t_text_client *x)
             pd_error(x, "text: field %s not of type text", x->tc_field->s_name);
             return (0);
         }
+        x->tc_lines = &x->tc_ownlines;
         return (*(t_binbuf **)(((char *)vec) + onset));
     }
     else return (0);    /* shouldn't happen */
@@ -737,9 +875,52 @@ static  void text_client_senditup(t_text_client *x)
     }
 }
 
+    /* the line table for the buffer text_client_getbuf() just returned */
+static t_textlines *text_client_lines(t_text_client *x, t_binbuf *b)
+{
+    return (textlines_get(x->tc_lines, b));
+}
+
+    /* text_nthline() using the line table if there is one */
+static int textlines_nthline(t_textlines *tl, t_binbuf *b, int line,
+    int *startp, int *endp)
+{
+    if (!tl && binbuf_ispacked(b))
+    {
+        int n = binbuf_getnatom(b), i, j;
+        for (i = 0; i < n; i = j + 1, line--)
+        {
+            j = binbuf_nextbreak(b, i);
+            if (!line)
+            {
+                *startp = i;
+                *endp = j;
+                return (1);
+            }
+        }
+        return (0);
+    }
+    if (!tl)
+        return (text_nthline(binbuf_getnatom(b), binbuf_getvec(b), line,
+            startp, endp));
+    if (line < 0 || line >= tl->tl_nlines)
+        return (0);
+    *startp = tl->tl_start[line];
+    *endp = tl->tl_end[line];
+    return (1);
+}
+
+static int text_client_nthline(t_text_client *x, t_binbuf *b, int line,
+    int *startp, int *endp)
+{
+    return (textlines_nthline(text_client_lines(x, b), b, line,
+        startp, endp));
+}
+
 static void text_client_free(t_text_client *x)
 {
     gpointer_unset(&x->tc_gp);
+    textlines_clear(&x->tc_ownlines);
 }
 
 /* ------- text_get object - output all or part of nth lines ----------- */
@@ -807,24 +988,24 @@ static void text_get_float(t_text_get *x, t_floatarg f)
 {
     t_binbuf *b = text_client_getbuf(&x->x_tc);
     int start, end, n, startfield, nfield;
-    t_atom *vec;
     if (!b)
        return;
-    vec = binbuf_getvec(b);
     n = binbuf_getnatom(b);
     startfield = x->x_f1;
     nfield = x->x_f2;
-    if (text_nthline(n, vec, f, &start, &end))
+    if (text_client_nthline(&x->x_tc, b, f, &start, &end))
     {
-        int outc = end - start, k;
-        t_atom *outv;
+        int outc = end - start;
+        t_atom *outv, term;
         if (x->x_f1 < 0)    /* negative start field for whole line */
         {
                 /* tell us what terminated the line (semi or comma) */
-            outlet_float(x->x_out2, (end < n && vec[end].a_type == A_COMMA));
+            SETSEMI(&term);
+            if (end < n)
+                binbuf_getatoms(b, end, 1, &term);
+            outlet_float(x->x_out2, (term.a_type == A_COMMA));
             ATOMS_ALLOCA(outv, outc);
-            for (k = 0; k < outc; k++)
-                outv[k] = vec[start+k];
+            binbuf_getatoms(b, start, outc, outv);
             outlet_list(x->x_out1, 0, outc, outv);
             ATOMS_FREEA(outv, outc);
         }
@@ -834,8 +1015,7 @@ static void text_get_float(t_text_get *x, t_floatarg f)
         else
         {
             ATOMS_ALLOCA(outv, nfield);
-            for (k = 0; k < nfield; k++)
-                outv[k] = vec[(start+startfield)+k];
+            binbuf_getatoms(b, start + startfield, nfield, outv);
             outlet_list(x->x_out1, 0, nfield, outv);
             ATOMS_FREEA(outv, nfield);
         }
@@ -906,6 +1086,7 @@ static void text_set_list(t_text_set *x,
             /* check for overflow in this conversion: */
         lineno = (x->x_f1 > (double)0x7fffffff ? 0x7fffffff : (int)x->x_f1);
     t_atom *vec;
+    t_textlines *tl;
     if (!b)
        return;
     vec = binbuf_getvec(b);
@@ -915,7 +1096,8 @@ static void text_set_list(t_text_set *x,
         pd_error(x, "text set: line number (%d) < 0", lineno);
         return;
     }
-    if (text_nthline(n, vec, lineno, &start, &end))
+    tl = text_client_lines(&x->x_tc, b);
+    if (textlines_nthline(tl, b, lineno, &start, &end))
     {
         if (fieldno < 0)
         {
@@ -933,6 +1115,14 @@ static void text_set_list(t_text_set *x,
                     (void)binbuf_resize(b, n);
                     vec = binbuf_getvec(b);
                 }
+                if (tl)
+                {
+                    textlines_shift(tl, lineno + 1, 0, n - oldn);
+                    tl->tl_end[lineno] += n - oldn;
+                        /* emptying an unterminated last line removes it */
+                    if (tl->tl_start[lineno] == n)
+                        tl->tl_nlines--;
+                }
             }
         }
         else
@@ -958,6 +1148,12 @@ static void text_set_list(t_text_set *x,
             SETSEMI(&vec[n]);
         SETSEMI(&vec[newsize-1]);
         start = n+addsemi;
+        if (tl)
+        {
+            textlines_shift(tl, tl->tl_nlines, 1, 0);
+            tl->tl_start[tl->tl_nlines-1] = start;
+            tl->tl_end[tl->tl_nlines-1] = newsize-1;
+        }
     }
     else
     {
@@ -970,6 +1166,9 @@ static void text_set_list(t_text_set *x,
             SETSYMBOL(&vec[start+i], gensym("(pointer)"));
         else vec[start+i] = argv[i];
     }
+    binbuf_touch(b);
+    if (tl)
+        tl->tl_stamp = binbuf_getstamp(b);
     text_client_senditup(&x->x_tc);
 }
 
@@ -1018,6 +1217,7 @@ static void text_insert_list(t_text_insert *x,
          lineno = (x->x_f1 > (double)0x7fffffff ? 0x7fffffff : x->x_f1);
 
     t_atom *vec;
+    t_textlines *tl;
     if (!b)
        return;
     if (lineno < 0)
@@ -1026,8 +1226,21 @@ static void text_insert_list(t_text_insert *x,
         return;
     }
     nwas = binbuf_getnatom(b);
-    if (!text_nthline(nwas, binbuf_getvec(b), lineno, &start, &end))
-        start = nwas;
+    tl = text_client_lines(&x->x_tc, b);
+    if (!textlines_nthline(tl, b, lineno, &start, &end))
+        start = nwas, lineno = (tl ? tl->tl_nlines : 0);
+    if (tl)
+    {
+            /* past the end, we extend a last line that had no terminator */
+        if (start == nwas && tl->tl_nlines && tl->tl_end[lineno-1] == nwas)
+            tl->tl_end[lineno-1] += argc;
+        else
+        {
+            textlines_shift(tl, lineno, 1, argc + 1);
+            tl->tl_start[lineno] = start;
+            tl->tl_end[lineno] = start + argc;
+        }
+    }
     (void)binbuf_resize(b, (n = nwas + argc + 1));
     vec = binbuf_getvec(b);
     if (start < n)
@@ -1039,6 +1252,8 @@ static void text_insert_list(t_text_insert *x,
         else vec[start+i] = argv[i];
     }
     SETSEMI(&vec[start+argc]);
+    if (tl)
+        tl->tl_stamp = binbuf_getstamp(b);
     text_client_senditup(&x->x_tc);
 }
 
@@ -1071,24 +1286,34 @@ static void text_delete_float(t_text_delete *x, t_floatarg f)
     int start, end, n,
          lineno = (f > (double)0x7fffffff ? 0x7fffffff : f);
     t_atom *vec;
+    t_textlines *tl;
     if (!b)
        return;
     vec = binbuf_getvec(b);
     n = binbuf_getnatom(b);
+    tl = text_client_lines(&x->x_tc, b);
     if (lineno < 0)
+    {
         binbuf_clear(b);
-    else if (text_nthline(n, vec, lineno, &start, &end))
+        if (tl)
+            tl->tl_nlines = 0;
+    }
+    else if (textlines_nthline(tl, b, lineno, &start, &end))
     {
         if (end < n)
             end++;
         memmove(&vec[start], &vec[end], sizeof(*vec) * (n - end));
         (void)binbuf_resize(b, n - (end - start));
+        if (tl)
+            textlines_shift(tl, lineno + 1, -1, -(end - start));
     }
     else
     {
         post("text delete: %d: line number out of range", lineno);
         return;
     }
+    if (tl)
+        tl->tl_stamp = binbuf_getstamp(b);
     text_client_senditup(&x->x_tc);
 }
 
@@ -1121,17 +1346,16 @@ static void text_size_bang(t_text_size *x)
 {
     t_binbuf *b = text_client_getbuf(&x->x_tc);
     int n, i, cnt = 0;
-    t_atom *vec;
+    t_textlines *tl;
     if (!b)
        return;
-    vec = binbuf_getvec(b);
-    n = binbuf_getnatom(b);
-    for (i = 0; i < n; i++)
+    if ((tl = text_client_lines(&x->x_tc, b)))
     {
-        if (vec[i].a_type == A_SEMI || vec[i].a_type == A_COMMA)
-            cnt++;
+        outlet_float(x->x_out1, tl->tl_nlines);
+        return;
     }
-    if (n && vec[n-1].a_type != A_SEMI && vec[n-1].a_type != A_COMMA)
+    n = binbuf_getnatom(b);
+    for (i = 0; i < n; i = binbuf_nextbreak(b, i) + 1)
         cnt++;
     outlet_float(x->x_out1, cnt);
 }
@@ -1139,13 +1363,10 @@ static void text_size_bang(t_text_size *x)
 static void text_size_float(t_text_size *x, t_floatarg f)
 {
     t_binbuf *b = text_client_getbuf(&x->x_tc);
-    int start, end, n;
-    t_atom *vec;
+    int start, end;
     if (!b)
        return;
-    vec = binbuf_getvec(b);
-    n = binbuf_getnatom(b);
-    if (text_nthline(n, vec, f, &start, &end))
+    if (text_client_nthline(&x->x_tc, b, f, &start, &end))
         outlet_float(x->x_out1, end-start);
     else outlet_float(x->x_out1, -1);
 }
@@ -1239,6 +1460,17 @@ typedef struct _text_search
     int x_onset;        /* first line to include in search */
     int x_range;        /* max number of lines to search */
     t_key *x_keyvec;
+        /* lines by the value of the first key's field, made on the second
+        search to the same version of the buffer as with textlines_get() */
+    unsigned long x_stamp;  /* binbuf stamp the following are valid for */
+    int x_nquery;           /* times searched in this version */
+    int x_nhash;            /* hash table size, 0 if none */
+    int x_nhashline;        /* number of lines hashed */
+    int *x_hashhead;        /* first line in each slot */
+    int *x_hashnext;        /* next line in the same slot, in order */
+    int x_nsort;            /* number of lines in x_sort, -1 if none */
+    t_textsortent *x_sort;  /* lines with a float in the field, by value */
+    int x_sortnan;          /* true if some value there isn't finite */
 } t_text_search;
 
 static void *text_search_new(t_symbol *s, int argc, t_atom *argv)
@@ -1256,6 +1488,10 @@ static void *text_search_new(t_symbol *s, int argc, t_atom *argv)
     x->x_onset = 0;
     x->x_range = 0x7fffffff;
     x->x_keyvec = (t_key *)getbytes(nkey * sizeof(*x->x_keyvec));
+    x->x_stamp = 0;
+    x->x_nquery = 0;
+    x->x_nhash = 0;
+    x->x_nsort = -1;
     if (!argc)
         x->x_keyvec[0].k_field = 0, x->x_keyvec[0].k_binop = KB_EQ;
     else for (i = key = 0, nextop = -1; i < argc; i++)
@@ -1294,13 +1530,330 @@ static void *text_search_new(t_symbol *s, int argc, t_atom *argv)
     return (x);
 }
 
+    /* test one line, "thisn" fields long and starting at "thisstart", and
+    if it matches and beats the best line so far, make it the best. */
+static void text_search_line(t_text_search *x, t_atom *vec, int lineno,
+    int thisstart, int thisn, int argc, t_atom *argv,
+    int *bestlinep, int *beststartp, int *failedp)
+{
+    int j, field, binop, nkeys = x->x_nkeys;
+    field = x->x_keyvec[0].k_field;
+    binop = x->x_keyvec[0].k_binop;
+        /* do we match? */
+    for (j = 0; j < argc; )
+    {
+        if (field >= thisn ||
+            vec[thisstart+field].a_type != argv[j].a_type)
+                return;
+        if (argv[j].a_type == A_FLOAT)      /* arg is a float */
+        {
+            switch (binop)
+            {
+                case KB_EQ:
+                    if (vec[thisstart+field].a_w.w_float !=
+                        argv[j].a_w.w_float)
+                            return;
+                break;
+                case KB_GT:
+                    if (vec[thisstart+field].a_w.w_float <=
+                        argv[j].a_w.w_float)
+                            return;
+                break;
+                case KB_GE:
+                    if (vec[thisstart+field].a_w.w_float <
+                        argv[j].a_w.w_float)
+                            return;
+                break;
+                case KB_LT:
+                    if (vec[thisstart+field].a_w.w_float >=
+                        argv[j].a_w.w_float)
+                            return;
+                break;
+                case KB_LE:
+                    if (vec[thisstart+field].a_w.w_float >
+                        argv[j].a_w.w_float)
+                            return;
+                break;
+                    /* the other possibility ('near') never fails */
+            }
+        }
+        else                                /* arg is a symbol */
+        {
+            if (binop != KB_EQ)
+            {
+                if (!*failedp)
+                {
+                    pd_error(x,
+            "text search (%s): only exact matches allowed for symbols",
+                        argv[j].a_w.w_symbol->s_name);
+                    *failedp = 1;
+                }
+                return;
+            }
+            if (vec[thisstart+field].a_w.w_symbol !=
+                argv[j].a_w.w_symbol)
+                    return;
+        }
+        if (++j >= nkeys)    /* if at last key just increment field */
+            field++;
+        else field = x->x_keyvec[j].k_field,    /* else next key */
+                binop = x->x_keyvec[j].k_binop;
+    }
+        /* the line matches.  Now, if there is a previous match, are
+        we better than it? */
+    if (*bestlinep >= 0)
+    {
+        field = x->x_keyvec[0].k_field;
+        binop = x->x_keyvec[0].k_binop;
+        for (j = 0; j < argc; )
+        {
+            if (field >= thisn
+                || vec[thisstart+field].a_type != argv[j].a_type)
+                    bug("text search 2");
+            if (argv[j].a_type == A_FLOAT)      /* arg is a float */
+            {
+                float thisv = vec[thisstart+field].a_w.w_float,
+                    bestv = (*beststartp >= 0 ?
+                        vec[*beststartp+field].a_w.w_float : -1e20);
+                switch (binop)
+                {
+                    case KB_GT:
+                    case KB_GE:
+                        if (thisv < bestv)
+                            goto replace;
+                        else if (thisv > bestv)
+                            return;
+                    break;
+                    case KB_LT:
+                    case KB_LE:
+                        if (thisv > bestv)
+                            goto replace;
+                        else if (thisv < bestv)
+                            return;
+                    break;
+                    case KB_NEAR:
+                        if (thisv >= argv[j].a_w.w_float &&
+                            bestv >= argv[j].a_w.w_float)
+                        {
+                            if (thisv < bestv)
+                                goto replace;
+                            else if (thisv > bestv)
+                                return;
+                        }
+                        else if (thisv <= argv[j].a_w.w_float &&
+                            bestv <= argv[j].a_w.w_float)
+                        {
+                            if (thisv > bestv)
+                                goto replace;
+                            else if (thisv < bestv)
+                                return;
+                        }
+                        else
+                        {
+                            float d1 = thisv - argv[j].a_w.w_float,
+                                d2 = bestv - argv[j].a_w.w_float;
+                            if (d1 < 0)
+                                d1 = -d1;
+                            if (d2 < 0)
+                                d2 = -d2;
+
+                            if (d1 < d2)
+                                goto replace;
+                            else if (d1 > d2)
+                                return;
+                        }
+                    break;
+                        /* the other possibility ('=') never decides */
+                }
+            }
+            if (++j >= nkeys)    /* last key - increment field */
+                field++;
+            else field = x->x_keyvec[j].k_field,    /* else next key */
+                    binop = x->x_keyvec[j].k_binop;
+        }
+        return;   /* a tie - keep the old one */
+    replace:
+        *bestlinep = lineno, *beststartp = thisstart;
+    }
+        /* no previous match so we're best */
+    else *bestlinep = lineno, *beststartp = thisstart;
+}
+
+static unsigned int text_search_hash(t_atom *a)
+{
+    unsigned int h;
+    if (a->a_type == A_SYMBOL)
+        h = a->a_w.w_symbol->s_hash;
+    else if (a->a_w.w_float == 0)   /* so that -0 and 0 hash alike */
+        h = 0;
+    else
+    {
+        unsigned char *bytes = (unsigned char *)&a->a_w.w_float;
+        int i;
+        for (i = 0, h = 2166136261u; i < (int)sizeof(t_float); i++)
+            h = (h ^ bytes[i]) * 16777619u;
+    }
+    return (h * 2654435761u);
+}
+
+    /* the number of fields "text search" sees in a line;  it has always
+    left the last atom out of the last line if it wasn't terminated. */
+#define TL_SEARCHSIZE(tl, n, line) \
+    ((tl)->tl_end[line] - (tl)->tl_start[line] - ((tl)->tl_end[line] == (n)))
+
+static void text_search_clearindex(t_text_search *x)
+{
+    if (x->x_nhash)
+    {
+        freebytes(x->x_hashhead, x->x_nhash * sizeof(int));
+        freebytes(x->x_hashnext, (x->x_nhashline + 1) * sizeof(int));
+        x->x_nhash = 0;
+    }
+    if (x->x_nsort >= 0)
+    {
+        freebytes(x->x_sort, (x->x_nsort + 1) * sizeof(t_textsortent));
+        x->x_nsort = -1;
+    }
+}
+
+    /* hash the lines by the atom in the first key's field */
+static void text_search_makehash(t_text_search *x, t_textlines *tl,
+    t_atom *vec, int n)
+{
+    int i, nhash = 16, field = x->x_keyvec[0].k_field;
+    while (nhash < tl->tl_nlines)
+        nhash *= 2;
+    x->x_nhash = nhash;
+    x->x_nhashline = tl->tl_nlines;
+    x->x_hashhead = (int *)getbytes(nhash * sizeof(int));
+    x->x_hashnext = (int *)getbytes((tl->tl_nlines + 1) * sizeof(int));
+    for (i = 0; i < nhash; i++)
+        x->x_hashhead[i] = -1;
+        /* go backward so that each slot lists its lines in order */
+    for (i = tl->tl_nlines - 1; i >= 0; i--)
+    {
+        t_atom *a = &vec[tl->tl_start[i] + field];
+        if (field < TL_SEARCHSIZE(tl, n, i) &&
+            (a->a_type == A_FLOAT || a->a_type == A_SYMBOL))
+        {
+            unsigned int slot = text_search_hash(a) & (nhash - 1);
+            x->x_hashnext[i] = x->x_hashhead[slot];
+            x->x_hashhead[slot] = i;
+        }
+        else x->x_hashnext[i] = -1;
+    }
+}
+
+    /* true if a (single precision) value is infinite or NaN.  The sorted
+    list is only used for single precision Pd, and can't be for values
+    like these that don't compare consistently. */
+static int text_search_notfinite(float f)
+{
+    union
+    {
+        float uf;
+        unsigned int ui;
+    } u;
+    u.uf = f;
+    return ((u.ui & 0x7f800000) == 0x7f800000);
+}
+
+static int text_search_sortcompare(const void *z1, const void *z2)
+{
+    const t_textsortent *e1 = (const t_textsortent *)z1,
+        *e2 = (const t_textsortent *)z2;
+    if (e1->se_value < e2->se_value)
+        return (-1);
+    else if (e1->se_value > e2->se_value)
+        return (1);
+    else return (e1->se_line - e2->se_line);
+}
+
+    /* sort the lines with a float in the first key's field by its value */
+static void text_search_makesort(t_text_search *x, t_textlines *tl,
+    t_atom *vec, int n)
+{
+    int i, nsort = 0, field = x->x_keyvec[0].k_field;
+    x->x_sort = (t_textsortent *)getbytes((tl->tl_nlines + 1) *
+        sizeof(t_textsortent));
+    x->x_sortnan = 0;
+    for (i = 0; i < tl->tl_nlines; i++)
+    {
+        t_atom *a = &vec[tl->tl_start[i] + field];
+        if (field < TL_SEARCHSIZE(tl, n, i) && a->a_type == A_FLOAT)
+        {
+            if (text_search_notfinite(a->a_w.w_float))
+                x->x_sortnan = 1;
+            x->x_sort[nsort].se_value = a->a_w.w_float;
+            x->x_sort[nsort++].se_line = i;
+        }
+    }
+    x->x_sort = (t_textsortent *)resizebytes(x->x_sort,
+        (tl->tl_nlines + 1) * sizeof(t_textsortent),
+            (nsort + 1) * sizeof(t_textsortent));
+    x->x_nsort = nsort;
+    if (!x->x_sortnan)
+        qsort(x->x_sort, nsort, sizeof(t_textsortent),
+            text_search_sortcompare);
+}
+
+    /* first entry in the sorted list whose value is >= f (or > f if
+    "after" is set) */
+static int text_search_bound(t_text_search *x, t_float f, int after)
+{
+    int lo = 0, hi = x->x_nsort;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (x->x_sort[mid].se_value < f ||
+            (after && x->x_sort[mid].se_value == f))
+                lo = mid + 1;
+        else hi = mid;
+    }
+    return (lo);
+}
+
+    /* search for a single float by comparison, if the sorted list allows. If
+    so set the best line (or -1) and return 1. */
+static int text_search_sorted(t_text_search *x, t_textlines *tl,
+    t_atom *vec, int n, t_float f, int *bestlinep)
+{
+    int binop = x->x_keyvec[0].k_binop, i;
+    if (binop == KB_EQ || binop == KB_NEAR || x->x_onset > 0 ||
+        x->x_onset + x->x_range < tl->tl_nlines ||
+            sizeof(t_float) != sizeof(float) || text_search_notfinite(f))
+                return (0);
+    if (x->x_nsort < 0)
+        text_search_makesort(x, tl, vec, n);
+    if (x->x_sortnan)
+        return (0);
+    if (binop == KB_GT || binop == KB_GE)
+    {
+            /* the smallest value above f wins, and takes the earliest line
+            because lines with equal values are sorted by line number */
+        i = text_search_bound(x, f, binop == KB_GT);
+        *bestlinep = (i < x->x_nsort ? x->x_sort[i].se_line : -1);
+    }
+    else
+    {
+            /* the largest value below f wins, again its earliest line */
+        i = text_search_bound(x, f, binop == KB_LE);
+        if (i > 0)
+            i = text_search_bound(x, x->x_sort[i-1].se_value, 0),
+                *bestlinep = x->x_sort[i].se_line;
+        else *bestlinep = -1;
+    }
+    return (1);
+}
+
 static void text_search_list(t_text_search *x,
     t_symbol *s, int argc, t_atom *argv)
 {
     t_binbuf *b = text_client_getbuf(&x->x_tc);
-    int i, n, lineno, bestline = -1, beststart=-1, bestn, thisstart,
-        nkeys = x->x_nkeys, failed = 0;
+    int i, n, lineno, bestline = -1, beststart=-1, thisstart,
+        nkeys = x->x_nkeys, failed = 0, last;
     t_atom *vec;
+    t_textlines *tl;
     if (!b)
        return;
     if (argc < nkeys)
@@ -1312,157 +1865,54 @@ static void text_search_list(t_text_search *x,
     n = binbuf_getnatom(b);
     if (nkeys < 1)
         bug("text_search");
+    if (x->x_stamp != binbuf_getstamp(b))
+    {
+        text_search_clearindex(x);
+        x->x_stamp = binbuf_getstamp(b);
+        x->x_nquery = 0;
+    }
+    x->x_nquery++;
+    if ((tl = text_client_lines(&x->x_tc, b)))
+    {
+        last = (tl->tl_nlines - x->x_onset < x->x_range ?
+            tl->tl_nlines : x->x_onset + x->x_range);
+        if (x->x_nquery >= 2 && argc && x->x_keyvec[0].k_binop == KB_EQ &&
+            (argv[0].a_type == A_FLOAT || argv[0].a_type == A_SYMBOL))
+        {
+                /* only lines hashed with the first key can match it */
+            if (!x->x_nhash)
+                text_search_makehash(x, tl, vec, n);
+            for (lineno = x->x_hashhead[text_search_hash(argv) &
+                (x->x_nhash - 1)]; lineno >= 0 && lineno < last;
+                    lineno = x->x_hashnext[lineno])
+                        if (lineno >= x->x_onset)
+                            text_search_line(x, vec, lineno,
+                                tl->tl_start[lineno],
+                                    TL_SEARCHSIZE(tl, n, lineno),
+                                        argc, argv, &bestline, &beststart,
+                                            &failed);
+        }
+        else if (!(x->x_nquery >= 2 && argc == 1 && nkeys == 1 &&
+            argv[0].a_type == A_FLOAT && text_search_sorted(x, tl, vec, n,
+                argv[0].a_w.w_float, &bestline)))
+        {
+            for (lineno = x->x_onset; lineno < last; lineno++)
+                text_search_line(x, vec, lineno, tl->tl_start[lineno],
+                    TL_SEARCHSIZE(tl, n, lineno), argc, argv,
+                        &bestline, &beststart, &failed);
+        }
+        outlet_float(x->x_out1, bestline);
+        return;
+    }
     for (i = lineno = thisstart = 0; i < n; i++)
     {
         if (vec[i].a_type == A_SEMI || vec[i].a_type == A_COMMA || i == n-1)
         {
-            int thisn, j, field, binop;
-            if (lineno < x->x_onset)
-                goto nomatch;
             if (lineno >= x->x_onset + x->x_range)
                 break;
-            thisn = i - thisstart;
-            field = x->x_keyvec[0].k_field;
-            binop = x->x_keyvec[0].k_binop;
-                /* do we match? */
-            for (j = 0; j < argc; )
-            {
-                if (field >= thisn ||
-                    vec[thisstart+field].a_type != argv[j].a_type)
-                        goto nomatch;
-                if (argv[j].a_type == A_FLOAT)      /* arg is a float */
-                {
-                    switch (binop)
-                    {
-                        case KB_EQ:
-                            if (vec[thisstart+field].a_w.w_float !=
-                                argv[j].a_w.w_float)
-                                    goto nomatch;
-                        break;
-                        case KB_GT:
-                            if (vec[thisstart+field].a_w.w_float <=
-                                argv[j].a_w.w_float)
-                                    goto nomatch;
-                        break;
-                        case KB_GE:
-                            if (vec[thisstart+field].a_w.w_float <
-                                argv[j].a_w.w_float)
-                                    goto nomatch;
-                        break;
-                        case KB_LT:
-                            if (vec[thisstart+field].a_w.w_float >=
-                                argv[j].a_w.w_float)
-                                    goto nomatch;
-                        break;
-                        case KB_LE:
-                            if (vec[thisstart+field].a_w.w_float >
-                                argv[j].a_w.w_float)
-                                    goto nomatch;
-                        break;
-                            /* the other possibility ('near') never fails */
-                    }
-                }
-                else                                /* arg is a symbol */
-                {
-                    if (binop != KB_EQ)
-                    {
-                        if (!failed)
-                        {
-                            pd_error(x,
-                    "text search (%s): only exact matches allowed for symbols",
-                                argv[j].a_w.w_symbol->s_name);
-                            failed = 1;
-                        }
-                        goto nomatch;
-                    }
-                    if (vec[thisstart+field].a_w.w_symbol !=
-                        argv[j].a_w.w_symbol)
-                            goto nomatch;
-                }
-                if (++j >= nkeys)    /* if at last key just increment field */
-                    field++;
-                else field = x->x_keyvec[j].k_field,    /* else next key */
-                        binop = x->x_keyvec[j].k_binop;
-            }
-                /* the line matches.  Now, if there is a previous match, are
-                we better than it? */
-            if (bestline >= 0)
-            {
-                field = x->x_keyvec[0].k_field;
-                binop = x->x_keyvec[0].k_binop;
-                for (j = 0; j < argc; )
-                {
-                    if (field >= thisn
-                        || vec[thisstart+field].a_type != argv[j].a_type)
-                            bug("text search 2");
-                    if (argv[j].a_type == A_FLOAT)      /* arg is a float */
-                    {
-                        float thisv = vec[thisstart+field].a_w.w_float,
-                            bestv = (beststart >= 0 ?
-                                vec[beststart+field].a_w.w_float : -1e20);
-                        switch (binop)
-                        {
-                            case KB_GT:
-                            case KB_GE:
-                                if (thisv < bestv)
-                                    goto replace;
-                                else if (thisv > bestv)
-                                    goto nomatch;
-                            break;
-                            case KB_LT:
-                            case KB_LE:
-                                if (thisv > bestv)
-                                    goto replace;
-                                else if (thisv < bestv)
-                                    goto nomatch;
-                            break;
-                            case KB_NEAR:
-                                if (thisv >= argv[j].a_w.w_float &&
-                                    bestv >= argv[j].a_w.w_float)
-                                {
-                                    if (thisv < bestv)
-                                        goto replace;
-                                    else if (thisv > bestv)
-                                        goto nomatch;
-                                }
-                                else if (thisv <= argv[j].a_w.w_float &&
-                                    bestv <= argv[j].a_w.w_float)
-                                {
-                                    if (thisv > bestv)
-                                        goto replace;
-                                    else if (thisv < bestv)
-                                        goto nomatch;
-                                }
-                                else
-                                {
-                                    float d1 = thisv - argv[j].a_w.w_float,
-                                        d2 = bestv - argv[j].a_w.w_float;
-                                    if (d1 < 0)
-                                        d1 = -d1;
-                                    if (d2 < 0)
-                                        d2 = -d2;
-
-                                    if (d1 < d2)
-                                        goto replace;
-                                    else if (d1 > d2)
-                                        goto nomatch;
-                                }
-                            break;
-                                /* the other possibility ('=') never decides */
-                        }
-                    }
-                    if (++j >= nkeys)    /* last key - increment field */
-                        field++;
-                    else field = x->x_keyvec[j].k_field,    /* else next key */
-                            binop = x->x_keyvec[j].k_binop;
-                }
-                goto nomatch;   /* a tie - keep the old one */
-            replace:
-                bestline = lineno, beststart = thisstart, bestn = thisn;
-            }
-                /* no previous match so we're best */
-            else bestline = lineno, beststart = thisstart, bestn = thisn;
-        nomatch:
+            if (lineno >= x->x_onset)
+                text_search_line(x, vec, lineno, thisstart, i - thisstart,
+                    argc, argv, &bestline, &beststart, &failed);
             lineno++;
             thisstart = i+1;
         }
@@ -1477,6 +1927,13 @@ static void text_search_range(t_text_search *x, t_floatarg onset,
     x->x_range = (range >= 0x7fffffff ? 0x7ffffff : (range < 0 ? 0 : range));
 }
 
+static void text_search_free(t_text_search *x)
+{
+    freebytes(x->x_keyvec, x->x_nkeys * sizeof(*x->x_keyvec));
+    text_search_clearindex(x);
+    text_client_free(&x->x_tc);
+}
+
 /* ---------------- text_sequence object - sequencer ----------- */
 t_class *text_sequence_class;
 
@@ -1787,7 +2244,7 @@ static void text_sequence_line(t_text_sequence *x, t_floatarg f)
     x->x_lastto = 0;
     vec = binbuf_getvec(b);
     n = binbuf_getnatom(b);
-    if (!text_nthline(n, vec, f, &start, &end))
+    if (!text_client_nthline(&x->x_tc, b, f, &start, &end))
     {
         pd_error(x, "text sequence: line number %d out of range", (int)f);
         x->x_onset = 0x7fffffff;
@@ -1866,6 +2323,41 @@ static void *text_new(t_symbol *s, int argc, t_atom *argv)
 * is probably best left alone.
 */
 
+    /* "read <file> stream" doesn't load the whole file.  Instead a thread
+    reads it ahead into a ring buffer, and the binbuf holds only a window
+    of messages that the main thread parses from it as playback needs them,
+    dropping those already played.  Parsing has to stay in the main thread
+    since it makes symbols. */
+
+#define QSTREAMRING 65536       /* bytes read ahead of the parser */
+#define QSTREAMCHUNK 4096       /* bytes taken from the ring at a time */
+#define QSTREAMWINDOW 1024      /* atoms to parse at each refill */
+
+typedef struct _qstream
+{
+    pthread_t s_thread;
+    pthread_mutex_t s_mutex;
+    pthread_cond_t s_cond;
+    int s_fd;
+    int s_cr;               /* map newlines to semicolons */
+        /* shared with the reader thread, under s_mutex: */
+    char *s_ring;
+    int s_ringhead;         /* where the thread writes next */
+    int s_ringfill;         /* bytes waiting to be parsed */
+    int s_eof;              /* the thread has read up to the end */
+    int s_errno;            /* nonzero if that was because of an error */
+    int s_rewind;           /* request to start over from the top */
+    int s_quit;             /* request to exit */
+        /* main thread only: */
+    int s_used;             /* taken anything from the ring since rewind */
+    int s_flushed;          /* parser has seen the end of the file */
+    t_binbufparser *s_parser;
+    t_binbuf *s_msg;        /* one parsed message */
+    char s_chunk[QSTREAMCHUNK];
+    int s_chunkn;
+    int s_chunkpos;
+} t_qstream;
+
 typedef struct _qlist
 {
     t_textbuf x_textbuf;
@@ -1877,11 +2369,198 @@ typedef struct _qlist
     t_float x_clockdelay;
     int x_rewound;          /* we've been rewound since last start */
     int x_innext;           /* we're currently inside the "next" routine */
+    t_qstream *x_stream;    /* file we're streaming from, if any */
+    t_atom *x_window;       /* the next message, if the binbuf is packed */
+    int x_windowsize;
 } t_qlist;
 #define x_ob x_textbuf.b_ob
 #define x_binbuf x_textbuf.b_binbuf
 #define x_canvas x_textbuf.b_canvas
 
+static void *qstream_thread(void *z)
+{
+    t_qstream *st = (t_qstream *)z;
+    sys_setthreadrole(SYS_THREAD_FILE);
+    pthread_mutex_lock(&st->s_mutex);
+    while (!st->s_quit)
+    {
+        int head, want, got;
+        if (st->s_rewind)
+        {
+            st->s_rewind = 0;
+            st->s_ringhead = st->s_ringfill = 0;
+            if (lseek(st->s_fd, 0, SEEK_SET) < 0)
+                st->s_eof = 1, st->s_errno = errno;
+            else st->s_eof = st->s_errno = 0;
+            pthread_cond_broadcast(&st->s_cond);
+            continue;
+        }
+        if (st->s_eof || st->s_ringfill == QSTREAMRING)
+        {
+            pthread_cond_wait(&st->s_cond, &st->s_mutex);
+            continue;
+        }
+        head = st->s_ringhead;
+        want = QSTREAMRING - st->s_ringfill;
+        if (want > QSTREAMRING - head)
+            want = QSTREAMRING - head;
+        pthread_mutex_unlock(&st->s_mutex);
+            /* the main thread doesn't touch the ring past s_ringfill */
+        got = (int)read(st->s_fd, st->s_ring + head, want);
+        pthread_mutex_lock(&st->s_mutex);
+        if (st->s_rewind)       /* what we just read is stale */
+            continue;
+        if (got <= 0)
+            st->s_eof = 1, st->s_errno = (got < 0 ? errno : 0);
+        else
+        {
+            st->s_ringhead = (head + got) % QSTREAMRING;
+            st->s_ringfill += got;
+        }
+        pthread_cond_broadcast(&st->s_cond);
+    }
+    pthread_mutex_unlock(&st->s_mutex);
+    return (0);
+}
+
+static t_qstream *qstream_new(int fd, int cr)
+{
+    t_qstream *st = (t_qstream *)getbytes(sizeof(*st));
+    st->s_fd = fd;
+    st->s_cr = cr;
+    st->s_ring = (char *)getbytes(QSTREAMRING);
+    st->s_ringhead = st->s_ringfill = st->s_eof = st->s_errno = 0;
+    st->s_rewind = st->s_quit = 0;
+    st->s_used = st->s_flushed = 0;
+    st->s_parser = binbufparser_new();
+    st->s_msg = binbuf_new();
+    st->s_chunkn = st->s_chunkpos = 0;
+    pthread_mutex_init(&st->s_mutex, 0);
+    pthread_cond_init(&st->s_cond, 0);
+    if (pthread_create(&st->s_thread, 0, qstream_thread, st))
+    {
+        pthread_mutex_destroy(&st->s_mutex);
+        pthread_cond_destroy(&st->s_cond);
+        binbufparser_free(st->s_parser);
+        binbuf_free(st->s_msg);
+        freebytes(st->s_ring, QSTREAMRING);
+        freebytes(st, sizeof(*st));
+        return (0);
+    }
+    return (st);
+}
+
+static void qstream_free(t_qstream *st)
+{
+    pthread_mutex_lock(&st->s_mutex);
+    st->s_quit = 1;
+    pthread_cond_broadcast(&st->s_cond);
+    pthread_mutex_unlock(&st->s_mutex);
+    pthread_join(st->s_thread, 0);
+    close(st->s_fd);
+    pthread_mutex_destroy(&st->s_mutex);
+    pthread_cond_destroy(&st->s_cond);
+    binbufparser_free(st->s_parser);
+    binbuf_free(st->s_msg);
+    freebytes(st->s_ring, QSTREAMRING);
+    freebytes(st, sizeof(*st));
+}
+
+    /* start over from the top of the file */
+static void qstream_rewind(t_qstream *st)
+{
+    binbufparser_clear(st->s_parser);
+    st->s_chunkn = st->s_chunkpos = 0;
+    st->s_flushed = 0;
+    if (st->s_used)
+    {
+        pthread_mutex_lock(&st->s_mutex);
+        st->s_rewind = 1;
+        st->s_ringfill = 0;
+        st->s_eof = 0;
+        pthread_cond_broadcast(&st->s_cond);
+        pthread_mutex_unlock(&st->s_mutex);
+        st->s_used = 0;
+    }
+}
+
+    /* take up to "size" bytes from the ring, waiting for the thread if it's
+    behind.  Returns 0 at the end of the file. */
+static int qstream_take(t_qstream *st, char *buf, int size)
+{
+    int tail, n;
+    pthread_mutex_lock(&st->s_mutex);
+    while (!st->s_ringfill && !st->s_eof)
+        pthread_cond_wait(&st->s_cond, &st->s_mutex);
+    tail = (st->s_ringhead - st->s_ringfill + QSTREAMRING) % QSTREAMRING;
+    n = st->s_ringfill;
+    if (n > QSTREAMRING - tail)
+        n = QSTREAMRING - tail;
+    if (n > size)
+        n = size;
+    memcpy(buf, st->s_ring + tail, n);
+    st->s_ringfill -= n;
+    pthread_cond_broadcast(&st->s_cond);
+    pthread_mutex_unlock(&st->s_mutex);
+    st->s_used = 1;
+    return (n);
+}
+
+    /* parse messages onto the end of the binbuf until it has grown by
+    QSTREAMWINDOW atoms or the file is done.  Returns 0 if it didn't grow. */
+static int qstream_parse(t_qstream *st, t_binbuf *b, void *owner)
+{
+    int natom = binbuf_getnatom(b), i;
+    while (binbuf_getnatom(b) < natom + QSTREAMWINDOW)
+    {
+        int nused;
+        if (st->s_chunkpos == st->s_chunkn)
+        {
+            if (st->s_flushed)
+                break;
+            st->s_chunkpos = 0;
+            if (!(st->s_chunkn = qstream_take(st, st->s_chunk, QSTREAMCHUNK)))
+            {
+                if (st->s_errno)
+                    pd_error(owner, "qlist: read failed: %s",
+                        strerror(st->s_errno));
+                    /* end a last message the file left unterminated */
+                st->s_chunk[0] = ';';
+                st->s_chunkn = 1;
+                st->s_flushed = 1;
+            }
+            else if (st->s_cr)
+                for (i = 0; i < st->s_chunkn; i++)
+                    if (st->s_chunk[i] == '\n')
+                        st->s_chunk[i] = ';';
+        }
+        if (binbufparser_text(st->s_parser, st->s_msg,
+            st->s_chunk + st->s_chunkpos, st->s_chunkn - st->s_chunkpos,
+                &nused))
+                    binbuf_add(b, binbuf_getnatom(st->s_msg),
+                        binbuf_getvec(st->s_msg));
+        st->s_chunkpos += nused;
+    }
+    return (binbuf_getnatom(b) > natom);
+}
+
+    /* when playback has used up the window, drop it and parse the next one.
+    Returns 0 if we aren't streaming, aren't playing, or the file is done. */
+static int qlist_more(t_qlist *x, int onset)
+{
+    if (!x->x_stream || onset != binbuf_getnatom(x->x_binbuf))
+        return (0);
+    binbuf_clear(x->x_binbuf);
+    x->x_onset = 0;
+    return (qstream_parse(x->x_stream, x->x_binbuf, x));
+}
+
+static void qlist_endstream(t_qlist *x)
+{
+    if (x->x_stream)
+        qstream_free(x->x_stream), x->x_stream = 0;
+}
+
 static void qlist_tick(t_qlist *x);
 
 static t_class *qlist_class;
@@ -1898,17 +2577,57 @@ static void *qlist_new(void)
     x->x_whenclockset = 0;
     x->x_clockdelay = 0;
     x->x_rewound = x->x_innext = 0;
+    x->x_stream = 0;
+    x->x_window = 0;
+    x->x_windowsize = 0;
     return (x);
 }
 
 static void qlist_rewind(t_qlist *x)
 {
+    if (x->x_stream)
+    {
+        binbuf_clear(x->x_binbuf);
+        qstream_rewind(x->x_stream);
+    }
     x->x_onset = 0;
     if (x->x_clock) clock_unset(x->x_clock);
     x->x_whenclockset = 0;
     x->x_rewound = 1;
 }
 
+    /* if the binbuf is packed, skip semicolons and commas from "*onsetp"
+    (setting "*semip" if there was a semicolon) and copy the message after
+    them into x_window.  "*argcp" is set to where the message ends, so that
+    callers can step through the window as they would through the binbuf. */
+static t_atom *qlist_window(t_qlist *x, int *onsetp, int *argcp, int *semip)
+{
+    t_binbuf *b = x->x_binbuf;
+    int onset = *onsetp, n = binbuf_getnatom(b), end;
+    t_atom a;
+    for (; onset < n; onset++)
+    {
+        binbuf_getatoms(b, onset, 1, &a);
+        if (a.a_type == A_SEMI && semip)
+            *semip = 1;
+        else if (a.a_type != A_SEMI && a.a_type != A_COMMA)
+            break;
+    }
+    end = (onset < n ? binbuf_nextbreak(b, onset) : n);
+    if (end - onset > x->x_windowsize)
+    {
+        int size = 2 * (end - onset);
+        x->x_window = (t_atom *)resizebytes(x->x_window,
+            x->x_windowsize * sizeof(t_atom), size * sizeof(t_atom));
+        x->x_windowsize = size;
+    }
+    if (end > onset)
+        binbuf_getatoms(b, onset, end - onset, x->x_window);
+    *onsetp = onset;
+    *argcp = end;
+    return (x->x_window);
+}
+
 static void qlist_donext(t_qlist *x, int drop, int automatic)
 {
     t_pd *target = 0;
@@ -1922,14 +2641,25 @@ static void qlist_donext(t_qlist *x, int drop, int automatic)
     {
         int argc = binbuf_getnatom(x->x_binbuf),
             count, onset = x->x_onset, onset2, wasrewound;
-        t_atom *argv = binbuf_getvec(x->x_binbuf);
-        t_atom *ap = argv + onset, *ap2;
-        if (onset >= argc) goto end;
-        while (ap->a_type == A_SEMI || ap->a_type == A_COMMA)
+        t_atom *ap, *ap2;
+        if (binbuf_ispacked(x->x_binbuf))
+        {
+            int semi = 0;
+            ap = qlist_window(x, &onset, &argc, &semi);
+            if (semi)
+                target = 0;
+        }
+        else ap = binbuf_getvec(x->x_binbuf) + onset;
+        while (onset < argc && (ap->a_type == A_SEMI || ap->a_type == A_COMMA))
         {
             if (ap->a_type == A_SEMI) target = 0;
             onset++, ap++;
-            if (onset >= argc) goto end;
+        }
+        if (onset >= argc)
+        {
+            if (qlist_more(x, onset))
+                continue;
+            goto end;
         }
 
         if (!target && ap->a_type == A_FLOAT)
@@ -2023,21 +2753,27 @@ static void qlist_tick(t_qlist *x)
     qlist_donext(x, 0, 1);
 }
 
+    /* editing the contents ends streaming, leaving the window we had */
 static void qlist_add(t_qlist *x, t_symbol *s, int argc, t_atom *argv)
 {
     t_atom a;
+    qlist_endstream(x);
     SETSEMI(&a);
     binbuf_add(x->x_binbuf, argc, argv);
     binbuf_add(x->x_binbuf, 1, &a);
+    textbuf_packlater(&x->x_textbuf);
 }
 
 static void qlist_add2(t_qlist *x, t_symbol *s, int argc, t_atom *argv)
 {
+    qlist_endstream(x);
     binbuf_add(x->x_binbuf, argc, argv);
+    textbuf_packlater(&x->x_textbuf);
 }
 
 static void qlist_clear(t_qlist *x)
 {
+    qlist_endstream(x);
     qlist_rewind(x);
     binbuf_clear(x->x_binbuf);
 }
@@ -2048,16 +2784,42 @@ static void qlist_set(t_qlist *x, t_symbol *s, int argc, t_atom *argv)
     qlist_add(x, s, argc, argv);
 }
 
-static void qlist_read(t_qlist *x, t_symbol *filename, t_symbol *format)
+static void qlist_read(t_qlist *x, t_symbol *filename, t_symbol *format,
+    t_symbol *format2)
 {
-    int cr = 0;
-    if (!strcmp(format->s_name, "cr"))
-        cr = 1;
-    else if (*format->s_name)
-        pd_error(x, "qlist_read: unknown flag: %s", format->s_name);
-
-    if (binbuf_read_via_canvas(x->x_binbuf, filename->s_name, x->x_canvas, cr))
+    int cr = 0, stream = 0;
+    t_symbol *flags[2];
+    int i;
+    flags[0] = format;
+    flags[1] = format2;
+    for (i = 0; i < 2; i++)
+    {
+        if (!strcmp(flags[i]->s_name, "cr"))
+            cr = 1;
+        else if (!strcmp(flags[i]->s_name, "stream"))
+            stream = 1;
+        else if (*flags[i]->s_name)
+            pd_error(x, "qlist_read: unknown flag: %s", flags[i]->s_name);
+    }
+    qlist_endstream(x);
+    if (stream)
+    {
+        char buf[MAXPDSTRING], *bufptr;
+        int fd = canvas_open(x->x_canvas, filename->s_name, "",
+            buf, &bufptr, MAXPDSTRING, 1);
+        binbuf_clear(x->x_binbuf);
+        if (fd < 0)
+            pd_error(x, "%s: can't open", filename->s_name);
+        else if (!(x->x_stream = qstream_new(fd, cr)))
+        {
+            pd_error(x, "%s: couldn't start reader thread", filename->s_name);
+            close(fd);
+        }
+    }
+    else if (binbuf_read_via_canvas(x->x_binbuf, filename->s_name,
+        x->x_canvas, cr))
             pd_error(x, "%s: read failed", filename->s_name);
+    else textbuf_packlater(&x->x_textbuf);
     x->x_onset = 0x7fffffff;
     x->x_rewound = 1;
 }
@@ -2101,7 +2863,10 @@ static void qlist_tempo(t_qlist *x, t_float f)
 
 static void qlist_free(t_qlist *x)
 {
+    qlist_endstream(x);
     textbuf_free(&x->x_textbuf);
+    if (x->x_window)
+        freebytes(x->x_window, x->x_windowsize * sizeof(t_atom));
     clock_free(x->x_clock);
 }
 
@@ -2126,18 +2891,29 @@ static void *textfile_new(void)
     x->x_whenclockset = 0;
     x->x_clockdelay = 0;
     x->x_clock = NULL;
+    x->x_stream = 0;
+    x->x_window = 0;
+    x->x_windowsize = 0;
     return (x);
 }
 
 static void textfile_bang(t_qlist *x)
 {
-    int argc = binbuf_getnatom(x->x_binbuf),
-        onset = x->x_onset, onset2;
-    t_atom *argv = binbuf_getvec(x->x_binbuf);
-    t_atom *ap = argv + onset, *ap2;
-    while (onset < argc &&
-        (ap->a_type == A_SEMI || ap->a_type == A_COMMA))
-            onset++, ap++;
+    int argc, onset, onset2;
+    t_atom *ap, *ap2;
+    while (1)
+    {
+        argc = binbuf_getnatom(x->x_binbuf);
+        onset = x->x_onset;
+        if (binbuf_ispacked(x->x_binbuf))
+            ap = qlist_window(x, &onset, &argc, 0);
+        else ap = binbuf_getvec(x->x_binbuf) + onset;
+        while (onset < argc &&
+            (ap->a_type == A_SEMI || ap->a_type == A_COMMA))
+                onset++, ap++;
+        if (onset < argc || !qlist_more(x, onset))
+            break;
+    }
     onset2 = onset;
     ap2 = ap;
     while (onset2 < argc &&
@@ -2160,9 +2936,22 @@ static void textfile_bang(t_qlist *x)
 
 static void textfile_rewind(t_qlist *x)
 {
+    if (x->x_stream)
+    {
+        binbuf_clear(x->x_binbuf);
+        qstream_rewind(x->x_stream);
+    }
     x->x_onset = 0;
 }
 
+static void textfile_free(t_qlist *x)
+{
+    qlist_endstream(x);
+    textbuf_free(&x->x_textbuf);
+    if (x->x_window)
+        freebytes(x->x_window, x->x_windowsize * sizeof(t_atom));
+}
+
 /* ---------------- global setup function -------------------- */
 
 static t_pd *text_templatecanvas;
@@ -2266,7 +3055,7 @@ void x_qlist_setup(void)
     class_sethelpsymbol(text_fromlist_class, gensym("text-object"));
 
     text_search_class = class_new(gensym("text search"),
-        (t_newmethod)text_search_new, (t_method)text_client_free,
+        (t_newmethod)text_search_new, (t_method)text_search_free,
             sizeof(t_text_search), 0, A_GIMME, 0);
     class_addlist(text_search_class, text_search_list);
     class_addmethod(text_search_class, (t_method)text_search_range,
@@ -2306,7 +3095,7 @@ void x_qlist_setup(void)
     class_addmethod(qlist_class, (t_method)qlist_add, gensym("append"),
         A_GIMME, 0);
     class_addmethod(qlist_class, (t_method)qlist_read, gensym("read"),
-        A_SYMBOL, A_DEFSYM, 0);
+        A_SYMBOL, A_DEFSYM, A_DEFSYM, 0);
     class_addmethod(qlist_class, (t_method)qlist_write, gensym("write"),
         A_SYMBOL, A_DEFSYM, 0);
     class_addmethod(qlist_class, (t_method)textbuf_open, gensym("click"), 0);
@@ -2322,7 +3111,7 @@ void x_qlist_setup(void)
     class_addbang(qlist_class, qlist_bang);
 
     textfile_class = class_new(gensym("textfile"), (t_newmethod)textfile_new,
-        (t_method)textbuf_free, sizeof(t_qlist), 0, 0);
+        (t_method)textfile_free, sizeof(t_qlist), 0, 0);
     class_addmethod(textfile_class, (t_method)textfile_rewind, gensym("rewind"),
         0);
     class_addmethod(textfile_class, (t_method)qlist_set, gensym("set"),
@@ -2335,7 +3124,7 @@ void x_qlist_setup(void)
     class_addmethod(textfile_class, (t_method)qlist_add, gensym("append"),
         A_GIMME, 0);
     class_addmethod(textfile_class, (t_method)qlist_read, gensym("read"),
-        A_SYMBOL, A_DEFSYM, 0);
+        A_SYMBOL, A_DEFSYM, A_DEFSYM, 0);
     class_addmethod(textfile_class, (t_method)qlist_write, gensym("write"),
         A_SYMBOL, A_DEFSYM, 0);
     class_addmethod(textfile_class, (t_method)textbuf_open, gensym("click"), 0);
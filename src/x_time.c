@@ -410,9 +410,11 @@ static t_class *pipe_class;
 
 typedef struct _hang
 {
-    t_clock *h_clock;
-    struct _hang *h_next;
-    struct _pipe *h_owner;
+    struct _hang *h_next;       /* next older hang, or next in the pool */
+    struct _hang *h_prev;       /* next newer hang */
+    double h_settime;           /* logical time it's due */
+    double h_order;             /* order added, to break ties */
+    int h_index;                /* where we are in the heap */
     t_gpointer *h_gp;
     union word h_vec[1];        /* not the actual number. */
 } t_hang;
@@ -431,9 +433,25 @@ typedef struct _pipe
     t_float x_deltime;
     t_pipeout *x_vec;
     t_gpointer *x_gp;
-    t_hang *x_hang;
+    t_hang *x_hang;             /* pending hangs, newest first */
+    t_hang *x_pool;             /* spare hangs to reuse */
+    t_hang **x_heap;            /* pending hangs again, soonest first */
+    int x_nheap;
+    int x_heapsize;
+    double x_order;             /* count of hangs added, for ties */
+    t_clock *x_clock;           /* set for the soonest hang */
 } t_pipe;
 
+/* Pending messages ("hangs") are kept in a binary heap ordered by the time
+they're due, with a single clock set for the one at the top, so that adding
+or outputting one takes O(log n) time however many are pending.  Hangs due at
+the same time come out in the order they went in, as they did when each had
+its own clock.  They are also kept in a list, newest first, since "flush"
+outputs them in that order.  Hangs that have gone out are kept in a pool and
+reused, so that a pipe running steadily doesn't allocate memory. */
+
+static void pipe_tick(t_pipe *x);
+
 static void *pipe_new(t_symbol *s, int argc, t_atom *argv)
 {
     t_pipe *x = (t_pipe *)pd_new(pipe_class);
@@ -510,38 +528,101 @@ static void *pipe_new(t_symbol *s, int argc, t_atom *argv)
     }
     floatinlet_new(&x->x_obj, &x->x_deltime);
     x->x_hang = 0;
+    x->x_pool = 0;
+    x->x_heap = 0;
+    x->x_nheap = x->x_heapsize = 0;
+    x->x_order = 0;
+    x->x_clock = clock_new(x, (t_method)pipe_tick);
     x->x_deltime = deltime;
     return (x);
 }
 
-static void hang_free(t_hang *h)
+    /* true if hang x is due before hang y */
+#define HANG_BEFORE(x, y) ((x)->h_settime < (y)->h_settime || \
+    ((x)->h_settime == (y)->h_settime && (x)->h_order < (y)->h_order))
+
+static void pipe_heapput(t_hang **heap, int i, t_hang *h)
+{
+    heap[i] = h;
+    h->h_index = i;
+}
+
+static void pipe_heapup(t_hang **heap, int i)
+{
+    t_hang *h = heap[i];
+    while (i > 0)
+    {
+        int parent = (i - 1) >> 1;
+        if (!HANG_BEFORE(h, heap[parent]))
+            break;
+        pipe_heapput(heap, i, heap[parent]);
+        i = parent;
+    }
+    pipe_heapput(heap, i, h);
+}
+
+static void pipe_heapdown(t_hang **heap, int n, int i)
+{
+    t_hang *h = heap[i];
+    while (1)
+    {
+        int child = 2 * i + 1;
+        if (child >= n)
+            break;
+        if (child + 1 < n && HANG_BEFORE(heap[child + 1], heap[child]))
+            child++;
+        if (!HANG_BEFORE(heap[child], h))
+            break;
+        pipe_heapput(heap, i, heap[child]);
+        i = child;
+    }
+    pipe_heapput(heap, i, h);
+}
+
+    /* set the clock for whichever hang is now due first */
+static void pipe_setclock(t_pipe *x)
+{
+    if (x->x_nheap)
+        clock_set(x->x_clock, x->x_heap[0]->h_settime);
+    else clock_unset(x->x_clock);
+}
+
+    /* take a hang out of the heap and the list, but don't free it yet */
+static void pipe_remove(t_pipe *x, t_hang *h)
+{
+    int i = h->h_index, n = --x->x_nheap;
+    if (i < n)
+    {
+        pipe_heapput(x->x_heap, i, x->x_heap[n]);
+        if (i > 0 && HANG_BEFORE(x->x_heap[i], x->x_heap[(i - 1) >> 1]))
+            pipe_heapup(x->x_heap, i);
+        else pipe_heapdown(x->x_heap, n, i);
+    }
+    if (h->h_prev)
+        h->h_prev->h_next = h->h_next;
+    else x->x_hang = h->h_next;
+    if (h->h_next)
+        h->h_next->h_prev = h->h_prev;
+    if (i == 0)
+        pipe_setclock(x);
+}
+
+    /* let go of a hang's pointers and put it back in the pool */
+static void hang_free(t_pipe *x, t_hang *h)
 {
-    t_pipe *x = h->h_owner;
     t_gpointer *gp;
     int i;
     for (gp = h->h_gp, i = x->x_nptr; i--; gp++)
         gpointer_unset(gp);
-    freebytes(h->h_gp, x->x_nptr * sizeof(*h->h_gp));
-    clock_free(h->h_clock);
-    freebytes(h, sizeof(*h) + (x->x_n - 1) * sizeof(*h->h_vec));
+    h->h_next = x->x_pool;
+    x->x_pool = h;
 }
 
-static void hang_tick(t_hang *h)
+static void hang_output(t_pipe *x, t_hang *h)
 {
-    t_pipe *x = h->h_owner;
-    t_hang *h2, *h3;
     t_pipeout *p;
     int i;
     union word *w;
-    if (x->x_hang == h) x->x_hang = h->h_next;
-    else for (h2 = x->x_hang; (h3 = h2->h_next); h2 = h3)
-    {
-        if (h3 == h)
-        {
-            h2->h_next = h3->h_next;
-            break;
-        }
-    }
     for (i = x->x_n, p = x->x_vec + (x->x_n - 1), w = h->h_vec + (x->x_n - 1);
         i--; p--, w--)
     {
@@ -557,19 +638,30 @@ static void hang_tick(t_hang *h)
         default: break;
         }
     }
-    hang_free(h);
+    hang_free(x, h);
+}
+
+    /* output the hang that's due.  If others are due at the same time the
+    clock has been set again for them, so that they take their turns with
+    any other clocks set for the same time. */
+static void pipe_tick(t_pipe *x)
+{
+    if (x->x_nheap)
+    {
+        t_hang *h = x->x_heap[0];
+        pipe_remove(x, h);
+        hang_output(x, h);
+    }
 }
 
 static void pipe_list(t_pipe *x, t_symbol *s, int ac, t_atom *av)
 {
-    t_hang *h = (t_hang *)
-        getbytes(sizeof(*h) + (x->x_n - 1) * sizeof(*h->h_vec));
+    t_hang *h;
     t_gpointer *gp, *gp2;
     t_pipeout *p;
     int i, n = x->x_n;
     t_atom *ap;
     t_word *w;
-    h->h_gp = (t_gpointer *)getbytes(x->x_nptr * sizeof(t_gpointer));
     if (ac > n)
     {
         if (av[n].a_type == A_FLOAT)
@@ -597,6 +689,14 @@ static void pipe_list(t_pipe *x, t_symbol *s, int ac, t_atom *av)
         default: break;
         }
     }
+    if ((h = x->x_pool))
+        x->x_pool = h->h_next;
+    else
+    {
+        h = (t_hang *)
+            rt_getbytes(sizeof(*h) + (n - 1) * sizeof(*h->h_vec));
+        h->h_gp = (t_gpointer *)rt_getbytes(x->x_nptr * sizeof(t_gpointer));
+    }
     for (i = 0, gp = x->x_gp, gp2 = h->h_gp, p = x->x_vec, w = h->h_vec;
         i < n; i++, p++, w++)
     {
@@ -608,34 +708,62 @@ static void pipe_list(t_pipe *x, t_symbol *s, int ac, t_atom *av)
         }
         else *w = p->p_atom.a_w;
     }
-    h->h_next = x->x_hang;
+    h->h_prev = 0;
+    if ((h->h_next = x->x_hang))
+        h->h_next->h_prev = h;
     x->x_hang = h;
-    h->h_owner = x;
-    h->h_clock = clock_new(h, (t_method)hang_tick);
-    clock_delay(h->h_clock, (x->x_deltime >= 0 ? x->x_deltime : 0));
+    h->h_settime =
+        clock_getsystimeafter(x->x_deltime >= 0 ? x->x_deltime : 0);
+    h->h_order = x->x_order++;
+    if (x->x_nheap == x->x_heapsize)
+    {
+        int newsize = (x->x_heapsize ? 2 * x->x_heapsize : 16);
+        x->x_heap = (t_hang **)resizebytes(x->x_heap,
+            x->x_heapsize * sizeof(*x->x_heap), newsize * sizeof(*x->x_heap));
+        x->x_heapsize = newsize;
+    }
+    x->x_heap[x->x_nheap] = h;
+    pipe_heapup(x->x_heap, x->x_nheap++);
+    if (h->h_index == 0)
+        pipe_setclock(x);
 }
 
 static void pipe_flush(t_pipe *x)
 {
-    while (x->x_hang) hang_tick(x->x_hang);
+    t_hang *h;
+    while ((h = x->x_hang))
+    {
+        pipe_remove(x, h);
+        hang_output(x, h);
+    }
 }
 
 static void pipe_clear(t_pipe *x)
 {
-    t_hang *hang;
-    while ((hang = x->x_hang))
+    t_hang *h;
+    while ((h = x->x_hang))
     {
-        x->x_hang = hang->h_next;
-        hang_free(hang);
+        x->x_hang = h->h_next;
+        hang_free(x, h);
     }
+    x->x_nheap = 0;
+    clock_unset(x->x_clock);
 }
 
 static void pipe_free(t_pipe *x)
 {
+    t_hang *h;
     pipe_clear(x);
+    while ((h = x->x_pool))
+    {
+        x->x_pool = h->h_next;
+        rt_freebytes(h->h_gp, x->x_nptr * sizeof(*h->h_gp));
+        rt_freebytes(h, sizeof(*h) + (x->x_n - 1) * sizeof(*h->h_vec));
+    }
+    freebytes(x->x_heap, x->x_heapsize * sizeof(*x->x_heap));
+    clock_free(x->x_clock);
     freebytes(x->x_vec, x->x_n * sizeof(*x->x_vec));
     freebytes(x->x_gp, x->x_nptr * sizeof(*x->x_gp));
-
 }
 
 static void pipe_setup(void)
@@ -66,6 +66,7 @@
  */
 
 #include <string.h>
+#include <math.h>
 #include <stdlib.h>
 #include <ctype.h>
 #include "x_vexp.h"
@@ -100,6 +101,10 @@ struct ex_ex *eval_store(struct expr *expr, struct ex_ex *eptr,
                                                 struct ex_ex *optr, int i);
 struct ex_ex *eval_sigidx(struct expr *expr, struct ex_ex *eptr,
                                                 struct ex_ex *optr, int i);
+static void ex_sigidx(struct expr *expr, struct ex_ex *eptr,
+                        struct ex_ex *arg, struct ex_ex *optr, int idx);
+static void ex_tab(struct expr *expr, struct ex_ex *eptr,
+                                        struct ex_ex *arg, struct ex_ex *optr);
 static int cal_sigidx(struct ex_ex *optr,       /* The output value */
            int i, t_float rem_i,      /* integer and fractinal part of index */
            int idx,                  /* index of current fexpr~ processing */
@@ -1401,6 +1406,25 @@ eval_tab(struct expr *expr, struct ex_ex *eptr, struct ex_ex *optr, int idx)
 /* the result pointer */
 {
         struct ex_ex arg;
+        struct ex_ex *tptr = eptr;
+
+        arg.ex_type = 0;
+        arg.ex_int = 0;
+        if (!(eptr = ex_eval(expr, ++eptr, &arg, idx)))
+                return (eptr);
+        ex_tab(expr, tptr, &arg, optr);
+        if (arg.ex_type == ET_VEC)
+                fts_free(arg.ex_vec);
+        return (eptr);
+}
+
+/*
+ * ex_tab -- look up the table at eptr for the evaluated index arg
+ */
+static void
+ex_tab(struct expr *expr, struct ex_ex *eptr, struct ex_ex *arg,
+                                                        struct ex_ex *optr)
+{
         char *tbl = (char *) 0;
         int notable = 0;
 
@@ -1428,18 +1452,10 @@ eval_tab(struct expr *expr, struct ex_ex *eptr, struct ex_ex *optr, int idx)
                 notable++;
 
         }
-        arg.ex_type = 0;
-        arg.ex_int = 0;
-        if (!(eptr = ex_eval(expr, ++eptr, &arg, idx)))
-                return (eptr);
-
         optr->ex_type = ET_INT;
         optr->ex_int = 0;
         if (!notable)
-                (void)max_ex_tab(expr, (t_symbol *)tbl, &arg, optr);
-        if (arg.ex_type == ET_VEC)
-                fts_free(arg.ex_vec);
-        return (eptr);
+                (void)max_ex_tab(expr, (t_symbol *)tbl, arg, optr);
 }
 
 /*
@@ -1492,23 +1508,36 @@ eval_sigidx(struct expr *expr, struct ex_ex *eptr, struct ex_ex *optr, int idx)
 {
         struct ex_ex arg;
         struct ex_ex *reteptr;
-        int i = 0;
-        t_float fi = 0,         /* index in float */
-              rem_i = 0;        /* remains of the float */
 
         arg.ex_type = 0;
         arg.ex_int = 0;
         reteptr = ex_eval(expr, eptr + 1, &arg, idx);
-        if (arg.ex_type == ET_FLT) {
-                fi = arg.ex_flt;                /* float index */
-                i = (int) arg.ex_flt;           /* integer index */
-                rem_i =  arg.ex_flt - i;        /* remains of integer */
-        } else if (arg.ex_type == ET_INT) {
-                fi = arg.ex_int;                /* float index */
-                i = (int) arg.ex_int;           /* integer index */
+        ex_sigidx(expr, eptr, &arg, optr, idx);
+        return (reteptr);
+}
+
+/*
+ * ex_sigidx -- the value of the signal vector at eptr for the evaluated
+ *              index arg, this is shared by eval_sigidx() and ex_run()
+ */
+static void
+ex_sigidx(struct expr *expr, struct ex_ex *eptr, struct ex_ex *arg,
+                                                struct ex_ex *optr, int idx)
+{
+        int i = 0;
+        t_float fi = 0,         /* index in float */
+              rem_i = 0;        /* remains of the float */
+
+        if (arg->ex_type == ET_FLT) {
+                fi = arg->ex_flt;               /* float index */
+                i = (int) arg->ex_flt;          /* integer index */
+                rem_i =  arg->ex_flt - i;       /* remains of integer */
+        } else if (arg->ex_type == ET_INT) {
+                fi = arg->ex_int;               /* float index */
+                i = (int) arg->ex_int;          /* integer index */
                 rem_i = 0;
         } else {
-                post("eval_sigidx: bad res type (%d)", arg.ex_type);
+                post("eval_sigidx: bad res type (%d)", arg->ex_type);
         }
         optr->ex_type = ET_FLT;
         /*
@@ -1560,7 +1589,7 @@ eval_sigidx(struct expr *expr, struct ex_ex *eptr, struct ex_ex *optr, int idx)
                         post("fexpr~: $y%d illegal: not that many exprs",
                                                                 eptr->ex_int);
                         optr->ex_flt = 0;
-                        return (reteptr);
+                        return;
                 }
                 if (cal_sigidx(optr, i, rem_i, idx, expr->exp_vsize,
                              expr->exp_tmpres[eptr->ex_int],
@@ -1578,7 +1607,6 @@ eval_sigidx(struct expr *expr, struct ex_ex *eptr, struct ex_ex *optr, int idx)
                 post("fexpr~:eval_sigidx: internal error - unknown vector (%d)",
                                                                 eptr->ex_type);
         }
-        return (reteptr);
 }
 
 /*
@@ -1633,6 +1661,1162 @@ cal_sigidx(struct ex_ex *optr,  /* The output value */
         return (1);
 }
 
+/*
+ * The compiled form of expr~ and fexpr~ expressions.
+ *
+ * ex_compile() walks the prefix tree once and emits a postfix program in
+ * which every operator already knows the types of its operands, so that
+ * ex_run() only has to step through a flat array.  For fexpr~ this
+ * replaces one recursive ex_eval() per node and per sample, for expr~ the
+ * intermediate vectors live in preallocated slots instead of being
+ * allocated per node and per block.  The result is the same as that of
+ * ex_eval(); whatever the compiler does not handle (stores, tables and
+ * variables in expr~, if() in expr~) leaves the expression to ex_eval().
+ *
+ * On the way the program is simplified where this does not change the
+ * result: operators and functions on constants are folded, if() with a
+ * constant condition keeps only the branch taken, subexpressions that
+ * occur more than once (as in $v1*$v1 + sin($v1*$v1)) are computed once
+ * into a register, pow() by 2, 3 or 4 becomes multiplications in double
+ * precision, as pow() computes, and a division by a power of two becomes
+ * a multiplication.
+ *
+ * Tables named in the expression are looked up once at dsp time by
+ * ex_prog_findtables() rather than on every access; in expr~ a table
+ * indexed by a signal reads the whole vector in one instruction.
+ */
+
+#define EC_CONST        1       /* push c_ex */
+#define EC_II           2       /* push integer inlet c_ex.ex_int */
+#define EC_FI           3       /* push float inlet c_ex.ex_int */
+#define EC_VI           4       /* push signal inlet c_ex.ex_int (expr~) */
+#define EC_XI0          5       /* push $x#[0] (fexpr~) */
+#define EC_YOM1         6       /* push $y#[-1] (fexpr~) */
+#define EC_SIGIDX       7       /* replace the index by $x#[] or $y#[] */
+#define EC_TAB          8       /* replace the index by table[] */
+#define EC_VAR          9       /* push a variable */
+#define EC_FUNC         10      /* call a function on scalars */
+#define EC_VFUNC        11      /* call a function to a vector slot */
+#define EC_TOFLT        12      /* make stack element c_ex.ex_int a float */
+#define EC_JZ           13      /* pop, jump to c_ex.ex_int if false */
+#define EC_JMP          14      /* jump to c_ex.ex_int */
+#define EC_US           15      /* unary operator c_ex.ex_op on a scalar */
+#define EC_UV           16      /*          ... on a vector */
+#define EC_BII          17      /* binary operator c_ex.ex_op on two ints */
+#define EC_BFF          18      /*          ... on two floats */
+#define EC_BVV          19      /*          ... on two vectors */
+#define EC_BVS          20      /*          ... on vector and float */
+#define EC_BSV          21      /*          ... on float and vector */
+#define EC_BDD          22      /*          ... on types known at run time */
+#define EC_XK           23      /* push $x#[c_ex.ex_int] (fexpr~) */
+#define EC_YK           24      /* push $y#[c_ex.ex_int] (fexpr~) */
+#define EC_REG          25      /* push register c_ex.ex_int */
+#define EC_SAVE         26      /* copy the top of stack to a register */
+#define EC_POWS         27      /* scalar to the power c_ex.ex_int */
+#define EC_POWV         28      /* vector to the power c_ex.ex_int */
+#define EC_TABV         29      /* replace the vector index by table[] */
+
+/* the instructions that write a vector to c_dst */
+#define EC_WRITESVEC(op) ((op) == EC_UV || (op) == EC_BVV ||            \
+        (op) == EC_BVS || (op) == EC_BSV || (op) == EC_VFUNC ||         \
+        (op) == EC_POWV || (op) == EC_TABV)
+
+/*
+ * the binary operators with the conversion ex_eval() applies to them
+ */
+#define EC_BINOPS(DO)                                                   \
+        DO(OP_MUL, EC_PLAIN, *)                                         \
+        DO(OP_ADD, EC_PLAIN, +)                                         \
+        DO(OP_SUB, EC_PLAIN, -)                                         \
+        DO(OP_LT, EC_PLAIN, <)                                          \
+        DO(OP_LE, EC_PLAIN, <=)                                         \
+        DO(OP_GT, EC_PLAIN, >)                                          \
+        DO(OP_GE, EC_PLAIN, >=)                                         \
+        DO(OP_EQ, EC_PLAIN, ==)                                         \
+        DO(OP_NE, EC_PLAIN, !=)                                         \
+        DO(OP_SL, EC_TOINT, <<)                                         \
+        DO(OP_SR, EC_TOINT, >>)                                         \
+        DO(OP_AND, EC_TOINT, &)                                         \
+        DO(OP_XOR, EC_TOINT, ^)                                         \
+        DO(OP_OR, EC_TOINT, |)                                          \
+        DO(OP_LAND, EC_TOINT, &&)                                       \
+        DO(OP_LOR, EC_TOINT, ||)                                        \
+        DO(OP_MOD, EC_MODZ, %)                                          \
+        DO(OP_DIV, EC_DIVZ, /)
+
+#define EC_PLAIN(A, OPR, B)     (A OPR B)
+#define EC_TOINT(A, OPR, B)     (((int)A) OPR ((int)B))
+#define EC_MODZ(A, OPR, B)      ((((int)B)?(((int)A) OPR ((int)B))      \
+                                                : (ex_dzdetect(expr),0)))
+#define EC_DIVZ(A, OPR, B)      (((B)?(A OPR B):(ex_dzdetect(expr),0)))
+
+#define EC_CASE_II(OPN, DZ, OPR)                                        \
+        case OPN: lp1->ex_int = DZ(lp1->ex_int, OPR, rp1->ex_int); break;
+#define EC_CASE_FF(OPN, DZ, OPR)                                        \
+        case OPN: lp1->ex_flt = DZ(lp1->ex_flt, OPR, rp1->ex_flt); break;
+#define EC_CASE_VV(OPN, DZ, OPR)                                        \
+        case OPN:                                                       \
+                for (i = 0; i < n; i++)                                 \
+                        op[i] = DZ(lp[i], OPR, rp[i]);                  \
+                break;
+#define EC_CASE_VS(OPN, DZ, OPR)                                        \
+        case OPN:                                                       \
+                for (i = 0; i < n; i++)                                 \
+                        op[i] = DZ(lp[i], OPR, scalar);                 \
+                break;
+#define EC_CASE_SV(OPN, DZ, OPR)                                        \
+        case OPN:                                                       \
+                for (i = 0; i < n; i++)                                 \
+                        op[i] = DZ(scalar, OPR, rp[i]);                 \
+                break;
+#define EC_CASE_OP(OPN, DZ, OPR)        case OPN:
+
+/* where ex_run() puts the vector that instruction c computes */
+#define EC_DST(c)       ((c)->c_dst < 0 ? optr->ex_vec : \
+                                        prog->p_vec + (c)->c_dst * n)
+
+/* the compiler's state */
+struct ex_comp {
+        struct expr *c_expr;
+        struct ex_code *c_code;         /* the program so far */
+        int c_ncode;                    /* number of instructions */
+        int c_size;                     /* allocated instructions */
+        int c_sp;                       /* the depth of the stack */
+        int c_depth;                    /* maximum depth of the stack */
+        int c_vector;                   /* compiling for expr~ */
+        struct ex_ex *c_base;           /* the first node of the tree */
+        int *c_reg;                     /* register of each node, or -1 */
+        int c_nreg;                     /* number of registers */
+        char *c_done;                   /* register already computed */
+        long *c_rtype;                  /* type of the register */
+        int c_inif;                     /* inside the branches of if() */
+};
+
+/*
+ * ec_emit -- append an instruction that changes the depth of the stack by
+ *            push, its result (if any) is on top of the stack
+ */
+static struct ex_code *
+ec_emit(struct ex_comp *cp, int op, int push)
+{
+        struct ex_code *c;
+
+        if (cp->c_ncode == cp->c_size) {
+                int newsize = 2 * cp->c_size + 16;
+                struct ex_code *newcode = (struct ex_code *)
+                        fts_realloc(cp->c_code, newsize * sizeof (*newcode));
+                if (!newcode)
+                        return (0);
+                cp->c_code = newcode;
+                cp->c_size = newsize;
+        }
+        c = cp->c_code + cp->c_ncode++;
+        cp->c_sp += push;
+        if (cp->c_sp > cp->c_depth)
+                cp->c_depth = cp->c_sp;
+        c->c_op = op;
+        c->c_dst = cp->c_nreg + cp->c_sp - 1;
+        c->c_ex.ex_type = 0;
+        c->c_ex.ex_int = 0;
+        c->c_node = 0;
+#ifdef PD
+        c->c_tabvec = 0;
+        c->c_tabsize = 0;
+#endif
+        return (c);
+}
+
+/*
+ * ec_tofloat -- convert the operand that the instructions from..to-1 left
+ *               at depth 'down' below the top of the stack to a float;
+ *               an integer constant is converted right away
+ */
+static int
+ec_tofloat(struct ex_comp *cp, int from, int to, int down)
+{
+        struct ex_code *c;
+
+        if (to - from == 1 && cp->c_code[from].c_op == EC_CONST &&
+                                cp->c_code[from].c_ex.ex_type == ET_INT) {
+                t_float f = cp->c_code[from].c_ex.ex_int;
+                c = cp->c_code + from;
+                c->c_ex.ex_type = ET_FLT;
+                c->c_ex.ex_flt = f;
+                return (1);
+        }
+        if (!(c = ec_emit(cp, EC_TOFLT, 0)))
+                return (0);
+        c->c_ex.ex_int = down;
+        return (1);
+}
+
+/*
+ * ec_const -- replace the instructions from 'from' on, which started at
+ *             stack depth sp, by the constant value
+ */
+static int
+ec_const(struct ex_comp *cp, int from, int sp, struct ex_ex *value,
+                                                                long *type)
+{
+        struct ex_code *c;
+
+        cp->c_ncode = from;
+        cp->c_sp = sp;
+        if (!(c = ec_emit(cp, EC_CONST, 1)))
+                return (0);
+        c->c_ex = *value;
+        *type = value->ex_type;
+        return (1);
+}
+
+/* the instructions from..to-1 push a number constant */
+#define EC_ISCONST(cp, from, to) ((to) - (from) == 1 &&                    \
+        (cp)->c_code[from].c_op == EC_CONST &&                          \
+        ((cp)->c_code[from].c_ex.ex_type == ET_INT ||                   \
+        (cp)->c_code[from].c_ex.ex_type == ET_FLT))
+
+/*
+ * ec_skip -- return the node after the subtree at eptr
+ */
+static struct ex_ex *
+ec_skip(struct ex_ex *eptr)
+{
+        int i, n;
+
+        switch (eptr->ex_type) {
+        case ET_XI:
+        case ET_YO:
+        case ET_TBL:
+        case ET_SI:
+                return (ec_skip(eptr + 1));
+        case ET_FUNC:
+                n = ((t_ex_func *)eptr->ex_ptr)->f_argc;
+                for (eptr++, i = 0; i < n; i++)
+                        eptr = ec_skip(eptr);
+                return (eptr);
+        case ET_OP:
+                if (unary_op(eptr->ex_op))
+                        return (ec_skip(eptr + 1));
+                return (ec_skip(ec_skip(eptr + 1)));
+        default:
+                return (eptr + 1);
+        }
+}
+
+/*
+ * ec_same -- are the subtrees at a and b (both n nodes) the same
+ */
+static int
+ec_same(struct ex_ex *a, struct ex_ex *b, int n)
+{
+        for (; n--; a++, b++) {
+                if (a->ex_type != b->ex_type)
+                        return (0);
+                switch (a->ex_type) {
+                case ET_FLT:
+                        if (memcmp(&a->ex_flt, &b->ex_flt, sizeof (t_float)))
+                                return (0);
+                        break;
+                case ET_TBL:
+                case ET_FUNC:
+                case ET_SYM:
+                case ET_VAR:
+                        if (a->ex_ptr != b->ex_ptr)
+                                return (0);
+                        break;
+                default:
+                        if (a->ex_int != b->ex_int)
+                                return (0);
+                }
+        }
+        return (1);
+}
+
+/*
+ * ec_cse -- give a register to every subtree that occurs more than once,
+ *           returns the number of registers
+ */
+static int
+ec_cse(struct ex_comp *cp, struct ex_ex *root)
+{
+        struct ex_ex *e;
+        int n = ec_skip(root) - root, *len, *first, i, j, k, nreg = 0;
+
+        if (!(len = (int *)fts_malloc(2 * n * sizeof (int))) ||
+            !(cp->c_reg = (int *)fts_malloc(n * sizeof (int)))) {
+                if (len)
+                        fts_free(len);
+                return (0);
+        }
+        first = len + n;
+        for (i = 0; i < n; i++) {
+                e = root + i;
+                len[i] = ec_skip(e) - e;
+                first[i] = -1;
+                cp->c_reg[i] = -1;
+                /* only nonterminals, without random() */
+                if (len[i] < 2)
+                        continue;
+                for (k = 0; k < len[i]; k++)
+                        if (e[k].ex_type == ET_FUNC &&
+                            !strcmp(((t_ex_func *)e[k].ex_ptr)->f_name,
+                                                                "random"))
+                                break;
+                if (k < len[i])
+                        continue;
+                for (j = 0; j < i; j++)
+                        if (first[j] == j && len[j] == len[i] &&
+                            ec_same(root + j, e, len[i]))
+                                break;
+                first[i] = j;
+                if (j < i) {
+                        if (cp->c_reg[j] < 0)
+                                cp->c_reg[j] = nreg++;
+                        cp->c_reg[i] = cp->c_reg[j];
+                }
+        }
+        fts_free(len);
+        return (nreg);
+}
+
+static struct ex_ex *ec_node(struct ex_comp *cp, struct ex_ex *eptr,
+                                                                long *type);
+static void ex_scalarunop(struct expr *expr, long op, struct ex_ex *lp1);
+static void ex_scalarop(struct expr *expr, long op, struct ex_ex *lp1,
+                                                        struct ex_ex *rp1);
+
+/*
+ * ec_if -- compile if(), as a pair of jumps so that only one of its
+ *          branches is evaluated as in ex_if(), or only the branch taken
+ *          if the condition is constant
+ */
+static struct ex_ex *
+ec_if(struct ex_comp *cp, struct ex_ex *eptr, long *type)
+{
+        struct ex_code *c;
+        long ctype, atype, btype;
+        int from = cp->c_ncode, jz, jmp, cond;
+
+        if (!(eptr = ec_node(cp, eptr, &ctype)))
+                return (exNULL);
+        if (EC_ISCONST(cp, from, cp->c_ncode)) {
+                c = cp->c_code + from;
+                cond = (ctype == ET_INT ? c->c_ex.ex_int != 0 :
+                                                c->c_ex.ex_flt != 0);
+                cp->c_ncode = from;
+                cp->c_sp--;
+                if (!cond)
+                        eptr = ec_skip(eptr);
+                if (!(eptr = ec_node(cp, eptr, type)))
+                        return (exNULL);
+                return (cond ? ec_skip(eptr) : eptr);
+        }
+        if (cp->c_vector || !ec_emit(cp, EC_JZ, -1))
+                return (exNULL);
+        jz = cp->c_ncode - 1;
+        cp->c_inif++;
+        if (!(eptr = ec_node(cp, eptr, &atype)) || !ec_emit(cp, EC_JMP, 0))
+                return (exNULL);
+        jmp = cp->c_ncode - 1;
+        cp->c_sp--;
+        cp->c_code[jz].c_ex.ex_int = cp->c_ncode;
+        if (!(eptr = ec_node(cp, eptr, &btype)))
+                return (exNULL);
+        cp->c_inif--;
+        cp->c_code[jmp].c_ex.ex_int = cp->c_ncode;
+        *type = (atype == btype ? atype : 0);
+        return (eptr);
+}
+
+/*
+ * ec_func -- compile a function call
+ */
+static struct ex_ex *
+ec_func(struct ex_comp *cp, struct ex_ex *eptr, long *type)
+{
+        t_ex_func *f = (t_ex_func *)eptr->ex_ptr;
+        struct ex_ex *node = eptr++, args[MAX_ARGS], res;
+        struct ex_code *c;
+        long atype = 0;
+        int i, from = cp->c_ncode, sp = cp->c_sp, afrom, vec = 0, cst = 1;
+
+        if (!f || !f->f_name || f->f_argc > MAX_ARGS)
+                return (exNULL);
+        if (f->f_func == (void (*)) ex_if)
+                return (ec_if(cp, eptr, type));
+        for (i = 0; i < f->f_argc; i++) {
+                afrom = cp->c_ncode;
+                if (!(eptr = ec_node(cp, eptr, &atype)))
+                        return (exNULL);
+                if (atype == ET_VEC)
+                        vec = 1;
+                if (EC_ISCONST(cp, afrom, cp->c_ncode))
+                        args[i] = cp->c_code[afrom].c_ex;
+                else
+                        cst = 0;
+        }
+        if (cst && strcmp(f->f_name, "random")) {
+                /* a function of constants is evaluated right away */
+                res.ex_type = 0;
+                res.ex_int = 0;
+                (*f->f_func)(cp->c_expr, f->f_argc, args, &res);
+                if (res.ex_type == ET_INT || res.ex_type == ET_FLT)
+                        return (ec_const(cp, from, sp, &res, type) ?
+                                                        eptr : exNULL);
+        }
+        c = cp->c_code + cp->c_ncode - 1;
+        if (!strcmp(f->f_name, "pow") && cp->c_ncode - from > 1 &&
+            EC_ISCONST(cp, cp->c_ncode - 1, cp->c_ncode) &&
+            (c->c_ex.ex_type == ET_INT ? (c->c_ex.ex_int >= 2 &&
+                c->c_ex.ex_int <= 4) : (c->c_ex.ex_flt == 2 ||
+                c->c_ex.ex_flt == 3 || c->c_ex.ex_flt == 4))) {
+                /* pow() by a small integer */
+                i = (c->c_ex.ex_type == ET_INT ? c->c_ex.ex_int :
+                                                (int)c->c_ex.ex_flt);
+                cp->c_ncode--;
+                cp->c_sp--;
+                if (!(c = ec_emit(cp, vec ? EC_POWV : EC_POWS, 0)))
+                        return (exNULL);
+                c->c_ex.ex_int = i;
+                *type = (vec ? ET_VEC : ET_FLT);
+                return (eptr);
+        }
+        if (!(c = ec_emit(cp, vec ? EC_VFUNC : EC_FUNC, 1 - f->f_argc)))
+                return (exNULL);
+        c->c_node = node;
+        *type = (vec ? ET_VEC : 0);
+        return (eptr);
+}
+
+/*
+ * ec_node -- compile the subtree at eptr; if it has a register, compute
+ *            it into the register the first time and use that afterwards
+ */
+static struct ex_ex *ec_subtree(struct ex_comp *cp, struct ex_ex *eptr,
+                                                                long *type);
+
+static struct ex_ex *
+ec_node(struct ex_comp *cp, struct ex_ex *eptr, long *type)
+{
+        struct ex_code *c;
+        int r, from;
+
+        if (!eptr || !cp->c_reg || (r = cp->c_reg[eptr - cp->c_base]) < 0)
+                return (ec_subtree(cp, eptr, type));
+        if (cp->c_done[r]) {
+                if (!(c = ec_emit(cp, EC_REG, 1)))
+                        return (exNULL);
+                c->c_ex.ex_int = r;
+                *type = cp->c_rtype[r];
+                return (ec_skip(eptr));
+        }
+        from = cp->c_ncode;
+        if (!(eptr = ec_subtree(cp, eptr, type)))
+                return (exNULL);
+        /* not in a branch of if() as it may not be run */
+        if (cp->c_inif || EC_ISCONST(cp, from, cp->c_ncode))
+                return (eptr);
+        c = cp->c_code + cp->c_ncode - 1;
+        if (*type == ET_VEC) {
+                if (!EC_WRITESVEC(c->c_op))
+                        return (eptr);
+                c->c_dst = r;
+        }
+        if (!(c = ec_emit(cp, EC_SAVE, 0)))
+                return (exNULL);
+        c->c_ex.ex_int = r;
+        cp->c_done[r] = 1;
+        cp->c_rtype[r] = *type;
+        return (eptr);
+}
+
+/*
+ * ec_subtree -- compile the subtree at eptr, put the type of its value in
+ *               type (0 if it is only known at run time) and return the
+ *               node after it, or exNULL if it cannot be compiled
+ */
+static struct ex_ex *
+ec_subtree(struct ex_comp *cp, struct ex_ex *eptr, long *type)
+{
+        struct ex_ex *node, lval, rval;
+        struct ex_code *c;
+        long op, ltype, rtype;
+        int lfrom, rfrom, rto, lsp, kind, e;
+        t_float d;
+
+        if (!eptr)
+                return (exNULL);
+        switch (eptr->ex_type) {
+        case ET_INT:
+        case ET_FLT:
+        case ET_SYM:
+                if (!(c = ec_emit(cp, EC_CONST, 1)))
+                        return (exNULL);
+                c->c_ex = *eptr;
+                *type = (eptr->ex_type == ET_SYM ? 0 : eptr->ex_type);
+                return (++eptr);
+        case ET_II:
+        case ET_FI:
+                if (eptr->ex_int == -1 || !(c = ec_emit(cp,
+                    eptr->ex_type == ET_II ? EC_II : EC_FI, 1)))
+                        return (exNULL);
+                c->c_ex.ex_int = eptr->ex_int;
+                *type = (eptr->ex_type == ET_II ? ET_INT : ET_FLT);
+                return (++eptr);
+        case ET_VI:
+                if (!cp->c_vector || !(c = ec_emit(cp, EC_VI, 1)))
+                        return (exNULL);
+                c->c_ex.ex_int = eptr->ex_int;
+                *type = ET_VEC;
+                return (++eptr);
+        case ET_XI0:
+        case ET_YOM1:
+                if (cp->c_vector || !(c = ec_emit(cp,
+                    eptr->ex_type == ET_XI0 ? EC_XI0 : EC_YOM1, 1)))
+                        return (exNULL);
+                c->c_ex.ex_int = eptr->ex_int;
+                *type = ET_FLT;
+                return (++eptr);
+        case ET_XI:
+        case ET_YO:
+        case ET_TBL:
+        case ET_SI:
+                /* these are followed by the index expression */
+                if (cp->c_vector && eptr->ex_type != ET_TBL)
+                        return (exNULL);
+                node = eptr;
+                kind = (node->ex_type == ET_XI || node->ex_type == ET_YO) ?
+                                                        EC_SIGIDX : EC_TAB;
+                lfrom = cp->c_ncode;
+                if (!(eptr = ec_node(cp, eptr + 1, &ltype)))
+                        return (exNULL);
+                c = cp->c_code + lfrom;
+                if (kind == EC_SIGIDX && cp->c_ncode - lfrom == 1 &&
+                    c->c_op == EC_CONST && c->c_ex.ex_type == ET_INT &&
+                    (node->ex_type == ET_XI ? c->c_ex.ex_int <= 0 :
+                    (c->c_ex.ex_int < 0 &&
+                        node->ex_int < cp->c_expr->exp_nexpr))) {
+                        /* a constant index in range, as in $x1[-1] */
+                        c->c_op = (node->ex_type == ET_XI ? EC_XK : EC_YK);
+                } else {
+                        if (ltype == ET_VEC)
+                                kind = EC_TABV;
+                        if (!(c = ec_emit(cp, kind, 0)))
+                                return (exNULL);
+                }
+                c->c_node = node;
+                *type = (kind == EC_SIGIDX ? ET_FLT :
+                                        kind == EC_TABV ? ET_VEC : 0);
+                return (eptr);
+        case ET_VAR:
+                if (cp->c_vector || !(c = ec_emit(cp, EC_VAR, 1)))
+                        return (exNULL);
+                c->c_node = eptr;
+                *type = 0;
+                return (++eptr);
+        case ET_FUNC:
+                return (ec_func(cp, eptr, type));
+        case ET_OP:
+                break;
+        default:
+                return (exNULL);
+        }
+        op = eptr->ex_op;
+        if (unary_op(op)) {
+                lfrom = cp->c_ncode;
+                if (!(eptr = ec_node(cp, eptr + 1, &ltype)))
+                        return (exNULL);
+                c = cp->c_code + lfrom;
+                if (cp->c_ncode - lfrom == 1 && c->c_op == EC_CONST &&
+                                (ltype == ET_INT || ltype == ET_FLT)) {
+                        /* fold it into the constant, as in -1 */
+                        ex_scalarunop(cp->c_expr, op, &c->c_ex);
+                        *type = ltype;
+                        return (eptr);
+                }
+                if (!(c = ec_emit(cp, ltype == ET_VEC ? EC_UV : EC_US, 0)))
+                        return (exNULL);
+                c->c_ex.ex_op = op;
+                *type = ltype;
+                return (eptr);
+        }
+        switch (op) {
+        EC_BINOPS(EC_CASE_OP)
+                break;
+        default:
+                /* the store operator and the separators */
+                return (exNULL);
+        }
+        lfrom = cp->c_ncode;
+        lsp = cp->c_sp;
+        if (!(eptr = ec_node(cp, eptr + 1, &ltype)))
+                return (exNULL);
+        rfrom = cp->c_ncode;
+        if (!(eptr = ec_node(cp, eptr, &rtype)))
+                return (exNULL);
+        rto = cp->c_ncode;
+        if (EC_ISCONST(cp, lfrom, rfrom) && EC_ISCONST(cp, rfrom, rto)) {
+                lval = cp->c_code[lfrom].c_ex;
+                rval = cp->c_code[rfrom].c_ex;
+                /* leave a division by zero to report it when running */
+                if (!((op == OP_DIV || op == OP_MOD) &&
+                    (rval.ex_type == ET_INT ? !rval.ex_int :
+                        (op == OP_MOD ? !(int)rval.ex_flt : !rval.ex_flt)))) {
+                        ex_scalarop(cp->c_expr, op, &lval, &rval);
+                        return (ec_const(cp, lfrom, lsp, &lval, type) ?
+                                                        eptr : exNULL);
+                }
+        }
+        if (ltype == ET_VEC && rtype == ET_VEC)
+                kind = EC_BVV;
+        else if (ltype == ET_VEC) {
+                if (!ec_tofloat(cp, rfrom, rto, 0))
+                        return (exNULL);
+                kind = EC_BVS;
+        } else if (rtype == ET_VEC) {
+                if (!ec_tofloat(cp, lfrom, rfrom, 1))
+                        return (exNULL);
+                kind = EC_BSV;
+        } else if (ltype == ET_INT && rtype == ET_INT)
+                kind = EC_BII;
+        else if (ltype && rtype) {
+                if ((ltype == ET_INT && !ec_tofloat(cp, lfrom, rfrom, 1)) ||
+                    (rtype == ET_INT && !ec_tofloat(cp, rfrom, rto, 0)))
+                        return (exNULL);
+                kind = EC_BFF;
+        } else
+                kind = EC_BDD;
+        c = cp->c_code + rfrom;
+        if (op == OP_DIV && (kind == EC_BFF || kind == EC_BVS) &&
+            rto - rfrom == 1 && c->c_op == EC_CONST &&
+            c->c_ex.ex_type == ET_FLT && (d = c->c_ex.ex_flt) != 0 &&
+            fabs(frexp(d, &e)) == 0.5 && e > -126 && e < 128) {
+                /* the reciprocal of a power of two is exact */
+                c->c_ex.ex_flt = 1 / d;
+                op = OP_MUL;
+        }
+        if (!(c = ec_emit(cp, kind, -1)))
+                return (exNULL);
+        c->c_ex.ex_op = op;
+        *type = (kind == EC_BII ? ET_INT : kind == EC_BFF ? ET_FLT :
+                kind == EC_BDD ? 0 : ET_VEC);
+        return (eptr);
+}
+
+/*
+ * ex_compile -- compile the expression at eptr, return 0 if it has to be
+ *               left to ex_eval()
+ */
+t_ex_prog *
+ex_compile(struct expr *expr, struct ex_ex *eptr)
+{
+        struct ex_comp comp;
+        struct ex_code *last;
+        struct ex_ex *ret;
+        t_ex_prog *prog = 0;
+        long type;
+        int pass, i;
+
+        comp.c_expr = expr;
+        comp.c_code = 0;
+        comp.c_size = 0;
+        comp.c_vector = IS_EXPR_TILDE(expr);
+        comp.c_base = eptr;
+        comp.c_reg = 0;
+        comp.c_nreg = 0;
+        comp.c_done = 0;
+        comp.c_rtype = 0;
+        /*
+         * the first pass finds out if the tree can be compiled at all,
+         * the second one is only needed for common subexpressions
+         */
+        for (pass = 0; pass < 2; pass++) {
+                comp.c_ncode = 0;
+                comp.c_sp = comp.c_depth = 0;
+                comp.c_inif = 0;
+                if (!(ret = ec_node(&comp, eptr, &type)) || ret->ex_type ||
+                                                        comp.c_sp != 1)
+                        goto done;
+                if (pass || !(comp.c_nreg = ec_cse(&comp, eptr)))
+                        break;
+                if (!(comp.c_done = (char *)fts_calloc(comp.c_nreg, 1)) ||
+                    !(comp.c_rtype = (long *)
+                        fts_malloc(comp.c_nreg * sizeof (long))))
+                        goto done;
+        }
+        /* the last vector operation can write to the output directly */
+        last = comp.c_code + comp.c_ncode - 1;
+        if (comp.c_vector && type == ET_VEC && EC_WRITESVEC(last->c_op))
+                last->c_dst = -1;
+        if (!(prog = (t_ex_prog *)fts_malloc(sizeof (*prog))))
+                goto done;
+        prog->p_nreg = comp.c_nreg;
+        if (!(prog->p_stack = (struct ex_ex *)fts_malloc(
+                (comp.c_depth + comp.c_nreg) * sizeof (struct ex_ex)))) {
+                fts_free(prog);
+                prog = 0;
+                goto done;
+        }
+        prog->p_reg = prog->p_stack + comp.c_depth;
+        for (i = 0; i < prog->p_nreg; i++)
+                prog->p_reg[i].ex_type = 0;
+        prog->p_code = comp.c_code;
+        prog->p_ncode = comp.c_ncode;
+        prog->p_depth = comp.c_depth;
+        prog->p_vector = comp.c_vector;
+        prog->p_vec = 0;
+        prog->p_vsize = 0;
+        comp.c_code = 0;
+done:
+        if (comp.c_code)
+                fts_free(comp.c_code);
+        if (comp.c_reg)
+                fts_free(comp.c_reg);
+        if (comp.c_done)
+                fts_free(comp.c_done);
+        if (comp.c_rtype)
+                fts_free(comp.c_rtype);
+        return (prog);
+}
+
+/*
+ * ex_prog_setsize -- allocate the vector slots of an expr~ program,
+ *                    returns 0 if out of memory
+ */
+int
+ex_prog_setsize(t_ex_prog *prog, int vsize)
+{
+        if (!prog->p_vector || prog->p_vsize == vsize)
+                return (1);
+        if (prog->p_vec)
+                fts_free(prog->p_vec);
+        prog->p_vsize = 0;
+        if (!(prog->p_vec = (t_float *)fts_malloc(
+                (prog->p_nreg + prog->p_depth) * vsize * sizeof (t_float))))
+                return (0);
+        prog->p_vsize = vsize;
+        return (1);
+}
+
+/*
+ * ex_prog_findtables -- look up the tables the program reads, so that
+ *                       ex_run() need not find them on every access; this
+ *                       is done again whenever dsp is restarted, which Pd
+ *                       does when an array used in dsp is resized or deleted
+ */
+void
+ex_prog_findtables(struct expr *expr, t_ex_prog *prog)
+{
+#ifdef PD
+        struct ex_code *c, *end = prog->p_code + prog->p_ncode;
+
+        for (c = prog->p_code; c < end; c++)
+                if ((c->c_op == EC_TAB || c->c_op == EC_TABV) &&
+                    c->c_node->ex_type == ET_TBL && c->c_node->ex_ptr)
+                        c->c_tabvec = max_ex_tab_find(expr,
+                                (t_symbol *)c->c_node->ex_ptr, &c->c_tabsize);
+#endif
+}
+
+void
+ex_prog_free(t_ex_prog *prog)
+{
+        if (prog->p_vec)
+                fts_free(prog->p_vec);
+        fts_free(prog->p_stack);
+        fts_free(prog->p_code);
+        fts_free(prog);
+}
+
+/*
+ * ex_scalarop -- binary operator on scalars whose types were not known
+ *                when compiling
+ */
+static void
+ex_scalarop(struct expr *expr, long op, struct ex_ex *lp1, struct ex_ex *rp1)
+{
+        if (lp1->ex_type == ET_INT && rp1->ex_type == ET_INT) {
+                switch (op) {
+                EC_BINOPS(EC_CASE_II)
+                }
+                return;
+        }
+        if ((lp1->ex_type != ET_INT && lp1->ex_type != ET_FLT) ||
+            (rp1->ex_type != ET_INT && rp1->ex_type != ET_FLT)) {
+                post_error((fts_object_t *) expr,
+                        "expr: ex_run: bad operand types %ld %ld\n",
+                                                lp1->ex_type, rp1->ex_type);
+                lp1->ex_type = ET_INT;
+                lp1->ex_int = 0;
+                return;
+        }
+        if (lp1->ex_type == ET_INT) {
+                t_float f = lp1->ex_int;
+                lp1->ex_type = ET_FLT;
+                lp1->ex_flt = f;
+        }
+        if (rp1->ex_type == ET_INT) {
+                t_float f = rp1->ex_int;
+                rp1->ex_type = ET_FLT;
+                rp1->ex_flt = f;
+        }
+        switch (op) {
+        EC_BINOPS(EC_CASE_FF)
+        }
+}
+
+/*
+ * ex_scalarunop -- unary operator on an int or a float
+ */
+static void
+ex_scalarunop(struct expr *expr, long op, struct ex_ex *lp1)
+{
+        if (lp1->ex_type == ET_INT) {
+                switch (op) {
+                case OP_NOT: lp1->ex_int = !lp1->ex_int; break;
+                case OP_NEG: lp1->ex_int = ~lp1->ex_int; break;
+                case OP_UMINUS: lp1->ex_int = -lp1->ex_int; break;
+                }
+        } else if (lp1->ex_type == ET_FLT) {
+                switch (op) {
+                case OP_NOT: lp1->ex_flt = !lp1->ex_flt; break;
+                case OP_NEG: lp1->ex_flt = ~((long)lp1->ex_flt); break;
+                case OP_UMINUS: lp1->ex_flt = -lp1->ex_flt; break;
+                }
+        } else {
+                post_error((fts_object_t *) expr,
+                        "expr: ex_run: bad operand type %ld\n", lp1->ex_type);
+                lp1->ex_type = ET_INT;
+                lp1->ex_int = 0;
+        }
+}
+
+/*
+ * ex_scalarpow -- a scalar to the power k (2, 3, or 4) as ex_pow() does
+ */
+static void
+ex_scalarpow(struct expr *expr, int k, struct ex_ex *lp1)
+{
+        double d, p;
+
+        if (lp1->ex_type == ET_INT)
+                d = lp1->ex_int;
+        else if (lp1->ex_type == ET_FLT)
+                d = lp1->ex_flt;
+        else {
+                post_error((fts_object_t *) expr,
+                        "expr: ex_run: bad operand type %ld\n", lp1->ex_type);
+                d = 0;
+        }
+        p = d * d;
+        if (k == 3)
+                p *= d;
+        else if (k == 4)
+                p *= p;
+        lp1->ex_type = ET_FLT;
+        lp1->ex_flt = p;
+}
+
+#ifdef PD
+/*
+ * ex_tabindex -- the point of a table of size points at index f, which
+ *                max_ex_tab() truncates and clips in the same way
+ */
+static inline int
+ex_tabindex(t_float f, int size)
+{
+        int i;
+
+        /* clip before converting so that the conversion does not overflow */
+        if (!(f >= 0))
+                f = 0;
+        else if (f > size)
+                f = size;
+        i = f;
+        return (i < 0 ? 0 : i >= size ? size - 1 : i);
+}
+#endif
+
+/*
+ * ex_run -- run a compiled expression, the counterpart of ex_eval(); for
+ *           expr~ optr is the output vector, for fexpr~ idx is the sample
+ */
+void
+ex_run(struct expr *expr, t_ex_prog *prog, struct ex_ex *optr, int idx)
+{
+        struct ex_code *code = prog->p_code, *c, *end = code + prog->p_ncode;
+        struct ex_ex *sp = prog->p_stack - 1, *lp1, *rp1, res;
+        t_float *lp, *rp, *op, scalar;
+        int i, n = expr->exp_vsize;
+        t_ex_func *f;
+
+        for (c = code; c < end; c++) {
+                switch (c->c_op) {
+                case EC_CONST:
+                        *++sp = c->c_ex;
+                        break;
+                case EC_II:
+                        sp++;
+                        sp->ex_type = ET_INT;
+                        sp->ex_int = expr->exp_var[c->c_ex.ex_int].ex_int;
+                        break;
+                case EC_FI:
+                        sp++;
+                        sp->ex_type = ET_FLT;
+                        sp->ex_flt = expr->exp_var[c->c_ex.ex_int].ex_flt;
+                        break;
+                case EC_VI:
+                        sp++;
+                        sp->ex_type = ET_VEC;
+                        sp->ex_vec = expr->exp_var[c->c_ex.ex_int].ex_vec;
+                        break;
+                case EC_XI0:
+                        sp++;
+                        sp->ex_type = ET_FLT;
+                        sp->ex_flt = expr->exp_var[c->c_ex.ex_int].ex_vec[idx];
+                        break;
+                case EC_YOM1:
+                        sp++;
+                        sp->ex_type = ET_FLT;
+                        i = c->c_ex.ex_int;
+                        if (idx == 0)
+                                sp->ex_flt = expr->exp_p_res[i][n - 1];
+                        else
+                                sp->ex_flt = expr->exp_tmpres[i][idx - 1];
+                        break;
+                case EC_XK:
+                case EC_YK:
+                        sp++;
+                        sp->ex_type = ET_FLT;
+                        i = c->c_node->ex_int;
+                        if (c->c_op == EC_XK) {
+                                lp = expr->exp_var[i].ex_vec;
+                                rp = expr->exp_p_var[i];
+                        } else {
+                                lp = expr->exp_tmpres[i];
+                                rp = expr->exp_p_res[i];
+                        }
+                        if ((i = idx + c->c_ex.ex_int) >= 0)
+                                sp->ex_flt = lp[i];
+                        else if (i + n > 0)
+                                sp->ex_flt = rp[i + n];
+                        else {
+                                /* out of bounds, let it report */
+                                res = c->c_ex;
+                                ex_sigidx(expr, c->c_node, &res, sp, idx);
+                        }
+                        break;
+                case EC_REG:
+                        *++sp = prog->p_reg[c->c_ex.ex_int];
+                        break;
+                case EC_SAVE:
+                        prog->p_reg[c->c_ex.ex_int] = *sp;
+                        break;
+                case EC_POWS:
+                        ex_scalarpow(expr, c->c_ex.ex_int, sp);
+                        break;
+                case EC_POWV:
+                        op = EC_DST(c);
+                        lp = sp->ex_vec;
+                        if (c->c_ex.ex_int == 2)
+                                for (i = 0; i < n; i++)
+                                        op[i] = (double)lp[i] * lp[i];
+                        else if (c->c_ex.ex_int == 3)
+                                for (i = 0; i < n; i++)
+                                        op[i] = (double)lp[i] * lp[i] * lp[i];
+                        else
+                                for (i = 0; i < n; i++) {
+                                        double d = (double)lp[i] * lp[i];
+                                        op[i] = d * d;
+                                }
+                        sp->ex_vec = op;
+                        break;
+                case EC_SIGIDX:
+                        res = *sp;
+                        ex_sigidx(expr, c->c_node, &res, sp, idx);
+                        break;
+                case EC_TAB:
+#ifdef PD
+                        if (c->c_tabvec && (sp->ex_type == ET_INT ||
+                            sp->ex_type == ET_FLT)) {
+                                i = (sp->ex_type == ET_INT ?
+                                        (sp->ex_int < 0 ? 0 :
+                                        sp->ex_int >= c->c_tabsize ?
+                                        c->c_tabsize - 1 : sp->ex_int) :
+                                        ex_tabindex(sp->ex_flt, c->c_tabsize));
+                                sp->ex_type = ET_FLT;
+                                sp->ex_flt = c->c_tabvec[i].w_float;
+                                break;
+                        }
+#endif
+                        res = *sp;
+                        ex_tab(expr, c->c_node, &res, sp);
+                        break;
+                case EC_TABV:
+                        op = EC_DST(c);
+                        lp = sp->ex_vec;
+#ifdef PD
+                        /* the table may have been made after dsp started */
+                        if (!c->c_tabvec && c->c_node->ex_ptr)
+                                c->c_tabvec = max_ex_tab_find(expr,
+                                        (t_symbol *)c->c_node->ex_ptr,
+                                                        &c->c_tabsize);
+                        if (c->c_tabvec) {
+                                t_word *vec = c->c_tabvec;
+                                int size = c->c_tabsize;
+
+                                for (i = 0; i < n; i++)
+                                        op[i] = vec[ex_tabindex(lp[i],
+                                                                size)].w_float;
+                                sp->ex_vec = op;
+                                break;
+                        }
+#endif
+                        /* no such table, let it report */
+                        res.ex_type = ET_FLT;
+                        res.ex_flt = lp[0];
+                        ex_tab(expr, c->c_node, &res, &res);
+                        ex_mkvector(op, res.ex_flt, n);
+                        sp->ex_vec = op;
+                        break;
+                case EC_VAR:
+                        sp++;
+                        sp->ex_type = 0;
+                        sp->ex_int = 0;
+                        eval_var(expr, c->c_node, sp, idx);
+                        break;
+                case EC_FUNC:
+                case EC_VFUNC:
+                        f = (t_ex_func *)c->c_node->ex_ptr;
+                        sp -= f->f_argc - 1;
+                        if (c->c_op == EC_VFUNC) {
+                                res.ex_type = ET_VEC;
+                                res.ex_vec = EC_DST(c);
+                        } else {
+                                res.ex_type = 0;
+                                res.ex_int = 0;
+                        }
+                        (*f->f_func)(expr, f->f_argc, sp, &res);
+                        *sp = res;
+                        break;
+                case EC_TOFLT:
+                        lp1 = sp - c->c_ex.ex_int;
+                        if (lp1->ex_type == ET_INT) {
+                                scalar = lp1->ex_int;
+                                lp1->ex_type = ET_FLT;
+                                lp1->ex_flt = scalar;
+                        } else if (lp1->ex_type != ET_FLT) {
+                                post_error((fts_object_t *) expr,
+                                        "expr: ex_run: bad operand type %ld\n",
+                                                                lp1->ex_type);
+                                lp1->ex_type = ET_FLT;
+                                lp1->ex_flt = 0;
+                        }
+                        break;
+                case EC_JZ:
+                        sp--;
+                        if (sp[1].ex_type == ET_INT ? !sp[1].ex_int :
+                            sp[1].ex_type == ET_FLT ? !sp[1].ex_flt : 1) {
+                                c = code + c->c_ex.ex_int - 1;
+                        }
+                        break;
+                case EC_JMP:
+                        c = code + c->c_ex.ex_int - 1;
+                        break;
+                case EC_US:
+                        ex_scalarunop(expr, c->c_ex.ex_op, sp);
+                        break;
+                case EC_UV:
+                        op = EC_DST(c);
+                        lp = sp->ex_vec;
+                        switch (c->c_ex.ex_op) {
+                        case OP_NOT:
+                                for (i = 0; i < n; i++)
+                                        op[i] = !(lp[i]);
+                                break;
+                        case OP_NEG:
+                                for (i = 0; i < n; i++)
+                                        op[i] = ~((long)lp[i]);
+                                break;
+                        case OP_UMINUS:
+                                for (i = 0; i < n; i++)
+                                        op[i] = -(lp[i]);
+                                break;
+                        }
+                        sp->ex_vec = op;
+                        break;
+                case EC_BII:
+                        rp1 = sp--;
+                        lp1 = sp;
+                        switch (c->c_ex.ex_op) {
+                        EC_BINOPS(EC_CASE_II)
+                        }
+                        break;
+                case EC_BFF:
+                        rp1 = sp--;
+                        lp1 = sp;
+                        switch (c->c_ex.ex_op) {
+                        EC_BINOPS(EC_CASE_FF)
+                        }
+                        break;
+                case EC_BDD:
+                        sp--;
+                        ex_scalarop(expr, c->c_ex.ex_op, sp, sp + 1);
+                        break;
+                case EC_BVV:
+                        sp--;
+                        op = EC_DST(c);
+                        lp = sp->ex_vec;
+                        rp = sp[1].ex_vec;
+                        switch (c->c_ex.ex_op) {
+                        EC_BINOPS(EC_CASE_VV)
+                        }
+                        sp->ex_vec = op;
+                        break;
+                case EC_BVS:
+                        sp--;
+                        op = EC_DST(c);
+                        lp = sp->ex_vec;
+                        scalar = sp[1].ex_flt;
+                        switch (c->c_ex.ex_op) {
+                        EC_BINOPS(EC_CASE_VS)
+                        }
+                        sp->ex_vec = op;
+                        break;
+                case EC_BSV:
+                        sp--;
+                        op = EC_DST(c);
+                        scalar = sp->ex_flt;
+                        rp = sp[1].ex_vec;
+                        switch (c->c_ex.ex_op) {
+                        EC_BINOPS(EC_CASE_SV)
+                        }
+                        sp->ex_type = ET_VEC;
+                        sp->ex_vec = op;
+                        break;
+                }
+        }
+        if (!prog->p_vector) {
+                *optr = *sp;
+                return;
+        }
+        switch (sp->ex_type) {
+        case ET_VEC:
+                if (sp->ex_vec != optr->ex_vec)
+                        memcpy(optr->ex_vec, sp->ex_vec, n * sizeof (t_float));
+                break;
+        case ET_INT:
+                ex_mkvector(optr->ex_vec, (t_float)sp->ex_int, n);
+                break;
+        case ET_FLT:
+                ex_mkvector(optr->ex_vec, sp->ex_flt, n);
+                break;
+        default:
+                post_error((fts_object_t *) expr,
+                        "expr: ex_run: bad result type %ld\n", sp->ex_type);
+        }
+}
+
 /*
  * getoken -- return 1 on syntax error otherwise 0
  */
@@ -185,6 +185,46 @@ struct ex_ex {
 #define EE_NOTABLE      0x08    /* NO TABLE */
 #define EE_NOVAR        0x10    /* NO VARIABLE */
 
+/*
+ * a compiled expression (see ex_compile() in x_vexp.c): the prefix tree
+ * is flattened into a postfix program that ex_run() executes on a stack
+ * without recursing; for expr~ the vectors are kept in p_vec so that no
+ * memory is allocated while running
+ */
+struct ex_code {
+        int c_op;                       /* EC_* instruction */
+        int c_dst;                      /* vector slot of result, -1 output */
+        struct ex_ex c_ex;              /* constant, inlet, operator, or jump */
+        struct ex_ex *c_node;           /* the tree node for calls and lookups */
+#ifdef PD
+        t_word *c_tabvec;               /* the table, found at dsp time */
+        int c_tabsize;                  /* number of points in it */
+#endif
+};
+
+typedef struct ex_prog {
+        struct ex_code *p_code;         /* the instructions */
+        int p_ncode;                    /* number of instructions */
+        int p_depth;                    /* maximum depth of the stack */
+        int p_vector;                   /* values may be vectors (expr~) */
+        struct ex_ex *p_stack;          /* the stack */
+        struct ex_ex *p_reg;            /* common subexpressions */
+        int p_nreg;                     /* number of registers */
+        t_float *p_vec;                 /* p_nreg + p_depth vectors */
+        int p_vsize;                    /* current size of the vectors */
+} t_ex_prog;
+
+#ifdef PD
+        /* variables we've looked up, hashed by name, valid as long as
+        value_changes doesn't change */
+#define EX_VARCACHE 8
+typedef struct ex_varcache {
+        t_symbol *v_sym;
+        t_float *v_f;
+        int v_changes;
+} t_ex_varcache;
+#endif
+
 typedef struct expr {
 #ifdef PD
         t_object exp_ob;
@@ -199,11 +239,13 @@ typedef struct expr {
         t_outlet *exp_outlet[MAX_VARS];
 #ifdef PD
         struct _exprproxy *exp_proxy;
+        t_ex_varcache exp_varcache[EX_VARCACHE];
 #else /* MAX */
         void *exp_proxy[MAX_VARS];
         long exp_proxy_id;
 #endif
         struct ex_ex *exp_stack[MAX_VARS];
+        t_ex_prog *exp_prog[MAX_VARS];  /* compiled exp_stack, or 0 */
         struct ex_ex exp_var[MAX_VARS];
         struct ex_ex exp_res[MAX_VARS]; /* the evluation result */
         t_float *exp_p_var[MAX_VARS];
@@ -229,12 +271,21 @@ max_ex_tab_store(struct expr *expr, t_symbol *s, struct ex_ex *arg,
 extern int
 max_ex_tab(struct expr *expr, t_symbol *s, struct ex_ex *arg,
                                                                                                                 struct ex_ex *optr);
+#ifdef PD
+extern t_word *max_ex_tab_find(struct expr *expr, t_symbol *s, int *size);
+#endif
 extern int max_ex_var(struct expr *expr, t_symbol *s, struct ex_ex *optr,
                                                                                                                                         int idx);
 extern int max_ex_var_store(struct expr *, t_symbol *, struct ex_ex *, struct ex_ex *);
 extern int ex_getsym(char *p, t_symbol **s);
 extern const char *ex_symname(t_symbol *s);
 void ex_mkvector(t_float *fp, t_float x, int size);
+extern t_ex_prog *ex_compile(struct expr *expr, struct ex_ex *eptr);
+extern int ex_prog_setsize(t_ex_prog *prog, int vsize);
+extern void ex_prog_free(t_ex_prog *prog);
+extern void ex_prog_findtables(struct expr *expr, t_ex_prog *prog);
+extern void ex_run(struct expr *expr, t_ex_prog *prog, struct ex_ex *optr,
+                                                                int idx);
 extern void ex_size(t_expr *expr, long int argc, struct ex_ex *argv,
                                                         struct ex_ex *optr);
 extern void ex_sum(t_expr *expr, long int argc, struct ex_ex *argv,                                                                     struct ex_ex *optr);
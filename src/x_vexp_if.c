@@ -23,6 +23,9 @@
 #include <stdlib.h>
 
 #include "x_vexp.h"
+#ifdef PD
+#include "m_imp.h"
+#endif
 
 static char *exp_version = "0.55";
 
@@ -146,9 +149,12 @@ expr_ff(t_expr *x)
 #endif
                 y = x->exp_proxy;
         }
-        for (i = 0 ; i < x->exp_nexpr; i++)
+        for (i = 0 ; i < x->exp_nexpr; i++) {
                 if (x->exp_stack[i])
                         fts_free(x->exp_stack[i]);
+                if (x->exp_prog[i])
+                        ex_prog_free(x->exp_prog[i]);
+        }
 /*
  * SDY free all the allocated buffers here for expr~ and fexpr~
  * check to see if there are others
@@ -199,7 +205,9 @@ expr_bang(t_expr *x)
                 return;
 
         for (i = x->exp_nexpr - 1; i > -1 ; i--) {
-                if (!ex_eval(x, x->exp_stack[i], &x->exp_res[i], 0)) {
+                if (x->exp_prog[i])
+                        ex_run(x, x->exp_prog[i], &x->exp_res[i], 0);
+                else if (!ex_eval(x, x->exp_stack[i], &x->exp_res[i], 0)) {
                         /*fprintf(stderr,"expr_bang(error evaluation)\n"); */
                 /*  SDY now that we have multiple ones, on error we should
                  * continue
@@ -284,6 +292,7 @@ Nexpr_new(t_symbol *s, int ac, t_atom *av)
         x->exp_error = 0;
         for (i = 0; i < MAX_VARS; i++) {
                 x->exp_stack[i] = (struct ex_ex *)0;
+                x->exp_prog[i] = (t_ex_prog *)0;
                 x->exp_outlet[i] = (t_outlet *)0;
                 x->exp_res[i].ex_type = 0;
                 x->exp_res[i].ex_int = 0;
@@ -307,6 +316,12 @@ SDY the following coredumps why?
                 return (0);
         }
 
+        /*
+         * run compiled expressions where they can be compiled
+         */
+        for (i = 0; i < x->exp_nexpr; i++)
+                x->exp_prog[i] = ex_compile(x, x->exp_stack[i]);
+
         ninlet = 1;
         for (i = 0, eptr = x->exp_var; i < MAX_VARS ; i++, eptr++)
                 if (eptr->ex_type) {
@@ -421,13 +436,19 @@ expr_perform(t_int *w)
                  * the data because, outputs could be the same buffer as
                  * inputs
                  */
-                if ( x->exp_nexpr == 1)
-                        ex_eval(x, x->exp_stack[0], &x->exp_res[0], 0);
-                else {
+                if ( x->exp_nexpr == 1) {
+                        if (x->exp_prog[0])
+                                ex_run(x, x->exp_prog[0], &x->exp_res[0], 0);
+                        else
+                                ex_eval(x, x->exp_stack[0], &x->exp_res[0], 0);
+                } else {
                         res.ex_type = ET_VEC;
                         for (i = 0; i < x->exp_nexpr; i++) {
                                 res.ex_vec = x->exp_tmpres[i];
-                                ex_eval(x, x->exp_stack[i], &res, 0);
+                                if (x->exp_prog[i])
+                                        ex_run(x, x->exp_prog[i], &res, 0);
+                                else
+                                        ex_eval(x, x->exp_stack[i], &res, 0);
                         }
                         n = x->exp_vsize * sizeof(t_float);
                         for (i = 0; i < x->exp_nexpr; i++)
@@ -449,7 +470,10 @@ expr_perform(t_int *w)
         for (i = 0; i < x->exp_vsize; i++) for (j = 0; j < x->exp_nexpr; j++) {
                 res.ex_type = 0;
                 res.ex_int = 0;
-                ex_eval(x, x->exp_stack[j], &res, i);
+                if (x->exp_prog[j])
+                        ex_run(x, x->exp_prog[j], &res, i);
+                else
+                        ex_eval(x, x->exp_stack[j], &res, i);
                 switch (res.ex_type) {
                 case ET_INT:
                         x->exp_tmpres[j][i] = (t_float) res.ex_int;
@@ -486,6 +510,14 @@ expr_dsp(t_expr *x, t_signal **sp)
         x->exp_error = 0;               /* reset all errors */
         newsize = (x->exp_vsize !=  sp[0]->s_n);
         x->exp_vsize = sp[0]->s_n;      /* record the vector size */
+        for (i = 0; i < x->exp_nexpr; i++)
+                if (x->exp_prog[i] &&
+                    !ex_prog_setsize(x->exp_prog[i], x->exp_vsize)) {
+                        /* out of memory, go back to the tree */
+                        ex_prog_free(x->exp_prog[i]);
+                        x->exp_prog[i] = 0;
+                } else if (x->exp_prog[i])
+                        ex_prog_findtables(x, x->exp_prog[i]);
         for (i = 0; i < x->exp_nexpr; i++) {
                 x->exp_res[i].ex_type = ET_VEC;
                 x->exp_res[i].ex_vec =  sp[x->exp_nivec + i]->s_vec;
@@ -933,6 +965,27 @@ max_ex_tab(struct expr *expr, fts_symbol_t s, struct ex_ex *arg,
         return (0);
 }
 
+#ifdef PD
+/*
+ * max_ex_tab_find -- find the table s for a compiled expression and mark
+ *                    it as used in dsp, returns 0 if there is no such table
+ */
+t_word *
+max_ex_tab_find(struct expr *expr, fts_symbol_t s, int *size)
+{
+        t_garray *garray;
+        t_word *wvec;
+
+        if (!(garray = (t_garray *)pd_findbyclass(s, garray_class)) ||
+            !garray_getfloatwords(garray, size, &wvec)) {
+                *size = 0;
+                return (0);
+        }
+        garray_usedindsp(garray);
+        return (wvec);
+}
+#endif
+
 /*
  * max_ex_tab_store -- store a value in a table
  *                                              tbl[arg->value] = rval.value
@@ -1015,20 +1068,45 @@ max_ex_tab_store(struct expr *expr, t_symbol *s, struct ex_ex *arg,
         return (0);
 }
 
+/*
+ * ex_findvar -- find a "value" variable, looking it up by name (which can
+ *               mean walking everything bound to the symbol) only the
+ *               first time or after some variable has gone away
+ */
+static t_float *
+ex_findvar(struct expr *expr, t_symbol *var)
+{
+        t_ex_varcache *c =
+                &expr->exp_varcache[((size_t)var >> 4) & (EX_VARCACHE - 1)];
+
+        if (c->v_sym != var || c->v_changes != value_changes) {
+                if (!(c->v_f = value_find(var))) {
+                        c->v_sym = 0;
+                        return (0);
+                }
+                c->v_sym = var;
+                c->v_changes = value_changes;
+        }
+        return (c->v_f);
+}
+
 int
 max_ex_var(struct expr *expr, t_symbol *var, struct ex_ex *optr, int idx)
 {
+        t_float *fp;
+
         optr->ex_type = ET_FLT;
                 if (!strcmp(var->s_name, "sys_idx")) {
                         optr->ex_flt = idx;
                         return (0);
                 }
-        if (value_getfloat(var, &(optr->ex_flt))) {
+        if (!(fp = ex_findvar(expr, var))) {
                 optr->ex_type = ET_FLT;
                 optr->ex_flt = 0;
                 pd_error(expr, "no such var '%s'", var->s_name);
                 return (1);
         }
+        optr->ex_flt = *fp;
         return (0);
 }
 
@@ -1277,7 +1355,7 @@ ex_Avg(t_expr *e, long int argc, struct ex_ex *argv, struct ex_ex *optr)
 int
 max_ex_var_store(struct expr *expr, t_symbol * var, struct ex_ex *eptr, struct ex_ex *optr)
 {
-                t_float value = 0.;
+                t_float value = 0., *fp;
 
                 *optr = *eptr;
                 switch (eptr->ex_type) {
@@ -1291,11 +1369,12 @@ max_ex_var_store(struct expr *expr, t_symbol * var, struct ex_ex *eptr, struct e
                         post("do not know yet\n");
                 }
 
-        if (value_setfloat(var, value)) {
+        if (!(fp = ex_findvar(expr, var))) {
                 optr->ex_flt = 0;
                 pd_error(expr, "no such var '%s'", var->s_name);
                 return (1);
         }
+        *fp = value;
         return (0);
 }
 
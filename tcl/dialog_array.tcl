@@ -15,6 +15,8 @@ array set pd_array_listview_page {}
 set pd_array_listview_pagesize 0
 # this stores the state of the "save me" check button
 array set saveme_button {}
+# this stores the state of the "save as binary file" check button
+array set savebinary_button {}
 # this stores the state of the "draw as" radio buttons
 array set drawas_button {}
 # this stores the state of the "in new graph"/"in last graph" radio buttons
@@ -214,7 +216,7 @@ proc ::dialog_array::apply {mytoplevel} {
     pdsend "$mytoplevel arraydialog \
             [::dialog_gatom::escape [$mytoplevel.array.name.entry get]] \
             [$mytoplevel.array.size.entry get] \
-            [expr $::saveme_button($mytoplevel) + (2 * $::drawas_button($mytoplevel))] \
+            [expr $::saveme_button($mytoplevel) + (2 * $::drawas_button($mytoplevel)) + (16 * $::savebinary_button($mytoplevel))] \
             $::otherflag_button($mytoplevel)"
 }
 
@@ -244,6 +246,7 @@ proc ::dialog_array::pdtk_array_dialog {mytoplevel name size flags newone} {
     $mytoplevel.array.size.entry insert 0 $size
     set ::saveme_button($mytoplevel) [expr $flags & 1]
     set ::drawas_button($mytoplevel) [expr ( $flags & 6 ) >> 1]
+    set ::savebinary_button($mytoplevel) [expr ( $flags & 16 ) >> 4]
     set ::otherflag_button($mytoplevel) 0
 # pd -> tcl
 #  2 * (int)(template_getfloat(template_findbyname(sc->sc_template), gensym("style"), x->x_scalar->sc_vec, 1)));
@@ -280,6 +283,9 @@ proc ::dialog_array::create_dialog {mytoplevel newone} {
     checkbutton $mytoplevel.array.saveme -text [_ "Save contents"] \
         -variable ::saveme_button($mytoplevel) -anchor w
     pack $mytoplevel.array.saveme -side top
+    checkbutton $mytoplevel.array.savebinary -text [_ "Save as binary file"] \
+        -variable ::savebinary_button($mytoplevel) -anchor w
+    pack $mytoplevel.array.savebinary -side top
 
     # draw as
     labelframe $mytoplevel.drawas -text [_ "Draw as:"] -padx 20 -borderwidth 1
@@ -338,6 +344,7 @@ proc ::dialog_array::create_dialog {mytoplevel newone} {
 
             # call apply on button changes
             $mytoplevel.array.saveme config -command [ concat ::dialog_array::apply $mytoplevel ]
+            $mytoplevel.array.savebinary config -command [ concat ::dialog_array::apply $mytoplevel ]
             $mytoplevel.drawas.points config -command [ concat ::dialog_array::apply $mytoplevel ]
             $mytoplevel.drawas.polygon config -command [ concat ::dialog_array::apply $mytoplevel ]
             $mytoplevel.drawas.bezier config -command [ concat ::dialog_array::apply $mytoplevel ]
@@ -78,6 +78,7 @@ namespace import ::pdwindow::pdtk_pd_meters
 namespace import ::pdtk_canvas::pdtk_canvas_popup
 namespace import ::pdtk_canvas::pdtk_canvas_editmode
 namespace import ::pdtk_canvas::pdtk_canvas_getscroll
+namespace import ::pdtk_canvas::pdtk_canvas_culled
 namespace import ::pdtk_canvas::pdtk_canvas_setparents
 namespace import ::pdtk_canvas::pdtk_canvas_reflecttitle
 namespace import ::pdtk_canvas::pdtk_canvas_menuclose
@@ -566,6 +567,8 @@ proc pdtk_pd_startup {major minor bugfix test
     ::pd_guiprefs::init
     pdsend "pd init [enquote_path [pwd]] $oldtclversion \
         $::font_measured $::font_zoom2_measured"
+    # from Tcl 8.6 on we can decode coordinates sent in binary (pdtk_coords)
+    if {![catch {binary decode base64 ""}]} {pdsend "pd guicoords 1"}
     ::pd_bindings::class_bindings
     ::pd_bindings::global_bindings
     ::pd_menus::create_menubar
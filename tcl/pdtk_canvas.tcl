@@ -7,6 +7,7 @@ namespace eval ::pdtk_canvas:: {
     namespace export pdtk_canvas_popup
     namespace export pdtk_canvas_editmode
     namespace export pdtk_canvas_getscroll
+    namespace export pdtk_canvas_culled
     namespace export pdtk_canvas_setparents
     namespace export pdtk_canvas_reflecttitle
     namespace export pdtk_canvas_menuclose
@@ -116,8 +117,8 @@ proc pdtk_canvas_new {mytoplevel width height geometry editable} {
     set tkcanvas [tkcanvas_name $mytoplevel]
     canvas $tkcanvas -width $width -height $height \
         -highlightthickness 0 -scrollregion [list 0 0 $width $height] \
-        -xscrollcommand "$mytoplevel.xscroll set" \
-        -yscrollcommand "$mytoplevel.yscroll set"
+        -xscrollcommand "::pdtk_canvas::scrolled $tkcanvas x" \
+        -yscrollcommand "::pdtk_canvas::scrolled $tkcanvas y"
     scrollbar $mytoplevel.xscroll -orient horizontal -command "$tkcanvas xview"
     scrollbar $mytoplevel.yscroll -orient vertical -command "$tkcanvas yview"
     pack $tkcanvas -side left -expand 1 -fill both
@@ -349,6 +350,20 @@ proc ::pdtk_canvas::pdtk_canvas_getscroll {tkcanvas} {
     set width [winfo width $tkcanvas]
 
     set bbox [$tkcanvas bbox all]
+    # include what Pd hasn't drawn yet
+    if {[info exists ::pdtk_canvas::culled($tkcanvas)] && \
+            [llength $::pdtk_canvas::culled($tkcanvas)] == 4} {
+        set culled $::pdtk_canvas::culled($tkcanvas)
+        if {[llength $bbox] != 4} {
+            set bbox $culled
+        } else {
+            set bbox [list \
+                [expr {min([lindex $bbox 0], [lindex $culled 0])}] \
+                [expr {min([lindex $bbox 1], [lindex $culled 1])}] \
+                [expr {max([lindex $bbox 2], [lindex $culled 2])}] \
+                [expr {max([lindex $bbox 3], [lindex $culled 3])}]]
+        }
+    }
     if {$bbox eq "" || [llength $bbox] != 4} {return}
     set xupperleft [lindex $bbox 0]
     set yupperleft [lindex $bbox 1]
@@ -378,6 +393,46 @@ proc ::pdtk_canvas::pdtk_canvas_getscroll {tkcanvas} {
     }
 }
 
+# Pd only draws the objects in or near the window, and draws the rest as
+# they're scrolled into view.  It tells us the bounds of what it hasn't
+# drawn (or nothing, once everything is) so that we can scroll there.
+proc ::pdtk_canvas::pdtk_canvas_culled {tkcanvas args} {
+    set ::pdtk_canvas::culled($tkcanvas) $args
+    unset -nocomplain ::pdtk_canvas::lastview($tkcanvas)
+    pdtk_canvas_getscroll $tkcanvas
+}
+
+# the canvas's view changed: update the scrollbar and, once things settle,
+# tell Pd what part of the canvas is in view
+proc ::pdtk_canvas::scrolled {tkcanvas axis first last} {
+    set mytoplevel [winfo toplevel $tkcanvas]
+    if {[winfo exists $mytoplevel.${axis}scroll]} {
+        $mytoplevel.${axis}scroll set $first $last
+    }
+    if {![info exists ::pdtk_canvas::viewpending($tkcanvas)]} {
+        set ::pdtk_canvas::viewpending($tkcanvas) 1
+        after idle [list ::pdtk_canvas::sendview $tkcanvas]
+    }
+}
+
+proc ::pdtk_canvas::sendview {tkcanvas} {
+    unset -nocomplain ::pdtk_canvas::viewpending($tkcanvas)
+    if {! [winfo exists $tkcanvas]} {
+        return
+    }
+    set view [list \
+        [expr {int([$tkcanvas canvasx 0])}] \
+        [expr {int([$tkcanvas canvasy 0])}] \
+        [expr {int([$tkcanvas canvasx [winfo width $tkcanvas]])}] \
+        [expr {int([$tkcanvas canvasy [winfo height $tkcanvas]])}]]
+    if {[info exists ::pdtk_canvas::lastview($tkcanvas)] && \
+            $::pdtk_canvas::lastview($tkcanvas) eq $view} {
+        return
+    }
+    set ::pdtk_canvas::lastview($tkcanvas) $view
+    pdsend "[winfo toplevel $tkcanvas] view $view"
+}
+
 proc ::pdtk_canvas::scroll {tkcanvas axis amount} {
     if {$axis eq "x" && $::xscrollable($tkcanvas) == 1} {
         $tkcanvas xview scroll [expr {- ($amount)}] units
@@ -427,3 +482,21 @@ proc ::pdtk_canvas::pdtk_canvas_reflecttitle {mytoplevel \
         wm title $mytoplevel "$name$dirtychar$arguments - $path"
     }
 }
+
+#------------------------------------------------------------------------------#
+# binary coordinates
+
+# Pd sends long coordinate lists as base64-encoded little-endian integers
+# once we've told it we can decode them ("pd guicoords 1", see s_inter.c).
+# 'format' is 's' for 16 bit or 'i' for 32 bit.
+proc pdtk_coords {format data} {
+    binary scan [binary decode base64 $data] ${format}* coords
+    return $coords
+}
+
+# draw one rectangle for each four coordinates, for plots in "points" style
+proc pdtk_rectangles {tkcanvas coords args} {
+    foreach {x1 y1 x2 y2} $coords {
+        $tkcanvas create rectangle $x1 $y1 $x2 $y2 {*}$args
+    }
+}